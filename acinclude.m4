@@ -46,6 +46,19 @@ AC_DEFUN([AC_PROG_CC_UBSAN], [
 	])
 ])
 
+AC_DEFUN([AC_PROG_CC_PGO], [
+	AC_CACHE_CHECK([whether ${CC-cc} accepts -fprofile-partial-training], ac_cv_prog_cc_pgo, [
+		echo 'void f(){}' > conftest.c
+		if test -z "`${CC-cc} -fprofile-generate -c conftest.c 2>&1`" &&
+			test -z "`${CC-cc} -fprofile-use -fprofile-partial-training -Wno-missing-profile -c conftest.c 2>&1`"; then
+			ac_cv_prog_cc_pgo=yes
+		else
+			ac_cv_prog_cc_pgo=no
+		fi
+		rm -rf conftest*
+	])
+])
+
 AC_DEFUN([COMPILER_FLAGS], [
 	if (test "${CFLAGS}" = ""); then
 		CFLAGS="-Wall -fsigned-char -fno-exceptions"
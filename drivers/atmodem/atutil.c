@@ -13,20 +13,35 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <gattty.h>
+#include <gdbus.h>
+#include <ell/ell.h>
 
 #define OFONO_API_SUBJECT_TO_CHANGE
 #include <ofono/log.h>
 #include <ofono/types.h>
 #include <ofono/modem.h>
+#include <ofono/dbus.h>
+#include <ofono/storage.h>
 
 #include "atutil.h"
 #include "vendor.h"
 
 static const char *cpin_prefix[] = { "+CPIN:", NULL };
 
+struct at_util_chat_stats {
+	struct ofono_modem *modem;
+	GSList *channels;
+};
+
+struct chat_stats_channel {
+	char *name;
+	GAtChat *chat;
+};
+
 struct at_util_sim_state_query {
 	GAtChat *chat;
 	guint cpin_poll_source;
@@ -764,7 +779,7 @@ GAtChat *at_util_open_device(struct ofono_modem *modem, const char *key,
 		return NULL;
 
 	syntax = g_at_syntax_new_gsm_permissive();
-	chat = g_at_chat_new(channel, syntax);
+	chat = g_at_chat_new_fd(channel, syntax);
 	g_at_syntax_unref(syntax);
 	g_io_channel_unref(channel);
 
@@ -776,3 +791,297 @@ GAtChat *at_util_open_device(struct ofono_modem *modem, const char *key,
 
 	return chat;
 }
+
+static void chat_stats_append_latency(DBusMessageIter *dict, const char *key,
+					const GAtChatLatency *latency)
+{
+	DBusMessageIter entry, variant, array;
+	const guint *buckets = latency->buckets;
+	char *max_key;
+	dbus_uint64_t max;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+						"au", &variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY,
+						"u", &array);
+	dbus_message_iter_append_fixed_array(&array, DBUS_TYPE_UINT32,
+						&buckets,
+						G_AT_CHAT_LATENCY_BUCKETS);
+	dbus_message_iter_close_container(&variant, &array);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+
+	max_key = g_strconcat(key, "Max", NULL);
+	max = latency->max_usec;
+	ofono_dbus_dict_append(dict, max_key, DBUS_TYPE_UINT64, &max);
+	g_free(max_key);
+}
+
+static void chat_stats_append_command(const char *command,
+					const GAtChatCommandStats *stats,
+					gpointer user_data)
+{
+	DBusMessageIter *commands = user_data;
+	DBusMessageIter entry, dict;
+	dbus_uint32_t value;
+
+	dbus_message_iter_open_container(commands, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &command);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = stats->completed;
+	ofono_dbus_dict_append(&dict, "Completed", DBUS_TYPE_UINT32, &value);
+
+	value = stats->cancelled;
+	ofono_dbus_dict_append(&dict, "Cancelled", DBUS_TYPE_UINT32, &value);
+
+	value = stats->retries;
+	ofono_dbus_dict_append(&dict, "Retries", DBUS_TYPE_UINT32, &value);
+
+	chat_stats_append_latency(&dict, "QueueWait", &stats->queue_wait);
+	chat_stats_append_latency(&dict, "WireTime", &stats->wire_time);
+	chat_stats_append_latency(&dict, "ParseTime", &stats->parse_time);
+
+	dbus_message_iter_close_container(&entry, &dict);
+	dbus_message_iter_close_container(commands, &entry);
+}
+
+static DBusMessage *chat_stats_get(DBusConnection *conn, DBusMessage *msg,
+					void *user_data)
+{
+	struct at_util_chat_stats *stats = user_data;
+	DBusMessage *reply;
+	DBusMessageIter iter, channels;
+	GSList *l;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+						"{sa{sa{sv}}}", &channels);
+
+	for (l = stats->channels; l; l = l->next) {
+		struct chat_stats_channel *channel = l->data;
+		DBusMessageIter entry, commands;
+
+		dbus_message_iter_open_container(&channels,
+						DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						&channel->name);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+						"{sa{sv}}", &commands);
+
+		g_at_chat_foreach_stats(channel->chat,
+					chat_stats_append_command, &commands);
+
+		dbus_message_iter_close_container(&entry, &commands);
+		dbus_message_iter_close_container(&channels, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &channels);
+
+	return reply;
+}
+
+static DBusMessage *chat_stats_enable(struct at_util_chat_stats *stats,
+					DBusMessage *msg, gboolean enable)
+{
+	GSList *l;
+
+	for (l = stats->channels; l; l = l->next) {
+		struct chat_stats_channel *channel = l->data;
+
+		g_at_chat_set_stats(channel->chat, enable);
+	}
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *chat_stats_start(DBusConnection *conn, DBusMessage *msg,
+					void *user_data)
+{
+	return chat_stats_enable(user_data, msg, TRUE);
+}
+
+static DBusMessage *chat_stats_stop(DBusConnection *conn, DBusMessage *msg,
+					void *user_data)
+{
+	return chat_stats_enable(user_data, msg, FALSE);
+}
+
+static DBusMessage *chat_stats_reset(DBusConnection *conn, DBusMessage *msg,
+					void *user_data)
+{
+	struct at_util_chat_stats *stats = user_data;
+	GSList *l;
+
+	for (l = stats->channels; l; l = l->next) {
+		struct chat_stats_channel *channel = l->data;
+
+		g_at_chat_reset_stats(channel->chat);
+	}
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable chat_stats_methods[] = {
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sa{sa{sv}}}" }),
+			chat_stats_get) },
+	{ GDBUS_METHOD("StartStatistics", NULL, NULL, chat_stats_start) },
+	{ GDBUS_METHOD("StopStatistics", NULL, NULL, chat_stats_stop) },
+	{ GDBUS_METHOD("ResetStatistics", NULL, NULL, chat_stats_reset) },
+	{ }
+};
+
+static void chat_stats_channel_free(gpointer data)
+{
+	struct chat_stats_channel *channel = data;
+
+	g_free(channel->name);
+	g_free(channel);
+}
+
+static void chat_stats_destroy(gpointer user_data)
+{
+	struct at_util_chat_stats *stats = user_data;
+
+	g_slist_free_full(stats->channels, chat_stats_channel_free);
+	g_free(stats);
+}
+
+struct at_util_chat_stats *at_util_chat_stats_new(struct ofono_modem *modem)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = ofono_modem_get_path(modem);
+	struct at_util_chat_stats *stats;
+
+	stats = g_new0(struct at_util_chat_stats, 1);
+	stats->modem = modem;
+
+	if (!g_dbus_register_interface(conn, path, OFONO_AT_DEBUG_INTERFACE,
+					chat_stats_methods, NULL, NULL,
+					stats, chat_stats_destroy)) {
+		ofono_error("Could not register %s interface under %s",
+				OFONO_AT_DEBUG_INTERFACE, path);
+		g_free(stats);
+		return NULL;
+	}
+
+	ofono_modem_add_interface(modem, OFONO_AT_DEBUG_INTERFACE);
+
+	return stats;
+}
+
+void at_util_chat_stats_add(struct at_util_chat_stats *stats,
+				const char *name, GAtChat *chat)
+{
+	struct chat_stats_channel *channel;
+
+	if (stats == NULL || chat == NULL)
+		return;
+
+	channel = g_new0(struct chat_stats_channel, 1);
+	channel->name = g_strdup(name);
+	channel->chat = chat;
+
+	stats->channels = g_slist_append(stats->channels, channel);
+}
+
+void at_util_chat_stats_free(struct at_util_chat_stats *stats)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct ofono_modem *modem;
+
+	if (stats == NULL)
+		return;
+
+	modem = stats->modem;
+
+	ofono_modem_remove_interface(modem, OFONO_AT_DEBUG_INTERFACE);
+	g_dbus_unregister_interface(conn, ofono_modem_get_path(modem),
+					OFONO_AT_DEBUG_INTERFACE);
+}
+
+static char *device_cache_path(struct ofono_modem *modem, const char *name)
+{
+	const char *serial = ofono_modem_get_string(modem, "SerialNumber");
+	const char *p;
+
+	if (!serial || !*serial)
+		return NULL;
+
+	for (p = serial; *p; p++)
+		if (!l_ascii_isalnum(*p) && *p != '-' && *p != '_')
+			return NULL;
+
+	return l_strdup_printf("%s/%s-%s", ofono_storage_dir(), name, serial);
+}
+
+struct l_settings *at_util_device_cache_load(struct ofono_modem *modem,
+						const char *name)
+{
+	const char *revision = ofono_modem_get_string(modem, "Revision");
+	_auto_(l_free) char *path = device_cache_path(modem, name);
+	_auto_(l_free) char *cached_revision = NULL;
+	struct l_settings *cache;
+
+	if (!path || !revision)
+		return NULL;
+
+	cache = l_settings_new();
+
+	if (!l_settings_load_from_file(cache, path))
+		goto fail;
+
+	cached_revision = l_settings_get_string(cache, "Device", "Revision");
+	if (!l_streq0(cached_revision, revision)) {
+		DBG("Firmware revision changed: %s -> %s",
+						cached_revision, revision);
+		goto fail;
+	}
+
+	return cache;
+
+fail:
+	l_settings_free(cache);
+	return NULL;
+}
+
+void at_util_device_cache_save(struct ofono_modem *modem, const char *name,
+				struct l_settings *cache)
+{
+	const char *revision = ofono_modem_get_string(modem, "Revision");
+	_auto_(l_free) char *path = device_cache_path(modem, name);
+	_auto_(l_free) char *contents = NULL;
+	size_t len;
+
+	if (!path || !revision)
+		return;
+
+	l_settings_set_string(cache, "Device", "Revision", revision);
+
+	contents = l_settings_to_data(cache, &len);
+	if (!contents || l_file_set_contents(path, contents, len) < 0)
+		DBG("Unable to write %s", path);
+}
+
+void at_util_device_cache_drop(struct ofono_modem *modem, const char *name)
+{
+	_auto_(l_free) char *path = device_cache_path(modem, name);
+
+	if (!path)
+		return;
+
+	DBG("Removing %s", path);
+	unlink(path);
+}
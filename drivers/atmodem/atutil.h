@@ -9,6 +9,7 @@
 #include <gatchat.h>
 
 struct ofono_modem;
+struct l_settings;
 
 enum at_util_sms_store {
 	AT_UTIL_SMS_STORE_SM =	0,
@@ -163,3 +164,26 @@ static inline int at_util_convert_signal_strength(int strength)
 GAtChat *at_util_open_device(struct ofono_modem *modem, const char *key,
 				GAtDebugFunc debug_func, char *debug_prefix,
 				char *tty_option, ...);
+
+struct at_util_chat_stats;
+
+/*
+ * Exports the command statistics of the chats added to it on the AtDebug
+ * interface of the modem.  The chats are not referenced, the statistics
+ * must be freed before the chats are.
+ */
+struct at_util_chat_stats *at_util_chat_stats_new(struct ofono_modem *modem);
+void at_util_chat_stats_add(struct at_util_chat_stats *stats,
+				const char *name, GAtChat *chat);
+void at_util_chat_stats_free(struct at_util_chat_stats *stats);
+
+/*
+ * Results of bring-up probes that only change with the firmware, kept per
+ * device under the name given.  Devices are told apart by the USB serial
+ * number, the cache is only returned while the Revision still matches.
+ */
+struct l_settings *at_util_device_cache_load(struct ofono_modem *modem,
+						const char *name);
+void at_util_device_cache_save(struct ofono_modem *modem, const char *name,
+				struct l_settings *cache);
+void at_util_device_cache_drop(struct ofono_modem *modem, const char *name);
@@ -33,6 +33,11 @@
 
 #define STATIC_IP_NETMASK "255.255.255.255"
 
+/* Probe a silent link after 10s, give up after 3 misses 2s apart */
+#define PPP_KEEPALIVE_INTERVAL 10
+#define PPP_KEEPALIVE_RETRY 2
+#define PPP_KEEPALIVE_FAILURES 3
+
 static const char *cgdata_prefix[] = { "+CGDATA:", NULL };
 static const char *none_prefix[] = { NULL };
 
@@ -55,6 +60,11 @@ struct gprs_context_data {
 	void *cb_data;                                  /* Callback data */
 	unsigned int vendor;
 	gboolean use_atd99;
+	gboolean dtr_escape;
+	gboolean escaping;		/* PPP suspend in progress */
+	gboolean command_mode;		/* Chat resumed while PPP suspended */
+	gboolean escape_wanted;		/* Commands wait for the link up */
+	guint escape_source;
 };
 
 static void ppp_debug(const char *str, void *data)
@@ -62,6 +72,32 @@ static void ppp_debug(const char *str, void *data)
 	ofono_info("%s: %s", (const char *) data, str);
 }
 
+static gboolean escape_to_command_mode(gpointer user_data)
+{
+	struct ofono_gprs_context *gc = user_data;
+	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+
+	gcd->escape_source = 0;
+
+	if (gcd->ppp == NULL || gcd->escaping || gcd->command_mode)
+		return FALSE;
+
+	/* Leave the link alone until it is up, or while it goes down */
+	if (gcd->state == STATE_ENABLING)
+		gcd->escape_wanted = TRUE;
+
+	if (gcd->state != STATE_ACTIVE)
+		return FALSE;
+
+	DBG("");
+
+	gcd->escape_wanted = FALSE;
+	gcd->escaping = TRUE;
+	g_at_ppp_suspend(gcd->ppp);
+
+	return FALSE;
+}
+
 static void ppp_connect(const char *interface, const char *local,
 			const char *remote,
 			const char *dns1, const char *dns2,
@@ -82,23 +118,44 @@ static void ppp_connect(const char *interface, const char *local,
 
 	gcd->state = STATE_ACTIVE;
 	ofono_gprs_context_set_interface(gc, interface);
+	ofono_gprs_context_set_data_path(gc, OFONO_GPRS_CONTEXT_DATA_PATH_PPP);
 	ofono_gprs_context_set_ipv4_address(gc, local, TRUE);
 	ofono_gprs_context_set_ipv4_netmask(gc, STATIC_IP_NETMASK);
 	ofono_gprs_context_set_ipv4_dns_servers(gc, dns);
 
 	CALLBACK_WITH_SUCCESS(gcd->cb, gcd->cb_data);
+
+	if (gcd->escape_wanted && gcd->escape_source == 0)
+		gcd->escape_source = g_idle_add(escape_to_command_mode, gc);
 }
 
 static void ppp_disconnect(GAtPPPDisconnectReason reason, gpointer user_data)
 {
 	struct ofono_gprs_context *gc = user_data;
 	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+	GAtPPPKeepaliveStats stats;
 
 	DBG("Reason: %d", reason);
 
+	if (g_at_ppp_get_keepalive_stats(gcd->ppp, &stats))
+		DBG("Echo requests %lu replies %lu timeouts %lu "
+			"suppressed %lu rtt %ums max %ums",
+			stats.echo_requests, stats.echo_replies,
+			stats.echo_timeouts, stats.suppressed,
+			stats.rtt_last, stats.rtt_max);
+
 	g_at_ppp_unref(gcd->ppp);
 	gcd->ppp = NULL;
 
+	gcd->escaping = FALSE;
+	gcd->command_mode = FALSE;
+	gcd->escape_wanted = FALSE;
+
+	if (gcd->escape_source) {
+		g_source_remove(gcd->escape_source);
+		gcd->escape_source = 0;
+	}
+
 	switch (gcd->state) {
 	case STATE_ENABLING:
 		CALLBACK_WITH_FAILURE(gcd->cb, gcd->cb_data);
@@ -121,6 +178,72 @@ static void ppp_disconnect(GAtPPPDisconnectReason reason, gpointer user_data)
 	g_at_chat_resume(gcd->chat);
 }
 
+static void resume_data_cb(gboolean ok, GAtResult *result,
+						gpointer user_data)
+{
+	struct ofono_gprs_context *gc = user_data;
+	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+
+	DBG("ok %d", ok);
+
+	if (gcd->ppp == NULL)
+		return;
+
+	if (!ok) {
+		ofono_error("Unable to resume the data session");
+		ppp_disconnect(G_AT_PPP_REASON_LINK_DEAD, gc);
+		return;
+	}
+
+	g_at_chat_suspend(gcd->chat);
+	g_at_ppp_resume(gcd->ppp);
+}
+
+static void ppp_suspended(gpointer user_data)
+{
+	struct ofono_gprs_context *gc = user_data;
+	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+
+	DBG("");
+
+	gcd->escaping = FALSE;
+	gcd->command_mode = TRUE;
+
+	/* Runs all the commands queued so far, see chat_queue_notify */
+	g_at_chat_resume(gcd->chat);
+}
+
+/*
+ * On modems with a single port the other atoms queue their commands on
+ * the chat suspended for PPP.  They are run in batches, one switch to
+ * command mode for all the commands queued by then and straight back
+ * to data once they are done.
+ */
+static void chat_queue_notify(gboolean pending, gpointer user_data)
+{
+	struct ofono_gprs_context *gc = user_data;
+	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+
+	if (pending) {
+		/* Let the commands queued in this main loop run join in */
+		if (gcd->escape_source == 0)
+			gcd->escape_source = g_idle_add(escape_to_command_mode,
+									gc);
+		return;
+	}
+
+	if (gcd->command_mode == FALSE)
+		return;
+
+	DBG("batch done");
+
+	gcd->command_mode = FALSE;
+
+	if (g_at_chat_send(gcd->chat, "ATO", none_prefix,
+					resume_data_cb, gc, NULL) == 0)
+		ofono_error("Unable to resume the data session");
+}
+
 static gboolean setup_ppp(struct ofono_gprs_context *gc)
 {
 	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
@@ -156,6 +279,14 @@ static gboolean setup_ppp(struct ofono_gprs_context *gc)
 	if (gcd->vendor == OFONO_VENDOR_QUECTEL_SERIAL)
 		g_at_ppp_set_accm(gcd->ppp, 0x000a0000);
 
+	g_at_ppp_set_keepalive(gcd->ppp, PPP_KEEPALIVE_INTERVAL,
+				PPP_KEEPALIVE_RETRY, PPP_KEEPALIVE_FAILURES);
+
+	if (gcd->dtr_escape)
+		g_at_ppp_set_escape_method(gcd->ppp, G_AT_PPP_ESCAPE_DTR);
+
+	g_at_ppp_set_suspend_function(gcd->ppp, ppp_suspended, gc);
+
 	/* set connect and disconnect callbacks */
 	g_at_ppp_set_connect_function(gcd->ppp, ppp_connect, gc);
 	g_at_ppp_set_disconnect_function(gcd->ppp, ppp_disconnect, gc);
@@ -451,6 +582,18 @@ static int at_gprs_context_probe(struct ofono_gprs_context *gc,
 
 	ofono_gprs_context_set_data(gc, gcd);
 
+	g_at_chat_set_queue_function(gcd->chat, chat_queue_notify, gc);
+
+	/*
+	 * Where DTR is known to reach the modem, leaving data mode with
+	 * it skips the guard times of the escape sequence
+	 */
+	if (ofono_modem_get_boolean(ofono_gprs_context_get_modem(gc),
+							"DTREscape")) {
+		gcd->dtr_escape = TRUE;
+		g_at_chat_send(chat, "AT&D1", none_prefix, NULL, NULL, NULL);
+	}
+
 	switch (vendor) {
 	case OFONO_VENDOR_SIMCOM_SIM900:
 		gcd->use_atd99 = FALSE;
@@ -478,6 +621,11 @@ static void at_gprs_context_remove(struct ofono_gprs_context *gc)
 
 	DBG("");
 
+	g_at_chat_set_queue_function(gcd->chat, NULL, NULL);
+
+	if (gcd->escape_source)
+		g_source_remove(gcd->escape_source);
+
 	if (gcd->state != STATE_IDLE && gcd->ppp) {
 		if ((gcd->vendor == OFONO_VENDOR_HUAWEI) && gcd->chat) {
 			/* immediately send escape sequence */
@@ -627,6 +627,22 @@ void at_register_manual(struct ofono_netreg *netreg,
 	CALLBACK_WITH_FAILURE(cb, data);
 }
 
+/* Reports a 27.007 <rssi> value, 99 being not known */
+static void csq_signal_notify(struct ofono_netreg *netreg, int rssi)
+{
+	struct ofono_netreg_signal signal;
+
+	ofono_netreg_strength_notify(netreg,
+				at_util_convert_signal_strength(rssi));
+
+	ofono_netreg_signal_init(&signal);
+
+	if (rssi >= 0 && rssi <= 31)
+		signal.rssi = -113 + 2 * rssi;
+
+	ofono_netreg_signal_notify(netreg, &signal);
+}
+
 static void csq_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_netreg *netreg = user_data;
@@ -641,8 +657,7 @@ static void csq_notify(GAtResult *result, gpointer user_data)
 	if (!g_at_result_iter_next_number(&iter, &strength))
 		return;
 
-	ofono_netreg_strength_notify(netreg,
-				at_util_convert_signal_strength(strength));
+	csq_signal_notify(netreg, strength);
 }
 
 static void calypso_csq_notify(GAtResult *result, gpointer user_data)
@@ -659,8 +674,7 @@ static void calypso_csq_notify(GAtResult *result, gpointer user_data)
 	if (!g_at_result_iter_next_number(&iter, &strength))
 		return;
 
-	ofono_netreg_strength_notify(netreg,
-				at_util_convert_signal_strength(strength));
+	csq_signal_notify(netreg, strength);
 }
 
 static void option_osigq_notify(GAtResult *result, gpointer user_data)
@@ -950,6 +964,7 @@ static void tlts_notify(GAtResult *result, gpointer user_data)
         nd->time.mday = mday;
         nd->time.mon = mon;
         nd->time.year = 2000 + year;
+	nd->time.received = l_time_now();
 
 	nd->time.utcoff = atoi(tz) * 15 * 60;
 
@@ -1059,11 +1074,13 @@ static void ifx_ctzv_notify(GAtResult *result, gpointer user_data)
 	nd->time.mday = mday;
 	nd->time.mon = mon;
 	nd->time.year = 2000 + year;
+	nd->time.received = l_time_now();
 
 	if (nd->nitz_timeout > 0)
 		g_source_remove(nd->nitz_timeout);
 
-	nd->nitz_timeout = g_timeout_add_seconds(1, notify_time, user_data);
+	nd->nitz_timeout = g_timeout_add(AT_NITZ_DST_DELAY_MS, notify_time,
+						user_data);
 }
 
 static void ifx_ctzdst_notify(GAtResult *result, gpointer user_data)
@@ -1144,8 +1161,7 @@ static void huawei_rssi_notify(GAtResult *result, gpointer user_data)
 	if (!g_at_result_iter_next_number(&iter, &strength))
 		return;
 
-	ofono_netreg_strength_notify(netreg,
-				at_util_convert_signal_strength(strength));
+	csq_signal_notify(netreg, strength);
 }
 
 static void huawei_mode_notify(GAtResult *result, gpointer user_data)
@@ -1180,8 +1196,11 @@ static void huawei_hcsq_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_netreg *netreg = user_data;
 	struct at_netreg_data *nd = ofono_netreg_get_data(netreg);
+	struct ofono_netreg_signal signal;
 	GAtResultIter iter;
 	const char *mode;
+	int value[4];
+	int n;
 
 	g_at_result_iter_init(&iter, result);
 
@@ -1195,6 +1214,36 @@ static void huawei_hcsq_notify(GAtResult *result, gpointer user_data)
 		nd->tech = ACCESS_TECHNOLOGY_EUTRAN;
 
 	/* for other technologies, notification ^MODE is used */
+
+	for (n = 0; n < 4; n++) {
+		if (!g_at_result_iter_next_number(&iter, &value[n]))
+			break;
+
+		/* 255 stands for not known or not detectable */
+		if (value[n] == 255)
+			value[n] = -1;
+	}
+
+	ofono_netreg_signal_init(&signal);
+
+	if (n > 0 && value[0] >= 0)
+		signal.rssi = -120 + value[0];
+
+	if (!strcmp("LTE", mode)) {
+		if (n > 1 && value[1] >= 0)
+			signal.rsrp = -140 + value[1];
+
+		if (n > 2 && value[2] >= 0)
+			signal.sinr = -20 + value[2] / 5;
+
+		if (n > 3 && value[3] >= 0)
+			signal.rsrq = (value[3] - 39) / 2;
+	} else if (!strcmp("WCDMA", mode)) {
+		if (n > 2 && value[2] >= 0)
+			signal.ecio = -32 + value[2] / 2;
+	}
+
+	ofono_netreg_signal_notify(netreg, &signal);
 }
 
 static void huawei_nwtime_notify(GAtResult *result, gpointer user_data)
@@ -1237,6 +1286,7 @@ static void huawei_nwtime_notify(GAtResult *result, gpointer user_data)
 	nd->time.mday = mday;
 	nd->time.mon = mon;
 	nd->time.year = 2000 + year;
+	nd->time.received = l_time_now();
 
 	ofono_netreg_time_notify(netreg, &nd->time);
 }
@@ -1347,6 +1397,7 @@ static void mbm_etzv_notify(GAtResult *result, gpointer user_data)
 	nd->time.mday = mday;
 	nd->time.mon = mon;
 	nd->time.year = year;
+	nd->time.received = l_time_now();
 
 	ofono_netreg_time_notify(netreg, &nd->time);
 }
@@ -1,4 +1,10 @@
 
+/*
+ * How long a time report is held back for a +CTZDST that may follow it.
+ * The report keeps its receipt time, so the wait does not skew it.
+ */
+#define AT_NITZ_DST_DELAY_MS 200
+
 struct at_netreg_data {
 	GAtChat *chat;
 	char mcc[OFONO_MAX_MCC_LENGTH + 1];
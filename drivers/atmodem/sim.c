@@ -31,6 +31,9 @@
 #define EF_STATUS_INVALIDATED 0
 #define EF_STATUS_VALID 1
 
+/* Records queued by a single read_file_records call */
+#define AT_SIM_RECORDS_BATCH 16
+
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 struct sim_data {
@@ -310,6 +313,133 @@ static void at_sim_read_record(struct ofono_sim *sim, int fileid,
 	CALLBACK_WITH_FAILURE(cb, NULL, 0, data);
 }
 
+/*
+ * A record is read per AT+CRSM, all of a batch are queued at once so that
+ * the next command goes out as soon as the previous one completed.  The
+ * commands complete in order, after a failure the others are dropped and
+ * the records read up to there are returned.
+ */
+struct records_read {
+	ofono_sim_read_cb_t cb;
+	void *data;
+	int length;
+	int count;
+	int completed;
+	int received;
+	int refs;
+	struct ofono_error error;
+	unsigned char buf[];
+};
+
+static void records_read_unref(gpointer user_data)
+{
+	struct records_read *rr = user_data;
+
+	if (--rr->refs == 0)
+		g_free(rr);
+}
+
+static void at_crsm_records_cb(gboolean ok, GAtResult *result,
+				gpointer user_data)
+{
+	struct records_read *rr = user_data;
+	GAtResultIter iter;
+	const guint8 *response;
+	gint sw1, sw2, len;
+
+	rr->completed += 1;
+
+	if (rr->received < rr->completed - 1)
+		goto done;
+
+	decode_at_error(&rr->error, g_at_result_final_response(result));
+
+	if (!ok)
+		goto done;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+CRSM:"))
+		goto failed;
+
+	g_at_result_iter_next_number(&iter, &sw1);
+	g_at_result_iter_next_number(&iter, &sw2);
+
+	if ((sw1 != 0x90 && sw1 != 0x91 && sw1 != 0x92 && sw1 != 0x9f) ||
+			(sw1 == 0x90 && sw2 != 0x00)) {
+		rr->error.type = OFONO_ERROR_TYPE_SIM;
+		rr->error.error = (sw1 << 8) | sw2;
+		goto done;
+	}
+
+	if (!g_at_result_iter_next_hexstring(&iter, &response, &len) ||
+			len != rr->length)
+		goto failed;
+
+	memcpy(rr->buf + rr->received * rr->length, response, len);
+	rr->received += 1;
+	goto done;
+
+failed:
+	rr->error.type = OFONO_ERROR_TYPE_FAILURE;
+	rr->error.error = 0;
+
+done:
+	if (rr->completed < rr->count)
+		return;
+
+	DBG("%d of %d records", rr->received, rr->count);
+
+	if (rr->received == 0) {
+		rr->cb(&rr->error, NULL, 0, rr->data);
+		return;
+	}
+
+	CALLBACK_WITH_SUCCESS(rr->cb, rr->buf, rr->received * rr->length,
+				rr->data);
+}
+
+static void at_sim_read_records(struct ofono_sim *sim, int fileid,
+				int record, int count, int length,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *data)
+{
+	struct sim_data *sd = ofono_sim_get_data(sim);
+	struct records_read *rr;
+	char buf[128];
+	unsigned int len;
+	int i;
+
+	count = MIN(count, AT_SIM_RECORDS_BATCH);
+
+	rr = g_malloc0(sizeof(*rr) + count * length);
+	rr->cb = cb;
+	rr->data = data;
+	rr->length = length;
+	rr->refs = 1;
+
+	for (i = 0; i < count; i++) {
+		len = snprintf(buf, sizeof(buf), "AT+CRSM=178,%i,%i,4,%i",
+				fileid, record + i, length);
+
+		append_file_path(buf + len, path, path_len);
+
+		if (g_at_chat_send(sd->chat, buf, crsm_prefix,
+					at_crsm_records_cb, rr,
+					records_read_unref) == 0)
+			break;
+
+		rr->refs += 1;
+		rr->count += 1;
+	}
+
+	if (rr->count == 0)
+		CALLBACK_WITH_FAILURE(cb, NULL, 0, data);
+
+	records_read_unref(rr);
+}
+
 static void at_crsm_update_cb(gboolean ok, GAtResult *result,
 				gpointer user_data)
 {
@@ -2098,6 +2228,7 @@ static const struct ofono_sim_driver driver = {
 	.read_file_transparent	= at_sim_read_binary,
 	.read_file_linear	= at_sim_read_record,
 	.read_file_cyclic	= at_sim_read_record,
+	.read_file_records	= at_sim_read_records,
 	.write_file_transparent	= at_sim_update_binary,
 	.write_file_linear	= at_sim_update_record,
 	.write_file_cyclic	= at_sim_update_cyclic,
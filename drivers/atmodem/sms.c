@@ -36,6 +36,7 @@ static const char *cpms_prefix[] = { "+CPMS:", NULL };
 static const char *cnmi_prefix[] = { "+CNMI:", NULL };
 static const char *cmgs_prefix[] = { "+CMGS:", NULL };
 static const char *cmgl_prefix[] = { "+CMGL:", NULL };
+static const char *cmgd_prefix[] = { "+CMGD:", NULL };
 static const char *none_prefix[] = { NULL };
 
 static gboolean set_cmgf(gpointer user_data);
@@ -64,6 +65,9 @@ struct sms_data {
 	guint timeout_source;
 	GAtChat *chat;
 	unsigned int vendor;
+	gboolean batch_delete;		/* CMGD can delete all read messages */
+	unsigned int batch_stores;	/* Stores with unread messages */
+	gboolean batch_running;
 };
 
 struct cpms_request {
@@ -572,9 +576,122 @@ static void at_send_cmgr_cpms(struct ofono_sms *sms, int store, int index,
 	}
 }
 
+static void at_cmgl_parse(struct ofono_sms *sms, GAtResult *result,
+							gboolean delete_each);
+static void at_batch_next(struct ofono_sms *sms);
+
+static void at_batch_cmgd_cb(gboolean ok, GAtResult *result,
+							gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	struct sms_data *data = ofono_sms_get_data(sms);
+
+	if (!ok)
+		ofono_error("Unable to delete received SMS");
+
+	data->batch_running = FALSE;
+	at_batch_next(sms);
+}
+
+static void at_batch_cmgl_notify(GAtResult *result, gpointer user_data)
+{
+	at_cmgl_parse(user_data, result, FALSE);
+}
+
+static void at_batch_cmgl_cb(gboolean ok, GAtResult *result,
+							gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	struct sms_data *data = ofono_sms_get_data(sms);
+
+	if (!ok) {
+		ofono_error("Received CMTI, but listing new SMS failed");
+		data->batch_running = FALSE;
+		at_batch_next(sms);
+		return;
+	}
+
+	/*
+	 * Listing marked the messages as read.  Anything that arrived
+	 * since is still unread and stays, to be picked up by the next
+	 * batch that its own CMTI triggers.
+	 */
+	g_at_chat_send(data->chat, "AT+CMGD=1,1", none_prefix,
+				at_batch_cmgd_cb, sms, NULL);
+}
+
+static void at_batch_cpms_cb(gboolean ok, GAtResult *result,
+							gpointer user_data)
+{
+	struct cpms_request *req = user_data;
+	struct ofono_sms *sms = req->sms;
+	struct sms_data *data = ofono_sms_get_data(sms);
+
+	if (!ok) {
+		ofono_error("Received CMTI, but CPMS request failed");
+		data->batch_running = FALSE;
+		at_batch_next(sms);
+		return;
+	}
+
+	data->store = req->store;
+	data->expect_sr = FALSE;
+
+	g_at_chat_send_pdu_listing(data->chat, "AT+CMGL=0", cmgl_prefix,
+					at_batch_cmgl_notify, at_batch_cmgl_cb,
+					sms, NULL);
+}
+
+/*
+ * Messages announced by CMTI are fetched in batches, one listing of the
+ * unread messages followed by a single delete of all read ones, rather
+ * than a read and a delete for every single message.
+ */
+static void at_batch_next(struct ofono_sms *sms)
+{
+	struct sms_data *data = ofono_sms_get_data(sms);
+	int store;
+
+	if (data->batch_running || data->batch_stores == 0)
+		return;
+
+	if (data->batch_stores & (1 << data->store))
+		store = data->store;
+	else
+		store = __builtin_ffs(data->batch_stores) - 1;
+
+	data->batch_stores &= ~(1 << store);
+	data->batch_running = TRUE;
+
+	DBG("Fetching new messages from %s", storages[store]);
+
+	if (store == data->store) {
+		struct cpms_request req;
+
+		req.sms = sms;
+		req.store = store;
+
+		at_batch_cpms_cb(TRUE, NULL, &req);
+	} else {
+		char buf[128];
+		const char *incoming = storages[data->incoming];
+		struct cpms_request *req = g_new(struct cpms_request, 1);
+
+		req->sms = sms;
+		req->store = store;
+
+		snprintf(buf, sizeof(buf), "AT+CPMS=\"%s\",\"%s\",\"%s\"",
+				storages[store], storages[store], incoming);
+
+		g_at_chat_send(data->chat, buf, cpms_prefix, at_batch_cpms_cb,
+				req, g_free);
+	}
+}
+
 static void at_cmti_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
+	struct sms_data *data = ofono_sms_get_data(sms);
 	enum at_util_sms_store store;
 	int index;
 
@@ -586,6 +703,13 @@ static void at_cmti_notify(GAtResult *result, gpointer user_data)
 		goto error;
 
 	DBG("Got a CMTI indication at %s, index: %d", storages[store], index);
+
+	if (data->batch_delete) {
+		data->batch_stores |= 1 << store;
+		at_batch_next(sms);
+		return;
+	}
+
 	at_send_cmgr_cpms(sms, store, index, FALSE);
 	return;
 
@@ -642,9 +766,9 @@ static void at_cmgl_done(struct ofono_sms *sms)
 				sms, NULL);
 }
 
-static void at_cmgl_notify(GAtResult *result, gpointer user_data)
+static void at_cmgl_parse(struct ofono_sms *sms, GAtResult *result,
+							gboolean delete_each)
 {
-	struct ofono_sms *sms = user_data;
 	struct sms_data *data = ofono_sms_get_data(sms);
 	GAtResultIter iter;
 	const char *hexpdu;
@@ -687,6 +811,9 @@ static void at_cmgl_notify(GAtResult *result, gpointer user_data)
 		decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
 		ofono_sms_deliver_notify(sms, pdu, pdu_len, tpdu_len);
 
+		if (!delete_each)
+			continue;
+
 		/* We don't buffer SMS on the SIM/ME, send along a CMGD */
 		snprintf(buf, sizeof(buf), "AT+CMGD=%d", index);
 		g_at_chat_send(data->chat, buf, none_prefix,
@@ -698,12 +825,25 @@ err:
 	ofono_error("Unable to parse CMGL response");
 }
 
+static void at_cmgl_notify(GAtResult *result, gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	struct sms_data *data = ofono_sms_get_data(sms);
+
+	at_cmgl_parse(sms, result, !data->batch_delete);
+}
+
 static void at_cmgl_cb(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
+	struct sms_data *data = ofono_sms_get_data(sms);
 
 	if (!ok)
 		DBG("Initial listing SMS storage failed!");
+	else if (data->batch_delete)
+		/* The listing left all MT messages read, drop them at once */
+		g_at_chat_send(data->chat, "AT+CMGD=1,1", none_prefix,
+				at_cmgd_cb, NULL, NULL);
 
 	at_cmgl_done(sms);
 }
@@ -754,15 +894,50 @@ static void at_cmgl_set_cpms(struct ofono_sms *sms, int store)
 	}
 }
 
-static void at_sms_initialized(struct ofono_sms *sms)
+static void at_cmgd_query_cb(gboolean ok, GAtResult *result,
+							gpointer user_data)
 {
+	struct ofono_sms *sms = user_data;
 	struct sms_data *data = ofono_sms_get_data(sms);
+	GAtResultIter iter;
+	int min, max;
+
+	if (!ok)
+		goto out;
+
+	g_at_result_iter_init(&iter, result);
+
+	/* +CMGD: (list of <index>s),(list of <delflag>s) */
+	if (!g_at_result_iter_next(&iter, "+CMGD:"))
+		goto out;
+
+	if (!g_at_result_iter_skip_next(&iter))
+		goto out;
+
+	if (!g_at_result_iter_open_list(&iter))
+		goto out;
+
+	while (g_at_result_iter_next_range(&iter, &min, &max)) {
+		if (min <= 1 && max >= 1)
+			data->batch_delete = TRUE;
+	}
+
+out:
+	DBG("Batched deletes %ssupported", data->batch_delete ? "" : "not ");
 
 	/* Inspect and free the incoming SMS storage */
 	if (data->incoming == AT_UTIL_SMS_STORE_MT)
 		at_cmgl_set_cpms(sms, AT_UTIL_SMS_STORE_ME);
 	else
 		at_cmgl_set_cpms(sms, data->incoming);
+}
+
+static void at_sms_initialized(struct ofono_sms *sms)
+{
+	struct sms_data *data = ofono_sms_get_data(sms);
+
+	g_at_chat_send(data->chat, "AT+CMGD=?", cmgd_prefix,
+			at_cmgd_query_cb, sms, NULL);
 
 	ofono_sms_register(sms);
 }
@@ -35,6 +35,9 @@
 /* Amount of time we give for CLIP to arrive before we commence CLCC poll */
 #define CLIP_INTERVAL 200
 
+/* With call state URCs, CLCC only reconciles and runs at most this often */
+#define RECONCILE_CLCC_INTERVAL 3000
+
 /* When +VTD returns 0, an unspecified manufacturer-specific delay is used */
 #define TONE_DURATION 1000
 
@@ -48,6 +51,22 @@ static const char *atd_prefix[] = { "+COLP:", NULL };
 #define FLAG_NEED_CNAP 2
 #define FLAG_NEED_CDIP 4
 
+/* Call state URCs, a modem reporting them needs no CLCC polling */
+#define CALLSTATE_URC_DSCI 0x1
+#define CALLSTATE_URC_CLCC 0x2
+#define CALLSTATE_URC_UCALLSTAT 0x4
+
+static const struct {
+	unsigned int vendor;
+	unsigned int caps;
+	const char *enable;
+} callstate_urcs[] = {
+	{ OFONO_VENDOR_QUECTEL_EC2X, CALLSTATE_URC_DSCI, "AT^DSCI=1" },
+	{ OFONO_VENDOR_QUECTEL_EG91X, CALLSTATE_URC_DSCI, "AT^DSCI=1" },
+	{ OFONO_VENDOR_SIMCOM_A76XX, CALLSTATE_URC_CLCC, "AT+CLCC=1" },
+	{ OFONO_VENDOR_UBLOX, CALLSTATE_URC_UCALLSTAT, "AT+UCALLSTAT=1" },
+};
+
 struct voicecall_data {
 	GSList *calls;
 	unsigned int local_release;
@@ -58,6 +77,7 @@ struct voicecall_data {
 	guint vts_source;
 	unsigned int vts_delay;
 	unsigned char flags;
+	unsigned int callstate_caps;
 };
 
 struct release_id_req {
@@ -75,6 +95,8 @@ struct change_state_req {
 };
 
 static gboolean poll_clcc(gpointer user_data);
+static void schedule_clcc(struct voicecall_data *vd,
+				struct ofono_voicecall *vc);
 
 static int class_to_call_type(int cls)
 {
@@ -248,10 +270,13 @@ static void clcc_poll_cb(gboolean ok, GAtResult *result, gpointer user_data)
 
 	vd->local_release = 0;
 
+	/* Transitions are reported as they happen, no need to chase them */
+	if (vd->callstate_caps)
+		poll_again = FALSE;
+
 poll_again:
-	if (poll_again && !vd->clcc_source)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+	if (poll_again)
+		schedule_clcc(vd, vc);
 }
 
 static void send_clcc(struct voicecall_data *vd, struct ofono_voicecall *vc)
@@ -270,6 +295,32 @@ static gboolean poll_clcc(gpointer user_data)
 	return FALSE;
 }
 
+/*
+ * Without call state URCs, CLCC is polled for as long as calls are in
+ * transition.  With them, CLCC runs only to reconcile our view with the
+ * modem, and all requests made within the interval share a single run.
+ */
+static void schedule_clcc(struct voicecall_data *vd,
+				struct ofono_voicecall *vc)
+{
+	if (vd->clcc_source)
+		return;
+
+	vd->clcc_source = g_timeout_add(vd->callstate_caps ?
+						RECONCILE_CLCC_INTERVAL :
+						POLL_CLCC_INTERVAL,
+					poll_clcc, vc);
+}
+
+static void request_clcc(struct voicecall_data *vd,
+				struct ofono_voicecall *vc)
+{
+	if (vd->callstate_caps)
+		schedule_clcc(vd, vc);
+	else
+		send_clcc(vd, vc);
+}
+
 static void generic_cb(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct change_state_req *req = user_data;
@@ -290,7 +341,7 @@ static void generic_cb(gboolean ok, GAtResult *result, gpointer user_data)
 		}
 	}
 
-	send_clcc(vd, req->vc);
+	request_clcc(vd, req->vc);
 
 	/* We have to callback after we schedule a poll if required */
 	req->cb(&error, req->data);
@@ -308,7 +359,7 @@ static void release_id_cb(gboolean ok, GAtResult *result,
 	if (ok)
 		vd->local_release = 1 << req->id;
 
-	send_clcc(vd, req->vc);
+	request_clcc(vd, req->vc);
 
 	/* We have to callback after we schedule a poll if required */
 	req->cb(&error, req->data);
@@ -333,6 +384,15 @@ static void atd_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	if (!ok)
 		goto out;
 
+	/* The call state URC may well have beaten the final response */
+	if (vd->callstate_caps && (g_slist_find_custom(vd->calls,
+				GINT_TO_POINTER(CALL_STATUS_DIALING),
+				at_util_call_compare_by_status) ||
+			g_slist_find_custom(vd->calls,
+				GINT_TO_POINTER(CALL_STATUS_ALERTING),
+				at_util_call_compare_by_status)))
+		goto poll;
+
 	/* On a success, make sure to put all active calls on hold */
 	for (l = vd->calls; l; l = l->next) {
 		call = l->data;
@@ -373,9 +433,8 @@ static void atd_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	if (validity != 2)
 		ofono_voicecall_notify(vc, call);
 
-	if (!vd->clcc_source)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+poll:
+	schedule_clcc(vd, vc);
 
 out:
 	cb(&error, cbd->data);
@@ -641,6 +700,223 @@ error:
 	CALLBACK_WITH_FAILURE(cb, data);
 }
 
+/*
+ * Applies one call state transition reported by a URC.  A status of -1
+ * means the call is gone.  Calls not known yet are only created when the
+ * URC carries enough to announce them, otherwise CLCC is asked.
+ */
+static void callstate_update(struct ofono_voicecall *vc, int id,
+				int status, const struct ofono_call *info)
+{
+	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
+	struct ofono_call *call;
+	GSList *l;
+
+	l = g_slist_find_custom(vd->calls, GINT_TO_POINTER(id),
+				at_util_call_compare_by_id);
+
+	if (status < 0) {
+		enum ofono_disconnect_reason reason;
+
+		if (l == NULL)
+			return;
+
+		call = l->data;
+
+		if (vd->local_release & (1 << id))
+			reason = OFONO_DISCONNECT_REASON_LOCAL_HANGUP;
+		else
+			reason = OFONO_DISCONNECT_REASON_REMOTE_HANGUP;
+
+		if (call->type == 0)
+			ofono_voicecall_disconnected(vc, id, reason, NULL);
+
+		vd->local_release &= ~(1 << id);
+		vd->calls = g_slist_remove(vd->calls, call);
+		g_free(call);
+		goto reconcile;
+	}
+
+	if (l == NULL) {
+		/* CNAP and CDIP may still follow for an incoming call */
+		if (status == CALL_STATUS_INCOMING ||
+				status == CALL_STATUS_WAITING)
+			vd->flags = FLAG_NEED_CNAP | FLAG_NEED_CDIP;
+
+		if (info == NULL) {
+			send_clcc(vd, vc);
+			return;
+		}
+
+		call = g_try_new(struct ofono_call, 1);
+		if (call == NULL)
+			return;
+
+		memcpy(call, info, sizeof(*call));
+		vd->calls = g_slist_insert_sorted(vd->calls, call,
+						at_util_call_compare);
+	} else {
+		call = l->data;
+
+		if (call->status == status)
+			return;
+
+		call->status = status;
+	}
+
+	if (call->type == 0)
+		ofono_voicecall_notify(vc, call);
+
+reconcile:
+	schedule_clcc(vd, vc);
+}
+
+/* Both URCs use the CLCC status values, with 6 for a released call */
+static int callstate_status(int stat)
+{
+	if (stat < CALL_STATUS_ACTIVE || stat > CALL_STATUS_WAITING)
+		return -1;
+
+	return stat;
+}
+
+static void callstate_info(struct ofono_call *call, int id, int dir,
+				int status, int type, const char *num,
+				int num_type)
+{
+	ofono_call_init(call);
+
+	call->id = id;
+	call->direction = dir;
+	call->status = status;
+	call->type = type;
+	l_strlcpy(call->phone_number.number, num,
+			sizeof(call->phone_number.number));
+	call->phone_number.type = num_type;
+
+	if (num[0] != '\0')
+		call->clip_validity = CLIP_VALIDITY_VALID;
+	else
+		call->clip_validity = CLIP_VALIDITY_NOT_AVAILABLE;
+
+	call->cnap_validity = CNAP_VALIDITY_NOT_AVAILABLE;
+}
+
+/* ^DSCI: <id>,<dir>,<stat>,<type>,<number>,<num_type>[,...] */
+static void dsci_notify(GAtResult *result, gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	GAtResultIter iter;
+	struct ofono_call info;
+	const char *num = "";
+	int id, dir, stat, type;
+	int num_type = 129;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "^DSCI:"))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &id) || id == 0)
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &dir))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &stat))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &type))
+		return;
+
+	if (g_at_result_iter_next_string(&iter, &num))
+		g_at_result_iter_next_number(&iter, &num_type);
+
+	DBG("id %d dir %d stat %d type %d", id, dir, stat, type);
+
+	callstate_info(&info, id, dir, callstate_status(stat), type,
+			num, num_type);
+	callstate_update(vc, id, info.status, &info);
+}
+
+/* Unsolicited +CLCC: <id>,<dir>,<stat>,<mode>,<mpty>[,<number>,<type>] */
+static void clcc_notify(GAtResult *result, gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	GAtResultIter iter;
+	struct ofono_call info;
+	const char *num = "";
+	int id, dir, stat, mode, mpty;
+	int num_type = 129;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+CLCC:"))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &id) || id == 0)
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &dir))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &stat))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &mode))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &mpty))
+		return;
+
+	if (g_at_result_iter_next_string(&iter, &num))
+		g_at_result_iter_next_number(&iter, &num_type);
+
+	DBG("id %d dir %d stat %d mode %d", id, dir, stat, mode);
+
+	callstate_info(&info, id, dir, callstate_status(stat), mode,
+			num, num_type);
+	callstate_update(vc, id, info.status, &info);
+}
+
+/* +UCALLSTAT: <id>,<stat>, without any details about the call */
+static void ucallstat_notify(GAtResult *result, gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	GAtResultIter iter;
+	int id, stat, status;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+UCALLSTAT:"))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &id) || id == 0)
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &stat))
+		return;
+
+	DBG("id %d stat %d", id, stat);
+
+	switch (stat) {
+	case 6:
+		status = -1;
+		break;
+	case 7:
+		/* Voice channel connected */
+		status = CALL_STATUS_ACTIVE;
+		break;
+	default:
+		status = callstate_status(stat);
+		if (status < 0)
+			return;
+		break;
+	}
+
+	callstate_update(vc, id, status, NULL);
+}
+
 static void ring_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_voicecall *vc = user_data;
@@ -943,9 +1219,7 @@ static void ccwa_notify(GAtResult *result, gpointer user_data)
 	if (call->type == 0) /* Only notify voice calls */
 		ofono_voicecall_notify(vc, call);
 
-	if (vd->clcc_source == 0)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+	schedule_clcc(vd, vc);
 }
 
 static void no_carrier_notify(GAtResult *result, gpointer user_data)
@@ -1051,6 +1325,20 @@ static void vtd_query_cb(gboolean ok, GAtResult *result, gpointer user_data)
 		vd->tone_duration = duration * 100;
 }
 
+static void callstate_enable_cb(gboolean ok, GAtResult *result,
+					gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
+
+	if (ok)
+		return;
+
+	/* Firmware without the URC, fall back to polling */
+	ofono_warn("Call state URCs unavailable, polling CLCC instead");
+	vd->callstate_caps = 0;
+}
+
 static void at_voicecall_initialized(gboolean ok, GAtResult *result,
 					gpointer user_data)
 {
@@ -1059,21 +1347,40 @@ static void at_voicecall_initialized(gboolean ok, GAtResult *result,
 
 	DBG("voicecall_init: registering to notifications");
 
-	g_at_chat_register(vd->chat, "RING", ring_notify, FALSE, vc, NULL);
-	g_at_chat_register(vd->chat, "+CRING:", cring_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "+CLIP:", clip_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "+CDIP:", cdip_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "+CNAP:", cnap_notify, FALSE, vc, NULL);
-	g_at_chat_register(vd->chat, "+CCWA:", ccwa_notify, FALSE, vc, NULL);
 
-	/* Modems with 'better' call progress indicators should
-	 * probably not even bother registering to these
+	if (vd->callstate_caps & CALLSTATE_URC_DSCI)
+		g_at_chat_register(vd->chat, "^DSCI:", dsci_notify,
+							FALSE, vc, NULL);
+
+	if (vd->callstate_caps & CALLSTATE_URC_CLCC)
+		g_at_chat_register(vd->chat, "+CLCC:", clcc_notify,
+							FALSE, vc, NULL);
+
+	if (vd->callstate_caps & CALLSTATE_URC_UCALLSTAT)
+		g_at_chat_register(vd->chat, "+UCALLSTAT:", ucallstat_notify,
+							FALSE, vc, NULL);
+
+	/*
+	 * Modems with call state URCs learn about new and released calls
+	 * from those, the others have to go and look
 	 */
-	g_at_chat_register(vd->chat, "NO CARRIER",
-				no_carrier_notify, FALSE, vc, NULL);
-	g_at_chat_register(vd->chat, "NO ANSWER",
-				no_answer_notify, FALSE, vc, NULL);
-	g_at_chat_register(vd->chat, "BUSY", busy_notify, FALSE, vc, NULL);
+	if (vd->callstate_caps == 0) {
+		g_at_chat_register(vd->chat, "RING", ring_notify,
+							FALSE, vc, NULL);
+		g_at_chat_register(vd->chat, "+CRING:", cring_notify,
+							FALSE, vc, NULL);
+		g_at_chat_register(vd->chat, "+CCWA:", ccwa_notify,
+							FALSE, vc, NULL);
+		g_at_chat_register(vd->chat, "NO CARRIER",
+					no_carrier_notify, FALSE, vc, NULL);
+		g_at_chat_register(vd->chat, "NO ANSWER",
+					no_answer_notify, FALSE, vc, NULL);
+		g_at_chat_register(vd->chat, "BUSY", busy_notify,
+							FALSE, vc, NULL);
+	}
 
 	g_at_chat_register(vd->chat, "+CSSI:", cssi_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "+CSSU:", cssu_notify, FALSE, vc, NULL);
@@ -1089,6 +1396,7 @@ static int at_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 {
 	GAtChat *chat = data;
 	struct voicecall_data *vd;
+	unsigned int i;
 
 	vd = g_try_new0(struct voicecall_data, 1);
 	if (vd == NULL)
@@ -1119,6 +1427,17 @@ static int at_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 	}
 
 	g_at_chat_send(vd->chat, "AT+CSSN=1,1", NULL, NULL, NULL, NULL);
+
+	for (i = 0; i < L_ARRAY_SIZE(callstate_urcs); i++) {
+		if (callstate_urcs[i].vendor != vd->vendor)
+			continue;
+
+		vd->callstate_caps = callstate_urcs[i].caps;
+		g_at_chat_send(vd->chat, callstate_urcs[i].enable, none_prefix,
+				callstate_enable_cb, vc, NULL);
+		break;
+	}
+
 	g_at_chat_send(vd->chat, "AT+VTD?", NULL,
 				vtd_query_cb, vc, NULL);
 	g_at_chat_send(vd->chat, "AT+CCWA=1", NULL,
@@ -115,6 +115,118 @@ static enum ofono_radio_band_umts band_umts_from_huawei(unsigned int band)
 	return OFONO_RADIO_BAND_UMTS_ANY;
 }
 
+static gboolean band_to_huawei(enum ofono_radio_band_gsm band_gsm,
+				enum ofono_radio_band_umts band_umts,
+				unsigned int *huawei_band)
+{
+	unsigned int huawei_band_gsm;
+	unsigned int huawei_band_umts;
+
+	if (band_gsm == OFONO_RADIO_BAND_GSM_ANY
+			&& band_umts == OFONO_RADIO_BAND_UMTS_ANY) {
+		*huawei_band = HUAWEI_BAND_ANY;
+		return TRUE;
+	}
+
+	huawei_band_gsm = band_gsm_to_huawei(band_gsm);
+
+	if (!huawei_band_gsm)
+		return FALSE;
+
+	huawei_band_umts = band_umts_to_huawei(band_umts);
+
+	if (!huawei_band_umts)
+		return FALSE;
+
+	*huawei_band = huawei_band_gsm | huawei_band_umts;
+
+	return TRUE;
+}
+
+static gboolean syscfg_mode_from_value(int value, unsigned int *mode)
+{
+	switch (value) {
+	case 2:
+		*mode = OFONO_RADIO_ACCESS_MODE_ANY;
+		return TRUE;
+	case 13:
+		*mode = OFONO_RADIO_ACCESS_MODE_GSM;
+		return TRUE;
+	case 14:
+		*mode = OFONO_RADIO_ACCESS_MODE_UMTS;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean syscfg_mode_to_value(unsigned int mode, unsigned int *value,
+					unsigned int *acq_order)
+{
+	switch (mode) {
+	case OFONO_RADIO_ACCESS_MODE_ANY:
+		*value = 2;
+		*acq_order = 0;
+		return TRUE;
+	case OFONO_RADIO_ACCESS_MODE_GSM:
+		*value = 13;
+		*acq_order = 1;
+		return TRUE;
+	case OFONO_RADIO_ACCESS_MODE_UMTS:
+		*value = 14;
+		*acq_order = 2;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean syscfgex_mode_from_acqorder(const char *acqorder,
+						unsigned int *mode)
+{
+	if ((strcmp(acqorder, "00") == 0) ||
+			(strstr(acqorder, "01") &&
+				strstr(acqorder, "02") &&
+				strstr(acqorder, "03")))
+		*mode = OFONO_RADIO_ACCESS_MODE_ANY;
+	else if (strstr(acqorder, "0302"))
+		*mode = OFONO_RADIO_ACCESS_MODE_LTE |
+				OFONO_RADIO_ACCESS_MODE_UMTS;
+	else if (strstr(acqorder, "0201"))
+		*mode = OFONO_RADIO_ACCESS_MODE_UMTS |
+				OFONO_RADIO_ACCESS_MODE_GSM;
+	else if (strstr(acqorder, "03"))
+		*mode = OFONO_RADIO_ACCESS_MODE_LTE;
+	else if (strstr(acqorder, "02"))
+		*mode = OFONO_RADIO_ACCESS_MODE_UMTS;
+	else if (strstr(acqorder, "01"))
+		*mode = OFONO_RADIO_ACCESS_MODE_GSM;
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+static const char *syscfgex_mode_to_acqorder(unsigned int mode)
+{
+	switch (mode) {
+	case OFONO_RADIO_ACCESS_MODE_LTE | OFONO_RADIO_ACCESS_MODE_UMTS:
+		return "0302";
+	case OFONO_RADIO_ACCESS_MODE_UMTS | OFONO_RADIO_ACCESS_MODE_GSM:
+		return "0201";
+	case OFONO_RADIO_ACCESS_MODE_ANY:
+		return "00";
+	case OFONO_RADIO_ACCESS_MODE_GSM:
+		return "01";
+	case OFONO_RADIO_ACCESS_MODE_UMTS:
+		return "02";
+	case OFONO_RADIO_ACCESS_MODE_LTE:
+		return "03";
+	}
+
+	return "030201";
+}
+
 static void syscfg_query_mode_cb(gboolean ok, GAtResult *result,
 					gpointer user_data)
 {
@@ -140,20 +252,8 @@ static void syscfg_query_mode_cb(gboolean ok, GAtResult *result,
 	if (g_at_result_iter_next_number(&iter, &value) == FALSE)
 		goto error;
 
-	switch (value) {
-	case 2:
-		mode = OFONO_RADIO_ACCESS_MODE_ANY;
-		break;
-	case 13:
-		mode = OFONO_RADIO_ACCESS_MODE_GSM;
-		break;
-	case 14:
-		mode = OFONO_RADIO_ACCESS_MODE_UMTS;
-		break;
-	default:
-		CALLBACK_WITH_FAILURE(cb, -1, cbd->data);
-		return;
-	}
+	if (!syscfg_mode_from_value(value, &mode))
+		goto error;
 
 	cb(&error, mode, cbd->data);
 
@@ -188,22 +288,7 @@ static void syscfgex_query_mode_cb(gboolean ok, GAtResult *result,
 	if (g_at_result_iter_next_string(&iter, &acqorder) == FALSE)
 		goto error;
 
-	if ((strcmp(acqorder, "00") == 0) ||
-			(strstr(acqorder, "01") &&
-				strstr(acqorder, "02") &&
-				strstr(acqorder, "03")))
-		mode = OFONO_RADIO_ACCESS_MODE_ANY;
-	else if (strstr(acqorder, "0302"))
-		mode = (OFONO_RADIO_ACCESS_MODE_LTE | OFONO_RADIO_ACCESS_MODE_UMTS);
-	else if (strstr(acqorder, "0201"))
-		mode = (OFONO_RADIO_ACCESS_MODE_UMTS | OFONO_RADIO_ACCESS_MODE_GSM);
-	else if (strstr(acqorder, "03"))
-		mode = OFONO_RADIO_ACCESS_MODE_LTE;
-	else if (strstr(acqorder, "02"))
-		mode = OFONO_RADIO_ACCESS_MODE_UMTS;
-	else if (strstr(acqorder, "01"))
-		mode = OFONO_RADIO_ACCESS_MODE_GSM;
-	else
+	if (!syscfgex_mode_from_acqorder(acqorder, &mode))
 		goto error;
 
 	cb(&error, mode, cbd->data);
@@ -254,26 +339,10 @@ static void syscfg_set_rat_mode(struct radio_settings_data *rsd,
 {
 	struct cb_data *cbd = cb_data_new(cb, data);
 	char buf[40];
-	unsigned int value = 2, acq_order = 0;
+	unsigned int value, acq_order;
 
-	switch (mode) {
-	case OFONO_RADIO_ACCESS_MODE_ANY:
-		value = 2;
-		acq_order = 0;
-		break;
-	case OFONO_RADIO_ACCESS_MODE_GSM:
-		value = 13;
-		acq_order = 1;
-		break;
-	case OFONO_RADIO_ACCESS_MODE_UMTS:
-		value = 14;
-		acq_order = 2;
-		break;
-	case OFONO_RADIO_ACCESS_MODE_LTE:
+	if (!syscfg_mode_to_value(mode, &value, &acq_order))
 		goto error;
-	default:
-		goto error;
-	}
 
 	snprintf(buf, sizeof(buf), "AT^SYSCFG=%u,%u,40000000,2,4",
 							value, acq_order);
@@ -295,31 +364,8 @@ static void syscfgex_set_rat_mode(struct radio_settings_data *rsd,
 	struct cb_data *cbd = cb_data_new(cb, data);
 	char buf[50];
 	char *atcmd = "AT^SYSCFGEX=\"%s\",40000000,2,4,40000000,,";
-	char *acqorder = "030201";
-
-	switch (mode) {
-	case OFONO_RADIO_ACCESS_MODE_ANY:
-		acqorder = "00";
-		break;
-	case OFONO_RADIO_ACCESS_MODE_GSM:
-		acqorder = "01";
-		break;
-	case OFONO_RADIO_ACCESS_MODE_UMTS:
-		acqorder = "02";
-		break;
-	case OFONO_RADIO_ACCESS_MODE_LTE:
-		acqorder = "03";
-		break;
-	default:
-		break;
-	}
-
-	if (mode == (OFONO_RADIO_ACCESS_MODE_LTE | OFONO_RADIO_ACCESS_MODE_UMTS))
-		acqorder = "0302";
-	else if (mode == (OFONO_RADIO_ACCESS_MODE_UMTS | OFONO_RADIO_ACCESS_MODE_GSM))
-		acqorder = "0201";
 
-	snprintf(buf, sizeof(buf), atcmd, acqorder);
+	snprintf(buf, sizeof(buf), atcmd, syscfgex_mode_to_acqorder(mode));
 
 	if (g_at_chat_send(rsd->chat, buf, none_prefix,
 			syscfgxx_modify_mode_cb, cbd, g_free) > 0)
@@ -364,25 +410,8 @@ static void syscfgex_set_band(struct radio_settings_data *rsd,
 	char *atcmd = "AT^SYSCFGEX=\"99\",%x,2,4,40000000,,";
 	unsigned int huawei_band;
 
-	if (band_gsm == OFONO_RADIO_BAND_GSM_ANY
-			&& band_umts == OFONO_RADIO_BAND_UMTS_ANY) {
-		huawei_band = HUAWEI_BAND_ANY;
-	} else {
-		unsigned int huawei_band_gsm;
-		unsigned int huawei_band_umts;
-
-		huawei_band_gsm = band_gsm_to_huawei(band_gsm);
-
-		if (!huawei_band_gsm)
-			goto error;
-
-		huawei_band_umts = band_umts_to_huawei(band_umts);
-
-		if (!huawei_band_umts)
-			goto error;
-
-		huawei_band = huawei_band_gsm | huawei_band_umts;
-	}
+	if (!band_to_huawei(band_gsm, band_umts, &huawei_band))
+		goto error;
 
 	snprintf(buf, sizeof(buf), atcmd, huawei_band);
 
@@ -405,25 +434,8 @@ static void syscfg_set_band(struct radio_settings_data *rsd,
 	char buf[40];
 	unsigned int huawei_band;
 
-	if (band_gsm == OFONO_RADIO_BAND_GSM_ANY
-			&& band_umts == OFONO_RADIO_BAND_UMTS_ANY) {
-		huawei_band = HUAWEI_BAND_ANY;
-	} else {
-		unsigned int huawei_band_gsm;
-		unsigned int huawei_band_umts;
-
-		huawei_band_gsm = band_gsm_to_huawei(band_gsm);
-
-		if (!huawei_band_gsm)
-			goto error;
-
-		huawei_band_umts = band_umts_to_huawei(band_umts);
-
-		if (!huawei_band_umts)
-			goto error;
-
-		huawei_band = huawei_band_gsm | huawei_band_umts;
-	}
+	if (!band_to_huawei(band_gsm, band_umts, &huawei_band))
+		goto error;
 
 	snprintf(buf, sizeof(buf), "AT^SYSCFG=16,3,%x,2,4", huawei_band);
 
@@ -509,6 +521,171 @@ static void huawei_query_band(struct ofono_radio_settings *rs,
 	}
 }
 
+static void syscfg_query_settings_cb(gboolean ok, GAtResult *result,
+					gpointer user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_radio_settings_query_cb_t cb = cbd->cb;
+	struct ofono_error error;
+	GAtResultIter iter;
+	unsigned int mode;
+	unsigned int band;
+	const char *band_str;
+	int value;
+
+	decode_at_error(&error, g_at_result_final_response(result));
+
+	if (!ok) {
+		cb(&error, -1, -1, -1, cbd->data);
+		return;
+	}
+
+	g_at_result_iter_init(&iter, result);
+
+	if (g_at_result_iter_next(&iter, "^SYSCFG:") == FALSE)
+		goto error;
+
+	if (g_at_result_iter_next_number(&iter, &value) == FALSE)
+		goto error;
+
+	if (!syscfg_mode_from_value(value, &mode))
+		goto error;
+
+	if (g_at_result_iter_skip_next(&iter) == FALSE)
+		goto error;
+
+	if (g_at_result_iter_next_unquoted_string(&iter, &band_str) == FALSE)
+		goto error;
+
+	if (sscanf(band_str, "%x", &band) != 1)
+		goto error;
+
+	cb(&error, mode, band_gsm_from_huawei(band),
+				band_umts_from_huawei(band), cbd->data);
+
+	return;
+
+error:
+	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, cbd->data);
+}
+
+static void syscfgex_query_settings_cb(gboolean ok, GAtResult *result,
+					gpointer user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_radio_settings_query_cb_t cb = cbd->cb;
+	struct ofono_error error;
+	GAtResultIter iter;
+	unsigned int mode;
+	unsigned int band;
+	const char *acqorder;
+	const char *band_str;
+
+	decode_at_error(&error, g_at_result_final_response(result));
+
+	if (!ok) {
+		cb(&error, -1, -1, -1, cbd->data);
+		return;
+	}
+
+	g_at_result_iter_init(&iter, result);
+
+	if (g_at_result_iter_next(&iter, "^SYSCFGEX:") == FALSE)
+		goto error;
+
+	if (g_at_result_iter_next_string(&iter, &acqorder) == FALSE)
+		goto error;
+
+	if (!syscfgex_mode_from_acqorder(acqorder, &mode))
+		goto error;
+
+	if (g_at_result_iter_next_unquoted_string(&iter, &band_str) == FALSE)
+		goto error;
+
+	if (sscanf(band_str, "%x", &band) != 1)
+		goto error;
+
+	cb(&error, mode, band_gsm_from_huawei(band),
+				band_umts_from_huawei(band), cbd->data);
+
+	return;
+
+error:
+	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, cbd->data);
+}
+
+/*
+ * ^SYSCFG and ^SYSCFGEX carry both the access mode and the bands, so one
+ * query and one write cover what otherwise takes two rescans of the modem
+ */
+static void huawei_query_settings(struct ofono_radio_settings *rs,
+			ofono_radio_settings_query_cb_t cb, void *data)
+{
+	struct radio_settings_data *rsd = ofono_radio_settings_get_data(rs);
+	struct cb_data *cbd = cb_data_new(cb, data);
+
+	if (rsd->syscfgex_cap && g_at_chat_send(rsd->chat, "AT^SYSCFGEX?",
+					syscfgex_prefix,
+					syscfgex_query_settings_cb,
+					cbd, g_free) > 0)
+		return;
+
+	if (!rsd->syscfgex_cap && g_at_chat_send(rsd->chat, "AT^SYSCFG?",
+					syscfg_prefix,
+					syscfg_query_settings_cb,
+					cbd, g_free) > 0)
+		return;
+
+	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, data);
+	g_free(cbd);
+}
+
+static void syscfgxx_modify_settings_cb(gboolean ok, GAtResult *result,
+							gpointer user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_radio_settings_set_cb_t cb = cbd->cb;
+	struct ofono_error error;
+
+	decode_at_error(&error, g_at_result_final_response(result));
+	cb(&error, cbd->data);
+}
+
+static void huawei_set_settings(struct ofono_radio_settings *rs,
+				unsigned int mode,
+				enum ofono_radio_band_gsm band_gsm,
+				enum ofono_radio_band_umts band_umts,
+				ofono_radio_settings_set_cb_t cb,
+				void *data)
+{
+	struct radio_settings_data *rsd = ofono_radio_settings_get_data(rs);
+	struct cb_data *cbd = cb_data_new(cb, data);
+	char buf[64];
+	unsigned int huawei_band;
+	unsigned int value, acq_order;
+
+	if (!band_to_huawei(band_gsm, band_umts, &huawei_band))
+		goto error;
+
+	if (rsd->syscfgex_cap)
+		snprintf(buf, sizeof(buf),
+				"AT^SYSCFGEX=\"%s\",%x,2,4,40000000,,",
+				syscfgex_mode_to_acqorder(mode), huawei_band);
+	else if (syscfg_mode_to_value(mode, &value, &acq_order))
+		snprintf(buf, sizeof(buf), "AT^SYSCFG=%u,%u,%x,2,4",
+					value, acq_order, huawei_band);
+	else
+		goto error;
+
+	if (g_at_chat_send(rsd->chat, buf, none_prefix,
+				syscfgxx_modify_settings_cb, cbd, g_free) > 0)
+		return;
+
+error:
+	CALLBACK_WITH_FAILURE(cb, data);
+	g_free(cbd);
+}
+
 static void syscfg_support_cb(gboolean ok, GAtResult *result,
 				gpointer user_data)
 {
@@ -575,6 +752,8 @@ static const struct ofono_radio_settings_driver driver = {
 	.set_rat_mode		= huawei_set_rat_mode,
 	.query_band		= huawei_query_band,
 	.set_band		= huawei_set_band,
+	.query_settings		= huawei_query_settings,
+	.set_settings		= huawei_set_settings,
 };
 
 OFONO_ATOM_DRIVER_BUILTIN(radio_settings, huaweimodem, &driver)
@@ -37,10 +37,9 @@ static void cusd_parse(GAtResult *result, struct ofono_ussd *ussd)
 	GAtResultIter iter;
 	int status;
 	int dcs = 0;
-	const char *content;
 	unsigned char msg[160] = {0};
 	const unsigned char *msg_ptr = NULL;
-	long msg_len;
+	int msg_len;
 
 	g_at_result_iter_init(&iter, result);
 
@@ -50,16 +49,13 @@ static void cusd_parse(GAtResult *result, struct ofono_ussd *ussd)
 	if (!g_at_result_iter_next_number(&iter, &status))
 		return;
 
-	if (!g_at_result_iter_next_string(&iter, &content))
+	if (!g_at_result_iter_next_hexstring_buf(&iter, msg, sizeof(msg),
+							&msg_len))
 		goto out;
 
+	msg_ptr = msg;
 	g_at_result_iter_next_number(&iter, &dcs);
 
-	if (strlen(content) > sizeof(msg) * 2)
-		goto out;
-
-	msg_ptr = decode_hex_own_buf(content, -1, &msg_len, 0, msg);
-
 out:
 	ofono_ussd_notify(ussd, status, dcs, msg_ptr, msg_ptr ? msg_len : 0);
 }
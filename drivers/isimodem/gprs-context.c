@@ -59,6 +59,15 @@ struct context_data {
 
 	uint8_t handle;	/* GPDS context ID */
 	uint8_t type;
+
+	/* Setup runs in two branches joined in setup_joined() */
+	gboolean pipe_ready;
+	gboolean context_ready;
+	gboolean failed;
+	gint64 setup_start;
+
+	unsigned int activations;
+	unsigned int failures;
 };
 
 static gboolean client_reset(gpointer data)
@@ -71,13 +80,24 @@ static gboolean client_reset(gpointer data)
 	return FALSE;
 }
 
+static void log_pipe_stats(struct context_data *cd)
+{
+	const GIsiPipeStats *stats = g_isi_pipe_get_stats(cd->pipe);
+
+	DBG("pipe 0x%02x: %u requests, %u errors, create %u us, enable %u us",
+		g_isi_pipe_get_handle(cd->pipe), stats->requests,
+		stats->errors, stats->create_usec, stats->enable_usec);
+}
+
 static void reset_context(struct context_data *cd)
 {
 	if (cd == NULL)
 		return;
 
-	if (cd->pipe)
+	if (cd->pipe) {
+		log_pipe_stats(cd);
 		g_isi_pipe_destroy(cd->pipe);
+	}
 
 	if (cd->pep)
 		g_isi_pep_destroy(cd->pep);
@@ -93,6 +113,13 @@ typedef void (*ContextFailFunc)(struct context_data *cd);
 
 static void gprs_up_fail(struct context_data *cd)
 {
+	/* Both setup branches can fail, only the first one reports it */
+	if (cd->failed)
+		return;
+
+	cd->failed = TRUE;
+	cd->failures++;
+
 	reset_context(cd);
 	CALLBACK_WITH_FAILURE(cd->cb, cd->data);
 }
@@ -109,6 +136,10 @@ static gboolean check_resp(const GIsiMessage *msg, uint8_t id, size_t minlen,
 {
 	const uint8_t *data = g_isi_msg_data(msg);
 
+	/* Late answer to one setup branch after the other one failed */
+	if (cd->failed)
+		return FALSE;
+
 	if (g_isi_msg_error(msg) < 0) {
 		DBG("ISI message error: %d", g_isi_msg_error(msg));
 		goto error;
@@ -293,6 +324,13 @@ static void activate_ind_cb(const GIsiMessage *msg, void *opaque)
 		ofono_gprs_context_set_ipv6_dns_servers(cd->context, dns);
 	}
 
+	cd->activations++;
+
+	DBG("context 0x%02x up in %u us, %u activations, %u failures",
+		cd->handle,
+		(unsigned int) (g_get_monotonic_time() - cd->setup_start),
+		cd->activations, cd->failures);
+
 	CALLBACK_WITH_SUCCESS(cd->cb, cd->data);
 	return;
 
@@ -328,6 +366,38 @@ static void send_context_activate(GIsiClient *client, void *opaque)
 		gprs_up_fail(cd);
 }
 
+static void link_conf_cb(const GIsiMessage *msg, void *opaque)
+{
+	struct context_data *cd = opaque;
+
+	if (!check_resp(msg, GPDS_LL_CONFIGURE_RESP, 2, cd, gprs_up_fail))
+		return;
+
+	send_context_activate(cd->client, cd);
+}
+
+/*
+ * The context is configured and authenticated while the pipe is being
+ * created.  Binding the context to the pipe needs both, so it goes out
+ * once the second branch is done.
+ */
+static void setup_joined(struct context_data *cd)
+{
+	const uint8_t req[] = {
+		GPDS_LL_CONFIGURE_REQ,
+		cd->handle,	/* context ID */
+		g_isi_pipe_get_handle(cd->pipe),
+		GPDS_LL_PLAIN,	/* link type */
+	};
+
+	if (!cd->pipe_ready || !cd->context_ready)
+		return;
+
+	if (!g_isi_client_send(cd->client, req, sizeof(req), link_conf_cb,
+				cd, NULL))
+		gprs_up_fail(cd);
+}
+
 static void context_auth_cb(const GIsiMessage *msg, void *opaque)
 {
 	struct context_data *cd = opaque;
@@ -335,7 +405,8 @@ static void context_auth_cb(const GIsiMessage *msg, void *opaque)
 	if (!check_resp(msg, GPDS_CONTEXT_AUTH_RESP, 2, cd, gprs_up_fail))
 		return;
 
-	send_context_activate(cd->client, cd);
+	cd->context_ready = TRUE;
+	setup_joined(cd);
 }
 
 static void send_context_authenticate(GIsiClient *client, void *opaque)
@@ -392,15 +463,17 @@ static void context_conf_cb(const GIsiMessage *msg, void *opaque)
 	if (!check_resp(msg, GPDS_CONTEXT_CONFIGURE_RESP, 2, cd, gprs_up_fail))
 		return;
 
-	if (cd->username[0] != '\0')
+	if (cd->username[0] != '\0') {
 		send_context_authenticate(cd->client, cd);
-	else
-		send_context_activate(cd->client, cd);
+		return;
+	}
+
+	cd->context_ready = TRUE;
+	setup_joined(cd);
 }
 
-static void link_conf_cb(const GIsiMessage *msg, void *opaque)
+static void send_context_configure(struct context_data *cd)
 {
-	struct context_data *cd = opaque;
 	size_t apn_len = strlen(cd->apn);
 	size_t sb_apn_info_len = ALIGN4(3 + apn_len);
 	size_t apn_pad_len = sb_apn_info_len - (3 + apn_len);
@@ -430,9 +503,6 @@ static void link_conf_cb(const GIsiMessage *msg, void *opaque)
 		{ (uint8_t *) padding, apn_pad_len },
 	};
 
-	if (!check_resp(msg, GPDS_LL_CONFIGURE_RESP, 2, cd, gprs_up_fail))
-		return;
-
 	if (!g_isi_client_vsend(cd->client, iov, 3, context_conf_cb, cd, NULL))
 		gprs_up_fail(cd);
 }
@@ -442,34 +512,23 @@ static void create_context_cb(const GIsiMessage *msg, void *opaque)
 	struct context_data *cd = opaque;
 	const uint8_t *data = g_isi_msg_data(msg);
 
-	uint8_t req[] = {
-		GPDS_LL_CONFIGURE_REQ,
-		0x00,		/* GPDS context ID, added later */
-		g_isi_pipe_get_handle(cd->pipe),
-		GPDS_LL_PLAIN,	/* link type */
-	};
-
 	if (!check_resp(msg, GPDS_CONTEXT_ID_CREATE_RESP, 2, cd, gprs_up_fail))
 		return;
 
-	cd->handle = req[1] = data[0];
+	cd->handle = data[0];
 
-	if (!g_isi_client_send(cd->client, req, sizeof(req), link_conf_cb,
-				cd, NULL))
-		gprs_up_fail(cd);
+	send_context_configure(cd);
 }
 
 static void create_pipe_cb(GIsiPipe *pipe)
 {
 	struct context_data *cd = g_isi_pipe_get_userdata(pipe);
 
-	const uint8_t msg[] = {
-		GPDS_CONTEXT_ID_CREATE_REQ,
-	};
+	DBG("pipe 0x%02x created in %u us", g_isi_pipe_get_handle(pipe),
+		g_isi_pipe_get_stats(pipe)->create_usec);
 
-	if (!g_isi_client_send(cd->client, msg, sizeof(msg), create_context_cb,
-				cd, NULL))
-		gprs_up_fail(cd);
+	cd->pipe_ready = TRUE;
+	setup_joined(cd);
 }
 
 static void isi_gprs_activate_primary(struct ofono_gprs_context *gc,
@@ -478,6 +537,10 @@ static void isi_gprs_activate_primary(struct ofono_gprs_context *gc,
 {
 	struct context_data *cd = ofono_gprs_context_get_data(gc);
 
+	const uint8_t create_req[] = {
+		GPDS_CONTEXT_ID_CREATE_REQ,
+	};
+
 	DBG("activate: gpds = 0x%04x", cd->gpds);
 
 	if (cd == NULL || !cd->gpds) {
@@ -498,6 +561,10 @@ static void isi_gprs_activate_primary(struct ofono_gprs_context *gc,
 	cd->pep = NULL;
 	cd->pipe = NULL;
 	cd->handle = INVALID_ID;
+	cd->pipe_ready = FALSE;
+	cd->context_ready = FALSE;
+	cd->failed = FALSE;
+	cd->setup_start = g_get_monotonic_time();
 
 	switch (ctx->proto) {
 	case OFONO_GPRS_PROTO_IP:
@@ -541,6 +608,12 @@ static void isi_gprs_activate_primary(struct ofono_gprs_context *gc,
 		goto error;
 
 	g_isi_pipe_set_userdata(cd->pipe, cd);
+
+	/* The context is set up while the pipe is being created */
+	if (!g_isi_client_send(cd->client, create_req, sizeof(create_req),
+				create_context_cb, cd, NULL))
+		goto error;
+
 	return;
 
 error:
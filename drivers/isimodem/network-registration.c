@@ -884,6 +884,7 @@ static gboolean parse_nettime(GIsiSubBlockIter *iter,
 		info->utcoff *= -1;
 
 	info->dst = time->dst != NET_INVALID_TIME ? time->dst : -1;
+	info->received = l_time_now();
 	return TRUE;
 }
 
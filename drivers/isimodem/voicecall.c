@@ -1784,6 +1784,7 @@ static void isi_swap_without_accept(struct ofono_voicecall *ovc,
 	isi_call_control_req(ovc, id, op, 0, cb, data);
 }
 
+/* CALL_DTMF_STRING carries pauses too, the modem times them itself */
 static void isi_send_tones(struct ofono_voicecall *ovc, const char *tones,
 				ofono_voicecall_cb_t cb, void *data)
 {
@@ -1936,6 +1937,7 @@ static const struct ofono_voicecall_driver driver = {
 	.deflect		= isi_deflect,
 	.swap_without_accept	= isi_swap_without_accept,
 	.send_tones		= isi_send_tones,
+	.send_tone_string	= isi_send_tones,
 };
 
 OFONO_ATOM_DRIVER_BUILTIN(voicecall, isimodem, &driver)
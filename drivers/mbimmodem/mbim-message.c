@@ -122,6 +122,140 @@ static bool is_fixed_size(const char *sig_start, const char *sig_end)
 	return true;
 }
 
+/*
+ * The shape of a signature as the iterators need it, worked out once per
+ * signature instead of on every entry.  There is one entry for every
+ * character of the signature, describing the complete type starting there.
+ */
+struct mbim_signature_entry {
+	uint8_t span;		/* Characters in the type, 0 if malformed */
+	bool fixed : 1;		/* No 'a', 's' or 'v' anywhere in the type */
+	uint32_t count;		/* Bytes in a fixed 'Ny' array */
+};
+
+struct signature_program {
+	char *signature;
+	size_t len;
+	struct mbim_signature_entry entries[];
+};
+
+/* Signatures are string constants, so these are kept for good */
+static struct l_hashmap *signature_programs;
+
+static uint8_t compile_type(const char *sig, size_t len, size_t i,
+				struct mbim_signature_entry *entries)
+{
+	struct mbim_signature_entry *entry = &entries[i];
+	size_t j;
+
+	entry->span = 0;
+	entry->fixed = true;
+	entry->count = 0;
+
+	switch (sig[i]) {
+	case '(':
+		for (j = i + 1; j < len && sig[j] != ')';) {
+			uint8_t span = compile_type(sig, len, j, entries);
+
+			if (!span)
+				return 0;
+
+			if (!entries[j].fixed)
+				entry->fixed = false;
+
+			j += span;
+		}
+
+		if (j == len)
+			return 0;
+
+		entries[j].span = 1;
+		entries[j].fixed = true;
+		entries[j].count = 0;
+		entry->span = j - i + 1;
+		break;
+	case 'a':
+		if (i + 1 == len || !compile_type(sig, len, i + 1, entries))
+			return 0;
+
+		entry->span = entries[i + 1].span + 1;
+		entry->fixed = false;
+		break;
+	case '0' ... '9':
+		for (j = i; j < len && sig[j] >= '0' && sig[j] <= '9'; j++) {
+			entry->count = entry->count * 10 + sig[j] - '0';
+			entries[j].span = 0;
+		}
+
+		if (j == len || sig[j] != 'y')
+			return 0;
+
+		entries[j].span = 1;
+		entries[j].fixed = true;
+		entries[j].count = 0;
+		entry->span = j - i + 1;
+		break;
+	case 's':
+	case 'v':
+		entry->span = 1;
+		entry->fixed = false;
+		break;
+	default:
+		entry->span = 1;
+		break;
+	}
+
+	return entry->span;
+}
+
+static const struct mbim_signature_entry *signature_entries(
+						const char *signature,
+						size_t len)
+{
+	struct signature_program *program;
+	size_t i;
+
+	if (!signature_programs)
+		signature_programs = l_hashmap_new();
+
+	program = l_hashmap_lookup(signature_programs, signature);
+
+	/* Nothing stops a caller from building a signature at runtime */
+	if (program && program->len == len &&
+			!memcmp(program->signature, signature, len))
+		return program->entries;
+
+	if (program) {
+		l_hashmap_remove(signature_programs, signature);
+		l_free(program->signature);
+		l_free(program);
+	}
+
+	program = l_malloc(sizeof(struct signature_program) +
+				len * sizeof(struct mbim_signature_entry));
+	program->signature = l_strndup(signature, len);
+	program->len = len;
+
+	for (i = 0; i < len;) {
+		uint8_t span = compile_type(signature, len, i,
+						program->entries);
+
+		/* The rest stays unreadable */
+		if (!span) {
+			for (; i < len; i++)
+				program->entries[i].span = 0;
+
+			break;
+		}
+
+		i += span;
+	}
+
+	l_hashmap_insert(signature_programs, signature, program);
+
+	return program->entries;
+}
+
 static inline const void *_iter_get_data(struct mbim_message_iter *iter,
 						size_t pos)
 {
@@ -192,13 +326,18 @@ static bool _iter_copy_string(struct mbim_message_iter *iter,
 	return true;
 }
 
+/*
+ * sig_entries describe sig_start onwards, iterators over a part of their
+ * parent's signature share its entries
+ */
 static inline void _iter_init_internal(struct mbim_message_iter *iter,
-					char container_type,
-					const char *sig_start,
-					const char *sig_end,
-					const struct iovec *iov, uint32_t n_iov,
-					size_t len, size_t base_offset,
-					size_t pos, uint32_t n_elem)
+				char container_type,
+				const char *sig_start,
+				const char *sig_end,
+				const struct mbim_signature_entry *sig_entries,
+				const struct iovec *iov, uint32_t n_iov,
+				size_t len, size_t base_offset,
+				size_t pos, uint32_t n_elem)
 {
 	size_t sig_len;
 
@@ -207,7 +346,11 @@ static inline void _iter_init_internal(struct mbim_message_iter *iter,
 	else
 		sig_len = strlen(sig_start);
 
+	if (!sig_entries)
+		sig_entries = signature_entries(sig_start, sig_len);
+
 	iter->sig_start = sig_start;
+	iter->sig_entries = sig_entries;
 	iter->sig_len = sig_len;
 	iter->sig_pos = 0;
 	iter->iov = iov;
@@ -309,6 +452,7 @@ static bool _iter_enter_array(struct mbim_message_iter *iter,
 	uint32_t n_elem;
 	const char *sig_start;
 	const char *sig_end;
+	const struct mbim_signature_entry *element;
 	const void *data;
 	bool fixed;
 	uint32_t offset;
@@ -316,18 +460,20 @@ static bool _iter_enter_array(struct mbim_message_iter *iter,
 	if (iter->container_type == CONTAINER_TYPE_ARRAY && !iter->n_elem)
 		return false;
 
-	if (iter->sig_start[iter->sig_pos] != 'a')
+	if (iter->sig_start[iter->sig_pos] != 'a' ||
+			!iter->sig_entries[iter->sig_pos].span)
 		return false;
 
+	element = &iter->sig_entries[iter->sig_pos + 1];
 	sig_start = iter->sig_start + iter->sig_pos + 1;
-	sig_end = _signature_end(sig_start) + 1;
+	sig_end = sig_start + element->span;
 
 	/*
 	 * Two possibilities:
 	 * 1. Element Count, followed by OL_PAIR_LIST
 	 * 2. Offset, followed by element length or size for raw buffers
 	 */
-	fixed = is_fixed_size(sig_start, sig_end);
+	fixed = element->fixed;
 
 	if (fixed) {
 		pos = align_len(iter->pos, 4);
@@ -354,7 +500,7 @@ static bool _iter_enter_array(struct mbim_message_iter *iter,
 _Pragma("GCC diagnostic push")
 _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
 		_iter_init_internal(array, CONTAINER_TYPE_ARRAY,
-					sig_start, sig_end,
+					sig_start, sig_end, element,
 					iter->iov, iter->n_iov,
 					iter->len, iter->base_offset,
 					offset, n_elem);
@@ -363,7 +509,7 @@ _Pragma("GCC diagnostic pop")
 	}
 
 	_iter_init_internal(array, CONTAINER_TYPE_ARRAY, sig_start, sig_end,
-				iter->iov, iter->n_iov,
+				element, iter->iov, iter->n_iov,
 				iter->len, iter->base_offset, pos, n_elem);
 
 	iter->pos = pos + 8 * n_elem;
@@ -379,6 +525,7 @@ static bool _iter_enter_struct(struct mbim_message_iter *iter,
 	size_t pos;
 	const char *sig_start;
 	const char *sig_end;
+	const struct mbim_signature_entry *entry;
 	const void *data;
 
 	if (iter->container_type == CONTAINER_TYPE_ARRAY && !iter->n_elem)
@@ -387,11 +534,15 @@ static bool _iter_enter_struct(struct mbim_message_iter *iter,
 	if (iter->sig_start[iter->sig_pos] != '(')
 		return false;
 
+	entry = &iter->sig_entries[iter->sig_pos];
+	if (!entry->span)
+		return false;
+
 	sig_start = iter->sig_start + iter->sig_pos + 1;
-	sig_end = _signature_end(iter->sig_start + iter->sig_pos);
+	sig_end = iter->sig_start + iter->sig_pos + entry->span - 1;
 
 	/* TODO: support fixed size structures */
-	if (is_fixed_size(sig_start, sig_end))
+	if (entry->fixed)
 		return false;
 
 	pos = align_len(iter->pos, 4);
@@ -405,7 +556,8 @@ static bool _iter_enter_struct(struct mbim_message_iter *iter,
 	len = l_get_le32(data);
 
 	_iter_init_internal(structure, CONTAINER_TYPE_STRUCT,
-				sig_start, sig_end, iter->iov, iter->n_iov,
+				sig_start, sig_end, entry + 1,
+				iter->iov, iter->n_iov,
 				len, iter->base_offset + offset, 0, 0);
 
 	if (iter->container_type != CONTAINER_TYPE_ARRAY)
@@ -424,7 +576,7 @@ static bool _iter_enter_databuf(struct mbim_message_iter *iter,
 		return false;
 
 	_iter_init_internal(databuf, CONTAINER_TYPE_DATABUF,
-				signature, NULL, iter->iov, iter->n_iov,
+				signature, NULL, NULL, iter->iov, iter->n_iov,
 				iter->len - iter->pos,
 				iter->base_offset + iter->pos, 0, 0);
 
@@ -438,7 +590,7 @@ static bool message_iter_next_entry_valist(struct mbim_message_iter *orig,
 {
 	struct mbim_message_iter *iter = orig;
 	const char *signature = orig->sig_start + orig->sig_pos;
-	const char *end;
+	const struct mbim_signature_entry *entry;
 	uint32_t *out_n_elem;
 	struct mbim_message_iter *sub_iter;
 	struct mbim_message_iter stack[MAX_NESTING];
@@ -466,9 +618,12 @@ static bool message_iter_next_entry_valist(struct mbim_message_iter *orig,
 			if (iter->pos >= iter->len)
 				return false;
 
+			entry = &orig->sig_entries[signature - orig->sig_start];
+			if (!entry->span)
+				return false;
+
 			pos = align_len(iter->pos, 4);
-			end = _signature_end(signature);
-			n_elem = strtol(signature, NULL, 10);
+			n_elem = entry->count;
 
 			if (pos + n_elem > iter->len)
 				return false;
@@ -483,7 +638,7 @@ static bool message_iter_next_entry_valist(struct mbim_message_iter *orig,
 			src = _iter_get_data(iter, pos + i);
 			memcpy(arg + i, src, n_elem - i);
 			iter->pos = pos + n_elem;
-			signature = end + 1;
+			signature += entry->span;
 			break;
 		}
 		case '(':
@@ -520,8 +675,8 @@ static bool message_iter_next_entry_valist(struct mbim_message_iter *orig,
 
 			*out_n_elem = sub_iter->n_elem;
 
-			end = _signature_end(signature + 1);
-			signature = end + 1;
+			entry = &orig->sig_entries[signature - orig->sig_start];
+			signature += entry->span;
 			break;
 		case 'd':
 		{
@@ -709,7 +864,7 @@ struct mbim_message *_mbim_message_build(const void *header,
 	switch (L_LE32_TO_CPU(hdr->type)) {
 	case MBIM_COMMAND_DONE:
 		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuuu", NULL,
+						"16yuuu", NULL, NULL,
 						frags, n_frags,
 						frags[0].iov_len, 0, 0, 0);
 		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
@@ -718,7 +873,7 @@ struct mbim_message *_mbim_message_build(const void *header,
 		break;
 	case MBIM_COMMAND_MSG:
 		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuuu", NULL,
+						"16yuuu", NULL, NULL,
 						frags, n_frags,
 						frags[0].iov_len, 0, 0, 0);
 		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
@@ -727,7 +882,7 @@ struct mbim_message *_mbim_message_build(const void *header,
 		break;
 	case MBIM_INDICATE_STATUS_MSG:
 		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuu", NULL,
+						"16yuu", NULL, NULL,
 						frags, n_frags,
 						frags[0].iov_len, 0, 0, 0);
 		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
@@ -800,7 +955,7 @@ bool mbim_message_get_arguments(struct mbim_message *message,
 	begin = _mbim_information_buffer_offset(type);
 
 	_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-				signature, NULL,
+				signature, NULL, NULL,
 				message->frags, message->n_frags,
 				message->info_buf_len, begin, 0, 0);
 
@@ -834,7 +989,7 @@ static bool _mbim_message_get_data(struct mbim_message *message,
 	begin = _mbim_information_buffer_offset(type);
 
 	_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-				"", NULL,
+				"", NULL, NULL,
 				message->frags, message->n_frags,
 				message->info_buf_len, begin, offset, 0);
 
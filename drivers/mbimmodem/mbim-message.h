@@ -11,6 +11,7 @@
 
 struct mbim_message;
 struct mbim_message_iter;
+struct mbim_signature_entry;
 
 enum mbim_command_type {
 	MBIM_COMMAND_TYPE_QUERY = 0,
@@ -19,6 +20,7 @@ enum mbim_command_type {
 
 struct mbim_message_iter {
 	const char *sig_start;
+	const struct mbim_signature_entry *sig_entries;
 	uint8_t sig_len;
 	uint8_t sig_pos;
 	const struct iovec *iov;
@@ -107,13 +107,22 @@ const uint8_t mbim_context_type_local[] = {
 	0x03, 0x3C, 0x39, 0xF6, 0x0D, 0xB9,
 };
 
+/*
+ * Fragments are read straight into a buffer with room for all of them, the
+ * message is built on top of it without copying.  Limits what a broken
+ * fragment header can make us reserve.
+ */
+#define MAX_FRAGMENTS 128
+
 struct message_assembly_node {
 	struct mbim_message_header msg_hdr;
 	struct mbim_fragment_header frag_hdr;
-	struct iovec *iov;
-	size_t n_iov;
-	size_t cur_iov;
-} __attribute((packed))__;
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	uint32_t n_frags;
+	uint32_t cur_frag;
+};
 
 struct message_assembly {
 	struct l_queue *transactions;
@@ -130,12 +139,8 @@ static bool message_assembly_node_match_tid(const void *a, const void *b)
 static void message_assembly_node_free(void *data)
 {
 	struct message_assembly_node *node = data;
-	size_t i;
-
-	for (i = 0; i < node->n_iov; i++)
-		l_free(node->iov[i].iov_base);
 
-	l_free(node->iov);
+	l_free(node->buf);
 	l_free(node);
 }
 
@@ -154,6 +159,53 @@ static void message_assembly_free(struct message_assembly *assembly)
 	l_free(assembly);
 }
 
+/*
+ * Returns where the next fragment of tid should be read to, or NULL if no
+ * message is being assembled for it
+ */
+static void *message_assembly_next(struct message_assembly *assembly,
+					uint32_t tid, size_t frag_len)
+{
+	struct message_assembly_node *node;
+
+	node = l_queue_find(assembly->transactions,
+				message_assembly_node_match_tid,
+				L_UINT_TO_PTR(tid));
+	if (!node)
+		return NULL;
+
+	/* Only a modem with fragments larger than the first gets here */
+	if (frag_len > node->size - node->len) {
+		node->size = node->len +
+				frag_len * (node->n_frags - node->cur_frag - 1);
+		node->buf = l_realloc(node->buf, node->size);
+	}
+
+	return node->buf + node->len;
+}
+
+static struct mbim_message *message_assembly_build(const void *header,
+						void *buf, size_t len)
+{
+	struct iovec *iov = l_new(struct iovec, 1);
+	struct mbim_message *message;
+
+	iov[0].iov_base = buf;
+	iov[0].iov_len = len;
+
+	message = _mbim_message_build(header, iov, 1);
+	if (!message) {
+		l_free(buf);
+		l_free(iov);
+	}
+
+	return message;
+}
+
+/*
+ * frag is either where message_assembly_next() said to put it, or a buffer
+ * of its own which is taken over.
+ */
 static struct mbim_message *message_assembly_add(
 					struct message_assembly *assembly,
 					const void *header,
@@ -169,62 +221,58 @@ static struct mbim_message *message_assembly_add(
 	struct message_assembly_node *node;
 	struct mbim_message *message;
 
-	if (type != MBIM_COMMAND_DONE && type != MBIM_INDICATE_STATUS_MSG)
-		return NULL;
-
 	node = l_queue_find(assembly->transactions,
 				message_assembly_node_match_tid,
 				L_UINT_TO_PTR(tid));
 
-	if (!node) {
-		if (cur_frag != 0)
+	if (node && frag == node->buf + node->len) {
+		if (node->n_frags != n_frags || node->cur_frag + 1 != cur_frag) {
+			l_queue_remove(assembly->transactions, node);
+			message_assembly_node_free(node);
 			return NULL;
+		}
 
-		if (n_frags == 1) {
-			struct iovec *iov = l_new(struct iovec, 1);
-
-			iov[0].iov_base = frag;
-			iov[0].iov_len = frag_len;
+		node->cur_frag = cur_frag;
+		node->len += frag_len;
 
-			return _mbim_message_build(header, iov, 1);
-		}
+		if (node->cur_frag + 1 < node->n_frags)
+			return NULL;
 
-		node = l_new(struct message_assembly_node, 1);
-		memcpy(&node->msg_hdr, msg_hdr, sizeof(*msg_hdr));
-		memcpy(&node->frag_hdr, frag_hdr, sizeof(*frag_hdr));
-		node->iov = l_new(struct iovec, n_frags);
-		node->n_iov = n_frags;
-		node->cur_iov = cur_frag;
-		node->iov[node->cur_iov].iov_base = frag;
-		node->iov[node->cur_iov].iov_len = frag_len;
+		l_queue_remove(assembly->transactions, node);
+		node->msg_hdr.len = L_CPU_TO_LE32(HEADER_SIZE + node->len);
 
-		l_queue_push_head(assembly->transactions, node);
+		/* Give back what the last fragment didn't need */
+		message = message_assembly_build(&node->msg_hdr,
+					l_realloc(node->buf, node->len),
+					node->len);
+		l_free(node);
 
-		return NULL;
+		return message;
 	}
 
-	if (node->n_iov != n_frags)
-		return NULL;
-
-	if (node->cur_iov + 1 != cur_frag)
+	if (node || cur_frag != 0 || !n_frags || n_frags > MAX_FRAGMENTS ||
+			(type != MBIM_COMMAND_DONE &&
+				type != MBIM_INDICATE_STATUS_MSG)) {
+		l_free(frag);
 		return NULL;
+	}
 
-	node->cur_iov = cur_frag;
-	node->iov[node->cur_iov].iov_base = frag;
-	node->iov[node->cur_iov].iov_len = frag_len;
-
-	if (node->cur_iov + 1 < node->n_iov)
-		return NULL;
+	if (n_frags == 1)
+		return message_assembly_build(header, frag, frag_len);
 
-	l_queue_remove(assembly->transactions, node);
-	message = _mbim_message_build(&node->msg_hdr, node->iov, node->n_iov);
+	/* Every fragment but the last one is as large as the first */
+	node = l_new(struct message_assembly_node, 1);
+	memcpy(&node->msg_hdr, msg_hdr, sizeof(*msg_hdr));
+	memcpy(&node->frag_hdr, frag_hdr, sizeof(*frag_hdr));
+	node->size = frag_len * n_frags;
+	node->buf = l_realloc(frag, node->size);
+	node->len = frag_len;
+	node->n_frags = n_frags;
+	node->cur_frag = cur_frag;
 
-	if (!message)
-		message_assembly_node_free(node);
-	else
-		l_free(node);
+	l_queue_push_head(assembly->transactions, node);
 
-	return message;
+	return NULL;
 }
 
 struct mbim_device {
@@ -237,6 +285,8 @@ struct mbim_device {
 	mbim_device_debug_func_t debug_handler;
 	void *debug_data;
 	mbim_device_destroy_func_t debug_destroy;
+	mbim_device_trace_func_t trace_handler;
+	void *trace_data;
 	mbim_device_disconnect_func_t disconnect_handler;
 	void *disconnect_data;
 	mbim_device_destroy_func_t disconnect_destroy;
@@ -247,6 +297,9 @@ struct mbim_device {
 	size_t header_offset;
 	size_t segment_bytes_remaining;
 	void *segment;
+	uint8_t *body;
+	size_t body_offset;
+	void *fragment;
 	struct l_queue *pending_commands;
 	struct l_queue *sent_commands;
 	struct l_queue *notifications;
@@ -402,6 +455,16 @@ static void disconnect_handler(struct l_io *io, void *user_data)
 		device->disconnect_handler(device->disconnect_data);
 }
 
+static void device_trace(struct mbim_device *device, bool in,
+					const void *data, size_t len)
+{
+	if (!device->trace_handler || !len)
+		return;
+
+	device->trace_handler(in, l_io_get_fd(device->io), data, len,
+					device->trace_data);
+}
+
 static int receive_header(struct mbim_device *device, int fd)
 {
 	size_t to_read = sizeof(struct mbim_message_header) -
@@ -417,6 +480,7 @@ static int receive_header(struct mbim_device *device, int fd)
 		return false;
 	}
 
+	device_trace(device, true, device->header + device->header_offset, len);
 	l_util_hexdump(true, device->header + device->header_offset, len,
 				device->debug_handler, device->debug_data);
 	device->header_offset += len;
@@ -477,6 +541,7 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 		if (written < 0)
 			return false;
 
+		device_trace(device, false, buf, written);
 		l_util_hexdump(false, buf, written, device->debug_handler,
 				device->debug_data);
 	} else {
@@ -586,17 +651,43 @@ static void dispatch_message(struct mbim_device *device, uint32_t type,
 	}
 }
 
+/*
+ * Picks where the body of the segment whose header was just read goes:
+ * the buffer of the message being reassembled, a buffer of its own that
+ * becomes part of the message, or the scratch segment if it is dropped
+ */
+static uint8_t *segment_body(struct mbim_device *device, uint32_t type,
+					uint32_t tid, size_t len)
+{
+	uint8_t *body;
+
+	if (type != MBIM_COMMAND_DONE && type != MBIM_INDICATE_STATUS_MSG)
+		return device->segment;
+
+	if (!len)
+		return device->segment;
+
+	body = message_assembly_next(device->assembly, tid, len);
+	if (body)
+		return body;
+
+	device->fragment = l_malloc(len);
+	return device->fragment;
+}
+
 static bool command_read_handler(struct l_io *io, void *user_data)
 {
 	struct mbim_device *device = user_data;
 	ssize_t len;
 	uint32_t type;
+	uint32_t msg_len;
 	int fd;
 	struct mbim_message_header *hdr;
 	struct iovec iov[2];
 	uint32_t n_iov = 0;
 	uint32_t header_size;
 	struct mbim_message *message;
+	uint8_t *body;
 	uint32_t i;
 
 	fd = l_io_get_fd(io);
@@ -611,17 +702,28 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 
 	hdr = (struct mbim_message_header *) device->header;
 	type = L_LE32_TO_CPU(hdr->type);
-
-	if (device->segment_bytes_remaining == 0)
-		device->segment_bytes_remaining =
-					L_LE32_TO_CPU(hdr->len) -
-					sizeof(struct mbim_message_header);
+	msg_len = L_LE32_TO_CPU(hdr->len);
 
 	if (type == MBIM_COMMAND_DONE || type == MBIM_INDICATE_STATUS_MSG)
 		header_size = HEADER_SIZE;
 	else
 		header_size = sizeof(struct mbim_message_header);
 
+	if (!device->body) {
+		if (msg_len < header_size || msg_len > device->max_segment_size) {
+			l_util_debug(device->debug_handler, device->debug_data,
+					"Invalid segment length: %u", msg_len);
+			return false;
+		}
+
+		device->segment_bytes_remaining = msg_len -
+					sizeof(struct mbim_message_header);
+		device->body_offset = 0;
+		device->body = segment_body(device, type,
+						L_LE32_TO_CPU(hdr->tid),
+						msg_len - header_size);
+	}
+
 	/* Put the rest of the header into the first chunk */
 	if (device->header_offset < header_size) {
 		iov[n_iov].iov_base = device->header + device->header_offset;
@@ -629,57 +731,61 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 		n_iov += 1;
 	}
 
-	l_info("hdr->len: %u", L_LE32_TO_CPU(hdr->len));
-	l_info("header_size: %u", header_size);
-	l_info("header_offset: %zu", device->header_offset);
-	l_info("segment_bytes_remaining: %zu", device->segment_bytes_remaining);
-
-	iov[n_iov].iov_base = device->segment + L_LE32_TO_CPU(hdr->len) -
-				device->header_offset -
-				device->segment_bytes_remaining;
-	iov[n_iov].iov_len = device->segment_bytes_remaining -
-				(header_size - device->header_offset);
+	iov[n_iov].iov_base = device->body + device->body_offset;
+	iov[n_iov].iov_len = msg_len - header_size - device->body_offset;
 	n_iov += 1;
 
-	len = L_TFR(readv(fd, iov, n_iov));
-	if (len < 0) {
-		if (errno == EAGAIN)
-			return true;
+	if (device->segment_bytes_remaining > 0) {
+		len = L_TFR(readv(fd, iov, n_iov));
+		if (len < 0) {
+			if (errno == EAGAIN)
+				return true;
 
-		return false;
-	}
+			return false;
+		}
+	} else
+		len = 0;
 
 	device->segment_bytes_remaining -= len;
 
-	if (n_iov == 2) {
-		if ((size_t) len >= iov[0].iov_len)
-			device->header_offset += iov[0].iov_len;
+	for (i = 0; i < n_iov; i++) {
+		size_t n = (size_t) len < iov[i].iov_len ? (size_t) len :
+								iov[i].iov_len;
+
+		/* The body always comes last */
+		if (i + 1 < n_iov)
+			device->header_offset += n;
 		else
-			device->header_offset += len;
-	}
+			device->body_offset += n;
 
-	for (i = 0; i < n_iov; i++) {
-		if ((size_t) len < iov[i].iov_len) {
-			iov[i].iov_len = len;
-			n_iov = i;
+		if (n < iov[i].iov_len) {
+			iov[i].iov_len = n;
+			n_iov = i + 1;
 			break;
 		}
 
-		len -= iov[i].iov_len;
+		len -= n;
 	}
 
+	for (i = 0; i < n_iov; i++)
+		device_trace(device, true, iov[i].iov_base, iov[i].iov_len);
+
 	l_util_hexdumpv(true, iov, n_iov,
 				device->debug_handler, device->debug_data);
 
 	if (device->segment_bytes_remaining > 0)
 		return true;
 
+	body = device->body;
+	device->body = NULL;
+	device->fragment = NULL;
 	device->header_offset = 0;
-	message = message_assembly_add(device->assembly, device->header,
-					device->segment,
-					L_LE32_TO_CPU(hdr->len) - header_size);
-	device->segment = l_malloc(device->max_segment_size - HEADER_SIZE);
 
+	if (body == device->segment)
+		return true;
+
+	message = message_assembly_add(device->assembly, device->header,
+					body, msg_len - header_size);
 	if (!message)
 		return true;
 
@@ -706,6 +812,7 @@ static bool open_write_handler(struct l_io *io, void *user_data)
 	if (written < 0)
 		return false;
 
+	device_trace(device, false, buf, written);
 	l_util_hexdump(false, buf, written,
 				device->debug_handler, device->debug_data);
 
@@ -752,6 +859,7 @@ static bool open_read_handler(struct l_io *io, void *user_data)
 		return false;
 	}
 
+	device_trace(device, true, buf, len);
 	l_util_hexdump(true, buf, len,
 				device->debug_handler, device->debug_data);
 	device->segment_bytes_remaining -= len;
@@ -801,6 +909,7 @@ static bool close_write_handler(struct l_io *io, void *user_data)
 	if (written < 0)
 		return false;
 
+	device_trace(device, false, buf, written);
 	l_util_hexdump(false, buf, written,
 				device->debug_handler, device->debug_data);
 
@@ -859,6 +968,7 @@ static bool close_read_handler(struct l_io *io, void *user_data)
 		return false;
 	}
 
+	device_trace(device, true, buf, len);
 	l_util_hexdump(true, buf, len,
 				device->debug_handler, device->debug_data);
 	device->segment_bytes_remaining -= len;
@@ -892,7 +1002,8 @@ struct mbim_device *mbim_device_new(int fd, uint32_t max_segment_size)
 	device->next_tid = 1;
 	device->next_notification = 1;
 
-	device->segment = l_malloc(max_segment_size - HEADER_SIZE);
+	/* Scratch space for the segments nothing is reassembled from */
+	device->segment = l_malloc(max_segment_size);
 
 	device->io = l_io_new(fd);
 	l_io_set_disconnect_handler(device->io, disconnect_handler,
@@ -935,6 +1046,7 @@ void mbim_device_unref(struct mbim_device *device)
 	}
 
 	l_free(device->segment);
+	l_free(device->fragment);
 
 	if (device->debug_destroy)
 		device->debug_destroy(device->debug_data);
@@ -1005,6 +1117,18 @@ bool mbim_device_set_debug(struct mbim_device *device,
 	return true;
 }
 
+bool mbim_device_set_trace(struct mbim_device *device,
+				mbim_device_trace_func_t func, void *user_data)
+{
+	if (!device)
+		return false;
+
+	device->trace_handler = func;
+	device->trace_data = user_data;
+
+	return true;
+}
+
 bool mbim_device_set_close_on_unref(struct mbim_device *device, bool do_close)
 {
 	if (!device)
@@ -1111,6 +1235,158 @@ bool mbim_device_cancel_group(struct mbim_device *device, uint32_t gid)
 	return true;
 }
 
+struct batch_entry {
+	struct mbim_batch *batch;
+	struct mbim_message *message;
+	mbim_device_reply_func_t function;
+	void *user_data;
+	bool replied : 1;
+};
+
+struct mbim_batch {
+	struct l_queue *entries;
+	unsigned int outstanding;
+	bool success : 1;
+	bool cancelled : 1;
+	mbim_device_batch_func_t function;
+	void *user_data;
+	mbim_device_destroy_func_t destroy;
+};
+
+static void batch_entry_free(void *data)
+{
+	struct batch_entry *entry = data;
+
+	mbim_message_unref(entry->message);
+	l_free(entry);
+}
+
+struct mbim_batch *mbim_batch_new(void)
+{
+	struct mbim_batch *batch = l_new(struct mbim_batch, 1);
+
+	batch->entries = l_queue_new();
+	batch->success = true;
+
+	return batch;
+}
+
+/* Only for batches that were never sent, a sent one frees itself */
+void mbim_batch_free(struct mbim_batch *batch)
+{
+	if (!batch)
+		return;
+
+	l_queue_destroy(batch->entries, batch_entry_free);
+	l_free(batch);
+}
+
+bool mbim_batch_append(struct mbim_batch *batch, struct mbim_message *message,
+				mbim_device_reply_func_t function,
+				void *user_data)
+{
+	struct batch_entry *entry;
+
+	if (!batch || !message || !batch->entries)
+		return false;
+
+	entry = l_new(struct batch_entry, 1);
+	entry->batch = batch;
+	entry->message = message;
+	entry->function = function;
+	entry->user_data = user_data;
+
+	l_queue_push_tail(batch->entries, entry);
+
+	return true;
+}
+
+static void batch_reply(struct mbim_message *message, void *user_data)
+{
+	struct batch_entry *entry = user_data;
+
+	entry->replied = true;
+
+	if (mbim_message_get_error(message) != 0)
+		entry->batch->success = false;
+
+	if (entry->function)
+		entry->function(message, entry->user_data);
+}
+
+/*
+ * Called once per command whether it was replied to, cancelled or dropped
+ * with the device.  Like a single command that never gets its reply, the
+ * batch then only gets its destroy callback.
+ */
+static void batch_entry_done(void *user_data)
+{
+	struct batch_entry *entry = user_data;
+	struct mbim_batch *batch = entry->batch;
+
+	if (!entry->replied)
+		batch->cancelled = true;
+
+	l_free(entry);
+
+	if (--batch->outstanding)
+		return;
+
+	if (!batch->cancelled && batch->function)
+		batch->function(batch->success, batch->user_data);
+
+	if (batch->destroy)
+		batch->destroy(batch->user_data);
+
+	l_free(batch);
+}
+
+/*
+ * Queues all commands of the batch at once, so they go out back to back up
+ * to the device's max outstanding instead of one per round trip.  The reply
+ * function of each command is called as usual, function is called once the
+ * last of them returned, with success if none of them failed.  The batch is
+ * taken over in any case.
+ */
+bool mbim_device_send_batch(struct mbim_device *device, uint32_t gid,
+				struct mbim_batch *batch,
+				mbim_device_batch_func_t function,
+				void *user_data,
+				mbim_device_destroy_func_t destroy)
+{
+	struct l_queue *entries;
+	struct batch_entry *entry;
+
+	if (!batch)
+		return false;
+
+	if (!device || l_queue_isempty(batch->entries)) {
+		mbim_batch_free(batch);
+		return false;
+	}
+
+	batch->function = function;
+	batch->user_data = user_data;
+	batch->destroy = destroy;
+	batch->outstanding = l_queue_length(batch->entries);
+
+	/* From here on the entries belong to the device */
+	entries = batch->entries;
+	batch->entries = NULL;
+
+	while ((entry = l_queue_pop_head(entries))) {
+		struct mbim_message *message = entry->message;
+
+		entry->message = NULL;
+		mbim_device_send(device, gid, message, batch_reply, entry,
+					batch_entry_done);
+	}
+
+	l_queue_destroy(entries, NULL);
+
+	return true;
+}
+
 uint32_t mbim_device_register(struct mbim_device *device, uint32_t gid,
 				const uint8_t *uuid, uint32_t cid,
 				mbim_device_reply_func_t notify,
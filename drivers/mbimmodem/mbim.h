@@ -74,11 +74,16 @@ enum mbim_data_class {
 };
 
 typedef void (*mbim_device_debug_func_t) (const char *str, void *user_data);
+typedef void (*mbim_device_trace_func_t) (bool in, int fd, const void *data,
+						size_t len, void *user_data);
 typedef void (*mbim_device_disconnect_func_t) (void *user_data);
 typedef void (*mbim_device_destroy_func_t) (void *user_data);
 typedef void (*mbim_device_ready_func_t) (void *user_data);
 typedef void (*mbim_device_reply_func_t) (struct mbim_message *message,
 							void *user_data);
+typedef void (*mbim_device_batch_func_t) (bool success, void *user_data);
+
+struct mbim_batch;
 
 extern const uint8_t mbim_uuid_basic_connect[];
 extern const uint8_t mbim_uuid_sms[];
@@ -109,6 +114,8 @@ bool mbim_device_set_max_outstanding(struct mbim_device *device, uint32_t max);
 bool mbim_device_set_debug(struct mbim_device *device,
 				mbim_device_debug_func_t func, void *user_data,
 				mbim_device_destroy_func_t destroy);
+bool mbim_device_set_trace(struct mbim_device *device,
+				mbim_device_trace_func_t func, void *user_data);
 bool mbim_device_set_disconnect_handler(struct mbim_device *device,
 					mbim_device_disconnect_func_t function,
 					void *user_data,
@@ -126,6 +133,17 @@ uint32_t mbim_device_send(struct mbim_device *device, uint32_t gid,
 bool mbim_device_cancel(struct mbim_device *device, uint32_t tid);
 bool mbim_device_cancel_group(struct mbim_device *device, uint32_t gid);
 
+struct mbim_batch *mbim_batch_new(void);
+void mbim_batch_free(struct mbim_batch *batch);
+bool mbim_batch_append(struct mbim_batch *batch, struct mbim_message *message,
+				mbim_device_reply_func_t function,
+				void *user_data);
+bool mbim_device_send_batch(struct mbim_device *device, uint32_t gid,
+				struct mbim_batch *batch,
+				mbim_device_batch_func_t function,
+				void *user_data,
+				mbim_device_destroy_func_t destroy);
+
 uint32_t mbim_device_register(struct mbim_device *device, uint32_t gid,
 				const uint8_t *uuid, uint32_t cid,
 				mbim_device_reply_func_t notify,
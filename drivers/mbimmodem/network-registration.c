@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <ofono/log.h>
@@ -24,9 +25,22 @@
 #include "drivers/mbimmodem/mbim-message.h"
 #include "drivers/mbimmodem/mbimmodem.h"
 
+/*
+ * REGISTER_STATE and SIGNAL_STATE notifications carry the same payload as
+ * the query responses.  The last one seen is kept, so that the operator
+ * and strength queries the core sends on every registration change are
+ * answered without another round trip to the function.
+ */
 struct netreg_data {
 	struct mbim_device *device;
 	struct l_idle *delayed_register;
+	bool state_valid;
+	uint32_t register_state;
+	uint32_t available_data_classes;
+	char provider_id[OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 1];
+	char provider_name[OFONO_MAX_OPERATOR_NAME_LENGTH + 1];
+	bool strength_valid;
+	int strength;
 };
 
 static inline int register_state_to_status(uint32_t register_state)
@@ -50,29 +64,57 @@ static inline int register_state_to_status(uint32_t register_state)
 	return NETWORK_REGISTRATION_STATUS_UNKNOWN;
 }
 
+static bool mbim_parse_register_state(struct mbim_message *message,
+					struct netreg_data *nd)
+{
+	uint32_t nw_error;
+	uint32_t register_mode;
+	uint32_t dummy;
+	L_AUTO_FREE_VAR(char *, provider_id) = NULL;
+	L_AUTO_FREE_VAR(char *, provider_name) = NULL;
+	L_AUTO_FREE_VAR(char *, roaming_text) = NULL;
+
+	nd->state_valid = false;
+
+	if (!mbim_message_get_arguments(message, "uuuuusss",
+					&nw_error, &nd->register_state,
+					&register_mode,
+					&nd->available_data_classes, &dummy,
+					&provider_id, &provider_name,
+					&roaming_text))
+		return false;
+
+	DBG("NwError: %u, RegisterState: %u, RegisterMode: %u",
+			nw_error, nd->register_state, register_mode);
+
+	l_strlcpy(nd->provider_id, provider_id ? provider_id : "",
+					sizeof(nd->provider_id));
+	l_strlcpy(nd->provider_name, provider_name ? provider_name : "",
+					sizeof(nd->provider_name));
+
+	/* If MBIMRegisterStateRoaming or MBIMRegisterStatePartner */
+	if (nd->register_state == 4 || nd->register_state == 5)
+		DBG("roaming text: %s", roaming_text);
+
+	nd->state_valid = true;
+	return true;
+}
+
 static void mbim_register_state_changed(struct mbim_message *message,
 								void *user)
 {
 	struct ofono_netreg *netreg = user;
-	uint32_t nw_error;
-	uint32_t register_state;
-	uint32_t register_mode;
-	uint32_t available_data_classes;
+	struct netreg_data *nd = ofono_netreg_get_data(netreg);
 	int status;
 	int tech;
 
 	DBG("");
 
-	if (!mbim_message_get_arguments(message, "uuuu",
-						&nw_error, &register_state,
-						&register_mode,
-						&available_data_classes))
+	if (!mbim_parse_register_state(message, nd))
 		return;
 
-	DBG("NwError: %u, RegisterMode: %u", nw_error, register_mode);
-
-	status = register_state_to_status(register_state);
-	tech = mbim_data_class_to_tech(available_data_classes);
+	status = register_state_to_status(nd->register_state);
+	tech = mbim_data_class_to_tech(nd->available_data_classes);
 
 	ofono_netreg_status_notify(netreg, status, -1, -1, tech);
 }
@@ -81,10 +123,8 @@ static void mbim_registration_status_cb(struct mbim_message *message,
 								void *user)
 {
 	struct cb_data *cbd = user;
+	struct netreg_data *nd = cbd->user;
 	ofono_netreg_status_cb_t cb = cbd->cb;
-	uint32_t dummy;
-	uint32_t register_state;
-	uint32_t available_data_classes;
 	int status;
 	int tech;
 
@@ -93,14 +133,11 @@ static void mbim_registration_status_cb(struct mbim_message *message,
 	if (mbim_message_get_error(message) != 0)
 		goto error;
 
-	if (!mbim_message_get_arguments(message, "uuuu",
-						&dummy, &register_state,
-						&dummy,
-						&available_data_classes))
+	if (!mbim_parse_register_state(message, nd))
 		goto error;
 
-	status = register_state_to_status(register_state);
-	tech = mbim_data_class_to_tech(available_data_classes);
+	status = register_state_to_status(nd->register_state);
+	tech = mbim_data_class_to_tech(nd->available_data_classes);
 
 	CALLBACK_WITH_SUCCESS(cb, status, -1, -1, tech, cbd->data);
 	return;
@@ -116,6 +153,8 @@ static void mbim_registration_status(struct ofono_netreg *netreg,
 	struct cb_data *cbd = cb_data_new(cb, data);
 	struct mbim_message *message;
 
+	cbd->user = nd;
+
 	message = mbim_message_new(mbim_uuid_basic_connect,
 					MBIM_CID_REGISTER_STATE,
 					MBIM_COMMAND_TYPE_QUERY);
@@ -130,54 +169,50 @@ static void mbim_registration_status(struct ofono_netreg *netreg,
 	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, -1, data);
 }
 
-static void mbim_current_operator_cb(struct mbim_message *message, void *user)
+static void mbim_current_operator_reply(struct netreg_data *nd,
+				ofono_netreg_operator_cb_t cb, void *data)
 {
-	struct cb_data *cbd = user;
-	ofono_netreg_operator_cb_t cb = cbd->cb;
 	struct ofono_network_operator op;
-	uint32_t dummy;
-	uint32_t register_state;
-	uint32_t available_data_classes;
-	L_AUTO_FREE_VAR(char *, provider_id) = NULL;
-	L_AUTO_FREE_VAR(char *, provider_name) = NULL;
-	L_AUTO_FREE_VAR(char *, roaming_text) = NULL;
-
-	DBG("");
-
-	if (mbim_message_get_error(message) != 0)
-		goto error;
 
-	if (!mbim_message_get_arguments(message, "uuuuusss",
-						&dummy, &register_state, &dummy,
-						&available_data_classes, &dummy,
-						&provider_id, &provider_name,
-						&roaming_text))
-		goto error;
-
-	if (register_state < 3 || register_state > 5)
-		goto error;
+	if (nd->register_state < 3 || nd->register_state > 5) {
+		CALLBACK_WITH_FAILURE(cb, NULL, data);
+		return;
+	}
 
-	DBG("provider: %s(%s)", provider_name, provider_id);
+	DBG("provider: %s(%s)", nd->provider_name, nd->provider_id);
 
-	/* If MBIMRegisterStateRoaming or MBIMRegisterStatePartner */
-	if (register_state == 4 || register_state == 5)
-		DBG("roaming text: %s", roaming_text);
-
-	strncpy(op.name, provider_name, OFONO_MAX_OPERATOR_NAME_LENGTH);
+	strncpy(op.name, nd->provider_name, OFONO_MAX_OPERATOR_NAME_LENGTH);
 	op.name[OFONO_MAX_OPERATOR_NAME_LENGTH] = '\0';
 
-	strncpy(op.mcc, provider_id, OFONO_MAX_MCC_LENGTH);
+	strncpy(op.mcc, nd->provider_id, OFONO_MAX_MCC_LENGTH);
 	op.mcc[OFONO_MAX_MCC_LENGTH] = '\0';
 
-	strncpy(op.mnc, provider_id + OFONO_MAX_MCC_LENGTH,
+	strncpy(op.mnc, nd->provider_id + strlen(op.mcc),
 						OFONO_MAX_MNC_LENGTH);
 	op.mnc[OFONO_MAX_MNC_LENGTH] = '\0';
 
 	/* Set to current */
 	op.status = 2;
-	op.tech = mbim_data_class_to_tech(available_data_classes);
+	op.tech = mbim_data_class_to_tech(nd->available_data_classes);
+
+	CALLBACK_WITH_SUCCESS(cb, &op, data);
+}
 
-	CALLBACK_WITH_SUCCESS(cb, &op, cbd->data);
+static void mbim_current_operator_cb(struct mbim_message *message, void *user)
+{
+	struct cb_data *cbd = user;
+	struct netreg_data *nd = cbd->user;
+	ofono_netreg_operator_cb_t cb = cbd->cb;
+
+	DBG("");
+
+	if (mbim_message_get_error(message) != 0)
+		goto error;
+
+	if (!mbim_parse_register_state(message, nd))
+		goto error;
+
+	mbim_current_operator_reply(nd, cb, cbd->data);
 	return;
 error:
 	CALLBACK_WITH_FAILURE(cb, NULL, cbd->data);
@@ -187,9 +222,17 @@ static void mbim_current_operator(struct ofono_netreg *netreg,
 				ofono_netreg_operator_cb_t cb, void *data)
 {
 	struct netreg_data *nd = ofono_netreg_get_data(netreg);
-	struct cb_data *cbd = cb_data_new(cb, data);
+	struct cb_data *cbd;
 	struct mbim_message *message;
 
+	if (nd->state_valid) {
+		mbim_current_operator_reply(nd, cb, data);
+		return;
+	}
+
+	cbd = cb_data_new(cb, data);
+	cbd->user = nd;
+
 	message = mbim_message_new(mbim_uuid_basic_connect,
 					MBIM_CID_REGISTER_STATE,
 					MBIM_COMMAND_TYPE_QUERY);
@@ -255,6 +298,7 @@ static inline int convert_signal_strength(uint32_t strength)
 static void mbim_signal_state_query_cb(struct mbim_message *message, void *user)
 {
 	struct cb_data *cbd = user;
+	struct netreg_data *nd = cbd->user;
 	ofono_netreg_strength_cb_t cb = cbd->cb;
 	uint32_t strength;
 
@@ -266,7 +310,10 @@ static void mbim_signal_state_query_cb(struct mbim_message *message, void *user)
 	if (!mbim_message_get_arguments(message, "u", &strength))
 		goto error;
 
-	CALLBACK_WITH_SUCCESS(cb, convert_signal_strength(strength), cbd->data);
+	nd->strength = convert_signal_strength(strength);
+	nd->strength_valid = true;
+
+	CALLBACK_WITH_SUCCESS(cb, nd->strength, cbd->data);
 	return;
 
 error:
@@ -277,9 +324,17 @@ static void mbim_signal_strength(struct ofono_netreg *netreg,
 				ofono_netreg_strength_cb_t cb, void *data)
 {
 	struct netreg_data *nd = ofono_netreg_get_data(netreg);
-	struct cb_data *cbd = cb_data_new(cb, data);
+	struct cb_data *cbd;
 	struct mbim_message *message;
 
+	if (nd->strength_valid) {
+		CALLBACK_WITH_SUCCESS(cb, nd->strength, data);
+		return;
+	}
+
+	cbd = cb_data_new(cb, data);
+	cbd->user = nd;
+
 	message = mbim_message_new(mbim_uuid_basic_connect,
 					MBIM_CID_SIGNAL_STATE,
 					MBIM_COMMAND_TYPE_QUERY);
@@ -297,6 +352,8 @@ static void mbim_signal_strength(struct ofono_netreg *netreg,
 static void mbim_signal_state_changed(struct mbim_message *message, void *user)
 {
 	struct ofono_netreg *netreg = user;
+	struct netreg_data *nd = ofono_netreg_get_data(netreg);
+	struct ofono_netreg_signal signal;
 	uint32_t strength;
 	uint32_t error_rate;
 	uint32_t signal_strength_interval;
@@ -314,7 +371,61 @@ static void mbim_signal_state_changed(struct mbim_message *message, void *user)
 	DBG("strength interval: %u, rssi_threshold: %u",
 				signal_strength_interval, rssi_threshold);
 
-	ofono_netreg_strength_notify(netreg, convert_signal_strength(strength));
+	nd->strength = convert_signal_strength(strength);
+	nd->strength_valid = true;
+
+	ofono_netreg_strength_notify(netreg, nd->strength);
+
+	ofono_netreg_signal_init(&signal);
+
+	if (strength <= 31)
+		signal.rssi = -113 + 2 * (int) strength;
+
+	ofono_netreg_signal_notify(netreg, &signal);
+}
+
+static void mbim_signal_state_set_cb(struct mbim_message *message, void *user)
+{
+	struct cb_data *cbd = user;
+	ofono_netreg_register_cb_t cb = cbd->cb;
+
+	DBG("");
+
+	if (mbim_message_get_error(message) != 0)
+		CALLBACK_WITH_FAILURE(cb, cbd->data);
+	else
+		CALLBACK_WITH_SUCCESS(cb, cbd->data);
+}
+
+static void mbim_set_signal_thresholds(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *deltas,
+				ofono_netreg_register_cb_t cb, void *data)
+{
+	struct netreg_data *nd = ofono_netreg_get_data(netreg);
+	struct cb_data *cbd = cb_data_new(cb, data);
+	struct mbim_message *message;
+	uint32_t rssi_threshold = 0;
+
+	/*
+	 * Only RSSI can be subscribed to, the threshold counts steps of
+	 * 2 dBm, 0 leaves it to the function and error rate reports are off
+	 */
+	if (deltas->rssi > 0)
+		rssi_threshold = (deltas->rssi + 1) / 2;
+
+	message = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_SIGNAL_STATE,
+					MBIM_COMMAND_TYPE_SET);
+	mbim_message_set_arguments(message, "uuu", 0, rssi_threshold,
+					0xffffffff);
+
+	if (mbim_device_send(nd->device, NETREG_GROUP, message,
+				mbim_signal_state_set_cb, cbd, l_free) > 0)
+		return;
+
+	l_free(cbd);
+	mbim_message_unref(message);
+	CALLBACK_WITH_FAILURE(cb, data);
 }
 
 static void delayed_register(struct l_idle *idle, void *user_data)
@@ -387,6 +498,7 @@ static const struct ofono_netreg_driver driver = {
 	.current_operator		= mbim_current_operator,
 	.register_auto			= mbim_register_auto,
 	.strength			= mbim_signal_strength,
+	.set_signal_thresholds		= mbim_set_signal_thresholds,
 };
 
 OFONO_ATOM_DRIVER_BUILTIN(netreg, mbim, &driver)
@@ -26,6 +26,8 @@
 struct sms_data {
 	struct mbim_device *device;
 	uint32_t configuration_notify_id;
+	bool read_pending;
+	bool read_again;
 };
 
 static void mbim_sca_set_cb(struct mbim_message *message, void *user)
@@ -183,16 +185,17 @@ static void mbim_submit(struct ofono_sms *sms, const unsigned char *pdu,
 	CALLBACK_WITH_FAILURE(cb, -1, data);
 }
 
-static void mbim_sms_send_delete(struct sms_data *sd, uint32_t index)
+static void mbim_sms_send_delete(struct sms_data *sd, uint32_t filter,
+							uint32_t index)
 {
 	struct mbim_message *delete;
 
-	DBG("%u", index);
+	DBG("%u %u", filter, index);
 
 	delete = mbim_message_new(mbim_uuid_sms,
 					MBIM_CID_SMS_DELETE,
 					MBIM_COMMAND_TYPE_SET);
-	mbim_message_set_arguments(delete, "uu", 1, index);
+	mbim_message_set_arguments(delete, "uu", filter, index);
 
 	if (!mbim_device_send(sd->device, SMS_GROUP, delete,
 				mbim_delete_cb, NULL, NULL))
@@ -210,6 +213,8 @@ static void mbim_parse_sms_read_info(struct mbim_message *message,
 	uint32_t index;
 	uint32_t status;
 	uint32_t pdu_len;
+	uint32_t n_read = 0;
+	uint32_t last_read = 0;
 
 	if (!mbim_message_get_arguments(message, "ua(uuay)",
 						&format, &n_sms, &array))
@@ -232,10 +237,24 @@ static void mbim_parse_sms_read_info(struct mbim_message *message,
 
 			tpdu_len = pdu_len - pdu[0] - 1;
 			ofono_sms_deliver_notify(sms, pdu, pdu_len, tpdu_len);
+
+			n_read += 1;
+			last_read = index;
+			continue;
 		}
 
-		mbim_sms_send_delete(sd, index);
+		mbim_sms_send_delete(sd, 1, index);
 	}
+
+	/*
+	 * Reading marks New messages as Old, so all delivered messages go
+	 * away with a single MBIMSmsFlagOld (3) delete.  Any that arrive in
+	 * the meantime are still New and are left for the next read.
+	 */
+	if (n_read == 1)
+		mbim_sms_send_delete(sd, 1, last_read);
+	else if (n_read > 1)
+		mbim_sms_send_delete(sd, 3, 0);
 }
 
 static void mbim_sms_read_notify(struct mbim_message *message, void *user)
@@ -247,23 +266,65 @@ static void mbim_sms_read_notify(struct mbim_message *message, void *user)
 	mbim_parse_sms_read_info(message, sms);
 }
 
+static void mbim_sms_read_new(struct ofono_sms *sms);
+
 static void mbim_sms_read_new_query_cb(struct mbim_message *message, void *user)
 {
 	struct ofono_sms *sms = user;
+	struct sms_data *sd = ofono_sms_get_data(sms);
 
 	DBG("");
 
+	sd->read_pending = false;
+
 	mbim_parse_sms_read_info(message, sms);
+
+	if (!sd->read_again)
+		return;
+
+	sd->read_again = false;
+	mbim_sms_read_new(sms);
+}
+
+static void mbim_sms_read_new(struct ofono_sms *sms)
+{
+	struct sms_data *sd = ofono_sms_get_data(sms);
+	struct mbim_message *read_query;
+
+	/*
+	 * A burst of arrivals sends one store status notification each, the
+	 * read in flight picks up all New messages there are by the time the
+	 * function handles it, so only one more read is needed after it
+	 */
+	if (sd->read_pending) {
+		sd->read_again = true;
+		return;
+	}
+
+	read_query = mbim_message_new(mbim_uuid_sms,
+					MBIM_CID_SMS_READ,
+					MBIM_COMMAND_TYPE_QUERY);
+	if (!read_query)
+		return;
+
+	/* Query using MBIMSmsFormatPdu(0) and MBIMSmsFlagNew (2) */
+	mbim_message_set_arguments(read_query, "uuu", 0, 2, 0);
+
+	if (!mbim_device_send(sd->device, SMS_GROUP, read_query,
+				mbim_sms_read_new_query_cb, sms, NULL)) {
+		mbim_message_unref(read_query);
+		return;
+	}
+
+	sd->read_pending = true;
 }
 
 static void mbim_sms_message_store_status_changed(struct mbim_message *message,
 								void *user)
 {
 	struct ofono_sms *sms = user;
-	struct sms_data *sd = ofono_sms_get_data(sms);
 	uint32_t flag;
 	uint32_t index;
-	struct mbim_message *read_query;
 
 	DBG("");
 
@@ -276,18 +337,7 @@ static void mbim_sms_message_store_status_changed(struct mbim_message *message,
 	if ((flag & 2) == 0)
 		return;
 
-	read_query = mbim_message_new(mbim_uuid_sms,
-					MBIM_CID_SMS_READ,
-					MBIM_COMMAND_TYPE_QUERY);
-	if (!read_query)
-		return;
-
-	/* Query using MBIMSmsFormatPdu(0) and MBIMSmsFlagNew (2) */
-	mbim_message_set_arguments(read_query, "uuu", 0, 2, 0);
-
-	if (!mbim_device_send(sd->device, SMS_GROUP, read_query,
-				mbim_sms_read_new_query_cb, sms, NULL))
-		mbim_message_unref(read_query);
+	mbim_sms_read_new(sms);
 }
 
 static void mbim_sms_read_all_query_cb(struct mbim_message *message, void *user)
@@ -482,6 +532,7 @@ static void mbim_sms_remove(struct ofono_sms *sms)
 }
 
 static const struct ofono_sms_driver driver = {
+	.flags		= OFONO_SMS_DRIVER_FLAG_PIPELINE_SUBMIT,
 	.probe		= mbim_sms_probe,
 	.remove		= mbim_sms_remove,
 	.sca_query	= mbim_sca_query,
@@ -19,6 +19,7 @@
 #include "qmi.h"
 #include "common.h"
 #include "wds.h"
+#include "wda.h"
 #include "util.h"
 
 struct gprs_context_data {
@@ -30,6 +31,8 @@ struct gprs_context_data {
 	uint32_t start_network_ipv4_id;
 	uint32_t start_network_ipv6_id;
 	uint8_t mux_id;
+	/* QMAP aggregation limits of the data port backing this context */
+	struct qmi_wda_data_format aggregation;
 };
 
 static void check_all_deactivated(struct ofono_gprs_context *gc)
@@ -99,6 +102,14 @@ static void check_all_activated(struct gprs_context_data *data,
 		return;
 	}
 
+	if (data->aggregation.dl_aggregation_protocol)
+		DBG("mux_id: %hhu, DL: %u x %u bytes, UL: %u x %u bytes",
+			data->mux_id,
+			data->aggregation.dl_max_datagrams,
+			data->aggregation.dl_max_size,
+			data->aggregation.ul_max_datagrams,
+			data->aggregation.ul_max_size);
+
 	CALLBACK_WITH_SUCCESS(cb, user_data);
 }
 
@@ -172,6 +183,13 @@ done:
 	check_all_activated(data, cbd->cb, cbd->data);
 }
 
+struct ipv4_settings {
+	uint32_t address;
+	uint32_t gateway;
+	uint32_t netmask;
+	uint32_t dns[2];
+};
+
 static void get_settings_ipv4_cb(struct qmi_result *result, void *user_data)
 {
 	static const uint8_t RESULT_PRIMARY_DNS = 0x15;
@@ -179,11 +197,24 @@ static void get_settings_ipv4_cb(struct qmi_result *result, void *user_data)
 	static const uint8_t RESULT_IP_ADDRESS = 0x1e;
 	static const uint8_t RESULT_GATEWAY = 0x20;
 	static const uint8_t RESULT_GATEWAY_NETMASK = 0x21;
+	const struct qmi_result_field fields[] = {
+		{ RESULT_IP_ADDRESS, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ipv4_settings, address) },
+		{ RESULT_GATEWAY, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ipv4_settings, gateway) },
+		{ RESULT_GATEWAY_NETMASK, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ipv4_settings, netmask) },
+		{ RESULT_PRIMARY_DNS, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ipv4_settings, dns[0]) },
+		{ RESULT_SECONDARY_DNS, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ipv4_settings, dns[1]) },
+	};
 	struct cb_data *cbd = user_data;
 	struct ofono_gprs_context *gc = cbd->user;
 	struct gprs_context_data *data = ofono_gprs_context_get_data(gc);
 	uint16_t error;
-	uint32_t ip_addr;
+	struct ipv4_settings settings;
+	uint32_t found;
 	struct in_addr addr;
 	char* straddr;
 	const char *dns[3] = { NULL, NULL, NULL };
@@ -196,35 +227,38 @@ static void get_settings_ipv4_cb(struct qmi_result *result, void *user_data)
 		goto done;
 	}
 
-	if (qmi_result_get_uint32(result, RESULT_IP_ADDRESS, &ip_addr)) {
-		addr.s_addr = htonl(ip_addr);
+	found = qmi_result_get_fields(result, fields, L_ARRAY_SIZE(fields),
+					&settings);
+
+	if (found & (1 << 0)) {
+		addr.s_addr = htonl(settings.address);
 		straddr = inet_ntoa(addr);
 		DBG("IP addr: %s", straddr);
 		ofono_gprs_context_set_ipv4_address(gc, straddr, 1);
 	}
 
-	if (qmi_result_get_uint32(result, RESULT_GATEWAY, &ip_addr)) {
-		addr.s_addr = htonl(ip_addr);
+	if (found & (1 << 1)) {
+		addr.s_addr = htonl(settings.gateway);
 		straddr = inet_ntoa(addr);
 		DBG("Gateway: %s", straddr);
 		ofono_gprs_context_set_ipv4_gateway(gc, straddr);
 	}
 
-	if (qmi_result_get_uint32(result, RESULT_GATEWAY_NETMASK, &ip_addr)) {
-		addr.s_addr = htonl(ip_addr);
+	if (found & (1 << 2)) {
+		addr.s_addr = htonl(settings.netmask);
 		straddr = inet_ntoa(addr);
 		DBG("Gateway netmask: %s", straddr);
 		ofono_gprs_context_set_ipv4_netmask(gc, straddr);
 	}
 
-	if (qmi_result_get_uint32(result, RESULT_PRIMARY_DNS, &ip_addr)) {
-		addr.s_addr = htonl(ip_addr);
+	if (found & (1 << 3)) {
+		addr.s_addr = htonl(settings.dns[0]);
 		dns[0] = inet_ntop(AF_INET, &addr, dns_buf[0], sizeof(dns_buf[0]));
 		DBG("Primary DNS: %s", dns[0]);
 	}
 
-	if (qmi_result_get_uint32(result, RESULT_SECONDARY_DNS, &ip_addr)) {
-		addr.s_addr = htonl(ip_addr);
+	if (found & (1 << 4)) {
+		addr.s_addr = htonl(settings.dns[1]);
 		dns[1] = inet_ntop(AF_INET, &addr, dns_buf[1], sizeof(dns_buf[1]));
 		DBG("Secondary DNS: %s", dns[1]);
 	}
@@ -784,6 +818,8 @@ static int qmi_gprs_context_probev(struct ofono_gprs_context *gc,
 					va_arg(args, struct qmi_service *);
 	_auto_(qmi_service_free) struct qmi_service *ipv6 =
 					va_arg(args, struct qmi_service *);
+	const struct qmi_wda_data_format *aggregation =
+			va_arg(args, const struct qmi_wda_data_format *);
 	struct gprs_context_data *data;
 	int r;
 
@@ -813,6 +849,10 @@ static int qmi_gprs_context_probev(struct ofono_gprs_context *gc,
 	data->ipv6 = l_steal_ptr(ipv6);
 	data->mux_id = mux_id;
 
+	if (aggregation)
+		memcpy(&data->aggregation, aggregation,
+					sizeof(data->aggregation));
+
 	qmi_service_register(data->ipv4, QMI_WDS_PACKET_SERVICE_STATUS,
 					pkt_status_notify, gc, NULL);
 	qmi_service_register(data->ipv6, QMI_WDS_PACKET_SERVICE_STATUS,
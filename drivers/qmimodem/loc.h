@@ -0,0 +1,51 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#define QMI_LOC_REGISTER_EVENTS		33	/* Register for indications */
+#define QMI_LOC_START			34	/* Start a positioning session */
+#define QMI_LOC_STOP			35	/* Stop a positioning session */
+#define QMI_LOC_POSITION_REPORT_IND	36	/* Position report indication */
+#define QMI_LOC_NMEA_IND		38	/* NMEA sentence indication */
+
+/* Register for indications */
+#define QMI_LOC_PARAM_EVENT_MASK		0x01	/* uint64 */
+
+#define QMI_LOC_EVENT_POSITION_REPORT		0x01
+#define QMI_LOC_EVENT_NMEA			0x04
+
+/* Start and stop a positioning session */
+#define QMI_LOC_PARAM_SESSION_ID		0x01	/* uint8 */
+#define QMI_LOC_PARAM_FIX_RECURRENCE		0x10	/* uint32 */
+#define QMI_LOC_PARAM_INTERMEDIATE_REPORTS	0x12	/* uint32 */
+#define QMI_LOC_PARAM_MIN_INTERVAL		0x13	/* uint32 ms */
+
+#define QMI_LOC_FIX_RECURRENCE_PERIODIC		1
+#define QMI_LOC_INTERMEDIATE_REPORTS_OFF	2
+
+/* Position report indication, floats are IEEE 754 single precision */
+#define QMI_LOC_NOTIFY_SESSION_STATUS		0x01	/* uint32 */
+#define QMI_LOC_NOTIFY_LATITUDE			0x10	/* double */
+#define QMI_LOC_NOTIFY_LONGITUDE		0x11	/* double */
+#define QMI_LOC_NOTIFY_HORIZONTAL_UNC		0x12	/* float, meters */
+#define QMI_LOC_NOTIFY_SPEED			0x18	/* float, m/s */
+#define QMI_LOC_NOTIFY_ALTITUDE_MSL		0x1b	/* float, meters */
+#define QMI_LOC_NOTIFY_VERTICAL_UNC		0x1c	/* float, meters */
+#define QMI_LOC_NOTIFY_VERTICAL_SPEED		0x1f	/* float, m/s */
+#define QMI_LOC_NOTIFY_HEADING			0x20	/* float, degrees */
+#define QMI_LOC_NOTIFY_DOP			0x24	/* struct qmi_loc_dop */
+#define QMI_LOC_NOTIFY_TIMESTAMP		0x25	/* uint64, UTC ms */
+#define QMI_LOC_NOTIFY_SATELLITES		0x2c	/* uint8 n, uint16[n] */
+
+#define QMI_LOC_SESSION_STATUS_SUCCESS		0
+
+struct qmi_loc_dop {
+	uint32_t pdop;
+	uint32_t hdop;
+	uint32_t vdop;
+} __attribute__((__packed__));
+
+/* NMEA sentence indication */
+#define QMI_LOC_NOTIFY_NMEA			0x01	/* string */
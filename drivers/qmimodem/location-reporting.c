@@ -11,6 +11,8 @@
 
 #define _GNU_SOURCE
 #include <fcntl.h>
+#include <math.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <ofono/log.h>
@@ -19,13 +21,39 @@
 
 #include "qmi.h"
 #include "pds.h"
+#include "loc.h"
 #include "util.h"
 
+/*
+ * Trackers want fixes at up to 10 Hz, the modem reports them as fast as
+ * its receiver computes them within this limit.
+ */
+#define LOC_MIN_INTERVAL_MS	100
+#define LOC_SESSION_ID		1
+
+/* Fields the modem leaves out keep the bits of a NaN */
+#define LOC_FLOAT_NAN		0x7fc00000U
+#define LOC_DOUBLE_NAN		0x7ff8000000000000ULL
+
 struct location_data {
 	struct qmi_service *pds;
+	struct qmi_service *loc;
 	int fd;
 };
 
+struct loc_position_fields {
+	uint32_t status;
+	uint64_t latitude;
+	uint64_t longitude;
+	uint32_t horizontal_unc;
+	uint32_t speed;
+	uint32_t altitude;
+	uint32_t vertical_unc;
+	uint32_t vertical_speed;
+	uint32_t heading;
+	uint64_t timestamp;
+};
+
 static void event_notify(struct qmi_result *result, void *user_data)
 {
 	struct ofono_location_reporting *lr = user_data;
@@ -59,6 +87,112 @@ static void state_notify(struct qmi_result *result, void *user_data)
 	DBG("");
 }
 
+static double loc_float(uint32_t bits)
+{
+	float value;
+
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+static double loc_double(uint64_t bits)
+{
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+static void loc_position_notify(struct qmi_result *result, void *user_data)
+{
+	static const struct qmi_result_field fields[] = {
+		{ QMI_LOC_NOTIFY_SESSION_STATUS, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, status) },
+		{ QMI_LOC_NOTIFY_LATITUDE, QMI_RESULT_FIELD_UINT64,
+			offsetof(struct loc_position_fields, latitude) },
+		{ QMI_LOC_NOTIFY_LONGITUDE, QMI_RESULT_FIELD_UINT64,
+			offsetof(struct loc_position_fields, longitude) },
+		{ QMI_LOC_NOTIFY_HORIZONTAL_UNC, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, horizontal_unc) },
+		{ QMI_LOC_NOTIFY_SPEED, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, speed) },
+		{ QMI_LOC_NOTIFY_ALTITUDE_MSL, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, altitude) },
+		{ QMI_LOC_NOTIFY_VERTICAL_UNC, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, vertical_unc) },
+		{ QMI_LOC_NOTIFY_VERTICAL_SPEED, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, vertical_speed) },
+		{ QMI_LOC_NOTIFY_HEADING, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct loc_position_fields, heading) },
+		{ QMI_LOC_NOTIFY_TIMESTAMP, QMI_RESULT_FIELD_UINT64,
+			offsetof(struct loc_position_fields, timestamp) },
+	};
+	struct ofono_location_reporting *lr = user_data;
+	struct loc_position_fields info = {
+		.status = UINT32_MAX,
+		.latitude = LOC_DOUBLE_NAN,
+		.longitude = LOC_DOUBLE_NAN,
+		.horizontal_unc = LOC_FLOAT_NAN,
+		.speed = LOC_FLOAT_NAN,
+		.altitude = LOC_FLOAT_NAN,
+		.vertical_unc = LOC_FLOAT_NAN,
+		.vertical_speed = LOC_FLOAT_NAN,
+		.heading = LOC_FLOAT_NAN,
+	};
+	struct ofono_location_fix fix;
+	const struct qmi_loc_dop *dop;
+	const uint8_t *satellites;
+	uint16_t len;
+
+	qmi_result_get_fields(result, fields, L_ARRAY_SIZE(fields), &info);
+
+	/* Intermediate reports are off, anything else carries no position */
+	if (info.status != QMI_LOC_SESSION_STATUS_SUCCESS)
+		return;
+
+	fix.timestamp = info.timestamp;
+	fix.latitude = loc_double(info.latitude);
+	fix.longitude = loc_double(info.longitude);
+	fix.altitude = loc_float(info.altitude);
+	fix.speed = loc_float(info.speed);
+	fix.course = loc_float(info.heading);
+	fix.vertical_speed = loc_float(info.vertical_speed);
+	fix.horizontal_accuracy = loc_float(info.horizontal_unc);
+	fix.vertical_accuracy = loc_float(info.vertical_unc);
+	fix.hdop = NAN;
+	fix.satellites = 0;
+
+	dop = qmi_result_get(result, QMI_LOC_NOTIFY_DOP, &len);
+	if (dop && len == sizeof(*dop))
+		fix.hdop = loc_float(L_LE32_TO_CPU(dop->hdop));
+
+	satellites = qmi_result_get(result, QMI_LOC_NOTIFY_SATELLITES, &len);
+	if (satellites && len >= 1)
+		fix.satellites = satellites[0];
+
+	ofono_location_reporting_fix_notify(lr, &fix);
+}
+
+static void loc_nmea_notify(struct qmi_result *result, void *user_data)
+{
+	struct ofono_location_reporting *lr = user_data;
+	struct location_data *data = ofono_location_reporting_get_data(lr);
+	const char *nmea;
+	uint16_t len;
+
+	if (data->fd < 0)
+		return;
+
+	nmea = qmi_result_get(result, QMI_LOC_NOTIFY_NMEA, &len);
+	if (!nmea)
+		return;
+
+	if (write(data->fd, nmea, strnlen(nmea, len)) < 0)
+		ofono_warn("Failed to write NMEA data");
+}
+
 static int enable_data_stream(struct ofono_location_reporting *lr)
 {
 	struct location_data *data = ofono_location_reporting_get_data(lr);
@@ -84,6 +218,21 @@ static void disable_data_stream(struct ofono_location_reporting *lr)
 	data->fd = -1;
 }
 
+static struct qmi_param *loc_start_param(void)
+{
+	struct qmi_param *param = qmi_param_new();
+
+	qmi_param_append_uint8(param, QMI_LOC_PARAM_SESSION_ID, LOC_SESSION_ID);
+	qmi_param_append_uint32(param, QMI_LOC_PARAM_FIX_RECURRENCE,
+					QMI_LOC_FIX_RECURRENCE_PERIODIC);
+	qmi_param_append_uint32(param, QMI_LOC_PARAM_INTERMEDIATE_REPORTS,
+					QMI_LOC_INTERMEDIATE_REPORTS_OFF);
+	qmi_param_append_uint32(param, QMI_LOC_PARAM_MIN_INTERVAL,
+					LOC_MIN_INTERVAL_MS);
+
+	return param;
+}
+
 static void autotrack_enable_cb(struct qmi_result *result, void *user_data)
 {
 	struct cb_data *cbd = user_data;
@@ -114,15 +263,26 @@ static void qmi_location_reporting_enable(struct ofono_location_reporting *lr,
 {
 	struct location_data *data = ofono_location_reporting_get_data(lr);
 	struct cb_data *cbd = cb_data_new(cb, user_data);
+	struct qmi_service *service;
 	struct qmi_param *param;
+	uint16_t message;
 
 	DBG("");
 
 	cbd->user = lr;
 
-	param = qmi_param_new_uint8(QMI_PDS_PARAM_AUTO_TRACKING, 0x01);
+	/* Starting a session takes the same reply as enabling auto-tracking */
+	if (data->loc) {
+		service = data->loc;
+		message = QMI_LOC_START;
+		param = loc_start_param();
+	} else {
+		service = data->pds;
+		message = QMI_PDS_SET_AUTOTRACK;
+		param = qmi_param_new_uint8(QMI_PDS_PARAM_AUTO_TRACKING, 0x01);
+	}
 
-	if (qmi_service_send(data->pds, QMI_PDS_SET_AUTOTRACK, param,
+	if (qmi_service_send(service, message, param,
 					autotrack_enable_cb, cbd, l_free) > 0)
 		return;
 
@@ -154,15 +314,26 @@ static void qmi_location_reporting_disable(struct ofono_location_reporting *lr,
 {
 	struct location_data *data = ofono_location_reporting_get_data(lr);
 	struct cb_data *cbd = cb_data_new(cb, user_data);
+	struct qmi_service *service;
 	struct qmi_param *param;
+	uint16_t message;
 
 	DBG("");
 
 	cbd->user = lr;
 
-	param = qmi_param_new_uint8(QMI_PDS_PARAM_AUTO_TRACKING, 0x00);
+	if (data->loc) {
+		service = data->loc;
+		message = QMI_LOC_STOP;
+		param = qmi_param_new_uint8(QMI_LOC_PARAM_SESSION_ID,
+							LOC_SESSION_ID);
+	} else {
+		service = data->pds;
+		message = QMI_PDS_SET_AUTOTRACK;
+		param = qmi_param_new_uint8(QMI_PDS_PARAM_AUTO_TRACKING, 0x00);
+	}
 
-	if (qmi_service_send(data->pds, QMI_PDS_SET_AUTOTRACK, param,
+	if (qmi_service_send(service, message, param,
 					autotrack_disable_cb, cbd, l_free) > 0)
 		return;
 
@@ -186,28 +357,75 @@ static void set_event_cb(struct qmi_result *result, void *user_data)
 	ofono_location_reporting_register(lr);
 }
 
-static int qmi_location_reporting_probe(struct ofono_location_reporting *lr,
-					unsigned int vendor, void *user_data)
+static void loc_register_events_cb(struct qmi_result *result,
+							void *user_data)
 {
-	struct qmi_service *pds = user_data;
+	struct ofono_location_reporting *lr = user_data;
+	struct location_data *data = ofono_location_reporting_get_data(lr);
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		ofono_error("Unable to register for LOC indications");
+		return;
+	}
+
+	qmi_service_register(data->loc, QMI_LOC_POSITION_REPORT_IND,
+					loc_position_notify, lr, NULL);
+	qmi_service_register(data->loc, QMI_LOC_NMEA_IND,
+					loc_nmea_notify, lr, NULL);
+
+	ofono_location_reporting_register(lr);
+}
+
+/*
+ * With the LOC service the modem hands over the positions it computed,
+ * NMEA stays available for the clients that want the raw stream.  Older
+ * modems only have PDS, which is limited to NMEA.
+ */
+static int qmi_location_reporting_probev(struct ofono_location_reporting *lr,
+					unsigned int vendor, va_list args)
+{
+	struct qmi_service *pds = va_arg(args, struct qmi_service *);
+	struct qmi_service *loc = va_arg(args, struct qmi_service *);
+	uint64_t mask = L_CPU_TO_LE64(QMI_LOC_EVENT_POSITION_REPORT |
+					QMI_LOC_EVENT_NMEA);
 	struct location_data *data;
 	struct qmi_param *param;
+	bool sent;
 
-	DBG("");
+	DBG("pds: %p loc: %p", pds, loc);
 
-	param = qmi_param_new();
-	qmi_param_append_uint8(param, QMI_PDS_PARAM_REPORT_NMEA, 0x01);
-	qmi_param_append_uint8(param, QMI_PDS_PARAM_REPORT_NMEA_DEBUG, 0x00);
+	if (loc) {
+		qmi_service_free(pds);
+		pds = NULL;
+
+		param = qmi_param_new();
+		qmi_param_append(param, QMI_LOC_PARAM_EVENT_MASK,
+							sizeof(mask), &mask);
+
+		sent = qmi_service_send(loc, QMI_LOC_REGISTER_EVENTS, param,
+					loc_register_events_cb, lr, NULL);
+	} else {
+		param = qmi_param_new();
+		qmi_param_append_uint8(param, QMI_PDS_PARAM_REPORT_NMEA, 0x01);
+		qmi_param_append_uint8(param, QMI_PDS_PARAM_REPORT_NMEA_DEBUG,
+									0x00);
+
+		sent = qmi_service_send(pds, QMI_PDS_SET_EVENT, param,
+					set_event_cb, lr, NULL);
+	}
 
-	if (!qmi_service_send(pds, QMI_PDS_SET_EVENT, param,
-					set_event_cb, lr, NULL)) {
+	if (!sent) {
 		qmi_param_free(param);
 		qmi_service_free(pds);
+		qmi_service_free(loc);
 		return -EIO;
 	}
 
 	data = l_new(struct location_data, 1);
 	data->pds = pds;
+	data->loc = loc;
 	data->fd = -1;
 
 	ofono_location_reporting_set_data(lr, data);
@@ -224,12 +442,13 @@ static void qmi_location_reporting_remove(struct ofono_location_reporting *lr)
 	ofono_location_reporting_set_data(lr, NULL);
 
 	qmi_service_free(data->pds);
+	qmi_service_free(data->loc);
 	l_free(data);
 }
 
 static const struct ofono_location_reporting_driver driver = {
 	.type		= OFONO_LOCATION_REPORTING_TYPE_NMEA,
-	.probe		= qmi_location_reporting_probe,
+	.probev		= qmi_location_reporting_probev,
 	.remove		= qmi_location_reporting_remove,
 	.enable		= qmi_location_reporting_enable,
 	.disable	= qmi_location_reporting_disable,
@@ -145,6 +145,28 @@ struct qmi_nas_home_network {
 
 #define QMI_NAS_RESULT_SYSTEM_SELECTION_PREF_MODE	0x11
 
+/* Signal info indication */
+#define QMI_NAS_RESULT_SIGNAL_INFO_CDMA		0x10	/* int8, int16 */
+#define QMI_NAS_RESULT_SIGNAL_INFO_GSM		0x12	/* int8 */
+#define QMI_NAS_RESULT_SIGNAL_INFO_WCDMA	0x13	/* int8, int16 */
+#define QMI_NAS_RESULT_SIGNAL_INFO_LTE		0x14	/* 2x int8, 2x int16 */
+
+/* Config signal info, each a uint8 count followed by the thresholds */
+#define QMI_NAS_PARAM_SIGNAL_RSSI_THRESHOLD	0x10	/* int8 dBm */
+#define QMI_NAS_PARAM_SIGNAL_ECIO_THRESHOLD	0x11	/* int16 -0.5 dB */
+#define QMI_NAS_PARAM_SIGNAL_SNR_THRESHOLD	0x13	/* int16 0.1 dB */
+#define QMI_NAS_PARAM_SIGNAL_RSRQ_THRESHOLD	0x15	/* int8 dB */
+#define QMI_NAS_PARAM_SIGNAL_RSRP_THRESHOLD	0x16	/* int16 dBm */
+
+/*
+ * Get cell location info, variable length records each with a uint8 count
+ * of neighbour cells, see the decoders in netmon.c for the layouts
+ */
+#define QMI_NAS_RESULT_GERAN_INFO		0x10
+#define QMI_NAS_RESULT_UMTS_INFO		0x11
+#define QMI_NAS_RESULT_LTE_INTRA_INFO		0x13
+#define QMI_NAS_RESULT_LTE_INTER_INFO		0x14
+
 enum qmi_nas_data_capability {
 	QMI_NAS_DATA_CAPABILITY_NONE				= 0x00,
 	QMI_NAS_DATA_CAPABILITY_GPRS				= 0x01,
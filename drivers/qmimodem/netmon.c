@@ -24,9 +24,19 @@
 #include "qmi.h"
 #include "nas.h"
 #include "util.h"
+#include "simutil.h"
+
+/* Signal info indications refresh the cells at most this often */
+#define NETMON_MIN_INTERVAL_MS 1000
 
 struct netmon_data {
 	struct qmi_service *nas;
+	struct l_timeout *update_timeout;
+	unsigned int period;
+	uint16_t signal_info_id;
+	uint16_t location_id;
+	unsigned int requests;
+	uint64_t last_update;
 };
 
 static void get_rssi_cb(struct qmi_result *result, void *user_data)
@@ -169,6 +179,19 @@ static void get_rssi_cb(struct qmi_result *result, void *user_data)
 	CALLBACK_WITH_SUCCESS(cb, cbd->data);
 }
 
+static void request_done(void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	struct ofono_netmon *netmon = cbd->user;
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+
+	/* Requests are cancelled after the data is gone on removal */
+	if (data)
+		data->requests -= 1;
+
+	l_free(cbd);
+}
+
 static void qmi_netmon_request_update(struct ofono_netmon *netmon,
 					ofono_netmon_cb_t cb,
 					void *user_data)
@@ -187,7 +210,467 @@ static void qmi_netmon_request_update(struct ofono_netmon *netmon,
 	qmi_param_append_uint16(param, 0x10, 255);
 
 	if (qmi_service_send(data->nas, QMI_NAS_GET_SIGNAL_STRENGTH, param,
-					get_rssi_cb, cbd, l_free) > 0)
+					get_rssi_cb, cbd, request_done) > 0) {
+		data->requests += 1;
+		return;
+	}
+
+	qmi_param_free(param);
+	CALLBACK_WITH_FAILURE(cb, cbd->data);
+	l_free(cbd);
+}
+
+/* Clamps a value to the 0 to max range used by +CESQ */
+static int cesq_range(int value, int max)
+{
+	if (value < 0)
+		return 0;
+
+	if (value > max)
+		return max;
+
+	return value;
+}
+
+static void parse_plmn(const uint8_t *plmn, char *mcc, char *mnc)
+{
+	memset(mcc, 0, OFONO_MAX_MCC_LENGTH + 1);
+	memset(mnc, 0, OFONO_MAX_MNC_LENGTH + 1);
+	sim_parse_mcc_mnc(plmn, mcc, mnc);
+}
+
+/*
+ * uint32 cell id, plmn[3], uint16 lac, uint16 arfcn, uint8 bsic,
+ * uint32 timing advance, uint16 rx level, then a count of neighbours of
+ * uint32 cell id, plmn[3], uint16 lac, uint16 arfcn, uint8 bsic and
+ * uint16 rx level each
+ */
+static void geran_info_notify(struct ofono_netmon *netmon, const uint8_t *p,
+					uint16_t len, bool serving)
+{
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	uint32_t ci;
+	uint32_t ta;
+	uint8_t count;
+	uint8_t i;
+
+	if (len < 19)
+		return;
+
+	ci = l_get_le32(p);
+	ta = l_get_le32(p + 12);
+
+	if (serving && ci != 0xffffffff) {
+		parse_plmn(p + 4, mcc, mnc);
+		ofono_netmon_serving_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_GSM,
+				OFONO_NETMON_INFO_MCC, mcc,
+				OFONO_NETMON_INFO_MNC, mnc,
+				OFONO_NETMON_INFO_LAC, (int) l_get_le16(p + 7),
+				OFONO_NETMON_INFO_CI, (int) ci,
+				OFONO_NETMON_INFO_ARFCN,
+					(int) l_get_le16(p + 9),
+				OFONO_NETMON_INFO_BSIC, (int) p[11],
+				OFONO_NETMON_INFO_TIMING_ADVANCE,
+					ta == 0xffffffff ? -1 : (int) ta,
+				OFONO_NETMON_INFO_RXLEV,
+					cesq_range(l_get_le16(p + 16), 63),
+				OFONO_NETMON_INFO_INVALID);
+	}
+
+	count = p[18];
+	p += 19;
+	len -= 19;
+
+	for (i = 0; i < count && len >= 14; i++, p += 14, len -= 14) {
+		ci = l_get_le32(p);
+		parse_plmn(p + 4, mcc, mnc);
+
+		ofono_netmon_neighbouring_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_GSM,
+				OFONO_NETMON_INFO_MCC, mcc,
+				OFONO_NETMON_INFO_MNC, mnc,
+				OFONO_NETMON_INFO_LAC, (int) l_get_le16(p + 7),
+				OFONO_NETMON_INFO_CI,
+					ci == 0xffffffff ? -1 : (int) ci,
+				OFONO_NETMON_INFO_ARFCN,
+					(int) l_get_le16(p + 9),
+				OFONO_NETMON_INFO_BSIC, (int) p[11],
+				OFONO_NETMON_INFO_RXLEV,
+					cesq_range(l_get_le16(p + 12), 63),
+				OFONO_NETMON_INFO_INVALID);
+	}
+}
+
+/*
+ * uint16 cell id, plmn[3], uint16 lac, uint16 uarfcn, uint16 psc,
+ * int16 rscp in dBm, int16 ecio in dB, then a count of neighbours of
+ * uint16 uarfcn, uint16 psc, int16 rscp and int16 ecio each
+ */
+static void umts_info_notify(struct ofono_netmon *netmon, const uint8_t *p,
+					uint16_t len, bool serving)
+{
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	uint16_t ci;
+	uint8_t count;
+	uint8_t i;
+
+	if (len < 16)
+		return;
+
+	ci = l_get_le16(p);
+
+	if (serving && ci != 0xffff) {
+		parse_plmn(p + 2, mcc, mnc);
+		ofono_netmon_serving_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_UMTS,
+				OFONO_NETMON_INFO_MCC, mcc,
+				OFONO_NETMON_INFO_MNC, mnc,
+				OFONO_NETMON_INFO_LAC, (int) l_get_le16(p + 5),
+				OFONO_NETMON_INFO_CI, (int) ci,
+				OFONO_NETMON_INFO_ARFCN,
+					(int) l_get_le16(p + 7),
+				OFONO_NETMON_INFO_PSC, (int) l_get_le16(p + 9),
+				OFONO_NETMON_INFO_RSCP,
+					cesq_range((int16_t) l_get_le16(p + 11)
+							+ 121, 96),
+				OFONO_NETMON_INFO_ECN0,
+					cesq_range(((int16_t) l_get_le16(p + 13)
+							+ 24) * 2 + 1, 49),
+				OFONO_NETMON_INFO_INVALID);
+	}
+
+	count = p[15];
+	p += 16;
+	len -= 16;
+
+	for (i = 0; i < count && len >= 8; i++, p += 8, len -= 8)
+		ofono_netmon_neighbouring_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_UMTS,
+				OFONO_NETMON_INFO_ARFCN, (int) l_get_le16(p),
+				OFONO_NETMON_INFO_PSC, (int) l_get_le16(p + 2),
+				OFONO_NETMON_INFO_RSCP,
+					cesq_range((int16_t) l_get_le16(p + 4)
+							+ 121, 96),
+				OFONO_NETMON_INFO_ECN0,
+					cesq_range(((int16_t) l_get_le16(p + 6)
+							+ 24) * 2 + 1, 49),
+				OFONO_NETMON_INFO_INVALID);
+}
+
+/* uint16 pci, int16 rsrq, rsrp and rssi in 0.1 dB(m), int16 srxlev */
+#define LTE_CELL_LEN 10
+
+static void lte_cell_notify(struct ofono_netmon *netmon, const uint8_t *p,
+					int earfcn)
+{
+	int rsrq = (int16_t) l_get_le16(p + 2);
+	int rsrp = (int16_t) l_get_le16(p + 4);
+
+	ofono_netmon_neighbouring_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_LTE,
+				OFONO_NETMON_INFO_EARFCN, earfcn,
+				OFONO_NETMON_INFO_PCI, (int) l_get_le16(p),
+				OFONO_NETMON_INFO_RSRQ,
+					cesq_range((rsrq + 200) / 5, 34),
+				OFONO_NETMON_INFO_RSRP,
+					cesq_range(rsrp / 10 + 141, 97),
+				OFONO_NETMON_INFO_INVALID);
+}
+
+/*
+ * uint8 idle, plmn[3], uint16 tac, uint32 cell id, uint16 earfcn,
+ * uint16 serving pci, four uint8 reselection parameters, then a count
+ * of LTE_CELL_LEN cells, the serving one included
+ */
+static void lte_intra_info_notify(struct ofono_netmon *netmon,
+				const uint8_t *p, uint16_t len, bool serving)
+{
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	uint16_t earfcn;
+	uint16_t pci;
+	uint32_t ci;
+	int rsrq = -1;
+	int rsrp = -1;
+	uint8_t count;
+	uint8_t i;
+	const uint8_t *cell;
+
+	if (len < 19)
+		return;
+
+	ci = l_get_le32(p + 6);
+	earfcn = l_get_le16(p + 10);
+	pci = l_get_le16(p + 12);
+	count = p[18];
+
+	for (i = 0, cell = p + 19; i < count &&
+			cell + LTE_CELL_LEN <= p + len;
+			i++, cell += LTE_CELL_LEN) {
+		if (l_get_le16(cell) != pci) {
+			lte_cell_notify(netmon, cell, earfcn);
+			continue;
+		}
+
+		rsrq = cesq_range(((int16_t) l_get_le16(cell + 2) + 200) / 5,
+									34);
+		rsrp = cesq_range((int16_t) l_get_le16(cell + 4) / 10 + 141,
+									97);
+	}
+
+	if (!serving || ci == 0xffffffff)
+		return;
+
+	parse_plmn(p + 1, mcc, mnc);
+	ofono_netmon_serving_cell_notify(netmon, OFONO_NETMON_CELL_TYPE_LTE,
+				OFONO_NETMON_INFO_MCC, mcc,
+				OFONO_NETMON_INFO_MNC, mnc,
+				OFONO_NETMON_INFO_TAC, (int) l_get_le16(p + 4),
+				OFONO_NETMON_INFO_CI, (int) ci,
+				OFONO_NETMON_INFO_EARFCN, (int) earfcn,
+				OFONO_NETMON_INFO_PCI, (int) pci,
+				OFONO_NETMON_INFO_RSRQ, rsrq,
+				OFONO_NETMON_INFO_RSRP, rsrp,
+				OFONO_NETMON_INFO_INVALID);
+}
+
+/*
+ * uint8 idle, then a count of frequencies of uint16 earfcn, three uint8
+ * reselection parameters and a count of LTE_CELL_LEN cells each
+ */
+static void lte_inter_info_notify(struct ofono_netmon *netmon,
+					const uint8_t *p, uint16_t len)
+{
+	const uint8_t *end = p + len;
+	uint8_t n_freqs;
+	uint8_t i;
+
+	if (len < 2)
+		return;
+
+	n_freqs = p[1];
+	p += 2;
+
+	for (i = 0; i < n_freqs && p + 6 <= end; i++) {
+		uint16_t earfcn = l_get_le16(p);
+		uint8_t count = p[5];
+		uint8_t j;
+
+		p += 6;
+
+		for (j = 0; j < count && p + LTE_CELL_LEN <= end;
+						j++, p += LTE_CELL_LEN)
+			lte_cell_notify(netmon, p, earfcn);
+
+		if (j < count)
+			break;
+	}
+}
+
+/*
+ * The modem reports the cell it camps on in the record of its RAT, the
+ * records of other RATs only list the cells it measures there.  Serving
+ * cell notifications are skipped for neighbour only updates, these would
+ * otherwise end up in the reply to a neighbour cell request.
+ */
+static void cell_location_notify(struct ofono_netmon *netmon,
+					struct qmi_result *result,
+					bool serving)
+{
+	const uint8_t *p;
+	uint16_t len;
+	bool lte;
+	bool umts;
+
+	p = qmi_result_get(result, QMI_NAS_RESULT_LTE_INTRA_INFO, &len);
+	lte = p && len >= 10 && l_get_le32(p + 6) != 0xffffffff;
+	if (p)
+		lte_intra_info_notify(netmon, p, len, serving);
+
+	p = qmi_result_get(result, QMI_NAS_RESULT_LTE_INTER_INFO, &len);
+	if (p)
+		lte_inter_info_notify(netmon, p, len);
+
+	p = qmi_result_get(result, QMI_NAS_RESULT_UMTS_INFO, &len);
+	umts = !lte && p && len >= 2 && l_get_le16(p) != 0xffff;
+	if (p)
+		umts_info_notify(netmon, p, len, serving && !lte);
+
+	p = qmi_result_get(result, QMI_NAS_RESULT_GERAN_INFO, &len);
+	if (p)
+		geran_info_notify(netmon, p, len, serving && !lte && !umts);
+}
+
+static void get_neighbours_cb(struct qmi_result *result, void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	struct ofono_netmon *netmon = cbd->user;
+	ofono_netmon_cb_t cb = cbd->cb;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		CALLBACK_WITH_FAILURE(cb, cbd->data);
+		return;
+	}
+
+	cell_location_notify(netmon, result, false);
+
+	CALLBACK_WITH_SUCCESS(cb, cbd->data);
+}
+
+static void qmi_netmon_neighbouring_cell_update(struct ofono_netmon *netmon,
+					ofono_netmon_cb_t cb, void *user_data)
+{
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+	struct cb_data *cbd = cb_data_new(cb, user_data);
+
+	DBG("");
+
+	cbd->user = netmon;
+
+	if (qmi_service_send(data->nas, QMI_NAS_GET_CELL_LOCATION_INFO, NULL,
+				get_neighbours_cb, cbd, request_done) > 0) {
+		data->requests += 1;
+		return;
+	}
+
+	CALLBACK_WITH_FAILURE(cb, cbd->data);
+	l_free(cbd);
+}
+
+static void periodic_location_cb(struct qmi_result *result, void *user_data)
+{
+	struct ofono_netmon *netmon = user_data;
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+
+	data->location_id = 0;
+
+	if (qmi_result_set_error(result, NULL))
+		return;
+
+	/* The reply to an on-demand request must only carry its own data */
+	if (data->requests)
+		return;
+
+	cell_location_notify(netmon, result, true);
+}
+
+static void periodic_update(struct ofono_netmon *netmon)
+{
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+
+	if (data->location_id)
+		return;
+
+	data->last_update = l_time_now();
+	data->location_id = qmi_service_send(data->nas,
+					QMI_NAS_GET_CELL_LOCATION_INFO, NULL,
+					periodic_location_cb, netmon, NULL);
+
+	l_timeout_modify(data->update_timeout, data->period);
+}
+
+static void update_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	periodic_update(user_data);
+}
+
+/*
+ * Signal info indications come at the modem's own cadence whenever a
+ * threshold is crossed, typically on a cell change, the period only
+ * covers quiet times
+ */
+static void signal_info_notify(struct qmi_result *result, void *user_data)
+{
+	struct ofono_netmon *netmon = user_data;
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+
+	if (l_time_diff(data->last_update, l_time_now()) <
+				NETMON_MIN_INTERVAL_MS * L_USEC_PER_MSEC)
+		return;
+
+	periodic_update(netmon);
+}
+
+static void periodic_update_stop(struct netmon_data *data)
+{
+	l_timeout_remove(data->update_timeout);
+	data->update_timeout = NULL;
+
+	if (data->signal_info_id) {
+		qmi_service_unregister(data->nas, data->signal_info_id);
+		data->signal_info_id = 0;
+	}
+
+	if (data->location_id) {
+		qmi_service_cancel(data->nas, data->location_id);
+		data->location_id = 0;
+	}
+}
+
+static void register_indications_cb(struct qmi_result *result,
+							void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	struct ofono_netmon *netmon = cbd->user;
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+	ofono_netmon_cb_t cb = cbd->cb;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		CALLBACK_WITH_FAILURE(cb, cbd->data);
+		return;
+	}
+
+	periodic_update_stop(data);
+
+	data->update_timeout = l_timeout_create(data->period,
+					update_timeout_cb, netmon, NULL);
+	data->signal_info_id = qmi_service_register(data->nas,
+					QMI_NAS_SIGNAL_INFO_INDICATION,
+					signal_info_notify, netmon, NULL);
+
+	periodic_update(netmon);
+
+	CALLBACK_WITH_SUCCESS(cb, cbd->data);
+}
+
+static void qmi_netmon_periodic_update(struct ofono_netmon *netmon,
+					unsigned int enable,
+					unsigned int period,
+					ofono_netmon_cb_t cb, void *user_data)
+{
+	static const uint8_t PARAM_SIGNAL_INFO = 0x19;
+	struct netmon_data *data = ofono_netmon_get_data(netmon);
+	struct cb_data *cbd;
+	struct qmi_param *param;
+
+	DBG("enable %u period %u", enable, period);
+
+	/*
+	 * The client is shared with netreg, which relies on the signal
+	 * info indications as well, so they are never turned off here
+	 */
+	if (!enable) {
+		periodic_update_stop(data);
+		CALLBACK_WITH_SUCCESS(cb, user_data);
+		return;
+	}
+
+	cbd = cb_data_new(cb, user_data);
+	cbd->user = netmon;
+	data->period = period;
+
+	param = qmi_param_new();
+	qmi_param_append_uint8(param, PARAM_SIGNAL_INFO, 0x01);
+
+	if (qmi_service_send(data->nas, QMI_NAS_REGISTER_INDICATIONS, param,
+				register_indications_cb, cbd, l_free) > 0)
 		return;
 
 	qmi_param_free(param);
@@ -219,6 +702,7 @@ static void qmi_netmon_remove(struct ofono_netmon *netmon)
 
 	ofono_netmon_set_data(netmon, NULL);
 
+	l_timeout_remove(nmd->update_timeout);
 	qmi_service_free(nmd->nas);
 	l_free(nmd);
 }
@@ -228,6 +712,8 @@ static const struct ofono_netmon_driver driver = {
 	.probe			= qmi_netmon_probe,
 	.remove			= qmi_netmon_remove,
 	.request_update		= qmi_netmon_request_update,
+	.enable_periodic_update	= qmi_netmon_periodic_update,
+	.neighbouring_cell_update = qmi_netmon_neighbouring_cell_update,
 };
 
 OFONO_ATOM_DRIVER_BUILTIN(netmon, qmimodem, &driver)
@@ -24,13 +24,18 @@
 
 #include "src/common.h"
 
+#define SIGNAL_THRESHOLDS_MAX 32
+
 struct netreg_data {
 	struct qmi_service *nas;
+	uint16_t scan_id;
 	struct ofono_network_operator operator;
 	uint8_t current_rat;
 	int lac;
 	int cellid;
 	bool is_roaming;
+	int reported_status;
+	int reported_tech;
 };
 
 enum roaming_status {
@@ -63,6 +68,7 @@ static bool extract_ss_info_time(
 		time->sec = time_3gpp->second;
 		time->utcoff = time_3gpp->timezone * 15 * 60;
 		time->dst = dst_3gpp;
+		time->received = l_time_now();
 		return true;
 	}
 
@@ -71,17 +77,32 @@ static bool extract_ss_info_time(
 	return false;
 }
 
+struct ss_info_fields {
+	uint8_t roaming;
+	uint16_t lac;
+	uint32_t cellid;
+};
+
 static bool extract_ss_info(struct qmi_result *result, int *status,
 				int *lac, int *cellid, int *tech,
 				enum roaming_status *roaming,
 				struct ofono_network_operator *operator)
 {
 	static const uint8_t RESULT_DATA_CAPABILITY_STATUS = 0x11;
+	static const struct qmi_result_field fields[] = {
+		{ QMI_NAS_RESULT_ROAMING_STATUS, QMI_RESULT_FIELD_UINT8,
+			offsetof(struct ss_info_fields, roaming) },
+		{ QMI_NAS_RESULT_LOCATION_AREA_CODE, QMI_RESULT_FIELD_UINT16,
+			offsetof(struct ss_info_fields, lac) },
+		{ QMI_NAS_RESULT_CELL_ID, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct ss_info_fields, cellid) },
+	};
 	const struct qmi_nas_serving_system *ss;
 	const struct qmi_nas_current_plmn *plmn;
-	uint8_t i, roaming_status;
-	uint16_t value16, len, opname_len;
-	uint32_t value32;
+	struct ss_info_fields info;
+	uint32_t found;
+	uint8_t i;
+	uint16_t len, opname_len;
 	const void *dcs;
 
 	DBG("");
@@ -102,12 +123,14 @@ static bool extract_ss_info(struct qmi_result *result, int *status,
 		*tech = qmi_nas_rat_to_tech(ss->radio_if[i - 1]);
 	}
 
+	found = qmi_result_get_fields(result, fields, L_ARRAY_SIZE(fields),
+					&info);
+
 	*roaming = ROAMING_STATUS_NO_CHANGE;
-	if (qmi_result_get_uint8(result, QMI_NAS_RESULT_ROAMING_STATUS,
-							&roaming_status)) {
-		if (roaming_status == 0)
+	if (found & (1 << 0)) {
+		if (info.roaming == 0)
 			*roaming = ROAMING_STATUS_ON;
-		else if (roaming_status == 1)
+		else if (info.roaming == 1)
 			*roaming = ROAMING_STATUS_OFF;
 	}
 
@@ -160,16 +183,8 @@ static bool extract_ss_info(struct qmi_result *result, int *status,
 		}
 	}
 
-	if (qmi_result_get_uint16(result, QMI_NAS_RESULT_LOCATION_AREA_CODE,
-								&value16))
-		*lac = value16;
-	else
-		*lac = -1;
-
-	if (qmi_result_get_uint32(result, QMI_NAS_RESULT_CELL_ID, &value32))
-		*cellid = value32;
-	else
-		*cellid = -1;
+	*lac = found & (1 << 1) ? info.lac : -1;
+	*cellid = found & (1 << 2) ? (int) info.cellid : -1;
 
 	DBG("roaming %u lac %d cellid %d tech %d", *roaming, *lac, *cellid,
 									*tech);
@@ -202,11 +217,21 @@ static int remember_ss_info(struct netreg_data *data, int status, int lac,
 	return status;
 }
 
+static bool operator_changed(const struct ofono_network_operator *a,
+				const struct ofono_network_operator *b)
+{
+	return strcmp(a->mcc, b->mcc) || strcmp(a->mnc, b->mnc) ||
+					strcmp(a->name, b->name);
+}
+
 static void ss_info_notify(struct qmi_result *result, void *user_data)
 {
 	struct ofono_netreg *netreg = user_data;
 	struct ofono_network_time net_time;
 	struct netreg_data *data = ofono_netreg_get_data(netreg);
+	struct ofono_network_operator previous = data->operator;
+	int previous_lac = data->lac;
+	int previous_cellid = data->cellid;
 	int status, lac, cellid, tech;
 	enum roaming_status roaming;
 
@@ -221,6 +246,23 @@ static void ss_info_notify(struct qmi_result *result, void *user_data)
 
 	status = remember_ss_info(data, status, lac, cellid, roaming);
 
+	/*
+	 * Serving system indications repeat on every cell and signal change
+	 * on LTE.  Each status notification makes the core query the
+	 * operator and the signal strength again, so identical state is not
+	 * passed on.
+	 */
+	if (status == data->reported_status && tech == data->reported_tech &&
+			data->lac == previous_lac &&
+			data->cellid == previous_cellid &&
+			!operator_changed(&previous, &data->operator)) {
+		DBG("serving system unchanged");
+		return;
+	}
+
+	data->reported_status = status;
+	data->reported_tech = tech;
+
 	ofono_netreg_status_notify(netreg, status, data->lac, data->cellid,
 									tech);
 }
@@ -248,6 +290,9 @@ static void get_ss_info_cb(struct qmi_result *result, void *user_data)
 
 	status = remember_ss_info(data, status, lac, cellid, roaming);
 
+	data->reported_status = status;
+	data->reported_tech = tech;
+
 	CALLBACK_WITH_SUCCESS(cb, status, data->lac, data->cellid, tech,
 								cbd->data);
 }
@@ -285,6 +330,7 @@ static void scan_nets_cb(struct qmi_result *result, void *user_data)
 {
 	struct cb_data *cbd = user_data;
 	ofono_netreg_operator_list_cb_t cb = cbd->cb;
+	struct netreg_data *data = cbd->user;
 	struct ofono_network_operator *list;
 	const struct qmi_nas_network_list *netlist;
 	const struct qmi_nas_network_rat *netrat;
@@ -293,6 +339,8 @@ static void scan_nets_cb(struct qmi_result *result, void *user_data)
 
 	DBG("");
 
+	data->scan_id = 0;
+
 	if (qmi_result_set_error(result, NULL)) {
 		CALLBACK_WITH_FAILURE(cb, 0, NULL, cbd->data);
 		return;
@@ -374,8 +422,11 @@ static void qmi_list_operators(struct ofono_netreg *netreg,
 
 	DBG("");
 
-	if (qmi_service_send(data->nas, QMI_NAS_NETWORK_SCAN, NULL,
-					scan_nets_cb, cbd, l_free) > 0)
+	cbd->user = data;
+
+	data->scan_id = qmi_service_send(data->nas, QMI_NAS_NETWORK_SCAN, NULL,
+						scan_nets_cb, cbd, l_free);
+	if (data->scan_id > 0)
 		return;
 
 	CALLBACK_WITH_FAILURE(cb, 0, NULL, cbd->data);
@@ -383,6 +434,23 @@ static void qmi_list_operators(struct ofono_netreg *netreg,
 	l_free(cbd);
 }
 
+/*
+ * The modem keeps scanning in the background, only the pending request
+ * and its response are dropped.
+ */
+static void qmi_cancel_list_operators(struct ofono_netreg *netreg)
+{
+	struct netreg_data *data = ofono_netreg_get_data(netreg);
+
+	DBG("");
+
+	if (!data->scan_id)
+		return;
+
+	qmi_service_cancel(data->nas, data->scan_id);
+	data->scan_id = 0;
+}
+
 static void register_net_cb(struct qmi_result *result, void *user_data)
 {
 	struct cb_data *cbd = user_data;
@@ -528,11 +596,141 @@ static void system_info_notify(struct qmi_result *result, void *user_data)
 	qmi_result_print_tlvs(result);
 }
 
+static void signal_info_lte(const uint8_t *p,
+				struct ofono_netreg_signal *signal)
+{
+	signal->rssi = (int8_t) p[0];
+	signal->rsrq = (int8_t) p[1];
+	signal->rsrp = (int16_t) l_get_le16(p + 2);
+	signal->sinr = (int16_t) l_get_le16(p + 4) / 10;
+}
+
+static void signal_info_ecio(const uint8_t *p,
+				struct ofono_netreg_signal *signal)
+{
+	signal->rssi = (int8_t) p[0];
+	signal->ecio = -(int16_t) l_get_le16(p + 1) / 2;
+}
+
+static void signal_info_rssi(const uint8_t *p,
+				struct ofono_netreg_signal *signal)
+{
+	signal->rssi = (int8_t) p[0];
+}
+
+/* In order of preference, the first one present is reported */
+static const struct {
+	uint8_t type;
+	uint16_t min_len;
+	void (*decode)(const uint8_t *p, struct ofono_netreg_signal *signal);
+} signal_info_rats[] = {
+	{ QMI_NAS_RESULT_SIGNAL_INFO_LTE,	6, signal_info_lte },
+	{ QMI_NAS_RESULT_SIGNAL_INFO_WCDMA,	3, signal_info_ecio },
+	{ QMI_NAS_RESULT_SIGNAL_INFO_GSM,	1, signal_info_rssi },
+	{ QMI_NAS_RESULT_SIGNAL_INFO_CDMA,	3, signal_info_ecio },
+};
+
 static void signal_info_notify(struct qmi_result *result, void *user_data)
 {
+	struct ofono_netreg *netreg = user_data;
+	struct ofono_netreg_signal signal;
+	const uint8_t *p;
+	uint16_t len;
+	unsigned int i;
+
 	DBG("");
 
-	qmi_result_print_tlvs(result);
+	ofono_netreg_signal_init(&signal);
+
+	for (i = 0; i < L_ARRAY_SIZE(signal_info_rats); i++) {
+		p = qmi_result_get(result, signal_info_rats[i].type, &len);
+		if (!p || len < signal_info_rats[i].min_len)
+			continue;
+
+		signal_info_rats[i].decode(p, &signal);
+		break;
+	}
+
+	/* The core drops values identical to the last ones reported */
+	ofono_netreg_signal_notify(netreg, &signal);
+}
+
+/*
+ * Thresholds are absolute on QMI, a delta is turned into a ladder over
+ * the range of the metric, made coarser if it would not fit the list.
+ */
+static void append_thresholds(struct qmi_param *param, uint8_t type,
+				size_t size, int delta, int min, int max,
+				int scale)
+{
+	uint8_t buf[1 + SIGNAL_THRESHOLDS_MAX * sizeof(int16_t)];
+	unsigned int n = 0;
+	int v;
+
+	if (delta <= 0)
+		return;
+
+	while ((max - min) / delta >= SIGNAL_THRESHOLDS_MAX)
+		delta += 1;
+
+	for (v = min; v <= max; v += delta, n++) {
+		int16_t t = v * scale;
+
+		if (size == 1)
+			buf[1 + n] = (uint8_t) (int8_t) t;
+		else
+			l_put_le16(t, buf + 1 + n * 2);
+	}
+
+	buf[0] = n;
+	qmi_param_append(param, type, 1 + n * size, buf);
+}
+
+static void config_signal_info_cb(struct qmi_result *result, void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_netreg_register_cb_t cb = cbd->cb;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		CALLBACK_WITH_FAILURE(cb, cbd->data);
+		return;
+	}
+
+	CALLBACK_WITH_SUCCESS(cb, cbd->data);
+}
+
+static void qmi_set_signal_thresholds(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *deltas,
+				ofono_netreg_register_cb_t cb, void *user_data)
+{
+	struct netreg_data *data = ofono_netreg_get_data(netreg);
+	struct cb_data *cbd = cb_data_new(cb, user_data);
+	struct qmi_param *param;
+
+	DBG("");
+
+	param = qmi_param_new();
+
+	append_thresholds(param, QMI_NAS_PARAM_SIGNAL_RSSI_THRESHOLD, 1,
+					deltas->rssi, -120, -25, 1);
+	append_thresholds(param, QMI_NAS_PARAM_SIGNAL_ECIO_THRESHOLD, 2,
+					deltas->ecio, -32, 0, -2);
+	append_thresholds(param, QMI_NAS_PARAM_SIGNAL_SNR_THRESHOLD, 2,
+					deltas->sinr, -20, 30, 10);
+	append_thresholds(param, QMI_NAS_PARAM_SIGNAL_RSRQ_THRESHOLD, 1,
+					deltas->rsrq, -20, -3, 1);
+	append_thresholds(param, QMI_NAS_PARAM_SIGNAL_RSRP_THRESHOLD, 2,
+					deltas->rsrp, -140, -44, 1);
+
+	if (qmi_service_send(data->nas, QMI_NAS_CONFIG_SIGNAL_INFO, param,
+					config_signal_info_cb, cbd, l_free) > 0)
+		return;
+
+	qmi_param_free(param);
+	CALLBACK_WITH_FAILURE(cb, cbd->data);
+	l_free(cbd);
 }
 
 static void event_notify(struct qmi_result *result, void *user_data)
@@ -665,6 +863,8 @@ static int qmi_netreg_probe(struct ofono_netreg *netreg,
 	data->is_roaming = false;
 	data->lac = -1;
 	data->cellid = -1;
+	data->reported_status = -1;
+	data->reported_tech = -1;
 
 	ofono_netreg_set_data(netreg, data);
 
@@ -689,9 +889,11 @@ static const struct ofono_netreg_driver driver = {
 	.registration_status	= qmi_registration_status,
 	.current_operator	= qmi_current_operator,
 	.list_operators		= qmi_list_operators,
+	.cancel_list_operators	= qmi_cancel_list_operators,
 	.register_auto		= qmi_register_auto,
 	.register_manual	= qmi_register_manual,
 	.strength		= qmi_signal_strength,
+	.set_signal_thresholds	= qmi_set_signal_thresholds,
 };
 
 OFONO_ATOM_DRIVER_BUILTIN(netreg, qmimodem, &driver)
@@ -32,6 +32,9 @@
 
 #define DISCOVER_TIMEOUT 5
 
+#define MAX_WRITE_BATCH 8
+#define MAX_CLIENT_OUTSTANDING 16
+
 #define DEBUG(debug, fmt, args...)					\
 	l_util_debug((debug)->func, (debug)->user_data, "%s:%i " fmt,	\
 			__func__, __LINE__, ## args)
@@ -63,6 +66,7 @@ struct qmi_request {
 	void *user_data;
 	response_func_t callback;
 	void (*free_request)(struct qmi_request *req);
+	bool pooled : 1;		/* Allocated from request_pool */
 	uint16_t len;
 	uint8_t data[];
 };
@@ -79,8 +83,15 @@ struct debug_data {
 	void *user_data;
 };
 
+struct trace_data {
+	qmi_trace_func_t func;
+	void *user_data;
+};
+
 struct qmi_transport_ops {
-	int (*write)(struct qmi_transport *transport, struct qmi_request *req);
+	/* Returns the number of requests written or a negative errno */
+	int (*write)(struct qmi_transport *transport,
+			struct qmi_request **reqs, unsigned int n_reqs);
 };
 
 struct qmi_transport {
@@ -91,12 +102,14 @@ struct qmi_transport {
 	struct l_hashmap *family_list;
 	const struct qmi_transport_ops *ops;
 	struct debug_data debug;
+	struct trace_data trace;
 	bool writer_active : 1;
 };
 
 struct qmi_qmux_device {
 	struct qmi_service_info *service_list;
 	uint16_t n_services;
+	uint32_t control_version;
 	struct qmi_transport transport;
 	char *version_str;
 	struct debug_data debug;
@@ -105,6 +118,7 @@ struct qmi_qmux_device {
 		void *user_data;
 		qmi_destroy_func_t destroy;
 		struct l_timeout *timeout;
+		struct l_idle *idle;
 		uint16_t tid;
 	} discover;
 	struct {
@@ -130,6 +144,8 @@ struct service_family {
 	uint16_t next_notify_id;
 	unsigned int next_service_handle;
 	struct l_queue *notify_list;
+	struct l_hashmap *notify_map;	/* Message id to queue of notifies */
+	uint32_t indications;
 	void (*free_family)(struct service_family *family);
 };
 
@@ -139,16 +155,42 @@ struct qmi_service {
 };
 
 struct qmi_param {
-	void *data;
+	uint8_t *buf;		/* TLVs start at SERVICE_REQUEST_HEADROOM */
+	uint16_t size;
 	uint16_t length;
 };
 
+/*
+ * Polling drivers send a steady stream of small requests, so request
+ * memory and params are recycled instead of going back to the heap.
+ * Params are built before any transport is known so the pools are
+ * shared by all the transports.
+ */
+#define REQUEST_BLOCK_SIZE	512
+#define REQUEST_POOL_MAX	16
+#define PARAM_POOL_MAX		16
+
+struct pool_entry {
+	struct pool_entry *next;
+};
+
+struct pool {
+	struct pool_entry *head;
+	unsigned int count;
+	unsigned int max;
+};
+
+static struct pool request_pool = { .max = REQUEST_POOL_MAX };
+static struct pool param_pool = { .max = PARAM_POOL_MAX };
+
 struct qmi_result {
 	uint16_t message;
 	uint16_t result;
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint16_t tlv_offset[256];	/* Header offset + 1, 0 if absent */
 };
 
 struct qmi_notify {
@@ -195,6 +237,42 @@ struct qmi_tlv_hdr {
 } __attribute__ ((packed));
 #define QMI_TLV_HDR_SIZE 3
 
+/*
+ * Params reserve room for the service request and its headers in front of
+ * the TLVs so qmi_service_send can turn the buffer into the request as is
+ */
+#define SERVICE_REQUEST_HEADROOM \
+	(offsetof(struct qmi_service_request, super) + \
+		offsetof(struct qmi_request, data) + QMI_MUX_HDR_SIZE + \
+		QMI_SERVICE_HDR_SIZE + QMI_MESSAGE_HDR_SIZE)
+
+static void *pool_get(struct pool *pool, size_t size)
+{
+	struct pool_entry *entry = pool->head;
+
+	if (!entry)
+		return l_malloc(size);
+
+	pool->head = entry->next;
+	pool->count -= 1;
+
+	return entry;
+}
+
+static void pool_put(struct pool *pool, void *mem)
+{
+	struct pool_entry *entry = mem;
+
+	if (pool->count >= pool->max) {
+		l_free(mem);
+		return;
+	}
+
+	entry->next = pool->head;
+	pool->head = entry;
+	pool->count += 1;
+}
+
 static unsigned int next_id(unsigned int *id)
 {
 	if (*id == 0) /* 0 is reserved for control */
@@ -220,29 +298,24 @@ static bool qmi_service_info_matches(const void *data, const void *user)
 	return true;
 }
 
-static void *__request_alloc(uint32_t service_type,
+static void __request_init(void *mem, uint32_t service_type,
 					uint8_t client, uint16_t message,
-					const void *data, uint16_t length,
-					size_t offset)
+					uint16_t length, size_t offset, bool pooled)
 {
-	void *mem;
-	struct qmi_request *req;
+	struct qmi_request *req = mem + offset;
 	struct qmi_mux_hdr *hdr;
 	struct qmi_message_hdr *msg;
 	uint16_t hdrlen = QMI_MUX_HDR_SIZE;
-	uint16_t msglen;
 
 	if (service_type == QMI_SERVICE_CONTROL)
 		hdrlen += QMI_CONTROL_HDR_SIZE;
 	else
 		hdrlen += QMI_SERVICE_HDR_SIZE;
 
-	msglen = hdrlen + QMI_MESSAGE_HDR_SIZE + length;
-	mem = l_malloc(offset + sizeof(struct qmi_request) + msglen);
-	req = mem + offset;
-	memset(req, 0, sizeof(struct qmi_request));
-	req->len = msglen;
+	memset(req, 0, offsetof(struct qmi_request, data));
+	req->len = hdrlen + QMI_MESSAGE_HDR_SIZE + length;
 	req->client = client;
+	req->pooled = pooled;
 
 	hdr = (struct qmi_mux_hdr *) req->data;
 
@@ -256,9 +329,37 @@ static void *__request_alloc(uint32_t service_type,
 
 	msg->message = L_CPU_TO_LE16(message);
 	msg->length = L_CPU_TO_LE16(length);
+}
+
+static void *__request_alloc(uint32_t service_type,
+					uint8_t client, uint16_t message,
+					const void *data, uint16_t length,
+					size_t offset)
+{
+	void *mem;
+	struct qmi_request *req;
+	size_t size = offset + offsetof(struct qmi_request, data) +
+			QMI_MUX_HDR_SIZE + QMI_MESSAGE_HDR_SIZE + length;
+	bool pooled;
+
+	if (service_type == QMI_SERVICE_CONTROL)
+		size += QMI_CONTROL_HDR_SIZE;
+	else
+		size += QMI_SERVICE_HDR_SIZE;
+
+	pooled = size <= REQUEST_BLOCK_SIZE;
+
+	if (pooled)
+		mem = pool_get(&request_pool, REQUEST_BLOCK_SIZE);
+	else
+		mem = l_malloc(size);
+
+	__request_init(mem, service_type, client, message, length, offset,
+								pooled);
+	req = mem + offset;
 
 	if (data && length > 0)
-		memcpy(req->data + hdrlen + QMI_MESSAGE_HDR_SIZE, data, length);
+		memcpy(req->data + req->len - length, data, length);
 
 	return mem;
 }
@@ -271,6 +372,15 @@ static void *__control_request_alloc(uint16_t message,
 					data, length, offset);
 }
 
+/* Releases the memory of req, mem being the start of its container */
+static void __request_release(void *mem, struct qmi_request *req)
+{
+	if (req->pooled)
+		pool_put(&request_pool, mem);
+	else
+		l_free(mem);
+}
+
 static void __request_free(void *data)
 {
 	struct qmi_request *req = data;
@@ -278,7 +388,7 @@ static void __request_free(void *data)
 	if (req->free_request)
 		req->free_request(req);
 	else
-		l_free(req);
+		__request_release(req, req);
 }
 
 static bool __request_compare(const void *a, const void *b)
@@ -313,6 +423,25 @@ static bool __notify_compare(const void *data, const void *user_data)
 			notify->service_handle == details->service_handle;
 }
 
+/*
+ * Empty queues stay in the map until the family goes away, a callback may
+ * unregister itself while its queue is being walked.
+ */
+static void notify_map_remove(struct l_hashmap *notify_map,
+						struct qmi_notify *notify)
+{
+	struct l_queue *queue = l_hashmap_lookup(notify_map,
+					L_UINT_TO_PTR(notify->message));
+
+	if (queue)
+		l_queue_remove(queue, notify);
+}
+
+static void notify_map_queue_destroy(void *data)
+{
+	l_queue_destroy(data, NULL);
+}
+
 static const char *__service_type_to_string(uint8_t type)
 {
 	switch (type) {
@@ -502,6 +631,16 @@ static void __debug_data_init(struct debug_data *debug,
 	debug->user_data = user_data;
 }
 
+static void __trace(struct qmi_transport *transport, bool in,
+				const void *data, size_t len)
+{
+	if (!transport->trace.func || !len)
+		return;
+
+	transport->trace.func(in, l_io_get_fd(transport->io), data, len,
+					transport->trace.user_data);
+}
+
 static void __debug_msg(char dir, const struct qmi_message_hdr *msg,
 			uint32_t service_type, uint8_t transaction_type,
 			uint16_t tid, uint8_t client, uint16_t overall_length,
@@ -559,6 +698,10 @@ static void __debug_msg(char dir, const struct qmi_message_hdr *msg,
 		const struct qmi_tlv_hdr *tlv = ptr + offset;
 		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
 
+		if (tlv_length > L_LE16_TO_CPU(msg->length) - offset -
+							QMI_TLV_HDR_SIZE)
+			break;
+
 		if (tlv->type == 0x02 && tlv_length == QMI_RESULT_CODE_SIZE) {
 			const struct qmi_result_code *result = ptr + offset +
 							QMI_TLV_HDR_SIZE;
@@ -649,26 +792,85 @@ static void __qrtr_debug_msg(const char dir, const void *buf, size_t len,
 						debug->func, debug->user_data);
 }
 
+static unsigned int __client_outstanding(struct qmi_transport *transport,
+						unsigned int group_id,
+						struct qmi_request **batch,
+						unsigned int n_batch)
+{
+	const struct l_queue_entry *entry;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (entry = l_queue_get_entries(transport->service_queue); entry;
+							entry = entry->next) {
+		const struct qmi_request *req = entry->data;
+
+		if (req->group_id == group_id)
+			count += 1;
+	}
+
+	for (i = 0; i < n_batch; i++)
+		if (batch[i]->group_id == group_id)
+			count += 1;
+
+	return count;
+}
+
+/*
+ * Gather up to MAX_WRITE_BATCH queued requests per wakeup.  Requests of a
+ * client with MAX_CLIENT_OUTSTANDING requests awaiting a response are left
+ * queued, in order, until responses come in.  Requests of other clients
+ * may go out ahead of them.
+ */
 static bool can_write_data(struct l_io *io, void *user_data)
 {
 	struct qmi_transport *transport = user_data;
-	struct qmi_request *req;
+	struct qmi_request *batch[MAX_WRITE_BATCH];
+	const struct l_queue_entry *entry;
+	unsigned int n_batch = 0;
+	unsigned int written;
+	unsigned int i;
 	int r;
 
-	req = l_queue_pop_head(transport->req_queue);
-	if (!req)
+	for (entry = l_queue_get_entries(transport->req_queue);
+				entry && n_batch < L_ARRAY_SIZE(batch);
+				entry = entry->next) {
+		struct qmi_request *req = entry->data;
+
+		/* Control requests are never held back */
+		if (req->group_id && __client_outstanding(transport,
+						req->group_id, batch,
+						n_batch) >=
+						MAX_CLIENT_OUTSTANDING)
+			continue;
+
+		batch[n_batch++] = req;
+	}
+
+	if (!n_batch)
 		return false;
 
-	r = transport->ops->write(transport, req);
+	for (i = 0; i < n_batch; i++)
+		l_queue_remove(transport->req_queue, batch[i]);
+
+	r = transport->ops->write(transport, batch, n_batch);
+	written = r < 0 ? 1 : r;	/* A failed request is dropped */
+
+	/* Whatever was not written goes back to the front, in order */
+	for (i = n_batch; i > written; i--)
+		l_queue_push_head(transport->req_queue, batch[i - 1]);
+
 	if (r < 0) {
-		__request_free(req);
+		__request_free(batch[0]);
 		return false;
 	}
 
-	if (l_queue_length(transport->req_queue) > 0)
+	/* The transport is backed up, try again once it is writable */
+	if (written < n_batch)
 		return true;
 
-	return false;
+	return n_batch == L_ARRAY_SIZE(batch) &&
+				!l_queue_isempty(transport->req_queue);
 }
 
 static void write_watch_destroy(void *user_data)
@@ -689,6 +891,13 @@ static void wakeup_writer(struct qmi_transport *transport)
 	transport->writer_active = true;
 }
 
+/* A response or cancellation may unblock requests held back by the writer */
+static void resume_writer(struct qmi_transport *transport)
+{
+	if (!l_queue_isempty(transport->req_queue))
+		wakeup_writer(transport);
+}
+
 static uint16_t __service_request_submit(struct qmi_transport *transport,
 						struct qmi_service *service,
 						struct qmi_request *req)
@@ -713,22 +922,44 @@ static uint16_t __service_request_submit(struct qmi_transport *transport,
 	return req->tid;
 }
 
-static void service_notify_if_message_matches(void *data, void *user_data)
+static void service_notify_callback(void *data, void *user_data)
 {
 	struct qmi_notify *notify = data;
 	struct qmi_result *result = user_data;
 
-	if (notify->message == result->message)
-		notify->callback(result, notify->user_data);
+	notify->callback(result, notify->user_data);
+}
+
+static void service_notify(struct service_family *family,
+						struct qmi_result *result)
+{
+	struct l_queue *queue;
+
+	family->indications += 1;
+
+	queue = l_hashmap_lookup(family->notify_map,
+					L_UINT_TO_PTR(result->message));
+	if (!queue)
+		return;
+
+	l_queue_foreach(queue, service_notify_callback, result);
 }
 
-static void service_notify(const void *key, void *value, void *user_data)
+struct broadcast_details {
+	uint32_t service_type;
+	struct qmi_result *result;
+};
+
+static void service_notify_broadcast(const void *key, void *value,
+							void *user_data)
 {
 	struct service_family *family = value;
-	struct qmi_result *result = user_data;
+	struct broadcast_details *details = user_data;
+
+	if (family->info.service_type != details->service_type)
+		return;
 
-	l_queue_foreach(family->notify_list, service_notify_if_message_matches,
-				result);
+	service_notify(family, details->result);
 }
 
 static unsigned int family_list_create_hash(uint16_t service_type,
@@ -753,10 +984,16 @@ static void handle_indication(struct qmi_transport *transport,
 	result.message = message;
 	result.data = data;
 	result.length = length;
+	result.indexed = false;
 
 	if (client_id == 0xff) {
-		l_hashmap_foreach(transport->family_list, service_notify,
-					&result);
+		struct broadcast_details details = {
+			.service_type = service_type,
+			.result = &result,
+		};
+
+		l_hashmap_foreach(transport->family_list,
+					service_notify_broadcast, &details);
 		return;
 	}
 
@@ -767,12 +1004,12 @@ static void handle_indication(struct qmi_transport *transport,
 	if (!family)
 		return;
 
-	service_notify(NULL, family, &result);
+	service_notify(family, &result);
 }
 
 static void __rx_message(struct qmi_transport *transport,
 				uint32_t service_type, uint8_t client_id,
-				const void *buf)
+				const void *buf, size_t len)
 {
 	const struct qmi_service_hdr *service = buf;
 	const struct qmi_message_hdr *msg = buf + QMI_SERVICE_HDR_SIZE;
@@ -782,10 +1019,16 @@ static void __rx_message(struct qmi_transport *transport,
 	uint16_t message;
 	uint16_t length;
 
+	if (len < QMI_SERVICE_HDR_SIZE + QMI_MESSAGE_HDR_SIZE)
+		return;
+
 	message = L_LE16_TO_CPU(msg->message);
 	length = L_LE16_TO_CPU(msg->length);
 	tid = L_LE16_TO_CPU(service->transaction);
 
+	if (length > len - QMI_SERVICE_HDR_SIZE - QMI_MESSAGE_HDR_SIZE)
+		return;
+
 	if (service->type == 0x04) {
 		handle_indication(transport, service_type, client_id,
 					message, length, data);
@@ -797,6 +1040,8 @@ static void __rx_message(struct qmi_transport *transport,
 	if (!req)
 		return;
 
+	resume_writer(transport);
+
 	if (req->callback)
 		req->callback(req, message, length, data);
 
@@ -860,6 +1105,9 @@ void qmi_result_print_tlvs(struct qmi_result *result)
 		const struct qmi_tlv_hdr *tlv = ptr;
 		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
 
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
 		DBG("tlv: 0x%02x len 0x%04x", tlv->type, tlv->length);
 
 		ptr += QMI_TLV_HDR_SIZE + tlv_length;
@@ -877,6 +1125,9 @@ static const void *tlv_get(const void *data, uint16_t size,
 		const struct qmi_tlv_hdr *tlv = ptr;
 		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
 
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
 		if (tlv->type == type) {
 			if (length)
 				*length = tlv_length;
@@ -930,37 +1181,51 @@ bool qmi_qmux_device_has_service(struct qmi_qmux_device *qmux, uint16_t type)
 	return __qmux_service_info_find(qmux, type);
 }
 
+/*
+ * cdc-wdm turns every write into a single encapsulated command, so the
+ * messages cannot be gathered into one writev and go out one by one
+ */
 static int qmi_qmux_device_write(struct qmi_transport *transport,
-					struct qmi_request *req)
+					struct qmi_request **reqs,
+					unsigned int n_reqs)
 {
 	struct qmi_qmux_device *qmux =
 		l_container_of(transport, struct qmi_qmux_device, transport);
-	struct qmi_mux_hdr *hdr;
-	ssize_t bytes_written;
+	int fd = l_io_get_fd(transport->io);
+	unsigned int i;
 
-	bytes_written = write(l_io_get_fd(transport->io), req->data, req->len);
-	if (bytes_written < 0)
-		return -errno;
+	for (i = 0; i < n_reqs; i++) {
+		struct qmi_request *req = reqs[i];
+		struct qmi_mux_hdr *hdr;
+		ssize_t bytes_written;
 
-	l_util_hexdump(false, req->data, bytes_written,
-			transport->debug.func, transport->debug.user_data);
+		bytes_written = write(fd, req->data, req->len);
+		if (bytes_written < 0)
+			return i ? (int) i : -errno;
 
-	__qmux_debug_msg(' ', req->data, bytes_written,
-			transport->debug.func, transport->debug.user_data);
+		__trace(transport, false, req->data, bytes_written);
+		l_util_hexdump(false, req->data, bytes_written,
+				transport->debug.func,
+				transport->debug.user_data);
 
-	hdr = (struct qmi_mux_hdr *) req->data;
+		__qmux_debug_msg(' ', req->data, bytes_written,
+				transport->debug.func,
+				transport->debug.user_data);
 
-	if (hdr->service == QMI_SERVICE_CONTROL)
-		l_queue_push_tail(qmux->control_queue, req);
-	else
-		l_queue_push_tail(transport->service_queue, req);
+		hdr = (struct qmi_mux_hdr *) req->data;
 
-	return 0;
+		if (hdr->service == QMI_SERVICE_CONTROL)
+			l_queue_push_tail(qmux->control_queue, req);
+		else
+			l_queue_push_tail(transport->service_queue, req);
+	}
+
+	return n_reqs;
 }
 
 static void __rx_ctl_message(struct qmi_qmux_device *qmux,
 				uint8_t service_type, uint8_t client_id,
-				const void *buf)
+				const void *buf, size_t len)
 {
 	const struct qmi_control_hdr *control = buf;
 	const struct qmi_message_hdr *msg = buf + QMI_CONTROL_HDR_SIZE;
@@ -973,9 +1238,15 @@ static void __rx_ctl_message(struct qmi_qmux_device *qmux,
 	if (client_id != 0x00)
 		return;
 
+	if (len < QMI_CONTROL_HDR_SIZE + QMI_MESSAGE_HDR_SIZE)
+		return;
+
 	message = L_LE16_TO_CPU(msg->message);
 	length = L_LE16_TO_CPU(msg->length);
 
+	if (length > len - QMI_CONTROL_HDR_SIZE - QMI_MESSAGE_HDR_SIZE)
+		return;
+
 	if (control->type == 0x02 && control->transaction == 0x00) {
 		handle_indication(&qmux->transport, service_type, client_id,
 					message, length, data);
@@ -1006,13 +1277,14 @@ static bool received_qmux_data(struct l_io *io, void *user_data)
 	if (bytes_read < 0)
 		return true;
 
+	__trace(transport, true, buf, bytes_read);
 	l_util_hexdump(true, buf, bytes_read,
 			transport->debug.func, transport->debug.user_data);
 
 	offset = 0;
 
 	while (offset < bytes_read) {
-		uint16_t len;
+		uint32_t len;
 		const void *msg;
 
 		/* Check if QMI mux header fits into packet */
@@ -1028,7 +1300,7 @@ static bool received_qmux_data(struct l_io *io, void *user_data)
 		len = L_LE16_TO_CPU(hdr->length) + 1;
 
 		/* Check that packet size matches frame size */
-		if (bytes_read - offset < len)
+		if (bytes_read - offset < len || len < QMI_MUX_HDR_SIZE)
 			break;
 
 		__qmux_debug_msg(' ', buf + offset, len,
@@ -1038,10 +1310,12 @@ static bool received_qmux_data(struct l_io *io, void *user_data)
 		msg = buf + offset + QMI_MUX_HDR_SIZE;
 
 		if (hdr->service == QMI_SERVICE_CONTROL)
-			__rx_ctl_message(qmux, hdr->service, hdr->client, msg);
+			__rx_ctl_message(qmux, hdr->service, hdr->client, msg,
+						len - QMI_MUX_HDR_SIZE);
 		else
 			__rx_message(&qmux->transport,
-					hdr->service, hdr->client, msg);
+					hdr->service, hdr->client, msg,
+					len - QMI_MUX_HDR_SIZE);
 
 		offset += len;
 	}
@@ -1078,6 +1352,7 @@ static void service_family_unref(struct service_family *family)
 				L_UINT_TO_PTR(family->info.service_type));
 
 done:
+	l_hashmap_destroy(family->notify_map, notify_map_queue_destroy);
 	l_queue_destroy(family->notify_list, NULL);
 	family->free_family(family);
 }
@@ -1114,6 +1389,7 @@ static void __service_family_init(struct service_family *family,
 	family->transport = transport;
 	family->client_id = client_id;
 	family->notify_list = l_queue_new();
+	family->notify_map = l_hashmap_new();
 	family->group_id = group_id;
 	memcpy(&family->info, info, sizeof(family->info));
 }
@@ -1157,6 +1433,10 @@ static void __qmux_discovery_finished(struct qmi_qmux_device *qmux)
 	qmi_destroy_func_t destroy = qmux->discover.destroy;
 
 	l_timeout_remove(qmux->discover.timeout);
+
+	if (qmux->discover.idle)
+		l_idle_remove(qmux->discover.idle);
+
 	memset(&qmux->discover, 0, sizeof(qmux->discover));
 
 	func(user_data);
@@ -1173,6 +1453,28 @@ static void qmux_sync_callback(struct qmi_request *req, uint16_t message,
 	__qmux_discovery_finished(qmux);
 }
 
+static void __qmux_discovery_sync(struct qmi_qmux_device *qmux)
+{
+	struct qmi_request *req;
+
+	/*
+	 * If the device support the QMI call SYNC over the CTL interface,
+	 * invoke it to reset the state, including release all previously
+	 * allocated clients
+	 */
+	if (qmux->control_version < SERVICE_VERSION(1, 5)) {
+		__qmux_discovery_finished(qmux);
+		return;
+	}
+
+	req = __control_request_alloc(QMI_CTL_SYNC, NULL, 0, 0);
+	req->user_data = qmux;
+
+	DEBUG(&qmux->debug, "Sending sync to reset QMI");
+	qmux->discover.tid = __ctl_request_submit(qmux, req,
+							qmux_sync_callback);
+}
+
 static void qmux_discover_callback(struct qmi_request *req, uint16_t message,
 					uint16_t length, const void *buffer)
 {
@@ -1182,7 +1484,6 @@ static void qmux_discover_callback(struct qmi_request *req, uint16_t message,
 	const void *ptr;
 	uint16_t len;
 	unsigned int i;
-	uint32_t control_version = 0;
 
 	result_code = tlv_get(buffer, length, 0x02, &len);
 	if (!result_code)
@@ -1201,6 +1502,10 @@ static void qmux_discover_callback(struct qmi_request *req, uint16_t message,
 	if (!service_list->count)
 		goto done;
 
+	if (len < QMI_SERVICE_LIST_SIZE + service_list->count *
+				sizeof(service_list->services[0]))
+		goto done;
+
 	l_free(qmux->service_list);
 	qmux->n_services = 0;
 	qmux->service_list = l_new(struct qmi_service_info, service_list->count);
@@ -1221,7 +1526,7 @@ static void qmux_discover_callback(struct qmi_request *req, uint16_t message,
 					type, major, minor);
 
 		if (type == QMI_SERVICE_CONTROL) {
-			control_version = SERVICE_VERSION(major, minor);
+			qmux->control_version = SERVICE_VERSION(major, minor);
 			continue;
 		}
 
@@ -1239,25 +1544,7 @@ static void qmux_discover_callback(struct qmi_request *req, uint16_t message,
 	DEBUG(&qmux->debug, "version string: %s", qmux->version_str);
 
 done:
-	/*
-	 * If the device support the QMI call SYNC over the CTL interface,
-	 * invoke it to reset the state, including release all previously
-	 * allocated clients
-	 */
-	if (control_version >= SERVICE_VERSION(1, 5)) {
-		struct qmi_request *req =
-			__control_request_alloc(QMI_CTL_SYNC, NULL, 0, 0);
-
-		req->user_data = qmux;
-
-		DEBUG(&qmux->debug, "Sending sync to reset QMI");
-		qmux->discover.tid = __ctl_request_submit(qmux, req,
-							qmux_sync_callback);
-
-		return;
-	}
-
-	__qmux_discovery_finished(qmux);
+	__qmux_discovery_sync(qmux);
 }
 
 static void qmux_discover_reply_timeout(struct l_timeout *timeout,
@@ -1285,7 +1572,7 @@ int qmi_qmux_device_discover(struct qmi_qmux_device *qmux,
 
 	DEBUG(&qmux->debug, "device %p", qmux);
 
-	if (qmux->n_services || qmux->discover.tid)
+	if (qmux->n_services || qmux->discover.tid || qmux->discover.idle)
 		return -EALREADY;
 
 	req = __control_request_alloc(QMI_CTL_GET_VERSION_INFO, NULL, 0, 0);
@@ -1303,6 +1590,134 @@ int qmi_qmux_device_discover(struct qmi_qmux_device *qmux,
 	return 0;
 }
 
+static void qmux_discover_idle(struct l_idle *idle, void *user_data)
+{
+	struct qmi_qmux_device *qmux = user_data;
+
+	__qmux_discovery_finished(qmux);
+}
+
+/**
+ * qmi_qmux_device_discover_cached:
+ * @qmux: the device
+ * @services: a table previously returned by qmi_qmux_device_get_services
+ * @func: called once the services can be used
+ * @user_data: user data for @func and @destroy
+ * @destroy: destroy function for @user_data
+ *
+ * Restores the services found by an earlier discovery instead of querying
+ * the device for them.  The device state is still reset, so clients can
+ * be created as after a full discovery.
+ *
+ * Returns: 0 on success, -EINVAL if @services could not be parsed
+ */
+int qmi_qmux_device_discover_cached(struct qmi_qmux_device *qmux,
+				const char *services,
+				qmi_qmux_device_discover_func_t func,
+				void *user_data, qmi_destroy_func_t destroy)
+{
+	_auto_(l_strv_free) char **entries = NULL;
+	struct qmi_service_info *service_list;
+	uint32_t control_version = 0;
+	unsigned int n_services = 0;
+	unsigned int i;
+
+	if (!qmux || !services)
+		return -EINVAL;
+
+	if (qmux->n_services || qmux->discover.tid || qmux->discover.idle)
+		return -EALREADY;
+
+	entries = l_strsplit(services, ' ');
+	service_list = l_new(struct qmi_service_info, l_strv_length(entries));
+
+	for (i = 0; entries[i]; i++) {
+		unsigned int type, major, minor;
+		char c;
+
+		if (sscanf(entries[i], "%u:%u.%u%c", &type, &major, &minor,
+								&c) != 3 ||
+				type > 0xff || major > 0xffff ||
+				minor > 0xffff) {
+			l_free(service_list);
+			return -EINVAL;
+		}
+
+		if (type == QMI_SERVICE_CONTROL) {
+			control_version = SERVICE_VERSION(major, minor);
+			continue;
+		}
+
+		service_list[n_services].service_type = type;
+		service_list[n_services].major = major;
+		service_list[n_services].minor = minor;
+		n_services += 1;
+	}
+
+	if (!n_services) {
+		l_free(service_list);
+		return -EINVAL;
+	}
+
+	DEBUG(&qmux->debug, "device %p restored %u services", qmux,
+								n_services);
+
+	qmux->service_list = service_list;
+	qmux->n_services = n_services;
+	qmux->control_version = control_version;
+
+	qmux->discover.func = func;
+	qmux->discover.user_data = user_data;
+	qmux->discover.destroy = destroy;
+
+	if (control_version >= SERVICE_VERSION(1, 5)) {
+		__qmux_discovery_sync(qmux);
+		qmux->discover.timeout =
+			l_timeout_create(DISCOVER_TIMEOUT,
+						qmux_discover_reply_timeout,
+						qmux, NULL);
+	} else
+		qmux->discover.idle = l_idle_create(qmux_discover_idle,
+							qmux, NULL);
+
+	return 0;
+}
+
+/**
+ * qmi_qmux_device_get_services:
+ * @qmux: the device
+ *
+ * Returns: the discovered services and their versions in a form that can
+ * be stored and handed to qmi_qmux_device_discover_cached, or NULL if no
+ * discovery has completed
+ */
+char *qmi_qmux_device_get_services(struct qmi_qmux_device *qmux)
+{
+	struct l_string *str;
+	unsigned int i;
+
+	if (!qmux || !qmux->n_services)
+		return NULL;
+
+	str = l_string_new(16 * (qmux->n_services + 1));
+
+	if (qmux->control_version)
+		l_string_append_printf(str, "%u:%u.%u", QMI_SERVICE_CONTROL,
+					qmux->control_version >> 16,
+					qmux->control_version & 0xffff);
+
+	for (i = 0; i < qmux->n_services; i++) {
+		const struct qmi_service_info *info = &qmux->service_list[i];
+
+		l_string_append_printf(str, "%s%u:%u.%u",
+					l_string_length(str) ? " " : "",
+					info->service_type,
+					info->major, info->minor);
+	}
+
+	return l_string_unwrap(str);
+}
+
 static void qmux_client_release_callback(struct qmi_request *req,
 					uint16_t message, uint16_t length,
 					const void *buffer)
@@ -1370,7 +1785,7 @@ static void qmux_create_client_request_free(struct qmi_request *r)
 	if (req->destroy)
 		req->destroy(req->user_data);
 
-	l_free(req);
+	__request_release(req, &req->super);
 }
 
 static void qmux_create_client_timeout(struct l_timeout *timeout,
@@ -1496,6 +1911,9 @@ static void __qmux_device_free(struct qmi_qmux_device *qmux)
 
 	l_timeout_remove(qmux->discover.timeout);
 
+	if (qmux->discover.idle)
+		l_idle_remove(qmux->discover.idle);
+
 	if (qmux->discover.destroy)
 		qmux->discover.destroy(qmux->discover.user_data);
 
@@ -1567,12 +1985,20 @@ static const struct qmi_transport_ops qmux_ops = {
 	.write = qmi_qmux_device_write,
 };
 
-struct qmi_qmux_device *qmi_qmux_device_new(const char *device)
+/**
+ * qmi_qmux_device_new_from_fd:
+ * @fd: an open file descriptor carrying QMUX frames
+ *
+ * Creates a QMUX device on top of @fd, which is closed when the device is
+ * freed.  Reads and writes on @fd must preserve the frame boundaries, as
+ * they do on cdc-wdm character devices or SOCK_SEQPACKET sockets.
+ *
+ * Returns: the new device, or NULL on failure.  @fd is closed in that case.
+ */
+struct qmi_qmux_device *qmi_qmux_device_new_from_fd(int fd)
 {
 	struct qmi_qmux_device *qmux;
-	int fd;
 
-	fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
 	if (fd < 0)
 		return NULL;
 
@@ -1592,6 +2018,17 @@ struct qmi_qmux_device *qmi_qmux_device_new(const char *device)
 	return qmux;
 }
 
+struct qmi_qmux_device *qmi_qmux_device_new(const char *device)
+{
+	int fd;
+
+	fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	return qmi_qmux_device_new_from_fd(fd);
+}
+
 void qmi_qmux_device_free(struct qmi_qmux_device *qmux)
 {
 	if (!qmux)
@@ -1626,6 +2063,16 @@ void qmi_qmux_device_set_io_debug(struct qmi_qmux_device *qmux,
 	__debug_data_init(&qmux->transport.debug, func, user_data);
 }
 
+void qmi_qmux_device_set_trace(struct qmi_qmux_device *qmux,
+				qmi_trace_func_t func, void *user_data)
+{
+	if (!qmux)
+		return;
+
+	qmux->transport.trace.func = func;
+	qmux->transport.trace.user_data = user_data;
+}
+
 struct qmi_qrtr_node {
 	unsigned int next_group_id;	/* Matches requests with services */
 	struct l_queue *service_infos;
@@ -1701,39 +2148,60 @@ static struct service_family *qrtr_service_family_new(
 }
 
 static int qmi_qrtr_node_write(struct qmi_transport *transport,
-					struct qmi_request *req)
+					struct qmi_request **reqs,
+					unsigned int n_reqs)
 {
-	struct sockaddr_qrtr addr;
-	uint8_t *data;
-	uint16_t len;
-	ssize_t bytes_written;
+	struct sockaddr_qrtr addr[MAX_WRITE_BATCH];
+	struct iovec iov[MAX_WRITE_BATCH];
+	struct mmsghdr msgs[MAX_WRITE_BATCH];
 	int fd = l_io_get_fd(transport->io);
+	unsigned int i;
+	int sent;
 
-	/* Skip the QMUX header */
-	data = req->data + QMI_MUX_HDR_SIZE;
-	len = req->len - QMI_MUX_HDR_SIZE;
+	if (n_reqs > MAX_WRITE_BATCH)
+		n_reqs = MAX_WRITE_BATCH;
 
-	memset(&addr, 0, sizeof(addr));	/* Ensures internal padding is 0 */
-	addr.sq_family = AF_QIPCRTR;
-	addr.sq_node = req->info.qrtr_node;
-	addr.sq_port = req->info.qrtr_port;
+	memset(addr, 0, sizeof(addr));	/* Ensures internal padding is 0 */
+	memset(msgs, 0, sizeof(msgs));
 
-	bytes_written = sendto(fd, data, len, 0, (struct sockaddr *) &addr,
-							sizeof(addr));
-	if (bytes_written < 0) {
-		DEBUG(&transport->debug, "sendto: %s", strerror(errno));
+	for (i = 0; i < n_reqs; i++) {
+		struct qmi_request *req = reqs[i];
+
+		addr[i].sq_family = AF_QIPCRTR;
+		addr[i].sq_node = req->info.qrtr_node;
+		addr[i].sq_port = req->info.qrtr_port;
+
+		/* Skip the QMUX header */
+		iov[i].iov_base = req->data + QMI_MUX_HDR_SIZE;
+		iov[i].iov_len = req->len - QMI_MUX_HDR_SIZE;
+
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	sent = sendmmsg(fd, msgs, n_reqs, 0);
+	if (sent < 0) {
+		DEBUG(&transport->debug, "sendmmsg: %s", strerror(errno));
 		return -errno;
 	}
 
-	l_util_hexdump(false, data, bytes_written,
-			transport->debug.func, transport->debug.user_data);
+	for (i = 0; i < (unsigned int) sent; i++) {
+		struct qmi_request *req = reqs[i];
 
-	__qrtr_debug_msg(' ', data, bytes_written,
-			req->info.service_type, &transport->debug);
+		__trace(transport, false, iov[i].iov_base, msgs[i].msg_len);
+		l_util_hexdump(false, iov[i].iov_base, msgs[i].msg_len,
+				transport->debug.func,
+				transport->debug.user_data);
 
-	l_queue_push_tail(transport->service_queue, req);
+		__qrtr_debug_msg(' ', iov[i].iov_base, msgs[i].msg_len,
+				req->info.service_type, &transport->debug);
 
-	return 0;
+		l_queue_push_tail(transport->service_queue, req);
+	}
+
+	return sent;
 }
 
 static void qrtr_debug_ctrl_request(const struct qrtr_ctrl_pkt *packet,
@@ -1841,7 +2309,7 @@ static void qrtr_received_service_message(struct qmi_qrtr_node *node,
 	}
 
 	__qrtr_debug_msg(' ', buf, len, service_type, &transport->debug);
-	__rx_message(transport, service_type, 0, buf);
+	__rx_message(transport, service_type, 0, buf, len);
 }
 
 static bool qrtr_received_data(struct l_io *io, void *user_data)
@@ -1863,6 +2331,7 @@ static bool qrtr_received_data(struct l_io *io, void *user_data)
 	if (bytes_read < 0)
 		return true;
 
+	__trace(&qrtr->transport, true, buf, bytes_read);
 	l_util_hexdump(true, buf, bytes_read, debug->func, debug->user_data);
 
 	if (addr.sq_port == QRTR_PORT_CTRL)
@@ -1934,6 +2403,16 @@ void qmi_qrtr_node_set_io_debug(struct qmi_qrtr_node *node,
 	__debug_data_init(&node->transport.debug, func, user_data);
 }
 
+void qmi_qrtr_node_set_trace(struct qmi_qrtr_node *node,
+				qmi_trace_func_t func, void *user_data)
+{
+	if (!node)
+		return;
+
+	node->transport.trace.func = func;
+	node->transport.trace.user_data = user_data;
+}
+
 static void qrtr_lookup_reply_timeout(struct l_timeout *timeout,
 							void *user_data)
 {
@@ -1991,6 +2470,7 @@ int qmi_qrtr_node_lookup(struct qmi_qrtr_node *node,
 		return -errno;
 	}
 
+	__trace(&node->transport, false, &packet, bytes_written);
 	l_util_hexdump(false, &packet, bytes_written,
 			debug->func, debug->user_data);
 
@@ -2081,9 +2561,11 @@ static bool qrtr_service_family_dedicated_rx(struct l_io *io, void *user_data)
 	if (addr.sq_port != info->qrtr_port && addr.sq_node != info->qrtr_node)
 		return true;
 
+	__trace(&family->transport, true, buf, bytes_read);
 	l_util_hexdump(true, buf, bytes_read, debug->func, debug->user_data);
 	__qrtr_debug_msg(' ', buf, bytes_read, info->service_type, debug);
-	__rx_message(&family->transport, info->service_type, 0, buf);
+	__rx_message(&family->transport, info->service_type, 0, buf,
+								bytes_read);
 
 	return true;
 }
@@ -2130,13 +2612,29 @@ struct qmi_service *qmi_qrtr_node_get_dedicated_service(
 					family, NULL);
 	memcpy(&family->transport.debug, &node->transport.debug,
 						sizeof(struct debug_data));
+	memcpy(&family->transport.trace, &node->transport.trace,
+						sizeof(struct trace_data));
 
 	return service_create(&family->super);
 }
 
 struct qmi_param *qmi_param_new(void)
 {
-	return l_new(struct qmi_param, 1);
+	struct qmi_param *param = pool_get(&param_pool, sizeof(*param));
+
+	memset(param, 0, sizeof(*param));
+
+	return param;
+}
+
+static void param_release_buf(struct qmi_param *param)
+{
+	if (param->size == REQUEST_BLOCK_SIZE)
+		pool_put(&request_pool, param->buf);
+	else
+		l_free(param->buf);
+
+	param->buf = NULL;
 }
 
 void qmi_param_free(struct qmi_param *param)
@@ -2144,15 +2642,17 @@ void qmi_param_free(struct qmi_param *param)
 	if (!param)
 		return;
 
-	l_free(param->data);
-	l_free(param);
+	if (param->buf)
+		param_release_buf(param);
+
+	pool_put(&param_pool, param);
 }
 
 bool qmi_param_append(struct qmi_param *param, uint8_t type,
 					uint16_t length, const void *data)
 {
 	struct qmi_tlv_hdr *tlv;
-	void *ptr;
+	size_t needed;
 
 	if (!param || !type)
 		return false;
@@ -2163,19 +2663,37 @@ bool qmi_param_append(struct qmi_param *param, uint8_t type,
 	if (!data)
 		return false;
 
-	if (param->data)
-		ptr = l_realloc(param->data,
-				param->length + QMI_TLV_HDR_SIZE + length);
-	else
-		ptr = l_malloc(QMI_TLV_HDR_SIZE + length);
+	needed = SERVICE_REQUEST_HEADROOM + param->length +
+						QMI_TLV_HDR_SIZE + length;
+
+	if (!param->buf) {
+		if (needed <= REQUEST_BLOCK_SIZE) {
+			param->buf = pool_get(&request_pool,
+						REQUEST_BLOCK_SIZE);
+			param->size = REQUEST_BLOCK_SIZE;
+		} else {
+			param->buf = l_malloc(needed);
+			param->size = needed;
+		}
+	} else if (needed > param->size) {
+		/* Only buffers outgrowing a pool block ever get here */
+		uint8_t *buf = l_malloc(needed);
+
+		memcpy(buf + SERVICE_REQUEST_HEADROOM,
+				param->buf + SERVICE_REQUEST_HEADROOM,
+				param->length);
+		param_release_buf(param);
+		param->buf = buf;
+		param->size = needed;
+	}
 
-	tlv = ptr + param->length;
+	tlv = (struct qmi_tlv_hdr *) (param->buf + SERVICE_REQUEST_HEADROOM +
+							param->length);
 
 	tlv->type = type;
 	tlv->length = L_CPU_TO_LE16(length);
 	memcpy(tlv->value, data, length);
 
-	param->data = ptr;
 	param->length += QMI_TLV_HDR_SIZE + length;
 
 	return true;
@@ -2277,13 +2795,63 @@ const char *qmi_result_get_error(struct qmi_result *result)
 	return __error_to_string(result->error);
 }
 
+/*
+ * Results are usually queried for several TLVs in a row, so walk the
+ * message once on the first lookup and remember where each type starts.
+ * When a type is repeated the first one wins, same as with tlv_get.
+ */
+static void result_index(struct qmi_result *result)
+{
+	const uint8_t *ptr = result->data;
+	uint16_t len = result->length;
+
+	memset(result->tlv_offset, 0, sizeof(result->tlv_offset));
+	result->indexed = true;
+
+	while (len > QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = (const void *) ptr;
+		uint16_t tlv_length = L_LE16_TO_CPU(tlv->length);
+		uint16_t offset = ptr - (const uint8_t *) result->data;
+
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
+		if (!result->tlv_offset[tlv->type])
+			result->tlv_offset[tlv->type] = offset + 1;
+
+		ptr += QMI_TLV_HDR_SIZE + tlv_length;
+		len -= QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *result_tlv_get(struct qmi_result *result, uint8_t type,
+							uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+	uint16_t offset;
+
+	if (!result->indexed)
+		result_index(result);
+
+	offset = result->tlv_offset[type];
+	if (!offset)
+		return NULL;
+
+	tlv = (const void *) ((const uint8_t *) result->data + offset - 1);
+
+	if (length)
+		*length = L_LE16_TO_CPU(tlv->length);
+
+	return tlv->value;
+}
+
 const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 							uint16_t *length)
 {
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -2294,7 +2862,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -2310,7 +2878,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr || len != sizeof(uint8_t))
 		return false;
 
@@ -2329,7 +2897,7 @@ bool qmi_result_get_int16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr || len != sizeof(int16_t))
 		return false;
 
@@ -2350,7 +2918,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr || len != sizeof(uint16_t))
 		return false;
 
@@ -2372,7 +2940,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr || len != sizeof(uint32_t))
 		return false;
 
@@ -2394,7 +2962,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr || len != sizeof(uint64_t))
 		return false;
 
@@ -2406,6 +2974,76 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	return true;
 }
 
+/**
+ * qmi_result_get_fields:
+ * @result: the result to decode
+ * @fields: table of up to 32 TLV types and where their values go
+ * @n_fields: number of entries in @fields
+ * @out: the struct the offsets in @fields refer to
+ *
+ * Decodes a set of fixed size TLVs in one go.  Members for TLVs that are
+ * missing or have an unexpected length are left untouched.
+ *
+ * Returns: a mask with bit N set if @fields[N] was found and decoded
+ */
+uint32_t qmi_result_get_fields(struct qmi_result *result,
+					const struct qmi_result_field *fields,
+					unsigned int n_fields, void *out)
+{
+	static const uint8_t sizes[] = {
+		[QMI_RESULT_FIELD_UINT8] = sizeof(uint8_t),
+		[QMI_RESULT_FIELD_INT16] = sizeof(int16_t),
+		[QMI_RESULT_FIELD_UINT16] = sizeof(uint16_t),
+		[QMI_RESULT_FIELD_UINT32] = sizeof(uint32_t),
+		[QMI_RESULT_FIELD_UINT64] = sizeof(uint64_t),
+	};
+	uint32_t found = 0;
+	unsigned int i;
+
+	if (!result || !fields || !out || n_fields > 32)
+		return 0;
+
+	for (i = 0; i < n_fields; i++) {
+		const struct qmi_result_field *field = &fields[i];
+		uint8_t *dest = (uint8_t *) out + field->offset;
+		const void *ptr;
+		uint16_t len;
+		uint16_t u16;
+		uint32_t u32;
+		uint64_t u64;
+
+		if (!field->type || field->format >= L_ARRAY_SIZE(sizes))
+			continue;
+
+		ptr = result_tlv_get(result, field->type, &len);
+		if (!ptr || len != sizes[field->format])
+			continue;
+
+		switch (field->format) {
+		case QMI_RESULT_FIELD_UINT8:
+			*dest = l_get_u8(ptr);
+			break;
+		case QMI_RESULT_FIELD_INT16:
+		case QMI_RESULT_FIELD_UINT16:
+			u16 = l_get_le16(ptr);
+			memcpy(dest, &u16, sizeof(u16));
+			break;
+		case QMI_RESULT_FIELD_UINT32:
+			u32 = l_get_le32(ptr);
+			memcpy(dest, &u32, sizeof(u32));
+			break;
+		case QMI_RESULT_FIELD_UINT64:
+			u64 = l_get_le64(ptr);
+			memcpy(dest, &u64, sizeof(u64));
+			break;
+		}
+
+		found |= 1U << i;
+	}
+
+	return found;
+}
+
 const char *qmi_service_get_identifier(struct qmi_service *service)
 {
 	if (!service)
@@ -2445,7 +3083,7 @@ static void qmi_service_request_free(struct qmi_request *req)
 	if (sreq->destroy)
 		sreq->destroy(sreq->user_data);
 
-	l_free(sreq);
+	__request_release(sreq, req);
 }
 
 static void service_send_callback(struct qmi_request *req, uint16_t message,
@@ -2460,6 +3098,7 @@ static void service_send_callback(struct qmi_request *req, uint16_t message,
 	result.message = message;
 	result.data = buffer;
 	result.length = length;
+	result.indexed = false;
 
 	result_code = tlv_get(buffer, length, 0x02, &len);
 	if (!result_code)
@@ -2498,10 +3137,20 @@ uint16_t qmi_service_send(struct qmi_service *service,
 		return 0;
 
 	info = &family->info;
-	sreq = __request_alloc(info->service_type, family->client_id, message,
-				param ? param->data : NULL,
-				param ? param->length : 0,
+
+	if (param && param->buf) {
+		/* The TLVs are already in place, only the headers are missing */
+		sreq = (struct qmi_service_request *) param->buf;
+		__request_init(sreq, info->service_type, family->client_id,
+				message, param->length,
+				offsetof(struct qmi_service_request, super),
+				param->size == REQUEST_BLOCK_SIZE);
+		param->buf = NULL;
+	} else
+		sreq = __request_alloc(info->service_type, family->client_id,
+				message, NULL, 0,
 				offsetof(struct qmi_service_request, super));
+
 	qmi_param_free(param);
 
 	memcpy(&sreq->super.info, info, sizeof(*info));
@@ -2564,6 +3213,8 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 						&lookup);
 		if (!req)
 			return false;
+
+		resume_writer(transport);
 	}
 
 	__request_free(req);
@@ -2616,6 +3267,7 @@ static bool qmi_service_cancel_all(struct qmi_service *service)
 				service->family->group_id, service->handle);
 	remove_client(transport->service_queue,
 				service->family->group_id, service->handle);
+	resume_writer(transport);
 
 	return true;
 }
@@ -2626,6 +3278,7 @@ uint16_t qmi_service_register(struct qmi_service *service,
 {
 	struct qmi_notify *notify;
 	struct service_family *family;
+	struct l_queue *queue;
 
 	if (!service || !func)
 		return 0;
@@ -2646,6 +3299,15 @@ uint16_t qmi_service_register(struct qmi_service *service,
 
 	l_queue_push_tail(family->notify_list, notify);
 
+	queue = l_hashmap_lookup(family->notify_map, L_UINT_TO_PTR(message));
+	if (!queue) {
+		queue = l_queue_new();
+		l_hashmap_insert(family->notify_map, L_UINT_TO_PTR(message),
+									queue);
+	}
+
+	l_queue_push_tail(queue, notify);
+
 	return notify->id;
 }
 
@@ -2666,6 +3328,7 @@ bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 	if (!notify)
 		return false;
 
+	notify_map_remove(service->family->notify_map, notify);
 	__notify_free(notify);
 
 	return true;
@@ -2674,11 +3337,12 @@ bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 static bool remove_notify_if_handle_match(void *data, void *user_data)
 {
 	struct qmi_notify *notify = data;
-	unsigned int handle = L_PTR_TO_UINT(user_data);
+	struct qmi_service *service = user_data;
 
-	if (notify->service_handle != handle)
+	if (notify->service_handle != service->handle)
 		return false;
 
+	notify_map_remove(service->family->notify_map, notify);
 	__notify_free(notify);
 
 	return true;
@@ -2690,12 +3354,26 @@ static bool qmi_service_unregister_all(struct qmi_service *service)
 		return false;
 
 	l_queue_foreach_remove(service->family->notify_list,
-					remove_notify_if_handle_match,
-					L_UINT_TO_PTR(service->handle));
+					remove_notify_if_handle_match, service);
 
 	return true;
 }
 
+/**
+ * qmi_service_get_indication_count:
+ * @service: lightweight service handle
+ *
+ * Returns: the number of indications received by the client @service
+ * belongs to, whether or not anything was registered for them
+ */
+uint32_t qmi_service_get_indication_count(struct qmi_service *service)
+{
+	if (!service)
+		return 0;
+
+	return service->family->indications;
+}
+
 struct qmi_service *qmi_service_clone(struct qmi_service *service)
 {
 	if (!service)
@@ -8,6 +8,7 @@
 #include <ell/cleanup.h>
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define QMI_SERVICE_CONTROL	0	/* Control service */
@@ -62,6 +63,8 @@ struct qmi_service;
 struct qmi_result;
 
 typedef void (*qmi_debug_func_t)(const char *str, void *user_data);
+typedef void (*qmi_trace_func_t)(bool in, int fd, const void *data,
+					size_t len, void *user_data);
 typedef void (*qmi_qmux_device_discover_func_t)(void *user_data);
 typedef void (*qmi_qmux_device_create_client_func_t)(struct qmi_service *,
 							void *user_data);
@@ -71,14 +74,22 @@ typedef void (*qmi_qrtr_node_lookup_done_func_t)(void *);
 typedef void (*qmi_service_result_func_t)(struct qmi_result *, void *);
 
 struct qmi_qmux_device *qmi_qmux_device_new(const char *device);
+struct qmi_qmux_device *qmi_qmux_device_new_from_fd(int fd);
 void qmi_qmux_device_free(struct qmi_qmux_device *qmux);
 void qmi_qmux_device_set_debug(struct qmi_qmux_device *qmux,
 				qmi_debug_func_t func, void *user_data);
 void qmi_qmux_device_set_io_debug(struct qmi_qmux_device *qmux,
 				qmi_debug_func_t func, void *user_data);
+void qmi_qmux_device_set_trace(struct qmi_qmux_device *qmux,
+				qmi_trace_func_t func, void *user_data);
 int qmi_qmux_device_discover(struct qmi_qmux_device *qmux,
 				qmi_qmux_device_discover_func_t func,
 				void *user_data, qmi_destroy_func_t destroy);
+int qmi_qmux_device_discover_cached(struct qmi_qmux_device *qmux,
+				const char *services,
+				qmi_qmux_device_discover_func_t func,
+				void *user_data, qmi_destroy_func_t destroy);
+char *qmi_qmux_device_get_services(struct qmi_qmux_device *qmux);
 bool qmi_qmux_device_create_client(struct qmi_qmux_device *qmux,
 				uint16_t service_type,
 				qmi_qmux_device_create_client_func_t func,
@@ -97,6 +108,8 @@ void qmi_qrtr_node_set_debug(struct qmi_qrtr_node *node,
 				qmi_debug_func_t func, void *user_data);
 void qmi_qrtr_node_set_io_debug(struct qmi_qrtr_node *node,
 				qmi_debug_func_t func, void *user_data);
+void qmi_qrtr_node_set_trace(struct qmi_qrtr_node *node,
+				qmi_trace_func_t func, void *user_data);
 int qmi_qrtr_node_lookup(struct qmi_qrtr_node *node,
 			qmi_qrtr_node_lookup_done_func_t func,
 			void *user_data, qmi_destroy_func_t destroy);
@@ -145,6 +158,25 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 							uint64_t *value);
 void qmi_result_print_tlvs(struct qmi_result *result);
 
+enum qmi_result_field_type {
+	QMI_RESULT_FIELD_UINT8,
+	QMI_RESULT_FIELD_INT16,
+	QMI_RESULT_FIELD_UINT16,
+	QMI_RESULT_FIELD_UINT32,
+	QMI_RESULT_FIELD_UINT64,
+};
+
+/* Describes where the value of a fixed size TLV is stored in a struct */
+struct qmi_result_field {
+	uint8_t type;
+	enum qmi_result_field_type format;
+	size_t offset;
+};
+
+uint32_t qmi_result_get_fields(struct qmi_result *result,
+					const struct qmi_result_field *fields,
+					unsigned int n_fields, void *out);
+
 int qmi_error_to_ofono_cme(int qmi_error);
 
 struct qmi_service *qmi_service_clone(struct qmi_service *service);
@@ -154,6 +186,7 @@ DEFINE_CLEANUP_FUNC(qmi_service_free)
 
 const char *qmi_service_get_identifier(struct qmi_service *service);
 bool qmi_service_get_version(struct qmi_service *service, uint8_t *out_version);
+uint32_t qmi_service_get_indication_count(struct qmi_service *service);
 
 uint16_t qmi_service_send(struct qmi_service *service,
 				uint16_t message, struct qmi_param *param,
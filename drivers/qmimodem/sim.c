@@ -250,8 +250,47 @@ error:
 	l_free(cbd);
 }
 
-static void qmi_read_record(struct ofono_sim *sim,
-				int fileid, int record, int length,
+/* Records after the first one of a multi record read come in TLV 0x12 */
+static void read_records_cb(struct qmi_result *result, void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_sim_read_cb_t cb = cbd->cb;
+	const unsigned char *content;
+	const unsigned char *additional;
+	uint16_t len;
+	uint16_t additional_len;
+	unsigned char *buf;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		CALLBACK_WITH_FAILURE(cb, NULL, 0, cbd->data);
+		return;
+	}
+
+	content = qmi_result_get(result, 0x11, &len);
+	if (!content || len < 2) {
+		CALLBACK_WITH_FAILURE(cb, NULL, 0, cbd->data);
+		return;
+	}
+
+	additional = qmi_result_get(result, 0x12, &additional_len);
+	if (!additional || additional_len < 2) {
+		CALLBACK_WITH_SUCCESS(cb, content + 2, len - 2, cbd->data);
+		return;
+	}
+
+	buf = l_malloc(len - 2 + additional_len - 2);
+	memcpy(buf, content + 2, len - 2);
+	memcpy(buf + len - 2, additional + 2, additional_len - 2);
+
+	CALLBACK_WITH_SUCCESS(cb, buf, len - 2 + additional_len - 2,
+				cbd->data);
+	l_free(buf);
+}
+
+static void read_record(struct ofono_sim *sim, int fileid, int record,
+				int last, int length,
 				const unsigned char *path,
 				unsigned int path_len,
 				ofono_sim_read_cb_t cb, void *user_data)
@@ -282,8 +321,13 @@ static void qmi_read_record(struct ofono_sim *sim,
 	qmi_param_append(param, 0x02, fileid_len, fileid_data);
 	qmi_param_append(param, 0x03, sizeof(read_data), read_data);
 
+	if (last > record)
+		qmi_param_append_uint16(param, 0x10, last);
+
 	if (qmi_service_send(data->uim, QMI_UIM_READ_RECORD, param,
-					read_generic_cb, cbd, l_free) > 0)
+				last > record ? read_records_cb :
+						read_generic_cb,
+				cbd, l_free) > 0)
 		return;
 
 	qmi_param_free(param);
@@ -293,6 +337,26 @@ error:
 	l_free(cbd);
 }
 
+static void qmi_read_record(struct ofono_sim *sim,
+				int fileid, int record, int length,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *user_data)
+{
+	read_record(sim, fileid, record, record, length, path, path_len,
+			cb, user_data);
+}
+
+static void qmi_read_records(struct ofono_sim *sim, int fileid,
+				int record, int count, int length,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *user_data)
+{
+	read_record(sim, fileid, record, record + count - 1, length,
+			path, path_len, cb, user_data);
+}
+
 static void write_generic_cb(struct qmi_result *result, void *user_data)
 {
 	struct cb_data *cbd = user_data;
@@ -1095,6 +1159,7 @@ static const struct ofono_sim_driver driver = {
 	.read_file_transparent	= qmi_read_transparent,
 	.read_file_linear	= qmi_read_record,
 	.read_file_cyclic	= qmi_read_record,
+	.read_file_records	= qmi_read_records,
 	.write_file_transparent = qmi_write_transparent,
 	.write_file_linear	= qmi_write_linear,
 	.write_file_cyclic	= qmi_write_cyclic,
@@ -20,18 +20,27 @@
 #include "wms.h"
 #include "util.h"
 
+#define SMS_READS_IN_FLIGHT 8
+
 struct sms_data {
 	struct qmi_service *wms;
-	struct qmi_wms_read_msg_id rd_msg_id;
 	struct qmi_wms_result_msg_list *msg_list;
 	uint32_t rd_msg_num;
+	unsigned int reads_in_flight;
+	unsigned int deletes_in_flight;
+	uint8_t read_stores;		/* Storages holding messages read */
 	uint8_t msg_mode;
 	bool msg_mode_all;
 	bool msg_list_chk;
+	bool relist;			/* New messages announced meanwhile */
+};
+
+struct sms_read {
+	struct ofono_sms *sms;
+	struct qmi_wms_read_msg_id id;
 };
 
 static void get_msg_list(struct ofono_sms *sms);
-static void raw_read(struct ofono_sms *sms, uint8_t type, uint32_t ndx);
 
 static void get_smsc_addr_cb(struct qmi_result *result, void *user_data)
 {
@@ -308,7 +317,9 @@ static void qmi_bearer_set(struct ofono_sms *sms, int bearer,
 	l_free(cbd);
 }
 
-static void delete_msg_cb(struct qmi_result *result, void *user_data)
+static void read_next(struct ofono_sms *sms);
+
+static void delete_read_cb(struct qmi_result *result, void *user_data)
 {
 	struct ofono_sms *sms = user_data;
 	struct sms_data *data = ofono_sms_get_data(sms);
@@ -319,78 +330,67 @@ static void delete_msg_cb(struct qmi_result *result, void *user_data)
 	if (qmi_result_set_error(result, &err))
 		DBG("Err: delete %d - %s", err, qmi_result_get_error(result));
 
+	if (--data->deletes_in_flight)
+		return;
+
 	/*
-	 * Continue processing msg list. If error occurred, something
-	 * serious happened, then don't bother.
+	 * A listing is repeated until it comes back empty, as messages
+	 * that arrived meanwhile may only be found that way.  Once it does,
+	 * rely on event indications to get new messages.
 	 */
-	if (data->msg_list && data->msg_list_chk) {
-		uint32_t msg = ++data->rd_msg_num;
-
-		/*
-		 * Get another msg. If list is empty check for more. Once query
-		 * returns empty, rely on event indication to get new msgs.
-		 */
-		if (msg < data->msg_list->cnt)
-			raw_read(sms, data->msg_list->msg[msg].type,
-				L_LE32_TO_CPU(data->msg_list->msg[msg].ndx));
-		else
-			get_msg_list(sms);
+	if (data->msg_list_chk || data->relist) {
+		data->relist = false;
+		get_msg_list(sms);
 	}
 }
 
-static void delete_msg(struct ofono_sms *sms, uint8_t tag)
+static void delete_msg(struct ofono_sms *sms, uint8_t store, uint8_t tag,
+				qmi_service_result_func_t func)
 {
 	struct sms_data *data = ofono_sms_get_data(sms);
 	struct qmi_param *param;
-	qmi_service_result_func_t func = NULL;
 
-	DBG("");
+	DBG("delete msgs in store %d tag %d mode %d", store, tag,
+		data->msg_mode);
 
 	param = qmi_param_new();
 
-	qmi_param_append_uint8(param, QMI_WMS_PARAM_DEL_STORE,
-				QMI_WMS_STORAGE_TYPE_NV);
-
-	if (tag == QMI_WMS_MT_UNDEFINE) {
-		DBG("delete read msg type %d ndx %d", data->rd_msg_id.type,
-			data->rd_msg_id.ndx);
-
-		/* delete 1 msg */
-		qmi_param_append_uint32(param, QMI_WMS_PARAM_DEL_NDX,
-					data->rd_msg_id.ndx);
-		func = delete_msg_cb;
-	} else {
-		DBG("delete msg tag %d mode %d", tag, data->msg_mode);
-
-		/* delete all msgs from 1 tag type */
-		qmi_param_append_uint8(param, QMI_WMS_PARAM_DEL_TYPE, tag);
-	}
-
+	/* delete all msgs from 1 tag type */
+	qmi_param_append_uint8(param, QMI_WMS_PARAM_DEL_STORE, store);
+	qmi_param_append_uint8(param, QMI_WMS_PARAM_DEL_TYPE, tag);
 	qmi_param_append_uint8(param, QMI_WMS_PARAM_DEL_MODE, data->msg_mode);
 
 	if (qmi_service_send(data->wms, QMI_WMS_DELETE, param,
-				func, sms, NULL) > 0)
+				func, sms, NULL) > 0) {
+		if (func)
+			data->deletes_in_flight += 1;
+
 		return;
+	}
 
 	qmi_param_free(param);
-	data->msg_list_chk = false;
 }
 
 static void raw_read_cb(struct qmi_result *result, void *user_data)
 {
-	struct ofono_sms *sms = user_data;
+	struct sms_read *req = user_data;
+	struct ofono_sms *sms = req->sms;
 	struct sms_data *data = ofono_sms_get_data(sms);
 	const struct qmi_wms_raw_message *msg;
 	uint16_t err;
 
 	DBG("");
 
+	data->reads_in_flight -= 1;
+
 	if (qmi_result_set_error(result, &err)) {
 		DBG("Err: read %d - %s", err, qmi_result_get_error(result));
-		data->msg_list_chk = false;
-		return;
+		goto next;
 	}
 
+	/* Reading tagged the message as read, it goes with the batch */
+	data->read_stores |= 1 << req->id.type;
+
 	/* Raw message data */
 	msg = qmi_result_get(result, QMI_WMS_RESULT_READ_MSG, NULL);
 	if (msg) {
@@ -402,37 +402,87 @@ static void raw_read_cb(struct qmi_result *result, void *user_data)
 
 		ofono_sms_deliver_notify(sms, msg->msg_data, plen, tpdu_len);
 	} else
-		DBG("Err: no data in type %d ndx %d", data->rd_msg_id.type,
-			data->rd_msg_id.ndx);
+		DBG("Err: no data in type %d ndx %d", req->id.type,
+			L_LE32_TO_CPU(req->id.ndx));
 
-	/* delete read msg */
-	delete_msg(sms, QMI_WMS_MT_UNDEFINE);
+next:
+	read_next(sms);
 }
 
-static void raw_read(struct ofono_sms *sms, uint8_t type, uint32_t ndx)
+static bool raw_read(struct ofono_sms *sms, uint8_t type, uint32_t ndx)
 {
 	struct sms_data *data = ofono_sms_get_data(sms);
 	struct qmi_param *param;
+	struct sms_read *req;
 
-	DBG("");
-
-	param = qmi_param_new();
+	DBG("read type %d ndx %d", type, ndx);
 
-	data->rd_msg_id.type = type;
-	data->rd_msg_id.ndx = ndx;
+	req = l_new(struct sms_read, 1);
+	req->sms = sms;
+	req->id.type = type;
+	req->id.ndx = L_CPU_TO_LE32(ndx);
 
-	DBG("read type %d ndx %d", data->rd_msg_id.type, data->rd_msg_id.ndx);
+	param = qmi_param_new();
 
 	qmi_param_append(param, QMI_WMS_PARAM_READ_MSG,
-				sizeof(data->rd_msg_id), &data->rd_msg_id);
+				sizeof(req->id), &req->id);
 	qmi_param_append_uint8(param, QMI_WMS_PARAM_READ_MODE, data->msg_mode);
 
 	if (qmi_service_send(data->wms, QMI_WMS_RAW_READ, param,
-				raw_read_cb, sms, NULL) > 0)
-		return;
+				raw_read_cb, req, l_free) > 0) {
+		data->reads_in_flight += 1;
+		return true;
+	}
 
 	qmi_param_free(param);
+	l_free(req);
+
+	return false;
+}
+
+/*
+ * Up to SMS_READS_IN_FLIGHT messages are read at a time.  Once all are
+ * in, the messages read are deleted with one request per storage, by
+ * their read tag, instead of one delete per message.
+ */
+static void read_next(struct ofono_sms *sms)
+{
+	struct sms_data *data = ofono_sms_get_data(sms);
+	uint8_t store;
+
+	while (data->msg_list && data->rd_msg_num < data->msg_list->cnt &&
+			data->reads_in_flight < SMS_READS_IN_FLIGHT) {
+		uint32_t msg = data->rd_msg_num++;
+
+		if (!raw_read(sms, data->msg_list->msg[msg].type,
+				L_LE32_TO_CPU(data->msg_list->msg[msg].ndx)))
+			break;
+	}
+
+	if (data->reads_in_flight)
+		return;
+
+	l_free(data->msg_list);
+	data->msg_list = NULL;
+
+	for (store = 0; data->read_stores; store++) {
+		if (!(data->read_stores & (1 << store)))
+			continue;
+
+		data->read_stores &= ~(1 << store);
+		delete_msg(sms, store, QMI_WMS_MT_READ, delete_read_cb);
+	}
+
+	if (data->deletes_in_flight)
+		return;
+
+	/* Nothing could be read, don't loop on the listing */
 	data->msg_list_chk = false;
+
+	if (data->relist) {
+		data->relist = false;
+		get_msg_list(sms);
+	}
 }
 
 static void get_msg_list_cb(struct qmi_result *result, void *user_data)
@@ -441,12 +491,12 @@ static void get_msg_list_cb(struct qmi_result *result, void *user_data)
 	struct sms_data *data = ofono_sms_get_data(sms);
 	const struct qmi_wms_result_msg_list *list;
 	uint32_t cnt = 0;
-	uint16_t tmp;
+	uint32_t tmp;
 
 	DBG("");
 
-	if (qmi_result_set_error(result, &tmp)) {
-		DBG("Err: get msg list mode=%d %d=%s", data->msg_mode, tmp,
+	if (qmi_result_set_error(result, NULL)) {
+		DBG("Err: get msg list mode=%d %s", data->msg_mode,
 			qmi_result_get_error(result));
 		goto done;
 	}
@@ -465,23 +515,17 @@ static void get_msg_list_cb(struct qmi_result *result, void *user_data)
 			L_LE32_TO_CPU(list->msg[tmp].ndx));
 	}
 
-	/* free list from last time */
-	if (data->msg_list) {
-		l_free(data->msg_list);
-		data->msg_list = NULL;
-	}
-
-	/* save list and get 1st msg */
+	/* save list and read the messages */
 	if (cnt) {
 		int msg_size = cnt * sizeof(list->msg[0]);
 
+		l_free(data->msg_list);
 		data->msg_list = l_malloc(sizeof(list->cnt) + msg_size);
 		data->msg_list->cnt = cnt;
 		memcpy(data->msg_list->msg, list->msg, msg_size);
 
 		data->rd_msg_num = 0;
-		raw_read(sms, data->msg_list->msg[0].type,
-				L_LE32_TO_CPU(data->msg_list->msg[0].ndx));
+		read_next(sms);
 		return;
 	}
 
@@ -493,6 +537,13 @@ done:
 		data->msg_mode_all = false;
 		data->msg_mode = QMI_WMS_MESSAGE_MODE_GSMWCDMA;
 		get_msg_list(sms);
+		return;
+	}
+
+	/* Messages announced while the listing was on its way */
+	if (data->relist) {
+		data->relist = false;
+		get_msg_list(sms);
 	}
 }
 
@@ -588,10 +639,15 @@ static void event_notify(struct qmi_result *result, void *user_data)
 		DBG("msg type %d ndx %d mode %d", notify->storage_type,
 			L_LE32_TO_CPU(notify->storage_index), data->msg_mode);
 
-		/* don't read if list is being processed, get this msg later */
-		if (!data->msg_list_chk)
-			raw_read(sms, notify->storage_type,
-					L_LE32_TO_CPU(notify->storage_index));
+		/*
+		 * Don't read if a list is being processed or too many reads
+		 * are out already, get this msg with the next listing.
+		 */
+		if (data->msg_list_chk ||
+				data->reads_in_flight >= SMS_READS_IN_FLIGHT ||
+				!raw_read(sms, notify->storage_type,
+					L_LE32_TO_CPU(notify->storage_index)))
+			data->relist = true;
 	} else {
 		/* route is either transfer only or transfer and ACK */
 		const struct qmi_wms_result_message *message;
@@ -628,11 +684,11 @@ static void set_routes_cb(struct qmi_result *result, void *user_data)
 	 * to free device memory to prevent blockage of new messages.
 	 */
 	data->msg_mode = QMI_WMS_MESSAGE_MODE_CDMA;
-	delete_msg(sms, QMI_WMS_MT_READ);
-	delete_msg(sms, QMI_WMS_MO_SENT);
+	delete_msg(sms, QMI_WMS_STORAGE_TYPE_NV, QMI_WMS_MT_READ, NULL);
+	delete_msg(sms, QMI_WMS_STORAGE_TYPE_NV, QMI_WMS_MO_SENT, NULL);
 	data->msg_mode = QMI_WMS_MESSAGE_MODE_GSMWCDMA;
-	delete_msg(sms, QMI_WMS_MT_READ);
-	delete_msg(sms, QMI_WMS_MO_SENT);
+	delete_msg(sms, QMI_WMS_STORAGE_TYPE_NV, QMI_WMS_MT_READ, NULL);
+	delete_msg(sms, QMI_WMS_STORAGE_TYPE_NV, QMI_WMS_MO_SENT, NULL);
 
 	/*
 	 * Subsystem initialized, now start process to check for unread
@@ -734,7 +790,6 @@ static int qmi_sms_probe(struct ofono_sms *sms,
 
 	data = l_new(struct sms_data, 1);
 	data->wms = wms;
-	memset(&data->rd_msg_id, 0, sizeof(data->rd_msg_id));
 	data->msg_mode = QMI_WMS_MESSAGE_MODE_GSMWCDMA;
 	qmi_service_register(data->wms, QMI_WMS_EVENT, event_notify, sms, NULL);
 
@@ -759,6 +814,7 @@ static void qmi_sms_remove(struct ofono_sms *sms)
 }
 
 static const struct ofono_sms_driver driver = {
+	.flags		= OFONO_SMS_DRIVER_FLAG_PIPELINE_SUBMIT,
 	.probe		= qmi_sms_probe,
 	.remove		= qmi_sms_remove,
 	.sca_query	= qmi_sca_query,
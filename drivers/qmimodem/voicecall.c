@@ -24,7 +24,8 @@
 
 struct voicecall_data {
 	struct qmi_service *voice;
-	struct l_queue *call_list;
+	struct ofono_call *calls[256];		/* Indexed by QMI call id */
+	uint32_t present[256 / 32];		/* Slots in use */
 	struct ofono_phone_number dialed;
 	char *full_dtmf;
 	const char *next_dtmf;
@@ -59,34 +60,38 @@ struct qmi_voice_remote_party_number {
 	struct qmi_voice_remote_party_number_instance instance[0];
 } __attribute__((__packed__));
 
-static int ofono_call_compare(const void *a, const void *b, void *data)
+static struct ofono_call *call_find_by_status(struct voicecall_data *vd,
+							int status)
 {
-	const struct ofono_call *ca = a;
-	const struct ofono_call *cb = b;
+	unsigned int w;
 
-	if (ca->id < cb->id)
-		return -1;
+	for (w = 0; w < L_ARRAY_SIZE(vd->present); w++) {
+		uint32_t bits = vd->present[w];
 
-	if (ca->id > cb->id)
-		return 1;
+		while (bits) {
+			unsigned int id = w * 32 + __builtin_ctz(bits);
 
-	return 0;
-}
+			if (vd->calls[id]->status == status)
+				return vd->calls[id];
 
-static bool ofono_call_match_by_id(const void *a, const void *b)
-{
-	const struct ofono_call *call = a;
-	unsigned int id = L_PTR_TO_UINT(b);
+			bits &= bits - 1;
+		}
+	}
 
-	return call->id == id;
+	return NULL;
 }
 
-static bool ofono_call_match_by_status(const void *a, const void *b)
+static void call_slot_set(struct voicecall_data *vd, struct ofono_call *call)
 {
-	const struct ofono_call *call = a;
-	int status = L_PTR_TO_INT(b);
+	vd->calls[call->id] = call;
+	vd->present[call->id / 32] |= 1U << (call->id % 32);
+}
 
-	return status == call->status;
+static void call_slot_release(struct voicecall_data *vd, unsigned int id)
+{
+	l_free(vd->calls[id]);
+	vd->calls[id] = NULL;
+	vd->present[id / 32] &= ~(1U << (id % 32));
 }
 
 static void ofono_call_list_dial_callback(struct ofono_voicecall *vc,
@@ -94,14 +99,10 @@ static void ofono_call_list_dial_callback(struct ofono_voicecall *vc,
 {
 	struct ofono_call *call;
 	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
-	struct l_queue *call_list = vd->call_list;
 	const struct ofono_phone_number *ph = &vd->dialed;
 
 	/* check if call_id already present */
-	call = l_queue_find(call_list, ofono_call_match_by_id,
-				L_UINT_TO_PTR(call_id));
-
-	if (call)
+	if (vd->calls[call_id])
 		return;
 
 	call = l_new(struct ofono_call, 1);
@@ -112,64 +113,40 @@ static void ofono_call_list_dial_callback(struct ofono_voicecall *vc,
 	call->status = CALL_STATUS_DIALING;
 	call->type = 0; /* voice */
 
-	l_queue_insert(call_list, call, ofono_call_compare, NULL);
+	call_slot_set(vd, call);
 
 	ofono_voicecall_notify(vc, call);
 }
 
-static void ofono_call_list_notify(struct ofono_voicecall *vc,
-					struct l_queue *calls)
+/*
+ * Applies one decoded call of an indication to its slot, notifying the
+ * core only when the call is new or one of its fields changed.
+ */
+static void call_slot_update(struct ofono_voicecall *vc,
+				const struct ofono_call *update)
 {
 	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
-	struct l_queue *old_calls = vd->call_list;
-	struct l_queue *new_calls = calls;
-	struct ofono_call *new_call, *old_call;
-	const struct l_queue_entry *old_entry, *new_entry;
-	uint i;
-
-	uint loop_length =
-		MAX(l_queue_length(old_calls), l_queue_length(new_calls));
-
-	old_entry = l_queue_get_entries(old_calls);
-	new_entry = l_queue_get_entries(new_calls);
+	struct ofono_call *call = vd->calls[update->id];
 
-	for (i = 0; i < loop_length; ++i) {
-		old_call = old_entry ? old_entry->data : NULL;
-		new_call = new_entry ? new_entry->data : NULL;
-
-		if (new_call && new_call->status == CALL_STATUS_DISCONNECTED) {
-			ofono_voicecall_disconnected(
-				vc, new_call->id,
-				OFONO_DISCONNECT_REASON_REMOTE_HANGUP, NULL);
-			new_entry = new_entry->next;
-			l_queue_remove(calls, new_call);
-			l_free(new_call);
-			continue;
-		}
+	if (update->status == CALL_STATUS_DISCONNECTED) {
+		if (!call)
+			return;
 
-		if (old_call &&
-				(!new_call || (new_call->id > old_call->id)))
-			ofono_voicecall_disconnected(
-				vc, old_call->id,
+		ofono_voicecall_disconnected(vc, update->id,
 				OFONO_DISCONNECT_REASON_REMOTE_HANGUP, NULL);
-		else if (new_call &&
-				(!old_call || (new_call->id < old_call->id))) {
-			DBG("Notify new call %d", new_call->id);
-			/* new call, signal it */
-			if (new_call->type == 0)
-				ofono_voicecall_notify(vc, new_call);
-		} else if (memcmp(new_call, old_call, sizeof(*new_call)) &&
-				new_call->type == 0)
-			ofono_voicecall_notify(vc, new_call);
-
-		if (old_entry)
-			old_entry = old_entry->next;
-		if (new_entry)
-			new_entry = new_entry->next;
+		call_slot_release(vd, update->id);
+		return;
 	}
 
-	l_queue_destroy(old_calls, l_free);
-	vd->call_list = calls;
+	if (!call) {
+		DBG("Notify new call %d", update->id);
+		call = l_new(struct ofono_call, 1);
+		call_slot_set(vd, call);
+	} else if (!memcmp(call, update, sizeof(*call)))
+		return;
+
+	memcpy(call, update, sizeof(*call));
+	ofono_voicecall_notify(vc, call);
 }
 
 static const char *qmi_voice_call_state_name(enum qmi_voice_call_state value)
@@ -255,7 +232,9 @@ static void all_call_status_ind(struct qmi_result *result, void *user_data)
 	const struct qmi_voice_call_information *call_information;
 	const struct qmi_voice_remote_party_number *remote_party_number;
 	const struct qmi_voice_remote_party_number_instance *remote_party_number_inst[16];
-	struct l_queue *calls;
+	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
+	uint32_t seen[L_ARRAY_SIZE(vd->present)] = { 0 };
+	unsigned int w;
 
 	static const uint8_t RESULT_CALL_STATUS_CALL_INFORMATION = 0x01;
 	static const uint8_t RESULT_CALL_STATUS_REMOTE_NUMBER = 0x10;
@@ -339,10 +318,9 @@ static void all_call_status_ind(struct qmi_result *result, void *user_data)
 			instance->number_size;
 	}
 
-	calls = l_queue_new();
-
 	for (i = 0; i < call_information->size && i < 16; i++) {
-		struct ofono_call *call = l_new(struct ofono_call, 1);
+		struct ofono_call call_buf;
+		struct ofono_call *call = &call_buf;
 		struct qmi_voice_call_information_instance call_info;
 		const struct qmi_voice_remote_party_number_instance
 			*remote_party = remote_party_number_inst[i];
@@ -351,6 +329,7 @@ static void all_call_status_ind(struct qmi_result *result, void *user_data)
 
 		call_info = call_information->instance[i];
 
+		memset(call, 0, sizeof(*call));
 		call->id = call_info.id;
 		call->direction = qmi_to_ofono_direction(call_info.direction);
 		call->type = 0; /* always voice */
@@ -370,7 +349,6 @@ static void all_call_status_ind(struct qmi_result *result, void *user_data)
 		if (qmi_to_ofono_status(call_info.state, &call->status)) {
 			DBG("Ignore call id %d, because can not convert QMI state 0x%x to ofono.",
 				call_info.id, call_info.state);
-			l_free(call);
 			continue;
 		}
 
@@ -378,10 +356,23 @@ static void all_call_status_ind(struct qmi_result *result, void *user_data)
 			qmi_voice_call_state_name(call_info.state),
 			call_info.state);
 
-		l_queue_push_tail(calls, call);
+		seen[call->id / 32] |= 1U << (call->id % 32);
+		call_slot_update(vc, call);
 	}
 
-	ofono_call_list_notify(vc, calls);
+	/* Calls the modem no longer reports are gone */
+	for (w = 0; w < L_ARRAY_SIZE(vd->present); w++) {
+		uint32_t gone = vd->present[w] & ~seen[w];
+
+		while (gone) {
+			unsigned int id = w * 32 + __builtin_ctz(gone);
+
+			ofono_voicecall_disconnected(vc, id,
+				OFONO_DISCONNECT_REASON_REMOTE_HANGUP, NULL);
+			call_slot_release(vd, id);
+			gone &= gone - 1;
+		}
+	}
 }
 
 static void dial_cb(struct qmi_result *result, void *user_data)
@@ -486,8 +477,7 @@ static void answer(struct ofono_voicecall *vc,
 
 	DBG("");
 
-	call = l_queue_find(vd->call_list, ofono_call_match_by_status,
-				L_UINT_TO_PTR(CALL_STATUS_INCOMING));
+	call = call_find_by_status(vd, CALL_STATUS_INCOMING);
 	if (!call) {
 		ofono_error("Can not find a call to pick up");
 		goto error;
@@ -571,8 +561,7 @@ static void hangup_active(struct ofono_voicecall *vc, ofono_voicecall_cb_t cb,
 	DBG("");
 
 	for (uint32_t i = 0; i < L_ARRAY_SIZE(active); i++) {
-		call = l_queue_find(vd->call_list, ofono_call_match_by_status,
-			L_INT_TO_PTR(active[i]));
+		call = call_find_by_status(vd, active[i]);
 
 		if (call)
 			break;
@@ -717,7 +706,6 @@ static int qmi_voicecall_probe(struct ofono_voicecall *vc,
 
 	data = l_new(struct voicecall_data, 1);
 	data->voice = voice;
-	data->call_list = l_queue_new();
 
 	qmi_service_register(data->voice, QMI_VOICE_ALL_CALL_STATUS_IND,
 				all_call_status_ind, vc, NULL);
@@ -730,13 +718,17 @@ static int qmi_voicecall_probe(struct ofono_voicecall *vc,
 static void qmi_voicecall_remove(struct ofono_voicecall *vc)
 {
 	struct voicecall_data *data = ofono_voicecall_get_data(vc);
+	unsigned int i;
 
 	DBG("");
 
 	ofono_voicecall_set_data(vc, NULL);
 
 	qmi_service_free(data->voice);
-	l_queue_destroy(data->call_list, l_free);
+
+	for (i = 0; i < L_ARRAY_SIZE(data->calls); i++)
+		l_free(data->calls[i]);
+
 	l_free(data->full_dtmf);
 	l_free(data);
 }
@@ -24,6 +24,8 @@ int qmi_wda_parse_data_format(struct qmi_result *result,
 	static const uint8_t RESULT_DL_AGGREGATION_PROTOCOL = 0x13;
 	static const uint8_t RESULT_DL_MAX_DATAGRAMS = 0x15;
 	static const uint8_t RESULT_DL_MAX_SIZE = 0x16;
+	static const uint8_t RESULT_UL_MAX_DATAGRAMS = 0x17;
+	static const uint8_t RESULT_UL_MAX_SIZE = 0x18;
 	struct qmi_wda_data_format format;
 
 	if (!qmi_result_get_uint32(result, RESULT_LL_PROTO,
@@ -46,6 +48,15 @@ int qmi_wda_parse_data_format(struct qmi_result *result,
 					&format.dl_max_size))
 		return -ENOENT;
 
+	/* Older firmware doesn't report the uplink limits at all */
+	if (!qmi_result_get_uint32(result, RESULT_UL_MAX_DATAGRAMS,
+					&format.ul_max_datagrams))
+		format.ul_max_datagrams = 0;
+
+	if (!qmi_result_get_uint32(result, RESULT_UL_MAX_SIZE,
+					&format.ul_max_size))
+		format.ul_max_size = 0;
+
 	if (out_format)
 		memcpy(out_format, &format, sizeof(struct qmi_wda_data_format));
 
@@ -32,6 +32,9 @@ struct qmi_wda_data_format {
 	uint32_t dl_aggregation_protocol;
 	uint32_t dl_max_datagrams;
 	uint32_t dl_max_size;
+	/* Only reported by the modem, zero if uplink aggregation is off */
+	uint32_t ul_max_datagrams;
+	uint32_t ul_max_size;
 };
 
 int qmi_wda_parse_data_format(struct qmi_result *result,
@@ -119,10 +119,8 @@ static void ril_data_reg_cb(struct ril_msg *message, gpointer user_data)
 	struct ril_gprs_data *gd = ofono_gprs_get_data(gprs);
 	struct ofono_modem *modem;
 	struct parcel rilp;
+	struct parcel_str strv[4];
 	int num_str;
-	char **strv;
-	char *debug_str;
-	char *end;
 	int status;
 	int tech = -1;
 	gboolean attached = FALSE;
@@ -138,29 +136,25 @@ static void ril_data_reg_cb(struct ril_msg *message, gpointer user_data)
 		goto error;
 	}
 
+	/* Only the status and technology are used, parsed in place */
 	g_ril_init_parcel(message, &rilp);
-	strv = parcel_r_strv(&rilp);
-	num_str = g_strv_length(strv);
+	num_str = parcel_r_str_array(&rilp, strv, G_N_ELEMENTS(strv));
 
-	if (strv == NULL)
+	if (num_str <= 0)
 		goto error;
 
-	debug_str = g_strjoinv(",", strv);
-	g_ril_append_print_buf(gd->ril, "{%d,%s}", num_str, debug_str);
-	g_free(debug_str);
+	ril_util_append_print_strs(gd->ril, strv, num_str);
 	g_ril_print_response(gd->ril, message);
 
-	status = strtoul(strv[0], &end, 10);
-	if (end == strv[0] || *end != '\0')
-		goto error_free;
+	if (parcel_str_to_int(&strv[0], 10, &status) < 0)
+		goto error;
 
 	status = ril_util_registration_state_to_status(status);
 	if (status < 0)
-		goto error_free;
+		goto error;
 
 	if (num_str >= 4) {
-		tech = strtoul(strv[3], &end, 10);
-		if (end == strv[3] || *end != '\0')
+		if (parcel_str_to_int(&strv[3], 10, &tech) < 0)
 			tech = -1;
 
 		if (g_ril_vendor(gd->ril) == OFONO_RIL_VENDOR_MTK) {
@@ -257,9 +251,6 @@ static void ril_data_reg_cb(struct ril_msg *message, gpointer user_data)
 
 	return;
 
-error_free:
-	g_strfreev(strv);
-
 error:
 	if (cb)
 		CALLBACK_WITH_FAILURE(cb, -1, cbd->data);
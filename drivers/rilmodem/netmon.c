@@ -48,8 +48,22 @@
 #define MSECS_RATE_INVALID	(0x7fffffff)
 #define SECS_TO_MSECS(x)	((x) * 1000)
 
+/* The serving cell as last passed on, zeroed before filling */
+struct serving_cell {
+	int type;
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	int lac, cid, psc;
+	int rssi, ber;
+	int ci, pci, tac;
+	int rsrp, rsrq, rssnr;
+	int cqi, tadv;
+};
+
 struct netmon_data {
 	GRil *ril;
+	struct serving_cell cell;
+	gint64 last_report;
 };
 
 static gboolean ril_delayed_register(gpointer user_data)
@@ -83,26 +97,35 @@ static int ril_cell_type_to_size(int cell_type)
 	return 0;
 }
 
-static int process_cellinfo_list(struct ril_msg *message,
-					struct ofono_netmon *netmon)
+static void parse_plmn(struct parcel *rilp, struct serving_cell *cell)
+{
+	int mcc = parcel_r_int32(rilp);
+	int mnc = parcel_r_int32(rilp);
+
+	if (mcc >= 0 && mcc <= 999)
+		snprintf(cell->mcc, sizeof(cell->mcc), "%03d", mcc);
+
+	if (mnc >= 0 && mnc <= 999)
+		snprintf(cell->mnc, sizeof(cell->mnc), "%03d", mnc);
+}
+
+static gboolean parse_cellinfo_list(struct ril_msg *message,
+					struct serving_cell *cell)
 {
 	struct parcel rilp;
 	int skip_len;
 	int cell_info_cnt;
 	int cell_type;
 	int registered = 0;
-	int mcc, mnc;
 	int lac, cid, psc;
 	int rssi, ber;
 	int ci, pci, tac;
 	int rsrp, rsrq, rssnr;
 	int cqi, tadv;
-	char s_mcc[OFONO_MAX_MCC_LENGTH + 1];
-	char s_mnc[OFONO_MAX_MNC_LENGTH + 1];
 	int i, j;
 
 	if (message->error != RIL_E_SUCCESS)
-		return OFONO_ERROR_TYPE_FAILURE;
+		return FALSE;
 
 	g_ril_init_parcel(message, &rilp);
 
@@ -134,79 +157,37 @@ static int process_cellinfo_list(struct ril_msg *message,
 	}
 
 	if (!registered)
-		return OFONO_ERROR_TYPE_FAILURE;
+		return FALSE;
+
+	memset(cell, 0, sizeof(*cell));
+	cell->type = cell_type;
 
 	if (cell_type == NETMON_RIL_CELLINFO_TYPE_GSM) {
-		mcc = parcel_r_int32(&rilp);
-		mnc = parcel_r_int32(&rilp);
+		parse_plmn(&rilp, cell);
 		lac = parcel_r_int32(&rilp);
 		cid = parcel_r_int32(&rilp);
 		rssi = parcel_r_int32(&rilp);
 		ber = parcel_r_int32(&rilp);
 
-		if (mcc >= 0 && mcc <= 999)
-			snprintf(s_mcc, sizeof(s_mcc), "%03d", mcc);
-		else
-			strcpy(s_mcc, "");
-
-		if (mnc >= 0 && mnc <= 999)
-			snprintf(s_mnc, sizeof(s_mnc), "%03d", mnc);
-		else
-			strcpy(s_mnc, "");
-
-		lac = (lac >= 0 && lac <= 65535) ? lac : -1;
-		cid = (cid >= 0 && cid <= 65535) ? cid : -1;
-		rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
-		ber = (ber >= 0 && ber <= 7) ? ber : -1;
-
-		ofono_netmon_serving_cell_notify(netmon,
-				OFONO_NETMON_CELL_TYPE_GSM,
-				OFONO_NETMON_INFO_MCC, s_mcc,
-				OFONO_NETMON_INFO_MNC, s_mnc,
-				OFONO_NETMON_INFO_LAC, lac,
-				OFONO_NETMON_INFO_CI, cid,
-				OFONO_NETMON_INFO_RSSI, rssi,
-				OFONO_NETMON_INFO_BER, ber,
-				OFONO_NETMON_INFO_INVALID);
+		cell->lac = (lac >= 0 && lac <= 65535) ? lac : -1;
+		cell->cid = (cid >= 0 && cid <= 65535) ? cid : -1;
+		cell->rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
+		cell->ber = (ber >= 0 && ber <= 7) ? ber : -1;
 	} else if (cell_type == NETMON_RIL_CELLINFO_TYPE_UMTS) {
-		mcc = parcel_r_int32(&rilp);
-		mnc = parcel_r_int32(&rilp);
+		parse_plmn(&rilp, cell);
 		lac = parcel_r_int32(&rilp);
 		cid = parcel_r_int32(&rilp);
 		psc = parcel_r_int32(&rilp);
 		rssi = parcel_r_int32(&rilp);
 		ber = parcel_r_int32(&rilp);
 
-		if (mcc >= 0 && mcc <= 999)
-			snprintf(s_mcc, sizeof(s_mcc), "%03d", mcc);
-		else
-			strcpy(s_mcc, "");
-
-		if (mnc >= 0 && mnc <= 999)
-			snprintf(s_mnc, sizeof(s_mnc), "%03d", mnc);
-		else
-			strcpy(s_mnc, "");
-
-		lac = (lac >= 0 && lac <= 65535) ? lac : -1;
-		cid = (cid >= 0 && cid <= 268435455) ? cid : -1;
-		psc = (psc >= 0 && psc <= 511) ? psc : -1;
-		rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
-		ber = (ber >= 0 && ber <= 7) ? ber : -1;
-
-		ofono_netmon_serving_cell_notify(netmon,
-				OFONO_NETMON_CELL_TYPE_UMTS,
-				OFONO_NETMON_INFO_MCC, s_mcc,
-				OFONO_NETMON_INFO_MNC, s_mnc,
-				OFONO_NETMON_INFO_LAC, lac,
-				OFONO_NETMON_INFO_CI, cid,
-				OFONO_NETMON_INFO_PSC, psc,
-				OFONO_NETMON_INFO_RSSI, rssi,
-				OFONO_NETMON_INFO_BER, ber,
-				OFONO_NETMON_INFO_INVALID);
-
+		cell->lac = (lac >= 0 && lac <= 65535) ? lac : -1;
+		cell->cid = (cid >= 0 && cid <= 268435455) ? cid : -1;
+		cell->psc = (psc >= 0 && psc <= 511) ? psc : -1;
+		cell->rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
+		cell->ber = (ber >= 0 && ber <= 7) ? ber : -1;
 	} else if (cell_type == NETMON_RIL_CELLINFO_TYPE_LTE) {
-		mcc = parcel_r_int32(&rilp);
-		mnc = parcel_r_int32(&rilp);
+		parse_plmn(&rilp, cell);
 		ci =  parcel_r_int32(&rilp);
 		pci = parcel_r_int32(&rilp);
 		tac = parcel_r_int32(&rilp);
@@ -217,44 +198,59 @@ static int process_cellinfo_list(struct ril_msg *message,
 		cqi = parcel_r_int32(&rilp);
 		tadv = parcel_r_int32(&rilp);
 
-		if (mcc >= 0 && mcc <= 999)
-		snprintf(s_mcc, sizeof(s_mcc), "%03d", mcc);
-		else
-		strcpy(s_mcc, "");
-
-		if (mnc >= 0 && mnc <= 999)
-		snprintf(s_mnc, sizeof(s_mnc), "%03d", mnc);
-		else
-		strcpy(s_mnc, "");
-
-		ci = (ci >= 0 && ci <= 268435455) ? ci : -1;
-		pci = (pci >= 0 && pci <= 503) ? pci : -1;
-		tac = (tac >= 0 && tac <= 65535) ? tac : -1;
-		rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
-		rsrp = (rsrp >= 44 && rsrp <= 140) ? -rsrp : -1;
-		rsrq = (rsrq >= 3 && rsrq <= 20) ? -rsrq : -1;
-		rssnr = (rssnr >= -200 && rssnr <= 300) ? rssnr : -1;
-		cqi = (cqi >= 0 && cqi <= 15) ? cqi : -1;
-		tadv = (tadv >=0 && tadv <= 63) ? tadv : -1;
+		cell->ci = (ci >= 0 && ci <= 268435455) ? ci : -1;
+		cell->pci = (pci >= 0 && pci <= 503) ? pci : -1;
+		cell->tac = (tac >= 0 && tac <= 65535) ? tac : -1;
+		cell->rssi = (rssi >= 0 && rssi <= 31) ? rssi : -1;
+		cell->rsrp = (rsrp >= 44 && rsrp <= 140) ? -rsrp : -1;
+		cell->rsrq = (rsrq >= 3 && rsrq <= 20) ? -rsrq : -1;
+		cell->rssnr = (rssnr >= -200 && rssnr <= 300) ? rssnr : -1;
+		cell->cqi = (cqi >= 0 && cqi <= 15) ? cqi : -1;
+		cell->tadv = (tadv >= 0 && tadv <= 63) ? tadv : -1;
+	}
+
+	return TRUE;
+}
 
+static void serving_cell_notify(struct ofono_netmon *netmon,
+					const struct serving_cell *cell)
+{
+	if (cell->type == NETMON_RIL_CELLINFO_TYPE_GSM)
+		ofono_netmon_serving_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_GSM,
+				OFONO_NETMON_INFO_MCC, cell->mcc,
+				OFONO_NETMON_INFO_MNC, cell->mnc,
+				OFONO_NETMON_INFO_LAC, cell->lac,
+				OFONO_NETMON_INFO_CI, cell->cid,
+				OFONO_NETMON_INFO_RSSI, cell->rssi,
+				OFONO_NETMON_INFO_BER, cell->ber,
+				OFONO_NETMON_INFO_INVALID);
+	else if (cell->type == NETMON_RIL_CELLINFO_TYPE_UMTS)
+		ofono_netmon_serving_cell_notify(netmon,
+				OFONO_NETMON_CELL_TYPE_UMTS,
+				OFONO_NETMON_INFO_MCC, cell->mcc,
+				OFONO_NETMON_INFO_MNC, cell->mnc,
+				OFONO_NETMON_INFO_LAC, cell->lac,
+				OFONO_NETMON_INFO_CI, cell->cid,
+				OFONO_NETMON_INFO_PSC, cell->psc,
+				OFONO_NETMON_INFO_RSSI, cell->rssi,
+				OFONO_NETMON_INFO_BER, cell->ber,
+				OFONO_NETMON_INFO_INVALID);
+	else if (cell->type == NETMON_RIL_CELLINFO_TYPE_LTE)
 		ofono_netmon_serving_cell_notify(netmon,
 				OFONO_NETMON_CELL_TYPE_LTE,
-				OFONO_NETMON_INFO_MCC, s_mcc,
-				OFONO_NETMON_INFO_MNC, s_mnc,
-				OFONO_NETMON_INFO_CI, ci,
-				OFONO_NETMON_INFO_PCI, pci,
-				OFONO_NETMON_INFO_TAC, tac,
-				OFONO_NETMON_INFO_RSSI, rssi,
-				OFONO_NETMON_INFO_RSRP, rsrp,
-				OFONO_NETMON_INFO_RSRQ, rsrq,
-				OFONO_NETMON_INFO_SNR, rssnr,
-				OFONO_NETMON_INFO_CQI, cqi,
-				OFONO_NETMON_INFO_TIMING_ADVANCE, tadv,
+				OFONO_NETMON_INFO_MCC, cell->mcc,
+				OFONO_NETMON_INFO_MNC, cell->mnc,
+				OFONO_NETMON_INFO_CI, cell->ci,
+				OFONO_NETMON_INFO_PCI, cell->pci,
+				OFONO_NETMON_INFO_TAC, cell->tac,
+				OFONO_NETMON_INFO_RSSI, cell->rssi,
+				OFONO_NETMON_INFO_RSRP, cell->rsrp,
+				OFONO_NETMON_INFO_RSRQ, cell->rsrq,
+				OFONO_NETMON_INFO_SNR, cell->rssnr,
+				OFONO_NETMON_INFO_CQI, cell->cqi,
+				OFONO_NETMON_INFO_TIMING_ADVANCE, cell->tadv,
 				OFONO_NETMON_INFO_INVALID);
-
-	}
-
-	return OFONO_ERROR_TYPE_NO_ERROR;
 }
 
 static void ril_netmon_update_cb(struct ril_msg *message, gpointer user_data)
@@ -262,9 +258,10 @@ static void ril_netmon_update_cb(struct ril_msg *message, gpointer user_data)
 	struct cb_data *cbd = user_data;
 	ofono_netmon_cb_t cb = cbd->cb;
 	struct ofono_netmon *netmon = cbd->data;
+	struct netmon_data *nmd = cbd->user;
 
-	if (process_cellinfo_list(message, netmon) ==
-			OFONO_ERROR_TYPE_NO_ERROR) {
+	if (parse_cellinfo_list(message, &nmd->cell)) {
+		serving_cell_notify(netmon, &nmd->cell);
 		CALLBACK_WITH_SUCCESS(cb, cbd->data);
 		return;
 	}
@@ -272,11 +269,32 @@ static void ril_netmon_update_cb(struct ril_msg *message, gpointer user_data)
 	CALLBACK_WITH_FAILURE(cb, cbd->data);
 }
 
+/*
+ * Unsolicited lists are dropped when they come faster than the cell
+ * information rate, whatever rate rild was asked for, and are only passed
+ * on when the serving cell changed.  Requested updates always are.
+ */
 static void ril_cellinfo_notify(struct ril_msg *message, gpointer user_data)
 {
 	struct ofono_netmon *netmon = user_data;
+	struct netmon_data *nmd = ofono_netmon_get_data(netmon);
+	gint64 rate = g_ril_get_cell_info_rate(nmd->ril) * (gint64) 1000;
+	gint64 now = g_get_monotonic_time();
+	struct serving_cell cell;
+
+	if (rate && nmd->last_report && now - nmd->last_report < rate)
+		return;
+
+	nmd->last_report = now;
 
-	process_cellinfo_list(message, netmon);
+	if (!parse_cellinfo_list(message, &cell))
+		return;
+
+	if (!memcmp(&cell, &nmd->cell, sizeof(cell)))
+		return;
+
+	nmd->cell = cell;
+	serving_cell_notify(netmon, &cell);
 }
 
 static void setup_cell_info_notify(struct ofono_netmon *netmon)
@@ -364,7 +382,8 @@ static void ril_netmon_periodic_update(struct ofono_netmon *netmon,
 	parcel_w_int32(&rilp, 1);	/* Number of elements */
 
 	if (enable)
-		parcel_w_int32(&rilp, SECS_TO_MSECS(period));
+		parcel_w_int32(&rilp, MAX(SECS_TO_MSECS(period),
+					g_ril_get_cell_info_rate(nmd->ril)));
 	else
 		parcel_w_int32(&rilp, MSECS_RATE_INVALID);
 
@@ -373,7 +392,7 @@ static void ril_netmon_periodic_update(struct ofono_netmon *netmon,
 		return;
 
 	g_free(cbd);
-	CALLBACK_WITH_FAILURE(cb, cbd->data);
+	CALLBACK_WITH_FAILURE(cb, data);
 }
 
 static const struct ofono_netmon_driver driver = {
@@ -17,6 +17,7 @@
 #include <stdio.h>
 
 #include <glib.h>
+#include <ell/ell.h>
 
 #include <ofono/log.h>
 #include <ofono/modem.h>
@@ -31,6 +32,9 @@
 #include "common.h"
 #include "rilutil.h"
 
+/* RIL_SignalStrength_v10 is 13 ints, leave room for vendor additions */
+#define SIGNAL_STRENGTH_MAX_LEN 64
+
 struct netreg_data {
 	GRil *ril;
 	char mcc[OFONO_MAX_MCC_LENGTH + 1];
@@ -42,6 +46,11 @@ struct netreg_data {
 	int tech;
 	guint nitz_timeout;
 	unsigned int vendor;
+	unsigned char strength[SIGNAL_STRENGTH_MAX_LEN];
+	unsigned int strength_len;
+	int strength_tech;
+	guint strength_timeout;
+	gboolean strength_pending;
 };
 
 /*
@@ -232,14 +241,12 @@ static void ril_creg_cb(struct ril_msg *message, gpointer user_data)
 	ofono_netreg_status_cb_t cb = cbd->cb;
 	struct netreg_data *nd = cbd->user;
 	struct parcel rilp;
-	char **strv;
+	struct parcel_str strv[4];
 	int num_str;
-	char *debug_str;
 	int status = -1;
 	int lac = -1;
 	int ci = -1;
 	int tech = -1;
-	char *end;
 
 	DBG("");
 
@@ -249,41 +256,31 @@ static void ril_creg_cb(struct ril_msg *message, gpointer user_data)
 		goto error;
 	}
 
+	/* Only the leading fields are used, they are parsed in place */
 	g_ril_init_parcel(message, &rilp);
-	strv = parcel_r_strv(&rilp);
-	num_str = g_strv_length(strv);
+	num_str = parcel_r_str_array(&rilp, strv, G_N_ELEMENTS(strv));
 
-	if (strv == NULL)
+	if (num_str <= 0)
 		goto error;
 
-	debug_str = g_strjoinv(",", strv);
-	g_ril_append_print_buf(nd->ril, "{%d,%s}", num_str, debug_str);
-	g_free(debug_str);
+	ril_util_append_print_strs(nd->ril, strv, num_str);
 	g_ril_print_response(nd->ril, message);
 
-	status = strtoul(strv[0], &end, 10);
-	if (end == strv[0] || *end != '\0')
-		goto error_free;
+	if (parcel_str_to_int(&strv[0], 10, &status) < 0)
+		goto error;
 
 	status = ril_util_registration_state_to_status(status);
 	if (status < 0)
-		goto error_free;
+		goto error;
 
-	if (num_str >= 2) {
-		lac = strtoul(strv[1], &end, 16);
-		if (end == strv[1] || *end != '\0')
-			lac = -1;
-	}
+	if (num_str >= 2 && parcel_str_to_int(&strv[1], 16, &lac) < 0)
+		lac = -1;
 
-	if (num_str >= 3) {
-		ci = strtoul(strv[2], &end, 16);
-		if (end == strv[2] || *end != '\0')
-			ci = -1;
-	}
+	if (num_str >= 3 && parcel_str_to_int(&strv[2], 16, &ci) < 0)
+		ci = -1;
 
 	if (num_str >= 4) {
-		tech = strtoul(strv[3], &end, 10);
-		if (end == strv[3] || *end != '\0')
+		if (parcel_str_to_int(&strv[3], 10, &tech) < 0)
 			tech = -1;
 
 		if (g_ril_vendor(nd->ril) == OFONO_RIL_VENDOR_MTK) {
@@ -310,7 +307,6 @@ static void ril_creg_cb(struct ril_msg *message, gpointer user_data)
 		}
 	}
 
-	g_strfreev(strv);
 	nd->tech = tech;
 
 	CALLBACK_WITH_SUCCESS(cb, status, lac, ci,
@@ -318,8 +314,6 @@ static void ril_creg_cb(struct ril_msg *message, gpointer user_data)
 				cbd->data);
 	return;
 
-error_free:
-	g_strfreev(strv);
 error:
 	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, -1, cbd->data);
 }
@@ -663,13 +657,73 @@ static void ril_register_manual(struct ofono_netreg *netreg,
 	CALLBACK_WITH_FAILURE(cb, data);
 }
 
+static void strength_report(struct ofono_netreg *netreg)
+{
+	struct netreg_data *nd = ofono_netreg_get_data(netreg);
+	struct ril_msg message = {
+		.buf = (gchar *) nd->strength,
+		.buf_len = nd->strength_len,
+		.unsolicited = TRUE,
+		.req = RIL_UNSOL_SIGNAL_STRENGTH,
+	};
+
+	nd->strength_tech = nd->tech;
+	ofono_netreg_strength_notify(netreg,
+			parse_signal_strength(nd->ril, &message, nd->tech));
+}
+
+static gboolean strength_timeout_cb(gpointer user_data)
+{
+	struct ofono_netreg *netreg = user_data;
+	struct netreg_data *nd = ofono_netreg_get_data(netreg);
+
+	if (!nd->strength_pending) {
+		nd->strength_timeout = 0;
+		return FALSE;
+	}
+
+	nd->strength_pending = FALSE;
+	strength_report(netreg);
+
+	return TRUE;
+}
+
+/*
+ * rild repeats unchanged measurements and may send them several times a
+ * second.  Repeats are not parsed again, and within the interval only
+ * the last report is kept and passed on once the interval is over.
+ */
 static void ril_strength_notify(struct ril_msg *message, gpointer user_data)
 {
 	struct ofono_netreg *netreg = user_data;
 	struct netreg_data *nd = ofono_netreg_get_data(netreg);
-	int strength = parse_signal_strength(nd->ril, message, nd->tech);
+	unsigned int interval = g_ril_get_signal_interval(nd->ril);
+
+	if (message->buf_len > sizeof(nd->strength)) {
+		nd->strength_len = 0;
+		ofono_netreg_strength_notify(netreg,
+			parse_signal_strength(nd->ril, message, nd->tech));
+		return;
+	}
+
+	if (message->buf_len == nd->strength_len &&
+			nd->tech == nd->strength_tech &&
+			!memcmp(message->buf, nd->strength, message->buf_len))
+		return;
+
+	memcpy(nd->strength, message->buf, message->buf_len);
+	nd->strength_len = message->buf_len;
+
+	if (nd->strength_timeout) {
+		nd->strength_pending = TRUE;
+		return;
+	}
+
+	strength_report(netreg);
 
-	ofono_netreg_strength_notify(netreg, strength);
+	if (interval)
+		nd->strength_timeout = g_timeout_add(interval,
+						strength_timeout_cb, netreg);
 }
 
 static void ril_strength_cb(struct ril_msg *message, gpointer user_data)
@@ -719,8 +773,10 @@ static void ril_nitz_notify(struct ril_msg *message, gpointer user_data)
 	struct parcel rilp;
 	int year, mon, mday, hour, min, sec, dst, tzi, n_match;
 	char tzs, tz[4];
-	gchar *nitz;
+	struct parcel_str str;
+	char nitz[64];
 	struct ofono_network_time time;
+	uint64_t received = l_time_now();
 
 	DBG("");
 
@@ -730,18 +786,18 @@ static void ril_nitz_notify(struct ril_msg *message, gpointer user_data)
 
 	g_ril_init_parcel(message, &rilp);
 
-	nitz = parcel_r_string(&rilp);
+	/* Copied straight into nitz, an empty string fails the parse */
+	if (parcel_r_str(&rilp, &str) < 0 ||
+			parcel_str_copy(&str, nitz, sizeof(nitz)) < 0)
+		nitz[0] = '\0';
 
 	g_ril_append_print_buf(nd->ril, "(%s)", nitz);
 	g_ril_print_unsol(nd->ril, message);
 
-	if (nitz == NULL)
-		goto error;
-
 	n_match = sscanf(nitz, "%u/%u/%u,%u:%u:%u%c%u,%u", &year, &mon,
 				&mday, &hour, &min, &sec, &tzs, &tzi, &dst);
 	if (n_match != 9)
-		goto error;
+		return;
 
 	sprintf(tz, "%c%d", tzs, tzi);
 
@@ -753,11 +809,9 @@ static void ril_nitz_notify(struct ril_msg *message, gpointer user_data)
 	time.mday = mday;
 	time.mon = mon;
 	time.year = 2000 + year;
+	time.received = received;
 
 	ofono_netreg_time_notify(netreg, &time);
-
-error:
-	g_free(nitz);
 }
 
 static gboolean ril_delayed_register(gpointer user_data)
@@ -793,6 +847,7 @@ static int ril_netreg_probe(struct ofono_netreg *netreg, unsigned int vendor,
 	nd->ril = g_ril_clone(ril);
 	nd->vendor = vendor;
 	nd->tech = RADIO_TECH_UNKNOWN;
+	nd->strength_tech = -1;
 
 	ofono_netreg_set_data(netreg, nd);
 
@@ -815,6 +870,9 @@ static void ril_netreg_remove(struct ofono_netreg *netreg)
 	if (nd->nitz_timeout)
 		g_source_remove(nd->nitz_timeout);
 
+	if (nd->strength_timeout)
+		g_source_remove(nd->strength_timeout);
+
 	ofono_netreg_set_data(netreg, NULL);
 
 	g_ril_unref(nd->ril);
@@ -148,6 +148,21 @@ ext1_info(const GSList *pb_files)
 	return NULL;
 }
 
+/* Most alpha fields on a SIM are unused, only allocate for the others */
+static char *alpha_to_utf8(const unsigned char *msg, size_t len)
+{
+	long utf8_len = sim_string_to_utf8_own_buf(msg, len, NULL, 0);
+	char *utf8;
+
+	if (utf8_len <= 0)
+		return NULL;
+
+	utf8 = l_malloc(utf8_len + 1);
+	sim_string_to_utf8_own_buf(msg, len, utf8, utf8_len + 1);
+
+	return utf8;
+}
+
 static struct phonebook_entry *handle_adn(size_t len, const unsigned char *msg,
 					struct pb_ref_rec *ref, int adn_idx)
 {
@@ -157,7 +172,7 @@ static struct phonebook_entry *handle_adn(size_t len, const unsigned char *msg,
 	unsigned extension_record = UNUSED;
 	unsigned i, prefix;
 	char *number = NULL;
-	char *name = sim_string_to_utf8(msg, name_length);
+	char *name = alpha_to_utf8(msg, name_length);
 	struct phonebook_entry *new_entry;
 
 	/* Length contains also TON & NPI */
@@ -188,9 +203,13 @@ static struct phonebook_entry *handle_adn(size_t len, const unsigned char *msg,
 	DBG("number length %d extension_record %d",
 		2 * number_length, extension_record);
 
-	if ((name == NULL || *name == '\0') && number == NULL)
+	if (name == NULL && number == NULL)
 		goto end;
 
+	/* The core expects a name, even an empty one */
+	if (name == NULL)
+		name = l_strdup("");
+
 	new_entry = l_new(struct phonebook_entry, 1);
 	new_entry->name = name;
 	new_entry->number = number;
@@ -278,9 +297,9 @@ static void handle_sne(size_t len, const unsigned char *msg,
 	if (rec_data->set_by_iap)
 		len -= 2;
 
-	sne = sim_string_to_utf8(msg, len);
+	sne = alpha_to_utf8(msg, len);
 
-	if (sne && *sne != '\0') {
+	if (sne) {
 		struct phonebook_entry *entry;
 
 		entry = g_tree_lookup(ref->phonebook,
@@ -297,8 +316,6 @@ static void handle_sne(size_t len, const unsigned char *msg,
 		} else {
 			l_free(sne);
 		}
-	} else {
-		l_free(sne);
 	}
 }
 
@@ -397,11 +414,9 @@ static void handle_email(size_t len, const unsigned char *msg,
 	if (rec_data->set_by_iap)
 		len -= 2;
 
-	email = sim_string_to_utf8(msg, len);
-	if (email == NULL || *email == '\0') {
-		l_free(email);
+	email = alpha_to_utf8(msg, len);
+	if (email == NULL)
 		return;
-	}
 
 	entry = g_tree_lookup(ref->phonebook,
 				GINT_TO_POINTER(rec_data->adn_idx));
@@ -83,6 +83,37 @@ void ril_util_build_deactivate_data_call(GRil *gril, struct parcel *rilp,
 	g_free(reason_str);
 }
 
+void ril_util_append_print_strs(GRil *gril, const struct parcel_str *strs,
+					int num_str)
+{
+	char buf[512];
+	size_t len = 0;
+	int i;
+
+	if (!g_ril_get_trace(gril))
+		return;
+
+	buf[0] = '\0';
+
+	/* Null strings and what doesn't fit are left empty */
+	for (i = 0; i < num_str && len + 1 < sizeof(buf); i++) {
+		int n;
+
+		if (i)
+			buf[len++] = ',';
+
+		n = parcel_str_copy(&strs[i], buf + len, sizeof(buf) - len);
+		if (n < 0)
+			buf[len] = '\0';
+		else
+			len += n;
+	}
+
+	buf[len] = '\0';
+
+	g_ril_append_print_buf(gril, "{%d,%s}", num_str, buf);
+}
+
 const char *ril_util_gprs_proto_to_ril_string(enum ofono_gprs_proto proto)
 {
 	switch (proto) {
@@ -91,6 +91,10 @@ static inline int ril_util_convert_signal_strength(int strength)
 	return result;
 }
 
+/* Fills the trace buffer with a string array as {count,str,...} */
+void ril_util_append_print_strs(GRil *gril, const struct parcel_str *strs,
+					int num_str);
+
 const char *ril_util_gprs_proto_to_ril_string(enum ofono_gprs_proto);
 
 int ril_util_registration_state_to_status(int reg_state);
@@ -234,6 +234,21 @@ error:
 #define ROOTMF ((char[]) {'\x3F', '\x00'})
 #define ROOTMF_SZ sizeof(ROOTMF)
 
+/*
+ * Size of a SIM IO write, so that the parcel is allocated once however
+ * long the data is: the command, file id, P1-P3 and the MTK session id
+ * around the path, data, pin2 and AID strings
+ */
+static size_t sim_io_write_size(const char *hex_path, const char *hex_data,
+					const char *aid_str)
+{
+	return 6 * sizeof(int32_t) +
+		PARCEL_STRING_SIZE(strlen(hex_path)) +
+		PARCEL_STRING_SIZE(strlen(hex_data)) +
+		PARCEL_STRING_SIZE(0) +
+		PARCEL_STRING_SIZE(aid_str ? strlen(aid_str) : 0);
+}
+
 static char *get_path(int vendor, guint app_type, const int fileid,
 			const unsigned char *path, unsigned int path_len)
 {
@@ -551,7 +566,8 @@ static void ril_sim_update_binary(struct ofono_sim *sim, int fileid,
 	p2 = start & 0xff;
 	hex_data = l_util_hexstring(value, length);
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, sim_io_write_size(hex_path, hex_data,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_UPDATE_BINARY);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -607,7 +623,8 @@ static void update_record(struct ofono_sim *sim, int fileid,
 
 	hex_data = l_util_hexstring(value, length);
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, sim_io_write_size(hex_path, hex_data,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_UPDATE_RECORD);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -323,7 +323,9 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 
 	/* TODO: if (mms) { ... } */
 
-	parcel_init(&rilp);
+	/* Count, NULL SMSC and the hex TPDU */
+	parcel_init_sized(&rilp, 2 * sizeof(int32_t) +
+					PARCEL_STRING_SIZE(tpdu_len * 2));
 	parcel_w_int32(&rilp, 2);	/* Number of strings */
 
 	/*
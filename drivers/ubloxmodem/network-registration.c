@@ -17,6 +17,7 @@
 #include <stdbool.h>
 
 #include <glib.h>
+#include <ell/ell.h>
 
 #include <ofono/log.h>
 #include <ofono/modem.h>
@@ -149,6 +150,7 @@ static void ctzv_notify(GAtResult *result, gpointer user_data)
 	nd->time.mday = mday;
 	nd->time.mon = mon;
 	nd->time.year = 2000 + year;
+	nd->time.received = l_time_now();
 
 	nd->time.utcoff = atoi(tz) * 15 * 60;
 
@@ -156,7 +158,8 @@ static void ctzv_notify(GAtResult *result, gpointer user_data)
 	if (nd->nitz_timeout > 0)
 		g_source_remove(nd->nitz_timeout);
 
-	nd->nitz_timeout = g_timeout_add_seconds(1, notify_time, user_data);
+	nd->nitz_timeout = g_timeout_add(AT_NITZ_DST_DELAY_MS, notify_time,
+						user_data);
 }
 
 static void ctze_notify(GAtResult *result, gpointer user_data)
@@ -194,6 +197,7 @@ static void ctze_notify(GAtResult *result, gpointer user_data)
 	nd->time.mday = mday;
 	nd->time.mon = mon;
 	nd->time.year = 2000 + year;
+	nd->time.received = l_time_now();
 
 	nd->time.utcoff = atoi(tz) * 15 * 60;
 	nd->time.dst = dst;
@@ -221,6 +221,7 @@ static void xmm_ims_remove(struct ofono_ims *ims)
 }
 
 static const struct ofono_ims_driver driver = {
+	.flags				= OFONO_IMS_DRIVER_FLAG_STATUS_NOTIFY,
 	.probe				= xmm_ims_probe,
 	.remove				= xmm_ims_remove,
 	.ims_register			= xmm_ims_register,
@@ -24,6 +24,11 @@
 
 #define PPP_TIMEOUT 15
 
+/* Probe a silent link after 10s, give up after 3 misses 2s apart */
+#define PPP_KEEPALIVE_INTERVAL 10
+#define PPP_KEEPALIVE_RETRY 2
+#define PPP_KEEPALIVE_FAILURES 3
+
 static int next_device_id = 0;
 static GHashTable *device_hash;
 
@@ -49,6 +54,8 @@ struct dundee_device {
 
 	DBusMessage *pending;
 	guint connect_timeout;
+	gint64 dial_time;
+	gint64 link_up_time;
 	void *data;
 };
 
@@ -236,6 +243,7 @@ static void ppp_connect(const char *iface, const char *local, const char *peer,
 	device->pending = NULL;
 
 	device->active = TRUE;
+	device->link_up_time = g_get_monotonic_time();
 
 	settings_changed(device);
 	ofono_dbus_signal_property_changed(conn, device->path,
@@ -315,6 +323,10 @@ static void ppp_disconnect(GAtPPPDisconnectReason reason, gpointer user_data)
 	DBG("%p", device);
 	DBG("PPP Link down: %d\n", reason);
 
+	if (reason == G_AT_PPP_REASON_LINK_DEAD)
+		ofono_warn("%s: peer stopped answering, link dead",
+							device->path);
+
 	g_at_ppp_unref(device->ppp);
 	device->ppp = NULL;
 
@@ -363,6 +375,8 @@ static void dial_cb(gboolean ok, GAtResult *result, gpointer user_data)
 		goto err;
 	}
 	g_at_ppp_set_debug(device->ppp, debug, "PPP");
+	g_at_ppp_set_keepalive(device->ppp, PPP_KEEPALIVE_INTERVAL,
+				PPP_KEEPALIVE_RETRY, PPP_KEEPALIVE_FAILURES);
 
 	device->connect_timeout = g_timeout_add_seconds(PPP_TIMEOUT,
 						ppp_connect_timeout, device);
@@ -403,6 +417,7 @@ static int device_dial_setup(struct dundee_device *device, int fd)
 
 	g_at_chat_set_debug(device->chat, debug, "Control");
 
+	device->dial_time = g_get_monotonic_time();
 	g_at_chat_send(device->chat, "ATD*99#", none_prefix, dial_cb,
 			device, NULL);
 
@@ -485,6 +500,81 @@ static DBusMessage *device_set_property(DBusConnection *conn,
 	return __dundee_error_invalid_args(msg);
 }
 
+static DBusMessage *device_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct dundee_device *device = data;
+	GAtHDLCStats stats;
+	GAtPPPKeepaliveStats keepalive;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_uint32_t value;
+
+	if (device->active == FALSE ||
+			!g_at_ppp_get_stats(device->ppp, &stats) ||
+			!g_at_ppp_get_keepalive_stats(device->ppp, &keepalive))
+		return __dundee_error_failed(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	ofono_dbus_dict_append(&dict, "RxBytes", DBUS_TYPE_UINT64,
+				&stats.rx_bytes);
+	value = stats.rx_frames;
+	ofono_dbus_dict_append(&dict, "RxFrames", DBUS_TYPE_UINT32, &value);
+	value = stats.rx_errors;
+	ofono_dbus_dict_append(&dict, "RxErrors", DBUS_TYPE_UINT32, &value);
+
+	ofono_dbus_dict_append(&dict, "TxBytes", DBUS_TYPE_UINT64,
+				&stats.tx_bytes);
+	value = stats.tx_frames;
+	ofono_dbus_dict_append(&dict, "TxFrames", DBUS_TYPE_UINT32, &value);
+
+	value = stats.tx_flushes ?
+			stats.tx_delay_total / stats.tx_flushes : 0;
+	ofono_dbus_dict_append(&dict, "TxDelayAverage", DBUS_TYPE_UINT32,
+				&value);
+	value = stats.tx_delay_max;
+	ofono_dbus_dict_append(&dict, "TxDelayMaximum", DBUS_TYPE_UINT32,
+				&value);
+
+	value = (device->link_up_time - device->dial_time) / 1000;
+	ofono_dbus_dict_append(&dict, "SetupTime", DBUS_TYPE_UINT32, &value);
+	value = (g_get_monotonic_time() - device->link_up_time) /
+							G_USEC_PER_SEC;
+	ofono_dbus_dict_append(&dict, "Duration", DBUS_TYPE_UINT32, &value);
+
+	value = keepalive.echo_requests;
+	ofono_dbus_dict_append(&dict, "EchoRequests", DBUS_TYPE_UINT32,
+				&value);
+	value = keepalive.echo_replies;
+	ofono_dbus_dict_append(&dict, "EchoReplies", DBUS_TYPE_UINT32, &value);
+	value = keepalive.echo_timeouts;
+	ofono_dbus_dict_append(&dict, "EchoTimeouts", DBUS_TYPE_UINT32,
+				&value);
+	value = keepalive.suppressed;
+	ofono_dbus_dict_append(&dict, "EchoSuppressed", DBUS_TYPE_UINT32,
+				&value);
+	value = keepalive.rtt_last;
+	ofono_dbus_dict_append(&dict, "EchoRoundTrip", DBUS_TYPE_UINT32,
+				&value);
+	value = keepalive.rtt_max;
+	ofono_dbus_dict_append(&dict, "EchoRoundTripMaximum",
+				DBUS_TYPE_UINT32, &value);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static const GDBusMethodTable device_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -492,6 +582,9 @@ static const GDBusMethodTable device_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, device_set_property) },
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			device_get_statistics) },
 	{ }
 };
 
@@ -18,6 +18,7 @@
 #include <sys/signalfd.h>
 
 #include <gdbus.h>
+#include <gatio.h>
 
 #include "dundee.h"
 
@@ -119,6 +120,7 @@ static void system_bus_disconnected(DBusConnection *conn, void *user_data)
 static gchar *option_debug = NULL;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
+static gboolean option_threaded_reads = FALSE;
 
 static gboolean parse_debug(const char *key, const char *value,
 					gpointer user_data, GError **error)
@@ -138,6 +140,9 @@ static GOptionEntry options[] = {
 	{ "nodetach", 'n', G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_detach,
 				"Don't run as daemon in background" },
+	{ "threaded-reads", 't', 0, G_OPTION_ARG_NONE,
+				&option_threaded_reads,
+				"Read each device on a thread of its own" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
 	{ NULL },
@@ -181,6 +186,8 @@ int main(int argc, char **argv)
 
 	event_loop = g_main_loop_new(NULL, FALSE);
 
+	g_at_io_set_threaded_reads(option_threaded_reads);
+
 	signal = setup_signalfd();
 
 	__ofono_log_init(argv[0], option_debug, option_detach);
@@ -190,6 +190,11 @@ static void example_history_sms_send_status(
 	}
 }
 
+static void example_history_flush(struct ofono_history_context *context)
+{
+	ofono_debug("End of history batch");
+}
+
 static struct ofono_history_driver example_driver = {
 	.name = "Example Call History",
 	.probe = example_history_probe,
@@ -199,6 +204,7 @@ static struct ofono_history_driver example_driver = {
 	.sms_received = example_history_sms_received,
 	.sms_send_pending = example_history_sms_send_pending,
 	.sms_send_status = example_history_sms_send_status,
+	.flush = example_history_flush,
 };
 
 static int example_history_init(void)
@@ -24,7 +24,9 @@
 #endif
 
 #include <string.h>
+#include <inttypes.h>
 #include <glib.h>
+#include <ell/ell.h>
 
 #define OFONO_API_SUBJECT_TO_CHANGE
 #include <ofono/plugin.h>
@@ -60,6 +62,10 @@ static void example_nettime_info_received(struct ofono_nettime_context *context,
 			info->min, info->sec, info->utcoff > 0 ? '+' : '-',
 			info->utcoff / 3600, (info->utcoff % 3600) / 60,
 			info->dst);
+
+	/* The time is as of receipt, add the delay since then */
+	ofono_debug("Received %" PRIu64 " us ago",
+			l_time_diff(info->received, l_time_now()));
 }
 
 static struct ofono_nettime_driver example_driver = {
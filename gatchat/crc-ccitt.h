@@ -31,3 +31,6 @@ static inline guint16 crc_ccitt_byte(guint16 crc, const guint8 c)
 {
 	return (crc >> 8) ^ crc_ccitt_table[(crc ^ c) & 0xff];
 }
+
+/* Updates crc over the buffer, a table lookup per 8 bytes */
+guint16 crc_ccitt_update(guint16 crc, const guint8 *buffer, gsize len);
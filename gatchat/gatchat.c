@@ -40,6 +40,9 @@
 
 #define COMMAND_FLAG_EXPECT_PDU			0x1
 #define COMMAND_FLAG_EXPECT_SHORT_PROMPT	0x2
+#define COMMAND_FLAG_PIPELINED			0x4
+
+#define LINE_CHUNK_SIZE 2048
 
 struct at_chat;
 static void chat_wakeup_writer(struct at_chat *chat);
@@ -56,6 +59,10 @@ struct at_command {
 	GAtNotifyFunc listing;
 	gpointer user_data;
 	GDestroyNotify notify;
+	GAtChatCommandStats *stats;		/* NULL if not accounted */
+	gint64 queue_time;
+	gint64 write_time;
+	gint64 written_time;
 };
 
 struct at_notify_node {
@@ -75,6 +82,25 @@ struct at_notify {
 	gboolean pdu;
 };
 
+/*
+ * Notification prefixes are compiled into a trie, stored as an array of
+ * nodes with first child / next sibling links into the same array.  The
+ * root is always the first node, index 0 therefore doubles as no link.
+ */
+struct notify_trie_node {
+	char c;
+	unsigned int child;
+	unsigned int sibling;
+	struct at_notify *notify;
+};
+
+struct line_chunk {
+	struct line_chunk *next;
+	gsize size;
+	gsize used;
+	char data[];
+};
+
 struct at_chat {
 	gint ref_count;				/* Ref count */
 	guint next_cmd_id;			/* Next command id */
@@ -83,15 +109,24 @@ struct at_chat {
 	GAtIO *io;				/* AT IO */
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
+	guint pipeline_written;			/* cmds written ahead of cmd */
+	guint pipeline_depth;			/* max cmds awaiting response */
 	GHashTable *notify_list;		/* List of notification reg */
+	struct notify_trie_node *notify_trie;	/* Compiled notify prefixes */
+	gboolean notify_trie_dirty;		/* notify_list has changed */
+	GHashTable *command_stats;		/* Latencies by command name */
+	gboolean stats_enabled;			/* Account new commands */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
+	GAtChatQueueFunc queue_func;		/* commands wait or are done */
+	gpointer queue_data;
 	guint read_so_far;			/* Number of bytes processed */
 	gboolean suspended;			/* Are we suspended? */
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
 	GSList *response_lines;			/* char * lines of the response */
+	struct line_chunk *line_slab;		/* Storage for received lines */
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -118,6 +153,154 @@ struct terminator_info {
 	gboolean success;
 };
 
+/*
+ * Received lines, and the list nodes linking them into a GAtResult, are
+ * carved out of a per-chat slab instead of being allocated one by one.
+ * The slab is only grown when a chunk fills up and is reset as soon as no
+ * response line or PDU prefix refers into it, which means lines handed to
+ * callbacks must not be kept beyond the callback.
+ */
+static gpointer line_slab_alloc(struct at_chat *chat, gsize len)
+{
+	struct line_chunk *chunk = chat->line_slab;
+	char *line;
+
+	if (chunk == NULL || chunk->size - chunk->used < len) {
+		gsize size = MAX(len, LINE_CHUNK_SIZE);
+
+		chunk = g_try_malloc(sizeof(struct line_chunk) + size);
+		if (chunk == NULL)
+			return NULL;
+
+		chunk->next = chat->line_slab;
+		chunk->size = size;
+		chunk->used = 0;
+		chat->line_slab = chunk;
+	}
+
+	line = chunk->data + chunk->used;
+	chunk->used += len;
+
+	return line;
+}
+
+static GSList *line_slab_prepend(struct at_chat *chat, GSList *list,
+					gpointer data)
+{
+	struct line_chunk *chunk = chat->line_slab;
+	GSList *node;
+
+	/* Lines are not padded, realign for the node */
+	if (chunk) {
+		gsize used = (chunk->used + sizeof(gpointer) - 1) &
+						~(sizeof(gpointer) - 1);
+
+		chunk->used = MIN(used, chunk->size);
+	}
+
+	node = line_slab_alloc(chat, sizeof(GSList));
+	if (node == NULL)
+		return list;
+
+	node->data = data;
+	node->next = list;
+
+	return node;
+}
+
+static void line_slab_reset(struct at_chat *chat)
+{
+	struct line_chunk *chunk = chat->line_slab;
+
+	if (chunk == NULL)
+		return;
+
+	/* Only keep the oldest chunk around for reuse */
+	while (chunk->next) {
+		struct line_chunk *next = chunk->next;
+
+		g_free(chunk);
+		chunk = next;
+	}
+
+	chunk->used = 0;
+	chat->line_slab = chunk;
+}
+
+static void line_slab_free(struct at_chat *chat)
+{
+	line_slab_reset(chat);
+
+	g_free(chat->line_slab);
+	chat->line_slab = NULL;
+}
+
+/*
+ * Commands are accounted by name, including any trailing ? or =? to tell
+ * queries and tests apart from the command itself.  The AT prefix and any
+ * arguments are left out.
+ */
+static char *command_stats_key(const char *cmd)
+{
+	gsize len;
+
+	if (g_ascii_strncasecmp(cmd, "AT", 2) == 0)
+		cmd += 2;
+
+	len = strcspn(cmd, "=?;\r\032");
+
+	if (cmd[len] == '?')
+		len += 1;
+	else if (cmd[len] == '=')
+		len += cmd[len + 1] == '?' ? 2 : 1;
+
+	return g_strndup(cmd, len);
+}
+
+/*
+ * Looked up once as the command is queued.  The entries live as long as
+ * the chat, resetting the statistics only clears them.
+ */
+static GAtChatCommandStats *command_stats_lookup(struct at_chat *chat,
+						struct at_command *cmd)
+{
+	GAtChatCommandStats *stats;
+	char *key;
+
+	if (chat->command_stats == NULL)
+		chat->command_stats = g_hash_table_new_full(g_str_hash,
+						g_str_equal, g_free, g_free);
+
+	key = command_stats_key(cmd->cmd);
+	stats = g_hash_table_lookup(chat->command_stats, key);
+
+	if (stats) {
+		g_free(key);
+		return stats;
+	}
+
+	stats = g_new0(GAtChatCommandStats, 1);
+	g_hash_table_insert(chat->command_stats, key, stats);
+
+	return stats;
+}
+
+static void latency_add(GAtChatLatency *latency, gint64 start, gint64 end)
+{
+	guint64 usec = end > start ? end - start : 0;
+	guint64 msec = usec / 1000;
+	guint bucket = 0;
+
+	while (msec > 0 && bucket < G_AT_CHAT_LATENCY_BUCKETS - 1) {
+		msec >>= 1;
+		bucket += 1;
+	}
+
+	latency->buckets[bucket] += 1;
+	latency->total_usec += usec;
+	latency->max_usec = MAX(latency->max_usec, usec);
+}
+
 static gboolean node_is_destroyed(struct at_notify_node *node, gpointer user)
 {
 	return node->destroyed;
@@ -222,8 +405,10 @@ static gboolean at_chat_unregister_all(struct at_chat *chat,
 			g_slist_free_1(t);
 		}
 
-		if (notify->nodes == NULL)
+		if (notify->nodes == NULL) {
 			g_hash_table_iter_remove(&iter);
+			chat->notify_trie_dirty = TRUE;
+		}
 	}
 
 	return TRUE;
@@ -327,10 +512,12 @@ static void chat_cleanup(struct at_chat *chat)
 		chat->command_queue = NULL;
 	}
 
-	/* Cleanup any response lines we have pending */
-	if (chat->response_lines) {
-		g_slist_free_full(chat->response_lines, g_free);
-		chat->response_lines = NULL;
+	/* Any response lines pending live in the slab */
+	chat->response_lines = NULL;
+
+	if (chat->command_stats) {
+		g_hash_table_destroy(chat->command_stats);
+		chat->command_stats = NULL;
 	}
 
 	/* Cleanup registered notifications */
@@ -339,10 +526,11 @@ static void chat_cleanup(struct at_chat *chat)
 		chat->notify_list = NULL;
 	}
 
-	if (chat->pdu_notify) {
-		g_free(chat->pdu_notify);
-		chat->pdu_notify = NULL;
-	}
+	g_free(chat->notify_trie);
+	chat->notify_trie = NULL;
+
+	chat->pdu_notify = NULL;
+	line_slab_free(chat);
 
 	if (chat->wakeup) {
 		g_free(chat->wakeup);
@@ -388,27 +576,103 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 	node->callback(result, node->user_data);
 }
 
-static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
+static void notify_trie_compile(struct at_chat *chat)
 {
+	struct notify_trie_node *trie;
 	GHashTableIter iter;
-	struct at_notify *notify;
 	gpointer key, value;
-	gboolean ret = FALSE;
-	GAtResult result;
+	unsigned int size = 1;
+	unsigned int used = 1;
 
 	g_hash_table_iter_init(&iter, chat->notify_list);
-	result.lines = 0;
-	result.final_or_pdu = 0;
 
-	chat->in_notify = TRUE;
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		size += strlen(key);
+
+	trie = g_new0(struct notify_trie_node, size);
+
+	g_hash_table_iter_init(&iter, chat->notify_list);
 
 	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		notify = value;
+		const char *c;
+		unsigned int node = 0;
 
-		if (!g_str_has_prefix(line, key))
-			continue;
+		for (c = key; *c; c++) {
+			unsigned int child = trie[node].child;
+
+			while (child && trie[child].c != *c)
+				child = trie[child].sibling;
+
+			if (child == 0) {
+				child = used++;
+				trie[child].c = *c;
+				trie[child].sibling = trie[node].child;
+				trie[node].child = child;
+			}
+
+			node = child;
+		}
 
+		trie[node].notify = value;
+	}
+
+	g_free(chat->notify_trie);
+	chat->notify_trie = trie;
+	chat->notify_trie_dirty = FALSE;
+}
+
+/*
+ * Walks down the trie along line, starting from node *node at line offset
+ * *pos, and returns the notification registered for the next prefix of
+ * line.  Both *pos and *node are updated so that further calls return the
+ * longer matching prefixes, if any.
+ */
+static struct at_notify *notify_trie_next(struct at_chat *chat,
+						const char *line,
+						unsigned int *pos,
+						unsigned int *node)
+{
+	struct notify_trie_node *trie = chat->notify_trie;
+
+	while (line[*pos] != '\0') {
+		unsigned int child = trie[*node].child;
+
+		while (child && trie[child].c != line[*pos])
+			child = trie[child].sibling;
+
+		if (child == 0)
+			return NULL;
+
+		*node = child;
+		*pos += 1;
+
+		if (trie[child].notify)
+			return trie[child].notify;
+	}
+
+	return NULL;
+}
+
+static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
+{
+	struct at_notify *notify;
+	unsigned int pos = 0;
+	unsigned int node = 0;
+	gboolean ret = FALSE;
+	GAtResult result;
+	GSList line_node = { line, NULL };
+
+	if (chat->notify_trie == NULL || chat->notify_trie_dirty)
+		notify_trie_compile(chat);
+
+	result.lines = NULL;
+	result.final_or_pdu = NULL;
+
+	chat->in_notify = TRUE;
+
+	while ((notify = notify_trie_next(chat, line, &pos, &node))) {
 		if (notify->pdu) {
+			chat->in_notify = FALSE;
 			chat->pdu_notify = line;
 
 			if (chat->syntax->set_hint)
@@ -417,8 +681,7 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 			return TRUE;
 		}
 
-		if (result.lines == NULL)
-			result.lines = g_slist_prepend(NULL, line);
+		result.lines = &line_node;
 
 		g_slist_foreach(notify->nodes, at_notify_call_callback,
 					&result);
@@ -427,26 +690,87 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 
 	chat->in_notify = FALSE;
 
-	if (ret) {
-		g_slist_free(result.lines);
-		g_free(line);
-
+	if (ret)
 		at_chat_unregister_all(chat, FALSE, node_is_destroyed, NULL);
-	}
 
 	return ret;
 }
 
+/*
+ * Commands are normally written one at a time, the command being written
+ * being the one at the head of the queue.  When pipelining, up to
+ * pipeline_depth - 1 completely written commands can precede the command
+ * currently being written, all of them awaiting their final responses in
+ * queue order.
+ */
+static gboolean at_chat_command_started(struct at_chat *chat, guint n)
+{
+	if (n < chat->pipeline_written)
+		return TRUE;
+
+	return n == chat->pipeline_written && chat->cmd_bytes_written > 0;
+}
+
+/* Returns the last character written of the command at the queue head */
+static char at_chat_head_last_written(struct at_chat *chat,
+					struct at_command *cmd)
+{
+	if (chat->pipeline_written > 0)
+		return cmd->cmd[strlen(cmd->cmd) - 1];
+
+	if (chat->cmd_bytes_written == 0)
+		return '\0';
+
+	return cmd->cmd[chat->cmd_bytes_written - 1];
+}
+
+/*
+ * Moves on to writing the next command while the one written last is still
+ * awaiting its final response, if both are side-effect free and the
+ * pipeline has room left
+ */
+static gboolean at_chat_pipeline_advance(struct at_chat *chat)
+{
+	struct at_command *cur;
+	struct at_command *next;
+
+	if (chat->pipeline_written + 2 > chat->pipeline_depth)
+		return FALSE;
+
+	cur = g_queue_peek_nth(chat->command_queue, chat->pipeline_written);
+	next = g_queue_peek_nth(chat->command_queue,
+					chat->pipeline_written + 1);
+
+	if (cur == NULL || !(cur->flags & COMMAND_FLAG_PIPELINED))
+		return FALSE;
+
+	if (next == NULL || !(next->flags & COMMAND_FLAG_PIPELINED))
+		return FALSE;
+
+	if (chat->cmd_bytes_written < strlen(cur->cmd))
+		return FALSE;
+
+	chat->pipeline_written += 1;
+	chat->cmd_bytes_written = 0;
+
+	return TRUE;
+}
+
 static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 {
 	struct at_command *cmd = g_queue_pop_head(p->command_queue);
+	GAtChatCommandStats *stats;
 	GSList *response_lines;
+	gint64 now = 0;
 
 	/* Cannot happen, but lets be paranoid */
 	if (cmd == NULL)
 		return;
 
-	p->cmd_bytes_written = 0;
+	if (p->pipeline_written > 0)
+		p->pipeline_written -= 1;
+	else
+		p->cmd_bytes_written = 0;
 
 	if (g_queue_peek_head(p->command_queue))
 		chat_wakeup_writer(p);
@@ -454,6 +778,16 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 	response_lines = p->response_lines;
 	p->response_lines = NULL;
 
+	stats = cmd->stats;
+
+	if (stats) {
+		now = g_get_monotonic_time();
+		stats->completed += 1;
+		latency_add(&stats->queue_wait, cmd->queue_time,
+				cmd->write_time);
+		latency_add(&stats->wire_time, cmd->written_time, now);
+	}
+
 	if (cmd->callback) {
 		GAtResult result;
 
@@ -463,12 +797,19 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 		result.lines = response_lines;
 
 		cmd->callback(ok, &result, cmd->user_data);
-	}
 
-	g_slist_free_full(response_lines, g_free);
+		/* The chat might be gone, but the stats are freed with it */
+		if (stats && !p->destroyed)
+			latency_add(&stats->parse_time, now,
+					g_get_monotonic_time());
+	}
 
-	g_free(final);
 	at_command_destroy(cmd);
+
+	/* Checked after the callback, which may well queue the next one */
+	if (!p->destroyed && !p->suspended && p->queue_func &&
+			g_queue_get_length(p->command_queue) == 0)
+		p->queue_func(FALSE, p->queue_data);
 }
 
 static struct terminator_info terminator_table[] = {
@@ -563,16 +904,15 @@ out:
 
 	if (cmd->listing) {
 		GAtResult result;
+		GSList line_node = { line, NULL };
 
-		result.lines = g_slist_prepend(NULL, line);
+		result.lines = &line_node;
 		result.final_or_pdu = NULL;
 
 		cmd->listing(&result, cmd->user_data);
-
-		g_slist_free(result.lines);
-		g_free(line);
 	} else
-		p->response_lines = g_slist_prepend(p->response_lines, line);
+		p->response_lines = line_slab_prepend(p, p->response_lines,
+							line);
 
 	return TRUE;
 }
@@ -587,12 +927,12 @@ static void have_line(struct at_chat *p, char *str)
 
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2))
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
-	if (cmd && p->cmd_bytes_written > 0) {
-		char c = cmd->cmd[p->cmd_bytes_written - 1];
+	if (cmd && at_chat_command_started(p, 0)) {
+		char c = at_chat_head_last_written(p, cmd);
 
 		/* We check that we have submitted a terminator, in which case
 		 * a command might have failed or completed successfully
@@ -607,33 +947,23 @@ static void have_line(struct at_chat *p, char *str)
 			return;
 	}
 
-	if (at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
-	/* No matches & no commands active, ignore line */
-	g_free(str);
+	/* No matches & no commands active, line is ignored */
+	at_chat_match_notify(p, str);
 }
 
 static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 {
-	GHashTableIter iter;
 	struct at_notify *notify;
-	char *prefix;
-	gpointer key, value;
+	unsigned int pos = 0;
+	unsigned int node = 0;
 	gboolean called = FALSE;
 
-	p->in_notify = TRUE;
-
-	g_hash_table_iter_init(&iter, p->notify_list);
+	if (p->notify_trie == NULL || p->notify_trie_dirty)
+		notify_trie_compile(p);
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		prefix = key;
-		notify = value;
-
-		if (!g_str_has_prefix(p->pdu_notify, prefix))
-			continue;
+	p->in_notify = TRUE;
 
+	while ((notify = notify_trie_next(p, p->pdu_notify, &pos, &node))) {
 		if (!notify->pdu)
 			continue;
 
@@ -651,19 +981,20 @@ static void have_pdu(struct at_chat *p, char *pdu)
 {
 	struct at_command *cmd;
 	GAtResult result;
+	GSList line_node = { p->pdu_notify, NULL };
 	gboolean listing_pdu = FALSE;
 
 	if (pdu == NULL)
 		goto error;
 
-	result.lines = g_slist_prepend(NULL, p->pdu_notify);
+	result.lines = &line_node;
 	result.final_or_pdu = pdu;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
 	if (cmd && (cmd->flags & COMMAND_FLAG_EXPECT_PDU) &&
-			p->cmd_bytes_written > 0) {
-		char c = cmd->cmd[p->cmd_bytes_written - 1];
+			at_chat_command_started(p, 0)) {
+		char c = at_chat_head_last_written(p, cmd);
 
 		if (c == '\r')
 			listing_pdu = TRUE;
@@ -678,14 +1009,8 @@ static void have_pdu(struct at_chat *p, char *pdu)
 	} else
 		have_notify_pdu(p, pdu, &result);
 
-	g_slist_free(result.lines);
-
 error:
-	g_free(p->pdu_notify);
 	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
 }
 
 static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
@@ -718,7 +1043,7 @@ static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	line = g_try_new(char, line_length + 1);
+	line = line_slab_alloc(p, line_length + 1);
 	if (line == NULL) {
 		ring_buffer_drain(rbuf, p->read_so_far);
 		return NULL;
@@ -779,6 +1104,9 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 			break;
 		}
 
+		if (p->response_lines == NULL && p->pdu_notify == NULL)
+			line_slab_reset(p);
+
 		len -= p->read_so_far;
 		wrap -= p->read_so_far;
 		p->read_so_far = 0;
@@ -844,10 +1172,10 @@ static gboolean can_write_data(gpointer data)
 	int limiter;
 #endif
 
-	/* Grab the first command off the queue and write as
-	 * much of it as we can
+	/* Grab the first command not written yet off the queue and
+	 * write as much of it as we can
 	 */
-	cmd = g_queue_peek_head(chat->command_queue);
+	cmd = g_queue_peek_nth(chat->command_queue, chat->pipeline_written);
 
 	/* For some reason command queue is empty, cancel write watcher */
 	if (cmd == NULL)
@@ -856,13 +1184,19 @@ static gboolean can_write_data(gpointer data)
 	len = strlen(cmd->cmd);
 
 	/* For some reason write watcher fired, but we've already
-	 * written the entire command out to the io channel,
-	 * cancel write watcher
+	 * written the entire command out to the io channel.  Unless
+	 * the next command can be pipelined, cancel write watcher
 	 */
-	if (chat->cmd_bytes_written >= len)
-		return FALSE;
+	if (chat->cmd_bytes_written >= len) {
+		if (!at_chat_pipeline_advance(chat))
+			return FALSE;
 
-	if (chat->wakeup) {
+		cmd = g_queue_peek_nth(chat->command_queue,
+					chat->pipeline_written);
+		len = strlen(cmd->cmd);
+	}
+
+	if (chat->wakeup && chat->pipeline_written == 0) {
 		if (chat->wakeup_timer == NULL) {
 			wakeup_first = TRUE;
 			chat->wakeup_timer = g_timer_new();
@@ -912,8 +1246,14 @@ static gboolean can_write_data(gpointer data)
 	if (bytes_written == 0)
 		return FALSE;
 
+	if (cmd->stats && chat->cmd_bytes_written == 0)
+		cmd->write_time = g_get_monotonic_time();
+
 	chat->cmd_bytes_written += bytes_written;
 
+	if (cmd->stats && chat->cmd_bytes_written == len)
+		cmd->written_time = g_get_monotonic_time();
+
 	if (bytes_written < towrite)
 		return TRUE;
 
@@ -931,7 +1271,8 @@ static gboolean can_write_data(gpointer data)
 	if (chat->wakeup_timer)
 		g_timer_start(chat->wakeup_timer);
 
-	return FALSE;
+	/* Keep writing if the next command can be pipelined */
+	return at_chat_pipeline_advance(chat);
 }
 
 static void chat_wakeup_writer(struct at_chat *chat)
@@ -946,6 +1287,9 @@ static void at_chat_suspend(struct at_chat *chat)
 	g_at_io_set_write_handler(chat->io, NULL, NULL);
 	g_at_io_set_read_handler(chat->io, NULL, NULL);
 	g_at_io_set_debug(chat->io, NULL, NULL);
+
+	if (chat->queue_func && g_queue_get_length(chat->command_queue) > 0)
+		chat->queue_func(TRUE, chat->queue_data);
 }
 
 static void at_chat_resume(struct at_chat *chat)
@@ -964,6 +1308,8 @@ static void at_chat_resume(struct at_chat *chat)
 
 	if (g_queue_get_length(chat->command_queue) > 0)
 		chat_wakeup_writer(chat);
+	else if (chat->queue_func)
+		chat->queue_func(FALSE, chat->queue_data);
 }
 
 static struct at_chat *at_chat_ref(struct at_chat *chat)
@@ -985,6 +1331,8 @@ static void at_chat_unref(struct at_chat *chat)
 	if (is_zero == FALSE)
 		return;
 
+	chat->queue_func = NULL;
+
 	if (chat->io) {
 		at_chat_suspend(chat);
 		g_at_io_unref(chat->io);
@@ -1058,9 +1406,24 @@ static guint at_chat_send_common(struct at_chat *chat, guint gid,
 
 	c->id = chat->next_cmd_id++;
 
+	if (chat->stats_enabled) {
+		c->stats = command_stats_lookup(chat, c);
+		c->queue_time = g_get_monotonic_time();
+	}
+
 	g_queue_push_tail(chat->command_queue, c);
 
-	if (g_queue_get_length(chat->command_queue) == 1)
+	if (g_queue_get_length(chat->command_queue) > 1)
+		return c->id;
+
+	/*
+	 * The IO belongs to someone else while suspended, the command
+	 * has to wait for at_chat_resume
+	 */
+	if (chat->suspended) {
+		if (chat->queue_func)
+			chat->queue_func(TRUE, chat->queue_data);
+	} else
 		chat_wakeup_writer(chat);
 
 	return c->id;
@@ -1081,9 +1444,16 @@ static gboolean at_chat_retry(struct at_chat *chat, guint id)
 	if (chat->cmd_bytes_written != strlen(cmd->cmd))
 		return FALSE;
 
+	/* can't re-write it once further commands have been pipelined */
+	if (chat->pipeline_written > 0)
+		return FALSE;
+
 	/* reset number of written bytes to re-write command */
 	chat->cmd_bytes_written = 0;
 
+	if (cmd->stats)
+		cmd->stats->retries += 1;
+
 	chat_wakeup_writer(chat);
 
 	return TRUE;
@@ -1109,6 +1479,7 @@ static struct at_notify *at_notify_create(struct at_chat *chat,
 	notify->pdu = pdu;
 
 	g_hash_table_insert(chat->notify_list, key, notify);
+	chat->notify_trie_dirty = TRUE;
 
 	return notify;
 }
@@ -1132,12 +1503,15 @@ static gboolean at_chat_cancel(struct at_chat *chat, guint group, guint id)
 	if (c->gid != group)
 		return FALSE;
 
-	if (c == g_queue_peek_head(chat->command_queue) &&
-			chat->cmd_bytes_written > 0) {
+	if (at_chat_command_started(chat,
+				g_queue_index(chat->command_queue, c))) {
 		/* We can't actually remove it since it is most likely
 		 * already in progress, just null out the callback
 		 * so it won't be called
 		 */
+		if (c->callback && c->stats)
+			c->stats->cancelled += 1;
+
 		c->callback = NULL;
 	} else {
 		at_command_destroy(c);
@@ -1161,7 +1535,7 @@ static gboolean at_chat_cancel_group(struct at_chat *chat, guint group)
 			continue;
 		}
 
-		if (n == 0 && chat->cmd_bytes_written > 0) {
+		if (at_chat_command_started(chat, n)) {
 			c->callback = NULL;
 			n += 1;
 			continue;
@@ -1273,8 +1647,10 @@ static gboolean at_chat_unregister(struct at_chat *chat, gboolean mark_only,
 		at_notify_node_destroy(node, NULL);
 		notify->nodes = g_slist_remove(notify->nodes, node);
 
-		if (notify->nodes == NULL)
+		if (notify->nodes == NULL) {
 			g_hash_table_iter_remove(&iter);
+			chat->notify_trie_dirty = TRUE;
+		}
 
 		return TRUE;
 	}
@@ -1294,7 +1670,7 @@ static gboolean node_compare_by_group(struct at_notify_node *node,
 }
 
 static struct at_chat *create_chat(GIOChannel *channel, GIOFlags flags,
-					GAtSyntax *syntax)
+					gboolean fd_backed, GAtSyntax *syntax)
 {
 	struct at_chat *chat;
 
@@ -1311,9 +1687,12 @@ static struct at_chat *create_chat(GIOChannel *channel, GIOFlags flags,
 	chat->ref_count = 1;
 	chat->next_cmd_id = 1;
 	chat->next_notify_id = 1;
+	chat->pipeline_depth = 1;
 	chat->debugf = NULL;
 
-	if (flags & G_IO_FLAG_NONBLOCK)
+	if (fd_backed)
+		chat->io = g_at_io_new_fd(channel);
+	else if (flags & G_IO_FLAG_NONBLOCK)
 		chat->io = g_at_io_new(channel);
 	else
 		chat->io = g_at_io_new_blocking(channel);
@@ -1350,7 +1729,7 @@ error:
 }
 
 static GAtChat *g_at_chat_new_common(GIOChannel *channel, GIOFlags flags,
-					GAtSyntax *syntax)
+					gboolean fd_backed, GAtSyntax *syntax)
 {
 	GAtChat *chat;
 
@@ -1358,7 +1737,7 @@ static GAtChat *g_at_chat_new_common(GIOChannel *channel, GIOFlags flags,
 	if (chat == NULL)
 		return NULL;
 
-	chat->parent = create_chat(channel, flags, syntax);
+	chat->parent = create_chat(channel, flags, fd_backed, syntax);
 	if (chat->parent == NULL) {
 		g_free(chat);
 		return NULL;
@@ -1372,12 +1751,17 @@ static GAtChat *g_at_chat_new_common(GIOChannel *channel, GIOFlags flags,
 
 GAtChat *g_at_chat_new(GIOChannel *channel, GAtSyntax *syntax)
 {
-	return g_at_chat_new_common(channel, G_IO_FLAG_NONBLOCK, syntax);
+	return g_at_chat_new_common(channel, G_IO_FLAG_NONBLOCK, FALSE, syntax);
 }
 
 GAtChat *g_at_chat_new_blocking(GIOChannel *channel, GAtSyntax *syntax)
 {
-	return g_at_chat_new_common(channel, 0, syntax);
+	return g_at_chat_new_common(channel, 0, FALSE, syntax);
+}
+
+GAtChat *g_at_chat_new_fd(GIOChannel *channel, GAtSyntax *syntax)
+{
+	return g_at_chat_new_common(channel, G_IO_FLAG_NONBLOCK, TRUE, syntax);
 }
 
 GAtChat *g_at_chat_clone(GAtChat *clone)
@@ -1536,6 +1920,31 @@ gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 	return at_chat_set_wakeup_command(chat->parent, cmd, timeout, msec);
 }
 
+gboolean g_at_chat_set_queue_function(GAtChat *chat, GAtChatQueueFunc func,
+					gpointer user_data)
+{
+	if (chat == NULL)
+		return FALSE;
+
+	chat->parent->queue_func = func;
+	chat->parent->queue_data = user_data;
+
+	return TRUE;
+}
+
+gboolean g_at_chat_set_pipeline_depth(GAtChat *chat, guint depth)
+{
+	if (chat == NULL || chat->group != 0 || depth == 0)
+		return FALSE;
+
+	chat->parent->pipeline_depth = depth;
+
+	if (g_queue_get_length(chat->parent->command_queue) > 0)
+		chat_wakeup_writer(chat->parent);
+
+	return TRUE;
+}
+
 guint g_at_chat_send(GAtChat *chat, const char *cmd,
 			const char **prefix_list, GAtResultFunc func,
 			gpointer user_data, GDestroyNotify notify)
@@ -1545,6 +1954,20 @@ guint g_at_chat_send(GAtChat *chat, const char *cmd,
 					func, user_data, notify);
 }
 
+guint g_at_chat_send_pipelined(GAtChat *chat, const char *cmd,
+				const char **prefix_list, GAtResultFunc func,
+				gpointer user_data, GDestroyNotify notify)
+{
+	/* Commands with a prompt can't be written ahead of time */
+	if (strchr(cmd, '\r'))
+		return 0;
+
+	return at_chat_send_common(chat->parent, chat->group,
+					cmd, prefix_list,
+					COMMAND_FLAG_PIPELINED, NULL,
+					func, user_data, notify);
+}
+
 guint g_at_chat_send_listing(GAtChat *chat, const char *cmd,
 				const char **prefix_list,
 				GAtNotifyFunc listing, GAtResultFunc func,
@@ -1648,3 +2071,42 @@ gboolean g_at_chat_unregister_all(GAtChat *chat)
 					node_compare_by_group,
 					GUINT_TO_POINTER(chat->group));
 }
+
+void g_at_chat_foreach_stats(GAtChat *chat, GAtChatStatsFunc func,
+				gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	if (chat == NULL || func == NULL || chat->parent->command_stats == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, chat->parent->command_stats);
+
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		func(key, value, user_data);
+}
+
+void g_at_chat_set_stats(GAtChat *chat, gboolean enable)
+{
+	if (chat == NULL)
+		return;
+
+	chat->parent->stats_enabled = enable;
+}
+
+void g_at_chat_reset_stats(GAtChat *chat)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (chat == NULL || chat->parent->command_stats == NULL)
+		return;
+
+	/* Queued commands still point at the entries */
+	g_hash_table_iter_init(&iter, chat->parent->command_stats);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		memset(value, 0, sizeof(GAtChatCommandStats));
+}
@@ -38,6 +38,7 @@ typedef struct _GAtChat GAtChat;
 typedef void (*GAtResultFunc)(gboolean success, GAtResult *result,
 				gpointer user_data);
 typedef void (*GAtNotifyFunc)(GAtResult *result, gpointer user_data);
+typedef void (*GAtChatQueueFunc)(gboolean pending, gpointer user_data);
 
 enum _GAtChatTerminator {
 	G_AT_CHAT_TERMINATOR_OK,
@@ -54,9 +55,52 @@ enum _GAtChatTerminator {
 
 typedef enum _GAtChatTerminator GAtChatTerminator;
 
+#define G_AT_CHAT_LATENCY_BUCKETS 16
+
+/*!
+ * Latency histogram, bucket n counting the samples below 2^n milliseconds
+ * and the last bucket all the samples beyond
+ */
+struct _GAtChatLatency {
+	guint buckets[G_AT_CHAT_LATENCY_BUCKETS];
+	guint64 total_usec;
+	guint64 max_usec;
+};
+
+typedef struct _GAtChatLatency GAtChatLatency;
+
+/*!
+ * Statistics collected for all commands sharing the same name, e.g. +COPS?
+ * queue_wait covers the time from being queued until the first byte is
+ * written, wire_time until the final response is received and parse_time
+ * the time spent in the callback handling it.  Cancelled counts the commands
+ * cancelled while awaiting their final response, such as the ones a driver
+ * gives up on.
+ */
+struct _GAtChatCommandStats {
+	guint completed;
+	guint cancelled;
+	guint retries;
+	GAtChatLatency queue_wait;
+	GAtChatLatency wire_time;
+	GAtChatLatency parse_time;
+};
+
+typedef struct _GAtChatCommandStats GAtChatCommandStats;
+
+typedef void (*GAtChatStatsFunc)(const char *command,
+					const GAtChatCommandStats *stats,
+					gpointer user_data);
+
 GAtChat *g_at_chat_new(GIOChannel *channel, GAtSyntax *syntax);
 GAtChat *g_at_chat_new_blocking(GIOChannel *channel, GAtSyntax *syntax);
 
+/*!
+ * Same as g_at_chat_new() for a channel created by g_io_channel_unix_new(),
+ * such as the ones returned by g_at_tty_open(), see g_at_io_new_fd()
+ */
+GAtChat *g_at_chat_new_fd(GIOChannel *channel, GAtSyntax *syntax);
+
 GIOChannel *g_at_chat_get_channel(GAtChat *chat);
 GAtIO *g_at_chat_get_io(GAtChat *chat);
 
@@ -115,6 +159,19 @@ guint g_at_chat_send(GAtChat *chat, const char *cmd,
 				const char **valid_resp, GAtResultFunc func,
 				gpointer user_data, GDestroyNotify notify);
 
+/*!
+ * Same as g_at_chat_send, except that the caller guarantees the command to
+ * be free of side effects, e.g. a query.  Consecutive commands sent this way
+ * may be written to the modem before the preceding ones have received their
+ * final response, up to the depth set by g_at_chat_set_pipeline_depth.  The
+ * responses are attributed to the commands in the order they were sent, so
+ * this must only be used with modems known to process them in order.
+ * Commands expecting a prompt can not be pipelined.
+ */
+guint g_at_chat_send_pipelined(GAtChat *chat, const char *cmd,
+				const char **valid_resp, GAtResultFunc func,
+				gpointer user_data, GDestroyNotify notify);
+
 /*!
  * Same as the above command, except that the caller wishes to receive the
  * intermediate responses immediately through the GAtNotifyFunc callback.
@@ -166,9 +223,40 @@ guint g_at_chat_register(GAtChat *chat, const char *prefix,
 gboolean g_at_chat_unregister(GAtChat *chat, guint id);
 gboolean g_at_chat_unregister_all(GAtChat *chat);
 
+/*!
+ * Statistics are only collected for the commands queued while enabled,
+ * which they are not by default.  The setting and the statistics are
+ * shared by all clones of the chat.
+ */
+void g_at_chat_set_stats(GAtChat *chat, gboolean enable);
+
+/*!
+ * Calls func for the statistics of every command name seen so far.
+ */
+void g_at_chat_foreach_stats(GAtChat *chat, GAtChatStatsFunc func,
+				gpointer user_data);
+void g_at_chat_reset_stats(GAtChat *chat);
+
 gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 					guint timeout, guint msec);
 
+/*!
+ * Lets the user of a port shared with data know when commands wait for
+ * the chat to be resumed.  func is called with pending TRUE when a
+ * command is queued on the suspended chat, or it is suspended with
+ * commands queued, and with pending FALSE once the resumed chat has no
+ * command left.  All the clones of a chat share one such function.
+ */
+gboolean g_at_chat_set_queue_function(GAtChat *chat, GAtChatQueueFunc func,
+					gpointer user_data);
+
+/*!
+ * Sets how many commands sent with g_at_chat_send_pipelined may be awaiting
+ * their final response at the same time.  The default of 1 means commands
+ * are never pipelined.
+ */
+gboolean g_at_chat_set_pipeline_depth(GAtChat *chat, guint depth);
+
 void g_at_chat_add_terminator(GAtChat *chat, char *terminator,
 				int len, gboolean success);
 void g_at_chat_blacklist_terminator(GAtChat *chat,
@@ -23,17 +23,14 @@
 #include <config.h>
 #endif
 
-#include <arpa/inet.h>
-#include <sys/time.h>
 #include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
 #include "crc-ccitt.h"
 #include "ringbuffer.h"
+#include "recorder.h"
 #include "gatio.h"
 #include "gatutil.h"
 #include "gathdlc.h"
@@ -49,7 +46,11 @@
 #define HDLC_INITFCS	0xffff	/* Initial FCS value */
 #define HDLC_GOODFCS	0xf0b8	/* Good final FCS value */
 
-#define HDLC_FCS(fcs, c) crc_ccitt_byte(fcs, c)
+/* Helpers to test all bytes of a word at once */
+#define WORD_ONES	(~0UL / 0xff)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+#define WORD_HAS_LESS(w, n)	(((w) - WORD_ONES * (n)) & ~(w) & WORD_HIGHS)
+#define WORD_HAS_BYTE(w, c)	WORD_HAS_LESS((w) ^ (WORD_ONES * (c)), 1)
 
 #define GUARD_TIMEOUT	1000	/* Pause time before and after '+++' sequence */
 
@@ -61,13 +62,15 @@ struct _GAtHDLC {
 	guint decode_offset;
 	guint16 decode_fcs;
 	gboolean decode_escape;
+	gboolean decode_overflow;
 	guint32 xmit_accm[8];
+	guint8 xmit_escape[256];	/* xmit_accm as a lookup table */
 	guint32 recv_accm;
 	GAtReceiveFunc receive_func;
 	gpointer receive_data;
 	GAtDebugFunc debugf;
 	gpointer debug_data;
-	int record_fd;
+	struct recorder *recorder;
 	gboolean in_read_handler;
 	gboolean destroyed;
 	gboolean wakeup_sent;
@@ -78,52 +81,17 @@ struct _GAtHDLC {
 	guint suspend_source;
 	GTimer *timer;
 	guint num_plus;
+	GAtHDLCStats stats;
+	gint64 tx_since;	/* First write since the queue was empty */
 };
 
 static inline void hdlc_record(GAtHDLC *hdlc, gboolean in,
 					guint8 *data, guint16 length)
 {
-	guint16 len = htons(length);
-	guint32 ts;
-	struct timeval now;
-	unsigned char id;
-	int err;
-
 	g_at_util_debug_hexdump(in, data, length,
 					hdlc->debugf, hdlc->debug_data);
 
-	if (hdlc->record_fd < 0)
-		return;
-
-	if (length == 0)
-		return;
-
-	gettimeofday(&now, NULL);
-	ts = htonl(now.tv_sec & 0xffffffff);
-
-	id = 0x07;
-
-	err = write(hdlc->record_fd, &id, 1);
-	if (err < 0)
-		return;
-
-	err = write(hdlc->record_fd, &ts, 4);
-	if (err < 0)
-		return;
-
-	id = in ? 0x02 : 0x01;
-
-	err = write(hdlc->record_fd, &id, 1);
-	if (err < 0)
-		return;
-
-	err = write(hdlc->record_fd, &len, 2);
-	if (err < 0)
-		return;
-
-	err = write(hdlc->record_fd, data, length);
-	if (err < 0)
-		return;
+	recorder_stream(hdlc->recorder, in, data, length);
 }
 
 void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename)
@@ -131,16 +99,13 @@ void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename)
 	if (hdlc == NULL)
 		return;
 
-	if (hdlc->record_fd > fileno(stderr)) {
-		close(hdlc->record_fd);
-		hdlc->record_fd = -1;
-	}
+	recorder_free(hdlc->recorder);
+	hdlc->recorder = NULL;
 
 	if (filename == NULL)
 		return;
 
-	hdlc->record_fd = open(filename, O_WRONLY | O_CREAT | O_APPEND,
-					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	hdlc->recorder = recorder_new(filename);
 }
 
 void g_at_hdlc_set_recv_accm(GAtHDLC *hdlc, guint32 accm)
@@ -242,6 +207,74 @@ static gboolean check_escape(GAtHDLC *hdlc, struct ring_buffer *rbuf)
 	return TRUE;
 }
 
+static inline gboolean is_special(unsigned char c, guint32 accm)
+{
+	if (c == HDLC_FLAG || c == HDLC_ESCAPE)
+		return TRUE;
+
+	return c < 0x20 && (accm & (1U << c));
+}
+
+/*
+ * Returns the number of leading bytes that can be copied into the frame
+ * as they are, scanning a word at a time as long as the word holds no
+ * flag, escape or control characters.
+ */
+static unsigned int clean_run(const unsigned char *buf, unsigned int len,
+				guint32 accm)
+{
+	unsigned int n = 0;
+	unsigned int end;
+	unsigned long w;
+
+	while (n < len) {
+		end = len;
+
+		if (len - n >= sizeof(w)) {
+			memcpy(&w, buf + n, sizeof(w));
+
+			if (!WORD_HAS_BYTE(w, HDLC_FLAG) &&
+					!WORD_HAS_BYTE(w, HDLC_ESCAPE) &&
+					!(accm && WORD_HAS_LESS(w, 0x20))) {
+				n += sizeof(w);
+				continue;
+			}
+
+			end = n + sizeof(w);
+		}
+
+		for (; n < end; n++)
+			if (is_special(buf[n], accm))
+				return n;
+	}
+
+	return n;
+}
+
+static void decode_append(GAtHDLC *hdlc, const unsigned char *data,
+				unsigned int len)
+{
+	if (hdlc->decode_offset + len > BUFFER_SIZE) {
+		hdlc->decode_overflow = TRUE;
+		return;
+	}
+
+	memcpy(hdlc->decode_buffer + hdlc->decode_offset, data, len);
+	hdlc->decode_fcs = crc_ccitt_update(hdlc->decode_fcs, data, len);
+	hdlc->decode_offset += len;
+}
+
+static void count_rx_frame(GAtHDLC *hdlc)
+{
+	if (hdlc->decode_overflow || hdlc->decode_fcs != HDLC_GOODFCS) {
+		hdlc->stats.rx_errors += 1;
+		return;
+	}
+
+	hdlc->stats.rx_frames += 1;
+	hdlc->stats.rx_bytes += hdlc->decode_offset - 2;
+}
+
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtHDLC *hdlc = user_data;
@@ -272,6 +305,8 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 	hdlc->in_read_handler = TRUE;
 
 	while (pos < len) {
+		unsigned int step = 1;
+
 		/*
 		 * We try to detect NO CARRIER conditions here.  We
 		 * (ab) use the fact that a HDLC_FLAG must be followed
@@ -285,15 +320,22 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		if (hdlc->decode_escape == TRUE) {
 			unsigned char val = *buf ^ HDLC_TRANS;
 
-			hdlc->decode_buffer[hdlc->decode_offset++] = val;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, val);
+			decode_append(hdlc, &val, 1);
 
 			hdlc->decode_escape = FALSE;
 		} else if (*buf == HDLC_ESCAPE) {
 			hdlc->decode_escape = TRUE;
 		} else if (*buf == HDLC_FLAG) {
+			if (hdlc->decode_offset > 2)
+				count_rx_frame(hdlc);
+
 			if (hdlc->receive_func && hdlc->decode_offset > 2 &&
+					hdlc->decode_overflow == FALSE &&
 					hdlc->decode_fcs == HDLC_GOODFCS) {
+				recorder_frame(hdlc->recorder, TRUE,
+						hdlc->decode_buffer,
+						hdlc->decode_offset - 2);
+
 				hdlc->receive_func(hdlc->decode_buffer,
 							hdlc->decode_offset - 2,
 							hdlc->receive_data);
@@ -304,14 +346,18 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 			hdlc->decode_fcs = HDLC_INITFCS;
 			hdlc->decode_offset = 0;
+			hdlc->decode_overflow = FALSE;
 		} else if (*buf >= 0x20 ||
 					(hdlc->recv_accm & (1 << *buf)) == 0) {
-			hdlc->decode_buffer[hdlc->decode_offset++] = *buf;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, *buf);
+			unsigned int avail = (pos < wrap ? wrap : len) - pos;
+
+			/* Take the whole run up to the next special character */
+			step += clean_run(buf + 1, avail - 1, hdlc->recv_accm);
+			decode_append(hdlc, buf, step);
 		}
 
-		buf++;
-		pos++;
+		buf += step;
+		pos += step;
 
 		if (pos == wrap) {
 			buf = ring_buffer_read_ptr(rbuf, pos);
@@ -328,6 +374,15 @@ out:
 		g_free(hdlc);
 }
 
+static void update_xmit_escape(GAtHDLC *hdlc)
+{
+	unsigned int c;
+
+	for (c = 0; c < 256; c++)
+		hdlc->xmit_escape[c] = (hdlc->xmit_accm[c >> 5] >>
+						(c & 0x1f)) & 1;
+}
+
 GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 {
 	GAtHDLC *hdlc;
@@ -347,6 +402,7 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 
 	hdlc->xmit_accm[0] = ~0U;
 	hdlc->xmit_accm[3] = 0x60000000; /* 0x7d, 0x7e */
+	update_xmit_escape(hdlc);
 	hdlc->recv_accm = ~0U;
 
 	write_buffer = ring_buffer_new(BUFFER_SIZE);
@@ -363,8 +419,6 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	if (!hdlc->decode_buffer)
 		goto error;
 
-	hdlc->record_fd = -1;
-
 	hdlc->io = g_at_io_ref(io);
 	g_at_io_set_read_handler(hdlc->io, new_bytes, hdlc);
 
@@ -419,10 +473,8 @@ void g_at_hdlc_unref(GAtHDLC *hdlc)
 	if (g_atomic_int_dec_and_test(&hdlc->ref_count) == FALSE)
 		return;
 
-	if (hdlc->record_fd > fileno(stderr)) {
-		close(hdlc->record_fd);
-		hdlc->record_fd = -1;
-	}
+	recorder_free(hdlc->recorder);
+	hdlc->recorder = NULL;
 
 	g_at_io_set_write_handler(hdlc->io, NULL, NULL);
 	g_at_io_set_read_handler(hdlc->io, NULL, NULL);
@@ -440,7 +492,8 @@ void g_at_hdlc_unref(GAtHDLC *hdlc)
 
 	g_free(hdlc->decode_buffer);
 
-	g_timer_destroy(hdlc->timer);
+	if (hdlc->timer)
+		g_timer_destroy(hdlc->timer);
 
 	if (hdlc->in_read_handler)
 		hdlc->destroyed = TRUE;
@@ -501,6 +554,16 @@ static gboolean can_write_data(gpointer data)
 	if (ring_buffer_len(write_buffer) > 0)
 		return TRUE;
 
+	if (hdlc->tx_since) {
+		guint64 delay = g_get_monotonic_time() - hdlc->tx_since;
+
+		hdlc->stats.tx_flushes += 1;
+		hdlc->stats.tx_delay_total += delay;
+		hdlc->stats.tx_delay_max = MAX(hdlc->stats.tx_delay_max,
+							delay);
+		hdlc->tx_since = 0;
+	}
+
 	return FALSE;
 }
 
@@ -510,6 +573,7 @@ void g_at_hdlc_set_xmit_accm(GAtHDLC *hdlc, guint32 accm)
 		return;
 
 	hdlc->xmit_accm[0] = accm;
+	update_xmit_escape(hdlc);
 }
 
 guint32 g_at_hdlc_get_xmit_accm(GAtHDLC *hdlc)
@@ -528,20 +592,69 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 	return hdlc->io;
 }
 
-#define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
+gboolean g_at_hdlc_get_stats(GAtHDLC *hdlc, GAtHDLCStats *stats)
+{
+	if (hdlc == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = hdlc->stats;
+
+	return TRUE;
+}
+
+/*
+ * Escapes data into the free space of the write buffer starting at *pos,
+ * copying the runs of octets which need no escaping as they are
+ */
+static gboolean hdlc_encode(GAtHDLC *hdlc, struct ring_buffer *rbuf,
+				unsigned int *pos, const unsigned char *data,
+				gsize size)
+{
+	unsigned int avail = ring_buffer_avail(rbuf);
+	unsigned int wrap = ring_buffer_avail_no_wrap(rbuf);
+	unsigned int offset = *pos;
+	gsize i = 0;
+
+	while (i < size) {
+		unsigned int room = (offset < wrap ? wrap : avail) - offset;
+		unsigned int limit = MIN(room, size - i);
+		unsigned char *buf = ring_buffer_write_ptr(rbuf, offset);
+		unsigned int run = 0;
+
+		if (room == 0)
+			return FALSE;
+
+		while (run < limit && !hdlc->xmit_escape[data[i + run]])
+			run += 1;
+
+		memcpy(buf, data + i, run);
+		offset += run;
+		i += run;
+
+		if (run == limit)
+			continue;
+
+		/* The escape sequence may straddle the wrap around */
+		if (offset + 2 > avail)
+			return FALSE;
+
+		*ring_buffer_write_ptr(rbuf, offset++) = HDLC_ESCAPE;
+		*ring_buffer_write_ptr(rbuf, offset++) = data[i++] ^ HDLC_TRANS;
+	}
+
+	*pos = offset;
+
+	return TRUE;
+}
 
 gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
 {
 	struct ring_buffer* write_buffer = g_queue_peek_tail(hdlc->write_queue);
 
 	unsigned int avail = ring_buffer_avail(write_buffer);
-	unsigned int wrap = ring_buffer_avail_no_wrap(write_buffer);
-	unsigned char *buf;
 	unsigned char tail[2];
-	unsigned int i = 0;
-	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
+	guint16 fcs;
+	unsigned int pos = 0;
 
 	if (avail < size + HDLC_OVERHEAD) {
 		if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS)
@@ -554,89 +667,47 @@ gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
 		g_queue_push_tail(hdlc->write_queue, write_buffer);
 
 		avail = ring_buffer_avail(write_buffer);
-		wrap = ring_buffer_avail_no_wrap(write_buffer);
 	}
 
-	i = 0;
-	buf = ring_buffer_write_ptr(write_buffer, 0);
-
 	if (hdlc->start_frame_marker == TRUE) {
 		/* Protocol requires 0x7e as start marker */
 		if (pos + 1 > avail)
 			return FALSE;
 
-		*buf++ = HDLC_FLAG;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
+		*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 	} else if (hdlc->wakeup_sent == FALSE) {
 		/* Write an initial 0x7e as wakeup character */
-		*buf++ = HDLC_FLAG;
-		pos++;
+		*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 
 		hdlc->wakeup_sent = TRUE;
 	}
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
-
-	if (i < size)
+	if (!hdlc_encode(hdlc, write_buffer, &pos, data, size))
 		return FALSE;
 
-	fcs ^= HDLC_INITFCS;
+	fcs = crc_ccitt_update(HDLC_INITFCS, data, size) ^ HDLC_INITFCS;
 	tail[0] = fcs & 0xff;
 	tail[1] = fcs >> 8;
 
-	i = 0;
-
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
-
-	if (i < sizeof(tail))
+	if (!hdlc_encode(hdlc, write_buffer, &pos, tail, sizeof(tail)))
 		return FALSE;
 
 	if (pos + 1 > avail)
 		return FALSE;
 
 	/* Add 0x7e as end marker */
-	*buf = HDLC_FLAG;
-	pos++;
+	*ring_buffer_write_ptr(write_buffer, pos++) = HDLC_FLAG;
 
 	ring_buffer_write_advance(write_buffer, pos);
 
+	recorder_frame(hdlc->recorder, FALSE, data, size);
+
+	hdlc->stats.tx_frames += 1;
+	hdlc->stats.tx_bytes += size;
+
+	if (hdlc->tx_since == 0)
+		hdlc->tx_since = g_get_monotonic_time();
+
 	g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
 
 	return TRUE;
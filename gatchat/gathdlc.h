@@ -33,6 +33,19 @@ struct _GAtHDLC;
 
 typedef struct _GAtHDLC GAtHDLC;
 
+struct _GAtHDLCStats {
+	gulong rx_frames;
+	guint64 rx_bytes;
+	gulong rx_errors;	/* Frames dropped for a bad FCS or overflow */
+	gulong tx_frames;
+	guint64 tx_bytes;
+	gulong tx_flushes;	/* Times the write queue drained */
+	guint64 tx_delay_total;	/* Microseconds from queued to drained */
+	guint64 tx_delay_max;
+};
+
+typedef struct _GAtHDLCStats GAtHDLCStats;
+
 GAtHDLC *g_at_hdlc_new(GIOChannel *channel);
 GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io);
 
@@ -55,6 +68,8 @@ void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename);
 
 GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc);
 
+gboolean g_at_hdlc_get_stats(GAtHDLC *hdlc, GAtHDLCStats *stats);
+
 void g_at_hdlc_set_start_frame_marker(GAtHDLC *hdlc, gboolean marker);
 void g_at_hdlc_set_no_carrier_detect(GAtHDLC *hdlc, gboolean detect);
 
@@ -29,6 +29,9 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
 
 #include <glib.h>
 
@@ -36,6 +39,46 @@
 #include "gatio.h"
 #include "gatutil.h"
 
+#ifdef HAVE_IO_URING
+#include "uring.h"
+
+#define URING_ENTRIES 256
+#define URING_NBUFS 64
+#define URING_BUF_SIZE 4096
+#endif
+
+#define READ_WORKER_FIFO_SIZE 16384
+
+/*
+ * Reads on a thread of its own into a single producer, single consumer
+ * FIFO.  Only the worker moves head and only the main thread moves tail,
+ * everything past the FIFO, tracing included, stays on the main thread.
+ */
+struct read_worker {
+	GThread *thread;
+	int fd;
+	int wake_fd;		/* Worker to main thread, data or end */
+	int kick_fd;		/* Main thread to worker, space or stop */
+	unsigned char fifo[READ_WORKER_FIFO_SIZE];
+	guint head;
+	guint tail;
+	gint waiting;		/* Worker waits for room in the FIFO */
+	gint stopping;
+	gint finished;
+};
+
+#ifdef HAVE_IO_URING
+/*
+ * A multishot read on the ring shared by all GAtIOs.  It outlives its
+ * GAtIO until the kernel reports the read as ended, since completions
+ * may still be in flight when the GAtIO goes.
+ */
+struct uring_read {
+	GAtIO *io;		/* NULL once the GAtIO has gone */
+	gboolean armed;
+};
+#endif
+
 struct _GAtIO {
 	gint ref_count;				/* Ref count */
 	guint read_watch;			/* GSource read id, 0 if no */
@@ -45,6 +88,9 @@ struct _GAtIO {
 	gpointer user_disconnect_data;		/* user disconnect data */
 	struct ring_buffer *buf;		/* Current read buffer */
 	guint max_read_attempts;		/* max reads / select */
+	gsize max_read_size;			/* max bytes / read, 0 if any */
+	gboolean packet_reads;			/* One packet per read */
+	int fd;					/* fd for readv, -1 if no */
 	GAtIOReadFunc read_handler;		/* Read callback */
 	gpointer read_data;			/* Read callback userdata */
 	gboolean use_write_watch;		/* Use write select */
@@ -55,12 +101,69 @@ struct _GAtIO {
 	GAtDisconnectFunc write_done_func;	/* tx empty notifier */
 	gpointer write_done_data;		/* tx empty data */
 	gboolean destroyed;			/* Re-entrancy guard */
+	struct read_worker *worker;		/* Threaded reads, if any */
+#ifdef HAVE_IO_URING
+	struct uring_read *uring_read;		/* io_uring reads, if any */
+#endif
 };
 
+static GAtIOTraceFunc trace_func;
+static gboolean threaded_reads;
+static GSList *io_list;
+
+#ifdef HAVE_IO_URING
+static gboolean uring_reads;
+static struct uring *uring;
+static guint uring_watch;
+static unsigned int uring_users;
+static gboolean uring_dispatching;
+
+static void uring_read_release(struct uring_read *r);
+#endif
+
+static inline void io_trace(GAtIO *io, gboolean in, const char *data,
+								gsize len)
+{
+	if (trace_func && len > 0)
+		trace_func(in, g_io_channel_unix_get_fd(io->channel),
+								data, len);
+}
+
+static void read_worker_free(struct read_worker *w)
+{
+	g_atomic_int_set(&w->stopping, 1);
+	eventfd_write(w->kick_fd, 1);
+	g_thread_join(w->thread);
+
+	close(w->wake_fd);
+	close(w->kick_fd);
+	g_free(w);
+}
+
 static void read_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
 
+	if (io->worker) {
+		read_worker_free(io->worker);
+		io->worker = NULL;
+	}
+
+#ifdef HAVE_IO_URING
+	if (io->uring_read) {
+		struct uring_read *r = io->uring_read;
+
+		r->io = NULL;
+		io->uring_read = NULL;
+
+		if (r->armed) {
+			uring_cancel(uring, (uintptr_t) r);
+			uring_submit(uring);
+		} else
+			uring_read_release(r);
+	}
+#endif
+
 	ring_buffer_free(io->buf);
 	io->buf = NULL;
 
@@ -79,6 +182,473 @@ static void read_watcher_destroy_notify(gpointer user_data)
 		io->user_disconnect(io->user_disconnect_data);
 }
 
+/*
+ * Reads straight into both halves of the ring buffer with a single
+ * readv(), bypassing the GIOChannel.  A short read means the kernel has
+ * nothing more to give us, so there's no point trying again.
+ */
+static gboolean received_data_readv(GAtIO *io, GIOCondition cond)
+{
+	struct iovec iov[2];
+	gsize toread;
+	gsize total_read = 0;
+	guint read_count = 0;
+	ssize_t rbytes = 0;
+	int err = 0;
+
+	while (read_count < io->max_read_attempts) {
+		toread = ring_buffer_avail(io->buf);
+
+		if (io->max_read_size > 0 && io->max_read_size < toread)
+			toread = io->max_read_size;
+
+		if (toread == 0)
+			break;
+
+		iov[0].iov_base = ring_buffer_write_ptr(io->buf, 0);
+		iov[0].iov_len = MIN(toread,
+			(gsize) ring_buffer_avail_no_wrap(io->buf));
+		iov[1].iov_base = ring_buffer_write_ptr(io->buf,
+							iov[0].iov_len);
+		iov[1].iov_len = toread - iov[0].iov_len;
+
+		rbytes = readv(io->fd, iov, iov[1].iov_len ? 2 : 1);
+		err = rbytes < 0 ? errno : 0;
+
+		read_count++;
+
+		if (rbytes < 0)
+			break;
+
+		io_trace(io, TRUE, iov[0].iov_base,
+					MIN((gsize) rbytes, iov[0].iov_len));
+		g_at_util_debug_chat(TRUE, iov[0].iov_base,
+					MIN((gsize) rbytes, iov[0].iov_len),
+					io->debugf, io->debug_data);
+
+		if ((gsize) rbytes > iov[0].iov_len) {
+			io_trace(io, TRUE, iov[1].iov_base,
+						rbytes - iov[0].iov_len);
+			g_at_util_debug_chat(TRUE, iov[1].iov_base,
+						rbytes - iov[0].iov_len,
+						io->debugf, io->debug_data);
+		}
+
+		total_read += rbytes;
+		ring_buffer_write_advance(io->buf, rbytes);
+
+		/*
+		 * Packet reads are always short, keep going for as long as
+		 * another full sized packet is sure to fit
+		 */
+		if (io->packet_reads) {
+			if (rbytes == 0 || (gsize) ring_buffer_avail(io->buf) <
+							io->max_read_size)
+				break;
+		} else if ((gsize) rbytes != toread)
+			break;
+	}
+
+	if (total_read > 0 && io->read_handler)
+		io->read_handler(io->buf, io->read_data);
+
+	if (cond & (G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	/* End of file or an actual error */
+	if (read_count > 0 && rbytes <= 0 &&
+			err != EAGAIN && err != EWOULDBLOCK && err != EINTR)
+		return FALSE;
+
+	/* We're overflowing the buffer, shutdown the socket */
+	if (ring_buffer_avail(io->buf) == 0)
+		return FALSE;
+
+	return TRUE;
+}
+
+static gpointer read_worker_run(gpointer data)
+{
+	struct read_worker *w = data;
+	struct pollfd pfd[2] = {
+		{ .fd = -1 },
+		{ .fd = w->kick_fd, .events = POLLIN },
+	};
+	guint head = w->head;
+
+	while (!g_atomic_int_get(&w->stopping)) {
+		guint space = READ_WORKER_FIFO_SIZE -
+					(head - g_atomic_int_get(&w->tail));
+		guint offset = head % READ_WORKER_FIFO_SIZE;
+		eventfd_t count;
+		ssize_t rbytes;
+		int r;
+
+		/*
+		 * With the FIFO full, wait for the main thread to catch up.
+		 * It publishes tail before it checks waiting, so looking at
+		 * tail again once waiting is set cannot miss the kick.
+		 */
+		if (space == 0) {
+			g_atomic_int_set(&w->waiting, 1);
+			space = READ_WORKER_FIFO_SIZE -
+					(head - g_atomic_int_get(&w->tail));
+		}
+
+		pfd[0].fd = space ? w->fd : -1;
+		pfd[0].events = POLLIN;
+
+		r = poll(pfd, 2, -1);
+		g_atomic_int_set(&w->waiting, 0);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		if (pfd[1].revents & POLLIN)
+			eventfd_read(w->kick_fd, &count);
+
+		if (!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		rbytes = read(w->fd, w->fifo + offset,
+				MIN(space, READ_WORKER_FIFO_SIZE - offset));
+		if (rbytes > 0) {
+			head += rbytes;
+			g_atomic_int_set(&w->head, head);
+			eventfd_write(w->wake_fd, 1);
+			continue;
+		}
+
+		if (rbytes < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+
+		/* End of file or an actual error */
+		break;
+	}
+
+	g_atomic_int_set(&w->finished, 1);
+	eventfd_write(w->wake_fd, 1);
+
+	return NULL;
+}
+
+static gboolean received_worker_data(GIOChannel *channel,
+					GIOCondition cond, gpointer data)
+{
+	GAtIO *io = data;
+	struct read_worker *w = io->worker;
+	gboolean finished;
+	eventfd_t count;
+	gsize total_read;
+	guint head;
+	guint tail;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	eventfd_read(w->wake_fd, &count);
+
+	/* Checked first, so that the data read before the end is seen */
+	finished = g_atomic_int_get(&w->finished);
+	head = g_atomic_int_get(&w->head);
+	tail = w->tail;
+
+	/*
+	 * What does not fit in the read buffer is taken once the read
+	 * handler made room, no wakeup would come for it otherwise
+	 */
+	do {
+		total_read = 0;
+
+		while (tail != head) {
+			guint offset = tail % READ_WORKER_FIFO_SIZE;
+			gsize len = MIN(head - tail,
+					READ_WORKER_FIFO_SIZE - offset);
+			unsigned char *buf = ring_buffer_write_ptr(io->buf, 0);
+
+			len = MIN(len,
+				(gsize) ring_buffer_avail_no_wrap(io->buf));
+			if (len == 0)
+				break;
+
+			memcpy(buf, w->fifo + offset, len);
+			io_trace(io, TRUE, (char *) buf, len);
+			g_at_util_debug_chat(TRUE, (char *) buf, len,
+						io->debugf, io->debug_data);
+
+			ring_buffer_write_advance(io->buf, len);
+			tail += len;
+			total_read += len;
+		}
+
+		if (total_read == 0)
+			break;
+
+		/* Publish the room first, then wake a worker waiting for it */
+		g_atomic_int_set(&w->tail, tail);
+
+		if (g_atomic_int_get(&w->waiting))
+			eventfd_write(w->kick_fd, 1);
+
+		if (io->read_handler)
+			io->read_handler(io->buf, io->read_data);
+	} while (tail != head);
+
+	if (finished && tail == head)
+		return FALSE;
+
+	/* We're overflowing the buffer, shutdown the socket */
+	if (ring_buffer_avail(io->buf) == 0)
+		return FALSE;
+
+	return TRUE;
+}
+
+static gboolean read_worker_start(GAtIO *io)
+{
+	struct read_worker *w;
+	GIOChannel *channel;
+
+	w = g_try_new0(struct read_worker, 1);
+	if (w == NULL)
+		return FALSE;
+
+	w->fd = io->fd;
+	w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	w->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (w->wake_fd < 0 || w->kick_fd < 0)
+		goto error;
+
+	w->thread = g_thread_try_new("gatio", read_worker_run, w, NULL);
+	if (w->thread == NULL)
+		goto error;
+
+	io->worker = w;
+
+	channel = g_io_channel_unix_new(w->wake_fd);
+	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				received_worker_data, io,
+				read_watcher_destroy_notify);
+	g_io_channel_unref(channel);
+
+	return TRUE;
+
+error:
+	if (w->wake_fd >= 0)
+		close(w->wake_fd);
+
+	if (w->kick_fd >= 0)
+		close(w->kick_fd);
+
+	g_free(w);
+
+	return FALSE;
+}
+
+#ifdef HAVE_IO_URING
+static void uring_teardown(void)
+{
+	if (uring_watch > 0)
+		g_source_remove(uring_watch);
+
+	uring_free(uring);
+	uring = NULL;
+	uring_watch = 0;
+}
+
+static void uring_read_release(struct uring_read *r)
+{
+	g_free(r);
+
+	if (--uring_users == 0 && !uring_dispatching)
+		uring_teardown();
+}
+
+static void uring_received_data(GAtIO *io, const unsigned char *data,
+								gsize len)
+{
+	g_at_io_ref(io);
+
+	while (len > 0 && io->read_watch > 0) {
+		gsize total = 0;
+
+		while (total < len) {
+			unsigned char *buf = ring_buffer_write_ptr(io->buf, 0);
+			gsize n = MIN(len - total,
+				(gsize) ring_buffer_avail_no_wrap(io->buf));
+
+			if (n == 0)
+				break;
+
+			memcpy(buf, data + total, n);
+			io_trace(io, TRUE, (char *) buf, n);
+			g_at_util_debug_chat(TRUE, (char *) buf, n,
+						io->debugf, io->debug_data);
+
+			ring_buffer_write_advance(io->buf, n);
+			total += n;
+		}
+
+		/* We're overflowing the buffer, shutdown the socket */
+		if (total == 0) {
+			g_source_remove(io->read_watch);
+			break;
+		}
+
+		data += total;
+		len -= total;
+
+		if (io->read_handler)
+			io->read_handler(io->buf, io->read_data);
+	}
+
+	if (io->read_watch > 0 && ring_buffer_avail(io->buf) == 0)
+		g_source_remove(io->read_watch);
+
+	g_at_io_unref(io);
+}
+
+static void uring_read_done(uint64_t id, int res, const void *data,
+						bool more, void *user_data)
+{
+	struct uring_read *r = (struct uring_read *) (uintptr_t) id;
+	GAtIO *io = r->io;
+
+	if (!more)
+		r->armed = FALSE;
+
+	if (io && res > 0)
+		uring_received_data(io, data, res);
+
+	/* The GAtIO may have gone while its data was handled */
+	io = r->io;
+
+	if (io == NULL) {
+		if (!r->armed)
+			uring_read_release(r);
+
+		return;
+	}
+
+	if (more)
+		return;
+
+	/* Out of buffers, they are all back by the time this is submitted */
+	if ((res > 0 || res == -ENOBUFS) &&
+			uring_read_multishot(uring, io->fd, id)) {
+		r->armed = TRUE;
+		return;
+	}
+
+	/* End of file or an actual error */
+	g_source_remove(io->read_watch);
+}
+
+static gboolean uring_event(GIOChannel *channel, GIOCondition cond,
+							gpointer data)
+{
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	uring_dispatching = TRUE;
+	uring_process(uring, uring_read_done, NULL);
+	uring_dispatching = FALSE;
+
+	if (uring_users > 0)
+		return TRUE;
+
+	uring_free(uring);
+	uring = NULL;
+	uring_watch = 0;
+
+	return FALSE;
+}
+
+static gboolean uring_setup(void)
+{
+	GIOChannel *channel;
+
+	uring = uring_new(URING_ENTRIES, URING_NBUFS, URING_BUF_SIZE);
+	if (uring == NULL)
+		return FALSE;
+
+	channel = g_io_channel_unix_new(uring_get_fd(uring));
+	uring_watch = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				uring_event, NULL);
+	g_io_channel_unref(channel);
+
+	return TRUE;
+}
+
+/*
+ * Reads are driven by the ring, the source only ties the life of the
+ * GAtIO to read_watch like for the other kinds of reads
+ */
+static gboolean uring_source_prepare(GSource *source, gint *timeout)
+{
+	*timeout = -1;
+	return FALSE;
+}
+
+static gboolean uring_source_check(GSource *source)
+{
+	return FALSE;
+}
+
+static gboolean uring_source_dispatch(GSource *source, GSourceFunc func,
+							gpointer data)
+{
+	return TRUE;
+}
+
+static GSourceFuncs uring_source_funcs = {
+	.prepare = uring_source_prepare,
+	.check = uring_source_check,
+	.dispatch = uring_source_dispatch,
+};
+
+static gboolean uring_read_start(GAtIO *io)
+{
+	struct uring_read *r;
+	GSource *source;
+
+	if (uring == NULL && !uring_setup())
+		return FALSE;
+
+	r = g_new0(struct uring_read, 1);
+	r->io = io;
+
+	if (!uring_read_multishot(uring, io->fd, (uintptr_t) r)) {
+		g_free(r);
+
+		if (uring_users == 0)
+			uring_teardown();
+
+		return FALSE;
+	}
+
+	uring_submit(uring);
+
+	r->armed = TRUE;
+	uring_users += 1;
+	io->uring_read = r;
+
+	source = g_source_new(&uring_source_funcs, sizeof(GSource));
+	g_source_set_callback(source, NULL, io, read_watcher_destroy_notify);
+	io->read_watch = g_source_attach(source, NULL);
+	g_source_unref(source);
+
+	return TRUE;
+}
+#endif
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
@@ -93,10 +663,16 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
+	if (io->fd >= 0)
+		return received_data_readv(io, cond);
+
 	/* Regardless of condition, try to read all the data available */
 	do {
 		toread = ring_buffer_avail_no_wrap(io->buf);
 
+		if (io->max_read_size > 0)
+			toread = MIN(toread, io->max_read_size);
+
 		if (toread == 0)
 			break;
 
@@ -105,6 +681,7 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		status = g_io_channel_read_chars(channel, (char *) buf,
 							toread, &rbytes, NULL);
+		io_trace(io, TRUE, (char *) buf, rbytes);
 		g_at_util_debug_chat(TRUE, (char *)buf, rbytes,
 					io->debugf, io->debug_data);
 
@@ -147,12 +724,56 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 		return 0;
 	}
 
+	io_trace(io, FALSE, data, bytes_written);
 	g_at_util_debug_chat(FALSE, data, bytes_written,
 				io->debugf, io->debug_data);
 
 	return bytes_written;
 }
 
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt)
+{
+	gsize bytes_written = 0;
+	ssize_t written;
+	int i;
+
+	if (io->fd < 0) {
+		for (i = 0; i < iovcnt; i++) {
+			gsize len = g_at_io_write(io, iov[i].iov_base,
+							iov[i].iov_len);
+
+			bytes_written += len;
+
+			if (len < iov[i].iov_len)
+				break;
+		}
+
+		return bytes_written;
+	}
+
+	do {
+		written = writev(io->fd, iov, iovcnt);
+	} while (written < 0 && errno == EINTR);
+
+	if (written < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			g_source_remove(io->read_watch);
+
+		return 0;
+	}
+
+	for (i = 0; i < iovcnt && bytes_written < (gsize) written; i++) {
+		gsize len = MIN(iov[i].iov_len, written - bytes_written);
+
+		io_trace(io, FALSE, iov[i].iov_base, len);
+		g_at_util_debug_chat(FALSE, iov[i].iov_base, len,
+					io->debugf, io->debug_data);
+		bytes_written += len;
+	}
+
+	return bytes_written;
+}
+
 static void write_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
@@ -182,7 +803,8 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 	return io->write_handler(io->write_data);
 }
 
-static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
+static GAtIO *create_io(GIOChannel *channel, GIOFlags flags,
+				gboolean fd_backed)
 {
 	GAtIO *io;
 
@@ -204,7 +826,10 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		io->use_write_watch = FALSE;
 	}
 
-	io->buf = ring_buffer_new(8192);
+	/* Prefer a mirrored buffer, saving the consumers the wrap handling */
+	io->buf = ring_buffer_new_mirrored(8192);
+	if (io->buf == NULL)
+		io->buf = ring_buffer_new(8192);
 
 	if (!io->buf)
 		goto error;
@@ -212,12 +837,31 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 	if (!g_at_util_setup_io(channel, flags))
 		goto error;
 
+	/*
+	 * With encoding and buffering disabled a unix GIOChannel is a plain
+	 * wrapper around read(), so it is safe to go to the fd directly.
+	 * Other channels, e.g. the GAtMux ones, have no fd behind them.
+	 */
+	io->fd = fd_backed ? g_io_channel_unix_get_fd(channel) : -1;
+
 	io->channel = channel;
+
+#ifdef HAVE_IO_URING
+	if (uring_reads && io->fd >= 0 && uring_read_start(io))
+		goto done;
+#endif
+
+	if (threaded_reads && io->fd >= 0 && read_worker_start(io))
+		goto done;
+
 	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 				received_data, io,
 				read_watcher_destroy_notify);
 
+done:
+	io_list = g_slist_prepend(io_list, io);
+
 	return io;
 
 error:
@@ -231,12 +875,17 @@ error:
 
 GAtIO *g_at_io_new(GIOChannel *channel)
 {
-	return create_io(channel, G_IO_FLAG_NONBLOCK);
+	return create_io(channel, G_IO_FLAG_NONBLOCK, FALSE);
 }
 
 GAtIO *g_at_io_new_blocking(GIOChannel *channel)
 {
-	return create_io(channel, 0);
+	return create_io(channel, 0, FALSE);
+}
+
+GAtIO *g_at_io_new_fd(GIOChannel *channel)
+{
+	return create_io(channel, G_IO_FLAG_NONBLOCK, TRUE);
 }
 
 GIOChannel *g_at_io_get_channel(GAtIO *io)
@@ -342,6 +991,7 @@ void g_at_io_unref(GAtIO *io)
 	if (is_zero == FALSE)
 		return;
 
+	io_list = g_slist_remove(io_list, io);
 	io_shutdown(io);
 
 	/* glib delays the destruction of the watcher until it exits, this
@@ -355,6 +1005,28 @@ void g_at_io_unref(GAtIO *io)
 		g_free(io);
 }
 
+gboolean g_at_io_set_read_policy(GAtIO *io, guint max_attempts,
+					gsize max_size)
+{
+	if (io == NULL || max_attempts == 0)
+		return FALSE;
+
+	io->max_read_attempts = max_attempts;
+	io->max_read_size = max_size;
+
+	return TRUE;
+}
+
+gboolean g_at_io_set_packet_reads(GAtIO *io, gboolean packet_reads)
+{
+	if (io == NULL)
+		return FALSE;
+
+	io->packet_reads = packet_reads;
+
+	return TRUE;
+}
+
 gboolean g_at_io_set_disconnect_function(GAtIO *io,
 			GAtDisconnectFunc disconnect, gpointer user_data)
 {
@@ -367,6 +1039,26 @@ gboolean g_at_io_set_disconnect_function(GAtIO *io,
 	return TRUE;
 }
 
+void g_at_io_set_trace_func(GAtIOTraceFunc func)
+{
+	trace_func = func;
+}
+
+void g_at_io_set_threaded_reads(gboolean enable)
+{
+	threaded_reads = enable;
+}
+
+gboolean g_at_io_set_io_uring(gboolean enable)
+{
+#ifdef HAVE_IO_URING
+	uring_reads = enable;
+	return TRUE;
+#else
+	return !enable;
+#endif
+}
+
 gboolean g_at_io_set_debug(GAtIO *io, GAtDebugFunc func, gpointer user_data)
 {
 	if (io == NULL)
@@ -388,6 +1080,17 @@ void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 	io->write_done_data = user_data;
 }
 
+void g_at_io_trim_all(void)
+{
+	GSList *l;
+
+	for (l = io_list; l; l = l->next) {
+		GAtIO *io = l->data;
+
+		ring_buffer_trim(io->buf);
+	}
+}
+
 void g_at_io_drain_ring_buffer(GAtIO *io, guint len)
 {
 	ring_buffer_drain(io->buf, len);
@@ -33,13 +33,22 @@ struct _GAtIO;
 typedef struct _GAtIO GAtIO;
 
 struct ring_buffer;
+struct iovec;
 
 typedef void (*GAtIOReadFunc)(struct ring_buffer *buffer, gpointer user_data);
 typedef gboolean (*GAtIOWriteFunc)(gpointer user_data);
+typedef void (*GAtIOTraceFunc)(gboolean in, int fd, const char *data,
+								gsize len);
 
 GAtIO *g_at_io_new(GIOChannel *channel);
 GAtIO *g_at_io_new_blocking(GIOChannel *channel);
 
+/*!
+ * Same as g_at_io_new() for a channel created by g_io_channel_unix_new(),
+ * whose fd is then read directly with readv()
+ */
+GAtIO *g_at_io_new_fd(GIOChannel *channel);
+
 GIOChannel *g_at_io_get_channel(GAtIO *io);
 
 GAtIO *g_at_io_ref(GAtIO *io);
@@ -56,11 +65,67 @@ void g_at_io_drain_ring_buffer(GAtIO *io, guint len);
 
 gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count);
 
+/*!
+ * Writes the buffers with a single writev() where the channel allows it,
+ * so that e.g. a packet split across a ring buffer goes out in one piece.
+ * Returns the number of bytes written, 0 if the channel is not writable.
+ */
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt);
+
+/*!
+ * Sets how many reads are attempted each time the channel becomes readable
+ * and the maximum number of bytes requested per read, 0 meaning as much as
+ * the buffer can take.  Channels with high data rates, e.g. NMEA streams,
+ * benefit from a larger size and fewer attempts per wakeup.
+ */
+gboolean g_at_io_set_read_policy(GAtIO *io, guint max_attempts,
+					gsize max_size);
+
+/*!
+ * Each read of a packet device, e.g. tun, returns a single packet.  With
+ * packet reads enabled, a short read doesn't end the reads of a wakeup,
+ * they go on while another packet of max_size bytes is sure to fit.
+ */
+gboolean g_at_io_set_packet_reads(GAtIO *io, gboolean packet_reads);
+
 gboolean g_at_io_set_disconnect_function(GAtIO *io,
 			GAtDisconnectFunc disconnect, gpointer user_data);
 
 gboolean g_at_io_set_debug(GAtIO *io, GAtDebugFunc func, gpointer user_data);
 
+/*!
+ * Installs a hook that sees the raw bytes read from and written to every
+ * GAtIO, along with the underlying file descriptor.  Unlike the debug
+ * function this is global, so that traffic can be captured without each
+ * user of the library having to opt in.
+ */
+void g_at_io_set_trace_func(GAtIOTraceFunc func);
+
+/*!
+ * With threaded reads enabled, GAtIOs created afterwards by g_at_io_new_fd()
+ * do their reads on a worker thread of their own.  The data is handed to
+ * the main loop through a lock-free FIFO and parsed there, so one busy
+ * device no longer holds up the others while it is read.  The read policy
+ * does not apply to these.
+ */
+void g_at_io_set_threaded_reads(gboolean enable);
+
+/*!
+ * With io_uring enabled, GAtIOs created afterwards by g_at_io_new_fd() are
+ * read through multishot reads on a ring shared by all of them, into
+ * a common pool of kernel provided buffers.  A single wakeup then covers
+ * the data of every channel, with no read() call per channel.  It takes
+ * precedence over threaded reads and the read policy does not apply.
+ * Falls back to the usual reads where the kernel lacks support.  Returns
+ * FALSE if the library was built without io_uring support.
+ */
+gboolean g_at_io_set_io_uring(gboolean enable);
+
+/*!
+ * Releases the pages of the read buffers that are currently empty
+ */
+void g_at_io_trim_all(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +56,8 @@ typedef void (*GAtMuxWriteFrame)(GAtMux *mux, guint8 dlc, guint8 control,
 #define BITMAP_SIZE 8
 #define MUX_CHANNEL_BUFFER_SIZE 4096
 #define MUX_BUFFER_SIZE 4096
+#define DEFAULT_PRIORITY 1
+#define DEFAULT_WRITE_QUANTUM 16
 
 struct _GAtMuxChannel
 {
@@ -63,9 +65,14 @@ struct _GAtMuxChannel
 	GAtMux *mux;
 	GIOCondition condition;
 	struct ring_buffer *buffer;
+	const guint8 *pending;		/* Frame payload being dispatched */
+	gsize pending_len;
 	GSList *sources;
 	gboolean throttled;
 	guint dlc;
+	guint8 priority;		/* Frames per turn at the writer */
+	guint credits;			/* Frames left in the current turn */
+	GAtMuxChannelStats stats;
 };
 
 struct _GAtMuxWatch
@@ -89,7 +96,11 @@ struct _GAtMux {
 	const GAtMuxDriver *driver;		/* Driver functions */
 	void *driver_data;			/* Driver data */
 	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
+	int buf_start;				/* Start of unparsed data */
 	int buf_used;				/* Bytes of buf being used */
+	int frame_size;				/* Max payload per frame */
+	guint write_quantum;			/* Frames per writer wakeup */
+	int next_writer;			/* DLC index to go first */
 	gboolean shutdown;
 };
 
@@ -239,6 +250,17 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 	debug(mux, "received data");
 
+	/*
+	 * Partial frames are left where they are, only move them down
+	 * once the room behind them gets short
+	 */
+	if (mux->buf_start > 0 &&
+			sizeof(mux->buf) - mux->buf_used < MUX_BUFFER_SIZE / 4) {
+		mux->buf_used -= mux->buf_start;
+		memmove(mux->buf, mux->buf + mux->buf_start, mux->buf_used);
+		mux->buf_start = 0;
+	}
+
 	bytes_read = 0;
 	status = g_io_channel_read_chars(mux->channel, mux->buf + mux->buf_used,
 					sizeof(mux->buf) - mux->buf_used,
@@ -251,13 +273,17 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		memset(mux->newdata, 0, BITMAP_SIZE);
 
-		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
-		mux->buf_used -= nread;
+		/* Frames may be dispatched to the channels while parsing */
+		g_at_mux_ref(mux);
 
-		if (mux->buf_used > 0)
-			memmove(mux->buf, mux->buf + nread, mux->buf_used);
+		nread = mux->driver->feed_data(mux, mux->buf + mux->buf_start,
+						mux->buf_used - mux->buf_start);
+		mux->buf_start += nread;
 
-		g_at_mux_ref(mux);
+		if (mux->buf_start == mux->buf_used) {
+			mux->buf_start = 0;
+			mux->buf_used = 0;
+		}
 
 		for (i = 1; i <= MAX_CHANNELS; i++) {
 			int offset = i / 8;
@@ -272,7 +298,8 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 			dispatch_sources(mux->dlcs[i-1], G_IO_IN);
 		}
 
-		buffer_full = mux->buf_used == sizeof(mux->buf);
+		buffer_full = mux->buf_used - mux->buf_start ==
+							sizeof(mux->buf);
 
 		g_at_mux_unref(mux);
 	}
@@ -296,53 +323,129 @@ static void write_watcher_destroy_notify(gpointer user_data)
 	mux->write_watch = 0;
 }
 
+static gboolean channel_wants_write(GAtMuxChannel *channel)
+{
+	GSList *l;
+
+	if (channel == NULL || channel->throttled)
+		return FALSE;
+
+	for (l = channel->sources; l; l = l->next) {
+		GAtMuxWatch *source = l->data;
+
+		if (source->condition & G_IO_OUT)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Order the channels waiting to write by priority, channels of the same
+ * priority taking turns at going first
+ */
+static int schedule_writers(GAtMux *mux, int *order)
+{
+	int n = 0;
+	int i;
+
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		int dlc = (mux->next_writer + i) % MAX_CHANNELS;
+		GAtMuxChannel *channel = mux->dlcs[dlc];
+		int j;
+
+		if (!channel_wants_write(channel))
+			continue;
+
+		for (j = n; j > 0; j--) {
+			if (mux->dlcs[order[j - 1]]->priority >=
+							channel->priority)
+				break;
+
+			order[j] = order[j - 1];
+		}
+
+		order[j] = dlc;
+		n += 1;
+	}
+
+	return n;
+}
+
 static gboolean can_write_data(GIOChannel *chan, GIOCondition cond,
 				gpointer data)
 {
 	GAtMux *mux = data;
+	int order[MAX_CHANNELS];
+	guint budget = mux->write_quantum;
+	gboolean progress = TRUE;
+	gboolean again = FALSE;
 	int dlc;
+	int n;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
 	debug(mux, "can write data");
 
-	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
-		GAtMuxChannel *channel = mux->dlcs[dlc];
+	g_at_mux_ref(mux);
 
-		if (channel == NULL)
-			continue;
+	/*
+	 * Hand out the quantum in turns of up to priority frames, so that
+	 * a bulk writer can not hold the other channels up for longer
+	 * than its own turn
+	 */
+	while (budget > 0 && progress) {
+		progress = FALSE;
+		n = schedule_writers(mux, order);
 
-		debug(mux, "checking channel for write: %p", channel);
+		for (i = 0; i < n && budget > 0; i++) {
+			GAtMuxChannel *channel = mux->dlcs[order[i]];
+			guint granted;
 
-		if (channel->throttled)
-			continue;
+			if (!channel_wants_write(channel))
+				continue;
 
-		debug(mux, "dispatching write sources: %p", channel);
+			granted = MIN(channel->priority, budget);
+			channel->credits = granted;
 
-		dispatch_sources(channel, G_IO_OUT);
-	}
+			debug(mux, "dispatching write sources: %p", channel);
 
-	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
-		GAtMuxChannel *channel = mux->dlcs[dlc];
-		GSList *l;
-		GAtMuxWatch *source;
+			dispatch_sources(channel, G_IO_OUT);
 
-		if (channel == NULL)
-			continue;
+			/* The channel was closed by its writer */
+			if (mux->dlcs[order[i]] != channel)
+				continue;
 
-		if (channel->throttled)
-			continue;
+			budget -= granted - channel->credits;
+
+			if (channel->credits < granted)
+				progress = TRUE;
+
+			channel->credits = 0;
+			mux->next_writer = (order[i] + 1) % MAX_CHANNELS;
+		}
 
-		for (l = channel->sources; l; l = l->next) {
-			source = l->data;
+		/* Count the turns lost to the quantum running out */
+		for (; i < n; i++) {
+			GAtMuxChannel *channel = mux->dlcs[order[i]];
 
-			if (source->condition & G_IO_OUT)
-				return TRUE;
+			if (channel_wants_write(channel))
+				channel->stats.tx_deferred += 1;
 		}
 	}
 
-	return FALSE;
+	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
+		if (channel_wants_write(mux->dlcs[dlc])) {
+			again = TRUE;
+			break;
+		}
+	}
+
+	g_at_mux_unref(mux);
+
+	return again;
 }
 
 static void wakeup_writer(GAtMux *mux)
@@ -370,15 +473,34 @@ int g_at_mux_raw_write(GAtMux *mux, const void *data, int towrite)
 	return bytes_written;
 }
 
-void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
+static void queue_dlc_data(GAtMux *mux, GAtMuxChannel *channel,
 				const void *data, int tofeed)
 {
-	GAtMuxChannel *channel;
-
 	int written;
 	int offset;
 	int bit;
 
+	written = ring_buffer_write(channel->buffer, data, tofeed);
+
+	if (written < 0)
+		return;
+
+	channel->stats.rx_queued = ring_buffer_len(channel->buffer);
+	if (channel->stats.rx_queued > channel->stats.rx_queued_max)
+		channel->stats.rx_queued_max = channel->stats.rx_queued;
+
+	offset = channel->dlc / 8;
+	bit = channel->dlc % 8;
+
+	mux->newdata[offset] |= 1 << bit;
+	channel->condition |= G_IO_IN;
+}
+
+void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
+				const void *data, int tofeed)
+{
+	GAtMuxChannel *channel;
+
 	debug(mux, "deliver_data: dlc: %hu", dlc);
 
 	if (dlc < 1 || dlc > MAX_CHANNELS)
@@ -389,16 +511,35 @@ void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
 	if (channel == NULL)
 		return;
 
-	written = ring_buffer_write(channel->buffer, data, tofeed);
+	channel->stats.rx_frames += 1;
+	channel->stats.rx_bytes += tofeed;
 
-	if (written < 0)
+	if (ring_buffer_len(channel->buffer) > 0 || channel->sources == NULL) {
+		queue_dlc_data(mux, channel, data, tofeed);
 		return;
+	}
 
-	offset = dlc / 8;
-	bit = dlc % 8;
-
-	mux->newdata[offset] |= 1 << bit;
+	/*
+	 * With nothing queued on the channel its readers can take the
+	 * payload straight out of the frame, whatever they leave behind
+	 * is queued up as usual
+	 */
+	channel->pending = data;
+	channel->pending_len = tofeed;
 	channel->condition |= G_IO_IN;
+
+	g_io_channel_ref(&channel->channel);
+	dispatch_sources(channel, G_IO_IN);
+
+	data = channel->pending;
+	tofeed = channel->pending_len;
+	channel->pending = NULL;
+	channel->pending_len = 0;
+
+	if (tofeed > 0 && mux->dlcs[dlc-1] == channel)
+		queue_dlc_data(mux, channel, data, tofeed);
+
+	g_io_channel_unref(&channel->channel);
 }
 
 void g_at_mux_set_dlc_status(GAtMux *mux, guint8 dlc, int status)
@@ -414,22 +555,20 @@ void g_at_mux_set_dlc_status(GAtMux *mux, guint8 dlc, int status)
 	if (channel == NULL)
 		return;
 
-	if (status & G_AT_MUX_DLC_STATUS_RTR) {
-		GSList *l;
-
-		mux->dlcs[dlc-1]->throttled = FALSE;
-		debug(mux, "setting throttled to FALSE");
+	/* The other side sets FC while it can not accept frames on the DLC */
+	if (status & G_AT_MUX_DLC_STATUS_FC) {
+		channel->throttled = TRUE;
+		channel->stats.throttled = TRUE;
+		debug(mux, "setting throttled to TRUE");
+		return;
+	}
 
-		for (l = mux->dlcs[dlc-1]->sources; l; l = l->next) {
-			GAtMuxWatch *source = l->data;
+	channel->throttled = FALSE;
+	channel->stats.throttled = FALSE;
+	debug(mux, "setting throttled to FALSE");
 
-			if (source->condition & G_IO_OUT) {
-				wakeup_writer(mux);
-				break;
-			}
-		}
-	} else
-		mux->dlcs[dlc-1]->throttled = TRUE;
+	if (channel_wants_write(channel))
+		wakeup_writer(mux);
 }
 
 void g_at_mux_set_data(GAtMux *mux, void *data)
@@ -493,12 +632,24 @@ static GIOStatus channel_read(GIOChannel *channel, gchar *buf, gsize count,
 					gsize *bytes_read, GError **err)
 {
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
-	unsigned int avail = ring_buffer_len_no_wrap(mux_channel->buffer);
+	unsigned int avail;
+
+	if (mux_channel->pending_len > 0) {
+		*bytes_read = MIN(count, mux_channel->pending_len);
+		memcpy(buf, mux_channel->pending, *bytes_read);
+		mux_channel->pending += *bytes_read;
+		mux_channel->pending_len -= *bytes_read;
+
+		return G_IO_STATUS_NORMAL;
+	}
+
+	avail = ring_buffer_len_no_wrap(mux_channel->buffer);
 
 	if (avail > count)
 		avail = count;
 
 	*bytes_read = ring_buffer_read(mux_channel->buffer, buf, avail);
+	mux_channel->stats.rx_queued = ring_buffer_len(mux_channel->buffer);
 
 	if (*bytes_read == 0)
 		return G_IO_STATUS_AGAIN;
@@ -511,6 +662,21 @@ static GIOStatus channel_write(GIOChannel *channel, const gchar *buf,
 {
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 	GAtMux *mux = mux_channel->mux;
+	guint frames;
+
+	/* Within a turn at the writer, only send what the turn allows */
+	if (mux->frame_size > 0) {
+		if (mux_channel->credits > 0)
+			count = MIN(count, (gsize) mux_channel->credits *
+							mux->frame_size);
+
+		frames = (count + mux->frame_size - 1) / mux->frame_size;
+	} else
+		frames = count > 0 ? 1 : 0;
+
+	mux_channel->credits -= MIN(mux_channel->credits, frames);
+	mux_channel->stats.tx_frames += frames;
+	mux_channel->stats.tx_bytes += count;
 
 	if (mux->driver->write)
 		mux->driver->write(mux, mux_channel->dlc, buf, count);
@@ -618,6 +784,7 @@ GAtMux *g_at_mux_new(GIOChannel *channel, const GAtMuxDriver *driver)
 	mux->ref_count = 1;
 	mux->driver = driver;
 	mux->shutdown = TRUE;
+	mux->write_quantum = DEFAULT_WRITE_QUANTUM;
 
 	mux->channel = channel;
 	g_io_channel_ref(channel);
@@ -767,6 +934,8 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	mux_channel->dlc = i+1;
 	mux_channel->buffer = ring_buffer_new(MUX_CHANNEL_BUFFER_SIZE);
 	mux_channel->throttled = FALSE;
+	mux_channel->priority = DEFAULT_PRIORITY;
+	mux_channel->stats.priority = DEFAULT_PRIORITY;
 
 	mux->dlcs[i] = mux_channel;
 
@@ -775,6 +944,56 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	return channel;
 }
 
+static GAtMuxChannel *mux_channel_get(GAtMux *mux, GIOChannel *channel)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (mux == NULL || channel == NULL || channel->funcs != &channel_funcs)
+		return NULL;
+
+	if (mux_channel->mux != mux)
+		return NULL;
+
+	return mux_channel;
+}
+
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					guint8 priority)
+{
+	GAtMuxChannel *mux_channel = mux_channel_get(mux, channel);
+
+	if (mux_channel == NULL || priority == 0)
+		return FALSE;
+
+	mux_channel->priority = priority;
+	mux_channel->stats.priority = priority;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_set_write_quantum(GAtMux *mux, guint frames)
+{
+	if (mux == NULL || frames == 0)
+		return FALSE;
+
+	mux->write_quantum = frames;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_get_channel_stats(GAtMux *mux, GIOChannel *channel,
+					GAtMuxChannelStats *stats)
+{
+	GAtMuxChannel *mux_channel = mux_channel_get(mux, channel);
+
+	if (mux_channel == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = mux_channel->stats;
+
+	return TRUE;
+}
+
 static void msd_free(gpointer user_data)
 {
 	struct mux_setup_data *msd = user_data;
@@ -1171,6 +1390,7 @@ GAtMux *g_at_mux_new_gsm0710_basic(GIOChannel *channel, int frame_size)
 
 	gd = g_new0(struct gsm0710_data, 1);
 	gd->frame_size = frame_size;
+	mux->frame_size = frame_size;
 
 	g_at_mux_set_data(mux, gd);
 
@@ -1326,6 +1546,7 @@ GAtMux *g_at_mux_new_gsm0710_advanced(GIOChannel *channel, int frame_size)
 
 	gd = g_new0(struct gsm0710_data, 1);
 	gd->frame_size = frame_size;
+	mux->frame_size = frame_size;
 
 	g_at_mux_set_data(mux, gd);
 
@@ -36,13 +36,29 @@ typedef struct _GAtMuxDriver GAtMuxDriver;
 typedef enum _GAtMuxChannelStatus GAtMuxChannelStatus;
 typedef void (*GAtMuxSetupFunc)(GAtMux *mux, gpointer user_data);
 
+/* V.24 signals octet of the GSM 07.10 modem status command */
 enum _GAtMuxDlcStatus {
-	G_AT_MUX_DLC_STATUS_RTC = 0x02,
-	G_AT_MUX_DLC_STATUS_RTR = 0x04,
-	G_AT_MUX_DLC_STATUS_IC = 0x08,
+	G_AT_MUX_DLC_STATUS_FC = 0x02,
+	G_AT_MUX_DLC_STATUS_RTC = 0x04,
+	G_AT_MUX_DLC_STATUS_RTR = 0x08,
+	G_AT_MUX_DLC_STATUS_IC = 0x40,
 	G_AT_MUX_DLC_STATUS_DV = 0x80,
 };
 
+struct _GAtMuxChannelStats {
+	guint8 priority;
+	gboolean throttled;
+	gsize rx_queued;	/* Bytes waiting for the channel's readers */
+	gsize rx_queued_max;
+	gulong rx_frames;
+	gulong rx_bytes;
+	gulong tx_frames;
+	gulong tx_bytes;
+	gulong tx_deferred;	/* Turns lost to the write quantum running out */
+};
+
+typedef struct _GAtMuxChannelStats GAtMuxChannelStats;
+
 struct _GAtMuxDriver {
 	void (*remove)(GAtMux *mux);
 	gboolean (*startup)(GAtMux *mux);
@@ -71,6 +87,18 @@ gboolean g_at_mux_set_debug(GAtMux *mux, GAtDebugFunc func, gpointer user_data);
 
 GIOChannel *g_at_mux_create_channel(GAtMux *mux);
 
+/*!
+ * Each time the multiplexer can write, it hands out up to frames frames
+ * to the channels waiting to write, in turns of up to the channel's
+ * priority frames.  Channels of higher priority get the first turns.
+ */
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					guint8 priority);
+gboolean g_at_mux_set_write_quantum(GAtMux *mux, guint frames);
+
+gboolean g_at_mux_get_channel_stats(GAtMux *mux, GIOChannel *channel,
+					GAtMuxChannelStats *stats);
+
 /*!
  * Multiplexer driver integration functions
  */
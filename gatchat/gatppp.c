@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <termios.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
@@ -46,6 +47,7 @@
 #define PPP_CTRL	0x03
 
 #define GUARD_TIMEOUTS 1500
+#define DTR_DROP_TIME 100
 
 enum ppp_phase {
 	PPP_PHASE_DEAD = 0,		/* Link dead */
@@ -83,8 +85,19 @@ struct _GAtPPP {
 	int fd;
 	guint guard_timeout_source;
 	gboolean suspended;
+	GAtPPPEscapeMethod escape_method;
+	gboolean dtr_dropped;
 	gboolean xmit_acfc;
 	gboolean xmit_pfc;
+	guint keepalive_interval;
+	guint keepalive_retry;
+	guint keepalive_max_failures;
+	guint keepalive_source;
+	gulong keepalive_rx_frames;	/* Frames received at the last check */
+	guint8 echo_identifier;
+	guint echo_outstanding;		/* Unanswered since the peer was heard */
+	gint64 echo_sent_time;
+	GAtPPPKeepaliveStats keepalive_stats;
 };
 
 void ppp_debug(GAtPPP *ppp, const char *str)
@@ -354,11 +367,123 @@ void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
 		ppp_send_acfc_frame(ppp, packet, infolen);
 }
 
+static gboolean keepalive_timeout(gpointer user_data);
+
+static void keepalive_stop(GAtPPP *ppp)
+{
+	if (ppp->keepalive_source == 0)
+		return;
+
+	g_source_remove(ppp->keepalive_source);
+	ppp->keepalive_source = 0;
+}
+
+static void keepalive_schedule(GAtPPP *ppp, guint seconds)
+{
+	keepalive_stop(ppp);
+	ppp->keepalive_source = g_timeout_add_seconds(seconds,
+						keepalive_timeout, ppp);
+}
+
+static void keepalive_start(GAtPPP *ppp)
+{
+	GAtHDLCStats stats;
+
+	keepalive_stop(ppp);
+
+	if (ppp->keepalive_interval == 0 || ppp->phase != PPP_PHASE_LINK_UP ||
+			ppp->suspended)
+		return;
+
+	g_at_hdlc_get_stats(ppp->hdlc, &stats);
+	ppp->keepalive_rx_frames = stats.rx_frames;
+	ppp->echo_outstanding = 0;
+
+	keepalive_schedule(ppp, ppp->keepalive_interval);
+}
+
+static gboolean keepalive_timeout(gpointer user_data)
+{
+	GAtPPP *ppp = user_data;
+	GAtHDLCStats stats;
+
+	ppp->keepalive_source = 0;
+
+	g_at_hdlc_get_stats(ppp->hdlc, &stats);
+
+	/*
+	 * Any frame from the peer shows it is alive, so a busy link never
+	 * needs to be probed
+	 */
+	if (stats.rx_frames != ppp->keepalive_rx_frames) {
+		ppp->keepalive_rx_frames = stats.rx_frames;
+		ppp->echo_outstanding = 0;
+		ppp->keepalive_stats.suppressed += 1;
+		keepalive_schedule(ppp, ppp->keepalive_interval);
+		return FALSE;
+	}
+
+	if (ppp->echo_outstanding > 0)
+		ppp->keepalive_stats.echo_timeouts += 1;
+
+	if (ppp->echo_outstanding >= ppp->keepalive_max_failures) {
+		DBG(ppp, "%u Echo-Requests unanswered, link dead",
+						ppp->echo_outstanding);
+		ppp->disconnect_reason = G_AT_PPP_REASON_LINK_DEAD;
+		pppcp_signal_down(ppp->lcp);
+		pppcp_signal_close(ppp->lcp);
+		return FALSE;
+	}
+
+	ppp->echo_identifier += 1;
+
+	if (pppcp_send_echo_request(ppp->lcp, ppp->echo_identifier)) {
+		ppp->echo_outstanding += 1;
+		ppp->echo_sent_time = g_get_monotonic_time();
+		ppp->keepalive_stats.echo_requests += 1;
+	}
+
+	keepalive_schedule(ppp, ppp->keepalive_retry);
+
+	return FALSE;
+}
+
+void ppp_lcp_echo_reply_notify(GAtPPP *ppp, guint8 identifier)
+{
+	GAtHDLCStats stats;
+	guint rtt;
+
+	if (ppp->echo_outstanding == 0 || ppp->keepalive_source == 0)
+		return;
+
+	ppp->keepalive_stats.echo_replies += 1;
+
+	if (identifier == ppp->echo_identifier) {
+		rtt = (g_get_monotonic_time() - ppp->echo_sent_time) / 1000;
+
+		ppp->keepalive_stats.rtt_last = rtt;
+		if (rtt > ppp->keepalive_stats.rtt_max)
+			ppp->keepalive_stats.rtt_max = rtt;
+	}
+
+	/* The reply itself is not traffic, start a quiet interval over */
+	g_at_hdlc_get_stats(ppp->hdlc, &stats);
+	ppp->keepalive_rx_frames = stats.rx_frames;
+	ppp->echo_outstanding = 0;
+
+	keepalive_schedule(ppp, ppp->keepalive_interval);
+}
+
 static inline void ppp_enter_phase(GAtPPP *ppp, enum ppp_phase phase)
 {
 	DBG(ppp, "%d", phase);
 	ppp->phase = phase;
 
+	if (phase == PPP_PHASE_LINK_UP)
+		keepalive_start(ppp);
+	else
+		keepalive_stop(ppp);
+
 	if (phase == PPP_PHASE_DEAD && ppp->sta_pending == FALSE)
 		ppp->ppp_dead_source = g_idle_add(ppp_dead, ppp);
 }
@@ -535,6 +660,7 @@ static void ppp_proxy_suspend_net_interface(gpointer user_data)
 	GAtPPP *ppp = user_data;
 
 	ppp->suspended = TRUE;
+	keepalive_stop(ppp);
 	ppp_net_suspend_interface(ppp->net);
 
 	if (ppp->suspend_func)
@@ -637,6 +763,38 @@ void g_at_ppp_set_recording(GAtPPP *ppp, const char *filename)
 	g_at_hdlc_set_recording(ppp->hdlc, filename);
 }
 
+gboolean g_at_ppp_get_stats(GAtPPP *ppp, GAtHDLCStats *stats)
+{
+	if (ppp == NULL)
+		return FALSE;
+
+	return g_at_hdlc_get_stats(ppp->hdlc, stats);
+}
+
+void g_at_ppp_set_keepalive(GAtPPP *ppp, guint interval, guint retry,
+					guint max_failures)
+{
+	if (ppp == NULL)
+		return;
+
+	ppp->keepalive_interval = interval;
+	ppp->keepalive_retry = retry ? retry : 1;
+	ppp->keepalive_max_failures = max_failures ? max_failures : 1;
+
+	keepalive_start(ppp);
+}
+
+gboolean g_at_ppp_get_keepalive_stats(GAtPPP *ppp,
+					GAtPPPKeepaliveStats *stats)
+{
+	if (ppp == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = ppp->keepalive_stats;
+
+	return TRUE;
+}
+
 void g_at_ppp_set_connect_function(GAtPPP *ppp, GAtPPPConnectFunc func,
 							gpointer user_data)
 {
@@ -713,14 +871,54 @@ static gboolean send_escape_sequence(gpointer user_data)
 	return FALSE;
 }
 
+static gboolean set_dtr(GAtPPP *ppp, gboolean on)
+{
+	GIOChannel *channel = g_at_io_get_channel(g_at_hdlc_get_io(ppp->hdlc));
+	int bits = TIOCM_DTR;
+
+	if (channel == NULL)
+		return FALSE;
+
+	if (ioctl(g_io_channel_unix_get_fd(channel),
+				on ? TIOCMBIS : TIOCMBIC, &bits) < 0)
+		return FALSE;
+
+	ppp->dtr_dropped = !on;
+
+	return TRUE;
+}
+
+static gboolean raise_dtr(gpointer user_data)
+{
+	GAtPPP *ppp = user_data;
+
+	if (set_dtr(ppp, TRUE) == FALSE)
+		DBG(ppp, "Unable to raise DTR");
+
+	return call_suspend_cb(ppp);
+}
+
 void g_at_ppp_suspend(GAtPPP *ppp)
 {
 	if (ppp == NULL)
 		return;
 
 	ppp->suspended = TRUE;
+	keepalive_stop(ppp);
 	ppp_net_suspend_interface(ppp->net);
 	g_at_hdlc_suspend(ppp->hdlc);
+
+	/* A modem set to AT&D1 goes to command mode as soon as DTR drops */
+	if (ppp->escape_method == G_AT_PPP_ESCAPE_DTR) {
+		if (set_dtr(ppp, FALSE)) {
+			ppp->guard_timeout_source = g_timeout_add(DTR_DROP_TIME,
+								raise_dtr, ppp);
+			return;
+		}
+
+		DBG(ppp, "Unable to drop DTR, using the escape sequence");
+	}
+
 	ppp->guard_timeout_source = g_timeout_add(GUARD_TIMEOUTS,
 						send_escape_sequence, ppp);
 }
@@ -740,6 +938,7 @@ void g_at_ppp_resume(GAtPPP *ppp)
 							io_disconnect, ppp);
 	ppp_net_resume_interface(ppp->net);
 	g_at_hdlc_resume(ppp->hdlc);
+	keepalive_start(ppp);
 }
 
 void g_at_ppp_ref(GAtPPP *ppp)
@@ -787,6 +986,11 @@ void g_at_ppp_unref(GAtPPP *ppp)
 		ppp->guard_timeout_source = 0;
 	}
 
+	if (ppp->dtr_dropped)
+		set_dtr(ppp, TRUE);
+
+	keepalive_stop(ppp);
+
 	g_at_hdlc_unref(ppp->hdlc);
 
 	g_free(ppp);
@@ -806,6 +1010,14 @@ void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote,
 	ipcp_set_server_info(ppp->ipcp, r, d1, d2);
 }
 
+void g_at_ppp_set_escape_method(GAtPPP *ppp, GAtPPPEscapeMethod method)
+{
+	if (ppp == NULL)
+		return;
+
+	ppp->escape_method = method;
+}
+
 void g_at_ppp_set_accm(GAtPPP *ppp, guint32 accm)
 {
 	lcp_set_accm(ppp->lcp, accm);
@@ -853,6 +1065,16 @@ GAtPPP *g_at_ppp_new(void)
 	return ppp_init_common(FALSE, 0);
 }
 
+GAtPPP *g_at_ppp_new_full(int fd)
+{
+	GAtPPP *ppp = ppp_init_common(FALSE, 0);
+
+	if (ppp != NULL)
+		ppp->fd = fd;
+
+	return ppp;
+}
+
 GAtPPP *g_at_ppp_server_new_full(const char *local, int fd)
 {
 	GAtPPP *ppp;
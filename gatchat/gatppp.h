@@ -43,12 +43,28 @@ typedef enum _GAtPPPDisconnectReason {
 	G_AT_PPP_REASON_LOCAL_CLOSE,	/* Normal user close */
 } GAtPPPDisconnectReason;
 
+typedef enum _GAtPPPEscapeMethod {
+	G_AT_PPP_ESCAPE_GUARD_TIME,	/* '+++' between guard times */
+	G_AT_PPP_ESCAPE_DTR,		/* DTR drop, for modems set to AT&D1 */
+} GAtPPPEscapeMethod;
+
 typedef enum _GAtPPPAuthMethod {
 	G_AT_PPP_AUTH_METHOD_CHAP,
 	G_AT_PPP_AUTH_METHOD_PAP,
 	G_AT_PPP_AUTH_METHOD_NONE,
 } GAtPPPAuthMethod;
 
+struct _GAtPPPKeepaliveStats {
+	gulong echo_requests;
+	gulong echo_replies;
+	gulong echo_timeouts;	/* Echo-Requests left unanswered */
+	gulong suppressed;	/* Probes skipped as frames were received */
+	guint rtt_last;		/* Milliseconds to the last Echo-Reply */
+	guint rtt_max;
+};
+
+typedef struct _GAtPPPKeepaliveStats GAtPPPKeepaliveStats;
+
 typedef void (*GAtPPPConnectFunc)(const char *iface, const char *local,
 					const char *peer,
 					const char *dns1, const char *dns2,
@@ -57,6 +73,7 @@ typedef void (*GAtPPPDisconnectFunc)(GAtPPPDisconnectReason reason,
 					gpointer user_data);
 
 GAtPPP *g_at_ppp_new(void);
+GAtPPP *g_at_ppp_new_full(int fd);
 GAtPPP *g_at_ppp_server_new(const char *local);
 GAtPPP *g_at_ppp_server_new_full(const char *local, int fd);
 
@@ -85,9 +102,33 @@ GAtPPPAuthMethod g_at_ppp_get_auth_method(GAtPPP *ppp);
 
 void g_at_ppp_set_recording(GAtPPP *ppp, const char *filename);
 
+/*!
+ * Counts all the frames on the link, those of LCP and IPCP included
+ */
+gboolean g_at_ppp_get_stats(GAtPPP *ppp, GAtHDLCStats *stats);
+
+/*!
+ * Once the link is up, sends an LCP Echo-Request whenever nothing was
+ * received from the peer for interval seconds, and every retry seconds
+ * while they go unanswered.  After max_failures unanswered requests the
+ * link is taken down with G_AT_PPP_REASON_LINK_DEAD.  An interval of 0,
+ * the default, turns the keepalive off.
+ */
+void g_at_ppp_set_keepalive(GAtPPP *ppp, guint interval, guint retry,
+					guint max_failures);
+gboolean g_at_ppp_get_keepalive_stats(GAtPPP *ppp,
+					GAtPPPKeepaliveStats *stats);
+
 void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote_ip,
 				const char *dns1, const char *dns2);
 
+/*!
+ * Sets how g_at_ppp_suspend returns the modem to command mode.  Dropping
+ * DTR avoids the guard times around '+++', about three seconds, and
+ * falls back to them when the IO is not a TTY.
+ */
+void g_at_ppp_set_escape_method(GAtPPP *ppp, GAtPPPEscapeMethod method);
+
 void g_at_ppp_set_accm(GAtPPP *ppp, guint32 accm);
 void g_at_ppp_set_acfc_enabled(GAtPPP *ppp, gboolean enabled);
 void g_at_ppp_set_pfc_enabled(GAtPPP *ppp, gboolean enabled);
@@ -27,14 +27,22 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <net/if.h>
 #include <linux/if_tun.h>
 
 #include <glib.h>
 
 #include "ringbuffer.h"
+#include "gatutil.h"
 #include "gatrawip.h"
 
+/* Packets moved per wakeup in each direction */
+#define MAX_BATCH 16
+
+/* Largest packet read from the tun device */
+#define TUN_READ_SIZE 2048
+
 struct _GAtRawIP {
 	gint ref_count;
 	GAtIO *io;
@@ -109,20 +117,29 @@ void g_at_rawip_unref(GAtRawIP *rawip)
 	g_free(rawip);
 }
 
+static int write_ring_buffer(GAtIO *io, struct ring_buffer *rbuf,
+				unsigned int len)
+{
+	struct iovec iov[2];
+
+	iov[0].iov_base = ring_buffer_read_ptr(rbuf, 0);
+	iov[0].iov_len = MIN(len, (unsigned int) ring_buffer_len_no_wrap(rbuf));
+	iov[1].iov_base = ring_buffer_read_ptr(rbuf, iov[0].iov_len);
+	iov[1].iov_len = len - iov[0].iov_len;
+
+	return g_at_io_writev(io, iov, iov[1].iov_len ? 2 : 1);
+}
+
 static gboolean can_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
-	unsigned int len;
-	unsigned char *buf;
 	gsize bytes_written;
 
 	if (rawip->write_buffer == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->write_buffer);
-	buf = ring_buffer_read_ptr(rawip->write_buffer, 0);
-
-	bytes_written = g_at_io_write(rawip->io, (gchar *) buf, len);
+	bytes_written = write_ring_buffer(rawip->io, rawip->write_buffer,
+					ring_buffer_len(rawip->write_buffer));
 	ring_buffer_drain(rawip->write_buffer, bytes_written);
 
 	if (ring_buffer_len(rawip->write_buffer) > 0)
@@ -133,23 +150,39 @@ static gboolean can_write_data(gpointer data)
 	return FALSE;
 }
 
+/*
+ * Each write to the tun device has to be a single packet, write out up
+ * to a batch of them, even when split across the ends of the buffer
+ */
 static gboolean tun_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
-	unsigned int len;
-	unsigned char *buf;
-	gsize bytes_written;
+	struct ring_buffer *rbuf = rawip->tun_write_buffer;
+	int count;
+	int len;
 
-	if (rawip->tun_write_buffer == NULL)
+	if (rbuf == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->tun_write_buffer);
-	buf = ring_buffer_read_ptr(rawip->tun_write_buffer, 0);
+	for (count = 0; count < MAX_BATCH; count++) {
+		len = g_at_util_ip_packet_len(rbuf);
+
+		/* Skip over whatever can't be an IP packet to resync */
+		if (len < 0) {
+			ring_buffer_drain(rbuf, 1);
+			continue;
+		}
 
-	bytes_written = g_at_io_write(rawip->tun_io, (gchar *) buf, len);
-	ring_buffer_drain(rawip->tun_write_buffer, bytes_written);
+		if (len == 0)
+			break;
 
-	if (ring_buffer_len(rawip->tun_write_buffer) > 0)
+		if (write_ring_buffer(rawip->tun_io, rbuf, len) == 0)
+			return TRUE;
+
+		ring_buffer_drain(rbuf, len);
+	}
+
+	if (count == MAX_BATCH && g_at_util_ip_packet_len(rbuf) != 0)
 		return TRUE;
 
 	rawip->tun_write_buffer = NULL;
@@ -163,7 +196,10 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 	rawip->tun_write_buffer = rbuf;
 
-	g_at_io_set_write_handler(rawip->tun_io, tun_write_data, rawip);
+	/* The tun device hardly ever pushes back, don't wait to write */
+	if (tun_write_data(rawip))
+		g_at_io_set_write_handler(rawip->tun_io, tun_write_data,
+						rawip);
 }
 
 static void tun_bytes(struct ring_buffer *rbuf, gpointer user_data)
@@ -203,9 +239,12 @@ static void create_tun(GAtRawIP *rawip)
 		return;
 	}
 
-	rawip->tun_io = g_at_io_new(channel);
+	rawip->tun_io = g_at_io_new_fd(channel);
 
 	g_io_channel_unref(channel);
+
+	g_at_io_set_read_policy(rawip->tun_io, MAX_BATCH, TUN_READ_SIZE);
+	g_at_io_set_packet_reads(rawip->tun_io, TRUE);
 }
 
 void g_at_rawip_open(GAtRawIP *rawip)
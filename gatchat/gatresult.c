@@ -24,7 +24,6 @@
 #endif
 
 #include <string.h>
-#include <stdio.h>
 
 #include <glib.h>
 
@@ -206,14 +205,22 @@ out:
 	return TRUE;
 }
 
-gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
-		const guint8 **str, gint *length)
+static void decode_hex(const char *in, unsigned int len, guint8 *out)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i += 2)
+		*out++ = g_ascii_xdigit_value(in[i]) << 4 |
+				g_ascii_xdigit_value(in[i + 1]);
+}
+
+static gboolean next_hexstring(GAtResultIter *iter, guint8 *buf, gint size,
+				const guint8 **str, gint *length)
 {
 	unsigned int pos;
 	unsigned int end;
 	unsigned int len;
 	char *line;
-	char *bufpos;
 
 	if (iter == NULL)
 		return FALSE;
@@ -225,12 +232,14 @@ gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
 	len = strlen(line);
 
 	pos = iter->line_pos;
-	bufpos = iter->buf + pos;
+
+	/* By default decode into the iterator, any line fits in there */
+	if (buf == NULL)
+		buf = (guint8 *) iter->buf + pos;
 
 	/* Omitted string */
 	if (line[pos] == ',') {
 		end = pos;
-		iter->buf[pos] = '\0';
 		*length = 0;
 		goto out;
 	}
@@ -246,10 +255,11 @@ gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
 	if ((end - pos) & 1)
 		return FALSE;
 
-	*length = (end - pos) / 2;
+	if (size >= 0 && (end - pos) / 2 > (unsigned int) size)
+		return FALSE;
 
-	for (; pos < end; pos += 2)
-		sscanf(line + pos, "%02hhx", bufpos++);
+	*length = (end - pos) / 2;
+	decode_hex(line + pos, end - pos, buf);
 
 	if (line[end] == '"')
 		end += 1;
@@ -258,11 +268,27 @@ out:
 	iter->line_pos = skip_to_next_field(line, end, len);
 
 	if (str)
-		*str = (guint8 *) bufpos - *length;
+		*str = buf;
 
 	return TRUE;
 }
 
+gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
+		const guint8 **str, gint *length)
+{
+	return next_hexstring(iter, NULL, -1, str, length);
+}
+
+gboolean g_at_result_iter_next_hexstring_buf(GAtResultIter *iter,
+						guint8 *buf, gint size,
+						gint *length)
+{
+	if (buf == NULL)
+		return FALSE;
+
+	return next_hexstring(iter, buf, size, NULL, length);
+}
+
 gboolean g_at_result_iter_next_number(GAtResultIter *iter, gint *number)
 {
 	int pos;
@@ -64,6 +64,9 @@ gboolean g_at_result_iter_next_number_default(GAtResultIter *iter, gint dflt,
 						gint *number);
 gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
 		const guint8 **str, gint *length);
+gboolean g_at_result_iter_next_hexstring_buf(GAtResultIter *iter,
+						guint8 *buf, gint size,
+						gint *length);
 
 const char *g_at_result_iter_raw_line(GAtResultIter *iter);
 
@@ -106,6 +106,15 @@ struct at_command {
 	GDestroyNotify destroy_notify;
 };
 
+/*
+ * The registered prefixes are compiled into a collision free open hash
+ * table, so that each lookup costs a single hash and string comparison
+ */
+struct command_slot {
+	const char *prefix;
+	struct at_command *node;
+};
+
 struct _GAtServer {
 	gint ref_count;				/* Ref count */
 	struct v250_settings v250;		/* V.250 command setting */
@@ -116,6 +125,10 @@ struct _GAtServer {
 	GAtDebugFunc debugf;			/* Debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
 	GHashTable *command_list;		/* List of AT commands */
+	struct command_slot *command_slots;	/* Compiled command_list */
+	guint command_slots_mask;		/* Number of slots - 1 */
+	guint32 command_seed;			/* Seed making it collision free */
+	gboolean command_slots_dirty;		/* command_list has changed */
 	GQueue *write_queue;			/* Write buffer queue */
 	guint max_read_attempts;		/* Max reads per select */
 	enum ParserState parser_state;
@@ -145,7 +158,7 @@ static struct ring_buffer *allocate_next(GAtServer *server)
 	return buf;
 }
 
-static void send_common(GAtServer *server, const char *buf, unsigned int len)
+static void write_common(GAtServer *server, const char *buf, unsigned int len)
 {
 	gsize towrite = len;
 	gsize bytes_written = 0;
@@ -169,7 +182,11 @@ static void send_common(GAtServer *server, const char *buf, unsigned int len)
 				bytes_written < towrite)
 			write_buf = allocate_next(server);
 	}
+}
 
+static void send_common(GAtServer *server, const char *buf, unsigned int len)
+{
+	write_common(server, buf, len);
 	server_wakeup_writer(server);
 }
 
@@ -260,20 +277,25 @@ void g_at_server_send_unsolicited(GAtServer *server, const char *result)
 
 void g_at_server_send_info(GAtServer *server, const char *line, gboolean last)
 {
-	char buf[MAX_TEXT_SIZE + 1];
-	char t = server->v250.s3;
-	char r = server->v250.s4;
-	unsigned int len;
+	g_at_server_send_info_len(server, line, strlen(line), last);
+}
 
-	if (strlen(line) > 2048)
+void g_at_server_send_info_len(GAtServer *server, const char *line,
+					gsize len, gboolean last)
+{
+	const char crlf[2] = { server->v250.s3, server->v250.s4 };
+
+	if (len > 2048)
 		return;
 
+	/* Straight into the write buffer, no intermediate copy */
+	write_common(server, crlf, sizeof(crlf));
+	write_common(server, line, len);
+
 	if (last)
-		len = sprintf(buf, "%c%c%s%c%c", t, r, line, t, r);
-	else
-		len = sprintf(buf, "%c%c%s", t, r, line);
+		write_common(server, crlf, sizeof(crlf));
 
-	send_common(server, buf, len);
+	server_wakeup_writer(server);
 }
 
 static gboolean get_result_value(GAtServer *server, GAtResult *result,
@@ -585,25 +607,111 @@ static inline gboolean is_extended_command_prefix(const char c)
 	}
 }
 
+static guint32 command_hash(const char *prefix, guint32 seed)
+{
+	guint32 h = 2166136261u ^ seed;
+
+	while (*prefix) {
+		h ^= (unsigned char) *prefix++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static gboolean command_slots_fill(GAtServer *server, guint size,
+					guint32 seed)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	memset(server->command_slots, 0, size * sizeof(struct command_slot));
+	g_hash_table_iter_init(&iter, server->command_list);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct command_slot *slot = &server->command_slots[
+					command_hash(key, seed) & (size - 1)];
+
+		if (slot->prefix)
+			return FALSE;
+
+		slot->prefix = key;
+		slot->node = value;
+	}
+
+	return TRUE;
+}
+
+static void command_slots_compile(GAtServer *server)
+{
+	guint count = g_hash_table_size(server->command_list);
+	guint size = 16;
+	guint32 seed;
+
+	server->command_slots_dirty = FALSE;
+
+	while (size < count * 2)
+		size <<= 1;
+
+	/* A handful of seeds is usually enough at this load factor */
+	for (; size <= 4096; size <<= 1) {
+		server->command_slots = g_renew(struct command_slot,
+						server->command_slots, size);
+
+		for (seed = 0; seed < 64; seed++) {
+			if (!command_slots_fill(server, size, seed))
+				continue;
+
+			server->command_slots_mask = size - 1;
+			server->command_seed = seed;
+			return;
+		}
+	}
+
+	/* Fall back to the hash table lookup */
+	g_free(server->command_slots);
+	server->command_slots = NULL;
+}
+
+static struct at_command *command_lookup(GAtServer *server,
+						const char *prefix)
+{
+	struct command_slot *slot;
+
+	if (server->command_slots_dirty)
+		command_slots_compile(server);
+
+	if (server->command_slots == NULL)
+		return g_hash_table_lookup(server->command_list, prefix);
+
+	slot = &server->command_slots[command_hash(prefix,
+						server->command_seed) &
+						server->command_slots_mask];
+
+	if (slot->prefix == NULL || strcmp(slot->prefix, prefix))
+		return NULL;
+
+	return slot->node;
+}
+
 static void at_command_notify(GAtServer *server, char *command,
 				char *prefix, GAtServerRequestType type)
 {
 	struct at_command *node;
 	GAtResult result;
+	GSList line = { command, NULL };
 
-	node = g_hash_table_lookup(server->command_list, prefix);
+	node = command_lookup(server, prefix);
 
 	if (node == NULL) {
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
 		return;
 	}
 
-	result.lines = g_slist_prepend(NULL, command);
+	result.lines = &line;
 	result.final_or_pdu = 0;
 
 	node->notify(server, type, &result, node->user_data);
-
-	g_slist_free(result.lines);
 }
 
 static unsigned int parse_extended_command(GAtServer *server, char *buf)
@@ -979,6 +1087,7 @@ static char *extract_line(GAtServer *p, struct ring_buffer *rbuf)
 
 	pos = 0;
 	i = 0;
+	in_string = FALSE;
 	wrap = ring_buffer_len_no_wrap(rbuf);
 	buf = ring_buffer_read_ptr(rbuf, pos);
 
@@ -1183,6 +1292,9 @@ static void g_at_server_cleanup(GAtServer *server)
 	g_hash_table_destroy(server->command_list);
 	server->command_list = NULL;
 
+	g_free(server->command_slots);
+	server->command_slots = NULL;
+
 	g_free(server->last_line);
 
 	g_at_io_unref(server->io);
@@ -1451,6 +1563,7 @@ gboolean g_at_server_register(GAtServer *server, const char *prefix,
 	node->destroy_notify = destroy_notify;
 
 	g_hash_table_replace(server->command_list, g_strdup(prefix), node);
+	server->command_slots_dirty = TRUE;
 
 	return TRUE;
 }
@@ -1470,6 +1583,7 @@ gboolean g_at_server_unregister(GAtServer *server, const char *prefix)
 		return FALSE;
 
 	g_hash_table_remove(server->command_list, prefix);
+	server->command_slots_dirty = TRUE;
 
 	return TRUE;
 }
@@ -117,6 +117,13 @@ void g_at_server_send_unsolicited(GAtServer *server, const char *result);
  */
 void g_at_server_send_info(GAtServer *server, const char *line, gboolean last);
 
+/*
+ * Same as g_at_server_send_info, for a line of known length that need not
+ * be NUL terminated, e.g. a response template kept by the caller.
+ */
+void g_at_server_send_info_len(GAtServer *server, const char *line,
+					gsize len, gboolean last);
+
 gboolean g_at_server_set_finish_callback(GAtServer *server,
 						GAtServerFinishFunc finishf,
 						gpointer user_data);
@@ -23,6 +23,8 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <glib.h>
 
 #include "gatsyntax.h"
@@ -59,6 +61,83 @@ enum GSM_PERMISSIVE_STATE {
 	GSM_PERMISSIVE_STATE_SHORT_PROMPT,
 };
 
+/*
+ * Inside a response, a string or a PDU only a couple of delimiters can make
+ * the state machines below change state.  Instead of going around the state
+ * machine for every byte, skip ahead to the next delimiter.  Single
+ * delimiters are left to memchr, which is usually vectorized by the C
+ * library, pairs of them are searched for a machine word at a time.
+ */
+#define WORD_ONES	(~0UL / 0xff)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+#define WORD_HAS_ZERO(v)	(((v) - WORD_ONES) & ~(v) & WORD_HIGHS)
+
+static gsize skip_until(const char *bytes, gsize len, char a)
+{
+	const char *p = memchr(bytes, a, len);
+
+	if (p == NULL)
+		return len;
+
+	return p - bytes;
+}
+
+static gsize skip_until_either(const char *bytes, gsize len, char a, char b)
+{
+	unsigned long mask_a = WORD_ONES * (unsigned char) a;
+	unsigned long mask_b = WORD_ONES * (unsigned char) b;
+	gsize i = 0;
+
+	while (i + sizeof(unsigned long) <= len) {
+		unsigned long word;
+
+		memcpy(&word, bytes + i, sizeof(word));
+
+		if (WORD_HAS_ZERO(word ^ mask_a) ||
+				WORD_HAS_ZERO(word ^ mask_b))
+			break;
+
+		i += sizeof(word);
+	}
+
+	while (i < len && bytes[i] != a && bytes[i] != b)
+		i += 1;
+
+	return i;
+}
+
+static gsize gsmv1_skip(int state, const char *bytes, gsize len)
+{
+	switch (state) {
+	case GSMV1_STATE_RESPONSE:
+		return skip_until_either(bytes, len, '\r', '"');
+	case GSMV1_STATE_RESPONSE_STRING:
+		return skip_until(bytes, len, '"');
+	case GSMV1_STATE_MULTILINE_RESPONSE:
+	case GSMV1_STATE_PDU:
+		return skip_until(bytes, len, '\r');
+	case GSMV1_STATE_ECHO:
+		return skip_until_either(bytes, len, '\r', 26);
+	case GSMV1_STATE_PPP_DATA:
+		return skip_until(bytes, len, '~');
+	default:
+		return 0;
+	}
+}
+
+static gsize gsm_permissive_skip(int state, const char *bytes, gsize len)
+{
+	switch (state) {
+	case GSM_PERMISSIVE_STATE_RESPONSE:
+	case GSM_PERMISSIVE_STATE_RESPONSE_STRING:
+		return skip_until_either(bytes, len, '\r', '"');
+	case GSM_PERMISSIVE_STATE_PDU:
+		return skip_until(bytes, len, '\r');
+	default:
+		return 0;
+	}
+}
+
 static void gsmv1_hint(GAtSyntax *syntax, GAtSyntaxExpectHint hint)
 {
 	switch (hint) {
@@ -83,7 +162,13 @@ static GAtSyntaxResult gsmv1_feed(GAtSyntax *syntax,
 	GAtSyntaxResult res = G_AT_SYNTAX_RESULT_UNSURE;
 
 	while (i < *len) {
-		char byte = bytes[i];
+		char byte;
+
+		i += gsmv1_skip(syntax->state, bytes + i, *len - i);
+		if (i == *len)
+			break;
+
+		byte = bytes[i];
 
 		switch (syntax->state) {
 		case GSMV1_STATE_IDLE:
@@ -279,7 +364,13 @@ static GAtSyntaxResult gsm_permissive_feed(GAtSyntax *syntax,
 	GAtSyntaxResult res = G_AT_SYNTAX_RESULT_UNSURE;
 
 	while (i < *len) {
-		char byte = bytes[i];
+		char byte;
+
+		i += gsm_permissive_skip(syntax->state, bytes + i, *len - i);
+		if (i == *len)
+			break;
+
+		byte = bytes[i];
 
 		switch (syntax->state) {
 		case GSM_PERMISSIVE_STATE_IDLE:
@@ -29,6 +29,7 @@
 
 #include <glib.h>
 
+#include "ringbuffer.h"
 #include "gatutil.h"
 
 void g_at_util_debug_chat(gboolean in, const char *str, gsize len,
@@ -197,3 +198,40 @@ gboolean g_at_util_setup_io(GIOChannel *io, GIOFlags flags)
 
 	return TRUE;
 }
+
+/*
+ * A length the buffer could never hold is taken for garbage as well,
+ * waiting for the rest of such a packet would stall the link for good
+ */
+int g_at_util_ip_packet_len(struct ring_buffer *rbuf)
+{
+	unsigned int avail = ring_buffer_len(rbuf);
+	unsigned char hdr[6];
+	unsigned int len;
+	unsigned int i;
+
+	if (avail < sizeof(hdr))
+		return 0;
+
+	for (i = 0; i < sizeof(hdr); i++)
+		hdr[i] = *ring_buffer_read_ptr(rbuf, i);
+
+	switch (hdr[0] >> 4) {
+	case 4:
+		len = hdr[2] << 8 | hdr[3];
+
+		if (len < 20)
+			return -1;
+		break;
+	case 6:
+		len = 40 + (hdr[4] << 8 | hdr[5]);
+		break;
+	default:
+		return -1;
+	}
+
+	if (len > (unsigned int) ring_buffer_capacity(rbuf))
+		return -1;
+
+	return len <= avail ? (int) len : 0;
+}
@@ -39,6 +39,14 @@ void g_at_util_debug_hexdump(gboolean in, const unsigned char *buf, gsize len,
 
 gboolean g_at_util_setup_io(GIOChannel *io, GIOFlags flags);
 
+struct ring_buffer;
+
+/*
+ * Length of the IP packet at the head of the buffer, 0 if it isn't all
+ * there yet and -1 if the head of the buffer is not an IP packet
+ */
+int g_at_util_ip_packet_len(struct ring_buffer *rbuf);
+
 #ifdef __cplusplus
 }
 #endif
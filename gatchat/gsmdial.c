@@ -692,7 +692,7 @@ static GOptionEntry options[] = {
 	{ "password", 'w', 0, G_OPTION_ARG_STRING, &option_password,
 				"Specify PPP password" },
 	{ "pppdump", 'D', 0, G_OPTION_ARG_STRING, &option_pppdump,
-				"Specify pppdump filename" },
+				"Specify pppdump or *.pcapng filename" },
 	{ "pfc", 0, 0, G_OPTION_ARG_NONE, &option_pfc,
 				"Use Protocol Field Compression" },
 	{ "acfc", 0, 0, G_OPTION_ARG_NONE, &option_acfc,
@@ -0,0 +1,412 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <gatio.h>
+#include <gatppp.h>
+
+#define MAX_PACKET	1500
+#define IP_HEADER	20
+
+struct bench_config {
+	guint size;
+	guint32 accm;
+	gboolean acfc;
+	gboolean pfc;
+};
+
+struct bench {
+	const struct bench_config *config;
+	GMainLoop *loop;
+	GAtPPP *client;
+	GAtPPP *server;
+	int tx_sink;		/* Our end of the sending PPP's interface */
+	int rx_sink;		/* Our end of the receiving PPP's interface */
+	guint rx_watch;
+	guint stall_timer;
+	guint links_up;
+	guint sent;
+	guint received;
+	guint last_received;
+	guint target;
+	GArray *latency;
+	guint8 packet[MAX_PACKET];
+	gint64 start;
+	double cpu_start;
+	gboolean failed;
+};
+
+static gint option_size = 0;
+static gchar *option_accm = NULL;
+static gchar *option_compression = NULL;
+static gint option_count = 20000;
+static gint option_window = 8;
+static gboolean option_reverse = FALSE;
+static gboolean option_debug = FALSE;
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ppp_debug(const char *str, gpointer user_data)
+{
+	g_print("%s: %s\n", (const char *) user_data, str);
+}
+
+static void send_packet(struct bench *bench)
+{
+	guint32 seq = bench->sent;
+	gint64 now = g_get_monotonic_time();
+	guint16 len = htons(bench->config->size);
+
+	/* Just enough of an IPv4 header for ppp_net to find the length */
+	memcpy(bench->packet + 2, &len, sizeof(len));
+	memcpy(bench->packet + IP_HEADER, &seq, sizeof(seq));
+	memcpy(bench->packet + IP_HEADER + sizeof(seq), &now, sizeof(now));
+
+	if (send(bench->tx_sink, bench->packet, bench->config->size,
+				MSG_DONTWAIT) < 0)
+		return;
+
+	bench->sent += 1;
+}
+
+static gboolean received_packets(GIOChannel *channel, GIOCondition cond,
+					gpointer user_data)
+{
+	struct bench *bench = user_data;
+	guint8 buf[MAX_PACKET];
+	ssize_t n;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP)) {
+		bench->failed = TRUE;
+		g_main_loop_quit(bench->loop);
+		bench->rx_watch = 0;
+		return FALSE;
+	}
+
+	while ((n = recv(bench->rx_sink, buf, sizeof(buf),
+						MSG_DONTWAIT)) > 0) {
+		gint64 sent;
+		guint32 usec;
+
+		if ((guint) n != bench->config->size)
+			continue;
+
+		memcpy(&sent, buf + IP_HEADER + sizeof(guint32), sizeof(sent));
+		usec = g_get_monotonic_time() - sent;
+		g_array_append_val(bench->latency, usec);
+
+		bench->received += 1;
+
+		if (bench->received == bench->target) {
+			g_main_loop_quit(bench->loop);
+			break;
+		}
+
+		if (bench->sent < bench->target)
+			send_packet(bench);
+	}
+
+	return TRUE;
+}
+
+static gboolean stall_check(gpointer user_data)
+{
+	struct bench *bench = user_data;
+
+	if (bench->links_up == 2 && bench->received != bench->last_received) {
+		bench->last_received = bench->received;
+		return TRUE;
+	}
+
+	bench->failed = TRUE;
+	bench->stall_timer = 0;
+	g_main_loop_quit(bench->loop);
+
+	return FALSE;
+}
+
+static void ppp_connect(const char *iface, const char *local,
+			const char *peer, const char *dns1, const char *dns2,
+			gpointer user_data)
+{
+	struct bench *bench = user_data;
+	guint i;
+
+	if (option_debug)
+		g_print("%s up, %s -> %s\n", iface, local, peer);
+
+	if (++bench->links_up < 2)
+		return;
+
+	bench->start = g_get_monotonic_time();
+	bench->cpu_start = cpu_time();
+
+	for (i = 0; i < (guint) option_window && i < bench->target; i++)
+		send_packet(bench);
+}
+
+static void ppp_disconnect(GAtPPPDisconnectReason reason, gpointer user_data)
+{
+	struct bench *bench = user_data;
+
+	g_printerr("PPP link down: %d\n", reason);
+
+	bench->failed = TRUE;
+	g_main_loop_quit(bench->loop);
+}
+
+static GAtPPP *setup_ppp(struct bench *bench, GAtPPP *ppp, const char *name)
+{
+	if (option_debug)
+		g_at_ppp_set_debug(ppp, ppp_debug, (gpointer) name);
+
+	g_at_ppp_set_accm(ppp, bench->config->accm);
+	g_at_ppp_set_acfc_enabled(ppp, bench->config->acfc);
+	g_at_ppp_set_pfc_enabled(ppp, bench->config->pfc);
+	g_at_ppp_set_auth_method(ppp, G_AT_PPP_AUTH_METHOD_NONE);
+	g_at_ppp_set_connect_function(ppp, ppp_connect, bench);
+	g_at_ppp_set_disconnect_function(ppp, ppp_disconnect, bench);
+
+	return ppp;
+}
+
+static GAtIO *create_io(int fd)
+{
+	GIOChannel *channel = g_io_channel_unix_new(fd);
+	GAtIO *io;
+
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	io = g_at_io_new_fd(channel);
+	g_io_channel_unref(channel);
+
+	return io;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	guint32 la = *(const guint32 *) a;
+	guint32 lb = *(const guint32 *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static gboolean run_bench(const struct bench_config *config)
+{
+	struct bench bench;
+	int link[2], client_sink[2], server_sink[2];
+	GAtIO *client_io, *server_io;
+	GIOChannel *channel;
+	double elapsed, cpu;
+	guint32 *latency;
+	guint64 total = 0;
+	guint i;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.config = config;
+	bench.target = option_count;
+	bench.latency = g_array_sized_new(FALSE, FALSE, sizeof(guint32),
+						option_count);
+
+	for (i = IP_HEADER + 12; i < config->size; i++)
+		bench.packet[i] = g_random_int_range(0, 256);
+
+	bench.packet[0] = 0x45;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, link) < 0 ||
+			socketpair(AF_UNIX, SOCK_SEQPACKET, 0,
+					client_sink) < 0 ||
+			socketpair(AF_UNIX, SOCK_SEQPACKET, 0,
+					server_sink) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	bench.client = setup_ppp(&bench, g_at_ppp_new_full(client_sink[0]),
+					"Client");
+	bench.server = setup_ppp(&bench,
+			g_at_ppp_server_new_full("192.168.1.1", server_sink[0]),
+			"Server");
+	g_at_ppp_set_server_info(bench.server, "192.168.1.2",
+					"10.10.10.10", "10.10.10.11");
+
+	bench.tx_sink = option_reverse ? server_sink[1] : client_sink[1];
+	bench.rx_sink = option_reverse ? client_sink[1] : server_sink[1];
+
+	channel = g_io_channel_unix_new(bench.rx_sink);
+	bench.rx_watch = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				received_packets, &bench);
+	g_io_channel_unref(channel);
+
+	server_io = create_io(link[0]);
+	client_io = create_io(link[1]);
+	g_at_ppp_listen(bench.server, server_io);
+	g_at_ppp_open(bench.client, client_io);
+	g_at_io_unref(server_io);
+	g_at_io_unref(client_io);
+
+	bench.loop = g_main_loop_new(NULL, FALSE);
+	bench.stall_timer = g_timeout_add_seconds(2, stall_check, &bench);
+	g_main_loop_run(bench.loop);
+
+	elapsed = (g_get_monotonic_time() - bench.start) / 1e6;
+	cpu = cpu_time() - bench.cpu_start;
+
+	if (bench.stall_timer)
+		g_source_remove(bench.stall_timer);
+
+	if (bench.rx_watch)
+		g_source_remove(bench.rx_watch);
+
+	g_at_ppp_set_disconnect_function(bench.client, NULL, NULL);
+	g_at_ppp_set_disconnect_function(bench.server, NULL, NULL);
+	g_at_ppp_unref(bench.client);
+	g_at_ppp_unref(bench.server);
+	close(client_sink[1]);
+	close(server_sink[1]);
+	g_main_loop_unref(bench.loop);
+
+	printf("%5u %08x %-4s %-4s ", config->size, config->accm,
+		config->acfc ? "on" : "off", config->pfc ? "on" : "off");
+
+	if (bench.failed) {
+		printf("stalled after %u of %u packets\n", bench.received,
+			bench.target);
+		g_array_free(bench.latency, TRUE);
+		return FALSE;
+	}
+
+	latency = (guint32 *) bench.latency->data;
+	qsort(latency, bench.latency->len, sizeof(guint32), compare_latency);
+
+	for (i = 0; i < bench.latency->len; i++)
+		total += latency[i];
+
+	printf("%9.2f %9.0f %8.1f %8u %8u %6.1f%%\n",
+		bench.received * config->size * 8 / elapsed / 1e6,
+		bench.received / elapsed,
+		(double) total / bench.latency->len,
+		latency[bench.latency->len / 2],
+		latency[bench.latency->len * 99 / 100],
+		cpu * 100 / elapsed);
+
+	g_array_free(bench.latency, TRUE);
+
+	return TRUE;
+}
+
+static GOptionEntry options[] = {
+	{ "size", 's', 0, G_OPTION_ARG_INT, &option_size,
+				"Packet size, 64, 576 and 1500 if not given" },
+	{ "accm", 'a', 0, G_OPTION_ARG_STRING, &option_accm,
+				"ACCM, 0xffffffff and 0 if not given" },
+	{ "compression", 'c', 0, G_OPTION_ARG_STRING, &option_compression,
+				"Header compression: none, acfc, pfc or both."
+				" none and both if not given" },
+	{ "count", 'n', 0, G_OPTION_ARG_INT, &option_count,
+				"Number of packets per run" },
+	{ "window", 'w', 0, G_OPTION_ARG_INT, &option_window,
+				"Number of packets in flight" },
+	{ "reverse", 'r', 0, G_OPTION_ARG_NONE, &option_reverse,
+				"Send from the server to the client" },
+	{ "debug", 'd', 0, G_OPTION_ARG_NONE, &option_debug,
+				"Enable PPP debugging" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	static const guint sizes[] = { 64, 576, 1500 };
+	static const guint32 accms[] = { 0xffffffff, 0 };
+	static const char *compressions[] = { "none", "both" };
+	GOptionContext *context;
+	GError *error = NULL;
+	struct bench_config config;
+	guint nsizes, naccms, ncompressions;
+	guint s, a, c;
+	int status = EXIT_SUCCESS;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+		} else
+			g_printerr("An unknown error occurred\n");
+		exit(EXIT_FAILURE);
+	}
+
+	g_option_context_free(context);
+
+	if (option_size && (option_size < IP_HEADER + 12 ||
+				option_size > MAX_PACKET)) {
+		g_printerr("Packet size must be between %d and %d\n",
+				IP_HEADER + 12, MAX_PACKET);
+		exit(EXIT_FAILURE);
+	}
+
+	if (option_count <= 0 || option_window <= 0) {
+		g_printerr("Count and window must be positive\n");
+		exit(EXIT_FAILURE);
+	}
+
+	nsizes = option_size ? 1 : G_N_ELEMENTS(sizes);
+	naccms = option_accm ? 1 : G_N_ELEMENTS(accms);
+	ncompressions = option_compression ? 1 : G_N_ELEMENTS(compressions);
+
+	printf("%5s %-8s %-4s %-4s %9s %9s %8s %8s %8s %7s\n", "Size",
+		"ACCM", "ACFC", "PFC", "Mbit/s", "Packet/s", "Avg(us)",
+		"P50(us)", "P99(us)", "CPU");
+
+	for (s = 0; s < nsizes; s++) {
+		for (a = 0; a < naccms; a++) {
+			for (c = 0; c < ncompressions; c++) {
+				const char *comp = option_compression ?
+						option_compression :
+						compressions[c];
+
+				config.size = option_size ? (guint) option_size :
+								sizes[s];
+				config.accm = option_accm ?
+					strtoul(option_accm, NULL, 0) :
+					accms[a];
+				config.acfc = !strcmp(comp, "acfc") ||
+						!strcmp(comp, "both");
+				config.pfc = !strcmp(comp, "pfc") ||
+						!strcmp(comp, "both");
+
+				if (!run_bench(&config))
+					status = EXIT_FAILURE;
+			}
+		}
+	}
+
+	g_free(option_accm);
+	g_free(option_compression);
+
+	return status;
+}
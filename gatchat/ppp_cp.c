@@ -865,11 +865,39 @@ static guint8 pppcp_process_protocol_reject(struct pppcp_data *data,
 	return RXJ_MINUS;
 }
 
+/*
+ * transmit an Echo-Request packet, only allowed in the OPENED state
+ */
+gboolean pppcp_send_echo_request(struct pppcp_data *data, guint8 identifier)
+{
+	struct pppcp_packet *packet;
+
+	if (data->state != OPENED)
+		return FALSE;
+
+	/*
+	 * 0 bytes for data, 4 bytes for magic number
+	 */
+	packet = pppcp_packet_new(data, PPPCP_CODE_TYPE_ECHO_REQUEST, 4);
+	if (packet == NULL)
+		return FALSE;
+
+	packet->identifier = identifier;
+
+	/* magic number will always be zero */
+	ppp_transmit(data->ppp, pppcp_to_ppp_packet(packet),
+			ntohs(packet->length));
+
+	pppcp_packet_free(packet);
+
+	return TRUE;
+}
+
 /*
  * For Echo-Request, Echo-Reply, and Discard-Request, we will not
- * bother checking the magic number of the packet, because we will
- * never send an echo or discard request.  We can't reliably detect
- * loop back anyway, since we don't negotiate a magic number.
+ * bother checking the magic number of the packet.  We can't reliably
+ * detect loop back anyway, since we don't negotiate a magic number.
+ * Echo-Requests are only sent by LCP, for the keepalive of GAtPPP.
  */
 static guint8 pppcp_process_echo_request(struct pppcp_data *data,
 					const struct pppcp_packet *packet)
@@ -880,6 +908,9 @@ static guint8 pppcp_process_echo_request(struct pppcp_data *data,
 static guint8 pppcp_process_echo_reply(struct pppcp_data *data,
 					const struct pppcp_packet *packet)
 {
+	if (data->state == OPENED)
+		ppp_lcp_echo_reply_notify(data->ppp, packet->identifier);
+
 	return 0;
 }
 
@@ -120,6 +120,7 @@ void pppcp_set_local_options(struct pppcp_data *data,
 void pppcp_process_packet(gpointer priv, const guint8 *new_packet, gsize len);
 void pppcp_send_protocol_reject(struct pppcp_data *data,
 				const guint8 *rejected_packet, gsize len);
+gboolean pppcp_send_echo_request(struct pppcp_data *data, guint8 identifier);
 void pppcp_signal_open(struct pppcp_data *data);
 void pppcp_signal_close(struct pppcp_data *data);
 void pppcp_signal_up(struct pppcp_data *data);
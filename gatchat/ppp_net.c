@@ -30,6 +30,7 @@
 #include <net/if.h>
 #include <linux/if_tun.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 
 #include <glib.h>
@@ -39,6 +40,7 @@
 #include "ppp.h"
 
 #define MAX_PACKET 1500
+#define MAX_BATCH 16	/* Maximum number of packets read per wakeup */
 
 struct ppp_net {
 	GAtPPP *ppp;
@@ -47,6 +49,11 @@ struct ppp_net {
 	guint watch;
 	gint mtu;
 	struct ppp_header *ppp_packet;
+	guint rx_packets;	/* Packets written to the tun device */
+	guint64 rx_bytes;
+	guint rx_dropped;
+	guint tx_packets;	/* Packets read from the tun device */
+	guint64 tx_bytes;
 };
 
 gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
@@ -77,11 +84,14 @@ gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
 	return TRUE;
 }
 
+/*
+ * The packet still sits in the HDLC decode buffer, where it was
+ * unescaped to, and the tun device takes it from there as it is.
+ */
 void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 				gsize plen)
 {
-	GIOStatus status;
-	gsize bytes_written;
+	ssize_t bytes_written;
 	guint16 len;
 
 	if (plen < 4)
@@ -89,17 +99,23 @@ void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 
 	/* find the length of the packet to transmit */
 	len = get_host_short(&packet[2]);
-	status = g_io_channel_write_chars(net->channel, (gchar *) packet,
-						MIN(len, plen),
-						&bytes_written, NULL);
+	bytes_written = write(g_io_channel_unix_get_fd(net->channel), packet,
+				MIN(len, plen));
 
-	if (status != G_IO_STATUS_NORMAL)
+	if (bytes_written < 0) {
+		net->rx_dropped += 1;
 		return;
+	}
+
+	net->rx_packets += 1;
+	net->rx_bytes += bytes_written;
 }
 
 /*
  * packets received by the tun interface need to be written to
- * the modem.  So, just read a packet, write out to the modem
+ * the modem.  So, just read the packets, write out to the modem.
+ * Draining several packets per wakeup lets HDLC encode them into
+ * its write buffer back to back and send them out in one go.
  */
 static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
@@ -108,21 +124,33 @@ static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 	GIOStatus status;
 	gsize bytes_read;
 	gchar *buf = (gchar *) net->ppp_packet->info;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
-	if (cond & G_IO_IN) {
+	if (!(cond & G_IO_IN))
+		return TRUE;
+
+	for (i = 0; i < MAX_BATCH; i++) {
 		/* leave space to add PPP protocol field */
 		status = g_io_channel_read_chars(channel, buf, net->mtu,
 							&bytes_read, NULL);
-		if (bytes_read > 0)
+		if (bytes_read > 0) {
 			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
 					bytes_read);
 
-		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
+			net->tx_packets += 1;
+			net->tx_bytes += bytes_read;
+		}
+
+		if (status == G_IO_STATUS_AGAIN)
+			break;
+
+		if (status != G_IO_STATUS_NORMAL)
 			return FALSE;
 	}
+
 	return TRUE;
 }
 
@@ -131,6 +159,17 @@ const char *ppp_net_get_interface(struct ppp_net *net)
 	return net->if_name;
 }
 
+static gboolean is_packet_socket(int fd)
+{
+	int type;
+	socklen_t len = sizeof(type);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+		return FALSE;
+
+	return type == SOCK_SEQPACKET || type == SOCK_DGRAM;
+}
+
 struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 {
 	struct ppp_net *net;
@@ -170,8 +209,13 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 			goto error;
 	} else {
 		err = ioctl(fd, TUNGETIFF, (void *) &ifr);
-		if (err < 0)
+
+		/* Any socket preserving packet boundaries does as well */
+		if (err < 0 && !is_packet_socket(fd))
 			goto error;
+
+		if (err < 0)
+			snprintf(ifr.ifr_name, IFNAMSIZ, "fd%d", fd);
 	}
 
 	net->if_name = strdup(ifr.ifr_name);
@@ -181,7 +225,7 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
 	g_io_channel_set_buffered(channel, FALSE);
@@ -212,6 +256,11 @@ badalloc:
 
 void ppp_net_free(struct ppp_net *net)
 {
+	DBG(net->ppp, "%s: received %u packets, %" G_GUINT64_FORMAT " bytes, "
+		"%u dropped, sent %u packets, %" G_GUINT64_FORMAT " bytes",
+		net->if_name, net->rx_packets, net->rx_bytes,
+		net->rx_dropped, net->tx_packets, net->tx_bytes);
+
 	if (net->watch) {
 		g_source_remove(net->watch);
 		net->watch = 0;
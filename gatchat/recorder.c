@@ -0,0 +1,244 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+#include "recorder.h"
+
+#define RECORD_BUFFER_SIZE (64 * 1024)
+#define RECORD_FLUSH_INTERVAL 1
+
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_EPB_FLAGS 2
+#define PCAPNG_EPB_INBOUND 0x1
+#define PCAPNG_EPB_OUTBOUND 0x2
+#define LINKTYPE_PPP 9
+
+struct recorder {
+	int fd;
+	gboolean pcapng;
+	struct ring_buffer *buf;
+	guint flush_source;
+};
+
+static guint8 *put16(guint8 *p, guint16 val)
+{
+	memcpy(p, &val, sizeof(val));
+	return p + sizeof(val);
+}
+
+static guint8 *put32(guint8 *p, guint32 val)
+{
+	memcpy(p, &val, sizeof(val));
+	return p + sizeof(val);
+}
+
+static gboolean flush_timeout(gpointer user_data)
+{
+	struct recorder *rec = user_data;
+
+	rec->flush_source = 0;
+	recorder_flush(rec);
+
+	return FALSE;
+}
+
+static void recorder_append(struct recorder *rec, const void *data,
+				unsigned int len)
+{
+	int err;
+
+	if ((unsigned int) ring_buffer_avail(rec->buf) < len)
+		recorder_flush(rec);
+
+	if ((unsigned int) ring_buffer_avail(rec->buf) >= len) {
+		ring_buffer_write(rec->buf, data, len);
+
+		if (rec->flush_source == 0)
+			rec->flush_source = g_timeout_add_seconds(
+						RECORD_FLUSH_INTERVAL,
+						flush_timeout, rec);
+		return;
+	}
+
+	/* Too large to be worth buffering */
+	err = write(rec->fd, data, len);
+	if (err < 0)
+		return;
+}
+
+static void pcapng_header(struct recorder *rec)
+{
+	guint8 block[48];
+	guint8 *p = block;
+
+	/* Section header, native byte order, section length unknown */
+	p = put32(p, PCAPNG_SHB);
+	p = put32(p, 28);
+	p = put32(p, PCAPNG_BYTE_ORDER_MAGIC);
+	p = put16(p, 1);
+	p = put16(p, 0);
+	p = put32(p, 0xffffffff);
+	p = put32(p, 0xffffffff);
+	p = put32(p, 28);
+
+	/* A single PPP interface, no snap length */
+	p = put32(p, PCAPNG_IDB);
+	p = put32(p, 20);
+	p = put16(p, LINKTYPE_PPP);
+	p = put16(p, 0);
+	p = put32(p, 0);
+	p = put32(p, 20);
+
+	recorder_append(rec, block, p - block);
+}
+
+struct recorder *recorder_new(const char *filename)
+{
+	struct recorder *rec;
+
+	rec = g_try_new0(struct recorder, 1);
+	if (rec == NULL)
+		return NULL;
+
+	rec->buf = ring_buffer_new(RECORD_BUFFER_SIZE);
+	if (rec->buf == NULL)
+		goto error;
+
+	rec->fd = open(filename, O_WRONLY | O_CREAT | O_APPEND,
+					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (rec->fd < 0)
+		goto error;
+
+	rec->pcapng = g_str_has_suffix(filename, ".pcapng");
+
+	/* Appending to an existing capture starts a new section */
+	if (rec->pcapng)
+		pcapng_header(rec);
+
+	return rec;
+
+error:
+	if (rec->buf)
+		ring_buffer_free(rec->buf);
+
+	g_free(rec);
+
+	return NULL;
+}
+
+void recorder_free(struct recorder *rec)
+{
+	if (rec == NULL)
+		return;
+
+	if (rec->flush_source > 0)
+		g_source_remove(rec->flush_source);
+
+	recorder_flush(rec);
+
+	close(rec->fd);
+	ring_buffer_free(rec->buf);
+	g_free(rec);
+}
+
+void recorder_stream(struct recorder *rec, gboolean in,
+				const void *data, unsigned int len)
+{
+	guint8 header[8];
+	guint8 *p = header;
+
+	if (rec == NULL || rec->pcapng || len == 0)
+		return;
+
+	/* The time in seconds, then the direction and length of the data */
+	*p++ = 0x07;
+	p = put32(p, htonl(g_get_real_time() / G_USEC_PER_SEC));
+	*p++ = in ? 0x02 : 0x01;
+	p = put16(p, htons(len));
+
+	recorder_append(rec, header, p - header);
+	recorder_append(rec, data, len);
+}
+
+void recorder_frame(struct recorder *rec, gboolean in,
+				const void *data, unsigned int len)
+{
+	static const guint8 padding[3];
+	guint8 header[28];
+	guint8 trailer[16];
+	guint8 *p = header;
+	unsigned int pad = -len & 3;
+	guint32 total = sizeof(header) + len + pad + sizeof(trailer);
+	guint64 now;
+
+	if (rec == NULL || !rec->pcapng)
+		return;
+
+	now = g_get_real_time();
+
+	/* Enhanced packet block, timestamps in the default microseconds */
+	p = put32(p, PCAPNG_EPB);
+	p = put32(p, total);
+	p = put32(p, 0);
+	p = put32(p, now >> 32);
+	p = put32(p, now & 0xffffffff);
+	p = put32(p, len);
+	p = put32(p, len);
+	recorder_append(rec, header, p - header);
+
+	recorder_append(rec, data, len);
+	recorder_append(rec, padding, pad);
+
+	p = trailer;
+	p = put16(p, PCAPNG_OPT_EPB_FLAGS);
+	p = put16(p, 4);
+	p = put32(p, in ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND);
+	p = put32(p, 0);
+	p = put32(p, total);
+	recorder_append(rec, trailer, p - trailer);
+}
+
+void recorder_flush(struct recorder *rec)
+{
+	struct iovec iov[2];
+	unsigned int len;
+	int err;
+
+	if (rec == NULL)
+		return;
+
+	len = ring_buffer_len(rec->buf);
+	if (len == 0)
+		return;
+
+	iov[0].iov_base = ring_buffer_read_ptr(rec->buf, 0);
+	iov[0].iov_len = ring_buffer_len_no_wrap(rec->buf);
+	iov[1].iov_base = ring_buffer_read_ptr(rec->buf, iov[0].iov_len);
+	iov[1].iov_len = len - iov[0].iov_len;
+
+	/* Recording is best effort, whatever fails to go out is dropped */
+	err = writev(rec->fd, iov, iov[1].iov_len ? 2 : 1);
+	ring_buffer_drain(rec->buf, len);
+
+	if (err < 0)
+		return;
+}
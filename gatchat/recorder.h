@@ -0,0 +1,38 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+struct recorder;
+
+/*!
+ * Creates a recorder appending to filename.  Files named *.pcapng get a
+ * pcapng capture of the PPP frames, anything else a pppdump style dump
+ * of the raw HDLC stream.  Records are collected in memory and written
+ * out in blocks from the main loop.
+ */
+struct recorder *recorder_new(const char *filename);
+
+/*!
+ * Writes out whatever is still pending and closes the file
+ */
+void recorder_free(struct recorder *rec);
+
+/*!
+ * Records a chunk of the raw stream, ignored for pcapng captures
+ */
+void recorder_stream(struct recorder *rec, gboolean in,
+				const void *data, unsigned int len);
+
+/*!
+ * Records a complete frame without framing or FCS, only used for
+ * pcapng captures
+ */
+void recorder_frame(struct recorder *rec, gboolean in,
+				const void *data, unsigned int len);
+
+/*!
+ * Writes out the pending records now
+ */
+void recorder_flush(struct recorder *rec);
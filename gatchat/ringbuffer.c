@@ -19,11 +19,15 @@
  *
  */
 
+#define _GNU_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <glib.h>
 
@@ -37,6 +41,7 @@ struct ring_buffer {
 	unsigned int mask;
 	unsigned int in;
 	unsigned int out;
+	gboolean mirrored;
 };
 
 struct ring_buffer *ring_buffer_new(unsigned int size)
@@ -65,6 +70,83 @@ struct ring_buffer *ring_buffer_new(unsigned int size)
 	buffer->mask = real_size - 1;
 	buffer->in = 0;
 	buffer->out = 0;
+	buffer->mirrored = FALSE;
+
+	return buffer;
+}
+
+/*
+ * Maps the same memory twice, back to back, so that the size bytes
+ * following any offset into the first mapping are always contiguous
+ */
+static unsigned char *mirror_map(unsigned int size)
+{
+	unsigned char *addr;
+	int fd;
+
+	fd = memfd_create("ringbuffer", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, size) < 0)
+		goto error;
+
+	addr = mmap(NULL, size * 2, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+
+	if (mmap(addr, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	if (mmap(addr + size, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	close(fd);
+
+	return addr;
+
+unmap:
+	munmap(addr, size * 2);
+error:
+	close(fd);
+
+	return NULL;
+}
+
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size)
+{
+	unsigned int page_size = sysconf(_SC_PAGESIZE);
+	unsigned int real_size = 1;
+	struct ring_buffer *buffer;
+
+	/* The mappings need to be page aligned */
+	size = MAX(size, page_size);
+
+	/* Find the next power of two for size */
+	while (real_size < size && real_size < MAX_SIZE)
+		real_size = real_size << 1;
+
+	if (real_size < size)
+		return NULL;
+
+	buffer = g_slice_new(struct ring_buffer);
+	if (buffer == NULL)
+		return NULL;
+
+	buffer->buffer = mirror_map(real_size);
+	if (buffer->buffer == NULL) {
+		g_slice_free(struct ring_buffer, buffer);
+		return NULL;
+	}
+
+	buffer->size = real_size;
+	buffer->mask = real_size - 1;
+	buffer->in = 0;
+	buffer->out = 0;
+	buffer->mirrored = TRUE;
 
 	return buffer;
 }
@@ -81,6 +163,14 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
 
 	/* Determine how much to write before wrapping */
 	offset = buf->in & buf->mask;
+
+	if (buf->mirrored) {
+		memcpy(buf->buffer + offset, d, len);
+		buf->in += len;
+
+		return len;
+	}
+
 	end = MIN(len, buf->size - offset);
 	memcpy(buf->buffer+offset, d, end);
 
@@ -103,6 +193,9 @@ int ring_buffer_avail_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->in & buf->mask;
 	unsigned int len = buf->size - buf->in + buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
@@ -124,7 +217,7 @@ int ring_buffer_read(struct ring_buffer *buf, void *data, unsigned int len)
 
 	/* Grab data from buffer starting at offset until the end */
 	offset = buf->out & buf->mask;
-	end = MIN(len, buf->size - offset);
+	end = buf->mirrored ? len : MIN(len, buf->size - offset);
 	memcpy(d, buf->buffer + offset, end);
 
 	/* Now grab remainder from the beginning */
@@ -155,6 +248,9 @@ int ring_buffer_len_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->out & buf->mask;
 	unsigned int len = buf->in - buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
@@ -181,6 +277,27 @@ void ring_buffer_reset(struct ring_buffer *buf)
 	buf->out = 0;
 }
 
+gboolean ring_buffer_trim(struct ring_buffer *buf)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long start, end;
+
+	if (buf == NULL || buf->in != buf->out)
+		return FALSE;
+
+	/* Punching the hole in the memfd drops the pages of both views */
+	if (buf->mirrored)
+		return madvise(buf->buffer, buf->size, MADV_REMOVE) == 0;
+
+	start = ((unsigned long) buf->buffer + page - 1) & ~(page - 1);
+	end = ((unsigned long) buf->buffer + buf->size) & ~(page - 1);
+
+	if (start >= end)
+		return FALSE;
+
+	return madvise((void *) start, end - start, MADV_DONTNEED) == 0;
+}
+
 int ring_buffer_avail(struct ring_buffer *buf)
 {
 	if (buf == NULL)
@@ -202,6 +319,10 @@ void ring_buffer_free(struct ring_buffer *buf)
 	if (buf == NULL)
 		return;
 
-	g_slice_free1(buf->size, buf->buffer);
+	if (buf->mirrored)
+		munmap(buf->buffer, buf->size * 2);
+	else
+		g_slice_free1(buf->size, buf->buffer);
+
 	g_slice_free1(sizeof(struct ring_buffer), buf);
 }
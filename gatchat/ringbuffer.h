@@ -26,6 +26,14 @@ struct ring_buffer;
  */
 struct ring_buffer *ring_buffer_new(unsigned int size);
 
+/*!
+ * Creates a new ring buffer with capacity size, mapped twice back to back
+ * so that its contents are always contiguous in memory: the _no_wrap
+ * functions return the same as their wrapping counterparts.  Returns NULL
+ * if the mapping could not be set up.
+ */
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size);
+
 /*!
  * Frees the resources allocated for the ring buffer
  */
@@ -100,6 +108,13 @@ int ring_buffer_len(struct ring_buffer *buf);
  */
 int ring_buffer_len_no_wrap(struct ring_buffer *buf);
 
+/*!
+ * Gives the memory of an empty buffer back to the kernel, it is faulted in
+ * again, zeroed, on the next write.  Returns FALSE if the buffer holds data
+ * or has no whole page to release.
+ */
+gboolean ring_buffer_trim(struct ring_buffer *buf);
+
 /*!
  * Drains the ring buffer of len bytes.  Returns the number of bytes the
  * read counter was actually advanced.
@@ -0,0 +1,448 @@
+/*
+ *
+ *  AT chat library with GLib integration
+ *
+ *  Copyright (C) 2008-2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include <glib.h>
+
+#include "uring.h"
+
+/* Added in Linux 6.7, the kernel support is probed for at runtime */
+#if !HAVE_DECL_IORING_OP_READ_MULTISHOT
+#define IORING_OP_READ_MULTISHOT 49
+#endif
+
+#define URING_BUF_GROUP 0
+
+struct uring {
+	int fd;
+	int event_fd;
+	unsigned char *sq_ring;
+	size_t sq_ring_size;
+	unsigned char *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_flags;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;	/* Including the unsubmitted ones */
+	unsigned int sq_pending;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	unsigned char *bufs;
+	unsigned int nbufs;
+	unsigned int buf_size;
+	uint16_t buf_tail;
+};
+
+static int sys_io_uring_setup(unsigned int entries,
+					struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+				unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+							flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg,
+						unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static bool probe_ops(int fd)
+{
+	static const uint8_t needed[] = {
+		IORING_OP_READ_MULTISHOT,
+		IORING_OP_ASYNC_CANCEL,
+	};
+	struct io_uring_probe *probe;
+	unsigned int i;
+	bool ok = true;
+
+	probe = g_malloc0(sizeof(*probe) + 256 * sizeof(probe->ops[0]));
+
+	if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		ok = false;
+
+	for (i = 0; ok && i < G_N_ELEMENTS(needed); i++)
+		if (needed[i] >= probe->ops_len ||
+				!(probe->ops[needed[i]].flags &
+						IO_URING_OP_SUPPORTED))
+			ok = false;
+
+	g_free(probe);
+
+	return ok;
+}
+
+static void buf_recycle(struct uring *ring, uint16_t bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->nbufs - 1)];
+	buf->addr = (uintptr_t) (ring->bufs + (size_t) bid * ring->buf_size);
+	buf->len = ring->buf_size;
+	buf->bid = bid;
+
+	ring->buf_tail += 1;
+}
+
+static void buf_publish(struct uring *ring)
+{
+	__atomic_store_n(&ring->buf_ring->tail, ring->buf_tail,
+							__ATOMIC_RELEASE);
+}
+
+static bool map_rings(struct uring *ring, struct io_uring_params *p)
+{
+	unsigned int *array;
+	unsigned int i;
+
+	ring->sq_ring_size = p->sq_off.array +
+				p->sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = p->cq_off.cqes +
+				p->cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sq_ring_size = MAX(ring->sq_ring_size,
+						ring->cq_ring_size);
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd,
+				IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		return false;
+	}
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size,
+					PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, ring->fd,
+					IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			return false;
+		}
+	}
+
+	ring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd,
+				IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		return false;
+	}
+
+	ring->sq_head = (void *) (ring->sq_ring + p->sq_off.head);
+	ring->sq_tail = (void *) (ring->sq_ring + p->sq_off.tail);
+	ring->sq_flags = (void *) (ring->sq_ring + p->sq_off.flags);
+	ring->sq_mask = p->sq_entries - 1;
+	ring->sq_entries = p->sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+
+	/* Submission slots are always used in order */
+	array = (void *) (ring->sq_ring + p->sq_off.array);
+	for (i = 0; i < p->sq_entries; i++)
+		array[i] = i;
+
+	ring->cq_head = (void *) (ring->cq_ring + p->cq_off.head);
+	ring->cq_tail = (void *) (ring->cq_ring + p->cq_off.tail);
+	ring->cq_mask = p->cq_entries - 1;
+	ring->cqes = (void *) (ring->cq_ring + p->cq_off.cqes);
+
+	return true;
+}
+
+static bool setup_bufs(struct uring *ring)
+{
+	struct io_uring_buf_reg reg;
+	unsigned int i;
+
+	ring->buf_ring_size = ring->nbufs * sizeof(struct io_uring_buf);
+	ring->buf_ring = mmap(NULL, ring->buf_ring_size,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->buf_ring == MAP_FAILED) {
+		ring->buf_ring = NULL;
+		return false;
+	}
+
+	ring->bufs = g_try_malloc((size_t) ring->nbufs * ring->buf_size);
+	if (ring->bufs == NULL)
+		return false;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t) ring->buf_ring;
+	reg.ring_entries = ring->nbufs;
+	reg.bgid = URING_BUF_GROUP;
+
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING,
+							&reg, 1) < 0)
+		return false;
+
+	for (i = 0; i < ring->nbufs; i++)
+		buf_recycle(ring, i);
+
+	buf_publish(ring);
+
+	return true;
+}
+
+struct uring *uring_new(unsigned int entries, unsigned int nbufs,
+						unsigned int buf_size)
+{
+	struct io_uring_params p;
+	struct uring *ring;
+
+	/* The buffer ring size must be a power of two */
+	if (nbufs == 0 || nbufs > 32768 || (nbufs & (nbufs - 1)))
+		return NULL;
+
+	ring = g_try_new0(struct uring, 1);
+	if (ring == NULL)
+		return NULL;
+
+	ring->event_fd = -1;
+	ring->nbufs = nbufs;
+	ring->buf_size = buf_size;
+
+	memset(&p, 0, sizeof(p));
+
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		goto error;
+
+	/* Completions must never be dropped, a read would be lost */
+	if (!(p.features & IORING_FEAT_NODROP) || !probe_ops(ring->fd))
+		goto error;
+
+	if (!map_rings(ring, &p))
+		goto error;
+
+	ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->event_fd < 0)
+		goto error;
+
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_EVENTFD,
+						&ring->event_fd, 1) < 0)
+		goto error;
+
+	if (!setup_bufs(ring))
+		goto error;
+
+	return ring;
+
+error:
+	uring_free(ring);
+	return NULL;
+}
+
+void uring_free(struct uring *ring)
+{
+	if (ring == NULL)
+		return;
+
+	/* Closing the ring cancels whatever is still in flight */
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	if (ring->event_fd >= 0)
+		close(ring->event_fd);
+
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+
+	if (ring->buf_ring)
+		munmap(ring->buf_ring, ring->buf_ring_size);
+
+	g_free(ring->bufs);
+	g_free(ring);
+}
+
+int uring_get_fd(struct uring *ring)
+{
+	return ring->event_fd;
+}
+
+static struct io_uring_sqe *get_sqe(struct uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (ring->sq_local_tail - head >= ring->sq_entries) {
+		uring_submit(ring);
+
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (ring->sq_local_tail - head >= ring->sq_entries)
+			return NULL;
+	}
+
+	sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ring->sq_local_tail += 1;
+	ring->sq_pending += 1;
+
+	return sqe;
+}
+
+bool uring_read_multishot(struct uring *ring, int fd, uint64_t id)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_READ_MULTISHOT;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) -1;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUF_GROUP;
+	sqe->user_data = id;
+
+	return true;
+}
+
+bool uring_cancel(struct uring *ring, uint64_t id)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+
+	if (sqe == NULL)
+		return false;
+
+	/* The outcome shows in the final completion of the read itself */
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = id;
+	sqe->user_data = 0;
+
+	return true;
+}
+
+int uring_submit(struct uring *ring)
+{
+	int r;
+
+	if (ring->sq_pending == 0)
+		return 0;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	do {
+		r = sys_io_uring_enter(ring->fd, ring->sq_pending, 0, 0);
+	} while (r < 0 && errno == EINTR);
+
+	if (r < 0)
+		return -errno;
+
+	ring->sq_pending -= r;
+
+	return r;
+}
+
+unsigned int uring_process(struct uring *ring, uring_read_func_t func,
+							void *user_data)
+{
+	unsigned int count = 0;
+	eventfd_t value;
+
+	eventfd_read(ring->event_fd, &value);
+
+	for (;;) {
+		unsigned int head = *ring->cq_head;
+		unsigned int tail = __atomic_load_n(ring->cq_tail,
+							__ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe =
+				&ring->cqes[head & ring->cq_mask];
+			uint64_t id = cqe->user_data;
+			uint32_t flags = cqe->flags;
+			int res = cqe->res;
+			const void *data = NULL;
+			uint16_t bid = 0;
+
+			if (flags & IORING_CQE_F_BUFFER) {
+				bid = flags >> IORING_CQE_BUFFER_SHIFT;
+				data = ring->bufs +
+					(size_t) bid * ring->buf_size;
+			}
+
+			if (id) {
+				func(id, res, data,
+					flags & IORING_CQE_F_MORE, user_data);
+				count += 1;
+			}
+
+			if (flags & IORING_CQE_F_BUFFER)
+				buf_recycle(ring, bid);
+		}
+
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		buf_publish(ring);
+
+		/* Completions that did not fit are held back by the kernel */
+		if (!(__atomic_load_n(ring->sq_flags, __ATOMIC_RELAXED) &
+						IORING_SQ_CQ_OVERFLOW))
+			break;
+
+		sys_io_uring_enter(ring->fd, 0, 0, IORING_ENTER_GETEVENTS);
+	}
+
+	uring_submit(ring);
+
+	return count;
+}
@@ -0,0 +1,68 @@
+/*
+ *
+ *  AT chat library with GLib integration
+ *
+ *  Copyright (C) 2008-2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct uring;
+
+/*!
+ * Called for each completion of a read, with the bytes read in data.
+ * data is only valid until the function returns, the buffer goes back to
+ * the kernel afterwards.  more is false once the read is no longer armed,
+ * after an error, end of file or cancellation, or when the buffers ran
+ * out, res being -ENOBUFS in that last case.
+ */
+typedef void (*uring_read_func_t)(uint64_t id, int res, const void *data,
+						bool more, void *user_data);
+
+/*!
+ * Sets up a ring with a pool of nbufs buffers of buf_size bytes, shared by
+ * all the reads on it.  Returns NULL if the kernel lacks io_uring or any
+ * of the features used, so that callers can fall back to plain reads.
+ */
+struct uring *uring_new(unsigned int entries, unsigned int nbufs,
+						unsigned int buf_size);
+void uring_free(struct uring *ring);
+
+/*!
+ * Returns a descriptor that turns readable when completions are pending
+ */
+int uring_get_fd(struct uring *ring);
+
+/*!
+ * Queues a multishot read of fd, which stays armed across completions.
+ * The id, which must not be 0, identifies the read towards the read
+ * function and uring_cancel.  Queued requests go to the kernel with the
+ * next uring_submit.
+ */
+bool uring_read_multishot(struct uring *ring, int fd, uint64_t id);
+bool uring_cancel(struct uring *ring, uint64_t id);
+int uring_submit(struct uring *ring);
+
+/*!
+ * Reaps all pending completions, calling func for each read completion,
+ * and returns their number.  Requests queued from func are submitted
+ * together at the end.
+ */
+unsigned int uring_process(struct uring *ring, uring_read_func_t func,
+							void *user_data);
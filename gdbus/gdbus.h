@@ -303,6 +303,34 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 				const char *interface, DBusMessageIter *iter);
 
+typedef void (*GDBusInterfaceFunc)(const char *path, const char *interface,
+					const GDBusMethodTable *methods,
+					void *interface_data, void *user_data);
+
+/* Walks the interfaces of path and of every object registered below it */
+gboolean g_dbus_foreach_interface(DBusConnection *connection,
+					const char *path,
+					GDBusInterfaceFunc func,
+					void *user_data);
+
+/*
+ * Fills dict, an already opened a{sv}, with the properties that the object
+ * manager reports for an interface registered without a property table
+ */
+typedef void (*GDBusAppendPropertiesFunc)(const char *path,
+					const char *interface,
+					const GDBusMethodTable *methods,
+					void *interface_data,
+					DBusMessageIter *dict);
+
+void g_dbus_set_object_manager_properties(GDBusAppendPropertiesFunc func);
+
+/* Called for every interface removed, before its destroy function runs */
+typedef void (*GDBusInterfaceRemovedFunc)(const char *path,
+					const char *interface);
+
+void g_dbus_set_interface_removed_hook(GDBusInterfaceRemovedFunc func);
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection);
 gboolean g_dbus_detach_object_manager(DBusConnection *connection);
 
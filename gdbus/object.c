@@ -52,11 +52,12 @@ struct generic_data {
 	DBusConnection *conn;
 	char *path;
 	GSList *interfaces;
+	GHashTable *interface_index;
 	GSList *objects;
 	GSList *added;
 	GSList *removed;
+	GSList *changed;
 	guint process_id;
-	gboolean pending_prop;
 	char *introspect;
 	struct generic_data *parent;
 };
@@ -66,11 +67,24 @@ struct interface_data {
 	const GDBusMethodTable *methods;
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
+	GHashTable *method_index;
+	GHashTable *property_index;
 	GSList *pending_prop;
 	void *user_data;
 	GDBusDestroyFunction destroy;
 };
 
+/*
+ * Methods are looked up by name, with the concatenated input signature
+ * precomputed at registration.  Entries sharing a name are chained in
+ * table order.
+ */
+struct method_data {
+	const GDBusMethodTable *method;
+	char *signature;
+	struct method_data *next;
+};
+
 struct security_data {
 	GDBusPendingReply pending;
 	DBusMessage *message;
@@ -86,6 +100,8 @@ struct property_data {
 
 static int global_flags = 0;
 static struct generic_data *root;
+static GDBusAppendPropertiesFunc manager_properties;
+static GDBusInterfaceRemovedFunc interface_removed;
 static GSList *pending = NULL;
 
 static gboolean process_changes(gpointer user_data);
@@ -230,6 +246,10 @@ done:
 	data->introspect = g_string_free(gstr, FALSE);
 }
 
+/*
+ * The document is kept until the interfaces of the object change or a
+ * child object is registered or unregistered below it, which reset it
+ */
 static DBusMessage *introspect(DBusConnection *connection,
 				DBusMessage *message, void *user_data)
 {
@@ -542,23 +562,52 @@ static void append_properties(struct interface_data *data,
 	dbus_message_iter_close_container(iter, &dict);
 }
 
+static void append_manager_properties(const char *path,
+					struct interface_data *iface,
+					DBusMessageIter *iter)
+{
+	DBusMessageIter dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+				DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+				DBUS_TYPE_STRING_AS_STRING
+				DBUS_TYPE_VARIANT_AS_STRING
+				DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dict);
+
+	manager_properties(path, iface->name, iface->methods,
+						iface->user_data, &dict);
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+struct append_interface_data {
+	const char *path;
+	DBusMessageIter *array;
+};
+
 static void append_interface(gpointer data, gpointer user_data)
 {
 	struct interface_data *iface = data;
-	DBusMessageIter *array = user_data;
+	struct append_interface_data *append = user_data;
 	DBusMessageIter entry;
 
-	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL,
-								&entry);
+	dbus_message_iter_open_container(append->array, DBUS_TYPE_DICT_ENTRY,
+							NULL, &entry);
 	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &iface->name);
-	append_properties(data, &entry);
-	dbus_message_iter_close_container(array, &entry);
+
+	if (iface->properties == NULL && manager_properties != NULL)
+		append_manager_properties(append->path, iface, &entry);
+	else
+		append_properties(data, &entry);
+
+	dbus_message_iter_close_container(append->array, &entry);
 }
 
 static void emit_interfaces_added(struct generic_data *data)
 {
 	DBusMessage *signal;
 	DBusMessageIter iter, array;
+	struct append_interface_data append;
 
 	if (root == NULL || data == root)
 		return;
@@ -583,7 +632,9 @@ static void emit_interfaces_added(struct generic_data *data)
 				DBUS_DICT_ENTRY_END_CHAR_AS_STRING
 				DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &array);
 
-	g_slist_foreach(data->added, append_interface, &array);
+	append.path = data->path;
+	append.array = &array;
+	g_slist_foreach(data->added, append_interface, &append);
 	g_slist_free(data->added);
 	data->added = NULL;
 
@@ -594,21 +645,13 @@ static void emit_interfaces_added(struct generic_data *data)
 	dbus_message_unref(signal);
 }
 
-static struct interface_data *find_interface(GSList *interfaces,
+static struct interface_data *find_interface(struct generic_data *data,
 						const char *name)
 {
-	GSList *list;
-
 	if (name == NULL)
 		return NULL;
 
-	for (list = interfaces; list; list = list->next) {
-		struct interface_data *iface = list->data;
-		if (!strcmp(name, iface->name))
-			return iface;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(data->interface_index, name);
 }
 
 static gboolean g_dbus_args_have_signature(const GDBusArgInfo *args,
@@ -642,17 +685,31 @@ static void add_pending(struct generic_data *data)
 	pending = g_slist_append(pending, data);
 }
 
+static void interface_index_free(struct interface_data *iface)
+{
+	g_hash_table_destroy(iface->method_index);
+	iface->method_index = NULL;
+
+	g_hash_table_destroy(iface->property_index);
+	iface->property_index = NULL;
+}
+
 static gboolean remove_interface(struct generic_data *data, const char *name)
 {
 	struct interface_data *iface;
 
-	iface = find_interface(data->interfaces, name);
+	iface = find_interface(data, name);
 	if (iface == NULL)
 		return FALSE;
 
+	if (interface_removed)
+		interface_removed(data->path, iface->name);
+
 	process_properties_from_interface(data, iface);
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
+	g_hash_table_remove(data->interface_index, iface->name);
+	interface_index_free(iface);
 
 	if (iface->destroy) {
 		iface->destroy(iface->user_data);
@@ -734,23 +791,23 @@ done:
 	return data;
 }
 
-static inline const GDBusPropertyTable *find_property(const GDBusPropertyTable *properties,
-							const char *name)
+static inline const GDBusPropertyTable *find_property(
+					struct interface_data *iface,
+					const char *name)
 {
 	const GDBusPropertyTable *p;
 
-	for (p = properties; p && p->name; p++) {
-		if (strcmp(name, p->name) != 0)
-			continue;
+	if (name == NULL)
+		return NULL;
 
-		if (check_experimental(p->flags,
-					G_DBUS_PROPERTY_FLAG_EXPERIMENTAL))
-			break;
+	p = g_hash_table_lookup(iface->property_index, name);
+	if (p == NULL)
+		return NULL;
 
-		return p;
-	}
+	if (check_experimental(p->flags, G_DBUS_PROPERTY_FLAG_EXPERIMENTAL))
+		return NULL;
 
-	return NULL;
+	return p;
 }
 
 static DBusMessage *properties_get(DBusConnection *connection,
@@ -769,12 +826,12 @@ static DBusMessage *properties_get(DBusConnection *connection,
 					DBUS_TYPE_INVALID))
 		return NULL;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 				"No such interface '%s'", interface);
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 				"No such property '%s'", name);
@@ -820,7 +877,7 @@ static DBusMessage *properties_get_all(DBusConnection *connection,
 					DBUS_TYPE_INVALID))
 		return NULL;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 					"No such interface '%s'", interface);
@@ -875,12 +932,12 @@ static DBusMessage *properties_set(DBusConnection *connection,
 
 	dbus_message_iter_recurse(&iter, &sub);
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 					"No such interface '%s'", interface);
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL)
 		return g_dbus_create_error(message,
 						DBUS_ERROR_UNKNOWN_PROPERTY,
@@ -1000,7 +1057,7 @@ static gboolean process_changes(gpointer user_data)
 		emit_interfaces_added(data);
 
 	/* Flush pending properties */
-	if (data->pending_prop == TRUE)
+	if (data->changed != NULL)
 		process_property_changes(data);
 
 	if (data->removed != NULL)
@@ -1028,6 +1085,8 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 	g_slist_foreach(data->objects, reset_parent, data->parent);
 	g_slist_free(data->objects);
 
+	g_hash_table_destroy(data->interface_index);
+
 	dbus_connection_unref(data->conn);
 	g_free(data->introspect);
 	g_free(data->path);
@@ -1039,28 +1098,36 @@ static DBusHandlerResult generic_message(DBusConnection *connection,
 {
 	struct generic_data *data = user_data;
 	struct interface_data *iface;
+	struct method_data *entry;
 	const GDBusMethodTable *method;
 	const char *interface;
+	const char *member;
+	const char *signature;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	interface = dbus_message_get_interface(message);
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	for (method = iface->methods; method &&
-			method->name && method->function; method++) {
+	member = dbus_message_get_member(message);
+	if (member == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-		if (dbus_message_is_method_call(message, iface->name,
-							method->name) == FALSE)
-			continue;
+	signature = dbus_message_get_signature(message);
+
+	for (entry = g_hash_table_lookup(iface->method_index, member);
+					entry; entry = entry->next) {
+		method = entry->method;
 
 		if (check_experimental(method->flags,
 					G_DBUS_METHOD_FLAG_EXPERIMENTAL))
 			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-		if (g_dbus_args_have_signature(method->in_args,
-							message) == FALSE)
+		if (strcmp(entry->signature, signature) != 0)
 			continue;
 
 		if (check_privilege(connection, message, method,
@@ -1088,6 +1155,7 @@ static const GDBusMethodTable introspect_methods[] = {
 static void append_interfaces(struct generic_data *data, DBusMessageIter *iter)
 {
 	DBusMessageIter array;
+	struct append_interface_data append = { data->path, &array };
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
 				DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
@@ -1099,7 +1167,7 @@ static void append_interfaces(struct generic_data *data, DBusMessageIter *iter)
 				DBUS_DICT_ENTRY_END_CHAR_AS_STRING
 				DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &array);
 
-	g_slist_foreach(data->interfaces, append_interface, &array);
+	g_slist_foreach(data->interfaces, append_interface, &append);
 
 	dbus_message_iter_close_container(iter, &array);
 }
@@ -1171,6 +1239,71 @@ static const GDBusSignalTable manager_signals[] = {
 	{ }
 };
 
+static void method_data_free(gpointer user_data)
+{
+	struct method_data *entry = user_data;
+
+	while (entry) {
+		struct method_data *next = entry->next;
+
+		g_free(entry->signature);
+		g_free(entry);
+		entry = next;
+	}
+}
+
+static char *method_signature(const GDBusArgInfo *args)
+{
+	GString *signature = g_string_new(NULL);
+
+	for (; args && args->signature; args++)
+		g_string_append(signature, args->signature);
+
+	return g_string_free(signature, FALSE);
+}
+
+static void interface_index_build(struct interface_data *iface)
+{
+	const GDBusMethodTable *method;
+	const GDBusPropertyTable *property;
+
+	iface->method_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+							NULL, method_data_free);
+
+	for (method = iface->methods; method &&
+			method->name && method->function; method++) {
+		struct method_data *entry, *last;
+
+		entry = g_new0(struct method_data, 1);
+		entry->method = method;
+		entry->signature = method_signature(method->in_args);
+
+		last = g_hash_table_lookup(iface->method_index, method->name);
+		if (last == NULL) {
+			g_hash_table_insert(iface->method_index,
+						(gpointer) method->name, entry);
+			continue;
+		}
+
+		while (last->next)
+			last = last->next;
+
+		last->next = entry;
+	}
+
+	iface->property_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (property = iface->properties; property && property->name;
+								property++) {
+		if (g_hash_table_lookup(iface->property_index, property->name))
+			continue;
+
+		g_hash_table_insert(iface->property_index,
+					(gpointer) property->name,
+					(gpointer) property);
+	}
+}
+
 static gboolean add_interface(struct generic_data *data,
 				const char *name,
 				const GDBusMethodTable *methods,
@@ -1214,7 +1347,10 @@ done:
 	iface->user_data = user_data;
 	iface->destroy = destroy;
 
+	interface_index_build(iface);
+
 	data->interfaces = g_slist_append(data->interfaces, iface);
+	g_hash_table_insert(data->interface_index, iface->name, iface);
 	if (data->parent == NULL)
 		return TRUE;
 
@@ -1242,12 +1378,14 @@ static struct generic_data *object_path_ref(DBusConnection *connection,
 	data->conn = dbus_connection_ref(connection);
 	data->path = g_strdup(path);
 	data->refcount = 1;
+	data->interface_index = g_hash_table_new(g_str_hash, g_str_equal);
 
 	data->introspect = g_strdup(DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE "<node></node>");
 
 	if (!dbus_connection_register_object_path(connection, path,
 						&generic_table, data)) {
 		dbus_connection_unref(data->conn);
+		g_hash_table_destroy(data->interface_index);
 		g_free(data->path);
 		g_free(data->introspect);
 		g_free(data);
@@ -1302,7 +1440,7 @@ static gboolean check_signal(DBusConnection *conn, const char *path,
 		return FALSE;
 	}
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL) {
 		error("dbus_connection_emit_signal: %s does not implement %s",
 				path, interface);
@@ -1341,7 +1479,7 @@ gboolean g_dbus_register_interface(DBusConnection *connection,
 	if (data == NULL)
 		return FALSE;
 
-	if (find_interface(data->interfaces, name)) {
+	if (find_interface(data, name)) {
 		object_path_unref(connection, path);
 		return FALSE;
 	}
@@ -1352,7 +1490,7 @@ gboolean g_dbus_register_interface(DBusConnection *connection,
 		return FALSE;
 	}
 
-	if (properties != NULL && !find_interface(data->interfaces,
+	if (properties != NULL && !find_interface(data,
 						DBUS_INTERFACE_PROPERTIES))
 		add_interface(data, DBUS_INTERFACE_PROPERTIES,
 				properties_methods, properties_signals, NULL,
@@ -1650,16 +1788,18 @@ static void process_properties_from_interface(struct generic_data *data,
 	DBusMessageIter iter, dict, array;
 	GSList *invalidated;
 
-	data->pending_prop = FALSE;
-
 	if (iface->pending_prop == NULL)
 		return;
 
+	data->changed = g_slist_remove(data->changed, iface);
+
 	signal = dbus_message_new_signal(data->path,
 			DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
 	if (signal == NULL) {
 		error("Unable to allocate new " DBUS_INTERFACE_PROPERTIES
 						".PropertiesChanged signal");
+		g_slist_free(iface->pending_prop);
+		iface->pending_prop = NULL;
 		return;
 	}
 
@@ -1709,15 +1849,11 @@ static void process_properties_from_interface(struct generic_data *data,
 	dbus_message_unref(signal);
 }
 
+/* Only the interfaces with pending changes are visited */
 static void process_property_changes(struct generic_data *data)
 {
-	GSList *l;
-
-	for (l = data->interfaces; l != NULL; l = l->next) {
-		struct interface_data *iface = l->data;
-
-		process_properties_from_interface(data, iface);
-	}
+	while (data->changed != NULL)
+		process_properties_from_interface(data, data->changed->data);
 }
 
 void g_dbus_emit_property_changed(DBusConnection *connection,
@@ -1735,7 +1871,7 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 					(void **) &data) || data == NULL)
 		return;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return;
 
@@ -1746,7 +1882,7 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 	if (root && g_slist_find(data->added, iface))
 		return;
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL) {
 		error("Could not find property %s in %p", name,
 							iface->properties);
@@ -1756,7 +1892,9 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 	if (g_slist_find(iface->pending_prop, (void *) property) != NULL)
 		return;
 
-	data->pending_prop = TRUE;
+	if (iface->pending_prop == NULL)
+		data->changed = g_slist_append(data->changed, iface);
+
 	iface->pending_prop = g_slist_prepend(iface->pending_prop,
 						(void *) property);
 
@@ -1776,7 +1914,7 @@ gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 					(void **) &data) || data == NULL)
 		return FALSE;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return FALSE;
 
@@ -1785,6 +1923,57 @@ gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 	return TRUE;
 }
 
+struct foreach_data {
+	GDBusInterfaceFunc func;
+	void *user_data;
+};
+
+static void foreach_object(struct generic_data *data,
+					struct foreach_data *foreach)
+{
+	GSList *l;
+
+	for (l = data->interfaces; l != NULL; l = l->next) {
+		struct interface_data *iface = l->data;
+
+		foreach->func(data->path, iface->name, iface->methods,
+					iface->user_data, foreach->user_data);
+	}
+
+	for (l = data->objects; l != NULL; l = l->next)
+		foreach_object(l->data, foreach);
+}
+
+gboolean g_dbus_foreach_interface(DBusConnection *connection,
+					const char *path,
+					GDBusInterfaceFunc func,
+					void *user_data)
+{
+	struct generic_data *data;
+	struct foreach_data foreach = { func, user_data };
+
+	if (path == NULL || func == NULL)
+		return FALSE;
+
+	if (!dbus_connection_get_object_path_data(connection, path,
+					(void **) &data) || data == NULL)
+		return FALSE;
+
+	foreach_object(data, &foreach);
+
+	return TRUE;
+}
+
+void g_dbus_set_object_manager_properties(GDBusAppendPropertiesFunc func)
+{
+	manager_properties = func;
+}
+
+void g_dbus_set_interface_removed_hook(GDBusInterfaceRemovedFunc func)
+{
+	interface_removed = func;
+}
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection)
 {
 	struct generic_data *data;
@@ -43,6 +43,19 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 static guint listener_id = 0;
 static GSList *listeners = NULL;
 
+/*
+ * Filters are indexed by their full match, by the member (and arg0, when
+ * the filter has one) a signal must carry to reach them, by bus name for
+ * the owner cache and by watch id, so that neither dispatching a signal
+ * nor adding or removing a watch walks every filter of the process.
+ * Filters without a member are few and go through wildcard_listeners.
+ */
+static GHashTable *filter_index = NULL;
+static GHashTable *dispatch_index = NULL;
+static GSList *wildcard_listeners = NULL;
+static GHashTable *name_index = NULL;
+static GHashTable *watch_index = NULL;
+
 struct service_data {
 	DBusConnection *conn;
 	DBusPendingCall *call;
@@ -71,6 +84,8 @@ struct filter_data {
 	char *interface;
 	char *member;
 	char *argument;
+	char *key;
+	char *dispatch_key;
 	GSList *callbacks;
 	GSList *processed;
 	guint name_watch;
@@ -78,45 +93,83 @@ struct filter_data {
 	gboolean registered;
 };
 
-static struct filter_data *filter_data_find_match(DBusConnection *connection,
-							const char *name,
-							const char *owner,
-							const char *path,
-							const char *interface,
-							const char *member,
-							const char *argument)
+static char *filter_key(DBusConnection *connection, const char *sender,
+				const char *path, const char *interface,
+				const char *member, const char *argument)
 {
-	GSList *current;
+	return g_strdup_printf("%p\n%s\n%s\n%s\n%s\n%s%s", connection,
+				sender ? : "", path ? : "", interface ? : "",
+				member ? : "", argument ? "=" : "",
+				argument ? : "");
+}
 
-	for (current = listeners;
-			current != NULL; current = current->next) {
-		struct filter_data *data = current->data;
+static char *dispatch_key(const char *member, const char *argument)
+{
+	if (argument == NULL)
+		return g_strdup(member);
 
-		if (connection != data->connection)
-			continue;
+	return g_strconcat(member, "\n", argument, NULL);
+}
 
-		if (g_strcmp0(name, data->name) != 0)
-			continue;
+static void index_add(GHashTable *index, const char *key, void *data)
+{
+	GSList *list = g_hash_table_lookup(index, key);
 
-		if (g_strcmp0(owner, data->owner) != 0)
-			continue;
+	/* Appending to a non-empty list keeps its head */
+	if (list) {
+		list = g_slist_append(list, data);
+		return;
+	}
 
-		if (g_strcmp0(path, data->path) != 0)
-			continue;
+	g_hash_table_insert(index, g_strdup(key), g_slist_append(NULL, data));
+}
 
-		if (g_strcmp0(interface, data->interface) != 0)
-			continue;
+static void index_remove(GHashTable *index, const char *key, void *data)
+{
+	GSList *list = g_hash_table_lookup(index, key);
 
-		if (g_strcmp0(member, data->member) != 0)
-			continue;
+	list = g_slist_remove(list, data);
 
-		if (g_strcmp0(argument, data->argument) != 0)
-			continue;
+	if (list == NULL)
+		g_hash_table_remove(index, key);
+	else
+		g_hash_table_insert(index, g_strdup(key), list);
+}
 
-		return data;
+static void filter_data_link(struct filter_data *data)
+{
+	if (filter_index == NULL) {
+		filter_index = g_hash_table_new(g_str_hash, g_str_equal);
+		dispatch_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+								g_free, NULL);
+		name_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+								g_free, NULL);
 	}
 
-	return NULL;
+	listeners = g_slist_append(listeners, data);
+	g_hash_table_insert(filter_index, data->key, data);
+
+	if (data->dispatch_key)
+		index_add(dispatch_index, data->dispatch_key, data);
+	else
+		wildcard_listeners = g_slist_append(wildcard_listeners, data);
+
+	if (data->name)
+		index_add(name_index, data->name, data);
+}
+
+static void filter_data_unlink(struct filter_data *data)
+{
+	listeners = g_slist_remove(listeners, data);
+	g_hash_table_remove(filter_index, data->key);
+
+	if (data->dispatch_key)
+		index_remove(dispatch_index, data->dispatch_key, data);
+	else
+		wildcard_listeners = g_slist_remove(wildcard_listeners, data);
+
+	if (data->name)
+		index_remove(name_index, data->name, data);
 }
 
 static struct filter_data *filter_data_find(DBusConnection *connection)
@@ -214,6 +267,7 @@ static struct filter_data *filter_data_get(DBusConnection *connection,
 {
 	struct filter_data *data;
 	const char *name = NULL, *owner = NULL;
+	char *key;
 
 	if (filter_data_find(connection) == NULL) {
 		if (!dbus_connection_add_filter(connection,
@@ -232,10 +286,14 @@ static struct filter_data *filter_data_get(DBusConnection *connection,
 		name = sender;
 
 proceed:
-	data = filter_data_find_match(connection, name, owner, path,
-						interface, member, argument);
-	if (data)
+	key = filter_key(connection, sender, path, interface, member,
+								argument);
+
+	data = filter_index ? g_hash_table_lookup(filter_index, key) : NULL;
+	if (data) {
+		g_free(key);
 		return data;
+	}
 
 	data = g_new0(struct filter_data, 1);
 
@@ -246,13 +304,26 @@ proceed:
 	data->interface = g_strdup(interface);
 	data->member = g_strdup(member);
 	data->argument = g_strdup(argument);
+	data->key = key;
+
+	if (member)
+		data->dispatch_key = dispatch_key(member, argument);
 
 	if (!add_match(data, filter)) {
+		g_free(data->name);
+		g_free(data->owner);
+		g_free(data->path);
+		g_free(data->interface);
+		g_free(data->member);
+		g_free(data->argument);
+		g_free(data->key);
+		g_free(data->dispatch_key);
+		dbus_connection_unref(data->connection);
 		g_free(data);
 		return NULL;
 	}
 
-	listeners = g_slist_append(listeners, data);
+	filter_data_link(data);
 
 	return data;
 }
@@ -286,8 +357,12 @@ static void filter_data_free(struct filter_data *data)
 		dbus_connection_remove_filter(data->connection, message_filter,
 									NULL);
 
-	for (l = data->callbacks; l != NULL; l = l->next)
-		g_free(l->data);
+	for (l = data->callbacks; l != NULL; l = l->next) {
+		struct filter_callback *cb = l->data;
+
+		g_hash_table_remove(watch_index, GUINT_TO_POINTER(cb->id));
+		g_free(cb);
+	}
 
 	g_slist_free(data->callbacks);
 	g_dbus_remove_watch(data->connection, data->name_watch);
@@ -297,6 +372,8 @@ static void filter_data_free(struct filter_data *data)
 	g_free(data->interface);
 	g_free(data->member);
 	g_free(data->argument);
+	g_free(data->key);
+	g_free(data->dispatch_key);
 	dbus_connection_unref(data->connection);
 	g_free(data);
 }
@@ -311,9 +388,13 @@ static void filter_data_call_and_free(struct filter_data *data)
 			cb->disc_func(data->connection, cb->user_data);
 		if (cb->destroy_func)
 			cb->destroy_func(cb->user_data);
+		g_hash_table_remove(watch_index, GUINT_TO_POINTER(cb->id));
 		g_free(cb);
 	}
 
+	g_slist_free(data->callbacks);
+	data->callbacks = NULL;
+
 	filter_data_free(data);
 }
 
@@ -336,6 +417,11 @@ static struct filter_callback *filter_data_add_callback(
 	cb->user_data = user_data;
 	cb->id = ++listener_id;
 
+	if (watch_index == NULL)
+		watch_index = g_hash_table_new(NULL, NULL);
+
+	g_hash_table_insert(watch_index, GUINT_TO_POINTER(cb->id), data);
+
 	if (data->lock)
 		data->processed = g_slist_append(data->processed, cb);
 	else
@@ -368,6 +454,7 @@ static gboolean filter_data_remove_callback(struct filter_data *data,
 {
 	data->callbacks = g_slist_remove(data->callbacks, cb);
 	data->processed = g_slist_remove(data->processed, cb);
+	g_hash_table_remove(watch_index, GUINT_TO_POINTER(cb->id));
 
 	/* Cancel pending operations */
 	if (cb->data) {
@@ -389,7 +476,7 @@ static gboolean filter_data_remove_callback(struct filter_data *data,
 	if (data->registered && !remove_match(data))
 		return FALSE;
 
-	listeners = g_slist_remove(listeners, data);
+	filter_data_unlink(data);
 	filter_data_free(data);
 
 	return TRUE;
@@ -428,11 +515,11 @@ static void update_name_cache(const char *name, const char *owner)
 {
 	GSList *l;
 
-	for (l = listeners; l != NULL; l = l->next) {
-		struct filter_data *data = l->data;
+	if (name_index == NULL)
+		return;
 
-		if (g_strcmp0(data->name, name) != 0)
-			continue;
+	for (l = g_hash_table_lookup(name_index, name); l; l = l->next) {
+		struct filter_data *data = l->data;
 
 		g_free(data->owner);
 		data->owner = g_strdup(owner);
@@ -443,16 +530,14 @@ static const char *check_name_cache(const char *name)
 {
 	GSList *l;
 
-	for (l = listeners; l != NULL; l = l->next) {
-		struct filter_data *data = l->data;
-
-		if (g_strcmp0(data->name, name) != 0)
-			continue;
+	if (name_index == NULL)
+		return NULL;
 
-		return data->owner;
-	}
+	l = g_hash_table_lookup(name_index, name);
+	if (l == NULL)
+		return NULL;
 
-	return NULL;
+	return ((struct filter_data *) l->data)->owner;
 }
 
 static DBusHandlerResult service_filter(DBusConnection *connection,
@@ -506,49 +591,54 @@ static DBusHandlerResult service_filter(DBusConnection *connection,
 }
 
 
-static DBusHandlerResult message_filter(DBusConnection *connection,
-					DBusMessage *message, void *user_data)
-{
-	struct filter_data *data;
-	const char *sender, *path, *iface, *member, *arg = NULL;
-	GSList *current, *delete_listener = NULL;
-
-	/* Only filter signals */
-	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+struct signal_info {
+	const char *sender;
+	const char *path;
+	const char *iface;
+	const char *member;
+	const char *arg;
+};
 
-	sender = dbus_message_get_sender(message);
-	path = dbus_message_get_path(message);
-	iface = dbus_message_get_interface(message);
-	member = dbus_message_get_member(message);
-	dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
+/*
+ * Filters removed by a handler are unlinked from the list being walked,
+ * which stays valid, only the filter being handled is locked and is left
+ * in place until the whole message has been dispatched.
+ */
+static GSList *dispatch_list(GSList *list, DBusConnection *connection,
+				DBusMessage *message,
+				const struct signal_info *info,
+				GSList *delete_listener)
+{
+	GSList *current;
 
 	/* If sender != NULL it is always the owner */
 
-	for (current = listeners; current != NULL; current = current->next) {
-		data = current->data;
+	for (current = list; current != NULL; current = current->next) {
+		struct filter_data *data = current->data;
 
 		if (connection != data->connection)
 			continue;
 
-		if (!sender && data->owner)
+		if (!info->sender && data->owner)
 			continue;
 
-		if (data->owner && g_str_equal(sender, data->owner) == FALSE)
+		if (data->owner && g_str_equal(info->sender,
+						data->owner) == FALSE)
 			continue;
 
-		if (data->path && g_str_equal(path, data->path) == FALSE)
+		if (data->path && g_str_equal(info->path, data->path) == FALSE)
 			continue;
 
-		if (data->interface && g_str_equal(iface,
+		if (data->interface && g_str_equal(info->iface,
 						data->interface) == FALSE)
 			continue;
 
-		if (data->member && g_str_equal(member, data->member) == FALSE)
+		if (data->member && g_str_equal(info->member,
+						data->member) == FALSE)
 			continue;
 
-		if (data->argument && g_str_equal(arg,
-						data->argument) == FALSE)
+		if (data->argument && g_strcmp0(info->arg,
+						data->argument) != 0)
 			continue;
 
 		if (data->handle_func) {
@@ -563,24 +653,61 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 
 		if (!data->callbacks)
 			delete_listener = g_slist_prepend(delete_listener,
-								current);
+									data);
 	}
 
+	return delete_listener;
+}
+
+static DBusHandlerResult message_filter(DBusConnection *connection,
+					DBusMessage *message, void *user_data)
+{
+	struct filter_data *data;
+	struct signal_info info = { NULL };
+	GSList *list, *current, *delete_listener = NULL;
+
+	/* Only filter signals */
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	info.sender = dbus_message_get_sender(message);
+	info.path = dbus_message_get_path(message);
+	info.iface = dbus_message_get_interface(message);
+	info.member = dbus_message_get_member(message);
+	dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &info.arg,
+							DBUS_TYPE_INVALID);
+
+	if (info.member && dispatch_index) {
+		list = g_hash_table_lookup(dispatch_index, info.member);
+		delete_listener = dispatch_list(list, connection, message,
+						&info, delete_listener);
+
+		if (info.arg) {
+			char *key = dispatch_key(info.member, info.arg);
+
+			list = g_hash_table_lookup(dispatch_index, key);
+			delete_listener = dispatch_list(list, connection,
+					message, &info, delete_listener);
+			g_free(key);
+		}
+	}
+
+	delete_listener = dispatch_list(wildcard_listeners, connection,
+					message, &info, delete_listener);
+
 	if (delete_listener == NULL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	for (current = delete_listener; current != NULL;
-					current = delete_listener->next) {
-		GSList *l = current->data;
-
-		data = l->data;
+						current = current->next) {
+		data = current->data;
 
 		/* Has any other callback added callbacks back to this data? */
 		if (data->callbacks != NULL)
 			continue;
 
 		remove_match(data);
-		listeners = g_slist_delete_link(listeners, l);
+		filter_data_unlink(data);
 
 		filter_data_free(data);
 	}
@@ -789,22 +916,21 @@ gboolean g_dbus_remove_watch(DBusConnection *connection, guint id)
 {
 	struct filter_data *data;
 	struct filter_callback *cb;
-	GSList *ldata;
 
-	if (id == 0)
+	if (id == 0 || watch_index == NULL)
 		return FALSE;
 
-	for (ldata = listeners; ldata; ldata = ldata->next) {
-		data = ldata->data;
+	data = g_hash_table_lookup(watch_index, GUINT_TO_POINTER(id));
+	if (data == NULL)
+		return FALSE;
 
-		cb = filter_data_find_callback(data, id);
-		if (cb) {
-			filter_data_remove_callback(data, cb);
-			return TRUE;
-		}
-	}
+	cb = filter_data_find_callback(data, id);
+	if (cb == NULL)
+		return FALSE;
 
-	return FALSE;
+	filter_data_remove_callback(data, cb);
+
+	return TRUE;
 }
 
 void g_dbus_remove_all_watches(DBusConnection *connection)
@@ -812,7 +938,7 @@ void g_dbus_remove_all_watches(DBusConnection *connection)
 	struct filter_data *data;
 
 	while ((data = filter_data_find(connection))) {
-		listeners = g_slist_remove(listeners, data);
+		filter_data_unlink(data);
 		filter_data_call_and_free(data);
 	}
 }
@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
@@ -45,9 +46,19 @@
 	if ((m) != NULL && (m)->debug != NULL)		\
 		m->debug("gisi: "fmt, ##__VA_ARGS__);
 
+/*
+ * Received messages are read in batches into a pool that is set up once
+ * per modem.  Slots fit the largest Phonet payload, pages that are never
+ * written to are never faulted in.
+ */
+#define ISI_RX_SLOTS		8
+#define ISI_RX_SLOT_SIZE	65536
+
 struct _GIsiServiceMux {
 	GIsiModem *modem;
-	GSList *pending;
+	GHashTable *transactions;	/* UTID to RESP */
+	GHashTable *handlers;		/* Message ID to list of REQ/IND/NTF */
+	GSList *pings;			/* COMMON version queries */
 	GIsiVersion version;
 	uint8_t resource;
 	uint8_t last_utid;
@@ -72,6 +83,12 @@ struct _GIsiModem {
 	GIsiNotifyFunc trace;
 	void *opaque;
 	unsigned long flags;
+	uint8_t *rx_buf;
+	struct iovec rx_iov[ISI_RX_SLOTS];
+	struct sockaddr_pn rx_addr[ISI_RX_SLOTS];
+	struct mmsghdr rx_msgs[ISI_RX_SLOTS];
+	gboolean in_dispatch;
+	gboolean destroyed;
 };
 
 struct _GIsiPending {
@@ -102,6 +119,8 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	g_hash_table_insert(modem->services, GINT_TO_POINTER(key), mux);
 
 	mux->modem = modem;
+	mux->transactions = g_hash_table_new(g_direct_hash, NULL);
+	mux->handlers = g_hash_table_new(g_direct_hash, NULL);
 	mux->resource = resource;
 	mux->version.major = -1;
 	mux->version.minor = -1;
@@ -111,12 +130,98 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	return mux;
 }
 
-static gint utid_equal(gconstpointer a, gconstpointer b)
+static void pending_link(GIsiPending *op)
+{
+	GIsiServiceMux *mux = op->service;
+	gpointer key;
+	GSList *list;
+
+	switch (op->type) {
+	case GISI_MESSAGE_TYPE_RESP:
+		key = GUINT_TO_POINTER(op->utid);
+		g_hash_table_insert(mux->transactions, key, op);
+		break;
+
+	case GISI_MESSAGE_TYPE_COMMON:
+		mux->pings = g_slist_prepend(mux->pings, op);
+		break;
+
+	default:
+		key = GUINT_TO_POINTER(op->msgid);
+		list = g_hash_table_lookup(mux->handlers, key);
+		list = g_slist_append(list, op);
+		g_hash_table_insert(mux->handlers, key, list);
+		break;
+	}
+}
+
+static void pending_unlink(GIsiPending *op)
+{
+	GIsiServiceMux *mux = op->service;
+	gpointer key;
+	GSList *list;
+
+	switch (op->type) {
+	case GISI_MESSAGE_TYPE_RESP:
+		key = GUINT_TO_POINTER(op->utid);
+
+		if (g_hash_table_lookup(mux->transactions, key) == op)
+			g_hash_table_remove(mux->transactions, key);
+		break;
+
+	case GISI_MESSAGE_TYPE_COMMON:
+		mux->pings = g_slist_remove(mux->pings, op);
+		break;
+
+	default:
+		key = GUINT_TO_POINTER(op->msgid);
+		list = g_hash_table_lookup(mux->handlers, key);
+		list = g_slist_remove(list, op);
+
+		if (list == NULL)
+			g_hash_table_remove(mux->handlers, key);
+		else
+			g_hash_table_insert(mux->handlers, key, list);
+		break;
+	}
+}
+
+static gboolean utid_busy(GIsiServiceMux *mux, uint8_t utid)
 {
-	const GIsiPending *pa = a;
-	const GIsiPending *pb = b;
+	GSList *l;
+
+	if (g_hash_table_contains(mux->transactions, GUINT_TO_POINTER(utid)))
+		return TRUE;
+
+	for (l = mux->pings; l != NULL; l = l->next) {
+		GIsiPending *ping = l->data;
+
+		if (ping->utid == utid)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static GSList *service_pending_list(GIsiServiceMux *mux)
+{
+	GSList *list = g_slist_copy(mux->pings);
+	GHashTableIter iter;
+	gpointer value;
+	GSList *l;
+
+	g_hash_table_iter_init(&iter, mux->transactions);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		list = g_slist_prepend(list, value);
+
+	g_hash_table_iter_init(&iter, mux->handlers);
 
-	return pa->utid - pb->utid;
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		for (l = value; l != NULL; l = l->next)
+			list = g_slist_prepend(list, l->data);
+
+	return list;
 }
 
 static const char *pend_type_to_str(enum GIsiMessageType type)
@@ -157,7 +262,7 @@ static void pending_remove_and_dispatch(GIsiPending *op, GIsiMessage *msg)
 {
 	GIsiModem *modem;
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
+	pending_unlink(op);
 
 	if (op->notify == NULL || msg == NULL)
 		goto destroy;
@@ -187,45 +292,55 @@ static void service_dispatch(GIsiServiceMux *mux, GIsiMessage *msg,
 {
 	uint8_t msgid = g_isi_msg_id(msg);
 	uint8_t utid = g_isi_msg_utid(msg);
+	GIsiPending *resp;
+	GSList *l;
 
-	GSList *l = mux->pending;
+	/*
+	 * REQs, NTFs and INDs are dispatched on message ID.  While
+	 * INDs have the unique transaction ID set to zero, NTFs
+	 * typically mirror the UTID of the request that set up the
+	 * session, and REQs can naturally have any transaction ID.
+	 */
+	l = g_hash_table_lookup(mux->handlers, GUINT_TO_POINTER(msgid));
 
 	while (l != NULL) {
 		GSList *next = l->next;
-		GIsiPending *pend = l->data;
 
-		/*
-		 * REQs, NTFs and INDs are dispatched on message ID.  While
-		 * INDs have the unique transaction ID set to zero, NTFs
-		 * typically mirror the UTID of the request that set up the
-		 * session, and REQs can naturally have any transaction ID.
-		 *
-		 * RESPs are dispatched on unique transaction ID, explicitly
-		 * ignoring the msgid.  A RESP also completes a transaction,
-		 * so it needs to be removed after being notified of.
-		 *
-		 * Version query responses are dispatched in a similar fashion
-		 * as RESPs, but based on the pending type and the message ID.
-		 * Some of these may be synthesized, but nevertheless need to
-		 * be removed.
-		 */
-		if (pend->type < GISI_MESSAGE_TYPE_RESP
-				&& pend->msgid == msgid) {
+		pending_dispatch(l->data, msg);
+		l = next;
+	}
 
-			pending_dispatch(pend, msg);
+	/*
+	 * RESPs are dispatched on unique transaction ID, explicitly
+	 * ignoring the msgid.  A RESP also completes a transaction,
+	 * so it needs to be removed after being notified of.
+	 */
+	if (!is_indication) {
+		resp = g_hash_table_lookup(mux->transactions,
+						GUINT_TO_POINTER(utid));
+		if (resp != NULL) {
+			pending_remove_and_dispatch(resp, msg);
+			return;
+		}
+	}
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_RESP &&
-				!is_indication && pend->utid == utid) {
+	/*
+	 * Version query responses are dispatched in a similar fashion
+	 * as RESPs, but based on the pending type and the message ID.
+	 * Some of these may be synthesized, but nevertheless need to
+	 * be removed.
+	 */
+	if (msgid != COMMON_MESSAGE)
+		return;
 
-			pending_remove_and_dispatch(pend, msg);
-			break;
+	l = mux->pings;
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_COMMON &&
-				msgid == COMMON_MESSAGE &&
-				pend->msgid == COMM_ISI_VERSION_GET_REQ) {
+	while (l != NULL) {
+		GSList *next = l->next;
+		GIsiPending *pend = l->data;
 
+		if (pend->msgid == COMM_ISI_VERSION_GET_REQ)
 			pending_remove_and_dispatch(pend, msg);
-		}
 
 		l = next;
 	}
@@ -279,62 +394,93 @@ static void firewall_notify_handle(GIsiModem *modem, GIsiMessage *msg)
 	ISIDBG(modem, "firewall blocked message 0x%02X", id);
 }
 
+static void isi_message_handle(GIsiModem *modem, const void *buf,
+				size_t len, struct sockaddr_pn *addr,
+				gboolean is_indication)
+{
+	GIsiServiceMux *mux;
+	GIsiMessage msg;
+	unsigned key;
+
+	if (len < 2)
+		return;
+
+	msg.addr = addr;
+	msg.error = 0;
+	msg.data = buf;
+	msg.len = len;
+
+	if (modem->trace != NULL)
+		modem->trace(&msg, NULL);
+
+	key = addr->spn_resource;
+	mux = g_hash_table_lookup(modem->services, GINT_TO_POINTER(key));
+	if (mux == NULL) {
+		/*
+		 * Unfortunately, the FW report has the wrong
+		 * resource ID in the N900 modem.
+		 */
+		if (key == PN_FIREWALL)
+			firewall_notify_handle(modem, &msg);
+
+		return;
+	}
+
+	msg.version = &mux->version;
+
+	if (g_isi_msg_id(&msg) == COMMON_MESSAGE)
+		common_message_decode(mux, &msg);
+
+	service_dispatch(mux, &msg, is_indication);
+}
+
+static void modem_free(GIsiModem *modem)
+{
+	g_free(modem->rx_buf);
+	g_free(modem);
+}
+
 static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
 	GIsiModem *modem = data;
-	int len;
-	int fd;
+	gboolean is_indication;
+	int count;
+	int i;
 
 	if (cond & (G_IO_NVAL|G_IO_HUP)) {
 		ISIDBG(modem, "Unexpected event on PhoNet channel %p", channel);
 		return FALSE;
 	}
 
-	fd = g_io_channel_unix_get_fd(channel);
-	len = g_isi_phonet_peek_length(channel);
+	is_indication = g_io_channel_unix_get_fd(channel) == modem->ind_fd;
 
-	if (len > 0) {
-		struct sockaddr_pn addr;
-		uint32_t buf[(len + 3) / 4];
+	count = g_isi_phonet_read_batch(channel, modem->rx_msgs,
+					ISI_RX_SLOTS);
+	if (count <= 0)
+		return TRUE;
 
-		GIsiServiceMux *mux;
-		GIsiMessage msg;
-		unsigned key;
+	/* A handler may destroy the modem, stop with the rest unread */
+	modem->in_dispatch = TRUE;
 
-		len = g_isi_phonet_read(channel, buf, len, &addr);
-		if (len < 2)
-			return TRUE;
-
-		msg.addr = &addr;
-		msg.error = 0;
-		msg.data = buf;
-		msg.len = len;
-
-		if (modem->trace != NULL)
-			modem->trace(&msg, NULL);
-
-		key = addr.spn_resource;
-		mux = g_hash_table_lookup(modem->services,
-						GINT_TO_POINTER(key));
-		if (mux == NULL) {
-			/*
-			 * Unfortunately, the FW report has the wrong
-			 * resource ID in the N900 modem.
-			 */
-			if (key == PN_FIREWALL)
-				firewall_notify_handle(modem, &msg);
+	for (i = 0; i < count && !modem->destroyed; i++) {
+		struct msghdr *hdr = &modem->rx_msgs[i].msg_hdr;
 
-			return TRUE;
+		if (hdr->msg_flags & MSG_TRUNC) {
+			ISIDBG(modem, "Dropping truncated message");
+			continue;
 		}
 
-		msg.version = &mux->version;
+		isi_message_handle(modem, hdr->msg_iov->iov_base,
+					modem->rx_msgs[i].msg_len,
+					hdr->msg_name, is_indication);
+	}
 
-		if (g_isi_msg_id(&msg) == COMMON_MESSAGE)
-			common_message_decode(mux, &msg);
+	modem->in_dispatch = FALSE;
+
+	if (modem->destroyed)
+		modem_free(modem);
 
-		service_dispatch(mux, &msg, fd == modem->ind_fd);
-	}
 	return TRUE;
 }
 
@@ -457,10 +603,16 @@ static void pending_destroy(gpointer value, gpointer user)
 	g_free(op);
 }
 
+static void handlers_free(gpointer key, gpointer value, gpointer user_data)
+{
+	g_slist_free(value);
+}
+
 static void service_finalize(gpointer value)
 {
 	GIsiServiceMux *mux = value;
 	GIsiModem *modem = mux->modem;
+	GSList *pending;
 
 	if (mux->subscriptions > 0)
 		modem_subs_update_when_idle(modem);
@@ -468,8 +620,14 @@ static void service_finalize(gpointer value)
 	if (mux->registrations > 0)
 		service_name_deregister(mux);
 
-	g_slist_foreach(mux->pending, pending_destroy, NULL);
-	g_slist_free(mux->pending);
+	pending = service_pending_list(mux);
+	g_slist_foreach(pending, pending_destroy, NULL);
+	g_slist_free(pending);
+
+	g_hash_table_foreach(mux->handlers, handlers_free, NULL);
+	g_hash_table_unref(mux->handlers);
+	g_hash_table_unref(mux->transactions);
+	g_slist_free(mux->pings);
 	g_free(mux);
 }
 
@@ -478,6 +636,7 @@ GIsiModem *g_isi_modem_create(unsigned index)
 	GIsiModem *modem;
 	GIOChannel *inds;
 	GIOChannel *reqs;
+	unsigned int i;
 
 	if (index == 0) {
 		errno = ENODEV;
@@ -490,11 +649,30 @@ GIsiModem *g_isi_modem_create(unsigned index)
 		return NULL;
 	}
 
+	modem->rx_buf = g_try_malloc(ISI_RX_SLOTS * ISI_RX_SLOT_SIZE);
+	if (modem->rx_buf == NULL) {
+		g_free(modem);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (i = 0; i < ISI_RX_SLOTS; i++) {
+		struct msghdr *hdr = &modem->rx_msgs[i].msg_hdr;
+
+		modem->rx_iov[i].iov_base = modem->rx_buf +
+						i * ISI_RX_SLOT_SIZE;
+		modem->rx_iov[i].iov_len = ISI_RX_SLOT_SIZE;
+
+		hdr->msg_name = &modem->rx_addr[i];
+		hdr->msg_iov = &modem->rx_iov[i];
+		hdr->msg_iovlen = 1;
+	}
+
 	inds = g_isi_phonet_new(index);
 	reqs = g_isi_phonet_new(index);
 
 	if (inds == NULL || reqs == NULL) {
-		g_free(modem);
+		modem_free(modem);
 		return NULL;
 	}
 
@@ -650,7 +828,12 @@ void g_isi_modem_destroy(GIsiModem *modem)
 	if (modem->req_watch > 0)
 		g_source_remove(modem->req_watch);
 
-	g_free(modem);
+	if (modem->in_dispatch) {
+		modem->destroyed = TRUE;
+		return;
+	}
+
+	modem_free(modem);
 }
 
 unsigned g_isi_modem_index(GIsiModem *modem)
@@ -784,7 +967,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	resp->destroy = destroy;
 	resp->data = data;
 
-	if (g_slist_find_custom(mux->pending, resp, utid_equal)) {
+	if (utid_busy(mux, resp->utid)) {
 		/*
 		 * FIXME: perhaps retry with randomized access after
 		 * initial miss. Although if the rate at which
@@ -817,7 +1000,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 		goto error;
 	}
 
-	mux->pending = g_slist_prepend(mux->pending, resp);
+	pending_link(resp);
 
 	if (timeout > 0)
 		resp->timeout = g_timeout_add_seconds(timeout, resp_timeout,
@@ -856,7 +1039,7 @@ void g_isi_pending_remove(GIsiPending *op)
 		return;
 	}
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
+	pending_unlink(op);
 
 	pending_destroy(op, NULL);
 }
@@ -892,8 +1075,8 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 					gpointer owner)
 {
 	GIsiServiceMux *mux;
+	GSList *pending;
 	GSList *l;
-	GSList *next;
 	GIsiPending *op;
 	GSList *owned = NULL;
 
@@ -901,19 +1084,20 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 	if (mux == NULL)
 		return;
 
-	for (l = mux->pending; l != NULL; l = next) {
-		next = l->next;
+	pending = service_pending_list(mux);
+
+	for (l = pending; l != NULL; l = l->next) {
 		op = l->data;
 
 		if (op->owner != owner)
 			continue;
 
-		mux->pending = g_slist_remove_link(mux->pending, l);
-
-		l->next = owned;
-		owned = l;
+		pending_unlink(op);
+		owned = g_slist_prepend(owned, op);
 	}
 
+	g_slist_free(pending);
+
 	for (l = owned; l != NULL; l = l->next) {
 		op = l->data;
 
@@ -949,7 +1133,7 @@ GIsiPending *g_isi_ntf_subscribe(GIsiModem *modem, uint8_t resource,
 	ntf->destroy = destroy;
 	ntf->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, ntf);
+	pending_link(ntf);
 
 	ISIDBG(modem, "Subscribed to %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(ntf->type), ntf, resource, msgid);
@@ -983,7 +1167,7 @@ GIsiPending *g_isi_service_bind(GIsiModem *modem, uint8_t resource,
 	srv->destroy = destroy;
 	srv->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, srv);
+	pending_link(srv);
 
 	ISIDBG(modem, "Bound service for %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(srv->type), srv, resource, msgid);
@@ -1019,7 +1203,7 @@ GIsiPending *g_isi_ind_subscribe(GIsiModem *modem, uint8_t resource,
 	ind->destroy = destroy;
 	ind->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, ind);
+	pending_link(ind);
 
 	ISIDBG(modem, "Subscribed for %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(ind->type), ind, resource, msgid);
@@ -1167,7 +1351,7 @@ static int version_get_send(GIsiModem *modem, GIsiPending *ping)
 	};
 	ssize_t ret;
 
-	if (g_slist_find_custom(mux->pending, ping, utid_equal))
+	if (utid_busy(mux, ping->utid))
 		return -EBUSY;
 
 	ret = sendto(modem->req_fd, msg, sizeof(msg), MSG_NOSIGNAL,
@@ -1249,7 +1433,7 @@ GIsiPending *g_isi_resource_ping(GIsiModem *modem, uint8_t resource,
 
 	ping->timeout = g_timeout_add_seconds(COMMON_TIMEOUT, resp_timeout,
 						ping);
-	mux->pending = g_slist_prepend(mux->pending, ping);
+	pending_link(ping);
 	mux->version_pending = TRUE;
 
 	ISIDBG(modem, "Ping sent %s (%p) [res=0x%02X]",
@@ -122,6 +122,8 @@ struct _GIsiPipe {
 	uint8_t handle;
 	gboolean enabled;
 	gboolean enabling;
+	gint64 sent;	/* When the pending request went out */
+	GIsiPipeStats stats;
 };
 
 static int g_isi_pipe_error(enum pn_pipe_error code)
@@ -163,6 +165,7 @@ static void g_isi_pipe_handle_error(GIsiPipe *pipe, uint8_t code)
 		return;
 
 	pipe->error = err;
+	pipe->stats.errors++;
 
 	if (pipe->error_handler)
 		pipe->error_handler(pipe);
@@ -191,6 +194,7 @@ static void g_isi_pipe_created(const GIsiMessage *msg, void *data)
 	}
 
 	pipe->handle = resp->pipe_handle;
+	pipe->stats.create_usec = g_get_monotonic_time() - pipe->sent;
 
 	if (pipe->enabling)
 		g_isi_pipe_start(pipe);
@@ -246,10 +250,13 @@ GIsiPipe *g_isi_pipe_create(GIsiModem *modem, GIsiPipeHandler cb, uint16_t obj1,
 	pipe->enabling = FALSE;
 	pipe->enabled = FALSE;
 	pipe->handle = PN_PIPE_INVALID_HANDLE;
+	pipe->sent = g_get_monotonic_time();
 
 	if (g_isi_client_send(pipe->client, &msg, len,
-					g_isi_pipe_created, pipe, NULL))
+					g_isi_pipe_created, pipe, NULL)) {
+		pipe->stats.requests++;
 		return pipe;
+	}
 
 	g_isi_client_destroy(pipe->client);
 	g_free(pipe);
@@ -281,8 +288,10 @@ static void g_isi_pipe_enabled(const GIsiMessage *msg, void *data)
 
 	pipe->enabling = FALSE;
 
-	if (!pipe->error)
+	if (!pipe->error) {
 		pipe->enabled = TRUE;
+		pipe->stats.enable_usec = g_get_monotonic_time() - pipe->sent;
+	}
 }
 
 static void g_isi_pipe_enable(GIsiPipe *pipe)
@@ -293,8 +302,11 @@ static void g_isi_pipe_enable(GIsiPipe *pipe)
 	};
 	size_t len = sizeof(msg);
 
-	g_isi_client_send(pipe->client, &msg, len,
-				g_isi_pipe_enabled, pipe, NULL);
+	pipe->sent = g_get_monotonic_time();
+
+	if (g_isi_client_send(pipe->client, &msg, len,
+				g_isi_pipe_enabled, pipe, NULL))
+		pipe->stats.requests++;
 }
 
 /**
@@ -352,8 +364,9 @@ static void g_isi_pipe_remove(GIsiPipe *pipe)
 	};
 	size_t len = sizeof(msg);
 
-	g_isi_client_send(pipe->client, &msg, len,
-				g_isi_pipe_removed, pipe, NULL);
+	if (g_isi_client_send(pipe->client, &msg, len,
+				g_isi_pipe_removed, pipe, NULL))
+		pipe->stats.requests++;
 }
 
 /**
@@ -403,3 +416,14 @@ uint8_t g_isi_pipe_get_handle(GIsiPipe *pipe)
 {
 	return pipe->handle;
 }
+
+/**
+ * Return the pipe counters.
+ * @param pipe pipe as returned from g_isi_pipe_create()
+ * @return counters of the PNS requests made for the pipe, round trip
+ * times are zero until the matching response is received.
+ */
+const GIsiPipeStats *g_isi_pipe_get_stats(const GIsiPipe *pipe)
+{
+	return &pipe->stats;
+}
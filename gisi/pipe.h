@@ -29,6 +29,14 @@ extern "C" {
 struct _GIsiPipe;
 typedef struct _GIsiPipe GIsiPipe;
 
+struct _GIsiPipeStats {
+	unsigned int requests;		/* PNS requests sent */
+	unsigned int errors;		/* Failed or timed out responses */
+	unsigned int create_usec;	/* PNS_PIPE_CREATE round trip */
+	unsigned int enable_usec;	/* PNS_PIPE_ENABLE round trip */
+};
+typedef struct _GIsiPipeStats GIsiPipeStats;
+
 typedef void (*GIsiPipeHandler)(GIsiPipe *pipe);
 typedef void (*GIsiPipeErrorHandler)(GIsiPipe *pipe);
 
@@ -41,6 +49,7 @@ int g_isi_pipe_get_error(const GIsiPipe *pipe);
 void *g_isi_pipe_set_userdata(GIsiPipe *pipe, void *data);
 void *g_isi_pipe_get_userdata(GIsiPipe *pipe);
 uint8_t g_isi_pipe_get_handle(GIsiPipe *pipe);
+const GIsiPipeStats *g_isi_pipe_get_stats(const GIsiPipe *pipe);
 
 int g_isi_pipe_start(GIsiPipe *pipe);
 
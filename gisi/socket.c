@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -94,3 +95,21 @@ ssize_t g_isi_phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 
 	return ret;
 }
+
+/*
+ * Reads up to count queued datagrams without blocking.  The caller sets
+ * up each msg_hdr with one buffer and a sockaddr_pn name.
+ */
+int g_isi_phonet_read_batch(GIOChannel *channel, struct mmsghdr *msgs,
+				unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_pn);
+		msgs[i].msg_hdr.msg_flags = 0;
+	}
+
+	return recvmmsg(g_io_channel_unix_get_fd(channel), msgs, count,
+			MSG_DONTWAIT, NULL);
+}
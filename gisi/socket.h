@@ -23,3 +23,5 @@ GIOChannel *g_isi_phonet_new(unsigned int ifindex);
 size_t g_isi_phonet_peek_length(GIOChannel *io);
 ssize_t g_isi_phonet_read(GIOChannel *io, void *restrict buf, size_t len,
 				struct sockaddr_pn *addr);
+int g_isi_phonet_read_batch(GIOChannel *io, struct mmsghdr *msgs,
+				unsigned int count);
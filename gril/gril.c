@@ -82,6 +82,7 @@ struct ril_s {
 	GRilIO *io;				/* GRil IO */
 	GQueue *command_queue;			/* Command queue */
 	GQueue *out_queue;			/* Commands sent/been sent */
+	GHashTable *pending;			/* Serial to command link */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
@@ -96,6 +97,8 @@ struct ril_s {
 	gboolean in_notify;
 	enum ofono_ril_vendor vendor;
 	int slot;
+	guint signal_interval;			/* Min ms between strengths */
+	guint cell_info_rate;			/* Min ms between cell lists */
 	GRilMsgIdToStrFunc req_to_string;
 	GRilMsgIdToStrFunc unsol_to_string;
 };
@@ -256,7 +259,8 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	if (rilp != NULL)
 		data_len = rilp->size;
 
-	r = g_try_new0(struct ril_request, 1);
+	/* The wire data follows the request, in the same allocation */
+	r = g_try_malloc0(sizeof(*r) + sizeof(header) + data_len);
 	if (r == NULL) {
 		ofono_error("%s Out of memory", __func__);
 		return NULL;
@@ -264,13 +268,7 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 
 	/* Full request size: header size plus buffer length */
 	r->data_len = data_len + sizeof(header);
-
-	r->data = g_try_new(char, r->data_len);
-	if (r->data == NULL) {
-		ofono_error("ril_request: can't allocate new request.");
-		g_free(r);
-		return NULL;
-	}
+	r->data = (gchar *) (r + 1);
 
 	/* Length does not include the length field. Network order. */
 	header.length = htonl(r->data_len - sizeof(header.length));
@@ -298,7 +296,6 @@ static void ril_request_destroy(struct ril_request *req)
 	if (req->notify)
 		req->notify(req->user_data);
 
-	g_free(req->data);
 	g_free(req);
 }
 
@@ -316,6 +313,11 @@ static void ril_cleanup(struct ril_s *p)
 		p->out_queue = NULL;
 	}
 
+	if (p->pending) {
+		g_hash_table_destroy(p->pending);
+		p->pending = NULL;
+	}
+
 	/* Cleanup registered notifications */
 	if (p->notify_list) {
 		g_hash_table_destroy(p->notify_list);
@@ -351,60 +353,44 @@ static void io_disconnect(gpointer user_data)
 
 static void handle_response(struct ril_s *p, struct ril_msg *message)
 {
-	guint count = g_queue_get_length(p->command_queue);
+	GList *link = g_hash_table_lookup(p->pending,
+					GINT_TO_POINTER(message->serial_no));
 	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
-
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
-
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
-
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
 
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
-
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	if (link == NULL) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			len = g_queue_get_length(p->out_queue);
+	req = link->data;
+	message->req = req->req;
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
+			request_id_to_string(p, message->req),
+			ril_error_to_string(message->error));
 
-			ril_request_destroy(req);
+	g_hash_table_remove(p->pending, GINT_TO_POINTER(req->id));
+	g_queue_delete_link(p->command_queue, link);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			break;
-		}
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed) {
+		ril_request_destroy(req);
+		return;
 	}
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	g_queue_remove(p->out_queue, GINT_TO_POINTER(req->id));
 
+	ril_request_destroy(req);
+
+	if (g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -458,9 +444,14 @@ static void dispatch(struct ril_s *p, struct ril_msg *message)
 {
 	int32_t *unsolicited_field, *id_num_field;
 	gchar *bufp = message->buf;
-	gchar *datap;
 	gsize data_len;
 
+	if (message->buf_len < 8) {
+		ofono_error("RIL record too short (%u), dropped",
+				message->buf_len);
+		return;
+	}
+
 	/* This could be done with a struct/union... */
 	unsolicited_field = (int32_t *) (void *) bufp;
 	if (*unsolicited_field)
@@ -481,6 +472,12 @@ static void dispatch(struct ril_s *p, struct ril_msg *message)
 		 */
 		data_len = message->buf_len - 8;
 	} else {
+		if (message->buf_len < 12) {
+			ofono_error("RIL response too short (%u), dropped",
+					message->buf_len);
+			return;
+		}
+
 		message->serial_no = (int) *id_num_field;
 
 		bufp += 4;
@@ -499,45 +496,22 @@ static void dispatch(struct ril_s *p, struct ril_msg *message)
 	bufp += 4;
 
 	/*
-	 * Now, use buffer for event data if present
+	 * The event data is left where it is, the record is only drained
+	 * from the ring buffer once dispatched.  No data is flagged with
+	 * a NULL buffer.
 	 */
-	if (data_len) {
-		datap = g_try_malloc(data_len);
-		if (datap == NULL)
-			goto error;
-
-		/* Copy event bytes from message->buf into new buffer */
-		memcpy(datap, bufp, data_len);
-
-		/* Free buffer that includes header */
-		g_free(message->buf);
-
-		/* ...and replace with new buffer */
-		message->buf = datap;
-		message->buf_len = data_len;
-	} else {
-		/* Free buffer that includes header */
-		g_free(message->buf);
-
-		/* To know if there was no data when parsing */
-		message->buf = NULL;
-		message->buf_len = 0;
-	}
+	message->buf = data_len ? bufp : NULL;
+	message->buf_len = data_len;
 
 	if (message->unsolicited == TRUE)
 		handle_unsol_req(p, message);
 	else
 		handle_response(p, message);
-
-error:
-	g_free(message->buf);
-	g_free(message);
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+static gboolean read_fixed_record(struct ril_s *p, const guchar *bytes,
+					gsize *len, struct ril_msg *message)
 {
-	struct ril_msg *message;
 	unsigned message_len, plen;
 
 	/* First four bytes are length in TCP byte order (Big Endian) */
@@ -562,30 +536,26 @@ static struct ril_msg *read_fixed_record(struct ril_s *p,
 
 	/*
 	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
+	 * then return FALSE & leave ringbuffer as is.
 	 */
 
 	message_len = *len - 4;
 	if (message_len < plen)
-		return NULL;
-
-	message = g_malloc(sizeof(struct ril_msg));
+		return FALSE;
 
-	/* allocate ril_msg->buffer */
+	/* The message points into the ring buffer, nothing is copied */
+	memset(message, 0, sizeof(*message));
+	message->buf = (gchar *) bytes;
 	message->buf_len = plen;
-	message->buf = g_malloc(plen);
-
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
 
 	/* Indicate to caller size of record we extracted */
 	*len = plen + 4;
-	return message;
+	return TRUE;
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
+	struct ril_msg message;
 	struct ril_s *p = user_data;
 	unsigned int len = ring_buffer_len(rbuf);
 	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
@@ -604,14 +574,11 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		/*
 		 * This function attempts to read the next full length
 		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
+		 * available, it returns FALSE.  otherwise it fills in
+		 * a ril_message pointing at the record, whose bytes are
+		 * drained from the ring_buffer after dispatch
 		 */
-		message = read_fixed_record(p, buf, &rbytes);
-
-		/* wait for the rest of the record... */
-		if (message == NULL)
+		if (read_fixed_record(p, buf, &rbytes, &message) == FALSE)
 			break;
 
 		buf += rbytes;
@@ -623,7 +590,7 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 			wrap = len;
 		}
 
-		dispatch(p, message);
+		dispatch(p, &message);
 
 		ring_buffer_drain(rbuf, p->read_so_far);
 
@@ -888,6 +855,8 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
+	ril->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
 							ril_notify_destroy);
@@ -956,6 +925,7 @@ static void ril_cancel_group(struct ril_s *ril, guint group)
 		if (sent)
 			continue;
 
+		g_hash_table_remove(ril->pending, GINT_TO_POINTER(req->id));
 		g_queue_remove(ril->command_queue, req);
 		ril_request_destroy(req);
 	}
@@ -1151,6 +1121,8 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 	p->next_cmd_id++;
 
 	g_queue_push_tail(p->command_queue, r);
+	g_hash_table_insert(p->pending, GINT_TO_POINTER(r->id),
+				g_queue_peek_tail_link(p->command_queue));
 
 	ril_wakeup_writer(p);
 
@@ -1216,6 +1188,33 @@ int g_ril_get_slot(GRil *ril)
 	return ril->parent->slot;
 }
 
+gboolean g_ril_set_report_intervals(GRil *ril, unsigned int signal_ms,
+						unsigned int cell_info_ms)
+{
+	if (ril == NULL || ril->parent == NULL)
+		return FALSE;
+
+	ril->parent->signal_interval = signal_ms;
+	ril->parent->cell_info_rate = cell_info_ms;
+	return TRUE;
+}
+
+unsigned int g_ril_get_signal_interval(GRil *ril)
+{
+	if (ril == NULL)
+		return 0;
+
+	return ril->parent->signal_interval;
+}
+
+unsigned int g_ril_get_cell_info_rate(GRil *ril)
+{
+	if (ril == NULL)
+		return 0;
+
+	return ril->parent->cell_info_rate;
+}
+
 gboolean g_ril_set_debugf(GRil *ril,
 			GRilDebugFunc func, gpointer user_data)
 {
@@ -131,6 +131,16 @@ gboolean g_ril_set_trace(GRil *ril, gboolean trace);
 int g_ril_get_slot(GRil *ril);
 gboolean g_ril_set_slot(GRil *ril, int slot);
 
+/*!
+ * Minimum intervals in milliseconds at which the drivers pass signal
+ * strength and cell information reports on, 0 for every change.  Shared
+ * by all the clones of ril.
+ */
+gboolean g_ril_set_report_intervals(GRil *ril, unsigned int signal_ms,
+						unsigned int cell_info_ms);
+unsigned int g_ril_get_signal_interval(GRil *ril);
+unsigned int g_ril_get_cell_info_rate(GRil *ril);
+
 /*!
  * If the function is not NULL, then on every read/write from the GIOChannel
  * provided to GRil the logging function will be called with the
@@ -46,20 +46,45 @@
 
 typedef uint16_t char16_t;
 
-void parcel_init(struct parcel *p)
+/*
+ * Room for the common requests, most are a handful of integers and short
+ * strings and are then built without reallocating
+ */
+#define PARCEL_DEFAULT_SIZE 128
+
+void parcel_init_sized(struct parcel *p, size_t size)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	if (size < sizeof(int32_t))
+		size = sizeof(int32_t);
+
+	p->data = g_malloc0(size);
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
+	p->capacity = size;
 	p->offset = 0;
 	p->malformed = 0;
 }
 
+void parcel_init(struct parcel *p)
+{
+	parcel_init_sized(p, PARCEL_DEFAULT_SIZE);
+}
+
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = p->capacity * 2;
+
+	/* Grow geometrically so that appending stays amortized O(1) */
+	if (capacity < p->capacity + size)
+		capacity = p->capacity + size;
+
+	p->data = g_realloc(p->data, capacity);
+	p->capacity = capacity;
+}
+
+static void parcel_reserve(struct parcel *p, size_t len)
+{
+	if (p->offset + len > p->capacity)
+		parcel_grow(p, p->offset + len - p->capacity);
 }
 
 void parcel_free(struct parcel *p)
@@ -90,79 +115,60 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
-
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
-		}
-	}
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+
 	return 0;
 }
 
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
-	size_t len;
-	size_t gs16_size;
+	const char *end;
+	const char *s;
+	char16_t *dst;
+	size_t len16 = 0;
+	size_t padded;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	/* Only the valid UTF-8 prefix is sent, the rest is discarded */
+	g_utf8_validate(str, -1, &end);
 
-	if (parcel_w_int32(p, gs16_len) == -1)
-		return -1;
+	for (s = str; s < end; s = g_utf8_next_char(s))
+		len16 += g_utf8_get_char(s) > 0xffff ? 2 : 1;
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	/* Length, UTF-16 units and NUL, padded to 4 bytes */
+	padded = PAD_SIZE((len16 + 1) * sizeof(char16_t));
+	parcel_reserve(p, sizeof(int32_t) + padded);
+
+	parcel_w_int32(p, len16);
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	/* Encode straight into the parcel, surrogate pairs above the BMP */
+	dst = (char16_t *) (void *) (p->data + p->offset);
 
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
-		}
+	for (s = str; s < end; s = g_utf8_next_char(s)) {
+		gunichar c = g_utf8_get_char(s);
+
+		if (c > 0xffff) {
+			c -= 0x10000;
+			*dst++ = 0xd800 + (c >> 10);
+			*dst++ = 0xdc00 + (c & 0x3ff);
+		} else
+			*dst++ = c;
 	}
 
-	g_free(gs16);
+	/* The terminator and the padding are zeroed */
+	memset(dst, 0, padded - len16 * sizeof(char16_t));
+
+	p->offset += padded;
+	p->size += padded;
+
 	return 0;
 }
 
@@ -220,6 +226,133 @@ void parcel_skip_string(struct parcel *p)
 	p->offset += strbytes;
 }
 
+int parcel_r_str(struct parcel *p, struct parcel_str *str)
+{
+	int len16 = parcel_r_int32(p);
+	size_t strbytes;
+
+	str->data = NULL;
+	str->len = 0;
+
+	if (p->malformed)
+		return -1;
+
+	/* This is how a null string is sent */
+	if (len16 < 0)
+		return 0;
+
+	strbytes = PAD_SIZE((len16 + 1) * sizeof(char16_t));
+	if (p->offset + strbytes > p->size) {
+		ofono_error("%s: parcel is too small", __func__);
+		p->malformed = 1;
+		return -1;
+	}
+
+	str->data = (const uint16_t *) (void *) (p->data + p->offset);
+	str->len = len16;
+	p->offset += strbytes;
+
+	return 0;
+}
+
+int parcel_r_str_array(struct parcel *p, struct parcel_str *strs, int max)
+{
+	int num_str = parcel_r_int32(p);
+	int i;
+
+	if (p->malformed || num_str < 0)
+		return -1;
+
+	for (i = 0; i < num_str; i++) {
+		if (i < max)
+			parcel_r_str(p, &strs[i]);
+		else
+			parcel_skip_string(p);
+	}
+
+	if (p->malformed)
+		return -1;
+
+	return num_str < max ? num_str : max;
+}
+
+int parcel_str_equal(const struct parcel_str *str, const char *ascii)
+{
+	int i;
+
+	if (str->data == NULL)
+		return ascii == NULL;
+
+	if (ascii == NULL)
+		return 0;
+
+	for (i = 0; i < str->len; i++)
+		if (ascii[i] == '\0' || str->data[i] != (unsigned char) ascii[i])
+			return 0;
+
+	return ascii[i] == '\0';
+}
+
+int parcel_str_to_int(const struct parcel_str *str, int base, int *out)
+{
+	char buf[24];
+	char *end;
+	int i;
+
+	if (str->data == NULL || str->len == 0 ||
+			(size_t) str->len >= sizeof(buf))
+		return -1;
+
+	/* Numbers are plain ASCII, anything else can't parse */
+	for (i = 0; i < str->len; i++) {
+		if (str->data[i] == 0 || str->data[i] > 0x7f)
+			return -1;
+
+		buf[i] = str->data[i];
+	}
+
+	buf[i] = '\0';
+
+	*out = strtoul(buf, &end, base);
+	if (end == buf || *end != '\0')
+		return -1;
+
+	return 0;
+}
+
+int parcel_str_copy(const struct parcel_str *str, char *buf, size_t size)
+{
+	size_t n = 0;
+	int i;
+
+	if (str->data == NULL || size == 0)
+		return -1;
+
+	for (i = 0; i < str->len; i++) {
+		gunichar c = str->data[i];
+		int clen;
+
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < str->len &&
+				str->data[i + 1] >= 0xdc00 &&
+				str->data[i + 1] < 0xe000) {
+			c = 0x10000 + ((c - 0xd800) << 10) +
+						(str->data[i + 1] - 0xdc00);
+			i += 1;
+		} else if (c >= 0xd800 && c < 0xe000)
+			return -1;
+
+		clen = g_unichar_to_utf8(c, NULL);
+		if (n + clen >= size)
+			return -1;
+
+		n += g_unichar_to_utf8(c, buf + n);
+	}
+
+	buf[n] = '\0';
+
+	return n;
+}
+
 int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 {
 	if (data == NULL) {
@@ -227,21 +360,14 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 		return 0;
 	}
 
+	parcel_reserve(p, sizeof(int32_t) + len);
+
 	parcel_w_int32(p, len);
 
-	for (;;) {
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
+
 	return 0;
 }
 
@@ -33,7 +33,21 @@ struct parcel {
 	int malformed;
 };
 
+/*
+ * A UTF-16 string borrowed from a parcel, valid for as long as the parcel
+ * data is.  data is NULL for a null string.
+ */
+struct parcel_str {
+	const uint16_t *data;
+	int len;
+};
+
+/* Bytes a string of len UTF-16 units takes in a parcel, length included */
+#define PARCEL_STRING_SIZE(len) \
+	(sizeof(int32_t) + ((((len) + 1) * sizeof(uint16_t) + 3) & ~3))
+
 void parcel_init(struct parcel *p);
+void parcel_init_sized(struct parcel *p, size_t size);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
@@ -46,4 +60,15 @@ void *parcel_r_raw(struct parcel *p,  int *len);
 size_t parcel_data_avail(struct parcel *p);
 char **parcel_r_strv(struct parcel *p);
 
+/*
+ * Reads without allocating or transcoding.  parcel_r_str_array takes a
+ * string array, keeping at most max strings and skipping the rest, and
+ * returns how many were kept or -1 if the parcel is malformed.
+ */
+int parcel_r_str(struct parcel *p, struct parcel_str *str);
+int parcel_r_str_array(struct parcel *p, struct parcel_str *strs, int max);
+int parcel_str_equal(const struct parcel_str *str, const char *ascii);
+int parcel_str_to_int(const struct parcel_str *str, int base, int *out);
+int parcel_str_copy(const struct parcel_str *str, char *buf, size_t size);
+
 #endif
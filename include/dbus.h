@@ -53,6 +53,10 @@ extern "C" {
 #define OFONO_NETMON_AGENT_INTERFACE OFONO_SERVICE ".NetworkMonitorAgent"
 #define OFONO_LTE_INTERFACE OFONO_SERVICE ".LongTermEvolution"
 #define OFONO_IMS_INTERFACE OFONO_SERVICE ".IpMultimediaSystem"
+#define OFONO_AT_DEBUG_INTERFACE OFONO_SERVICE ".AtDebug"
+#define OFONO_DATA_FAILOVER_INTERFACE OFONO_SERVICE ".DataFailover"
+#define OFONO_TELEMETRY_INTERFACE OFONO_SERVICE ".Telemetry"
+#define OFONO_TELEMETRY_AGENT_INTERFACE OFONO_SERVICE ".TelemetryAgent"
 
 /* Essentially a{sv} */
 #define OFONO_PROPERTIES_ARRAY_SIGNATURE DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING \
@@ -29,6 +29,14 @@ enum ofono_gprs_context_type {
 	OFONO_GPRS_CONTEXT_TYPE_IA		= 0x0020,
 };
 
+/* How the packets of an active context get to and from the host */
+enum ofono_gprs_context_data_path {
+	/* A network interface of the modem, e.g. NCM, ECM or QMI WWAN */
+	OFONO_GPRS_CONTEXT_DATA_PATH_NETDEV = 0,
+	/* PPP run by oFono over an AT port */
+	OFONO_GPRS_CONTEXT_DATA_PATH_PPP,
+};
+
 struct ofono_gprs_primary_context {
 	unsigned int cid;
 	char apn[OFONO_GPRS_MAX_APN_LENGTH + 1];
@@ -83,6 +91,8 @@ const char *ofono_gprs_context_get_interface(struct ofono_gprs_context *gc);
 
 void ofono_gprs_context_set_interface(struct ofono_gprs_context *gc,
 					const char *interface);
+void ofono_gprs_context_set_data_path(struct ofono_gprs_context *gc,
+				enum ofono_gprs_context_data_path data_path);
 
 void ofono_gprs_context_set_ipv4_address(struct ofono_gprs_context *gc,
 						const char *address,
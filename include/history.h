@@ -53,6 +53,12 @@ struct ofono_history_driver {
 					const struct ofono_uuid *uuid,
 					time_t when,
 					enum ofono_history_sms_status status);
+	/*
+	 * Events are delivered from the main loop after they happened, in
+	 * batches.  flush is called after each batch, drivers writing to
+	 * storage commit there instead of once per event.
+	 */
+	void (*flush)(struct ofono_history_context *context);
 };
 
 int ofono_history_driver_register(const struct ofono_history_driver *driver);
@@ -24,6 +24,12 @@ typedef void (*ofono_ims_status_cb_t)(const struct ofono_error *error,
 						int reg_info, int ext_info,
 						void *data);
 
+/*
+ * The driver reports every registration change through
+ * ofono_ims_status_notify, the status is not queried after Register
+ */
+#define OFONO_IMS_DRIVER_FLAG_STATUS_NOTIFY	0x100
+
 struct ofono_ims_driver {
 	unsigned int flags;
 	int (*probe)(struct ofono_ims *ims, unsigned int vendor, void *data);
@@ -14,6 +14,7 @@ extern "C" {
 #endif
 
 #include <stdarg.h>
+#include <stdint.h>
 
 #include <ofono/types.h>
 
@@ -23,6 +24,24 @@ enum ofono_location_reporting_type {
 	OFONO_LOCATION_REPORTING_TYPE_NMEA = 0,
 };
 
+/*
+ * A position computed by the modem.  Values it did not report are NAN, or
+ * 0 for the integer fields.
+ */
+struct ofono_location_fix {
+	uint64_t timestamp;	/* Milliseconds since the epoch, UTC */
+	double latitude;	/* Degrees, positive north */
+	double longitude;	/* Degrees, positive east */
+	double altitude;	/* Meters above mean sea level */
+	double speed;		/* Horizontal, meters per second */
+	double course;		/* Degrees from true north */
+	double vertical_speed;	/* Meters per second, positive up */
+	double horizontal_accuracy;	/* Meters, circular */
+	double vertical_accuracy;	/* Meters */
+	double hdop;
+	uint8_t satellites;	/* Used in the fix */
+};
+
 typedef void (*ofono_location_reporting_enable_cb_t)(
 						const struct ofono_error *error,
 						int fd, void *data);
@@ -59,6 +78,13 @@ void *ofono_location_reporting_get_data(struct ofono_location_reporting *lr);
 struct ofono_modem *ofono_location_reporting_get_modem(
 					struct ofono_location_reporting *lr);
 
+/*
+ * For drivers that get positions from the modem rather than parsing NMEA,
+ * reported fixes replace the ones parsed from the stream.
+ */
+void ofono_location_reporting_fix_notify(struct ofono_location_reporting *lr,
+					const struct ofono_location_fix *fix);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,7 @@ extern "C" {
 #endif
 
 #include <stdarg.h>
+#include <limits.h>
 
 #include <ofono/types.h>
 
@@ -31,6 +32,32 @@ struct ofono_network_operator {
 	int tech;
 };
 
+#define OFONO_NETREG_SIGNAL_UNKNOWN INT_MIN
+
+/*
+ * Signal quality of the serving cell, each metric being set to
+ * OFONO_NETREG_SIGNAL_UNKNOWN when the current technology or the modem
+ * does not report it.  The same structure carries the reporting
+ * thresholds passed to drivers, as the change in dB that is worth a
+ * report, 0 for metrics nobody is interested in.
+ */
+struct ofono_netreg_signal {
+	int rssi;		/* dBm */
+	int rsrp;		/* dBm */
+	int rsrq;		/* dB */
+	int sinr;		/* dB */
+	int ecio;		/* dB */
+};
+
+static inline void ofono_netreg_signal_init(struct ofono_netreg_signal *s)
+{
+	s->rssi = OFONO_NETREG_SIGNAL_UNKNOWN;
+	s->rsrp = OFONO_NETREG_SIGNAL_UNKNOWN;
+	s->rsrq = OFONO_NETREG_SIGNAL_UNKNOWN;
+	s->sinr = OFONO_NETREG_SIGNAL_UNKNOWN;
+	s->ecio = OFONO_NETREG_SIGNAL_UNKNOWN;
+}
+
 typedef void (*ofono_netreg_operator_cb_t)(const struct ofono_error *error,
 					const struct ofono_network_operator *op,
 					void *data);
@@ -69,6 +96,8 @@ struct ofono_netreg_driver {
 			ofono_netreg_operator_cb_t cb, void *data);
 	void (*list_operators)(struct ofono_netreg *netreg,
 			ofono_netreg_operator_list_cb_t cb, void *data);
+	/* The list_operators callback must not be called after this */
+	void (*cancel_list_operators)(struct ofono_netreg *netreg);
 	void (*register_auto)(struct ofono_netreg *netreg,
 			ofono_netreg_register_cb_t cb, void *data);
 	void (*register_manual)(struct ofono_netreg *netreg,
@@ -76,14 +105,33 @@ struct ofono_netreg_driver {
 				ofono_netreg_register_cb_t cb, void *data);
 	void (*strength)(struct ofono_netreg *netreg,
 			ofono_netreg_strength_cb_t, void *data);
+	/*
+	 * Configures the modem to report signal quality changes of at
+	 * least the given deltas through ofono_netreg_signal_notify.
+	 * Called again whenever the subscriptions change.
+	 */
+	void (*set_signal_thresholds)(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *deltas,
+				ofono_netreg_register_cb_t cb, void *data);
 };
 
 void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength);
+void ofono_netreg_signal_notify(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *signal);
 void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 					int lac, int ci, int tech);
 void ofono_netreg_time_notify(struct ofono_netreg *netreg,
 				struct ofono_network_time *info);
 
+/*
+ * Drivers able to report networks while list_operators is still running
+ * pass them here as they are found.  The final callback still carries
+ * the complete list.
+ */
+void ofono_netreg_operator_list_notify(struct ofono_netreg *netreg,
+				int total,
+				const struct ofono_network_operator *list);
+
 struct ofono_netreg *ofono_netreg_create(struct ofono_modem *modem,
 						unsigned int vendor,
 						const char *driver, ...);
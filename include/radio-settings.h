@@ -59,6 +59,15 @@ typedef void (*ofono_radio_settings_band_query_cb_t)(
 					enum ofono_radio_band_umts band_umts,
 					void *data);
 
+typedef void (*ofono_radio_settings_query_cb_t)(
+					const struct ofono_error *error,
+					int mode,
+					enum ofono_radio_band_gsm band_gsm,
+					enum ofono_radio_band_umts band_umts,
+					void *data);
+typedef void (*ofono_radio_settings_set_cb_t)(const struct ofono_error *error,
+						void *data);
+
 typedef void (*ofono_radio_settings_fast_dormancy_set_cb_t)(
 						const struct ofono_error *error,
 						void *data);
@@ -93,6 +102,19 @@ struct ofono_radio_settings_driver {
 				enum ofono_radio_band_umts band_umts,
 				ofono_radio_settings_band_set_cb_t cb,
 				void *data);
+	/*
+	 * Optional, query or set the access mode and the bands at once where
+	 * the modem has a single command for both
+	 */
+	void (*query_settings)(struct ofono_radio_settings *rs,
+				ofono_radio_settings_query_cb_t cb,
+				void *data);
+	void (*set_settings)(struct ofono_radio_settings *rs,
+				unsigned int mode,
+				enum ofono_radio_band_gsm band_gsm,
+				enum ofono_radio_band_umts band_umts,
+				ofono_radio_settings_set_cb_t cb,
+				void *data);
 	void (*query_fast_dormancy)(struct ofono_radio_settings *rs,
 			ofono_radio_settings_fast_dormancy_query_cb_t cb,
 			void *data);
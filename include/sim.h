@@ -144,6 +144,15 @@ struct ofono_sim_driver {
 			int record, int length,
 			const unsigned char *path, unsigned int path_len,
 			ofono_sim_read_cb_t cb, void *data);
+	/*
+	 * Optional.  Reads count consecutive records of a linear fixed EF
+	 * starting at record, returned back to back.  Fewer whole records
+	 * than asked for may be returned, the rest are asked for again.
+	 */
+	void (*read_file_records)(struct ofono_sim *sim, int fileid,
+			int record, int count, int length,
+			const unsigned char *path, unsigned int path_len,
+			ofono_sim_read_cb_t cb, void *data);
 	void (*write_file_transparent)(struct ofono_sim *sim, int fileid,
 			int start, int length, const unsigned char *value,
 			const unsigned char *path, unsigned int path_len,
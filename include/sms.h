@@ -30,6 +30,9 @@ typedef void (*ofono_sms_bearer_set_cb_t)(const struct ofono_error *error,
 typedef void (*ofono_sms_bearer_query_cb_t)(const struct ofono_error *error,
 						int bearer, void *data);
 
+/* The driver can have several submits outstanding at once */
+#define OFONO_SMS_DRIVER_FLAG_PIPELINE_SUBMIT	0x100
+
 struct ofono_sms_driver {
 	unsigned int flags;
 	int (*probe)(struct ofono_sms *sms, unsigned int vendor, void *data);
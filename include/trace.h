@@ -0,0 +1,39 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef __OFONO_TRACE_H
+#define __OFONO_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <ofono/types.h>
+
+/*
+ * Raw protocol traffic exchanged with the modem is recorded into an
+ * in-memory ring, which can be written out as pcapng on demand.  Each
+ * link uses its own pcapng link type, LINKTYPE_USER0 plus the value below.
+ */
+enum ofono_trace_link {
+	OFONO_TRACE_LINK_AT = 0,
+	OFONO_TRACE_LINK_QMI,
+	OFONO_TRACE_LINK_MBIM,
+};
+
+ofono_bool_t ofono_trace_enabled(void);
+
+void ofono_trace_record(enum ofono_trace_link link, unsigned int channel,
+				ofono_bool_t incoming,
+				const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OFONO_TRACE_H */
@@ -8,6 +8,8 @@
 #ifndef __OFONO_TYPES_H
 #define __OFONO_TYPES_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -92,6 +94,7 @@ struct ofono_network_time {
 	int year;	/* Current year, -1 if unavailable */
 	int dst;	/* Current adjustment, in hours */
 	int utcoff;	/* Offset from UTC in seconds */
+	uint64_t received; /* l_time_now() at receipt, 0 if unknown */
 };
 
 #define OFONO_SHA1_UUID_LEN 20
@@ -19,6 +19,8 @@ extern "C" {
 struct ofono_modem;
 struct ofono_voicecall;
 
+#define OFONO_VOICECALL_TONE_STRING_MAX 64
+
 typedef void (*ofono_voicecall_cb_t)(const struct ofono_error *error,
 					void *data);
 
@@ -132,6 +134,14 @@ struct ofono_voicecall_driver {
 			ofono_voicecall_cb_t cb, void *data);
 	void (*send_tones)(struct ofono_voicecall *vc, const char *tones,
 			ofono_voicecall_cb_t cb, void *data);
+	/*
+	 * Optional, sends up to OFONO_VOICECALL_TONE_STRING_MAX tones in a
+	 * single request with 'p' pause characters left in place for the
+	 * modem to honour.  When present it is used instead of send_tones.
+	 */
+	void (*send_tone_string)(struct ofono_voicecall *vc,
+			const char *tones,
+			ofono_voicecall_cb_t cb, void *data);
 };
 
 void ofono_voicecall_en_list_notify(struct ofono_voicecall *vc,
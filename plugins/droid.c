@@ -37,6 +37,7 @@
 #include <ofono/sms.h>
 #include <ofono/ussd.h>
 #include <ofono/voicecall.h>
+#include <ofono/trace.h>
 
 #include <drivers/qmimodem/qmi.h>
 #include <drivers/qmimodem/dms.h>
@@ -79,6 +80,12 @@ static void droid_io_debug(const char *str, void *user_data)
 	ofono_debug("%s%s", prefix, str);
 }
 
+static void droid_trace(bool in, int fd, const void *data, size_t len,
+							void *user_data)
+{
+	ofono_trace_record(OFONO_TRACE_LINK_QMI, fd, in, data, len);
+}
+
 static int droid_probe(struct ofono_modem *modem)
 {
 	struct droid_data *data;
@@ -368,6 +375,9 @@ static int droid_enable(struct ofono_modem *modem)
 		qmi_qmux_device_set_io_debug(data->qmux,
 						droid_io_debug, "QMI: ");
 
+	if (ofono_trace_enabled())
+		qmi_qmux_device_set_trace(data->qmux, droid_trace, NULL);
+
 	qmi_qmux_device_discover(data->qmux, discover_cb, modem, NULL);
 
 	return -EINPROGRESS;
@@ -462,7 +472,7 @@ static void droid_pre_sim(struct ofono_modem *modem)
 	ofono_voicecall_create(modem, 0, "qmimodem",
 				qmi_service_clone(data->voice));
 	ofono_location_reporting_create(modem, 0, "qmimodem",
-					l_steal_ptr(data->pds));
+					l_steal_ptr(data->pds), NULL);
 }
 
 static void droid_post_sim(struct ofono_modem *modem)
@@ -498,7 +508,8 @@ static void droid_post_sim(struct ofono_modem *modem)
 
 	gc = ofono_gprs_context_create(modem, 0, "qmimodem", -1,
 					qmi_service_clone(data->wds_ip4),
-					qmi_service_clone(data->wds_ip6));
+					qmi_service_clone(data->wds_ip6),
+					NULL);
 	if (!gc) {
 		ofono_warn("Unable to create gprs-context for: %s",
 				ofono_modem_get_path(modem));
@@ -0,0 +1,397 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2014 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include <ofono.h>
+#include <gdbus.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/plugin.h>
+#include <ofono/log.h>
+#include <ofono/modem.h>
+#include <ofono/emulator.h>
+
+#include "gatchat.h"
+
+#define EMULATOR_BENCH_INTERFACE "org.ofono.test.EmulatorBench"
+#define EMULATOR_BENCH_PATH   "/test"
+
+/*
+ * Drives an HFP AG emulator over a socketpair the way a polling car kit
+ * would: service level connection setup, then AT+CIND? and AT+CLCC in a
+ * loop with an indicator change before each round.  Each command is sent
+ * once the previous one completed, so the rate measured is that of a
+ * single hands-free unit going as fast as the emulator lets it.
+ */
+enum bench_cmd {
+	BENCH_CMD_BRSF,
+	BENCH_CMD_CIND_SUPPORT,
+	BENCH_CMD_CIND,
+	BENCH_CMD_CMER,
+	BENCH_CMD_DIAL,
+	BENCH_CMD_CLCC,
+	BENCH_CMD_CHUP,
+	BENCH_CMD_COUNT,
+};
+
+static const char *const bench_cmd_names[] = {
+	[BENCH_CMD_BRSF] = "+BRSF",
+	[BENCH_CMD_CIND_SUPPORT] = "+CIND=?",
+	[BENCH_CMD_CIND] = "+CIND?",
+	[BENCH_CMD_CMER] = "+CMER",
+	[BENCH_CMD_DIAL] = "D",
+	[BENCH_CMD_CLCC] = "+CLCC",
+	[BENCH_CMD_CHUP] = "+CHUP",
+};
+
+static const char *const bench_cmd_strings[] = {
+	[BENCH_CMD_BRSF] = "AT+BRSF=0",
+	[BENCH_CMD_CIND_SUPPORT] = "AT+CIND=?",
+	[BENCH_CMD_CIND] = "AT+CIND?",
+	[BENCH_CMD_CMER] = "AT+CMER=3,0,0,1",
+	[BENCH_CMD_CLCC] = "AT+CLCC",
+	[BENCH_CMD_CHUP] = "AT+CHUP",
+};
+
+static const enum bench_cmd bench_setup[] = {
+	BENCH_CMD_BRSF,
+	BENCH_CMD_CIND_SUPPORT,
+	BENCH_CMD_CIND,
+	BENCH_CMD_CMER,
+};
+
+struct bench_stat {
+	unsigned int count;
+	uint64_t total;
+	uint64_t max;
+};
+
+struct bench {
+	DBusMessage *pending;
+	struct ofono_emulator *em;
+	GAtChat *chat;
+	int server_fd;
+	char *dial;
+	unsigned int rounds;
+	unsigned int step;
+	enum bench_cmd cmd;
+	ofono_bool_t failed;
+	uint64_t start;
+	uint64_t sent;
+	uint64_t duration;
+	size_t heap_start;
+	size_t heap_end;
+	struct bench_stat stats[BENCH_CMD_COUNT];
+};
+
+static struct bench *bench;
+
+static size_t heap_in_use(void)
+{
+#ifdef HAVE_MALLINFO2
+	struct mallinfo2 info = mallinfo2();
+
+	return info.uordblks;
+#else
+	return 0;
+#endif
+}
+
+static int bench_next_cmd(struct bench *b)
+{
+	unsigned int step = b->step++;
+
+	if (step < L_ARRAY_SIZE(bench_setup))
+		return bench_setup[step];
+
+	step -= L_ARRAY_SIZE(bench_setup);
+
+	if (b->dial) {
+		if (step == 0)
+			return BENCH_CMD_DIAL;
+
+		step -= 1;
+	}
+
+	if (step < b->rounds * 2) {
+		if (step % 2)
+			return BENCH_CMD_CLCC;
+
+		ofono_emulator_set_indicator(b->em, OFONO_EMULATOR_IND_SIGNAL,
+						step / 2 % 6);
+		return BENCH_CMD_CIND;
+	}
+
+	if (b->dial && step == b->rounds * 2)
+		return BENCH_CMD_CHUP;
+
+	return -1;
+}
+
+static void bench_append_stats(struct bench *b, DBusMessageIter *iter)
+{
+	DBusMessageIter dict;
+	DBusMessageIter entry;
+	DBusMessageIter stat;
+	unsigned int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					"{s(uuu)}", &dict);
+
+	for (i = 0; i < BENCH_CMD_COUNT; i++) {
+		const struct bench_stat *s = &b->stats[i];
+		dbus_uint32_t mean;
+		dbus_uint32_t max = s->max;
+
+		if (s->count == 0)
+			continue;
+
+		mean = s->total / s->count;
+
+		dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+							&bench_cmd_names[i]);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_STRUCT,
+							NULL, &stat);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32,
+							&s->count);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32, &mean);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32, &max);
+		dbus_message_iter_close_container(&entry, &stat);
+		dbus_message_iter_close_container(&dict, &entry);
+	}
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+static DBusMessage *bench_reply(struct bench *b)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	dbus_uint32_t commands = 0;
+	dbus_uint32_t rate;
+	dbus_uint64_t duration = b->duration;
+	dbus_int64_t heap = (int64_t) b->heap_end - (int64_t) b->heap_start;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_CMD_COUNT; i++)
+		commands += b->stats[i].count;
+
+	rate = duration ? (uint64_t) commands * 1000000 / duration : 0;
+
+	reply = dbus_message_new_method_return(b->pending);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &commands);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &duration);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &rate);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT64, &heap);
+	bench_append_stats(b, &iter);
+
+	return reply;
+}
+
+static gboolean bench_finish(gpointer user_data)
+{
+	struct bench *b = user_data;
+	DBusMessage *reply;
+
+	g_at_chat_unref(b->chat);
+	ofono_emulator_remove(b->em);
+	close(b->server_fd);
+
+	if (b->failed)
+		reply = g_dbus_create_error(b->pending, "org.ofono.test.Error",
+						"%s failed",
+						bench_cmd_names[b->cmd]);
+	else
+		reply = bench_reply(b);
+
+	__ofono_dbus_pending_reply(&b->pending, reply);
+
+	l_free(b->dial);
+	l_free(b);
+	bench = NULL;
+
+	return FALSE;
+}
+
+static void bench_send_next(struct bench *b);
+
+static void bench_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct bench *b = user_data;
+	struct bench_stat *s = &b->stats[b->cmd];
+	uint64_t latency = l_time_diff(b->sent, l_time_now());
+
+	s->count += 1;
+	s->total += latency;
+	s->max = MAX(s->max, latency);
+
+	if (!ok) {
+		b->failed = TRUE;
+		g_idle_add(bench_finish, b);
+		return;
+	}
+
+	bench_send_next(b);
+}
+
+static void bench_send_next(struct bench *b)
+{
+	int cmd = bench_next_cmd(b);
+	const char *str;
+
+	if (cmd < 0) {
+		b->duration = l_time_diff(b->start, l_time_now());
+		b->heap_end = heap_in_use();
+
+		/* Not from within the GAtChat callback that is unwinding */
+		g_idle_add(bench_finish, b);
+		return;
+	}
+
+	b->cmd = cmd;
+	str = cmd == BENCH_CMD_DIAL ? b->dial : bench_cmd_strings[cmd];
+	b->sent = l_time_now();
+
+	g_at_chat_send(b->chat, str, NULL, bench_cb, b, NULL);
+}
+
+static ofono_bool_t modem_match_path(struct ofono_modem *modem,
+							void *user_data)
+{
+	return g_str_equal(ofono_modem_get_path(modem), user_data);
+}
+
+static GAtChat *bench_chat_new(int fd)
+{
+	GIOChannel *channel;
+	GAtSyntax *syntax;
+	GAtChat *chat;
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	chat = g_at_chat_new(channel, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(channel);
+
+	return chat;
+}
+
+static DBusMessage *bench_run(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	const char *path;
+	const char *number;
+	dbus_uint32_t rounds;
+	struct ofono_modem *modem;
+	int fds[2];
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
+					DBUS_TYPE_UINT32, &rounds,
+					DBUS_TYPE_STRING, &number,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (bench)
+		return __ofono_error_busy(msg);
+
+	modem = ofono_modem_find(modem_match_path, (void *) path);
+	if (modem == NULL)
+		return __ofono_error_not_found(msg);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		return __ofono_error_failed(msg);
+
+	bench = l_new(struct bench, 1);
+	bench->rounds = rounds;
+	bench->server_fd = fds[0];
+
+	if (number[0] != '\0')
+		bench->dial = l_strdup_printf("ATD%s;", number);
+
+	bench->em = ofono_emulator_create(modem, OFONO_EMULATOR_TYPE_HFP);
+	bench->chat = bench_chat_new(fds[1]);
+
+	if (bench->em == NULL || bench->chat == NULL) {
+		if (bench->em)
+			ofono_emulator_remove(bench->em);
+
+		g_at_chat_unref(bench->chat);
+		close(fds[0]);
+		l_free(bench->dial);
+		l_free(bench);
+		bench = NULL;
+
+		return __ofono_error_failed(msg);
+	}
+
+	ofono_emulator_register(bench->em, fds[0]);
+
+	bench->pending = dbus_message_ref(msg);
+	bench->heap_start = heap_in_use();
+	bench->start = l_time_now();
+	bench_send_next(bench);
+
+	return NULL;
+}
+
+static const GDBusMethodTable emulator_bench_methods[] = {
+	{ GDBUS_ASYNC_METHOD("Run",
+		GDBUS_ARGS({ "modem", "o" }, { "rounds", "u" },
+				{ "number", "s" }),
+		GDBUS_ARGS({ "commands", "u" }, { "duration", "t" },
+				{ "rate", "u" }, { "heap", "x" },
+				{ "latencies", "a{s(uuu)}" }),
+		bench_run) },
+	{ },
+};
+
+static int emulator_bench_init(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	DBG("");
+
+	if (!g_dbus_register_interface(conn, EMULATOR_BENCH_PATH,
+					EMULATOR_BENCH_INTERFACE,
+					emulator_bench_methods, NULL,
+					NULL, NULL, NULL)) {
+		ofono_error("Register Profile interface failed: %s",
+						EMULATOR_BENCH_PATH);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void emulator_bench_exit(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	DBG("");
+
+	g_dbus_unregister_interface(conn, EMULATOR_BENCH_PATH,
+						EMULATOR_BENCH_INTERFACE);
+}
+
+OFONO_PLUGIN_DEFINE(emulator_bench, "Emulator Benchmark",
+				VERSION, OFONO_PLUGIN_PRIORITY_DEFAULT,
+				emulator_bench_init, emulator_bench_exit)
@@ -39,6 +39,8 @@
 #include <ofono/location-reporting.h>
 #include <ofono/log.h>
 #include <ofono/message-waiting.h>
+#include <ofono/storage.h>
+#include <ofono/trace.h>
 
 #include <ell/ell.h>
 
@@ -57,11 +59,13 @@
 #define GOBI_UIM	(1 << 5)
 #define GOBI_VOICE	(1 << 6)
 #define GOBI_WDA	(1 << 7)
+#define GOBI_LOC	(1 << 8)
 
 #define MAX_CONTEXTS 4
 #define DEFAULT_MTU 1400
 #define RMNET_MAX_MTU 16384
 #define DEFAULT_DL_DATAGRAMS 32
+#define UL_AGGREGATION_TIMEOUT_NS 3000000
 
 #define QMI_WWAN_RAW_IP "/sys/class/net/%s/qmi/raw_ip"
 #define QMI_WWAN_PASS_THROUGH "/sys/class/net/%s/qmi/pass_through"
@@ -76,6 +80,7 @@ enum wda_data_format {
 struct service_request {
 	struct qmi_service **member;
 	uint32_t service_type;
+	struct ofono_modem *modem;
 };
 
 struct gobi_data {
@@ -87,6 +92,7 @@ struct gobi_data {
 	struct qmi_service *wms;
 	struct qmi_service *voice;
 	struct qmi_service *pds;
+	struct qmi_service *loc;
 	struct qmi_service *uim;
 	struct {
 		struct qmi_service *wds_ipv4;
@@ -96,7 +102,7 @@ struct gobi_data {
 	uint8_t n_premux;
 	int rmnet_id;
 	struct service_request service_requests[8 + MAX_CONTEXTS * 2];
-	int cur_service_request;
+	int pending_service_requests;
 	int num_service_requests;
 	unsigned long features;
 	unsigned int discover_attempts;
@@ -105,10 +111,14 @@ struct gobi_data {
 	char main_net_name[IFNAMSIZ];
 	uint8_t interface_number;
 	uint32_t max_aggregation_size;
+	struct qmi_wda_data_format negotiated;
 	uint32_t set_powered_id;
 	uint32_t set_mtu_id;
 	enum wda_data_format data_format;
+	enum wda_data_format cached_data_format;
 	bool no_pass_through : 1;
+	bool service_request_failed : 1;
+	bool services_cached : 1;
 };
 
 static void gobi_debug(const char *str, void *user_data)
@@ -125,6 +135,12 @@ static void gobi_io_debug(const char *str, void *user_data)
 	ofono_debug("%s%s", prefix, str);
 }
 
+static void gobi_trace(bool in, int fd, const void *data, size_t len,
+							void *user_data)
+{
+	ofono_trace_record(OFONO_TRACE_LINK_QMI, fd, in, data, len);
+}
+
 static bool wda_get_data_format(struct gobi_data *data,
 				struct qmi_wda_data_format *out_format)
 {
@@ -158,17 +174,23 @@ done:
 	return true;
 }
 
-static int wda_data_format_to_mtu(enum wda_data_format format, uint32_t *out_mtu)
+static int wda_data_format_to_mtu(struct gobi_data *data, uint32_t *out_mtu)
 {
 	uint32_t mtu;
 
-	switch (format) {
+	switch (data->data_format) {
 	case WDA_DATA_FORMAT_802_3:
 	case WDA_DATA_FORMAT_RAW_IP:
 		mtu = DEFAULT_MTU;
 		break;
 	case WDA_DATA_FORMAT_RMNET_QMAP5:
-		mtu = RMNET_MAX_MTU;
+		/*
+		 * qmi_wwan sizes its receive buffers from the MTU, so match
+		 * the largest aggregate the modem agreed to send
+		 */
+		mtu = data->negotiated.dl_max_size;
+		if (!mtu || mtu > RMNET_MAX_MTU)
+			mtu = RMNET_MAX_MTU;
 		break;
 	default:
 		return -ENOTSUP;
@@ -180,6 +202,27 @@ static int wda_data_format_to_mtu(enum wda_data_format format, uint32_t *out_mtu
 	return 0;
 }
 
+static bool wda_get_ul_aggregation(struct gobi_data *data,
+					struct rmnet_aggregation *out)
+{
+	const struct qmi_wda_data_format *format = &data->negotiated;
+
+	if (format->ul_aggregation_protocol ==
+				QMI_WDA_AGGREGATION_PROTOCOL_DISABLED)
+		return false;
+
+	if (format->ul_max_datagrams < 2 || !format->ul_max_size)
+		return false;
+
+	out->max_size = format->ul_max_size > UINT16_MAX ?
+					UINT16_MAX : format->ul_max_size;
+	out->max_datagrams = format->ul_max_datagrams > UINT16_MAX ?
+					UINT16_MAX : format->ul_max_datagrams;
+	out->timeout_ns = UL_AGGREGATION_TIMEOUT_NS;
+
+	return true;
+}
+
 static int qmi_wwan_set_raw_ip(const char *interface, char value)
 {
 	return l_sysctl_set_char(value, QMI_WWAN_RAW_IP, interface);
@@ -293,6 +336,9 @@ static void cleanup_services(struct gobi_data *data)
 	qmi_service_free(data->pds);
 	data->pds = NULL;
 
+	qmi_service_free(data->loc);
+	data->loc = NULL;
+
 	qmi_service_free(data->uim);
 	data->uim = NULL;
 
@@ -355,10 +401,13 @@ static void __shutdown_device(struct ofono_modem *modem)
 
 	data->discover_attempts = 0;
 	memset(&data->service_requests, 0, sizeof(data->service_requests));
-	data->cur_service_request = 0;
+	data->pending_service_requests = 0;
 	data->num_service_requests = 0;
+	data->service_request_failed = false;
+	data->services_cached = false;
 	data->features = 0;
 	data->data_format = WDA_DATA_FORMAT_UNKNOWN;
+	data->cached_data_format = WDA_DATA_FORMAT_UNKNOWN;
 
 	qmi_qmux_device_free(data->device);
 	data->device = NULL;
@@ -491,43 +540,154 @@ error:
 	shutdown_device(modem);
 }
 
-static void request_service_cb(struct qmi_service *service, void *user_data)
+/*
+ * The services found by discovery are remembered per device, keyed by the
+ * USB serial number, and reused as long as the firmware revision matches
+ */
+static char *service_cache_path(struct ofono_modem *modem)
+{
+	const char *serial = ofono_modem_get_string(modem, "SerialNumber");
+	const char *p;
+
+	if (!serial || !*serial)
+		return NULL;
+
+	for (p = serial; *p; p++)
+		if (!l_ascii_isalnum(*p) && *p != '-' && *p != '_')
+			return NULL;
+
+	return l_strdup_printf("%s/qmi-%s", ofono_storage_dir(), serial);
+}
+
+static void save_service_cache(struct ofono_modem *modem)
 {
-	struct ofono_modem *modem = user_data;
 	struct gobi_data *data = ofono_modem_get_data(modem);
-	struct service_request *req =
-		&data->service_requests[data->cur_service_request];
+	const char *revision = ofono_modem_get_string(modem, "Revision");
+	_auto_(l_free) char *path = service_cache_path(modem);
+	_auto_(l_free) char *services = NULL;
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+	_auto_(l_free) char *contents = NULL;
+	size_t len;
+
+	if (!path || !revision)
+		return;
 
-	DBG("");
+	services = qmi_qmux_device_get_services(data->device);
+	if (!services)
+		return;
 
-	if (!service)
-		goto error;
+	cache = l_settings_new();
+	l_settings_set_string(cache, "QMI", "Revision", revision);
+	l_settings_set_string(cache, "QMI", "Services", services);
+
+	contents = l_settings_to_data(cache, &len);
+	if (!contents || l_file_set_contents(path, contents, len) < 0)
+		DBG("Unable to write %s", path);
+}
+
+/*
+ * The data format that was negotiated is kept with the services, so that
+ * the next enable starts with it instead of trying the formats the
+ * firmware already turned down.
+ */
+static void save_data_format_cache(struct ofono_modem *modem)
+{
+	struct gobi_data *data = ofono_modem_get_data(modem);
+	_auto_(l_free) char *path = service_cache_path(modem);
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+	_auto_(l_free) char *contents = NULL;
+	size_t len;
+
+	if (!path)
+		return;
 
-	*req->member = service;
+	cache = l_settings_new();
+	if (!l_settings_load_from_file(cache, path))
+		return;
 
-	data->cur_service_request += 1;
-	if (data->cur_service_request == data->num_service_requests) {
-		DBG("All services requested, query DMS Capabilities");
+	l_settings_set_uint(cache, "QMI", "DataFormat", data->data_format);
 
-		if (qmi_service_send(data->dms, QMI_DMS_GET_CAPS, NULL,
-						get_caps_cb, modem, NULL) > 0)
-			return;
+	contents = l_settings_to_data(cache, &len);
+	if (!contents || l_file_set_contents(path, contents, len) < 0)
+		DBG("Unable to write %s", path);
+}
+
+static void drop_service_cache(struct ofono_modem *modem)
+{
+	struct gobi_data *data = ofono_modem_get_data(modem);
+	_auto_(l_free) char *path = NULL;
+
+	if (!data->services_cached)
+		return;
+
+	path = service_cache_path(modem);
+	DBG("Cached services failed, removing %s", path);
+	unlink(path);
+}
+
+static void request_service_cb(struct qmi_service *service, void *user_data)
+{
+	struct service_request *req = user_data;
+	struct ofono_modem *modem = req->modem;
+	struct gobi_data *data = ofono_modem_get_data(modem);
+
+	DBG("%u: %p", req->service_type, service);
+
+	if (service)
+		*req->member = service;
+	else
+		data->service_request_failed = true;
+
+	data->pending_service_requests -= 1;
+	if (data->pending_service_requests > 0)
+		return;
 
+	if (data->service_request_failed) {
+		drop_service_cache(modem);
 		goto error;
 	}
 
-	req = &data->service_requests[data->cur_service_request];
-	DBG("Requesting: %u", req->service_type);
+	DBG("All services requested, query DMS Capabilities");
 
-	if (qmi_qmux_device_create_client(data->device, req->service_type,
-					request_service_cb, modem, NULL))
+	if (qmi_service_send(data->dms, QMI_DMS_GET_CAPS, NULL,
+					get_caps_cb, modem, NULL) > 0)
 		return;
 
 error:
 	shutdown_device(modem);
 }
 
-static uint32_t start_service_requests(struct ofono_modem *modem)
+/*
+ * Ask for all the clients at once rather than waiting for each CTL round
+ * trip.  When a request cannot be made, the ones already sent are still
+ * waited for so that none of the services created leak.
+ */
+static bool request_services(struct ofono_modem *modem)
+{
+	struct gobi_data *data = ofono_modem_get_data(modem);
+	int i;
+
+	for (i = 0; i < data->num_service_requests; i++) {
+		struct service_request *req = &data->service_requests[i];
+
+		DBG("Requesting: %u", req->service_type);
+		req->modem = modem;
+
+		if (!qmi_qmux_device_create_client(data->device,
+						req->service_type,
+						request_service_cb, req,
+						NULL)) {
+			data->service_request_failed = true;
+			break;
+		}
+
+		data->pending_service_requests += 1;
+	}
+
+	return data->pending_service_requests > 0;
+}
+
+static bool start_service_requests(struct ofono_modem *modem)
 {
 	struct gobi_data *data = ofono_modem_get_data(modem);
 	unsigned int i;
@@ -541,8 +701,7 @@ static uint32_t start_service_requests(struct ofono_modem *modem)
 					QMI_SERVICE_WDS);
 	}
 
-	return qmi_qmux_device_create_client(data->device, QMI_SERVICE_DMS,
-				request_service_cb, modem, NULL);
+	return request_services(modem);
 }
 
 static void rmnet_get_interfaces_cb(int error, unsigned int n_interfaces,
@@ -570,7 +729,7 @@ static void rmnet_get_interfaces_cb(int error, unsigned int n_interfaces,
 				sizeof(struct rmnet_ifinfo) * n_interfaces);
 	data->n_premux = n_interfaces;
 
-	if (start_service_requests(modem) > 0)
+	if (start_service_requests(modem))
 		return;
 error:
 	shutdown_device(modem);
@@ -600,6 +759,9 @@ static void enable_set_mtu_cb(int error, uint16_t type,
 	}
 
 	if (L_IN_SET(data->data_format, WDA_DATA_FORMAT_RMNET_QMAP5)) {
+		struct rmnet_aggregation aggregation;
+		bool aggregate_ul;
+
 		DBG("Setting QMI WWAN to pass_through");
 
 		if (qmi_wwan_set_pass_through(data->main_net_name, 'Y') < 0) {
@@ -607,8 +769,16 @@ static void enable_set_mtu_cb(int error, uint16_t type,
 			goto error;
 		}
 
+		aggregate_ul = wda_get_ul_aggregation(data, &aggregation);
+		if (aggregate_ul)
+			DBG("UL aggregation: %hu datagrams, %hu bytes",
+					aggregation.max_datagrams,
+					aggregation.max_size);
+
 		data->rmnet_id = rmnet_get_interfaces(data->main_net_ifindex,
 							MAX_CONTEXTS,
+							aggregate_ul ?
+							&aggregation : NULL,
 							rmnet_get_interfaces_cb,
 							modem, NULL);
 		if (data->rmnet_id > 0)
@@ -618,7 +788,7 @@ static void enable_set_mtu_cb(int error, uint16_t type,
 		goto error;
 	}
 
-	if (start_service_requests(modem) > 0)
+	if (start_service_requests(modem))
 		return;
 error:
 	shutdown_device(modem);
@@ -648,6 +818,8 @@ static int compare_data_format(struct gobi_data *data, struct qmi_result *result
 			actual.dl_aggregation_protocol)
 		return -EBADE;
 
+	memcpy(&data->negotiated, &actual, sizeof(actual));
+
 	return 0;
 }
 
@@ -671,8 +843,10 @@ static void set_data_format_cb(struct qmi_result *result, void *user_data)
 		ofono_error("Setting Data Format had no effect");
 	}
 
-	if (data->data_format == WDA_DATA_FORMAT_802_3)
+	if (data->data_format == WDA_DATA_FORMAT_802_3) {
+		drop_service_cache(modem);
 		goto error;
+	}
 
 	DBG("Trying next data format");
 	data->data_format += 1;
@@ -687,9 +861,15 @@ static void set_data_format_cb(struct qmi_result *result, void *user_data)
 	goto error;
 
 done:
+	if (data->data_format != data->cached_data_format)
+		save_data_format_cache(modem);
+
 	DBG("Set Data Format succeeded, try to set MTU...");
+	DBG("DL aggregation: %u datagrams, %u bytes",
+			data->negotiated.dl_max_datagrams,
+			data->negotiated.dl_max_size);
 
-	if (L_WARN_ON(wda_data_format_to_mtu(data->data_format, &mtu) < 0))
+	if (L_WARN_ON(wda_data_format_to_mtu(data, &mtu) < 0))
 		goto error;
 
 	data->set_mtu_id = l_rtnl_link_set_mtu(l_rtnl_get(),
@@ -716,8 +896,7 @@ static void create_wda_cb(struct qmi_service *service, void *user_data)
 	if (!service) {
 		DBG("Failed to request WDA service, assume 802.3");
 
-		if (qmi_qmux_device_create_client(data->device, QMI_SERVICE_DMS,
-					request_service_cb, modem, NULL) > 0)
+		if (request_services(modem))
 			return;
 
 		goto error;
@@ -727,6 +906,8 @@ static void create_wda_cb(struct qmi_service *service, void *user_data)
 
 	if (data->no_pass_through)
 		data->data_format = WDA_DATA_FORMAT_802_3;
+	else if (data->cached_data_format != WDA_DATA_FORMAT_UNKNOWN)
+		data->data_format = data->cached_data_format;
 	else
 		data->data_format = WDA_DATA_FORMAT_UNKNOWN + 1;
 
@@ -759,6 +940,8 @@ static void discover_cb(void *user_data)
 		data->features |= GOBI_WDA;
 	if (qmi_qmux_device_has_service(data->device, QMI_SERVICE_PDS))
 		data->features |= GOBI_PDS;
+	if (qmi_qmux_device_has_service(data->device, QMI_SERVICE_LOC))
+		data->features |= GOBI_LOC;
 	if (qmi_qmux_device_has_service(data->device, QMI_SERVICE_UIM))
 		data->features |= GOBI_UIM;
 	if (qmi_qmux_device_has_service(data->device, QMI_SERVICE_VOICE))
@@ -780,9 +963,13 @@ static void discover_cb(void *user_data)
 								modem, NULL))
 			return;
 
+		drop_service_cache(modem);
 		goto error;
 	}
 
+	if (!data->services_cached)
+		save_service_cache(modem);
+
 	add_service_request(data, &data->dms, QMI_SERVICE_DMS);
 	if (data->features & GOBI_NAS)
 		add_service_request(data, &data->nas, QMI_SERVICE_NAS);
@@ -794,6 +981,10 @@ static void discover_cb(void *user_data)
 		add_service_request(data, &data->voice, QMI_SERVICE_VOICE);
 	if (data->features & GOBI_UIM)
 		add_service_request(data, &data->uim, QMI_SERVICE_UIM);
+	if (data->features & GOBI_LOC)
+		add_service_request(data, &data->loc, QMI_SERVICE_LOC);
+	else if (data->features & GOBI_PDS)
+		add_service_request(data, &data->pds, QMI_SERVICE_PDS);
 
 	if (qmi_qmux_device_create_client(data->device, QMI_SERVICE_WDA,
 						create_wda_cb, modem, NULL))
@@ -803,6 +994,52 @@ error:
 	shutdown_device(modem);
 }
 
+static int discover_device(struct ofono_modem *modem)
+{
+	struct gobi_data *data = ofono_modem_get_data(modem);
+	const char *revision = ofono_modem_get_string(modem, "Revision");
+	_auto_(l_free) char *path = service_cache_path(modem);
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+	_auto_(l_free) char *cached_revision = NULL;
+	_auto_(l_free) char *services = NULL;
+	unsigned int data_format;
+
+	if (!path || !revision)
+		goto discover;
+
+	cache = l_settings_new();
+	if (!l_settings_load_from_file(cache, path))
+		goto discover;
+
+	cached_revision = l_settings_get_string(cache, "QMI", "Revision");
+	services = l_settings_get_string(cache, "QMI", "Services");
+
+	if (!services || !cached_revision)
+		goto discover;
+
+	if (!l_streq0(cached_revision, revision)) {
+		DBG("Firmware revision changed: %s -> %s",
+						cached_revision, revision);
+		goto discover;
+	}
+
+	if (!qmi_qmux_device_discover_cached(data->device, services,
+						discover_cb, modem, NULL)) {
+		data->services_cached = true;
+
+		if (l_settings_get_uint(cache, "QMI", "DataFormat",
+						&data_format) &&
+				data_format > WDA_DATA_FORMAT_UNKNOWN &&
+				data_format <= WDA_DATA_FORMAT_802_3)
+			data->cached_data_format = data_format;
+
+		return 0;
+	}
+
+discover:
+	return qmi_qmux_device_discover(data->device, discover_cb, modem, NULL);
+}
+
 static void init_powered_down_cb(int error, uint16_t type,
 					const void *msg, uint32_t len,
 					void *user_data)
@@ -835,7 +1072,7 @@ static void init_powered_down_cb(int error, uint16_t type,
 		goto error;
 	}
 
-	r = qmi_qmux_device_discover(data->device, discover_cb, modem, NULL);
+	r = discover_device(modem);
 	if (!r)
 		return;
 error:
@@ -864,6 +1101,9 @@ static int gobi_enable(struct ofono_modem *modem)
 		qmi_qmux_device_set_io_debug(data->device,
 						gobi_io_debug, "QMI: ");
 
+	if (ofono_trace_enabled())
+		qmi_qmux_device_set_trace(data->device, gobi_trace, NULL);
+
 	data->set_powered_id =
 		l_rtnl_set_powered(l_rtnl_get(), data->main_net_ifindex,
 					false, init_powered_down_cb,
@@ -1049,9 +1289,11 @@ static void gobi_pre_sim(struct ofono_modem *modem)
 		ofono_voicecall_create(modem, 0, "qmimodem",
 					qmi_service_clone(data->voice));
 
-	if (data->features & GOBI_PDS) /* exclusive use, no need to clone */
+	/* exclusive use, no need to clone */
+	if (data->features & (GOBI_PDS | GOBI_LOC))
 		ofono_location_reporting_create(modem, 0, "qmimodem",
-						l_steal_ptr(data->pds));
+						l_steal_ptr(data->pds),
+						l_steal_ptr(data->loc));
 }
 
 static void gobi_setup_gprs(struct ofono_modem *modem)
@@ -1077,7 +1319,7 @@ static void gobi_setup_gprs(struct ofono_modem *modem)
 
 		gc = ofono_gprs_context_create(modem, 0, "qmimodem", -1,
 						qmi_service_clone(ipv4),
-						qmi_service_clone(ipv6));
+						qmi_service_clone(ipv6), NULL);
 		if (!gc) {
 			ofono_warn("Unable to create gprs-context for: %s",
 					ofono_modem_get_path(modem));
@@ -1098,7 +1340,8 @@ static void gobi_setup_gprs(struct ofono_modem *modem)
 		gc = ofono_gprs_context_create(modem, 0, "qmimodem",
 						ifinfo->mux_id,
 						qmi_service_clone(ipv4),
-						qmi_service_clone(ipv6));
+						qmi_service_clone(ipv6),
+						&data->negotiated);
 
 		if (!gc) {
 			ofono_warn("gprs-context creation failed for [%d] %s",
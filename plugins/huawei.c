@@ -66,8 +66,11 @@ struct huawei_data {
 	struct ofono_gprs_context *gc;
 	gboolean have_sim;
 	int sim_state;
+	gboolean sim_state_reported;
 	guint sysinfo_poll_source;
 	guint sysinfo_poll_count;
+	unsigned int sysinfo_queries;
+	unsigned int sysinfo_avoided;
 	struct cb_data *online_cbd;
 	const char *offline_command;
 	gboolean have_voice;
@@ -286,6 +289,9 @@ static void cvoice_support_cb(gboolean ok, GAtResult *result,
 					cvoice_query_cb, modem, NULL);
 }
 
+static gboolean sysinfo_enable_check(gpointer user_data);
+static gboolean sysinfo_online_check(gpointer user_data);
+
 static void simst_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_modem *modem = user_data;
@@ -304,6 +310,19 @@ static void simst_notify(GAtResult *result, gpointer user_data)
 	DBG("%d -> %d", data->sim_state, sim_state);
 
 	data->sim_state = sim_state;
+	data->sim_state_reported = TRUE;
+
+	if (data->sysinfo_poll_source == 0)
+		return;
+
+	/* Waiting for the SIM, check again now rather than on the timer */
+	g_source_remove(data->sysinfo_poll_source);
+	data->sysinfo_poll_source = 0;
+
+	if (data->online_cbd)
+		sysinfo_online_check(data);
+	else
+		sysinfo_enable_check(modem);
 }
 
 static gboolean parse_sysinfo_result(GAtResult *result, int *srv_status,
@@ -365,27 +384,11 @@ static void cfun_offline(gboolean ok, GAtResult *result, gpointer user_data)
 	ofono_modem_set_powered(modem, TRUE);
 }
 
-static gboolean sysinfo_enable_check(gpointer user_data);
-
-static void sysinfo_enable_cb(gboolean ok, GAtResult *result,
-						gpointer user_data)
+static void sysinfo_enable_done(struct ofono_modem *modem)
 {
-	struct ofono_modem *modem = user_data;
 	struct huawei_data *data = ofono_modem_get_data(modem);
-	int srv_status, srv_domain, sim_state;
-
-	if (!ok)
-		goto failure;
-
-	if (parse_sysinfo_result(result, &srv_status, &srv_domain,
-						&sim_state) == FALSE)
-		goto failure;
-
-	DBG("%d -> %d", data->sim_state, sim_state);
-
-	data->sim_state = sim_state;
 
-	if (sim_state == SIM_STATE_NOT_EXISTENT) {
+	if (data->sim_state == SIM_STATE_NOT_EXISTENT) {
 		data->sysinfo_poll_count++;
 
 		if (data->sysinfo_poll_count > 5)
@@ -445,6 +448,31 @@ failure:
 	ofono_modem_set_powered(modem, FALSE);
 }
 
+static void sysinfo_enable_cb(gboolean ok, GAtResult *result,
+						gpointer user_data)
+{
+	struct ofono_modem *modem = user_data;
+	struct huawei_data *data = ofono_modem_get_data(modem);
+	int srv_status, srv_domain, sim_state;
+
+	if (!ok)
+		goto failure;
+
+	if (parse_sysinfo_result(result, &srv_status, &srv_domain,
+						&sim_state) == FALSE)
+		goto failure;
+
+	DBG("%d -> %d", data->sim_state, sim_state);
+
+	data->sim_state = sim_state;
+	sysinfo_enable_done(modem);
+	return;
+
+failure:
+	shutdown_device(data);
+	ofono_modem_set_powered(modem, FALSE);
+}
+
 static gboolean sysinfo_enable_check(gpointer user_data)
 {
 	struct ofono_modem *modem = user_data;
@@ -452,6 +480,17 @@ static gboolean sysinfo_enable_check(gpointer user_data)
 
 	data->sysinfo_poll_source = 0;
 
+	/* ^SIMST already told whether the SIM is there */
+	if (data->sim_state_reported &&
+			data->sim_state != SIM_STATE_NOT_EXISTENT) {
+		data->sysinfo_avoided++;
+		DBG("SIM state %d known, ^SYSINFO avoided %u",
+					data->sim_state, data->sysinfo_avoided);
+		sysinfo_enable_done(modem);
+		return FALSE;
+	}
+
+	data->sysinfo_queries++;
 	g_at_chat_send(data->pcui, "AT^SYSINFO", sysinfo_prefix,
 					sysinfo_enable_cb, modem, NULL);
 
@@ -605,6 +644,7 @@ static int huawei_enable(struct ofono_modem *modem)
 	g_at_chat_send(data->pcui, "ATE0 +CMEE=1", NULL, NULL, NULL, NULL);
 
 	data->sim_state = SIM_STATE_NOT_EXISTENT;
+	data->sim_state_reported = FALSE;
 
 	/* Check for GSM capabilities */
 	g_at_chat_send(data->pcui, "ATI", gcap_prefix,
@@ -632,6 +672,8 @@ static int huawei_disable(struct ofono_modem *modem)
 	struct huawei_data *data = ofono_modem_get_data(modem);
 
 	DBG("%p", modem);
+	DBG("^SYSINFO queries %u, avoided %u", data->sysinfo_queries,
+						data->sysinfo_avoided);
 
 	g_at_chat_cancel_all(data->modem);
 	g_at_chat_unregister_all(data->modem);
@@ -657,7 +699,19 @@ static int huawei_disable(struct ofono_modem *modem)
 	return -EINPROGRESS;
 }
 
-static gboolean sysinfo_online_check(gpointer user_data);
+static gboolean sim_state_present(int sim_state)
+{
+	switch (sim_state) {
+	case SIM_STATE_VALID:
+	case SIM_STATE_INVALID_CS:
+	case SIM_STATE_INVALID_PS:
+	case SIM_STATE_INVALID_PS_AND_CS:
+	case SIM_STATE_ROMSIM:
+		return TRUE;
+	}
+
+	return FALSE;
+}
 
 static void sysinfo_online_cb(gboolean ok, GAtResult *result,
 						gpointer user_data)
@@ -683,12 +737,7 @@ static void sysinfo_online_cb(gboolean ok, GAtResult *result,
 		goto done;
 	}
 
-	switch (sim_state) {
-	case SIM_STATE_VALID:
-	case SIM_STATE_INVALID_CS:
-	case SIM_STATE_INVALID_PS:
-	case SIM_STATE_INVALID_PS_AND_CS:
-	case SIM_STATE_ROMSIM:
+	if (sim_state_present(sim_state)) {
 		CALLBACK_WITH_SUCCESS(cb, data->online_cbd->data);
 		goto done;
 	}
@@ -716,6 +765,21 @@ static gboolean sysinfo_online_check(gpointer user_data)
 
 	data->sysinfo_poll_source = 0;
 
+	/* A SIM that ^SIMST reported as present is enough to go online */
+	if (data->sim_state_reported && sim_state_present(data->sim_state)) {
+		ofono_modem_online_cb_t cb = data->online_cbd->cb;
+
+		data->sysinfo_avoided++;
+		DBG("SIM state %d known, ^SYSINFO avoided %u",
+					data->sim_state, data->sysinfo_avoided);
+
+		CALLBACK_WITH_SUCCESS(cb, data->online_cbd->data);
+		g_free(data->online_cbd);
+		data->online_cbd = NULL;
+		return FALSE;
+	}
+
+	data->sysinfo_queries++;
 	g_at_chat_send(data->pcui, "AT^SYSINFO", sysinfo_prefix,
 					sysinfo_online_cb, data, NULL);
 
@@ -429,6 +429,10 @@ static void setup_internal_mux(struct ofono_modem *modem)
 	for (i = 0; i < NUM_DLC; i++) {
 		GIOChannel *channel = g_at_mux_create_channel(data->mux);
 
+		/* Keep call control responsive during bulk data transfers */
+		if (i == VOICE_DLC)
+			g_at_mux_set_channel_priority(data->mux, channel, 4);
+
 		data->dlcs[i] = create_chat(channel, modem, dlc_prefixes[i]);
 		if (data->dlcs[i] == NULL) {
 			ofono_error("Failed to create channel");
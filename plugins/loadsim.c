@@ -0,0 +1,846 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/plugin.h>
+#include <ofono/log.h>
+#include <ofono/modem.h>
+#include <ofono/cbs.h>
+#include <ofono/netreg.h>
+#include <ofono/sim.h>
+#include <ofono/sms.h>
+#include <ofono/voicecall.h>
+
+#include "ofono.h"
+
+#include "common.h"
+
+#define LOADSIM_INTERFACE	"org.ofono.test.LoadSim"
+#define LOADSIM_PATH		"/test"
+#define LOADSIM_MAX_MODEMS	256
+
+#define CALLBACK_WITH_FAILURE(cb, args...)		\
+	do {						\
+		struct ofono_error cb_e;		\
+		cb_e.type = OFONO_ERROR_TYPE_FAILURE;	\
+		cb_e.error = 0;				\
+							\
+		cb(&cb_e, ##args);			\
+	} while (0)					\
+
+#define CALLBACK_WITH_SUCCESS(f, args...)		\
+	do {						\
+		struct ofono_error e;			\
+		e.type = OFONO_ERROR_TYPE_NO_ERROR;	\
+		e.error = 0;				\
+		f(&e, ##args);				\
+	} while (0)
+
+/*
+ * Creates any number of modems whose atoms are fed from timers instead
+ * of hardware.  Every event goes through the same notify functions a
+ * real driver would call, and the time the core spends in each of them,
+ * D-Bus signals and storage included, is accounted per event type.
+ * The SIM has no files besides the IMSI, so that it becomes ready right
+ * away, and the modems go online as soon as they are powered.  Event
+ * timers of different modems are spread over the interval so that the
+ * load is even rather than in bursts.
+ */
+enum loadsim_event {
+	LOADSIM_EVENT_REGISTRATION,
+	LOADSIM_EVENT_SIGNAL,
+	LOADSIM_EVENT_SMS,
+	LOADSIM_EVENT_CBS,
+	LOADSIM_EVENT_CALL,
+	LOADSIM_EVENT_COUNT,
+};
+
+static const char *const loadsim_event_names[] = {
+	[LOADSIM_EVENT_REGISTRATION] = "Registration",
+	[LOADSIM_EVENT_SIGNAL] = "Signal",
+	[LOADSIM_EVENT_SMS] = "Sms",
+	[LOADSIM_EVENT_CBS] = "Cbs",
+	[LOADSIM_EVENT_CALL] = "Call",
+};
+
+/* An SMS-DELIVER and a single CBS page of topic 50, from unit/test-sms */
+static const char loadsim_sms_pdu[] = "07911326040000F0040B911346610089F6"
+		"0000208062917314480CC8F71D14969741F977FD07";
+
+static const char loadsim_cbs_pdu[] = "011000320111C2327BFC76BBCBEE46A3D1"
+	"68341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46"
+	"A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A"
+	"8D46A3D100";
+
+struct loadsim_stat {
+	unsigned int count;
+	uint64_t total;
+	uint64_t max;
+};
+
+struct loadsim_data {
+	unsigned int index;
+	struct ofono_netreg *netreg;
+	struct ofono_sms *sms;
+	struct ofono_cbs *cbs;
+	struct ofono_voicecall *vc;
+	struct l_timeout *timers[LOADSIM_EVENT_COUNT];
+	unsigned int seq[LOADSIM_EVENT_COUNT];
+	int status;
+	int ci;
+	struct ofono_call call;
+	bool in_call;
+	int mr;
+};
+
+static struct l_queue *loadsim_modems;
+static unsigned int loadsim_count;
+static unsigned int loadsim_intervals[LOADSIM_EVENT_COUNT];
+static struct loadsim_stat loadsim_stats[LOADSIM_EVENT_COUNT];
+static uint64_t loadsim_start;
+static unsigned char *sms_pdu;
+static size_t sms_pdu_len;
+static unsigned char *cbs_pdu;
+static size_t cbs_pdu_len;
+
+static void loadsim_registration(struct loadsim_data *ld, unsigned int seq)
+{
+	/* A cell change every time, and coverage lost every fourth */
+	ld->ci += 1;
+	ld->status = seq % 4 == 3 ? NETWORK_REGISTRATION_STATUS_SEARCHING :
+					NETWORK_REGISTRATION_STATUS_REGISTERED;
+
+	ofono_netreg_status_notify(ld->netreg, ld->status, 0x1000, ld->ci,
+					ACCESS_TECHNOLOGY_EUTRAN);
+}
+
+static void loadsim_signal(struct loadsim_data *ld, unsigned int seq)
+{
+	struct ofono_netreg_signal signal;
+	int step = seq * 7 % 40;
+
+	ofono_netreg_signal_init(&signal);
+	signal.rssi = -100 + step;
+	signal.rsrp = -125 + step;
+
+	ofono_netreg_strength_notify(ld->netreg, 20 + step * 2);
+	ofono_netreg_signal_notify(ld->netreg, &signal);
+}
+
+static void loadsim_sms(struct loadsim_data *ld, unsigned int seq)
+{
+	ofono_sms_deliver_notify(ld->sms, sms_pdu, sms_pdu_len,
+					sms_pdu_len - sms_pdu[0] - 1);
+}
+
+static void loadsim_cbs(struct loadsim_data *ld, unsigned int seq)
+{
+	ofono_cbs_notify(ld->cbs, cbs_pdu, cbs_pdu_len);
+}
+
+/* Calls come in on one event and are hung up remotely on the next */
+static void loadsim_call(struct loadsim_data *ld, unsigned int seq)
+{
+	if (ld->in_call) {
+		ld->in_call = false;
+		ofono_voicecall_disconnected(ld->vc, ld->call.id,
+				OFONO_DISCONNECT_REASON_REMOTE_HANGUP, NULL);
+		return;
+	}
+
+	ofono_call_init(&ld->call);
+	ld->call.id = ofono_voicecall_get_next_callid(ld->vc);
+	ld->call.type = 0;
+	ld->call.direction = CALL_DIRECTION_MOBILE_TERMINATED;
+	ld->call.status = CALL_STATUS_INCOMING;
+	ld->call.clip_validity = CLIP_VALIDITY_VALID;
+	snprintf(ld->call.phone_number.number,
+			sizeof(ld->call.phone_number.number),
+			"1555%07u", ld->index * 1000 + seq % 1000);
+	ld->call.phone_number.type = 129;
+
+	ld->in_call = true;
+	ofono_voicecall_notify(ld->vc, &ld->call);
+}
+
+static void (*const loadsim_generators[])(struct loadsim_data *ld,
+							unsigned int seq) = {
+	[LOADSIM_EVENT_REGISTRATION] = loadsim_registration,
+	[LOADSIM_EVENT_SIGNAL] = loadsim_signal,
+	[LOADSIM_EVENT_SMS] = loadsim_sms,
+	[LOADSIM_EVENT_CBS] = loadsim_cbs,
+	[LOADSIM_EVENT_CALL] = loadsim_call,
+};
+
+static void loadsim_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct loadsim_data *ld = user_data;
+	struct loadsim_stat *s;
+	enum loadsim_event ev;
+	uint64_t start;
+	uint64_t elapsed;
+
+	for (ev = 0; ev < LOADSIM_EVENT_COUNT; ev++)
+		if (ld->timers[ev] == timeout)
+			break;
+
+	if (ev == LOADSIM_EVENT_COUNT)
+		return;
+
+	start = l_time_now();
+	loadsim_generators[ev](ld, ld->seq[ev]++);
+	elapsed = l_time_diff(start, l_time_now());
+
+	s = &loadsim_stats[ev];
+	s->count += 1;
+	s->total += elapsed;
+	s->max = MAX(s->max, elapsed);
+
+	l_timeout_modify_ms(timeout, loadsim_intervals[ev]);
+}
+
+static bool loadsim_has_atom(struct loadsim_data *ld, enum loadsim_event ev)
+{
+	switch (ev) {
+	case LOADSIM_EVENT_REGISTRATION:
+	case LOADSIM_EVENT_SIGNAL:
+		return ld->netreg != NULL;
+	case LOADSIM_EVENT_SMS:
+		return ld->sms != NULL;
+	case LOADSIM_EVENT_CBS:
+		return ld->cbs != NULL;
+	case LOADSIM_EVENT_CALL:
+		return ld->vc != NULL;
+	case LOADSIM_EVENT_COUNT:
+		break;
+	}
+
+	return false;
+}
+
+static void loadsim_timers_start(struct loadsim_data *ld)
+{
+	enum loadsim_event ev;
+
+	for (ev = 0; ev < LOADSIM_EVENT_COUNT; ev++) {
+		unsigned int interval = loadsim_intervals[ev];
+
+		if (interval == 0 || ld->timers[ev])
+			continue;
+
+		if (!loadsim_has_atom(ld, ev))
+			continue;
+
+		ld->timers[ev] = l_timeout_create_ms(interval / loadsim_count *
+							ld->index + 1,
+							loadsim_timeout_cb,
+							ld, NULL);
+	}
+}
+
+static void loadsim_timers_stop(struct loadsim_data *ld)
+{
+	enum loadsim_event ev;
+
+	for (ev = 0; ev < LOADSIM_EVENT_COUNT; ev++) {
+		l_timeout_remove(ld->timers[ev]);
+		ld->timers[ev] = NULL;
+	}
+}
+
+static int loadsim_sim_probe(struct ofono_sim *sim, unsigned int vendor,
+								void *data)
+{
+	ofono_sim_set_data(sim, data);
+
+	return 0;
+}
+
+static void loadsim_sim_remove(struct ofono_sim *sim)
+{
+	ofono_sim_set_data(sim, NULL);
+}
+
+static void loadsim_read_file_info(struct ofono_sim *sim, int fileid,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_file_info_cb_t cb, void *data)
+{
+	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, NULL, 0, data);
+}
+
+static void loadsim_read_file(struct ofono_sim *sim, int fileid,
+				int start, int length,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *data)
+{
+	CALLBACK_WITH_FAILURE(cb, NULL, 0, data);
+}
+
+static void loadsim_read_imsi(struct ofono_sim *sim, ofono_sim_imsi_cb_t cb,
+								void *data)
+{
+	struct loadsim_data *ld = ofono_sim_get_data(sim);
+	char imsi[16];
+
+	snprintf(imsi, sizeof(imsi), "00101%010u", ld->index);
+
+	CALLBACK_WITH_SUCCESS(cb, imsi, data);
+}
+
+static void loadsim_query_passwd_state(struct ofono_sim *sim,
+					ofono_sim_passwd_cb_t cb, void *data)
+{
+	CALLBACK_WITH_SUCCESS(cb, OFONO_SIM_PASSWORD_NONE, data);
+}
+
+static const struct ofono_sim_driver sim_driver = {
+	.flags			= OFONO_ATOM_DRIVER_FLAG_REGISTER_ON_PROBE,
+	.probe			= loadsim_sim_probe,
+	.remove			= loadsim_sim_remove,
+	.read_file_info		= loadsim_read_file_info,
+	.read_file_transparent	= loadsim_read_file,
+	.read_file_linear	= loadsim_read_file,
+	.read_file_cyclic	= loadsim_read_file,
+	.read_imsi		= loadsim_read_imsi,
+	.query_passwd_state	= loadsim_query_passwd_state,
+};
+
+OFONO_ATOM_DRIVER_BUILTIN(sim, loadsim, &sim_driver)
+
+static int loadsim_netreg_probe(struct ofono_netreg *netreg,
+					unsigned int vendor, void *data)
+{
+	struct loadsim_data *ld = data;
+
+	ld->netreg = netreg;
+	ofono_netreg_set_data(netreg, ld);
+
+	return 0;
+}
+
+static void loadsim_netreg_remove(struct ofono_netreg *netreg)
+{
+	struct loadsim_data *ld = ofono_netreg_get_data(netreg);
+
+	ofono_netreg_set_data(netreg, NULL);
+	ld->netreg = NULL;
+}
+
+static void loadsim_registration_status(struct ofono_netreg *netreg,
+					ofono_netreg_status_cb_t cb,
+					void *data)
+{
+	struct loadsim_data *ld = ofono_netreg_get_data(netreg);
+
+	CALLBACK_WITH_SUCCESS(cb, ld->status, 0x1000, ld->ci,
+				ACCESS_TECHNOLOGY_EUTRAN, data);
+}
+
+static void loadsim_current_operator(struct ofono_netreg *netreg,
+					ofono_netreg_operator_cb_t cb,
+					void *data)
+{
+	struct ofono_network_operator op;
+
+	memset(&op, 0, sizeof(op));
+	l_strlcpy(op.name, "LoadSim", sizeof(op.name));
+	l_strlcpy(op.mcc, "001", sizeof(op.mcc));
+	l_strlcpy(op.mnc, "01", sizeof(op.mnc));
+	op.status = OPERATOR_STATUS_CURRENT;
+	op.tech = ACCESS_TECHNOLOGY_EUTRAN;
+
+	CALLBACK_WITH_SUCCESS(cb, &op, data);
+}
+
+static void loadsim_register_auto(struct ofono_netreg *netreg,
+					ofono_netreg_register_cb_t cb,
+					void *data)
+{
+	CALLBACK_WITH_SUCCESS(cb, data);
+}
+
+static void loadsim_register_manual(struct ofono_netreg *netreg,
+					const char *mcc, const char *mnc,
+					ofono_netreg_register_cb_t cb,
+					void *data)
+{
+	CALLBACK_WITH_FAILURE(cb, data);
+}
+
+static void loadsim_strength(struct ofono_netreg *netreg,
+				ofono_netreg_strength_cb_t cb, void *data)
+{
+	CALLBACK_WITH_SUCCESS(cb, 60, data);
+}
+
+static const struct ofono_netreg_driver netreg_driver = {
+	.flags			= OFONO_ATOM_DRIVER_FLAG_REGISTER_ON_PROBE,
+	.probe			= loadsim_netreg_probe,
+	.remove			= loadsim_netreg_remove,
+	.registration_status	= loadsim_registration_status,
+	.current_operator	= loadsim_current_operator,
+	.register_auto		= loadsim_register_auto,
+	.register_manual	= loadsim_register_manual,
+	.strength		= loadsim_strength,
+};
+
+OFONO_ATOM_DRIVER_BUILTIN(netreg, loadsim, &netreg_driver)
+
+static int loadsim_sms_probe(struct ofono_sms *sms, unsigned int vendor,
+								void *data)
+{
+	struct loadsim_data *ld = data;
+
+	ld->sms = sms;
+	ofono_sms_set_data(sms, ld);
+
+	return 0;
+}
+
+static void loadsim_sms_remove(struct ofono_sms *sms)
+{
+	struct loadsim_data *ld = ofono_sms_get_data(sms);
+
+	ofono_sms_set_data(sms, NULL);
+	ld->sms = NULL;
+}
+
+static void loadsim_sca_query(struct ofono_sms *sms,
+				ofono_sms_sca_query_cb_t cb, void *data)
+{
+	struct ofono_phone_number sca = { .number = "15555550000",
+						.type = 145 };
+
+	CALLBACK_WITH_SUCCESS(cb, &sca, data);
+}
+
+static void loadsim_submit(struct ofono_sms *sms, const unsigned char *pdu,
+				int pdu_len, int tpdu_len, int mms,
+				ofono_sms_submit_cb_t cb, void *data)
+{
+	struct loadsim_data *ld = ofono_sms_get_data(sms);
+
+	ld->mr = (ld->mr + 1) % 256;
+
+	CALLBACK_WITH_SUCCESS(cb, ld->mr, data);
+}
+
+static const struct ofono_sms_driver sms_driver = {
+	.flags			= OFONO_ATOM_DRIVER_FLAG_REGISTER_ON_PROBE,
+	.probe			= loadsim_sms_probe,
+	.remove			= loadsim_sms_remove,
+	.sca_query		= loadsim_sca_query,
+	.submit			= loadsim_submit,
+};
+
+OFONO_ATOM_DRIVER_BUILTIN(sms, loadsim, &sms_driver)
+
+static int loadsim_cbs_probe(struct ofono_cbs *cbs, unsigned int vendor,
+								void *data)
+{
+	struct loadsim_data *ld = data;
+
+	ld->cbs = cbs;
+	ofono_cbs_set_data(cbs, ld);
+
+	return 0;
+}
+
+static void loadsim_cbs_remove(struct ofono_cbs *cbs)
+{
+	struct loadsim_data *ld = ofono_cbs_get_data(cbs);
+
+	ofono_cbs_set_data(cbs, NULL);
+	ld->cbs = NULL;
+}
+
+static void loadsim_set_topics(struct ofono_cbs *cbs, const char *topics,
+				ofono_cbs_set_cb_t cb, void *data)
+{
+	CALLBACK_WITH_SUCCESS(cb, data);
+}
+
+static void loadsim_clear_topics(struct ofono_cbs *cbs,
+				ofono_cbs_set_cb_t cb, void *data)
+{
+	CALLBACK_WITH_SUCCESS(cb, data);
+}
+
+static const struct ofono_cbs_driver cbs_driver = {
+	.flags			= OFONO_ATOM_DRIVER_FLAG_REGISTER_ON_PROBE,
+	.probe			= loadsim_cbs_probe,
+	.remove			= loadsim_cbs_remove,
+	.set_topics		= loadsim_set_topics,
+	.clear_topics		= loadsim_clear_topics,
+};
+
+OFONO_ATOM_DRIVER_BUILTIN(cbs, loadsim, &cbs_driver)
+
+static int loadsim_voicecall_probe(struct ofono_voicecall *vc,
+					unsigned int vendor, void *data)
+{
+	struct loadsim_data *ld = data;
+
+	ld->vc = vc;
+	ofono_voicecall_set_data(vc, ld);
+
+	return 0;
+}
+
+static void loadsim_voicecall_remove(struct ofono_voicecall *vc)
+{
+	struct loadsim_data *ld = ofono_voicecall_get_data(vc);
+
+	ofono_voicecall_set_data(vc, NULL);
+	ld->vc = NULL;
+	ld->in_call = false;
+}
+
+static void loadsim_dial(struct ofono_voicecall *vc,
+				const struct ofono_phone_number *number,
+				enum ofono_clir_option clir,
+				ofono_voicecall_cb_t cb, void *data)
+{
+	CALLBACK_WITH_FAILURE(cb, data);
+}
+
+static void loadsim_answer(struct ofono_voicecall *vc,
+				ofono_voicecall_cb_t cb, void *data)
+{
+	struct loadsim_data *ld = ofono_voicecall_get_data(vc);
+
+	if (!ld->in_call) {
+		CALLBACK_WITH_FAILURE(cb, data);
+		return;
+	}
+
+	ld->call.status = CALL_STATUS_ACTIVE;
+	ofono_voicecall_notify(vc, &ld->call);
+
+	CALLBACK_WITH_SUCCESS(cb, data);
+}
+
+static void loadsim_hangup_active(struct ofono_voicecall *vc,
+				ofono_voicecall_cb_t cb, void *data)
+{
+	struct loadsim_data *ld = ofono_voicecall_get_data(vc);
+
+	if (ld->in_call) {
+		ld->in_call = false;
+		ofono_voicecall_disconnected(vc, ld->call.id,
+				OFONO_DISCONNECT_REASON_LOCAL_HANGUP, NULL);
+	}
+
+	CALLBACK_WITH_SUCCESS(cb, data);
+}
+
+static const struct ofono_voicecall_driver voicecall_driver = {
+	.flags			= OFONO_ATOM_DRIVER_FLAG_REGISTER_ON_PROBE,
+	.probe			= loadsim_voicecall_probe,
+	.remove			= loadsim_voicecall_remove,
+	.dial			= loadsim_dial,
+	.answer			= loadsim_answer,
+	.hangup_active		= loadsim_hangup_active,
+};
+
+OFONO_ATOM_DRIVER_BUILTIN(voicecall, loadsim, &voicecall_driver)
+
+static int loadsim_probe(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld;
+
+	DBG("%p", modem);
+
+	ld = l_new(struct loadsim_data, 1);
+	ld->index = ofono_modem_get_integer(modem, "Index");
+	ld->status = NETWORK_REGISTRATION_STATUS_REGISTERED;
+	ld->ci = ld->index << 8;
+
+	ofono_modem_set_data(modem, ld);
+
+	return 0;
+}
+
+static void loadsim_remove(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld = ofono_modem_get_data(modem);
+
+	DBG("%p", modem);
+
+	loadsim_timers_stop(ld);
+
+	ofono_modem_set_data(modem, NULL);
+	l_free(ld);
+}
+
+static int loadsim_enable(struct ofono_modem *modem)
+{
+	DBG("%p", modem);
+
+	return 0;
+}
+
+static int loadsim_disable(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld = ofono_modem_get_data(modem);
+
+	DBG("%p", modem);
+
+	loadsim_timers_stop(ld);
+
+	return 0;
+}
+
+static void loadsim_pre_sim(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld = ofono_modem_get_data(modem);
+	struct ofono_sim *sim;
+
+	DBG("%p", modem);
+
+	sim = ofono_sim_create(modem, 0, "loadsim", ld);
+	ofono_voicecall_create(modem, 0, "loadsim", ld);
+
+	if (sim)
+		ofono_sim_inserted_notify(sim, TRUE);
+}
+
+static void loadsim_post_sim(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld = ofono_modem_get_data(modem);
+
+	DBG("%p", modem);
+
+	ofono_sms_create(modem, 0, "loadsim", ld);
+	ofono_cbs_create(modem, 0, "loadsim", ld);
+}
+
+static void loadsim_post_online(struct ofono_modem *modem)
+{
+	struct loadsim_data *ld = ofono_modem_get_data(modem);
+
+	DBG("%p", modem);
+
+	ofono_netreg_create(modem, 0, "loadsim", ld);
+
+	loadsim_timers_start(ld);
+}
+
+static struct ofono_modem_driver loadsim_driver = {
+	.probe		= loadsim_probe,
+	.remove		= loadsim_remove,
+	.enable		= loadsim_enable,
+	.disable	= loadsim_disable,
+	.pre_sim	= loadsim_pre_sim,
+	.post_sim	= loadsim_post_sim,
+	.post_online	= loadsim_post_online,
+};
+
+OFONO_MODEM_DRIVER_BUILTIN(loadsim, &loadsim_driver)
+
+static void loadsim_modem_remove(void *data)
+{
+	ofono_modem_remove(data);
+}
+
+static void loadsim_stop(void)
+{
+	l_queue_destroy(loadsim_modems, loadsim_modem_remove);
+	loadsim_modems = NULL;
+	loadsim_count = 0;
+}
+
+static DBusMessage *loadsim_start_modems(DBusConnection *conn,
+						DBusMessage *msg,
+						void *user_data)
+{
+	dbus_uint32_t count;
+	dbus_uint32_t intervals[LOADSIM_EVENT_COUNT];
+	unsigned int i;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &count,
+			DBUS_TYPE_UINT32,
+				&intervals[LOADSIM_EVENT_REGISTRATION],
+			DBUS_TYPE_UINT32, &intervals[LOADSIM_EVENT_SIGNAL],
+			DBUS_TYPE_UINT32, &intervals[LOADSIM_EVENT_SMS],
+			DBUS_TYPE_UINT32, &intervals[LOADSIM_EVENT_CBS],
+			DBUS_TYPE_UINT32, &intervals[LOADSIM_EVENT_CALL],
+			DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (count == 0 || count > LOADSIM_MAX_MODEMS)
+		return __ofono_error_invalid_format(msg);
+
+	if (loadsim_modems)
+		return __ofono_error_busy(msg);
+
+	memcpy(loadsim_intervals, intervals, sizeof(loadsim_intervals));
+	memset(loadsim_stats, 0, sizeof(loadsim_stats));
+	loadsim_start = l_time_now();
+	loadsim_count = count;
+	loadsim_modems = l_queue_new();
+
+	for (i = 0; i < count; i++) {
+		struct ofono_modem *modem;
+		char name[16];
+
+		snprintf(name, sizeof(name), "loadsim%u", i);
+
+		modem = ofono_modem_create(name, "loadsim");
+		if (modem == NULL)
+			break;
+
+		ofono_modem_set_integer(modem, "Index", i);
+
+		if (ofono_modem_register(modem) < 0) {
+			ofono_modem_remove(modem);
+			break;
+		}
+
+		l_queue_push_tail(loadsim_modems, modem);
+	}
+
+	if (i < count) {
+		loadsim_stop();
+		return __ofono_error_failed(msg);
+	}
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *loadsim_stop_modems(DBusConnection *conn,
+						DBusMessage *msg,
+						void *user_data)
+{
+	if (loadsim_modems == NULL)
+		return __ofono_error_not_available(msg);
+
+	loadsim_stop();
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *loadsim_get_statistics(DBusConnection *conn,
+						DBusMessage *msg,
+						void *user_data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	DBusMessageIter entry;
+	DBusMessageIter stat;
+	dbus_uint64_t duration;
+	unsigned int i;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	duration = loadsim_start ? l_time_diff(loadsim_start,
+							l_time_now()) : 0;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &duration);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					"{s(uuu)}", &dict);
+
+	for (i = 0; i < LOADSIM_EVENT_COUNT; i++) {
+		const struct loadsim_stat *s = &loadsim_stats[i];
+		dbus_uint32_t mean;
+		dbus_uint32_t max = s->max;
+
+		if (s->count == 0)
+			continue;
+
+		mean = s->total / s->count;
+
+		dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						&loadsim_event_names[i]);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_STRUCT,
+							NULL, &stat);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32,
+							&s->count);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32, &mean);
+		dbus_message_iter_append_basic(&stat, DBUS_TYPE_UINT32, &max);
+		dbus_message_iter_close_container(&entry, &stat);
+		dbus_message_iter_close_container(&dict, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static const GDBusMethodTable loadsim_methods[] = {
+	{ GDBUS_METHOD("Start",
+		GDBUS_ARGS({ "modems", "u" }, { "registration", "u" },
+				{ "signal", "u" }, { "sms", "u" },
+				{ "cbs", "u" }, { "call", "u" }),
+		NULL, loadsim_start_modems) },
+	{ GDBUS_METHOD("Stop", NULL, NULL, loadsim_stop_modems) },
+	{ GDBUS_METHOD("GetStatistics",
+		NULL, GDBUS_ARGS({ "duration", "t" },
+					{ "events", "a{s(uuu)}" }),
+		loadsim_get_statistics) },
+	{ },
+};
+
+static int loadsim_init(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	DBG("");
+
+	sms_pdu = l_util_from_hexstring(loadsim_sms_pdu, &sms_pdu_len);
+	cbs_pdu = l_util_from_hexstring(loadsim_cbs_pdu, &cbs_pdu_len);
+
+	if (!g_dbus_register_interface(conn, LOADSIM_PATH, LOADSIM_INTERFACE,
+					loadsim_methods, NULL,
+					NULL, NULL, NULL)) {
+		ofono_error("Register LoadSim interface failed: %s",
+						LOADSIM_PATH);
+		l_free(sms_pdu);
+		l_free(cbs_pdu);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void loadsim_exit(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	DBG("");
+
+	loadsim_stop();
+
+	g_dbus_unregister_interface(conn, LOADSIM_PATH, LOADSIM_INTERFACE);
+
+	l_free(sms_pdu);
+	sms_pdu = NULL;
+	l_free(cbs_pdu);
+	cbs_pdu = NULL;
+}
+
+OFONO_PLUGIN_DEFINE(loadsim, "Load generating modem simulator", VERSION,
+			OFONO_PLUGIN_PRIORITY_DEFAULT, loadsim_init,
+			loadsim_exit)
@@ -28,6 +28,7 @@
 #include <ofono/sms.h>
 #include <ofono/gprs.h>
 #include <ofono/gprs-context.h>
+#include <ofono/trace.h>
 
 #include <ell/ell.h>
 
@@ -41,6 +42,7 @@ struct mbim_data {
 	uint16_t max_segment;
 	uint8_t max_outstanding;
 	uint8_t max_sessions;
+	bool enable_failed;
 };
 
 static void mbim_debug(const char *str, void *user_data)
@@ -50,6 +52,12 @@ static void mbim_debug(const char *str, void *user_data)
 	ofono_info("%s%s", prefix, str);
 }
 
+static void mbim_trace(bool in, int fd, const void *data, size_t len,
+							void *user_data)
+{
+	ofono_trace_record(OFONO_TRACE_LINK_MBIM, fd, in, data, len);
+}
+
 static int mbim_parse_descriptors(struct mbim_data *md, const char *file)
 {
 	void *data;
@@ -127,42 +135,17 @@ static void mbim_radio_state_init_cb(struct mbim_message *message, void *user)
 	bool r;
 
 	if (mbim_message_get_error(message) != 0)
-		goto error;
+		return;
 
 	r = mbim_message_get_arguments(message, "uu",
 					&hw_state, &sw_state);
-	if (!r)
-		goto error;
+	if (!r) {
+		md->enable_failed = true;
+		return;
+	}
 
 	/* TODO: How to handle HwRadioState != 1 */
 	DBG("HwRadioState: %u, SwRadioState: %u", hw_state, sw_state);
-	ofono_modem_set_powered(modem, TRUE);
-	return;
-
-error:
-	mbim_device_shutdown(md->device);
-}
-
-static void mbim_device_subscribe_list_set_cb(struct mbim_message *message,
-						void *user)
-{
-	struct ofono_modem *modem = user;
-	struct mbim_data *md = ofono_modem_get_data(modem);
-
-	if (mbim_message_get_error(message) != 0)
-		goto error;
-
-	message = mbim_message_new(mbim_uuid_basic_connect,
-					MBIM_CID_RADIO_STATE,
-					MBIM_COMMAND_TYPE_SET);
-
-	mbim_message_set_arguments(message, "u", 0);
-	if (mbim_device_send(md->device, 0, message,
-				mbim_radio_state_init_cb, modem, NULL))
-		return;
-
-error:
-	mbim_device_shutdown(md->device);
 }
 
 static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
@@ -184,7 +167,7 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 	bool r;
 
 	if (mbim_message_get_error(message) != 0)
-		goto error;
+		return;
 
 	r = mbim_message_get_arguments(message, "uuuuuuuussss",
 					&device_type, &cellular_class,
@@ -192,8 +175,10 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 					&sms_caps, &control_caps, &max_sessions,
 					&custom_data_class, &device_id,
 					&firmware_info, &hardware_info);
-	if (!r)
-		goto error;
+	if (!r) {
+		md->enable_failed = true;
+		return;
+	}
 
 	md->max_sessions = max_sessions;
 
@@ -208,32 +193,19 @@ static void mbim_device_caps_info_cb(struct mbim_message *message, void *user)
 	l_free(device_id);
 	l_free(firmware_info);
 	l_free(hardware_info);
+}
 
-	message = mbim_message_new(mbim_uuid_basic_connect,
-					MBIM_CID_DEVICE_SERVICE_SUBSCRIBE_LIST,
-					MBIM_COMMAND_TYPE_SET);
-
-	mbim_message_set_arguments(message, "av", 2,
-					"16yuuuuuuu",
-					mbim_uuid_basic_connect, 6,
-					MBIM_CID_SUBSCRIBER_READY_STATUS,
-					MBIM_CID_RADIO_STATE,
-					MBIM_CID_REGISTER_STATE,
-					MBIM_CID_PACKET_SERVICE,
-					MBIM_CID_SIGNAL_STATE,
-					MBIM_CID_CONNECT,
-					"16yuuuu", mbim_uuid_sms, 3,
-					MBIM_CID_SMS_CONFIGURATION,
-					MBIM_CID_SMS_READ,
-					MBIM_CID_SMS_MESSAGE_STORE_STATUS);
+static void mbim_enable_cb(bool success, void *user)
+{
+	struct ofono_modem *modem = user;
+	struct mbim_data *md = ofono_modem_get_data(modem);
 
-	if (mbim_device_send(md->device, 0, message,
-				mbim_device_subscribe_list_set_cb,
-				modem, NULL))
+	if (!success || md->enable_failed) {
+		mbim_device_shutdown(md->device);
 		return;
+	}
 
-error:
-	mbim_device_shutdown(md->device);
+	ofono_modem_set_powered(modem, TRUE);
 }
 
 static void mbim_device_closed(void *user_data)
@@ -251,13 +223,45 @@ static void mbim_device_ready(void *user_data)
 {
 	struct ofono_modem *modem = user_data;
 	struct mbim_data *md = ofono_modem_get_data(modem);
-	struct mbim_message *message =
-		mbim_message_new(mbim_uuid_basic_connect,
-					1, MBIM_COMMAND_TYPE_QUERY);
+	struct mbim_batch *batch = mbim_batch_new();
+	struct mbim_message *message;
 
+	/* None of these depend on each other, so send them in one go */
+	message = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_DEVICE_CAPS,
+					MBIM_COMMAND_TYPE_QUERY);
 	mbim_message_set_arguments(message, "");
-	mbim_device_send(md->device, 0, message,
-				mbim_device_caps_info_cb, modem, NULL);
+	mbim_batch_append(batch, message, mbim_device_caps_info_cb, modem);
+
+	message = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_DEVICE_SERVICE_SUBSCRIBE_LIST,
+					MBIM_COMMAND_TYPE_SET);
+	mbim_message_set_arguments(message, "av", 2,
+					"16yuuuuuuu",
+					mbim_uuid_basic_connect, 6,
+					MBIM_CID_SUBSCRIBER_READY_STATUS,
+					MBIM_CID_RADIO_STATE,
+					MBIM_CID_REGISTER_STATE,
+					MBIM_CID_PACKET_SERVICE,
+					MBIM_CID_SIGNAL_STATE,
+					MBIM_CID_CONNECT,
+					"16yuuuu", mbim_uuid_sms, 3,
+					MBIM_CID_SMS_CONFIGURATION,
+					MBIM_CID_SMS_READ,
+					MBIM_CID_SMS_MESSAGE_STORE_STATUS);
+	mbim_batch_append(batch, message, NULL, NULL);
+
+	message = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_RADIO_STATE,
+					MBIM_COMMAND_TYPE_SET);
+	mbim_message_set_arguments(message, "u", 0);
+	mbim_batch_append(batch, message, mbim_radio_state_init_cb, modem);
+
+	md->enable_failed = false;
+
+	if (!mbim_device_send_batch(md->device, 0, batch,
+					mbim_enable_cb, modem, NULL))
+		mbim_device_shutdown(md->device);
 }
 
 static int mbim_enable(struct ofono_modem *modem)
@@ -287,6 +291,9 @@ static int mbim_enable(struct ofono_modem *modem)
 					mbim_device_closed, modem, NULL);
 	mbim_device_set_debug(md->device, mbim_debug, "MBIM:", NULL);
 
+	if (ofono_trace_enabled())
+		mbim_device_set_trace(md->device, mbim_trace, NULL);
+
 	return -EINPROGRESS;
 }
 
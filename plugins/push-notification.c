@@ -68,10 +68,9 @@ static void push_received(const char *from, const struct tm *remote,
 					NULL, NULL, NULL);
 }
 
-static DBusMessage *push_notification_register_agent(DBusConnection *conn,
-						DBusMessage *msg, void *data)
+static DBusMessage *register_agent(struct push_notification *pn,
+					DBusMessage *msg, gboolean use_fd)
 {
-	struct push_notification *pn = data;
 	const char *agent_path;
 
 	if (pn->agent)
@@ -85,6 +84,9 @@ static DBusMessage *push_notification_register_agent(DBusConnection *conn,
 	if (!dbus_validate_path(agent_path, NULL))
 		return __ofono_error_invalid_format(msg);
 
+	if (use_fd && !sms_agent_fd_delivery_supported())
+		return __ofono_error_not_supported(msg);
+
 	pn->agent = sms_agent_new(AGENT_INTERFACE,
 					dbus_message_get_sender(msg),
 					agent_path);
@@ -92,6 +94,9 @@ static DBusMessage *push_notification_register_agent(DBusConnection *conn,
 	if (pn->agent == NULL)
 		return __ofono_error_failed(msg);
 
+	if (use_fd)
+		sms_agent_set_fd_delivery(pn->agent);
+
 	sms_agent_set_removed_notify(pn->agent, agent_exited, pn);
 
 	pn->push_watch = __ofono_sms_datagram_watch_add(pn->sms,
@@ -103,6 +108,18 @@ static DBusMessage *push_notification_register_agent(DBusConnection *conn,
 	return dbus_message_new_method_return(msg);
 }
 
+static DBusMessage *push_notification_register_agent(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	return register_agent(data, msg, FALSE);
+}
+
+static DBusMessage *push_notification_register_fd_agent(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	return register_agent(data, msg, TRUE);
+}
+
 static DBusMessage *push_notification_unregister_agent(DBusConnection *conn,
 						DBusMessage *msg, void *data)
 {
@@ -130,6 +147,8 @@ static DBusMessage *push_notification_unregister_agent(DBusConnection *conn,
 static const GDBusMethodTable push_notification_methods[] = {
 	{ GDBUS_METHOD("RegisterAgent",	GDBUS_ARGS({ "path", "o" }), NULL,
 			push_notification_register_agent) },
+	{ GDBUS_METHOD("RegisterFdAgent", GDBUS_ARGS({ "path", "o" }), NULL,
+			push_notification_register_fd_agent) },
 	{ GDBUS_METHOD("UnregisterAgent", GDBUS_ARGS({ "path", "o" }), NULL,
 			push_notification_unregister_agent) },
 	{ }
@@ -37,6 +37,7 @@
 #include <ofono/location-reporting.h>
 #include <ofono/log.h>
 #include <ofono/message-waiting.h>
+#include <ofono/trace.h>
 
 #include <ell/ell.h>
 
@@ -51,6 +52,7 @@
 #define DEFAULT_DL_DATAGRAMS 32
 #define DEFAULT_DL_AGGREGATION_SIZE 32768
 #define DEFAULT_UL_AGGREGATION_SIZE 16384
+#define UL_AGGREGATION_TIMEOUT_NS 3000000
 
 struct qrtrqmi_data {
 	struct qmi_qrtr_node *node;
@@ -61,6 +63,7 @@ struct qrtrqmi_data {
 	struct rmnet_ifinfo rmnet_interfaces[MAX_CONTEXTS];
 	uint8_t n_premux;
 	int rmnet_id;
+	struct qmi_wda_data_format negotiated;
 	uint32_t set_powered_id;
 	bool have_voice : 1;
 	bool soc_premux : 1;
@@ -73,6 +76,12 @@ static void qrtrqmi_io_debug(const char *str, void *user_data)
 	ofono_info("%s%s", prefix, str);
 }
 
+static void qrtrqmi_trace(bool in, int fd, const void *data, size_t len,
+							void *user_data)
+{
+	ofono_trace_record(OFONO_TRACE_LINK_QMI, fd, in, data, len);
+}
+
 static void qrtrqmi_debug(const char *str, void *user_data)
 {
 	const char *prefix = user_data;
@@ -251,6 +260,9 @@ static void set_data_format_cb(struct qmi_result *result, void *user_data)
 	struct ofono_modem *modem = user_data;
 	struct qrtrqmi_data *data = ofono_modem_get_data(modem);
 	struct qmi_wda_data_format format;
+	struct rmnet_aggregation aggregation = {
+		.timeout_ns = UL_AGGREGATION_TIMEOUT_NS,
+	};
 	int r;
 
 	DBG("");
@@ -266,9 +278,21 @@ static void set_data_format_cb(struct qmi_result *result, void *user_data)
 	DBG("DL Max Datagrams: %u", format.dl_max_datagrams);
 	DBG("DL Aggregation Protocol: %u", format.dl_aggregation_protocol);
 	DBG("UL Aggregation Protocol: %u", format.ul_aggregation_protocol);
+	DBG("UL Aggregation Size: %u", format.ul_max_size);
+	DBG("UL Max Datagrams: %u", format.ul_max_datagrams);
+
+	memcpy(&data->negotiated, &format, sizeof(format));
+
+	/* A zero size or datagram count leaves uplink aggregation off */
+	aggregation.max_size = DEFAULT_UL_AGGREGATION_SIZE;
+	if (format.ul_max_size < DEFAULT_UL_AGGREGATION_SIZE)
+		aggregation.max_size = format.ul_max_size;
+
+	aggregation.max_datagrams = format.ul_max_datagrams > UINT16_MAX ?
+					UINT16_MAX : format.ul_max_datagrams;
 
 	data->rmnet_id = rmnet_get_interfaces(data->main_net_ifindex,
-						MAX_CONTEXTS,
+						MAX_CONTEXTS, &aggregation,
 						rmnet_get_interfaces_cb,
 						modem, NULL);
 	if (data->rmnet_id > 0)
@@ -410,6 +434,9 @@ static int qrtrqmi_enable(struct ofono_modem *modem)
 		qmi_qrtr_node_set_io_debug(data->node,
 						qrtrqmi_io_debug, "QRTR: ");
 
+	if (ofono_trace_enabled())
+		qmi_qrtr_node_set_trace(data->node, qrtrqmi_trace, NULL);
+
 	r = qmi_qrtr_node_lookup(data->node, lookup_done, modem, NULL);
 	if (!r)
 		return -EINPROGRESS;
@@ -572,7 +599,8 @@ static int setup_gprs_context(uint8_t mux_id, const char *interface,
 								QMI_SERVICE_WDS);
 	struct ofono_gprs_context *gc;
 
-	gc = ofono_gprs_context_create(modem, 0, "qmimodem", mux_id, ipv4, ipv6);
+	gc = ofono_gprs_context_create(modem, 0, "qmimodem", mux_id, ipv4, ipv6,
+				data->soc_premux ? NULL : &data->negotiated);
 	if (!gc) {
 		ofono_warn("Unable to create gprs-context for: %s, %s[%u]",
 				ofono_modem_get_path(modem), interface, mux_id);
@@ -54,6 +54,8 @@ static const char *cgmm_prefix[] = { "UC15", "Quectel_M95", "EG916Q-GL", "Quecte
 					"EC21", "EC200", NULL };
 static const char *none_prefix[] = { NULL };
 
+#define QUECTEL_CACHE "quectel"
+
 static const uint8_t gsm0710_terminate[] = {
 	0xf9, /* open flag */
 	0x03, /* channel 0 */
@@ -81,9 +83,13 @@ struct quectel_data {
 	enum ofono_vendor vendor;
 	enum quectel_model model;
 	struct at_util_sim_state_query *sim_state_query;
+	struct at_util_chat_stats *chat_stats;
 	unsigned int sim_watch;
 	bool sim_locked;
 	bool sim_ready;
+	char *model_name;
+	bool profile_cached;
+	bool urc_configured;
 
 	/* used by quectel uart driver */
 	GIOChannel *device;
@@ -205,6 +211,7 @@ static void quectel_remove(struct ofono_modem *modem)
 	l_timeout_remove(data->gpio_timeout);
 	l_gpio_writer_free(data->gpio);
 	at_util_sim_state_query_free(data->sim_state_query);
+	at_util_chat_stats_free(data->chat_stats);
 	g_at_chat_unref(data->aux);
 	g_at_chat_unref(data->modem);
 	g_at_chat_unref(data->uart);
@@ -213,6 +220,7 @@ static void quectel_remove(struct ofono_modem *modem)
 	if (data->device)
 		g_io_channel_unref(data->device);
 
+	l_free(data->model_name);
 	l_free(data);
 }
 
@@ -268,6 +276,9 @@ static void close_serial(struct ofono_modem *modem)
 	at_util_sim_state_query_free(data->sim_state_query);
 	data->sim_state_query = NULL;
 
+	at_util_chat_stats_free(data->chat_stats);
+	data->chat_stats = NULL;
+
 	g_at_chat_unref(data->aux);
 	data->aux = NULL;
 
@@ -747,6 +758,37 @@ static void sim_state_cb(gboolean present, gpointer user_data)
 			NULL);
 }
 
+/*
+ * The model and the URC port and service domain settings, which the modem
+ * keeps in NV, are remembered once it came up.  The next enable then skips
+ * the model query and does not write the settings again.
+ */
+static void save_profile(struct ofono_modem *modem)
+{
+	struct quectel_data *data = ofono_modem_get_data(modem);
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+
+	if (data->profile_cached || data->model_name == NULL)
+		return;
+
+	cache = l_settings_new();
+	l_settings_set_string(cache, "Profile", "Model", data->model_name);
+	l_settings_set_bool(cache, "Profile", "UrcConfigured",
+				data->urc_configured);
+
+	at_util_device_cache_save(modem, QUECTEL_CACHE, cache);
+}
+
+static void enable_failed(struct ofono_modem *modem)
+{
+	struct quectel_data *data = ofono_modem_get_data(modem);
+
+	if (data->profile_cached)
+		at_util_device_cache_drop(modem, QUECTEL_CACHE);
+
+	close_serial(modem);
+}
+
 static void cfun_cb(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct ofono_modem *modem = user_data;
@@ -755,11 +797,17 @@ static void cfun_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	DBG("%p ok %d", modem, ok);
 
 	if (!ok) {
-		close_serial(modem);
+		enable_failed(modem);
 		return;
 	}
 
+	save_profile(modem);
 	dbus_hw_enable(modem);
+
+	data->chat_stats = at_util_chat_stats_new(modem);
+	at_util_chat_stats_add(data->chat_stats, "Modem", data->modem);
+	at_util_chat_stats_add(data->chat_stats, "Aux", data->aux);
+
 	data->sim_state_query = at_util_sim_state_query_new(data->aux,
 						2, 20, sim_state_cb, modem,
 						NULL);
@@ -773,7 +821,7 @@ static void cfun_enable(gboolean ok, GAtResult *result, gpointer user_data)
 	DBG("%p ok %d", modem, ok);
 
 	if (!ok) {
-		close_serial(modem);
+		enable_failed(modem);
 		return;
 	}
 
@@ -791,14 +839,14 @@ static void cfun_query(gboolean ok, GAtResult *result, gpointer user_data)
 	DBG("%p ok %d", modem, ok);
 
 	if (!ok) {
-		close_serial(modem);
+		enable_failed(modem);
 		return;
 	}
 
 	g_at_result_iter_init(&iter, result);
 
 	if (g_at_result_iter_next(&iter, "+CFUN:") == FALSE) {
-		close_serial(modem);
+		enable_failed(modem);
 		return;
 	}
 
@@ -821,6 +869,13 @@ static void cfun_query(gboolean ok, GAtResult *result, gpointer user_data)
 		cfun_enable(TRUE, NULL, modem);
 }
 
+static void urc_config_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct quectel_data *data = user_data;
+
+	data->urc_configured = ok;
+}
+
 static void setup_aux(struct ofono_modem *modem)
 {
 	struct quectel_data *data = ofono_modem_get_data(modem);
@@ -832,13 +887,19 @@ static void setup_aux(struct ofono_modem *modem)
 	if (data->model == QUECTEL_EC21) {
 		g_at_chat_send(data->aux, "ATE0; &C0; +CMEE=1", none_prefix,
 				NULL, NULL, NULL);
-		g_at_chat_send(data->aux, "AT+QURCCFG=\"urcport\",\"uart1\"", none_prefix,
-				NULL, NULL, NULL);
+
+		if (!data->urc_configured)
+			g_at_chat_send(data->aux,
+					"AT+QURCCFG=\"urcport\",\"uart1\"",
+					none_prefix, urc_config_cb, data, NULL);
 	} else if (data->model == QUECTEL_EC200) {
 		g_at_chat_send(data->aux, "ATE0; &C0; +CMEE=1", none_prefix,
 				NULL, NULL, NULL);
-		g_at_chat_send(data->aux, "AT+QCFG=\"servicedomain\",2", none_prefix,
-				NULL, NULL, NULL);
+
+		if (!data->urc_configured)
+			g_at_chat_send(data->aux,
+					"AT+QCFG=\"servicedomain\",2",
+					none_prefix, urc_config_cb, data, NULL);
 	} else
 		g_at_chat_send(data->aux, "ATE0; &C0; +CMEE=1; +QIURC=0",
 				none_prefix, NULL, NULL, NULL);
@@ -847,19 +908,12 @@ static void setup_aux(struct ofono_modem *modem)
 			NULL);
 }
 
-static void cgmm_cb(int ok, GAtResult *result, void *user_data)
+static void set_model(struct ofono_modem *modem, const char *model)
 {
-	struct ofono_modem *modem = user_data;
 	struct quectel_data *data = ofono_modem_get_data(modem);
-	const char *model;
 
-	DBG("%p ok %d", modem, ok);
-
-	if (!at_util_parse_attr(result, "", &model)) {
-		ofono_error("Failed to query modem model");
-		close_serial(modem);
-		return;
-	}
+	l_free(data->model_name);
+	data->model_name = l_strdup(model);
 
 	if (strcmp(model, "UC15") == 0) {
 		DBG("%p model UC15", modem);
@@ -890,16 +944,64 @@ static void cgmm_cb(int ok, GAtResult *result, void *user_data)
 		data->vendor = OFONO_VENDOR_QUECTEL;
 		data->model = QUECTEL_UNKNOWN;
 	}
+}
 
+static void cgmm_cb(int ok, GAtResult *result, void *user_data)
+{
+	struct ofono_modem *modem = user_data;
+	const char *model;
+
+	DBG("%p ok %d", modem, ok);
+
+	if (!at_util_parse_attr(result, "", &model)) {
+		ofono_error("Failed to query modem model");
+		close_serial(modem);
+		return;
+	}
+
+	set_model(modem, model);
 	setup_aux(modem);
 }
 
+static bool load_profile(struct ofono_modem *modem)
+{
+	struct quectel_data *data = ofono_modem_get_data(modem);
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+	_auto_(l_free) char *model = NULL;
+
+	cache = at_util_device_cache_load(modem, QUECTEL_CACHE);
+	if (!cache)
+		return false;
+
+	model = l_settings_get_string(cache, "Profile", "Model");
+	if (!model)
+		return false;
+
+	set_model(modem, model);
+
+	if (!l_settings_get_bool(cache, "Profile", "UrcConfigured",
+					&data->urc_configured))
+		data->urc_configured = false;
+
+	data->profile_cached = true;
+
+	return true;
+}
+
 static void identify_model(struct ofono_modem *modem)
 {
 	struct quectel_data *data = ofono_modem_get_data(modem);
 
 	DBG("%p", modem);
 
+	data->profile_cached = false;
+	data->urc_configured = false;
+
+	if (load_profile(modem)) {
+		setup_aux(modem);
+		return;
+	}
+
 	g_at_chat_send(data->aux, "AT+CGMM", cgmm_prefix, cgmm_cb, modem,
 			NULL);
 }
@@ -987,6 +1089,13 @@ static void cmux_gatmux(struct ofono_modem *modem)
 		return;
 	}
 
+	/*
+	 * Commands and URCs go over aux, keep them from queueing up behind
+	 * PPP frames on the modem channel while data is flowing
+	 */
+	g_at_mux_set_channel_priority(data->mux,
+					g_at_chat_get_channel(data->aux), 4);
+
 	identify_model(modem);
 }
 
@@ -350,6 +350,9 @@ static int create_gril(struct ofono_modem *modem)
 		return -EIO;
 	}
 	g_ril_set_slot(rd->ril, slot_id);
+	g_ril_set_report_intervals(rd->ril,
+		ofono_modem_get_integer(modem, "SignalStrengthInterval"),
+		ofono_modem_get_integer(modem, "CellInfoRate"));
 
 	if (getenv("OFONO_RIL_TRACE"))
 		g_ril_set_trace(rd->ril, TRUE);
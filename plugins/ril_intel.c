@@ -528,6 +528,10 @@ static int ril_enable(struct ofono_modem *modem)
 		return -EIO;
 	}
 
+	g_ril_set_report_intervals(rd->ril,
+		ofono_modem_get_integer(modem, "SignalStrengthInterval"),
+		ofono_modem_get_integer(modem, "CellInfoRate"));
+
 	if (getenv("OFONO_RIL_TRACE"))
 		g_ril_set_trace(rd->ril, TRUE);
 
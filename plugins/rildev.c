@@ -12,6 +12,7 @@
 
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include <glib.h>
@@ -23,8 +24,30 @@
 #include <ofono/modem.h>
 #include <ofono/log.h>
 
+/*
+ * rild can send signal strength and cell information several times a
+ * second, by default the drivers pass them on at most once a second
+ */
+#define DEFAULT_REPORT_INTERVAL_MS	1000
+
 static GSList *modem_list;
 
+static int report_interval(const char *name)
+{
+	const char *value = getenv(name);
+	char *endp;
+	unsigned long ms;
+
+	if (value == NULL || *value == '\0')
+		return DEFAULT_REPORT_INTERVAL_MS;
+
+	ms = strtoul(value, &endp, 10);
+	if (*endp != '\0' || ms > INT_MAX)
+		return DEFAULT_REPORT_INTERVAL_MS;
+
+	return ms;
+}
+
 static int create_rilmodem(const char *ril_type, int slot)
 {
 	struct ofono_modem *modem;
@@ -42,6 +65,10 @@ static int create_rilmodem(const char *ril_type, int slot)
 	modem_list = g_slist_prepend(modem_list, modem);
 
 	ofono_modem_set_integer(modem, "Slot", slot);
+	ofono_modem_set_integer(modem, "SignalStrengthInterval",
+			report_interval("OFONO_RIL_SIGNAL_STRENGTH_INTERVAL"));
+	ofono_modem_set_integer(modem, "CellInfoRate",
+			report_interval("OFONO_RIL_CELL_INFO_RATE"));
 
 	/* This causes driver->probe() to be called... */
 	retval = ofono_modem_register(modem);
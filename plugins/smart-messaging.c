@@ -91,10 +91,9 @@ static void vcal_received(const char *from, const struct tm *remote,
 					NULL, NULL, NULL);
 }
 
-static DBusMessage *smart_messaging_register_agent(DBusConnection *conn,
-					DBusMessage *msg, void *data)
+static DBusMessage *register_agent(struct smart_messaging *sm,
+					DBusMessage *msg, gboolean use_fd)
 {
-	struct smart_messaging *sm = data;
 	const char *agent_path;
 
 	if (sm->agent)
@@ -108,6 +107,9 @@ static DBusMessage *smart_messaging_register_agent(DBusConnection *conn,
 	if (!dbus_validate_path(agent_path, NULL))
 		return __ofono_error_invalid_format(msg);
 
+	if (use_fd && !sms_agent_fd_delivery_supported())
+		return __ofono_error_not_supported(msg);
+
 	sm->agent = sms_agent_new(AGENT_INTERFACE,
 					dbus_message_get_sender(msg),
 					agent_path);
@@ -115,6 +117,9 @@ static DBusMessage *smart_messaging_register_agent(DBusConnection *conn,
 	if (sm->agent == NULL)
 		return __ofono_error_failed(msg);
 
+	if (use_fd)
+		sms_agent_set_fd_delivery(sm->agent);
+
 	sms_agent_set_removed_notify(sm->agent, agent_exited, sm);
 
 	sm->vcard_watch = __ofono_sms_datagram_watch_add(sm->sms,
@@ -132,6 +137,18 @@ static DBusMessage *smart_messaging_register_agent(DBusConnection *conn,
 	return dbus_message_new_method_return(msg);
 }
 
+static DBusMessage *smart_messaging_register_agent(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return register_agent(data, msg, FALSE);
+}
+
+static DBusMessage *smart_messaging_register_fd_agent(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return register_agent(data, msg, TRUE);
+}
+
 static DBusMessage *smart_messaging_unregister_agent(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
@@ -255,6 +272,8 @@ static DBusMessage *smart_messaging_send_vcal(DBusConnection *conn,
 static const GDBusMethodTable smart_messaging_methods[] = {
 	{ GDBUS_METHOD("RegisterAgent", GDBUS_ARGS({ "path", "o" }), NULL,
 			smart_messaging_register_agent) },
+	{ GDBUS_METHOD("RegisterFdAgent", GDBUS_ARGS({ "path", "o" }), NULL,
+			smart_messaging_register_fd_agent) },
 	{ GDBUS_METHOD("UnregisterAgent", GDBUS_ARGS({ "path", "o" }), NULL,
 			smart_messaging_unregister_agent) },
 	{ GDBUS_ASYNC_METHOD("SendBusinessCard",
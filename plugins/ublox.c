@@ -36,9 +36,12 @@
 #include <ofono/message-waiting.h>
 #include <ofono/ussd.h>
 
+#include <drivers/atmodem/atutil.h>
 #include <drivers/atmodem/vendor.h>
 #include <drivers/ubloxmodem/ubloxmodem.h>
 
+#define UBLOX_CACHE "ublox"
+
 static const char *uusbconf_prefix[] = { "+UUSBCONF:", NULL };
 static const char *none_prefix[] = { NULL };
 
@@ -53,6 +56,8 @@ struct ublox_data {
 
 	const struct ublox_model *model;
 	int flags;
+	int usb_profile;
+	bool profile_cached;
 
 	struct l_timeout *init_timeout;
 	int init_count;
@@ -105,17 +110,100 @@ static void close_devices(struct ofono_modem* modem)
 	ofono_modem_set_powered(modem, FALSE);
 }
 
+static bool set_usb_profile(struct ublox_data *data, int profile)
+{
+	switch (profile) {
+	case 0: /* Fairly back compatible */
+	case 1: /* Fairly back compatible plus audio */
+		break;
+	case 2: /* Low/medium throughput */
+		ofono_error("Medium throughput mode not supported");
+		return false;
+	case 3: /* High throughput mode */
+		data->flags |= UBLOX_DEVICE_F_HIGH_THROUGHPUT_MODE;
+		break;
+	default:
+		ofono_error("Unexpected USB profile: %d", profile);
+		return false;
+	}
+
+	data->usb_profile = profile;
+
+	return true;
+}
+
+/*
+ * The model and the USB profile only change with a firmware upgrade or an
+ * explicit AT+UUSBCONF, which needs a reboot.  They are remembered once the
+ * modem came up, so that the next enable can skip querying them.
+ */
+static void save_profile(struct ofono_modem *modem)
+{
+	struct ublox_data *data = ofono_modem_get_data(modem);
+	_auto_(l_settings_free) struct l_settings *cache = l_settings_new();
+
+	l_settings_set_string(cache, "Profile", "Model", data->model->name);
+
+	if (data->model->flags & UBLOX_F_HAVE_USBCONF)
+		l_settings_set_int(cache, "Profile", "UsbProfile",
+					data->usb_profile);
+
+	at_util_device_cache_save(modem, UBLOX_CACHE, cache);
+}
+
+static bool load_profile(struct ofono_modem *modem)
+{
+	struct ublox_data *data = ofono_modem_get_data(modem);
+	_auto_(l_settings_free) struct l_settings *cache = NULL;
+	_auto_(l_free) char *model = NULL;
+	const struct ublox_model *m;
+	int profile;
+
+	cache = at_util_device_cache_load(modem, UBLOX_CACHE);
+	if (!cache)
+		return false;
+
+	model = l_settings_get_string(cache, "Profile", "Model");
+	m = model ? ublox_model_from_name(model) : NULL;
+	if (!m)
+		return false;
+
+	if (m->flags & UBLOX_F_HAVE_USBCONF) {
+		if (!l_settings_get_int(cache, "Profile", "UsbProfile",
+								&profile))
+			return false;
+
+		if (!set_usb_profile(data, profile))
+			return false;
+	}
+
+	data->model = m;
+	data->vendor_family = OFONO_VENDOR_UBLOX;
+	data->profile_cached = true;
+
+	DBG("Cached model: %s", data->model->name);
+
+	return true;
+}
+
 static void cfun_enable(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct ofono_modem *modem = user_data;
+	struct ublox_data *data = ofono_modem_get_data(modem);
 
 	DBG("ok %d", ok);
 
 	if (!ok) {
+		if (data->profile_cached)
+			at_util_device_cache_drop(modem, UBLOX_CACHE);
+
 		close_devices(modem);
 		return;
 	}
 
+	if (!data->profile_cached)
+		save_profile(modem);
+
 	ofono_modem_set_powered(modem, TRUE);
 }
 
@@ -143,20 +231,8 @@ retry:
 	if (!g_at_result_iter_next_number(&iter, &profile))
 		goto retry;
 
-	switch (profile) {
-	case 0: /* Fairly back compatible */
-	case 1: /* Fairly back compatible plus audio */
-		break;
-	case 2: /* Low/medium throughput */
-		ofono_error("Medium throughput mode not supported");
-		goto error;
-	case 3: /* High throughput mode */
-		data->flags |= UBLOX_DEVICE_F_HIGH_THROUGHPUT_MODE;
-		break;
-	default:
-		ofono_error("Unexpected USB profile: %d", profile);
+	if (!set_usb_profile(data, profile))
 		goto error;
-	}
 
 	if (g_at_chat_send(data->aux, "AT+CFUN=4", none_prefix,
 					cfun_enable, modem, NULL))
@@ -271,6 +347,14 @@ static void init_timeout_cb(struct l_timeout *timeout, void *user_data)
 	g_at_chat_send(data->aux, "AT+CMEE=1", none_prefix,
 					NULL, NULL, NULL);
 
+	if (load_profile(modem)) {
+		if (g_at_chat_send(data->aux, "AT+CFUN=4", none_prefix,
+						cfun_enable, modem, NULL) > 0)
+			return;
+
+		goto fail;
+	}
+
 	if (g_at_chat_send(data->aux, "AT+CGMM", NULL,
 				query_model_cb, modem, NULL) > 0)
 		return;
@@ -327,6 +411,7 @@ static int ublox_enable(struct ofono_modem *modem)
 	 * reliably.)
 	 */
 
+	data->profile_cached = false;
 	data->init_count = 0;
 	data->init_cmd = g_at_chat_send(data->aux, "AT", none_prefix,
 					init_cmd_cb, modem, NULL);
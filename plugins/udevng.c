@@ -25,6 +25,8 @@
 #include <ofono/modem.h>
 #include <ofono/log.h>
 
+#include "ofono.h"
+
 enum modem_type {
 	MODEM_TYPE_USB,
 	MODEM_TYPE_SERIAL,
@@ -46,6 +48,7 @@ struct modem_info {
 	};
 	struct ofono_modem *modem;
 	const char *sysattr;
+	guint settle_source;
 };
 
 struct device_info {
@@ -233,6 +236,30 @@ static int setup_qmi_netdev(struct modem_info *modem,
 	return 0;
 }
 
+/* Lets the driver recognise the device across restarts */
+static void set_usb_identity(struct modem_info *modem,
+				const struct device_info *info)
+{
+	struct udev_device *usb_device;
+	const char *serial;
+	const char *revision;
+
+	usb_device = udev_device_get_parent_with_subsystem_devtype(
+							info->udev_device,
+							"usb", "usb_device");
+	if (usb_device == NULL)
+		return;
+
+	serial = udev_device_get_sysattr_value(usb_device, "serial");
+	revision = udev_device_get_sysattr_value(usb_device, "bcdDevice");
+
+	if (serial)
+		ofono_modem_set_string(modem->modem, "SerialNumber", serial);
+
+	if (revision)
+		ofono_modem_set_string(modem->modem, "Revision", revision);
+}
+
 static int setup_qmi_qmux(struct modem_info *modem,
 				const struct device_info *qmi,
 				const struct device_info *net)
@@ -256,6 +283,8 @@ static int setup_qmi_qmux(struct modem_info *modem,
 
 	ofono_modem_set_string(modem->modem, "Bus", "usb");
 
+	set_usb_identity(modem, qmi);
+
 	return setup_qmi_netdev(modem, net);
 }
 
@@ -1072,6 +1101,8 @@ static gboolean setup_quectel_usb(struct modem_info *modem)
 	ofono_modem_set_string(modem->modem, "Aux", aux);
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
 
+	set_usb_identity(modem, modem->devices->data);
+
 	return TRUE;
 }
 
@@ -1362,6 +1393,8 @@ static gboolean setup_ublox(struct modem_info *modem)
 	ofono_modem_set_string(modem->modem, "Modem", mdm);
 	ofono_modem_set_string(modem->modem, "NetworkInterface", net);
 
+	set_usb_identity(modem, modem->devices->data);
+
 	return TRUE;
 }
 
@@ -1681,7 +1714,7 @@ static gboolean setup_mhi(struct modem_info *modem)
 	return TRUE;
 }
 
-static struct {
+static struct driver_entry {
 	const char *name;
 	gboolean (*setup)(struct modem_info *modem);
 	const char *sysattr;
@@ -1729,16 +1762,27 @@ static struct {
 
 static GHashTable *modem_list;
 
+/* driver_list and vendor_list hashed at init, see build_match_index() */
+static GHashTable *driver_index;
+static GHashTable *vendor_index;
+
+static struct {
+	unsigned int checked;		/* USB devices looked at */
+	unsigned int by_property;	/* Matched through OFONO_DRIVER */
+	unsigned int by_table;		/* Matched through vendor_list */
+	unsigned int unmatched;
+	unsigned int modems;		/* Modems set up and registered */
+	unsigned int setup_failed;
+} match_stats;
+
 static const char *get_sysattr(const char *driver)
 {
-	unsigned int i;
+	struct driver_entry *entry = g_hash_table_lookup(driver_index, driver);
 
-	for (i = 0; driver_list[i].name; i++) {
-		if (g_str_equal(driver_list[i].name, driver) == TRUE)
-			return driver_list[i].sysattr;
-	}
+	if (entry == NULL)
+		return NULL;
 
-	return NULL;
+	return entry->sysattr;
 }
 
 static void device_info_free(struct device_info *info)
@@ -1769,6 +1813,9 @@ static void destroy_modem(gpointer data)
 
 	DBG("%s", modem->syspath);
 
+	if (modem->settle_source > 0)
+		g_source_remove(modem->settle_source);
+
 	ofono_modem_remove(modem->modem);
 
 	switch (modem->type) {
@@ -1885,6 +1932,45 @@ static struct udev_device *get_serial_modem_device(struct udev_device *dev)
  * - The modem consists of only a single interface
  * - The device must have an OFONO_DRIVER property from udev
  */
+/*
+ * A hub coming back announces its interfaces one uevent at a time.  Every
+ * new interface restarts the settle window of its modem, and the modem is
+ * only set up once no interface has shown up for settle_time ms, with the
+ * complete interface set.  Each modem has its own window, so a busy hub
+ * doesn't hold back the others.
+ */
+#define DEFAULT_SETTLE_TIME 1000
+
+static unsigned int settle_time = DEFAULT_SETTLE_TIME;
+
+static gboolean create_modem(gpointer key, gpointer value, gpointer user_data);
+
+static gboolean modem_settled(gpointer user_data)
+{
+	struct modem_info *modem = user_data;
+
+	modem->settle_source = 0;
+
+	DBG("%s", modem->syspath);
+
+	if (create_modem(modem->syspath, modem, NULL))
+		g_hash_table_remove(modem_list, modem->syspath);
+
+	return FALSE;
+}
+
+static void modem_settle(struct modem_info *modem)
+{
+	/* Already set up, late interfaces don't cause a second setup */
+	if (modem->modem != NULL)
+		return;
+
+	if (modem->settle_source > 0)
+		g_source_remove(modem->settle_source);
+
+	modem->settle_source = g_timeout_add(settle_time, modem_settled, modem);
+}
+
 static void add_serial_device(struct udev_device *dev)
 {
 	const char *syspath, *devpath, *devname, *devnode;
@@ -1935,6 +2021,8 @@ static void add_serial_device(struct udev_device *dev)
 	info->dev = udev_device_ref(dev);
 
 	modem->serial = info;
+
+	modem_settle(modem);
 }
 
 static void add_device(const char *modem_syspath, const char *modem_devname,
@@ -2027,6 +2115,8 @@ static void add_device(const char *modem_syspath, const char *modem_devname,
 
 	modem->devices = g_slist_insert_sorted(modem->devices, info,
 							compare_device);
+
+	modem_settle(modem);
 }
 
 static struct {
@@ -2132,6 +2222,58 @@ static struct {
 	{ }
 };
 
+static char *vendor_key(const char *drv, const char *vid, const char *pid)
+{
+	return g_strdup_printf("%s:%s:%s", drv, vid ? vid : "",
+							pid ? pid : "");
+}
+
+/*
+ * Tries the most specific entries first, an entry for the exact vid:pid
+ * wins over one for all the products of a vendor or of a kernel driver.
+ */
+static const char *lookup_vendor(const char *drv, const char *vid,
+					const char *pid)
+{
+	const char *keys[][2] = {
+		{ vid, pid }, { vid, NULL }, { NULL, pid }, { NULL, NULL },
+	};
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(keys); i++) {
+		char *key = vendor_key(drv, keys[i][0], keys[i][1]);
+		const char *driver = g_hash_table_lookup(vendor_index, key);
+
+		g_free(key);
+
+		if (driver)
+			return driver;
+	}
+
+	return NULL;
+}
+
+static void build_match_index(void)
+{
+	unsigned int i;
+
+	driver_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (i = 0; driver_list[i].name; i++)
+		g_hash_table_insert(driver_index, (char *) driver_list[i].name,
+							&driver_list[i]);
+
+	vendor_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
+
+	for (i = 0; vendor_list[i].driver; i++)
+		g_hash_table_replace(vendor_index,
+					vendor_key(vendor_list[i].drv,
+							vendor_list[i].vid,
+							vendor_list[i].pid),
+					(char *) vendor_list[i].driver);
+}
+
 static void check_usb_device(struct udev_device *device)
 {
 	struct udev_device *usb_device;
@@ -2182,34 +2324,25 @@ static void check_usb_device(struct udev_device *device)
 		}
 	}
 
-	if (driver == NULL) {
-		unsigned int i;
+	match_stats.checked += 1;
 
+	if (driver == NULL) {
 		DBG("%s [%s:%s]", kernel_driver, vendor, model);
 
-		if (vendor == NULL || model == NULL)
+		if (vendor == NULL || model == NULL) {
+			match_stats.unmatched += 1;
 			return;
-
-		for (i = 0; vendor_list[i].driver; i++) {
-			if (g_strcmp0(vendor_list[i].drv, kernel_driver))
-				continue;
-
-			if (vendor_list[i].vid) {
-				if (!g_str_equal(vendor_list[i].vid, vendor))
-					continue;
-			}
-
-			if (vendor_list[i].pid) {
-				if (!g_str_equal(vendor_list[i].pid, model))
-					continue;
-			}
-
-			driver = vendor_list[i].driver;
 		}
 
-		if (driver == NULL)
+		driver = lookup_vendor(kernel_driver, vendor, model);
+		if (driver == NULL) {
+			match_stats.unmatched += 1;
 			return;
-	}
+		}
+
+		match_stats.by_table += 1;
+	} else
+		match_stats.by_property += 1;
 
 	add_device(syspath, devname, driver, vendor, model, MODEM_TYPE_USB,
 			device, kernel_driver);
@@ -2451,7 +2584,12 @@ static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
 {
 	struct modem_info *modem = value;
 	const char *syspath = key;
-	unsigned int i;
+	struct driver_entry *entry;
+
+	if (modem->settle_source > 0) {
+		g_source_remove(modem->settle_source);
+		modem->settle_source = 0;
+	}
 
 	if (modem->modem != NULL)
 		return FALSE;
@@ -2467,22 +2605,21 @@ static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
 	if (modem->modem == NULL)
 		return TRUE;
 
-	for (i = 0; driver_list[i].name; i++) {
-		if (g_str_equal(driver_list[i].name, modem->driver) == FALSE)
-			continue;
-
-		if (driver_list[i].setup(modem) == TRUE) {
-			ofono_modem_set_string(modem->modem, "SystemPath",
-								syspath);
-			if (ofono_modem_register(modem->modem) < 0) {
-				DBG("could not register modem '%s'", modem->driver);
-				return TRUE;
-			}
+	entry = g_hash_table_lookup(driver_index, modem->driver);
 
-			return FALSE;
+	if (entry && entry->setup(modem) == TRUE) {
+		ofono_modem_set_string(modem->modem, "SystemPath", syspath);
+		if (ofono_modem_register(modem->modem) < 0) {
+			DBG("could not register modem '%s'", modem->driver);
+			match_stats.setup_failed += 1;
+			return TRUE;
 		}
+
+		match_stats.modems += 1;
+		return FALSE;
 	}
 
+	match_stats.setup_failed += 1;
 	return TRUE;
 }
 
@@ -2525,23 +2662,17 @@ static void enumerate_devices(struct udev *context)
 	udev_enumerate_unref(enumerate);
 
 	g_hash_table_foreach_remove(modem_list, create_modem, NULL);
+
+	DBG("checked %u usb devices: %u by property, %u by table, "
+		"%u unmatched; %u modems, %u setups failed",
+		match_stats.checked, match_stats.by_property,
+		match_stats.by_table, match_stats.unmatched,
+		match_stats.modems, match_stats.setup_failed);
 }
 
 static struct udev *udev_ctx;
 static struct udev_monitor *udev_mon;
 static guint udev_watch = 0;
-static guint udev_delay = 0;
-
-static gboolean check_modem_list(gpointer user_data)
-{
-	udev_delay = 0;
-
-	DBG("");
-
-	g_hash_table_foreach_remove(modem_list, create_modem, NULL);
-
-	return FALSE;
-}
 
 static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
@@ -2563,14 +2694,9 @@ static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 	if (action == NULL)
 		return TRUE;
 
-	if (g_str_equal(action, "add") == TRUE) {
-		if (udev_delay > 0)
-			g_source_remove(udev_delay);
-
+	if (g_str_equal(action, "add") == TRUE)
 		check_device(device);
-
-		udev_delay = g_timeout_add_seconds(1, check_modem_list, NULL);
-	} else if (g_str_equal(action, "remove") == TRUE)
+	else if (g_str_equal(action, "remove") == TRUE)
 		remove_device(device);
 
 	udev_device_unref(device);
@@ -2624,6 +2750,12 @@ static int detect_init(void)
 	modem_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 						NULL, destroy_modem);
 
+	build_match_index();
+
+	if (!l_settings_get_uint(__ofono_get_config(), "Udev", "SettleTime",
+					&settle_time))
+		settle_time = DEFAULT_SETTLE_TIME;
+
 	udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "tty", NULL);
 	udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "usb", NULL);
 	udev_monitor_filter_add_match_subsystem_devtype(udev_mon,
@@ -2642,9 +2774,6 @@ static int detect_init(void)
 
 static void detect_exit(void)
 {
-	if (udev_delay > 0)
-		g_source_remove(udev_delay);
-
 	if (udev_watch > 0)
 		g_source_remove(udev_watch);
 
@@ -2654,6 +2783,8 @@ static void detect_exit(void)
 	udev_monitor_filter_remove(udev_mon);
 
 	g_hash_table_destroy(modem_list);
+	g_hash_table_destroy(driver_index);
+	g_hash_table_destroy(vendor_index);
 
 	udev_monitor_unref(udev_mon);
 	udev_unref(udev_ctx);
@@ -105,6 +105,33 @@ struct xmm7xxx_data {
 /* eUICC Implementation */
 #define EUICC_EID_CMD "80e2910006BF3E035C015A00"
 #define EUICC_ISDR_AID "A0000005591010FFFFFFFF8900000100"
+#define EUICC_INS_STORE_DATA 0xE2
+#define EUICC_INS_GET_RESPONSE 0xC0
+#define EUICC_MAX_SHORT_LC 255
+
+struct euicc_apdu {
+	unsigned char *buf;
+	unsigned int len;
+};
+
+/*
+ * APDUs of a TransmitLpaApdu or TransmitLpaApduList request, run one
+ * after the other on the ISD-R channel.  Commands with more data than
+ * fits a short APDU are sent as STORE DATA blocks, and the responses
+ * chained with 61xx are gathered with GET RESPONSE before being stored.
+ */
+struct euicc_batch {
+	DBusMessage *msg;
+	ofono_bool_t list;
+	struct euicc_apdu *commands;
+	struct euicc_apdu *responses;
+	unsigned int n_commands;
+	unsigned int n_responses;
+	unsigned int offset;		/* Data sent of the current command */
+	unsigned char block;		/* STORE DATA block number */
+	struct euicc_apdu sent;		/* Last APDU sent to the card */
+	struct euicc_apdu response;	/* Response data gathered so far */
+};
 
 struct xmm7xxx_euicc {
 	GAtChat *chat;
@@ -114,9 +141,27 @@ struct xmm7xxx_euicc {
 	char *command;
 	int length;
 	DBusMessage *pending;
+	struct euicc_batch *batch;
 	ofono_bool_t is_registered;
 };
 
+static void euicc_batch_free(struct euicc_batch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->n_commands; i++)
+		g_free(batch->commands[i].buf);
+
+	for (i = 0; i < batch->n_responses; i++)
+		g_free(batch->responses[i].buf);
+
+	g_free(batch->commands);
+	g_free(batch->responses);
+	g_free(batch->sent.buf);
+	g_free(batch->response.buf);
+	g_free(batch);
+}
+
 static void euicc_cleanup(void *data)
 {
 	struct xmm7xxx_euicc *euicc = data;
@@ -127,6 +172,9 @@ static void euicc_cleanup(void *data)
 	if (euicc->pending)
 		dbus_message_unref(euicc->pending);
 
+	if (euicc->batch)
+		euicc_batch_free(euicc->batch);
+
 	g_free(euicc);
 }
 
@@ -201,6 +249,8 @@ static DBusMessage *euicc_get_properties(DBusConnection *conn,
 
 static DBusMessage *euicc_transmit_pdu(DBusConnection *conn,
 					DBusMessage *msg, void *data);
+static DBusMessage *euicc_transmit_pdu_list(DBusConnection *conn,
+					DBusMessage *msg, void *data);
 static DBusMessage *euicc_select_isdr_req(DBusConnection *conn,
 						DBusMessage *msg, void *data);
 static DBusMessage *euicc_release_isdr_req(DBusConnection *conn,
@@ -211,6 +261,10 @@ static const GDBusMethodTable euicc_methods[] = {
 			GDBUS_ARGS({ "pdu", "ay" }),
 			GDBUS_ARGS({ "pdu", "ay" }),
 			euicc_transmit_pdu) },
+	{ GDBUS_ASYNC_METHOD("TransmitLpaApduList",
+			GDBUS_ARGS({ "pdus", "aay" }),
+			GDBUS_ARGS({ "pdus", "aay" }),
+			euicc_transmit_pdu_list) },
 	{ GDBUS_ASYNC_METHOD("SelectISDR",
 			NULL, NULL, euicc_select_isdr_req) },
 	{ GDBUS_ASYNC_METHOD("ReleaseISDR",
@@ -364,13 +418,342 @@ static void euicc_select_isdr(struct xmm7xxx_euicc *euicc)
 			euicc_select_isdr_cb, euicc, NULL);
 }
 
+static void euicc_apdu_append(struct euicc_apdu *apdu,
+				const unsigned char *data, unsigned int len)
+{
+	apdu->buf = g_realloc(apdu->buf, apdu->len + len);
+	memcpy(apdu->buf + apdu->len, data, len);
+	apdu->len += len;
+}
+
+static void euicc_apdu_set(struct euicc_apdu *apdu,
+				const unsigned char *data, unsigned int len)
+{
+	apdu->len = 0;
+	euicc_apdu_append(apdu, data, len);
+}
+
+static void euicc_batch_reply(struct xmm7xxx_euicc *euicc,
+						DBusMessage *reply)
+{
+	euicc_batch_free(euicc->batch);
+	euicc->batch = NULL;
+
+	__ofono_dbus_pending_reply(&euicc->pending, reply);
+}
+
+static void euicc_batch_append_response(DBusMessageIter *iter,
+					const struct euicc_apdu *response)
+{
+	DBusMessageIter array;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_BYTE_AS_STRING, &array);
+	dbus_message_iter_append_fixed_array(&array, DBUS_TYPE_BYTE,
+					&response->buf, response->len);
+	dbus_message_iter_close_container(iter, &array);
+}
+
+static void euicc_batch_done(struct xmm7xxx_euicc *euicc)
+{
+	struct euicc_batch *batch = euicc->batch;
+	DBusMessage *reply;
+	DBusMessageIter iter, list;
+	unsigned int i;
+
+	reply = dbus_message_new_method_return(batch->msg);
+	if (reply == NULL)
+		goto done;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	if (!batch->list) {
+		euicc_batch_append_response(&iter, &batch->responses[0]);
+		goto done;
+	}
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_TYPE_BYTE_AS_STRING, &list);
+
+	for (i = 0; i < batch->n_responses; i++)
+		euicc_batch_append_response(&list, &batch->responses[i]);
+
+	dbus_message_iter_close_container(&iter, &list);
+
+done:
+	euicc_batch_reply(euicc, reply);
+}
+
+static void euicc_batch_cgla_cb(gboolean ok, GAtResult *result,
+						gpointer user_data);
+
+static void euicc_batch_send(struct xmm7xxx_euicc *euicc)
+{
+	struct euicc_apdu *sent = &euicc->batch->sent;
+	char *buff = g_new0(char, sent->len * 2 + 32);
+	int n;
+
+	n = sprintf(buff, "AT+CGLA=%u,%u,\"", euicc->channel, sent->len * 2);
+	encode_hex_own_buf(sent->buf, sent->len, 0, buff + n);
+	strcat(buff, "\"");
+
+	g_at_chat_send(euicc->chat, buff, cgla_prefix,
+			euicc_batch_cgla_cb, euicc, NULL);
+
+	g_free(buff);
+}
+
+/*
+ * Data length of an extended length STORE DATA command, coded as
+ * CLA INS P1 P2 00 Lc1 Lc2 data [Le], or 0 for any other command.
+ */
+static unsigned int euicc_store_data_lc(const struct euicc_apdu *cmd)
+{
+	unsigned int lc;
+
+	if (cmd->len <= 7 || cmd->buf[1] != EUICC_INS_STORE_DATA ||
+			cmd->buf[4] != 0x00)
+		return 0;
+
+	lc = (cmd->buf[5] << 8) | cmd->buf[6];
+
+	return MIN(lc, cmd->len - 7);
+}
+
+/*
+ * Sends the next command of the batch, or its next STORE DATA block when
+ * the command carries more data than fits a short APDU.
+ */
+static void euicc_batch_next(struct xmm7xxx_euicc *euicc)
+{
+	struct euicc_batch *batch = euicc->batch;
+	const struct euicc_apdu *cmd = &batch->commands[batch->n_responses];
+	const unsigned char *data;
+	unsigned char header[5];
+	unsigned int lc;
+	unsigned int chunk;
+
+	if (batch->n_responses == batch->n_commands) {
+		euicc_batch_done(euicc);
+		return;
+	}
+
+	batch->response.len = 0;
+
+	lc = euicc_store_data_lc(cmd);
+	if (lc == 0) {
+		euicc_apdu_set(&batch->sent, cmd->buf, cmd->len);
+		euicc_batch_send(euicc);
+		return;
+	}
+
+	data = cmd->buf + 7 + batch->offset;
+	chunk = MIN(lc - batch->offset, EUICC_MAX_SHORT_LC);
+
+	/* The last block has bit 8 of P1 set, see GlobalPlatform STORE DATA */
+	memcpy(header, cmd->buf, 4);
+
+	if (batch->offset + chunk < lc)
+		header[2] &= ~0x80;
+	else
+		header[2] |= 0x80;
+
+	header[3] = cmd->buf[3] + batch->block;
+	header[4] = chunk;
+
+	euicc_apdu_set(&batch->sent, header, sizeof(header));
+	euicc_apdu_append(&batch->sent, data, chunk);
+
+	batch->offset += chunk;
+	batch->block += 1;
+
+	euicc_batch_send(euicc);
+}
+
+static ofono_bool_t euicc_batch_segmented(struct euicc_batch *batch)
+{
+	const struct euicc_apdu *cmd = &batch->commands[batch->n_responses];
+
+	return batch->offset && batch->offset < euicc_store_data_lc(cmd);
+}
+
+static void euicc_batch_cgla_cb(gboolean ok, GAtResult *result,
+						gpointer user_data)
+{
+	struct xmm7xxx_euicc *euicc = user_data;
+	struct euicc_batch *batch = euicc->batch;
+	struct euicc_apdu *sent = &batch->sent;
+	GAtResultIter iter;
+	int length;
+	const char *resp;
+	unsigned char *rsp;
+	long len;
+	unsigned char sw[2];
+
+	DBG("ok %d", ok);
+
+	if (!ok)
+		goto error;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+CGLA:"))
+		goto error;
+
+	if (!g_at_result_iter_next_number(&iter, &length))
+		goto error;
+
+	if (!g_at_result_iter_next_string(&iter, &resp))
+		goto error;
+
+	rsp = g_new(unsigned char, strlen(resp) / 2 + 1);
+
+	if (!decode_hex_own_buf(resp, -1, &len, 0, rsp) || len < 2) {
+		g_free(rsp);
+		goto error;
+	}
+
+	memcpy(sw, rsp + len - 2, 2);
+	euicc_apdu_append(&batch->response, rsp, len - 2);
+	g_free(rsp);
+
+	DBG("SW %02x%02x", sw[0], sw[1]);
+
+	if (sw[0] == 0x61) {
+		/* Keep the logical channel coded in the class byte */
+		unsigned char cla = sent->buf[0];
+		unsigned char get_response[5] = {
+			(cla & 0x40) ? (cla & 0x4f) : (cla & 0x03),
+			EUICC_INS_GET_RESPONSE, 0x00, 0x00, sw[1]
+		};
+
+		euicc_apdu_set(sent, get_response, sizeof(get_response));
+		euicc_batch_send(euicc);
+		return;
+	}
+
+	/* Wrong Le, send the same case 2 command again with the right one */
+	if (sw[0] == 0x6c && sent->len == 5) {
+		sent->buf[4] = sw[1];
+		euicc_batch_send(euicc);
+		return;
+	}
+
+	if (sw[0] == 0x90 && sw[1] == 0x00 && euicc_batch_segmented(batch)) {
+		euicc_batch_next(euicc);
+		return;
+	}
+
+	euicc_apdu_append(&batch->response, sw, sizeof(sw));
+
+	batch->responses[batch->n_responses] = batch->response;
+	batch->n_responses += 1;
+	memset(&batch->response, 0, sizeof(batch->response));
+	batch->offset = 0;
+	batch->block = 0;
+
+	/* Commands after a failed one are not run, 91xx means success */
+	if (sw[0] != 0x90 && sw[0] != 0x91) {
+		euicc_batch_done(euicc);
+		return;
+	}
+
+	euicc_batch_next(euicc);
+	return;
+
+error:
+	euicc_batch_reply(euicc, __ofono_error_failed(batch->msg));
+}
+
+static void euicc_batch_select_cb(gboolean ok, GAtResult *result,
+						gpointer user_data)
+{
+	struct xmm7xxx_euicc *euicc = user_data;
+	GAtResultIter iter;
+
+	DBG("ok %d", ok);
+
+	if (!ok)
+		goto error;
+
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+CCHO:"))
+		goto error;
+
+	if (!g_at_result_iter_next_number(&iter, &euicc->channel))
+		goto error;
+
+	euicc_batch_next(euicc);
+	return;
+
+error:
+	euicc->channel = -1;
+	euicc_batch_reply(euicc,
+			__ofono_error_failed(euicc->batch->msg));
+}
+
+static ofono_bool_t euicc_batch_add(struct euicc_batch *batch,
+					DBusMessageIter *iter)
+{
+	const unsigned char *command;
+	int length;
+	DBusMessageIter array;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return FALSE;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	if (dbus_message_iter_get_arg_type(&array) != DBUS_TYPE_BYTE)
+		return FALSE;
+
+	dbus_message_iter_get_fixed_array(&array, &command, &length);
+
+	/* At least CLA, INS, P1 and P2 */
+	if (length < 4)
+		return FALSE;
+
+	batch->commands = g_renew(struct euicc_apdu, batch->commands,
+					batch->n_commands + 1);
+	batch->commands[batch->n_commands].buf = g_memdup2(command, length);
+	batch->commands[batch->n_commands].len = length;
+	batch->n_commands += 1;
+
+	return TRUE;
+}
+
+static void euicc_batch_start(struct xmm7xxx_euicc *euicc,
+					struct euicc_batch *batch,
+					DBusMessage *msg)
+{
+	char buff[50];
+
+	batch->msg = msg;
+	batch->responses = g_new0(struct euicc_apdu, batch->n_commands);
+
+	euicc->batch = batch;
+	euicc->pending = dbus_message_ref(msg);
+
+	if (euicc->channel >= 0) {
+		euicc_batch_next(euicc);
+		return;
+	}
+
+	/* The ISD-R channel then stays open until ReleaseISDR */
+	snprintf(buff, sizeof(buff), "AT+CCHO=\"%s\"", EUICC_ISDR_AID);
+
+	g_at_chat_send(euicc->chat, buff, ccho_prefix,
+			euicc_batch_select_cb, euicc, NULL);
+}
+
 static DBusMessage *euicc_transmit_pdu(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
 	struct xmm7xxx_euicc *euicc = data;
-	DBusMessageIter iter, array;
-	const unsigned char *command;
-	int length;
+	struct euicc_batch *batch;
+	DBusMessageIter iter;
 
 	DBG("euicc_transmit_pdu");
 
@@ -383,23 +766,56 @@ static DBusMessage *euicc_transmit_pdu(DBusConnection *conn,
 	if (!dbus_message_iter_init(msg, &iter))
 		return __ofono_error_invalid_args(msg);
 
-	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+	batch = g_new0(struct euicc_batch, 1);
+
+	if (!euicc_batch_add(batch, &iter)) {
+		euicc_batch_free(batch);
 		return __ofono_error_invalid_args(msg);
+	}
 
-	dbus_message_iter_recurse(&iter, &array);
+	euicc_batch_start(euicc, batch, msg);
 
-	if (dbus_message_iter_get_arg_type(&array) != DBUS_TYPE_BYTE)
+	return NULL;
+}
+
+static DBusMessage *euicc_transmit_pdu_list(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct xmm7xxx_euicc *euicc = data;
+	struct euicc_batch *batch;
+	DBusMessageIter iter, list;
+
+	DBG("");
+
+	if (euicc->pending)
+		return __ofono_error_busy(msg);
+
+	if (!dbus_message_iter_init(msg, &iter))
 		return __ofono_error_invalid_args(msg);
 
-	dbus_message_iter_get_fixed_array(&array, &command, &length);
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		return __ofono_error_invalid_args(msg);
 
-	g_free(euicc->command);
-	euicc->length = length * 2;
-	euicc->command = g_new0(char, euicc->length + 1);
-	encode_hex_own_buf(command,(long)length, 0, euicc->command);
-	euicc->pending = dbus_message_ref(msg);
+	dbus_message_iter_recurse(&iter, &list);
+
+	batch = g_new0(struct euicc_batch, 1);
+	batch->list = TRUE;
+
+	while (dbus_message_iter_get_arg_type(&list) != DBUS_TYPE_INVALID) {
+		if (!euicc_batch_add(batch, &list)) {
+			euicc_batch_free(batch);
+			return __ofono_error_invalid_args(msg);
+		}
+
+		dbus_message_iter_next(&list);
+	}
+
+	if (batch->n_commands == 0) {
+		euicc_batch_free(batch);
+		return __ofono_error_invalid_args(msg);
+	}
 
-	euicc_send_cmd(euicc);
+	euicc_batch_start(euicc, batch, msg);
 
 	return NULL;
 }
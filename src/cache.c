@@ -0,0 +1,231 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <ell/ell.h>
+
+#include "ofono.h"
+
+/*
+ * Daemon wide caches of results derived from data that many modems share,
+ * such as the SIM files of one operator.  Entries are keyed by the very
+ * data they were derived from, so a result is only ever shared between
+ * modems that would have computed an identical one.  Values are reference
+ * counted, a value looked up stays valid after it is evicted.
+ */
+struct ofono_cache {
+	char *name;
+	unsigned int max_entries;
+	ofono_cache_ref_func_t ref;
+	ofono_destroy_func unref;
+	struct l_queue *entries;	/* Most recently used first */
+	uint64_t hits;
+	uint64_t misses;
+};
+
+struct cache_entry {
+	uint32_t hash;
+	size_t len;
+	uint64_t last_used;
+	void *value;
+	uint8_t key[];
+};
+
+struct cache_key {
+	uint32_t hash;
+	const void *data;
+	size_t len;
+};
+
+static struct l_queue *caches;
+static unsigned int trim_id;
+
+/* FNV-1a, only used to skip most of the key comparisons */
+static uint32_t cache_hash(const uint8_t *data, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void cache_entry_free(void *data, void *user_data)
+{
+	struct cache_entry *entry = data;
+	struct ofono_cache *cache = user_data;
+
+	cache->unref(entry->value);
+	l_free(entry);
+}
+
+static bool cache_entry_match(const void *a, const void *b)
+{
+	const struct cache_entry *entry = a;
+	const struct cache_key *key = b;
+
+	return entry->hash == key->hash && entry->len == key->len &&
+				!memcmp(entry->key, key->data, key->len);
+}
+
+static bool cache_name_match(const void *a, const void *b)
+{
+	const struct ofono_cache *cache = a;
+
+	return !strcmp(cache->name, b);
+}
+
+/*
+ * Returns the cache with the given name, creating it on first use.  The
+ * caches live until ofonod exits, the parameters of later calls are
+ * ignored.
+ */
+struct ofono_cache *__ofono_cache_get(const char *name,
+					unsigned int max_entries,
+					ofono_cache_ref_func_t ref,
+					ofono_destroy_func unref)
+{
+	struct ofono_cache *cache;
+
+	cache = l_queue_find(caches, cache_name_match, name);
+	if (cache)
+		return cache;
+
+	cache = l_new(struct ofono_cache, 1);
+	cache->name = l_strdup(name);
+	cache->max_entries = max_entries;
+	cache->ref = ref;
+	cache->unref = unref;
+	cache->entries = l_queue_new();
+
+	if (caches == NULL)
+		caches = l_queue_new();
+
+	l_queue_push_tail(caches, cache);
+
+	return cache;
+}
+
+/* Returns a new reference to the value derived from key, or NULL */
+void *__ofono_cache_lookup(struct ofono_cache *cache,
+					const void *key, size_t len)
+{
+	struct cache_key k = {
+		.hash = cache_hash(key, len),
+		.data = key,
+		.len = len,
+	};
+	struct cache_entry *entry;
+
+	entry = l_queue_remove_if(cache->entries, cache_entry_match, &k);
+	if (entry == NULL) {
+		cache->misses += 1;
+		return NULL;
+	}
+
+	cache->hits += 1;
+	entry->last_used = l_time_now();
+	l_queue_push_head(cache->entries, entry);
+
+	return cache->ref(entry->value);
+}
+
+/* The cache takes its own reference to value */
+void __ofono_cache_insert(struct ofono_cache *cache,
+				const void *key, size_t len, void *value)
+{
+	struct cache_key k = {
+		.hash = cache_hash(key, len),
+		.data = key,
+		.len = len,
+	};
+	struct cache_entry *entry;
+
+	entry = l_queue_remove_if(cache->entries, cache_entry_match, &k);
+	if (entry)
+		cache_entry_free(entry, cache);
+
+	while (l_queue_length(cache->entries) >= cache->max_entries) {
+		entry = l_queue_peek_tail(cache->entries);
+		l_queue_remove(cache->entries, entry);
+		cache_entry_free(entry, cache);
+	}
+
+	entry = l_malloc(sizeof(struct cache_entry) + len);
+	entry->hash = k.hash;
+	entry->len = len;
+	entry->last_used = l_time_now();
+	entry->value = cache->ref(value);
+	memcpy(entry->key, key, len);
+
+	l_queue_push_head(cache->entries, entry);
+}
+
+void __ofono_cache_foreach(ofono_cache_foreach_func_t func, void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(caches); entry; entry = entry->next) {
+		const struct ofono_cache *cache = entry->data;
+
+		func(cache->name, l_queue_length(cache->entries),
+				cache->hits, cache->misses, user_data);
+	}
+}
+
+static void cache_trim(uint64_t before, void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(caches); entry; entry = entry->next) {
+		struct ofono_cache *cache = entry->data;
+		struct cache_entry *last;
+
+		/* Entries are in the order they were used */
+		while ((last = l_queue_peek_tail(cache->entries)) &&
+					last->last_used < before) {
+			l_queue_remove(cache->entries, last);
+			cache_entry_free(last, cache);
+		}
+	}
+}
+
+static void cache_free(void *data)
+{
+	struct ofono_cache *cache = data;
+
+	l_queue_foreach(cache->entries, cache_entry_free, cache);
+	l_queue_destroy(cache->entries, NULL);
+	l_free(cache->name);
+	l_free(cache);
+}
+
+static int cache_init(void)
+{
+	trim_id = __ofono_memtrim_add(cache_trim, NULL);
+
+	return 0;
+}
+
+static void cache_exit(void)
+{
+	__ofono_memtrim_remove(trim_id);
+	trim_id = 0;
+
+	l_queue_destroy(caches, cache_free);
+	caches = NULL;
+}
+
+OFONO_MODULE(cache, cache_init, cache_exit)
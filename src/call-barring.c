@@ -21,14 +21,22 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "storage.h"
 
 #define CALL_BARRING_FLAG_CACHED 0x1
 #define NUM_OF_BARRINGS 5
 
+#define SETTINGS_STORE "callbarring"
+#define SETTINGS_GROUP "Locks"
+
 static void cb_ss_query_next_lock(struct ofono_call_barring *cb);
-static void get_query_next_lock(struct ofono_call_barring *cb);
 static void set_query_next_lock(struct ofono_call_barring *cb);
 
+struct cb_query {
+	struct ofono_call_barring *cb;
+	int lock;
+};
+
 struct ofono_call_barring {
 	int flags;
 	DBusMessage *pending;
@@ -37,9 +45,14 @@ struct ofono_call_barring {
 	int query_start;
 	int query_end;
 	int query_next;
+	struct cb_query queries[NUM_OF_BARRINGS];
+	unsigned int query_mask;
+	bool query_failed;
 	int ss_req_type;
 	int ss_req_cls;
 	int ss_req_lock;
+	char *imsi;
+	GKeyFile *settings;
 	struct ofono_ussd *ussd;
 	unsigned int ussd_watch;
 	const struct ofono_call_barring_driver *driver;
@@ -75,6 +88,51 @@ static struct call_barring_lock cb_locks[] = {
 #define CB_ALL_OUTGOING 6
 #define CB_ALL_INCOMING 7
 
+/*
+ * The class masks of the locks are kept per IMSI once all of them have
+ * been queried, and dropped again when a query fails.
+ */
+static void cb_cache_save(struct ofono_call_barring *cb)
+{
+	if (cb->settings == NULL)
+		return;
+
+	if (!(cb->flags & CALL_BARRING_FLAG_CACHED)) {
+		if (g_key_file_remove_group(cb->settings, SETTINGS_GROUP, NULL))
+			storage_sync(cb->imsi, SETTINGS_STORE, cb->settings);
+
+		return;
+	}
+
+	g_key_file_set_integer_list(cb->settings, SETTINGS_GROUP, "Classes",
+					cb->cur_locks, NUM_OF_BARRINGS);
+	storage_stamp(cb->settings, SETTINGS_GROUP);
+	storage_sync(cb->imsi, SETTINGS_STORE, cb->settings);
+}
+
+static void cb_cache_load(struct ofono_call_barring *cb)
+{
+	int *locks;
+	gsize len;
+
+	if (!storage_stamp_valid(cb->settings, SETTINGS_GROUP,
+					SS_CACHE_MAX_AGE))
+		return;
+
+	locks = g_key_file_get_integer_list(cb->settings, SETTINGS_GROUP,
+						"Classes", &len, NULL);
+	if (locks == NULL)
+		return;
+
+	if (len == NUM_OF_BARRINGS) {
+		memcpy(cb->cur_locks, locks, sizeof(cb->cur_locks));
+		memcpy(cb->new_locks, locks, sizeof(cb->new_locks));
+		cb->flags |= CALL_BARRING_FLAG_CACHED;
+	}
+
+	g_free(locks);
+}
+
 static inline void emit_barring_changed(struct ofono_call_barring *cb,
 					int start, int end,
 					const char *type, int cls)
@@ -129,6 +187,8 @@ static void update_barrings(struct ofono_call_barring *cb, int mask)
 
 	for (i = cb->query_start; i <= cb->query_end; i++)
 		cb->cur_locks[i] = cb->new_locks[i];
+
+	cb_cache_save(cb);
 }
 
 static void cb_ss_property_append(struct ofono_call_barring *cb,
@@ -272,6 +332,7 @@ static void cb_ss_query_next_lock_callback(const struct ofono_error *error,
 						telephony_error_to_str(error));
 
 		cb->flags &= ~CALL_BARRING_FLAG_CACHED;
+		cb_cache_save(cb);
 
 		__ofono_dbus_pending_reply(&cb->pending,
 				__ofono_error_from_error(error, cb->pending));
@@ -627,35 +688,44 @@ static void cb_get_properties_reply(struct ofono_call_barring *cb, int mask)
 static void get_query_lock_callback(const struct ofono_error *error,
 					int status, void *data)
 {
-	struct ofono_call_barring *cb = data;
+	struct cb_query *query = data;
+	struct ofono_call_barring *cb = query->cb;
+	struct ofono_modem *modem = __ofono_atom_get_modem(cb->atom);
 
-	if (error->type == OFONO_ERROR_TYPE_NO_ERROR) {
-		cb->new_locks[cb->query_next] = status;
+	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
+		cb->new_locks[query->lock] = status;
+	else
+		cb->query_failed = true;
 
-		if (cb->query_next == CB_ALL_END)
+	cb->query_mask &= ~(1 << query->lock);
+
+	/* The reply is sent once all locks are in, as one snapshot */
+	if (cb->query_mask == 0) {
+		if (!cb->query_failed)
 			cb->flags |= CALL_BARRING_FLAG_CACHED;
-	}
 
-	if (cb->query_next < CB_ALL_END) {
-		cb->query_next = cb->query_next + 1;
-		get_query_next_lock(cb);
-		return;
+		cb_get_properties_reply(cb, BEARER_CLASS_VOICE);
+		update_barrings(cb, BEARER_CLASS_VOICE);
 	}
 
-	cb_get_properties_reply(cb, BEARER_CLASS_VOICE);
-	update_barrings(cb, BEARER_CLASS_VOICE);
+	__ofono_ss_query_done(modem, cb, query->lock);
 }
 
-static void get_query_next_lock(struct ofono_call_barring *cb)
+static void get_query_lock_start(void *user_data)
 {
-	cb->driver->query(cb, cb_locks[cb->query_next].fac,
-			BEARER_CLASS_DEFAULT, get_query_lock_callback, cb);
+	struct cb_query *query = user_data;
+	struct ofono_call_barring *cb = query->cb;
+
+	cb->driver->query(cb, cb_locks[query->lock].fac,
+			BEARER_CLASS_DEFAULT, get_query_lock_callback, query);
 }
 
 static DBusMessage *cb_get_properties(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
 	struct ofono_call_barring *cb = data;
+	struct ofono_modem *modem = __ofono_atom_get_modem(cb->atom);
+	int i;
 
 	if (__ofono_call_barring_is_busy(cb) || __ofono_ussd_is_busy(cb->ussd))
 		return __ofono_error_busy(msg);
@@ -665,11 +735,20 @@ static DBusMessage *cb_get_properties(DBusConnection *conn, DBusMessage *msg,
 
 	cb->pending = dbus_message_ref(msg);
 
-	if (cb->flags & CALL_BARRING_FLAG_CACHED)
+	if (cb->flags & CALL_BARRING_FLAG_CACHED) {
 		cb_get_properties_reply(cb, BEARER_CLASS_VOICE);
-	else {
-		cb->query_next = CB_ALL_START;
-		get_query_next_lock(cb);
+		return NULL;
+	}
+
+	cb->query_failed = false;
+	cb->query_mask = (1 << (CB_ALL_END + 1)) - (1 << CB_ALL_START);
+
+	for (i = CB_ALL_START; i <= CB_ALL_END; i++) {
+		cb->queries[i].cb = cb;
+		cb->queries[i].lock = i;
+
+		__ofono_ss_query_submit(modem, cb, i, get_query_lock_start,
+							&cb->queries[i]);
 	}
 
 	return NULL;
@@ -685,6 +764,7 @@ static void set_query_lock_callback(const struct ofono_error *error,
 				"but query was not");
 
 		cb->flags &= ~CALL_BARRING_FLAG_CACHED;
+		cb_cache_save(cb);
 
 		__ofono_dbus_pending_reply(&cb->pending,
 					__ofono_error_failed(cb->pending));
@@ -995,6 +1075,16 @@ static void call_barring_unregister(struct ofono_atom *atom)
 
 	if (cb->ussd_watch)
 		__ofono_modem_remove_atom_watch(modem, cb->ussd_watch);
+
+	__ofono_ss_query_cancel(modem, cb);
+
+	if (cb->settings) {
+		storage_close(cb->imsi, SETTINGS_STORE, cb->settings, TRUE);
+
+		l_free(cb->imsi);
+		cb->imsi = NULL;
+		cb->settings = NULL;
+	}
 }
 
 static void call_barring_remove(struct ofono_atom *atom)
@@ -1033,6 +1123,8 @@ void ofono_call_barring_register(struct ofono_call_barring *cb)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(cb->atom);
 	struct ofono_modem *modem = __ofono_atom_get_modem(cb->atom);
+	struct ofono_sim *sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
+	const char *imsi = sim ? ofono_sim_get_imsi(sim) : NULL;
 
 	if (!g_dbus_register_interface(conn, path,
 					OFONO_CALL_BARRING_INTERFACE,
@@ -1046,6 +1138,14 @@ void ofono_call_barring_register(struct ofono_call_barring *cb)
 
 	ofono_modem_add_interface(modem, OFONO_CALL_BARRING_INTERFACE);
 
+	if (imsi)
+		cb->settings = storage_open(imsi, SETTINGS_STORE);
+
+	if (cb->settings) {
+		cb->imsi = l_strdup(imsi);
+		cb_cache_load(cb);
+	}
+
 	cb->ussd_watch = __ofono_modem_add_atom_watch(modem,
 					OFONO_ATOM_TYPE_USSD,
 					ussd_watch, cb, NULL);
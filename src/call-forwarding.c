@@ -21,10 +21,14 @@
 
 #include "common.h"
 #include "simutil.h"
+#include "storage.h"
 
 #define CALL_FORWARDING_FLAG_CACHED	0x1
 #define CALL_FORWARDING_FLAG_CPHS_CFF	0x2
 
+#define SETTINGS_STORE "callforwarding"
+#define SETTINGS_GROUP "Conditions"
+
 /* According to 27.007 Spec */
 #define DEFAULT_NO_REPLY_TIMEOUT 20
 
@@ -42,16 +46,26 @@ enum call_forwarding_type {
 	CALL_FORWARDING_TYPE_ALL_CONDITIONAL =	5
 };
 
+struct cf_query {
+	struct ofono_call_forwarding *cf;
+	int type;
+};
+
 struct ofono_call_forwarding {
 	GSList *cf_conditions[4];
 	int flags;
 	DBusMessage *pending;
 	int query_next;
 	int query_end;
+	struct cf_query queries[4];
+	unsigned int query_mask;
+	bool query_failed;
 	struct cf_ss_request *ss_req;
 	struct ofono_sim *sim;
 	struct ofono_sim_context *sim_context;
 	unsigned char cfis_record_id;
+	char *imsi;
+	GKeyFile *settings;
 	struct ofono_ussd *ussd;
 	unsigned int ussd_watch;
 	const struct ofono_call_forwarding_driver *driver;
@@ -66,7 +80,6 @@ struct cf_ss_request {
 	GSList *cf_list[4];
 };
 
-static void get_query_next_cf_cond(struct ofono_call_forwarding *cf);
 static void set_query_next_cf_cond(struct ofono_call_forwarding *cf);
 static void ss_set_query_next_cf_cond(struct ofono_call_forwarding *cf);
 
@@ -169,6 +182,103 @@ static const char *cf_type_lut[] = {
 	"AllConditional"
 };
 
+/*
+ * The conditions are kept per IMSI once all of them have been queried,
+ * each as "class,type,timeout,number".  They are rewritten on any change
+ * and dropped when a query fails or the SIM reports a change, so that
+ * GetProperties after a restart does not have to query the network.
+ */
+static void cf_cache_save(struct ofono_call_forwarding *cf)
+{
+	int type;
+
+	if (cf->settings == NULL)
+		return;
+
+	if (!(cf->flags & CALL_FORWARDING_FLAG_CACHED)) {
+		if (g_key_file_remove_group(cf->settings, SETTINGS_GROUP, NULL))
+			storage_sync(cf->imsi, SETTINGS_STORE, cf->settings);
+
+		return;
+	}
+
+	for (type = 0; type < 4; type++) {
+		GSList *l = cf->cf_conditions[type];
+		char **conds = g_new0(char *, g_slist_length(l) + 1);
+		int n = 0;
+
+		for (; l; l = l->next) {
+			struct ofono_call_forwarding_condition *cond = l->data;
+
+			conds[n++] = g_strdup_printf("%d,%d,%d,%s", cond->cls,
+						cond->phone_number.type,
+						cond->time,
+						cond->phone_number.number);
+		}
+
+		g_key_file_set_string_list(cf->settings, SETTINGS_GROUP,
+						cf_type_lut[type],
+						(const char **) conds, n);
+		g_strfreev(conds);
+	}
+
+	storage_stamp(cf->settings, SETTINGS_GROUP);
+	storage_sync(cf->imsi, SETTINGS_STORE, cf->settings);
+}
+
+static GSList *cf_cache_load_type(struct ofono_call_forwarding *cf, int type)
+{
+	GSList *l = NULL;
+	char **conds;
+	int i;
+
+	conds = g_key_file_get_string_list(cf->settings, SETTINGS_GROUP,
+						cf_type_lut[type], NULL, NULL);
+	if (conds == NULL)
+		return NULL;
+
+	for (i = 0; conds[i]; i++) {
+		struct ofono_call_forwarding_condition *cond;
+		int cls, number_type, time, offset;
+
+		if (sscanf(conds[i], "%d,%d,%d,%n", &cls, &number_type,
+						&time, &offset) != 3)
+			continue;
+
+		if (strlen(conds[i] + offset) > OFONO_MAX_PHONE_NUMBER_LENGTH)
+			continue;
+
+		cond = g_new0(struct ofono_call_forwarding_condition, 1);
+		cond->status = 1;
+		cond->cls = cls;
+		cond->time = time;
+		cond->phone_number.type = number_type;
+		strcpy(cond->phone_number.number, conds[i] + offset);
+
+		l = g_slist_insert_sorted(l, cond, cf_cond_compare);
+	}
+
+	g_strfreev(conds);
+
+	return l;
+}
+
+static void cf_cache_load(struct ofono_call_forwarding *cf)
+{
+	int type;
+
+	if (!storage_stamp_valid(cf->settings, SETTINGS_GROUP,
+					SS_CACHE_MAX_AGE))
+		return;
+
+	cf_clear_all(cf);
+
+	for (type = 0; type < 4; type++)
+		cf->cf_conditions[type] = cf_cache_load_type(cf, type);
+
+	cf->flags |= CALL_FORWARDING_FLAG_CACHED;
+}
+
 static void sim_cfis_update_cb(int ok, void *data)
 {
 	if (!ok)
@@ -367,6 +477,8 @@ static void set_new_cond_list(struct ofono_call_forwarding *cf,
 	if (update_sim == TRUE)
 		sim_set_cf_indicator(cf);
 
+	cf_cache_save(cf);
+
 	if ((cf->flags & CALL_FORWARDING_FLAG_CPHS_CFF) ||
 			cf->cfis_record_id > 0)
 		new_cfu = is_cfu_enabled(cf);
@@ -514,35 +626,44 @@ static void get_query_cf_callback(const struct ofono_error *error, int total,
 			const struct ofono_call_forwarding_condition *list,
 			void *data)
 {
-	struct ofono_call_forwarding *cf = data;
+	struct cf_query *query = data;
+	struct ofono_call_forwarding *cf = query->cf;
+	struct ofono_modem *modem = __ofono_atom_get_modem(cf->atom);
 
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR) {
 		GSList *l = cf_cond_list_create(total, list);
 
-		set_new_cond_list(cf, cf->query_next, l);
+		set_new_cond_list(cf, query->type, l);
 
-		DBG("%s conditions:", cf_type_lut[cf->query_next]);
+		DBG("%s conditions:", cf_type_lut[query->type]);
 
 		cf_cond_list_print(l);
+	} else
+		cf->query_failed = true;
+
+	cf->query_mask &= ~(1 << query->type);
 
-		if (cf->query_next == CALL_FORWARDING_TYPE_NOT_REACHABLE)
+	/* The reply is sent once all reasons are in, as one snapshot */
+	if (cf->query_mask == 0) {
+		if (!cf->query_failed) {
 			cf->flags |= CALL_FORWARDING_FLAG_CACHED;
-	}
+			cf_cache_save(cf);
+		}
 
-	if (cf->query_next == CALL_FORWARDING_TYPE_NOT_REACHABLE) {
 		__ofono_dbus_pending_reply(&cf->pending,
 				cf_get_properties_reply(cf->pending, cf));
-		return;
 	}
 
-	cf->query_next++;
-	get_query_next_cf_cond(cf);
+	__ofono_ss_query_done(modem, cf, query->type);
 }
 
-static inline void get_query_next_cf_cond(struct ofono_call_forwarding *cf)
+static void get_query_cf_start(void *user_data)
 {
-	cf->driver->query(cf, cf->query_next, BEARER_CLASS_DEFAULT,
-				get_query_cf_callback, cf);
+	struct cf_query *query = user_data;
+	struct ofono_call_forwarding *cf = query->cf;
+
+	cf->driver->query(cf, query->type, BEARER_CLASS_DEFAULT,
+				get_query_cf_callback, query);
 }
 
 static DBusMessage *cf_get_properties(DBusConnection *conn, DBusMessage *msg,
@@ -550,6 +671,7 @@ static DBusMessage *cf_get_properties(DBusConnection *conn, DBusMessage *msg,
 {
 	struct ofono_call_forwarding *cf = data;
 	struct ofono_modem *modem = __ofono_atom_get_modem(cf->atom);
+	int i;
 
 	if ((cf->flags & CALL_FORWARDING_FLAG_CACHED) ||
 			ofono_modem_get_online(modem) == FALSE)
@@ -563,9 +685,16 @@ static DBusMessage *cf_get_properties(DBusConnection *conn, DBusMessage *msg,
 		return __ofono_error_busy(msg);
 
 	cf->pending = dbus_message_ref(msg);
-	cf->query_next = 0;
+	cf->query_failed = false;
+	cf->query_mask = (1 << (CALL_FORWARDING_TYPE_NOT_REACHABLE + 1)) - 1;
 
-	get_query_next_cf_cond(cf);
+	for (i = 0; i <= CALL_FORWARDING_TYPE_NOT_REACHABLE; i++) {
+		cf->queries[i].cf = cf;
+		cf->queries[i].type = i;
+
+		__ofono_ss_query_submit(modem, cf, i, get_query_cf_start,
+							&cf->queries[i]);
+	}
 
 	return NULL;
 }
@@ -634,6 +763,7 @@ static void set_query_cf_callback(const struct ofono_error *error, int total,
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		ofono_error("Setting succeeded, but query failed");
 		cf->flags &= ~CALL_FORWARDING_FLAG_CACHED;
+		cf_cache_save(cf);
 		__ofono_dbus_pending_reply(&cf->pending,
 					__ofono_error_failed(cf->pending));
 		return;
@@ -968,6 +1098,7 @@ static void ss_set_query_cf_callback(const struct ofono_error *error, int total,
 		ofono_error("Query failed with error: %s",
 						telephony_error_to_str(error));
 		cf->flags &= ~CALL_FORWARDING_FLAG_CACHED;
+		cf_cache_save(cf);
 		reply = __ofono_error_from_error(error, cf->pending);
 		__ofono_dbus_pending_reply(&cf->pending, reply);
 		return;
@@ -1376,6 +1507,16 @@ static void call_forwarding_unregister(struct ofono_atom *atom)
 	if (cf->ussd_watch)
 		__ofono_modem_remove_atom_watch(modem, cf->ussd_watch);
 
+	__ofono_ss_query_cancel(modem, cf);
+
+	if (cf->settings) {
+		storage_close(cf->imsi, SETTINGS_STORE, cf->settings, TRUE);
+
+		l_free(cf->imsi);
+		cf->imsi = NULL;
+		cf->settings = NULL;
+	}
+
 	cf->flags = 0;
 }
 
@@ -1394,8 +1535,11 @@ static void sim_cfis_changed(int id, void *userdata)
 	 * query can take a noticeable amount of time.  Instead of
 	 * sending PropertyChanged, we reregister the Call Forwarding
 	 * atom.  The client will invoke GetProperties only if it
-	 * is still interested.
+	 * is still interested.  The stored conditions are stale too.
 	 */
+	cf->flags &= ~CALL_FORWARDING_FLAG_CACHED;
+	cf_cache_save(cf);
+
 	call_forwarding_unregister(cf->atom);
 	ofono_call_forwarding_register(cf);
 }
@@ -1473,6 +1617,16 @@ void ofono_call_forwarding_register(struct ofono_call_forwarding *cf)
 
 	cf->sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
 	if (cf->sim) {
+		const char *imsi = ofono_sim_get_imsi(cf->sim);
+
+		if (imsi)
+			cf->settings = storage_open(imsi, SETTINGS_STORE);
+
+		if (cf->settings) {
+			cf->imsi = l_strdup(imsi);
+			cf_cache_load(cf);
+		}
+
 		cf->sim_context = ofono_sim_context_create(cf->sim);
 		sim_read_cf_indicator(cf);
 	}
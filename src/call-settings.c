@@ -12,6 +12,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
 
 #include <glib.h>
@@ -20,9 +21,13 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "storage.h"
 
 #define CALL_SETTINGS_FLAG_CACHED 0x1
 
+#define SETTINGS_STORE "callsettings"
+#define SETTINGS_GROUP "Settings"
+
 /* 27.007 Section 7.7 */
 enum clir_status {
 	CLIR_STATUS_NOT_PROVISIONED =		0,
@@ -91,6 +96,9 @@ struct ofono_call_settings {
 	int ss_req_type;
 	int ss_req_cls;
 	enum call_setting_type ss_setting;
+	unsigned int query_mask;
+	char *imsi;
+	GKeyFile *settings;
 	struct ofono_ussd *ussd;
 	unsigned int ussd_watch;
 	const struct ofono_call_settings_driver *driver;
@@ -188,6 +196,79 @@ static const char *clir_status_to_string(int status)
 	return "unknown";
 }
 
+/*
+ * The settings are kept per IMSI once all of them have been queried, and
+ * dropped again when a query fails.
+ */
+static const struct {
+	const char *key;
+	size_t offset;
+} cs_cache_keys[] = {
+	{ "CLIR", offsetof(struct ofono_call_settings, clir) },
+	{ "COLR", offsetof(struct ofono_call_settings, colr) },
+	{ "CLIP", offsetof(struct ofono_call_settings, clip) },
+	{ "CNAP", offsetof(struct ofono_call_settings, cnap) },
+	{ "CDIP", offsetof(struct ofono_call_settings, cdip) },
+	{ "COLP", offsetof(struct ofono_call_settings, colp) },
+	{ "HideCallerId", offsetof(struct ofono_call_settings, clir_setting) },
+	{ "CW", offsetof(struct ofono_call_settings, cw) },
+};
+
+static void cs_cache_save(struct ofono_call_settings *cs)
+{
+	unsigned int i;
+
+	if (cs->settings == NULL)
+		return;
+
+	if (!(cs->flags & CALL_SETTINGS_FLAG_CACHED)) {
+		if (g_key_file_remove_group(cs->settings, SETTINGS_GROUP, NULL))
+			storage_sync(cs->imsi, SETTINGS_STORE, cs->settings);
+
+		return;
+	}
+
+	for (i = 0; i < L_ARRAY_SIZE(cs_cache_keys); i++) {
+		int *value = (int *) ((char *) cs + cs_cache_keys[i].offset);
+
+		g_key_file_set_integer(cs->settings, SETTINGS_GROUP,
+					cs_cache_keys[i].key, *value);
+	}
+
+	storage_stamp(cs->settings, SETTINGS_GROUP);
+	storage_sync(cs->imsi, SETTINGS_STORE, cs->settings);
+}
+
+static void cs_cache_load(struct ofono_call_settings *cs)
+{
+	int values[L_ARRAY_SIZE(cs_cache_keys)];
+	unsigned int i;
+
+	if (!storage_stamp_valid(cs->settings, SETTINGS_GROUP,
+					SS_CACHE_MAX_AGE))
+		return;
+
+	for (i = 0; i < L_ARRAY_SIZE(cs_cache_keys); i++) {
+		GError *error = NULL;
+
+		values[i] = g_key_file_get_integer(cs->settings,
+						SETTINGS_GROUP,
+						cs_cache_keys[i].key, &error);
+		if (error) {
+			g_error_free(error);
+			return;
+		}
+	}
+
+	for (i = 0; i < L_ARRAY_SIZE(cs_cache_keys); i++) {
+		int *value = (int *) ((char *) cs + cs_cache_keys[i].offset);
+
+		*value = values[i];
+	}
+
+	cs->flags |= CALL_SETTINGS_FLAG_CACHED;
+}
+
 static void set_clir_network(struct ofono_call_settings *cs, int clir)
 {
 	DBusConnection *conn;
@@ -208,6 +289,8 @@ static void set_clir_network(struct ofono_call_settings *cs, int clir)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"CallingLineRestriction",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_clir_override(struct ofono_call_settings *cs, int override)
@@ -230,6 +313,8 @@ static void set_clir_override(struct ofono_call_settings *cs, int override)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"HideCallerId",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_cdip(struct ofono_call_settings *cs, int cdip)
@@ -252,6 +337,8 @@ static void set_cdip(struct ofono_call_settings *cs, int cdip)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"CalledLinePresentation",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_clip(struct ofono_call_settings *cs, int clip)
@@ -274,6 +361,8 @@ static void set_clip(struct ofono_call_settings *cs, int clip)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"CallingLinePresentation",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_cnap(struct ofono_call_settings *cs, int cnap)
@@ -296,6 +385,8 @@ static void set_cnap(struct ofono_call_settings *cs, int cnap)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"CallingNamePresentation",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_colp(struct ofono_call_settings *cs, int colp)
@@ -318,6 +409,8 @@ static void set_colp(struct ofono_call_settings *cs, int colp)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"ConnectedLinePresentation",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_colr(struct ofono_call_settings *cs, int colr)
@@ -340,6 +433,8 @@ static void set_colr(struct ofono_call_settings *cs, int colr)
 						OFONO_CALL_SETTINGS_INTERFACE,
 						"ConnectedLineRestriction",
 						DBUS_TYPE_STRING, &str);
+
+	cs_cache_save(cs);
 }
 
 static void set_cw(struct ofono_call_settings *cs, int new_cw, int mask)
@@ -371,6 +466,8 @@ static void set_cw(struct ofono_call_settings *cs, int new_cw, int mask)
 	}
 
 	cs->cw = new_cw;
+
+	cs_cache_save(cs);
 }
 
 static void property_append_cw_conditions(DBusMessageIter *dict,
@@ -445,6 +542,7 @@ static void cw_ss_query_callback(const struct ofono_error *error, int status,
 		DBG("setting CW via SS failed");
 
 		cs->flags &= ~CALL_SETTINGS_FLAG_CACHED;
+		cs_cache_save(cs);
 		__ofono_dbus_pending_reply(&cs->pending,
 					__ofono_error_failed(cs->pending));
 
@@ -931,41 +1029,44 @@ static DBusMessage *generate_get_properties_reply(struct ofono_call_settings *cs
 	return reply;
 }
 
-static void cs_clir_callback(const struct ofono_error *error,
-				int override_setting, int network_setting,
-				void *data)
+static void cs_query_done(struct ofono_call_settings *cs,
+					enum call_setting_type type)
 {
-	struct ofono_call_settings *cs = data;
-
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		goto out;
+	struct ofono_modem *modem = __ofono_atom_get_modem(cs->atom);
 
-	set_clir_network(cs, network_setting);
-	set_clir_override(cs, override_setting);
+	cs->query_mask &= ~(1 << type);
 
-	cs->flags |= CALL_SETTINGS_FLAG_CACHED;
-
-out:
-	if (cs->pending) {
+	/* The reply is sent once all settings are in, as one snapshot */
+	if (cs->query_mask == 0 && cs->pending) {
 		DBusMessage *reply = generate_get_properties_reply(cs,
 								cs->pending);
 		__ofono_dbus_pending_reply(&cs->pending, reply);
 	}
+
+	__ofono_ss_query_done(modem, cs, type);
 }
 
-static void query_clir(struct ofono_call_settings *cs)
+static void cs_clir_callback(const struct ofono_error *error,
+				int override_setting, int network_setting,
+				void *data)
 {
-	if (cs->driver->clir_query == NULL) {
-		if (cs->pending) {
-			DBusMessage *reply =
-				generate_get_properties_reply(cs,
-								cs->pending);
-			__ofono_dbus_pending_reply(&cs->pending, reply);
-		}
+	struct ofono_call_settings *cs = data;
 
-		return;
+	if (error->type == OFONO_ERROR_TYPE_NO_ERROR) {
+		set_clir_network(cs, network_setting);
+		set_clir_override(cs, override_setting);
+
+		cs->flags |= CALL_SETTINGS_FLAG_CACHED;
+		cs_cache_save(cs);
 	}
 
+	cs_query_done(cs, CALL_SETTING_TYPE_CLIR);
+}
+
+static void query_clir(void *user_data)
+{
+	struct ofono_call_settings *cs = user_data;
+
 	cs->driver->clir_query(cs, cs_clir_callback, cs);
 }
 
@@ -977,20 +1078,16 @@ static void cs_cdip_callback(const struct ofono_error *error,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_cdip(cs, state);
 
-	query_clir(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_CDIP);
 }
 
-static void query_cdip(struct ofono_call_settings *cs)
+static void query_cdip(void *user_data)
 {
-	if (cs->driver->cdip_query == NULL) {
-		query_clir(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->cdip_query(cs, cs_cdip_callback, cs);
 }
 
-
 static void cs_cnap_callback(const struct ofono_error *error,
 				int state, void *data)
 {
@@ -999,15 +1096,12 @@ static void cs_cnap_callback(const struct ofono_error *error,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_cnap(cs, state);
 
-	query_cdip(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_CNAP);
 }
 
-static void query_cnap(struct ofono_call_settings *cs)
+static void query_cnap(void *user_data)
 {
-	if (cs->driver->cnap_query == NULL) {
-		query_cdip(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->cnap_query(cs, cs_cnap_callback, cs);
 }
@@ -1020,15 +1114,12 @@ static void cs_clip_callback(const struct ofono_error *error,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_clip(cs, state);
 
-	query_cnap(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_CLIP);
 }
 
-static void query_clip(struct ofono_call_settings *cs)
+static void query_clip(void *user_data)
 {
-	if (cs->driver->clip_query == NULL) {
-		query_clir(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->clip_query(cs, cs_clip_callback, cs);
 }
@@ -1041,15 +1132,12 @@ static void cs_colp_callback(const struct ofono_error *error,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_colp(cs, state);
 
-	query_clip(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_COLP);
 }
 
-static void query_colp(struct ofono_call_settings *cs)
+static void query_colp(void *user_data)
 {
-	if (cs->driver->colp_query == NULL) {
-		query_clip(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->colp_query(cs, cs_colp_callback, cs);
 }
@@ -1062,15 +1150,12 @@ static void cs_colr_callback(const struct ofono_error *error,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_colr(cs, state);
 
-	query_colp(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_COLR);
 }
 
-static void query_colr(struct ofono_call_settings *cs)
+static void query_colr(void *user_data)
 {
-	if (cs->driver->colr_query == NULL) {
-		query_colp(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->colr_query(cs, cs_colr_callback, cs);
 }
@@ -1083,15 +1168,12 @@ static void cs_cw_callback(const struct ofono_error *error, int status,
 	if (error->type == OFONO_ERROR_TYPE_NO_ERROR)
 		set_cw(cs, status, BEARER_CLASS_VOICE);
 
-	query_colr(cs);
+	cs_query_done(cs, CALL_SETTING_TYPE_CW);
 }
 
-static void query_cw(struct ofono_call_settings *cs)
+static void query_cw(void *user_data)
 {
-	if (cs->driver->cw_query == NULL) {
-		query_colr(cs);
-		return;
-	}
+	struct ofono_call_settings *cs = user_data;
 
 	cs->driver->cw_query(cs, BEARER_CLASS_DEFAULT, cs_cw_callback, cs);
 }
@@ -1100,6 +1182,18 @@ static DBusMessage *cs_get_properties(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
 	struct ofono_call_settings *cs = data;
+	struct ofono_modem *modem = __ofono_atom_get_modem(cs->atom);
+	const struct ofono_call_settings_driver *driver = cs->driver;
+	static const ofono_ss_query_func_t query_start[] = {
+		[CALL_SETTING_TYPE_CLIP] = query_clip,
+		[CALL_SETTING_TYPE_CNAP] = query_cnap,
+		[CALL_SETTING_TYPE_CDIP] = query_cdip,
+		[CALL_SETTING_TYPE_COLP] = query_colp,
+		[CALL_SETTING_TYPE_COLR] = query_colr,
+		[CALL_SETTING_TYPE_CLIR] = query_clir,
+		[CALL_SETTING_TYPE_CW] = query_cw,
+	};
+	unsigned int i;
 
 	if (__ofono_call_settings_is_busy(cs) || __ofono_ussd_is_busy(cs->ussd))
 		return __ofono_error_busy(msg);
@@ -1107,10 +1201,33 @@ static DBusMessage *cs_get_properties(DBusConnection *conn, DBusMessage *msg,
 	if (cs->flags & CALL_SETTINGS_FLAG_CACHED)
 		return generate_get_properties_reply(cs, msg);
 
+	cs->query_mask = 0;
+
+	if (driver->clip_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_CLIP;
+	if (driver->cnap_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_CNAP;
+	if (driver->cdip_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_CDIP;
+	if (driver->colp_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_COLP;
+	if (driver->colr_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_COLR;
+	if (driver->clir_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_CLIR;
+	if (driver->cw_query)
+		cs->query_mask |= 1 << CALL_SETTING_TYPE_CW;
+
+	if (cs->query_mask == 0)
+		return generate_get_properties_reply(cs, msg);
+
 	/* Query the settings and report back */
 	cs->pending = dbus_message_ref(msg);
 
-	query_cw(cs);
+	for (i = 0; i < L_ARRAY_SIZE(query_start); i++)
+		if (cs->query_mask & (1 << i))
+			__ofono_ss_query_submit(modem, cs, i, query_start[i],
+									cs);
 
 	return NULL;
 }
@@ -1129,6 +1246,7 @@ static void clir_set_query_callback(const struct ofono_error *error,
 		ofono_error("set clir successful, but the query was not");
 
 		cs->flags &= ~CALL_SETTINGS_FLAG_CACHED;
+		cs_cache_save(cs);
 
 		reply = __ofono_error_failed(cs->pending);
 		__ofono_dbus_pending_reply(&cs->pending, reply);
@@ -1192,6 +1310,7 @@ static void cw_set_query_callback(const struct ofono_error *error, int status,
 		ofono_error("CW set succeeded, but query failed!");
 
 		cs->flags &= ~CALL_SETTINGS_FLAG_CACHED;
+		cs_cache_save(cs);
 
 		__ofono_dbus_pending_reply(&cs->pending,
 					__ofono_error_failed(cs->pending));
@@ -1349,6 +1468,16 @@ static void call_settings_unregister(struct ofono_atom *atom)
 
 	if (cs->ussd_watch)
 		__ofono_modem_remove_atom_watch(modem, cs->ussd_watch);
+
+	__ofono_ss_query_cancel(modem, cs);
+
+	if (cs->settings) {
+		storage_close(cs->imsi, SETTINGS_STORE, cs->settings, TRUE);
+
+		l_free(cs->imsi);
+		cs->imsi = NULL;
+		cs->settings = NULL;
+	}
 }
 
 static void call_settings_remove(struct ofono_atom *atom)
@@ -1394,6 +1523,8 @@ void ofono_call_settings_register(struct ofono_call_settings *cs)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(cs->atom);
 	struct ofono_modem *modem = __ofono_atom_get_modem(cs->atom);
+	struct ofono_sim *sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
+	const char *imsi = sim ? ofono_sim_get_imsi(sim) : NULL;
 
 	if (!g_dbus_register_interface(conn, path,
 					OFONO_CALL_SETTINGS_INTERFACE,
@@ -1407,6 +1538,14 @@ void ofono_call_settings_register(struct ofono_call_settings *cs)
 
 	ofono_modem_add_interface(modem, OFONO_CALL_SETTINGS_INTERFACE);
 
+	if (imsi)
+		cs->settings = storage_open(imsi, SETTINGS_STORE);
+
+	if (cs->settings) {
+		cs->imsi = l_strdup(imsi);
+		cs_cache_load(cs);
+	}
+
 	cs->ussd_watch = __ofono_modem_add_atom_watch(modem,
 					OFONO_ATOM_TYPE_USSD,
 					ussd_watch, cs, NULL);
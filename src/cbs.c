@@ -53,6 +53,8 @@ struct ofono_cbs {
 	unsigned short efcbmid_length;
 	GSList *efcbmid_contents;
 	gboolean efcbmid_update;
+	unsigned char enabled_topics[CBS_TOPIC_BITMAP_SIZE];
+	unsigned char download_topics[CBS_TOPIC_BITMAP_SIZE];
 	guint reset_source;
 	int lac;
 	int ci;
@@ -66,6 +68,27 @@ struct ofono_cbs {
 	struct ofono_atom *atom;
 };
 
+/*
+ * Rebuilds the topic bitmaps used to filter incoming pages.  The enabled
+ * topics are the ones cbs_topics_to_str() asks the modem for
+ */
+static void cbs_update_topic_bitmaps(struct ofono_cbs *cbs)
+{
+	unsigned int topic;
+
+	memset(cbs->download_topics, 0, CBS_TOPIC_BITMAP_SIZE);
+	cbs_topic_bitmap_add_ranges(cbs->download_topics,
+					cbs->efcbmid_contents);
+
+	memcpy(cbs->enabled_topics, cbs->download_topics,
+					CBS_TOPIC_BITMAP_SIZE);
+	cbs_topic_bitmap_add_ranges(cbs->enabled_topics, cbs->topics);
+
+	for (topic = ETWS_TOPIC_TYPE_EARTHQUAKE;
+			topic <= ETWS_TOPIC_TYPE_EMERGENCY; topic++)
+		cbs->enabled_topics[topic >> 3] |= 1 << (topic & 0x7);
+}
+
 static void cbs_dispatch_base_station_id(struct ofono_cbs *cbs, const char *id)
 {
 	DBG("Base station id: %s", id);
@@ -83,7 +106,10 @@ static void cbs_dispatch_base_station_id(struct ofono_cbs *cbs, const char *id)
 
 static void cbs_dispatch_emergency(struct ofono_cbs *cbs, const char *message,
 					enum etws_topic_type topic,
-					gboolean alert, gboolean popup)
+					gboolean alert, gboolean popup,
+					gboolean complete,
+					time_t received_time,
+					uint64_t received)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(cbs->atom);
@@ -92,6 +118,10 @@ static void cbs_dispatch_emergency(struct ofono_cbs *cbs, const char *message,
 	DBusMessageIter dict;
 	dbus_bool_t boolean;
 	const char *emergency_str;
+	char buf[128];
+	const char *str = buf;
+	struct tm local;
+	uint32_t latency;
 
 	if (topic == ETWS_TOPIC_TYPE_TEST) {
 		ofono_error("Explicitly ignoring ETWS Test messages");
@@ -138,6 +168,18 @@ static void cbs_dispatch_emergency(struct ofono_cbs *cbs, const char *message,
 	boolean = popup;
 	ofono_dbus_dict_append(&dict, "Popup", DBUS_TYPE_BOOLEAN, &boolean);
 
+	boolean = complete;
+	ofono_dbus_dict_append(&dict, "Complete", DBUS_TYPE_BOOLEAN, &boolean);
+
+	localtime_r(&received_time, &local);
+	strftime(buf, 127, "%Y-%m-%dT%H:%M:%S%z", &local);
+	buf[127] = '\0';
+	ofono_dbus_dict_append(&dict, "ReceivedTime", DBUS_TYPE_STRING, &str);
+
+	latency = l_time_diff(received, l_time_now());
+	ofono_dbus_dict_append(&dict, "DispatchLatency",
+				DBUS_TYPE_UINT32, &latency);
+
 	dbus_message_iter_close_container(&iter, &dict);
 	g_dbus_send_message(conn, signal);
 }
@@ -166,16 +208,28 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 	enum sms_charset charset;
 	char *message;
 	char iso639_lang[3];
+	uint64_t received = l_time_now();
+	time_t received_time = time(NULL);
+	gboolean etws;
+	gboolean alert = FALSE;
+	gboolean popup = FALSE;
+	gboolean had_page = FALSE;
 
 	if (cbs->assembly == NULL)
 		return;
 
+	/* Drop pages of topics we have not asked for before decoding */
+	if (pdu_len >= 6 && !cbs_topic_bitmap_test(cbs->enabled_topics,
+							l_get_be16(pdu + 2)))
+		return;
+
 	if (!cbs_decode(pdu, pdu_len, &c)) {
 		ofono_error("Unable to decode CBS PDU");
 		return;
 	}
 
-	if (cbs_topic_in_range(c.message_identifier, cbs->efcbmid_contents)) {
+	if (cbs_topic_bitmap_test(cbs->download_topics,
+					c.message_identifier)) {
 		if (cbs->sim == NULL)
 			return;
 
@@ -215,8 +269,42 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 		return;
 	}
 
+	etws = c.message_identifier >= ETWS_TOPIC_TYPE_EARTHQUAKE &&
+			c.message_identifier <= ETWS_TOPIC_TYPE_EMERGENCY;
+
+	if (etws) {
+		/* 3GPP 23.041 9.4.1.2.1: Alert is encoded in bit 9 */
+		if (c.message_code & (1 << 9))
+			alert = TRUE;
+
+		/* 3GPP 23.041 9.4.1.2.1: Popup is encoded in bit 8 */
+		if (c.message_code & (1 << 8))
+			popup = TRUE;
+
+		had_page = cbs_assembly_has_page(cbs->assembly, &c);
+	}
+
 	cbs_list = cbs_assembly_add_page(cbs->assembly, &c);
 
+	/*
+	 * The first page of a warning is signalled on its own as soon as
+	 * it arrives, the whole text follows once all pages are in
+	 */
+	if (cbs_list == NULL && etws && c.page == 1 && !had_page &&
+			cbs_assembly_has_page(cbs->assembly, &c)) {
+		GSList page = { .data = &c, .next = NULL };
+
+		message = cbs_decode_text(&page, iso639_lang);
+		if (message == NULL)
+			return;
+
+		cbs_dispatch_emergency(cbs, message, c.message_identifier,
+					alert, popup, FALSE,
+					received_time, received);
+		g_free(message);
+		return;
+	}
+
 	if (cbs_list == NULL)
 		return;
 
@@ -225,21 +313,10 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 	if (message == NULL)
 		goto out;
 
-	if (c.message_identifier >= ETWS_TOPIC_TYPE_EARTHQUAKE &&
-			c.message_identifier <= ETWS_TOPIC_TYPE_EMERGENCY) {
-		gboolean alert = FALSE;
-		gboolean popup = FALSE;
-
-		/* 3GPP 23.041 9.4.1.2.1: Alert is encoded in bit 9 */
-		if (c.message_code & (1 << 9))
-			alert = TRUE;
-
-		/* 3GPP 23.041 9.4.1.2.1: Popup is encoded in bit 8 */
-		if (c.message_code & (1 << 8))
-			popup = TRUE;
-
-		cbs_dispatch_emergency(cbs, message,
-					c.message_identifier, alert, popup);
+	if (etws) {
+		cbs_dispatch_emergency(cbs, message, c.message_identifier,
+					alert, popup, TRUE,
+					received_time, received);
 		goto out;
 	}
 
@@ -332,6 +409,7 @@ static void cbs_set_topics_cb(const struct ofono_error *error, void *data)
 	g_slist_free_full(cbs->topics, g_free);
 	cbs->topics = cbs->new_topics;
 	cbs->new_topics = NULL;
+	cbs_update_topic_bitmaps(cbs);
 
 	reply = dbus_message_new_method_return(cbs->pending);
 	__ofono_dbus_pending_reply(&cbs->pending, reply);
@@ -567,6 +645,8 @@ static void cbs_unregister(struct ofono_atom *atom)
 		cbs->efcbmid_contents = NULL;
 	}
 
+	cbs_update_topic_bitmaps(cbs);
+
 	if (cbs->sim_context) {
 		ofono_sim_context_free(cbs->sim_context);
 		cbs->sim_context = NULL;
@@ -626,6 +706,7 @@ static void cbs_remove(struct ofono_atom *atom)
 
 OFONO_DEFINE_ATOM_CREATE(cbs, OFONO_ATOM_TYPE_CBS, {
 	atom->assembly = cbs_assembly_new();
+	cbs_update_topic_bitmaps(atom);
 })
 
 static void cbs_got_file_contents(struct ofono_cbs *cbs)
@@ -654,6 +735,8 @@ static void cbs_got_file_contents(struct ofono_cbs *cbs)
 		storage_sync(cbs->imsi, SETTINGS_STORE, cbs->settings);
 	}
 
+	cbs_update_topic_bitmaps(cbs);
+
 	if (cbs->efcbmi_length) {
 		cbs->efcbmi_length = 0;
 		g_slist_free_full(cbs->efcbmi_contents, g_free);
@@ -813,6 +896,8 @@ static void sim_cbmid_read_cb(int ok, int length, int record,
 	g_free(str);
 
 done:
+	cbs_update_topic_bitmaps(cbs);
+
 	if (cbs->efcbmid_update) {
 		if (cbs->powered == TRUE) {
 			char *topic_str = cbs_topics_to_str(cbs, cbs->topics);
@@ -880,6 +965,8 @@ static void cbs_got_imsi(struct ofono_cbs *cbs)
 	if (topics_str)
 		g_free(topics_str);
 
+	cbs_update_topic_bitmaps(cbs);
+
 	ofono_sim_read(cbs->sim_context, SIM_EFCBMID_FILEID,
 			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
 			sim_cbmid_read_cb, cbs);
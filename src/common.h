@@ -157,6 +157,9 @@ int mmi_service_code_to_bearer_class(int code);
 
 gboolean valid_ussd_string(const char *str, gboolean call_in_progress);
 
+/* How long SS states read from the network are trusted across restarts */
+#define SS_CACHE_MAX_AGE	(24 * 60 * 60)
+
 gboolean parse_ss_control_string(char *str, int *ss_type,
 					char **sc, char **sia,
 					char **sib, char **sic,
@@ -11,14 +11,43 @@
 
 #include <glib.h>
 #include <errno.h>
+#include <string.h>
 #include <gdbus.h>
 
 #include "ofono.h"
 
 #define OFONO_ERROR_INTERFACE "org.ofono.Error"
 
+#define DEFAULT_COALESCED_PROPERTIES "org.ofono.NetworkRegistration.Strength"
+
 static DBusConnection *g_connection;
 
+/*
+ * PropertyChanged signals of high rate properties can be held back for
+ * a short window, so that a burst of changes to the same property of the
+ * same object goes out as a single signal carrying the latest value.
+ * Clients that asked for full rate updates get every change immediately,
+ * sent directly to them.
+ */
+struct pending_signal {
+	char *key;
+	DBusMessage *signal;
+};
+
+static unsigned int coalesce_window;
+static char **coalesced_properties;
+static struct l_queue *pending_signals;
+static GHashTable *pending_index;
+static guint coalesce_source;
+static GHashTable *full_rate_clients;
+
+/*
+ * GetProperties replies of interfaces that opt in are kept as templates,
+ * keyed by object path and interface, and cloned for every further call
+ * until a PropertyChanged signal on that interface invalidates them.
+ */
+static GHashTable *reply_cache;
+
 struct error_mapping_entry {
 	int error;
 	DBusMessage *(*ofono_error_func)(DBusMessage *);
@@ -195,8 +224,157 @@ void ofono_dbus_dict_append_dict(DBusMessageIter *dict, const char *key,
 	dbus_message_iter_close_container(dict, &entry);
 }
 
-int ofono_dbus_signal_property_changed(DBusConnection *conn,
-					const char *path,
+static bool property_is_coalesced(const char *interface, const char *name)
+{
+	size_t len = strlen(interface);
+	int i;
+
+	if (coalesce_window == 0 || coalesced_properties == NULL)
+		return false;
+
+	for (i = 0; coalesced_properties[i]; i++) {
+		const char *prop = coalesced_properties[i];
+
+		if (strncmp(prop, interface, len) == 0 && prop[len] == '.' &&
+				strcmp(prop + len + 1, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void pending_signal_free(void *data)
+{
+	struct pending_signal *pending = data;
+
+	if (pending->signal)
+		dbus_message_unref(pending->signal);
+
+	g_free(pending->key);
+	g_free(pending);
+}
+
+static void flush_pending_signal(void *data, void *user_data)
+{
+	struct pending_signal *pending = data;
+	DBusConnection *conn = user_data;
+
+	g_dbus_send_message(conn, pending->signal);
+	pending->signal = NULL;
+}
+
+static void flush_pending_signals(void)
+{
+	if (coalesce_source) {
+		g_source_remove(coalesce_source);
+		coalesce_source = 0;
+	}
+
+	if (pending_signals == NULL || l_queue_isempty(pending_signals))
+		return;
+
+	g_hash_table_remove_all(pending_index);
+	l_queue_foreach(pending_signals, flush_pending_signal, g_connection);
+	l_queue_clear(pending_signals, pending_signal_free);
+}
+
+static gboolean coalesce_timeout(gpointer user_data)
+{
+	coalesce_source = 0;
+	flush_pending_signals();
+
+	return FALSE;
+}
+
+static void send_full_rate(DBusConnection *conn, DBusMessage *signal)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (full_rate_clients == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, full_rate_clients);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		DBusMessage *copy = dbus_message_copy(signal);
+
+		if (copy == NULL)
+			continue;
+
+		dbus_message_set_destination(copy, key);
+		g_dbus_send_message(conn, copy);
+	}
+}
+
+/*
+ * Queue the signal, replacing an earlier one for the same property of
+ * the same object.  The replacement keeps the original position, so the
+ * relative order of different coalesced properties is preserved.
+ */
+static int coalesce_signal(DBusConnection *conn, DBusMessage *signal,
+				const char *path, const char *interface,
+				const char *name)
+{
+	struct pending_signal *pending;
+	char *key;
+
+	send_full_rate(conn, signal);
+
+	key = g_strconcat(path, " ", interface, " ", name, NULL);
+
+	pending = g_hash_table_lookup(pending_index, key);
+	if (pending) {
+		g_free(key);
+		dbus_message_unref(pending->signal);
+		pending->signal = signal;
+		return 0;
+	}
+
+	pending = g_new0(struct pending_signal, 1);
+	pending->key = key;
+	pending->signal = signal;
+	l_queue_push_tail(pending_signals, pending);
+	g_hash_table_insert(pending_index, pending->key, pending);
+
+	if (coalesce_source == 0)
+		coalesce_source = g_timeout_add(coalesce_window,
+						coalesce_timeout, NULL);
+
+	return 0;
+}
+
+static bool pending_signal_match(void *data, void *user_data)
+{
+	struct pending_signal *pending = data;
+	const char *prefix = user_data;
+
+	if (!g_str_has_prefix(pending->key, prefix))
+		return false;
+
+	g_hash_table_remove(pending_index, pending->key);
+	pending_signal_free(pending);
+
+	return true;
+}
+
+/*
+ * Changes held back for an interface that goes away must not be sent
+ * after its removal, nor after it was registered again
+ */
+static void drop_pending_signals(const char *path, const char *interface)
+{
+	char *prefix;
+
+	if (pending_signals == NULL || l_queue_isempty(pending_signals))
+		return;
+
+	prefix = g_strconcat(path, " ", interface, " ", NULL);
+	l_queue_foreach_remove(pending_signals, pending_signal_match, prefix);
+	g_free(prefix);
+}
+
+static DBusMessage *property_changed_new(const char *path,
 					const char *interface,
 					const char *name,
 					int type, const void *value)
@@ -208,7 +386,7 @@ int ofono_dbus_signal_property_changed(DBusConnection *conn,
 	if (signal == NULL) {
 		ofono_error("Unable to allocate new %s.PropertyChanged signal",
 				interface);
-		return -1;
+		return NULL;
 	}
 
 	dbus_message_iter_init_append(signal, &iter);
@@ -217,9 +395,180 @@ int ofono_dbus_signal_property_changed(DBusConnection *conn,
 
 	append_variant(&iter, type, value);
 
+	return signal;
+}
+
+static char *reply_cache_key(const char *path, const char *interface)
+{
+	if (path == NULL || interface == NULL)
+		return NULL;
+
+	return g_strconcat(path, " ", interface, NULL);
+}
+
+DBusMessage *__ofono_dbus_cached_reply(DBusMessage *msg)
+{
+	DBusMessage *cached;
+	DBusMessage *reply;
+	char *key;
+
+	if (reply_cache == NULL || g_hash_table_size(reply_cache) == 0)
+		return NULL;
+
+	key = reply_cache_key(dbus_message_get_path(msg),
+				dbus_message_get_interface(msg));
+	if (key == NULL)
+		return NULL;
+
+	cached = g_hash_table_lookup(reply_cache, key);
+	g_free(key);
+
+	if (cached == NULL)
+		return NULL;
+
+	reply = dbus_message_copy(cached);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_set_reply_serial(reply, dbus_message_get_serial(msg));
+	dbus_message_set_destination(reply, dbus_message_get_sender(msg));
+
+	return reply;
+}
+
+DBusMessage *__ofono_dbus_cache_reply(DBusMessage *msg, DBusMessage *reply)
+{
+	DBusMessage *cached;
+	char *key;
+
+	if (reply == NULL)
+		return NULL;
+
+	key = reply_cache_key(dbus_message_get_path(msg),
+				dbus_message_get_interface(msg));
+	if (key == NULL)
+		return reply;
+
+	cached = dbus_message_copy(reply);
+	if (cached == NULL) {
+		g_free(key);
+		return reply;
+	}
+
+	if (reply_cache == NULL)
+		reply_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free,
+					(GDestroyNotify) dbus_message_unref);
+
+	g_hash_table_replace(reply_cache, key, cached);
+
+	return reply;
+}
+
+void __ofono_dbus_invalidate_reply(const char *path, const char *interface)
+{
+	char *key;
+
+	if (reply_cache == NULL || g_hash_table_size(reply_cache) == 0)
+		return;
+
+	key = reply_cache_key(path, interface);
+	if (key == NULL)
+		return;
+
+	g_hash_table_remove(reply_cache, key);
+	g_free(key);
+}
+
+int ofono_dbus_signal_property_changed(DBusConnection *conn,
+					const char *path,
+					const char *interface,
+					const char *name,
+					int type, const void *value)
+{
+	DBusMessage *signal;
+
+	__ofono_dbus_invalidate_reply(path, interface);
+
+	signal = property_changed_new(path, interface, name, type, value);
+	if (signal == NULL)
+		return -1;
+
+	if (property_is_coalesced(interface, name))
+		return coalesce_signal(conn, signal, path, interface, name);
+
 	return g_dbus_send_message(conn, signal);
 }
 
+/*
+ * Changes that are below the reporting threshold of a property, e.g. the
+ * signal strength hysteresis, are still of interest to full rate clients.
+ */
+int __ofono_dbus_signal_property_changed_full_rate(DBusConnection *conn,
+						const char *path,
+						const char *interface,
+						const char *name,
+						int type, const void *value)
+{
+	DBusMessage *signal;
+
+	if (full_rate_clients == NULL ||
+			g_hash_table_size(full_rate_clients) == 0)
+		return 0;
+
+	signal = property_changed_new(path, interface, name, type, value);
+	if (signal == NULL)
+		return -1;
+
+	send_full_rate(conn, signal);
+	dbus_message_unref(signal);
+
+	return 0;
+}
+
+static void full_rate_client_disconnect(DBusConnection *conn, void *user_data)
+{
+	const char *sender = user_data;
+
+	DBG("%s", sender);
+
+	g_hash_table_remove(full_rate_clients, sender);
+}
+
+int __ofono_dbus_set_full_rate(const char *sender, bool enable)
+{
+	guint watch;
+
+	if (full_rate_clients == NULL)
+		return -ENOTSUP;
+
+	watch = GPOINTER_TO_UINT(g_hash_table_lookup(full_rate_clients,
+								sender));
+
+	if (!enable) {
+		if (watch) {
+			g_dbus_remove_watch(g_connection, watch);
+			g_hash_table_remove(full_rate_clients, sender);
+		}
+
+		return 0;
+	}
+
+	if (watch)
+		return 0;
+
+	watch = g_dbus_add_disconnect_watch(g_connection, sender,
+						full_rate_client_disconnect,
+						g_strdup(sender), g_free);
+	if (watch == 0)
+		return -EIO;
+
+	g_hash_table_insert(full_rate_clients, g_strdup(sender),
+						GUINT_TO_POINTER(watch));
+
+	return 0;
+}
+
 int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
 						const char *path,
 						const char *interface,
@@ -230,6 +579,8 @@ int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
 	DBusMessage *signal;
 	DBusMessageIter iter;
 
+	__ofono_dbus_invalidate_reply(path, interface);
+
 	signal = dbus_message_new_signal(path, interface, "PropertyChanged");
 	if (signal == NULL) {
 		ofono_error("Unable to allocate new %s.PropertyChanged signal",
@@ -256,6 +607,8 @@ int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
 	DBusMessage *signal;
 	DBusMessageIter iter;
 
+	__ofono_dbus_invalidate_reply(path, interface);
+
 	signal = dbus_message_new_signal(path, interface, "PropertyChanged");
 	if (signal == NULL) {
 		ofono_error("Unable to allocate new %s.PropertyChanged signal",
@@ -473,10 +826,70 @@ static void dbus_gsm_set_connection(DBusConnection *conn)
 	g_connection = conn;
 }
 
+static void coalesce_init(void)
+{
+	const struct l_settings *settings = __ofono_get_config();
+
+	if (!l_settings_get_uint(settings, "DBus", "PropertyChangedWindow",
+					&coalesce_window) ||
+			coalesce_window == 0)
+		return;
+
+	coalesced_properties = l_settings_get_string_list(settings, "DBus",
+							"CoalescedProperties",
+							',');
+	if (coalesced_properties == NULL)
+		coalesced_properties = l_strsplit(DEFAULT_COALESCED_PROPERTIES,
+									',');
+
+	pending_signals = l_queue_new();
+	pending_index = g_hash_table_new(g_str_hash, g_str_equal);
+	full_rate_clients = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
+
+	DBG("coalescing window %u ms", coalesce_window);
+}
+
+static void remove_full_rate_watch(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	g_dbus_remove_watch(g_connection, GPOINTER_TO_UINT(value));
+}
+
+static void coalesce_cleanup(void)
+{
+	if (pending_signals == NULL)
+		return;
+
+	flush_pending_signals();
+
+	l_queue_destroy(pending_signals, NULL);
+	pending_signals = NULL;
+	g_hash_table_destroy(pending_index);
+	pending_index = NULL;
+
+	g_hash_table_foreach(full_rate_clients, remove_full_rate_watch, NULL);
+	g_hash_table_destroy(full_rate_clients);
+	full_rate_clients = NULL;
+
+	l_strv_free(coalesced_properties);
+	coalesced_properties = NULL;
+	coalesce_window = 0;
+}
+
+static void interface_removed(const char *path, const char *interface)
+{
+	drop_pending_signals(path, interface);
+	__ofono_dbus_invalidate_reply(path, interface);
+}
+
 int __ofono_dbus_init(DBusConnection *conn)
 {
 	dbus_gsm_set_connection(conn);
 
+	coalesce_init();
+	g_dbus_set_interface_removed_hook(interface_removed);
+
 	return 0;
 }
 
@@ -484,6 +897,14 @@ void __ofono_dbus_cleanup(void)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 
+	g_dbus_set_interface_removed_hook(NULL);
+	coalesce_cleanup();
+
+	if (reply_cache) {
+		g_hash_table_destroy(reply_cache);
+		reply_cache = NULL;
+	}
+
 	if (conn == NULL || !dbus_connection_get_is_connected(conn))
 		return;
 
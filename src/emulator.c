@@ -61,6 +61,10 @@ struct ofono_emulator {
 	bool clip : 1;
 	bool ccwa : 1;
 	bool ddr_active : 1;
+	char *cind_query;
+	size_t cind_query_len;
+	char *cind_support;
+	size_t cind_support_len;
 };
 
 struct indicator {
@@ -68,6 +72,8 @@ struct indicator {
 	int value;
 	int min;
 	int max;
+	unsigned int offset;	/* Of the value in the +CIND? template */
+	unsigned int width;
 	gboolean deferred;
 	gboolean active;
 	gboolean mandatory;
@@ -484,80 +490,92 @@ fail:
 	}
 }
 
-static void cind_cb(GAtServer *server, GAtServerRequestType type,
-			GAtResult *result, gpointer user_data)
+/*
+ * The +CIND replies are built once and kept.  Car kits poll them, so the
+ * query template is patched in place as indicators change and sent
+ * without formatting or allocating anything.
+ */
+static void cind_templates_build(struct ofono_emulator *em)
 {
-	struct ofono_emulator *em = user_data;
+	struct l_string *query = l_string_new(64);
+	struct l_string *support = l_string_new(256);
 	GSList *l;
-	struct indicator *ind;
-	gsize size;
-	int len;
-	char *buf;
-	char *tmp;
 
-	switch (type) {
-	case G_AT_SERVER_REQUEST_TYPE_QUERY:
-		/*
-		 * "+CIND: " + terminating null + number of indicators *
-		 * (max of 3 digits in the value + separator)
-		 */
-		size = 7 + 1 + (g_slist_length(em->indicators) * 4);
-		buf = g_try_malloc0(size);
-		if (buf == NULL)
-			goto fail;
+	l_string_append(query, "+CIND: ");
+	l_string_append(support, "+CIND: ");
 
-		len = sprintf(buf, "+CIND: ");
-		tmp = buf + len;
+	for (l = em->indicators; l; l = l->next) {
+		struct indicator *ind = l->data;
+		const char *sep = l == em->indicators ? "" : ",";
 
-		for (l = em->indicators; l; l = l->next) {
-			ind = l->data;
-			len = sprintf(tmp, "%s%d",
-					l == em->indicators ? "" : ",",
-					ind->value);
-			tmp = tmp + len;
-		}
+		l_string_append(query, sep);
+		ind->offset = l_string_length(query);
+		l_string_append_printf(query, "%d", ind->value);
+		ind->width = l_string_length(query) - ind->offset;
 
-		g_at_server_send_info(em->server, buf, TRUE);
-		g_free(buf);
-		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
-		break;
+		l_string_append_printf(support, "%s(\"%s\",(%d%c%d))", sep,
+					ind->name, ind->min,
+					(ind->max - ind->min) == 1 ? ',' : '-',
+					ind->max);
+	}
 
-	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
-		/*
-		 * '+CIND: ' + terminating null + number of indicators *
-		 * ( indicator name + '("",(000,000))' + separator)
-		 */
-		size = 8;
+	em->cind_query_len = l_string_length(query);
+	em->cind_query = l_string_unwrap(query);
+	em->cind_support_len = l_string_length(support);
+	em->cind_support = l_string_unwrap(support);
+}
 
-		for (l = em->indicators; l; l = l->next) {
-			ind = l->data;
-			size += strlen(ind->name) + 15;
-		}
+static void cind_templates_free(struct ofono_emulator *em)
+{
+	l_free(em->cind_query);
+	em->cind_query = NULL;
 
-		buf = g_try_malloc0(size);
-		if (buf == NULL)
-			goto fail;
+	l_free(em->cind_support);
+	em->cind_support = NULL;
+}
 
-		len = sprintf(buf, "+CIND: ");
-		tmp = buf + len;
+static void cind_template_update(struct ofono_emulator *em,
+					const struct indicator *ind)
+{
+	char digits[12];
+	int len;
 
-		for (l = em->indicators; l; l = l->next) {
-			ind = l->data;
-			len = sprintf(tmp, "%s(\"%s\",(%d%c%d))",
-					l == em->indicators ? "" : ",",
-					ind->name, ind->min,
-					(ind->max - ind->min) == 1 ? ',' : '-',
-					ind->max);
-			tmp = tmp + len;
-		}
+	if (em->cind_query == NULL)
+		return;
+
+	len = sprintf(digits, "%d", ind->value);
+
+	/* The values after it would move, rebuild on the next query */
+	if ((unsigned int) len != ind->width) {
+		cind_templates_free(em);
+		return;
+	}
+
+	memcpy(em->cind_query + ind->offset, digits, len);
+}
+
+static void cind_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *result, gpointer user_data)
+{
+	struct ofono_emulator *em = user_data;
 
-		g_at_server_send_info(server, buf, TRUE);
-		g_free(buf);
+	if (em->cind_query == NULL)
+		cind_templates_build(em);
+
+	switch (type) {
+	case G_AT_SERVER_REQUEST_TYPE_QUERY:
+		g_at_server_send_info_len(server, em->cind_query,
+						em->cind_query_len, TRUE);
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+		break;
+
+	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
+		g_at_server_send_info_len(server, em->cind_support,
+						em->cind_support_len, TRUE);
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
 		break;
 
 	default:
-fail:
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
 		break;
 	}
@@ -578,8 +596,8 @@ static void cmer_cb(GAtServer *server, GAtServerRequestType type,
 		break;
 
 	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
-		sprintf(buf, "+CMER: (0,3),(0),(0),(0,1),(0)");
-		g_at_server_send_info(em->server, buf, TRUE);
+		g_at_server_send_info(em->server,
+				"+CMER: (0,3),(0),(0),(0,1),(0)", TRUE);
 		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
 		break;
 
@@ -1160,6 +1178,7 @@ static void emulator_add_indicator(struct ofono_emulator *em, const char* name,
 	ind->mandatory = mandatory;
 
 	em->indicators = g_slist_append(em->indicators, ind);
+	cind_templates_free(em);
 }
 
 static void emulator_unregister(struct ofono_atom *atom)
@@ -1183,6 +1202,7 @@ static void emulator_unregister(struct ofono_atom *atom)
 
 	g_slist_free(em->indicators);
 	em->indicators = NULL;
+	cind_templates_free(em);
 
 	g_at_ppp_unref(em->ppp);
 	em->ppp = NULL;
@@ -1541,6 +1561,7 @@ void ofono_emulator_set_indicator(struct ofono_emulator *em,
 		return;
 
 	ind->value = value;
+	cind_template_update(em, ind);
 
 	call_ind = find_indicator(em, OFONO_EMULATOR_IND_CALL, NULL);
 	cs_ind = find_indicator(em, OFONO_EMULATOR_IND_CALLSETUP, NULL);
@@ -1614,6 +1635,7 @@ void __ofono_emulator_set_indicator_forced(struct ofono_emulator *em,
 		return;
 
 	ind->value = value;
+	cind_template_update(em, ind);
 
 	if (em->events_mode == 3 && em->events_ind && em->slc && ind->active) {
 		if (!g_at_server_command_pending(em->server)) {
@@ -0,0 +1,312 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "eventloop.h"
+
+/*
+ * The GLib file descriptors are kept in an epoll set of their own, which
+ * is watched by the ell loop like any other descriptor.  Each iteration
+ * GLib is prepared and queried first, then ell waits for whichever of
+ * the two timeouts expires first, and only when the GLib set became
+ * readable are the GLib descriptors looked at again.
+ */
+struct glib_fd {
+	int fd;
+	uint32_t events;
+};
+
+struct eventloop {
+	GMainContext *context;
+	int epoll_fd;
+	struct l_io *io;
+	bool pending;
+	bool running;
+	int max_priority;
+	GPollFD *fds;
+	int n_fds;
+	struct glib_fd *registered;
+	int n_registered;
+	struct glib_fd *wanted;
+	struct epoll_event *events;
+	int size;
+};
+
+static struct eventloop *loop;
+
+static uint32_t gio_to_epoll(gushort events)
+{
+	uint32_t r = 0;
+
+	if (events & G_IO_IN)
+		r |= EPOLLIN;
+
+	if (events & G_IO_PRI)
+		r |= EPOLLPRI;
+
+	if (events & G_IO_OUT)
+		r |= EPOLLOUT;
+
+	return r;
+}
+
+static gushort epoll_to_gio(uint32_t events)
+{
+	gushort r = 0;
+
+	if (events & EPOLLIN)
+		r |= G_IO_IN;
+
+	if (events & EPOLLPRI)
+		r |= G_IO_PRI;
+
+	if (events & EPOLLOUT)
+		r |= G_IO_OUT;
+
+	if (events & EPOLLERR)
+		r |= G_IO_ERR;
+
+	if (events & EPOLLHUP)
+		r |= G_IO_HUP;
+
+	return r;
+}
+
+static int glib_fd_compare(const void *a, const void *b)
+{
+	const struct glib_fd *fa = a;
+	const struct glib_fd *fb = b;
+
+	return fa->fd - fb->fd;
+}
+
+static void loop_resize(int size)
+{
+	if (size <= loop->size)
+		return;
+
+	loop->fds = l_realloc(loop->fds, size * sizeof(GPollFD));
+	loop->registered = l_realloc(loop->registered,
+					size * sizeof(struct glib_fd));
+	loop->wanted = l_realloc(loop->wanted, size * sizeof(struct glib_fd));
+	loop->events = l_realloc(loop->events,
+					size * sizeof(struct epoll_event));
+	loop->size = size;
+}
+
+static void epoll_add(const struct glib_fd *want, uint32_t cached)
+{
+	struct epoll_event ev = {
+		.events = want->events,
+		.data.fd = want->fd,
+	};
+
+	/*
+	 * The add is always attempted: a descriptor that was closed and
+	 * reopened under the same number in the meantime dropped out of the
+	 * set on its own, and is only noticed here.
+	 */
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, want->fd, &ev) == 0 ||
+			errno != EEXIST || cached == want->events)
+		return;
+
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, want->fd, &ev);
+}
+
+/* Brings the epoll set in line with the GLib poll records */
+static void loop_sync(void)
+{
+	struct glib_fd *swap;
+	int n = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < loop->n_fds; i++) {
+		const GPollFD *pfd = &loop->fds[i];
+
+		if (pfd->fd < 0)
+			continue;
+
+		for (j = 0; j < n; j++)
+			if (loop->wanted[j].fd == pfd->fd)
+				break;
+
+		if (j == n) {
+			loop->wanted[n].fd = pfd->fd;
+			loop->wanted[n++].events = 0;
+		}
+
+		loop->wanted[j].events |= gio_to_epoll(pfd->events);
+	}
+
+	qsort(loop->wanted, n, sizeof(struct glib_fd), glib_fd_compare);
+
+	for (i = 0, j = 0; i < loop->n_registered || j < n;) {
+		const struct glib_fd *reg = &loop->registered[i];
+		const struct glib_fd *want = &loop->wanted[j];
+
+		if (j == n || (i < loop->n_registered && reg->fd < want->fd)) {
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, reg->fd, NULL);
+			i++;
+		} else if (i == loop->n_registered || want->fd < reg->fd) {
+			epoll_add(want, 0);
+			j++;
+		} else {
+			epoll_add(want, reg->events);
+			i++;
+			j++;
+		}
+	}
+
+	swap = loop->registered;
+	loop->registered = loop->wanted;
+	loop->wanted = swap;
+	loop->n_registered = n;
+}
+
+/* Returns the GLib timeout in milliseconds, -1 if there is none */
+static int loop_prepare(void)
+{
+	int timeout;
+	int n;
+
+	g_main_context_prepare(loop->context, &loop->max_priority);
+
+	while ((n = g_main_context_query(loop->context, loop->max_priority,
+						&timeout, loop->fds,
+						loop->size)) > loop->size)
+		loop_resize(n);
+
+	loop->n_fds = n;
+	loop_sync();
+
+	return timeout;
+}
+
+static void loop_dispatch(void)
+{
+	int n = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < loop->n_fds; i++)
+		loop->fds[i].revents = 0;
+
+	if (loop->pending) {
+		loop->pending = false;
+		n = epoll_wait(loop->epoll_fd, loop->events, loop->size, 0);
+	}
+
+	for (i = 0; i < n; i++) {
+		gushort revents = epoll_to_gio(loop->events[i].events);
+		int fd = loop->events[i].data.fd;
+
+		for (j = 0; j < loop->n_fds; j++) {
+			GPollFD *pfd = &loop->fds[j];
+
+			if (pfd->fd == fd)
+				pfd->revents = revents & (pfd->events |
+						G_IO_ERR | G_IO_HUP);
+		}
+	}
+
+	if (g_main_context_check(loop->context, loop->max_priority,
+					loop->fds, loop->n_fds))
+		g_main_context_dispatch(loop->context);
+}
+
+static bool glib_ready(struct l_io *io, void *user_data)
+{
+	loop->pending = true;
+
+	return true;
+}
+
+int eventloop_init(void)
+{
+	if (loop)
+		return -EALREADY;
+
+	loop = l_new(struct eventloop, 1);
+	loop->context = g_main_context_default();
+
+	if (!g_main_context_acquire(loop->context)) {
+		l_free(loop);
+		loop = NULL;
+		return -EBUSY;
+	}
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd < 0) {
+		int err = -errno;
+
+		g_main_context_release(loop->context);
+		l_free(loop);
+		loop = NULL;
+		return err;
+	}
+
+	loop->io = l_io_new(loop->epoll_fd);
+	l_io_set_close_on_destroy(loop->io, true);
+	l_io_set_read_handler(loop->io, glib_ready, NULL, NULL);
+
+	loop_resize(16);
+
+	return 0;
+}
+
+void eventloop_run(void)
+{
+	if (!loop)
+		return;
+
+	loop->running = true;
+
+	while (loop->running) {
+		int glib_timeout = loop_prepare();
+		int timeout = l_main_prepare();
+
+		if (timeout < 0 || (glib_timeout >= 0 &&
+						glib_timeout < timeout))
+			timeout = glib_timeout;
+
+		l_main_iterate(timeout);
+		loop_dispatch();
+	}
+}
+
+void eventloop_quit(void)
+{
+	if (loop)
+		loop->running = false;
+}
+
+void eventloop_exit(void)
+{
+	if (!loop)
+		return;
+
+	l_io_destroy(loop->io);
+	g_main_context_release(loop->context);
+
+	l_free(loop->fds);
+	l_free(loop->registered);
+	l_free(loop->wanted);
+	l_free(loop->events);
+	l_free(loop);
+	loop = NULL;
+}
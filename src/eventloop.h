@@ -0,0 +1,15 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Runs the ell main loop with the default GLib main context driven from
+ * it, so that GLib and ell sources share a single epoll wait.  l_main_init
+ * must have been called first.
+ */
+int eventloop_init(void);
+void eventloop_run(void);
+void eventloop_quit(void);
+void eventloop_exit(void);
@@ -0,0 +1,776 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+
+#include "common.h"
+
+/*
+ * The default route goes over the internet context of one modem at a
+ * time.  With Standby set the internet contexts of the other modems are
+ * kept up as well, so that moving the route is all a switch takes.  A
+ * link is degraded while its signal is below the policy minimum.  The
+ * route leaves a degraded link once that has lasted HoldTime, and a lost
+ * link right away.  It returns to a link earlier in Priority once that
+ * link has been healthy for HoldTime.
+ */
+#define DEFAULT_HOLD_TIME	500	/* ms */
+#define DEFAULT_MIN_RSRP	-115	/* dBm */
+#define DEFAULT_MIN_RSSI	-100	/* dBm */
+#define ROUTE_PRIORITY		50
+#define RETRY_DELAY_MIN		1000	/* ms */
+#define RETRY_DELAY_MAX		300000	/* ms */
+
+struct failover_link {
+	struct ofono_modem *modem;
+	unsigned int gprs_watch;
+	unsigned int netreg_watch;
+	struct ofono_gprs *gprs;
+	unsigned int link_watch;
+	struct ofono_netreg *netreg;
+	unsigned int status_watch;
+	unsigned int signal_watch;
+	bool attached;
+	bool registered;
+	char *interface;
+	char *gateway;
+	struct ofono_netreg_signal signal;
+	bool healthy;
+	uint64_t since;		/* Last change of healthy */
+	uint64_t retry_at;	/* Next internet activation attempt */
+	unsigned int retry_delay;	/* ms */
+};
+
+static struct l_queue *links;
+static struct failover_link *active;
+static struct l_rtnl_route *route;
+static int route_ifindex;
+static struct l_netlink *rtnl;
+static struct l_timeout *hold_timeout;
+static struct l_idle *evaluate_idle;
+static unsigned int modemwatch_id;
+
+static bool policy_enabled;
+static bool policy_standby = true;
+static int policy_min_rsrp = DEFAULT_MIN_RSRP;
+static int policy_min_rssi = DEFAULT_MIN_RSSI;
+static unsigned int policy_hold_time = DEFAULT_HOLD_TIME;
+static char **policy_priority;
+
+static void failover_evaluate(void);
+
+static void evaluate_idle_cb(struct l_idle *idle, void *user_data)
+{
+	l_idle_remove(evaluate_idle);
+	evaluate_idle = NULL;
+
+	failover_evaluate();
+}
+
+/* Changes often come in bursts, they are looked at together */
+static void schedule_evaluate(void)
+{
+	if (evaluate_idle == NULL)
+		evaluate_idle = l_idle_create(evaluate_idle_cb, NULL, NULL);
+}
+
+static void signal_active_modem(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = active ? ofono_modem_get_path(active->modem) : "/";
+
+	ofono_dbus_signal_property_changed(conn, OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					"ActiveModem", DBUS_TYPE_OBJECT_PATH,
+					&path);
+}
+
+static void rtnl_result(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	const char *what = user_data;
+
+	if (error < 0)
+		ofono_error("%s: %s (%d)", what, strerror(-error), -error);
+}
+
+static void route_clear(void)
+{
+	if (route) {
+		l_rtnl_route_delete(rtnl, route_ifindex, route, rtnl_result,
+					"Failed to remove default route", NULL);
+		l_rtnl_route_free(route);
+		route = NULL;
+		route_ifindex = 0;
+	}
+
+	if (active == NULL)
+		return;
+
+	active = NULL;
+	signal_active_modem();
+}
+
+/*
+ * The new route is in place before the old one goes, the kernel keeps
+ * both for a moment under different metrics.  Without a gateway the
+ * link is point to point and the route points at the device.
+ */
+static void route_set(struct failover_link *link)
+{
+	struct l_rtnl_route *rt;
+	int ifindex;
+
+	ifindex = if_nametoindex(link->interface);
+	if (ifindex == 0) {
+		ofono_error("No interface %s for default route",
+				link->interface);
+		return;
+	}
+
+	if (link == active && ifindex == route_ifindex)
+		return;
+
+	if (link->gateway && strcmp(link->gateway, "0.0.0.0"))
+		rt = l_rtnl_route_new_gateway(link->gateway);
+	else {
+		rt = l_rtnl_route_new_gateway("0.0.0.0");
+		if (rt)
+			l_rtnl_route_set_scope(rt, RT_SCOPE_LINK);
+	}
+
+	if (rt == NULL) {
+		ofono_error("Invalid gateway %s", link->gateway);
+		return;
+	}
+
+	l_rtnl_route_set_priority(rt, ROUTE_PRIORITY);
+	l_rtnl_route_set_protocol(rt, RTPROT_STATIC);
+
+	if (!l_rtnl_route_add(rtnl, ifindex, rt, rtnl_result,
+				"Failed to add default route", NULL)) {
+		ofono_error("Failed to add default route");
+		l_rtnl_route_free(rt);
+		return;
+	}
+
+	DBG("default route over %s", link->interface);
+
+	if (route) {
+		l_rtnl_route_delete(rtnl, route_ifindex, route, rtnl_result,
+					"Failed to remove default route", NULL);
+		l_rtnl_route_free(route);
+	}
+
+	route = rt;
+	route_ifindex = ifindex;
+	active = link;
+
+	signal_active_modem();
+}
+
+static bool link_usable(const struct failover_link *link)
+{
+	return link->registered && link->attached && link->interface;
+}
+
+static bool link_signal_ok(const struct failover_link *link)
+{
+	if (link->signal.rsrp != OFONO_NETREG_SIGNAL_UNKNOWN)
+		return link->signal.rsrp >= policy_min_rsrp;
+
+	if (link->signal.rssi != OFONO_NETREG_SIGNAL_UNKNOWN)
+		return link->signal.rssi >= policy_min_rssi;
+
+	return true;
+}
+
+static void link_update_health(struct failover_link *link)
+{
+	bool healthy = link_usable(link) && link_signal_ok(link);
+
+	if (healthy != link->healthy) {
+		DBG("%s %s", ofono_modem_get_path(link->modem),
+					healthy ? "healthy" : "degraded");
+
+		link->healthy = healthy;
+		link->since = l_time_now();
+	}
+
+	schedule_evaluate();
+}
+
+static void link_recheck(void *data, void *user_data)
+{
+	link_update_health(data);
+}
+
+/* Modems missing from Priority come last, in the order they appeared */
+static unsigned int link_rank(const struct failover_link *link)
+{
+	const char *path = ofono_modem_get_path(link->modem);
+	unsigned int i;
+
+	for (i = 0; policy_priority[i]; i++)
+		if (g_str_equal(policy_priority[i], path))
+			return i;
+
+	return i;
+}
+
+static void hold_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	failover_evaluate();
+}
+
+static void due_at(uint64_t *due, uint64_t when)
+{
+	if (*due == 0 || when < *due)
+		*due = when;
+}
+
+/*
+ * Activation failures are not reported back, the link just stays down.
+ * Each attempt that has not brought it up by the next one doubles the
+ * wait, until an interface shows up.
+ */
+static void link_activate(struct failover_link *link, uint64_t now,
+				uint64_t *due)
+{
+	if (now < link->retry_at) {
+		due_at(due, link->retry_at);
+		return;
+	}
+
+	if (link->retry_delay == 0)
+		link->retry_delay = RETRY_DELAY_MIN;
+
+	if (__ofono_gprs_activate_internet(link->gprs))
+		DBG("%s retry in %u ms", ofono_modem_get_path(link->modem),
+					link->retry_delay);
+
+	link->retry_at = now + (uint64_t) link->retry_delay * 1000;
+	link->retry_delay = MIN(link->retry_delay * 2, RETRY_DELAY_MAX);
+	due_at(due, link->retry_at);
+}
+
+static void failover_evaluate(void)
+{
+	uint64_t now = l_time_now();
+	uint64_t hold = (uint64_t) policy_hold_time * 1000;
+	struct failover_link *healthy = NULL;
+	struct failover_link *usable = NULL;
+	struct failover_link *target = NULL;
+	uint64_t due = 0;
+	const struct l_queue_entry *entry;
+
+	l_timeout_remove(hold_timeout);
+	hold_timeout = NULL;
+
+	if (!policy_enabled) {
+		route_clear();
+		return;
+	}
+
+	for (entry = l_queue_get_entries(links); entry; entry = entry->next) {
+		struct failover_link *link = entry->data;
+
+		if (link->gprs && link->attached && !link->interface &&
+				(policy_standby || active == NULL))
+			link_activate(link, now, &due);
+
+		if (!link_usable(link))
+			continue;
+
+		if (!usable || link_rank(link) < link_rank(usable))
+			usable = link;
+
+		if (!link->healthy)
+			continue;
+
+		if (!healthy || link_rank(link) < link_rank(healthy))
+			healthy = link;
+	}
+
+	if (active == NULL || !link_usable(active))
+		target = healthy ? healthy : usable;
+	else if (!active->healthy && healthy) {
+		if (now >= active->since + hold)
+			target = healthy;
+		else
+			due_at(&due, active->since + hold);
+	} else if (active->healthy && healthy && healthy != active &&
+				link_rank(healthy) < link_rank(active)) {
+		if (now >= healthy->since + hold)
+			target = healthy;
+		else
+			due_at(&due, healthy->since + hold);
+	}
+
+	if (due)
+		hold_timeout = l_timeout_create_ms((due - now + 999) / 1000,
+						hold_timeout_cb, NULL, NULL);
+
+	if (target)
+		route_set(target);
+	else if (active && !link_usable(active))
+		route_clear();
+}
+
+static void link_notify(ofono_bool_t attached, const char *interface,
+				const char *gateway, void *data)
+{
+	struct failover_link *link = data;
+
+	link->attached = attached;
+
+	if (g_strcmp0(link->interface, interface) ||
+			g_strcmp0(link->gateway, gateway)) {
+		l_free(link->interface);
+		link->interface = l_strdup(interface);
+		l_free(link->gateway);
+		link->gateway = l_strdup(gateway);
+
+		if (interface) {
+			link->retry_at = 0;
+			link->retry_delay = 0;
+		}
+
+		/* The route refers to the link as it was */
+		if (link == active)
+			route_clear();
+	}
+
+	link_update_health(link);
+}
+
+static void gprs_watch(struct ofono_atom *atom,
+			enum ofono_atom_watch_condition cond, void *data)
+{
+	struct failover_link *link = data;
+
+	if (cond == OFONO_ATOM_WATCH_CONDITION_UNREGISTERED) {
+		__ofono_gprs_remove_link_watch(link->gprs, link->link_watch);
+		link->link_watch = 0;
+		link->gprs = NULL;
+
+		link_notify(FALSE, NULL, NULL, link);
+		return;
+	}
+
+	link->gprs = __ofono_atom_get_data(atom);
+	link->link_watch = __ofono_gprs_add_link_watch(link->gprs,
+							link_notify, link,
+							NULL);
+}
+
+static void status_notify(int status, int lac, int ci, int tech,
+				const char *mcc, const char *mnc, void *data)
+{
+	struct failover_link *link = data;
+
+	link->registered = status == NETWORK_REGISTRATION_STATUS_REGISTERED ||
+				status == NETWORK_REGISTRATION_STATUS_ROAMING;
+
+	link_update_health(link);
+}
+
+static void signal_notify(const struct ofono_netreg_signal *signal,
+				void *data)
+{
+	struct failover_link *link = data;
+
+	link->signal = *signal;
+
+	link_update_health(link);
+}
+
+static void netreg_watch(struct ofono_atom *atom,
+			enum ofono_atom_watch_condition cond, void *data)
+{
+	struct failover_link *link = data;
+	struct ofono_netreg_signal deltas;
+
+	if (cond == OFONO_ATOM_WATCH_CONDITION_UNREGISTERED) {
+		__ofono_netreg_remove_status_watch(link->netreg,
+							link->status_watch);
+		__ofono_netreg_remove_signal_watch(link->netreg,
+							link->signal_watch);
+		link->status_watch = 0;
+		link->signal_watch = 0;
+		link->netreg = NULL;
+
+		link->registered = false;
+		ofono_netreg_signal_init(&link->signal);
+		link_update_health(link);
+		return;
+	}
+
+	link->netreg = __ofono_atom_get_data(atom);
+
+	memset(&deltas, 0, sizeof(deltas));
+	deltas.rssi = 2;
+	deltas.rsrp = 2;
+
+	link->status_watch = __ofono_netreg_add_status_watch(link->netreg,
+							status_notify, link,
+							NULL);
+	link->signal_watch = __ofono_netreg_add_signal_watch(link->netreg,
+							&deltas, signal_notify,
+							link, NULL);
+
+	status_notify(ofono_netreg_get_status(link->netreg), -1, -1, -1,
+			NULL, NULL, link);
+}
+
+static bool link_match(const void *a, const void *b)
+{
+	const struct failover_link *link = a;
+
+	return link->modem == b;
+}
+
+static void link_free(void *data)
+{
+	struct failover_link *link = data;
+
+	if (link->link_watch)
+		__ofono_gprs_remove_link_watch(link->gprs, link->link_watch);
+
+	if (link->status_watch)
+		__ofono_netreg_remove_status_watch(link->netreg,
+							link->status_watch);
+
+	if (link->signal_watch)
+		__ofono_netreg_remove_signal_watch(link->netreg,
+							link->signal_watch);
+
+	__ofono_modem_remove_atom_watch(link->modem, link->gprs_watch);
+	__ofono_modem_remove_atom_watch(link->modem, link->netreg_watch);
+
+	l_free(link->interface);
+	l_free(link->gateway);
+	l_free(link);
+}
+
+static void modem_watch(struct ofono_modem *modem, gboolean added, void *data)
+{
+	struct failover_link *link;
+
+	if (added == FALSE) {
+		link = l_queue_remove_if(links, link_match, modem);
+		if (link == NULL)
+			return;
+
+		if (link == active)
+			route_clear();
+
+		link_free(link);
+		schedule_evaluate();
+		return;
+	}
+
+	link = l_new(struct failover_link, 1);
+	link->modem = modem;
+	ofono_netreg_signal_init(&link->signal);
+
+	l_queue_push_tail(links, link);
+
+	link->gprs_watch = __ofono_modem_add_atom_watch(modem,
+						OFONO_ATOM_TYPE_GPRS,
+						gprs_watch, link, NULL);
+	link->netreg_watch = __ofono_modem_add_atom_watch(modem,
+						OFONO_ATOM_TYPE_NETREG,
+						netreg_watch, link, NULL);
+}
+
+static void call_modemwatch(struct ofono_modem *modem, void *data)
+{
+	modem_watch(modem, TRUE, data);
+}
+
+static DBusMessage *failover_get_properties(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_bool_t value;
+	const char *path;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = policy_enabled;
+	ofono_dbus_dict_append(&dict, "Enabled", DBUS_TYPE_BOOLEAN, &value);
+
+	value = policy_standby;
+	ofono_dbus_dict_append(&dict, "Standby", DBUS_TYPE_BOOLEAN, &value);
+
+	ofono_dbus_dict_append_array(&dict, "Priority", DBUS_TYPE_OBJECT_PATH,
+					&policy_priority);
+
+	ofono_dbus_dict_append(&dict, "MinimumRsrp", DBUS_TYPE_INT32,
+				&policy_min_rsrp);
+	ofono_dbus_dict_append(&dict, "MinimumRssi", DBUS_TYPE_INT32,
+				&policy_min_rssi);
+	ofono_dbus_dict_append(&dict, "HoldTime", DBUS_TYPE_UINT32,
+				&policy_hold_time);
+
+	path = active ? ofono_modem_get_path(active->modem) : "/";
+	ofono_dbus_dict_append(&dict, "ActiveModem", DBUS_TYPE_OBJECT_PATH,
+				&path);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static bool parse_priority(DBusMessageIter *var, char ***out)
+{
+	DBusMessageIter array;
+	const char *path;
+	char **priority;
+	unsigned int n = 0;
+
+	if (dbus_message_iter_get_arg_type(var) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(var) !=
+						DBUS_TYPE_OBJECT_PATH)
+		return false;
+
+	dbus_message_iter_recurse(var, &array);
+	priority = l_new(char *, 1);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		dbus_message_iter_get_basic(&array, &path);
+
+		priority = l_realloc(priority, sizeof(char *) * (n + 2));
+		priority[n++] = l_strdup(path);
+		priority[n] = NULL;
+
+		dbus_message_iter_next(&array);
+	}
+
+	*out = priority;
+
+	return true;
+}
+
+static DBusMessage *failover_set_property(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	DBusMessageIter iter;
+	DBusMessageIter var;
+	const char *property;
+	dbus_bool_t value;
+	dbus_int32_t level;
+	dbus_uint32_t hold;
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_get_basic(&iter, &property);
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_VARIANT)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_recurse(&iter, &var);
+
+	if (g_str_equal(property, "Enabled") ||
+			g_str_equal(property, "Standby")) {
+		bool *policy = g_str_equal(property, "Enabled") ?
+					&policy_enabled : &policy_standby;
+
+		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_BOOLEAN)
+			return __ofono_error_invalid_args(msg);
+
+		dbus_message_iter_get_basic(&var, &value);
+
+		if (*policy != (bool) value) {
+			*policy = value;
+			ofono_dbus_signal_property_changed(conn,
+					OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					property, DBUS_TYPE_BOOLEAN, &value);
+		}
+	} else if (g_str_equal(property, "MinimumRsrp") ||
+			g_str_equal(property, "MinimumRssi")) {
+		int *policy = g_str_equal(property, "MinimumRsrp") ?
+					&policy_min_rsrp : &policy_min_rssi;
+
+		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_INT32)
+			return __ofono_error_invalid_args(msg);
+
+		dbus_message_iter_get_basic(&var, &level);
+
+		if (level >= 0)
+			return __ofono_error_invalid_format(msg);
+
+		if (*policy != level) {
+			*policy = level;
+			ofono_dbus_signal_property_changed(conn,
+					OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					property, DBUS_TYPE_INT32, &level);
+		}
+	} else if (g_str_equal(property, "HoldTime")) {
+		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_UINT32)
+			return __ofono_error_invalid_args(msg);
+
+		dbus_message_iter_get_basic(&var, &hold);
+
+		if (policy_hold_time != hold) {
+			policy_hold_time = hold;
+			ofono_dbus_signal_property_changed(conn,
+					OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					property, DBUS_TYPE_UINT32, &hold);
+		}
+	} else if (g_str_equal(property, "Priority")) {
+		char **priority;
+
+		if (!parse_priority(&var, &priority))
+			return __ofono_error_invalid_args(msg);
+
+		l_strv_free(policy_priority);
+		policy_priority = priority;
+
+		ofono_dbus_signal_array_property_changed(conn,
+					OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					property, DBUS_TYPE_OBJECT_PATH,
+					&policy_priority);
+	} else
+		return __ofono_error_invalid_args(msg);
+
+	/* Thresholds apply to the signal already known */
+	l_queue_foreach(links, link_recheck, NULL);
+	schedule_evaluate();
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable failover_methods[] = {
+	{ GDBUS_METHOD("GetProperties",
+			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
+			failover_get_properties) },
+	{ GDBUS_METHOD("SetProperty",
+			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
+			NULL, failover_set_property) },
+	{ }
+};
+
+static const GDBusSignalTable failover_signals[] = {
+	{ GDBUS_SIGNAL("PropertyChanged",
+			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ }
+};
+
+static int failover_init(void)
+{
+	const struct l_settings *config = __ofono_get_config();
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	l_settings_get_bool(config, "DataFailover", "Enabled",
+				&policy_enabled);
+	l_settings_get_bool(config, "DataFailover", "Standby",
+				&policy_standby);
+	l_settings_get_int(config, "DataFailover", "MinimumRsrp",
+				&policy_min_rsrp);
+	l_settings_get_int(config, "DataFailover", "MinimumRssi",
+				&policy_min_rssi);
+	l_settings_get_uint(config, "DataFailover", "HoldTime",
+				&policy_hold_time);
+
+	policy_priority = l_settings_get_string_list(config, "DataFailover",
+							"Priority", ',');
+	if (policy_priority == NULL)
+		policy_priority = l_new(char *, 1);
+
+	rtnl = l_netlink_new(NETLINK_ROUTE);
+	if (rtnl == NULL) {
+		ofono_error("Unable to open rtnetlink, data failover "
+				"is not available");
+		l_strv_free(policy_priority);
+		policy_priority = NULL;
+		return 0;
+	}
+
+	if (!g_dbus_register_interface(conn, OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE,
+					failover_methods, failover_signals,
+					NULL, NULL, NULL)) {
+		ofono_error("Could not create %s interface",
+				OFONO_DATA_FAILOVER_INTERFACE);
+		l_netlink_destroy(rtnl);
+		rtnl = NULL;
+		l_strv_free(policy_priority);
+		policy_priority = NULL;
+		return 0;
+	}
+
+	links = l_queue_new();
+
+	modemwatch_id = __ofono_modemwatch_add(modem_watch, NULL, NULL);
+	__ofono_modem_foreach(call_modemwatch, NULL);
+
+	return 0;
+}
+
+static void failover_exit(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	if (rtnl == NULL || links == NULL)
+		return;
+
+	__ofono_modemwatch_remove(modemwatch_id);
+
+	route_clear();
+
+	l_queue_destroy(links, link_free);
+	links = NULL;
+
+	l_timeout_remove(hold_timeout);
+	hold_timeout = NULL;
+
+	l_idle_remove(evaluate_idle);
+	evaluate_idle = NULL;
+
+	g_dbus_unregister_interface(conn, OFONO_MANAGER_PATH,
+					OFONO_DATA_FAILOVER_INTERFACE);
+
+	l_netlink_destroy(rtnl);
+	rtnl = NULL;
+
+	l_strv_free(policy_priority);
+	policy_priority = NULL;
+}
+
+OFONO_MODULE(failover, failover_init, failover_exit)
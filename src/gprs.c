@@ -14,10 +14,10 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <net/if.h>
-#include <net/route.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
@@ -43,8 +43,12 @@
 #define MAX_CONTEXT_NAME_LENGTH 127
 #define MAX_MESSAGE_PROXY_LENGTH 255
 #define MAX_MESSAGE_CENTER_LENGTH 255
+#define DEFAULT_MAX_PARALLEL 4
+#define DEFAULT_STATS_INTERVAL 10
+
 #define MAX_CONTEXTS 256
 #define SUSPEND_TIMEOUT 8
+#define REATTACH_TIMEOUT 30
 
 struct ofono_gprs {
 	GSList *contexts;
@@ -64,9 +68,15 @@ struct ofono_gprs {
 	struct ofono_netreg *netreg;
 	unsigned int netreg_watch;
 	unsigned int status_watch;
+	struct ofono_watchlist *link_watches;
 	GKeyFile *settings;
 	char *imsi;
 	DBusMessage *pending;
+	struct context_batch *batch;
+	unsigned int max_parallel;
+	guint stats_timeout;
+	unsigned int stats_interval;
+	unsigned int stats_dump_id;
 	GSList *context_drivers;
 	const struct ofono_gprs_driver *driver;
 	void *driver_data;
@@ -74,6 +84,21 @@ struct ofono_gprs {
 	unsigned int spn_watch;
 };
 
+enum context_stat {
+	STAT_RX_BYTES = 0,
+	STAT_TX_BYTES,
+	STAT_RX_PACKETS,
+	STAT_TX_PACKETS,
+	STAT_COUNT,
+};
+
+static const char *stat_names[] = {
+	[STAT_RX_BYTES] = "RxBytes",
+	[STAT_TX_BYTES] = "TxBytes",
+	[STAT_RX_PACKETS] = "RxPackets",
+	[STAT_TX_PACKETS] = "TxPackets",
+};
+
 struct ipv4_settings {
 	ofono_bool_t static_ip;
 	char *ip;
@@ -93,6 +118,7 @@ struct ipv6_settings {
 struct context_settings {
 	struct ipv4_settings *ipv4;
 	struct ipv6_settings *ipv6;
+	enum ofono_gprs_context_data_path data_path;
 };
 
 struct ofono_gprs_context {
@@ -102,6 +128,8 @@ struct ofono_gprs_context {
 	const struct ofono_gprs_context_driver *driver;
 	void *driver_data;
 	char *interface;
+	int ifindex;
+	char *address;
 	struct context_settings *settings;
 	struct ofono_atom *atom;
 };
@@ -121,11 +149,38 @@ struct pri_context {
 	struct ofono_gprs_primary_context context;
 	struct ofono_gprs_context *context_driver;
 	struct ofono_gprs *gprs;
+	uint64_t stats[STAT_COUNT];
+	uint64_t stats_base[STAT_COUNT];
+	uint64_t stats_session[STAT_COUNT];
+	int stats_ifindex;
+	bool stats_have_base;
+	bool stats_changed;
+	struct l_queue *stats_reads;
+	struct ofono_gprs_context *reattach_gc;
+	struct context_settings reattach_settings;
+	guint reattach_timeout;
+	bool user_inactive;	/* Last switched off over D-Bus */
+};
+
+/*
+ * ActivateContexts and DeactivateAll work through a queue of contexts,
+ * keeping up to max_parallel driver requests in flight.  The method call
+ * is answered once the queue is drained and nothing is running.
+ */
+struct context_batch {
+	GSList *queue;
+	unsigned int running;
+	bool activate;
+	bool starting;
+	bool failed;
 };
 
 static void gprs_attached_update(struct ofono_gprs *gprs);
 static void gprs_netreg_update(struct ofono_gprs *gprs);
-static void gprs_deactivate_next(struct ofono_gprs *gprs);
+static void link_watches_notify(struct ofono_gprs *gprs);
+static void batch_next(struct ofono_gprs *gprs);
+static void stats_stop(struct pri_context *ctx);
+static void reattach_flush(struct pri_context *ctx, bool signal);
 
 const char *packet_bearer_to_string(int bearer)
 {
@@ -250,6 +305,7 @@ static gboolean assign_context(struct pri_context *ctx, unsigned int use_cid)
 {
 	struct l_uintset *used_cids = ctx->gprs->used_cids;
 	struct ofono_gprs_context *gc;
+	GSList *l;
 
 	if (used_cids == NULL)
 		return FALSE;
@@ -264,11 +320,21 @@ static gboolean assign_context(struct pri_context *ctx, unsigned int use_cid)
 	if (gc == NULL)
 		return FALSE;
 
+	/* The link may still be set up for another context */
+	for (l = ctx->gprs->contexts; l; l = l->next) {
+		struct pri_context *other = l->data;
+
+		if (other != ctx && other->reattach_gc == gc)
+			reattach_flush(other, true);
+	}
+
 	l_uintset_put(used_cids, use_cid);
 	ctx->context.cid = use_cid;
 
 	ctx->context_driver = gc;
 	ctx->context_driver->inuse = TRUE;
+	__ofono_dbus_invalidate_reply(ctx->path,
+					OFONO_CONNECTION_CONTEXT_INTERFACE);
 
 	if (ctx->context.proto == OFONO_GPRS_PROTO_IPV4V6 ||
 			ctx->context.proto == OFONO_GPRS_PROTO_IP)
@@ -286,11 +352,18 @@ static void release_context(struct pri_context *ctx)
 	if (ctx == NULL || ctx->gprs == NULL || ctx->context_driver == NULL)
 		return;
 
+	stats_stop(ctx);
+
 	l_uintset_take(ctx->gprs->used_cids, ctx->context.cid);
 	ctx->context.cid = 0;
 	ctx->context_driver->inuse = FALSE;
 	ctx->context_driver = NULL;
 	ctx->active = FALSE;
+	__ofono_dbus_invalidate_reply(ctx->path,
+					OFONO_CONNECTION_CONTEXT_INTERFACE);
+
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_INTERNET)
+		link_watches_notify(ctx->gprs);
 }
 
 static struct pri_context *gprs_context_by_path(struct ofono_gprs *gprs,
@@ -331,6 +404,19 @@ static void context_settings_free(struct context_settings *settings)
 	}
 }
 
+static const char *gprs_data_path_to_string(
+				enum ofono_gprs_context_data_path data_path)
+{
+	switch (data_path) {
+	case OFONO_GPRS_CONTEXT_DATA_PATH_NETDEV:
+		return "netdev";
+	case OFONO_GPRS_CONTEXT_DATA_PATH_PPP:
+		return "ppp";
+	}
+
+	return NULL;
+}
+
 static void context_settings_append_ipv4(struct context_settings *settings,
 						const char *interface,
 						DBusMessageIter *iter)
@@ -340,6 +426,7 @@ static void context_settings_append_ipv4(struct context_settings *settings,
 	char typesig[5];
 	char arraysig[6];
 	const char *method;
+	const char *data_path;
 
 	arraysig[0] = DBUS_TYPE_ARRAY;
 	arraysig[1] = typesig[0] = DBUS_DICT_ENTRY_BEGIN_CHAR;
@@ -359,6 +446,10 @@ static void context_settings_append_ipv4(struct context_settings *settings,
 	ofono_dbus_dict_append(&array, "Interface",
 				DBUS_TYPE_STRING, &interface);
 
+	data_path = gprs_data_path_to_string(settings->data_path);
+	ofono_dbus_dict_append(&array, "DataPath", DBUS_TYPE_STRING,
+				&data_path);
+
 	/* If we have a Proxy, no other settings are relevant */
 	if (settings->ipv4->proxy) {
 		ofono_dbus_dict_append(&array, "Proxy", DBUS_TYPE_STRING,
@@ -421,6 +512,7 @@ static void context_settings_append_ipv6(struct context_settings *settings,
 	DBusMessageIter array;
 	char typesig[5];
 	char arraysig[6];
+	const char *data_path;
 
 	arraysig[0] = DBUS_TYPE_ARRAY;
 	arraysig[1] = typesig[0] = DBUS_DICT_ENTRY_BEGIN_CHAR;
@@ -440,6 +532,10 @@ static void context_settings_append_ipv6(struct context_settings *settings,
 	ofono_dbus_dict_append(&array, "Interface",
 				DBUS_TYPE_STRING, &interface);
 
+	data_path = gprs_data_path_to_string(settings->data_path);
+	ofono_dbus_dict_append(&array, "DataPath", DBUS_TYPE_STRING,
+				&data_path);
+
 	if (settings->ipv6->ip)
 		ofono_dbus_dict_append(&array, "Address", DBUS_TYPE_STRING,
 					&settings->ipv6->ip);
@@ -492,6 +588,8 @@ static void signal_settings(struct pri_context *ctx, const char *prop,
 	struct context_settings *settings;
 	const char *interface;
 
+	__ofono_dbus_invalidate_reply(path, OFONO_CONNECTION_CONTEXT_INTERFACE);
+
 	signal = dbus_message_new_signal(path,
 					OFONO_CONNECTION_CONTEXT_INTERFACE,
 					"PropertyChanged");
@@ -573,152 +671,633 @@ static void pri_parse_proxy(struct pri_context *ctx, const char *proxy)
 	l_free(scheme);
 }
 
-static void pri_ifupdown(const char *interface, ofono_bool_t active)
+/*
+ * Interface configuration goes out over rtnetlink without waiting for
+ * the kernel.  Requests issued back to back for a context, link state,
+ * address and proxy route, are queued on the same socket and processed
+ * in order.
+ */
+static struct l_netlink *rtnl;
+
+static void rtnl_result(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	const char *what = user_data;
+
+	if (error < 0)
+		ofono_error("%s: %s (%d)", what, strerror(-error), -error);
+}
+
+static int context_ifindex(struct ofono_gprs_context *gc)
+{
+	if (gc->interface == NULL || rtnl == NULL)
+		return 0;
+
+	if (gc->ifindex == 0)
+		gc->ifindex = if_nametoindex(gc->interface);
+
+	return gc->ifindex;
+}
+
+static void pri_ifupdown(struct ofono_gprs_context *gc, ofono_bool_t active)
 {
-	struct ifreq ifr;
-	int sk;
+	int ifindex = context_ifindex(gc);
 
-	if (interface == NULL)
+	if (ifindex == 0)
 		return;
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
+	if (!l_rtnl_set_powered(rtnl, ifindex, active, rtnl_result,
+				"Failed to change interface flags", NULL))
+		ofono_error("Failed to change interface flags");
+}
+
+static void pri_set_ipv4_addr(struct ofono_gprs_context *gc,
+						const char *address)
+{
+	int ifindex = context_ifindex(gc);
+
+	if (ifindex == 0)
 		return;
 
-	memset(&ifr, 0, sizeof(ifr));
-	l_strlcpy(ifr.ifr_name, interface, IFNAMSIZ);
+	if (gc->address) {
+		l_rtnl_ifaddr4_delete(rtnl, ifindex, 32, gc->address, NULL,
+					rtnl_result,
+					"Failed to remove interface address",
+					NULL);
+		l_free(gc->address);
+		gc->address = NULL;
+	}
 
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
+	if (address == NULL)
+		return;
 
-	if (active == TRUE) {
-		if (ifr.ifr_flags & IFF_UP)
-			goto done;
-		ifr.ifr_flags |= IFF_UP;
-	} else {
-		if (!(ifr.ifr_flags & IFF_UP))
-			goto done;
-		ifr.ifr_flags &= ~IFF_UP;
+	if (!l_rtnl_ifaddr4_add(rtnl, ifindex, 32, address, NULL,
+				rtnl_result, "Failed to set interface address",
+				NULL)) {
+		ofono_error("Failed to set interface address");
+		return;
 	}
 
-	if (ioctl(sk, SIOCSIFFLAGS, &ifr) < 0)
-		ofono_error("Failed to change interface flags");
+	gc->address = l_strdup(address);
+}
 
-done:
-	close(sk);
+static void pri_setproxy(struct ofono_gprs_context *gc, const char *proxy)
+{
+	int ifindex = context_ifindex(gc);
+	struct l_rtnl_route *rt;
+
+	if (ifindex == 0)
+		return;
+
+	/* Host route on the link, the proxy is reached without gateway */
+	rt = l_rtnl_route_new_prefix(proxy, 32);
+	if (rt == NULL) {
+		ofono_error("Invalid proxy host %s", proxy);
+		return;
+	}
+
+	if (!l_rtnl_route_add(rtnl, ifindex, rt, rtnl_result,
+				"Failed to add proxy host route", NULL))
+		ofono_error("Failed to add proxy host route");
+
+	l_rtnl_route_free(rt);
+}
+
+/*
+ * Traffic counters come from the kernel statistics of the context
+ * interface.  The link counters seen at activation are the base of the
+ * session and the difference is added to the stored totals once the
+ * context goes away.  While contexts are up, a single link dump per
+ * interval refreshes all of them and Statistics is signalled only for
+ * those whose counters moved.
+ */
+struct stats_read {
+	struct pri_context *ctx;
+	uint64_t base[STAT_COUNT];
+	uint64_t session[STAT_COUNT];
+	bool final;
+	DBusMessage *msg;
+	unsigned int id;
+};
+
+static bool parse_link_stats(const void *data, uint32_t len,
+					int *out_ifindex, uint64_t *out)
+{
+	const struct ifinfomsg *ifi = data;
+	struct rtnl_link_stats64 st;
+	struct l_netlink_attr attr;
+	uint16_t rta_type;
+	uint16_t rta_len;
+	const void *rta_data;
+
+	if (l_netlink_attr_init(&attr, sizeof(struct ifinfomsg),
+							data, len) < 0)
+		return false;
+
+	while (!l_netlink_attr_next(&attr, &rta_type, &rta_len, &rta_data)) {
+		if (rta_type != IFLA_STATS64)
+			continue;
+
+		/* Older kernels send a shorter structure */
+		if (rta_len < 4 * sizeof(uint64_t))
+			return false;
+
+		/* The payload is only guaranteed to be 4 byte aligned */
+		memset(&st, 0, sizeof(st));
+		memcpy(&st, rta_data, MIN(rta_len, sizeof(st)));
+
+		out[STAT_RX_BYTES] = st.rx_bytes;
+		out[STAT_TX_BYTES] = st.tx_bytes;
+		out[STAT_RX_PACKETS] = st.rx_packets;
+		out[STAT_TX_PACKETS] = st.tx_packets;
+		*out_ifindex = ifi->ifi_index;
+
+		return true;
+	}
+
+	return false;
+}
+
+static void append_stats(struct pri_context *ctx, DBusMessageIter *iter)
+{
+	DBusMessageIter dict;
+	unsigned int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	for (i = 0; i < STAT_COUNT; i++) {
+		uint64_t value = ctx->stats[i] + ctx->stats_session[i];
+
+		ofono_dbus_dict_append(&dict, stat_names[i],
+					DBUS_TYPE_UINT64, &value);
+	}
+
+	dbus_message_iter_close_container(iter, &dict);
 }
 
-static void pri_set_ipv4_addr(const char *interface, const char *address)
+static void append_stats_variant(struct pri_context *ctx,
+					DBusMessageIter *iter)
 {
-	struct ifreq ifr;
-	struct sockaddr_in addr;
-	int sk;
+	DBusMessageIter variant;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT,
+					"a" OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&variant);
+	append_stats(ctx, &variant);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+static void signal_stats(struct pri_context *ctx)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *prop = "Statistics";
+	DBusMessage *signal;
+	DBusMessageIter iter;
+
+	ctx->stats_changed = false;
+
+	__ofono_dbus_invalidate_reply(ctx->path,
+					OFONO_CONNECTION_CONTEXT_INTERFACE);
 
-	if (interface == NULL)
+	signal = dbus_message_new_signal(ctx->path,
+					OFONO_CONNECTION_CONTEXT_INTERFACE,
+					"PropertyChanged");
+	if (signal == NULL)
 		return;
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &prop);
+	append_stats_variant(ctx, &iter);
+
+	g_dbus_send_message(conn, signal);
+}
+
+static void stats_store(struct pri_context *ctx)
+{
+	GKeyFile *settings = ctx->gprs->settings;
+	unsigned int i;
+
+	if (settings == NULL)
 		return;
 
-	memset(&ifr, 0, sizeof(ifr));
-	l_strlcpy(ifr.ifr_name, interface, IFNAMSIZ);
+	for (i = 0; i < STAT_COUNT; i++)
+		g_key_file_set_uint64(settings, ctx->key, stat_names[i],
+					ctx->stats[i] + ctx->stats_session[i]);
 
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
+	storage_sync(ctx->gprs->imsi, SETTINGS_STORE, settings);
+}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = address ? inet_addr(address) : INADDR_ANY;
-	memcpy(&ifr.ifr_addr, &addr, sizeof(ifr.ifr_addr));
+/* Counters going backwards mean the link was recreated, keep what we had */
+static void stats_update(struct pri_context *ctx, const uint64_t *sample)
+{
+	unsigned int i;
 
-	if (ioctl(sk, SIOCSIFADDR, &ifr) < 0) {
-		ofono_error("Failed to set interface address");
-		goto done;
+	if (!ctx->stats_have_base) {
+		memcpy(ctx->stats_base, sample, sizeof(ctx->stats_base));
+		ctx->stats_have_base = true;
+		return;
 	}
 
-	if (address == NULL)
-		goto done;
+	for (i = 0; i < STAT_COUNT; i++) {
+		uint64_t delta;
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr("255.255.255.255");
-	memcpy(&ifr.ifr_netmask, &addr, sizeof(ifr.ifr_netmask));
+		if (sample[i] < ctx->stats_base[i])
+			continue;
 
-	if (ioctl(sk, SIOCSIFNETMASK, &ifr) < 0)
-		ofono_error("Failed to set interface netmask");
+		delta = sample[i] - ctx->stats_base[i];
+		if (delta == ctx->stats_session[i])
+			continue;
 
-done:
-	close(sk);
+		ctx->stats_session[i] = delta;
+		ctx->stats_changed = true;
+	}
 }
 
-static void pri_setproxy(const char *interface, const char *proxy)
+static void stats_dump_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
 {
-	struct rtentry rt;
-	struct sockaddr_in addr;
-	int sk;
+	struct ofono_gprs *gprs = user_data;
+	uint64_t sample[STAT_COUNT];
+	int ifindex;
+	GSList *l;
 
-	if (interface == NULL)
+	if (error || type != RTM_NEWLINK)
 		return;
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
+	if (!parse_link_stats(data, len, &ifindex, sample))
 		return;
 
-	memset(&rt, 0, sizeof(rt));
-	rt.rt_flags = RTF_UP | RTF_HOST;
-	rt.rt_dev = (char *) interface;
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr(proxy);
-	memcpy(&rt.rt_dst, &addr, sizeof(rt.rt_dst));
+		if (ctx->stats_ifindex == ifindex)
+			stats_update(ctx, sample);
+	}
+}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	memcpy(&rt.rt_gateway, &addr, sizeof(rt.rt_gateway));
+static void stats_dump_destroy(void *user_data)
+{
+	struct ofono_gprs *gprs = user_data;
+	GSList *l;
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	memcpy(&rt.rt_genmask, &addr, sizeof(rt.rt_genmask));
+	gprs->stats_dump_id = 0;
 
-	if (ioctl(sk, SIOCADDRT, &rt) < 0)
-		ofono_error("Failed to add proxy host route");
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
 
-	close(sk);
+		if (ctx->stats_changed)
+			signal_stats(ctx);
+	}
+}
+
+static void stats_poll(struct ofono_gprs *gprs)
+{
+	struct l_netlink_message *nlm;
+	struct ifinfomsg ifi;
+
+	if (rtnl == NULL || gprs->stats_dump_id)
+		return;
+
+	nlm = l_netlink_message_new_sized(RTM_GETLINK, NLM_F_DUMP,
+						sizeof(ifi));
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
+
+	gprs->stats_dump_id = l_netlink_send(rtnl, nlm, stats_dump_cb, gprs,
+						stats_dump_destroy);
+	if (!gprs->stats_dump_id)
+		l_netlink_message_unref(nlm);
+}
+
+static gboolean stats_timeout(gpointer user_data)
+{
+	struct ofono_gprs *gprs = user_data;
+	GSList *l;
+
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
+
+		if (ctx->stats_ifindex)
+			break;
+	}
+
+	if (l == NULL) {
+		gprs->stats_timeout = 0;
+		return FALSE;
+	}
+
+	stats_poll(gprs);
+
+	return TRUE;
+}
+
+static void stats_read_cb(int error, uint16_t type, const void *data,
+					uint32_t len, void *user_data)
+{
+	struct stats_read *read = user_data;
+	struct pri_context *ctx = read->ctx;
+	uint64_t sample[STAT_COUNT];
+	int ifindex;
+	unsigned int i;
+
+	if (error || type != RTM_NEWLINK)
+		return;
+
+	if (!parse_link_stats(data, len, &ifindex, sample))
+		return;
+
+	if (!read->final) {
+		stats_update(ctx, sample);
+		return;
+	}
+
+	/* The session so far was already folded into the totals */
+	for (i = 0; i < STAT_COUNT; i++) {
+		uint64_t end = read->base[i] + read->session[i];
+
+		if (sample[i] <= end)
+			continue;
+
+		ctx->stats[i] += sample[i] - end;
+		ctx->stats_changed = true;
+	}
+}
+
+static void stats_read_destroy(void *user_data)
+{
+	struct stats_read *read = user_data;
+	struct pri_context *ctx = read->ctx;
+
+	l_queue_remove(ctx->stats_reads, read);
+
+	if (read->msg) {
+		DBusMessage *reply = dbus_message_new_method_return(read->msg);
+		DBusMessageIter iter;
+
+		dbus_message_iter_init_append(reply, &iter);
+		append_stats(ctx, &iter);
+		__ofono_dbus_pending_reply(&read->msg, reply);
+	}
+
+	/* Skip the store while the context itself is being torn down */
+	if (read->final && ctx->stats_reads) {
+		stats_store(ctx);
+
+		if (ctx->stats_changed)
+			signal_stats(ctx);
+	}
+
+	l_free(read);
+}
+
+static bool stats_read(struct pri_context *ctx, int ifindex,
+					bool final, DBusMessage *msg)
+{
+	struct l_netlink_message *nlm;
+	struct stats_read *read;
+	struct ifinfomsg ifi;
+
+	if (rtnl == NULL)
+		return false;
+
+	nlm = l_netlink_message_new_sized(RTM_GETLINK, 0, sizeof(ifi));
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = ifindex;
+	l_netlink_message_add_header(nlm, &ifi, sizeof(ifi));
+
+	read = l_new(struct stats_read, 1);
+	read->ctx = ctx;
+	read->final = final;
+	memcpy(read->base, ctx->stats_base, sizeof(read->base));
+	memcpy(read->session, ctx->stats_session, sizeof(read->session));
+
+	read->id = l_netlink_send(rtnl, nlm, stats_read_cb, read,
+					stats_read_destroy);
+	if (!read->id) {
+		l_netlink_message_unref(nlm);
+		l_free(read);
+		return false;
+	}
+
+	if (msg)
+		read->msg = dbus_message_ref(msg);
+
+	if (ctx->stats_reads == NULL)
+		ctx->stats_reads = l_queue_new();
+
+	l_queue_push_tail(ctx->stats_reads, read);
+
+	return true;
+}
+
+static void stats_start(struct pri_context *ctx)
+{
+	struct ofono_gprs *gprs = ctx->gprs;
+	int ifindex = context_ifindex(ctx->context_driver);
+
+	if (ifindex == 0)
+		return;
+
+	ctx->stats_ifindex = ifindex;
+	ctx->stats_have_base = false;
+	memset(ctx->stats_session, 0, sizeof(ctx->stats_session));
+
+	/* Takes the base right away rather than one interval later */
+	stats_poll(gprs);
+
+	if (gprs->stats_timeout == 0 && gprs->stats_interval)
+		gprs->stats_timeout = g_timeout_add_seconds(
+						gprs->stats_interval,
+						stats_timeout, gprs);
+}
+
+static void stats_stop(struct pri_context *ctx)
+{
+	int ifindex = ctx->stats_ifindex;
+	bool pending;
+	unsigned int i;
+
+	if (ifindex == 0)
+		return;
+
+	ctx->stats_ifindex = 0;
+
+	/*
+	 * Fold what the last poll saw into the totals now and let the final
+	 * read add whatever went through the link since then.
+	 */
+	pending = ctx->stats_have_base &&
+			stats_read(ctx, ifindex, true, NULL);
+
+	for (i = 0; i < STAT_COUNT; i++)
+		ctx->stats[i] += ctx->stats_session[i];
+
+	memset(ctx->stats_session, 0, sizeof(ctx->stats_session));
+
+	if (!pending)
+		stats_store(ctx);
 }
 
 static void pri_reset_context_settings(struct pri_context *ctx)
 {
 	struct context_settings *settings;
-	const char *interface;
 	gboolean signal_ipv4;
 	gboolean signal_ipv6;
 
 	if (ctx->context_driver == NULL)
 		return;
 
-	interface = ctx->context_driver->interface;
 	settings = ctx->context_driver->settings;
 
-	signal_ipv4 = settings->ipv4 != NULL;
-	signal_ipv6 = settings->ipv6 != NULL;
+	signal_ipv4 = settings->ipv4 != NULL;
+	signal_ipv6 = settings->ipv6 != NULL;
+
+	context_settings_free(settings);
+
+	pri_context_signal_settings(ctx, signal_ipv4, signal_ipv6);
+
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS) {
+		pri_set_ipv4_addr(ctx->context_driver, NULL);
+
+		l_free(ctx->proxy_host);
+		ctx->proxy_host = NULL;
+		ctx->proxy_port = 0;
+	}
+
+	pri_ifupdown(ctx->context_driver, FALSE);
+}
+
+/*
+ * A context dropped by a detach usually comes back with the very same
+ * settings once the radio recovers.  Its settings are parked for a while
+ * with the interface left configured, so that a matching reactivation
+ * neither cycles the link nor signals Settings again.
+ */
+static bool ipv4_settings_equal(const struct ipv4_settings *a,
+					const struct ipv4_settings *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	/* The MMS proxy is derived locally, not reported by the driver */
+	return a->static_ip == b->static_ip && l_streq0(a->ip, b->ip) &&
+			l_streq0(a->netmask, b->netmask) &&
+			l_streq0(a->gateway, b->gateway) &&
+			l_strv_eq(a->dns, b->dns);
+}
+
+static bool ipv6_settings_equal(const struct ipv6_settings *a,
+					const struct ipv6_settings *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	return a->prefix_len == b->prefix_len && l_streq0(a->ip, b->ip) &&
+			l_streq0(a->gateway, b->gateway) &&
+			l_strv_eq(a->dns, b->dns);
+}
+
+static void reattach_flush(struct pri_context *ctx, bool signal)
+{
+	struct ofono_gprs_context *gc = ctx->reattach_gc;
+	struct context_settings *settings = &ctx->reattach_settings;
+	gboolean signal_ipv4 = settings->ipv4 != NULL;
+	gboolean signal_ipv6 = settings->ipv6 != NULL;
+
+	if (gc == NULL)
+		return;
+
+	ctx->reattach_gc = NULL;
+
+	if (ctx->reattach_timeout) {
+		g_source_remove(ctx->reattach_timeout);
+		ctx->reattach_timeout = 0;
+	}
+
+	context_settings_free(settings);
+
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS) {
+		pri_set_ipv4_addr(gc, NULL);
+
+		l_free(ctx->proxy_host);
+		ctx->proxy_host = NULL;
+		ctx->proxy_port = 0;
+	}
+
+	pri_ifupdown(gc, FALSE);
+
+	if (signal)
+		pri_context_signal_settings(ctx, signal_ipv4, signal_ipv6);
+}
+
+static gboolean reattach_timeout(gpointer user_data)
+{
+	struct pri_context *ctx = user_data;
+
+	ctx->reattach_timeout = 0;
+	reattach_flush(ctx, true);
+
+	return FALSE;
+}
+
+static void pri_park_context_settings(struct pri_context *ctx)
+{
+	struct ofono_gprs_context *gc = ctx->context_driver;
+
+	if (gc->interface == NULL) {
+		pri_reset_context_settings(ctx);
+		return;
+	}
+
+	reattach_flush(ctx, false);
+
+	ctx->reattach_settings = *gc->settings;
+	memset(gc->settings, 0, sizeof(*gc->settings));
+
+	ctx->reattach_gc = gc;
+	ctx->reattach_timeout = g_timeout_add_seconds(REATTACH_TIMEOUT,
+							reattach_timeout, ctx);
+}
+
+/*
+ * Takes the parked settings back when the driver reports the same ones,
+ * in which case the interface is still set up.  Otherwise the old
+ * configuration is torn down without signalling, the new settings are
+ * about to be signalled anyway.
+ */
+static bool pri_reattach_context_settings(struct pri_context *ctx)
+{
+	struct ofono_gprs_context *gc = ctx->context_driver;
+	struct context_settings *settings = gc->settings;
+	struct context_settings *parked = &ctx->reattach_settings;
+
+	if (ctx->reattach_gc == NULL)
+		return false;
 
-	context_settings_free(settings);
+	if (ctx->reattach_gc != gc ||
+			!ipv4_settings_equal(parked->ipv4, settings->ipv4) ||
+			!ipv6_settings_equal(parked->ipv6, settings->ipv6)) {
+		reattach_flush(ctx, false);
+		return false;
+	}
 
-	pri_context_signal_settings(ctx, signal_ipv4, signal_ipv6);
+	DBG("%p kept settings of %s", ctx, gc->interface);
 
-	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS) {
-		pri_set_ipv4_addr(interface, NULL);
+	context_settings_free(settings);
+	*settings = *parked;
+	memset(parked, 0, sizeof(*parked));
 
-		l_free(ctx->proxy_host);
-		ctx->proxy_host = NULL;
-		ctx->proxy_port = 0;
-	}
+	ctx->reattach_gc = NULL;
+	g_source_remove(ctx->reattach_timeout);
+	ctx->reattach_timeout = 0;
 
-	pri_ifupdown(interface, FALSE);
+	return true;
 }
 
 static void pri_update_mms_context_settings(struct pri_context *ctx)
@@ -731,10 +1310,10 @@ static void pri_update_mms_context_settings(struct pri_context *ctx)
 
 	DBG("proxy %s port %u", ctx->proxy_host, ctx->proxy_port);
 
-	pri_set_ipv4_addr(gc->interface, settings->ipv4->ip);
+	pri_set_ipv4_addr(gc, settings->ipv4->ip);
 
 	if (ctx->proxy_host)
-		pri_setproxy(gc->interface, ctx->proxy_host);
+		pri_setproxy(gc, ctx->proxy_host);
 }
 
 static void append_context_properties(struct pri_context *ctx,
@@ -747,6 +1326,8 @@ static void append_context_properties(struct pri_context *ctx,
 	const char *strvalue;
 	struct context_settings *settings;
 	const char *interface;
+	const char *stats = "Statistics";
+	DBusMessageIter entry;
 
 	ofono_dbus_dict_append(dict, "Name", DBUS_TYPE_STRING, &name);
 
@@ -793,6 +1374,12 @@ static void append_context_properties(struct pri_context *ctx,
 
 	context_settings_append_ipv4_dict(settings, interface, dict);
 	context_settings_append_ipv6_dict(settings, interface, dict);
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &stats);
+	append_stats_variant(ctx, &entry);
+	dbus_message_iter_close_container(dict, &entry);
 }
 
 static DBusMessage *pri_get_properties(DBusConnection *conn,
@@ -803,6 +1390,10 @@ static DBusMessage *pri_get_properties(DBusConnection *conn,
 	DBusMessageIter iter;
 	DBusMessageIter dict;
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -815,6 +1406,28 @@ static DBusMessage *pri_get_properties(DBusConnection *conn,
 	append_context_properties(ctx, &dict);
 	dbus_message_iter_close_container(&iter, &dict);
 
+	return __ofono_dbus_cache_reply(msg, reply);
+}
+
+static DBusMessage *pri_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct pri_context *ctx = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+
+	/* A counting context is sampled afresh, the reply follows the read */
+	if (ctx->stats_ifindex && ctx->stats_have_base &&
+			stats_read(ctx, ctx->stats_ifindex, false, msg))
+		return NULL;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	append_stats(ctx, &iter);
+
 	return reply;
 }
 
@@ -830,19 +1443,24 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Activating context failed with error: %s",
 				telephony_error_to_str(error));
-		__ofono_dbus_pending_reply(&ctx->pending,
+
+		if (ctx->pending)
+			__ofono_dbus_pending_reply(&ctx->pending,
 					__ofono_error_failed(ctx->pending));
+
 		context_settings_free(ctx->context_driver->settings);
 		release_context(ctx);
 		return;
 	}
 
 	ctx->active = TRUE;
-	__ofono_dbus_pending_reply(&ctx->pending,
+
+	if (ctx->pending)
+		__ofono_dbus_pending_reply(&ctx->pending,
 				dbus_message_new_method_return(ctx->pending));
 
-	if (gc->interface != NULL) {
-		pri_ifupdown(gc->interface, TRUE);
+	if (gc->interface != NULL && !pri_reattach_context_settings(ctx)) {
+		pri_ifupdown(gc, TRUE);
 
 		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS &&
 				gc->settings->ipv4)
@@ -852,6 +1470,12 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 						gc->settings->ipv6 != NULL);
 	}
 
+	if (gc->interface != NULL)
+		stats_start(ctx);
+
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_INTERNET)
+		link_watches_notify(ctx->gprs);
+
 	value = ctx->active;
 	ofono_dbus_signal_property_changed(conn, ctx->path,
 					OFONO_CONNECTION_CONTEXT_INTERFACE,
@@ -910,6 +1534,8 @@ static void gprs_set_attached_property(struct ofono_gprs *gprs,
 	ofono_dbus_signal_property_changed(conn, path,
 				OFONO_CONNECTION_MANAGER_INTERFACE,
 				"Attached", DBUS_TYPE_BOOLEAN, &value);
+
+	link_watches_notify(gprs);
 }
 
 static void pri_read_settings_callback(const struct ofono_error *error,
@@ -932,17 +1558,23 @@ static void pri_read_settings_callback(const struct ofono_error *error,
 
 	pri_ctx->active = TRUE;
 
-	if (gc->interface != NULL) {
-		pri_ifupdown(gc->interface, TRUE);
+	if (gc->interface != NULL && !pri_reattach_context_settings(pri_ctx)) {
+		pri_ifupdown(gc, TRUE);
 
 		pri_context_signal_settings(pri_ctx, gc->settings->ipv4 != NULL,
 						gc->settings->ipv6 != NULL);
 	}
 
+	if (gc->interface != NULL)
+		stats_start(pri_ctx);
+
 	value = pri_ctx->active;
 
 	gprs_set_attached_property(pri_ctx->gprs, TRUE);
 
+	if (pri_ctx->type == OFONO_GPRS_CONTEXT_TYPE_INTERNET)
+		link_watches_notify(pri_ctx->gprs);
+
 	ofono_dbus_signal_property_changed(conn, pri_ctx->path,
 					OFONO_CONNECTION_CONTEXT_INTERFACE,
 					"Active", DBUS_TYPE_BOOLEAN, &value);
@@ -1249,6 +1881,8 @@ static DBusMessage *pri_set_property(DBusConnection *conn,
 
 		dbus_message_iter_get_basic(&var, &value);
 
+		ctx->user_inactive = !value;
+
 		if (ctx->active == (ofono_bool_t) value)
 			return dbus_message_new_method_return(msg);
 
@@ -1359,6 +1993,9 @@ static const GDBusMethodTable context_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, pri_set_property) },
+	{ GDBUS_ASYNC_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			pri_get_statistics) },
 	{ }
 };
 
@@ -1395,6 +2032,20 @@ static struct pri_context *pri_context_create(struct ofono_gprs *gprs,
 static void pri_context_destroy(gpointer userdata)
 {
 	struct pri_context *ctx = userdata;
+	struct l_queue *reads = ctx->stats_reads;
+	const struct l_queue_entry *entry;
+
+	/* Pending reads still answer GetStatistics when cancelled */
+	ctx->stats_reads = NULL;
+	ctx->stats_changed = false;
+
+	for (entry = l_queue_get_entries(reads); entry; entry = entry->next) {
+		struct stats_read *read = entry->data;
+
+		l_netlink_cancel(rtnl, read->id);
+	}
+
+	l_queue_destroy(reads, NULL);
 
 	l_free(ctx->proxy_host);
 	l_free(ctx->path);
@@ -1434,18 +2085,21 @@ static gboolean context_dbus_unregister(struct pri_context *ctx)
 	char path[256];
 
 	if (ctx->active == TRUE) {
-		const char *interface =
-			ctx->context_driver->interface;
+		struct ofono_gprs_context *gc = ctx->context_driver;
 
 		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-			pri_set_ipv4_addr(interface, NULL);
+			pri_set_ipv4_addr(gc, NULL);
 
-		pri_ifupdown(interface, FALSE);
+		pri_ifupdown(gc, FALSE);
 	}
 
+	reattach_flush(ctx, false);
+
 	strcpy(path, ctx->path);
 	l_uintset_take(ctx->gprs->used_pids, ctx->id);
 
+	__ofono_dbus_invalidate_reply(path, OFONO_CONNECTION_CONTEXT_INTERFACE);
+
 	return g_dbus_unregister_interface(conn, path,
 					OFONO_CONNECTION_CONTEXT_INTERFACE);
 }
@@ -1510,6 +2164,136 @@ void ofono_gprs_resume_notify(struct ofono_gprs *gprs)
 	update_suspended_property(gprs, FALSE);
 }
 
+static void get_link(struct ofono_gprs *gprs, const char **interface,
+						const char **gateway)
+{
+	GSList *l;
+
+	*interface = NULL;
+	*gateway = NULL;
+
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
+		struct ofono_gprs_context *gc = ctx->context_driver;
+
+		if (ctx->type != OFONO_GPRS_CONTEXT_TYPE_INTERNET)
+			continue;
+
+		if (ctx->active == FALSE || gc == NULL || gc->interface == NULL)
+			continue;
+
+		*interface = gc->interface;
+
+		if (gc->settings->ipv4)
+			*gateway = gc->settings->ipv4->gateway;
+
+		return;
+	}
+}
+
+static void link_watches_notify(struct ofono_gprs *gprs)
+{
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+	const char *interface;
+	const char *gateway;
+
+	if (gprs == NULL || gprs->link_watches == NULL)
+		return;
+
+	get_link(gprs, &interface, &gateway);
+
+	__ofono_watchlist_iter_init(&iter, gprs->link_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		ofono_gprs_link_notify_cb_t notify = item->notify;
+
+		notify(gprs->attached, interface, gateway, item->notify_data);
+	}
+}
+
+unsigned int __ofono_gprs_add_link_watch(struct ofono_gprs *gprs,
+				ofono_gprs_link_notify_cb_t notify,
+				void *data, ofono_destroy_func destroy)
+{
+	struct ofono_watchlist_item *item;
+	const char *interface;
+	const char *gateway;
+	unsigned int id;
+
+	DBG("%p", gprs);
+
+	if (gprs == NULL || gprs->link_watches == NULL || notify == NULL)
+		return 0;
+
+	item = g_new0(struct ofono_watchlist_item, 1);
+
+	item->notify = notify;
+	item->destroy = destroy;
+	item->notify_data = data;
+
+	id = __ofono_watchlist_add_item(gprs->link_watches, item);
+
+	get_link(gprs, &interface, &gateway);
+	notify(gprs->attached, interface, gateway, data);
+
+	return id;
+}
+
+gboolean __ofono_gprs_remove_link_watch(struct ofono_gprs *gprs,
+					unsigned int id)
+{
+	DBG("%p", gprs);
+
+	return __ofono_watchlist_remove_item(gprs->link_watches, id);
+}
+
+/*
+ * Brings up the first internet context without a D-Bus caller, as the
+ * Active property would.  A context the user switched off stays off.
+ * Returns TRUE only if an activation was started.
+ */
+ofono_bool_t __ofono_gprs_activate_internet(struct ofono_gprs *gprs)
+{
+	struct pri_context *ctx = NULL;
+	struct ofono_gprs_context *gc;
+	GSList *l;
+
+	if (!gprs->attached || gprs->pending)
+		return FALSE;
+
+	if (gprs->flags & GPRS_FLAG_ATTACHING)
+		return FALSE;
+
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *pri_ctx = l->data;
+
+		if (pri_ctx->type != OFONO_GPRS_CONTEXT_TYPE_INTERNET)
+			continue;
+
+		/* Already up, or on its way up or down */
+		if (pri_ctx->context_driver || pri_ctx->pending)
+			return FALSE;
+
+		if (pri_ctx->user_inactive)
+			continue;
+
+		if (ctx == NULL)
+			ctx = pri_ctx;
+	}
+
+	if (ctx == NULL || assign_context(ctx, 0) == FALSE)
+		return FALSE;
+
+	DBG("%s", ctx->path);
+
+	gc = ctx->context_driver;
+	gc->driver->activate_primary(gc, &ctx->context,
+					pri_activate_callback, ctx);
+
+	return TRUE;
+}
+
 static gboolean have_active_contexts(struct ofono_gprs *gprs)
 {
 	GSList *l;
@@ -1595,8 +2379,8 @@ static void detach_active_contexts(struct ofono_gprs *gprs)
 		if (gc->driver->detach_shutdown != NULL)
 			gc->driver->detach_shutdown(gc, ctx->context.cid);
 
-		/* Make sure the context is properly cleared */
-		pri_reset_context_settings(ctx);
+		/* Keep the link configured in case the context comes back */
+		pri_park_context_settings(ctx);
 		release_context(ctx);
 		pri_context_signal_active(ctx);
 	}
@@ -2010,6 +2794,7 @@ static struct pri_context *add_context(struct ofono_gprs *gprs,
 	if (gprs->settings) {
 		write_context_settings(gprs, context);
 		storage_sync(gprs->imsi, SETTINGS_STORE, gprs->settings);
+		storage_flush(gprs->settings);
 	}
 
 	gprs->contexts = g_slist_append(gprs->contexts, context);
@@ -2180,6 +2965,7 @@ static void gprs_deactivate_for_remove(const struct ofono_error *error,
 	if (gprs->settings) {
 		g_key_file_remove_group(gprs->settings, ctx->key, NULL);
 		storage_sync(gprs->imsi, SETTINGS_STORE, gprs->settings);
+		storage_flush(gprs->settings);
 	}
 
 	/* Make a backup copy of path for signal emission below */
@@ -2236,6 +3022,7 @@ static DBusMessage *gprs_remove_context(DBusConnection *conn,
 	if (gprs->settings) {
 		g_key_file_remove_group(gprs->settings, ctx->key, NULL);
 		storage_sync(gprs->imsi, SETTINGS_STORE, gprs->settings);
+		storage_flush(gprs->settings);
 	}
 
 	DBG("Unregistering context: %s", ctx->path);
@@ -2252,46 +3039,125 @@ static DBusMessage *gprs_remove_context(DBusConnection *conn,
 	return NULL;
 }
 
-static void gprs_deactivate_for_all(const struct ofono_error *error,
+static void batch_done_one(struct ofono_gprs *gprs,
+					const struct ofono_error *error)
+{
+	struct context_batch *batch = gprs->batch;
+
+	if (batch == NULL)
+		return;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		batch->failed = true;
+
+	batch->running -= 1;
+
+	/* Drivers may complete synchronously while the batch is starting */
+	if (!batch->starting)
+		batch_next(gprs);
+}
+
+static void batch_activate_callback(const struct ofono_error *error,
 					void *data)
 {
 	struct pri_context *ctx = data;
-	struct ofono_gprs *gprs = ctx->gprs;
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		__ofono_dbus_pending_reply(&gprs->pending,
-					__ofono_error_failed(gprs->pending));
-		return;
-	}
+	pri_activate_callback(error, ctx);
+	batch_done_one(ctx->gprs, error);
+}
 
-	pri_reset_context_settings(ctx);
-	release_context(ctx);
-	pri_context_signal_active(ctx);
+static void batch_deactivate_callback(const struct ofono_error *error,
+					void *data)
+{
+	struct pri_context *ctx = data;
+
+	if (error->type == OFONO_ERROR_TYPE_NO_ERROR) {
+		pri_reset_context_settings(ctx);
+		release_context(ctx);
+		pri_context_signal_active(ctx);
+	}
 
-	gprs_deactivate_next(gprs);
+	batch_done_one(ctx->gprs, error);
 }
 
-static void gprs_deactivate_next(struct ofono_gprs *gprs)
+static bool batch_start(struct ofono_gprs *gprs, struct pri_context *ctx)
 {
-	GSList *l;
-	struct pri_context *ctx;
+	struct context_batch *batch = gprs->batch;
 	struct ofono_gprs_context *gc;
 
-	for (l = gprs->contexts; l; l = l->next) {
-		ctx = l->data;
+	ctx->user_inactive = !batch->activate;
 
+	if (!batch->activate) {
 		if (ctx->active == FALSE)
-			continue;
+			return false;
 
 		gc = ctx->context_driver;
+		batch->running += 1;
 		gc->driver->deactivate_primary(gc, ctx->context.cid,
-					gprs_deactivate_for_all, ctx);
+					batch_deactivate_callback, ctx);
+		return true;
+	}
 
-		return;
+	if (ctx->active == TRUE)
+		return false;
+
+	if (!gprs->attached || assign_context(ctx, 0) == FALSE) {
+		batch->failed = true;
+		return false;
 	}
 
-	__ofono_dbus_pending_reply(&gprs->pending,
-				dbus_message_new_method_return(gprs->pending));
+	gc = ctx->context_driver;
+	batch->running += 1;
+	gc->driver->activate_primary(gc, &ctx->context,
+					batch_activate_callback, ctx);
+	return true;
+}
+
+static void batch_free(struct ofono_gprs *gprs)
+{
+	g_slist_free(gprs->batch->queue);
+	g_free(gprs->batch);
+	gprs->batch = NULL;
+}
+
+static void batch_next(struct ofono_gprs *gprs)
+{
+	struct context_batch *batch = gprs->batch;
+	DBusMessage *reply;
+
+	batch->starting = true;
+
+	while (batch->queue && batch->running < gprs->max_parallel) {
+		struct pri_context *ctx = batch->queue->data;
+
+		batch->queue = g_slist_delete_link(batch->queue, batch->queue);
+		batch_start(gprs, ctx);
+	}
+
+	batch->starting = false;
+
+	if (batch->running > 0)
+		return;
+
+	if (batch->failed)
+		reply = __ofono_error_failed(gprs->pending);
+	else
+		reply = dbus_message_new_method_return(gprs->pending);
+
+	batch_free(gprs);
+	__ofono_dbus_pending_reply(&gprs->pending, reply);
+}
+
+static void batch_run(struct ofono_gprs *gprs, DBusMessage *msg,
+					GSList *queue, bool activate)
+{
+	gprs->batch = g_new0(struct context_batch, 1);
+	gprs->batch->queue = queue;
+	gprs->batch->activate = activate;
+
+	gprs->pending = dbus_message_ref(msg);
+
+	batch_next(gprs);
 }
 
 static DBusMessage *gprs_deactivate_all(DBusConnection *conn,
@@ -2314,9 +3180,58 @@ static DBusMessage *gprs_deactivate_all(DBusConnection *conn,
 			return __ofono_error_busy(msg);
 	}
 
-	gprs->pending = dbus_message_ref(msg);
+	batch_run(gprs, msg, g_slist_copy(gprs->contexts), false);
+
+	return NULL;
+}
+
+static DBusMessage *gprs_activate_contexts(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_gprs *gprs = data;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GSList *queue = NULL;
+
+	if (gprs->pending)
+		return __ofono_error_busy(msg);
+
+	if (!gprs->attached)
+		return __ofono_error_not_attached(msg);
+
+	if (gprs->flags & GPRS_FLAG_ATTACHING)
+		return __ofono_error_attach_in_progress(msg);
 
-	gprs_deactivate_next(gprs);
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		struct pri_context *ctx;
+		const char *path;
+
+		dbus_message_iter_get_basic(&array, &path);
+
+		ctx = gprs_context_by_path(gprs, path);
+		if (ctx == NULL) {
+			g_slist_free(queue);
+			return __ofono_error_not_found(msg);
+		}
+
+		if (ctx->pending) {
+			g_slist_free(queue);
+			return __ofono_error_busy(msg);
+		}
+
+		if (!g_slist_find(queue, ctx))
+			queue = g_slist_append(queue, ctx);
+
+		dbus_message_iter_next(&array);
+	}
+
+	batch_run(gprs, msg, queue, true);
 
 	return NULL;
 }
@@ -2465,19 +3380,18 @@ static void provision_context(const struct provision_db_entry *ap,
 static void provision_contexts(struct ofono_gprs *gprs, const char *mcc,
 				const char *mnc, const char *spn)
 {
-	struct provision_db_entry *settings;
-	size_t count;
+	struct provision_db_result *settings;
 	size_t i;
 
-	if (!__ofono_provision_get_settings(mcc, mnc, spn, &settings, &count)) {
+	if (!__ofono_provision_get_settings(mcc, mnc, spn, &settings)) {
 		ofono_warn("Provisioning failed");
 		return;
 	}
 
-	for (i = 0; i < count; i++)
-		provision_context(&settings[i], gprs);
+	for (i = 0; i < settings->n_items; i++)
+		provision_context(&settings->items[i], gprs);
 
-	l_free(settings);
+	provision_db_result_unref(settings);
 }
 
 static void remove_non_active_context(struct ofono_gprs *gprs,
@@ -2584,6 +3498,9 @@ static const GDBusMethodTable manager_methods[] = {
 			gprs_remove_context) },
 	{ GDBUS_ASYNC_METHOD("DeactivateAll", NULL, NULL,
 			gprs_deactivate_all) },
+	{ GDBUS_ASYNC_METHOD("ActivateContexts",
+			GDBUS_ARGS({ "paths", "ao" }), NULL,
+			gprs_activate_contexts) },
 	{ GDBUS_METHOD("GetContexts", NULL,
 			GDBUS_ARGS({ "contexts_with_properties", "a(oa{sv})" }),
 			gprs_get_contexts) },
@@ -2688,6 +3605,13 @@ static void gprs_context_unregister(struct ofono_atom *atom)
 	if (gc->gprs == NULL)
 		goto done;
 
+	for (l = gc->gprs->contexts; l; l = l->next) {
+		ctx = l->data;
+
+		if (ctx->reattach_gc == gc)
+			reattach_flush(ctx, true);
+	}
+
 	for (l = gc->gprs->contexts; l; l = l->next) {
 		ctx = l->data;
 
@@ -2809,6 +3733,7 @@ static void gprs_context_remove(struct ofono_atom *atom)
 		gc->driver->remove(gc);
 
 	l_free(gc->interface);
+	l_free(gc->address);
 	g_free(gc);
 }
 
@@ -2867,6 +3792,15 @@ void ofono_gprs_context_set_interface(struct ofono_gprs_context *gc,
 {
 	l_free(gc->interface);
 	gc->interface = l_strdup(interface);
+	gc->ifindex = 0;
+}
+
+void ofono_gprs_context_set_data_path(struct ofono_gprs_context *gc,
+				enum ofono_gprs_context_data_path data_path)
+{
+	DBG("data path %d", data_path);
+
+	gc->settings->data_path = data_path;
 }
 
 void ofono_gprs_context_set_ipv4_address(struct ofono_gprs_context *gc,
@@ -2992,6 +3926,13 @@ static void free_contexts(struct ofono_gprs *gprs)
 	GSList *l;
 
 	if (gprs->settings) {
+		for (l = gprs->contexts; l; l = l->next) {
+			struct pri_context *context = l->data;
+
+			if (context->stats_ifindex)
+				stats_store(context);
+		}
+
 		storage_close(gprs->imsi, SETTINGS_STORE,
 				gprs->settings, TRUE);
 
@@ -3018,6 +3959,23 @@ static void gprs_unregister(struct ofono_atom *atom)
 
 	DBG("%p", gprs);
 
+	if (gprs->batch) {
+		batch_free(gprs);
+		__ofono_dbus_pending_reply(&gprs->pending,
+					__ofono_error_failed(gprs->pending));
+	}
+
+	if (gprs->stats_timeout) {
+		g_source_remove(gprs->stats_timeout);
+		gprs->stats_timeout = 0;
+	}
+
+	if (gprs->stats_dump_id)
+		l_netlink_cancel(rtnl, gprs->stats_dump_id);
+
+	__ofono_watchlist_free(gprs->link_watches);
+	gprs->link_watches = NULL;
+
 	free_contexts(gprs);
 
 	if (gprs->netreg_watch) {
@@ -3083,6 +4041,17 @@ OFONO_DEFINE_ATOM_CREATE(gprs, OFONO_ATOM_TYPE_GPRS, {
 	atom->netreg_status = -1;
 	atom->used_pids = l_uintset_new(MAX_CONTEXTS);
 	atom->used_cids = l_uintset_new_from_range(1, MAX_CONTEXTS - 1);
+
+	atom->max_parallel = DEFAULT_MAX_PARALLEL;
+	l_settings_get_uint(__ofono_get_config(), "ConnectionManager",
+				"MaxParallelActivations", &atom->max_parallel);
+
+	if (atom->max_parallel == 0)
+		atom->max_parallel = 1;
+
+	atom->stats_interval = DEFAULT_STATS_INTERVAL;
+	l_settings_get_uint(__ofono_get_config(), "ConnectionManager",
+				"StatisticsInterval", &atom->stats_interval);
 })
 
 static void netreg_watch(struct ofono_atom *atom,
@@ -3132,6 +4101,7 @@ static gboolean load_context(struct ofono_gprs *gprs, const char *group)
 	enum ofono_gprs_proto proto;
 	enum ofono_gprs_auth_method auth;
 	unsigned int id;
+	unsigned int i;
 
 	if (sscanf(group, "context%d", &id) != 1) {
 		if (sscanf(group, "primarycontext%d", &id) != 1)
@@ -3224,6 +4194,10 @@ static gboolean load_context(struct ofono_gprs *gprs, const char *group)
 	if (msgcenter != NULL)
 		strcpy(context->message_center, msgcenter);
 
+	for (i = 0; i < STAT_COUNT; i++)
+		context->stats[i] = g_key_file_get_uint64(gprs->settings,
+						group, stat_names[i], NULL);
+
 	if (context_dbus_register(context) == FALSE)
 		goto error;
 
@@ -3351,6 +4325,8 @@ static void ofono_gprs_finish_register(struct ofono_gprs *gprs)
 	ofono_modem_add_interface(modem,
 				OFONO_CONNECTION_MANAGER_INTERFACE);
 
+	gprs->link_watches = __ofono_watchlist_new(g_free);
+
 	gprs->netreg_watch = __ofono_modem_add_atom_watch(modem,
 					OFONO_ATOM_TYPE_NETREG,
 					netreg_watch, gprs, NULL);
@@ -3417,3 +4393,21 @@ void *ofono_gprs_get_data(struct ofono_gprs *gprs)
 {
 	return gprs->driver_data;
 }
+
+static int gprs_init(void)
+{
+	rtnl = l_netlink_new(NETLINK_ROUTE);
+	if (rtnl == NULL)
+		ofono_error("Unable to open rtnetlink, context interfaces "
+				"will not be configured");
+
+	return 0;
+}
+
+static void gprs_exit(void)
+{
+	l_netlink_destroy(rtnl);
+	rtnl = NULL;
+}
+
+OFONO_MODULE(gprs, gprs_init, gprs_exit)
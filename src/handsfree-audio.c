@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <gdbus.h>
 
@@ -37,6 +38,8 @@ struct ofono_handsfree_card {
 	char *path;
 	DBusMessage *msg;
 	unsigned char selected_codec;
+	uint16_t voice_setting;
+	uint64_t connect_start;
 	const struct ofono_handsfree_card_driver *driver;
 	void *driver_data;
 };
@@ -45,8 +48,23 @@ struct agent {
 	char *owner;
 	char *path;
 	guint watch;
+	int channel;
+	guint channel_watch;
 };
 
+/*
+ * Header of each connection record sent over the agent channel, followed
+ * by the NUL terminated card path.  The SCO socket travels as SCM_RIGHTS.
+ */
+struct channel_record {
+	uint8_t version;
+	uint8_t codec;
+	uint16_t voice_setting;
+	uint32_t setup_time;
+} __attribute__((packed));
+
+#define CHANNEL_VERSION 1
+
 static struct agent *agent = NULL;
 static int ref_count = 0;
 static GSList *card_list = 0;
@@ -77,29 +95,106 @@ static uint16_t codec2setting(uint8_t codec)
 	}
 }
 
-static ofono_bool_t apply_settings_from_codec(int fd, uint8_t codec)
+static ofono_bool_t apply_voice_setting(int fd, uint16_t setting)
 {
 	struct bt_voice voice;
 
-	memset(&voice, 0, sizeof(voice));
-	voice.setting = codec2setting(codec);
-
 	/* CVSD is the default, no need to set BT_VOICE. */
-	if (voice.setting == BT_VOICE_CVSD_16BIT)
+	if (setting == BT_VOICE_CVSD_16BIT)
 		return TRUE;
 
+	memset(&voice, 0, sizeof(voice));
+	voice.setting = setting;
+
 	if (setsockopt(fd, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice)) < 0)
 		return FALSE;
 
 	return TRUE;
 }
 
-static void send_new_connection(const char *card, int fd, uint8_t codec)
+static void channel_close(struct agent *agent)
+{
+	if (agent->channel_watch > 0) {
+		g_source_remove(agent->channel_watch);
+		agent->channel_watch = 0;
+	}
+
+	if (agent->channel >= 0) {
+		close(agent->channel);
+		agent->channel = -1;
+	}
+}
+
+static gboolean channel_hangup(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	DBG("Agent %s closed its channel", agent->owner);
+
+	agent->channel_watch = 0;
+	channel_close(agent);
+
+	return FALSE;
+}
+
+static ofono_bool_t channel_send(struct ofono_handsfree_card *card, int fd,
+							uint32_t setup_time)
+{
+	struct channel_record rec;
+	struct iovec iov[2];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	rec.version = CHANNEL_VERSION;
+	rec.codec = card->selected_codec;
+	rec.voice_setting = card->voice_setting;
+	rec.setup_time = setup_time;
+
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = card->path;
+	iov[1].iov_len = strlen(card->path) + 1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	if (sendmsg(agent->channel, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+		ofono_warn("Agent channel: %s (%d), using NewConnection",
+						strerror(errno), errno);
+		channel_close(agent);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void send_new_connection(struct ofono_handsfree_card *card, int fd)
 {
+	const char *path = card->path;
+	uint8_t codec = card->selected_codec;
+	uint32_t setup_time = 0;
 	DBusMessage *msg;
 	DBusMessageIter iter;
 
-	DBG("%p, fd: %d, codec: %hu", card, fd, codec);
+	if (card->connect_start) {
+		setup_time = l_time_diff(card->connect_start, l_time_now());
+		card->connect_start = 0;
+	}
+
+	DBG("%s, fd: %d, codec: %hu, setup: %u us", path, fd, codec,
+								setup_time);
+
+	if (agent->channel >= 0 && channel_send(card, fd, setup_time))
+		return;
 
 	msg = dbus_message_new_method_call(agent->owner, agent->path,
 				HFP_AUDIO_AGENT_INTERFACE, "NewConnection");
@@ -107,7 +202,7 @@ static void send_new_connection(const char *card, int fd, uint8_t codec)
 		return;
 
 	dbus_message_iter_init_append(msg, &iter);
-	dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &card);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &path);
 	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UNIX_FD, &fd);
 	dbus_message_iter_append_basic(&iter, DBUS_TYPE_BYTE, &codec);
 
@@ -138,10 +233,13 @@ static gboolean sco_accept(GIOChannel *io, GIOCondition cond,
 	socklen_t alen;
 	int sk, nsk;
 	char local[18], remote[18];
+	uint64_t start;
 
 	if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL))
 		return FALSE;
 
+	start = l_time_now();
+
 	sk = g_io_channel_unix_get_fd(io);
 
 	memset(&saddr, 0, sizeof(saddr));
@@ -178,7 +276,7 @@ static gboolean sco_accept(GIOChannel *io, GIOCondition cond,
 		return TRUE;
 	}
 
-	if (apply_settings_from_codec(nsk, card->selected_codec) == FALSE) {
+	if (apply_voice_setting(nsk, card->voice_setting) == FALSE) {
 		close(nsk);
 		return TRUE;
 	}
@@ -186,9 +284,12 @@ static gboolean sco_accept(GIOChannel *io, GIOCondition cond,
 	DBG("SCO connection setup between local: %s and remote: %s",
 		local, remote);
 
-	send_new_connection(card->path, nsk, card->selected_codec);
+	card->connect_start = start;
+	send_new_connection(card, nsk);
 	close(nsk);
 
+	__ofono_voicecall_audio_connected();
+
 	if (card->driver && card->driver->sco_connected_hint)
 		card->driver->sco_connected_hint(card);
 
@@ -310,6 +411,8 @@ static gboolean sco_connect_cb(GIOChannel *io, GIOCondition cond,
 
 	sk = g_io_channel_unix_get_fd(io);
 
+	__ofono_voicecall_audio_connected();
+
 	if (card->msg && dbus_message_has_member(card->msg, "Acquire")) {
 		reply = g_dbus_create_reply(card->msg, DBUS_TYPE_UNIX_FD, &sk,
 					DBUS_TYPE_BYTE, &card->selected_codec,
@@ -317,7 +420,7 @@ static gboolean sco_connect_cb(GIOChannel *io, GIOCondition cond,
 		goto done;
 	}
 
-	send_new_connection(card->path, sk, card->selected_codec);
+	send_new_connection(card, sk);
 
 	close(sk);
 
@@ -418,6 +521,7 @@ struct ofono_handsfree_card *ofono_handsfree_card_create(unsigned int vendor,
 
 	card->type = type;
 	card->selected_codec = HFP_CODEC_CVSD;
+	card->voice_setting = BT_VOICE_CVSD_16BIT;
 
 	card_list = g_slist_prepend(card_list, card);
 
@@ -499,11 +603,13 @@ int ofono_handsfree_card_connect_sco(struct ofono_handsfree_card *card)
 	addr.sco_family = AF_BLUETOOTH;
 	bt_str2ba(card->remote, &addr.sco_bdaddr);
 
-	if (apply_settings_from_codec(sk, card->selected_codec) == FALSE) {
+	if (apply_voice_setting(sk, card->voice_setting) == FALSE) {
 		close(sk);
 		return -1;
 	}
 
+	card->connect_start = l_time_now();
+
 	ret = connect(sk, (struct sockaddr *) &addr, sizeof(addr));
 	if (ret < 0 && errno != EINPROGRESS) {
 		close(sk);
@@ -625,7 +731,9 @@ ofono_bool_t ofono_handsfree_card_set_codec(struct ofono_handsfree_card *card,
 	return FALSE;
 
 done:
+	/* Resolve the socket setting now, not on every SCO connection */
 	card->selected_codec = codec;
+	card->voice_setting = codec2setting(codec);
 
 	return TRUE;
 }
@@ -645,6 +753,8 @@ static void agent_free(struct agent *agent)
 	if (agent->watch > 0)
 		g_dbus_remove_watch(ofono_dbus_get_connection(), agent->watch);
 
+	channel_close(agent);
+
 	l_free(agent->owner);
 	l_free(agent->path);
 	g_free(agent);
@@ -775,10 +885,53 @@ static DBusMessage *am_agent_register(DBusConnection *conn,
 	agent->path = l_strdup(path);
 	agent->watch = g_dbus_add_disconnect_watch(conn, sender,
 						agent_disconnect, NULL, NULL);
+	agent->channel = -1;
 
 	return dbus_message_new_method_return(msg);
 }
 
+static DBusMessage *am_open_channel(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	const char *sender = dbus_message_get_sender(msg);
+	GIOChannel *io;
+	DBusMessage *reply;
+	int fds[2];
+
+	if (agent == NULL)
+		return __ofono_error_not_found(msg);
+
+	if (strcmp(sender, agent->owner) != 0)
+		return __ofono_error_not_allowed(msg);
+
+	if (agent->channel >= 0)
+		return __ofono_error_in_use(msg);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+		return __ofono_error_failed(msg);
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &fds[1],
+					DBUS_TYPE_INVALID);
+	close(fds[1]);
+
+	if (reply == NULL) {
+		close(fds[0]);
+		return NULL;
+	}
+
+	agent->channel = fds[0];
+
+	io = g_io_channel_unix_new(fds[0]);
+	agent->channel_watch = g_io_add_watch(io,
+				G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				channel_hangup, NULL);
+	g_io_channel_unref(io);
+
+	DBG("Agent %s opened a channel", sender);
+
+	return reply;
+}
+
 static DBusMessage *am_agent_unregister(DBusConnection *conn,
 					DBusMessage *msg, void *user_data)
 {
@@ -821,6 +974,9 @@ static const GDBusMethodTable am_methods[] = {
 	{ GDBUS_METHOD("Unregister",
 			GDBUS_ARGS({"path", "o"}), NULL,
 			am_agent_unregister) },
+	{ GDBUS_METHOD("OpenChannel",
+			NULL, GDBUS_ARGS({"fd", "h"}),
+			am_open_channel) },
 	{ }
 };
 
@@ -18,67 +18,216 @@
 
 static GSList *history_drivers = NULL;
 
-struct history_call_foreach_data {
-	const struct ofono_call *call;
-	union {
-		struct {
-			time_t start;
-			time_t end;
-		};
-
-		time_t when;
-	};
+/*
+ * Events are queued per context and handed to the driver from an idle
+ * callback, at most HISTORY_BATCH_MAX per main loop iteration, followed
+ * by the driver's flush.  A driver that falls HISTORY_QUEUE_MAX events
+ * behind is caught up synchronously.
+ */
+#define HISTORY_BATCH_MAX 32
+#define HISTORY_QUEUE_MAX 512
+
+enum history_event_type {
+	HISTORY_EVENT_CALL_ENDED,
+	HISTORY_EVENT_CALL_MISSED,
+	HISTORY_EVENT_SMS_RECEIVED,
+	HISTORY_EVENT_SMS_SEND_PENDING,
+	HISTORY_EVENT_SMS_SEND_STATUS,
+};
+
+struct history_event {
+	unsigned int refcount;
+	enum history_event_type type;
+	struct ofono_call call;
+	struct ofono_uuid uuid;
+	char *address;
+	char *text;
+	time_t start;
+	time_t end;
+	struct tm remote;
+	struct tm local;
+	enum ofono_history_sms_status status;
 };
 
-struct history_sms_foreach_data {
-	const struct ofono_uuid *uuid;
-	const char *address;
-	const char *text;
-	union {
-		struct {
-			const struct tm *remote;
-			const struct tm *local;
-		};
-		struct {
-			time_t when;
-			enum ofono_history_sms_status status;
-		};
-	};
+struct history_context {
+	struct ofono_history_context context;
+	struct l_queue *events;
+	struct l_idle *idle;
+	unsigned int queued;
+	unsigned int batches;
+	unsigned int depth_max;
+	unsigned int forced;
 };
 
+static struct history_event *history_event_new(enum history_event_type type)
+{
+	struct history_event *event = l_new(struct history_event, 1);
+
+	event->refcount = 1;
+	event->type = type;
+
+	return event;
+}
+
+static void history_event_unref(void *data)
+{
+	struct history_event *event = data;
+
+	if (--event->refcount > 0)
+		return;
+
+	l_free(event->address);
+	l_free(event->text);
+	l_free(event);
+}
+
+static void history_deliver(struct ofono_history_context *context,
+				const struct history_event *event)
+{
+	const struct ofono_history_driver *driver = context->driver;
+
+	switch (event->type) {
+	case HISTORY_EVENT_CALL_ENDED:
+		if (driver->call_ended)
+			driver->call_ended(context, &event->call,
+						event->start, event->end);
+		break;
+	case HISTORY_EVENT_CALL_MISSED:
+		if (driver->call_missed)
+			driver->call_missed(context, &event->call,
+						event->start);
+		break;
+	case HISTORY_EVENT_SMS_RECEIVED:
+		if (driver->sms_received)
+			driver->sms_received(context, &event->uuid,
+						event->address, &event->remote,
+						&event->local, event->text);
+		break;
+	case HISTORY_EVENT_SMS_SEND_PENDING:
+		if (driver->sms_send_pending)
+			driver->sms_send_pending(context, &event->uuid,
+						event->address, event->start,
+						event->text);
+		break;
+	case HISTORY_EVENT_SMS_SEND_STATUS:
+		if (driver->sms_send_status)
+			driver->sms_send_status(context, &event->uuid,
+						event->start, event->status);
+		break;
+	}
+}
+
+static void history_flush(struct history_context *hc, unsigned int max)
+{
+	struct history_event *event;
+	unsigned int n = 0;
+
+	while (n < max && (event = l_queue_pop_head(hc->events))) {
+		history_deliver(&hc->context, event);
+		history_event_unref(event);
+		n += 1;
+	}
+
+	if (n == 0)
+		return;
+
+	hc->batches += 1;
+
+	if (hc->context.driver->flush)
+		hc->context.driver->flush(&hc->context);
+}
+
+static void history_idle_cb(struct l_idle *idle, void *user_data)
+{
+	struct history_context *hc = user_data;
+
+	history_flush(hc, HISTORY_BATCH_MAX);
+
+	if (!l_queue_isempty(hc->events))
+		return;
+
+	l_idle_remove(hc->idle);
+	hc->idle = NULL;
+}
+
+static void history_queue_one(struct ofono_atom *atom, void *data)
+{
+	struct ofono_history_context *context = __ofono_atom_get_data(atom);
+	struct history_context *hc = l_container_of(context,
+						struct history_context,
+						context);
+	struct history_event *event = data;
+	unsigned int depth;
+
+	event->refcount += 1;
+	l_queue_push_tail(hc->events, event);
+	hc->queued += 1;
+
+	depth = l_queue_length(hc->events);
+	if (depth > hc->depth_max)
+		hc->depth_max = depth;
+
+	if (depth >= HISTORY_QUEUE_MAX) {
+		hc->forced += 1;
+		history_flush(hc, depth);
+		return;
+	}
+
+	if (hc->idle == NULL)
+		hc->idle = l_idle_create(history_idle_cb, hc, NULL);
+}
+
+static void history_queue(struct ofono_modem *modem,
+				struct history_event *event)
+{
+	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
+					history_queue_one, event);
+	history_event_unref(event);
+}
+
 static struct ofono_history_context *history_context_create(
 					struct ofono_modem *modem,
 					struct ofono_history_driver *driver)
 {
-	struct ofono_history_context *context;
+	struct history_context *hc;
 
 	if (driver->probe == NULL)
 		return NULL;
 
-	context = g_try_new0(struct ofono_history_context, 1);
+	hc = l_new(struct history_context, 1);
+	hc->context.driver = driver;
+	hc->context.modem = modem;
 
-	if (context == NULL)
-		return NULL;
-
-	context->driver = driver;
-	context->modem = modem;
-
-	if (driver->probe(context) < 0) {
-		g_free(context);
+	if (driver->probe(&hc->context) < 0) {
+		l_free(hc);
 		return NULL;
 	}
 
-	return context;
+	hc->events = l_queue_new();
+
+	return &hc->context;
 }
 
 static void context_remove(struct ofono_atom *atom)
 {
 	struct ofono_history_context *context = __ofono_atom_get_data(atom);
+	struct history_context *hc = l_container_of(context,
+						struct history_context,
+						context);
+
+	/* Whatever is still queued is delivered before the driver goes */
+	history_flush(hc, l_queue_length(hc->events));
+	l_idle_remove(hc->idle);
+	l_queue_destroy(hc->events, NULL);
+
+	DBG("%s: %u events in %u batches, max depth %u, %u forced",
+			context->driver->name, hc->queued, hc->batches,
+			hc->depth_max, hc->forced);
 
 	if (context->driver->remove)
 		context->driver->remove(context);
 
-	g_free(context);
+	l_free(hc);
 }
 
 void __ofono_history_probe_drivers(struct ofono_modem *modem)
@@ -99,64 +248,30 @@ void __ofono_history_probe_drivers(struct ofono_modem *modem)
 	}
 }
 
-static void history_call_ended(struct ofono_atom *atom, void *data)
-{
-	struct ofono_history_context *context = __ofono_atom_get_data(atom);
-	struct history_call_foreach_data *hfd = data;
-
-	if (context->driver->call_ended == NULL)
-		return;
-
-	context->driver->call_ended(context, hfd->call, hfd->start, hfd->end);
-}
-
 void __ofono_history_call_ended(struct ofono_modem *modem,
 				const struct ofono_call *call,
 				time_t start, time_t end)
 {
-	struct history_call_foreach_data hfd;
+	struct history_event *event =
+			history_event_new(HISTORY_EVENT_CALL_ENDED);
 
-	hfd.call = call;
-	hfd.start = start;
-	hfd.end = end;
+	event->call = *call;
+	event->start = start;
+	event->end = end;
 
-	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
-					history_call_ended, &hfd);
-}
-
-static void history_call_missed(struct ofono_atom *atom, void *data)
-{
-	struct ofono_history_context *context = __ofono_atom_get_data(atom);
-	struct history_call_foreach_data *hfd = data;
-
-	if (context->driver->call_missed == NULL)
-		return;
-
-	context->driver->call_missed(context, hfd->call, hfd->when);
+	history_queue(modem, event);
 }
 
 void __ofono_history_call_missed(struct ofono_modem *modem,
 				const struct ofono_call *call, time_t when)
 {
-	struct history_call_foreach_data hfd;
-
-	hfd.call = call;
-	hfd.when = when;
-
-	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
-					history_call_missed, &hfd);
-}
-
-static void history_sms_received(struct ofono_atom *atom, void *data)
-{
-	struct ofono_history_context *context = __ofono_atom_get_data(atom);
-	struct history_sms_foreach_data *hfd = data;
+	struct history_event *event =
+			history_event_new(HISTORY_EVENT_CALL_MISSED);
 
-	if (context->driver->sms_received == NULL)
-		return;
+	event->call = *call;
+	event->start = when;
 
-	context->driver->sms_received(context, hfd->uuid, hfd->address,
-					hfd->remote, hfd->local, hfd->text);
+	history_queue(modem, event);
 }
 
 void __ofono_history_sms_received(struct ofono_modem *modem,
@@ -166,28 +281,16 @@ void __ofono_history_sms_received(struct ofono_modem *modem,
 					const struct tm *local,
 					const char *text)
 {
-	struct history_sms_foreach_data hfd;
+	struct history_event *event =
+			history_event_new(HISTORY_EVENT_SMS_RECEIVED);
 
-	hfd.uuid = uuid;
-	hfd.address = from;
-	hfd.remote = remote;
-	hfd.local = local;
-	hfd.text = text;
+	event->uuid = *uuid;
+	event->address = l_strdup(from);
+	event->remote = *remote;
+	event->local = *local;
+	event->text = l_strdup(text);
 
-	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
-					history_sms_received, &hfd);
-}
-
-static void history_sms_send_pending(struct ofono_atom *atom, void *data)
-{
-	struct ofono_history_context *context = __ofono_atom_get_data(atom);
-	struct history_sms_foreach_data *hfd = data;
-
-	if (context->driver->sms_send_pending == NULL)
-		return;
-
-	context->driver->sms_send_pending(context, hfd->uuid, hfd->address,
-						hfd->when, hfd->text);
+	history_queue(modem, event);
 }
 
 void __ofono_history_sms_send_pending(struct ofono_modem *modem,
@@ -195,28 +298,16 @@ void __ofono_history_sms_send_pending(struct ofono_modem *modem,
 					const char *to,
 					time_t when, const char *text)
 {
-	struct history_sms_foreach_data hfd;
+	struct history_event *event =
+			history_event_new(HISTORY_EVENT_SMS_SEND_PENDING);
 
-	hfd.uuid = uuid;
-	hfd.address = to;
-	hfd.text = text;
-	hfd.when = when;
-	hfd.status = OFONO_HISTORY_SMS_STATUS_PENDING;
+	event->uuid = *uuid;
+	event->address = l_strdup(to);
+	event->start = when;
+	event->text = l_strdup(text);
+	event->status = OFONO_HISTORY_SMS_STATUS_PENDING;
 
-	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
-					history_sms_send_pending, &hfd);
-}
-
-static void history_sms_send_status(struct ofono_atom *atom, void *data)
-{
-	struct ofono_history_context *context = __ofono_atom_get_data(atom);
-	struct history_sms_foreach_data *hfd = data;
-
-	if (context->driver->sms_send_status == NULL)
-		return;
-
-	context->driver->sms_send_status(context, hfd->uuid,
-						hfd->when, hfd->status);
+	history_queue(modem, event);
 }
 
 void __ofono_history_sms_send_status(struct ofono_modem *modem,
@@ -224,16 +315,14 @@ void __ofono_history_sms_send_status(struct ofono_modem *modem,
 					time_t when,
 					enum ofono_history_sms_status status)
 {
-	struct history_sms_foreach_data hfd;
+	struct history_event *event =
+			history_event_new(HISTORY_EVENT_SMS_SEND_STATUS);
 
-	hfd.uuid = uuid;
-	hfd.address = NULL;
-	hfd.text = NULL;
-	hfd.when = when;
-	hfd.status = status;
+	event->uuid = *uuid;
+	event->start = when;
+	event->status = status;
 
-	__ofono_modem_foreach_atom(modem, OFONO_ATOM_TYPE_HISTORY,
-					history_sms_send_status, &hfd);
+	history_queue(modem, event);
 }
 
 int ofono_history_driver_register(const struct ofono_history_driver *driver)
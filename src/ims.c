@@ -32,8 +32,67 @@ struct ofono_ims {
 	void *driver_data;
 	struct ofono_atom *atom;
 	DBusMessage *pending;
+	struct ofono_watchlist *ready_watches;
 };
 
+ofono_bool_t __ofono_ims_voice_ready(struct ofono_ims *ims)
+{
+	return ims->reg_info && ims->ext_info != -1 &&
+				(ims->ext_info & VOICE_CAPABLE_FLAG);
+}
+
+ofono_bool_t __ofono_ims_sms_ready(struct ofono_ims *ims)
+{
+	return ims->reg_info && ims->ext_info != -1 &&
+				(ims->ext_info & SMS_CAPABLE_FLAG);
+}
+
+unsigned int __ofono_ims_add_ready_watch(struct ofono_ims *ims,
+					ofono_ims_ready_notify_cb_t notify,
+					void *data, ofono_destroy_func destroy)
+{
+	struct ofono_watchlist_item *item;
+
+	if (ims == NULL || ims->ready_watches == NULL || notify == NULL)
+		return 0;
+
+	item = g_new0(struct ofono_watchlist_item, 1);
+
+	item->notify = notify;
+	item->destroy = destroy;
+	item->notify_data = data;
+
+	return __ofono_watchlist_add_item(ims->ready_watches, item);
+}
+
+gboolean __ofono_ims_remove_ready_watch(struct ofono_ims *ims,
+					unsigned int id)
+{
+	if (ims->ready_watches == NULL)
+		return FALSE;
+
+	return __ofono_watchlist_remove_item(ims->ready_watches, id);
+}
+
+static void notify_ready_watches(struct ofono_ims *ims)
+{
+	ofono_bool_t voice = __ofono_ims_voice_ready(ims);
+	ofono_bool_t sms = __ofono_ims_sms_ready(ims);
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+
+	if (ims->ready_watches == NULL)
+		return;
+
+	__ofono_watchlist_iter_init(&iter, ims->ready_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		ofono_ims_ready_notify_cb_t notify = item->notify;
+
+		notify(voice, sms, item->notify_data);
+	}
+}
+
 static DBusMessage *ims_get_properties(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
@@ -128,6 +187,7 @@ void ofono_ims_status_notify(struct ofono_ims *ims, int reg_info, int ext_info)
 {
 	dbus_bool_t new_reg_info;
 	dbus_bool_t new_voice_capable, new_sms_capable;
+	ofono_bool_t voice_ready, sms_ready;
 
 	if (ims == NULL)
 		return;
@@ -138,6 +198,9 @@ void ofono_ims_status_notify(struct ofono_ims *ims, int reg_info, int ext_info)
 	if (ims->ext_info == ext_info && ims->reg_info == reg_info)
 		return;
 
+	voice_ready = __ofono_ims_voice_ready(ims);
+	sms_ready = __ofono_ims_sms_ready(ims);
+
 	new_reg_info = reg_info ? TRUE : FALSE;
 	ims_set_registered(ims, new_reg_info);
 
@@ -153,6 +216,10 @@ void ofono_ims_status_notify(struct ofono_ims *ims, int reg_info, int ext_info)
 skip:
 	ims->reg_info = reg_info;
 	ims->ext_info = ext_info;
+
+	if (voice_ready != __ofono_ims_voice_ready(ims) ||
+			sms_ready != __ofono_ims_sms_ready(ims))
+		notify_ready_watches(ims);
 }
 
 static void registration_status_cb(const struct ofono_error *error,
@@ -181,6 +248,10 @@ static void register_cb(const struct ofono_error *error, void *data)
 
 	__ofono_dbus_pending_reply(&ims->pending, reply);
 
+	/* The new state arrives through ofono_ims_status_notify */
+	if (ims->driver->flags & OFONO_IMS_DRIVER_FLAG_STATUS_NOTIFY)
+		return;
+
 	if (ims->driver->registration_status == NULL)
 		return;
 
@@ -265,6 +336,10 @@ static void ims_atom_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 	const char *path = __ofono_atom_get_path(atom);
+	struct ofono_ims *ims = __ofono_atom_get_data(atom);
+
+	__ofono_watchlist_free(ims->ready_watches);
+	ims->ready_watches = NULL;
 
 	ofono_modem_remove_interface(modem, OFONO_IMS_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_IMS_INTERFACE);
@@ -285,6 +360,8 @@ static void ofono_ims_finish_register(struct ofono_ims *ims)
 		return;
 	}
 
+	ims->ready_watches = __ofono_watchlist_new(g_free);
+
 	ofono_modem_add_interface(modem, OFONO_IMS_INTERFACE);
 	__ofono_atom_register(ims->atom, ims_atom_unregister);
 }
@@ -11,20 +11,35 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <gdbus.h>
 
 #include "ofono.h"
 #include "common.h"
+#include "nmea.h"
+
+#include "gatio.h"
+#include "ringbuffer.h"
 
 #ifndef DBUS_TYPE_UNIX_FD
 #define DBUS_TYPE_UNIX_FD -1
 #endif
 
+enum subscriber_format {
+	SUBSCRIBER_FORMAT_NMEA,
+	SUBSCRIBER_FORMAT_FIX,
+};
+
 struct ofono_location_reporting {
 	DBusMessage *pending;
 	const struct ofono_location_reporting_driver *driver;
@@ -33,6 +48,43 @@ struct ofono_location_reporting {
 	ofono_bool_t enabled;
 	char *client_owner;
 	guint disconnect_watch;
+	ofono_bool_t fanout;
+	GAtIO *io;
+	struct nmea_parser *parser;
+	struct l_queue *subscribers;
+	enum subscriber_format pending_format;
+	ofono_bool_t driver_fixes;
+	char batch[PIPE_BUF];
+	size_t batch_len;
+};
+
+/* A client reading the shared stream through its own pipe */
+struct subscriber {
+	struct ofono_location_reporting *lr;
+	char *owner;
+	enum subscriber_format format;
+	guint watch;
+	int fd;
+	unsigned int dropped;
+};
+
+/*
+ * What SubscribeFixes clients read, in host byte order.  The length comes
+ * first so that fields added at the end can be skipped by older readers.
+ */
+struct fix_record {
+	uint32_t length;
+	uint32_t satellites;
+	uint64_t timestamp;
+	double latitude;
+	double longitude;
+	double altitude;
+	double speed;
+	double course;
+	double vertical_speed;
+	double horizontal_accuracy;
+	double vertical_accuracy;
+	double hdop;
 };
 
 static const char *location_reporting_type_to_string(
@@ -87,6 +139,7 @@ static void client_remove(struct ofono_location_reporting *lr)
 	}
 
 	l_free(lr->client_owner);
+	lr->client_owner = NULL;
 }
 
 static void signal_enabled(const struct ofono_location_reporting *lr)
@@ -201,6 +254,9 @@ static DBusMessage *location_reporting_release(DBusConnection *conn,
 	struct ofono_location_reporting *lr = data;
 	const char *caller = dbus_message_get_sender(msg);
 
+	if (lr->fanout)
+		return __ofono_error_access_denied(msg);
+
 	/*
 	 * Avoid a race by not trying to release the device if there is a
 	 * pending message or client already signaled it's exiting. In the
@@ -223,6 +279,389 @@ static DBusMessage *location_reporting_release(DBusConnection *conn,
 	return NULL;
 }
 
+static void subscriber_free(void *data)
+{
+	struct subscriber *sub = data;
+
+	if (sub->watch)
+		g_dbus_remove_watch(ofono_dbus_get_connection(), sub->watch);
+
+	if (sub->dropped)
+		DBG("%s missed %u bytes", sub->owner, sub->dropped);
+
+	if (sub->fd >= 0)
+		close(sub->fd);
+
+	l_free(sub->owner);
+	l_free(sub);
+}
+
+static bool subscriber_match_owner(const void *a, const void *b)
+{
+	const struct subscriber *sub = a;
+
+	return !strcmp(sub->owner, b);
+}
+
+static void subscriber_write(struct subscriber *sub, const void *data,
+								size_t len)
+{
+	if (sub->fd < 0)
+		return;
+
+	if (write(sub->fd, data, len) >= 0)
+		return;
+
+	if (errno == EAGAIN) {
+		sub->dropped += len;
+		return;
+	}
+
+	close(sub->fd);
+	sub->fd = -1;
+}
+
+/*
+ * Writes of up to PIPE_BUF bytes to a pipe are atomic, so a subscriber
+ * gets either the whole batch or, with its pipe full, none of it.  Only
+ * complete sentences reach the pipes and a slow reader never holds up
+ * the others.  libdbus ignores SIGPIPE, a closed pipe shows up as EPIPE.
+ */
+static void fanout_flush(struct ofono_location_reporting *lr)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(lr->subscribers); entry;
+						entry = entry->next) {
+		struct subscriber *sub = entry->data;
+
+		if (sub->format == SUBSCRIBER_FORMAT_NMEA)
+			subscriber_write(sub, lr->batch, lr->batch_len);
+	}
+
+	lr->batch_len = 0;
+}
+
+static void nmea_sentence_cb(const char *line, size_t len, void *user_data)
+{
+	struct ofono_location_reporting *lr = user_data;
+
+	if (lr->batch_len + len > sizeof(lr->batch))
+		fanout_flush(lr);
+
+	memcpy(lr->batch + lr->batch_len, line, len);
+	lr->batch_len += len;
+}
+
+static void fix_signal(struct ofono_location_reporting *lr,
+				const struct nmea_fix *fix)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = __ofono_atom_get_path(lr->atom);
+
+	g_dbus_emit_signal(conn, path, OFONO_LOCATION_REPORTING_INTERFACE,
+				"Fix",
+				DBUS_TYPE_UINT32, &fix->time,
+				DBUS_TYPE_UINT32, &fix->date,
+				DBUS_TYPE_DOUBLE, &fix->latitude,
+				DBUS_TYPE_DOUBLE, &fix->longitude,
+				DBUS_TYPE_DOUBLE, &fix->altitude,
+				DBUS_TYPE_DOUBLE, &fix->speed,
+				DBUS_TYPE_DOUBLE, &fix->course,
+				DBUS_TYPE_DOUBLE, &fix->hdop,
+				DBUS_TYPE_BYTE, &fix->quality,
+				DBUS_TYPE_BYTE, &fix->satellites,
+				DBUS_TYPE_INVALID);
+}
+
+static void fanout_fix(struct ofono_location_reporting *lr,
+				const struct ofono_location_fix *fix)
+{
+	struct fix_record record = {
+		.length = sizeof(record),
+		.satellites = fix->satellites,
+		.timestamp = fix->timestamp,
+		.latitude = fix->latitude,
+		.longitude = fix->longitude,
+		.altitude = fix->altitude,
+		.speed = fix->speed,
+		.course = fix->course,
+		.vertical_speed = fix->vertical_speed,
+		.horizontal_accuracy = fix->horizontal_accuracy,
+		.vertical_accuracy = fix->vertical_accuracy,
+		.hdop = fix->hdop,
+	};
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(lr->subscribers); entry;
+						entry = entry->next) {
+		struct subscriber *sub = entry->data;
+
+		if (sub->format == SUBSCRIBER_FORMAT_FIX)
+			subscriber_write(sub, &record, sizeof(record));
+	}
+}
+
+static void nmea_fix_cb(const struct nmea_fix *fix, void *user_data)
+{
+	struct ofono_location_reporting *lr = user_data;
+	struct ofono_location_fix lf = {
+		.latitude = fix->latitude,
+		.longitude = fix->longitude,
+		.altitude = fix->altitude,
+		.speed = fix->speed,
+		.course = fix->course,
+		.vertical_speed = NAN,
+		.horizontal_accuracy = NAN,
+		.vertical_accuracy = NAN,
+		.hdop = fix->hdop,
+		.satellites = fix->satellites,
+	};
+	struct tm tm = {
+		.tm_mday = fix->date / 10000,
+		.tm_mon = fix->date / 100 % 100 - 1,
+		.tm_year = fix->date % 100 + 100,
+	};
+
+	/* Positions from the driver are more complete, don't report twice */
+	if (lr->driver_fixes)
+		return;
+
+	fix_signal(lr, fix);
+
+	if (fix->date)
+		lf.timestamp = (uint64_t) timegm(&tm) * 1000 + fix->time;
+
+	fanout_fix(lr, &lf);
+}
+
+static void nmea_read_cb(struct ring_buffer *rbuf, gpointer user_data)
+{
+	struct ofono_location_reporting *lr = user_data;
+	unsigned int len;
+
+	while ((len = ring_buffer_len_no_wrap(rbuf)) > 0) {
+		nmea_parser_feed(lr->parser, ring_buffer_read_ptr(rbuf, 0),
+									len);
+		ring_buffer_drain(rbuf, len);
+	}
+
+	if (lr->batch_len)
+		fanout_flush(lr);
+}
+
+static void fanout_stop(struct ofono_location_reporting *lr)
+{
+	g_at_io_unref(lr->io);
+	lr->io = NULL;
+
+	nmea_parser_free(lr->parser);
+	lr->parser = NULL;
+	lr->batch_len = 0;
+
+	l_queue_destroy(lr->subscribers, subscriber_free);
+	lr->subscribers = NULL;
+}
+
+static void fanout_disable_cb(const struct ofono_error *error, void *data)
+{
+	struct ofono_location_reporting *lr = data;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		ofono_error("Disabling location-reporting failed");
+
+	lr->fanout = FALSE;
+	lr->enabled = FALSE;
+
+	signal_enabled(lr);
+}
+
+static void fanout_disable(struct ofono_location_reporting *lr)
+{
+	fanout_stop(lr);
+
+	lr->driver->disable(lr, fanout_disable_cb, lr);
+}
+
+static void fanout_disconnect(gpointer user_data)
+{
+	struct ofono_location_reporting *lr = user_data;
+
+	ofono_error("NMEA stream closed by the modem");
+
+	fanout_disable(lr);
+}
+
+/* The driver closes its descriptor once we return, read from a copy */
+static bool fanout_start(struct ofono_location_reporting *lr, int fd)
+{
+	GIOChannel *channel;
+
+	fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	lr->io = g_at_io_new_fd(channel);
+	g_io_channel_unref(channel);
+
+	if (lr->io == NULL)
+		return false;
+
+	/* NMEA comes in bursts, take each one with a single large read */
+	g_at_io_set_read_policy(lr->io, 1, 0);
+	g_at_io_set_read_handler(lr->io, nmea_read_cb, lr);
+	g_at_io_set_disconnect_function(lr->io, fanout_disconnect, lr);
+
+	lr->parser = nmea_parser_new();
+	nmea_parser_set_sentence_func(lr->parser, nmea_sentence_cb, lr);
+	nmea_parser_set_fix_func(lr->parser, nmea_fix_cb, lr);
+
+	lr->subscribers = l_queue_new();
+
+	return true;
+}
+
+static void subscriber_remove(struct subscriber *sub)
+{
+	struct ofono_location_reporting *lr = sub->lr;
+
+	l_queue_remove(lr->subscribers, sub);
+	subscriber_free(sub);
+
+	if (l_queue_isempty(lr->subscribers))
+		fanout_disable(lr);
+}
+
+static void subscriber_exited(DBusConnection *conn, void *data)
+{
+	struct subscriber *sub = data;
+
+	sub->watch = 0;
+	subscriber_remove(sub);
+}
+
+static DBusMessage *subscriber_add(struct ofono_location_reporting *lr,
+					DBusMessage *msg,
+					enum subscriber_format format)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct subscriber *sub;
+	DBusMessage *reply;
+	int fds[2];
+
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return __ofono_error_failed(msg);
+
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	sub = l_new(struct subscriber, 1);
+	sub->lr = lr;
+	sub->owner = l_strdup(dbus_message_get_sender(msg));
+	sub->format = format;
+	sub->fd = fds[1];
+	sub->watch = g_dbus_add_disconnect_watch(conn, sub->owner,
+						subscriber_exited, sub, NULL);
+	l_queue_push_tail(lr->subscribers, sub);
+
+	reply = dbus_message_new_method_return(msg);
+	dbus_message_append_args(reply, DBUS_TYPE_UNIX_FD, &fds[0],
+							DBUS_TYPE_INVALID);
+	close(fds[0]);
+
+	return reply;
+}
+
+static void fanout_enable_cb(const struct ofono_error *error, int fd,
+								void *data)
+{
+	struct ofono_location_reporting *lr = data;
+	DBusMessage *reply;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		ofono_error("Enabling location-reporting failed");
+
+		lr->fanout = FALSE;
+		reply = __ofono_error_failed(lr->pending);
+		__ofono_dbus_pending_reply(&lr->pending, reply);
+		return;
+	}
+
+	lr->enabled = TRUE;
+
+	if (fanout_start(lr, fd))
+		reply = subscriber_add(lr, lr->pending, lr->pending_format);
+	else
+		reply = __ofono_error_failed(lr->pending);
+
+	__ofono_dbus_pending_reply(&lr->pending, reply);
+
+	signal_enabled(lr);
+
+	if (l_queue_isempty(lr->subscribers))
+		fanout_disable(lr);
+}
+
+static DBusMessage *subscribe(struct ofono_location_reporting *lr,
+				DBusMessage *msg, enum subscriber_format format)
+{
+	const char *caller = dbus_message_get_sender(msg);
+
+	if (lr->pending != NULL)
+		return __ofono_error_busy(msg);
+
+	if (lr->enabled && !lr->fanout)
+		return __ofono_error_in_use(msg);
+
+	/* The last subscriber left and the stream is being turned off */
+	if (lr->fanout && lr->io == NULL)
+		return __ofono_error_busy(msg);
+
+	if (l_queue_find(lr->subscribers, subscriber_match_owner, caller))
+		return __ofono_error_in_use(msg);
+
+	if (lr->fanout)
+		return subscriber_add(lr, msg, format);
+
+	lr->pending = dbus_message_ref(msg);
+	lr->pending_format = format;
+	lr->fanout = TRUE;
+
+	lr->driver->enable(lr, fanout_enable_cb, lr);
+
+	return NULL;
+}
+
+static DBusMessage *location_reporting_subscribe(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	return subscribe(data, msg, SUBSCRIBER_FORMAT_NMEA);
+}
+
+static DBusMessage *location_reporting_subscribe_fixes(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	return subscribe(data, msg, SUBSCRIBER_FORMAT_FIX);
+}
+
+static DBusMessage *location_reporting_unsubscribe(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_location_reporting *lr = data;
+	const char *caller = dbus_message_get_sender(msg);
+	struct subscriber *sub;
+
+	sub = l_queue_find(lr->subscribers, subscriber_match_owner, caller);
+	if (sub == NULL)
+		return __ofono_error_not_available(msg);
+
+	subscriber_remove(sub);
+
+	return dbus_message_new_method_return(msg);
+}
+
 static const GDBusMethodTable location_reporting_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -232,12 +671,26 @@ static const GDBusMethodTable location_reporting_methods[] = {
 			location_reporting_request) },
 	{ GDBUS_ASYNC_METHOD("Release", NULL, NULL,
 					location_reporting_release) },
+	{ GDBUS_ASYNC_METHOD("Subscribe",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			location_reporting_subscribe) },
+	{ GDBUS_ASYNC_METHOD("SubscribeFixes",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			location_reporting_subscribe_fixes) },
+	{ GDBUS_METHOD("Unsubscribe", NULL, NULL,
+					location_reporting_unsubscribe) },
 	{ }
 };
 
 static const GDBusSignalTable location_reporting_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("Fix",
+			GDBUS_ARGS({ "time", "u" }, { "date", "u" },
+				{ "latitude", "d" }, { "longitude", "d" },
+				{ "altitude", "d" }, { "speed", "d" },
+				{ "course", "d" }, { "hdop", "d" },
+				{ "quality", "y" }, { "satellites", "y" })) },
 	{ }
 };
 
@@ -247,6 +700,38 @@ struct ofono_modem *ofono_location_reporting_get_modem(
 	return __ofono_atom_get_modem(lr->atom);
 }
 
+void ofono_location_reporting_fix_notify(struct ofono_location_reporting *lr,
+					const struct ofono_location_fix *fix)
+{
+	time_t seconds = fix->timestamp / 1000;
+	struct nmea_fix nf = {
+		.latitude = fix->latitude,
+		.longitude = fix->longitude,
+		.altitude = fix->altitude,
+		.speed = fix->speed,
+		.course = fix->course,
+		.hdop = fix->hdop,
+		.quality = 1,
+		.satellites = fix->satellites,
+	};
+	struct tm tm;
+
+	if (!lr->fanout || lr->subscribers == NULL)
+		return;
+
+	lr->driver_fixes = TRUE;
+
+	if (fix->timestamp && gmtime_r(&seconds, &tm)) {
+		nf.time = ((tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec) *
+					1000 + fix->timestamp % 1000;
+		nf.date = (tm.tm_mday * 100 + tm.tm_mon + 1) * 100 +
+					tm.tm_year % 100;
+	}
+
+	fix_signal(lr, &nf);
+	fanout_fix(lr, fix);
+}
+
 static void location_reporting_unregister(struct ofono_atom *atom)
 {
 	struct ofono_location_reporting *lr = __ofono_atom_get_data(atom);
@@ -254,6 +739,9 @@ static void location_reporting_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(lr->atom);
 
+	if (lr->fanout)
+		fanout_stop(lr);
+
 	ofono_modem_remove_interface(modem, OFONO_LOCATION_REPORTING_INTERFACE);
 	g_dbus_unregister_interface(conn, path,
 					OFONO_LOCATION_REPORTING_INTERFACE);
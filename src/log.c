@@ -14,7 +14,9 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <syslog.h>
+#include <time.h>
 #ifdef HAVE_BACKTRACE
 #include <execinfo.h>
 #endif
@@ -27,6 +29,64 @@
 static const char *program_exec;
 static const char *program_path;
 
+/*
+ * Optional in-memory log ring.  Records are fixed size so that logging
+ * never allocates; when the ring is enabled, debug messages are kept here
+ * instead of being pushed through syslog and are only read back on demand.
+ */
+#define LOG_RING_MSG_SIZE 112
+
+struct log_record {
+	uint64_t timestamp;
+	uint8_t priority;
+	char msg[LOG_RING_MSG_SIZE];
+};
+
+static struct log_record *ring;
+static unsigned int ring_size;
+static uint64_t ring_seq;
+
+static uint64_t log_timestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void ring_append(int priority, const char *format, va_list ap)
+{
+	struct log_record *rec = &ring[ring_seq % ring_size];
+
+	rec->timestamp = log_timestamp();
+	rec->priority = priority;
+	vsnprintf(rec->msg, sizeof(rec->msg), format, ap);
+	ring_seq++;
+}
+
+static void log_message(int priority, const char *format, va_list ap)
+{
+	va_list copy;
+
+	if (!ring) {
+		vsyslog(priority, format, ap);
+		return;
+	}
+
+	if (priority == LOG_DEBUG) {
+		ring_append(priority, format, ap);
+		return;
+	}
+
+	/* Keep warnings and errors in the ring for context as well */
+	va_copy(copy, ap);
+	ring_append(priority, format, copy);
+	va_end(copy);
+
+	vsyslog(priority, format, ap);
+}
+
 /**
  * ofono_info:
  * @format: format string
@@ -40,7 +100,7 @@ void ofono_info(const char *format, ...)
 
 	va_start(ap, format);
 
-	vsyslog(LOG_INFO, format, ap);
+	log_message(LOG_INFO, format, ap);
 
 	va_end(ap);
 }
@@ -58,7 +118,7 @@ void ofono_warn(const char *format, ...)
 
 	va_start(ap, format);
 
-	vsyslog(LOG_WARNING, format, ap);
+	log_message(LOG_WARNING, format, ap);
 
 	va_end(ap);
 }
@@ -76,7 +136,7 @@ void ofono_error(const char *format, ...)
 
 	va_start(ap, format);
 
-	vsyslog(LOG_ERR, format, ap);
+	log_message(LOG_ERR, format, ap);
 
 	va_end(ap);
 }
@@ -97,7 +157,7 @@ void ofono_debug(const char *format, ...)
 
 	va_start(ap, format);
 
-	vsyslog(LOG_DEBUG, format, ap);
+	log_message(LOG_DEBUG, format, ap);
 
 	va_end(ap);
 }
@@ -242,6 +302,13 @@ extern struct ofono_debug_desc __stop___debug[];
 
 static gchar **enabled = NULL;
 
+struct debug_section {
+	struct ofono_debug_desc *start;
+	struct ofono_debug_desc *stop;
+};
+
+static GSList *debug_sections = NULL;
+
 static ofono_bool_t is_enabled(struct ofono_debug_desc *desc)
 {
 	int i;
@@ -266,6 +333,9 @@ void __ofono_log_enable(struct ofono_debug_desc *start,
 {
 	struct ofono_debug_desc *desc;
 
+	struct debug_section *section;
+	GSList *l;
+
 	if (start == NULL || stop == NULL)
 		return;
 
@@ -273,6 +343,90 @@ void __ofono_log_enable(struct ofono_debug_desc *start,
 		if (is_enabled(desc) == TRUE)
 			desc->flags |= OFONO_DEBUG_FLAG_PRINT;
 	}
+
+	/* Built-in plugins share the daemon's own section */
+	for (l = debug_sections; l; l = l->next) {
+		section = l->data;
+
+		if (section->start == start)
+			return;
+	}
+
+	section = g_new0(struct debug_section, 1);
+	section->start = start;
+	section->stop = stop;
+	debug_sections = g_slist_prepend(debug_sections, section);
+}
+
+/*
+ * Replace the set of enabled debug patterns at runtime.  Every section
+ * registered through __ofono_log_enable() is re-evaluated, so messages
+ * can be switched both on and off without restarting the daemon.
+ * Returns the number of debug descriptors that ended up enabled.
+ */
+unsigned int __ofono_log_set_debug(const char *debug)
+{
+	unsigned int count = 0;
+	GSList *l;
+
+	g_strfreev(enabled);
+	enabled = NULL;
+
+	if (debug != NULL && *debug != '\0')
+		enabled = g_strsplit_set(debug, ":, ", 0);
+
+	for (l = debug_sections; l; l = l->next) {
+		struct debug_section *section = l->data;
+		struct ofono_debug_desc *desc;
+
+		for (desc = section->start; desc < section->stop; desc++) {
+			if (is_enabled(desc) == TRUE) {
+				desc->flags |= OFONO_DEBUG_FLAG_PRINT;
+				count += 1;
+			} else
+				desc->flags &= ~OFONO_DEBUG_FLAG_PRINT;
+		}
+	}
+
+	return count;
+}
+
+int __ofono_log_ring_enable(unsigned int entries)
+{
+	if (ring)
+		return -EALREADY;
+
+	if (entries == 0)
+		return -EINVAL;
+
+	ring = g_try_new0(struct log_record, entries);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring_size = entries;
+	ring_seq = 0;
+
+	return 0;
+}
+
+/*
+ * Walk the log ring from the oldest to the newest record.  Timestamps
+ * are in microseconds of CLOCK_MONOTONIC.
+ */
+void __ofono_log_ring_foreach(ofono_log_ring_func_t func, void *user_data)
+{
+	uint64_t seq;
+
+	if (ring == NULL)
+		return;
+
+	seq = ring_seq > ring_size ? ring_seq - ring_size : 0;
+
+	for (; seq != ring_seq; seq++) {
+		struct log_record *rec = &ring[seq % ring_size];
+
+		func(rec->timestamp, rec->priority, rec->msg, user_data);
+	}
 }
 
 int __ofono_log_init(const char *program, const char *debug,
@@ -314,4 +468,12 @@ void __ofono_log_cleanup(void)
 #endif
 
 	g_strfreev(enabled);
+	enabled = NULL;
+
+	g_slist_free_full(debug_sections, g_free);
+	debug_sections = NULL;
+
+	g_free(ring);
+	ring = NULL;
+	ring_size = 0;
 }
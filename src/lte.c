@@ -49,22 +49,22 @@ static bool provision_default_attach_info(struct ofono_lte *lte,
 						const char *mcc, const char *mnc,
 						const char *spn)
 {
-	_auto_(l_free) struct provision_db_entry *settings = NULL;
+	_auto_(provision_db_result_unref) struct provision_db_result *settings =
+									NULL;
 	const struct provision_db_entry *ap = NULL;
-	size_t count;
 	size_t i;
 
 	DBG("Provisioning default bearer info with mcc:'%s', mnc:'%s', spn:'%s'",
 			mcc, mnc, spn);
 
-	if (!__ofono_provision_get_settings(mcc, mnc, spn, &settings, &count))
+	if (!__ofono_provision_get_settings(mcc, mnc, spn, &settings))
 		return false;
 
-	DBG("Obtained %zu candidates", count);
+	DBG("Obtained %zu candidates", settings->n_items);
 
-	for (i = 0; i < count; i++) {
-		if (settings[i].type & OFONO_GPRS_CONTEXT_TYPE_IA) {
-			ap = &settings[i];
+	for (i = 0; i < settings->n_items; i++) {
+		if (settings->items[i].type & OFONO_GPRS_CONTEXT_TYPE_IA) {
+			ap = &settings->items[i];
 			break;
 		}
 	}
@@ -431,63 +431,98 @@ static void lte_init_default_attach_info_cb(const struct ofono_error *error,
 	ofono_lte_finish_register(lte);
 }
 
+static void lte_store_attach_info(struct ofono_lte *lte)
+{
+	const char *str;
+
+	if (lte->info.apn[0])
+		l_settings_set_string(lte->settings, SETTINGS_GROUP,
+					LTE_APN, lte->info.apn);
+
+	if (lte->info.username[0])
+		l_settings_set_string(lte->settings, SETTINGS_GROUP,
+				LTE_USERNAME, lte->info.username);
+
+	if (lte->info.password[0])
+		l_settings_set_string(lte->settings, SETTINGS_GROUP,
+				LTE_PASSWORD, lte->info.password);
+
+	str = gprs_proto_to_string(lte->info.proto);
+	l_settings_set_string(lte->settings, SETTINGS_GROUP,
+				LTE_PROTO, str);
+
+	str = gprs_auth_method_to_string(lte->info.auth_method);
+	l_settings_set_string(lte->settings, SETTINGS_GROUP,
+				LTE_AUTH_METHOD, str);
+
+	lte_save_settings(lte);
+}
+
+static void lte_update_attach_info_cb(const struct ofono_error *error,
+						void *data)
+{
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		ofono_error("Updating the provisioned attach APN failed");
+}
+
 static void spn_read_cb(const char *spn, const char *dc, void *data)
 {
 	struct ofono_lte *lte = data;
 	struct ofono_modem *modem = __ofono_atom_get_modem(lte->atom);
 	struct ofono_sim *sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
-	bool r;
+	struct ofono_lte_default_attach_info old;
 
 	ofono_sim_remove_spn_watch(sim, &lte->spn_watch);
 
-	r = provision_default_attach_info(lte, ofono_sim_get_mcc(sim),
-						ofono_sim_get_mnc(sim), spn);
-	if (r) {
-		const char *str;
-
-		if (lte->info.apn[0])
-			l_settings_set_string(lte->settings, SETTINGS_GROUP,
-						LTE_APN, lte->info.apn);
+	memcpy(&old, &lte->info, sizeof(old));
 
-		if (lte->info.username[0])
-			l_settings_set_string(lte->settings, SETTINGS_GROUP,
-					LTE_USERNAME, lte->info.username);
+	if (provision_default_attach_info(lte, ofono_sim_get_mcc(sim),
+						ofono_sim_get_mnc(sim), spn))
+		lte_store_attach_info(lte);
 
-		if (lte->info.password[0])
-			l_settings_set_string(lte->settings, SETTINGS_GROUP,
-					LTE_PASSWORD, lte->info.password);
-
-		str = gprs_proto_to_string(lte->info.proto);
-		l_settings_set_string(lte->settings, SETTINGS_GROUP,
-					LTE_PROTO, str);
-
-		str = gprs_auth_method_to_string(lte->info.auth_method);
-		l_settings_set_string(lte->settings, SETTINGS_GROUP,
-					LTE_AUTH_METHOD, str);
+	if (!__ofono_atom_get_registered(lte->atom)) {
+		if (lte->driver->set_default_attach_info) {
+			lte->driver->set_default_attach_info(lte, &lte->info,
+					lte_init_default_attach_info_cb, lte);
+			return;
+		}
 
-		lte_save_settings(lte);
+		ofono_lte_finish_register(lte);
+		return;
 	}
 
-	if (lte->driver->set_default_attach_info) {
-		lte->driver->set_default_attach_info(lte, &lte->info,
-					lte_init_default_attach_info_cb, lte);
+	/* Registered with the operator's defaults, which an MVNO overrides */
+	if (!memcmp(&old, &lte->info, sizeof(old)))
 		return;
-	}
 
-	ofono_lte_finish_register(lte);
+	DBG("Attach APN changed to '%s' by SPN provisioning", lte->info.apn);
+
+	if (lte->driver->set_default_attach_info)
+		lte->driver->set_default_attach_info(lte, &lte->info,
+					lte_update_attach_info_cb, lte);
 }
 
 void ofono_lte_register(struct ofono_lte *lte)
 {
-	/* Wait for SPN to be read in order to try provisioning */
+	struct ofono_modem *modem = __ofono_atom_get_modem(lte->atom);
+	struct ofono_sim *sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
+
+	/* Nothing stored for this IMSI yet, provision from the database */
 	if (lte_load_settings(lte) < 0) {
-		struct ofono_modem *modem = __ofono_atom_get_modem(lte->atom);
-		struct ofono_sim *sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM,
-								modem);
+		/* An SPN read already is handled right away */
+		if (ofono_sim_add_spn_watch(sim, &lte->spn_watch,
+						spn_read_cb, lte, NULL) &&
+				lte->spn_watch == 0)
+			return;
 
-		ofono_sim_add_spn_watch(sim, &lte->spn_watch,
-						spn_read_cb, lte, NULL);
-		return;
+		/*
+		 * Otherwise do not hold the first attach until EFspn is read,
+		 * which would let the radio attach with an empty APN.  The
+		 * operator's entry is applied now and corrected once the SPN
+		 * is known.
+		 */
+		provision_default_attach_info(lte, ofono_sim_get_mcc(sim),
+						ofono_sim_get_mnc(sim), NULL);
 	}
 
 	if (lte->driver->set_default_attach_info) {
@@ -21,6 +21,10 @@
 #include <ell/ell.h>
 
 #include "ofono.h"
+#include "storage.h"
+#include "eventloop.h"
+
+#include "gatio.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -32,9 +36,19 @@ const struct l_settings *__ofono_get_config(void)
 	return ofono_config;
 }
 
+static gboolean option_ell_loop = FALSE;
+
+static void main_loop_quit(void)
+{
+	if (option_ell_loop)
+		eventloop_quit();
+	else
+		g_main_loop_quit(event_loop);
+}
+
 void __ofono_exit(void)
 {
-	g_main_loop_quit(event_loop);
+	main_loop_quit();
 }
 
 static gboolean quit_eventloop(gpointer user_data)
@@ -73,6 +87,10 @@ static gboolean signal_handler(GIOChannel *channel, GIOCondition cond,
 
 		__terminated = 1;
 		break;
+	case SIGUSR2:
+		if (__ofono_trace_dump() < 0)
+			ofono_warn("Unable to write protocol trace");
+		break;
 	}
 
 	return TRUE;
@@ -88,6 +106,7 @@ static guint setup_signalfd(void)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR2);
 
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
 		perror("Failed to set signal mask");
@@ -119,13 +138,14 @@ static void system_bus_disconnected(DBusConnection *conn, void *user_data)
 {
 	ofono_error("System bus has disconnected!");
 
-	g_main_loop_quit(event_loop);
+	main_loop_quit();
 }
 
 static gchar *option_debug = NULL;
 static gchar *option_plugin = NULL;
 static gchar *option_noplugin = NULL;
 static gboolean option_detach = TRUE;
+static gboolean option_startup_trace = FALSE;
 static gboolean option_version = FALSE;
 
 static gboolean parse_debug(const char *key, const char *value,
@@ -161,9 +181,21 @@ static GOptionEntry options[] = {
 				"Don't run as daemon in background" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
+	{ "startup-trace", 0, 0, G_OPTION_ARG_NONE, &option_startup_trace,
+				"Record the timeline of modem bring-up" },
+	{ "ell-loop", 0, 0, G_OPTION_ARG_NONE, &option_ell_loop,
+				"Drive GLib sources from the ell event loop" },
 	{ NULL },
 };
 
+static gchar *get_config_plugins(const char *key)
+{
+	_auto_(l_free) char *value = l_settings_get_string(ofono_config,
+							"Plugins", key);
+
+	return g_strdup(value);
+}
+
 struct ell_event_source {
 	GSource source;
 	GPollFD pollfd;
@@ -195,10 +227,19 @@ int main(int argc, char **argv)
 	DBusConnection *conn;
 	DBusError error;
 	guint signal;
-	struct ell_event_source *source;
+	struct ell_event_source *source = NULL;
 	const char *config_dir;
 	char **config_dirs;
 	unsigned int i;
+	bool binary_settings;
+	bool threaded_reads;
+	bool io_uring;
+	unsigned int log_ring_size;
+	unsigned int trace_size;
+	unsigned int measring_size;
+	unsigned int mem_budget = 0;
+	unsigned int mem_log_interval = 0;
+	unsigned int mem_trim_interval = 0;
 
 	context = g_option_context_new(NULL);
 	g_option_context_add_main_entries(context, options, NULL);
@@ -235,15 +276,22 @@ int main(int argc, char **argv)
 	l_debug_enable("*");
 	l_main_init();
 
-	source = (struct ell_event_source *) g_source_new(&event_funcs,
+	if (option_ell_loop && eventloop_init() < 0) {
+		fprintf(stderr, "Unable to drive GLib from ell, nesting\n");
+		option_ell_loop = FALSE;
+	}
+
+	if (!option_ell_loop) {
+		source = (struct ell_event_source *) g_source_new(&event_funcs,
 					sizeof(struct ell_event_source));
 
-	source->pollfd.fd = l_main_get_epoll_fd();
-	source->pollfd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+		source->pollfd.fd = l_main_get_epoll_fd();
+		source->pollfd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
 
-	g_source_add_poll((GSource *)source, &source->pollfd);
-	g_source_attach((GSource *) source,
+		g_source_add_poll((GSource *)source, &source->pollfd);
+		g_source_attach((GSource *) source,
 					g_main_loop_get_context(event_loop));
+	}
 
 	signal = setup_signalfd();
 
@@ -270,6 +318,42 @@ int main(int argc, char **argv)
 
 	l_strv_free(config_dirs);
 
+	if (l_settings_get_uint(ofono_config, "Log", "RingSize",
+					&log_ring_size) && log_ring_size) {
+		if (__ofono_log_ring_enable(log_ring_size) < 0)
+			ofono_warn("Unable to enable log ring");
+	}
+
+	if (l_settings_get_uint(ofono_config, "Trace", "BufferSize",
+					&trace_size)) {
+		if (__ofono_trace_init(trace_size * 1024) < 0)
+			ofono_warn("Unable to enable protocol trace");
+	}
+
+	if (l_settings_get_uint(ofono_config, "Measurements", "RingSize",
+					&measring_size))
+		__ofono_measring_init(measring_size);
+
+	l_settings_get_uint(ofono_config, "Memory", "AtomBudget", &mem_budget);
+	l_settings_get_uint(ofono_config, "Memory", "LogInterval",
+							&mem_log_interval);
+	l_settings_get_uint(ofono_config, "Memory", "TrimInterval",
+							&mem_trim_interval);
+	__ofono_memstat_init(mem_budget, mem_log_interval, mem_trim_interval);
+
+	if (l_settings_get_bool(ofono_config, "Storage", "BinarySettings",
+					&binary_settings))
+		storage_set_binary_keyfiles(binary_settings);
+
+	if (l_settings_get_bool(ofono_config, "Transport", "ThreadedReads",
+					&threaded_reads))
+		g_at_io_set_threaded_reads(threaded_reads);
+
+	if (l_settings_get_bool(ofono_config, "Transport", "IoUring",
+					&io_uring) &&
+			!g_at_io_set_io_uring(io_uring))
+		ofono_warn("Built without io_uring support, ignoring IoUring");
+
 	dbus_error_init(&error);
 
 	conn = g_dbus_setup_bus(DBUS_BUS_SYSTEM, OFONO_SERVICE, &error);
@@ -293,26 +377,47 @@ int main(int argc, char **argv)
 	if (__ofono_modules_init() < 0)
 		goto fail_module_init;
 
+	__ofono_modem_set_startup_trace(option_startup_trace);
+
+	/* The command line takes precedence over main.conf */
+	if (option_plugin == NULL)
+		option_plugin = get_config_plugins("Enable");
+
+	if (option_noplugin == NULL)
+		option_noplugin = get_config_plugins("Disable");
+
 	__ofono_plugin_init(option_plugin, option_noplugin);
 	g_free(option_plugin);
 	g_free(option_noplugin);
 
-	g_main_loop_run(event_loop);
+	if (option_ell_loop)
+		eventloop_run();
+	else
+		g_main_loop_run(event_loop);
 
 	__ofono_plugin_cleanup();
 
 	__ofono_modules_cleanup();
 
+	storage_flush_all();
+
 fail_module_init:
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
 cleanup:
+	__ofono_memstat_cleanup();
+	__ofono_measring_cleanup();
+	__ofono_trace_cleanup();
 	l_settings_free(ofono_config);
 
 	g_source_remove(signal);
 
-	g_source_destroy((GSource *) source);
+	if (option_ell_loop)
+		eventloop_exit();
+	else
+		g_source_destroy((GSource *) source);
+
 	l_main_exit();
 
 	g_main_loop_unref(event_loop);
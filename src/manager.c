@@ -10,6 +10,7 @@
 #endif
 
 #include <string.h>
+#include <errno.h>
 #include <glib.h>
 #include <gdbus.h>
 
@@ -66,10 +67,576 @@ static DBusMessage *manager_get_modems(DBusConnection *conn,
 	return reply;
 }
 
+struct state_data {
+	DBusConnection *conn;
+	char **filter;
+	DBusMessageIter *array;
+	DBusMessageIter object;
+	DBusMessageIter interfaces;
+	const char *path;
+};
+
+static void copy_iter(DBusMessageIter *base, DBusMessageIter *iter)
+{
+	int type;
+
+	type = dbus_message_iter_get_arg_type(iter);
+
+	if (dbus_type_is_basic(type)) {
+		/* Large enough for any basic type, including 64 bit ones */
+		dbus_uint64_t value;
+
+		dbus_message_iter_get_basic(iter, &value);
+		dbus_message_iter_append_basic(base, type, &value);
+	} else if (dbus_type_is_container(type)) {
+		DBusMessageIter iter_sub, base_sub;
+		char *sig;
+
+		dbus_message_iter_recurse(iter, &iter_sub);
+
+		switch (type) {
+		case DBUS_TYPE_ARRAY:
+		case DBUS_TYPE_VARIANT:
+			sig = dbus_message_iter_get_signature(&iter_sub);
+			break;
+		default:
+			sig = NULL;
+			break;
+		}
+
+		dbus_message_iter_open_container(base, type, sig, &base_sub);
+
+		if (sig != NULL)
+			dbus_free(sig);
+
+		while (dbus_message_iter_get_arg_type(&iter_sub) !=
+							DBUS_TYPE_INVALID) {
+			copy_iter(&base_sub, &iter_sub);
+			dbus_message_iter_next(&iter_sub);
+		}
+
+		dbus_message_iter_close_container(base, &base_sub);
+	}
+}
+
+static const GDBusMethodTable *find_get_properties(
+					const GDBusMethodTable *methods)
+{
+	const GDBusMethodTable *method;
+
+	for (method = methods; method && method->name; method++) {
+		if (strcmp(method->name, "GetProperties"))
+			continue;
+
+		/* Async handlers reply later, on their own */
+		if (method->flags & G_DBUS_METHOD_FLAG_ASYNC)
+			return NULL;
+
+		return method;
+	}
+
+	return NULL;
+}
+
+/*
+ * Calls the GetProperties handler of an interface directly, with a locally
+ * built call message.  Returns NULL if it has none, replies later or fails.
+ */
+static DBusMessage *get_properties(DBusConnection *conn, const char *path,
+					const char *interface,
+					const GDBusMethodTable *methods,
+					void *interface_data)
+{
+	const GDBusMethodTable *method;
+	DBusMessage *call, *reply;
+
+	method = find_get_properties(methods);
+	if (method == NULL)
+		return NULL;
+
+	call = dbus_message_new_method_call(OFONO_SERVICE, path, interface,
+							"GetProperties");
+	if (call == NULL)
+		return NULL;
+
+	reply = method->function(conn, call, interface_data);
+	dbus_message_unref(call);
+
+	if (reply == NULL)
+		return NULL;
+
+	if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+		dbus_message_unref(reply);
+		return NULL;
+	}
+
+	return reply;
+}
+
+static void close_object(struct state_data *state)
+{
+	if (state->path == NULL)
+		return;
+
+	dbus_message_iter_close_container(&state->object, &state->interfaces);
+	dbus_message_iter_close_container(state->array, &state->object);
+	state->path = NULL;
+}
+
+static void append_state(const char *path, const char *interface,
+				const GDBusMethodTable *methods,
+				void *interface_data, void *user_data)
+{
+	struct state_data *state = user_data;
+	DBusMessage *reply;
+	DBusMessageIter iter, entry;
+
+	if (state->filter && !l_strv_contains(state->filter, interface))
+		return;
+
+	reply = get_properties(state->conn, path, interface, methods,
+							interface_data);
+	if (reply == NULL)
+		return;
+
+	if (!dbus_message_iter_init(reply, &iter))
+		goto done;
+
+	if (state->path == NULL || strcmp(state->path, path)) {
+		close_object(state);
+
+		dbus_message_iter_open_container(state->array,
+						DBUS_TYPE_DICT_ENTRY, NULL,
+						&state->object);
+		dbus_message_iter_append_basic(&state->object,
+						DBUS_TYPE_OBJECT_PATH, &path);
+		dbus_message_iter_open_container(&state->object,
+					DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&state->interfaces);
+		state->path = path;
+	}
+
+	dbus_message_iter_open_container(&state->interfaces,
+					DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &interface);
+	copy_iter(&entry, &iter);
+	dbus_message_iter_close_container(&state->interfaces, &entry);
+
+done:
+	dbus_message_unref(reply);
+}
+
+/*
+ * oFono interfaces have no D-Bus property tables, so GetManagedObjects and
+ * InterfacesAdded report what GetState would return for them
+ */
+static void append_object_properties(const char *path, const char *interface,
+					const GDBusMethodTable *methods,
+					void *interface_data,
+					DBusMessageIter *dict)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	DBusMessage *reply;
+	DBusMessageIter iter, props;
+
+	reply = get_properties(conn, path, interface, methods, interface_data);
+	if (reply == NULL)
+		return;
+
+	if (!dbus_message_iter_init(reply, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) !=
+							DBUS_TYPE_ARRAY)
+		goto done;
+
+	dbus_message_iter_recurse(&iter, &props);
+
+	while (dbus_message_iter_get_arg_type(&props) ==
+						DBUS_TYPE_DICT_ENTRY) {
+		copy_iter(dict, &props);
+		dbus_message_iter_next(&props);
+	}
+
+done:
+	dbus_message_unref(reply);
+}
+
+static DBusMessage *manager_get_state(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct state_data state;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	char **filter;
+	int n_filter;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_STRING, &filter, &n_filter,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL) {
+		dbus_free_string_array(filter);
+		return NULL;
+	}
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_OBJECT_PATH_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&array);
+
+	memset(&state, 0, sizeof(state));
+	state.conn = conn;
+	state.filter = n_filter > 0 ? filter : NULL;
+	state.array = &array;
+
+	g_dbus_foreach_interface(conn, OFONO_MANAGER_PATH,
+					append_state, &state);
+	close_object(&state);
+
+	dbus_message_iter_close_container(&iter, &array);
+	dbus_free_string_array(filter);
+
+	return reply;
+}
+
+/*
+ * SetDebug and GetLog are for root only.  The uid of the caller is asked
+ * from the bus, the method runs once the answer is in.
+ */
+typedef DBusMessage *(*root_method_func)(DBusMessage *msg);
+
+struct root_call {
+	DBusMessage *msg;
+	root_method_func func;
+};
+
+static void root_call_free(void *data)
+{
+	struct root_call *rc = data;
+
+	if (rc->msg)
+		dbus_message_unref(rc->msg);
+
+	g_free(rc);
+}
+
+static void root_call_unix_user_cb(DBusPendingCall *call, void *data)
+{
+	struct root_call *rc = data;
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	dbus_uint32_t uid;
+
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR ||
+			dbus_message_get_args(reply, NULL,
+						DBUS_TYPE_UINT32, &uid,
+						DBUS_TYPE_INVALID) == FALSE)
+		__ofono_dbus_pending_reply(&rc->msg,
+					__ofono_error_failed(rc->msg));
+	else if (uid != 0)
+		__ofono_dbus_pending_reply(&rc->msg,
+					__ofono_error_access_denied(rc->msg));
+	else
+		__ofono_dbus_pending_reply(&rc->msg, rc->func(rc->msg));
+
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(call);
+}
+
+static DBusMessage *root_call(DBusConnection *conn, DBusMessage *msg,
+				root_method_func func)
+{
+	const char *sender = dbus_message_get_sender(msg);
+	DBusMessage *query;
+	DBusPendingCall *call;
+	struct root_call *rc;
+
+	query = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+						DBUS_INTERFACE_DBUS,
+						"GetConnectionUnixUser");
+	if (query == NULL)
+		return __ofono_error_failed(msg);
+
+	dbus_message_append_args(query, DBUS_TYPE_STRING, &sender,
+					DBUS_TYPE_INVALID);
+
+	if (!dbus_connection_send_with_reply(conn, query, &call, -1) ||
+			call == NULL) {
+		dbus_message_unref(query);
+		return __ofono_error_failed(msg);
+	}
+
+	dbus_message_unref(query);
+
+	rc = g_new0(struct root_call, 1);
+	rc->msg = dbus_message_ref(msg);
+	rc->func = func;
+
+	dbus_pending_call_set_notify(call, root_call_unix_user_cb, rc,
+					root_call_free);
+
+	return NULL;
+}
+
+static DBusMessage *set_debug(DBusMessage *msg)
+{
+	const char *debug;
+	unsigned int count;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &debug,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	count = __ofono_log_set_debug(debug);
+	ofono_info("Debug set to '%s', %u messages enabled", debug, count);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *manager_set_debug(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return root_call(conn, msg, set_debug);
+}
+
+static DBusMessage *manager_set_full_rate(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	const char *sender = dbus_message_get_sender(msg);
+	dbus_bool_t enable;
+	int err;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_BOOLEAN, &enable,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	err = __ofono_dbus_set_full_rate(sender, enable);
+	if (err == -ENOTSUP)
+		return __ofono_error_not_available(msg);
+
+	if (err < 0)
+		return __ofono_error_failed(msg);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static void append_log_record(uint64_t timestamp, int priority,
+					const char *msg, void *user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+	dbus_uint64_t ts = timestamp;
+	dbus_uint32_t prio = priority;
+	const char *end;
+	char *valid = NULL;
+
+	/* Truncation may have split a multi-byte character */
+	if (g_utf8_validate(msg, -1, &end) == FALSE) {
+		valid = g_strndup(msg, end - msg);
+		msg = valid;
+	}
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &ts);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &prio);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &msg);
+	dbus_message_iter_close_container(array, &entry);
+
+	g_free(valid);
+}
+
+static DBusMessage *get_log(DBusMessage *msg)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_UINT32_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+	__ofono_log_ring_foreach(append_log_record, &array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *manager_get_log(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return root_call(conn, msg, get_log);
+}
+
+static void append_memory_usage(const char *path, const char *atom,
+					size_t bytes, size_t peak,
+					unsigned int blocks, void *user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+	dbus_uint64_t cur = bytes;
+	dbus_uint64_t max = peak;
+	dbus_uint32_t count = blocks;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &path);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &atom);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &cur);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &max);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &count);
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static DBusMessage *manager_get_memory_usage(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_UINT32_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+	__ofono_memstat_foreach(append_memory_usage, &array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static void append_cache_statistics(const char *name, unsigned int entries,
+					uint64_t hits, uint64_t misses,
+					void *user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+	dbus_uint32_t count = entries;
+	dbus_uint64_t found = hits;
+	dbus_uint64_t missed = misses;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &count);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &found);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &missed);
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static DBusMessage *manager_get_cache_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_UINT32_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+	__ofono_cache_foreach(append_cache_statistics, &array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *manager_acquire_measurement_ring(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	unsigned int records;
+	int fd;
+
+	fd = __ofono_measring_get_fd(&records);
+	if (fd == -ENOTSUP)
+		return __ofono_error_not_available(msg);
+
+	if (fd < 0)
+		return __ofono_error_failed(msg);
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &fd,
+					DBUS_TYPE_UINT32, &records,
+					DBUS_TYPE_INVALID);
+}
+
 static const GDBusMethodTable manager_methods[] = {
 	{ GDBUS_METHOD("GetModems",
 				NULL, GDBUS_ARGS({ "modems", "a(oa{sv})" }),
 				manager_get_modems) },
+	{ GDBUS_METHOD("GetState",
+				GDBUS_ARGS({ "interfaces", "as" }),
+				GDBUS_ARGS({ "objects", "a{oa{sa{sv}}}" }),
+				manager_get_state) },
+	{ GDBUS_ASYNC_METHOD("SetDebug",
+				GDBUS_ARGS({ "debug", "s" }), NULL,
+				manager_set_debug) },
+	{ GDBUS_METHOD("SetFullRateUpdates",
+				GDBUS_ARGS({ "enable", "b" }), NULL,
+				manager_set_full_rate) },
+	{ GDBUS_ASYNC_METHOD("GetLog",
+				NULL, GDBUS_ARGS({ "records", "a(tus)" }),
+				manager_get_log) },
+	{ GDBUS_METHOD("GetMemoryUsage",
+				NULL, GDBUS_ARGS({ "usage", "a(ssttu)" }),
+				manager_get_memory_usage) },
+	{ GDBUS_METHOD("GetCacheStatistics",
+				NULL, GDBUS_ARGS({ "caches", "a(sutt)" }),
+				manager_get_cache_statistics) },
+	{ GDBUS_METHOD("AcquireMeasurementRing",
+				NULL, GDBUS_ARGS({ "fd", "h" },
+						{ "records", "u" }),
+				manager_acquire_measurement_ring) },
 	{ }
 };
 
@@ -94,6 +661,11 @@ static int manager_init(void)
 	if (ret == FALSE)
 		return -1;
 
+	g_dbus_set_object_manager_properties(append_object_properties);
+
+	if (g_dbus_attach_object_manager(conn) == FALSE)
+		ofono_warn("Unable to attach the D-Bus ObjectManager");
+
 	return 0;
 }
 
@@ -101,6 +673,9 @@ static void manager_cleanup(void)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 
+	g_dbus_detach_object_manager(conn);
+	g_dbus_set_object_manager_properties(NULL);
+
 	g_dbus_unregister_interface(conn, OFONO_MANAGER_PATH,
 					OFONO_MANAGER_INTERFACE);
 }
@@ -0,0 +1,191 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+#define MEASRING_MAGIC 0x524d464f	/* "OFMR" */
+#define MEASRING_VERSION 1
+#define MEASRING_HEADER_SIZE 128
+#define MEASRING_RECORD_SIZE 128
+#define MEASRING_MIN_RECORDS 64
+
+/*
+ * The layout below is shared with clients mapping the ring, see
+ * doc/measurement-ring.txt.  The head is the number of records ever
+ * written and sits on its own cache line, away from the constant part.
+ */
+struct measring_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t header_size;
+	uint32_t records;
+	uint8_t reserved[48];
+	uint64_t head;
+	uint8_t reserved2[56];
+};
+
+/*
+ * A record being written has an odd sequence, a complete one holds
+ * 2 * n + 2 in its lower 32 bits where n is the record's position in
+ * the stream.  Readers check it before and after copying a record.
+ */
+struct measring_record {
+	uint32_t seq;
+	uint16_t type;
+	uint16_t len;
+	uint64_t timestamp;
+	char source[32];
+	uint8_t payload[MEASRING_RECORD_SIZE - 48];
+};
+
+static unsigned int ring_records;
+static size_t ring_size;
+static int ring_fd = -1;
+static struct measring_header *ring;
+
+ofono_bool_t __ofono_measring_enabled(void)
+{
+	return ring != NULL;
+}
+
+void __ofono_measring_write(enum ofono_measring_type type,
+				const char *source,
+				const void *payload, size_t len)
+{
+	struct measring_record *rec;
+	uint64_t n;
+
+	if (ring == NULL)
+		return;
+
+	len = MIN(len, sizeof(rec->payload));
+
+	/* Only the main loop writes, so the head is ours to read plainly */
+	n = ring->head;
+	rec = (struct measring_record *) ((uint8_t *) ring +
+				MEASRING_HEADER_SIZE +
+				(n % ring_records) * MEASRING_RECORD_SIZE);
+
+	__atomic_store_n(&rec->seq, (uint32_t) (2 * n + 1), __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec->type = type;
+	rec->len = len;
+	rec->timestamp = l_time_now();
+	l_strlcpy(rec->source, source ? source : "", sizeof(rec->source));
+	memcpy(rec->payload, payload, len);
+	memset(rec->payload + len, 0, sizeof(rec->payload) - len);
+
+	__atomic_store_n(&rec->seq, (uint32_t) (2 * n + 2), __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+static int ring_create(void)
+{
+	int fd;
+	int err;
+	void *addr;
+
+	fd = memfd_create("ofono-measurements", MFD_CLOEXEC |
+							MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, ring_size) < 0)
+		goto error;
+
+	addr = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+
+	/*
+	 * Clients get the same file, keep them from resizing it and, where
+	 * the kernel allows, from mapping it writable.  Our own mapping
+	 * predates the seal and stays writable.
+	 */
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+#ifdef F_SEAL_FUTURE_WRITE
+	fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+#endif
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL);
+
+	ring = addr;
+	ring->magic = MEASRING_MAGIC;
+	ring->version = MEASRING_VERSION;
+	ring->record_size = MEASRING_RECORD_SIZE;
+	ring->header_size = MEASRING_HEADER_SIZE;
+	ring->records = ring_records;
+	ring_fd = fd;
+
+	return 0;
+
+error:
+	err = -errno;
+	close(fd);
+	return err;
+}
+
+/* The ring is only set up once the first client asks for it */
+int __ofono_measring_get_fd(unsigned int *records)
+{
+	int err;
+
+	if (ring_records == 0)
+		return -ENOTSUP;
+
+	if (ring == NULL) {
+		err = ring_create();
+		if (err < 0)
+			return err;
+
+		ofono_info("Measurement ring of %u records created",
+				ring_records);
+	}
+
+	*records = ring_records;
+
+	return ring_fd;
+}
+
+void __ofono_measring_init(unsigned int records)
+{
+	if (records == 0)
+		return;
+
+	ring_records = MAX(records, MEASRING_MIN_RECORDS);
+	ring_size = MEASRING_HEADER_SIZE +
+			(size_t) ring_records * MEASRING_RECORD_SIZE;
+}
+
+void __ofono_measring_cleanup(void)
+{
+	if (ring != NULL) {
+		munmap(ring, ring_size);
+		ring = NULL;
+	}
+
+	if (ring_fd >= 0) {
+		close(ring_fd);
+		ring_fd = -1;
+	}
+
+	ring_records = 0;
+}
@@ -0,0 +1,317 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+
+#include <glib.h>
+
+#include "ofono.h"
+
+#include "gatio.h"
+
+/*
+ * Memory is accounted to tags, one per modem and atom type.  A tag lives
+ * for as long as an atom holds a reference or a block allocated from it
+ * is still around, so that leaks outlive the atom and show up in reports.
+ */
+struct ofono_memtag {
+	struct ofono_modem *modem;
+	char *path;
+	enum ofono_atom_type type;
+	unsigned int refs;
+	unsigned int blocks;
+	size_t bytes;
+	size_t peak;
+	bool over_budget;
+	struct ofono_telemetry *metric;
+};
+
+union mem_header {
+	struct {
+		struct ofono_memtag *tag;
+		size_t size;
+	};
+	max_align_t align;
+};
+
+struct memtrim_hook {
+	unsigned int id;
+	ofono_memtrim_func_t func;
+	void *user_data;
+};
+
+static struct l_queue *tags;
+static size_t tag_budget;
+static struct l_timeout *log_timeout;
+static struct l_queue *trim_hooks;
+static unsigned int trim_next_id;
+static struct l_timeout *trim_timeout;
+
+static void memtag_free(struct ofono_memtag *tag)
+{
+	l_queue_remove(tags, tag);
+	l_free(tag->path);
+	l_free(tag);
+}
+
+static bool memtag_match(const void *a, const void *b)
+{
+	const struct ofono_memtag *tag = a;
+	const struct ofono_memtag *key = b;
+
+	/* Tags without references may belong to a modem that has gone */
+	return tag->refs && tag->modem == key->modem &&
+						tag->type == key->type;
+}
+
+static void memtag_read(struct ofono_telemetry *metric, void *user_data)
+{
+	struct ofono_memtag *tag = user_data;
+
+	__ofono_telemetry_set(metric, tag->bytes);
+}
+
+struct ofono_memtag *__ofono_memtag_get(struct ofono_modem *modem,
+						enum ofono_atom_type type)
+{
+	struct ofono_memtag key = { .modem = modem, .type = type };
+	struct ofono_memtag *tag;
+	char name[64];
+
+	if (tags == NULL)
+		tags = l_queue_new();
+
+	tag = l_queue_find(tags, memtag_match, &key);
+	if (tag) {
+		tag->refs += 1;
+		return tag;
+	}
+
+	tag = l_new(struct ofono_memtag, 1);
+	tag->modem = modem;
+	tag->path = l_strdup(modem ? ofono_modem_get_path(modem) : NULL);
+	tag->type = type;
+	tag->refs = 1;
+
+	snprintf(name, sizeof(name), "memory.%s", __ofono_atom_type_name(type));
+	tag->metric = __ofono_telemetry_register(modem, name,
+						OFONO_TELEMETRY_COUNTER);
+	__ofono_telemetry_set_read_func(tag->metric, memtag_read, tag);
+
+	l_queue_push_tail(tags, tag);
+
+	return tag;
+}
+
+void __ofono_memtag_put(struct ofono_memtag *tag)
+{
+	if (tag == NULL || --tag->refs > 0)
+		return;
+
+	/* The modem may go away before the blocks left over */
+	__ofono_telemetry_unregister(tag->metric);
+	tag->metric = NULL;
+
+	if (tag->blocks == 0) {
+		memtag_free(tag);
+		return;
+	}
+
+	ofono_warn("%s %s released with %u blocks, %zu bytes in use",
+			tag->path ? tag->path : "/",
+			__ofono_atom_type_name(tag->type),
+			tag->blocks, tag->bytes);
+}
+
+void __ofono_memtag_charge(struct ofono_memtag *tag, ssize_t delta)
+{
+	if (tag == NULL)
+		return;
+
+	tag->bytes += delta;
+
+	if (tag->bytes > tag->peak)
+		tag->peak = tag->bytes;
+
+	if (tag_budget == 0)
+		return;
+
+	if (tag->over_budget == (tag->bytes > tag_budget))
+		return;
+
+	tag->over_budget = !tag->over_budget;
+
+	if (tag->over_budget)
+		ofono_warn("%s %s over its memory budget, %zu bytes in use",
+				tag->path ? tag->path : "/",
+				__ofono_atom_type_name(tag->type), tag->bytes);
+}
+
+bool __ofono_memtag_over_budget(struct ofono_memtag *tag)
+{
+	return tag && tag->over_budget;
+}
+
+void *__ofono_mem_alloc0(struct ofono_memtag *tag, size_t size)
+{
+	union mem_header *header = l_malloc(sizeof(*header) + size);
+
+	memset(header + 1, 0, size);
+	header->tag = tag;
+	header->size = size;
+
+	if (tag) {
+		tag->blocks += 1;
+		__ofono_memtag_charge(tag, sizeof(*header) + size);
+	}
+
+	return header + 1;
+}
+
+void __ofono_mem_free(void *ptr)
+{
+	union mem_header *header;
+	struct ofono_memtag *tag;
+
+	if (ptr == NULL)
+		return;
+
+	header = (union mem_header *) ptr - 1;
+	tag = header->tag;
+
+	if (tag) {
+		__ofono_memtag_charge(tag, -(ssize_t) (sizeof(*header) +
+							header->size));
+
+		if (--tag->blocks == 0 && tag->refs == 0)
+			memtag_free(tag);
+	}
+
+	l_free(header);
+}
+
+void __ofono_memstat_foreach(ofono_memstat_func_t func, void *user_data)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(tags); entry; entry = entry->next) {
+		const struct ofono_memtag *tag = entry->data;
+
+		func(tag->path ? tag->path : "/",
+			__ofono_atom_type_name(tag->type),
+			tag->bytes, tag->peak, tag->blocks, user_data);
+	}
+}
+
+static void log_usage(const char *path, const char *atom, size_t bytes,
+			size_t peak, unsigned int blocks, void *user_data)
+{
+	if (bytes == 0)
+		return;
+
+	ofono_info("Memory %s %s: %zu bytes in %u blocks, peak %zu",
+					path, atom, bytes, blocks, peak);
+}
+
+static void log_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	__ofono_memstat_foreach(log_usage, NULL);
+	l_timeout_modify(timeout, L_PTR_TO_UINT(user_data));
+}
+
+unsigned int __ofono_memtrim_add(ofono_memtrim_func_t func, void *user_data)
+{
+	struct memtrim_hook *hook;
+
+	if (trim_hooks == NULL)
+		trim_hooks = l_queue_new();
+
+	hook = l_new(struct memtrim_hook, 1);
+	hook->id = ++trim_next_id;
+	hook->func = func;
+	hook->user_data = user_data;
+
+	l_queue_push_tail(trim_hooks, hook);
+
+	return hook->id;
+}
+
+static bool memtrim_hook_match(const void *a, const void *b)
+{
+	const struct memtrim_hook *hook = a;
+
+	return hook->id == L_PTR_TO_UINT(b);
+}
+
+void __ofono_memtrim_remove(unsigned int id)
+{
+	l_free(l_queue_remove_if(trim_hooks, memtrim_hook_match,
+						L_UINT_TO_PTR(id)));
+}
+
+/*
+ * Caches that were not used during the whole last interval are dropped,
+ * they are rebuilt on their next use.  Empty transport buffers give back
+ * their pages, which are faulted in again by the next read.
+ */
+static void trim_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	unsigned int interval = L_PTR_TO_UINT(user_data);
+	uint64_t before = l_time_now() - (uint64_t) interval * L_USEC_PER_SEC;
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(trim_hooks); entry;
+							entry = entry->next) {
+		const struct memtrim_hook *hook = entry->data;
+
+		hook->func(before, hook->user_data);
+	}
+
+	g_at_io_trim_all();
+
+#ifdef HAVE_MALLOC_TRIM
+	malloc_trim(0);
+#endif
+
+	l_timeout_modify(timeout, interval);
+}
+
+void __ofono_memstat_init(unsigned int budget_kib, unsigned int interval,
+					unsigned int trim_interval)
+{
+	tag_budget = (size_t) budget_kib * 1024;
+
+	if (interval)
+		log_timeout = l_timeout_create(interval, log_timeout_cb,
+						L_UINT_TO_PTR(interval), NULL);
+
+	if (trim_interval)
+		trim_timeout = l_timeout_create(trim_interval,
+					trim_timeout_cb,
+					L_UINT_TO_PTR(trim_interval), NULL);
+}
+
+void __ofono_memstat_cleanup(void)
+{
+	l_timeout_remove(log_timeout);
+	log_timeout = NULL;
+
+	l_timeout_remove(trim_timeout);
+	trim_timeout = NULL;
+
+	l_queue_destroy(trim_hooks, l_free);
+	trim_hooks = NULL;
+}
@@ -25,6 +25,12 @@
 #include "simutil.h"
 #include "smsutil.h"
 
+/*
+ * Indications arriving within this many seconds of each other are
+ * signalled and written to the SIM together
+ */
+#define MW_UPDATE_DELAY 1
+
 struct mailbox_state {
 	gboolean indication;
 	unsigned char message_count;
@@ -32,6 +38,9 @@ struct mailbox_state {
 
 struct ofono_message_waiting {
 	struct mailbox_state messages[5];
+	struct mailbox_state signalled[5];
+	struct mailbox_state sim_state[5];
+	struct l_timeout *update_timeout;
 	unsigned char efmwis_length;
 	unsigned char efmbdn_length;
 	unsigned char efmbdn_record_id[5];
@@ -379,11 +388,14 @@ static void update_indicator_and_emit(struct ofono_message_waiting *mw,
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(mw->atom);
 
+	memcpy(&mw->sim_state[mailbox], info, sizeof(struct mailbox_state));
+
 	if (mw->messages[mailbox].message_count == info->message_count &&
 			mw->messages[mailbox].indication == info->indication)
 		return;
 
 	memcpy(&mw->messages[mailbox], info, sizeof(struct mailbox_state));
+	memcpy(&mw->signalled[mailbox], info, sizeof(struct mailbox_state));
 
 	indication = info->indication;
 	count = info->message_count;
@@ -659,50 +671,59 @@ static void mw_mwis_write_cb(int ok, void *userdata)
 		ofono_error("Writing new EF-MWIS failed");
 }
 
-static void mw_set_indicator(struct ofono_message_waiting *mw, int profile,
-				enum sms_mwi_type type,
-				gboolean present, unsigned char messages)
+static gboolean mailbox_state_equal(const struct mailbox_state *a,
+					const struct mailbox_state *b)
+{
+	return a->indication == b->indication &&
+				a->message_count == b->message_count;
+}
+
+static void mw_signal_changes(struct ofono_message_waiting *mw)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
-	unsigned char efmwis[255];  /* Max record size */
+	const char *path = __ofono_atom_get_path(mw->atom);
 	int i;
 
-	if (mw == NULL)
-		return;
-
-	/* Handle only current identity (TODO: currently assumes first) */
-	if (profile != 1)
-		return;
-
-	if (mw->messages[type].indication == present &&
-			mw->messages[type].message_count == messages)
-		return;
-
-	if (mw->messages[type].indication != present) {
-		dbus_bool_t indication;
-		const char *path = __ofono_atom_get_path(mw->atom);
+	for (i = 0; i < 5; i++) {
+		struct mailbox_state *state = &mw->messages[i];
+		struct mailbox_state *signalled = &mw->signalled[i];
+		dbus_bool_t indication = state->indication;
 
-		indication = present;
-		mw->messages[type].indication = present;
+		if (mw_message_waiting_property_name[i] == NULL) {
+			*signalled = *state;
+			continue;
+		}
 
-		if (mw_message_waiting_property_name[type])
+		if (signalled->indication != state->indication)
 			ofono_dbus_signal_property_changed(conn, path,
 					OFONO_MESSAGE_WAITING_INTERFACE,
-					mw_message_waiting_property_name[type],
+					mw_message_waiting_property_name[i],
 					DBUS_TYPE_BOOLEAN, &indication);
-	}
 
-	if (mw->messages[type].message_count != messages) {
-		const char *path = __ofono_atom_get_path(mw->atom);
-
-		mw->messages[type].message_count = messages;
-
-		if (mw_message_waiting_property_name[type])
+		if (signalled->message_count != state->message_count)
 			ofono_dbus_signal_property_changed(conn, path,
 					OFONO_MESSAGE_WAITING_INTERFACE,
-					mw_message_count_property_name[type],
-					DBUS_TYPE_BYTE, &messages);
+					mw_message_count_property_name[i],
+					DBUS_TYPE_BYTE, &state->message_count);
+
+		*signalled = *state;
 	}
+}
+
+static void mw_update_sim(struct ofono_message_waiting *mw)
+{
+	unsigned char efmwis[255];  /* Max record size */
+	int i;
+
+	/* Repeated or reverted indications leave the SIM alone */
+	for (i = 0; i < 5; i++)
+		if (!mailbox_state_equal(&mw->messages[i], &mw->sim_state[i]))
+			break;
+
+	if (i == 5)
+		return;
+
+	memcpy(mw->sim_state, mw->messages, sizeof(mw->sim_state));
 
 	/* Writes MWI states and/or MBDN back to SIM */
 	if (mw->efmwis_length < 5) {
@@ -713,6 +734,8 @@ static void mw_set_indicator(struct ofono_message_waiting *mw, int profile,
 		return;
 	}
 
+	memset(efmwis, 0, mw->efmwis_length);
+
 	/* Fill in numbers of messages in bytes 1 to X of EF-MWIS */
 	for (i = 0; i < 5 && i < mw->efmwis_length - 1; i++)
 		efmwis[i + 1] = mw->messages[i].message_count;
@@ -749,6 +772,47 @@ try_cphs:
 		ofono_error("Queuing a EF-MWIS write to SIM failed (CPHS)");
 }
 
+static void mw_update_flush(struct ofono_message_waiting *mw)
+{
+	if (mw->update_timeout == NULL)
+		return;
+
+	l_timeout_remove(mw->update_timeout);
+	mw->update_timeout = NULL;
+
+	mw_signal_changes(mw);
+	mw_update_sim(mw);
+}
+
+static void mw_update_timeout(struct l_timeout *timeout, void *user_data)
+{
+	mw_update_flush(user_data);
+}
+
+static void mw_set_indicator(struct ofono_message_waiting *mw, int profile,
+				enum sms_mwi_type type,
+				gboolean present, unsigned char messages)
+{
+	if (mw == NULL)
+		return;
+
+	/* Handle only current identity (TODO: currently assumes first) */
+	if (profile != 1)
+		return;
+
+	if (mw->messages[type].indication == present &&
+			mw->messages[type].message_count == messages)
+		return;
+
+	mw->messages[type].indication = present;
+	mw->messages[type].message_count = messages;
+
+	if (mw->update_timeout == NULL)
+		mw->update_timeout = l_timeout_create(MW_UPDATE_DELAY,
+							mw_update_timeout,
+							mw, NULL);
+}
+
 static void handle_special_sms_iei(struct ofono_message_waiting *mw,
 					const guint8 *iei, gboolean *discard)
 {
@@ -958,6 +1022,8 @@ static void message_waiting_unregister(struct ofono_atom *atom)
 	const char *path = __ofono_atom_get_path(atom);
 	struct ofono_message_waiting *mw = __ofono_atom_get_data(atom);
 
+	mw_update_flush(mw);
+
 	if (mw->sim_context) {
 		ofono_sim_context_free(mw->sim_context);
 		mw->sim_context = NULL;
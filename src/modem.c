@@ -12,6 +12,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <inttypes.h>
 
 #include <glib.h>
 #include <gdbus.h>
@@ -44,11 +46,15 @@ enum modem_state {
 	MODEM_STATE_ONLINE,
 };
 
+#define MODEM_STATE_COUNT (MODEM_STATE_ONLINE + 1)
+
 struct ofono_modem {
 	char			*path;
 	enum modem_state	modem_state;
-	GSList			*atoms;
-	struct ofono_watchlist	*atom_watches;
+	/* Atoms are indexed by the state they go away in and by type */
+	GSList			*atoms[MODEM_STATE_COUNT];
+	GSList			*atoms_by_type[OFONO_ATOM_TYPE_COUNT];
+	struct ofono_watchlist	*atom_watches[OFONO_ATOM_TYPE_COUNT];
 	GSList			*interface_list;
 	GSList			*feature_list;
 	unsigned int		call_ids;
@@ -75,6 +81,8 @@ struct ofono_modem {
 	char			*driver_type;
 	char			*name;
 	unsigned int		capabilities;
+	struct l_queue		*startup_trace;
+	uint64_t		startup_time;
 };
 
 struct ofono_devinfo {
@@ -100,7 +108,6 @@ struct ofono_atom {
 
 struct atom_watch {
 	struct ofono_watchlist_item item;
-	enum ofono_atom_type type;
 };
 
 struct modem_property {
@@ -108,6 +115,117 @@ struct modem_property {
 	void *value;
 };
 
+/* Enough for a full bring-up, later events are dropped */
+#define STARTUP_TRACE_MAX_EVENTS 256
+
+struct startup_event {
+	uint64_t usec;		/* Since the modem was powered up */
+	char *event;
+};
+
+static bool startup_trace;
+
+static const char *atom_type_names[OFONO_ATOM_TYPE_COUNT] = {
+	[OFONO_ATOM_TYPE_DEVINFO] = "devinfo",
+	[OFONO_ATOM_TYPE_CALL_BARRING] = "call-barring",
+	[OFONO_ATOM_TYPE_CALL_FORWARDING] = "call-forwarding",
+	[OFONO_ATOM_TYPE_CALL_METER] = "call-meter",
+	[OFONO_ATOM_TYPE_CALL_SETTINGS] = "call-settings",
+	[OFONO_ATOM_TYPE_NETREG] = "netreg",
+	[OFONO_ATOM_TYPE_PHONEBOOK] = "phonebook",
+	[OFONO_ATOM_TYPE_SMS] = "sms",
+	[OFONO_ATOM_TYPE_SIM] = "sim",
+	[OFONO_ATOM_TYPE_USSD] = "ussd",
+	[OFONO_ATOM_TYPE_VOICECALL] = "voicecall",
+	[OFONO_ATOM_TYPE_HISTORY] = "history",
+	[OFONO_ATOM_TYPE_SSN] = "ssn",
+	[OFONO_ATOM_TYPE_MESSAGE_WAITING] = "message-waiting",
+	[OFONO_ATOM_TYPE_CBS] = "cbs",
+	[OFONO_ATOM_TYPE_CALL_VOLUME] = "call-volume",
+	[OFONO_ATOM_TYPE_GPRS] = "gprs",
+	[OFONO_ATOM_TYPE_GPRS_CONTEXT] = "gprs-context",
+	[OFONO_ATOM_TYPE_RADIO_SETTINGS] = "radio-settings",
+	[OFONO_ATOM_TYPE_AUDIO_SETTINGS] = "audio-settings",
+	[OFONO_ATOM_TYPE_STK] = "stk",
+	[OFONO_ATOM_TYPE_NETTIME] = "nettime",
+	[OFONO_ATOM_TYPE_CTM] = "ctm",
+	[OFONO_ATOM_TYPE_CDMA_VOICECALL_MANAGER] = "cdma-voicecall",
+	[OFONO_ATOM_TYPE_CDMA_CONNMAN] = "cdma-connman",
+	[OFONO_ATOM_TYPE_SIM_AUTH] = "sim-auth",
+	[OFONO_ATOM_TYPE_EMULATOR_DUN] = "emulator-dun",
+	[OFONO_ATOM_TYPE_EMULATOR_HFP] = "emulator-hfp",
+	[OFONO_ATOM_TYPE_LOCATION_REPORTING] = "location-reporting",
+	[OFONO_ATOM_TYPE_GNSS] = "gnss",
+	[OFONO_ATOM_TYPE_CDMA_SMS] = "cdma-sms",
+	[OFONO_ATOM_TYPE_CDMA_NETREG] = "cdma-netreg",
+	[OFONO_ATOM_TYPE_HANDSFREE] = "handsfree",
+	[OFONO_ATOM_TYPE_SIRI] = "siri",
+	[OFONO_ATOM_TYPE_NETMON] = "netmon",
+	[OFONO_ATOM_TYPE_LTE] = "lte",
+	[OFONO_ATOM_TYPE_IMS] = "ims",
+};
+
+const char *__ofono_atom_type_name(enum ofono_atom_type type)
+{
+	return atom_type_names[type];
+}
+
+static const char *modem_state_names[MODEM_STATE_COUNT] = {
+	[MODEM_STATE_POWER_OFF] = "power-off",
+	[MODEM_STATE_PRE_SIM] = "pre-sim",
+	[MODEM_STATE_OFFLINE] = "offline",
+	[MODEM_STATE_ONLINE] = "online",
+};
+
+void __ofono_modem_set_startup_trace(bool enable)
+{
+	startup_trace = enable;
+}
+
+static void startup_event_free(void *data)
+{
+	struct startup_event *event = data;
+
+	l_free(event->event);
+	l_free(event);
+}
+
+static void startup_trace_start(struct ofono_modem *modem)
+{
+	if (!startup_trace)
+		return;
+
+	l_queue_destroy(modem->startup_trace, startup_event_free);
+	modem->startup_trace = l_queue_new();
+	modem->startup_time = l_time_now();
+}
+
+static void startup_trace_add(struct ofono_modem *modem, const char *format,
+				...) __attribute__((format(printf, 2, 3)));
+
+static void startup_trace_add(struct ofono_modem *modem, const char *format,
+				...)
+{
+	struct startup_event *event;
+	va_list args;
+
+	if (!modem->startup_trace ||
+			l_queue_length(modem->startup_trace) >=
+						STARTUP_TRACE_MAX_EVENTS)
+		return;
+
+	event = l_new(struct startup_event, 1);
+	event->usec = l_time_diff(modem->startup_time, l_time_now());
+
+	va_start(args, format);
+	event->event = l_strdup_vprintf(format, args);
+	va_end(args);
+
+	DBG("%s: +%" PRIu64 " us %s", modem->path, event->usec, event->event);
+
+	l_queue_push_tail(modem->startup_trace, event);
+}
+
 static const char *modem_type_to_string(enum ofono_modem_type type)
 {
 	switch (type) {
@@ -229,8 +347,9 @@ struct ofono_voicecall *ofono_modem_get_voicecall(struct ofono_modem *modem)
 	return __ofono_atom_find(OFONO_ATOM_TYPE_VOICECALL, modem);
 }
 
-struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
+static struct ofono_atom *modem_add_atom(struct ofono_modem *modem,
 					enum ofono_atom_type type,
+					enum modem_state modem_state,
 					void (*destruct)(struct ofono_atom *),
 					void *data)
 {
@@ -242,28 +361,48 @@ struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
 	atom = g_new0(struct ofono_atom, 1);
 
 	atom->type = type;
-	atom->modem_state = modem->modem_state;
+	atom->modem_state = modem_state;
 	atom->destruct = destruct;
 	atom->data = data;
 	atom->modem = modem;
 
-	modem->atoms = g_slist_prepend(modem->atoms, atom);
+	modem->atoms[modem_state] = g_slist_prepend(modem->atoms[modem_state],
+							atom);
+	modem->atoms_by_type[type] = g_slist_prepend(
+						modem->atoms_by_type[type],
+						atom);
+
+	startup_trace_add(modem, "%s created", atom_type_names[type]);
 
 	return atom;
 }
 
-struct ofono_atom *__ofono_modem_add_atom_offline(struct ofono_modem *modem,
+static void modem_remove_atom(struct ofono_modem *modem,
+				struct ofono_atom *atom)
+{
+	modem->atoms[atom->modem_state] =
+		g_slist_remove(modem->atoms[atom->modem_state], atom);
+	modem->atoms_by_type[atom->type] =
+		g_slist_remove(modem->atoms_by_type[atom->type], atom);
+}
+
+struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
 					enum ofono_atom_type type,
 					void (*destruct)(struct ofono_atom *),
 					void *data)
 {
-	struct ofono_atom *atom;
-
-	atom = __ofono_modem_add_atom(modem, type, destruct, data);
+	if (modem == NULL)
+		return NULL;
 
-	atom->modem_state = MODEM_STATE_OFFLINE;
+	return modem_add_atom(modem, type, modem->modem_state, destruct, data);
+}
 
-	return atom;
+struct ofono_atom *__ofono_modem_add_atom_offline(struct ofono_modem *modem,
+					enum ofono_atom_type type,
+					void (*destruct)(struct ofono_atom *),
+					void *data)
+{
+	return modem_add_atom(modem, type, MODEM_STATE_OFFLINE, destruct, data);
 }
 
 void *__ofono_atom_get_data(struct ofono_atom *atom)
@@ -285,19 +424,19 @@ static void call_watches(struct ofono_atom *atom,
 				enum ofono_atom_watch_condition cond)
 {
 	struct ofono_modem *modem = atom->modem;
-	GSList *atom_watches = modem->atom_watches->items;
-	GSList *l;
-	struct atom_watch *watch;
+	struct ofono_watchlist *watchlist = modem->atom_watches[atom->type];
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 	ofono_atom_watch_func notify;
 
-	for (l = atom_watches; l; l = l->next) {
-		watch = l->data;
+	if (watchlist == NULL)
+		return;
 
-		if (watch->type != atom->type)
-			continue;
+	__ofono_watchlist_iter_init(&iter, watchlist);
 
-		notify = watch->item.notify;
-		notify(atom, cond, watch->item.notify_data);
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		notify = item->notify;
+		notify(atom, cond, item->notify_data);
 	}
 }
 
@@ -309,6 +448,10 @@ void __ofono_atom_register(struct ofono_atom *atom,
 
 	atom->unregister = unregister;
 
+	/* Atoms register once the driver has answered its probe queries */
+	startup_trace_add(atom->modem, "%s registered",
+				atom_type_names[atom->type]);
+
 	call_watches(atom, OFONO_ATOM_WATCH_CONDITION_REGISTERED);
 }
 
@@ -328,6 +471,10 @@ gboolean __ofono_atom_get_registered(struct ofono_atom *atom)
 	return atom->unregister ? TRUE : FALSE;
 }
 
+/*
+ * Each atom type has its own watchlist, the type is folded into the watch
+ * id handed out so that removal goes straight to the right list.
+ */
 unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 					enum ofono_atom_type type,
 					ofono_atom_watch_func notify,
@@ -338,35 +485,48 @@ unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
 	GSList *l;
 	struct ofono_atom *atom;
 
-	if (notify == NULL)
+	if (notify == NULL || type >= OFONO_ATOM_TYPE_COUNT)
 		return 0;
 
+	if (modem->atom_watches[type] == NULL)
+		modem->atom_watches[type] = __ofono_watchlist_new(g_free);
+
 	watch = g_new0(struct atom_watch, 1);
 
-	watch->type = type;
 	watch->item.notify = notify;
 	watch->item.destroy = destroy;
 	watch->item.notify_data = data;
 
-	id = __ofono_watchlist_add_item(modem->atom_watches,
+	id = __ofono_watchlist_add_item(modem->atom_watches[type],
 					(struct ofono_watchlist_item *)watch);
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type != type || atom->unregister == NULL)
+		if (atom->unregister == NULL)
 			continue;
 
 		notify(atom, OFONO_ATOM_WATCH_CONDITION_REGISTERED, data);
 	}
 
-	return id;
+	return (id - 1) * OFONO_ATOM_TYPE_COUNT + type + 1;
 }
 
 gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
 						unsigned int id)
 {
-	return __ofono_watchlist_remove_item(modem->atom_watches, id);
+	unsigned int type;
+
+	if (id == 0)
+		return FALSE;
+
+	type = (id - 1) % OFONO_ATOM_TYPE_COUNT;
+
+	if (modem->atom_watches[type] == NULL)
+		return FALSE;
+
+	return __ofono_watchlist_remove_item(modem->atom_watches[type],
+				(id - 1) / OFONO_ATOM_TYPE_COUNT + 1);
 }
 
 struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
@@ -378,10 +538,10 @@ struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
 	if (modem == NULL)
 		return NULL;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type == type && atom->unregister != NULL)
+		if (atom->unregister != NULL)
 			return atom;
 	}
 
@@ -393,19 +553,12 @@ void __ofono_modem_foreach_atom(struct ofono_modem *modem,
 				ofono_atom_func callback, void *data)
 {
 	GSList *l;
-	struct ofono_atom *atom;
 
 	if (modem == NULL)
 		return;
 
-	for (l = modem->atoms; l; l = l->next) {
-		atom = l->data;
-
-		if (atom->type != type)
-			continue;
-
-		callback(atom, data);
-	}
+	for (l = modem->atoms_by_type[type]; l; l = l->next)
+		callback(l->data, data);
 }
 
 void __ofono_modem_foreach_registered_atom(struct ofono_modem *modem,
@@ -419,12 +572,9 @@ void __ofono_modem_foreach_registered_atom(struct ofono_modem *modem,
 	if (modem == NULL)
 		return;
 
-	for (l = modem->atoms; l; l = l->next) {
+	for (l = modem->atoms_by_type[type]; l; l = l->next) {
 		atom = l->data;
 
-		if (atom->type != type)
-			continue;
-
 		if (atom->unregister == NULL)
 			continue;
 
@@ -434,9 +584,7 @@ void __ofono_modem_foreach_registered_atom(struct ofono_modem *modem,
 
 void __ofono_atom_free(struct ofono_atom *atom)
 {
-	struct ofono_modem *modem = atom->modem;
-
-	modem->atoms = g_slist_remove(modem->atoms, atom);
+	modem_remove_atom(atom->modem, atom);
 
 	__ofono_atom_unregister(atom);
 
@@ -446,77 +594,97 @@ void __ofono_atom_free(struct ofono_atom *atom)
 	g_free(atom);
 }
 
+/*
+ * Only the buckets of the states being left are visited, the most recently
+ * added atoms of the highest state go first.
+ */
 static void flush_atoms(struct ofono_modem *modem, enum modem_state new_state)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
+	enum modem_state state;
 
 	DBG("");
 
-	prev = NULL;
-	cur = modem->atoms;
+	for (state = MODEM_STATE_ONLINE; state > new_state; state--) {
+		while (modem->atoms[state]) {
+			struct ofono_atom *atom = modem->atoms[state]->data;
 
-	while (cur) {
-		struct ofono_atom *atom = cur->data;
+			modem_remove_atom(modem, atom);
 
-		if (atom->modem_state <= new_state) {
-			prev = cur;
-			cur = cur->next;
-			continue;
+			__ofono_atom_unregister(atom);
+
+			if (atom->destruct)
+				atom->destruct(atom);
+
+			g_free(atom);
 		}
+	}
+}
 
-		if (prev)
-			prev->next = cur->next;
-		else
-			modem->atoms = cur->next;
+/*
+ * Built-in drivers by name, one index per driver section.  A section is
+ * indexed the first time a driver of its type is looked up, and the
+ * first driver of a given name wins, as with a linear search.
+ */
+static struct l_hashmap *builtin_sections;
 
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+static struct l_hashmap *builtin_index_new(
+				const struct ofono_driver_desc *start,
+				const struct ofono_driver_desc *stop)
+{
+	struct l_hashmap *index = l_hashmap_string_new();
+	const struct ofono_driver_desc *desc;
 
-		__ofono_atom_unregister(atom);
+	for (desc = start; desc < stop; desc++) {
+		if (!desc->name || !desc->driver)
+			continue;
 
-		if (atom->destruct)
-			atom->destruct(atom);
+		if (l_hashmap_lookup(index, desc->name))
+			continue;
 
-		g_free(atom);
+		l_hashmap_insert(index, desc->name, (void *) desc->driver);
 	}
+
+	return index;
+}
+
+static void builtin_index_free(void *data)
+{
+	l_hashmap_destroy(data, NULL);
 }
 
 const void *__ofono_driver_builtin_find(const char *name,
 				const struct ofono_driver_desc *start,
 				const struct ofono_driver_desc *stop)
 {
-	const struct ofono_driver_desc *desc;
+	struct l_hashmap *index;
 
 	if (!name)
 		return NULL;
 
-	for (desc = start; desc < stop; desc++) {
-		if (!desc->name || !desc->driver)
-			continue;
+	if (!builtin_sections)
+		builtin_sections = l_hashmap_new();
 
-		if (strcmp(desc->name, name))
-			continue;
-
-		return desc->driver;
+	index = l_hashmap_lookup(builtin_sections, start);
+	if (!index) {
+		index = builtin_index_new(start, stop);
+		l_hashmap_insert(builtin_sections, start, index);
 	}
 
-	return NULL;
+	return l_hashmap_lookup(index, name);
 }
 
 static void notify_online_watches(struct ofono_modem *modem)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_modem_online_notify_func notify;
 
 	if (modem->online_watches == NULL)
 		return;
 
-	for (l = modem->online_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(&iter, modem->online_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 		notify(modem, modem->online, item->notify_data);
 	}
@@ -524,15 +692,16 @@ static void notify_online_watches(struct ofono_modem *modem)
 
 static void notify_powered_watches(struct ofono_modem *modem)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_modem_powered_notify_func notify;
 
 	if (modem->powered_watches == NULL)
 		return;
 
-	for (l = modem->powered_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(&iter, modem->powered_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 		notify(modem, modem->powered, item->notify_data);
 	}
@@ -568,6 +737,8 @@ static void modem_change_state(struct ofono_modem *modem,
 
 	modem->modem_state = new_state;
 
+	startup_trace_add(modem, "state %s", modem_state_names[new_state]);
+
 	if (old_state > new_state)
 		flush_atoms(modem, new_state);
 
@@ -650,17 +821,7 @@ void __ofono_modem_remove_powered_watch(struct ofono_modem *modem,
 
 static gboolean modem_has_sim(struct ofono_modem *modem)
 {
-	GSList *l;
-	struct ofono_atom *atom;
-
-	for (l = modem->atoms; l; l = l->next) {
-		atom = l->data;
-
-		if (atom->type == OFONO_ATOM_TYPE_SIM)
-			return TRUE;
-	}
-
-	return FALSE;
+	return modem->atoms_by_type[OFONO_ATOM_TYPE_SIM] != NULL;
 }
 
 static gboolean modem_is_always_online(struct ofono_modem *modem)
@@ -932,6 +1093,10 @@ static DBusMessage *modem_get_properties(DBusConnection *conn,
 	DBusMessageIter iter;
 	DBusMessageIter dict;
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -944,7 +1109,7 @@ static DBusMessage *modem_get_properties(DBusConnection *conn,
 	__ofono_modem_append_properties(modem, &dict);
 	dbus_message_iter_close_container(&iter, &dict);
 
-	return reply;
+	return __ofono_dbus_cache_reply(msg, reply);
 }
 
 static int set_powered(struct ofono_modem *modem, ofono_bool_t powered)
@@ -965,6 +1130,9 @@ static int set_powered(struct ofono_modem *modem, ofono_bool_t powered)
 		return -EINVAL;
 
 	if (powered == TRUE) {
+		startup_trace_start(modem);
+		startup_trace_add(modem, "enable");
+
 		if (driver->enable)
 			err = driver->enable(modem);
 	} else {
@@ -1223,6 +1391,50 @@ static DBusMessage *modem_set_property(DBusConnection *conn,
 	return __ofono_error_invalid_args(msg);
 }
 
+static DBusMessage *modem_get_startup_trace(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_modem *modem = data;
+	const struct l_queue_entry *entry;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+
+	if (modem->startup_trace == NULL)
+		return __ofono_error_not_available(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+
+	for (entry = l_queue_get_entries(modem->startup_trace); entry;
+						entry = entry->next) {
+		struct startup_event *event = entry->data;
+		DBusMessageIter record;
+		dbus_uint64_t usec = event->usec;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &record);
+		dbus_message_iter_append_basic(&record, DBUS_TYPE_UINT64,
+						&usec);
+		dbus_message_iter_append_basic(&record, DBUS_TYPE_STRING,
+						&event->event);
+		dbus_message_iter_close_container(&array, &record);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
 static const GDBusMethodTable modem_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -1230,6 +1442,9 @@ static const GDBusMethodTable modem_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, modem_set_property) },
+	{ GDBUS_METHOD("GetStartupTrace",
+			NULL, GDBUS_ARGS({ "events", "a(ts)" }),
+			modem_get_startup_trace) },
 	{ }
 };
 
@@ -1301,6 +1516,7 @@ void ofono_modem_set_powered(struct ofono_modem *modem, ofono_bool_t powered)
 					&dbus_powered);
 
 	if (powered) {
+		startup_trace_add(modem, "powered");
 		modem_change_state(modem, MODEM_STATE_PRE_SIM);
 
 		/* Force SIM Ready for devices with no sim atom */
@@ -1683,6 +1899,9 @@ OFONO_DEFINE_ATOM_CREATE(devinfo, OFONO_ATOM_TYPE_DEVINFO)
 static void devinfo_unregister(struct ofono_atom *atom)
 {
 	struct ofono_devinfo *info = __ofono_atom_get_data(atom);
+	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
+
+	__ofono_dbus_invalidate_reply(modem->path, OFONO_MODEM_INTERFACE);
 
 	l_free(info->manufacturer);
 	info->manufacturer = NULL;
@@ -1750,6 +1969,9 @@ static int set_modem_property(struct ofono_modem *modem, const char *name,
 
 	DBG("modem %p property %s", modem, name);
 
+	/* SystemPath is exposed without a change notification */
+	__ofono_dbus_invalidate_reply(modem->path, OFONO_MODEM_INTERFACE);
+
 	if (type != PROPERTY_TYPE_STRING &&
 			type != PROPERTY_TYPE_INTEGER &&
 			type != PROPERTY_TYPE_BOOLEAN)
@@ -1908,6 +2130,7 @@ void ofono_modem_set_capabilities(struct ofono_modem *modem,
 	DBG("%u", capabilities);
 
 	modem->capabilities = capabilities;
+	__ofono_dbus_invalidate_reply(modem->path, OFONO_MODEM_INTERFACE);
 }
 
 struct ofono_modem *ofono_modem_create(const char *name, const char *type)
@@ -1975,6 +2198,9 @@ static int modemwatch_init(void)
 static void modemwatch_cleanup(void)
 {
 	__ofono_watchlist_free(g_modemwatches);
+
+	l_hashmap_destroy(builtin_sections, builtin_index_free);
+	builtin_sections = NULL;
 }
 
 unsigned int __ofono_modemwatch_add(ofono_modemwatch_cb_t cb, void *user,
@@ -2001,15 +2227,15 @@ gboolean __ofono_modemwatch_remove(unsigned int id)
 
 static void call_modemwatches(struct ofono_modem *modem, gboolean added)
 {
-	GSList *l;
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *watch;
 	ofono_modemwatch_cb_t notify;
 
 	DBG("%p added:%d", modem, added);
 
-	for (l = g_modemwatches->items; l; l = l->next) {
-		watch = l->data;
+	__ofono_watchlist_iter_init(&iter, g_modemwatches);
 
+	while ((watch = __ofono_watchlist_iter_next(&iter))) {
 		notify = watch->notify;
 		notify(modem, added, watch->notify_data);
 	}
@@ -2104,7 +2330,6 @@ int ofono_modem_register(struct ofono_modem *modem)
 	l_free(modem->driver_type);
 	modem->driver_type = NULL;
 
-	modem->atom_watches = __ofono_watchlist_new(g_free);
 	modem->online_watches = __ofono_watchlist_new(g_free);
 	modem->powered_watches = __ofono_watchlist_new(g_free);
 
@@ -2133,14 +2358,20 @@ static void emit_modem_removed(struct ofono_modem *modem)
 static void modem_unregister(struct ofono_modem *modem)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
+	unsigned int i;
 
 	DBG("%p", modem);
 
 	if (modem->powered == TRUE)
 		set_powered(modem, FALSE);
 
-	__ofono_watchlist_free(modem->atom_watches);
-	modem->atom_watches = NULL;
+	for (i = 0; i < OFONO_ATOM_TYPE_COUNT; i++) {
+		if (modem->atom_watches[i] == NULL)
+			continue;
+
+		__ofono_watchlist_free(modem->atom_watches[i]);
+		modem->atom_watches[i] = NULL;
+	}
 
 	__ofono_watchlist_free(modem->online_watches);
 	modem->online_watches = NULL;
@@ -2182,6 +2413,7 @@ static void modem_unregister(struct ofono_modem *modem)
 	}
 
 	g_dbus_unregister_interface(conn, modem->path, OFONO_MODEM_INTERFACE);
+	__ofono_dbus_invalidate_reply(modem->path, OFONO_MODEM_INTERFACE);
 
 	if (modem->driver && modem->driver->remove)
 		modem->driver->remove(modem);
@@ -2210,6 +2442,7 @@ void ofono_modem_remove(struct ofono_modem *modem)
 	l_free(modem->driver_type);
 	l_free(modem->name);
 	l_free(modem->path);
+	l_queue_destroy(modem->startup_trace, startup_event_free);
 	g_free(modem);
 }
 
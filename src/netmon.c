@@ -21,13 +21,25 @@
 #include "ofono.h"
 #include "netmonagent.h"
 
-#define CELL_INFO_DICT_APPEND(p_dict, key, info, type, dbus_type)	do { \
-	type value; \
-	if (info < 0) \
-		break; \
-	value = (type) info; \
-	ofono_dbus_dict_append(p_dict, key, dbus_type, &value); \
-} while (0)
+#define DEFAULT_BATCH_INTERVAL 1000
+#define MIN_BATCH_INTERVAL 100
+#define DEFAULT_MAX_RATE 50
+
+/*
+ * Signature of one entry of a CellMeasurements batch, see
+ * doc/networkmonitor-api.txt for the meaning and order of the fields.
+ */
+#define BATCH_CELL_SIGNATURE "(tybssuqqqyyyyyyyyyyi)"
+
+struct netmon_cell {
+	uint64_t timestamp;
+	enum ofono_netmon_cell_type type;
+	bool serving;
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	uint32_t present;	/* bit per enum ofono_netmon_info */
+	int info[OFONO_NETMON_INFO_INVALID];
+};
 
 struct ofono_netmon {
 	const struct ofono_netmon_driver *driver;
@@ -38,6 +50,58 @@ struct ofono_netmon {
 	void *driver_data;
 	struct ofono_atom *atom;
 	struct netmon_agent *agent;
+	unsigned int batch_interval;	/* ms, 0 for one call per report */
+	unsigned int batch_max;
+	unsigned int batch_dropped;
+	struct l_queue *batch;
+	struct l_timeout *batch_timeout;
+	bool batch_neighbours;
+};
+
+static const struct {
+	const char *key;
+	int type;
+} cell_info_keys[] = {
+	[OFONO_NETMON_INFO_LAC] = { "LocationAreaCode", DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_CI] = { "CellId", DBUS_TYPE_UINT32 },
+	[OFONO_NETMON_INFO_ARFCN] = { "ARFCN", DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_BSIC] = { "BSIC", DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_RXLEV] = { "ReceivedSignalStrength",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_BER] = { "BitErrorRate", DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_RSSI] = { "Strength", DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_TIMING_ADVANCE] = { "TimingAdvance",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_PSC] = { "PrimaryScramblingCode",
+							DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_RSCP] = { "ReceivedSignalCodePower",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_ECN0] = { "ReceivedEnergyRatio", DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_RSRQ] = { "ReferenceSignalReceivedQuality",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_RSRP] = { "ReferenceSignalReceivedPower",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_EARFCN] = { "EARFCN", DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_EBAND] = { "EBand", DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_CQI] = { "ChannelQualityIndicator",
+							DBUS_TYPE_BYTE },
+	[OFONO_NETMON_INFO_PCI] = { "PhysicalCellId", DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_TAC] = { "TrackingAreaCode", DBUS_TYPE_UINT16 },
+	[OFONO_NETMON_INFO_SNR] = { "SingalToNoiseRatio", DBUS_TYPE_INT32 },
+};
+
+/* Measurement bytes of a batch entry, in signature order */
+static const enum ofono_netmon_info batch_bytes[] = {
+	OFONO_NETMON_INFO_RXLEV,
+	OFONO_NETMON_INFO_BER,
+	OFONO_NETMON_INFO_RSSI,
+	OFONO_NETMON_INFO_TIMING_ADVANCE,
+	OFONO_NETMON_INFO_RSCP,
+	OFONO_NETMON_INFO_ECN0,
+	OFONO_NETMON_INFO_RSRQ,
+	OFONO_NETMON_INFO_RSRP,
+	OFONO_NETMON_INFO_EBAND,
+	OFONO_NETMON_INFO_CQI,
 };
 
 static const char *cell_type_to_tech_name(enum ofono_netmon_cell_type type)
@@ -54,175 +118,271 @@ static const char *cell_type_to_tech_name(enum ofono_netmon_cell_type type)
 	return NULL;
 }
 
-static void netmon_cell_info_dict_append(DBusMessageIter *dict,
-					va_list *arglist, int info_type)
+static bool cell_has(const struct netmon_cell *cell,
+					enum ofono_netmon_info info)
+{
+	return cell->present & (1U << info);
+}
+
+/* Negative values mean unknown for everything but the signed SNR */
+static void netmon_cell_parse(struct netmon_cell *cell, va_list *arglist,
+				int info_type)
 {
-	char *mcc;
-	char *mnc;
-	int intval;
 	enum ofono_netmon_info next_info_type = info_type;
+	const char *str;
+	int intval;
 
 	while (next_info_type != OFONO_NETMON_INFO_INVALID) {
 		switch (next_info_type) {
 		case OFONO_NETMON_INFO_MCC:
-			mcc = va_arg(*arglist, char *);
+			str = va_arg(*arglist, char *);
 
-			if (mcc && strlen(mcc))
-				ofono_dbus_dict_append(dict,
-						"MobileCountryCode",
-						DBUS_TYPE_STRING, &mcc);
+			if (str)
+				l_strlcpy(cell->mcc, str, sizeof(cell->mcc));
 			break;
 
 		case OFONO_NETMON_INFO_MNC:
-			mnc = va_arg(*arglist, char *);
+			str = va_arg(*arglist, char *);
 
-			if (mnc && strlen(mnc))
-				ofono_dbus_dict_append(dict,
-						"MobileNetworkCode",
-						DBUS_TYPE_STRING, &mnc);
+			if (str)
+				l_strlcpy(cell->mnc, str, sizeof(cell->mnc));
 			break;
 
-		case OFONO_NETMON_INFO_LAC:
-			intval = va_arg(*arglist, int);
-
-			CELL_INFO_DICT_APPEND(dict, "LocationAreaCode",
-					intval, uint16_t, DBUS_TYPE_UINT16);
+		case OFONO_NETMON_INFO_INVALID:
 			break;
 
-		case OFONO_NETMON_INFO_CI:
+		default:
 			intval = va_arg(*arglist, int);
 
-			CELL_INFO_DICT_APPEND(dict, "CellId",
-					intval, uint32_t, DBUS_TYPE_UINT32);
-			break;
-
-		case OFONO_NETMON_INFO_ARFCN:
-			intval = va_arg(*arglist, int);
+			if (intval < 0 &&
+					next_info_type != OFONO_NETMON_INFO_SNR)
+				break;
 
-			CELL_INFO_DICT_APPEND(dict, "ARFCN",
-					intval, uint16_t, DBUS_TYPE_UINT16);
+			cell->info[next_info_type] = intval;
+			cell->present |= 1U << next_info_type;
 			break;
+		}
 
-		case OFONO_NETMON_INFO_BSIC:
-				intval = va_arg(*arglist, int);
+		next_info_type = va_arg(*arglist, int);
+	}
+}
 
-			CELL_INFO_DICT_APPEND(dict, "BSIC",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+static void netmon_cell_info_dict_append(DBusMessageIter *dict,
+					const struct netmon_cell *cell)
+{
+	const char *tech = cell_type_to_tech_name(cell->type);
+	const char *str;
+	unsigned int i;
 
-		case OFONO_NETMON_INFO_RXLEV:
-				intval = va_arg(*arglist, int);
+	ofono_dbus_dict_append(dict, "Technology", DBUS_TYPE_STRING, &tech);
 
-			CELL_INFO_DICT_APPEND(dict, "ReceivedSignalStrength",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	if (cell->mcc[0] != '\0') {
+		str = cell->mcc;
+		ofono_dbus_dict_append(dict, "MobileCountryCode",
+						DBUS_TYPE_STRING, &str);
+	}
 
-		case OFONO_NETMON_INFO_TIMING_ADVANCE:
-			intval = va_arg(*arglist, int);
+	if (cell->mnc[0] != '\0') {
+		str = cell->mnc;
+		ofono_dbus_dict_append(dict, "MobileNetworkCode",
+						DBUS_TYPE_STRING, &str);
+	}
 
-			CELL_INFO_DICT_APPEND(dict, "TimingAdvance",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	for (i = 0; i < L_ARRAY_SIZE(cell_info_keys); i++) {
+		uint8_t byte;
+		uint16_t u16;
+		uint32_t u32;
+		int32_t i32;
 
-		case OFONO_NETMON_INFO_PSC:
-			intval = va_arg(*arglist, int);
+		if (cell_info_keys[i].key == NULL || !cell_has(cell, i))
+			continue;
 
-			CELL_INFO_DICT_APPEND(dict, "PrimaryScramblingCode",
-					intval, uint16_t, DBUS_TYPE_UINT16);
+		switch (cell_info_keys[i].type) {
+		case DBUS_TYPE_BYTE:
+			byte = cell->info[i];
+			ofono_dbus_dict_append(dict, cell_info_keys[i].key,
+						DBUS_TYPE_BYTE, &byte);
 			break;
-
-		case OFONO_NETMON_INFO_BER:
-			intval = va_arg(*arglist, int);
-
-			CELL_INFO_DICT_APPEND(dict, "BitErrorRate",
-					intval, uint8_t, DBUS_TYPE_BYTE);
+		case DBUS_TYPE_UINT16:
+			u16 = cell->info[i];
+			ofono_dbus_dict_append(dict, cell_info_keys[i].key,
+						DBUS_TYPE_UINT16, &u16);
 			break;
+		case DBUS_TYPE_UINT32:
+			u32 = cell->info[i];
+			ofono_dbus_dict_append(dict, cell_info_keys[i].key,
+						DBUS_TYPE_UINT32, &u32);
+			break;
+		case DBUS_TYPE_INT32:
+			i32 = cell->info[i];
+			ofono_dbus_dict_append(dict, cell_info_keys[i].key,
+						DBUS_TYPE_INT32, &i32);
+			break;
+		}
+	}
+}
 
-		case OFONO_NETMON_INFO_RSSI:
-			intval = va_arg(*arglist, int);
+static int cell_get(const struct netmon_cell *cell,
+			enum ofono_netmon_info info, int unknown)
+{
+	return cell_has(cell, info) ? cell->info[info] : unknown;
+}
 
-			CELL_INFO_DICT_APPEND(dict, "Strength",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+static void cell_to_measring(const struct netmon_cell *cell,
+				struct ofono_measring_cell *rec)
+{
+	unsigned int i;
+
+	memset(rec, 0, sizeof(*rec));
+
+	rec->ci = cell_get(cell, OFONO_NETMON_INFO_CI, UINT32_MAX);
+	rec->snr = cell_get(cell, OFONO_NETMON_INFO_SNR, INT32_MIN);
+	rec->area = cell_get(cell, OFONO_NETMON_INFO_LAC,
+			cell_get(cell, OFONO_NETMON_INFO_TAC, UINT16_MAX));
+	rec->channel = cell_get(cell, OFONO_NETMON_INFO_ARFCN,
+			cell_get(cell, OFONO_NETMON_INFO_EARFCN, UINT16_MAX));
+	rec->code = cell_get(cell, OFONO_NETMON_INFO_BSIC,
+			cell_get(cell, OFONO_NETMON_INFO_PSC,
+				cell_get(cell, OFONO_NETMON_INFO_PCI,
+						UINT16_MAX)));
+	rec->technology = cell->type;
+	rec->serving = cell->serving;
+	memcpy(rec->mcc, cell->mcc, sizeof(rec->mcc));
+	memcpy(rec->mnc, cell->mnc, sizeof(rec->mnc));
+
+	for (i = 0; i < L_ARRAY_SIZE(batch_bytes); i++)
+		rec->measurements[i] = cell_get(cell, batch_bytes[i],
+						UINT8_MAX);
+}
 
-		case OFONO_NETMON_INFO_RSCP:
-			intval = va_arg(*arglist, int);
+static void batch_append_cell(DBusMessageIter *array,
+				const struct netmon_cell *cell)
+{
+	struct ofono_measring_cell rec;
+	DBusMessageIter entry;
+	dbus_bool_t serving = cell->serving;
+	const char *mcc = rec.mcc;
+	const char *mnc = rec.mnc;
+	unsigned int i;
+
+	cell_to_measring(cell, &rec);
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64,
+						&cell->timestamp);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_BYTE,
+						&rec.technology);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &serving);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &mcc);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &mnc);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &rec.ci);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT16, &rec.area);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT16,
+						&rec.channel);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT16, &rec.code);
+
+	for (i = 0; i < L_ARRAY_SIZE(rec.measurements); i++)
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_BYTE,
+						&rec.measurements[i]);
+
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &rec.snr);
+	dbus_message_iter_close_container(array, &entry);
+}
 
-			CELL_INFO_DICT_APPEND(dict, "ReceivedSignalCodePower",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+/* Measurements also go to the shared memory ring, when one is mapped */
+static void measring_write_cell(struct ofono_netmon *netmon,
+				const struct netmon_cell *cell)
+{
+	struct ofono_measring_cell rec;
 
-		case OFONO_NETMON_INFO_ECN0:
-			intval = va_arg(*arglist, int);
+	if (!__ofono_measring_enabled() ||
+			cell_type_to_tech_name(cell->type) == NULL)
+		return;
 
-			CELL_INFO_DICT_APPEND(dict, "ReceivedEnergyRatio",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	cell_to_measring(cell, &rec);
+	__ofono_measring_write(OFONO_MEASRING_CELL,
+				__ofono_atom_get_path(netmon->atom),
+				&rec, sizeof(rec));
+}
 
-		case OFONO_NETMON_INFO_RSRQ:
-			intval = va_arg(*arglist, int);
+/* Over the rate limit the oldest reports give way to the newest */
+static void batch_push(struct ofono_netmon *netmon,
+				const struct netmon_cell *cell)
+{
+	if (l_queue_length(netmon->batch) >= netmon->batch_max) {
+		l_free(l_queue_pop_head(netmon->batch));
+		netmon->batch_dropped += 1;
+	}
 
-			CELL_INFO_DICT_APPEND(dict,
-					"ReferenceSignalReceivedQuality",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	l_queue_push_tail(netmon->batch, l_memdup(cell, sizeof(*cell)));
+}
 
-		case OFONO_NETMON_INFO_RSRP:
-			intval = va_arg(*arglist, int);
+static void batch_flush(struct ofono_netmon *netmon)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	struct netmon_cell *cell;
 
-			CELL_INFO_DICT_APPEND(dict,
-					"ReferenceSignalReceivedPower",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	if (l_queue_isempty(netmon->batch) && netmon->batch_dropped == 0)
+		return;
 
-		case OFONO_NETMON_INFO_EARFCN:
-			intval = va_arg(*arglist, int);
+	msg = netmon_agent_new_method_call(netmon->agent, "CellMeasurements");
+	if (msg == NULL)
+		return;
 
-			CELL_INFO_DICT_APPEND(dict, "EARFCN",
-					intval, uint16_t, DBUS_TYPE_UINT16);
-			break;
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+						BATCH_CELL_SIGNATURE, &array);
 
-		case OFONO_NETMON_INFO_EBAND:
-			intval = va_arg(*arglist, int);
+	while ((cell = l_queue_pop_head(netmon->batch))) {
+		batch_append_cell(&array, cell);
+		l_free(cell);
+	}
 
-			CELL_INFO_DICT_APPEND(dict, "EBand",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+	dbus_message_iter_close_container(&iter, &array);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+						&netmon->batch_dropped);
+	netmon->batch_dropped = 0;
 
-		case OFONO_NETMON_INFO_CQI:
-			intval = va_arg(*arglist, int);
+	netmon_agent_send_no_reply(netmon->agent, msg);
+}
 
-			CELL_INFO_DICT_APPEND(dict, "ChannelQualityIndicator",
-					intval, uint8_t, DBUS_TYPE_BYTE);
-			break;
+static void batch_neighbours_cb(const struct ofono_error *error, void *data)
+{
+	struct ofono_netmon *netmon = data;
 
-		case OFONO_NETMON_INFO_PCI:
-			intval = va_arg(*arglist, int);
+	netmon->batch_neighbours = false;
+}
 
-			CELL_INFO_DICT_APPEND(dict, "PhysicalCellId",
-					intval, uint16_t, DBUS_TYPE_UINT16);
-			break;
+static void batch_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	struct ofono_netmon *netmon = user_data;
 
-		case OFONO_NETMON_INFO_TAC:
-			intval = va_arg(*arglist, int);
+	batch_flush(netmon);
 
-			CELL_INFO_DICT_APPEND(dict, "TrackingAreaCode",
-					intval, uint16_t, DBUS_TYPE_UINT16);
-			break;
+	/* Neighbours are only reported on request, ask for the next batch */
+	if (netmon->driver->neighbouring_cell_update &&
+			!netmon->pending && !netmon->batch_neighbours) {
+		netmon->batch_neighbours = true;
+		netmon->driver->neighbouring_cell_update(netmon,
+						batch_neighbours_cb, netmon);
+	}
 
-		case OFONO_NETMON_INFO_SNR:
-			intval = va_arg(*arglist, int);
+	l_timeout_modify_ms(timeout, netmon->batch_interval);
+}
 
-			ofono_dbus_dict_append(dict, "SingalToNoiseRatio",
-					DBUS_TYPE_INT32, &intval);
-			break;
+static void batch_stop(struct ofono_netmon *netmon)
+{
+	l_timeout_remove(netmon->batch_timeout);
+	netmon->batch_timeout = NULL;
 
-		case OFONO_NETMON_INFO_INVALID:
-			break;
-		}
+	l_queue_destroy(netmon->batch, l_free);
+	netmon->batch = NULL;
 
-		next_info_type = va_arg(*arglist, int);
-	}
+	netmon->batch_interval = 0;
+	netmon->batch_dropped = 0;
 }
 
 void ofono_netmon_serving_cell_notify(struct ofono_netmon *netmon,
@@ -230,38 +390,49 @@ void ofono_netmon_serving_cell_notify(struct ofono_netmon *netmon,
 					int info_type, ...)
 {
 	va_list arglist;
+	struct netmon_cell cell;
 	DBusMessage *agent_notify = NULL;
 	DBusMessageIter iter;
 	DBusMessageIter dict;
-	const char *technology = cell_type_to_tech_name(type);
+
+	if (netmon->pending == NULL && netmon->agent == NULL &&
+			!__ofono_measring_enabled())
+		return;
+
+	memset(&cell, 0, sizeof(cell));
+	cell.timestamp = l_time_now();
+	cell.type = type;
+	cell.serving = true;
+
+	va_start(arglist, info_type);
+	netmon_cell_parse(&cell, &arglist, info_type);
+	va_end(arglist);
+
+	measring_write_cell(netmon, &cell);
 
 	if (netmon->pending != NULL) {
 		netmon->reply = dbus_message_new_method_return(netmon->pending);
 		dbus_message_iter_init_append(netmon->reply, &iter);
-	} else if (netmon->agent != NULL) {
+	} else if (netmon->agent == NULL) {
+		return;
+	} else if (netmon->batch_interval) {
+		if (cell_type_to_tech_name(type) != NULL)
+			batch_push(netmon, &cell);
+
+		return;
+	} else {
 		agent_notify = netmon_agent_new_method_call(netmon->agent,
 					"ServingCellInformationChanged");
 
 		dbus_message_iter_init_append(agent_notify, &iter);
-	} else
-		return;
+	}
 
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					OFONO_PROPERTIES_ARRAY_SIGNATURE,
 					&dict);
 
-	va_start(arglist, info_type);
-
-	if (technology == NULL)
-		goto done;
-
-	ofono_dbus_dict_append(&dict, "Technology",
-						DBUS_TYPE_STRING, &technology);
-
-	netmon_cell_info_dict_append(&dict, &arglist, info_type);
-
-done:
-	va_end(arglist);
+	if (cell_type_to_tech_name(type) != NULL)
+		netmon_cell_info_dict_append(&dict, &cell);
 
 	dbus_message_iter_close_container(&iter, &dict);
 
@@ -340,18 +511,45 @@ static void agent_removed_cb(gpointer user_data)
 	struct ofono_netmon *netmon = user_data;
 
 	netmon->agent = NULL;
+	batch_stop(netmon);
 
 	netmon->driver->enable_periodic_update(netmon, 0, 0,
 						periodic_updates_disabled_cb,
 						NULL);
 }
 
+static DBusMessage *register_agent(struct ofono_netmon *netmon,
+					DBusMessage *msg,
+					const char *agent_path,
+					unsigned int period)
+{
+	const unsigned int enable = 1;
+
+	if (!dbus_validate_path(agent_path, NULL))
+		return __ofono_error_invalid_format(msg);
+
+	if (!period)
+		return __ofono_error_invalid_args(msg);
+
+	netmon->agent = netmon_agent_new(agent_path,
+					dbus_message_get_sender(msg));
+
+	if (netmon->agent == NULL)
+		return __ofono_error_failed(msg);
+
+	netmon_agent_set_removed_notify(netmon->agent, agent_removed_cb, netmon);
+
+	netmon->driver->enable_periodic_update(netmon, enable, period,
+					periodic_updates_enabled_cb, netmon);
+
+	return dbus_message_new_method_return(msg);
+}
+
 static DBusMessage *netmon_register_agent(DBusConnection *conn,
 				DBusMessage *msg, void *data)
 {
 	struct ofono_netmon *netmon = data;
 	const char *agent_path;
-	const unsigned int enable = 1;
 	unsigned int period;
 
 	if (netmon->agent)
@@ -366,28 +564,89 @@ static DBusMessage *netmon_register_agent(DBusConnection *conn,
 				DBUS_TYPE_INVALID) == FALSE)
 		return __ofono_error_invalid_args(msg);
 
-	if (!dbus_validate_path(agent_path, NULL))
-		return __ofono_error_invalid_format(msg);
-
-	if (!period)
-		return __ofono_error_invalid_args(msg);
-
 	/* minimum period is 5 seconds, to avoid frequent updates*/
-	if (period < 5)
+	if (period && period < 5)
 		period = 5;
 
-	netmon->agent = netmon_agent_new(agent_path,
-					dbus_message_get_sender(msg));
+	return register_agent(netmon, msg, agent_path, period);
+}
 
-	if (netmon->agent == NULL)
-		return __ofono_error_failed(msg);
+static bool parse_batch_options(DBusMessageIter *iter,
+				unsigned int *interval, unsigned int *rate)
+{
+	DBusMessageIter dict;
 
-	netmon_agent_set_removed_notify(netmon->agent, agent_removed_cb, netmon);
+	dbus_message_iter_recurse(iter, &dict);
 
-	netmon->driver->enable_periodic_update(netmon, enable, period,
-					periodic_updates_enabled_cb, netmon);
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
 
-	return dbus_message_new_method_return(msg);
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (dbus_message_iter_get_arg_type(&value) != DBUS_TYPE_UINT32)
+			return false;
+
+		if (!strcmp(key, "BatchInterval"))
+			dbus_message_iter_get_basic(&value, interval);
+		else if (!strcmp(key, "MaxRate"))
+			dbus_message_iter_get_basic(&value, rate);
+		else
+			return false;
+
+		dbus_message_iter_next(&dict);
+	}
+
+	return true;
+}
+
+/*
+ * Batched variant of RegisterAgent, reports are collected and handed to
+ * the agent's CellMeasurements method once per batch interval.
+ */
+static DBusMessage *netmon_register_batch_agent(DBusConnection *conn,
+				DBusMessage *msg, void *data)
+{
+	struct ofono_netmon *netmon = data;
+	DBusMessageIter iter;
+	const char *agent_path;
+	unsigned int period;
+	unsigned int interval = DEFAULT_BATCH_INTERVAL;
+	unsigned int rate = DEFAULT_MAX_RATE;
+	DBusMessage *reply;
+
+	if (netmon->agent)
+		return __ofono_error_busy(msg);
+
+	if (!netmon->driver->enable_periodic_update)
+		return __ofono_error_not_implemented(msg);
+
+	dbus_message_iter_init(msg, &iter);
+	dbus_message_iter_get_basic(&iter, &agent_path);
+	dbus_message_iter_next(&iter);
+	dbus_message_iter_get_basic(&iter, &period);
+	dbus_message_iter_next(&iter);
+
+	if (!parse_batch_options(&iter, &interval, &rate))
+		return __ofono_error_invalid_args(msg);
+
+	if (interval < MIN_BATCH_INTERVAL || rate == 0)
+		return __ofono_error_invalid_args(msg);
+
+	reply = register_agent(netmon, msg, agent_path, period);
+	if (netmon->agent == NULL)
+		return reply;
+
+	netmon->batch_interval = interval;
+	netmon->batch_max = MAX((uint64_t) rate * interval / 1000, 1U);
+	netmon->batch = l_queue_new();
+	netmon->batch_timeout = l_timeout_create_ms(interval,
+						batch_timeout_cb, netmon, NULL);
+
+	return reply;
 }
 
 static DBusMessage *netmon_unregister_agent(DBusConnection *conn,
@@ -422,13 +681,30 @@ void ofono_netmon_neighbouring_cell_notify(struct ofono_netmon *netmon,
 					int info_type, ...)
 {
 	va_list arglist;
+	struct netmon_cell cell;
 	DBusMessageIter dict;
 	DBusMessageIter strct;
-	const char *tech = cell_type_to_tech_name(type);
 
-	if (netmon->pending == NULL)
+	if (netmon->pending == NULL && !netmon->batch_neighbours)
 		return;
 
+	memset(&cell, 0, sizeof(cell));
+	cell.timestamp = l_time_now();
+	cell.type = type;
+
+	va_start(arglist, info_type);
+	netmon_cell_parse(&cell, &arglist, info_type);
+	va_end(arglist);
+
+	measring_write_cell(netmon, &cell);
+
+	if (netmon->batch_neighbours) {
+		if (netmon->batch && cell_type_to_tech_name(type) != NULL)
+			batch_push(netmon, &cell);
+
+		return;
+	}
+
 	if (!netmon->reply) {
 		netmon->reply = dbus_message_new_method_return(netmon->pending);
 		dbus_message_iter_init_append(netmon->reply, &netmon->iter);
@@ -444,26 +720,14 @@ void ofono_netmon_neighbouring_cell_notify(struct ofono_netmon *netmon,
 					&netmon->arr);
 	}
 
-	tech = cell_type_to_tech_name(type);
-
 	dbus_message_iter_open_container(&netmon->arr, DBUS_TYPE_STRUCT,
 						NULL, &strct);
 	dbus_message_iter_open_container(&strct, DBUS_TYPE_ARRAY,
 					OFONO_PROPERTIES_ARRAY_SIGNATURE,
 					&dict);
 
-	va_start(arglist, info_type);
-
-	if (tech == NULL)
-		goto done;
-
-	ofono_dbus_dict_append(&dict, "Technology",
-					DBUS_TYPE_STRING, &tech);
-
-	netmon_cell_info_dict_append(&dict, &arglist, info_type);
-
-done:
-	va_end(arglist);
+	if (cell_type_to_tech_name(type) != NULL)
+		netmon_cell_info_dict_append(&dict, &cell);
 
 	dbus_message_iter_close_container(&strct, &dict);
 	dbus_message_iter_close_container(&netmon->arr, &strct);
@@ -508,7 +772,7 @@ static DBusMessage *netmon_get_neighbouring_cell_info(DBusConnection *conn,
 	if (!netmon->driver->neighbouring_cell_update)
 		return __ofono_error_not_implemented(msg);
 
-	if (netmon->pending)
+	if (netmon->pending || netmon->batch_neighbours)
 		return __ofono_error_busy(msg);
 
 	netmon->pending = dbus_message_ref(msg);
@@ -526,6 +790,10 @@ static const GDBusMethodTable netmon_methods[] = {
 	{ GDBUS_METHOD("RegisterAgent",
 			GDBUS_ARGS({ "path", "o"}, { "period", "u"}), NULL,
 			netmon_register_agent) },
+	{ GDBUS_METHOD("RegisterAgent",
+			GDBUS_ARGS({ "path", "o"}, { "period", "u"},
+					{ "options", "a{sv}" }), NULL,
+			netmon_register_batch_agent) },
 	{ GDBUS_METHOD("UnregisterAgent",
 			GDBUS_ARGS({ "agent", "o" }), NULL,
 			netmon_unregister_agent) },
@@ -540,6 +808,9 @@ static void netmon_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 	const char *path = __ofono_atom_get_path(atom);
+	struct ofono_netmon *netmon = __ofono_atom_get_data(atom);
+
+	netmon_agent_free(netmon->agent);
 
 	ofono_modem_remove_interface(modem, OFONO_NETMON_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_NETMON_INTERFACE);
@@ -11,7 +11,9 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <errno.h>
+#include <stdlib.h>
 
 #include <glib.h>
 #include <gdbus.h>
@@ -27,6 +29,8 @@
 #define SETTINGS_STORE "netreg"
 #define SETTINGS_GROUP "Settings"
 
+#define DEFAULT_SCAN_CACHE_LIFETIME 600
+
 #define NETWORK_REGISTRATION_FLAG_HOME_SHOW_PLMN	0x1
 #define NETWORK_REGISTRATION_FLAG_ROAMING_SHOW_SPN	0x2
 #define NETWORK_REGISTRATION_FLAG_READING_PNN		0x4
@@ -49,21 +53,64 @@ struct ofono_netreg {
 	struct ofono_network_registration_ops *ops;
 	int flags;
 	DBusMessage *pending;
+	bool scanning;
+	unsigned int scan_id;
+	uint64_t scan_time;
+	unsigned int scan_cache_lifetime;
 	int signal_strength;
+	int reported_strength;
+	unsigned int strength_hysteresis;
 	struct sim_spdi *spdi;
 	struct sim_eons *eons;
+	uint8_t *eons_raw;		/* EFpnn and EFopl records being read */
+	size_t eons_raw_len;
+	unsigned int pnn_records;
+	uint16_t pnn_record_length;
+	uint16_t opl_record_length;
+	bool pnn_has_name;
 	struct ofono_sim *sim;
 	struct ofono_sim_context *sim_context;
 	GKeyFile *settings;
 	char *imsi;
 	struct ofono_watchlist *status_watches;
+	struct ofono_netreg_signal signal;
+	struct ofono_netreg_signal signal_thresholds;	/* Set on driver */
+	struct ofono_watchlist *signal_watches;
+	GSList *signal_subscribers;
 	const struct ofono_netreg_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
+	struct ofono_memtag *memtag;
+	unsigned int trim_id;
 	unsigned int hfp_watch;
 	unsigned int spn_watch;
 };
 
+struct signal_watch {
+	struct ofono_watchlist_item item;
+	struct ofono_netreg_signal deltas;
+	struct ofono_netreg_signal reported;
+};
+
+/* A D-Bus client subscribed to signal quality changes */
+struct signal_subscriber {
+	struct ofono_netreg *netreg;
+	char *sender;
+	guint disconnect_watch;
+	unsigned int watch_id;
+};
+
+static const struct {
+	const char *name;
+	size_t offset;
+} signal_metrics[] = {
+	{ "RSSI", offsetof(struct ofono_netreg_signal, rssi) },
+	{ "RSRP", offsetof(struct ofono_netreg_signal, rsrp) },
+	{ "RSRQ", offsetof(struct ofono_netreg_signal, rsrq) },
+	{ "SINR", offsetof(struct ofono_netreg_signal, sinr) },
+	{ "ECIO", offsetof(struct ofono_netreg_signal, ecio) },
+};
+
 struct network_operator_data {
 	char name[OFONO_MAX_OPERATOR_NAME_LENGTH + 1];
 	char mcc[OFONO_MAX_MCC_LENGTH + 1];
@@ -72,6 +119,7 @@ struct network_operator_data {
 	unsigned int techs;
 	const struct sim_eons_operator_info *eons_info;
 	struct ofono_netreg *netreg;
+	unsigned int scan_id;
 };
 
 static const char *registration_mode_to_string(int mode)
@@ -220,11 +268,12 @@ static void register_callback(const struct ofono_error *error, void *data)
 }
 
 static struct network_operator_data *
-	network_operator_create(const struct ofono_network_operator *op)
+	network_operator_create(struct ofono_netreg *netreg,
+				const struct ofono_network_operator *op)
 {
 	struct network_operator_data *opd;
 
-	opd = g_new0(struct network_operator_data, 1);
+	opd = __ofono_mem_new0(netreg->memtag, struct network_operator_data, 1);
 
 	memcpy(&opd->name, op->name, sizeof(opd->name));
 	memcpy(&opd->mcc, op->mcc, sizeof(opd->mcc));
@@ -242,7 +291,7 @@ static void network_operator_destroy(gpointer user_data)
 {
 	struct network_operator_data *op = user_data;
 
-	g_free(op);
+	__ofono_mem_free(op);
 }
 
 static gint network_operator_compare(gconstpointer a, gconstpointer b)
@@ -656,109 +705,78 @@ static gboolean network_operator_dbus_unregister(struct ofono_netreg *netreg,
 					OFONO_NETWORK_OPERATOR_INTERFACE);
 }
 
-static GSList *compress_operator_list(const struct ofono_network_operator *list,
-					int total)
+/*
+ * Scan results are merged into the operator list as they are reported,
+ * whether partial or final.  Every operator seen is stamped with the id
+ * of the running scan, so the final result only has to drop the ones the
+ * scan did not report.
+ */
+static struct network_operator_data *merge_operator(
+					struct ofono_netreg *netreg,
+					const struct ofono_network_operator *op)
 {
-	GSList *oplist = 0;
-	GSList *o;
-	int i;
 	struct network_operator_data *opd;
+	GSList *o;
 
-	for (i = 0; i < total; i++) {
-		o = NULL;
-
-		if (list[i].mcc[0] == '\0' || list[i].mnc[0] == '\0')
-			continue;
+	if (op->mcc[0] == '\0' || op->mnc[0] == '\0')
+		return NULL;
 
-		if (oplist)
-			o = g_slist_find_custom(oplist, &list[i],
-						network_operator_compare);
+	o = g_slist_find_custom(netreg->operator_list, op,
+					network_operator_compare);
+	if (o == NULL) {
+		opd = network_operator_create(netreg, op);
 
-		if (o == NULL) {
-			opd = network_operator_create(&list[i]);
-			oplist = g_slist_prepend(oplist, opd);
-		} else if (o && list[i].tech != -1) {
-			opd = o->data;
-			opd->techs |= 1 << list[i].tech;
+		if (!network_operator_dbus_register(netreg, opd)) {
+			__ofono_mem_free(opd);
+			return NULL;
 		}
+
+		opd->scan_id = netreg->scan_id;
+		netreg->operator_list = g_slist_append(netreg->operator_list,
+							opd);
+		return opd;
 	}
 
-	if (oplist)
-		oplist = g_slist_reverse(oplist);
+	opd = o->data;
 
-	return oplist;
-}
+	/* Further entries of the same scan only add technologies */
+	if (opd->scan_id == netreg->scan_id) {
+		if (op->tech != -1)
+			set_network_operator_techs(opd,
+						opd->techs | 1 << op->tech);
 
-static gboolean update_operator_list(struct ofono_netreg *netreg, int total,
-				const struct ofono_network_operator *list)
-{
-	GSList *n = NULL;
-	GSList *o;
-	GSList *compressed;
-	GSList *c;
-	struct network_operator_data *current_op = NULL;
-	gboolean changed = FALSE;
+		return opd;
+	}
 
-	compressed = compress_operator_list(list, total);
+	opd->scan_id = netreg->scan_id;
+	set_network_operator_status(opd, op->status);
+	set_network_operator_techs(opd, op->tech != -1 ? 1 << op->tech : 0);
+	set_network_operator_name(opd, op->name);
 
-	for (c = compressed; c; c = c->next) {
-		struct network_operator_data *copd = c->data;
+	return opd;
+}
 
-		o = g_slist_find_custom(netreg->operator_list, copd,
-					network_operator_data_compare);
+static void prune_operator_list(struct ofono_netreg *netreg)
+{
+	GSList *o = netreg->operator_list;
 
-		if (o) { /* Update and move to a new list */
-			set_network_operator_status(o->data, copd->status);
-			set_network_operator_techs(o->data, copd->techs);
-			set_network_operator_name(o->data, copd->name);
+	while (o) {
+		struct network_operator_data *opd = o->data;
+		GSList *next = o->next;
 
-			n = g_slist_prepend(n, o->data);
+		if (opd->scan_id != netreg->scan_id &&
+				opd != netreg->current_operator) {
 			netreg->operator_list =
-				g_slist_remove(netreg->operator_list, o->data);
-		} else {
-			/* New operator */
-			struct network_operator_data *opd;
-
-			opd = g_memdup2(copd,
-					sizeof(struct network_operator_data));
-
-			if (!network_operator_dbus_register(netreg, opd)) {
-				g_free(opd);
-				continue;
-			}
+				g_slist_delete_link(netreg->operator_list, o);
 
-			n = g_slist_prepend(n, opd);
-			changed = TRUE;
+			if (opd->mcc[0] == '\0' && opd->mnc[0] == '\0')
+				__ofono_mem_free(opd);
+			else
+				network_operator_dbus_unregister(netreg, opd);
 		}
-	}
-
-	g_slist_free_full(compressed, g_free);
-
-	if (n)
-		n = g_slist_reverse(n);
 
-	if (netreg->operator_list)
-		changed = TRUE;
-
-	for (o = netreg->operator_list; o; o = o->next) {
-		struct network_operator_data *op = o->data;
-		if (op != op->netreg->current_operator)
-			network_operator_dbus_unregister(netreg, op);
-		else
-			current_op = op;
-	}
-
-	if (current_op) {
-		n = g_slist_prepend(n, current_op);
-		netreg->operator_list =
-			g_slist_remove(netreg->operator_list, current_op);
+		o = next;
 	}
-
-	g_slist_free(netreg->operator_list);
-
-	netreg->operator_list = n;
-
-	return changed;
 }
 
 static DBusMessage *network_get_properties(DBusConnection *conn,
@@ -773,6 +791,10 @@ static DBusMessage *network_get_properties(DBusConnection *conn,
 	const char *operator;
 	const char *mode = registration_mode_to_string(netreg->mode);
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -836,7 +858,7 @@ static DBusMessage *network_get_properties(DBusConnection *conn,
 
 	dbus_message_iter_close_container(&iter, &dict);
 
-	return reply;
+	return __ofono_dbus_cache_reply(msg, reply);
 }
 
 static DBusMessage *network_register(DBusConnection *conn,
@@ -923,25 +945,16 @@ static void append_operator_struct_list(struct ofono_netreg *netreg,
 	dbus_free_string_array(children);
 }
 
-static void operator_list_callback(const struct ofono_error *error, int total,
-				const struct ofono_network_operator *list,
-				void *data)
+static DBusMessage *operator_list_reply(struct ofono_netreg *netreg,
+						DBusMessage *msg)
 {
-	struct ofono_netreg *netreg = data;
 	DBusMessage *reply;
 	DBusMessageIter iter;
 	DBusMessageIter array;
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		DBG("Error occurred during operator list");
-		__ofono_dbus_pending_reply(&netreg->pending,
-					__ofono_error_failed(netreg->pending));
-		return;
-	}
-
-	update_operator_list(netreg, total, list);
-
-	reply = dbus_message_new_method_return(netreg->pending);
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
 
 	dbus_message_iter_init_append(reply, &iter);
 
@@ -958,13 +971,87 @@ static void operator_list_callback(const struct ofono_error *error, int total,
 	append_operator_struct_list(netreg, &array);
 	dbus_message_iter_close_container(&iter, &array);
 
+	return reply;
+}
+
+static void operator_list_callback(const struct ofono_error *error, int total,
+				const struct ofono_network_operator *list,
+				void *data)
+{
+	struct ofono_netreg *netreg = data;
+	DBusMessage *reply;
+	int i;
+
+	netreg->scanning = false;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		DBG("Error occurred during operator list");
+		__ofono_dbus_pending_reply(&netreg->pending,
+					__ofono_error_failed(netreg->pending));
+		return;
+	}
+
+	for (i = 0; i < total; i++)
+		merge_operator(netreg, &list[i]);
+
+	prune_operator_list(netreg);
+	netreg->scan_time = l_time_now();
+
+	reply = operator_list_reply(netreg, netreg->pending);
 	__ofono_dbus_pending_reply(&netreg->pending, reply);
 }
 
+/*
+ * A previous scan result can be reused while it is younger than the age
+ * the caller accepts.  Changes of the serving cell, the location area or
+ * the registration status discard it, as does the configured lifetime.
+ */
+static bool scan_cache_valid(struct ofono_netreg *netreg,
+					unsigned int max_age)
+{
+	uint64_t age;
+
+	if (netreg->scan_time == 0 || max_age == 0)
+		return false;
+
+	age = l_time_to_secs(l_time_diff(netreg->scan_time, l_time_now()));
+
+	if (netreg->scan_cache_lifetime && age >= netreg->scan_cache_lifetime)
+		netreg->scan_time = 0;
+
+	return netreg->scan_time != 0 && age < max_age;
+}
+
+static void scan_cache_invalidate(struct ofono_netreg *netreg)
+{
+	netreg->scan_time = 0;
+}
+
+/*
+ * Operators found by a scan that went unused are dropped, along with their
+ * D-Bus objects, as if the next scan had not seen them.  The current
+ * operator stays.
+ */
+static void netreg_trim(uint64_t before, void *user_data)
+{
+	struct ofono_netreg *netreg = user_data;
+
+	if (netreg->pending || netreg->scan_time == 0 ||
+					netreg->scan_time >= before)
+		return;
+
+	if (++netreg->scan_id == 0)
+		netreg->scan_id = 1;
+
+	prune_operator_list(netreg);
+	scan_cache_invalidate(netreg);
+}
+
 static DBusMessage *network_scan(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
 	struct ofono_netreg *netreg = data;
+	dbus_uint32_t max_age = 0;
 
 	if (netreg->mode == NETWORK_REGISTRATION_MODE_AUTO_ONLY)
 		return __ofono_error_access_denied(msg);
@@ -975,39 +1062,466 @@ static DBusMessage *network_scan(DBusConnection *conn,
 	if (netreg->driver->list_operators == NULL)
 		return __ofono_error_not_implemented(msg);
 
+	if (dbus_message_has_signature(msg, DBUS_TYPE_UINT32_AS_STRING))
+		dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &max_age,
+					DBUS_TYPE_INVALID);
+
+	if (scan_cache_valid(netreg, max_age)) {
+		DBG("reusing scan result");
+		return operator_list_reply(netreg, msg);
+	}
+
 	netreg->pending = dbus_message_ref(msg);
+	netreg->scanning = true;
+
+	/* Zero is left to operators that were never part of a scan */
+	if (++netreg->scan_id == 0)
+		netreg->scan_id = 1;
 
 	netreg->driver->list_operators(netreg, operator_list_callback, netreg);
 
 	return NULL;
 }
 
+static DBusMessage *network_cancel_scan(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_netreg *netreg = data;
+
+	if (!netreg->scanning)
+		return __ofono_error_not_active(msg);
+
+	if (netreg->driver->cancel_list_operators == NULL)
+		return __ofono_error_not_implemented(msg);
+
+	netreg->driver->cancel_list_operators(netreg);
+	netreg->scanning = false;
+	scan_cache_invalidate(netreg);
+
+	/* Operators reported so far are kept */
+	__ofono_dbus_pending_reply(&netreg->pending,
+				__ofono_error_canceled(netreg->pending));
+
+	return dbus_message_new_method_return(msg);
+}
+
+static void emit_operator_found(struct ofono_netreg *netreg,
+				struct network_operator_data *opd)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path;
+	DBusMessage *signal;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+
+	signal = dbus_message_new_signal(__ofono_atom_get_path(netreg->atom),
+					OFONO_NETWORK_REGISTRATION_INTERFACE,
+					"OperatorFound");
+	if (signal == NULL)
+		return;
+
+	path = network_operator_build_path(netreg, opd->mcc, opd->mnc);
+
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &path);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+	append_operator_properties(opd, &dict);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	g_dbus_send_message(conn, signal);
+}
+
+void ofono_netreg_operator_list_notify(struct ofono_netreg *netreg,
+				int total,
+				const struct ofono_network_operator *list)
+{
+	int i;
+
+	if (netreg == NULL || !netreg->scanning)
+		return;
+
+	DBG("%d operators", total);
+
+	for (i = 0; i < total; i++) {
+		struct network_operator_data *opd;
+
+		opd = merge_operator(netreg, &list[i]);
+		if (opd)
+			emit_operator_found(netreg, opd);
+	}
+}
+
 static DBusMessage *network_get_operators(DBusConnection *conn,
 						DBusMessage *msg, void *data)
 {
 	struct ofono_netreg *netreg = data;
+
+	return operator_list_reply(netreg, msg);
+}
+
+static int signal_get(const struct ofono_netreg_signal *signal,
+							unsigned int metric)
+{
+	return *(const int *) ((const char *) signal +
+					signal_metrics[metric].offset);
+}
+
+static void signal_set(struct ofono_netreg_signal *signal,
+					unsigned int metric, int value)
+{
+	*(int *) ((char *) signal + signal_metrics[metric].offset) = value;
+}
+
+static bool signal_watch_should_report(const struct signal_watch *watch,
+				const struct ofono_netreg_signal *signal)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(signal_metrics); i++) {
+		int delta = signal_get(&watch->deltas, i);
+		int old = signal_get(&watch->reported, i);
+		int new = signal_get(signal, i);
+
+		if (delta == 0 || old == new)
+			continue;
+
+		if (old == OFONO_NETREG_SIGNAL_UNKNOWN ||
+				new == OFONO_NETREG_SIGNAL_UNKNOWN)
+			return true;
+
+		if (abs(new - old) >= delta)
+			return true;
+	}
+
+	return false;
+}
+
+static void signal_thresholds_cb(const struct ofono_error *error, void *data)
+{
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		ofono_warn("Setting signal reporting thresholds failed");
+}
+
+/*
+ * The modem is asked for the finest reporting any watch wants, every
+ * watch then only hears about the changes it asked for.
+ */
+static void signal_thresholds_update(struct ofono_netreg *netreg)
+{
+	struct ofono_netreg_signal thresholds;
+	struct ofono_watchlist_iter iter;
+	const struct signal_watch *watch;
+	unsigned int i;
+
+	memset(&thresholds, 0, sizeof(thresholds));
+
+	__ofono_watchlist_iter_init(&iter, netreg->signal_watches);
+
+	while ((watch = __ofono_watchlist_iter_next(&iter))) {
+
+		for (i = 0; i < L_ARRAY_SIZE(signal_metrics); i++) {
+			int delta = signal_get(&watch->deltas, i);
+			int cur = signal_get(&thresholds, i);
+
+			if (delta && (cur == 0 || delta < cur))
+				signal_set(&thresholds, i, delta);
+		}
+	}
+
+	if (!memcmp(&thresholds, &netreg->signal_thresholds,
+						sizeof(thresholds)))
+		return;
+
+	netreg->signal_thresholds = thresholds;
+
+	DBG("rssi %d rsrp %d rsrq %d sinr %d ecio %d", thresholds.rssi,
+			thresholds.rsrp, thresholds.rsrq, thresholds.sinr,
+			thresholds.ecio);
+
+	if (netreg->driver->set_signal_thresholds == NULL)
+		return;
+
+	netreg->driver->set_signal_thresholds(netreg, &thresholds,
+						signal_thresholds_cb, netreg);
+}
+
+unsigned int __ofono_netreg_add_signal_watch(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *deltas,
+				ofono_netreg_signal_notify_cb_t notify,
+				void *data, ofono_destroy_func destroy)
+{
+	struct signal_watch *watch;
+	unsigned int id;
+
+	DBG("%p", netreg);
+
+	if (netreg == NULL || netreg->signal_watches == NULL)
+		return 0;
+
+	if (notify == NULL)
+		return 0;
+
+	watch = g_new0(struct signal_watch, 1);
+	watch->deltas = *deltas;
+	watch->reported = netreg->signal;
+	watch->item.notify = notify;
+	watch->item.notify_data = data;
+	watch->item.destroy = destroy;
+
+	id = __ofono_watchlist_add_item(netreg->signal_watches,
+					(struct ofono_watchlist_item *) watch);
+
+	signal_thresholds_update(netreg);
+	notify(&netreg->signal, data);
+
+	return id;
+}
+
+gboolean __ofono_netreg_remove_signal_watch(struct ofono_netreg *netreg,
+						unsigned int id)
+{
+	DBG("%p", netreg);
+
+	if (!__ofono_watchlist_remove_item(netreg->signal_watches, id))
+		return FALSE;
+
+	signal_thresholds_update(netreg);
+
+	return TRUE;
+}
+
+void ofono_netreg_signal_notify(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *signal)
+{
+	struct ofono_watchlist_iter iter;
+	struct signal_watch *watch;
+
+	if (!memcmp(&netreg->signal, signal, sizeof(*signal)))
+		return;
+
+	DBG("rssi %d rsrp %d rsrq %d sinr %d ecio %d", signal->rssi,
+			signal->rsrp, signal->rsrq, signal->sinr, signal->ecio);
+
+	netreg->signal = *signal;
+
+	if (netreg->signal_watches == NULL)
+		return;
+
+	__ofono_watchlist_iter_init(&iter, netreg->signal_watches);
+
+	while ((watch = __ofono_watchlist_iter_next(&iter))) {
+		ofono_netreg_signal_notify_cb_t notify = watch->item.notify;
+
+		if (!signal_watch_should_report(watch, signal))
+			continue;
+
+		watch->reported = *signal;
+		notify(signal, watch->item.notify_data);
+	}
+}
+
+static void append_signal_dict(DBusMessageIter *iter,
+				const struct ofono_netreg_signal *signal)
+{
+	DBusMessageIter dict;
+	unsigned int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	for (i = 0; i < L_ARRAY_SIZE(signal_metrics); i++) {
+		int32_t value = signal_get(signal, i);
+
+		if (value == OFONO_NETREG_SIGNAL_UNKNOWN)
+			continue;
+
+		ofono_dbus_dict_append(&dict, signal_metrics[i].name,
+					DBUS_TYPE_INT32, &value);
+	}
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+static void signal_subscriber_notify(const struct ofono_netreg_signal *signal,
+					void *data)
+{
+	struct signal_subscriber *sub = data;
+	DBusMessage *msg;
+	DBusMessageIter iter;
+
+	msg = dbus_message_new_signal(__ofono_atom_get_path(sub->netreg->atom),
+					OFONO_NETWORK_REGISTRATION_INTERFACE,
+					"SignalQualityChanged");
+	if (msg == NULL)
+		return;
+
+	/* Only the subscriber gets it, with its own thresholds applied */
+	dbus_message_set_destination(msg, sub->sender);
+
+	dbus_message_iter_init_append(msg, &iter);
+	append_signal_dict(&iter, signal);
+
+	g_dbus_send_message(ofono_dbus_get_connection(), msg);
+}
+
+static void signal_subscriber_free(struct signal_subscriber *sub)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	sub->netreg->signal_subscribers =
+		g_slist_remove(sub->netreg->signal_subscribers, sub);
+
+	__ofono_netreg_remove_signal_watch(sub->netreg, sub->watch_id);
+
+	if (sub->disconnect_watch)
+		g_dbus_remove_watch(conn, sub->disconnect_watch);
+
+	l_free(sub->sender);
+	g_free(sub);
+}
+
+static void signal_subscriber_disconnect(DBusConnection *conn, void *data)
+{
+	struct signal_subscriber *sub = data;
+
+	DBG("%s", sub->sender);
+
+	sub->disconnect_watch = 0;
+	signal_subscriber_free(sub);
+}
+
+static struct signal_subscriber *signal_subscriber_find(
+						struct ofono_netreg *netreg,
+						const char *sender)
+{
+	GSList *l;
+
+	for (l = netreg->signal_subscribers; l; l = l->next) {
+		struct signal_subscriber *sub = l->data;
+
+		if (!strcmp(sub->sender, sender))
+			return sub;
+	}
+
+	return NULL;
+}
+
+static bool parse_signal_thresholds(DBusMessage *msg,
+					struct ofono_netreg_signal *deltas)
+{
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	bool any = false;
+
+	memset(deltas, 0, sizeof(*deltas));
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return false;
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(&iter) !=
+						DBUS_TYPE_DICT_ENTRY)
+		return false;
+
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry;
+		DBusMessageIter value;
+		const char *key;
+		uint32_t delta;
+		unsigned int i;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (dbus_message_iter_get_arg_type(&value) != DBUS_TYPE_UINT32)
+			return false;
+
+		dbus_message_iter_get_basic(&value, &delta);
+
+		for (i = 0; i < L_ARRAY_SIZE(signal_metrics); i++)
+			if (!strcmp(key, signal_metrics[i].name))
+				break;
+
+		if (i == L_ARRAY_SIZE(signal_metrics) || delta > 100)
+			return false;
+
+		signal_set(deltas, i, delta);
+		any = any || delta;
+
+		dbus_message_iter_next(&dict);
+	}
+
+	return any;
+}
+
+static DBusMessage *network_subscribe_signal(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_netreg *netreg = data;
+	const char *sender = dbus_message_get_sender(msg);
+	struct ofono_netreg_signal deltas;
+	struct signal_subscriber *sub;
+
+	if (!parse_signal_thresholds(msg, &deltas))
+		return __ofono_error_invalid_args(msg);
+
+	sub = signal_subscriber_find(netreg, sender);
+	if (sub) {
+		__ofono_netreg_remove_signal_watch(netreg, sub->watch_id);
+	} else {
+		sub = g_new0(struct signal_subscriber, 1);
+		sub->netreg = netreg;
+		sub->sender = l_strdup(sender);
+		sub->disconnect_watch = g_dbus_add_disconnect_watch(conn,
+						sender,
+						signal_subscriber_disconnect,
+						sub, NULL);
+		netreg->signal_subscribers =
+			g_slist_prepend(netreg->signal_subscribers, sub);
+	}
+
+	sub->watch_id = __ofono_netreg_add_signal_watch(netreg, &deltas,
+						signal_subscriber_notify,
+						sub, NULL);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *network_unsubscribe_signal(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_netreg *netreg = data;
+	struct signal_subscriber *sub;
+
+	sub = signal_subscriber_find(netreg, dbus_message_get_sender(msg));
+	if (sub == NULL)
+		return __ofono_error_not_found(msg);
+
+	signal_subscriber_free(sub);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *network_get_signal(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_netreg *netreg = data;
 	DBusMessage *reply;
 	DBusMessageIter iter;
-	DBusMessageIter array;
 
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
 
 	dbus_message_iter_init_append(reply, &iter);
-
-	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
-					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
-					DBUS_TYPE_OBJECT_PATH_AS_STRING
-					DBUS_TYPE_ARRAY_AS_STRING
-					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
-					DBUS_TYPE_STRING_AS_STRING
-					DBUS_TYPE_VARIANT_AS_STRING
-					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
-					DBUS_STRUCT_END_CHAR_AS_STRING,
-					&array);
-	append_operator_struct_list(netreg, &array);
-	dbus_message_iter_close_container(&iter, &array);
+	append_signal_dict(&iter, &netreg->signal);
 
 	return reply;
 }
@@ -1024,12 +1538,30 @@ static const GDBusMethodTable network_registration_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Scan",
 		NULL, GDBUS_ARGS({ "operators_with_properties", "a(oa{sv})" }),
 		network_scan) },
+	{ GDBUS_ASYNC_METHOD("Scan",
+		GDBUS_ARGS({ "max_age", "u" }),
+		GDBUS_ARGS({ "operators_with_properties", "a(oa{sv})" }),
+		network_scan) },
+	{ GDBUS_METHOD("CancelScan", NULL, NULL, network_cancel_scan) },
+	{ GDBUS_METHOD("GetSignalQuality",
+			NULL, GDBUS_ARGS({ "signal", "a{sv}" }),
+			network_get_signal) },
+	{ GDBUS_METHOD("SubscribeSignalQuality",
+			GDBUS_ARGS({ "thresholds", "a{sv}" }), NULL,
+			network_subscribe_signal) },
+	{ GDBUS_METHOD("UnsubscribeSignalQuality", NULL, NULL,
+			network_unsubscribe_signal) },
 	{ }
 };
 
 static const GDBusSignalTable network_registration_signals[] = {
 	{ GDBUS_SIGNAL("PropertyChanged",
 			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("OperatorFound",
+			GDBUS_ARGS({ "path", "o" },
+					{ "properties", "a{sv}" })) },
+	{ GDBUS_SIGNAL("SignalQualityChanged",
+			GDBUS_ARGS({ "signal", "a{sv}" })) },
 	{ }
 };
 
@@ -1040,6 +1572,7 @@ static void set_registration_status(struct ofono_netreg *netreg, int status)
 	DBusConnection *conn = ofono_dbus_get_connection();
 
 	netreg->status = status;
+	scan_cache_invalidate(netreg);
 
 	ofono_dbus_signal_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
@@ -1057,6 +1590,7 @@ static void set_registration_location(struct ofono_netreg *netreg, int lac)
 		return;
 
 	netreg->location = lac;
+	scan_cache_invalidate(netreg);
 
 	if (netreg->location == -1)
 		return;
@@ -1074,6 +1608,7 @@ static void set_registration_cellid(struct ofono_netreg *netreg, int ci)
 	dbus_uint32_t dbus_ci = ci;
 
 	netreg->cellid = ci;
+	scan_cache_invalidate(netreg);
 
 	if (netreg->cellid == -1)
 		return;
@@ -1157,8 +1692,8 @@ gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
 
 static void notify_status_watches(struct ofono_netreg *netreg)
 {
+	struct ofono_watchlist_iter iter;
 	struct ofono_watchlist_item *item;
-	GSList *l;
 	ofono_netreg_status_notify_cb_t notify;
 	const char *mcc = NULL;
 	const char *mnc = NULL;
@@ -1171,8 +1706,9 @@ static void notify_status_watches(struct ofono_netreg *netreg)
 		mnc = netreg->current_operator->mnc;
 	}
 
-	for (l = netreg->status_watches->items; l; l = l->next) {
-		item = l->data;
+	__ofono_watchlist_iter_init(&iter, netreg->status_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 
 		notify(netreg->status, netreg->location, netreg->cellid,
@@ -1250,11 +1786,11 @@ static void current_operator_callback(const struct ofono_error *error,
 	if (current) {
 		struct network_operator_data *opd;
 
-		opd = network_operator_create(current);
+		opd = network_operator_create(netreg, current);
 
 		if (opd->mcc[0] != '\0' && opd->mnc[0] != '\0' &&
 				!network_operator_dbus_register(netreg, opd)) {
-			g_free(opd);
+			__ofono_mem_free(opd);
 			return;
 		} else
 			opd->netreg = netreg;
@@ -1367,6 +1903,7 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 					signal_strength_callback, netreg);
 	} else {
 		struct ofono_error error;
+		struct ofono_netreg_signal signal;
 
 		error.type = OFONO_ERROR_TYPE_NO_ERROR;
 		error.error = 0;
@@ -1375,6 +1912,13 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 		__ofono_netreg_set_base_station_name(netreg, NULL);
 
 		netreg->signal_strength = -1;
+		netreg->reported_strength = -1;
+		__ofono_dbus_invalidate_reply(
+					__ofono_atom_get_path(netreg->atom),
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
+
+		ofono_netreg_signal_init(&signal);
+		ofono_netreg_signal_notify(netreg, &signal);
 	}
 
 	notify_status_watches(netreg);
@@ -1388,10 +1932,13 @@ void ofono_netreg_time_notify(struct ofono_netreg *netreg,
 	if (info == NULL)
 		return;
 
-	DBG("net time %d-%02d-%02d %02d:%02d:%02d utcoff %d dst %d",
-	    info->year, info->mon, info->mday,
-	    info->hour, info->min, info->sec,
-	    info->utcoff, info->dst);
+	if (info->received == 0)
+		info->received = l_time_now();
+
+	DBG("net time %d-%02d-%02d %02d:%02d:%02d utcoff %d dst %d age %" PRIu64
+		"us", info->year, info->mon, info->mday,
+		info->hour, info->min, info->sec, info->utcoff, info->dst,
+		l_time_diff(info->received, l_time_now()));
 
 	__ofono_nettime_info_received(modem, info);
 }
@@ -1511,6 +2058,23 @@ static void notify_emulator_strength(struct ofono_atom *atom, void *data)
 	ofono_emulator_set_indicator(em, OFONO_EMULATOR_IND_SIGNAL, val);
 }
 
+/*
+ * Small fluctuations of the strength are not worth a signal to every
+ * client on the bus.  Only report once the value has moved by at least the
+ * hysteresis, or has reached either end of the scale.
+ */
+static bool strength_should_report(struct ofono_netreg *netreg, int strength)
+{
+	if (netreg->strength_hysteresis == 0 || netreg->reported_strength < 0)
+		return true;
+
+	if (strength == 0 || strength == 100)
+		return true;
+
+	return (unsigned int) abs(strength - netreg->reported_strength) >=
+						netreg->strength_hysteresis;
+}
+
 void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
@@ -1533,11 +2097,27 @@ void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 
 	netreg->signal_strength = strength;
 
+	/* Changes held back by the hysteresis are not signalled */
+	__ofono_dbus_invalidate_reply(__ofono_atom_get_path(netreg->atom),
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
+
 	if (strength != -1) {
 		const char *path = __ofono_atom_get_path(netreg->atom);
 		unsigned char strength_byte = netreg->signal_strength;
+		int32_t value = strength;
 
-		ofono_dbus_signal_property_changed(conn, path,
+		__ofono_measring_write(OFONO_MEASRING_SIGNAL_STRENGTH, path,
+					&value, sizeof(value));
+
+		if (strength_should_report(netreg, strength)) {
+			netreg->reported_strength = strength;
+			ofono_dbus_signal_property_changed(conn, path,
+					OFONO_NETWORK_REGISTRATION_INTERFACE,
+					"Strength", DBUS_TYPE_BYTE,
+					&strength_byte);
+		} else
+			__ofono_dbus_signal_property_changed_full_rate(conn,
+					path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
 					"Strength", DBUS_TYPE_BYTE,
 					&strength_byte);
@@ -1550,32 +2130,101 @@ void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 				GINT_TO_POINTER(netreg->signal_strength));
 }
 
-static void sim_opl_read_cb(int ok, int length, int record,
-				const unsigned char *data,
-				int record_length, void *user_data)
+/* Shared EONS of distinct PNN and OPL file pairs */
+#define EONS_CACHE_ENTRIES 8
+
+static void *eons_cache_ref(void *value)
 {
-	struct ofono_netreg *netreg = user_data;
-	int total;
-	GSList *l;
+	return sim_eons_ref(value);
+}
+
+static void eons_cache_unref(void *value)
+{
+	sim_eons_unref(value);
+}
 
-	if (!ok) {
-		if (record > 0)
-			goto optimize;
+static void eons_raw_append(struct ofono_netreg *netreg,
+				const void *data, size_t len)
+{
+	netreg->eons_raw = l_realloc(netreg->eons_raw,
+					netreg->eons_raw_len + len);
+	memcpy(netreg->eons_raw + netreg->eons_raw_len, data, len);
+	netreg->eons_raw_len += len;
+}
 
+static void eons_raw_reset(struct ofono_netreg *netreg)
+{
+	l_free(netreg->eons_raw);
+	netreg->eons_raw = NULL;
+	netreg->eons_raw_len = 0;
+	netreg->pnn_records = 0;
+	netreg->pnn_record_length = 0;
+	netreg->opl_record_length = 0;
+	netreg->pnn_has_name = false;
+}
+
+static struct sim_eons *eons_decode(struct ofono_netreg *netreg,
+							size_t len)
+{
+	const uint8_t *pnn = netreg->eons_raw;
+	size_t pnn_len = (size_t) netreg->pnn_records *
+						netreg->pnn_record_length;
+	const uint8_t *opl = pnn + pnn_len;
+	size_t opl_len = len - pnn_len;
+	struct sim_eons *eons = sim_eons_new(netreg->pnn_records);
+	unsigned int i;
+
+	for (i = 0; i < netreg->pnn_records; i++)
+		sim_eons_add_pnn_record(eons, i + 1,
+					pnn + i * netreg->pnn_record_length,
+					netreg->pnn_record_length);
+
+	for (i = 0; netreg->opl_record_length &&
+			(i + 1) * netreg->opl_record_length <= opl_len; i++)
+		sim_eons_add_opl_record(eons,
+					opl + i * netreg->opl_record_length,
+					netreg->opl_record_length);
+
+	sim_eons_optimize(eons);
+
+	return eons;
+}
+
+/*
+ * Modems with SIMs of the same operator read the very same EFpnn and
+ * EFopl, so the decoded EONS is shared between them, found by the file
+ * contents.
+ */
+static void eons_read_done(struct ofono_netreg *netreg)
+{
+	uint16_t record_lengths[2] = {
+		netreg->pnn_record_length, netreg->opl_record_length
+	};
+	size_t len = netreg->eons_raw_len;
+	struct ofono_cache *cache;
+	GSList *l;
+
+	if (netreg->pnn_records == 0) {
+		eons_raw_reset(netreg);
 		return;
 	}
 
-	if (record_length < 8 || length < record_length)
-		return;
+	/* The record sizes are part of the key along with the contents */
+	eons_raw_append(netreg, record_lengths, sizeof(record_lengths));
 
-	total = length / record_length;
+	cache = __ofono_cache_get("eons", EONS_CACHE_ENTRIES,
+					eons_cache_ref, eons_cache_unref);
 
-	sim_eons_add_opl_record(netreg->eons, data, record_length);
+	netreg->eons = __ofono_cache_lookup(cache, netreg->eons_raw,
+						netreg->eons_raw_len);
+	if (netreg->eons == NULL) {
+		netreg->eons = eons_decode(netreg, len);
+		__ofono_cache_insert(cache, netreg->eons_raw,
+					netreg->eons_raw_len, netreg->eons);
+	}
 
-	if (record != total)
-		return;
+	eons_raw_reset(netreg);
 
-optimize:
 	for (l = netreg->operator_list; l; l = l->next) {
 		struct network_operator_data *opd = l->data;
 		const struct sim_eons_operator_info *eons_info;
@@ -1586,6 +2235,36 @@ optimize:
 	}
 }
 
+static void sim_opl_read_cb(int ok, int length, int record,
+				const unsigned char *data,
+				int record_length, void *user_data)
+{
+	struct ofono_netreg *netreg = user_data;
+	int total;
+
+	/* EFpnn changed meanwhile and is being read again */
+	if (netreg->pnn_records == 0 ||
+			(netreg->flags & NETWORK_REGISTRATION_FLAG_READING_PNN))
+		return;
+
+	if (!ok)
+		goto done;
+
+	if (record_length < 8 || length < record_length)
+		goto done;
+
+	total = length / record_length;
+
+	netreg->opl_record_length = record_length;
+	eons_raw_append(netreg, data, record_length);
+
+	if (record != total)
+		return;
+
+done:
+	eons_read_done(netreg);
+}
+
 static void sim_pnn_read_cb(int ok, int length, int record,
 				const unsigned char *data,
 				int record_length, void *user_data)
@@ -1601,10 +2280,14 @@ static void sim_pnn_read_cb(int ok, int length, int record,
 
 	total = length / record_length;
 
-	if (netreg->eons == NULL)
-		netreg->eons = sim_eons_new(total);
+	if (netreg->pnn_records == 0)
+		netreg->pnn_record_length = record_length;
 
-	sim_eons_add_pnn_record(netreg->eons, record, data, record_length);
+	eons_raw_append(netreg, data, record_length);
+	netreg->pnn_records += 1;
+
+	if (sim_pnn_record_has_name(data, record_length))
+		netreg->pnn_has_name = true;
 
 	if (record != total)
 		return;
@@ -1618,10 +2301,12 @@ check:
 	 * still be used for the HPLMN and/or EHPLMN, if PNN
 	 * is present.
 	 */
-	if (netreg->eons && !sim_eons_pnn_is_empty(netreg->eons))
+	if (netreg->pnn_has_name)
 		ofono_sim_read(netreg->sim_context, SIM_EFOPL_FILEID,
 				OFONO_SIM_FILE_STRUCTURE_FIXED,
 				sim_opl_read_cb, netreg);
+	else
+		eons_read_done(netreg);
 }
 
 static void sim_spdi_read_cb(int ok, int length, int record,
@@ -1757,14 +2442,31 @@ static void netreg_unregister(struct ofono_atom *atom)
 
 	__ofono_modem_remove_atom_watch(modem, netreg->hfp_watch);
 
+	__ofono_memtrim_remove(netreg->trim_id);
+	netreg->trim_id = 0;
+
 	__ofono_watchlist_free(netreg->status_watches);
 	netreg->status_watches = NULL;
 
+	for (l = netreg->signal_subscribers; l; l = l->next) {
+		struct signal_subscriber *sub = l->data;
+
+		g_dbus_remove_watch(conn, sub->disconnect_watch);
+		l_free(sub->sender);
+		g_free(sub);
+	}
+
+	g_slist_free(netreg->signal_subscribers);
+	netreg->signal_subscribers = NULL;
+
+	__ofono_watchlist_free(netreg->signal_watches);
+	netreg->signal_watches = NULL;
+
 	for (l = netreg->operator_list; l; l = l->next) {
 		struct network_operator_data *opd = l->data;
 
 		if (opd->mcc[0] == '\0' && opd->mnc[0] == '\0') {
-			g_free(opd);
+			__ofono_mem_free(opd);
 			continue;
 		}
 
@@ -1773,6 +2475,7 @@ static void netreg_unregister(struct ofono_atom *atom)
 
 	g_slist_free(netreg->operator_list);
 	netreg->operator_list = NULL;
+	scan_cache_invalidate(netreg);
 
 	l_free(netreg->base_station);
 	netreg->base_station = NULL;
@@ -1798,6 +2501,8 @@ static void netreg_unregister(struct ofono_atom *atom)
 
 	g_dbus_unregister_interface(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE);
+	__ofono_dbus_invalidate_reply(path,
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
 	ofono_modem_remove_interface(modem,
 					OFONO_NETWORK_REGISTRATION_INTERFACE);
 }
@@ -1814,18 +2519,31 @@ static void netreg_remove(struct ofono_atom *atom)
 	if (netreg->driver != NULL && netreg->driver->remove != NULL)
 		netreg->driver->remove(netreg);
 
-	sim_eons_free(netreg->eons);
+	sim_eons_unref(netreg->eons);
+	l_free(netreg->eons_raw);
 	sim_spdi_free(netreg->spdi);
 
+	__ofono_memtag_put(netreg->memtag);
 	g_free(netreg);
 }
 
 OFONO_DEFINE_ATOM_CREATE(netreg, OFONO_ATOM_TYPE_NETREG, {
+	atom->memtag = __ofono_memtag_get(modem, OFONO_ATOM_TYPE_NETREG);
 	atom->status = NETWORK_REGISTRATION_STATUS_UNKNOWN;
 	atom->location = -1;
 	atom->cellid = -1;
 	atom->technology = -1;
 	atom->signal_strength = -1;
+	atom->reported_strength = -1;
+	ofono_netreg_signal_init(&atom->signal);
+	l_settings_get_uint(__ofono_get_config(), "NetworkRegistration",
+				"StrengthHysteresis",
+				&atom->strength_hysteresis);
+
+	atom->scan_cache_lifetime = DEFAULT_SCAN_CACHE_LIFETIME;
+	l_settings_get_uint(__ofono_get_config(), "NetworkRegistration",
+				"ScanCacheLifetime",
+				&atom->scan_cache_lifetime);
 })
 
 static void netreg_load_settings(struct ofono_netreg *netreg)
@@ -1903,8 +2621,9 @@ static void sim_pnn_opl_changed(int id, void *userdata)
 	for (l = netreg->operator_list; l; l = l->next)
 		set_network_operator_eons_info(l->data, NULL);
 
-	sim_eons_free(netreg->eons);
+	sim_eons_unref(netreg->eons);
 	netreg->eons = NULL;
+	eons_raw_reset(netreg);
 
 	netreg->flags |= NETWORK_REGISTRATION_FLAG_READING_PNN;
 	ofono_sim_read(netreg->sim_context, SIM_EFPNN_FILEID,
@@ -2007,6 +2726,8 @@ void ofono_netreg_register(struct ofono_netreg *netreg)
 	}
 
 	netreg->status_watches = __ofono_watchlist_new(g_free);
+	netreg->signal_watches = __ofono_watchlist_new(g_free);
+	netreg->trim_id = __ofono_memtrim_add(netreg_trim, netreg);
 
 	ofono_modem_add_interface(modem, OFONO_NETWORK_REGISTRATION_INTERFACE);
 
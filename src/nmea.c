@@ -0,0 +1,366 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ell/ell.h>
+
+#include "nmea.h"
+
+#define NMEA_MAX_FIELDS 24
+#define KNOTS_TO_MPS (1852.0 / 3600.0)
+
+struct nmea_parser {
+	char line[NMEA_MAX_SENTENCE];
+	size_t line_len;
+	bool overflow;
+	struct nmea_fix fix;
+	nmea_sentence_func_t sentence_func;
+	void *sentence_data;
+	nmea_fix_func_t fix_func;
+	void *fix_data;
+};
+
+static void fix_reset(struct nmea_fix *fix)
+{
+	memset(fix, 0, sizeof(*fix));
+
+	fix->latitude = NAN;
+	fix->longitude = NAN;
+	fix->altitude = NAN;
+	fix->speed = NAN;
+	fix->course = NAN;
+	fix->hdop = NAN;
+}
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+static bool parse_double(const char *s, double *out)
+{
+	char *end;
+	double v;
+
+	if (*s == '\0')
+		return false;
+
+	v = strtod(s, &end);
+	if (*end != '\0')
+		return false;
+
+	*out = v;
+	return true;
+}
+
+/* hhmmss with optional fractional seconds */
+static bool parse_time(const char *s, uint32_t *out)
+{
+	double seconds;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+
+	if (!parse_double(s + 4, &seconds))
+		return false;
+
+	*out = ((s[0] - '0') * 10 + s[1] - '0') * 3600000 +
+		((s[2] - '0') * 10 + s[3] - '0') * 60000 +
+		(uint32_t) (seconds * 1000 + 0.5);
+	return true;
+}
+
+/* (d)ddmm.mmmm followed by the hemisphere in its own field */
+static bool parse_coordinate(const char *value, const char *hemisphere,
+				double *out)
+{
+	double v;
+	unsigned int degrees;
+
+	if (!parse_double(value, &v) || v < 0)
+		return false;
+
+	degrees = v / 100;
+	v = degrees + (v - degrees * 100.0) / 60;
+
+	switch (hemisphere[0]) {
+	case 'S':
+	case 'W':
+		v = -v;
+		/* fall through */
+	case 'N':
+	case 'E':
+		break;
+	default:
+		return false;
+	}
+
+	*out = v;
+	return true;
+}
+
+static void parse_position(char **fields, struct nmea_fix *fix)
+{
+	double latitude;
+	double longitude;
+
+	if (!parse_coordinate(fields[0], fields[1], &latitude) ||
+			!parse_coordinate(fields[2], fields[3], &longitude))
+		return;
+
+	fix->latitude = latitude;
+	fix->longitude = longitude;
+}
+
+static bool parse_rmc(char **fields, unsigned int n, struct nmea_fix *fix)
+{
+	double v;
+
+	if (n < 10 || !parse_time(fields[1], &fix->time))
+		return false;
+
+	if (fields[2][0] == 'A')
+		parse_position(fields + 3, fix);
+
+	if (parse_double(fields[7], &v))
+		fix->speed = v * KNOTS_TO_MPS;
+
+	parse_double(fields[8], &fix->course);
+
+	if (strlen(fields[9]) == 6)
+		fix->date = strtoul(fields[9], NULL, 10);
+
+	fix->sentences = NMEA_SENTENCE_RMC;
+	return true;
+}
+
+static bool parse_gga(char **fields, unsigned int n, struct nmea_fix *fix)
+{
+	if (n < 10 || !parse_time(fields[1], &fix->time))
+		return false;
+
+	fix->quality = strtoul(fields[6], NULL, 10);
+	fix->satellites = strtoul(fields[7], NULL, 10);
+
+	if (fix->quality > 0)
+		parse_position(fields + 2, fix);
+
+	parse_double(fields[8], &fix->hdop);
+	parse_double(fields[9], &fix->altitude);
+
+	fix->sentences = NMEA_SENTENCE_GGA;
+	return true;
+}
+
+/*
+ * Parses a single sentence, without line terminator, into fix.  Returns
+ * false for sentences that fail the checksum or are not RMC or GGA.
+ */
+bool nmea_parse_sentence(const char *sentence, size_t len,
+				struct nmea_fix *fix)
+{
+	char buf[NMEA_MAX_SENTENCE];
+	char *fields[NMEA_MAX_FIELDS];
+	unsigned int n = 0;
+	const char *star;
+	unsigned char sum = 0;
+	const char *c;
+	char *p;
+
+	if (len < 7 || len > sizeof(buf) || sentence[0] != '$')
+		return false;
+
+	star = memchr(sentence, '*', len);
+	if (star == NULL || sentence + len - star != 3)
+		return false;
+
+	for (c = sentence + 1; c < star; c++)
+		sum ^= *c;
+
+	if (hex_value(star[1]) < 0 || hex_value(star[2]) < 0 ||
+			(hex_value(star[1]) << 4 | hex_value(star[2])) != sum)
+		return false;
+
+	memcpy(buf, sentence + 1, star - sentence - 1);
+	buf[star - sentence - 1] = '\0';
+
+	for (p = buf; n < NMEA_MAX_FIELDS; *p++ = '\0') {
+		fields[n++] = p;
+
+		p = strchr(p, ',');
+		if (p == NULL)
+			break;
+	}
+
+	/* Any talker, e.g. GP, GL or GN */
+	if (strlen(fields[0]) != 5)
+		return false;
+
+	fix_reset(fix);
+
+	if (!strcmp(fields[0] + 2, "RMC"))
+		return parse_rmc(fields, n, fix);
+
+	if (!strcmp(fields[0] + 2, "GGA"))
+		return parse_gga(fields, n, fix);
+
+	return false;
+}
+
+static void parser_report(struct nmea_parser *parser)
+{
+	parser->fix_func(&parser->fix, parser->fix_data);
+	fix_reset(&parser->fix);
+}
+
+static void parser_merge(struct nmea_parser *parser,
+				const struct nmea_fix *fix)
+{
+	struct nmea_fix *cur = &parser->fix;
+
+	if (cur->sentences && cur->time != fix->time)
+		parser_report(parser);
+
+	cur->time = fix->time;
+	cur->sentences |= fix->sentences;
+
+	if (!isnan(fix->latitude)) {
+		cur->latitude = fix->latitude;
+		cur->longitude = fix->longitude;
+	}
+
+	if (!isnan(fix->altitude))
+		cur->altitude = fix->altitude;
+
+	if (!isnan(fix->speed))
+		cur->speed = fix->speed;
+
+	if (!isnan(fix->course))
+		cur->course = fix->course;
+
+	if (!isnan(fix->hdop))
+		cur->hdop = fix->hdop;
+
+	if (fix->date)
+		cur->date = fix->date;
+
+	if (fix->sentences & NMEA_SENTENCE_GGA) {
+		cur->quality = fix->quality;
+		cur->satellites = fix->satellites;
+	}
+
+	if (cur->sentences == (NMEA_SENTENCE_RMC | NMEA_SENTENCE_GGA))
+		parser_report(parser);
+}
+
+static void parser_line(struct nmea_parser *parser, const char *line,
+								size_t len)
+{
+	struct nmea_fix fix;
+
+	if (len > NMEA_MAX_SENTENCE)
+		return;
+
+	if (parser->sentence_func)
+		parser->sentence_func(line, len, parser->sentence_data);
+
+	while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		len--;
+
+	if (parser->fix_func == NULL || !nmea_parse_sentence(line, len, &fix))
+		return;
+
+	parser_merge(parser, &fix);
+}
+
+void nmea_parser_feed(struct nmea_parser *parser, const void *data,
+								size_t len)
+{
+	const char *p = data;
+	const char *end = p + len;
+
+	while (p < end) {
+		const char *nl = memchr(p, '\n', end - p);
+		size_t n;
+
+		if (nl == NULL) {
+			n = end - p;
+
+			if (parser->line_len + n > sizeof(parser->line))
+				parser->overflow = true;
+			else {
+				memcpy(parser->line + parser->line_len, p, n);
+				parser->line_len += n;
+			}
+
+			return;
+		}
+
+		n = nl - p + 1;
+
+		/* Lines that arrive in one piece are parsed in place */
+		if (parser->line_len == 0 && !parser->overflow)
+			parser_line(parser, p, n);
+		else if (!parser->overflow &&
+				parser->line_len + n <= sizeof(parser->line)) {
+			memcpy(parser->line + parser->line_len, p, n);
+			parser_line(parser, parser->line,
+					parser->line_len + n);
+		}
+
+		parser->line_len = 0;
+		parser->overflow = false;
+		p += n;
+	}
+}
+
+void nmea_parser_set_sentence_func(struct nmea_parser *parser,
+					nmea_sentence_func_t func,
+					void *user_data)
+{
+	parser->sentence_func = func;
+	parser->sentence_data = user_data;
+}
+
+void nmea_parser_set_fix_func(struct nmea_parser *parser,
+				nmea_fix_func_t func, void *user_data)
+{
+	parser->fix_func = func;
+	parser->fix_data = user_data;
+}
+
+struct nmea_parser *nmea_parser_new(void)
+{
+	struct nmea_parser *parser = l_new(struct nmea_parser, 1);
+
+	fix_reset(&parser->fix);
+
+	return parser;
+}
+
+void nmea_parser_free(struct nmea_parser *parser)
+{
+	l_free(parser);
+}
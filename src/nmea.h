@@ -0,0 +1,62 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NMEA_MAX_SENTENCE 128
+
+enum nmea_sentence {
+	NMEA_SENTENCE_RMC = 0x1,
+	NMEA_SENTENCE_GGA = 0x2,
+};
+
+/*
+ * A fix merged from the RMC and GGA sentences of one epoch.  Values that
+ * neither sentence carried are NAN, or 0 for the integer fields.
+ */
+struct nmea_fix {
+	uint32_t time;		/* Milliseconds since midnight UTC */
+	uint32_t date;		/* ddmmyy as sent */
+	double latitude;	/* Degrees, positive north */
+	double longitude;	/* Degrees, positive east */
+	double altitude;	/* Meters above mean sea level */
+	double speed;		/* Meters per second */
+	double course;		/* Degrees from true north */
+	double hdop;
+	uint8_t quality;	/* GGA fix quality, 0 when there is no fix */
+	uint8_t satellites;
+	uint8_t sentences;	/* enum nmea_sentence bits seen */
+};
+
+struct nmea_parser;
+
+/* Called for every complete line, terminator included, as received */
+typedef void (*nmea_sentence_func_t)(const char *line, size_t len,
+							void *user_data);
+typedef void (*nmea_fix_func_t)(const struct nmea_fix *fix, void *user_data);
+
+struct nmea_parser *nmea_parser_new(void);
+void nmea_parser_free(struct nmea_parser *parser);
+
+void nmea_parser_set_sentence_func(struct nmea_parser *parser,
+					nmea_sentence_func_t func,
+					void *user_data);
+void nmea_parser_set_fix_func(struct nmea_parser *parser,
+				nmea_fix_func_t func, void *user_data);
+
+/*
+ * Data can be fed in chunks of any size, partial lines are kept until
+ * the rest arrives.  A fix is reported once both sentences of an epoch
+ * were seen, or when the next epoch starts.
+ */
+void nmea_parser_feed(struct nmea_parser *parser, const void *data,
+								size_t len);
+
+bool nmea_parse_sentence(const char *sentence, size_t len,
+				struct nmea_fix *fix);
@@ -6,6 +6,7 @@
  */
 
 #include <stdarg.h>
+#include <sys/types.h>
 #include <glib.h>
 #include <ell/ell.h>
 
@@ -28,12 +29,66 @@ int __ofono_log_init(const char *program, const char *debug,
 void __ofono_log_cleanup(void);
 void __ofono_log_enable(struct ofono_debug_desc *start,
 					struct ofono_debug_desc *stop);
+unsigned int __ofono_log_set_debug(const char *debug);
+
+typedef void (*ofono_log_ring_func_t)(uint64_t timestamp, int priority,
+					const char *msg, void *user_data);
+
+int __ofono_log_ring_enable(unsigned int entries);
+void __ofono_log_ring_foreach(ofono_log_ring_func_t func, void *user_data);
+
+#include <ofono/trace.h>
+
+int __ofono_trace_init(unsigned int size);
+void __ofono_trace_cleanup(void);
+int __ofono_trace_dump(void);
+
+enum ofono_measring_type {
+	OFONO_MEASRING_SIGNAL_STRENGTH = 1,
+	OFONO_MEASRING_CELL = 2,
+};
+
+/*
+ * Payload of OFONO_MEASRING_CELL.  Unknown values hold the maximum of
+ * their type, INT32_MIN for the signal to noise ratio.
+ */
+struct ofono_measring_cell {
+	uint32_t ci;
+	int32_t snr;
+	uint16_t area;
+	uint16_t channel;
+	uint16_t code;
+	uint8_t technology;
+	uint8_t serving;
+	char mcc[4];
+	char mnc[4];
+	uint8_t measurements[10];
+};
+
+void __ofono_measring_init(unsigned int records);
+void __ofono_measring_cleanup(void);
+ofono_bool_t __ofono_measring_enabled(void);
+int __ofono_measring_get_fd(unsigned int *records);
+void __ofono_measring_write(enum ofono_measring_type type,
+				const char *source,
+				const void *payload, size_t len);
 
 #include <ofono/dbus.h>
 
 int __ofono_dbus_init(DBusConnection *conn);
 void __ofono_dbus_cleanup(void);
 
+int __ofono_dbus_signal_property_changed_full_rate(DBusConnection *conn,
+						const char *path,
+						const char *interface,
+						const char *name,
+						int type, const void *value);
+int __ofono_dbus_set_full_rate(const char *sender, bool enable);
+
+DBusMessage *__ofono_dbus_cached_reply(DBusMessage *msg);
+DBusMessage *__ofono_dbus_cache_reply(DBusMessage *msg, DBusMessage *reply);
+void __ofono_dbus_invalidate_reply(const char *path, const char *interface);
+
 DBusMessage *__ofono_error_invalid_args(DBusMessage *msg);
 DBusMessage *__ofono_error_invalid_format(DBusMessage *msg);
 DBusMessage *__ofono_error_not_implemented(DBusMessage *msg);
@@ -69,10 +124,16 @@ struct ofono_watchlist_item {
 	ofono_destroy_func destroy;
 };
 
-struct ofono_watchlist {
-	int next_id;
-	GSList *items;
-	ofono_destroy_func destroy;
+struct ofono_watchlist;
+
+/*
+ * Walks the items newest first.  Items may be added or removed by the
+ * callbacks, including the one being visited, items added are not part
+ * of the walk.  Walks must be run until next returns NULL.
+ */
+struct ofono_watchlist_iter {
+	struct ofono_watchlist *watchlist;
+	unsigned int pos;
 };
 
 struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy);
@@ -80,8 +141,15 @@ unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item);
 gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id);
+void *__ofono_watchlist_find(struct ofono_watchlist *watchlist,
+					unsigned int id);
+unsigned int __ofono_watchlist_count(struct ofono_watchlist *watchlist);
 void __ofono_watchlist_free(struct ofono_watchlist *watchlist);
 
+void __ofono_watchlist_iter_init(struct ofono_watchlist_iter *iter,
+					struct ofono_watchlist *watchlist);
+void *__ofono_watchlist_iter_next(struct ofono_watchlist_iter *iter);
+
 struct ofono_module_desc {
 	const char *name;
 	int (*init)(void);
@@ -160,6 +228,8 @@ enum ofono_atom_type {
 	OFONO_ATOM_TYPE_IMS,
 };
 
+#define OFONO_ATOM_TYPE_COUNT (OFONO_ATOM_TYPE_IMS + 1)
+
 enum ofono_atom_watch_condition {
 	OFONO_ATOM_WATCH_CONDITION_REGISTERED,
 	OFONO_ATOM_WATCH_CONDITION_UNREGISTERED
@@ -171,6 +241,9 @@ typedef void (*ofono_atom_watch_func)(struct ofono_atom *atom,
 
 typedef void (*ofono_atom_func)(struct ofono_atom *atom, void *data);
 
+void __ofono_modem_set_startup_trace(bool enable);
+const char *__ofono_atom_type_name(enum ofono_atom_type type);
+
 struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
 					enum ofono_atom_type type,
 					void (*destruct)(struct ofono_atom *),
@@ -221,6 +294,83 @@ gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
 
 void __ofono_atom_free(struct ofono_atom *atom);
 
+struct ofono_memtag;
+
+typedef void (*ofono_memstat_func_t)(const char *path, const char *atom,
+					size_t bytes, size_t peak,
+					unsigned int blocks, void *user_data);
+
+void __ofono_memstat_init(unsigned int budget_kib, unsigned int interval,
+					unsigned int trim_interval);
+void __ofono_memstat_cleanup(void);
+void __ofono_memstat_foreach(ofono_memstat_func_t func, void *user_data);
+
+/*
+ * Called once per trim interval, caches last used before the given
+ * l_time_now() timestamp are to be released
+ */
+typedef void (*ofono_memtrim_func_t)(uint64_t before, void *user_data);
+
+unsigned int __ofono_memtrim_add(ofono_memtrim_func_t func, void *user_data);
+void __ofono_memtrim_remove(unsigned int id);
+
+struct ofono_cache;
+
+typedef void *(*ofono_cache_ref_func_t)(void *value);
+typedef void (*ofono_cache_foreach_func_t)(const char *name,
+					unsigned int entries,
+					uint64_t hits, uint64_t misses,
+					void *user_data);
+
+struct ofono_cache *__ofono_cache_get(const char *name,
+					unsigned int max_entries,
+					ofono_cache_ref_func_t ref,
+					ofono_destroy_func unref);
+void *__ofono_cache_lookup(struct ofono_cache *cache,
+					const void *key, size_t len);
+void __ofono_cache_insert(struct ofono_cache *cache,
+				const void *key, size_t len, void *value);
+void __ofono_cache_foreach(ofono_cache_foreach_func_t func, void *user_data);
+
+enum ofono_telemetry_type {
+	OFONO_TELEMETRY_COUNTER,
+	OFONO_TELEMETRY_HISTOGRAM,
+};
+
+#define OFONO_TELEMETRY_BUCKETS 16
+
+struct ofono_telemetry;
+
+typedef void (*ofono_telemetry_read_func_t)(struct ofono_telemetry *metric,
+						void *user_data);
+
+struct ofono_telemetry *__ofono_telemetry_register(struct ofono_modem *modem,
+					const char *name,
+					enum ofono_telemetry_type type);
+void __ofono_telemetry_unregister(struct ofono_telemetry *metric);
+void __ofono_telemetry_set_read_func(struct ofono_telemetry *metric,
+					ofono_telemetry_read_func_t func,
+					void *user_data);
+void __ofono_telemetry_add(struct ofono_telemetry *metric, uint64_t n);
+void __ofono_telemetry_set(struct ofono_telemetry *metric, uint64_t value);
+void __ofono_telemetry_sample(struct ofono_telemetry *metric, uint64_t value);
+
+struct ofono_memtag *__ofono_memtag_get(struct ofono_modem *modem,
+						enum ofono_atom_type type);
+void __ofono_memtag_put(struct ofono_memtag *tag);
+void __ofono_memtag_charge(struct ofono_memtag *tag, ssize_t delta);
+bool __ofono_memtag_over_budget(struct ofono_memtag *tag);
+
+/*
+ * Blocks charged to a tag, they must be freed with __ofono_mem_free().
+ * A NULL tag makes them plain allocations.
+ */
+void *__ofono_mem_alloc0(struct ofono_memtag *tag, size_t size);
+void __ofono_mem_free(void *ptr);
+
+#define __ofono_mem_new0(tag, type, count) \
+	((type *) __ofono_mem_alloc0(tag, sizeof(type) * (count)))
+
 const void *__ofono_driver_builtin_find(const char *name,
 				const struct ofono_driver_desc *start,
 				const struct ofono_driver_desc *stop);
@@ -316,11 +466,44 @@ gboolean __ofono_call_forwarding_is_busy(struct ofono_call_forwarding *cf);
 
 gboolean __ofono_call_settings_is_busy(struct ofono_call_settings *cs);
 
+/*
+ * Interrogations are started through func once a slot on the modem is
+ * free, the owner reports each one back with __ofono_ss_query_done.
+ * Submitting a query that is already pending for the same owner and tag
+ * joins it and returns false.
+ */
+typedef void (*ofono_ss_query_func_t)(void *user_data);
+
+bool __ofono_ss_query_submit(struct ofono_modem *modem, void *owner,
+				unsigned int tag, ofono_ss_query_func_t func,
+				void *user_data);
+void __ofono_ss_query_done(struct ofono_modem *modem, void *owner,
+				unsigned int tag);
+void __ofono_ss_query_cancel(struct ofono_modem *modem, void *owner);
+
 #include <ofono/cbs.h>
 #include <ofono/devinfo.h>
 #include <ofono/phonebook.h>
 #include <ofono/gprs.h>
 #include <ofono/gprs-context.h>
+
+/*
+ * Link watches follow the attach state and the interface of the first
+ * active internet context.  The gateway is NULL on point to point links.
+ * Watches are called right away and then whenever any of these change.
+ */
+typedef void (*ofono_gprs_link_notify_cb_t)(ofono_bool_t attached,
+						const char *interface,
+						const char *gateway,
+						void *data);
+
+unsigned int __ofono_gprs_add_link_watch(struct ofono_gprs *gprs,
+				ofono_gprs_link_notify_cb_t cb,
+				void *data, ofono_destroy_func destroy);
+gboolean __ofono_gprs_remove_link_watch(struct ofono_gprs *gprs,
+					unsigned int id);
+ofono_bool_t __ofono_gprs_activate_internet(struct ofono_gprs *gprs);
+
 #include <ofono/radio-settings.h>
 #include <ofono/audio-settings.h>
 #include <ofono/ctm.h>
@@ -361,6 +544,8 @@ void __ofono_voicecall_tone_cancel(struct ofono_voicecall *vc, int id);
 struct ofono_call *__ofono_voicecall_find_call_with_status(
 				struct ofono_voicecall *vc, int status);
 
+void __ofono_voicecall_audio_connected(void);
+
 #include <ofono/sms.h>
 
 struct sms;
@@ -371,6 +556,7 @@ enum ofono_sms_submit_flag {
 	OFONO_SMS_SUBMIT_FLAG_RETRY =		0x4,
 	OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS =	0x8,
 	OFONO_SMS_SUBMIT_FLAG_REUSE_UUID =	0x10,
+	OFONO_SMS_SUBMIT_FLAG_BULK =		0x20,
 };
 
 typedef void (*ofono_sms_txq_submit_cb_t)(gboolean ok, void *data);
@@ -472,6 +658,7 @@ unsigned char *__ofono_sim_session_get_aid(
 		struct ofono_sim_aid_session *session);
 
 const char *__ofono_sim_get_impi(struct ofono_sim *sim);
+const char *__ofono_sim_get_iccid(struct ofono_sim *sim);
 void __ofono_sim_clear_cached_pins(struct ofono_sim *sim);
 
 #include <ofono/stk.h>
@@ -532,6 +719,23 @@ unsigned int __ofono_netreg_add_status_watch(struct ofono_netreg *netreg,
 gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
 						unsigned int id);
 
+typedef void (*ofono_netreg_signal_notify_cb_t)(
+				const struct ofono_netreg_signal *signal,
+				void *data);
+
+/*
+ * The watch is called with the current signal quality right away and
+ * then whenever one of the metrics it has a non-zero delta for moved by
+ * at least that delta, or appeared or vanished.
+ */
+unsigned int __ofono_netreg_add_signal_watch(struct ofono_netreg *netreg,
+				const struct ofono_netreg_signal *deltas,
+				ofono_netreg_signal_notify_cb_t cb,
+				void *data, ofono_destroy_func destroy);
+
+gboolean __ofono_netreg_remove_signal_watch(struct ofono_netreg *netreg,
+						unsigned int id);
+
 void __ofono_netreg_set_base_station_name(struct ofono_netreg *netreg,
 						const char *name);
 
@@ -583,11 +787,10 @@ void __ofono_nettime_info_received(struct ofono_modem *modem,
 
 #include <ofono/sim-auth.h>
 
-struct provision_db_entry;
+struct provision_db_result;
 bool __ofono_provision_get_settings(const char *mcc,
 				const char *mnc, const char *spn,
-				struct provision_db_entry **settings,
-				size_t *count);
+				struct provision_db_result **settings);
 
 #include <ofono/emulator.h>
 
@@ -613,3 +816,14 @@ ofono_bool_t __ofono_private_network_request(ofono_private_network_cb_t cb,
 #include <ofono/netmon.h>
 #include <ofono/lte.h>
 #include <ofono/ims.h>
+
+typedef void (*ofono_ims_ready_notify_cb_t)(ofono_bool_t voice,
+						ofono_bool_t sms, void *data);
+
+unsigned int __ofono_ims_add_ready_watch(struct ofono_ims *ims,
+					ofono_ims_ready_notify_cb_t notify,
+					void *data, ofono_destroy_func destroy);
+gboolean __ofono_ims_remove_ready_watch(struct ofono_ims *ims,
+					unsigned int id);
+ofono_bool_t __ofono_ims_voice_ready(struct ofono_ims *ims);
+ofono_bool_t __ofono_ims_sms_ready(struct ofono_ims *ims);
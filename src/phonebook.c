@@ -9,11 +9,15 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include <glib.h>
 #include <gdbus.h>
@@ -21,12 +25,27 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "simutil.h"
+#include "storage.h"
 
 #define LEN_MAX 128
 #define TYPE_INTERNATIONAL 145
 
 #define PHONEBOOK_FLAG_CACHED 0x1
 
+/* vCards queued for a stream whose reader does not keep up */
+#define STREAM_MAX_BACKLOG (1024 * 1024)
+
+/*
+ * The last import is kept next to the SIM cache, behind a header of magic,
+ * version, the EFpsc and EFcc counters it was read at and the ICCID
+ */
+#define PHONEBOOK_CACHE_PATH STORAGEDIR "/%s-%i/phonebook"
+#define PHONEBOOK_CACHE_MAGIC "OFPB"
+#define PHONEBOOK_CACHE_VERSION 1
+#define PHONEBOOK_CACHE_HEADER_SIZE 32
+#define PHONEBOOK_COUNTERS_SIZE 6
+
 enum phonebook_number_type {
 	TEL_TYPE_HOME,
 	TEL_TYPE_MOBILE,
@@ -41,7 +60,19 @@ struct ofono_phonebook {
 	int flags;
 	struct l_string *vcards_builder; /* entries with vcard 3.0 format */
 	char *cached_vcards;
+	uint64_t cache_time; /* last use of the cached entries */
+	unsigned char cache_counters[PHONEBOOK_COUNTERS_SIZE];
+	bool cache_has_counters;
+	unsigned char counters[PHONEBOOK_COUNTERS_SIZE]; /* as last read */
+	bool has_counters;
+	bool reading_counters;
+	struct ofono_sim *sim;
+	struct ofono_sim_context *sim_context;
+	unsigned int trim_id;
 	GSList *merge_list; /* cache the entries that may need a merge */
+	struct l_hashmap *merge_index; /* merge_list by contact name */
+	struct phonebook_stream *stream;
+	struct ofono_memtag *memtag;
 	const struct ofono_phonebook_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
@@ -62,7 +93,26 @@ struct phonebook_person {
 	char *sip_uri;
 };
 
+/*
+ * vCards written to a pipe as the entries come in.  The stream is left
+ * to an idle callback to free, so that it can finish from within its own
+ * l_io callbacks, and it outlives the phonebook once detached from it.
+ */
+struct phonebook_stream {
+	struct ofono_phonebook *pb; /* NULL once detached */
+	struct l_io *io;
+	struct l_queue *chunks; /* runs of vCards, as strings */
+	size_t offset; /* already written of the first chunk */
+	size_t backlog;
+	bool done; /* all entries queued */
+	bool closing;
+};
+
 static const char *storage_support[] = { "SM", "ME", NULL };
+
+/* DFphonebook under DFtelecom */
+static const unsigned char phonebook_path[] = { 0x3F, 0x00, 0x7F, 0x10,
+						0x5F, 0x3A };
 static void export_phonebook(struct ofono_phonebook *pb);
 
 /* according to RFC 2425, the output string may need folding */
@@ -232,7 +282,7 @@ static void destroy_number(gpointer pointer)
 {
 	struct phonebook_number *pn = pointer;
 	l_free(pn->number);
-	g_free(pn);
+	__ofono_mem_free(pn);
 }
 
 static void print_merged_entry(gpointer pointer, gpointer user_data)
@@ -260,7 +310,7 @@ static void destroy_merged_entry(gpointer pointer)
 
 	g_slist_free_full(person->number_list, destroy_number);
 
-	g_free(person);
+	__ofono_mem_free(person);
 }
 
 static DBusMessage *generate_export_entries_reply(struct ofono_phonebook *pb,
@@ -308,11 +358,13 @@ static void merge_field_generic(char **str1, const char *str2)
 		*str1 = l_strdup(str2);
 }
 
-static void merge_field_number(GSList **l, const char *number, int type, char c)
+static void merge_field_number(struct ofono_memtag *tag, GSList **l,
+				const char *number, int type, char c)
 {
-	struct phonebook_number *pn = g_new0(struct phonebook_number, 1);
+	struct phonebook_number *pn;
 	enum phonebook_number_type category;
 
+	pn = __ofono_mem_new0(tag, struct phonebook_number, 1);
 	pn->number = l_strdup(number);
 	pn->type = type;
 	switch (tolower(c)) {
@@ -337,6 +389,131 @@ static void merge_field_number(GSList **l, const char *number, int type, char c)
 	*l = g_slist_append(*l, pn);
 }
 
+static void stream_free(void *data)
+{
+	struct phonebook_stream *stream = data;
+
+	l_io_destroy(stream->io);
+	l_queue_destroy(stream->chunks, l_free);
+	l_free(stream);
+}
+
+static void stream_finish(struct phonebook_stream *stream)
+{
+	if (stream->closing)
+		return;
+
+	stream->closing = true;
+
+	if (stream->pb)
+		stream->pb->stream = NULL;
+
+	stream->pb = NULL;
+	l_idle_oneshot(stream_free, stream, NULL);
+}
+
+static bool stream_write(struct l_io *io, void *user_data)
+{
+	struct phonebook_stream *stream = user_data;
+	const struct l_queue_entry *entry;
+	struct iovec iov[16];
+	unsigned int n = 0;
+	ssize_t written;
+
+	if (stream->closing)
+		return false;
+
+	for (entry = l_queue_get_entries(stream->chunks);
+			entry && n < L_ARRAY_SIZE(iov); entry = entry->next) {
+		iov[n].iov_base = entry->data;
+		iov[n].iov_len = strlen(entry->data);
+		n += 1;
+	}
+
+	if (n == 0)
+		return false;
+
+	iov[0].iov_base = (char *) iov[0].iov_base + stream->offset;
+	iov[0].iov_len -= stream->offset;
+
+	written = writev(l_io_get_fd(io), iov, n);
+	if (written < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return true;
+
+		stream_finish(stream);
+		return false;
+	}
+
+	stream->backlog -= written;
+	stream->offset += written;
+
+	while ((entry = l_queue_get_entries(stream->chunks))) {
+		size_t len = strlen(entry->data);
+
+		if (stream->offset < len)
+			return true;
+
+		stream->offset -= len;
+		l_free(l_queue_pop_head(stream->chunks));
+	}
+
+	if (stream->done)
+		stream_finish(stream);
+
+	return false;
+}
+
+static void stream_disconnect(struct l_io *io, void *user_data)
+{
+	DBG("reader went away");
+
+	stream_finish(user_data);
+}
+
+static void stream_push(struct phonebook_stream *stream, char *chunk)
+{
+	size_t len = strlen(chunk);
+
+	if (len == 0) {
+		l_free(chunk);
+		return;
+	}
+
+	if (stream->backlog && stream->backlog + len > STREAM_MAX_BACKLOG) {
+		ofono_warn("Phonebook stream reader is too slow, closing");
+		l_free(chunk);
+		stream_finish(stream);
+		return;
+	}
+
+	if (l_queue_isempty(stream->chunks))
+		l_io_set_write_handler(stream->io, stream_write, stream, NULL);
+
+	l_queue_push_tail(stream->chunks, chunk);
+	stream->backlog += len;
+}
+
+static void stream_end(struct phonebook_stream *stream)
+{
+	stream->done = true;
+
+	if (l_queue_isempty(stream->chunks))
+		stream_finish(stream);
+}
+
+/* Hands the vCards built so far to the stream, if one is open */
+static void stream_queue(struct ofono_phonebook *phonebook)
+{
+	if (phonebook->stream == NULL ||
+			l_string_length(phonebook->vcards_builder) == 0)
+		return;
+
+	stream_push(phonebook->stream,
+			l_string_unwrap(phonebook->vcards_builder));
+	phonebook->vcards_builder = l_string_new(0);
+}
+
 void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 				const char *number, int type,
 				const char *text, int hidden,
@@ -357,28 +534,29 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	 * are deemed as entries of one person.
 	 */
 	if (need_merge(text)) {
-		GSList *l;
 		size_t len_text = strlen(text) - 2;
 		struct phonebook_person *person;
+		char *name = l_strndup(text, len_text);
 
-		for (l = phonebook->merge_list; l; l = l->next) {
-			person = l->data;
-			if (!strncmp(text, person->text, len_text) &&
-					(strlen(person->text) == len_text))
-				break;
-		}
+		if (phonebook->merge_index == NULL)
+			phonebook->merge_index = l_hashmap_string_new();
+
+		person = l_hashmap_lookup(phonebook->merge_index, name);
 
-		if (l == NULL) {
-			person = g_new0(struct phonebook_person, 1);
+		if (person == NULL) {
+			person = __ofono_mem_new0(phonebook->memtag,
+						struct phonebook_person, 1);
 			phonebook->merge_list =
 				g_slist_prepend(phonebook->merge_list, person);
-			person->text = l_strndup(text, len_text);
-		}
+			person->text = name;
+			l_hashmap_insert(phonebook->merge_index, name, person);
+		} else
+			l_free(name);
 
-		merge_field_number(&(person->number_list), number, type,
-					text[len_text + 1]);
-		merge_field_number(&(person->number_list), adnumber, adtype,
-					text[len_text + 1]);
+		merge_field_number(phonebook->memtag, &(person->number_list),
+					number, type, text[len_text + 1]);
+		merge_field_number(phonebook->memtag, &(person->number_list),
+					adnumber, adtype, text[len_text + 1]);
 
 		merge_field_generic(&(person->group), group);
 		merge_field_generic(&(person->email), email);
@@ -402,6 +580,8 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	vcard_printf_email(phonebook->vcards_builder, email);
 	vcard_printf_sip_uri(phonebook->vcards_builder, sip_uri);
 	vcard_printf_end(phonebook->vcards_builder);
+
+	stream_queue(phonebook);
 }
 
 static void export_phonebook_cb(const struct ofono_error *error, void *data)
@@ -418,11 +598,108 @@ static void export_phonebook_cb(const struct ofono_error *error, void *data)
 				phonebook->vcards_builder);
 	g_slist_free_full(phonebook->merge_list, destroy_merged_entry);
 	phonebook->merge_list = NULL;
+	l_hashmap_destroy(phonebook->merge_index, NULL);
+	phonebook->merge_index = NULL;
+
+	stream_queue(phonebook);
 
 	phonebook->storage_index++;
 	export_phonebook(phonebook);
 }
 
+static void phonebook_set_cache(struct ofono_phonebook *pb, char *vcards)
+{
+	pb->cached_vcards = vcards;
+	pb->flags |= PHONEBOOK_FLAG_CACHED;
+	pb->cache_time = l_time_now();
+	__ofono_memtag_charge(pb->memtag, strlen(vcards) + 1);
+}
+
+static void phonebook_drop_cache(struct ofono_phonebook *pb)
+{
+	if (pb->cached_vcards == NULL)
+		return;
+
+	__ofono_memtag_charge(pb->memtag,
+				-(ssize_t) (strlen(pb->cached_vcards) + 1));
+
+	l_free(pb->cached_vcards);
+	pb->cached_vcards = NULL;
+	pb->cache_has_counters = false;
+	pb->flags &= ~PHONEBOOK_FLAG_CACHED;
+}
+
+static void phonebook_cache_header(struct ofono_phonebook *pb,
+					unsigned char *header)
+{
+	const char *iccid = __ofono_sim_get_iccid(pb->sim);
+
+	memset(header, 0, PHONEBOOK_CACHE_HEADER_SIZE);
+	memcpy(header, PHONEBOOK_CACHE_MAGIC, 4);
+	header[4] = PHONEBOOK_CACHE_VERSION;
+	memcpy(header + 5, pb->counters, PHONEBOOK_COUNTERS_SIZE);
+
+	if (iccid)
+		strncpy((char *) header + 11, iccid,
+				PHONEBOOK_CACHE_HEADER_SIZE - 12);
+}
+
+/* Loads the stored import if it was taken at the current counters */
+static void phonebook_load_cache(struct ofono_phonebook *pb)
+{
+	const char *imsi = ofono_sim_get_imsi(pb->sim);
+	unsigned char header[PHONEBOOK_CACHE_HEADER_SIZE];
+	unsigned char *data;
+	char *path;
+	size_t len;
+
+	if (imsi == NULL)
+		return;
+
+	path = l_strdup_printf(PHONEBOOK_CACHE_PATH, imsi,
+					ofono_sim_get_phase(pb->sim));
+	data = l_file_get_contents(path, &len);
+	l_free(path);
+
+	if (data == NULL)
+		return;
+
+	phonebook_cache_header(pb, header);
+
+	if (len >= PHONEBOOK_CACHE_HEADER_SIZE &&
+			!memcmp(data, header, PHONEBOOK_CACHE_HEADER_SIZE)) {
+		DBG("using the stored import");
+
+		phonebook_set_cache(pb, l_strndup((char *) data +
+					PHONEBOOK_CACHE_HEADER_SIZE,
+					len - PHONEBOOK_CACHE_HEADER_SIZE));
+		memcpy(pb->cache_counters, pb->counters,
+					PHONEBOOK_COUNTERS_SIZE);
+		pb->cache_has_counters = true;
+	}
+
+	l_free(data);
+}
+
+static void phonebook_store_cache(struct ofono_phonebook *pb)
+{
+	const char *imsi = ofono_sim_get_imsi(pb->sim);
+	size_t len = strlen(pb->cached_vcards);
+	unsigned char *data;
+
+	if (imsi == NULL)
+		return;
+
+	data = l_malloc(PHONEBOOK_CACHE_HEADER_SIZE + len);
+	phonebook_cache_header(pb, data);
+	memcpy(data + PHONEBOOK_CACHE_HEADER_SIZE, pb->cached_vcards, len);
+
+	write_file(data, PHONEBOOK_CACHE_HEADER_SIZE + len,
+			PHONEBOOK_CACHE_PATH, imsi,
+			ofono_sim_get_phase(pb->sim));
+	l_free(data);
+}
+
 static void export_phonebook(struct ofono_phonebook *phonebook)
 {
 	DBusMessage *reply;
@@ -434,9 +711,30 @@ static void export_phonebook(struct ofono_phonebook *phonebook)
 		return;
 	}
 
-	phonebook->cached_vcards = l_string_unwrap(phonebook->vcards_builder);
+	if (phonebook->pending == NULL) {
+		l_string_free(phonebook->vcards_builder);
+		phonebook->vcards_builder = NULL;
+
+		if (phonebook->stream)
+			stream_end(phonebook->stream);
+
+		return;
+	}
+
+	phonebook_set_cache(phonebook,
+			l_string_unwrap(phonebook->vcards_builder));
 	phonebook->vcards_builder = NULL;
-	phonebook->flags |= PHONEBOOK_FLAG_CACHED;
+
+	/*
+	 * Taken at the counters read before the export, a change made in
+	 * the meantime shows up as a mismatch on the next import
+	 */
+	if (phonebook->has_counters) {
+		memcpy(phonebook->cache_counters, phonebook->counters,
+					PHONEBOOK_COUNTERS_SIZE);
+		phonebook->cache_has_counters = true;
+		phonebook_store_cache(phonebook);
+	}
 
 	reply = generate_export_entries_reply(phonebook, phonebook->pending);
 	if (reply == NULL) {
@@ -447,30 +745,172 @@ static void export_phonebook(struct ofono_phonebook *phonebook)
 	__ofono_dbus_pending_reply(&phonebook->pending, reply);
 }
 
+/* Serves the pending Import or stream, from the cache if still valid */
+static void phonebook_import(struct ofono_phonebook *pb)
+{
+	pb->reading_counters = false;
+
+	/* The stream may have been closed by its reader in the meantime */
+	if (pb->pending == NULL && pb->stream == NULL)
+		return;
+
+	if (pb->has_counters) {
+		if (pb->cached_vcards && (!pb->cache_has_counters ||
+				memcmp(pb->cache_counters, pb->counters,
+					PHONEBOOK_COUNTERS_SIZE)))
+			phonebook_drop_cache(pb);
+
+		if (pb->cached_vcards == NULL)
+			phonebook_load_cache(pb);
+	}
+
+	if (!(pb->flags & PHONEBOOK_FLAG_CACHED)) {
+		pb->vcards_builder = l_string_new(0);
+		pb->storage_index = 0;
+		export_phonebook(pb);
+		return;
+	}
+
+	pb->cache_time = l_time_now();
+
+	if (pb->stream) {
+		stream_push(pb->stream, l_strdup(pb->cached_vcards));
+		stream_end(pb->stream);
+		return;
+	}
+
+	__ofono_dbus_pending_reply(&pb->pending,
+			generate_export_entries_reply(pb, pb->pending));
+}
+
+static void cc_read_cb(int ok, int length, int record,
+			const unsigned char *data, int record_length,
+			void *user_data)
+{
+	struct ofono_phonebook *pb = user_data;
+
+	if (ok && length >= 2) {
+		memcpy(pb->counters + 4, data, 2);
+		pb->has_counters = true;
+	}
+
+	phonebook_import(pb);
+}
+
+static void psc_read_cb(int ok, int length, int record,
+			const unsigned char *data, int record_length,
+			void *user_data)
+{
+	struct ofono_phonebook *pb = user_data;
+
+	if (!ok || length < 4) {
+		phonebook_import(pb);
+		return;
+	}
+
+	memcpy(pb->counters, data, 4);
+
+	if (ofono_sim_read_bytes(pb->sim_context, SIM_EFCC_FILEID, 0, 2,
+					phonebook_path, sizeof(phonebook_path),
+					cc_read_cb, pb) < 0)
+		phonebook_import(pb);
+}
+
+/*
+ * The synchronisation and change counters of the global USIM phonebook,
+ * TS 31.102 Section 4.4.2.12, move with every update of its entries.
+ * Reading them is enough to tell whether the last import still holds.
+ * Without them, as on 2G SIMs, the import is kept until trimmed, as it
+ * always was.
+ */
+static void phonebook_start_import(struct ofono_phonebook *pb)
+{
+
+	pb->has_counters = false;
+
+	if (pb->sim_context == NULL ||
+			ofono_sim_get_phase(pb->sim) != OFONO_SIM_PHASE_3G ||
+			ofono_sim_read_bytes(pb->sim_context,
+					SIM_EFPSC_FILEID, 0, 4,
+					phonebook_path, sizeof(phonebook_path),
+					psc_read_cb, pb) < 0) {
+		phonebook_import(pb);
+		return;
+	}
+
+	pb->reading_counters = true;
+}
+
+static bool phonebook_busy(struct ofono_phonebook *pb)
+{
+	return pb->pending || pb->vcards_builder || pb->stream ||
+						pb->reading_counters;
+}
+
 static DBusMessage *import_entries(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
 	struct ofono_phonebook *phonebook = data;
 
-	if (phonebook->pending)
-		return  __ofono_error_busy(phonebook->pending);
-
-	if (phonebook->flags & PHONEBOOK_FLAG_CACHED)
-		return generate_export_entries_reply(phonebook, msg);
+	if (phonebook_busy(phonebook))
+		return __ofono_error_busy(msg);
 
 	phonebook->pending = dbus_message_ref(msg);
-
-	phonebook->vcards_builder = l_string_new(0);
-	phonebook->storage_index = 0;
-	export_phonebook(phonebook);
+	phonebook_start_import(phonebook);
 
 	return NULL;
 }
 
+static DBusMessage *import_stream(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_phonebook *pb = data;
+	struct phonebook_stream *stream;
+	DBusMessage *reply;
+	int fds[2];
+
+	if (phonebook_busy(pb))
+		return __ofono_error_busy(msg);
+
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return __ofono_error_failed(msg);
+
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	stream = l_new(struct phonebook_stream, 1);
+	stream->pb = pb;
+	stream->io = l_io_new(fds[1]);
+	stream->chunks = l_queue_new();
+	l_io_set_close_on_destroy(stream->io, true);
+	l_io_set_disconnect_handler(stream->io, stream_disconnect,
+					stream, NULL);
+	pb->stream = stream;
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &fds[0],
+					DBUS_TYPE_INVALID);
+	close(fds[0]);
+
+	phonebook_start_import(pb);
+
+	return reply;
+}
+
+/* The next Import takes the entries from the disk or the SIM again */
+static void phonebook_trim(uint64_t before, void *user_data)
+{
+	struct ofono_phonebook *pb = user_data;
+
+	if (pb->cache_time < before)
+		phonebook_drop_cache(pb);
+}
+
 static const GDBusMethodTable phonebook_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Import",
 			NULL, GDBUS_ARGS({ "entries", "s" }),
 			import_entries) },
+	{ GDBUS_METHOD("ImportStream",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			import_stream) },
 	{ }
 };
 
@@ -485,6 +925,17 @@ static void phonebook_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(pb->atom);
 
+	__ofono_memtrim_remove(pb->trim_id);
+	pb->trim_id = 0;
+
+	if (pb->sim_context) {
+		ofono_sim_context_free(pb->sim_context);
+		pb->sim_context = NULL;
+	}
+
+	pb->sim = NULL;
+	pb->reading_counters = false;
+
 	ofono_modem_remove_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_PHONEBOOK_INTERFACE);
 }
@@ -501,12 +952,20 @@ static void phonebook_remove(struct ofono_atom *atom)
 	if (pb->driver && pb->driver->remove)
 		pb->driver->remove(pb);
 
+	if (pb->stream)
+		stream_free(pb->stream);
+
+	g_slist_free_full(pb->merge_list, destroy_merged_entry);
+	l_hashmap_destroy(pb->merge_index, NULL);
 	l_string_free(pb->vcards_builder);
-	l_free(pb->cached_vcards);
+	phonebook_drop_cache(pb);
+	__ofono_memtag_put(pb->memtag);
 	g_free(pb);
 }
 
-OFONO_DEFINE_ATOM_CREATE(phonebook, OFONO_ATOM_TYPE_PHONEBOOK)
+OFONO_DEFINE_ATOM_CREATE(phonebook, OFONO_ATOM_TYPE_PHONEBOOK, {
+	atom->memtag = __ofono_memtag_get(modem, OFONO_ATOM_TYPE_PHONEBOOK);
+})
 
 void ofono_phonebook_register(struct ofono_phonebook *pb)
 {
@@ -523,6 +982,12 @@ void ofono_phonebook_register(struct ofono_phonebook *pb)
 		return;
 	}
 
+	pb->trim_id = __ofono_memtrim_add(phonebook_trim, pb);
+
+	pb->sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
+	if (pb->sim)
+		pb->sim_context = ofono_sim_context_create(pb->sim);
+
 	ofono_modem_add_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 
 	__ofono_atom_register(pb->atom, phonebook_unregister);
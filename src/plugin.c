@@ -10,6 +10,8 @@
 #endif
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <string.h>
 
 #include <glib.h>
 
@@ -59,27 +61,36 @@ static gboolean add_plugin(void *handle, struct ofono_plugin_desc *desc)
 	return TRUE;
 }
 
-static gboolean check_plugin(struct ofono_plugin_desc *desc,
-				char **patterns, char **excludes)
+/* Returns 0 if the plugin is wanted, -EPERM if excluded, -ENOENT if not */
+static int match_name(const char *name, char **patterns, char **excludes)
 {
 	if (excludes) {
 		for (; *excludes; excludes++)
-			if (g_pattern_match_simple(*excludes, desc->name))
-				break;
-		if (*excludes) {
-			ofono_info("Excluding %s", desc->description);
-			return FALSE;
-		}
+			if (g_pattern_match_simple(*excludes, name))
+				return -EPERM;
 	}
 
 	if (patterns) {
 		for (; *patterns; patterns++)
-			if (g_pattern_match_simple(*patterns, desc->name))
+			if (g_pattern_match_simple(*patterns, name))
 				break;
-		if (*patterns == NULL) {
-			ofono_info("Ignoring %s", desc->description);
-			return FALSE;
-		}
+		if (*patterns == NULL)
+			return -ENOENT;
+	}
+
+	return 0;
+}
+
+static gboolean check_plugin(struct ofono_plugin_desc *desc,
+				char **patterns, char **excludes)
+{
+	switch (match_name(desc->name, patterns, excludes)) {
+	case -EPERM:
+		ofono_info("Excluding %s", desc->description);
+		return FALSE;
+	case -ENOENT:
+		ofono_info("Ignoring %s", desc->description);
+		return FALSE;
 	}
 
 	return TRUE;
@@ -95,6 +106,8 @@ int __ofono_plugin_init(const char *pattern, const char *exclude)
 	GDir *dir;
 	const gchar *file;
 	gchar *filename;
+	gchar *name;
+	int err;
 	unsigned int i;
 
 	DBG("");
@@ -123,6 +136,19 @@ int __ofono_plugin_init(const char *pattern, const char *exclude)
 					g_str_has_suffix(file, ".so") == FALSE)
 				continue;
 
+			/*
+			 * External plugins are named after their file, don't
+			 * map and relocate the ones that would be ignored.
+			 */
+			name = g_strndup(file, strlen(file) - 3);
+			err = match_name(name, patterns, excludes);
+			g_free(name);
+
+			if (err < 0) {
+				DBG("Not loading %s", file);
+				continue;
+			}
+
 			filename = g_build_filename(PLUGINDIR, file, NULL);
 
 			handle = dlopen(filename, RTLD_NOW);
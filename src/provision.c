@@ -17,14 +17,20 @@
 #include "ofono.h"
 
 static struct provision_db *pdb;
+static struct l_dir_watch *pdb_watch;
+static char *pdb_filename;
 
+/*
+ * Every modem looks the same SIM up again on each insertion, results are
+ * shared between them.  Release them with provision_db_result_unref().
+ */
 bool __ofono_provision_get_settings(const char *mcc,
 				const char *mnc, const char *spn,
-				struct provision_db_entry **settings,
-				size_t *count)
+				struct provision_db_result **settings)
 {
 	size_t n_contexts;
 	struct provision_db_entry *contexts;
+	struct provision_db_result *result;
 	int r;
 	size_t i;
 	uint32_t type;
@@ -37,11 +43,14 @@ bool __ofono_provision_get_settings(const char *mcc,
 							"Provision",
 							"TagsFilter", ',');
 
-	r = provision_db_lookup(pdb, mcc, mnc, spn, tags_filter,
-						&contexts, &n_contexts);
+	r = provision_db_lookup_shared(pdb, mcc, mnc, spn, tags_filter,
+						&result);
 	if (r < 0)
 		return false;
 
+	contexts = result->items;
+	n_contexts = result->n_items;
+
 	DBG("Obtained %zd contexts for %s%s, spn: %s",
 			n_contexts, mcc, mnc, spn);
 
@@ -63,21 +72,59 @@ bool __ofono_provision_get_settings(const char *mcc,
 		if (type & ap->type) {
 			ofono_warn("Duplicate detected for %s%s, spn: %s",
 					mcc, mnc, spn);
-			l_free(contexts);
+			provision_db_result_unref(result);
 			return false;
 		}
 
 		type |= ap->type;
 	}
 
-	*count = n_contexts;
-	*settings = contexts;
+	*settings = result;
 
 	return true;
 }
 
+/*
+ * provisiontool replaces the database with a rename, so a complete file
+ * shows up as created.  Partially written files fail validation in
+ * provision_db_new() and are ignored until the final write.  Contexts
+ * provisioned from the old database hold their own copies, and pending
+ * results keep the old mapping alive until they are released.
+ */
+static void provision_db_changed(const char *filename,
+					enum l_dir_watch_event event,
+					void *user_data)
+{
+	struct provision_db *new_pdb;
+
+	if (event != L_DIR_WATCH_EVENT_CREATED &&
+			event != L_DIR_WATCH_EVENT_MODIFIED)
+		return;
+
+	if (!l_streq0(filename, pdb_filename))
+		return;
+
+	if (provision_db_is_current(pdb, PROVISION_DB_DEFAULT_PATH))
+		return;
+
+	new_pdb = provision_db_new(PROVISION_DB_DEFAULT_PATH);
+	if (!new_pdb) {
+		DBG("Ignoring incomplete provisioning database update");
+		return;
+	}
+
+	provision_db_free(pdb);
+	pdb = new_pdb;
+
+	l_info("Reloaded provisioning database");
+}
+
 static int provision_init(void)
 {
+	const char *slash = strrchr(PROVISION_DB_DEFAULT_PATH, '/');
+	_auto_(l_free) char *dir = l_strndup(PROVISION_DB_DEFAULT_PATH,
+					slash - PROVISION_DB_DEFAULT_PATH);
+
 	DBG("");
 
 	pdb = provision_db_new_default();
@@ -85,12 +132,24 @@ static int provision_init(void)
 	if (!pdb)
 		l_warn("Unable to open provisioning database!");
 
+	pdb_filename = l_strdup(slash + 1);
+	pdb_watch = l_dir_watch_new(dir, provision_db_changed, NULL, NULL);
+	if (!pdb_watch)
+		l_warn("Unable to watch the provisioning database");
+
 	return 0;
 }
 
 static void provision_exit(void)
 {
+	l_dir_watch_destroy(pdb_watch);
+	pdb_watch = NULL;
+
+	l_free(pdb_filename);
+	pdb_filename = NULL;
+
 	provision_db_free(pdb);
+	pdb = NULL;
 }
 
 OFONO_MODULE(provision, provision_init, provision_exit)
@@ -44,6 +44,23 @@ struct provision_header {
 	/* followed by strings_size packed strings */
 } __attribute__((packed));
 
+/*
+ * Version 3 databases extend the header with an open addressed hash table
+ * of the nodes carrying provision data, placed after the strings.
+ */
+struct provision_index_header {
+	__le64 index_offset;
+	__le64 index_size;
+} __attribute__((packed));
+
+struct index_entry {
+	__le32 mccmnc;
+	__le32 reserved;
+	__le64 node_offset; /* 0 for an empty slot, the root is never found */
+} __attribute__((packed));
+
+#define PROVISION_DB_CACHE_SIZE 16
+
 struct node {
 	__le64 bit_offsets[2];
 	__le32 mccmnc;
@@ -73,6 +90,7 @@ struct context {
 } __attribute__((packed));
 
 struct provision_db {
+	int ref_count;
 	int fd;
 	time_t mtime;
 	size_t size;
@@ -83,12 +101,24 @@ struct provision_db {
 	uint64_t contexts_size;
 	uint64_t strings_offset;
 	uint64_t strings_size;
+	uint64_t index_offset;
+	uint64_t n_index_entries;
+	struct l_queue *cache;	/* Most recently used first */
+};
+
+struct cached_result {
+	char *key;
+	int error;
+	struct provision_db_result *result;
 };
 
 struct provision_db *provision_db_new(const char *pathname)
 {
 	struct provision_header *hdr;
+	struct provision_index_header *index_hdr = NULL;
 	struct provision_db *pdb = NULL;
+	uint64_t header_size;
+	uint64_t index_size = 0;
 	struct stat st;
 	void *addr;
 	size_t size;
@@ -117,7 +147,19 @@ struct provision_db *provision_db_new(const char *pathname)
 	if (L_LE64_TO_CPU(hdr->file_size) != size)
 		goto failed;
 
-	if (L_LE64_TO_CPU(hdr->header_size) != sizeof(struct provision_header))
+	header_size = L_LE64_TO_CPU(hdr->header_size);
+
+	if (header_size == sizeof(struct provision_header) +
+				sizeof(struct provision_index_header)) {
+		if (size < header_size)
+			goto failed;
+
+		index_hdr = addr + sizeof(struct provision_header);
+		index_size = L_LE64_TO_CPU(index_hdr->index_size);
+
+		if (!index_size || index_size % sizeof(struct index_entry))
+			goto failed;
+	} else if (header_size != sizeof(struct provision_header))
 		goto failed;
 
 	if (L_LE64_TO_CPU(hdr->node_struct_size) != sizeof(struct node))
@@ -130,13 +172,18 @@ struct provision_db *provision_db_new(const char *pathname)
 	if (L_LE64_TO_CPU(hdr->context_struct_size) != sizeof(struct context))
 		goto failed;
 
-	if (L_LE64_TO_CPU(hdr->header_size) + L_LE64_TO_CPU(hdr->nodes_size) +
+	if (header_size + L_LE64_TO_CPU(hdr->nodes_size) +
 			L_LE64_TO_CPU(hdr->contexts_size) +
-			L_LE64_TO_CPU(hdr->strings_size) != size)
+			L_LE64_TO_CPU(hdr->strings_size) + index_size != size)
+		goto failed;
+
+	if (index_hdr && L_LE64_TO_CPU(index_hdr->index_offset) !=
+			size - index_size)
 		goto failed;
 
 	pdb = l_new(struct provision_db, 1);
 
+	pdb->ref_count = 1;
 	pdb->fd = fd;
 	pdb->mtime = st.st_mtime;
 	pdb->size = size;
@@ -147,6 +194,12 @@ struct provision_db *provision_db_new(const char *pathname)
 	pdb->contexts_size = L_LE64_TO_CPU(hdr->contexts_size);
 	pdb->strings_offset = L_LE64_TO_CPU(hdr->strings_offset);
 	pdb->strings_size = L_LE64_TO_CPU(hdr->strings_size);
+	pdb->cache = l_queue_new();
+
+	if (index_hdr) {
+		pdb->index_offset = L_LE64_TO_CPU(index_hdr->index_offset);
+		pdb->n_index_entries = index_size / sizeof(struct index_entry);
+	}
 
 	return pdb;
 
@@ -161,7 +214,7 @@ struct provision_db *provision_db_new_default(void)
 {
 	struct provision_db *db = NULL;
 	size_t i;
-	const char * const paths[] = { "/usr/share/ofono/provision.db" };
+	const char * const paths[] = { PROVISION_DB_DEFAULT_PATH };
 
 	for (i = 0; !db && i < L_ARRAY_SIZE(paths); i++)
 		db = provision_db_new(paths[i]);
@@ -169,16 +222,67 @@ struct provision_db *provision_db_new_default(void)
 	return db;
 }
 
-void provision_db_free(struct provision_db *pdb)
+static void cached_result_free(void *data)
+{
+	struct cached_result *cached = data;
+
+	provision_db_result_unref(cached->result);
+	l_free(cached->key);
+	l_free(cached);
+}
+
+struct provision_db *provision_db_ref(struct provision_db *pdb)
+{
+	if (!pdb)
+		return NULL;
+
+	__atomic_fetch_add(&pdb->ref_count, 1, __ATOMIC_SEQ_CST);
+
+	return pdb;
+}
+
+void provision_db_unref(struct provision_db *pdb)
 {
 	if (!pdb)
 		return;
 
+	if (__atomic_sub_fetch(&pdb->ref_count, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_queue_destroy(pdb->cache, cached_result_free);
 	munmap(pdb->addr, pdb->size);
 	close(pdb->fd);
 	l_free(pdb);
 }
 
+/*
+ * Drops the reference taken by provision_db_new().  Cached results hold
+ * references of their own, so they are released first; results handed
+ * out to callers keep the mapping alive until they are unreferenced.
+ */
+void provision_db_free(struct provision_db *pdb)
+{
+	if (!pdb)
+		return;
+
+	l_queue_destroy(pdb->cache, cached_result_free);
+	pdb->cache = NULL;
+	provision_db_unref(pdb);
+}
+
+bool provision_db_is_current(struct provision_db *pdb, const char *pathname)
+{
+	struct stat st;
+
+	if (!pdb || !pathname)
+		return false;
+
+	if (stat(pathname, &st) < 0)
+		return false;
+
+	return (size_t) st.st_size == pdb->size && st.st_mtime == pdb->mtime;
+}
+
 static int __get_node(struct provision_db *pdb, uint64_t offset,
 				struct node **out_node)
 {
@@ -322,6 +426,45 @@ static uint8_t choose(struct node *node, uint32_t key)
 	return (key >> (31U - L_LE32_TO_CPU(node->diff))) & 1;
 }
 
+static uint64_t index_slot(uint32_t key, uint64_t n_entries)
+{
+	uint32_t hash = key * 0x9e3779b1U;
+
+	return ((uint64_t) hash * n_entries) >> 32;
+}
+
+static int __find_indexed(struct provision_db *pdb, uint32_t key,
+						struct node **out_node)
+{
+	struct index_entry *table = pdb->addr + pdb->index_offset;
+	uint64_t slot = index_slot(key, pdb->n_index_entries);
+	uint64_t i;
+	int r;
+
+	for (i = 0; i < pdb->n_index_entries; i++) {
+		struct index_entry *entry = table + slot;
+		uint64_t offset = L_LE64_TO_CPU(entry->node_offset);
+
+		if (!offset)
+			return -ENOENT;
+
+		if (L_LE32_TO_CPU(entry->mccmnc) == key) {
+			r = __get_node(pdb, offset, out_node);
+			if (r < 0)
+				return r;
+
+			if (L_LE32_TO_CPU((*out_node)->mccmnc) != key)
+				return -EPROTO;
+
+			return 0;
+		}
+
+		slot = (slot + 1) % pdb->n_index_entries;
+	}
+
+	return -ENOENT;
+}
+
 static int __find(struct provision_db *pdb, uint32_t key,
 						struct node **out_node)
 {
@@ -329,6 +472,9 @@ static int __find(struct provision_db *pdb, uint32_t key,
 	struct node *parent;
 	int r;
 
+	if (pdb->n_index_entries)
+		return __find_indexed(pdb, key, out_node);
+
 	r = __get_node(pdb, 0, &parent);
 	if (r < 0)
 		return r;
@@ -470,3 +616,131 @@ int provision_db_lookup(struct provision_db *pdb,
 	return __get_contexts(pdb, L_LE64_TO_CPU(found->context_offset),
 				tags_filter, items, n_items);
 }
+
+struct provision_db_result *provision_db_result_ref(
+					struct provision_db_result *result)
+{
+	if (!result)
+		return NULL;
+
+	__atomic_fetch_add(&result->ref_count, 1, __ATOMIC_SEQ_CST);
+
+	return result;
+}
+
+void provision_db_result_unref(struct provision_db_result *result)
+{
+	if (!result)
+		return;
+
+	if (__atomic_sub_fetch(&result->ref_count, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	l_free(result->items);
+	provision_db_unref(result->db);
+	l_free(result);
+}
+
+static char *cache_key(const char *mcc, const char *mnc, const char *spn,
+			char **tags_filter)
+{
+	_auto_(l_free) char *tags = NULL;
+
+	/* Tell a missing SPN or filter from an empty one */
+	if (tags_filter)
+		tags = l_strjoinv(tags_filter, ',');
+
+	return l_strdup_printf("%s:%s:%c%zu:%s:%c%s", mcc, mnc,
+				spn ? '+' : '-', spn ? strlen(spn) : 0,
+				spn ? spn : "", tags ? '+' : '-',
+				tags ? tags : "");
+}
+
+static bool cached_result_match(const void *a, const void *b)
+{
+	const struct cached_result *cached = a;
+
+	return !strcmp(cached->key, b);
+}
+
+/*
+ * Results are kept in a small LRU, keyed by everything the lookup depends
+ * on.  They point into the mapped database and hold a reference on it, so
+ * they stay valid after the database has been replaced and freed.
+ */
+int provision_db_lookup_shared(struct provision_db *pdb,
+				const char *mcc, const char *mnc,
+				const char *spn, char **tags_filter,
+				struct provision_db_result **out)
+{
+	struct cached_result *cached;
+	struct provision_db_result *result;
+	char *key;
+	int r;
+
+	if (pdb == NULL || pdb->cache == NULL)
+		return -EBADF;
+
+	key = cache_key(mcc, mnc, spn, tags_filter);
+	cached = l_queue_remove_if(pdb->cache, cached_result_match, key);
+
+	if (cached) {
+		l_free(key);
+		goto done;
+	}
+
+	result = l_new(struct provision_db_result, 1);
+	result->ref_count = 1;
+
+	r = provision_db_lookup(pdb, mcc, mnc, spn, tags_filter,
+				&result->items, &result->n_items);
+	if (r < 0) {
+		l_free(result);
+		result = NULL;
+
+		/* Only a missing entry is worth remembering */
+		if (r != -ENOENT) {
+			l_free(key);
+			return r;
+		}
+	} else
+		result->db = provision_db_ref(pdb);
+
+	cached = l_new(struct cached_result, 1);
+	cached->key = key;
+	cached->error = r;
+	cached->result = result;
+
+	if (l_queue_length(pdb->cache) == PROVISION_DB_CACHE_SIZE) {
+		struct cached_result *oldest = l_queue_peek_tail(pdb->cache);
+
+		l_queue_remove(pdb->cache, oldest);
+		cached_result_free(oldest);
+	}
+
+done:
+	l_queue_push_head(pdb->cache, cached);
+
+	if (cached->error < 0)
+		return cached->error;
+
+	*out = provision_db_result_ref(cached->result);
+	return 0;
+}
+
+void provision_db_lookup_batch(struct provision_db *pdb, char **tags_filter,
+				struct provision_db_query *queries,
+				size_t n_queries)
+{
+	size_t i;
+
+	for (i = 0; i < n_queries; i++) {
+		struct provision_db_query *query = queries + i;
+
+		query->result = NULL;
+		query->error = provision_db_lookup_shared(pdb, query->mcc,
+							query->mnc, query->spn,
+							tags_filter,
+							&query->result);
+	}
+}
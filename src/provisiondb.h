@@ -6,6 +6,10 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <ell/cleanup.h>
+
+#define PROVISION_DB_DEFAULT_PATH "/usr/share/ofono/provision.db"
 
 struct provision_db;
 
@@ -22,12 +26,45 @@ struct provision_db_entry {
 	const char *tags;
 };
 
+/* A shared lookup result, the strings point into the database */
+struct provision_db_result {
+	int ref_count;
+	size_t n_items;
+	struct provision_db_entry *items;
+	struct provision_db *db;	/* Keeps the mapping alive */
+};
+
+struct provision_db_query {
+	const char *mcc;
+	const char *mnc;
+	const char *spn;
+	int error;			/* Set by the lookup */
+	struct provision_db_result *result;	/* Set by the lookup */
+};
+
 struct provision_db *provision_db_new(const char *pathname);
 struct provision_db *provision_db_new_default(void);
 void provision_db_free(struct provision_db *pdb);
+struct provision_db *provision_db_ref(struct provision_db *pdb);
+void provision_db_unref(struct provision_db *pdb);
+bool provision_db_is_current(struct provision_db *pdb, const char *pathname);
 
 int provision_db_lookup(struct provision_db *pdb,
 			const char *mcc, const char *mnc, const char *spn,
 			char **tags_filter,
 			struct provision_db_entry **items,
 			size_t *n_items);
+
+int provision_db_lookup_shared(struct provision_db *pdb,
+				const char *mcc, const char *mnc,
+				const char *spn, char **tags_filter,
+				struct provision_db_result **out);
+void provision_db_lookup_batch(struct provision_db *pdb, char **tags_filter,
+				struct provision_db_query *queries,
+				size_t n_queries);
+
+struct provision_db_result *provision_db_result_ref(
+					struct provision_db_result *result);
+void provision_db_result_unref(struct provision_db_result *result);
+
+DEFINE_CLEANUP_FUNC(provision_db_result_unref);
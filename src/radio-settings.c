@@ -24,6 +24,7 @@
 #define SETTINGS_STORE "radiosetting"
 #define SETTINGS_GROUP "Settings"
 #define RADIO_SETTINGS_FLAG_CACHED 0x1
+#define RADIO_SETTINGS_FLAG_REG_SET_MODE 0x2
 
 struct ofono_radio_settings {
 	DBusMessage *pending;
@@ -747,13 +748,16 @@ static void ofono_radio_finish_register(struct ofono_radio_settings *rs)
 	__ofono_atom_register(rs->atom, radio_settings_unregister);
 }
 
-static void radio_mode_set_callback_at_reg(const struct ofono_error *error,
+static void radio_apply_at_reg(struct ofono_radio_settings *rs,
+					bool set_mode, bool set_band);
+
+static void radio_set_callback_at_reg(const struct ofono_error *error,
 						void *data)
 {
 	struct ofono_radio_settings *rs = data;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		DBG("Error setting radio access mode register time");
+		DBG("Error setting radio settings register time");
 
 	/*
 	 * Continue with atom register even if request fail at modem
@@ -764,12 +768,145 @@ static void radio_mode_set_callback_at_reg(const struct ofono_error *error,
 static void radio_band_set_callback_at_reg(const struct ofono_error *error,
 						void *data)
 {
+	struct ofono_radio_settings *rs = data;
+	bool set_mode = rs->flags & RADIO_SETTINGS_FLAG_REG_SET_MODE;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		DBG("Error setting radio access mode register time");
-	/*
-	 * Continue with atom register even if request fail at modem
-	 * ofono_radio_finish_register called by radio_mode_set_callback_at_reg
-	 */
+		DBG("Error setting radio band register time");
+
+	rs->flags &= ~RADIO_SETTINGS_FLAG_REG_SET_MODE;
+	radio_apply_at_reg(rs, set_mode, false);
+}
+
+/*
+ * Changing either setting makes most modems rescan, so only what differs
+ * from the modem's state is sent, in one request if the driver allows.
+ * Diff callbacks are used, there are no D-Bus clients yet at this point.
+ */
+static void radio_apply_at_reg(struct ofono_radio_settings *rs,
+					bool set_mode, bool set_band)
+{
+	const struct ofono_radio_settings_driver *driver = rs->driver;
+
+	if (driver->set_rat_mode == NULL)
+		set_mode = false;
+
+	if (driver->set_band == NULL)
+		set_band = false;
+
+	DBG("mode: %s, band: %s", set_mode ? "set" : "keep",
+					set_band ? "set" : "keep");
+
+	if (set_mode && set_band && driver->set_settings) {
+		driver->set_settings(rs, rs->mode, rs->band_gsm, rs->band_umts,
+					radio_set_callback_at_reg, rs);
+		return;
+	}
+
+	if (set_band) {
+		if (set_mode)
+			rs->flags |= RADIO_SETTINGS_FLAG_REG_SET_MODE;
+
+		driver->set_band(rs, rs->band_gsm, rs->band_umts,
+					radio_band_set_callback_at_reg, rs);
+		return;
+	}
+
+	if (set_mode) {
+		driver->set_rat_mode(rs, rs->mode,
+					radio_set_callback_at_reg, rs);
+		return;
+	}
+
+	ofono_radio_finish_register(rs);
+}
+
+static void radio_settings_query_callback_at_reg(
+					const struct ofono_error *error,
+					int mode,
+					enum ofono_radio_band_gsm band_gsm,
+					enum ofono_radio_band_umts band_umts,
+					void *data)
+{
+	struct ofono_radio_settings *rs = data;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		DBG("Error querying radio settings register time");
+		radio_apply_at_reg(rs, true, true);
+		return;
+	}
+
+	radio_apply_at_reg(rs, (unsigned int) mode != rs->mode,
+				band_gsm != rs->band_gsm ||
+				band_umts != rs->band_umts);
+}
+
+static void radio_band_query_callback_at_reg(const struct ofono_error *error,
+					enum ofono_radio_band_gsm band_gsm,
+					enum ofono_radio_band_umts band_umts,
+					void *data)
+{
+	struct ofono_radio_settings *rs = data;
+	bool set_mode = rs->flags & RADIO_SETTINGS_FLAG_REG_SET_MODE;
+
+	rs->flags &= ~RADIO_SETTINGS_FLAG_REG_SET_MODE;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		DBG("Error querying radio band register time");
+		radio_apply_at_reg(rs, set_mode, true);
+		return;
+	}
+
+	radio_apply_at_reg(rs, set_mode, band_gsm != rs->band_gsm ||
+					band_umts != rs->band_umts);
+}
+
+static void radio_mode_query_callback_at_reg(const struct ofono_error *error,
+						int mode, void *data)
+{
+	struct ofono_radio_settings *rs = data;
+	bool set_mode = error->type != OFONO_ERROR_TYPE_NO_ERROR ||
+					(unsigned int) mode != rs->mode;
+
+	if (rs->driver->query_band == NULL || rs->driver->set_band == NULL) {
+		radio_apply_at_reg(rs, set_mode, true);
+		return;
+	}
+
+	if (set_mode)
+		rs->flags |= RADIO_SETTINGS_FLAG_REG_SET_MODE;
+
+	rs->driver->query_band(rs, radio_band_query_callback_at_reg, rs);
+}
+
+static void radio_query_at_reg(struct ofono_radio_settings *rs)
+{
+	const struct ofono_radio_settings_driver *driver = rs->driver;
+
+	if (driver->set_rat_mode == NULL && driver->set_band == NULL) {
+		ofono_radio_finish_register(rs);
+		return;
+	}
+
+	if (driver->query_settings) {
+		driver->query_settings(rs, radio_settings_query_callback_at_reg,
+					rs);
+		return;
+	}
+
+	if (driver->query_rat_mode) {
+		driver->query_rat_mode(rs, radio_mode_query_callback_at_reg,
+					rs);
+		return;
+	}
+
+	if (driver->query_band) {
+		rs->flags |= RADIO_SETTINGS_FLAG_REG_SET_MODE;
+		driver->query_band(rs, radio_band_query_callback_at_reg, rs);
+		return;
+	}
+
+	radio_apply_at_reg(rs, true, true);
 }
 
 static void radio_load_settings(struct ofono_radio_settings *rs,
@@ -854,20 +991,7 @@ void ofono_radio_settings_register(struct ofono_radio_settings *rs)
 		goto finish;
 
 	radio_load_settings(rs, ofono_sim_get_imsi(sim));
-
-	if (rs->driver->set_band != NULL)
-		rs->driver->set_band(rs, rs->band_gsm, rs->band_umts,
-					radio_band_set_callback_at_reg, rs);
-
-	if (rs->driver->set_rat_mode == NULL)
-		goto finish;
-
-	/*
-	 * Diff callback used. No need of using DBUS pending concept.
-	 * As its atom registration time - no DBUS clients.
-	 */
-	rs->driver->set_rat_mode(rs, rs->mode,
-					radio_mode_set_callback_at_reg, rs);
+	radio_query_at_reg(rs);
 	return;
 
 finish:
@@ -37,6 +37,21 @@
 #define RMNET_FLAGS_EGRESS_MAP_CKSUMV5 (1U << 5)
 #endif
 
+/*
+ * Uplink aggregation was added in 6.1.  Older kernels ignore both the
+ * unknown flag and the unknown attribute
+ */
+#ifndef RMNET_FLAGS_EGRESS_AGGREGATION
+#define RMNET_FLAGS_EGRESS_AGGREGATION (1U << 6)
+#define IFLA_RMNET_UL_AGG_PARAMS 3
+
+struct rmnet_egress_agg_params {
+	uint16_t agg_size;
+	uint16_t agg_count;
+	uint32_t agg_time_nsec;
+};
+#endif
+
 struct rmnet_request {
 	uint32_t parent_ifindex;
 	rmnet_new_interfaces_func_t new_cb;
@@ -48,14 +63,35 @@ struct rmnet_request {
 	uint16_t request_type;
 	uint8_t current;
 	uint8_t n_interfaces;
+	uint8_t n_reused;
+	bool aggregate_egress;
+	struct rmnet_aggregation aggregation;
 	struct rmnet_ifinfo infos[];
 };
 
+/*
+ * Links handed out by rmnet_get_interfaces are remembered here.  When
+ * released by rmnet_del_interfaces they are parked rather than deleted,
+ * and the next request on the same parent takes them back, only creating
+ * the links still missing.  This saves the link creation and MTU setup
+ * on every power cycle of the modem.  Parked links left behind on exit
+ * are cleaned up by the initial link dump of the next run.
+ */
+struct rmnet_link {
+	struct rmnet_ifinfo info;
+	uint32_t parent_ifindex;
+	bool aggregate_egress;
+	struct rmnet_aggregation aggregation;
+	bool in_use;
+};
+
 static struct l_netlink *rtnl;
 static uint32_t dump_id;
 static uint32_t link_notify_id;
 static struct l_uintset *mux_ids;
 struct l_queue *request_q;
+static struct l_queue *links;
+static struct l_idle *reuse_idle;
 static int next_request_id = 1;
 
 static void rmnet_request_free(struct rmnet_request *req)
@@ -74,6 +110,55 @@ static bool rmnet_request_id_matches(const void *a, const void *b)
 	return req->id == id;
 }
 
+static bool rmnet_link_ifindex_matches(const void *a, const void *b)
+{
+	const struct rmnet_link *link = a;
+	uint32_t ifindex = L_PTR_TO_UINT(b);
+
+	return link->info.ifindex == ifindex;
+}
+
+static bool rmnet_link_reusable(const struct rmnet_link *link,
+					const struct rmnet_request *req)
+{
+	if (link->in_use || link->parent_ifindex != req->parent_ifindex)
+		return false;
+
+	if (link->aggregate_egress != req->aggregate_egress)
+		return false;
+
+	return !req->aggregate_egress ||
+		!memcmp(&link->aggregation, &req->aggregation,
+					sizeof(link->aggregation));
+}
+
+static void rmnet_link_park(uint32_t ifindex)
+{
+	struct rmnet_link *link = l_queue_find(links,
+						rmnet_link_ifindex_matches,
+						L_UINT_TO_PTR(ifindex));
+
+	if (link)
+		link->in_use = false;
+}
+
+/* Records the links created for a completed request, reused ones are known */
+static void rmnet_request_add_links(const struct rmnet_request *req)
+{
+	unsigned int i;
+
+	for (i = req->n_reused; i < req->n_interfaces; i++) {
+		struct rmnet_link *link = l_new(struct rmnet_link, 1);
+
+		link->info = req->infos[i];
+		link->parent_ifindex = req->parent_ifindex;
+		link->aggregate_egress = req->aggregate_egress;
+		link->aggregation = req->aggregation;
+		link->in_use = true;
+		l_queue_push_tail(links, link);
+	}
+}
+
 static struct rmnet_request *__rmnet_del_request_new(unsigned int n_interfaces,
 					const struct rmnet_ifinfo *interfaces)
 {
@@ -93,10 +178,21 @@ static struct rmnet_request *__rmnet_del_request_new(unsigned int n_interfaces,
 static struct rmnet_request *__rmnet_cancel_request(void)
 {
 	struct rmnet_request *req = l_queue_pop_head(request_q);
+	unsigned int i;
 
-	if (req->current) {
+	if (reuse_idle) {
+		l_idle_remove(reuse_idle);
+		reuse_idle = NULL;
+	}
+
+	/* Links taken from the pool go back there, new ones are deleted */
+	for (i = 0; i < req->n_reused; i++)
+		rmnet_link_park(req->infos[i].ifindex);
+
+	if (req->current > req->n_reused) {
 		struct rmnet_request *del_req =
-			__rmnet_del_request_new(req->current, req->infos);
+			__rmnet_del_request_new(req->current - req->n_reused,
+						req->infos + req->n_reused);
 		l_queue_push_head(request_q, del_req);
 	}
 
@@ -133,6 +229,7 @@ static int rmnet_link_del(uint32_t ifindex, l_netlink_command_func_t cb,
 
 static int rmnet_link_new(uint32_t parent_ifindex, uint8_t mux_id,
 				const char ifname[static IF_NAMESIZE],
+				const struct rmnet_aggregation *aggregation,
 				l_netlink_command_func_t cb,
 				void *userdata,
 				l_netlink_destroy_func_t destroy,
@@ -166,6 +263,20 @@ static int rmnet_link_new(uint32_t parent_ifindex, uint8_t mux_id,
 			RMNET_FLAGS_EGRESS_MAP_CKSUMV5 |
 			RMNET_FLAGS_INGRESS_MAP_CKSUMV5 |
 			RMNET_FLAGS_INGRESS_DEAGGREGATION;
+
+	if (aggregation) {
+		struct rmnet_egress_agg_params params = {
+			.agg_size = aggregation->max_size,
+			.agg_count = aggregation->max_datagrams,
+			.agg_time_nsec = aggregation->timeout_ns,
+		};
+
+		flags.flags |= RMNET_FLAGS_EGRESS_AGGREGATION;
+		flags.mask |= RMNET_FLAGS_EGRESS_AGGREGATION;
+		l_netlink_message_append(nlm, IFLA_RMNET_UL_AGG_PARAMS,
+						&params, sizeof(params));
+	}
+
 	l_netlink_message_append(nlm, IFLA_RMNET_FLAGS, &flags, sizeof(flags));
 	l_netlink_message_leave_nested(nlm);
 	l_netlink_message_leave_nested(nlm);
@@ -224,6 +335,7 @@ static void rmnet_set_mtu_cb(int error, uint16_t type, const void *data,
 			goto next_request;
 
 		l_queue_pop_head(request_q);
+		rmnet_request_add_links(req);
 	}
 
 	if (req->new_cb)
@@ -279,6 +391,24 @@ error:
 	rmnet_request_free(req);
 }
 
+static void rmnet_reuse_done(struct l_idle *idle, void *user_data)
+{
+	struct rmnet_request *req = l_queue_pop_head(request_q);
+
+	l_idle_remove(reuse_idle);
+	reuse_idle = NULL;
+
+	DBG("Reused %u interfaces", req->n_interfaces);
+
+	if (req->new_cb)
+		req->new_cb(0, req->n_interfaces, req->infos, req->user_data);
+
+	rmnet_request_free(req);
+
+	if (l_queue_length(request_q) > 0)
+		rmnet_start_next_request();
+}
+
 static void rmnet_start_next_request(void)
 {
 	struct rmnet_request *req = l_queue_peek_head(request_q);
@@ -288,6 +418,13 @@ static void rmnet_start_next_request(void)
 	if (!req)
 		return;
 
+	/* Served entirely from the pool, still reply from the main loop */
+	if (req->request_type == RTM_NEWLINK &&
+			req->current == req->n_interfaces) {
+		reuse_idle = l_idle_create(rmnet_reuse_done, NULL, NULL);
+		return;
+	}
+
 	if (req->request_type == RTM_DELLINK) {
 		uint32_t ifindex = req->infos[req->current].ifindex;
 
@@ -305,6 +442,8 @@ static void rmnet_start_next_request(void)
 	sprintf(info->ifname, RMNET_TYPE"%u", mux_id - 1);
 
 	L_WARN_ON(rmnet_link_new(req->parent_ifindex, mux_id, info->ifname,
+					req->aggregate_egress ?
+					&req->aggregation : NULL,
 					rmnet_new_link_cb, NULL, NULL,
 					&req->netlink_id) < 0);
 
@@ -314,17 +453,16 @@ static void rmnet_start_next_request(void)
 }
 
 int rmnet_get_interfaces(uint32_t parent_ifindex, unsigned int n_interfaces,
+				const struct rmnet_aggregation *aggregation,
 				rmnet_new_interfaces_func_t cb,
 				void *user_data, rmnet_destroy_func_t destroy)
 {
 	struct rmnet_request *req;
+	const struct l_queue_entry *entry;
 
 	if (!n_interfaces || n_interfaces > MAX_MUX_IDS)
 		return -EINVAL;
 
-	if (l_uintset_size(mux_ids) > MAX_MUX_IDS - n_interfaces)
-		return -ENOSPC;
-
 	req = l_malloc(sizeof(struct rmnet_request) +
 				sizeof(struct rmnet_ifinfo) * n_interfaces);
 	req->parent_ifindex = parent_ifindex;
@@ -337,7 +475,39 @@ int rmnet_get_interfaces(uint32_t parent_ifindex, unsigned int n_interfaces,
 	req->netlink_id = 0;
 	req->current = 0;
 	req->n_interfaces = n_interfaces;
+	req->n_reused = 0;
+	req->aggregate_egress = aggregation && aggregation->max_size &&
+					aggregation->max_datagrams > 1;
 	memset(req->infos, 0, sizeof(struct rmnet_ifinfo) * n_interfaces);
+	memset(&req->aggregation, 0, sizeof(req->aggregation));
+
+	if (req->aggregate_egress)
+		req->aggregation = *aggregation;
+
+	for (entry = l_queue_get_entries(links);
+			entry && req->n_reused < n_interfaces;
+			entry = entry->next) {
+		struct rmnet_link *link = entry->data;
+
+		if (!rmnet_link_reusable(link, req))
+			continue;
+
+		link->in_use = true;
+		req->infos[req->n_reused++] = link->info;
+	}
+
+	req->current = req->n_reused;
+
+	if (l_uintset_size(mux_ids) >
+			MAX_MUX_IDS - (n_interfaces - req->n_reused)) {
+		unsigned int i;
+
+		for (i = 0; i < req->n_reused; i++)
+			rmnet_link_park(req->infos[i].ifindex);
+
+		l_free(req);
+		return -ENOSPC;
+	}
 
 	if (next_request_id < 0)
 		next_request_id = 1;
@@ -354,11 +524,30 @@ int rmnet_del_interfaces(unsigned int n_interfaces,
 					const struct rmnet_ifinfo *interfaces)
 {
 	struct rmnet_request *req;
+	unsigned int i;
 
 	if (!n_interfaces || n_interfaces > MAX_MUX_IDS)
 		return -EINVAL;
 
 	req = __rmnet_del_request_new(n_interfaces, interfaces);
+	req->n_interfaces = 0;
+
+	/* Our own links are parked, anything else is deleted */
+	for (i = 0; i < n_interfaces; i++) {
+		if (l_queue_find(links, rmnet_link_ifindex_matches,
+				L_UINT_TO_PTR(interfaces[i].ifindex))) {
+			rmnet_link_park(interfaces[i].ifindex);
+			continue;
+		}
+
+		req->infos[req->n_interfaces++] = interfaces[i];
+	}
+
+	if (!req->n_interfaces) {
+		l_free(req);
+		return 0;
+	}
+
 	l_queue_push_tail(request_q, req);
 
 	if (l_queue_length(request_q) == 1 && !dump_id)
@@ -622,9 +811,14 @@ static void rmnet_link_notification(uint16_t type, const void *data,
 	if (type == RTM_NEWLINK) {
 		l_uintset_put(mux_ids, mux_id);
 		update_new_link_ifindex(mux_id, ifname, ifindex);
-	} else
+	} else {
 		l_uintset_take(mux_ids, mux_id);
 
+		/* Also covers links removed along with their parent */
+		l_free(l_queue_remove_if(links, rmnet_link_ifindex_matches,
+						L_UINT_TO_PTR(ifindex)));
+	}
+
 	DBG("link_notification: %s(%u) with mux_id: %u",
 			ifname, ifindex, mux_id);
 }
@@ -647,6 +841,7 @@ static int rmnet_init(void)
 					rmnet_link_notification, NULL, NULL);
 	mux_ids = l_uintset_new_from_range(1, MAX_MUX_IDS);
 	request_q = l_queue_new();
+	links = l_queue_new();
 
 	return 0;
 dump_failed:
@@ -656,6 +851,10 @@ dump_failed:
 
 static void rmnet_exit(void)
 {
+	if (reuse_idle)
+		l_idle_remove(reuse_idle);
+
+	l_queue_destroy(links, l_free);
 	l_queue_destroy(request_q, (l_queue_destroy_func_t) rmnet_request_free);
 	l_uintset_free(mux_ids);
 	l_netlink_unregister(rtnl, link_notify_id);
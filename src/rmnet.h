@@ -11,6 +11,13 @@ struct rmnet_ifinfo {
 	char ifname[IF_NAMESIZE];
 };
 
+/* Uplink aggregation limits, as negotiated with the modem */
+struct rmnet_aggregation {
+	uint16_t max_size;
+	uint16_t max_datagrams;
+	uint32_t timeout_ns;
+};
+
 typedef void (*rmnet_new_interfaces_func_t)(int error,
 					unsigned int n_interfaces,
 					const struct rmnet_ifinfo *interfaces,
@@ -18,6 +25,7 @@ typedef void (*rmnet_new_interfaces_func_t)(int error,
 typedef void (*rmnet_destroy_func_t)(void *user_data);
 
 int rmnet_get_interfaces(uint32_t parent_ifindex, unsigned int n_interfaces,
+				const struct rmnet_aggregation *aggregation,
 				rmnet_new_interfaces_func_t cb,
 				void *user_data, rmnet_destroy_func_t destroy);
 int rmnet_del_interfaces(unsigned int n_interfaces,
@@ -23,33 +23,49 @@
 #include "util.h"
 
 #define SIM_AUTH_MAX_RANDS	3
+#define SIM_AUTH_MAX_QUEUE	32
+
+/* Seconds a logical channel is kept open once no request needs it */
+#define SIM_AUTH_DEFAULT_IDLE_TIMEOUT	5
+
+struct aid_object;
 
 /*
- * Temporary handle used for the command authentication sequence.
+ * An authentication request, queued until the ones before it are done.
+ * All its AUTHENTICATE commands are sent at once, the reply is built
+ * when the last one returned.
  */
 struct auth_request {
-	/* DBus values for GSM authentication */
 	DBusMessage *msg;
-	DBusMessage *reply;
-	DBusMessageIter iter;
-	DBusMessageIter dict;
-	/* ID from open_channel */
-	int session_id;
+	struct aid_object *app;
 	/* list of rands to calculate key (1 if umts == 1) */
 	void *rands[SIM_AUTH_MAX_RANDS];
 	int num_rands;
-	/* number of keys that have been returned */
-	int cb_count;
 	void *autn;
 	uint8_t umts : 1;
-	unsigned int watch_id;
-	struct ofono_sim_aid_session *session;
+	uint8_t started : 1;
+	/* commands sent but not answered yet, and answers received */
+	int in_flight;
+	int num_results;
+	/* GSM results by rand index */
+	uint8_t sres[SIM_AUTH_MAX_RANDS][4];
+	uint8_t kc[SIM_AUTH_MAX_RANDS][8];
+	/* UMTS result or the error to reply with */
+	DBusMessage *reply;
+	uint64_t queued;
 };
 
 struct aid_object {
 	uint8_t aid[16];
 	char *path;
 	enum sim_app_type type;
+	struct ofono_sim_auth *sa;
+	/* The logical channel, kept open across requests */
+	struct ofono_sim_aid_session *session;
+	unsigned int watch_id;
+	int session_id;
+	uint8_t active : 1;
+	guint idle_source;
 };
 
 struct ofono_sim_auth {
@@ -60,14 +76,22 @@ struct ofono_sim_auth {
 	GSList *aid_objects;
 	uint8_t gsm_access : 1;
 	uint8_t gsm_context : 1;
-	struct auth_request *pending;
+	struct l_queue *requests;
+	unsigned int idle_timeout;
 	char *nai;
+	/* Latency of the requests answered, from queuing to reply */
+	uint32_t completed;
+	uint32_t failed;
+	uint64_t latency_total;
+	uint32_t latency_max;
 };
 
+static void sim_auth_next(struct ofono_sim_auth *sa);
+
 /*
  * Find an application by path. 'path' should be a DBusMessage object path.
  */
-static uint8_t *find_aid_by_path(GSList *aid_objects,
+static struct aid_object *find_app_by_path(GSList *aid_objects,
 		const char *path)
 {
 	GSList *iter = aid_objects;
@@ -76,7 +100,7 @@ static uint8_t *find_aid_by_path(GSList *aid_objects,
 		struct aid_object *obj = iter->data;
 
 		if (!strcmp(path, obj->path))
-			return obj->aid;
+			return obj;
 
 		iter = g_slist_next(iter);
 	}
@@ -84,6 +108,20 @@ static uint8_t *find_aid_by_path(GSList *aid_objects,
 	return NULL;
 }
 
+static void app_release_session(struct aid_object *app)
+{
+	if (app->idle_source) {
+		g_source_remove(app->idle_source);
+		app->idle_source = 0;
+	}
+
+	if (app->watch_id)
+		__ofono_sim_remove_session_watch(app->session, app->watch_id);
+
+	app->watch_id = 0;
+	app->active = 0;
+}
+
 /*
  * Free all discovered AID's
  */
@@ -104,6 +142,7 @@ static void free_apps(struct ofono_sim_auth *sa)
 			g_dbus_unregister_interface(conn, obj->path,
 					OFONO_ISIM_APPLICATION_INTERFACE);
 
+		app_release_session(obj);
 		g_free(obj->path);
 		g_free(obj);
 
@@ -119,22 +158,32 @@ static void free_apps(struct ofono_sim_auth *sa)
 	g_slist_free(sa->aid_objects);
 }
 
+static void auth_request_free(void *data)
+{
+	struct auth_request *req = data;
+
+	if (req->msg)
+		dbus_message_unref(req->msg);
+
+	if (req->reply)
+		dbus_message_unref(req->reply);
+
+	g_free(req);
+}
+
 static void sim_auth_unregister(struct ofono_atom *atom)
 {
 	struct ofono_sim_auth *sa = __ofono_atom_get_data(atom);
+	struct auth_request *req;
+
+	while ((req = l_queue_pop_head(sa->requests))) {
+		__ofono_dbus_pending_reply(&req->msg,
+				__ofono_error_sim_not_ready(req->msg));
+		auth_request_free(req);
+	}
 
 	free_apps(sa);
 	l_free(sa->nai);
-
-	if (sa->pending) {
-		__ofono_dbus_pending_reply(&sa->pending->msg,
-				__ofono_error_sim_not_ready(sa->pending->msg));
-
-		__ofono_sim_remove_session_watch(sa->pending->session,
-							sa->pending->watch_id);
-		g_free(sa->pending);
-		sa->pending = NULL;
-	}
 }
 
 static void sim_auth_remove(struct ofono_atom *atom)
@@ -146,6 +195,7 @@ static void sim_auth_remove(struct ofono_atom *atom)
 	if (sa == NULL)
 		return;
 
+	l_queue_destroy(sa->requests, auth_request_free);
 	g_free(sa);
 }
 
@@ -187,19 +237,19 @@ static void append_dict_byte_array(DBusMessageIter *iter, const char *key,
 	dbus_message_iter_close_container(iter, &keyiter);
 }
 
-static void handle_umts(struct ofono_sim_auth *sa, const uint8_t *resp,
-		uint16_t len)
+static DBusMessage *build_umts_reply(DBusMessage *msg, const uint8_t *resp,
+					uint16_t len)
 {
-	DBusMessage *reply = NULL;
+	DBusMessage *reply;
 	DBusMessageIter iter;
 	DBusMessageIter dict;
 	struct data_block res, ck, ik, auts, sres, kc;
 
 	if (!sim_parse_umts_authenticate(resp, len, &res, &ck, &ik,
 			&auts, &sres, &kc))
-		goto umts_end;
+		return __ofono_error_not_supported(msg);
 
-	reply = dbus_message_new_method_return(sa->pending->msg);
+	reply = dbus_message_new_method_return(msg);
 
 	dbus_message_iter_init_append(reply, &iter);
 
@@ -226,153 +276,261 @@ static void handle_umts(struct ofono_sim_auth *sa, const uint8_t *resp,
 
 	dbus_message_iter_close_container(&iter, &dict);
 
-umts_end:
-	if (!reply)
-		reply = __ofono_error_not_supported(sa->pending->msg);
-
-	__ofono_dbus_pending_reply(&sa->pending->msg, reply);
-
-	__ofono_sim_remove_session_watch(sa->pending->session,
-			sa->pending->watch_id);
-
-	g_free(sa->pending);
-	sa->pending = NULL;
+	return reply;
 }
 
-static void handle_gsm(struct ofono_sim_auth *sa, const uint8_t *resp,
-		uint16_t len)
+static DBusMessage *build_gsm_reply(struct auth_request *req)
 {
+	DBusMessage *reply;
 	DBusMessageIter iter;
-	const uint8_t *sres = NULL;
-	const uint8_t *kc = NULL;
+	DBusMessageIter array;
+	DBusMessageIter dict;
+	int i;
 
-	if (!sim_parse_gsm_authenticate(resp, len, &sres, &kc))
-		goto gsm_end;
+	reply = dbus_message_new_method_return(req->msg);
 
-	/* initial iteration, setup the reply message */
-	if (sa->pending->cb_count == 0) {
-		sa->pending->reply = dbus_message_new_method_return(
-				sa->pending->msg);
+	dbus_message_iter_init_append(reply, &iter);
 
-		dbus_message_iter_init_append(sa->pending->reply,
-				&sa->pending->iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "a{say}",
+			&array);
 
-		dbus_message_iter_open_container(&sa->pending->iter,
-				DBUS_TYPE_ARRAY, "a{say}", &sa->pending->dict);
+	/* the Nth sres/kc byte arrays answer the Nth rand */
+	for (i = 0; i < req->num_rands; i++) {
+		dbus_message_iter_open_container(&array, DBUS_TYPE_ARRAY,
+				"{say}", &dict);
+		append_dict_byte_array(&dict, "SRES", req->sres[i], 4);
+		append_dict_byte_array(&dict, "Kc", req->kc[i], 8);
+		dbus_message_iter_close_container(&array, &dict);
 	}
 
-	/* append the Nth sres/kc byte arrays */
-	dbus_message_iter_open_container(&sa->pending->dict, DBUS_TYPE_ARRAY,
-			"{say}", &iter);
-	append_dict_byte_array(&iter, "SRES", sres, 4);
-	append_dict_byte_array(&iter, "Kc", kc, 8);
-	dbus_message_iter_close_container(&sa->pending->dict, &iter);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static gboolean app_idle_timeout(gpointer user_data)
+{
+	struct aid_object *app = user_data;
 
-	sa->pending->cb_count++;
+	DBG("closing idle session for %s", app->path);
 
-	/* calculated the number of keys requested, close container */
-	if (sa->pending->cb_count == sa->pending->num_rands) {
-		dbus_message_iter_close_container(&sa->pending->iter,
-				&sa->pending->dict);
-		goto gsm_end;
-	}
+	app->idle_source = 0;
+	app_release_session(app);
+
+	return FALSE;
+}
+
+static void sim_auth_complete(struct ofono_sim_auth *sa)
+{
+	struct auth_request *req = l_queue_pop_head(sa->requests);
+	struct aid_object *app = req->app;
+	uint32_t latency;
 
-	return;
+	if (!req->reply && req->num_results == req->num_rands)
+		req->reply = build_gsm_reply(req);
+	else if (!req->reply)
+		req->reply = __ofono_error_failed(req->msg);
 
-gsm_end:
-	if (!sa->pending->reply)
-		sa->pending->reply = __ofono_error_not_supported(
-				sa->pending->msg);
+	if (dbus_message_get_type(req->reply) == DBUS_MESSAGE_TYPE_ERROR)
+		sa->failed++;
 
-	__ofono_dbus_pending_reply(&sa->pending->msg, sa->pending->reply);
+	latency = l_time_to_msecs(l_time_diff(req->queued, l_time_now()));
+	sa->completed++;
+	sa->latency_total += latency;
 
-	__ofono_sim_remove_session_watch(sa->pending->session,
-			sa->pending->watch_id);
+	if (latency > sa->latency_max)
+		sa->latency_max = latency;
 
-	g_free(sa->pending);
+	DBG("%s answered in %u ms", app->path, latency);
 
-	sa->pending = NULL;
+	__ofono_dbus_pending_reply(&req->msg, req->reply);
+	req->reply = NULL;
+	auth_request_free(req);
+
+	/* Keep the channel around for the requests which often follow */
+	if (app->watch_id && !app->idle_source) {
+		if (sa->idle_timeout)
+			app->idle_source = g_timeout_add_seconds(
+							sa->idle_timeout,
+							app_idle_timeout, app);
+		else
+			app_release_session(app);
+	}
+
+	sim_auth_next(sa);
 }
 
 static void logical_access_cb(const struct ofono_error *error,
 		const unsigned char *resp, unsigned int len, void *data)
 {
 	struct ofono_sim_auth *sa = data;
+	struct auth_request *req = l_queue_peek_head(sa->requests);
+	const uint8_t *sres;
+	const uint8_t *kc;
+	int index;
 
-	/* error must have occurred in a previous CB */
-	if (!sa->pending)
+	/* The request was dropped along with the atom */
+	if (req == NULL || req->in_flight == 0)
 		return;
 
+	req->in_flight--;
+	index = req->num_results++;
+
+	if (req->reply)
+		goto done;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		__ofono_dbus_pending_reply(&sa->pending->msg,
-				__ofono_error_failed(sa->pending->msg));
-		g_free(sa->pending);
-		sa->pending = NULL;
-		return;
+		req->reply = __ofono_error_failed(req->msg);
+		goto done;
 	}
 
-	if (sa->pending->umts)
-		handle_umts(sa, resp, len);
-	else
-		handle_gsm(sa, resp, len);
+	if (req->umts) {
+		req->reply = build_umts_reply(req->msg, resp, len);
+		goto done;
+	}
+
+	if (!sim_parse_gsm_authenticate(resp, len, &sres, &kc)) {
+		req->reply = __ofono_error_not_supported(req->msg);
+		goto done;
+	}
+
+	memcpy(req->sres[index], sres, 4);
+	memcpy(req->kc[index], kc, 8);
+
+done:
+	if (req->in_flight == 0)
+		sim_auth_complete(sa);
 }
 
-static void get_session_cb(ofono_bool_t active, int session_id,
-		void *data)
+/*
+ * Sends the AUTHENTICATE command for each RAND of the request at once,
+ * the driver queues them on the logical channel.  In the UMTS case,
+ * num_rands is 1.
+ */
+static void sim_auth_send(struct ofono_sim_auth *sa,
+				struct auth_request *req)
 {
-	struct ofono_sim_auth *sa = data;
 	int i;
 
-	if (!active)
-		goto error;
-
-	/* save session ID for close_channel() */
-	sa->pending->session_id = session_id;
+	req->started = 1;
 
-	/*
-	 * This will do the logical access num_rand times, providing a new
-	 * RAND seed each time. In the UMTS case, num_rands should be 1.
-	 */
-	for (i = 0; i < sa->pending->num_rands; i++) {
+	for (i = 0; i < req->num_rands; i++) {
 		uint8_t auth_cmd[40];
 		int len = 0;
 
-		if (sa->pending->umts)
+		if (req->umts)
 			len = sim_build_umts_authenticate(auth_cmd, 40,
-					sa->pending->rands[i],
-					sa->pending->autn);
+					req->rands[i], req->autn);
 		else
 			len = sim_build_gsm_authenticate(auth_cmd, 40,
-					sa->pending->rands[i]);
+					req->rands[i]);
+
+		if (!len) {
+			req->reply = __ofono_error_failed(req->msg);
+			break;
+		}
 
-		if (!len)
-			goto error;
+		req->in_flight++;
+		ofono_sim_logical_access(sa->sim, req->app->session_id,
+				auth_cmd, len, logical_access_cb, sa);
+	}
+
+	if (req->in_flight == 0)
+		sim_auth_complete(sa);
+}
+
+static void get_session_cb(ofono_bool_t active, int session_id,
+		void *data)
+{
+	struct aid_object *app = data;
+	struct ofono_sim_auth *sa = app->sa;
+	struct auth_request *req = l_queue_peek_head(sa->requests);
+
+	if (!active) {
+		/* Drop the watch so that the next request opens again */
+		app_release_session(app);
+
+		if (req && req->app == app && !req->started) {
+			req->started = 1;
+			req->reply = __ofono_error_failed(req->msg);
+			sim_auth_complete(sa);
+		}
 
-		ofono_sim_logical_access(sa->sim, session_id, auth_cmd, len,
-				logical_access_cb, sa);
+		return;
 	}
 
-	return;
+	/* save session ID for the logical access */
+	app->session_id = session_id;
+	app->active = 1;
 
-error:
-	__ofono_dbus_pending_reply(&sa->pending->msg,
-			__ofono_error_failed(sa->pending->msg));
-	__ofono_sim_remove_session_watch(sa->pending->session,
-			sa->pending->watch_id);
-	g_free(sa->pending);
-	sa->pending = NULL;
+	if (req && req->app == app && !req->started)
+		sim_auth_send(sa, req);
+}
+
+static void sim_auth_next(struct ofono_sim_auth *sa)
+{
+	struct auth_request *req = l_queue_peek_head(sa->requests);
+	struct aid_object *app;
+
+	if (req == NULL || req->started)
+		return;
+
+	app = req->app;
+
+	if (app->idle_source) {
+		g_source_remove(app->idle_source);
+		app->idle_source = 0;
+	}
+
+	if (app->active) {
+		sim_auth_send(sa, req);
+		return;
+	}
+
+	/* get_session_cb is called right away if the session is open */
+	if (app->watch_id == 0)
+		app->watch_id = __ofono_sim_add_session_watch(app->session,
+						get_session_cb, app, NULL);
+
+	if (app->watch_id == 0) {
+		req->started = 1;
+		req->reply = __ofono_error_failed(req->msg);
+		sim_auth_complete(sa);
+	}
+}
+
+static DBusMessage *sim_auth_queue(struct ofono_sim_auth *sa,
+					struct auth_request *req)
+{
+	req->app = find_app_by_path(sa->aid_objects,
+					dbus_message_get_path(req->msg));
+	req->queued = l_time_now();
+
+	if (l_queue_length(sa->requests) >= SIM_AUTH_MAX_QUEUE ||
+			req->app == NULL) {
+		DBusMessage *reply = req->app ?
+					__ofono_error_busy(req->msg) :
+					__ofono_error_failed(req->msg);
+
+		auth_request_free(req);
+		return reply;
+	}
+
+	l_queue_push_tail(sa->requests, req);
+
+	if (l_queue_length(sa->requests) == 1)
+		sim_auth_next(sa);
+
+	return NULL;
 }
 
 static DBusMessage *usim_gsm_authenticate(DBusConnection *conn,
 		DBusMessage *msg, void *data)
 {
 	struct ofono_sim_auth *sa = data;
+	struct auth_request *req;
 	DBusMessageIter iter;
 	DBusMessageIter array;
-	uint8_t *aid;
-
-	if (sa->pending)
-		return __ofono_error_busy(msg);
 
 	if (!dbus_message_iter_init(msg, &iter))
 		return __ofono_error_invalid_args(msg);
@@ -380,7 +538,8 @@ static DBusMessage *usim_gsm_authenticate(DBusConnection *conn,
 	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
 		return __ofono_error_invalid_format(msg);
 
-	sa->pending = g_new0(struct auth_request, 1);
+	req = g_new0(struct auth_request, 1);
+	req->msg = dbus_message_ref(msg);
 
 	dbus_message_iter_recurse(&iter, &array);
 
@@ -391,12 +550,11 @@ static DBusMessage *usim_gsm_authenticate(DBusConnection *conn,
 		dbus_message_iter_recurse(&array, &in);
 
 		if (dbus_message_iter_get_arg_type(&in) != DBUS_TYPE_BYTE ||
-				sa->pending->num_rands == SIM_AUTH_MAX_RANDS)
+				req->num_rands == SIM_AUTH_MAX_RANDS)
 			goto format_error;
 
 		dbus_message_iter_get_fixed_array(&in,
-				&sa->pending->rands[sa->pending->num_rands++],
-				&nelement);
+				&req->rands[req->num_rands++], &nelement);
 
 		if (nelement != 16)
 			goto format_error;
@@ -404,23 +562,13 @@ static DBusMessage *usim_gsm_authenticate(DBusConnection *conn,
 		dbus_message_iter_next(&array);
 	}
 
-	if (sa->pending->num_rands < 2)
+	if (req->num_rands < 2)
 		goto format_error;
 
-	/*
-	 * retrieve session from SIM
-	 */
-	aid = find_aid_by_path(sa->aid_objects, dbus_message_get_path(msg));
-	sa->pending->session = __ofono_sim_get_session_by_aid(sa->sim, aid);
-	sa->pending->msg = dbus_message_ref(msg);
-	sa->pending->watch_id = __ofono_sim_add_session_watch(
-			sa->pending->session, get_session_cb, sa, NULL);
-
-	return NULL;
+	return sim_auth_queue(sa, req);
 
 format_error:
-	g_free(sa->pending);
-	sa->pending = NULL;
+	auth_request_free(req);
 	return __ofono_error_invalid_format(msg);
 }
 
@@ -432,10 +580,7 @@ static DBusMessage *umts_common(DBusConnection *conn, DBusMessage *msg,
 	uint32_t rlen;
 	uint32_t alen;
 	struct ofono_sim_auth *sa = data;
-	uint8_t *aid;
-
-	if (sa->pending)
-		return __ofono_error_busy(msg);
+	struct auth_request *req;
 
 	/* get RAND/AUTN and setup handle args */
 	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_ARRAY,
@@ -447,23 +592,14 @@ static DBusMessage *umts_common(DBusConnection *conn, DBusMessage *msg,
 	if (rlen != 16 || alen != 16)
 		return __ofono_error_invalid_format(msg);
 
-	sa->pending = g_new0(struct auth_request, 1);
-	sa->pending->msg = dbus_message_ref(msg);
-	sa->pending->rands[0] = rand;
-	sa->pending->num_rands = 1;
-	sa->pending->autn = autn;
-	sa->pending->umts = 1;
-
-	/*
-	 * retrieve session from SIM
-	 */
-	aid = find_aid_by_path(sa->aid_objects, dbus_message_get_path(msg));
-	sa->pending->session = __ofono_sim_get_session_by_aid(sa->sim, aid);
-
-	sa->pending->watch_id = __ofono_sim_add_session_watch(
-			sa->pending->session, get_session_cb, sa, NULL);
+	req = g_new0(struct auth_request, 1);
+	req->msg = dbus_message_ref(msg);
+	req->rands[0] = rand;
+	req->num_rands = 1;
+	req->autn = autn;
+	req->umts = 1;
 
-	return NULL;
+	return sim_auth_queue(sa, req);
 }
 
 static DBusMessage *get_applications(DBusConnection *conn,
@@ -546,6 +682,20 @@ static DBusMessage *get_sim_auth_properties(DBusConnection *conn,
 		ofono_dbus_dict_append(&dict, "NetworkAccessIdentity",
 				DBUS_TYPE_STRING, &sa->nai);
 
+	ofono_dbus_dict_append(&dict, "CompletedRequests", DBUS_TYPE_UINT32,
+				&sa->completed);
+	ofono_dbus_dict_append(&dict, "FailedRequests", DBUS_TYPE_UINT32,
+				&sa->failed);
+
+	if (sa->completed) {
+		uint32_t average = sa->latency_total / sa->completed;
+
+		ofono_dbus_dict_append(&dict, "AverageLatency",
+					DBUS_TYPE_UINT32, &average);
+		ofono_dbus_dict_append(&dict, "MaximumLatency",
+					DBUS_TYPE_UINT32, &sa->latency_max);
+	}
+
 	dbus_message_iter_close_container(&iter, &dict);
 
 	return reply;
@@ -685,6 +835,7 @@ static void sim_auth_register(struct ofono_sim_auth *sa)
 		struct aid_object *new = g_new0(struct aid_object, 1);
 
 		new->type = r->type;
+		new->sa = sa;
 
 		switch (r->type) {
 		case SIM_APP_TYPE_USIM:
@@ -700,6 +851,8 @@ static void sim_auth_register(struct ofono_sim_auth *sa)
 					sa, NULL);
 
 			memcpy(new->aid, r->aid, 16);
+			new->session = __ofono_sim_get_session_by_aid(sim,
+								new->aid);
 
 			break;
 		case SIM_APP_TYPE_ISIM:
@@ -715,6 +868,8 @@ static void sim_auth_register(struct ofono_sim_auth *sa)
 					sa, NULL);
 
 			memcpy(new->aid, r->aid, 16);
+			new->session = __ofono_sim_get_session_by_aid(sim,
+								new->aid);
 
 			break;
 		default:
@@ -763,6 +918,13 @@ struct ofono_sim_auth *ofono_sim_auth_create(struct ofono_modem *modem)
 	if (sa == NULL)
 		return NULL;
 
+	sa->requests = l_queue_new();
+
+	if (!l_settings_get_uint(__ofono_get_config(), "SimAuthentication",
+					"SessionIdleTimeout",
+					&sa->idle_timeout))
+		sa->idle_timeout = SIM_AUTH_DEFAULT_IDLE_TIMEOUT;
+
 	sa->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_SIM_AUTH,
 						sim_auth_remove, sa);
 
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 
 #include <glib.h>
@@ -95,6 +96,8 @@ struct ofono_sim {
 
 	enum ofono_sim_state state;
 	struct ofono_watchlist *state_watches;
+	uint64_t inserted_time;
+	struct ofono_telemetry *ready_time;
 
 	char *spn;
 	char *spn_dc;
@@ -122,7 +125,11 @@ struct ofono_sim {
 	GSList *aid_sessions;
 	GSList *aid_list;
 	char *impi;
+
+	struct l_queue *warm_cards;	/* Most recently used first */
+
 	bool language_prefs_update : 1;
+	bool slot_switching : 1;
 	bool fixed_dialing : 1;
 	bool barred_dialing : 1;
 	bool sdn_ready : 1;
@@ -136,6 +143,29 @@ struct cached_pin {
 	char *pin;
 };
 
+/*
+ * Result of reading one of the EFs of the NAA initialisation procedure,
+ * remembered for the card it was read from.  It survives NAA
+ * reinitialisation and card removal, so that the procedure can be replayed
+ * without going to the card unless a refresh names the file.  The IMSI is
+ * kept the same way, as a string under SIM_EFIMSI_FILEID.
+ */
+struct warm_ef {
+	int id;
+	int length;
+	unsigned char data[];
+};
+
+/*
+ * The EFs remembered for one card.  One card per slot is kept, so that
+ * switching the active slot back and forth only goes to the card for its
+ * ICCID.
+ */
+struct warm_card {
+	char *iccid;
+	struct l_queue *efs;
+};
+
 struct msisdn_set_request {
 	struct ofono_sim *sim;
 	int pending;
@@ -350,11 +380,13 @@ static void service_number_free(gpointer pointer)
 
 static void call_state_watches(struct ofono_sim *sim)
 {
-	GSList *l;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 	ofono_sim_state_event_cb_t notify;
 
-	for (l = sim->state_watches->items; l; l = l->next) {
-		struct ofono_watchlist_item *item = l->data;
+	__ofono_watchlist_iter_init(&iter, sim->state_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		notify = item->notify;
 
 		notify(sim->state, item->notify_data);
@@ -660,6 +692,7 @@ static void sim_set_slot_callback(const struct ofono_error *error, void *data)
 		DBG("Error setting radio access mode");
 
 		sim->pending_active_card_slot = sim->active_card_slot;
+		sim->slot_switching = false;
 
 		reply = __ofono_error_from_error(error, sim->pending);
 		__ofono_dbus_pending_reply(&sim->pending, reply);
@@ -772,6 +805,7 @@ error:
 
 		sim->pending = dbus_message_ref(msg);
 		sim->pending_active_card_slot = value;
+		sim->slot_switching = true;
 
 		sim->driver->set_active_card_slot(sim, value - 1,
 							sim_set_slot_callback,
@@ -1052,19 +1086,22 @@ static DBusMessage *sim_enter_pin(DBusConnection *conn, DBusMessage *msg,
 	return NULL;
 }
 
+/* The XPM is only generated here, the cache keeps the decoded image */
 static void sim_get_image_cb(struct ofono_sim *sim,
-				unsigned char id, char *xpm, gboolean cache)
+				const struct stk_image *image)
 {
 	DBusMessage *reply;
 	DBusMessageIter iter, array;
+	char *xpm;
 	int xpm_len;
 
-	if (xpm == NULL) {
+	if (image == NULL) {
 		reply = __ofono_error_failed(sim->pending);
 		__ofono_dbus_pending_reply(&sim->pending, reply);
 		return;
 	}
 
+	xpm = stk_image_xpm(image);
 	xpm_len = strlen(xpm);
 
 	reply = dbus_message_new_method_return(sim->pending);
@@ -1079,12 +1116,18 @@ static void sim_get_image_cb(struct ofono_sim *sim,
 
 	__ofono_dbus_pending_reply(&sim->pending, reply);
 
-	if (cache)
-		sim_fs_cache_image(sim->simfs, (const char *) xpm, id);
-
 	l_free(xpm);
 }
 
+static void sim_image_decoded(struct ofono_sim *sim, unsigned char id,
+				struct stk_image *image)
+{
+	const unsigned char *efimg = &sim->efimg[id * 9];
+
+	sim_get_image_cb(sim, image);
+	sim_fs_cache_image(sim->simfs, image, id, efimg[3] << 8 | efimg[4]);
+}
+
 static void sim_iidf_read_clut_cb(int ok, int length, int record,
 					const unsigned char *data,
 					int record_length, void *userdata)
@@ -1094,7 +1137,7 @@ static void sim_iidf_read_clut_cb(int ok, int length, int record,
 	unsigned char *efimg;
 	unsigned short iidf_len;
 	unsigned short clut_len;
-	char *xpm;
+	struct stk_image *image;
 
 	DBG("ok: %d", ok);
 
@@ -1104,7 +1147,7 @@ static void sim_iidf_read_clut_cb(int ok, int length, int record,
 	efimg = &sim->efimg[id * 9];
 
 	if (!ok) {
-		sim_get_image_cb(sim, id, NULL, FALSE);
+		sim_get_image_cb(sim, NULL);
 		goto done;
 	}
 
@@ -1115,9 +1158,9 @@ static void sim_iidf_read_clut_cb(int ok, int length, int record,
 	else
 		clut_len = sim->iidf_image[3] * 3;
 
-	xpm = stk_image_to_xpm(sim->iidf_image, iidf_len, efimg[2],
+	image = stk_image_decode(sim->iidf_image, iidf_len, efimg[2],
 					data, clut_len);
-	sim_get_image_cb(sim, id, xpm, TRUE);
+	sim_image_decoded(sim, id, image);
 
 done:
 	g_free(sim->iidf_image);
@@ -1145,13 +1188,13 @@ static void sim_iidf_read_cb(int ok, int length, int record,
 	efimg = &sim->efimg[id * 9];
 
 	if (!ok) {
-		sim_get_image_cb(sim, id, NULL, FALSE);
+		sim_get_image_cb(sim, NULL);
 		return;
 	}
 
 	if (efimg[2] == STK_IMG_SCHEME_BASIC) {
-		char *xpm = stk_image_to_xpm(data, length, efimg[2], NULL, 0);
-		sim_get_image_cb(sim, id, xpm, TRUE);
+		sim_image_decoded(sim, id, stk_image_decode(data, length,
+							efimg[2], NULL, 0));
 		return;
 	}
 
@@ -1183,26 +1226,26 @@ static void sim_get_image(struct ofono_sim *sim, unsigned char id,
 				gpointer user_data)
 {
 	unsigned char *efimg;
-	char *image;
+	const struct stk_image *image;
 	unsigned short iidf_id;
 	unsigned short iidf_offset;
 	unsigned short iidf_len;
 
 	if (sim->efimg_length <= id * 9) {
-		sim_get_image_cb(sim, id, NULL, FALSE);
+		sim_get_image_cb(sim, NULL);
 		return;
 	}
 
-	image = sim_fs_get_cached_image(sim->simfs, id);
-	if (image != NULL)
-		sim_get_image_cb(sim, id, image, FALSE);
-
 	efimg = &sim->efimg[id * 9];
 
 	iidf_id = efimg[3] << 8 | efimg[4];
 	iidf_offset = efimg[5] << 8 | efimg[6];
 	iidf_len = efimg[7] << 8 | efimg[8];
 
+	image = sim_fs_get_cached_image(sim->simfs, id, iidf_id);
+	if (image != NULL)
+		sim_get_image_cb(sim, image);
+
 	/* read the image data */
 	if (image == NULL) {
 		unsigned char path[6];
@@ -1515,14 +1558,17 @@ static void sim_own_numbers_changed(int id, void *userdata)
 	sim_own_numbers_update(sim);
 }
 
-static void spn_watch_cb(gpointer data, gpointer user_data)
+static void spn_watches_notify(struct ofono_sim *sim)
 {
-	struct ofono_watchlist_item *item = data;
-	struct ofono_sim *sim = user_data;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 
-	if (item->notify)
-		((ofono_sim_spn_cb_t) item->notify)(sim->spn, sim->spn_dc,
-							item->notify_data);
+	__ofono_watchlist_iter_init(&iter, sim->spn_watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter)))
+		if (item->notify)
+			((ofono_sim_spn_cb_t) item->notify)(sim->spn,
+						sim->spn_dc, item->notify_data);
 }
 
 static void sim_spn_set(struct ofono_sim *sim, const void *data, int length,
@@ -1580,7 +1626,7 @@ notify:
 						"ServiceProviderName",
 						DBUS_TYPE_STRING, &sim->spn);
 
-	g_slist_foreach(sim->spn_watches->items, spn_watch_cb, sim);
+	spn_watches_notify(sim);
 }
 
 static void sim_cphs_spn_short_read_cb(int ok, int length, int record,
@@ -1765,6 +1811,18 @@ static void sim_set_ready(struct ofono_sim *sim)
 
 	sim->state = OFONO_SIM_STATE_READY;
 
+	if (sim->inserted_time) {
+		uint64_t elapsed = l_time_diff(sim->inserted_time,
+							l_time_now());
+
+		ofono_info("%s: SIM ready %" PRIu64 " ms after insertion",
+				__ofono_atom_get_path(sim->atom),
+				l_time_to_msecs(elapsed));
+		__ofono_telemetry_sample(sim->ready_time,
+						l_time_to_msecs(elapsed));
+		sim->inserted_time = 0;
+	}
+
 	sim_fs_check_version(sim->simfs);
 
 	call_state_watches(sim);
@@ -1834,12 +1892,122 @@ static void discover_apps_cb(const struct ofono_error *error,
 	}
 }
 
+static bool warm_ef_match(const void *a, const void *b)
+{
+	const struct warm_ef *ef = a;
+
+	return ef->id == L_PTR_TO_INT(b);
+}
+
+static void warm_card_free(void *data)
+{
+	struct warm_card *card = data;
+
+	l_queue_destroy(card->efs, l_free);
+	l_free(card->iccid);
+	l_free(card);
+}
+
+static bool warm_card_match(const void *a, const void *b)
+{
+	const struct warm_card *card = a;
+
+	return !strcmp(card->iccid, b);
+}
+
+/* Finds the EFs of the card inserted, creating them if asked to */
+static struct warm_card *sim_warm_card(struct ofono_sim *sim, bool create)
+{
+	unsigned int max = sim->card_slot_count ? sim->card_slot_count : 1;
+	struct warm_card *card;
+
+	if (sim->iccid == NULL)
+		return NULL;
+
+	card = l_queue_remove_if(sim->warm_cards, warm_card_match,
+								sim->iccid);
+	if (card == NULL && !create)
+		return NULL;
+
+	if (card == NULL) {
+		card = l_new(struct warm_card, 1);
+		card->iccid = l_strdup(sim->iccid);
+		card->efs = l_queue_new();
+	}
+
+	if (sim->warm_cards == NULL)
+		sim->warm_cards = l_queue_new();
+
+	/* Forget the card used longest ago once every slot has one */
+	while (l_queue_length(sim->warm_cards) >= max) {
+		struct warm_card *oldest = l_queue_peek_tail(sim->warm_cards);
+
+		l_queue_remove(sim->warm_cards, oldest);
+		warm_card_free(oldest);
+	}
+
+	l_queue_push_head(sim->warm_cards, card);
+
+	return card;
+}
+
+static struct warm_ef *sim_warm_find(struct ofono_sim *sim, int id)
+{
+	struct warm_card *card = sim_warm_card(sim, false);
+
+	if (card == NULL)
+		return NULL;
+
+	return l_queue_find(card->efs, warm_ef_match, L_INT_TO_PTR(id));
+}
+
+static void sim_warm_drop(struct ofono_sim *sim, int id)
+{
+	struct warm_card *card = sim_warm_card(sim, false);
+
+	if (card == NULL)
+		return;
+
+	if (id < 0) {
+		l_queue_clear(card->efs, l_free);
+		return;
+	}
+
+	l_free(l_queue_remove_if(card->efs, warm_ef_match, L_INT_TO_PTR(id)));
+}
+
+static void sim_warm_store(struct ofono_sim *sim, int id, int ok,
+				const unsigned char *data, int length)
+{
+	struct warm_card *card;
+	struct warm_ef *ef;
+
+	/* Failures may be transient, only remember what the card returned */
+	if (!ok)
+		return;
+
+	card = sim_warm_card(sim, true);
+	if (card == NULL)
+		return;
+
+	l_free(l_queue_remove_if(card->efs, warm_ef_match, L_INT_TO_PTR(id)));
+
+	ef = l_malloc(sizeof(struct warm_ef) + length);
+	ef->id = id;
+	ef->length = length;
+	memcpy(ef->data, data, length);
+
+	l_queue_push_tail(card->efs, ef);
+}
+
 static void sim_imsi_obtained(struct ofono_sim *sim, const char *imsi)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(sim->atom);
 
 	sim->imsi = l_strdup(imsi);
+	sim_warm_store(sim, SIM_EFIMSI_FILEID, 1,
+			(const unsigned char *) imsi, strlen(imsi) + 1);
 
 	ofono_dbus_signal_property_changed(conn, path,
 						OFONO_SIM_MANAGER_INTERFACE,
@@ -1932,6 +2100,14 @@ static void sim_imsi_cb(const struct ofono_error *error, const char *imsi,
 
 static void sim_retrieve_imsi(struct ofono_sim *sim)
 {
+	struct warm_ef *ef = sim_warm_find(sim, SIM_EFIMSI_FILEID);
+
+	if (ef) {
+		DBG("IMSI replayed for %s", sim->iccid);
+		sim_imsi_obtained(sim, (const char *) ef->data);
+		return;
+	}
+
 	if (sim->driver->read_imsi) {
 		sim->driver->read_imsi(sim, sim_imsi_cb, sim);
 		return;
@@ -2032,12 +2208,33 @@ out:
 	}
 }
 
+/*
+ * Reads one of the NAA initialisation EFs, replaying the remembered result
+ * if the card inserted is the one it was read from.
+ */
+static void sim_init_read(struct ofono_sim *sim, int id,
+				ofono_sim_file_read_cb_t cb)
+{
+	struct warm_ef *ef = sim_warm_find(sim, id);
+
+	if (ef) {
+		DBG("%04x replayed for %s", id, sim->iccid);
+		cb(1, ef->length, 0, ef->data, ef->length, sim);
+		return;
+	}
+
+	ofono_sim_read(sim->context, id, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
+			cb, sim);
+}
+
 static void sim_efsst_read_cb(int ok, int length, int record,
 				const unsigned char *data,
 				int record_length, void *userdata)
 {
 	struct ofono_sim *sim = userdata;
 
+	sim_warm_store(sim, SIM_EFSST_FILEID, ok, data, length);
+
 	if (!ok)
 		goto out;
 
@@ -2077,6 +2274,8 @@ static void sim_efest_read_cb(int ok, int length, int record,
 	struct ofono_sim *sim = userdata;
 	gboolean available;
 
+	sim_warm_store(sim, SIM_EFEST_FILEID, ok, data, length);
+
 	if (!ok)
 		goto out;
 
@@ -2121,6 +2320,8 @@ static void sim_efust_read_cb(int ok, int length, int record,
 {
 	struct ofono_sim *sim = userdata;
 
+	sim_warm_store(sim, SIM_EFUST_FILEID, ok, data, length);
+
 	if (!ok)
 		goto out;
 
@@ -2146,9 +2347,7 @@ static void sim_efust_read_cb(int ok, int length, int record,
 				SIM_UST_SERVICE_FDN) ||
 			sim_ust_is_available(sim->efust, sim->efust_length,
 				SIM_UST_SERVICE_BDN)) {
-		ofono_sim_read(sim->context, SIM_EFEST_FILEID,
-				OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-				sim_efest_read_cb, sim);
+		sim_init_read(sim, SIM_EFEST_FILEID, sim_efest_read_cb);
 
 		return;
 	}
@@ -2163,6 +2362,8 @@ static void sim_cphs_information_read_cb(int ok, int length, int record,
 {
 	struct ofono_sim *sim = userdata;
 
+	sim_warm_store(sim, SIM_EF_CPHS_INFORMATION_FILEID, ok, data, length);
+
 	sim->cphs_phase = OFONO_SIM_CPHS_PHASE_NONE;
 
 	if (!ok || length < 3)
@@ -2183,6 +2384,8 @@ static void sim_ad_read_cb(int ok, int length, int record,
 	struct ofono_sim *sim = userdata;
 	int new_mnc_length;
 
+	sim_warm_store(sim, SIM_EFAD_FILEID, ok, data, length);
+
 	if (!ok)
 		return;
 
@@ -2206,12 +2409,12 @@ static void sim_efphase_read_cb(int ok, int length, int record,
 {
 	struct ofono_sim *sim = userdata;
 
+	sim_warm_store(sim, SIM_EFPHASE_FILEID, ok, data, length);
+
 	if (!ok || length != 1) {
 		sim->phase = OFONO_SIM_PHASE_3G;
 
-		ofono_sim_read(sim->context, SIM_EFUST_FILEID,
-				OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-				sim_efust_read_cb, sim);
+		sim_init_read(sim, SIM_EFUST_FILEID, sim_efust_read_cb);
 
 		return;
 	}
@@ -2231,9 +2434,7 @@ static void sim_efphase_read_cb(int ok, int length, int record,
 		return;
 	}
 
-	ofono_sim_read(sim->context, SIM_EFSST_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_efsst_read_cb, sim);
+	sim_init_read(sim, SIM_EFSST_FILEID, sim_efsst_read_cb);
 }
 
 static void sim_initialize_after_pin(struct ofono_sim *sim)
@@ -2246,21 +2447,15 @@ static void sim_initialize_after_pin(struct ofono_sim *sim)
 	if (sim->driver->list_apps)
 		sim->driver->list_apps(sim, discover_apps_cb, sim);
 
-	ofono_sim_read(sim->context, SIM_EFPHASE_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_efphase_read_cb, sim);
-
-	ofono_sim_read(sim->context, SIM_EFAD_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_ad_read_cb, sim);
+	sim_init_read(sim, SIM_EFPHASE_FILEID, sim_efphase_read_cb);
+	sim_init_read(sim, SIM_EFAD_FILEID, sim_ad_read_cb);
 
 	/*
 	 * Read CPHS-support bits, this is still part of the SIM
 	 * initialisation but no order is specified for it.
 	 */
-	ofono_sim_read(sim->context, SIM_EF_CPHS_INFORMATION_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_cphs_information_read_cb, sim);
+	sim_init_read(sim, SIM_EF_CPHS_INFORMATION_FILEID,
+					sim_cphs_information_read_cb);
 }
 
 static void sim_efli_read_cb(int ok, int length, int record,
@@ -2927,16 +3122,21 @@ void ofono_sim_inserted_notify(struct ofono_sim *sim, ofono_bool_t inserted)
 		 * EFli and EFpl are retrieved.
 		 */
 		sim->state = OFONO_SIM_STATE_INSERTED;
+		sim->inserted_time = l_time_now();
 		__ofono_sim_recheck_pin(sim);
 		return;
 	}
 
-	if (inserted == TRUE && sim->state == OFONO_SIM_STATE_NOT_PRESENT)
+	if (inserted == TRUE && sim->state == OFONO_SIM_STATE_NOT_PRESENT) {
 		sim->state = OFONO_SIM_STATE_INSERTED;
-	else if (inserted == FALSE && sim->state != OFONO_SIM_STATE_NOT_PRESENT)
+		sim->inserted_time = l_time_now();
+		sim->slot_switching = false;
+	} else if (inserted == FALSE &&
+			sim->state != OFONO_SIM_STATE_NOT_PRESENT) {
 		sim->state = OFONO_SIM_STATE_NOT_PRESENT;
-	else
+	} else {
 		return;
+	}
 
 	if (!__ofono_atom_get_registered(sim->atom))
 		return;
@@ -2973,7 +3173,12 @@ void ofono_sim_inserted_notify(struct ofono_sim *sim, ofono_bool_t inserted)
 		sim->pin_retries[OFONO_SIM_PASSWORD_SIM_PIN2] = -1;
 		sim->pin_retries[OFONO_SIM_PASSWORD_SIM_PUK2] = -1;
 
-		pin_cache_remove(sim->iccid);
+		/*
+		 * The card left for another slot is still there, keep its
+		 * PIN for when the slot is switched back
+		 */
+		if (!sim->slot_switching)
+			pin_cache_remove(sim->iccid);
 
 		sim_free_state(sim);
 	}
@@ -3203,6 +3408,9 @@ static void sim_unregister(struct ofono_atom *atom)
 	__ofono_watchlist_free(sim->spn_watches);
 	sim->spn_watches = NULL;
 
+	__ofono_telemetry_unregister(sim->ready_time);
+	sim->ready_time = NULL;
+
 	g_dbus_unregister_interface(conn, path, OFONO_SIM_MANAGER_INTERFACE);
 	ofono_modem_remove_interface(modem, OFONO_SIM_MANAGER_INTERFACE);
 }
@@ -3221,6 +3429,8 @@ static void sim_remove(struct ofono_atom *atom)
 
 	sim_free_state(sim);
 
+	l_queue_destroy(sim->warm_cards, warm_card_free);
+
 	sim_fs_free(sim->simfs);
 	sim->simfs = NULL;
 	sim_fs_free(sim->simfs_isim);
@@ -3308,6 +3518,8 @@ void ofono_sim_register(struct ofono_sim *sim)
 	sim->state_watches = __ofono_watchlist_new(g_free);
 	sim->spn_watches = __ofono_watchlist_new(g_free);
 	sim->simfs = sim_fs_new(sim, sim->driver);
+	sim->ready_time = __ofono_telemetry_register(modem, "sim.ready-time",
+						OFONO_TELEMETRY_HISTOGRAM);
 
 	ofono_sim_add_state_watch(sim, sim_ready, sim, NULL);
 
@@ -3421,11 +3633,13 @@ static void sim_file_changed_flush(struct ofono_sim *sim, int id)
 				sim->efimg[i * 9 + 4];
 
 			if (imgid == id)
-				sim_fs_image_cache_flush_file(sim->simfs, i);
+				sim_fs_image_cache_flush_file(sim->simfs, i,
+								imgid);
 		}
 	}
 
 	sim_fs_cache_flush_file(sim->simfs, id);
+	sim_warm_drop(sim, id);
 }
 
 void __ofono_sim_refresh(struct ofono_sim *sim, struct l_queue *files,
@@ -3476,9 +3690,10 @@ void __ofono_sim_refresh(struct ofono_sim *sim, struct l_queue *files,
 	}
 
 	/* Flush cached content for affected files */
-	if (full_file_change)
+	if (full_file_change) {
 		sim_fs_cache_flush(sim->simfs);
-	else {
+		sim_warm_drop(sim, -1);
+	} else {
 		for (l = l_queue_get_entries(files); l; l = l->next) {
 			struct stk_file *file = l->data;
 			int id = (file->file[file->len - 2] << 8) |
@@ -3489,6 +3704,9 @@ void __ofono_sim_refresh(struct ofono_sim *sim, struct l_queue *files,
 	}
 
 	if (reinit_naa) {
+		/* The NAA may come back with another IMSI */
+		sim_warm_drop(sim, SIM_EFIMSI_FILEID);
+
 		sim->state = OFONO_SIM_STATE_RESETTING;
 		__ofono_modem_sim_reset(__ofono_atom_get_modem(sim->atom));
 
@@ -3519,6 +3737,11 @@ const char *__ofono_sim_get_impi(struct ofono_sim *sim)
 	return sim->impi;
 }
 
+const char *__ofono_sim_get_iccid(struct ofono_sim *sim)
+{
+	return sim->iccid;
+}
+
 static void open_channel_cb(const struct ofono_error *error, int session_id,
 		void *data);
 
@@ -3529,7 +3752,7 @@ static void close_channel_cb(const struct ofono_error *error, void *data)
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
 		DBG("session %d failed to close", session->session_id);
 
-	if (g_slist_length(session->watches->items) > 0 &&
+	if (__ofono_watchlist_count(session->watches) > 0 &&
 				session->state == SESSION_STATE_OPENING) {
 		/*
 		 * An atom requested to open during a close, we can re-open
@@ -3548,7 +3771,8 @@ static void open_channel_cb(const struct ofono_error *error, int session_id,
 		void *data)
 {
 	struct ofono_sim_aid_session *session = data;
-	GSList *iter = session->watches->items;
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
 	ofono_bool_t active = TRUE;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
@@ -3558,7 +3782,7 @@ static void open_channel_cb(const struct ofono_error *error, int session_id,
 		goto end;
 	}
 
-	if (g_slist_length(iter) == 0) {
+	if (__ofono_watchlist_count(session->watches) == 0) {
 		/*
 		 * All watchers stopped watching before the channel could open.
 		 * Close the channel.
@@ -3576,13 +3800,12 @@ end:
 	 * Notify any watchers, after this point, all future watchers will be
 	 * immediately notified with the session ID.
 	 */
-	while (iter) {
-		struct ofono_watchlist_item *item = iter->data;
+	__ofono_watchlist_iter_init(&iter, session->watches);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
 		ofono_sim_session_event_cb_t notify = item->notify;
 
 		notify(active, session->session_id, item->notify_data);
-
-		iter = g_slist_next(iter);
 	}
 }
 
@@ -3607,7 +3830,7 @@ unsigned int __ofono_sim_add_session_watch(
 	item->destroy = destroy;
 	item->notify_data = data;
 
-	if (g_slist_length(session->watches->items) == 0 &&
+	if (__ofono_watchlist_count(session->watches) == 0 &&
 			session->state == SESSION_STATE_INACTIVE) {
 		/*
 		 * If the session is inactive and there are no watchers, open
@@ -3639,7 +3862,7 @@ void __ofono_sim_remove_session_watch(struct ofono_sim_aid_session *session,
 {
 	__ofono_watchlist_remove_item(session->watches, id);
 
-	if (g_slist_length(session->watches->items) == 0 &&
+	if (__ofono_watchlist_count(session->watches) == 0 &&
 			session->state == SESSION_STATE_OPEN) {
 		/* last watcher, close session */
 		session->state = SESSION_STATE_CLOSING;
@@ -10,19 +10,22 @@
 #endif
 
 #include <stdio.h>
+#include <inttypes.h>
 
 #include <glib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
-#include <errno.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/mman.h>
 
 #include "ofono.h"
 
 #include "simfs.h"
 #include "simutil.h"
+#include "smsutil.h"
+#include "stkutil.h"
 #include "storage.h"
 #include "missing.h"
 
@@ -31,13 +34,37 @@
 #define SIM_CACHE_MODE 0600
 #define SIM_CACHE_BASEPATH STORAGEDIR "/%s-%i"
 #define SIM_CACHE_VERSION SIM_CACHE_BASEPATH "/version"
+#define SIM_CACHE_FILE SIM_CACHE_BASEPATH "/cache"
+/* One file per EF, as used up to version 3 */
 #define SIM_CACHE_PATH SIM_CACHE_BASEPATH "/%04x"
 #define SIM_CACHE_HEADER_SIZE 39
 #define SIM_FILE_INFO_SIZE 7
 #define SIM_IMAGE_CACHE_BASEPATH STORAGEDIR "/%s-%i/images"
-#define SIM_IMAGE_CACHE_PATH SIM_IMAGE_CACHE_BASEPATH "/%d.xpm"
+#define SIM_IMAGE_CACHE_PATH SIM_IMAGE_CACHE_BASEPATH "/%d-%04x.img"
 
-#define SIM_FS_VERSION 2
+/* Decoded images kept in memory, most recently used first */
+#define SIM_IMAGE_LRU_SIZE 16
+
+#define SIM_FS_VERSION 4
+
+#define SIM_CACHE_MAGIC "OFSC"
+#define SIM_CACHE_ENTRIES 128
+/* The mapping never moves, the file grows within it */
+#define SIM_CACHE_MAP_SIZE (8 * 1024 * 1024)
+
+/* Record reads kept in flight when the driver reads one at a time */
+#define SIM_FS_READAHEAD 4
+
+/*
+ * Operations are served by priority, in order of submission within one.
+ * The files read on the way to the SIM ready state go first, the large
+ * informational ones are read once nothing else is waiting.
+ */
+enum sim_fs_priority {
+	SIM_FS_PRIORITY_CRITICAL = 0,
+	SIM_FS_PRIORITY_NORMAL,
+	SIM_FS_PRIORITY_BACKGROUND,
+};
 
 static gboolean sim_fs_op_next(gpointer user_data);
 static gboolean sim_fs_op_read_record(gpointer user);
@@ -45,6 +72,8 @@ static gboolean sim_fs_op_read_block(gpointer user_data);
 
 struct sim_fs_op {
 	int id;
+	enum sim_fs_priority priority;
+	uint64_t queued;
 	unsigned char *buffer;
 	enum ofono_sim_file_structure structure;
 	unsigned short offset;
@@ -53,6 +82,11 @@ struct sim_fs_op {
 	int length;
 	int record_length;
 	int current;
+	int next;
+	int in_flight;
+	gboolean requesting;
+	gboolean failed;
+	unsigned char received[32];
 	unsigned char path[6];
 	unsigned char path_len;
 	gconstpointer cb;
@@ -66,19 +100,233 @@ struct ofono_sim_context {
 	struct ofono_watchlist *file_watches;
 };
 
+/*
+ * The cache of a SIM is a single file: a header, an index of the cached
+ * EFs and their contents.  It is mapped once, reading an EF from it is a
+ * lookup in the index.  The fields are in host byte order, the file
+ * never leaves the device.
+ */
+struct sim_cache_header {
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t size;
+} __attribute__((packed));
+
+struct sim_cache_entry {
+	uint16_t id;		/* 0 if the entry is free */
+	uint16_t reserved;
+	uint32_t capacity;
+	uint32_t offset;	/* 0 if the entry was never allocated */
+	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	unsigned char pad;
+} __attribute__((packed));
+
+#define SIM_CACHE_DATA_START (sizeof(struct sim_cache_header) + \
+			SIM_CACHE_ENTRIES * sizeof(struct sim_cache_entry))
+
+struct sim_cache {
+	char *imsi;
+	enum ofono_sim_phase phase;
+	int fd;
+	struct sim_cache_header *header;
+	struct sim_cache_entry *entries;
+};
+
 struct sim_fs {
 	GQueue *op_q;
 	gint op_source;
-	unsigned char bitmap[32];
-	int fd;
+	struct sim_cache cache;
+	struct sim_cache_entry *entry;
 	struct ofono_sim *sim;
 	const struct ofono_sim_driver *driver;
 	GSList *contexts;
 	struct ofono_sim_aid_session *session;
 	int session_id;
 	unsigned int watch_id;
+	struct l_queue *images;
+	unsigned int trim_id;
+};
+
+struct cached_image {
+	int id;
+	int iidf_id;
+	struct stk_image *image;
+	uint64_t last_used;
 };
 
+static void cached_image_free(void *data)
+{
+	struct cached_image *entry = data;
+
+	stk_image_free(entry->image);
+	l_free(entry);
+}
+
+static void sim_cache_close(struct sim_fs *fs)
+{
+	struct sim_cache *cache = &fs->cache;
+
+	fs->entry = NULL;
+
+	if (cache->header)
+		munmap(cache->header, SIM_CACHE_MAP_SIZE);
+
+	if (cache->fd != -1)
+		L_TFR(close(cache->fd));
+
+	l_free(cache->imsi);
+
+	memset(cache, 0, sizeof(*cache));
+	cache->fd = -1;
+}
+
+static gboolean sim_cache_reset(struct sim_cache *cache)
+{
+	struct sim_cache_header *header = cache->header;
+
+	if (ftruncate(cache->fd, SIM_CACHE_DATA_START) < 0)
+		return FALSE;
+
+	memset(header, 0, SIM_CACHE_DATA_START);
+	memcpy(header->magic, SIM_CACHE_MAGIC, sizeof(header->magic));
+	header->version = SIM_FS_VERSION;
+	header->size = SIM_CACHE_DATA_START;
+
+	return TRUE;
+}
+
+/* Maps the cache of the current SIM, creating it if needed */
+static struct sim_cache *sim_cache_open(struct sim_fs *fs)
+{
+	const char *imsi = ofono_sim_get_imsi(fs->sim);
+	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	struct sim_cache *cache = &fs->cache;
+	struct sim_cache_header *header;
+	struct stat st;
+	char *path;
+	void *map;
+
+	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
+		return NULL;
+
+	if (cache->header && cache->phase == phase &&
+			l_streq0(cache->imsi, imsi))
+		return cache;
+
+	sim_cache_close(fs);
+
+	path = l_strdup_printf(SIM_CACHE_FILE, imsi, phase);
+
+	if (create_dirs(path) == 0)
+		cache->fd = L_TFR(open(path, O_RDWR | O_CREAT,
+						SIM_CACHE_MODE));
+
+	l_free(path);
+
+	if (cache->fd == -1)
+		return NULL;
+
+	if (fstat(cache->fd, &st) < 0)
+		goto error;
+
+	map = mmap(NULL, SIM_CACHE_MAP_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, cache->fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+
+	cache->header = map;
+	cache->entries = (void *) ((char *) map +
+					sizeof(struct sim_cache_header));
+	cache->imsi = l_strdup(imsi);
+	cache->phase = phase;
+	header = cache->header;
+
+	/* Pages past the end of the file must not be touched */
+	if ((size_t) st.st_size >= SIM_CACHE_DATA_START &&
+			!memcmp(header->magic, SIM_CACHE_MAGIC,
+				sizeof(header->magic)) &&
+			header->version == SIM_FS_VERSION &&
+			header->size >= SIM_CACHE_DATA_START &&
+			header->size <= st.st_size)
+		return cache;
+
+	if (sim_cache_reset(cache))
+		return cache;
+
+error:
+	sim_cache_close(fs);
+	return NULL;
+}
+
+static struct sim_cache_entry *sim_cache_find(struct sim_cache *cache,
+						int id)
+{
+	int i;
+
+	for (i = 0; i < SIM_CACHE_ENTRIES; i++) {
+		struct sim_cache_entry *entry = &cache->entries[i];
+
+		if (entry->id == id && entry->offset != 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Finds room for the contents of an EF: the space it used before or the
+ * one of a flushed EF if large enough, or else new space at the end.
+ */
+static struct sim_cache_entry *sim_cache_alloc(struct sim_cache *cache,
+						int id, uint32_t capacity)
+{
+	struct sim_cache_header *header = cache->header;
+	struct sim_cache_entry *entry = sim_cache_find(cache, id);
+	struct sim_cache_entry *unused = NULL;
+	int i;
+
+	if (entry)
+		entry->id = 0;
+
+	for (i = 0; i < SIM_CACHE_ENTRIES; i++) {
+		entry = &cache->entries[i];
+
+		if (entry->offset == 0) {
+			if (unused == NULL)
+				unused = entry;
+
+			continue;
+		}
+
+		if (entry->id == 0 && entry->capacity >= capacity)
+			goto done;
+	}
+
+	entry = unused;
+
+	if (entry == NULL ||
+			capacity > SIM_CACHE_MAP_SIZE - header->size ||
+			ftruncate(cache->fd, header->size + capacity) < 0)
+		return NULL;
+
+	entry->offset = header->size;
+	entry->capacity = capacity;
+	header->size += capacity;
+
+done:
+	entry->id = id;
+	memset(entry->fileinfo, 0, sizeof(entry->fileinfo));
+
+	return entry;
+}
+
+static unsigned char *sim_cache_data(struct sim_cache *cache,
+					const struct sim_cache_entry *entry)
+{
+	return (unsigned char *) cache->header + entry->offset;
+}
+
 static void sim_fs_op_free(gpointer pointer)
 {
 	struct sim_fs_op *node = pointer;
@@ -112,6 +360,9 @@ void sim_fs_free(struct sim_fs *fs)
 	if (fs->watch_id)
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
+	__ofono_memtrim_remove(fs->trim_id);
+	l_queue_destroy(fs->images, cached_image_free);
+	sim_cache_close(fs);
 	g_free(fs);
 }
 
@@ -120,6 +371,26 @@ struct file_watch {
 	int ef;
 };
 
+static bool cached_image_trim(void *data, void *user_data)
+{
+	struct cached_image *entry = data;
+	const uint64_t *before = user_data;
+
+	if (entry->last_used >= *before)
+		return false;
+
+	cached_image_free(entry);
+	return true;
+}
+
+/* Images are decoded again from the disk cache on their next use */
+static void sim_fs_trim(uint64_t before, void *user_data)
+{
+	struct sim_fs *fs = user_data;
+
+	l_queue_foreach_remove(fs->images, cached_image_trim, &before);
+}
+
 struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 				const struct ofono_sim_driver *driver)
 {
@@ -131,7 +402,8 @@ struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 
 	fs->sim = sim;
 	fs->driver = driver;
-	fs->fd = -1;
+	fs->cache.fd = -1;
+	fs->trim_id = __ofono_memtrim_add(sim_fs_trim, fs);
 
 	return fs;
 }
@@ -236,13 +508,15 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 	for (l = fs->contexts; l; l = l->next) {
 		struct ofono_sim_context *context = l->data;
-		GSList *k;
+		struct ofono_watchlist_iter iter;
+		struct file_watch *w;
 
 		if (context->file_watches == NULL)
 			continue;
 
-		for (k = context->file_watches->items; k; k = k->next) {
-			struct file_watch *w = k->data;
+		__ofono_watchlist_iter_init(&iter, context->file_watches);
+
+		while ((w = __ofono_watchlist_iter_next(&iter))) {
 			ofono_sim_file_changed_cb_t notify = w->item.notify;
 
 			if (id == -1 || w->ef == id)
@@ -255,17 +529,15 @@ static void sim_fs_end_current(struct sim_fs *fs)
 {
 	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
 
+	DBG("%04x done %" PRIu64 " ms after being queued", op->id,
+		l_time_to_msecs(l_time_diff(op->queued, l_time_now())));
+
 	if (g_queue_get_length(fs->op_q) > 0)
 		fs->op_source = g_idle_add(sim_fs_op_next, fs);
 	else if (fs->watch_id) /* release the session if no pending reads */
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
-	if (fs->fd != -1) {
-		L_TFR(close(fs->fd));
-		fs->fd = -1;
-	}
-
-	memset(fs->bitmap, 0, sizeof(fs->bitmap));
+	fs->entry = NULL;
 
 	sim_fs_op_free(op);
 }
@@ -295,39 +567,17 @@ static void sim_fs_op_error(struct sim_fs *fs)
 static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
 				const unsigned char *data, int num_bytes)
 {
-	int offset;
-	int bit;
-	ssize_t r;
-	unsigned char b;
+	struct sim_cache_entry *entry = fs->entry;
 
-	if (fs->fd == -1)
+	if (entry == NULL ||
+			block * block_len + num_bytes > (int) entry->capacity)
 		return FALSE;
 
-	if (lseek(fs->fd, block * block_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-		return FALSE;
-
-	r = L_TFR(write(fs->fd, data, num_bytes));
-
-	if (r != num_bytes)
-		return FALSE;
+	memcpy(sim_cache_data(&fs->cache, entry) + block * block_len,
+		data, num_bytes);
 
 	/* update present bit for this block */
-	offset = block / 8;
-	bit = block % 8;
-
-	/* lseek to correct byte (skip file info) */
-	lseek(fs->fd, offset + SIM_FILE_INFO_SIZE, SEEK_SET);
-
-	b = fs->bitmap[offset];
-	b |= 1 << bit;
-
-	r = L_TFR(write(fs->fd, &b, sizeof(b)));
-
-	if (r != sizeof(b))
-		return FALSE;
-
-	fs->bitmap[offset] = b;
+	entry->fileinfo[SIM_FILE_INFO_SIZE + block / 8] |= 1 << (block % 8);
 
 	return TRUE;
 }
@@ -434,36 +684,38 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		}
 	}
 
-	while (fs->fd != -1 && op->current <= end_block) {
+	while (fs->entry && op->current <= end_block) {
+		const struct sim_cache_entry *entry = fs->entry;
+		const unsigned char *bitmap = entry->fileinfo +
+						SIM_FILE_INFO_SIZE;
 		int offset = op->current / 8;
 		int bit = 1 << op->current % 8;
 		int bufoff;
-		int seekoff;
+		int dataoff;
 		int toread;
 
-		if ((fs->bitmap[offset] & bit) == 0)
+		if ((bitmap[offset] & bit) == 0)
 			break;
 
 		if (op->current == start_block) {
 			bufoff = 0;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256 +
-				op->offset % 256;
+			dataoff = op->current * 256 + op->offset % 256;
 			toread = MIN(256 - op->offset % 256, op->num_bytes);
 		} else {
 			bufoff = (op->current - start_block) * 256 -
 					op->offset % 256;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256;
+			dataoff = op->current * 256;
 			toread = MIN(256, op->num_bytes - bufoff);
 		}
 
-		DBG("bufoff: %d, seekoff: %d, toread: %d",
-				bufoff, seekoff, toread);
+		DBG("bufoff: %d, dataoff: %d, toread: %d",
+				bufoff, dataoff, toread);
 
-		if (lseek(fs->fd, seekoff, SEEK_SET) == (off_t) -1)
+		if (dataoff + toread > (int) entry->capacity)
 			break;
 
-		if (L_TFR(read(fs->fd, op->buffer + bufoff, toread)) != toread)
-			break;
+		memcpy(op->buffer + bufoff,
+			sim_cache_data(&fs->cache, entry) + dataoff, toread);
 
 		op->current += 1;
 	}
@@ -495,108 +747,224 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 	return FALSE;
 }
 
-static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
-					const unsigned char *data, int len,
-					void *user)
+struct record_read {
+	struct sim_fs *fs;
+	struct sim_fs_op *op;
+	int record;
+	int count;
+};
+
+static void sim_fs_records_request(struct sim_fs *fs);
+
+/*
+ * Hands the records which arrived to the callback in order, and ends the
+ * operation once they all did or one of the reads failed.  Nothing can
+ * end while reads are in flight, their callbacks refer to the operation.
+ */
+static void sim_fs_records_progress(struct sim_fs *fs)
 {
-	struct sim_fs *fs = user;
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	int total = op->length / op->record_length;
-	ofono_sim_file_read_cb_t cb = op->cb;
+	ofono_sim_file_read_cb_t cb;
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+	/* Reads completing synchronously are picked up by the requester */
+	if (op->requesting)
 		return;
+
+	while (!op->failed && op->cb && op->current <= total) {
+		int offset = (op->current - 1) / 8;
+		int bit = 1 << ((op->current - 1) % 8);
+
+		if ((op->received[offset] & bit) == 0)
+			break;
+
+		cb = op->cb;
+		cb(1, op->length, op->current,
+			op->buffer + (op->current - 1) * op->record_length,
+			op->record_length, op->userdata);
+
+		op->current += 1;
 	}
 
-	cache_block(fs, op->current - 1, op->record_length,
-			data, op->record_length);
+	if (op->in_flight > 0)
+		return;
 
-	if (cb == NULL) {
+	if (op->failed)
+		sim_fs_op_error(fs);
+	else if (op->cb == NULL || op->current > total)
 		sim_fs_end_current(fs);
+	else
+		sim_fs_records_request(fs);
+}
+
+static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
+					const unsigned char *data, int len,
+					void *user)
+{
+	struct record_read *req = user;
+	struct sim_fs *fs = req->fs;
+	struct sim_fs_op *op = req->op;
+	int first = req->record - 1;
+	int count = req->count;
+	int i;
+
+	g_free(req);
+	op->in_flight -= 1;
+
+	/* Multi record reads may come back short, but never empty */
+	if (count > len / op->record_length)
+		count = len / op->record_length;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR || count == 0) {
+		op->failed = TRUE;
+		sim_fs_records_progress(fs);
 		return;
 	}
 
-	cb(1, op->length, op->current, data, op->record_length, op->userdata);
+	for (i = 0; i < count; i++) {
+		int record = first + i;
+		const unsigned char *rec = data + i * op->record_length;
 
-	if (op->current < total) {
-		op->current += 1;
-		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
-	} else {
-		sim_fs_end_current(fs);
+		memcpy(op->buffer + record * op->record_length, rec,
+			op->record_length);
+		op->received[record / 8] |= 1 << (record % 8);
+
+		cache_block(fs, record, op->record_length, rec,
+				op->record_length);
 	}
+
+	/* Whatever the driver left out is asked for again */
+	if (op->next > first + count + 1)
+		op->next = first + count + 1;
+
+	sim_fs_records_progress(fs);
 }
 
-static gboolean sim_fs_op_read_record(gpointer user)
+static gboolean sim_fs_record_from_cache(struct sim_fs *fs,
+					struct sim_fs_op *op, int record)
+{
+	int offset = (record - 1) / 8;
+	int bit = 1 << ((record - 1) % 8);
+	int dataoff = (record - 1) * op->record_length;
+	const struct sim_cache_entry *entry = fs->entry;
+	const unsigned char *bitmap;
+
+	if (entry == NULL)
+		return FALSE;
+
+	bitmap = entry->fileinfo + SIM_FILE_INFO_SIZE;
+
+	if ((bitmap[offset] & bit) == 0 ||
+			dataoff + op->record_length > (int) entry->capacity)
+		return FALSE;
+
+	memcpy(op->buffer + dataoff,
+		sim_cache_data(&fs->cache, entry) + dataoff,
+		op->record_length);
+
+	op->received[offset] |= bit;
+
+	return TRUE;
+}
+
+/*
+ * Keeps up to SIM_FS_READAHEAD record reads in flight, or asks for all
+ * the remaining records at once if the driver can read several.
+ */
+static void sim_fs_records_request(struct sim_fs *fs)
 {
-	struct sim_fs *fs = user;
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	const struct ofono_sim_driver *driver = fs->driver;
 	int total = op->length / op->record_length;
-	unsigned char buf[256];
+	struct record_read *req;
+	void (*read_record)(struct ofono_sim *sim, int fileid,
+				int record, int length,
+				const unsigned char *path, unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *data);
+
+	if (op->structure == OFONO_SIM_FILE_STRUCTURE_FIXED)
+		read_record = driver->read_file_linear;
+	else
+		read_record = driver->read_file_cyclic;
 
-	fs->op_source = 0;
+	if (op->next < op->current)
+		op->next = op->current;
 
-	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
-	}
+	op->requesting = TRUE;
 
-	while (fs->fd != -1 && op->current <= total) {
-		int offset = (op->current - 1) / 8;
-		int bit = 1 << ((op->current - 1) % 8);
-		ofono_sim_file_read_cb_t cb = op->cb;
+	while (!op->failed && op->next <= total &&
+			op->in_flight < SIM_FS_READAHEAD) {
+		int offset = (op->next - 1) / 8;
+		int bit = 1 << ((op->next - 1) % 8);
 
-		if ((fs->bitmap[offset] & bit) == 0)
-			break;
+		if ((op->received[offset] & bit) ||
+				sim_fs_record_from_cache(fs, op, op->next)) {
+			op->next += 1;
+			continue;
+		}
 
-		if (lseek(fs->fd, (op->current - 1) * op->record_length +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
+		if (read_record == NULL) {
+			op->failed = TRUE;
 			break;
+		}
 
-		if (L_TFR(read(fs->fd, buf, op->record_length)) !=
-				op->record_length)
-			break;
+		req = g_new0(struct record_read, 1);
+		req->fs = fs;
+		req->op = op;
+		req->record = op->next;
+		req->count = 1;
 
-		cb(1, op->length, op->current,
-				buf, op->record_length, op->userdata);
+		op->in_flight += 1;
 
-		op->current += 1;
-	}
+		if (op->structure == OFONO_SIM_FILE_STRUCTURE_FIXED &&
+				driver->read_file_records) {
+			req->count = total - op->next + 1;
+			op->next = total + 1;
 
-	if (op->current > total) {
-		sim_fs_end_current(fs);
+			driver->read_file_records(fs->sim, op->id,
+						req->record, req->count,
+						op->record_length, NULL, 0,
+						sim_fs_op_retrieve_cb, req);
+			continue;
+		}
 
-		return FALSE;
+		op->next += 1;
+
+		read_record(fs->sim, op->id, req->record, op->record_length,
+				NULL, 0, sim_fs_op_retrieve_cb, req);
 	}
 
-	switch (op->structure) {
-	case OFONO_SIM_FILE_STRUCTURE_FIXED:
-		if (driver->read_file_linear == NULL) {
-			sim_fs_op_error(fs);
-			return FALSE;
-		}
+	op->requesting = FALSE;
+	sim_fs_records_progress(fs);
+}
 
-		driver->read_file_linear(fs->sim, op->id, op->current,
-						op->record_length,
-						NULL, 0,
-						sim_fs_op_retrieve_cb, fs);
-		break;
-	case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
-		if (driver->read_file_cyclic == NULL) {
-			sim_fs_op_error(fs);
-			return FALSE;
-		}
+static gboolean sim_fs_op_read_record(gpointer user)
+{
+	struct sim_fs *fs = user;
+	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 
-		driver->read_file_cyclic(fs->sim, op->id, op->current,
-						op->record_length,
-						NULL, 0,
-						sim_fs_op_retrieve_cb, fs);
-		break;
-	default:
+	fs->op_source = 0;
+
+	if (op->cb == NULL) {
+		sim_fs_end_current(fs);
+		return FALSE;
+	}
+
+	if (op->structure != OFONO_SIM_FILE_STRUCTURE_FIXED &&
+			op->structure != OFONO_SIM_FILE_STRUCTURE_CYCLIC) {
 		ofono_error("Unrecognized file structure, this can't happen");
+		return FALSE;
+	}
+
+	op->buffer = g_try_new0(unsigned char, op->length);
+	if (op->buffer == NULL) {
+		sim_fs_op_error(fs);
+		return FALSE;
 	}
 
+	/* Cached records are taken first, only the others are read */
+	sim_fs_records_request(fs);
+
 	return FALSE;
 }
 
@@ -609,14 +977,11 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 					unsigned char file_status)
 {
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	struct sim_cache *cache;
+	struct sim_cache_entry *entry;
 	enum sim_file_access update;
 	enum sim_file_access invalidate;
 	enum sim_file_access rehabilitate;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
-	gboolean cache;
-	char *path;
 
 	/* TS 11.11, Section 9.3 */
 	update = file_access_condition_decode(access[0] & 0xf);
@@ -624,39 +989,31 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	invalidate = file_access_condition_decode(access[2] & 0xf);
 
 	/* Never cache card holder writable files */
-	cache = (update == SIM_FILE_ACCESS_ADM ||
+	if (!((update == SIM_FILE_ACCESS_ADM ||
 			update == SIM_FILE_ACCESS_NEVER) &&
 			(invalidate == SIM_FILE_ACCESS_ADM ||
 				invalidate == SIM_FILE_ACCESS_NEVER) &&
 			(rehabilitate == SIM_FILE_ACCESS_ADM ||
-				rehabilitate == SIM_FILE_ACCESS_NEVER);
-
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN || cache == FALSE)
+				rehabilitate == SIM_FILE_ACCESS_NEVER)))
 		return;
 
-	memset(fileinfo, 0, SIM_CACHE_HEADER_SIZE);
-
-	fileinfo[0] = error->type;
-	fileinfo[1] = length >> 8;
-	fileinfo[2] = length & 0xff;
-	fileinfo[3] = structure;
-	fileinfo[4] = record_length >> 8;
-	fileinfo[5] = record_length & 0xff;
-	fileinfo[6] = file_status;
-
-	path = l_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-	fs->fd = L_TFR(open(path, O_WRONLY | O_CREAT | O_TRUNC, SIM_CACHE_MODE));
-	l_free(path);
-
-	if (fs->fd == -1)
+	cache = sim_cache_open(fs);
+	if (cache == NULL)
 		return;
 
-	if (L_TFR(write(fs->fd, fileinfo, SIM_CACHE_HEADER_SIZE)) ==
-			SIM_CACHE_HEADER_SIZE)
+	entry = sim_cache_alloc(cache, op->id, length);
+	if (entry == NULL)
 		return;
 
-	L_TFR(close(fs->fd));
-	fs->fd = -1;
+	entry->fileinfo[0] = error->type;
+	entry->fileinfo[1] = length >> 8;
+	entry->fileinfo[2] = length & 0xff;
+	entry->fileinfo[3] = structure;
+	entry->fileinfo[4] = record_length >> 8;
+	entry->fileinfo[5] = record_length & 0xff;
+	entry->fileinfo[6] = file_status;
+
+	fs->entry = entry;
 }
 
 static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
@@ -725,40 +1082,24 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 
 static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	char *path;
-	int fd;
-	ssize_t len;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	struct sim_cache *cache = sim_cache_open(fs);
+	struct sim_cache_entry *entry;
+	const unsigned char *fileinfo;
 	int error_type;
 	int file_length;
 	enum ofono_sim_file_structure structure;
 	int record_length;
 	unsigned char file_status;
 
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
+	if (cache == NULL)
 		return FALSE;
 
-	path = l_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-	fd = L_TFR(open(path, O_RDWR));
-	l_free(path);
-
-	if (fd == -1) {
-		if (errno != ENOENT)
-			DBG("Error %i opening cache file for "
-					"fileid %04x, IMSI %s",
-					errno, op->id, imsi);
-
+	entry = sim_cache_find(cache, op->id);
+	if (entry == NULL)
 		return FALSE;
-	}
-
-	len = L_TFR(read(fd, fileinfo, SIM_CACHE_HEADER_SIZE));
-
-	if (len != SIM_CACHE_HEADER_SIZE)
-		goto error;
 
+	fileinfo = entry->fileinfo;
 	error_type = fileinfo[0];
 	file_length = (fileinfo[1] << 8) | fileinfo[2];
 	structure = fileinfo[3];
@@ -768,14 +1109,13 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 	if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
 		record_length = file_length;
 
-	if (record_length == 0 || file_length < record_length)
-		goto error;
+	if (record_length == 0 || file_length < record_length ||
+			file_length > (int) entry->capacity)
+		return FALSE;
 
 	op->length = file_length;
 	op->record_length = record_length;
-	memcpy(fs->bitmap, fileinfo + SIM_FILE_INFO_SIZE,
-			SIM_CACHE_HEADER_SIZE - SIM_FILE_INFO_SIZE);
-	fs->fd = fd;
+	fs->entry = entry;
 
 	if (error_type != OFONO_ERROR_TYPE_NO_ERROR ||
 			structure != op->structure) {
@@ -806,10 +1146,6 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 	}
 
 	return TRUE;
-
-error:
-	L_TFR(close(fd));
-	return FALSE;
 }
 
 static void sim_fs_read_session_cb(const struct ofono_error *error,
@@ -972,6 +1308,63 @@ static gboolean sim_fs_op_next(gpointer user_data)
 	return FALSE;
 }
 
+static enum sim_fs_priority sim_fs_priority(int id)
+{
+	switch (id) {
+	case SIM_EF_ICCID_FILEID:
+	case SIM_EFLI_FILEID:
+	case SIM_EFPL_FILEID:
+	case SIM_EFPHASE_FILEID:
+	case SIM_EFAD_FILEID:
+	case SIM_EF_CPHS_INFORMATION_FILEID:
+	case SIM_EFUST_FILEID:
+	case SIM_EFEST_FILEID:
+		return SIM_FS_PRIORITY_CRITICAL;
+	case SIM_EFADN_FILEID:
+	case SIM_EFSDN_FILEID:
+	case SIM_EFPNN_FILEID:
+	case SIM_EFOPL_FILEID:
+	case SIM_EFIMG_FILEID:
+	case SIM_EFCBMI_FILEID:
+	case SIM_EFCBMID_FILEID:
+	case SIM_EFCBMIR_FILEID:
+		return SIM_FS_PRIORITY_BACKGROUND;
+	}
+
+	return SIM_FS_PRIORITY_NORMAL;
+}
+
+/*
+ * Operations on the same file share a priority, so they are never
+ * reordered with respect to each other.  The head of the queue is in
+ * progress and stays there.
+ */
+static void sim_fs_op_enqueue(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	GList *l;
+
+	op->priority = sim_fs_priority(op->id);
+	op->queued = l_time_now();
+
+	if (fs->op_q == NULL)
+		fs->op_q = g_queue_new();
+
+	for (l = g_queue_peek_tail_link(fs->op_q); l && l->prev; l = l->prev) {
+		struct sim_fs_op *queued = l->data;
+
+		if (queued->priority <= op->priority)
+			break;
+	}
+
+	if (l)
+		g_queue_insert_after(fs->op_q, l, op);
+	else
+		g_queue_push_tail(fs->op_q, op);
+
+	if (g_queue_get_length(fs->op_q) == 1)
+		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+}
+
 int sim_fs_read_info(struct ofono_sim_context *context, int id,
 			enum ofono_sim_file_structure expected_type,
 			sim_fs_read_info_cb_t cb, void *data)
@@ -988,9 +1381,6 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 	if (fs->driver->read_file_info == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
 	op = g_try_new0(struct sim_fs_op, 1);
 	if (op == NULL)
 		return -ENOMEM;
@@ -1003,10 +1393,7 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 	op->info_only = TRUE;
 	op->context = context;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_enqueue(fs, op);
 
 	return 0;
 }
@@ -1039,9 +1426,6 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 		}
 	}
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
 	op = g_try_new0(struct sim_fs_op, 1);
 	if (op == NULL)
 		return -ENOMEM;
@@ -1058,10 +1442,7 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 	l_memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_enqueue(fs, op);
 
 	return 0;
 }
@@ -1098,9 +1479,6 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	if (fn == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
 	op = g_try_new0(struct sim_fs_op, 1);
 	if (op == NULL)
 		return -ENOMEM;
@@ -1115,22 +1493,70 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	op->current = record;
 	op->context = context;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_enqueue(fs, op);
 
 	return 0;
 }
 
-void sim_fs_cache_image(struct sim_fs *fs, const char *image, int id)
+static bool cached_image_match(const void *a, const void *b)
+{
+	const struct cached_image *entry = a;
+	const struct cached_image *key = b;
+
+	return entry->id == key->id && entry->iidf_id == key->iidf_id;
+}
+
+static void sim_fs_remember_image(struct sim_fs *fs, struct stk_image *image,
+					int id, int iidf_id)
+{
+	struct cached_image *entry;
+
+	if (fs->images == NULL)
+		fs->images = l_queue_new();
+
+	if (l_queue_length(fs->images) == SIM_IMAGE_LRU_SIZE) {
+		entry = l_queue_peek_tail(fs->images);
+		l_queue_remove(fs->images, entry);
+		cached_image_free(entry);
+	}
+
+	entry = l_new(struct cached_image, 1);
+	entry->id = id;
+	entry->iidf_id = iidf_id;
+	entry->image = image;
+	entry->last_used = l_time_now();
+	l_queue_push_head(fs->images, entry);
+}
+
+static void sim_fs_forget_image(struct sim_fs *fs, int id, int iidf_id)
+{
+	struct cached_image key = { .id = id, .iidf_id = iidf_id };
+	struct cached_image *entry;
+
+	entry = l_queue_remove_if(fs->images, cached_image_match, &key);
+	if (entry)
+		cached_image_free(entry);
+}
+
+void sim_fs_cache_image(struct sim_fs *fs, struct stk_image *image,
+			int id, int iidf_id)
 {
 	const char *imsi;
 	enum ofono_sim_phase phase;
+	uint8_t *buf;
+	size_t len;
 
-	if (fs == NULL || image == NULL)
+	if (image == NULL)
 		return;
 
+	if (fs == NULL) {
+		stk_image_free(image);
+		return;
+	}
+
+	sim_fs_forget_image(fs, id, iidf_id);
+	sim_fs_remember_image(fs, image, id, iidf_id);
+
 	imsi = ofono_sim_get_imsi(fs->sim);
 	if (imsi == NULL)
 		return;
@@ -1139,24 +1565,35 @@ void sim_fs_cache_image(struct sim_fs *fs, const char *image, int id)
 	if (phase == OFONO_SIM_PHASE_UNKNOWN)
 		return;
 
-	write_file((const unsigned char *) image, strlen(image),
-			SIM_IMAGE_CACHE_PATH, imsi, phase, id);
+	buf = stk_image_serialize(image, &len);
+	write_file(buf, len, SIM_IMAGE_CACHE_PATH, imsi, phase, id, iidf_id);
+	l_free(buf);
 }
 
-char *sim_fs_get_cached_image(struct sim_fs *fs, int id)
+const struct stk_image *sim_fs_get_cached_image(struct sim_fs *fs, int id,
+							int iidf_id)
 {
 	const char *imsi;
 	enum ofono_sim_phase phase;
-	unsigned short image_length;
+	struct cached_image key = { .id = id, .iidf_id = iidf_id };
+	struct cached_image *entry;
+	struct stk_image *image;
 	int fd;
-	char *buffer;
+	uint8_t *buffer;
 	char *path;
-	int len;
+	ssize_t len;
 	struct stat st_buf;
 
 	if (fs == NULL)
 		return NULL;
 
+	entry = l_queue_remove_if(fs->images, cached_image_match, &key);
+	if (entry) {
+		entry->last_used = l_time_now();
+		l_queue_push_head(fs->images, entry);
+		return entry->image;
+	}
+
 	imsi = ofono_sim_get_imsi(fs->sim);
 	if (imsi == NULL)
 		return NULL;
@@ -1165,44 +1602,58 @@ char *sim_fs_get_cached_image(struct sim_fs *fs, int id)
 	if (phase == OFONO_SIM_PHASE_UNKNOWN)
 		return NULL;
 
-	path = l_strdup_printf(SIM_IMAGE_CACHE_PATH, imsi, phase, id);
-
-	L_TFR(stat(path, &st_buf));
+	path = l_strdup_printf(SIM_IMAGE_CACHE_PATH, imsi, phase, id, iidf_id);
 	fd = L_TFR(open(path, O_RDONLY));
 	l_free(path);
 
 	if (fd < 0)
 		return NULL;
 
-	image_length = st_buf.st_size;
-	buffer = g_try_new0(char, image_length + 1);
-
-	if (buffer == NULL) {
+	if (fstat(fd, &st_buf) < 0) {
 		L_TFR(close(fd));
 		return NULL;
 	}
 
-	len = L_TFR(read(fd, buffer, image_length));
+	buffer = l_malloc(st_buf.st_size);
+	len = L_TFR(read(fd, buffer, st_buf.st_size));
 	L_TFR(close(fd));
 
-	if (len != image_length) {
-		g_free(buffer);
+	image = len == st_buf.st_size ?
+			stk_image_deserialize(buffer, len) : NULL;
+	l_free(buffer);
+
+	if (image == NULL)
 		return NULL;
-	}
 
-	return buffer;
+	sim_fs_remember_image(fs, image, id, iidf_id);
+
+	return image;
 }
 
-static void remove_cachefile(const char *imsi, enum ofono_sim_phase phase,
-				const struct dirent *file)
+static int legacy_cachefile_id(const struct dirent *file)
 {
 	int id;
-	char *path;
 
 	if (file->d_type != DT_REG)
-		return;
+		return -1;
+
+	if (strlen(file->d_name) != 4 ||
+			strspn(file->d_name, "0123456789abcdef") != 4)
+		return -1;
 
 	if (sscanf(file->d_name, "%4x", &id) != 1)
+		return -1;
+
+	return id;
+}
+
+static void remove_cachefile(const char *imsi, enum ofono_sim_phase phase,
+				const struct dirent *file)
+{
+	int id = legacy_cachefile_id(file);
+	char *path;
+
+	if (id < 0)
 		return;
 
 	path = l_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
@@ -1210,19 +1661,85 @@ static void remove_cachefile(const char *imsi, enum ofono_sim_phase phase,
 	l_free(path);
 }
 
+/* Moves an EF cached in its own file into the cache file */
+static void import_cachefile(struct sim_fs *fs, const char *imsi,
+				enum ofono_sim_phase phase,
+				const struct dirent *file)
+{
+	int id = legacy_cachefile_id(file);
+	unsigned char *buf;
+	struct sim_cache_entry *entry;
+	ssize_t len;
+	int file_length;
+
+	if (id < 0)
+		return;
+
+	buf = l_malloc(SIM_CACHE_HEADER_SIZE + 0xffff);
+	len = read_file(buf, SIM_CACHE_HEADER_SIZE + 0xffff, SIM_CACHE_PATH,
+			imsi, phase, id);
+
+	if (len < SIM_CACHE_HEADER_SIZE)
+		goto done;
+
+	file_length = (buf[1] << 8) | buf[2];
+
+	entry = sim_cache_alloc(&fs->cache, id, file_length);
+	if (entry == NULL)
+		goto done;
+
+	len = MIN(len - SIM_CACHE_HEADER_SIZE, file_length);
+	memcpy(entry->fileinfo, buf, SIM_CACHE_HEADER_SIZE);
+	memcpy(sim_cache_data(&fs->cache, entry),
+		buf + SIM_CACHE_HEADER_SIZE, len);
+
+done:
+	l_free(buf);
+	remove_cachefile(imsi, phase, file);
+}
+
+static gboolean sim_fs_cache_import(struct sim_fs *fs)
+{
+	const char *imsi = ofono_sim_get_imsi(fs->sim);
+	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	char *path;
+	struct dirent **entries;
+	int len;
+
+	if (sim_cache_open(fs) == NULL)
+		return FALSE;
+
+	if (!sim_cache_reset(&fs->cache))
+		return FALSE;
+
+	path = l_strdup_printf(SIM_CACHE_BASEPATH, imsi, phase);
+	len = scandir(path, &entries, NULL, alphasort);
+	l_free(path);
+
+	if (len <= 0)
+		return TRUE;
+
+	while (len--) {
+		import_cachefile(fs, imsi, phase, entries[len]);
+		free(entries[len]);
+	}
+
+	free(entries);
+
+	return TRUE;
+}
+
 static void remove_imagefile(const char *imsi, enum ofono_sim_phase phase,
 				const struct dirent *file)
 {
-	int id;
 	char *path;
 
 	if (file->d_type != DT_REG)
 		return;
 
-	if (sscanf(file->d_name, "%d", &id) != 1)
-		return;
-
-	path = l_strdup_printf(SIM_IMAGE_CACHE_PATH, imsi, phase, id);
+	/* Also drops images cached in formats used by older versions */
+	path = l_strdup_printf(SIM_IMAGE_CACHE_BASEPATH "/%s", imsi, phase,
+				file->d_name);
 	remove(path);
 	l_free(path);
 }
@@ -1236,11 +1753,21 @@ void sim_fs_check_version(struct sim_fs *fs)
 	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
 		return;
 
-	if (read_file(&version, 1, SIM_CACHE_VERSION, imsi, phase) == 1)
-		if (version == SIM_FS_VERSION)
-			return;
+	if (read_file(&version, 1, SIM_CACHE_VERSION, imsi, phase) != 1)
+		version = 0;
+
+	if (version == SIM_FS_VERSION)
+		return;
 
-	sim_fs_cache_flush(fs);
+	/* The EFs cached by version 2 and 3 are still good */
+	if (version == 2 || version == 3) {
+		if (!sim_fs_cache_import(fs))
+			sim_fs_cache_flush(fs);
+		else if (version == 2)
+			sim_fs_image_cache_flush(fs);
+	} else {
+		sim_fs_cache_flush(fs);
+	}
 
 	version = SIM_FS_VERSION;
 	write_file(&version, 1, SIM_CACHE_VERSION, imsi, phase);
@@ -1257,7 +1784,7 @@ void sim_fs_cache_flush(struct sim_fs *fs)
 	l_free(path);
 
 	if (len > 0) {
-		/* Remove all file ids */
+		/* Remove all file ids left by older versions */
 		while (len--) {
 			remove_cachefile(imsi, phase, entries[len]);
 			free(entries[len]);
@@ -1266,17 +1793,30 @@ void sim_fs_cache_flush(struct sim_fs *fs)
 		free(entries);
 	}
 
+	/* An operation in progress keeps its entry, now empty */
+	if (sim_cache_open(fs))
+		sim_cache_reset(&fs->cache);
+
 	sim_fs_image_cache_flush(fs);
 }
 
 void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = l_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
+	struct sim_cache *cache = sim_cache_open(fs);
+	struct sim_cache_entry *entry;
 
-	remove(path);
-	l_free(path);
+	if (cache == NULL)
+		return;
+
+	/* The space is reused by the next EF it fits */
+	entry = sim_cache_find(cache, id);
+	if (entry == NULL)
+		return;
+
+	entry->id = 0;
+
+	if (fs->entry == entry)
+		fs->entry = NULL;
 }
 
 void sim_fs_image_cache_flush(struct sim_fs *fs)
@@ -1289,6 +1829,9 @@ void sim_fs_image_cache_flush(struct sim_fs *fs)
 
 	l_free(path);
 
+	l_queue_destroy(fs->images, cached_image_free);
+	fs->images = NULL;
+
 	if (len <= 0)
 		return;
 
@@ -1301,12 +1844,15 @@ void sim_fs_image_cache_flush(struct sim_fs *fs)
 	free(entries);
 }
 
-void sim_fs_image_cache_flush_file(struct sim_fs *fs, int id)
+void sim_fs_image_cache_flush_file(struct sim_fs *fs, int id, int iidf_id)
 {
 	const char *imsi = ofono_sim_get_imsi(fs->sim);
 	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = l_strdup_printf(SIM_IMAGE_CACHE_PATH, imsi, phase, id);
+	char *path;
+
+	sim_fs_forget_image(fs, id, iidf_id);
 
+	path = l_strdup_printf(SIM_IMAGE_CACHE_PATH, imsi, phase, id, iidf_id);
 	remove(path);
 	l_free(path);
 }
@@ -45,14 +45,23 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 			enum ofono_sim_file_structure structure, int record,
 			const unsigned char *data, int length, void *userdata);
 
-char *sim_fs_get_cached_image(struct sim_fs *fs, int id);
+struct stk_image;
 
-void sim_fs_cache_image(struct sim_fs *fs, const char *image, int id);
+/*
+ * Decoded images are cached keyed by their EFimg record and EFiidf id.  The
+ * returned image stays owned by the cache and is only valid until the next
+ * call into it.  sim_fs_cache_image takes ownership of image.
+ */
+const struct stk_image *sim_fs_get_cached_image(struct sim_fs *fs, int id,
+							int iidf_id);
+
+void sim_fs_cache_image(struct sim_fs *fs, struct stk_image *image,
+			int id, int iidf_id);
 
 void sim_fs_cache_flush(struct sim_fs *fs);
 void sim_fs_cache_flush_file(struct sim_fs *fs, int id);
 void sim_fs_image_cache_flush(struct sim_fs *fs);
-void sim_fs_image_cache_flush_file(struct sim_fs *fs, int id);
+void sim_fs_image_cache_flush_file(struct sim_fs *fs, int id, int iidf_id);
 
 void sim_fs_free(struct sim_fs *fs);
 void sim_fs_context_free(struct ofono_sim_context *context);
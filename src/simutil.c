@@ -11,6 +11,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include <glib.h>
 #include <ell/ell.h>
@@ -22,7 +23,10 @@
 #include "missing.h"
 
 struct sim_eons {
+	unsigned int ref_count;
 	struct l_queue *opl_list;
+	struct l_hashmap *opl_index;	/* PLMN without wildcards to group */
+	struct l_queue *opl_wildcards;	/* Groups with a wildcard digit */
 	bool pnn_valid;
 	uint32_t pnn_max;
 	struct sim_eons_operator_info pnn_list[];
@@ -39,6 +43,28 @@ struct opl_operator {
 	guint16 lac_tac_low;
 	guint16 lac_tac_high;
 	guint8 id;
+	unsigned int pos;
+};
+
+/* LACs from low to high all resolve to the same OPL record */
+struct opl_segment {
+	guint16 low;
+	guint16 high;
+	const struct opl_operator *opl;
+};
+
+/*
+ * The OPL records of one MCC/MNC pattern.  The LAC ranges are flattened
+ * into disjoint segments, each naming the first record covering it, so
+ * that a lookup is a binary search.
+ */
+struct opl_group {
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	const struct opl_operator *any;	/* First record for all LACs */
+	struct l_queue *members;
+	unsigned int n_segments;
+	struct opl_segment *segments;
 };
 
 #define MF	1
@@ -767,6 +793,42 @@ bool validate_utf8_tlv(const unsigned char *tlv)
 	return l_utf8_validate((const char *)tlv + 2, len, NULL);
 }
 
+/* Packed names are unpacked on the stack unless they are unusually long */
+static char *sim_network_name_from_gsm(const unsigned char *buffer,
+					int length, long num_char)
+{
+	unsigned char stack_buf[256];
+	unsigned char *unpacked = stack_buf;
+	long written;
+	long utf8_len;
+	char *ret = NULL;
+
+	if (length * 8 / 7 > (int) sizeof(stack_buf))
+		unpacked = l_malloc(length * 8 / 7);
+
+	if (unpack_7bit_own_buf(buffer, length, 0, false, num_char,
+					&written, 0, unpacked) == NULL)
+		goto out;
+
+	utf8_len = convert_gsm_to_utf8_own_buf(unpacked, written, NULL,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT, NULL, 0);
+	if (utf8_len < 0)
+		goto out;
+
+	ret = l_malloc(utf8_len + 1);
+	convert_gsm_to_utf8_own_buf(unpacked, written, NULL,
+					GSM_DIALECT_DEFAULT,
+					GSM_DIALECT_DEFAULT, ret, utf8_len);
+	ret[utf8_len] = '\0';
+
+out:
+	if (unpacked != stack_buf)
+		l_free(unpacked);
+
+	return ret;
+}
+
 static char *sim_network_name_parse(const unsigned char *buffer, int length,
 					bool *add_ci)
 {
@@ -774,8 +836,7 @@ static char *sim_network_name_parse(const unsigned char *buffer, int length,
 	unsigned char dcs;
 	int i;
 	bool ci = FALSE;
-	unsigned char *unpacked_buf;
-	long num_char, written;
+	long num_char;
 	int spare_bits;
 
 	if (length < 2)
@@ -796,15 +857,7 @@ static char *sim_network_name_parse(const unsigned char *buffer, int length,
 		spare_bits = dcs & 0x07;
 		num_char = (length * 8 - spare_bits) / 7;
 
-		unpacked_buf = unpack_7bit(buffer, length, 0, false,
-						num_char, &written, 0);
-		if (unpacked_buf == NULL)
-			break;
-
-		ret = convert_gsm_to_utf8(unpacked_buf, written, NULL, NULL, 0);
-
-		l_free(unpacked_buf);
-
+		ret = sim_network_name_from_gsm(buffer, length, num_char);
 		break;
 	case 0x10:
 		if ((length % 2) == 1) {
@@ -990,6 +1043,7 @@ struct sim_eons *sim_eons_new(uint32_t pnn_records)
 	struct sim_eons *eons = l_malloc(sizeof(struct sim_eons) +
 			sizeof(struct sim_eons_operator_info) * pnn_records);
 
+	eons->ref_count = 1;
 	eons->pnn_valid = false;
 	eons->pnn_max = pnn_records;
 
@@ -997,6 +1051,8 @@ struct sim_eons *sim_eons_new(uint32_t pnn_records)
 			sizeof(struct sim_eons_operator_info) * pnn_records);
 
 	eons->opl_list = l_queue_new();
+	eons->opl_index = NULL;
+	eons->opl_wildcards = NULL;
 
 	return eons;
 }
@@ -1006,6 +1062,15 @@ gboolean sim_eons_pnn_is_empty(struct sim_eons *eons)
 	return !eons->pnn_valid;
 }
 
+/* Whether sim_eons_add_pnn_record() would find a network name in it */
+gboolean sim_pnn_record_has_name(const uint8_t *tlv, uint16_t length)
+{
+	int namelength;
+
+	return ber_tlv_find_by_tag(tlv, 0x43, length, &namelength) &&
+								namelength;
+}
+
 void sim_eons_add_pnn_record(struct sim_eons *eons, uint32_t record,
 				const uint8_t *tlv, uint16_t length)
 {
@@ -1035,6 +1100,24 @@ void sim_eons_add_pnn_record(struct sim_eons *eons, uint32_t record,
 	eons->pnn_valid = TRUE;
 }
 
+static void opl_group_free(void *data)
+{
+	struct opl_group *group = data;
+
+	l_queue_destroy(group->members, NULL);
+	l_free(group->segments);
+	l_free(group);
+}
+
+static void sim_eons_drop_index(struct sim_eons *eons)
+{
+	l_hashmap_destroy(eons->opl_index, opl_group_free);
+	eons->opl_index = NULL;
+
+	l_queue_destroy(eons->opl_wildcards, opl_group_free);
+	eons->opl_wildcards = NULL;
+}
+
 static struct opl_operator *opl_operator_alloc(const uint8_t *record)
 {
 	struct opl_operator *oper = l_new(struct opl_operator, 1);
@@ -1067,6 +1150,10 @@ void sim_eons_add_opl_record(struct sim_eons *eons,
 		return;
 	}
 
+	/* Records are matched in order, the index needs rebuilding */
+	sim_eons_drop_index(eons);
+
+	oper->pos = l_queue_length(eons->opl_list);
 	l_queue_push_tail(eons->opl_list, oper);
 }
 
@@ -1085,11 +1172,31 @@ void sim_eons_free(struct sim_eons *eons)
 		l_free(oper->longname);
 	}
 
+	sim_eons_drop_index(eons);
 	l_queue_destroy(eons->opl_list, l_free);
 
 	l_free(eons);
 }
 
+/* An EONS that is done with optimizing can be shared, it is read only */
+struct sim_eons *sim_eons_ref(struct sim_eons *eons)
+{
+	eons->ref_count += 1;
+
+	return eons;
+}
+
+void sim_eons_unref(struct sim_eons *eons)
+{
+	if (eons == NULL)
+		return;
+
+	if (--eons->ref_count)
+		return;
+
+	sim_eons_free(eons);
+}
+
 static bool opl_match_mcc_mnc(const char *opl, const char *s, size_t max)
 {
 	unsigned int i;
@@ -1101,6 +1208,241 @@ static bool opl_match_mcc_mnc(const char *opl, const char *s, size_t max)
 	return true;
 }
 
+static bool opl_is_any_lac(const struct opl_operator *opl)
+{
+	return opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe;
+}
+
+static int opl_boundary_compare(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *) a;
+	guint32 y = *(const guint32 *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void opl_group_build(struct opl_group *group)
+{
+	const struct l_queue_entry *entry;
+	unsigned int n = l_queue_length(group->members);
+	guint32 *bounds = l_new(guint32, 2 * n);
+	unsigned int n_bounds = 0;
+	unsigned int i;
+
+	for (entry = l_queue_get_entries(group->members);
+						entry; entry = entry->next) {
+		const struct opl_operator *opl = entry->data;
+
+		if (opl_is_any_lac(opl)) {
+			if (group->any == NULL)
+				group->any = opl;
+
+			continue;
+		}
+
+		if (opl->lac_tac_low > opl->lac_tac_high)
+			continue;
+
+		bounds[n_bounds++] = opl->lac_tac_low;
+		bounds[n_bounds++] = opl->lac_tac_high + 1;
+	}
+
+	qsort(bounds, n_bounds, sizeof(guint32), opl_boundary_compare);
+
+	group->segments = l_new(struct opl_segment, n_bounds);
+
+	/* Every range starts and ends on a boundary, so covers segments */
+	for (i = 0; i + 1 < n_bounds; i++) {
+		guint32 low = bounds[i];
+		guint32 high = bounds[i + 1] - 1;
+		const struct opl_operator *first = NULL;
+		struct opl_segment *last;
+
+		if (bounds[i] == bounds[i + 1])
+			continue;
+
+		for (entry = l_queue_get_entries(group->members);
+						entry; entry = entry->next) {
+			const struct opl_operator *opl = entry->data;
+
+			if (opl_is_any_lac(opl))
+				continue;
+
+			if (opl->lac_tac_low <= low &&
+					opl->lac_tac_high >= high) {
+				first = opl;
+				break;
+			}
+		}
+
+		if (first == NULL)
+			continue;
+
+		last = group->n_segments ?
+			&group->segments[group->n_segments - 1] : NULL;
+
+		if (last && last->opl == first && last->high + 1 == low) {
+			last->high = high;
+			continue;
+		}
+
+		group->segments[group->n_segments].low = low;
+		group->segments[group->n_segments].high = high;
+		group->segments[group->n_segments].opl = first;
+		group->n_segments += 1;
+	}
+
+	l_free(bounds);
+}
+
+static const struct opl_operator *opl_group_lookup(
+					const struct opl_group *group,
+					gboolean have_lac, guint16 lac)
+{
+	const struct opl_operator *found = group->any;
+	unsigned int low = 0;
+	unsigned int high = group->n_segments;
+
+	if (have_lac == FALSE)
+		return found;
+
+	while (low < high) {
+		unsigned int mid = (low + high) / 2;
+		const struct opl_segment *segment = &group->segments[mid];
+
+		if (lac < segment->low) {
+			high = mid;
+		} else if (lac > segment->high) {
+			low = mid + 1;
+		} else {
+			if (found == NULL || segment->opl->pos < found->pos)
+				found = segment->opl;
+
+			break;
+		}
+	}
+
+	return found;
+}
+
+static bool opl_group_match(const void *a, const void *b)
+{
+	const struct opl_group *group = a;
+	const struct opl_operator *opl = b;
+
+	return !strcmp(group->mcc, opl->mcc) && !strcmp(group->mnc, opl->mnc);
+}
+
+static bool opl_is_wildcard(const struct opl_operator *opl)
+{
+	return strchr(opl->mcc, 'b') || strchr(opl->mnc, 'b');
+}
+
+static struct opl_group *opl_group_new(const struct opl_operator *opl)
+{
+	struct opl_group *group = l_new(struct opl_group, 1);
+
+	strcpy(group->mcc, opl->mcc);
+	strcpy(group->mnc, opl->mnc);
+	group->members = l_queue_new();
+
+	return group;
+}
+
+static void opl_group_build_foreach(const void *key, void *value,
+					void *user_data)
+{
+	opl_group_build(value);
+}
+
+/*
+ * Groups the OPL records by MCC/MNC once they are all read, keeping the
+ * ones with wildcard digits apart, so that looking up a PLMN is a hash
+ * lookup and a binary search in each of the few wildcard groups.
+ */
+void sim_eons_optimize(struct sim_eons *eons)
+{
+	const struct l_queue_entry *entry;
+	char key[OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 1];
+	struct opl_group *group;
+
+	if (eons == NULL)
+		return;
+
+	sim_eons_drop_index(eons);
+
+	eons->opl_index = l_hashmap_string_new();
+	eons->opl_wildcards = l_queue_new();
+
+	for (entry = l_queue_get_entries(eons->opl_list);
+						entry; entry = entry->next) {
+		const struct opl_operator *opl = entry->data;
+
+		if (opl_is_wildcard(opl)) {
+			group = l_queue_find(eons->opl_wildcards,
+						opl_group_match, opl);
+
+			if (group == NULL) {
+				group = opl_group_new(opl);
+				l_queue_push_tail(eons->opl_wildcards, group);
+			}
+		} else {
+			snprintf(key, sizeof(key), "%s%s", opl->mcc, opl->mnc);
+			group = l_hashmap_lookup(eons->opl_index, key);
+
+			if (group == NULL) {
+				group = opl_group_new(opl);
+				l_hashmap_insert(eons->opl_index, key, group);
+			}
+		}
+
+		l_queue_push_tail(group->members, (void *) opl);
+	}
+
+	l_hashmap_foreach(eons->opl_index, opl_group_build_foreach, NULL);
+
+	for (entry = l_queue_get_entries(eons->opl_wildcards);
+						entry; entry = entry->next)
+		opl_group_build(entry->data);
+}
+
+static const struct opl_operator *sim_eons_lookup_index(
+					struct sim_eons *eons,
+					const char *mcc, const char *mnc,
+					gboolean have_lac, guint16 lac)
+{
+	char key[OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 1];
+	const struct l_queue_entry *entry;
+	const struct opl_group *group;
+	const struct opl_operator *found = NULL;
+	const struct opl_operator *opl;
+
+	snprintf(key, sizeof(key), "%s%s", mcc, mnc);
+	group = l_hashmap_lookup(eons->opl_index, key);
+
+	if (group)
+		found = opl_group_lookup(group, have_lac, lac);
+
+	/* The first matching record wins, wherever it was filed */
+	for (entry = l_queue_get_entries(eons->opl_wildcards);
+						entry; entry = entry->next) {
+		group = entry->data;
+
+		if (!opl_match_mcc_mnc(group->mcc, mcc, OFONO_MAX_MCC_LENGTH))
+			continue;
+
+		if (!opl_match_mcc_mnc(group->mnc, mnc, OFONO_MAX_MNC_LENGTH))
+			continue;
+
+		opl = opl_group_lookup(group, have_lac, lac);
+
+		if (opl && (found == NULL || opl->pos < found->pos))
+			found = opl;
+	}
+
+	return found;
+}
+
 static const struct sim_eons_operator_info *
 	sim_eons_lookup_common(struct sim_eons *eons,
 				const char *mcc, const char *mnc,
@@ -1109,6 +1451,14 @@ static const struct sim_eons_operator_info *
 	const struct l_queue_entry *entry;
 	const struct opl_operator *opl;
 
+	if (eons->opl_index) {
+		opl = sim_eons_lookup_index(eons, mcc, mnc, have_lac, lac);
+		if (opl == NULL)
+			return NULL;
+
+		goto found;
+	}
+
 	for (entry = l_queue_get_entries(eons->opl_list);
 						entry; entry = entry->next) {
 		opl = entry->data;
@@ -1119,7 +1469,7 @@ static const struct sim_eons_operator_info *
 		if (!opl_match_mcc_mnc(opl->mnc, mnc, OFONO_MAX_MNC_LENGTH))
 			continue;
 
-		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe)
+		if (opl_is_any_lac(opl))
 			goto found;
 
 		if (have_lac == FALSE)
@@ -1281,81 +1631,133 @@ static int find_ef_by_id(const void *key, const void *value)
 	return id - info->id;
 }
 
-struct sim_ef_info *sim_ef_db_lookup(unsigned short id)
+static struct sim_ef_info *ef_db_bsearch(unsigned short id)
 {
-	struct sim_ef_info *result;
-	unsigned int nelem = sizeof(ef_db) / sizeof(struct sim_ef_info);
+	return bsearch(GUINT_TO_POINTER((unsigned int) id), ef_db,
+				L_ARRAY_SIZE(ef_db), sizeof(struct sim_ef_info),
+				find_ef_by_id);
+}
+
+/*
+ * Nearly all EFs of interest live under DF7F20/DF7FFF with ids 0x6Fxx, so
+ * those are looked up directly by their low byte, anything else falls back
+ * to the binary search.  The 2G and 3G paths are resolved once for every
+ * entry, the per-read lookups only copy them out.
+ */
+struct ef_db_path {
+	unsigned char len;
+	unsigned char path[6];
+};
 
-	result = bsearch(GUINT_TO_POINTER((unsigned int) id), ef_db, nelem,
-				sizeof(struct sim_ef_info), find_ef_by_id);
+static unsigned char ef_db_6f[256];	/* Index into ef_db + 1, or 0 */
+static struct ef_db_path ef_db_2g[L_ARRAY_SIZE(ef_db)];
+static struct ef_db_path ef_db_3g[L_ARRAY_SIZE(ef_db)];
+static bool ef_db_indexed;
 
-	return result;
+static unsigned short ef_db_parent(const struct sim_ef_info *info, bool umts)
+{
+	return umts ? info->parent3g : info->parent2g;
 }
 
-unsigned int sim_ef_db_get_path_2g(unsigned short id, unsigned char out_path[])
+static void ef_db_resolve(const struct sim_ef_info *info, bool umts,
+				struct ef_db_path *out)
 {
-	struct sim_ef_info *info;
-	unsigned int nelem = sizeof(ef_db) / sizeof(struct sim_ef_info);
+	unsigned short parent = ef_db_parent(info, umts);
 	unsigned char path[6];
 	int i = 0;
 	int j;
 
-	info = bsearch(GUINT_TO_POINTER((unsigned int) id), ef_db, nelem,
-				sizeof(struct sim_ef_info), find_ef_by_id);
-	if (info == NULL || !info->parent2g)
-		return 0;
+	if (!parent)
+		return;
 
-	path[i++] = info->parent2g & 0xff;
-	path[i++] = info->parent2g >> 8;
+	path[i++] = parent & 0xff;
+	path[i++] = parent >> 8;
 
-	while (info->parent2g != ROOTMF) {
-		info = bsearch(GUINT_TO_POINTER((unsigned int) info->parent2g),
-				ef_db, nelem, sizeof(struct sim_ef_info),
-				find_ef_by_id);
-		if (info == NULL)
-			return 0;
+	while (parent != ROOTMF) {
+		info = ef_db_bsearch(parent);
+		if (info == NULL || i == sizeof(path))
+			return;
 
-		path[i++] = info->parent2g & 0xff;
-		path[i++] = info->parent2g >> 8;
+		parent = ef_db_parent(info, umts);
+		if (!parent)
+			return;
+
+		path[i++] = parent & 0xff;
+		path[i++] = parent >> 8;
 	}
 
 	for (j = 0; j < i; j++)
-		out_path[j] = path[i - j - 1];
+		out->path[j] = path[i - j - 1];
 
-	return i;
+	out->len = i;
 }
 
-unsigned int sim_ef_db_get_path_3g(unsigned short id, unsigned char out_path[])
+static void ef_db_index(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(ef_db); i++) {
+		const struct sim_ef_info *info = &ef_db[i];
+
+		if ((info->id >> 8) == 0x6F)
+			ef_db_6f[info->id & 0xff] = i + 1;
+
+		ef_db_resolve(info, false, &ef_db_2g[i]);
+		ef_db_resolve(info, true, &ef_db_3g[i]);
+	}
+
+	ef_db_indexed = true;
+}
+
+static int ef_db_find(unsigned short id)
 {
 	struct sim_ef_info *info;
-	unsigned int nelem = sizeof(ef_db) / sizeof(struct sim_ef_info);
-	unsigned char path[6];
-	int i = 0;
-	int j;
 
-	info = bsearch(GUINT_TO_POINTER((unsigned int) id), ef_db, nelem,
-				sizeof(struct sim_ef_info), find_ef_by_id);
-	if (info == NULL || !info->parent3g)
-		return 0;
+	if (!ef_db_indexed)
+		ef_db_index();
 
-	path[i++] = info->parent3g & 0xff;
-	path[i++] = info->parent3g >> 8;
+	if ((id >> 8) == 0x6F)
+		return ef_db_6f[id & 0xff] - 1;
 
-	while (info->parent3g != ROOTMF) {
-		info = bsearch(GUINT_TO_POINTER((unsigned int) info->parent3g),
-				ef_db, nelem, sizeof(struct sim_ef_info),
-				find_ef_by_id);
-		if (info == NULL)
-			return 0;
+	info = ef_db_bsearch(id);
+	if (info == NULL)
+		return -1;
 
-		path[i++] = info->parent3g & 0xff;
-		path[i++] = info->parent3g >> 8;
-	}
+	return info - ef_db;
+}
 
-	for (j = 0; j < i; j++)
-		out_path[j] = path[i - j - 1];
+struct sim_ef_info *sim_ef_db_lookup(unsigned short id)
+{
+	int i = ef_db_find(id);
+
+	if (i < 0)
+		return NULL;
+
+	return &ef_db[i];
+}
 
-	return i;
+static unsigned int ef_db_get_path(const struct ef_db_path *paths,
+					unsigned short id,
+					unsigned char out_path[])
+{
+	int i = ef_db_find(id);
+
+	if (i < 0)
+		return 0;
+
+	memcpy(out_path, paths[i].path, paths[i].len);
+
+	return paths[i].len;
+}
+
+unsigned int sim_ef_db_get_path_2g(unsigned short id, unsigned char out_path[])
+{
+	return ef_db_get_path(ef_db_2g, id, out_path);
+}
+
+unsigned int sim_ef_db_get_path_3g(unsigned short id, unsigned char out_path[])
+{
+	return ef_db_get_path(ef_db_3g, id, out_path);
 }
 
 gboolean sim_parse_3g_get_response(const unsigned char *data, int len,
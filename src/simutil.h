@@ -16,6 +16,8 @@ enum sim_fileid {
 	SIM_EF_ICCID_FILEID =			0x2FE2,
 	SIM_MF_FILEID =				0x3F00,
 	SIM_EFIMG_FILEID =			0x4F20,
+	SIM_EFPSC_FILEID =			0x4F22,
+	SIM_EFCC_FILEID =			0x4F23,
 	SIM_DFPHONEBOOK_FILEID =		0x5F3A,
 	SIM_EFLI_FILEID =			0x6F05,
 	SIM_EFARR_FILEID =			0x6F06,
@@ -451,6 +453,7 @@ struct sim_eons *sim_eons_new(uint32_t pnn_records);
 void sim_eons_add_pnn_record(struct sim_eons *eons, uint32_t record,
 				const uint8_t *tlv, uint16_t length);
 gboolean sim_eons_pnn_is_empty(struct sim_eons *eons);
+gboolean sim_pnn_record_has_name(const uint8_t *tlv, uint16_t length);
 void sim_eons_add_opl_record(struct sim_eons *eons,
 				const uint8_t *contents, uint16_t length);
 void sim_eons_optimize(struct sim_eons *eons);
@@ -463,6 +466,8 @@ const struct sim_eons_operator_info *sim_eons_lookup(struct sim_eons *eons,
 						const char *mcc,
 						const char *mnc);
 void sim_eons_free(struct sim_eons *eons);
+struct sim_eons *sim_eons_ref(struct sim_eons *eons);
+void sim_eons_unref(struct sim_eons *eons);
 
 void sim_parse_mcc_mnc(const guint8 *bcd, char *mcc, char *mnc);
 void sim_encode_mcc_mnc(guint8 *out, const char *mcc, const char *mnc);
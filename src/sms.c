@@ -35,6 +35,9 @@
 #define SETTINGS_GROUP "Settings"
 
 #define TXQ_MAX_RETRIES 4
+#define TXQ_DEFAULT_WINDOW 4
+#define TXQ_MAX_WINDOW 16
+#define TXQ_RESTORE_CHUNK 16	/* Messages restored per main loop run */
 #define NETWORK_TIMEOUT 332
 
 static gboolean tx_next(gpointer user_data);
@@ -50,18 +53,30 @@ struct ofono_sms {
 	DBusMessage *pending;
 	struct ofono_phone_number sca;
 	struct sms_assembly *assembly;
+	size_t assembly_size;		/* Charged to memtag */
+	struct ofono_memtag *memtag;
 	guint ref;
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	GQueue *restore_queue;		/* Backed up, not queued again yet */
+	unsigned long restore_id;
+	guint restore_source;
+	GQueue tx_submits;		/* Submits awaiting the driver */
+	unsigned int tx_window;		/* Max submits in flight */
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
 	struct ofono_netreg *netreg;
 	unsigned int netreg_watch;
 	unsigned int status_watch;
+	struct ofono_ims *ims;
+	unsigned int ims_watch;
+	unsigned int ims_ready_watch;
+	ofono_bool_t ims_ready;
 	GKeyFile *settings;
 	char *imsi;
+	struct storage_journal *txq_backup;
 	int bearer;
 	enum sms_alphabet alphabet;
 	const struct ofono_sms_driver *driver;
@@ -72,6 +87,7 @@ struct ofono_sms {
 	GHashTable *messages;
 	struct ofono_watchlist *text_handlers;
 	struct ofono_watchlist *datagram_handlers;
+	GHashTable *datagram_ports;	/* Destination port to handlers */
 };
 
 struct pending_pdu {
@@ -80,10 +96,21 @@ struct pending_pdu {
 	int pdu_len;
 };
 
+struct tx_submit {
+	struct ofono_sms *sms;
+	struct tx_queue_entry *entry;
+	unsigned char pdu;
+};
+
 struct tx_queue_entry {
 	struct pending_pdu *pdus;
 	unsigned char num_pdus;
-	unsigned char cur_pdu;
+	unsigned char cur_pdu;		/* Next pdu never submitted */
+	unsigned char sent_pdus;
+	unsigned char pending;		/* Submits in flight */
+	unsigned char resends;
+	unsigned int resend[8];		/* pdus to submit again */
+	gboolean failed;
 	struct sms_address receiver;
 	struct ofono_uuid uuid;
 	unsigned int retry;
@@ -94,6 +121,13 @@ struct tx_queue_entry {
 	unsigned long id;
 };
 
+static struct tx_queue_entry *sms_txq_queue(struct ofono_sms *sms,
+						GSList *list,
+						unsigned int flags,
+						struct message **out_m);
+static void sms_txq_backup_store(struct ofono_sms *sms,
+					struct tx_queue_entry *entry);
+
 static gboolean uuid_equal(gconstpointer v1, gconstpointer v2)
 {
 	return memcmp(v1, v2, OFONO_SHA1_UUID_LEN) == 0;
@@ -265,28 +299,68 @@ gboolean __ofono_sms_text_watch_remove(struct ofono_sms *sms,
 	return __ofono_watchlist_remove_item(sms->text_handlers, id);
 }
 
+/*
+ * Datagram handlers are also indexed by destination port, handlers for
+ * any port being kept under -1, so that dispatch only visits those that
+ * can match.
+ */
+static void datagram_port_add(struct ofono_sms *sms, struct sms_handler *h)
+{
+	gpointer key = GINT_TO_POINTER(h->dst);
+	GSList *handlers = g_hash_table_lookup(sms->datagram_ports, key);
+
+	g_hash_table_steal(sms->datagram_ports, key);
+	g_hash_table_insert(sms->datagram_ports, key,
+					g_slist_prepend(handlers, h));
+}
+
+static void datagram_port_remove(struct ofono_sms *sms, struct sms_handler *h)
+{
+	gpointer key = GINT_TO_POINTER(h->dst);
+	GSList *handlers = g_hash_table_lookup(sms->datagram_ports, key);
+
+	g_hash_table_steal(sms->datagram_ports, key);
+	handlers = g_slist_remove(handlers, h);
+
+	if (handlers)
+		g_hash_table_insert(sms->datagram_ports, key, handlers);
+}
+
 unsigned int __ofono_sms_datagram_watch_add(struct ofono_sms *sms,
 					ofono_sms_datagram_notify_cb_t cb,
 					int dst, int src, void *data,
 					ofono_destroy_func destroy)
 {
+	unsigned int id;
+
 	if (sms == NULL)
 		return 0;
 
 	DBG("%p: dst %d, src %d", sms, dst, src);
 
-	return add_sms_handler(sms->datagram_handlers, dst, src, cb, data,
+	id = add_sms_handler(sms->datagram_handlers, dst, src, cb, data,
 				destroy);
+	if (id)
+		datagram_port_add(sms, __ofono_watchlist_find(
+						sms->datagram_handlers, id));
+
+	return id;
 }
 
 gboolean __ofono_sms_datagram_watch_remove(struct ofono_sms *sms,
 					unsigned int id)
 {
+	struct sms_handler *h;
+
 	if (sms == NULL)
 		return FALSE;
 
 	DBG("%p", sms);
 
+	h = __ofono_watchlist_find(sms->datagram_handlers, id);
+	if (h)
+		datagram_port_remove(sms, h);
+
 	return __ofono_watchlist_remove_item(sms->datagram_handlers, id);
 }
 
@@ -627,8 +701,8 @@ static void tx_queue_entry_destroy(struct tx_queue_entry *entry)
 	if (entry->destroy)
 		entry->destroy(entry->data);
 
-	g_free(entry->pdus);
-	g_free(entry);
+	__ofono_mem_free(entry->pdus);
+	__ofono_mem_free(entry);
 }
 
 static void tx_queue_entry_destroy_foreach(gpointer _entry, gpointer unused)
@@ -674,7 +748,7 @@ static void sms_tx_queue_remove_entry(struct ofono_sms *sms, GList *entry_list,
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS) {
 		struct message *m;
 
-		sms_tx_backup_free(sms->imsi, entry->id, entry->flags,
+		sms_tx_backup_free(sms->txq_backup, entry->id, entry->flags,
 					ofono_uuid_to_str(&entry->uuid));
 
 		m = g_hash_table_lookup(sms->messages, &entry->uuid);
@@ -692,53 +766,142 @@ done:
 	tx_queue_entry_destroy(entry);
 }
 
+/* Returns the next pdu of the entry to submit, pdus to resend first */
+static int tx_entry_next_pdu(const struct tx_queue_entry *entry)
+{
+	unsigned int i;
+
+	for (i = 0; entry->resends && i < entry->cur_pdu; i++)
+		if (entry->resend[i / 32] & (1 << (i % 32)))
+			return i;
+
+	if (entry->cur_pdu < entry->num_pdus)
+		return entry->cur_pdu;
+
+	return -1;
+}
+
+static void tx_entry_take_pdu(struct tx_queue_entry *entry, unsigned char seq)
+{
+	if (seq < entry->cur_pdu) {
+		entry->resend[seq / 32] &= ~(1 << (seq % 32));
+		entry->resends -= 1;
+	} else
+		entry->cur_pdu += 1;
+}
+
+static void tx_entry_resend(struct tx_queue_entry *entry, unsigned char seq)
+{
+	entry->resend[seq / 32] |= 1 << (seq % 32);
+	entry->resends += 1;
+}
+
+/*
+ * Bulk messages go to the back of the queue.  Other messages go ahead of
+ * any bulk message that has not started sending yet.
+ */
+static void tx_queue_insert(struct ofono_sms *sms,
+				struct tx_queue_entry *entry)
+{
+	GList *l;
+
+	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_BULK) {
+		g_queue_push_tail(sms->txq, entry);
+		return;
+	}
+
+	for (l = sms->txq->head; l; l = l->next) {
+		struct tx_queue_entry *queued = l->data;
+
+		if ((queued->flags & OFONO_SMS_SUBMIT_FLAG_BULK) &&
+				queued->cur_pdu == 0)
+			break;
+	}
+
+	if (l)
+		g_queue_insert_before(sms->txq, l, entry);
+	else
+		g_queue_push_tail(sms->txq, entry);
+}
+
+/* Messages go out once either the network or IMS can carry them */
+static ofono_bool_t tx_can_send(struct ofono_sms *sms)
+{
+	return sms->registered || sms->ims_ready;
+}
+
+static void tx_schedule(struct ofono_sms *sms)
+{
+	/* Nothing goes out before the backed up messages are queued */
+	if (!tx_can_send(sms) || sms->tx_source || sms->restore_queue)
+		return;
+
+	if (g_queue_get_length(sms->txq))
+		sms->tx_source = g_timeout_add(0, tx_next, sms);
+}
+
 static void tx_finished(const struct ofono_error *error, int mr, void *data)
 {
-	struct ofono_sms *sms = data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_submit *submit = data;
+	struct ofono_sms *sms = submit->sms;
+	struct tx_queue_entry *entry = submit->entry;
+	unsigned char seq = submit->pdu;
 	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
-	enum message_state tx_state;
 
-	DBG("tx_finished %p", entry);
+	DBG("tx_finished %p pdu %u", entry, seq);
 
-	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	g_queue_remove(&sms->tx_submits, submit);
+	l_free(submit);
+	entry->pending -= 1;
+
+	if (g_queue_is_empty(&sms->tx_submits))
+		sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	if (ok == FALSE) {
 		/* Retry again when back in online mode */
 		/* Note this does not increment retry count */
-		if (sms->registered == FALSE)
-			return;
-
-		tx_state = MESSAGE_STATE_FAILED;
+		if (!tx_can_send(sms)) {
+			tx_entry_resend(entry, seq);
+			goto out;
+		}
 
 		/* Retry done only for Network Timeout failure */
 		if (error->type == OFONO_ERROR_TYPE_CMS &&
 				error->error != NETWORK_TIMEOUT)
-			goto next_q;
+			goto failed;
 
 		if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_RETRY))
-			goto next_q;
+			goto failed;
+
+		if (entry->failed)
+			goto out;
 
 		entry->retry += 1;
 
 		if (entry->retry < TXQ_MAX_RETRIES) {
 			DBG("Sending failed, retry in %d secs",
 					entry->retry * 5);
+			tx_entry_resend(entry, seq);
+
+			/* Nothing new is submitted until the retry is due */
+			if (sms->tx_source)
+				g_source_remove(sms->tx_source);
+
 			sms->tx_source = g_timeout_add_seconds(entry->retry * 5,
 								tx_next, sms);
 			return;
 		}
 
 		DBG("Max retries reached, giving up");
-		goto next_q;
+		goto failed;
 	}
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS)
-		sms_tx_backup_remove(sms->imsi, entry->id, entry->flags,
+		sms_tx_backup_remove(sms->txq_backup, entry->id, entry->flags,
 						ofono_uuid_to_str(&entry->uuid),
-						entry->cur_pdu);
+						seq);
 
-	entry->cur_pdu += 1;
+	entry->sent_pdus += 1;
 	entry->retry = 0;
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR)
@@ -748,48 +911,90 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 							mr, time(NULL),
 							entry->num_pdus);
 
-	if (entry->cur_pdu < entry->num_pdus) {
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
-		return;
+	if (entry->sent_pdus == entry->num_pdus) {
+		sms_tx_queue_remove_entry(sms,
+					g_queue_find(sms->txq, entry),
+					MESSAGE_STATE_SENT);
+		goto done;
 	}
 
-	tx_state = MESSAGE_STATE_SENT;
+	goto out;
 
-next_q:
-	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
-					tx_state);
+failed:
+	entry->failed = TRUE;
 
-	if (sms->registered == FALSE)
-		return;
+out:
+	/* Other pdus of a failed message may still be in flight */
+	if (entry->failed && entry->pending == 0)
+		sms_tx_queue_remove_entry(sms,
+					g_queue_find(sms->txq, entry),
+					MESSAGE_STATE_FAILED);
 
-	if (g_queue_peek_head(sms->txq)) {
-		DBG("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
-	}
+done:
+	/* Status report bookkeeping is batched while the queue is busy */
+	if (g_queue_is_empty(sms->txq))
+		status_report_assembly_sync(sms->sr_assembly);
+
+	tx_schedule(sms);
 }
 
+static void tx_submit(struct ofono_sms *sms, struct tx_queue_entry *entry,
+			unsigned char seq, int send_mms)
+{
+	struct pending_pdu *pdu = &entry->pdus[seq];
+	struct tx_submit *submit = l_new(struct tx_submit, 1);
+
+	DBG("tx_submit: %p pdu %u", entry, seq);
+
+	submit->sms = sms;
+	submit->entry = entry;
+	submit->pdu = seq;
+
+	entry->pending += 1;
+	g_queue_push_tail(&sms->tx_submits, submit);
+	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+
+	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
+				send_mms, tx_finished, submit);
+}
+
+/*
+ * Submits pdus in queue order until the window is full.  With a window of
+ * one this waits for each pdu to finish before sending the next, as
+ * drivers without pipelining support require.
+ */
 static gboolean tx_next(gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
-	int send_mms = 0;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
-	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
-
-	DBG("tx_next: %p", entry);
+	GList *l = sms->txq->head;
 
 	sms->tx_source = 0;
 
-	if (sms->registered == FALSE)
-		return FALSE;
+	/*
+	 * Drivers may complete a submit before returning, which can remove
+	 * entries, so start over from the head after every submit.  Stop
+	 * if that scheduled a retry.
+	 */
+	while (l && tx_can_send(sms) && sms->tx_source == 0 &&
+			g_queue_get_length(&sms->tx_submits) < sms->tx_window) {
+		struct tx_queue_entry *entry = l->data;
+		int seq;
+		int send_mms = 0;
+
+		seq = entry->failed ? -1 : tx_entry_next_pdu(entry);
+		if (seq < 0) {
+			l = l->next;
+			continue;
+		}
 
-	if (g_queue_get_length(sms->txq) > 1
-			|| (entry->num_pdus - entry->cur_pdu) > 1)
-		send_mms = 1;
+		tx_entry_take_pdu(entry, seq);
 
-	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+		if (l->next || tx_entry_next_pdu(entry) >= 0)
+			send_mms = 1;
 
-	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-				send_mms, tx_finished, sms);
+		tx_submit(sms, entry, seq, send_mms);
+		l = sms->txq->head;
+	}
 
 	return FALSE;
 }
@@ -812,17 +1017,7 @@ static void netreg_status_watch(int status, int lac, int ci, int tech,
 		break;
 	}
 
-	if (sms->registered == FALSE)
-		return;
-
-	if (sms->tx_source > 0)
-		return;
-
-	if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-		return;
-
-	if (g_queue_get_length(sms->txq))
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	tx_schedule(sms);
 }
 
 static void netreg_watch(struct ofono_atom *atom,
@@ -847,6 +1042,37 @@ static void netreg_watch(struct ofono_atom *atom,
 	netreg_status_watch(status, 0, 0, 0, NULL, NULL, sms);
 }
 
+static void ims_ready_watch(ofono_bool_t voice, ofono_bool_t ims_sms,
+				void *data)
+{
+	struct ofono_sms *sms = data;
+
+	DBG("SMS over IMS %s", ims_sms ? "ready" : "not ready");
+
+	sms->ims_ready = ims_sms;
+	tx_schedule(sms);
+}
+
+static void ims_watch(struct ofono_atom *atom,
+			enum ofono_atom_watch_condition cond, void *data)
+{
+	struct ofono_sms *sms = data;
+
+	if (cond == OFONO_ATOM_WATCH_CONDITION_UNREGISTERED) {
+		sms->ims_ready = FALSE;
+		sms->ims_ready_watch = 0;
+		sms->ims = NULL;
+		return;
+	}
+
+	sms->ims = __ofono_atom_get_data(atom);
+	sms->ims_ready_watch = __ofono_ims_add_ready_watch(sms->ims,
+						ims_ready_watch, sms, NULL);
+
+	ims_ready_watch(__ofono_ims_voice_ready(sms->ims),
+				__ofono_ims_sms_ready(sms->ims), sms);
+}
+
 
 /**
  * Generate a UUID from an SMS PDU List
@@ -889,22 +1115,18 @@ static gboolean sms_uuid_from_pdus(const struct pending_pdu *pdu,
 	return TRUE;
 }
 
-static struct tx_queue_entry *tx_queue_entry_new(GSList *msg_list,
+static struct tx_queue_entry *tx_queue_entry_new(struct ofono_sms *sms,
+							GSList *msg_list,
 							unsigned int flags)
 {
 	struct tx_queue_entry *entry;
 	int i = 0;
 	GSList *l;
 
-	entry = g_try_new0(struct tx_queue_entry, 1);
-	if (entry == NULL)
-		return NULL;
-
+	entry = __ofono_mem_new0(sms->memtag, struct tx_queue_entry, 1);
 	entry->num_pdus = g_slist_length(msg_list);
-
-	entry->pdus = g_try_new0(struct pending_pdu, entry->num_pdus);
-	if (entry->pdus == NULL)
-		goto error;
+	entry->pdus = __ofono_mem_new0(sms->memtag, struct pending_pdu,
+							entry->num_pdus);
 
 	if (flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR) {
 		struct sms *head = msg_list->data;
@@ -931,9 +1153,8 @@ static struct tx_queue_entry *tx_queue_entry_new(GSList *msg_list,
 	if (sms_uuid_from_pdus(entry->pdus, entry->num_pdus, &entry->uuid))
 		return entry;
 
-error:
-	g_free(entry->pdus);
-	g_free(entry);
+	__ofono_mem_free(entry->pdus);
+	__ofono_mem_free(entry);
 
 	return NULL;
 }
@@ -961,22 +1182,24 @@ static void message_queued(struct ofono_sms *sms,
 }
 
 /*
- * Pre-process a SMS text message and deliver it [D-Bus SendMessage()]
+ * Pre-process a SMS text message and deliver it [D-Bus SendMessage() and
+ * SendBulkMessage()]
  *
  * @conn: D-Bus connection
  * @msg: message data (telephone number and text)
- * @data: SMS object to use for transmision
+ * @sms: SMS object to use for transmision
+ * @extra_flags: submit flags on top of the ones every text message gets
  *
  * An alphabet is chosen for the text and it (might be) segmented in
  * fragments by sms_text_prepare() into @msg_list. A queue list @entry
- * is created by tx_queue_entry_new() and g_queue_push_tail()
- * appends that entry to the SMS transmit queue. Then the tx_next()
+ * is created by tx_queue_entry_new() and tx_queue_insert() puts that
+ * entry in the SMS transmit queue. Then the tx_next()
  * function is scheduled to run to process the queue.
  */
-static DBusMessage *sms_send_message(DBusConnection *conn, DBusMessage *msg,
-					void *data)
+static DBusMessage *sms_send_text(DBusConnection *conn, DBusMessage *msg,
+					struct ofono_sms *sms,
+					unsigned int extra_flags)
 {
-	struct ofono_sms *sms = data;
 	const char *to;
 	const char *text;
 	GSList *msg_list;
@@ -1002,7 +1225,8 @@ static DBusMessage *sms_send_message(DBusConnection *conn, DBusMessage *msg,
 	if (msg_list == NULL)
 		return __ofono_error_invalid_format(msg);
 
-	flags = OFONO_SMS_SUBMIT_FLAG_RECORD_HISTORY;
+	flags = extra_flags;
+	flags |= OFONO_SMS_SUBMIT_FLAG_RECORD_HISTORY;
 	flags |= OFONO_SMS_SUBMIT_FLAG_RETRY;
 	flags |= OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS;
 	if (sms->use_delivery_reports)
@@ -1022,6 +1246,207 @@ static DBusMessage *sms_send_message(DBusConnection *conn, DBusMessage *msg,
 	return NULL;
 }
 
+static DBusMessage *sms_send_message(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	return sms_send_text(conn, msg, data, 0);
+}
+
+/* As SendMessage, but queued behind all other messages */
+static DBusMessage *sms_send_bulk_message(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	return sms_send_text(conn, msg, data, OFONO_SMS_SUBMIT_FLAG_BULK);
+}
+
+struct sms_batch_item {
+	const char *to;
+	const char *text;
+	GSList *msg_list;
+	struct tx_queue_entry *entry;
+	struct message *m;
+};
+
+static void sms_batch_free(GArray *items)
+{
+	unsigned int i;
+
+	for (i = 0; i < items->len; i++) {
+		struct sms_batch_item *item;
+
+		item = &g_array_index(items, struct sms_batch_item, i);
+		g_slist_free_full(item->msg_list, g_free);
+	}
+
+	g_array_free(items, TRUE);
+}
+
+/*
+ * Validate and encode a batch of text messages [D-Bus SendMessages()]
+ *
+ * Nothing is queued unless every recipient and text of the batch is
+ * valid.  The references of multi-part messages are worked out ahead, the
+ * same way __ofono_sms_txq_submit() would step them.  The backup of the
+ * whole batch is written with a single journal commit, and the
+ * MessageAdded signals follow the reply.
+ */
+static GArray *sms_batch_prepare(struct ofono_sms *sms, DBusMessage *msg,
+					DBusMessage **error)
+{
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GArray *items;
+	guint ref = sms->ref;
+
+	*error = NULL;
+
+	if (!dbus_message_iter_init(msg, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) !=
+							DBUS_TYPE_ARRAY) {
+		*error = __ofono_error_invalid_args(msg);
+		return NULL;
+	}
+
+	items = g_array_new(FALSE, TRUE, sizeof(struct sms_batch_item));
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT) {
+		DBusMessageIter entry;
+		struct sms_batch_item item = { 0 };
+
+		dbus_message_iter_recurse(&array, &entry);
+
+		if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING)
+			goto invalid_args;
+
+		dbus_message_iter_get_basic(&entry, &item.to);
+		dbus_message_iter_next(&entry);
+
+		if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING)
+			goto invalid_args;
+
+		dbus_message_iter_get_basic(&entry, &item.text);
+
+		if (valid_phone_number_format(item.to) == FALSE)
+			goto invalid_format;
+
+		item.msg_list = sms_text_prepare_with_alphabet(item.to,
+						item.text, ref, FALSE,
+						sms->use_delivery_reports,
+						sms->alphabet);
+		if (item.msg_list == NULL)
+			goto invalid_format;
+
+		if (item.msg_list->next != NULL)
+			ref = ref == 65536 ? 1 : ref + 1;
+
+		g_array_append_val(items, item);
+		dbus_message_iter_next(&array);
+	}
+
+	if (dbus_message_iter_get_arg_type(&array) != DBUS_TYPE_INVALID)
+		goto invalid_args;
+
+	return items;
+
+invalid_args:
+	*error = __ofono_error_invalid_args(msg);
+	sms_batch_free(items);
+	return NULL;
+
+invalid_format:
+	*error = __ofono_error_invalid_format(msg);
+	sms_batch_free(items);
+	return NULL;
+}
+
+static DBusMessage *sms_send_messages(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_sms *sms = data;
+	struct ofono_modem *modem = __ofono_atom_get_modem(sms->atom);
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	GArray *items;
+	unsigned int flags;
+	unsigned int queued = 0;
+	unsigned int i;
+	time_t now = time(NULL);
+
+	items = sms_batch_prepare(sms, msg, &reply);
+	if (items == NULL)
+		return reply;
+
+	flags = OFONO_SMS_SUBMIT_FLAG_RECORD_HISTORY;
+	flags |= OFONO_SMS_SUBMIT_FLAG_RETRY;
+	flags |= OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS;
+	flags |= OFONO_SMS_SUBMIT_FLAG_BULK;
+	if (sms->use_delivery_reports)
+		flags |= OFONO_SMS_SUBMIT_FLAG_REQUEST_SR;
+
+	storage_journal_begin(sms->txq_backup);
+
+	for (i = 0; i < items->len; i++) {
+		struct sms_batch_item *item;
+
+		item = &g_array_index(items, struct sms_batch_item, i);
+		item->entry = sms_txq_queue(sms, item->msg_list, flags,
+						&item->m);
+		if (item->entry == NULL)
+			continue;
+
+		sms_txq_backup_store(sms, item->entry);
+		queued += 1;
+	}
+
+	storage_journal_commit(sms->txq_backup);
+
+	/* Whatever did get queued is sent and signalled regardless */
+	if (queued < items->len) {
+		reply = __ofono_error_failed(msg);
+	} else {
+		reply = dbus_message_new_method_return(msg);
+
+		dbus_message_iter_init_append(reply, &iter);
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_OBJECT_PATH_AS_STRING,
+					&array);
+
+		for (i = 0; i < items->len; i++) {
+			struct sms_batch_item *item;
+			const char *path;
+
+			item = &g_array_index(items, struct sms_batch_item, i);
+			path = __ofono_sms_message_path_from_uuid(sms,
+							&item->entry->uuid);
+			dbus_message_iter_append_basic(&array,
+						DBUS_TYPE_OBJECT_PATH, &path);
+		}
+
+		dbus_message_iter_close_container(&iter, &array);
+	}
+
+	g_dbus_send_message(conn, reply);
+
+	for (i = 0; i < items->len; i++) {
+		struct sms_batch_item *item;
+
+		item = &g_array_index(items, struct sms_batch_item, i);
+		if (item->entry == NULL)
+			continue;
+
+		__ofono_history_sms_send_pending(modem, &item->entry->uuid,
+							item->to, now,
+							item->text);
+		message_emit_added(item->m, OFONO_MESSAGE_MANAGER_INTERFACE);
+	}
+
+	sms_batch_free(items);
+
+	return NULL;
+}
+
 static DBusMessage *sms_get_messages(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
@@ -1099,31 +1524,25 @@ int __ofono_sms_txq_cancel(struct ofono_sms *sms, const struct ofono_uuid *uuid)
 
 	entry = l->data;
 
-	if (entry == g_queue_peek_head(sms->txq)) {
-		/*
-		 * Fail if any pdu was already transmitted or if we are
-		 * waiting the answer from driver.
-		 */
-		if (entry->cur_pdu > 0)
-			return -EPERM;
-
-		if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-			return -EPERM;
-		/*
-		 * Make sure we don't call tx_next() if there are no entries
-		 * and that next entry doesn't have to wait a 'retry time'
-		 * from this one.
-		 */
-		if (sms->tx_source) {
-			g_source_remove(sms->tx_source);
-			sms->tx_source = 0;
+	/*
+	 * Fail if any pdu was already transmitted or if we are
+	 * waiting the answer from driver.
+	 */
+	if (entry->sent_pdus > 0 || entry->pending > 0)
+		return -EPERM;
 
-			if (g_queue_get_length(sms->txq) > 1)
-				sms->tx_source = g_timeout_add(0, tx_next, sms);
-		}
+	/*
+	 * Make sure we don't call tx_next() if there are no entries
+	 * and that next entry doesn't have to wait a 'retry time'
+	 * from this one.
+	 */
+	if (entry->resends && sms->tx_source) {
+		g_source_remove(sms->tx_source);
+		sms->tx_source = 0;
 	}
 
 	sms_tx_queue_remove_entry(sms, l, MESSAGE_STATE_CANCELLED);
+	tx_schedule(sms);
 
 	return 0;
 }
@@ -1139,6 +1558,14 @@ static const GDBusMethodTable sms_manager_methods[] = {
 			GDBUS_ARGS({ "to", "s" }, { "text", "s" }),
 			GDBUS_ARGS({ "path", "o" }),
 			sms_send_message) },
+	{ GDBUS_ASYNC_METHOD("SendBulkMessage",
+			GDBUS_ARGS({ "to", "s" }, { "text", "s" }),
+			GDBUS_ARGS({ "path", "o" }),
+			sms_send_bulk_message) },
+	{ GDBUS_ASYNC_METHOD("SendMessages",
+			GDBUS_ARGS({ "messages", "a(ss)" }),
+			GDBUS_ARGS({ "paths", "ao" }),
+			sms_send_messages) },
 	{ GDBUS_METHOD("GetMessages",
 			NULL, GDBUS_ARGS({ "messages", "a(oa{sv})" }),
 			sms_get_messages) },
@@ -1208,21 +1635,31 @@ static void dispatch_app_datagram(struct ofono_sms *sms,
 	struct sms_handler *h;
 	GSList *l;
 	gboolean dispatched = FALSE;
+	int keys[2] = { dst, -1 };
+	unsigned int i;
 
 	ts = sms_scts_to_time(scts, &remote);
 	localtime_r(&ts, &local);
 
-	for (l = sms->datagram_handlers->items; l; l = l->next) {
-		h = l->data;
-		notify = h->item.notify;
+	for (i = 0; i < L_ARRAY_SIZE(keys); i++) {
+		l = g_hash_table_lookup(sms->datagram_ports,
+						GINT_TO_POINTER(keys[i]));
 
-		if (!port_equal(dst, h->dst) || !port_equal(src, h->src))
-			continue;
+		for (; l; l = l->next) {
+			h = l->data;
+			notify = h->item.notify;
+
+			if (!port_equal(src, h->src))
+				continue;
+
+			dispatched = TRUE;
 
-		dispatched = TRUE;
+			notify(sender, &remote, &local, dst, src, buf, len,
+				h->item.notify_data);
+		}
 
-		notify(sender, &remote, &local, dst, src, buf, len,
-			h->item.notify_data);
+		if (dst == -1)
+			break;
 	}
 
 	if (!dispatched)
@@ -1249,9 +1686,9 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	struct tm remote;
 	struct tm local;
 	const char *str = buf;
+	struct ofono_watchlist_iter handlers;
 	ofono_sms_text_notify_cb_t notify;
 	struct sms_handler *h;
-	GSList *l;
 
 	if (message == NULL)
 		return;
@@ -1296,8 +1733,9 @@ static void dispatch_text_message(struct ofono_sms *sms,
 	if (cls == SMS_CLASS_0)
 		return;
 
-	for (l = sms->text_handlers->items; l; l = l->next) {
-		h = l->data;
+	__ofono_watchlist_iter_init(&handlers, sms->text_handlers);
+
+	while ((h = __ofono_watchlist_iter_next(&handlers))) {
 		notify = h->item.notify;
 
 		notify(str, &remote, &local, message, h->item.notify_data);
@@ -1424,6 +1862,23 @@ static void sms_dispatch(struct ofono_sms *sms, GSList *sms_list)
 	}
 }
 
+/* Charges the growth or shrinkage of the assembly since the last call */
+static void sms_assembly_charge(struct ofono_sms *sms)
+{
+	size_t size = sms->assembly ? sms->assembly->size : 0;
+
+	__ofono_memtag_charge(sms->memtag,
+				(ssize_t) (size - sms->assembly_size));
+	sms->assembly_size = size;
+}
+
+static void sms_restore_assemblies(struct ofono_sms *sms)
+{
+	sms_assembly_restore(sms->assembly);
+	status_report_assembly_restore(sms->sr_assembly);
+	sms_assembly_charge(sms);
+}
+
 static void handle_deliver(struct ofono_sms *sms, const struct sms *incoming)
 {
 	GSList *l;
@@ -1435,14 +1890,32 @@ static void handle_deliver(struct ofono_sms *sms, const struct sms *incoming)
 
 	if (sms_extract_concatenation(incoming, &ref, &max, &seq)) {
 		GSList *sms_list;
+		enum sms_class cls;
 
 		if (sms->assembly == NULL)
 			return;
 
-		sms_list = sms_assembly_add_fragment(sms->assembly,
+		sms_restore_assemblies(sms);
+
+		/*
+		 * Class 0 messages are only displayed, never stored, so
+		 * their fragments skip the on-disk backup
+		 */
+		if (sms_dcs_decode(incoming->deliver.dcs, &cls,
+						NULL, NULL, NULL) &&
+				cls == SMS_CLASS_0)
+			sms_list = sms_assembly_add_volatile_fragment(
+						sms->assembly,
 						incoming, time(NULL),
 						&incoming->deliver.oaddr,
 						ref, max, seq);
+		else
+			sms_list = sms_assembly_add_fragment(sms->assembly,
+						incoming, time(NULL),
+						&incoming->deliver.oaddr,
+						ref, max, seq);
+
+		sms_assembly_charge(sms);
 
 		if (sms_list == NULL)
 			return;
@@ -1467,6 +1940,8 @@ static void handle_sms_status_report(struct ofono_sms *sms,
 
 	DBG("");
 
+	sms_restore_assemblies(sms);
+
 	if (status_report_assembly_report(sms->sr_assembly, incoming, uuid.uuid,
 						&delivered) == FALSE)
 		return;
@@ -1669,6 +2144,27 @@ void ofono_sms_status_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	handle_sms_status_report(sms, &s);
 }
 
+static void txq_backup_entry_free(gpointer data)
+{
+	struct txq_backup_entry *backup_entry = data;
+
+	g_slist_free_full(backup_entry->msg_list, g_free);
+	g_free(backup_entry);
+}
+
+static void sms_restore_stop(struct ofono_sms *sms)
+{
+	if (sms->restore_source) {
+		g_source_remove(sms->restore_source);
+		sms->restore_source = 0;
+	}
+
+	if (sms->restore_queue) {
+		g_queue_free_full(sms->restore_queue, txq_backup_entry_free);
+		sms->restore_queue = NULL;
+	}
+}
+
 static void sms_unregister(struct ofono_atom *atom)
 {
 	struct ofono_sms *sms = __ofono_atom_get_data(atom);
@@ -1676,6 +2172,8 @@ static void sms_unregister(struct ofono_atom *atom)
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 	const char *path = __ofono_atom_get_path(atom);
 
+	sms_restore_stop(sms);
+
 	g_dbus_unregister_interface(conn, path,
 					OFONO_MESSAGE_MANAGER_INTERFACE);
 	ofono_modem_remove_interface(modem, OFONO_MESSAGE_MANAGER_INTERFACE);
@@ -1699,6 +2197,19 @@ static void sms_unregister(struct ofono_atom *atom)
 
 	sms->netreg = NULL;
 
+	if (sms->ims_ready_watch) {
+		__ofono_ims_remove_ready_watch(sms->ims, sms->ims_ready_watch);
+		sms->ims_ready_watch = 0;
+	}
+
+	if (sms->ims_watch) {
+		__ofono_modem_remove_atom_watch(modem, sms->ims_watch);
+		sms->ims_watch = 0;
+	}
+
+	sms->ims = NULL;
+	sms->ims_ready = FALSE;
+
 	if (sms->messages) {
 		GHashTableIter iter;
 		struct message *m;
@@ -1718,6 +2229,9 @@ static void sms_unregister(struct ofono_atom *atom)
 	__ofono_watchlist_free(sms->text_handlers);
 	sms->text_handlers = NULL;
 
+	g_hash_table_destroy(sms->datagram_ports);
+	sms->datagram_ports = NULL;
+
 	__ofono_watchlist_free(sms->datagram_handlers);
 	sms->datagram_handlers = NULL;
 }
@@ -1742,6 +2256,7 @@ static void sms_remove(struct ofono_atom *atom)
 	if (sms->assembly) {
 		sms_assembly_free(sms->assembly);
 		sms->assembly = NULL;
+		sms_assembly_charge(sms);
 	}
 
 	if (sms->txq) {
@@ -1750,6 +2265,13 @@ static void sms_remove(struct ofono_atom *atom)
 		sms->txq = NULL;
 	}
 
+	g_queue_clear_full(&sms->tx_submits, l_free);
+
+	if (sms->txq_backup) {
+		storage_journal_close(sms->txq_backup);
+		sms->txq_backup = NULL;
+	}
+
 	if (sms->settings) {
 		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
 					"NextReference", sms->ref);
@@ -1773,6 +2295,7 @@ static void sms_remove(struct ofono_atom *atom)
 		sms->sr_assembly = NULL;
 	}
 
+	__ofono_memtag_put(sms->memtag);
 	g_free(sms);
 }
 
@@ -1780,7 +2303,9 @@ OFONO_DEFINE_ATOM_CREATE(sms, OFONO_ATOM_TYPE_SMS, {
 	atom->sca.type = 129;
 	atom->ref = 1;
 	atom->txq = g_queue_new();
+	atom->tx_window = 1;
 	atom->messages = g_hash_table_new(uuid_hash, uuid_equal);
+	atom->memtag = __ofono_memtag_get(modem, OFONO_ATOM_TYPE_SMS);
 })
 
 static void mw_watch(struct ofono_atom *atom,
@@ -1806,6 +2331,7 @@ static void sms_load_settings(struct ofono_sms *sms, const char *imsi)
 		return;
 
 	sms->imsi = l_strdup(imsi);
+	sms->txq_backup = sms_tx_backup_open(imsi);
 
 	error = NULL;
 	sms->ref = g_key_file_get_integer(sms->settings, SETTINGS_GROUP,
@@ -1853,66 +2379,123 @@ static void sms_load_settings(struct ofono_sms *sms, const char *imsi)
 	}
 }
 
+static void sms_load_tx_window(struct ofono_sms *sms)
+{
+	unsigned int window;
+
+	if (!(sms->driver->flags & OFONO_SMS_DRIVER_FLAG_PIPELINE_SUBMIT))
+		return;
+
+	if (!l_settings_get_uint(__ofono_get_config(), "SMS", "TxWindow",
+					&window))
+		window = TXQ_DEFAULT_WINDOW;
+
+	if (window < 1)
+		window = 1;
+	else if (window > TXQ_MAX_WINDOW)
+		window = TXQ_MAX_WINDOW;
+
+	sms->tx_window = window;
+
+	DBG("tx window %u", sms->tx_window);
+}
+
 static void bearer_init_callback(const struct ofono_error *error, void *data)
 {
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
 		ofono_error("Error bootstrapping SMS Bearer Preference");
 }
 
-static void sms_restore_tx_queue(struct ofono_sms *sms)
+static void sms_restore_tx_entry(struct ofono_sms *sms,
+					struct txq_backup_entry *backup_entry)
 {
-	GQueue *backupq;
-	struct txq_backup_entry *backup_entry;
-
-	DBG("");
+	struct message *m;
+	struct tx_queue_entry *txq_entry;
 
-	backupq = sms_tx_queue_load(sms->imsi);
+	/* The id given by sms_tx_queue_load, which keys its backup */
+	unsigned long id = sms->restore_id++;
 
-	if (backupq == NULL)
+	backup_entry->flags |= OFONO_SMS_SUBMIT_FLAG_REUSE_UUID;
+	txq_entry = tx_queue_entry_new(sms, backup_entry->msg_list,
+						backup_entry->flags);
+	if (txq_entry == NULL)
 		return;
 
-	while ((backup_entry = g_queue_pop_head(backupq))) {
-		struct message *m;
-		struct tx_queue_entry *txq_entry;
+	txq_entry->flags &= ~OFONO_SMS_SUBMIT_FLAG_REUSE_UUID;
+	memcpy(&txq_entry->uuid.uuid, &backup_entry->uuid, SMS_MSGID_LEN);
 
-		backup_entry->flags |= OFONO_SMS_SUBMIT_FLAG_REUSE_UUID;
-		txq_entry = tx_queue_entry_new(backup_entry->msg_list,
-							backup_entry->flags);
-		if (txq_entry == NULL)
-			goto loop_out;
+	m = message_create(&txq_entry->uuid, sms->atom);
+	if (m == NULL) {
+		tx_queue_entry_destroy(txq_entry);
+		return;
+	}
 
-		txq_entry->flags &= ~OFONO_SMS_SUBMIT_FLAG_REUSE_UUID;
-		memcpy(&txq_entry->uuid.uuid, &backup_entry->uuid,
-								SMS_MSGID_LEN);
+	if (message_dbus_register(m) == FALSE) {
+		tx_queue_entry_destroy(txq_entry);
+		return;
+	}
 
-		m = message_create(&txq_entry->uuid, sms->atom);
-		if (m == NULL) {
-			tx_queue_entry_destroy(txq_entry);
+	message_set_data(m, txq_entry);
+	g_hash_table_insert(sms->messages, &txq_entry->uuid, m);
 
-			goto loop_out;
-		}
+	txq_entry->id = id;
+	tx_queue_insert(sms, txq_entry);
 
-		if (message_dbus_register(m) == FALSE) {
-			tx_queue_entry_destroy(txq_entry);
+	/* The interface is already up, announce it like a new message */
+	message_emit_added(m, OFONO_MESSAGE_MANAGER_INTERFACE);
+}
 
-			goto loop_out;
-		}
+static gboolean sms_restore_idle(gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	struct txq_backup_entry *backup_entry;
+	unsigned int i;
 
-		message_set_data(m, txq_entry);
-		g_hash_table_insert(sms->messages, &txq_entry->uuid, m);
+	/* Unless an incoming message needed them first */
+	sms_restore_assemblies(sms);
 
-		txq_entry->id = sms->tx_counter++;
-		g_queue_push_tail(sms->txq, txq_entry);
+	for (i = 0; i < TXQ_RESTORE_CHUNK; i++) {
+		backup_entry = g_queue_pop_head(sms->restore_queue);
+		if (backup_entry == NULL)
+			break;
 
-loop_out:
-		g_slist_free_full(backup_entry->msg_list, g_free);
-		g_free(backup_entry);
+		sms_restore_tx_entry(sms, backup_entry);
+		txq_backup_entry_free(backup_entry);
 	}
 
-	if (g_queue_get_length(sms->txq) > 0)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	if (!g_queue_is_empty(sms->restore_queue))
+		return TRUE;
 
-	g_queue_free(backupq);
+	g_queue_free(sms->restore_queue);
+	sms->restore_queue = NULL;
+	sms->restore_source = 0;
+
+	DBG("restored, %u messages pending", g_queue_get_length(sms->txq));
+
+	tx_schedule(sms);
+
+	return FALSE;
+}
+
+/*
+ * Only the tx backup is read here, reserving the ids of the messages it
+ * holds so that new ones cannot take them.  The assemblies are read and
+ * the messages queued again from an idle source, a few at a time, and
+ * nothing is sent until then.
+ */
+static void sms_restore_start(struct ofono_sms *sms)
+{
+	sms->restore_queue = sms_tx_queue_load(sms->txq_backup);
+	if (sms->restore_queue == NULL)
+		sms->restore_queue = g_queue_new();
+
+	sms->restore_id = sms->tx_counter;
+	sms->tx_counter += g_queue_get_length(sms->restore_queue);
+
+	DBG("%u messages to restore",
+			g_queue_get_length(sms->restore_queue));
+
+	sms->restore_source = g_idle_add(sms_restore_idle, sms);
 }
 
 /*
@@ -1949,6 +2532,12 @@ void ofono_sms_register(struct ofono_sms *sms)
 					OFONO_ATOM_TYPE_NETREG,
 					netreg_watch, sms, NULL);
 
+	sms->ims_watch = __ofono_modem_add_atom_watch(modem,
+					OFONO_ATOM_TYPE_IMS,
+					ims_watch, sms, NULL);
+
+	sms_load_tx_window(sms);
+
 	sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
 
 	/*
@@ -1960,9 +2549,8 @@ void ofono_sms_register(struct ofono_sms *sms)
 		const char *imsi;
 
 		imsi = ofono_sim_get_imsi(sim);
-		sms->assembly = sms_assembly_new(imsi);
-
-		sms->sr_assembly = status_report_assembly_new(imsi);
+		sms->assembly = sms_assembly_new_deferred(imsi);
+		sms->sr_assembly = status_report_assembly_new_deferred(imsi);
 
 		sms_load_settings(sms, imsi);
 	} else {
@@ -1971,16 +2559,21 @@ void ofono_sms_register(struct ofono_sms *sms)
 		sms->bearer = 3; /* Default to CS then PS */
 	}
 
+	sms_assembly_charge(sms);
+
 	if (sms->driver->bearer_set)
 		sms->driver->bearer_set(sms, sms->bearer,
 						bearer_init_callback, sms);
 
-	sms_restore_tx_queue(sms);
-
 	sms->text_handlers = __ofono_watchlist_new(g_free);
 	sms->datagram_handlers = __ofono_watchlist_new(g_free);
+	sms->datagram_ports = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						(GDestroyNotify) g_slist_free);
 
 	__ofono_atom_register(sms->atom, sms_unregister);
+
+	sms_restore_start(sms);
 }
 
 void ofono_sms_remove(struct ofono_sms *sms)
@@ -2003,17 +2596,17 @@ unsigned short __ofono_sms_get_next_ref(struct ofono_sms *sms)
 	return sms->ref;
 }
 
-int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
-				unsigned int flags,
-				struct ofono_uuid *uuid,
-				ofono_sms_txq_queued_cb_t cb, void *data)
+static struct tx_queue_entry *sms_txq_queue(struct ofono_sms *sms,
+						GSList *list,
+						unsigned int flags,
+						struct message **out_m)
 {
 	struct message *m = NULL;
 	struct tx_queue_entry *entry;
 
-	entry = tx_queue_entry_new(list, flags);
+	entry = tx_queue_entry_new(sms, list, flags);
 	if (entry == NULL)
-		return -ENOMEM;
+		return NULL;
 
 	if (flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS) {
 		m = message_create(&entry->uuid, sms->atom);
@@ -2037,30 +2630,58 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 
 	entry->id = sms->tx_counter++;
 
-	g_queue_push_tail(sms->txq, entry);
+	tx_queue_insert(sms, entry);
+	tx_schedule(sms);
 
-	if (sms->registered && g_queue_get_length(sms->txq) == 1)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	*out_m = m;
 
-	if (uuid)
-		memcpy(uuid, &entry->uuid, sizeof(*uuid));
+	return entry;
 
-	if (flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS) {
-		const char *uuid_str;
-		unsigned char i;
+err:
+	tx_queue_entry_destroy(entry);
 
-		uuid_str = ofono_uuid_to_str(&entry->uuid);
+	return NULL;
+}
 
-		for (i = 0; i < entry->num_pdus; i++) {
-			struct pending_pdu *pdu;
+static void sms_txq_backup_store(struct ofono_sms *sms,
+					struct tx_queue_entry *entry)
+{
+	const char *uuid_str;
+	unsigned char i;
 
-			pdu = &entry->pdus[i];
+	if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS))
+		return;
 
-			sms_tx_backup_store(sms->imsi, entry->id, entry->flags,
-						uuid_str, i, pdu->pdu,
-						pdu->pdu_len, pdu->tpdu_len);
-		}
+	uuid_str = ofono_uuid_to_str(&entry->uuid);
+
+	for (i = 0; i < entry->num_pdus; i++) {
+		struct pending_pdu *pdu;
+
+		pdu = &entry->pdus[i];
+
+		sms_tx_backup_store(sms->txq_backup, entry->id,
+					entry->flags, uuid_str, i,
+					pdu->pdu,
+					pdu->pdu_len, pdu->tpdu_len);
 	}
+}
+
+int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
+				unsigned int flags,
+				struct ofono_uuid *uuid,
+				ofono_sms_txq_queued_cb_t cb, void *data)
+{
+	struct message *m;
+	struct tx_queue_entry *entry;
+
+	entry = sms_txq_queue(sms, list, flags, &m);
+	if (entry == NULL)
+		return -EINVAL;
+
+	if (uuid)
+		memcpy(uuid, &entry->uuid, sizeof(*uuid));
+
+	sms_txq_backup_store(sms, entry);
 
 	if (cb)
 		cb(sms, &entry->uuid, data);
@@ -2069,11 +2690,6 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 		message_emit_added(m, OFONO_MESSAGE_MANAGER_INTERFACE);
 
 	return 0;
-
-err:
-	tx_queue_entry_destroy(entry);
-
-	return -EINVAL;
 }
 
 int __ofono_sms_txq_set_submit_notify(struct ofono_sms *sms,
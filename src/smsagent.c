@@ -9,9 +9,13 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <glib.h>
 #include <gdbus.h>
@@ -21,6 +25,12 @@
 #include "common.h"
 #include "smsagent.h"
 
+/*
+ * Calls beyond the window wait in ofono until a reply comes in, rather
+ * than piling up against the bus daemon's limit on pending replies
+ */
+#define SMS_AGENT_WINDOW_DEFAULT 16
+
 struct sms_agent {
 	char *interface;
 	char *path;
@@ -29,6 +39,9 @@ struct sms_agent {
 	ofono_destroy_func removed_cb;
 	void *removed_data;
 	GSList *reqs;
+	GSList *queued;
+	unsigned int window;
+	ofono_bool_t fd_delivery;
 };
 
 struct sms_agent_request {
@@ -121,6 +134,7 @@ struct sms_agent *sms_agent_new(const char *interface,
 	agent->interface = l_strdup(interface);
 	agent->service = l_strdup(service);
 	agent->path = l_strdup(path);
+	agent->window = SMS_AGENT_WINDOW_DEFAULT;
 
 	agent->disconnect_watch = g_dbus_add_disconnect_watch(conn, service,
 							sms_agent_disconnect_cb,
@@ -129,6 +143,23 @@ struct sms_agent *sms_agent_new(const char *interface,
 	return agent;
 }
 
+ofono_bool_t sms_agent_fd_delivery_supported(void)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	return dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD);
+}
+
+void sms_agent_set_fd_delivery(struct sms_agent *agent)
+{
+	agent->fd_delivery = TRUE;
+}
+
+void sms_agent_set_window(struct sms_agent *agent, unsigned int window)
+{
+	agent->window = window ? window : 1;
+}
+
 void sms_agent_set_removed_notify(struct sms_agent *agent,
 					ofono_destroy_func destroy,
 					void *user_data)
@@ -165,6 +196,9 @@ void sms_agent_free(struct sms_agent *agent)
 	g_slist_foreach(agent->reqs, sms_agent_request_cancel, NULL);
 	g_slist_free(agent->reqs);
 
+	g_slist_free_full(agent->queued,
+				(GDestroyNotify) sms_agent_request_free);
+
 	l_free(agent->path);
 	l_free(agent->service);
 	l_free(agent->interface);
@@ -210,6 +244,39 @@ out:
 	return result;
 }
 
+static void sms_agent_dispatch_reply_cb(DBusPendingCall *call, void *data);
+
+static int sms_agent_request_send(struct sms_agent_request *req)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct sms_agent *agent = req->agent;
+
+	if (!dbus_connection_send_with_reply(conn, req->msg, &req->call, -1)) {
+		ofono_error("Sending D-Bus method failed");
+		return -EIO;
+	}
+
+	agent->reqs = g_slist_append(agent->reqs, req);
+
+	dbus_pending_call_set_notify(req->call, sms_agent_dispatch_reply_cb,
+					req, NULL);
+
+	return 0;
+}
+
+static void sms_agent_send_queued(struct sms_agent *agent)
+{
+	while (agent->queued && g_slist_length(agent->reqs) < agent->window) {
+		struct sms_agent_request *req = agent->queued->data;
+
+		agent->queued = g_slist_delete_link(agent->queued,
+							agent->queued);
+
+		if (sms_agent_request_send(req) < 0)
+			sms_agent_request_free(req);
+	}
+}
+
 static void sms_agent_dispatch_reply_cb(DBusPendingCall *call, void *data)
 {
 	struct sms_agent_request *req = data;
@@ -228,12 +295,51 @@ static void sms_agent_dispatch_reply_cb(DBusPendingCall *call, void *data)
 	agent->reqs = g_slist_remove(agent->reqs, req);
 	sms_agent_request_free(req);
 
+	/* The callback may free the agent */
+	sms_agent_send_queued(agent);
+
 	if (cb)
 		cb(agent, result, dispatch_data);
 
 	dbus_message_unref(reply);
 }
 
+/*
+ * The datagram goes into a sealed memfd, the agent gets a descriptor to
+ * read or map instead of the bytes being marshalled into the message.
+ */
+static int datagram_to_memfd(const unsigned char *content, unsigned int len)
+{
+	unsigned int written = 0;
+	int fd;
+
+	fd = memfd_create("ofono-datagram", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -errno;
+
+	while (written < len) {
+		ssize_t n = write(fd, content + written, len - written);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0) {
+			int err = n < 0 ? -errno : -EIO;
+
+			close(fd);
+			return err;
+		}
+
+		written += n;
+	}
+
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+								F_SEAL_SEAL);
+	lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
+
 int sms_agent_dispatch_datagram(struct sms_agent *agent, const char *method,
 				const char *from,
 				const struct tm *remote_sent_time,
@@ -243,12 +349,12 @@ int sms_agent_dispatch_datagram(struct sms_agent *agent, const char *method,
 				ofono_destroy_func destroy)
 {
 	struct sms_agent_request *req;
-	DBusConnection *conn = ofono_dbus_get_connection();
 	DBusMessageIter iter;
 	DBusMessageIter dict;
 	DBusMessageIter array;
 	char buf[128];
 	const char *str = buf;
+	int err;
 
 	req = sms_agent_request_new(agent, cb, user_data, destroy);
 	if (req == NULL)
@@ -263,12 +369,26 @@ int sms_agent_dispatch_datagram(struct sms_agent *agent, const char *method,
 
 	dbus_message_iter_init_append(req->msg, &iter);
 
-	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+	if (agent->fd_delivery) {
+		int fd = datagram_to_memfd(content, len);
+
+		if (fd < 0) {
+			ofono_error("Creating datagram buffer failed: %s",
+								strerror(-fd));
+			sms_agent_request_free(req);
+			return fd;
+		}
+
+		/* The message holds a duplicate of the descriptor */
+		dbus_message_iter_append_basic(&iter, DBUS_TYPE_UNIX_FD, &fd);
+		close(fd);
+	} else {
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					DBUS_TYPE_BYTE_AS_STRING, &array);
-	dbus_message_iter_append_fixed_array(&array, DBUS_TYPE_BYTE,
-						&content, len);
-	dbus_message_iter_close_container(&iter, &array);
-
+		dbus_message_iter_append_fixed_array(&array, DBUS_TYPE_BYTE,
+							&content, len);
+		dbus_message_iter_close_container(&iter, &array);
+	}
 
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					OFONO_PROPERTIES_ARRAY_SIGNATURE,
@@ -286,16 +406,14 @@ int sms_agent_dispatch_datagram(struct sms_agent *agent, const char *method,
 
 	dbus_message_iter_close_container(&iter, &dict);
 
-	if (!dbus_connection_send_with_reply(conn, req->msg, &req->call, -1)) {
-		ofono_error("Sending D-Bus method failed");
-		sms_agent_request_free(req);
-		return -EIO;
+	if (g_slist_length(agent->reqs) >= agent->window) {
+		agent->queued = g_slist_append(agent->queued, req);
+		return 0;
 	}
 
-	agent->reqs = g_slist_append(agent->reqs, req);
-
-	dbus_pending_call_set_notify(req->call, sms_agent_dispatch_reply_cb,
-					req, NULL);
+	err = sms_agent_request_send(req);
+	if (err < 0)
+		sms_agent_request_free(req);
 
-	return 0;
+	return err;
 }
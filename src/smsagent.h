@@ -20,6 +20,13 @@ typedef void (*sms_agent_dispatch_cb)(struct sms_agent *agent,
 struct sms_agent *sms_agent_new(const char *interface,
 					const char *service, const char *path);
 
+/* Datagrams are then passed as a sealed memfd rather than as bytes */
+ofono_bool_t sms_agent_fd_delivery_supported(void);
+void sms_agent_set_fd_delivery(struct sms_agent *agent);
+
+/* At most window dispatches are outstanding, the rest are queued */
+void sms_agent_set_window(struct sms_agent *agent, unsigned int window);
+
 void sms_agent_set_removed_notify(struct sms_agent *agent,
 					ofono_destroy_func destroy,
 					void *user_data);
@@ -13,9 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -28,16 +26,22 @@
 
 #define uninitialized_var(x) x = x
 
+/*
+ * Each store is a single journal.  The keys are the paths the entries had
+ * under the directory trees used before, which are migrated on load.
+ */
 #define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+#define SMS_BACKUP_JOURNAL SMS_BACKUP_PATH ".journal"
+#define SMS_BACKUP_KEY "%s-%i-%i/%03i"
 
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
-#define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
+#define SMS_SR_BACKUP_JOURNAL SMS_SR_BACKUP_PATH ".journal"
+#define SMS_SR_BACKUP_KEY "%s-%s"
 
 #define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+#define SMS_TX_BACKUP_JOURNAL SMS_TX_BACKUP_PATH ".journal"
+#define SMS_TX_BACKUP_KEY_DIR "%lu-%lu-%s"
+#define SMS_TX_BACKUP_KEY SMS_TX_BACKUP_KEY_DIR "/%03i"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -2091,22 +2095,12 @@ gboolean sms_extract_concatenation(const struct sms *sms, guint16 *ref_num,
 	return TRUE;
 }
 
-gboolean sms_extract_language_variant(const struct sms *sms, guint8 *locking,
-					guint8 *single)
+static void udh_iter_language_variant(struct sms_udh_iter *iter,
+					guint8 *locking, guint8 *single)
 {
-	struct sms_udh_iter iter;
 	enum sms_iei iei;
 	guint8 variant;
 
-	/*
-	 * We must ignore the entire user_data header here:
-	 * If the length of the User Data Header is such that there
-	 * are too few or too many octets in the final Information
-	 * Element then the whole User Data Header shall be ignored.
-	 */
-	if (!sms_udh_iter_init(sms, &iter))
-		return FALSE;
-
 	/*
 	 * According to the specification, we have to use the last
 	 * useable header:
@@ -2116,23 +2110,23 @@ gboolean sms_extract_language_variant(const struct sms *sms, guint8 *locking,
 	 * exclusive meanings (e.g. an 8bit port address and a 16bit
 	 * port address), then the last occurring IE shall be used.
 	 */
-	while ((iei = sms_udh_iter_get_ie_type(&iter)) !=
+	while ((iei = sms_udh_iter_get_ie_type(iter)) !=
 			SMS_IEI_INVALID) {
 		switch (iei) {
 		case SMS_IEI_NATIONAL_LANGUAGE_SINGLE_SHIFT:
-			if (sms_udh_iter_get_ie_length(&iter) != 1)
+			if (sms_udh_iter_get_ie_length(iter) != 1)
 				break;
 
-			sms_udh_iter_get_ie_data(&iter, &variant);
+			sms_udh_iter_get_ie_data(iter, &variant);
 			if (single)
 				*single = variant;
 			break;
 
 		case SMS_IEI_NATIONAL_LANGUAGE_LOCKING_SHIFT:
-			if (sms_udh_iter_get_ie_length(&iter) != 1)
+			if (sms_udh_iter_get_ie_length(iter) != 1)
 				break;
 
-			sms_udh_iter_get_ie_data(&iter, &variant);
+			sms_udh_iter_get_ie_data(iter, &variant);
 			if (locking)
 				*locking = variant;
 			break;
@@ -2140,8 +2134,25 @@ gboolean sms_extract_language_variant(const struct sms *sms, guint8 *locking,
 			break;
 		}
 
-		sms_udh_iter_next(&iter);
+		sms_udh_iter_next(iter);
 	}
+}
+
+gboolean sms_extract_language_variant(const struct sms *sms, guint8 *locking,
+					guint8 *single)
+{
+	struct sms_udh_iter iter;
+
+	/*
+	 * We must ignore the entire user_data header here:
+	 * If the length of the User Data Header is such that there
+	 * are too few or too many octets in the final Information
+	 * Element then the whole User Data Header shall be ignored.
+	 */
+	if (!sms_udh_iter_init(sms, &iter))
+		return FALSE;
+
+	udh_iter_language_variant(&iter, locking, single);
 
 	return TRUE;
 }
@@ -2220,42 +2231,159 @@ static inline int sms_text_capacity_gsm(int max, int offset)
 	return max - (offset * 8 + 6) / 7;
 }
 
+struct sms_text_decoder {
+	struct sms_udh_iter iter;
+	char *buf;
+	size_t size;
+	size_t len;
+	size_t written;
+	guint16 high_surrogate;
+	bool ucs2_done;
+};
+
+static size_t sms_text_decoder_room(struct sms_text_decoder *dec)
+{
+	/* Once something did not fit, nothing after it is written either */
+	if (dec->written != dec->len)
+		return 0;
+
+	return dec->size - dec->written;
+}
+
+static void sms_text_decoder_put(struct sms_text_decoder *dec, wchar_t c)
+{
+	size_t n;
+
+	if (c < 0x80)
+		n = 1;
+	else if (c < 0x800)
+		n = 2;
+	else if (c < 0x10000)
+		n = 3;
+	else
+		n = 4;
+
+	if (n <= sms_text_decoder_room(dec))
+		dec->written += l_utf8_from_wchar(c, dec->buf + dec->written);
+
+	dec->len += n;
+}
+
+static void sms_text_decode_gsm(struct sms_text_decoder *dec,
+				const guint8 *ud, int udl_in_bytes,
+				guint8 udl, guint8 taken,
+				guint8 locking_shift, guint8 single_shift)
+{
+	unsigned char buf[160];
+	long written;
+	long out_written;
+	long converted;
+	int max_chars = sms_text_capacity_gsm(udl, taken);
+	char *out = dec->buf ? dec->buf + dec->written : NULL;
+
+	if (unpack_7bit_own_buf(ud + taken, udl_in_bytes - taken, taken,
+				false, max_chars, &written, 0, buf) == NULL)
+		return;
+
+	/* Take care of improperly split fragments */
+	if (buf[written-1] == 0x1b)
+		written = written - 1;
+
+	/*
+	 * If language is not defined in 3GPP TS 23.038,
+	 * implementations are instructed to ignore it
+	 */
+	if (locking_shift > SMS_ALPHABET_URDU)
+		locking_shift = GSM_DIALECT_DEFAULT;
+
+	if (single_shift > SMS_ALPHABET_URDU)
+		single_shift = GSM_DIALECT_DEFAULT;
+
+	converted = convert_gsm_to_utf8_own_buf(buf, written, &out_written,
+						locking_shift, single_shift,
+						out,
+						sms_text_decoder_room(dec));
+	if (converted < 0)
+		return;
+
+	dec->written += out_written;
+	dec->len += converted;
+}
+
+/*
+ * In theory SMS supports encoding using UCS2 which is 16-bit, however in the
+ * real world messages are encoded in UTF-16 which can be 4 bytes and a
+ * multiple fragment message can split a 4-byte character in the middle.  So
+ * carry a pending high surrogate over to the next fragment.
+ */
+static void sms_text_decode_ucs2(struct sms_text_decoder *dec,
+					const guint8 *from, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < len && !dec->ucs2_done; i += 2) {
+		guint16 in = l_get_be16(from + i);
+		wchar_t c;
+
+		/* The text ends at the first NUL, even across fragments */
+		if (!in) {
+			dec->ucs2_done = true;
+			break;
+		}
+
+		if (in >= 0xdc00 && in < 0xe000) {
+			if (!dec->high_surrogate)
+				continue;
+
+			c = 0x10000 + (dec->high_surrogate - 0xd800) * 0x400 +
+				in - 0xdc00;
+			dec->high_surrogate = 0;
+		} else if (in >= 0xd800 && in < 0xdc00) {
+			dec->high_surrogate = in;
+			continue;
+		} else {
+			dec->high_surrogate = 0;
+			c = in;
+		}
+
+		if ((c >= 0xfdd0 && c <= 0xfdef) || (c & 0xfffe) == 0xfffe)
+			continue;
+
+		sms_text_decoder_put(dec, c);
+	}
+}
+
 /*!
- * Decodes a list of SMSes that contain a text in either 7bit or UCS2 encoding.
- * The list must be sorted in order of the sequence number.  This function
- * assumes that all fragments have a proper DCS.
+ * Decodes a list of SMSes that contain a text in either 7bit or UCS2 encoding
+ * into a caller supplied buffer of size bytes, in a single pass over the
+ * fragments.  The list must be sorted in order of the sequence number.  The
+ * text is truncated on a character boundary if it does not fit, and is always
+ * terminated if size is not 0.
  *
- * Returns a pointer to a newly allocated string or NULL if the conversion
- * failed.
+ * Returns the length of the complete text, not including the terminal '\0'.
+ * Calling this with a NULL buf and a size of 0 queries the size needed.
  */
-char *sms_decode_text(GSList *sms_list)
+size_t sms_decode_text_own_buf(GSList *sms_list, char *buf, size_t size)
 {
+	struct sms_text_decoder dec;
 	GSList *l;
-	struct l_string *str;
-	const struct sms *sms;
-	int guess_size = g_slist_length(sms_list);
-	char *utf8;
-	void *utf16 = NULL;
-	size_t utf16_size = 0;
 
-	if (guess_size == 1)
-		guess_size = 160;
-	else
-		guess_size = (guess_size - 1) * 160;
+	memset(&dec, 0, sizeof(dec));
+	dec.buf = buf;
 
-	str = l_string_new(guess_size);
+	if (buf && size)
+		dec.size = size - 1;
 
 	for (l = sms_list; l; l = l->next) {
+		const struct sms *sms = l->data;
 		guint8 taken = 0;
+		guint8 locking_shift = 0;
+		guint8 single_shift = 0;
 		guint8 dcs;
 		guint8 udl;
 		enum sms_charset charset;
 		int udl_in_bytes;
 		const guint8 *ud;
-		struct sms_udh_iter iter;
-		char *converted;
-
-		sms = l->data;
 
 		ud = sms_extract_common(sms, NULL, &dcs, &udl, NULL);
 
@@ -2266,99 +2394,63 @@ char *sms_decode_text(GSList *sms_list)
 		if (charset == SMS_CHARSET_8BIT)
 			continue;
 
-		if (sms_udh_iter_init(sms, &iter))
-			taken = sms_udh_iter_get_udh_length(&iter) + 1;
+		if (sms_udh_iter_init(sms, &dec.iter)) {
+			taken = sms_udh_iter_get_udh_length(&dec.iter) + 1;
+
+			if (charset == SMS_CHARSET_7BIT)
+				udh_iter_language_variant(&dec.iter,
+								&locking_shift,
+								&single_shift);
+		}
 
 		udl_in_bytes = sms_udl_in_bytes(udl, dcs);
 
 		if (udl_in_bytes == taken)
 			continue;
 
-		if (charset == SMS_CHARSET_7BIT) {
-			unsigned char buf[160];
-			long written;
-			guint8 locking_shift = 0;
-			guint8 single_shift = 0;
-			int max_chars = sms_text_capacity_gsm(udl, taken);
-
-			if (unpack_7bit_own_buf(ud + taken,
-						udl_in_bytes - taken,
-						taken, false, max_chars,
-						&written, 0, buf) == NULL)
-				continue;
-
-			/* Take care of improperly split fragments */
-			if (buf[written-1] == 0x1b)
-				written = written - 1;
-
-			sms_extract_language_variant(sms, &locking_shift,
-								&single_shift);
-
-			/*
-			 * If language is not defined in 3GPP TS 23.038,
-			 * implementations are instructed to ignore it
-			 */
-			if (locking_shift > SMS_ALPHABET_URDU)
-				locking_shift = GSM_DIALECT_DEFAULT;
-
-			if (single_shift > SMS_ALPHABET_URDU)
-				single_shift = GSM_DIALECT_DEFAULT;
-
-			converted = convert_gsm_to_utf8_with_lang(buf, written,
-								NULL, NULL, 0,
-								locking_shift,
-								single_shift);
-			if (converted) {
-				l_string_append(str, converted);
-				l_free(converted);
-			}
-		} else {
-			const guint8 *from = ud + taken;
-			/*
-			 * According to the spec: A UCS2 character shall not be
-			 * split in the middle; if the length of the User Data
-			 * Header is odd, the maximum length of the whole TP-UD
-			 * field is 139 octets
-			 */
-			size_t num_ucs2_chars = (udl_in_bytes - taken) >> 1;
-			num_ucs2_chars = num_ucs2_chars << 1;
-
-			/*
-			 * In theory SMS supports encoding using UCS2 which
-			 * is 16-bit, however in the real world messages
-			 * are encoded in UTF-16 which can be 4 bytes and
-			 * a multiple fragment message can split a 4-byte
-			 * character in the middle. So accumulate the
-			 * entire message before converting to UTF-8.
-			 */
-			utf16 = l_realloc(utf16, utf16_size + num_ucs2_chars);
-			memcpy(utf16 + utf16_size, from, num_ucs2_chars);
-			utf16_size += num_ucs2_chars;
-		}
+		/*
+		 * According to the spec: A UCS2 character shall not be split
+		 * in the middle; if the length of the User Data Header is odd,
+		 * the maximum length of the whole TP-UD field is 139 octets
+		 */
+		if (charset == SMS_CHARSET_7BIT)
+			sms_text_decode_gsm(&dec, ud, udl_in_bytes, udl,
+						taken, locking_shift,
+						single_shift);
+		else
+			sms_text_decode_ucs2(&dec, ud + taken,
+						udl_in_bytes - taken);
 	}
 
-	if (utf16) {
-		char *converted;
-
-		/* Strings are in UTF16-BE, so convert if needed */
-		if (L_CPU_TO_BE16(0x8000) != 0x8000) {
-			size_t i;
-			uint16_t *p = utf16;
+	if (buf && size)
+		buf[dec.written] = '\0';
 
-			for (i = 0; i < utf16_size / 2; i++)
-				p[i] = __builtin_bswap16(p[i]);
-		}
+	return dec.len;
+}
 
-		converted = l_utf8_from_utf16(utf16, utf16_size);
-		if (converted) {
-			l_string_append(str, converted);
-			l_free(converted);
-		}
+/*!
+ * Decodes a list of SMSes that contain a text in either 7bit or UCS2 encoding.
+ * The list must be sorted in order of the sequence number.  This function
+ * assumes that all fragments have a proper DCS.
+ *
+ * Returns a pointer to a newly allocated string or NULL if the conversion
+ * failed.
+ */
+char *sms_decode_text(GSList *sms_list)
+{
+	GSList *l;
+	size_t size = 1;
+	char *utf8;
 
-		l_free(utf16);
-	}
+	/*
+	 * Size the result for the worst case so that the text is decoded in
+	 * a single pass: 160 septets of at most 3 bytes each per fragment
+	 */
+	for (l = sms_list; l; l = l->next)
+		size += 160 * 3;
 
-	utf8 = l_string_unwrap(str);
+	utf8 = l_malloc(size);
+	sms_decode_text_own_buf(sms_list, utf8, size);
 
 	return utf8;
 }
@@ -2420,79 +2512,32 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
-static void sms_assembly_load(struct sms_assembly *assembly,
-				const struct dirent *dir)
+static void sms_assembly_load(const char *key, const void *value,
+				size_t len, time_t mtime, void *user_data)
 {
+	struct sms_assembly *assembly = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	guint16 ref;
 	guint8 max;
 	guint8 seq;
-	char *path;
-	int len;
-	struct stat segment_stat;
-	struct dirent **segments;
-	char *endp;
-	int r;
-	int i;
-	unsigned char buf[177];
+	char endc;
 	struct sms segment;
 
-	if (dir->d_type != DT_DIR)
-		return;
-
 	/* Max of SMS address size is 12 bytes, hex encoded */
-	if (sscanf(dir->d_name, SMS_ADDR_FMT "-%hi-%hhi",
-				straddr, &ref, &max) < 3)
+	if (sscanf(key, SMS_ADDR_FMT "-%hi-%hhi/%hhu%c",
+				straddr, &ref, &max, &seq, &endc) != 4)
 		return;
 
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
 		return;
 
-	path = l_strdup_printf(SMS_BACKUP_PATH "/%s",
-			assembly->imsi, dir->d_name);
-	len = scandir(path, &segments, NULL, versionsort);
-	l_free(path);
-
-	if (len < 0)
+	if (!sms_deserialize(value, &segment, len))
 		return;
 
-	for (i = 0; i < len; i++) {
-		if (segments[i]->d_type != DT_REG)
-			continue;
-
-		seq = strtol(segments[i]->d_name, &endp, 10);
-		if (*endp != '\0')
-			continue;
-
-		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		if (r < 0)
-			continue;
-
-		if (!sms_deserialize(buf, &segment, r))
-			continue;
-
-		path = l_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		r = stat(path, &segment_stat);
-		l_free(path);
-
-		if (r != 0)
-			continue;
-
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
-						segment_stat.st_mtime,
+	/* Errors cannot occur here */
+	sms_assembly_add_fragment_backup(assembly, &segment, mtime,
 						&addr, ref, max, seq, FALSE);
-	}
-
-	for (i = 0; i < len; i++)
-		free(segments[i]);
-
-	free(segments);
 }
 
 static gboolean sms_assembly_store(struct sms_assembly *assembly,
@@ -2502,8 +2547,10 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 	unsigned char buf[177];
 	int len;
 	DECLARE_SMS_ADDR_STR(straddr);
+	char *key;
+	bool r;
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
@@ -2511,87 +2558,133 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 
 	len = sms_serialize(buf, sms);
 
-	if (write_file(buf, len, SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	key = l_strdup_printf(SMS_BACKUP_KEY, straddr, node->ref,
+				node->max_fragments, seq);
+	r = storage_journal_put(assembly->journal, key, buf, len);
+	l_free(key);
 
-	return TRUE;
+	return r;
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
+	char *key;
 	int seq;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
+	for (seq = 0; seq <= node->max_fragments; seq++) {
+		if (node->fragments[seq] == NULL)
+			continue;
 
-		if (node->bitmap[offset] & bit) {
-			path = l_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			l_free(path);
-		}
+		key = l_strdup_printf(SMS_BACKUP_KEY, straddr, node->ref,
+					node->max_fragments, seq);
+		storage_journal_remove(assembly->journal, key);
+		l_free(key);
 	}
+}
 
-	path = l_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	l_free(path);
+static guint sms_assembly_node_hash(gconstpointer v)
+{
+	const struct sms_assembly_node *node = v;
+
+	return g_str_hash(node->addr.address) ^ node->ref;
 }
 
-struct sms_assembly *sms_assembly_new(const char *imsi)
+static gboolean sms_assembly_node_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
+
+	if (a->ref != b->ref)
+		return FALSE;
+
+	if (a->addr.number_type != b->addr.number_type)
+		return FALSE;
+
+	if (a->addr.numbering_plan != b->addr.numbering_plan)
+		return FALSE;
+
+	return strcmp(a->addr.address, b->addr.address) == 0;
+}
+
+static size_t sms_assembly_node_size(const struct sms_assembly_node *node)
+{
+	return sizeof(struct sms_assembly_node) +
+			(node->max_fragments + 1) * sizeof(struct sms *) +
+			node->num_fragments * sizeof(struct sms);
+}
+
+static void sms_assembly_node_free(struct sms_assembly_node *node)
+{
+	int seq;
+
+	for (seq = 0; seq <= node->max_fragments; seq++)
+		g_free(node->fragments[seq]);
+
+	g_free(node);
+}
+
+struct sms_assembly *sms_assembly_new_deferred(const char *imsi)
 {
 	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
-	char *path;
-	struct dirent **entries;
-	int len;
+
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
+	g_queue_init(&ret->expire_queue);
 
 	if (imsi) {
 		ret->imsi = imsi;
+		ret->restore_pending = TRUE;
+	}
+
+	return ret;
+}
 
-		/* Restore state from backup */
+void sms_assembly_restore(struct sms_assembly *assembly)
+{
+	char *path;
+	char *legacy;
 
-		path = l_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		l_free(path);
+	if (!assembly->restore_pending)
+		return;
 
-		if (len < 0)
-			return ret;
+	assembly->restore_pending = FALSE;
 
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
-		}
+	path = l_strdup_printf(SMS_BACKUP_JOURNAL, assembly->imsi);
+	legacy = l_strdup_printf(SMS_BACKUP_PATH, assembly->imsi);
+	assembly->journal = storage_journal_open(path, legacy);
+	l_free(legacy);
+	l_free(path);
 
-		free(entries);
-	}
+	storage_journal_foreach(assembly->journal, sms_assembly_load,
+					assembly);
+}
+
+struct sms_assembly *sms_assembly_new(const char *imsi)
+{
+	struct sms_assembly *ret = sms_assembly_new_deferred(imsi);
+
+	sms_assembly_restore(ret);
 
 	return ret;
 }
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
-
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	GList *link;
 
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-	}
+	while ((link = g_queue_pop_head_link(&assembly->expire_queue)))
+		sms_assembly_node_free(link->data);
 
-	g_slist_free(assembly->assembly_list);
+	g_hash_table_destroy(assembly->assembly_table);
+	storage_journal_close(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2604,40 +2697,60 @@ GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 						ts, addr, ref, max, seq, TRUE);
 }
 
-static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
+GSList *sms_assembly_add_volatile_fragment(struct sms_assembly *assembly,
 					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
-					guint16 ref, guint8 max, guint8 seq,
-					gboolean backup)
+					guint16 ref, guint8 max, guint8 seq)
 {
-	unsigned int offset = seq / 32;
-	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
-	struct sms *newsms;
-	struct sms_assembly_node *node;
-	GSList *completed;
-	unsigned int position;
-	unsigned int i;
-	unsigned int j;
+	return sms_assembly_add_fragment_backup(assembly, sms,
+						ts, addr, ref, max, seq, FALSE);
+}
 
-	prev = NULL;
+/* Keeps the queue sorted by age, fragments normally arrive in time order */
+static void sms_assembly_queue_node(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	GList *l;
 
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
+	for (l = assembly->expire_queue.tail; l; l = l->prev) {
+		struct sms_assembly_node *older = l->data;
 
-		if (node->addr.number_type != addr->number_type)
-			continue;
+		if (older->ts <= node->ts)
+			break;
+	}
 
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
+	node->expire_link.data = node;
+	g_queue_insert_after_link(&assembly->expire_queue, l,
+					&node->expire_link);
+}
 
-		if (strcmp(node->addr.address, addr->address))
-			continue;
+static void sms_assembly_remove_node(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	g_hash_table_remove(assembly->assembly_table, node);
+	g_queue_unlink(&assembly->expire_queue, &node->expire_link);
+}
 
-		if (ref != node->ref)
-			continue;
+static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
+					const struct sms *sms, time_t ts,
+					const struct sms_address *addr,
+					guint16 ref, guint8 max, guint8 seq,
+					gboolean backup)
+{
+	struct sms_assembly_node *node;
+	struct sms_assembly_node key;
+	GSList *completed = NULL;
+	int i;
+
+	/* 23.040 Section 9.2.3.24.1: Such an element is to be ignored */
+	if (seq > max)
+		return NULL;
 
+	memcpy(&key.addr, addr, sizeof(struct sms_address));
+	key.ref = ref;
+
+	node = g_hash_table_lookup(assembly->assembly_table, &key);
+	if (node) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2646,50 +2759,24 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 			return NULL;
 
 		/* Now check if we already have this seq number */
-		if (node->bitmap[offset] & bit)
+		if (node->fragments[seq])
 			return NULL;
-
-		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
-		 */
-		position = 0;
-		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
-
-		goto out;
+	} else {
+		node = g_malloc0(sizeof(struct sms_assembly_node) +
+					(max + 1) * sizeof(struct sms *));
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
+		assembly->size += sms_assembly_node_size(node);
+
+		g_hash_table_add(assembly->assembly_table, node);
+		sms_assembly_queue_node(assembly, node);
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
-
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
-
-out:
-	newsms = g_new(struct sms, 1);
-
-	memcpy(newsms, sms, sizeof(struct sms));
-	node->fragment_list = g_slist_insert(node->fragment_list,
-						newsms, position);
-	node->bitmap[offset] |= bit;
+	node->fragments[seq] = g_memdup2(sms, sizeof(struct sms));
 	node->num_fragments += 1;
+	assembly->size += sizeof(struct sms);
 
 	if (node->num_fragments < node->max_fragments) {
 		if (backup)
@@ -2698,17 +2785,16 @@ out:
 		return NULL;
 	}
 
-	completed = node->fragment_list;
-
 	sms_assembly_backup_free(assembly, node);
+	sms_assembly_remove_node(assembly, node);
+	assembly->size -= sms_assembly_node_size(node);
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+	for (i = max; i >= 0; i--)
+		if (node->fragments[i])
+			completed = g_slist_prepend(completed,
+							node->fragments[i]);
 
 	g_free(node);
-	g_slist_free_1(l);
 	return completed;
 }
 
@@ -2719,35 +2805,16 @@ out:
  */
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
-
-	prev = NULL;
-	cur = assembly->assembly_list;
-
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
+	struct sms_assembly_node *node;
 
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+	while ((node = g_queue_peek_head(&assembly->expire_queue))) {
+		if (node->ts > before)
+			break;
 
 		sms_assembly_backup_free(assembly, node);
-
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
-
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		sms_assembly_remove_node(assembly, node);
+		assembly->size -= sms_assembly_node_size(node);
+		sms_assembly_node_free(node);
 	}
 }
 
@@ -2765,32 +2832,224 @@ static guint sha1_hash(gconstpointer v)
 	return h;
 }
 
-static void sr_assembly_load_backup(GHashTable *assembly_table,
-					const char *imsi,
-					const struct dirent *addr_dir)
+/* Entries not yet in the journal are written out once this many build up */
+#define SR_BACKUP_BATCH 16
+
+struct sr_assembly_entry {
+	struct id_table_node node;	/* Stored in the journal as is */
+	const char *addr;		/* Key in assembly_table */
+	const unsigned char *msgid;	/* Key in the address id_table */
+	GList expire_link;
+	GList dirty_link;
+	bool dirty;
+};
+
+static gboolean sr_assembly_add_fragment_backup(
+				struct status_report_assembly *assembly,
+				const struct id_table_node *node,
+				const struct sms_address *addr,
+				const unsigned char *msgid)
 {
-	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
-	struct id_table_node *node;
+	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char *key;
+	bool r;
+
+	if (assembly->journal == NULL)
+		return FALSE;
+
+	if (sms_address_to_hex_string(addr, straddr) == FALSE)
+		return FALSE;
+
+	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
+		return FALSE;
+
+	key = l_strdup_printf(SMS_SR_BACKUP_KEY, straddr, msgid_str);
+	r = storage_journal_put(assembly->journal, key, node,
+				sizeof(struct id_table_node));
+	l_free(key);
+
+	return r;
+}
+
+static gboolean sr_assembly_remove_fragment_backup(
+				struct status_report_assembly *assembly,
+				const struct sms_address *addr,
+				const unsigned char *sha1)
+{
+	char *key;
+	DECLARE_SMS_ADDR_STR(straddr);
+	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+
+	if (assembly->journal == NULL)
+		return FALSE;
+
+	if (sms_address_to_hex_string(addr, straddr) == FALSE)
+		return FALSE;
+
+	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
+		return FALSE;
+
+	key = l_strdup_printf(SMS_SR_BACKUP_KEY, straddr, msgid_str);
+	storage_journal_remove(assembly->journal, key);
+	l_free(key);
+
+	return TRUE;
+}
+
+/*
+ * Writes out every entry changed since the last sync.  Sent messages are
+ * batched up rather than written one by one, so a crash can lose the
+ * delivery reports of the last few messages sent.
+ */
+void status_report_assembly_sync(struct status_report_assembly *assembly)
+{
+	struct sr_assembly_entry *entry;
+	struct sms_address addr;
+
+	while ((entry = g_queue_pop_head(&assembly->dirty))) {
+		entry->dirty = false;
+
+		__sms_address_from_string(&addr, entry->addr);
+		sr_assembly_add_fragment_backup(assembly, &entry->node, &addr,
+						entry->msgid);
+	}
+}
+
+static void sr_assembly_mark_dirty(struct status_report_assembly *assembly,
+					struct sr_assembly_entry *entry)
+{
+	if (assembly->journal == NULL || entry->dirty)
+		return;
+
+	entry->dirty = true;
+	entry->dirty_link.data = entry;
+	g_queue_push_tail_link(&assembly->dirty, &entry->dirty_link);
+
+	if (g_queue_get_length(&assembly->dirty) >= SR_BACKUP_BATCH)
+		status_report_assembly_sync(assembly);
+}
+
+/* Keeps the queue sorted by expiration, which normally only grows */
+static void sr_assembly_queue_entry(struct status_report_assembly *assembly,
+					struct sr_assembly_entry *entry)
+{
+	GList *l;
+
+	for (l = assembly->expire_queue.tail; l; l = l->prev) {
+		struct sr_assembly_entry *older = l->data;
+
+		if (older->node.expiration <= entry->node.expiration)
+			break;
+	}
+
+	entry->expire_link.data = entry;
+	g_queue_insert_after_link(&assembly->expire_queue, l,
+					&entry->expire_link);
+}
+
+/* Files the entry under each message reference it still waits for */
+static void sr_assembly_index_entry(struct status_report_assembly *assembly,
+					struct sr_assembly_entry *entry)
+{
+	unsigned int mr;
+
+	for (mr = 0; mr < 256; mr++)
+		if (entry->node.mrs[mr / 32] & (1 << (mr % 32)))
+			g_queue_push_tail(&assembly->mr_index[mr], entry);
+}
+
+static void sr_assembly_unindex_entry(struct status_report_assembly *assembly,
+					struct sr_assembly_entry *entry)
+{
+	unsigned int mr;
+
+	for (mr = 0; mr < 256; mr++)
+		if (entry->node.mrs[mr / 32] & (1 << (mr % 32)))
+			g_queue_remove(&assembly->mr_index[mr], entry);
+}
+
+static struct sr_assembly_entry *sr_assembly_insert(
+				struct status_report_assembly *assembly,
+				const char *straddr,
+				const unsigned char *msgid)
+{
+	struct sr_assembly_entry *entry;
 	GHashTable *id_table;
-	int r;
-	char *assembly_table_key;
-	unsigned int *id_table_key;
+	char *addr_key;
+	unsigned char *id_table_key;
+
+	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
+
+	/* Create hashtable keyed by the to address if required */
+	if (id_table == NULL) {
+		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
+								g_free, g_free);
+		addr_key = g_strdup(straddr);
+		g_hash_table_insert(assembly->assembly_table, addr_key,
+					id_table);
+	} else {
+		g_hash_table_lookup_extended(assembly->assembly_table,
+						straddr, (gpointer *) &addr_key,
+						NULL);
+	}
+
+	id_table_key = g_memdup2(msgid, SMS_MSGID_LEN);
+
+	entry = g_new0(struct sr_assembly_entry, 1);
+	entry->addr = addr_key;
+	entry->msgid = id_table_key;
+
+	g_hash_table_insert(id_table, id_table_key, entry);
+
+	return entry;
+}
+
+static void sr_assembly_remove(struct status_report_assembly *assembly,
+				struct sr_assembly_entry *entry)
+{
+	const char *straddr = entry->addr;
+	GHashTable *id_table;
+	struct sms_address addr;
+
+	sr_assembly_unindex_entry(assembly, entry);
+	g_queue_unlink(&assembly->expire_queue, &entry->expire_link);
+
+	if (entry->dirty)
+		g_queue_unlink(&assembly->dirty, &entry->dirty_link);
+
+	__sms_address_from_string(&addr, straddr);
+	sr_assembly_remove_fragment_backup(assembly, &addr, entry->msgid);
+
+	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
+
+	/* Frees the entry and its message id */
+	g_hash_table_remove(id_table, entry->msgid);
+
+	if (g_hash_table_size(id_table) == 0)
+		g_hash_table_remove(assembly->assembly_table, straddr);
+}
+
+static void sr_assembly_load_backup(const char *key, const void *value,
+					size_t len, time_t mtime,
+					void *user_data)
+{
+	struct status_report_assembly *assembly = user_data;
+	struct sms_address addr;
+	DECLARE_SMS_ADDR_STR(straddr);
+	struct sr_assembly_entry *entry;
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 	unsigned char msgid[SMS_MSGID_LEN];
 	char endc;
 
-	if (addr_dir->d_type != DT_REG)
-		return;
-
 	/*
 	 * All SMS-messages under the same IMSI-code are
-	 * included in the same directory.
-	 * So, SMS-address and message ID are included in the same file name
+	 * included in the same journal.
+	 * So, SMS-address and message ID are included in the same key
 	 * Max of SMS address size is 12 bytes, hex encoded
 	 * Max of SMS SHA1 hash is 20 bytes, hex encoded
 	 */
-	if (sscanf(addr_dir->d_name, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
+	if (sscanf(key, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
 				straddr, msgid_str, &endc) != 2)
 		return;
 
@@ -2804,131 +3063,82 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 				NULL, 0, msgid) == NULL)
 		return;
 
-	node = g_new0(struct id_table_node, 1);
-
-	r = read_file((unsigned char *) node,
-			sizeof(struct id_table_node),
-			SMS_SR_BACKUP_PATH "/%s",
-			imsi, addr_dir->d_name);
-
-	if (r < 0) {
-		g_free(node);
+	if (len != sizeof(struct id_table_node))
 		return;
-	}
-
-	id_table = g_hash_table_lookup(assembly_table,
-					sms_address_to_string(&addr));
-
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-							g_free, g_free);
-
-		assembly_table_key = g_strdup(sms_address_to_string(&addr));
-		g_hash_table_insert(assembly_table, assembly_table_key,
-					id_table);
-	}
 
-	/* Node ready, create key and add them to the table */
-	id_table_key = g_memdup2(msgid, SMS_MSGID_LEN);
+	entry = sr_assembly_insert(assembly, sms_address_to_string(&addr),
+					msgid);
+	memcpy(&entry->node, value, sizeof(struct id_table_node));
 
-	g_hash_table_insert(id_table, id_table_key, node);
+	sr_assembly_index_entry(assembly, entry);
+	sr_assembly_queue_entry(assembly, entry);
 }
 
-struct status_report_assembly *status_report_assembly_new(const char *imsi)
+struct status_report_assembly *status_report_assembly_new_deferred(
+							const char *imsi)
 {
-	char *path;
-	int len;
-	struct dirent **addresses;
 	struct status_report_assembly *ret =
 				g_new0(struct status_report_assembly, 1);
+	unsigned int mr;
 
 	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
 				g_free, (GDestroyNotify) g_hash_table_destroy);
 
-	if (imsi) {
-		ret->imsi = imsi;
-
-		/* Restore state from backup */
-		path = l_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
-		len = scandir(path, &addresses, NULL, alphasort);
-		l_free(path);
-
-		if (len < 0)
-			return ret;
-
-		/*
-		 * Go through different addresses. Each address can relate to
-		 * 1-n msg_ids.
-		 */
+	for (mr = 0; mr < 256; mr++)
+		g_queue_init(&ret->mr_index[mr]);
 
-		while (len--) {
-			sr_assembly_load_backup(ret->assembly_table, imsi,
-								addresses[len]);
-			g_free(addresses[len]);
-		}
+	g_queue_init(&ret->expire_queue);
+	g_queue_init(&ret->dirty);
 
-		g_free(addresses);
+	if (imsi) {
+		ret->imsi = imsi;
+		ret->restore_pending = TRUE;
 	}
 
 	return ret;
 }
 
-static gboolean sr_assembly_add_fragment_backup(const char *imsi,
-					const struct id_table_node *node,
-					const struct sms_address *addr,
-					const unsigned char *msgid)
+void status_report_assembly_restore(struct status_report_assembly *assembly)
 {
-	int len = sizeof(struct id_table_node);
-	DECLARE_SMS_ADDR_STR(straddr);
-	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char *path;
+	char *legacy;
 
-	if (imsi == NULL)
-		return FALSE;
+	if (!assembly->restore_pending)
+		return;
 
-	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
+	assembly->restore_pending = FALSE;
 
-	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
-		return FALSE;
-
-	/* storagedir/%s/sms_sr/%s-%s */
-	if (write_file((unsigned char *) node, len,
-			SMS_SR_BACKUP_PATH_FILE, imsi,
-			straddr, msgid_str) != len)
-		return FALSE;
+	path = l_strdup_printf(SMS_SR_BACKUP_JOURNAL, assembly->imsi);
+	legacy = l_strdup_printf(SMS_SR_BACKUP_PATH, assembly->imsi);
+	assembly->journal = storage_journal_open(path, legacy);
+	l_free(legacy);
+	l_free(path);
 
-	return TRUE;
+	storage_journal_foreach(assembly->journal, sr_assembly_load_backup,
+					assembly);
 }
 
-static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
-					const struct sms_address *addr,
-					const unsigned char *sha1)
+struct status_report_assembly *status_report_assembly_new(const char *imsi)
 {
-	char *path;
-	DECLARE_SMS_ADDR_STR(straddr);
-	char msgid_str[SMS_MSGID_LEN * 2 + 1];
-
-	if (imsi == NULL)
-		return FALSE;
+	struct status_report_assembly *ret =
+				status_report_assembly_new_deferred(imsi);
 
-	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
+	status_report_assembly_restore(ret);
 
-	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
-		return FALSE;
-
-	path = l_strdup_printf(SMS_SR_BACKUP_PATH_FILE,
-					imsi, straddr, msgid_str);
-	unlink(path);
-	l_free(path);
-
-	return TRUE;
+	return ret;
 }
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
+	unsigned int mr;
+
+	status_report_assembly_sync(assembly);
+
+	for (mr = 0; mr < 256; mr++)
+		g_queue_clear(&assembly->mr_index[mr]);
+
 	g_hash_table_destroy(assembly->assembly_table);
+	storage_journal_close(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2953,86 +3163,64 @@ static gboolean sr_st_to_delivered(enum sms_st st, gboolean *delivered)
 	return FALSE;
 }
 
-static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
-						unsigned char mr,
-						GHashTableIter *out_iter,
-						unsigned char **out_id)
+/*
+ * Some networks can change address to international format, although
+ * address is sent in the national format. Handle also change from national
+ * to international format.  Notify these special cases by comparing only
+ * last six digits of the assembly addresses and received address. If
+ * address contains less than six digits, compare only existing digits.
+ */
+static gboolean sr_fuzzy_address_match(const char *s_addr, const char *r_addr)
 {
-	unsigned int offset = mr / 32;
-	unsigned int bit = 1 << (mr % 32);
-	gpointer key, value;
-	struct id_table_node *node;
+	unsigned int len, r_len, s_len;
+	unsigned int i;
 
-	g_hash_table_iter_init(out_iter, id_table);
-	while (g_hash_table_iter_next(out_iter, &key, &value)) {
-		node = value;
+	if (r_addr[0] == '+' && s_addr[0] == '+')
+		return FALSE;
 
-		/* Address and MR matched */
-		if (node->mrs[offset] & bit) {
-			node->mrs[offset] ^= bit;
-			*out_id = key;
+	if (r_addr[0] != '+' && s_addr[0] != '+')
+		return FALSE;
 
-			return node;
-		}
-	}
+	r_len = strlen(r_addr);
+	s_len = strlen(s_addr);
 
-	return NULL;
+	len = MIN(6, MIN(r_len, s_len));
+
+	for (i = 0; i < len; i++)
+		if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
+			return FALSE;
+
+	return TRUE;
 }
 
 /*
- * Key (receiver address) does not exist in assembly. Some networks can change
- * address to international format, although address is sent in the national
- * format. Handle also change from national to international format.
- * Notify these special cases by comparing only last six digits of the assembly
- * addresses and received address. If address contains less than six digits,
- * compare only existing digits.
+ * Finds the oldest message sent to the address that is still waiting for
+ * a report with this reference, and marks the reference as reported.  If
+ * no message was sent to the address at all, fall back to a fuzzy match.
  */
-static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
-						const struct sms *sr,
-						const char **out_addr,
-						GHashTableIter *out_iter,
-						unsigned char **out_msgid)
-{
-	GHashTableIter iter_addr;
-	gpointer key, value;
-	const char *r_addr;
-
-	r_addr = sms_address_to_string(&sr->status_report.raddr);
-	g_hash_table_iter_init(&iter_addr, assy->assembly_table);
-
-	while (g_hash_table_iter_next(&iter_addr, &key, &value)) {
-		const char *s_addr = key;
-		GHashTable *id_table = value;
-		unsigned int len, r_len, s_len;
-		unsigned int i;
-		struct id_table_node *node;
-
-		if (r_addr[0] == '+' && s_addr[0] == '+')
-			continue;
-
-		if (r_addr[0] != '+' && s_addr[0] != '+')
-			continue;
-
-		r_len = strlen(r_addr);
-		s_len = strlen(s_addr);
+static struct sr_assembly_entry *find_by_mr_and_mark(
+				struct status_report_assembly *assembly,
+				unsigned char mr, const char *r_addr)
+{
+	GQueue *candidates = &assembly->mr_index[mr];
+	gboolean fuzzy;
+	GList *l;
 
-		len = MIN(6, MIN(r_len, s_len));
+	fuzzy = !g_hash_table_contains(assembly->assembly_table, r_addr);
 
-		for (i = 0; i < len; i++)
-			if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
-				break;
+	for (l = candidates->head; l; l = l->next) {
+		struct sr_assembly_entry *entry = l->data;
 
-		/* Not all digits matched. */
-		if (i < len)
+		if (fuzzy) {
+			if (!sr_fuzzy_address_match(entry->addr, r_addr))
+				continue;
+		} else if (strcmp(entry->addr, r_addr))
 			continue;
 
-		/* Address matched. Check message reference. */
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						out_iter, out_msgid);
-		if (node != NULL) {
-			*out_addr = s_addr;
-			return node;
-		}
+		entry->node.mrs[mr / 32] ^= 1 << (mr % 32);
+		g_queue_delete_link(candidates, l);
+
+		return entry;
 	}
 
 	return NULL;
@@ -3044,13 +3232,10 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					gboolean *out_delivered)
 {
 	const char *straddr;
-	GHashTable *id_table;
-	GHashTableIter iter;
-	struct sms_address addr;
+	struct sr_assembly_entry *entry;
 	struct id_table_node *node;
 	gboolean delivered;
 	gboolean pending;
-	unsigned char *msgid;
 	int i;
 
 	/* We ignore temporary or tempfinal status reports */
@@ -3058,23 +3243,20 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		return FALSE;
 
 	straddr = sms_address_to_string(&sr->status_report.raddr);
-	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
-
-	if (id_table != NULL)
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						&iter, &msgid);
-	else
-		node = fuzzy_lookup(assembly, sr, &straddr, &iter, &msgid);
+	entry = find_by_mr_and_mark(assembly, sr->status_report.mr, straddr);
 
 	/* Unable to find a message reference belonging to this address */
-	if (node == NULL)
+	if (entry == NULL)
 		return FALSE;
 
+	node = &entry->node;
 	node->deliverable = node->deliverable && delivered;
 
 	/* If we haven't sent the entire message yet, wait until sent */
-	if (node->sent_mrs < node->total_mrs)
+	if (node->sent_mrs < node->total_mrs) {
+		sr_assembly_mark_dirty(assembly, entry);
 		return FALSE;
+	}
 
 	/* Figure out if we are expecting more status reports */
 	for (i = 0, pending = FALSE; i < 8; i++) {
@@ -3085,15 +3267,12 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		}
 	}
 
-	__sms_address_from_string(&addr, straddr);
-
 	if (pending == TRUE && node->deliverable == TRUE) {
 		/*
 		 * More status reports expected, and already received
-		 * reports completed. Update backup file.
+		 * reports completed. Update backup.
 		 */
-		sr_assembly_add_fragment_backup(assembly->imsi, node,
-						&addr, msgid);
+		sr_assembly_mark_dirty(assembly, entry);
 
 		return FALSE;
 	}
@@ -3102,14 +3281,9 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		*out_delivered = node->deliverable;
 
 	if (out_msgid)
-		memcpy(out_msgid, msgid, SMS_MSGID_LEN);
-
-	sr_assembly_remove_fragment_backup(assembly->imsi, &addr, msgid);
-	id_table = g_hash_table_iter_get_hash_table(&iter);
-	g_hash_table_iter_remove(&iter);
+		memcpy(out_msgid, entry->msgid, SMS_MSGID_LEN);
 
-	if (g_hash_table_size(id_table) == 0)
-		g_hash_table_remove(assembly->assembly_table, straddr);
+	sr_assembly_remove(assembly, entry);
 
 	return TRUE;
 }
@@ -3123,246 +3297,217 @@ void status_report_assembly_add_fragment(
 {
 	unsigned int offset = mr / 32;
 	unsigned int bit = 1 << (mr % 32);
+	const char *straddr = sms_address_to_string(to);
 	GHashTable *id_table;
+	struct sr_assembly_entry *entry = NULL;
 	struct id_table_node *node;
-	unsigned char *id_table_key;
-
-	id_table = g_hash_table_lookup(assembly->assembly_table,
-					sms_address_to_string(to));
 
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-								g_free, g_free);
-		g_hash_table_insert(assembly->assembly_table,
-					g_strdup(sms_address_to_string(to)),
-					id_table);
-	}
-
-	node = g_hash_table_lookup(id_table, msgid);
+	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
+	if (id_table)
+		entry = g_hash_table_lookup(id_table, msgid);
 
 	/* Create node in the message id hashtable if required */
-	if (node == NULL) {
-		id_table_key = g_memdup2(msgid, SMS_MSGID_LEN);
-
-		node = g_new0(struct id_table_node, 1);
-		node->total_mrs = total_mrs;
-		node->deliverable = TRUE;
-
-		g_hash_table_insert(id_table, id_table_key, node);
+	if (entry == NULL) {
+		entry = sr_assembly_insert(assembly, straddr, msgid);
+		entry->node.total_mrs = total_mrs;
+		entry->node.deliverable = TRUE;
+	} else
+		g_queue_unlink(&assembly->expire_queue, &entry->expire_link);
+
+	node = &entry->node;
+
+	if (!(node->mrs[offset] & bit)) {
+		node->mrs[offset] |= bit;
+		g_queue_push_tail(&assembly->mr_index[mr], entry);
 	}
 
-	/* id_table and node both exists */
-	node->mrs[offset] |= bit;
 	node->expiration = expiration;
 	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+
+	sr_assembly_queue_entry(assembly, entry);
+	sr_assembly_mark_dirty(assembly, entry);
 }
 
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before)
 {
-	GHashTable *id_table;
-	GHashTableIter iter_addr, iter_node;
-	struct sms_address addr;
-	char *straddr;
-	gpointer key;
-	struct id_table_node *node;
+	struct sr_assembly_entry *entry;
 
-	g_hash_table_iter_init(&iter_addr, assembly->assembly_table);
-
-	/*
-	 * Go through different addresses. Each address can relate to
-	 * 1-n msg_ids.
-	 */
-	while (g_hash_table_iter_next(&iter_addr, (gpointer) &straddr,
-					(gpointer) &id_table)) {
-		__sms_address_from_string(&addr, straddr);
-		g_hash_table_iter_init(&iter_node, id_table);
-
-		/* Go through different messages. */
-		while (g_hash_table_iter_next(&iter_node, &key,
-						(gpointer) &node)) {
-			/*
-			 * If message is expired, removed it from the
-			 * hash-table and remove the backup-file
-			 */
-			if (node->expiration <= before) {
-				g_hash_table_iter_remove(&iter_node);
-
-				sr_assembly_remove_fragment_backup(
-								assembly->imsi,
-								&addr,
-								key);
-			}
-		}
+	while ((entry = g_queue_peek_head(&assembly->expire_queue))) {
+		if (entry->node.expiration > before)
+			break;
 
-		/*
-		 * If all messages are removed, remove address
-		 * from the hash-table.
-		 */
-		if (g_hash_table_size(id_table) == 0)
-			g_hash_table_iter_remove(&iter_addr);
+		sr_assembly_remove(assembly, entry);
 	}
 }
 
-static int sms_tx_load_filter(const struct dirent *dent)
+struct txq_backup_pdu {
+	unsigned long id;
+	unsigned long flags;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	guint8 seq;
+	size_t len;
+	unsigned char buf[177];
+};
+
+/*
+ * Each message has a key per pdu, order-flags-uuid/pdu.
+ */
+static void sms_tx_load(const char *key, const void *value, size_t len,
+				time_t mtime, void *user_data)
 {
-	char *endp;
-	guint8 seq __attribute__ ((unused));
+	GSList **pdus = user_data;
+	struct txq_backup_pdu pdu;
+	char endc;
 
-	if (dent->d_type != DT_REG)
-		return 0;
+	if (sscanf(key, "%lu-%lu-" SMS_MSGID_FMT "/%hhu%c", &pdu.id,
+				&pdu.flags, pdu.uuid, &pdu.seq, &endc) != 4)
+		return;
 
-	seq = strtol(dent->d_name, &endp, 10);
-	if (*endp != '\0')
-		return 0;
+	if (strlen(pdu.uuid) != 2 * SMS_MSGID_LEN)
+		return;
 
-	return 1;
+	if (len > sizeof(pdu.buf))
+		return;
+
+	memcpy(pdu.buf, value, len);
+	pdu.len = len;
+
+	*pdus = g_slist_prepend(*pdus, g_memdup2(&pdu, sizeof(pdu)));
 }
 
-/*
- * Each directory contains a file per pdu.
- */
-static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
+/* Keys sort as strings, the queue order is numeric */
+static gint sms_tx_pdu_compare(gconstpointer a, gconstpointer b)
 {
-	GSList *list = NULL;
-	struct dirent **pdus;
-	char *path;
-	int len, r;
-	unsigned char buf[177];
-	struct sms s;
+	const struct txq_backup_pdu *pa = a;
+	const struct txq_backup_pdu *pb = b;
 
-	if (dir->d_type != DT_DIR)
-		return NULL;
+	if (pa->id != pb->id)
+		return pa->id < pb->id ? -1 : 1;
 
-	path = l_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
-	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	l_free(path);
-
-	if (len < 0)
-		return NULL;
+	if (pa->flags != pb->flags)
+		return pa->flags < pb->flags ? -1 : 1;
 
-	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
+	if (strcmp(pa->uuid, pb->uuid))
+		return strcmp(pa->uuid, pb->uuid);
 
-		if (r < 0)
-			goto free_pdu;
+	return pa->seq - pb->seq;
+}
 
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
+static gboolean sms_tx_pdu_same_message(const struct txq_backup_pdu *a,
+					const struct txq_backup_pdu *b)
+{
+	return a->id == b->id && a->flags == b->flags &&
+						!strcmp(a->uuid, b->uuid);
+}
 
-		list = g_slist_prepend(list, g_memdup2(&s, sizeof(s)));
+static void sms_tx_backup_renumber(struct storage_journal *backup,
+					const struct txq_backup_pdu *pdu,
+					unsigned long id)
+{
+	char *oldkey;
+	char *newkey;
 
-free_pdu:
-		g_free(pdus[len]);
-	}
+	oldkey = l_strdup_printf(SMS_TX_BACKUP_KEY, pdu->id, pdu->flags,
+					pdu->uuid, pdu->seq);
+	newkey = l_strdup_printf(SMS_TX_BACKUP_KEY, id, pdu->flags,
+					pdu->uuid, pdu->seq);
 
-	g_free(pdus);
+	if (storage_journal_put(backup, newkey, pdu->buf, pdu->len))
+		storage_journal_remove(backup, oldkey);
 
-	return list;
+	l_free(newkey);
+	l_free(oldkey);
 }
 
-static int sms_tx_queue_filter(const struct dirent *dirent)
+struct storage_journal *sms_tx_backup_open(const char *imsi)
 {
-	if (dirent->d_type != DT_DIR)
-		return 0;
+	struct storage_journal *backup;
+	char *path;
+	char *legacy;
 
-	if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
-		return 0;
+	if (imsi == NULL)
+		return NULL;
 
-	return 1;
+	path = l_strdup_printf(SMS_TX_BACKUP_JOURNAL, imsi);
+	legacy = l_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+	backup = storage_journal_open(path, legacy);
+	l_free(legacy);
+	l_free(path);
+
+	return backup;
 }
 
 /*
  * populate the queue with tx_backup_entry from stored backup
  * data.
  */
-GQueue *sms_tx_queue_load(const char *imsi)
+GQueue *sms_tx_queue_load(struct storage_journal *backup)
 {
-	GQueue *retq = 0;
-	char *path;
-	struct dirent **entries;
-	int len;
-	int i;
-	unsigned long id;
+	GQueue *retq;
+	GSList *pdus = NULL;
+	GSList *l;
+	const struct txq_backup_pdu *last = NULL;
+	struct txq_backup_entry *entry = NULL;
+	unsigned long id = 0;
 
-	if (imsi == NULL)
+	if (backup == NULL)
 		return NULL;
 
-	path = l_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
-
-	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
-	if (len < 0)
-		goto nodir_exit;
+	storage_journal_foreach(backup, sms_tx_load, &pdus);
+	pdus = g_slist_sort(pdus, sms_tx_pdu_compare);
 
 	retq = g_queue_new();
 
-	for (i = 0, id = 0; i < len; i++) {
-		char uuid[SMS_MSGID_LEN * 2 + 1];
-		GSList *msg_list;
-		unsigned long oldid;
-		unsigned long flags;
-		char *oldpath, *newpath;
-		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
-		char endc;
-
-		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
-					&oldid, &flags, uuid, &endc) != 3)
-			continue;
+	/* Any renumbering below is written out at once */
+	storage_journal_begin(backup);
 
-		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
+	for (l = pdus; l; l = l->next) {
+		const struct txq_backup_pdu *pdu = l->data;
+		struct sms s;
 
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
+		if (sms_deserialize_outgoing(pdu->buf, &s, pdu->len) == FALSE)
 			continue;
 
-		entry = g_new0(struct txq_backup_entry, 1);
-		entry->msg_list = msg_list;
-		entry->flags = flags;
-		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
+		if (last == NULL || !sms_tx_pdu_same_message(last, pdu)) {
+			if (entry)
+				id++;
 
-		g_queue_push_tail(retq, entry);
+			entry = g_new0(struct txq_backup_entry, 1);
+			entry->flags = pdu->flags;
+			decode_hex_own_buf(pdu->uuid, -1, NULL, 0, entry->uuid);
 
-		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
-			continue;
+			g_queue_push_tail(retq, entry);
 		}
 
-		oldpath = l_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = l_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
+		last = pdu;
+		entry->msg_list = g_slist_append(entry->msg_list,
+						g_memdup2(&s, sizeof(s)));
 
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
-
-		l_free(newpath);
-		l_free(oldpath);
+		/* Re-key the pdu to reflect its new position in queue */
+		if (pdu->id != id)
+			sms_tx_backup_renumber(backup, pdu, id);
 	}
 
-	for (i = 0; i < len; i++)
-		free(entries[i]);
+	storage_journal_commit(backup);
 
-	free(entries);
+	g_slist_free_full(pdus, g_free);
 
-nodir_exit:
-	l_free(path);
 	return retq;
 }
 
-gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
-				guint8 seq, const unsigned char *pdu,
+gboolean sms_tx_backup_store(struct storage_journal *backup,
+				unsigned long id, unsigned long flags,
+				const char *uuid, guint8 seq,
+				const unsigned char *pdu,
 				int pdu_len, int tpdu_len)
 {
 	unsigned char buf[177];
 	int len;
+	char *key;
+	bool r;
 
-	if (!imsi)
+	if (!backup)
 		return FALSE;
 
 	memcpy(buf + 1, pdu, pdu_len);
@@ -3370,61 +3515,40 @@ gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 	len = pdu_len + 1;
 
 	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
+	 * key is: order-flags-uuid/pdu
 	 */
-	if (write_file(buf, len, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
-		return FALSE;
+	key = l_strdup_printf(SMS_TX_BACKUP_KEY, id, flags, uuid, seq);
+	r = storage_journal_put(backup, key, buf, len);
+	l_free(key);
 
-	return TRUE;
+	return r;
 }
 
-void sms_tx_backup_free(const char *imsi, unsigned long id,
+void sms_tx_backup_free(struct storage_journal *backup, unsigned long id,
 				unsigned long flags, const char *uuid)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = l_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
-
-	len = scandir(path, &entries, NULL, versionsort);
-
-	if (len < 0)
-		goto nodir_exit;
+	char *prefix;
 
-	/* skip '..' and '.' entries */
-	while (len-- > 2) {
-		struct dirent *dir = entries[len];
-		char *file = l_strdup_printf("%s/%s", path, dir->d_name);
-
-		unlink(file);
-		l_free(file);
-
-		free(entries[len]);
-	}
-
-	free(entries[1]);
-	free(entries[0]);
-	free(entries);
-
-	rmdir(path);
+	if (!backup)
+		return;
 
-nodir_exit:
-	l_free(path);
+	prefix = l_strdup_printf(SMS_TX_BACKUP_KEY_DIR "/", id, flags, uuid);
+	storage_journal_remove_prefix(backup, prefix);
+	l_free(prefix);
 }
 
-void sms_tx_backup_remove(const char *imsi, unsigned long id,
+void sms_tx_backup_remove(struct storage_journal *backup, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq)
 {
-	char *path;
+	char *key;
 
-	path = l_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
-	l_free(path);
+	if (!backup)
+		return;
+
+	key = l_strdup_printf(SMS_TX_BACKUP_KEY, id, flags, uuid, seq);
+	storage_journal_remove(backup, key);
+	l_free(key);
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -4138,102 +4262,148 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 	return FALSE;
 }
 
-struct cbs_assembly *cbs_assembly_new(void)
+/*
+ * Serials of received messages are remembered without their Update Number,
+ * which is what tells an update apart from a repeat.  The number kept is
+ * bounded, the least recently seen ones are forgotten first.
+ */
+#define CBS_SERIAL_MASK		(~0xfU)
+#define CBS_RECV_MAX		256
+
+struct cbs_recv {
+	guint32 serial;
+	GList link;
+};
+
+static inline guint32 cbs_serial(const struct cbs *cbs)
 {
-	return g_new0(struct cbs_assembly, 1);
+	return (guint32) cbs->message_identifier << 16 | cbs->gs << 14 |
+		cbs->message_code << 4 | cbs->update_number;
 }
 
-void cbs_assembly_free(struct cbs_assembly *assembly)
+static inline unsigned int cbs_serial_gs(guint32 serial)
 {
-	GSList *l;
+	return (serial >> 14) & 0x3;
+}
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct cbs_assembly_node *node = l->data;
+static void cbs_assembly_node_free(gpointer data)
+{
+	struct cbs_assembly_node *node = data;
 
-		g_slist_free_full(node->pages, g_free);
-		g_free(node);
-	}
+	g_slist_free_full(node->pages, g_free);
+	g_free(node);
+}
+
+struct cbs_assembly *cbs_assembly_new(void)
+{
+	struct cbs_assembly *assembly = g_new0(struct cbs_assembly, 1);
 
-	g_slist_free(assembly->assembly_list);
-	g_slist_free(assembly->recv_plmn);
-	g_slist_free(assembly->recv_loc);
-	g_slist_free(assembly->recv_cell);
+	assembly->assembly_table = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						cbs_assembly_node_free);
+	assembly->recv_table = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL, g_free);
+	g_queue_init(&assembly->recv_lru);
+
+	return assembly;
+}
+
+void cbs_assembly_free(struct cbs_assembly *assembly)
+{
+	g_hash_table_destroy(assembly->assembly_table);
+	g_hash_table_destroy(assembly->recv_table);
 
 	g_free(assembly);
 }
 
-static gint cbs_compare_node_by_gs(gconstpointer a, gconstpointer b)
+static void cbs_recv_touch(struct cbs_assembly *assembly,
+				struct cbs_recv *recv)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int gs = GPOINTER_TO_UINT(b);
+	g_queue_unlink(&assembly->recv_lru, &recv->link);
+	g_queue_push_tail_link(&assembly->recv_lru, &recv->link);
+}
 
-	if (((node->serial >> 14) & 0x3) == gs)
-		return 0;
+static void cbs_recv_remove(struct cbs_assembly *assembly,
+				struct cbs_recv *recv)
+{
+	guint32 serial = recv->serial & CBS_SERIAL_MASK;
 
-	return 1;
+	g_queue_unlink(&assembly->recv_lru, &recv->link);
+	g_hash_table_remove(assembly->recv_table, GUINT_TO_POINTER(serial));
 }
 
-static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
+static void cbs_recv_update(struct cbs_assembly *assembly, guint32 serial)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int serial = GPOINTER_TO_UINT(b);
+	gpointer key = GUINT_TO_POINTER(serial & CBS_SERIAL_MASK);
+	struct cbs_recv *recv = g_hash_table_lookup(assembly->recv_table, key);
 
-	if ((serial & (~0xf)) != (node->serial & (~0xf)))
-		return 1;
+	if (recv) {
+		recv->serial = serial;
+		cbs_recv_touch(assembly, recv);
+		return;
+	}
 
-	if (cbs_is_update_newer(node->serial, serial))
-		return 1;
+	if (assembly->recv_lru.length >= CBS_RECV_MAX)
+		cbs_recv_remove(assembly, assembly->recv_lru.head->data);
 
-	return 0;
+	recv = g_new0(struct cbs_recv, 1);
+	recv->serial = serial;
+	recv->link.data = recv;
+
+	g_hash_table_insert(assembly->recv_table, key, recv);
+	g_queue_push_tail_link(&assembly->recv_lru, &recv->link);
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
+static void cbs_recv_forget(struct cbs_assembly *assembly, unsigned int gs)
 {
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
+	GList *l = assembly->recv_lru.head;
 
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
+	while (l) {
+		struct cbs_recv *recv = l->data;
 
-	return 1;
+		l = l->next;
+
+		if (cbs_serial_gs(recv->serial) == gs)
+			cbs_recv_remove(assembly, recv);
+	}
 }
 
-static void cbs_assembly_expire(struct cbs_assembly *assembly,
-				GCompareFunc func, gconstpointer *userdata)
+static gboolean cbs_node_match_gs(gpointer key, gpointer value,
+					gpointer user_data)
 {
-	GSList *l;
-	GSList *prev;
-	GSList *tmp;
+	struct cbs_assembly_node *node = value;
 
-	/*
-	 * Take care of the case where several updates are being
-	 * reassembled at the same time. If the newer one is assembled
-	 * first, then the subsequent old update is discarded, make
-	 * sure that we're also discarding the assembly node for the
-	 * partially assembled ones
-	 */
-	prev = NULL;
-	l = assembly->assembly_list;
+	return cbs_serial_gs(node->serial) == GPOINTER_TO_UINT(user_data);
+}
 
-	while (l) {
-		struct cbs_assembly_node *node = l->data;
+static void cbs_assembly_expire_gs(struct cbs_assembly *assembly,
+					unsigned int gs)
+{
+	cbs_recv_forget(assembly, gs);
+	g_hash_table_foreach_remove(assembly->assembly_table,
+					cbs_node_match_gs,
+					GUINT_TO_POINTER(gs));
+}
 
-		if (func(node, userdata) != 0) {
-			prev = l;
-			l = l->next;
-			continue;
-		}
+/*
+ * Take care of the case where several updates are being reassembled at the
+ * same time. If the newer one is assembled first, then the subsequent old
+ * update is discarded, make sure that we're also discarding the assembly
+ * node for the partially assembled ones
+ */
+static void cbs_assembly_expire_updates(struct cbs_assembly *assembly,
+					guint32 serial)
+{
+	unsigned int update;
 
-		if (prev)
-			prev->next = l->next;
-		else
-			assembly->assembly_list = l->next;
+	for (update = 0; update < 16; update++) {
+		guint32 old = (serial & CBS_SERIAL_MASK) | update;
 
-		g_slist_free_full(node->pages, g_free);
-		g_free(node->pages);
-		tmp = l;
-		l = l->next;
-		g_slist_free_1(tmp);
+		if (cbs_is_update_newer(old, serial))
+			continue;
+
+		g_hash_table_remove(assembly->assembly_table,
+					GUINT_TO_POINTER(old));
 	}
 }
 
@@ -4251,78 +4421,61 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 	 * next cell according to whether the next cell is in the same Service
 	 * Area as the current cell)
 	 *
-	 * NOTE 4: According to 3GPP TS 23.003 [2] a Service Area consists of
+	 * NOTE 4: According to 3GPP TS 23.003 [2] a Service Area consists of
 	 * one cell only.
 	 */
 
 	if (plmn) {
 		lac = TRUE;
-		g_slist_free(assembly->recv_plmn);
-		assembly->recv_plmn = NULL;
-
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_PLMN);
 	}
 
 	if (lac) {
 		/* If LAC changed, then cell id has changed */
 		ci = TRUE;
-		g_slist_free(assembly->recv_loc);
-		assembly->recv_loc = NULL;
-
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_SERVICE_AREA);
 	}
 
 	if (ci) {
-		g_slist_free(assembly->recv_cell);
-		assembly->recv_cell = NULL;
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_NORMAL));
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_CELL_IMMEDIATE);
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_CELL_NORMAL);
 	}
 }
 
+gboolean cbs_assembly_has_page(struct cbs_assembly *assembly,
+				const struct cbs *cbs)
+{
+	struct cbs_assembly_node *node;
+
+	node = g_hash_table_lookup(assembly->assembly_table,
+					GUINT_TO_POINTER(cbs_serial(cbs)));
+
+	return node && (node->bitmap & (1 << cbs->page));
+}
+
 GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 				const struct cbs *cbs)
 {
 	struct cbs *newcbs;
 	struct cbs_assembly_node *node;
+	struct cbs_recv *recv;
 	GSList *completed;
-	unsigned int new_serial;
-	GSList **recv;
-	GSList *l;
-	GSList *prev;
+	guint32 new_serial = cbs_serial(cbs);
 	int position;
 
-	new_serial = cbs->gs << 14;
-	new_serial |= cbs->message_code << 4;
-	new_serial |= cbs->update_number;
-	new_serial |= cbs->message_identifier << 16;
-
-	if (cbs->gs == CBS_GEO_SCOPE_PLMN)
-		recv = &assembly->recv_plmn;
-	else if (cbs->gs == CBS_GEO_SCOPE_SERVICE_AREA)
-		recv = &assembly->recv_loc;
-	else
-		recv = &assembly->recv_cell;
-
 	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
+	recv = g_hash_table_lookup(assembly->recv_table,
+				GUINT_TO_POINTER(new_serial & CBS_SERIAL_MASK));
 
 	/* If we have, is the message newer? */
-	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
+	if (recv && !cbs_is_update_newer(new_serial, recv->serial)) {
+		cbs_recv_touch(assembly, recv);
 		return NULL;
+	}
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
+		cbs_recv_update(assembly, new_serial);
 
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
@@ -4331,58 +4484,36 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		return completed;
 	}
 
-	prev = NULL;
-	position = 0;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		int j;
-		node = l->data;
-
-		if (new_serial != node->serial)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial));
+	if (!node) {
+		node = g_new0(struct cbs_assembly_node, 1);
+		node->serial = new_serial;
 
-		if (node->bitmap & (1 << cbs->page))
-			return NULL;
-
-		for (j = 1; j < cbs->page; j++)
-			if (node->bitmap & (1 << j))
-				position += 1;
-
-		goto out;
-	}
-
-	node = g_new0(struct cbs_assembly_node, 1);
-	node->serial = new_serial;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+		g_hash_table_insert(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial), node);
+	} else if (node->bitmap & (1 << cbs->page))
+		return NULL;
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	/* Pages are kept in order, count the ones received before this one */
+	position = __builtin_popcount(node->bitmap & ((1 << cbs->page) - 1));
 
-out:
 	newcbs = g_new(struct cbs, 1);
 	memcpy(newcbs, cbs, sizeof(struct cbs));
 	node->pages = g_slist_insert(node->pages, newcbs, position);
 	node->bitmap |= 1 << cbs->page;
 
-	if (g_slist_length(node->pages) < cbs->max_pages)
+	if (__builtin_popcount(node->bitmap) < cbs->max_pages)
 		return NULL;
 
 	completed = node->pages;
+	node->pages = NULL;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
-	g_free(node);
-	g_slist_free_1(l);
-
-	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
+	g_hash_table_remove(assembly->assembly_table,
 				GUINT_TO_POINTER(new_serial));
-	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
+
+	cbs_assembly_expire_updates(assembly, new_serial);
+	cbs_recv_update(assembly, new_serial);
 
 	return completed;
 }
@@ -4627,6 +4758,23 @@ gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 					cbs_topic_compare) != NULL;
 }
 
+/*
+ * Sets the bits of all topics covered by ranges in a bitmap of
+ * CBS_TOPIC_BITMAP_SIZE bytes, leaving the other bits untouched
+ */
+void cbs_topic_bitmap_add_ranges(unsigned char *bitmap, GSList *ranges)
+{
+	GSList *l;
+
+	for (l = ranges; l; l = l->next) {
+		const struct cbs_topic_range *range = l->data;
+		unsigned int topic;
+
+		for (topic = range->min; topic <= range->max; topic++)
+			bitmap[topic >> 3] |= 1 << (topic & 0x7);
+	}
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data)
 {
 	gboolean udhi;
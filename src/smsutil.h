@@ -6,6 +6,7 @@
  */
 
 enum cbs_language;
+struct storage_journal;
 
 #define CBS_MAX_GSM_CHARS 93
 #define SMS_MSGID_LEN 20
@@ -339,16 +340,20 @@ struct sms_udh_iter {
 struct sms_assembly_node {
 	struct sms_address addr;
 	time_t ts;
-	GSList *fragment_list;
+	GList expire_link;
 	guint16 ref;
 	guint8 max_fragments;
 	guint8 num_fragments;
-	unsigned int bitmap[8];
+	struct sms *fragments[];	/* Indexed by sequence number */
 };
 
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	gboolean restore_pending;	/* Backup not read in yet */
+	struct storage_journal *journal;
+	GHashTable *assembly_table;	/* Nodes keyed by address and ref */
+	GQueue expire_queue;		/* Nodes, oldest first */
+	size_t size;			/* Bytes held by the nodes */
 };
 
 struct id_table_node {
@@ -361,7 +366,12 @@ struct id_table_node {
 
 struct status_report_assembly {
 	const char *imsi;
-	GHashTable *assembly_table;
+	gboolean restore_pending;	/* Backup not read in yet */
+	struct storage_journal *journal;
+	GHashTable *assembly_table;	/* Address, then message id */
+	GQueue mr_index[256];		/* Messages awaiting each reference */
+	GQueue expire_queue;		/* Messages, oldest first */
+	GQueue dirty;			/* Messages changed since last sync */
 };
 
 struct cbs {
@@ -383,10 +393,9 @@ struct cbs_assembly_node {
 };
 
 struct cbs_assembly {
-	GSList *assembly_list;
-	GSList *recv_plmn;
-	GSList *recv_loc;
-	GSList *recv_cell;
+	GHashTable *assembly_table;	/* serial -> cbs_assembly_node */
+	GHashTable *recv_table;		/* serial without update number */
+	GQueue recv_lru;		/* oldest received serial first */
 };
 
 struct cbs_topic_range {
@@ -485,17 +494,32 @@ gboolean sms_extract_language_variant(const struct sms *sms, guint8 *locking,
 
 unsigned char *sms_decode_datagram(GSList *sms_list, long *out_len);
 char *sms_decode_text(GSList *sms_list);
+size_t sms_decode_text_own_buf(GSList *sms_list, char *buf, size_t size);
 
 struct sms_assembly *sms_assembly_new(const char *imsi);
+/*
+ * Leaves reading the backup to sms_assembly_restore, which must be called
+ * before the assembly is first used.
+ */
+struct sms_assembly *sms_assembly_new_deferred(const char *imsi);
+void sms_assembly_restore(struct sms_assembly *assembly);
 void sms_assembly_free(struct sms_assembly *assembly);
 GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq);
+/* Fragments of messages that must not be stored, not backed up to disk */
+GSList *sms_assembly_add_volatile_fragment(struct sms_assembly *assembly,
+					const struct sms *sms, time_t ts,
+					const struct sms_address *addr,
+					guint16 ref, guint8 max, guint8 seq);
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before);
 gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr);
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi);
+struct status_report_assembly *status_report_assembly_new_deferred(
+							const char *imsi);
+void status_report_assembly_restore(struct status_report_assembly *assembly);
 void status_report_assembly_free(struct status_report_assembly *assembly);
 gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					const struct sms *status_report,
@@ -508,17 +532,20 @@ void status_report_assembly_add_fragment(struct status_report_assembly
 					unsigned char total_mrs);
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before);
+void status_report_assembly_sync(struct status_report_assembly *assembly);
 
-gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
-				guint8 seq, const unsigned char *pdu,
+struct storage_journal *sms_tx_backup_open(const char *imsi);
+gboolean sms_tx_backup_store(struct storage_journal *backup,
+				unsigned long id, unsigned long flags,
+				const char *uuid, guint8 seq,
+				const unsigned char *pdu,
 				int pdu_len, int tpdu_len);
-void sms_tx_backup_remove(const char *imsi, unsigned long id,
+void sms_tx_backup_remove(struct storage_journal *backup, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq);
-void sms_tx_backup_free(const char *imsi, unsigned long id,
+void sms_tx_backup_free(struct storage_journal *backup, unsigned long id,
 				unsigned long flags, const char *uuid);
-GQueue *sms_tx_queue_load(const char *imsi);
+GQueue *sms_tx_queue_load(struct storage_journal *backup);
 
 GSList *sms_text_prepare(const char *to, const char *utf8, guint16 ref,
 				gboolean use_16bit,
@@ -549,6 +576,9 @@ char *cbs_decode_text(GSList *cbs_list, char *iso639_lang);
 
 struct cbs_assembly *cbs_assembly_new(void);
 void cbs_assembly_free(struct cbs_assembly *assembly);
+/* Whether the page is held for a message that is still incomplete */
+gboolean cbs_assembly_has_page(struct cbs_assembly *assembly,
+				const struct cbs *cbs);
 GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 				const struct cbs *cbs);
 void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
@@ -559,5 +589,16 @@ GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
 
+/* One bit for each of the 65536 possible CBS message identifiers */
+#define CBS_TOPIC_BITMAP_SIZE (65536 / 8)
+
+void cbs_topic_bitmap_add_ranges(unsigned char *bitmap, GSList *ranges);
+
+static inline gboolean cbs_topic_bitmap_test(const unsigned char *bitmap,
+						unsigned short topic)
+{
+	return is_bit_set(bitmap[topic >> 3], topic & 0x7);
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data);
 gboolean ussd_encode(const char *str, long *items_written, unsigned char *pdu);
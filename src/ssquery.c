@@ -0,0 +1,176 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "ofono.h"
+
+/*
+ * Supplementary service interrogations of all atoms on a modem go through
+ * one queue.  Only a few run at a time, so that a full refresh does not
+ * flood the modem's command queue ahead of calls or SMS, and a query that
+ * is already queued or running under the same owner and tag is joined
+ * instead of being sent twice.
+ */
+#define SS_QUERY_MAX_RUNNING 2
+
+struct ss_query {
+	void *owner;
+	unsigned int tag;
+	ofono_ss_query_func_t func;
+	void *user_data;
+	bool running;
+};
+
+struct ss_query_queue {
+	struct ofono_modem *modem;
+	struct l_queue *queries;
+	unsigned int running;
+};
+
+static struct l_queue *queues;
+
+static bool queue_match(const void *a, const void *b)
+{
+	const struct ss_query_queue *ssq = a;
+
+	return ssq->modem == b;
+}
+
+static bool query_match(const void *a, const void *b)
+{
+	const struct ss_query *query = a;
+	const struct ss_query *key = b;
+
+	return query->owner == key->owner && query->tag == key->tag;
+}
+
+static bool query_match_owner(const void *a, const void *b)
+{
+	const struct ss_query *query = a;
+
+	return query->owner == b;
+}
+
+static bool query_match_queued(const void *a, const void *b)
+{
+	const struct ss_query *query = a;
+
+	return !query->running;
+}
+
+static void queue_dispatch(struct ss_query_queue *ssq)
+{
+	struct ss_query *query;
+
+	/* The query may complete from within func, which dispatches again */
+	while (ssq->running < SS_QUERY_MAX_RUNNING) {
+		query = l_queue_find(ssq->queries, query_match_queued, NULL);
+		if (query == NULL)
+			break;
+
+		query->running = true;
+		ssq->running += 1;
+
+		query->func(query->user_data);
+	}
+}
+
+bool __ofono_ss_query_submit(struct ofono_modem *modem, void *owner,
+				unsigned int tag, ofono_ss_query_func_t func,
+				void *user_data)
+{
+	struct ss_query key = { .owner = owner, .tag = tag };
+	struct ss_query_queue *ssq;
+	struct ss_query *query;
+
+	if (queues == NULL)
+		queues = l_queue_new();
+
+	ssq = l_queue_find(queues, queue_match, modem);
+	if (ssq == NULL) {
+		ssq = l_new(struct ss_query_queue, 1);
+		ssq->modem = modem;
+		ssq->queries = l_queue_new();
+		l_queue_push_tail(queues, ssq);
+	}
+
+	if (l_queue_find(ssq->queries, query_match, &key)) {
+		DBG("%p joined query %u", owner, tag);
+		return false;
+	}
+
+	query = l_new(struct ss_query, 1);
+	query->owner = owner;
+	query->tag = tag;
+	query->func = func;
+	query->user_data = user_data;
+
+	l_queue_push_tail(ssq->queries, query);
+	queue_dispatch(ssq);
+
+	return true;
+}
+
+void __ofono_ss_query_done(struct ofono_modem *modem, void *owner,
+				unsigned int tag)
+{
+	struct ss_query key = { .owner = owner, .tag = tag };
+	struct ss_query_queue *ssq = l_queue_find(queues, queue_match, modem);
+	struct ss_query *query;
+
+	if (ssq == NULL)
+		return;
+
+	query = l_queue_remove_if(ssq->queries, query_match, &key);
+	if (query == NULL)
+		return;
+
+	if (query->running)
+		ssq->running -= 1;
+
+	l_free(query);
+	queue_dispatch(ssq);
+}
+
+void __ofono_ss_query_cancel(struct ofono_modem *modem, void *owner)
+{
+	struct ss_query_queue *ssq = l_queue_find(queues, queue_match, modem);
+	struct ss_query *query;
+
+	if (ssq == NULL)
+		return;
+
+	/*
+	 * Queries still running belong to a driver that is going away along
+	 * with the owner, their callbacks never come and the slots are freed
+	 */
+	while ((query = l_queue_remove_if(ssq->queries, query_match_owner,
+								owner))) {
+		if (query->running)
+			ssq->running -= 1;
+
+		l_free(query);
+	}
+
+	if (!l_queue_isempty(ssq->queries)) {
+		queue_dispatch(ssq);
+		return;
+	}
+
+	l_queue_remove(queues, ssq);
+	l_queue_destroy(ssq->queries, NULL);
+	l_free(ssq);
+
+	if (l_queue_isempty(queues)) {
+		l_queue_destroy(queues, NULL);
+		queues = NULL;
+	}
+}
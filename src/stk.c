@@ -35,6 +35,16 @@ struct stk_timer {
 	time_t start;
 };
 
+struct envelope_stats {
+	unsigned int sent;
+	unsigned int failed;
+	unsigned int coalesced;
+	unsigned int depth_max;
+	uint64_t latency_total;		/* milliseconds, queued to answered */
+	unsigned int latency_max;
+	unsigned int latency_last;
+};
+
 struct ofono_stk {
 	const struct ofono_stk_driver *driver;
 	void *driver_data;
@@ -42,6 +52,7 @@ struct ofono_stk {
 	struct stk_command *pending_cmd;
 	void (*cancel_cmd)(struct ofono_stk *stk);
 	GQueue *envelope_q;
+	struct envelope_stats envelope_stats;
 	DBusMessage *pending;
 
 	struct stk_timer timers[8];
@@ -66,10 +77,24 @@ struct ofono_stk {
 	void *sms_pp_userdata;
 };
 
+/*
+ * Envelopes the user is waiting for go ahead of data downloads, which in
+ * turn go ahead of event downloads.  The envelope at the head of the queue
+ * is the one being sent and is never overtaken.
+ */
+enum envelope_priority {
+	ENVELOPE_PRIORITY_USER,
+	ENVELOPE_PRIORITY_DOWNLOAD,
+	ENVELOPE_PRIORITY_EVENT,
+};
+
 struct envelope_op {
 	uint8_t tlv[256];
 	unsigned int tlv_len;
 	int retries;
+	enum envelope_priority priority;
+	int event;			/* State event reported, or -1 */
+	uint64_t queued_time;
 	void (*cb)(struct ofono_stk *stk, gboolean ok,
 			const unsigned char *data, int length);
 };
@@ -184,8 +209,21 @@ static void envelope_cb(const struct ofono_error *error, const uint8_t *data,
 		goto out;
 	}
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		stk->envelope_stats.failed += 1;
 		result = FALSE;
+	} else {
+		struct envelope_stats *stats = &stk->envelope_stats;
+		unsigned int latency = l_time_diff(op->queued_time,
+						l_time_now()) / 1000;
+
+		stats->sent += 1;
+		stats->latency_total += latency;
+		stats->latency_last = latency;
+
+		if (latency > stats->latency_max)
+			stats->latency_max = latency;
+	}
 
 	g_queue_pop_head(stk->envelope_q);
 
@@ -208,6 +246,77 @@ static void envelope_queue_run(struct ofono_stk *stk)
 	}
 }
 
+static enum envelope_priority envelope_priority(const struct stk_envelope *e)
+{
+	switch (e->type) {
+	case STK_ENVELOPE_TYPE_MENU_SELECTION:
+	case STK_ENVELOPE_TYPE_CALL_CONTROL:
+	case STK_ENVELOPE_TYPE_MO_SMS_CONTROL:
+		return ENVELOPE_PRIORITY_USER;
+	case STK_ENVELOPE_TYPE_EVENT_DOWNLOAD:
+		return ENVELOPE_PRIORITY_EVENT;
+	default:
+		return ENVELOPE_PRIORITY_DOWNLOAD;
+	}
+}
+
+/* Events reporting a state, of which only the latest one matters */
+static int envelope_event(const struct stk_envelope *e)
+{
+	if (e->type != STK_ENVELOPE_TYPE_EVENT_DOWNLOAD)
+		return -1;
+
+	switch (e->event_download.type) {
+	case STK_EVENT_TYPE_LOCATION_STATUS:
+	case STK_EVENT_TYPE_SINGLE_ACCESS_TECHNOLOGY_CHANGE:
+	case STK_EVENT_TYPE_NETWORK_SEARCH_MODE_CHANGE:
+	case STK_EVENT_TYPE_DISPLAY_PARAMETERS_CHANGED:
+		return e->event_download.type;
+	default:
+		return -1;
+	}
+}
+
+static void envelope_queue_add(struct ofono_stk *stk, struct envelope_op *op)
+{
+	GList *l = stk->envelope_q->head;
+	unsigned int depth;
+
+	/* Skip the envelope being sent */
+	if (l)
+		l = l->next;
+
+	for (; l; l = l->next) {
+		struct envelope_op *queued = l->data;
+
+		if (op->event >= 0 && queued->event == op->event) {
+			DBG("event %02x superseded", op->event);
+			stk->envelope_stats.coalesced += 1;
+
+			l->data = op;
+			op->queued_time = queued->queued_time;
+
+			if (queued->cb)
+				queued->cb(stk, FALSE, NULL, 0);
+
+			g_free(queued);
+			return;
+		}
+
+		if (queued->priority > op->priority)
+			break;
+	}
+
+	if (l)
+		g_queue_insert_before(stk->envelope_q, l, op);
+	else
+		g_queue_push_tail(stk->envelope_q, op);
+
+	depth = g_queue_get_length(stk->envelope_q);
+	if (depth > stk->envelope_stats.depth_max)
+		stk->envelope_stats.depth_max = depth;
+}
+
 static int stk_send_envelope(struct ofono_stk *stk, struct stk_envelope *e,
 				void (*cb)(struct ofono_stk *stk, gboolean ok,
 						const uint8_t *data,
@@ -231,10 +340,13 @@ static int stk_send_envelope(struct ofono_stk *stk, struct stk_envelope *e,
 
 	op->cb = cb;
 	op->retries = retries;
+	op->priority = envelope_priority(e);
+	op->event = envelope_event(e);
+	op->queued_time = l_time_now();
 	memcpy(op->tlv, tlv, tlv_len);
 	op->tlv_len = tlv_len;
 
-	g_queue_push_tail(stk->envelope_q, op);
+	envelope_queue_add(stk, op);
 
 	if (g_queue_get_length(stk->envelope_q) == 1)
 		envelope_queue_run(stk);
@@ -846,6 +958,58 @@ static DBusMessage *stk_select_item(DBusConnection *conn,
 	return NULL;
 }
 
+static DBusMessage *stk_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_stk *stk = data;
+	struct envelope_stats *stats = &stk->envelope_stats;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	uint32_t value;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = stats->sent;
+	ofono_dbus_dict_append(&dict, "Envelopes", DBUS_TYPE_UINT32, &value);
+
+	value = stats->failed;
+	ofono_dbus_dict_append(&dict, "Failures", DBUS_TYPE_UINT32, &value);
+
+	value = stats->coalesced;
+	ofono_dbus_dict_append(&dict, "Superseded", DBUS_TYPE_UINT32, &value);
+
+	value = stats->sent ? stats->latency_total / stats->sent : 0;
+	ofono_dbus_dict_append(&dict, "LatencyAverage",
+					DBUS_TYPE_UINT32, &value);
+
+	value = stats->latency_max;
+	ofono_dbus_dict_append(&dict, "LatencyMaximum",
+					DBUS_TYPE_UINT32, &value);
+
+	value = stats->latency_last;
+	ofono_dbus_dict_append(&dict, "LatencyLast", DBUS_TYPE_UINT32, &value);
+
+	value = g_queue_get_length(stk->envelope_q);
+	ofono_dbus_dict_append(&dict, "Queued", DBUS_TYPE_UINT32, &value);
+
+	value = stats->depth_max;
+	ofono_dbus_dict_append(&dict, "QueuedMaximum",
+					DBUS_TYPE_UINT32, &value);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static const GDBusMethodTable stk_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -859,6 +1023,9 @@ static const GDBusMethodTable stk_methods[] = {
 	{ GDBUS_METHOD("UnregisterAgent",
 			GDBUS_ARGS({ "path", "o" }), NULL,
 			stk_unregister_agent) },
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			stk_get_statistics) },
 	{ }
 };
 
@@ -11,6 +11,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <glib.h>
@@ -27,6 +28,7 @@ enum stk_data_object_flag {
 	DATAOBJ_FLAG_MINIMUM =		2,
 	DATAOBJ_FLAG_CR =		4,
 	DATAOBJ_FLAG_LIST =		8,
+	DATAOBJ_FLAG_SCRATCH =		16,
 };
 
 struct stk_file_iter {
@@ -44,9 +46,108 @@ struct stk_tlv_builder {
 	unsigned int max_len;
 };
 
-typedef bool (*dataobj_handler)(struct comprehension_tlv_iter *, void *);
+typedef bool (*dataobj_handler)(struct comprehension_tlv_iter *, void *,
+					struct stk_arena *);
 typedef bool (*dataobj_writer)(struct stk_tlv_builder *, const void *, bool);
 
+/*
+ * All data parsed out of a proactive command is allocated from an arena
+ * owned by the command, which is released in one go by stk_command_free().
+ * The arena is a chain of blocks; the first block also holds the command
+ * itself, any further blocks are kept most recently allocated first.
+ */
+#define STK_ARENA_BLOCK_SIZE	1024
+#define STK_ARENA_ALIGN		8
+
+struct stk_arena {
+	struct stk_arena *next;
+	size_t size;
+	size_t used;
+	uint8_t data[];
+};
+
+static struct stk_arena *stk_arena_new(size_t size)
+{
+	struct stk_arena *block = l_malloc(sizeof(struct stk_arena) + size);
+
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+
+	return block;
+}
+
+static void stk_arena_free(struct stk_arena *arena)
+{
+	while (arena) {
+		struct stk_arena *next = arena->next;
+
+		l_free(arena);
+		arena = next;
+	}
+}
+
+static void *stk_arena_block_alloc(struct stk_arena *block, size_t size)
+{
+	uintptr_t start = (uintptr_t) (block->data + block->used);
+	size_t pad = -start & (STK_ARENA_ALIGN - 1);
+
+	if (pad + size > block->size - block->used)
+		return NULL;
+
+	block->used += pad + size;
+
+	return (void *) (start + pad);
+}
+
+static void *stk_arena_alloc(struct stk_arena *arena, size_t size)
+{
+	struct stk_arena *block;
+	void *ret;
+
+	ret = stk_arena_block_alloc(arena, size);
+	if (ret)
+		return ret;
+
+	if (arena->next) {
+		ret = stk_arena_block_alloc(arena->next, size);
+		if (ret)
+			return ret;
+	}
+
+	if (size + STK_ARENA_ALIGN > STK_ARENA_BLOCK_SIZE)
+		block = stk_arena_new(size + STK_ARENA_ALIGN);
+	else
+		block = stk_arena_new(STK_ARENA_BLOCK_SIZE);
+
+	block->next = arena->next;
+	arena->next = block;
+
+	return stk_arena_block_alloc(block, size);
+}
+
+static void *stk_arena_alloc0(struct stk_arena *arena, size_t size)
+{
+	return memset(stk_arena_alloc(arena, size), 0, size);
+}
+
+static void *stk_arena_memdup(struct stk_arena *arena, const void *mem,
+				size_t size)
+{
+	return memcpy(stk_arena_alloc(arena, size), mem, size);
+}
+
+static char *stk_arena_strndup(struct stk_arena *arena, const void *str,
+				size_t len)
+{
+	char *ret = stk_arena_alloc(arena, len + 1);
+
+	memcpy(ret, str, len);
+	ret[len] = '\0';
+
+	return ret;
+}
+
 /*
  * Defined in TS 102.223 Section 8.13
  * The type of gsm sms can be SMS-COMMAND AND SMS-SUBMIT. According to 23.040,
@@ -67,9 +168,79 @@ struct gsm_sms_tpdu {
 	if ((text == NULL || text[0] == '\0') && icon_id != 0)	\
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;	\
 
-static char *decode_text(uint8_t dcs, int len, const unsigned char *data)
+static char *stk_arena_utf8_from_gsm(struct stk_arena *arena,
+					const unsigned char *gsm, long len)
+{
+	long utf8_len;
+	char *utf8;
+
+	utf8_len = convert_gsm_to_utf8_own_buf(gsm, len, NULL,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT, NULL, 0);
+	if (utf8_len < 0)
+		return NULL;
+
+	utf8 = stk_arena_alloc(arena, utf8_len + 1);
+	convert_gsm_to_utf8_own_buf(gsm, len, NULL, GSM_DIALECT_DEFAULT,
+					GSM_DIALECT_DEFAULT, utf8, utf8_len);
+	utf8[utf8_len] = '\0';
+
+	return utf8;
+}
+
+/* Same rules as l_utf8_from_ucs2be, a NUL character ends the string */
+static char *stk_arena_utf8_from_ucs2be(struct stk_arena *arena,
+					const unsigned char *ucs2, int len)
+{
+	size_t utf8_len = 0;
+	char *utf8;
+	int i;
+
+	if (len % 2)
+		return NULL;
+
+	utf8 = stk_arena_alloc(arena, len / 2 * 3 + 1);
+
+	for (i = 0; i < len; i += 2) {
+		uint16_t c = l_get_be16(ucs2 + i);
+
+		if (!c)
+			break;
+
+		if (c >= 0xd800 && c < 0xe000)
+			return NULL;
+
+		if ((c >= 0xfdd0 && c <= 0xfdef) || c >= 0xfffe)
+			return NULL;
+
+		utf8_len += l_utf8_from_wchar(c, utf8 + utf8_len);
+	}
+
+	utf8[utf8_len] = '\0';
+
+	return utf8;
+}
+
+/* Decodes an alpha identifier, see sim_string_to_utf8 */
+static char *stk_arena_utf8_from_sim_string(struct stk_arena *arena,
+						const unsigned char *data,
+						int len)
 {
+	long utf8_len = sim_string_to_utf8_own_buf(data, len, NULL, 0);
 	char *utf8;
+
+	if (utf8_len < 0)
+		return NULL;
+
+	utf8 = stk_arena_alloc(arena, utf8_len + 1);
+	sim_string_to_utf8_own_buf(data, len, utf8, utf8_len + 1);
+
+	return utf8;
+}
+
+static char *decode_text(struct stk_arena *arena, uint8_t dcs, int len,
+				const unsigned char *data)
+{
 	enum sms_charset charset;
 
 	if (sms_dcs_decode(dcs, NULL, &charset, NULL, NULL) == FALSE)
@@ -80,28 +251,21 @@ static char *decode_text(uint8_t dcs, int len, const unsigned char *data)
 	{
 		long written;
 		unsigned long max_to_unpack = len * 8 / 7;
-		uint8_t *unpacked = unpack_7bit(data, len, 0, false,
-							max_to_unpack,
-							&written, 0);
-		if (unpacked == NULL)
+		uint8_t *unpacked = stk_arena_alloc(arena, max_to_unpack);
+
+		if (unpack_7bit_own_buf(data, len, 0, false, max_to_unpack,
+					&written, 0, unpacked) == NULL)
 			return NULL;
 
-		utf8 = convert_gsm_to_utf8(unpacked, written,
-						NULL, NULL, 0);
-		l_free(unpacked);
-		break;
+		return stk_arena_utf8_from_gsm(arena, unpacked, written);
 	}
 	case SMS_CHARSET_8BIT:
-		utf8 = convert_gsm_to_utf8(data, len, NULL, NULL, 0);
-		break;
+		return stk_arena_utf8_from_gsm(arena, data, len);
 	case SMS_CHARSET_UCS2:
-		utf8 = l_utf8_from_ucs2be(data, len);
-		break;
+		return stk_arena_utf8_from_ucs2be(arena, data, len);
 	default:
-		utf8 = NULL;
+		return NULL;
 	}
-
-	return utf8;
 }
 
 /* For data object only to indicate its existence */
@@ -133,7 +297,8 @@ static bool parse_dataobj_common_byte(struct comprehension_tlv_iter *iter,
 
 /* For data object that only has text terminated by '\0' */
 static bool parse_dataobj_common_text(struct comprehension_tlv_iter *iter,
-						char **text)
+						char **text,
+						struct stk_arena *arena)
 {
 	const uint8_t *data;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -143,16 +308,15 @@ static bool parse_dataobj_common_text(struct comprehension_tlv_iter *iter,
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	*text = l_malloc(len + 1);
-	memcpy(*text, data, len);
-	(*text)[len] = '\0';
+	*text = stk_arena_strndup(arena, data, len);
 
 	return true;
 }
 
 /* For data object that only has a byte array with undetermined length */
 static bool parse_dataobj_common_byte_array(struct comprehension_tlv_iter *iter,
-					struct stk_common_byte_array *array)
+					struct stk_common_byte_array *array,
+					struct stk_arena *arena)
 {
 	const uint8_t *data;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -163,8 +327,7 @@ static bool parse_dataobj_common_byte_array(struct comprehension_tlv_iter *iter,
 	data = comprehension_tlv_iter_get_data(iter);
 	array->len = len;
 
-	array->array = l_malloc(len);
-	memcpy(array->array, data, len);
+	array->array = stk_arena_memdup(arena, data, len);
 
 	return true;
 }
@@ -251,7 +414,7 @@ static bool stk_file_iter_next(struct stk_file_iter *iter)
 
 /* Defined in TS 102.223 Section 8.1 */
 static bool parse_dataobj_address(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_address *addr = user;
 	const uint8_t *data;
@@ -264,7 +427,7 @@ static bool parse_dataobj_address(struct comprehension_tlv_iter *iter,
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	number = l_malloc(len * 2 - 1);
+	number = stk_arena_alloc(arena, len * 2 - 1);
 	addr->ton_npi = data[0];
 	addr->number = number;
 	sim_extract_bcd_number(data + 1, len - 1, addr->number);
@@ -274,7 +437,7 @@ static bool parse_dataobj_address(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.2 */
 static bool parse_dataobj_alpha_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	char **alpha_id = user;
 	const uint8_t *data;
@@ -288,7 +451,7 @@ static bool parse_dataobj_alpha_id(struct comprehension_tlv_iter *iter,
 	}
 
 	data = comprehension_tlv_iter_get_data(iter);
-	utf8 = sim_string_to_utf8(data, len);
+	utf8 = stk_arena_utf8_from_sim_string(arena, data, len);
 
 	if (utf8 == NULL)
 		return false;
@@ -300,7 +463,8 @@ static bool parse_dataobj_alpha_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.3 */
 static bool parse_dataobj_subaddress(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_subaddress *subaddr = user;
 	const uint8_t *data;
@@ -323,7 +487,8 @@ static bool parse_dataobj_subaddress(struct comprehension_tlv_iter *iter,
 }
 
 /* Defined in TS 102.223 Section 8.4 */
-static bool parse_dataobj_ccp(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_ccp(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	struct stk_ccp *ccp = user;
 	const uint8_t *data;
@@ -345,7 +510,7 @@ static bool parse_dataobj_ccp(struct comprehension_tlv_iter *iter, void *user)
 
 /* Defined in TS 31.111 Section 8.5 */
 static bool parse_dataobj_cbs_page(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_cbs_page *cp = user;
 	const uint8_t *data;
@@ -367,7 +532,7 @@ static bool parse_dataobj_cbs_page(struct comprehension_tlv_iter *iter,
 
 /* Described in TS 102.223 Section 8.8 */
 static bool parse_dataobj_duration(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_duration *duration = user;
 	const uint8_t *data;
@@ -390,7 +555,8 @@ static bool parse_dataobj_duration(struct comprehension_tlv_iter *iter,
 }
 
 /* Defined in TS 102.223 Section 8.9 */
-static bool parse_dataobj_item(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_item(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	struct stk_item *item = user;
 	const uint8_t *data;
@@ -411,7 +577,7 @@ static bool parse_dataobj_item(struct comprehension_tlv_iter *iter, void *user)
 	if (data[0] == 0)
 		return false;
 
-	utf8 = sim_string_to_utf8(data + 1, len - 1);
+	utf8 = stk_arena_utf8_from_sim_string(arena, data + 1, len - 1);
 
 	if (utf8 == NULL)
 		return false;
@@ -424,7 +590,7 @@ static bool parse_dataobj_item(struct comprehension_tlv_iter *iter, void *user)
 
 /* Defined in TS 102.223 Section 8.10 */
 static bool parse_dataobj_item_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	uint8_t *id = user;
 	const uint8_t *data;
@@ -440,7 +606,8 @@ static bool parse_dataobj_item_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.11 */
 static bool parse_dataobj_response_len(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_response_length *response_len = user;
 	const uint8_t *data;
@@ -458,7 +625,7 @@ static bool parse_dataobj_response_len(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.12 */
 static bool parse_dataobj_result(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_result *result = user;
 	const uint8_t *data;
@@ -477,18 +644,18 @@ static bool parse_dataobj_result(struct comprehension_tlv_iter *iter,
 				(data[0] == 0x3c) || (data[0] == 0x3d)))
 		return false;
 
-	additional = l_malloc(len - 1);
+	additional = stk_arena_memdup(arena, data + 1, len - 1);
 	result->type = data[0];
 	result->additional_len = len - 1;
 	result->additional = additional;
-	memcpy(result->additional, data + 1, len - 1);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.13 */
 static bool parse_dataobj_gsm_sms_tpdu(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct gsm_sms_tpdu *tpdu = user;
 	const uint8_t *data;
@@ -507,7 +674,8 @@ static bool parse_dataobj_gsm_sms_tpdu(struct comprehension_tlv_iter *iter,
 }
 
 /* Defined in TS 102.223 Section 8.14 */
-static bool parse_dataobj_ss(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_ss(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	struct stk_ss *ss = user;
 	const uint8_t *data;
@@ -520,7 +688,7 @@ static bool parse_dataobj_ss(struct comprehension_tlv_iter *iter, void *user)
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	s = l_malloc(len * 2 - 1);
+	s = stk_arena_alloc(arena, len * 2 - 1);
 	ss->ton_npi = data[0];
 	ss->ss = s;
 	sim_extract_bcd_number(data + 1, len - 1, ss->ss);
@@ -529,7 +697,8 @@ static bool parse_dataobj_ss(struct comprehension_tlv_iter *iter, void *user)
 }
 
 /* Defined in TS 102.223 Section 8.15 */
-static bool parse_dataobj_text(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_text(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	char **text = user;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -537,13 +706,13 @@ static bool parse_dataobj_text(struct comprehension_tlv_iter *iter, void *user)
 	char *utf8;
 
 	if (len <= 1) {
-		*text = l_new(char, 1);
+		*text = stk_arena_alloc0(arena, 1);
 		return true;
 	}
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	utf8 = decode_text(data[0], len - 1, data + 1);
+	utf8 = decode_text(arena, data[0], len - 1, data + 1);
 
 	if (utf8 == NULL)
 		return false;
@@ -553,14 +722,16 @@ static bool parse_dataobj_text(struct comprehension_tlv_iter *iter, void *user)
 }
 
 /* Defined in TS 102.223 Section 8.16 */
-static bool parse_dataobj_tone(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_tone(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
 }
 
 /* Defined in TS 102.223 Section 8.17 */
-static bool parse_dataobj_ussd(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_ussd(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	struct stk_ussd_string *us = user;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -578,7 +749,7 @@ static bool parse_dataobj_ussd(struct comprehension_tlv_iter *iter, void *user)
 
 /* Defined in TS 102.223 Section 8.18 */
 static bool parse_dataobj_file_list(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct l_queue **out = user;
 	struct l_queue *fl;
@@ -595,6 +766,10 @@ static bool parse_dataobj_file_list(struct comprehension_tlv_iter *iter,
 	stk_file_iter_init(&sf_iter, data + 1, len - 1);
 	fl = l_queue_new();
 
+	/*
+	 * Not allocated from the arena, REFRESH hands the list over to the
+	 * SIM atom which may outlive the command
+	 */
 	while (stk_file_iter_next(&sf_iter)) {
 		sf = l_new(struct stk_file, 1);
 		sf->len = sf_iter.len;
@@ -615,7 +790,8 @@ error:
 
 /* Defined in TS 102.223 Section 8.19 */
 static bool parse_dataobj_location_info(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_location_info *li = user;
 	const uint8_t *data;
@@ -658,7 +834,7 @@ static bool parse_dataobj_location_info(struct comprehension_tlv_iter *iter,
  * "1A 32 54 76 98 10 32 54".
  */
 static bool parse_dataobj_imei(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	char *imei = user;
 	const uint8_t *data;
@@ -683,7 +859,8 @@ static bool parse_dataobj_imei(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.21 */
 static bool parse_dataobj_help_request(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	bool *ret = user;
 	return parse_dataobj_common_bool(iter, ret);
@@ -691,7 +868,8 @@ static bool parse_dataobj_help_request(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.22 */
 static bool parse_dataobj_network_measurement_results(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *nmr = user;
 	const uint8_t *data;
@@ -711,7 +889,8 @@ static bool parse_dataobj_network_measurement_results(
 
 /* Defined in TS 102.223 Section 8.23 */
 static bool parse_dataobj_default_text(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	char **text = user;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -722,7 +901,7 @@ static bool parse_dataobj_default_text(struct comprehension_tlv_iter *iter,
 	if (len <= 1)
 		return false;
 
-	utf8 = decode_text(data[0], len - 1, data + 1);
+	utf8 = decode_text(arena, data[0], len - 1, data + 1);
 
 	if (utf8 == NULL)
 		return false;
@@ -733,7 +912,8 @@ static bool parse_dataobj_default_text(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.24 */
 static bool parse_dataobj_items_next_action_indicator(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_items_next_action_indicator *inai = user;
 	const uint8_t *data;
@@ -751,7 +931,8 @@ static bool parse_dataobj_items_next_action_indicator(
 
 /* Defined in TS 102.223 Section 8.25 */
 static bool parse_dataobj_event_list(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_event_list *el = user;
 	const uint8_t *data;
@@ -772,7 +953,7 @@ static bool parse_dataobj_event_list(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.26 */
 static bool parse_dataobj_cause(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_cause *cause = user;
 	const uint8_t *data;
@@ -795,7 +976,8 @@ static bool parse_dataobj_cause(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.27 */
 static bool parse_dataobj_location_status(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 
@@ -804,7 +986,8 @@ static bool parse_dataobj_location_status(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.28 */
 static bool parse_dataobj_transaction_id(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_transaction_id *ti = user;
 	const uint8_t *data;
@@ -822,7 +1005,8 @@ static bool parse_dataobj_transaction_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 31.111 Section 8.29 */
 static bool parse_dataobj_bcch_channel_list(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_bcch_channel_list *bcl = user;
 	const uint8_t *data;
@@ -851,16 +1035,17 @@ static bool parse_dataobj_bcch_channel_list(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.30 */
 static bool parse_dataobj_call_control_requested_action(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
 
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.31 */
 static bool parse_dataobj_icon_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_icon_id *id = user;
 	const uint8_t *data;
@@ -878,7 +1063,8 @@ static bool parse_dataobj_icon_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.32 */
 static bool parse_dataobj_item_icon_id_list(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_item_icon_id_list *iiil = user;
 	const uint8_t *data;
@@ -897,7 +1083,8 @@ static bool parse_dataobj_item_icon_id_list(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.33 */
 static bool parse_dataobj_card_reader_status(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 
@@ -906,7 +1093,7 @@ static bool parse_dataobj_card_reader_status(
 
 /* Defined in TS 102.223 Section 8.34 */
 static bool parse_dataobj_card_atr(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_card_atr *ca = user;
 	const uint8_t *data;
@@ -924,7 +1111,7 @@ static bool parse_dataobj_card_atr(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.35 */
 static bool parse_dataobj_c_apdu(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_c_apdu *ca = user;
 	const uint8_t *data;
@@ -970,7 +1157,7 @@ static bool parse_dataobj_c_apdu(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.36 */
 static bool parse_dataobj_r_apdu(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_r_apdu *ra = user;
 	const uint8_t *data;
@@ -994,7 +1181,7 @@ static bool parse_dataobj_r_apdu(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.37 */
 static bool parse_dataobj_timer_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 
@@ -1003,7 +1190,8 @@ static bool parse_dataobj_timer_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.38 */
 static bool parse_dataobj_timer_value(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_timer_value *tv = user;
 	const uint8_t *data;
@@ -1022,7 +1210,8 @@ static bool parse_dataobj_timer_value(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.39 */
 static bool parse_dataobj_datetime_timezone(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct sms_scts *scts = user;
 	const uint8_t *data;
@@ -1039,23 +1228,26 @@ static bool parse_dataobj_datetime_timezone(
 
 /* Defined in TS 102.223 Section 8.40 */
 static bool parse_dataobj_at_command(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	char **command = user;
-	return parse_dataobj_common_text(iter, command);
+	return parse_dataobj_common_text(iter, command, arena);
 }
 
 /* Defined in TS 102.223 Section 8.41 */
 static bool parse_dataobj_at_response(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	char **response = user;
-	return parse_dataobj_common_text(iter, response);
+	return parse_dataobj_common_text(iter, response, arena);
 }
 
 /* Defined in TS 102.223 Section 8.42 */
 static bool parse_dataobj_bc_repeat_indicator(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_bc_repeat *bc_repeat = user;
 
@@ -1068,7 +1260,7 @@ static bool parse_dataobj_bc_repeat_indicator(
 
 /* Defined in 102.223 Section 8.43 */
 static bool parse_dataobj_imm_resp(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	bool *ret = user;
 	return parse_dataobj_common_bool(iter, ret);
@@ -1076,7 +1268,8 @@ static bool parse_dataobj_imm_resp(struct comprehension_tlv_iter *iter,
 
 /* Defined in 102.223 Section 8.44 */
 static bool parse_dataobj_dtmf_string(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	char **dtmf = user;
 	const uint8_t *data;
@@ -1087,7 +1280,7 @@ static bool parse_dataobj_dtmf_string(struct comprehension_tlv_iter *iter,
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	*dtmf = l_malloc(len * 2 + 1);
+	*dtmf = stk_arena_alloc(arena, len * 2 + 1);
 	sim_extract_bcd_number(data, len, *dtmf);
 
 	return true;
@@ -1095,7 +1288,7 @@ static bool parse_dataobj_dtmf_string(struct comprehension_tlv_iter *iter,
 
 /* Defined in 102.223 Section 8.45 */
 static bool parse_dataobj_language(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	char *lang = user;
 	const uint8_t *data;
@@ -1120,7 +1313,8 @@ static bool parse_dataobj_language(struct comprehension_tlv_iter *iter,
 
 /* Defined in 31.111 Section 8.46 */
 static bool parse_dataobj_timing_advance(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_timing_advance *ta = user;
 	const uint8_t *data;
@@ -1140,7 +1334,8 @@ static bool parse_dataobj_timing_advance(struct comprehension_tlv_iter *iter,
 
 /* Defined in 102.223 Section 8.47 */
 static bool parse_dataobj_browser_id(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 
@@ -1151,7 +1346,8 @@ static bool parse_dataobj_browser_id(struct comprehension_tlv_iter *iter,
 }
 
 /* Defined in TS 102.223 Section 8.48 */
-static bool parse_dataobj_url(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_url(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	char **url = user;
 	unsigned int len = comprehension_tlv_iter_get_length(iter);
@@ -1161,20 +1357,21 @@ static bool parse_dataobj_url(struct comprehension_tlv_iter *iter, void *user)
 		return true;
 	}
 
-	return parse_dataobj_common_text(iter, url);
+	return parse_dataobj_common_text(iter, url, arena);
 }
 
 /* Defined in TS 102.223 Section 8.49 */
 static bool parse_dataobj_bearer(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.50 */
 static bool parse_dataobj_provisioning_file_reference(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_file *f = user;
 	const uint8_t *data;
@@ -1200,7 +1397,8 @@ static bool parse_dataobj_provisioning_file_reference(
 
 /* Defined in 102.223 Section 8.51 */
 static bool parse_dataobj_browser_termination_cause(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1208,7 +1406,8 @@ static bool parse_dataobj_browser_termination_cause(
 
 /* Defined in TS 102.223 Section 8.52 */
 static bool parse_dataobj_bearer_description(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_bearer_description *bd = user;
 	const uint8_t *data;
@@ -1239,15 +1438,17 @@ static bool parse_dataobj_bearer_description(
 
 /* Defined in TS 102.223 Section 8.53 */
 static bool parse_dataobj_channel_data(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.54 */
 static bool parse_dataobj_channel_data_length(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1255,7 +1456,8 @@ static bool parse_dataobj_channel_data_length(
 
 /* Defined in TS 102.223 Section 8.55 */
 static bool parse_dataobj_buffer_size(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	uint16_t *size = user;
 	const uint8_t *data;
@@ -1271,7 +1473,8 @@ static bool parse_dataobj_buffer_size(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.56 */
 static bool parse_dataobj_channel_status(
-			struct comprehension_tlv_iter *iter, void *user)
+			struct comprehension_tlv_iter *iter, void *user,
+			struct stk_arena *arena)
 {
 	uint8_t *status = user;
 	const uint8_t *data;
@@ -1289,7 +1492,8 @@ static bool parse_dataobj_channel_status(
 
 /* Defined in TS 102.223 Section 8.57 */
 static bool parse_dataobj_card_reader_id(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_card_reader_id *cr_id = user;
 	const uint8_t *data;
@@ -1307,7 +1511,8 @@ static bool parse_dataobj_card_reader_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.58 */
 static bool parse_dataobj_other_address(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_other_address *oa = user;
 	const uint8_t *data;
@@ -1338,7 +1543,8 @@ static bool parse_dataobj_other_address(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.59 */
 static bool parse_dataobj_uicc_te_interface(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_uicc_te_interface *uti = user;
 	const uint8_t *data;
@@ -1355,7 +1561,8 @@ static bool parse_dataobj_uicc_te_interface(struct comprehension_tlv_iter *iter,
 }
 
 /* Defined in TS 102.223 Section 8.60 */
-static bool parse_dataobj_aid(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_aid(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	struct stk_aid *aid = user;
 	const uint8_t *data;
@@ -1377,7 +1584,8 @@ static bool parse_dataobj_aid(struct comprehension_tlv_iter *iter, void *user)
  * so we just use 1 byte to represent it.
  */
 static bool parse_dataobj_access_technology(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1385,7 +1593,8 @@ static bool parse_dataobj_access_technology(
 
 /* Defined in TS 102.223 Section 8.62 */
 static bool parse_dataobj_display_parameters(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_display_parameters *dp = user;
 	const uint8_t *data;
@@ -1403,7 +1612,8 @@ static bool parse_dataobj_display_parameters(
 
 /* Defined in TS 102.223 Section 8.63 */
 static bool parse_dataobj_service_record(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_service_record *sr = user;
 	const uint8_t *data;
@@ -1418,15 +1628,15 @@ static bool parse_dataobj_service_record(struct comprehension_tlv_iter *iter,
 	sr->serv_id = data[1];
 	sr->len = len - 2;
 
-	sr->serv_rec = l_malloc(sr->len);
-	memcpy(sr->serv_rec, data + 2, sr->len);
+	sr->serv_rec = stk_arena_memdup(arena, data + 2, sr->len);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.64 */
 static bool parse_dataobj_device_filter(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_device_filter *df = user;
 	const uint8_t *data;
@@ -1445,15 +1655,15 @@ static bool parse_dataobj_device_filter(struct comprehension_tlv_iter *iter,
 	df->tech_id = data[0];
 	df->len = len - 1;
 
-	df->dev_filter = l_malloc(df->len);
-	memcpy(df->dev_filter, data + 1, df->len);
+	df->dev_filter = stk_arena_memdup(arena, data + 1, df->len);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.65 */
 static bool parse_dataobj_service_search(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_service_search *ss = user;
 	const uint8_t *data;
@@ -1472,15 +1682,15 @@ static bool parse_dataobj_service_search(
 	ss->tech_id = data[0];
 	ss->len = len - 1;
 
-	ss->ser_search = l_malloc(ss->len);
-	memcpy(ss->ser_search, data + 1, ss->len);
+	ss->ser_search = stk_arena_memdup(arena, data + 1, ss->len);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.66 */
 static bool parse_dataobj_attribute_info(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_attribute_info *ai = user;
 	const uint8_t *data;
@@ -1499,23 +1709,24 @@ static bool parse_dataobj_attribute_info(struct comprehension_tlv_iter *iter,
 	ai->tech_id = data[0];
 	ai->len = len - 1;
 
-	ai->attr_info = l_malloc(ai->len);
-	memcpy(ai->attr_info, data + 1, ai->len);
+	ai->attr_info = stk_arena_memdup(arena, data + 1, ai->len);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.67 */
 static bool parse_dataobj_service_availability(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.68 */
 static bool parse_dataobj_remote_entity_address(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_remote_entity_address *rea = user;
 	const uint8_t *data;
@@ -1544,7 +1755,8 @@ static bool parse_dataobj_remote_entity_address(
 }
 
 /* Defined in TS 102.223 Section 8.69 */
-static bool parse_dataobj_esn(struct comprehension_tlv_iter *iter, void *user)
+static bool parse_dataobj_esn(struct comprehension_tlv_iter *iter, void *user,
+					struct stk_arena *arena)
 {
 	uint8_t *esn = user;
 	const uint8_t *data;
@@ -1564,7 +1776,7 @@ static bool parse_dataobj_esn(struct comprehension_tlv_iter *iter, void *user)
 /* Defined in TS 102.223 Section 8.70 */
 static bool parse_dataobj_network_access_name(
 					struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	char **apn = user;
 	const uint8_t *data;
@@ -1601,22 +1813,23 @@ static bool parse_dataobj_network_access_name(
 	}
 
 	decoded_apn[offset] = '\0';
-	*apn = l_strdup(decoded_apn);
+	*apn = stk_arena_strndup(arena, decoded_apn, offset);
 
 	return true;
 }
 
 /* Defined in TS 102.223 Section 8.71 */
 static bool parse_dataobj_cdma_sms_tpdu(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.72 */
 static bool parse_dataobj_text_attr(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_text_attribute *attr = user;
 	const uint8_t *data;
@@ -1637,7 +1850,8 @@ static bool parse_dataobj_text_attr(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 31.111 Section 8.72 */
 static bool parse_dataobj_pdp_act_par(
-			struct comprehension_tlv_iter *iter, void *user)
+			struct comprehension_tlv_iter *iter, void *user,
+			struct stk_arena *arena)
 {
 	struct stk_pdp_act_par *pcap = user;
 	const uint8_t *data;
@@ -1658,7 +1872,8 @@ static bool parse_dataobj_pdp_act_par(
 
 /* Defined in TS 102.223 Section 8.73 */
 static bool parse_dataobj_item_text_attribute_list(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_item_text_attribute_list *ital = user;
 	const uint8_t *data;
@@ -1677,7 +1892,8 @@ static bool parse_dataobj_item_text_attribute_list(
 
 /* Defined in TS 31.111 Section 8.73 */
 static bool parse_dataobj_utran_meas_qualifier(
-			struct comprehension_tlv_iter *iter, void *user)
+			struct comprehension_tlv_iter *iter, void *user,
+			struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1698,7 +1914,7 @@ static bool parse_dataobj_utran_meas_qualifier(
  * "13 32 54 76 98 10 32 54 F6".
  */
 static bool parse_dataobj_imeisv(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	char *imeisv = user;
 	const uint8_t *data;
@@ -1728,7 +1944,8 @@ static bool parse_dataobj_imeisv(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.75 */
 static bool parse_dataobj_network_search_mode(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1736,7 +1953,8 @@ static bool parse_dataobj_network_search_mode(
 
 /* Defined in TS 102.223 Section 8.76 */
 static bool parse_dataobj_battery_state(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	return parse_dataobj_common_byte(iter, byte);
@@ -1744,15 +1962,17 @@ static bool parse_dataobj_battery_state(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.77 */
 static bool parse_dataobj_browsing_status(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.78 */
 static bool parse_dataobj_frame_layout(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_frame_layout *fl = user;
 	const uint8_t *data;
@@ -1780,7 +2000,8 @@ static bool parse_dataobj_frame_layout(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.79 */
 static bool parse_dataobj_frames_info(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_frames_info *fi = user;
 	const uint8_t *data;
@@ -1816,7 +2037,7 @@ static bool parse_dataobj_frames_info(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.80 */
 static bool parse_dataobj_frame_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_frame_id *fi = user;
 	const uint8_t *data;
@@ -1837,7 +2058,7 @@ static bool parse_dataobj_frame_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.81 */
 static bool parse_dataobj_meid(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	uint8_t *meid = user;
 	const uint8_t *data;
@@ -1855,7 +2076,8 @@ static bool parse_dataobj_meid(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.82 */
 static bool parse_dataobj_mms_reference(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	struct stk_mms_reference *mr = user;
 	const uint8_t *data;
@@ -1877,7 +2099,7 @@ static bool parse_dataobj_mms_reference(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.83 */
 static bool parse_dataobj_mms_id(struct comprehension_tlv_iter *iter,
-					void *user)
+					void *user, struct stk_arena *arena)
 {
 	struct stk_mms_id *mi = user;
 	const uint8_t *data;
@@ -1899,7 +2121,8 @@ static bool parse_dataobj_mms_id(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.84 */
 static bool parse_dataobj_mms_transfer_status(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_mms_transfer_status *mts = user;
 	const uint8_t *data;
@@ -1917,7 +2140,8 @@ static bool parse_dataobj_mms_transfer_status(
 
 /* Defined in TS 102.223 Section 8.85 */
 static bool parse_dataobj_mms_content_id(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_mms_content_id *mci = user;
 	const uint8_t *data;
@@ -1939,15 +2163,17 @@ static bool parse_dataobj_mms_content_id(
 
 /* Defined in TS 102.223 Section 8.86 */
 static bool parse_dataobj_mms_notification(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_common_byte_array *array = user;
-	return parse_dataobj_common_byte_array(iter, array);
+	return parse_dataobj_common_byte_array(iter, array, arena);
 }
 
 /* Defined in TS 102.223 Section 8.87 */
 static bool parse_dataobj_last_envelope(struct comprehension_tlv_iter *iter,
-						void *user)
+						void *user,
+						struct stk_arena *arena)
 {
 	bool *ret = user;
 	return parse_dataobj_common_bool(iter, ret);
@@ -1955,7 +2181,8 @@ static bool parse_dataobj_last_envelope(struct comprehension_tlv_iter *iter,
 
 /* Defined in TS 102.223 Section 8.88 */
 static bool parse_dataobj_registry_application_data(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_registry_application_data *rad = user;
 	const uint8_t *data;
@@ -1967,7 +2194,7 @@ static bool parse_dataobj_registry_application_data(
 
 	data = comprehension_tlv_iter_get_data(iter);
 
-	utf8 = decode_text(data[2], len - 4, data + 4);
+	utf8 = decode_text(arena, data[2], len - 4, data + 4);
 
 	if (utf8 == NULL)
 		return false;
@@ -1981,7 +2208,8 @@ static bool parse_dataobj_registry_application_data(
 
 /* Defined in TS 102.223 Section 8.89 */
 static bool parse_dataobj_activate_descriptor(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	uint8_t *byte = user;
 	const uint8_t *data;
@@ -2001,7 +2229,8 @@ static bool parse_dataobj_activate_descriptor(
 
 /* Defined in TS 102.223 Section 8.90 */
 static bool parse_dataobj_broadcast_network_info(
-		struct comprehension_tlv_iter *iter, void *user)
+		struct comprehension_tlv_iter *iter, void *user,
+		struct stk_arena *arena)
 {
 	struct stk_broadcast_network_information *bni = user;
 	const uint8_t *data;
@@ -2022,202 +2251,137 @@ static bool parse_dataobj_broadcast_network_info(
 	return true;
 }
 
+/* Parsers for each data object, indexed by its tag */
+static const dataobj_handler dataobj_handlers[] = {
+	[STK_DATA_OBJECT_TYPE_ADDRESS] = parse_dataobj_address,
+	[STK_DATA_OBJECT_TYPE_ALPHA_ID] = parse_dataobj_alpha_id,
+	[STK_DATA_OBJECT_TYPE_SUBADDRESS] = parse_dataobj_subaddress,
+	[STK_DATA_OBJECT_TYPE_CCP] = parse_dataobj_ccp,
+	[STK_DATA_OBJECT_TYPE_CBS_PAGE] = parse_dataobj_cbs_page,
+	[STK_DATA_OBJECT_TYPE_DURATION] = parse_dataobj_duration,
+	[STK_DATA_OBJECT_TYPE_ITEM] = parse_dataobj_item,
+	[STK_DATA_OBJECT_TYPE_ITEM_ID] = parse_dataobj_item_id,
+	[STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH] = parse_dataobj_response_len,
+	[STK_DATA_OBJECT_TYPE_RESULT] = parse_dataobj_result,
+	[STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU] = parse_dataobj_gsm_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_SS_STRING] = parse_dataobj_ss,
+	[STK_DATA_OBJECT_TYPE_TEXT] = parse_dataobj_text,
+	[STK_DATA_OBJECT_TYPE_TONE] = parse_dataobj_tone,
+	[STK_DATA_OBJECT_TYPE_USSD_STRING] = parse_dataobj_ussd,
+	[STK_DATA_OBJECT_TYPE_FILE_LIST] = parse_dataobj_file_list,
+	[STK_DATA_OBJECT_TYPE_LOCATION_INFO] = parse_dataobj_location_info,
+	[STK_DATA_OBJECT_TYPE_IMEI] = parse_dataobj_imei,
+	[STK_DATA_OBJECT_TYPE_HELP_REQUEST] = parse_dataobj_help_request,
+	[STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS] =
+		parse_dataobj_network_measurement_results,
+	[STK_DATA_OBJECT_TYPE_DEFAULT_TEXT] = parse_dataobj_default_text,
+	[STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR] =
+		parse_dataobj_items_next_action_indicator,
+	[STK_DATA_OBJECT_TYPE_EVENT_LIST] = parse_dataobj_event_list,
+	[STK_DATA_OBJECT_TYPE_CAUSE] = parse_dataobj_cause,
+	[STK_DATA_OBJECT_TYPE_LOCATION_STATUS] = parse_dataobj_location_status,
+	[STK_DATA_OBJECT_TYPE_TRANSACTION_ID] = parse_dataobj_transaction_id,
+	[STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST] =
+		parse_dataobj_bcch_channel_list,
+	[STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION] =
+		parse_dataobj_call_control_requested_action,
+	[STK_DATA_OBJECT_TYPE_ICON_ID] = parse_dataobj_icon_id,
+	[STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST] =
+		parse_dataobj_item_icon_id_list,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_STATUS] =
+		parse_dataobj_card_reader_status,
+	[STK_DATA_OBJECT_TYPE_CARD_ATR] = parse_dataobj_card_atr,
+	[STK_DATA_OBJECT_TYPE_C_APDU] = parse_dataobj_c_apdu,
+	[STK_DATA_OBJECT_TYPE_R_APDU] = parse_dataobj_r_apdu,
+	[STK_DATA_OBJECT_TYPE_TIMER_ID] = parse_dataobj_timer_id,
+	[STK_DATA_OBJECT_TYPE_TIMER_VALUE] = parse_dataobj_timer_value,
+	[STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE] =
+		parse_dataobj_datetime_timezone,
+	[STK_DATA_OBJECT_TYPE_AT_COMMAND] = parse_dataobj_at_command,
+	[STK_DATA_OBJECT_TYPE_AT_RESPONSE] = parse_dataobj_at_response,
+	[STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR] =
+		parse_dataobj_bc_repeat_indicator,
+	[STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE] = parse_dataobj_imm_resp,
+	[STK_DATA_OBJECT_TYPE_DTMF_STRING] = parse_dataobj_dtmf_string,
+	[STK_DATA_OBJECT_TYPE_LANGUAGE] = parse_dataobj_language,
+	[STK_DATA_OBJECT_TYPE_BROWSER_ID] = parse_dataobj_browser_id,
+	[STK_DATA_OBJECT_TYPE_TIMING_ADVANCE] = parse_dataobj_timing_advance,
+	[STK_DATA_OBJECT_TYPE_URL] = parse_dataobj_url,
+	[STK_DATA_OBJECT_TYPE_BEARER] = parse_dataobj_bearer,
+	[STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF] =
+		parse_dataobj_provisioning_file_reference,
+	[STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE] =
+		parse_dataobj_browser_termination_cause,
+	[STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION] =
+		parse_dataobj_bearer_description,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA] = parse_dataobj_channel_data,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH] =
+		parse_dataobj_channel_data_length,
+	[STK_DATA_OBJECT_TYPE_BUFFER_SIZE] = parse_dataobj_buffer_size,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_STATUS] = parse_dataobj_channel_status,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_ID] = parse_dataobj_card_reader_id,
+	[STK_DATA_OBJECT_TYPE_OTHER_ADDRESS] = parse_dataobj_other_address,
+	[STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE] =
+		parse_dataobj_uicc_te_interface,
+	[STK_DATA_OBJECT_TYPE_AID] = parse_dataobj_aid,
+	[STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY] =
+		parse_dataobj_access_technology,
+	[STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS] =
+		parse_dataobj_display_parameters,
+	[STK_DATA_OBJECT_TYPE_SERVICE_RECORD] = parse_dataobj_service_record,
+	[STK_DATA_OBJECT_TYPE_DEVICE_FILTER] = parse_dataobj_device_filter,
+	[STK_DATA_OBJECT_TYPE_SERVICE_SEARCH] = parse_dataobj_service_search,
+	[STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO] = parse_dataobj_attribute_info,
+	[STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY] =
+		parse_dataobj_service_availability,
+	[STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS] =
+		parse_dataobj_remote_entity_address,
+	[STK_DATA_OBJECT_TYPE_ESN] = parse_dataobj_esn,
+	[STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME] =
+		parse_dataobj_network_access_name,
+	[STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU] = parse_dataobj_cdma_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE] = parse_dataobj_text_attr,
+	[STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER] =
+		parse_dataobj_pdp_act_par,
+	[STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST] =
+		parse_dataobj_item_text_attribute_list,
+	[STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER] =
+		parse_dataobj_utran_meas_qualifier,
+	[STK_DATA_OBJECT_TYPE_IMEISV] = parse_dataobj_imeisv,
+	[STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE] =
+		parse_dataobj_network_search_mode,
+	[STK_DATA_OBJECT_TYPE_BATTERY_STATE] = parse_dataobj_battery_state,
+	[STK_DATA_OBJECT_TYPE_BROWSING_STATUS] = parse_dataobj_browsing_status,
+	[STK_DATA_OBJECT_TYPE_FRAME_LAYOUT] = parse_dataobj_frame_layout,
+	[STK_DATA_OBJECT_TYPE_FRAMES_INFO] = parse_dataobj_frames_info,
+	[STK_DATA_OBJECT_TYPE_FRAME_ID] = parse_dataobj_frame_id,
+	[STK_DATA_OBJECT_TYPE_MEID] = parse_dataobj_meid,
+	[STK_DATA_OBJECT_TYPE_MMS_REFERENCE] = parse_dataobj_mms_reference,
+	[STK_DATA_OBJECT_TYPE_MMS_ID] = parse_dataobj_mms_id,
+	[STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS] =
+		parse_dataobj_mms_transfer_status,
+	[STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID] = parse_dataobj_mms_content_id,
+	[STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION] =
+		parse_dataobj_mms_notification,
+	[STK_DATA_OBJECT_TYPE_LAST_ENVELOPE] = parse_dataobj_last_envelope,
+	[STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA] =
+		parse_dataobj_registry_application_data,
+	[STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR] =
+		parse_dataobj_activate_descriptor,
+	[STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO] =
+		parse_dataobj_broadcast_network_info,
+};
+
 static dataobj_handler handler_for_type(enum stk_data_object_type type)
 {
-	switch (type) {
-	case STK_DATA_OBJECT_TYPE_ADDRESS:
-		return parse_dataobj_address;
-	case STK_DATA_OBJECT_TYPE_ALPHA_ID:
-		return parse_dataobj_alpha_id;
-	case STK_DATA_OBJECT_TYPE_SUBADDRESS:
-		return parse_dataobj_subaddress;
-	case STK_DATA_OBJECT_TYPE_CCP:
-		return parse_dataobj_ccp;
-	case STK_DATA_OBJECT_TYPE_CBS_PAGE:
-		return parse_dataobj_cbs_page;
-	case STK_DATA_OBJECT_TYPE_DURATION:
-		return parse_dataobj_duration;
-	case STK_DATA_OBJECT_TYPE_ITEM:
-		return parse_dataobj_item;
-	case STK_DATA_OBJECT_TYPE_ITEM_ID:
-		return parse_dataobj_item_id;
-	case STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH:
-		return parse_dataobj_response_len;
-	case STK_DATA_OBJECT_TYPE_RESULT:
-		return parse_dataobj_result;
-	case STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU:
-		return parse_dataobj_gsm_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_SS_STRING:
-		return parse_dataobj_ss;
-	case STK_DATA_OBJECT_TYPE_TEXT:
-		return parse_dataobj_text;
-	case STK_DATA_OBJECT_TYPE_TONE:
-		return parse_dataobj_tone;
-	case STK_DATA_OBJECT_TYPE_USSD_STRING:
-		return parse_dataobj_ussd;
-	case STK_DATA_OBJECT_TYPE_FILE_LIST:
-		return parse_dataobj_file_list;
-	case STK_DATA_OBJECT_TYPE_LOCATION_INFO:
-		return parse_dataobj_location_info;
-	case STK_DATA_OBJECT_TYPE_IMEI:
-		return parse_dataobj_imei;
-	case STK_DATA_OBJECT_TYPE_HELP_REQUEST:
-		return parse_dataobj_help_request;
-	case STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS:
-		return parse_dataobj_network_measurement_results;
-	case STK_DATA_OBJECT_TYPE_DEFAULT_TEXT:
-		return parse_dataobj_default_text;
-	case STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR:
-		return parse_dataobj_items_next_action_indicator;
-	case STK_DATA_OBJECT_TYPE_EVENT_LIST:
-		return parse_dataobj_event_list;
-	case STK_DATA_OBJECT_TYPE_CAUSE:
-		return parse_dataobj_cause;
-	case STK_DATA_OBJECT_TYPE_LOCATION_STATUS:
-		return parse_dataobj_location_status;
-	case STK_DATA_OBJECT_TYPE_TRANSACTION_ID:
-		return parse_dataobj_transaction_id;
-	case STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST:
-		return parse_dataobj_bcch_channel_list;
-	case STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION:
-		return parse_dataobj_call_control_requested_action;
-	case STK_DATA_OBJECT_TYPE_ICON_ID:
-		return parse_dataobj_icon_id;
-	case STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST:
-		return parse_dataobj_item_icon_id_list;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_STATUS:
-		return parse_dataobj_card_reader_status;
-	case STK_DATA_OBJECT_TYPE_CARD_ATR:
-		return parse_dataobj_card_atr;
-	case STK_DATA_OBJECT_TYPE_C_APDU:
-		return parse_dataobj_c_apdu;
-	case STK_DATA_OBJECT_TYPE_R_APDU:
-		return parse_dataobj_r_apdu;
-	case STK_DATA_OBJECT_TYPE_TIMER_ID:
-		return parse_dataobj_timer_id;
-	case STK_DATA_OBJECT_TYPE_TIMER_VALUE:
-		return parse_dataobj_timer_value;
-	case STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE:
-		return parse_dataobj_datetime_timezone;
-	case STK_DATA_OBJECT_TYPE_AT_COMMAND:
-		return parse_dataobj_at_command;
-	case STK_DATA_OBJECT_TYPE_AT_RESPONSE:
-		return parse_dataobj_at_response;
-	case STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR:
-		return parse_dataobj_bc_repeat_indicator;
-	case STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE:
-		return parse_dataobj_imm_resp;
-	case STK_DATA_OBJECT_TYPE_DTMF_STRING:
-		return parse_dataobj_dtmf_string;
-	case STK_DATA_OBJECT_TYPE_LANGUAGE:
-		return parse_dataobj_language;
-	case STK_DATA_OBJECT_TYPE_BROWSER_ID:
-		return parse_dataobj_browser_id;
-	case STK_DATA_OBJECT_TYPE_TIMING_ADVANCE:
-		return parse_dataobj_timing_advance;
-	case STK_DATA_OBJECT_TYPE_URL:
-		return parse_dataobj_url;
-	case STK_DATA_OBJECT_TYPE_BEARER:
-		return parse_dataobj_bearer;
-	case STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF:
-		return parse_dataobj_provisioning_file_reference;
-	case STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE:
-		return parse_dataobj_browser_termination_cause;
-	case STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION:
-		return parse_dataobj_bearer_description;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA:
-		return parse_dataobj_channel_data;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH:
-		return parse_dataobj_channel_data_length;
-	case STK_DATA_OBJECT_TYPE_BUFFER_SIZE:
-		return parse_dataobj_buffer_size;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_STATUS:
-		return parse_dataobj_channel_status;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_ID:
-		return parse_dataobj_card_reader_id;
-	case STK_DATA_OBJECT_TYPE_OTHER_ADDRESS:
-		return parse_dataobj_other_address;
-	case STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE:
-		return parse_dataobj_uicc_te_interface;
-	case STK_DATA_OBJECT_TYPE_AID:
-		return parse_dataobj_aid;
-	case STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY:
-		return parse_dataobj_access_technology;
-	case STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS:
-		return parse_dataobj_display_parameters;
-	case STK_DATA_OBJECT_TYPE_SERVICE_RECORD:
-		return parse_dataobj_service_record;
-	case STK_DATA_OBJECT_TYPE_DEVICE_FILTER:
-		return parse_dataobj_device_filter;
-	case STK_DATA_OBJECT_TYPE_SERVICE_SEARCH:
-		return parse_dataobj_service_search;
-	case STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO:
-		return parse_dataobj_attribute_info;
-	case STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY:
-		return parse_dataobj_service_availability;
-	case STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS:
-		return parse_dataobj_remote_entity_address;
-	case STK_DATA_OBJECT_TYPE_ESN:
-		return parse_dataobj_esn;
-	case STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME:
-		return parse_dataobj_network_access_name;
-	case STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU:
-		return parse_dataobj_cdma_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE:
-		return parse_dataobj_text_attr;
-	case STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER:
-		return parse_dataobj_pdp_act_par;
-	case STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST:
-		return parse_dataobj_item_text_attribute_list;
-	case STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER:
-		return parse_dataobj_utran_meas_qualifier;
-	case STK_DATA_OBJECT_TYPE_IMEISV:
-		return parse_dataobj_imeisv;
-	case STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE:
-		return parse_dataobj_network_search_mode;
-	case STK_DATA_OBJECT_TYPE_BATTERY_STATE:
-		return parse_dataobj_battery_state;
-	case STK_DATA_OBJECT_TYPE_BROWSING_STATUS:
-		return parse_dataobj_browsing_status;
-	case STK_DATA_OBJECT_TYPE_FRAME_LAYOUT:
-		return parse_dataobj_frame_layout;
-	case STK_DATA_OBJECT_TYPE_FRAMES_INFO:
-		return parse_dataobj_frames_info;
-	case STK_DATA_OBJECT_TYPE_FRAME_ID:
-		return parse_dataobj_frame_id;
-	case STK_DATA_OBJECT_TYPE_MEID:
-		return parse_dataobj_meid;
-	case STK_DATA_OBJECT_TYPE_MMS_REFERENCE:
-		return parse_dataobj_mms_reference;
-	case STK_DATA_OBJECT_TYPE_MMS_ID:
-		return parse_dataobj_mms_id;
-	case STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS:
-		return parse_dataobj_mms_transfer_status;
-	case STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID:
-		return parse_dataobj_mms_content_id;
-	case STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION:
-		return parse_dataobj_mms_notification;
-	case STK_DATA_OBJECT_TYPE_LAST_ENVELOPE:
-		return parse_dataobj_last_envelope;
-	case STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA:
-		return parse_dataobj_registry_application_data;
-	case STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR:
-		return parse_dataobj_activate_descriptor;
-	case STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO:
-		return parse_dataobj_broadcast_network_info;
-	default:
+	if (type >= L_ARRAY_SIZE(dataobj_handlers))
 		return NULL;
-	}
-}
 
-static void destroy_stk_item(gpointer pointer)
-{
-	struct stk_item *item = pointer;
-	l_free(item->text);
-	l_free(item);
+	return dataobj_handlers[type];
 }
 
-static bool parse_item_list(struct comprehension_tlv_iter *iter, void *data)
+static bool parse_item_list(struct comprehension_tlv_iter *iter, void *data,
+					struct stk_arena *arena)
 {
 	struct l_queue **out = data;
 	uint16_t tag = STK_DATA_OBJECT_TYPE_ITEM;
@@ -2232,7 +2396,7 @@ static bool parse_item_list(struct comprehension_tlv_iter *iter, void *data)
 		memset(&item, 0, sizeof(item));
 		count++;
 
-		if (!parse_dataobj_item(iter, &item))
+		if (!parse_dataobj_item(iter, &item, arena))
 			continue;
 
 		if (item.id == 0) {
@@ -2240,7 +2404,8 @@ static bool parse_item_list(struct comprehension_tlv_iter *iter, void *data)
 			continue;
 		}
 
-		l_queue_push_tail(list, l_memdup(&item, sizeof(item)));
+		l_queue_push_tail(list,
+				stk_arena_memdup(arena, &item, sizeof(item)));
 	} while (comprehension_tlv_iter_next(iter) == TRUE &&
 			comprehension_tlv_iter_get_tag(iter) == tag);
 
@@ -2251,12 +2416,12 @@ static bool parse_item_list(struct comprehension_tlv_iter *iter, void *data)
 		return true;
 	}
 
-	l_queue_destroy(list, destroy_stk_item);
+	l_queue_destroy(list, NULL);
 	return false;
 }
 
 static bool parse_provisioning_list(struct comprehension_tlv_iter *iter,
-					void *data)
+					void *data, struct stk_arena *arena)
 {
 	struct l_queue **out = data;
 	uint16_t tag = STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF;
@@ -2268,10 +2433,12 @@ static bool parse_provisioning_list(struct comprehension_tlv_iter *iter,
 		comprehension_tlv_iter_copy(iter, &iter_old);
 		memset(&file, 0, sizeof(file));
 
-		if (!parse_dataobj_provisioning_file_reference(iter, &file))
+		if (!parse_dataobj_provisioning_file_reference(iter, &file,
+								arena))
 			continue;
 
-		l_queue_push_tail(list, l_memdup(&file, sizeof(file)));
+		l_queue_push_tail(list,
+				stk_arena_memdup(arena, &file, sizeof(file)));
 	} while (comprehension_tlv_iter_next(iter) == TRUE &&
 			comprehension_tlv_iter_get_tag(iter) == tag);
 
@@ -2293,99 +2460,93 @@ static dataobj_handler list_handler_for_type(enum stk_data_object_type type)
 	}
 }
 
-struct dataobj_handler_entry {
+/*
+ * Describes a data object expected in a proactive command, the parsed value
+ * is stored at offset into struct stk_command, or into the caller's scratch
+ * area if DATAOBJ_FLAG_SCRATCH is set.  Arrays are terminated by an entry of
+ * type STK_DATA_OBJECT_TYPE_INVALID.
+ */
+struct dataobj_desc {
 	enum stk_data_object_type type;
 	int flags;
-	void *data;
+	size_t offset;
 };
 
+#define DATAOBJ(type, flags, member)					\
+	{ STK_DATA_OBJECT_TYPE_ ## type, flags,				\
+		offsetof(struct stk_command, member) }
+
+#define DATAOBJ_REQUIRED (DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM)
+
 static enum stk_command_parse_result parse_dataobj(
 					struct comprehension_tlv_iter *iter,
-					enum stk_data_object_type type, ...)
+					const struct dataobj_desc *desc,
+					struct stk_command *command,
+					void *scratch)
 {
-	GSList *entries = NULL;
-	GSList *l;
-	va_list args;
-	bool minimum_set = true;
+	const struct dataobj_desc *next = desc;
 	bool parse_error = false;
 
-	va_start(args, type);
-
-	while (type != STK_DATA_OBJECT_TYPE_INVALID) {
-		struct dataobj_handler_entry *entry;
-
-		entry = g_new0(struct dataobj_handler_entry, 1);
-
-		entry->type = type;
-		entry->flags = va_arg(args, int);
-		entry->data = va_arg(args, void *);
-
-		type = va_arg(args, enum stk_data_object_type);
-		entries = g_slist_prepend(entries, entry);
-	}
-
-	va_end(args);
-
-	entries = g_slist_reverse(entries);
-
-	l = entries;
 	while (comprehension_tlv_iter_next(iter) == TRUE) {
+		unsigned short tag = comprehension_tlv_iter_get_tag(iter);
+		const struct dataobj_desc *d;
 		dataobj_handler handler;
-		struct dataobj_handler_entry *entry;
-		GSList *l2;
-
-		for (l2 = l; l2; l2 = l2->next) {
-			entry = l2->data;
+		uint8_t *base;
 
-			if (comprehension_tlv_iter_get_tag(iter) == entry->type)
+		for (d = next; d->type != STK_DATA_OBJECT_TYPE_INVALID; d++) {
+			if (tag == d->type)
 				break;
 
 			/* Can't skip over mandatory objects */
-			if (entry->flags & DATAOBJ_FLAG_MANDATORY) {
-				l2 = NULL;
+			if (d->flags & DATAOBJ_FLAG_MANDATORY) {
+				d = NULL;
 				break;
 			}
 		}
 
-		if (l2 == NULL) {
+		if (d == NULL || d->type == STK_DATA_OBJECT_TYPE_INVALID) {
 			if (comprehension_tlv_get_cr(iter) == TRUE)
 				parse_error = true;
 
 			continue;
 		}
 
-		if (entry->flags & DATAOBJ_FLAG_LIST)
-			handler = list_handler_for_type(entry->type);
+		if (d->flags & DATAOBJ_FLAG_LIST)
+			handler = list_handler_for_type(d->type);
 		else
-			handler = handler_for_type(entry->type);
+			handler = handler_for_type(d->type);
 
-		if (!handler(iter, entry->data))
+		if (d->flags & DATAOBJ_FLAG_SCRATCH)
+			base = scratch;
+		else
+			base = (uint8_t *) command;
+
+		if (!handler(iter, base + d->offset, command->arena))
 			parse_error = true;
 
-		l = l2->next;
+		next = d + 1;
 	}
 
-	for (; l; l = l->next) {
-		struct dataobj_handler_entry *entry = l->data;
-
-		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
-			minimum_set = false;
+	for (; next->type != STK_DATA_OBJECT_TYPE_INVALID; next++) {
+		if (next->flags & DATAOBJ_FLAG_MANDATORY)
+			return STK_PARSE_RESULT_MISSING_VALUE;
 	}
 
-	g_slist_free_full(entries, g_free);
-
-	if (!minimum_set)
-		return STK_PARSE_RESULT_MISSING_VALUE;
 	if (parse_error)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	return STK_PARSE_RESULT_OK;
 }
 
-static void destroy_display_text(struct stk_command *command)
-{
-	l_free(command->display_text.text);
-}
+static const struct dataobj_desc display_text_dataobjs[] = {
+	DATAOBJ(TEXT, DATAOBJ_REQUIRED, display_text.text),
+	DATAOBJ(ICON_ID, 0, display_text.icon_id),
+	DATAOBJ(IMMEDIATE_RESPONSE, 0, display_text.immediate_response),
+	DATAOBJ(DURATION, 0, display_text.duration),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, display_text.text_attr),
+	DATAOBJ(FRAME_ID, 0, display_text.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_display_text(
 					struct stk_command *command,
@@ -2400,32 +2561,21 @@ static enum stk_command_parse_result parse_display_text(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_DISPLAY)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_display_text;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->immediate_response,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, display_text_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_get_inkey(struct stk_command *command)
-{
-	l_free(command->get_inkey.text);
-}
+static const struct dataobj_desc get_inkey_dataobjs[] = {
+	DATAOBJ(TEXT, DATAOBJ_REQUIRED, get_inkey.text),
+	DATAOBJ(ICON_ID, 0, get_inkey.icon_id),
+	DATAOBJ(DURATION, 0, get_inkey.duration),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, get_inkey.text_attr),
+	DATAOBJ(FRAME_ID, 0, get_inkey.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_get_inkey(
 					struct stk_command *command,
@@ -2440,31 +2590,22 @@ static enum stk_command_parse_result parse_get_inkey(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_get_inkey;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, get_inkey_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_get_input(struct stk_command *command)
-{
-	l_free(command->get_input.text);
-	l_free(command->get_input.default_text);
-}
+static const struct dataobj_desc get_input_dataobjs[] = {
+	DATAOBJ(TEXT, DATAOBJ_REQUIRED, get_input.text),
+	DATAOBJ(RESPONSE_LENGTH, DATAOBJ_REQUIRED, get_input.resp_len),
+	DATAOBJ(DEFAULT_TEXT, 0, get_input.default_text),
+	DATAOBJ(ICON_ID, 0, get_input.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, get_input.text_attr),
+	DATAOBJ(FRAME_ID, 0, get_input.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_get_input(
 					struct stk_command *command,
@@ -2479,23 +2620,7 @@ static enum stk_command_parse_result parse_get_input(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_get_input;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->resp_len,
-				STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
-				&obj->default_text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, get_input_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2515,10 +2640,15 @@ static enum stk_command_parse_result parse_more_time(
 	return STK_PARSE_RESULT_OK;
 }
 
-static void destroy_play_tone(struct stk_command *command)
-{
-	l_free(command->play_tone.alpha_id);
-}
+static const struct dataobj_desc play_tone_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, play_tone.alpha_id),
+	DATAOBJ(TONE, 0, play_tone.tone),
+	DATAOBJ(DURATION, 0, play_tone.duration),
+	DATAOBJ(ICON_ID, 0, play_tone.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, play_tone.text_attr),
+	DATAOBJ(FRAME_ID, 0, play_tone.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_play_tone(
 					struct stk_command *command,
@@ -2533,49 +2663,45 @@ static enum stk_command_parse_result parse_play_tone(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_EARPIECE)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_play_tone;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_TONE, 0,
-				&obj->tone,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, play_tone_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_desc poll_interval_dataobjs[] = {
+	DATAOBJ(DURATION, DATAOBJ_REQUIRED, poll_interval.duration),
+	{ }
+};
+
 static enum stk_command_parse_result parse_poll_interval(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_poll_interval *obj = &command->poll_interval;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_DURATION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, poll_interval_dataobjs, command, NULL);
 }
 
+static const struct dataobj_desc setup_menu_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, DATAOBJ_REQUIRED, setup_menu.alpha_id),
+	DATAOBJ(ITEM, DATAOBJ_REQUIRED | DATAOBJ_FLAG_LIST, setup_menu.items),
+	DATAOBJ(ITEMS_NEXT_ACTION_INDICATOR, 0, setup_menu.next_act),
+	DATAOBJ(ICON_ID, 0, setup_menu.icon_id),
+	DATAOBJ(ITEM_ICON_ID_LIST, 0, setup_menu.item_icon_id_list),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, setup_menu.text_attr),
+	DATAOBJ(ITEM_TEXT_ATTRIBUTE_LIST, 0, setup_menu.item_text_attr_list),
+	{ }
+};
+
 static void destroy_setup_menu(struct stk_command *command)
 {
-	l_free(command->setup_menu.alpha_id);
-	l_queue_destroy(command->setup_menu.items, destroy_stk_item);
+	l_queue_destroy(command->setup_menu.items, NULL);
 }
 
 static enum stk_command_parse_result parse_setup_menu(
@@ -2593,34 +2719,29 @@ static enum stk_command_parse_result parse_setup_menu(
 
 	command->destructor = destroy_setup_menu;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, setup_menu_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_desc select_item_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, select_item.alpha_id),
+	DATAOBJ(ITEM, DATAOBJ_REQUIRED | DATAOBJ_FLAG_LIST, select_item.items),
+	DATAOBJ(ITEMS_NEXT_ACTION_INDICATOR, 0, select_item.next_act),
+	DATAOBJ(ITEM_ID, 0, select_item.item_id),
+	DATAOBJ(ICON_ID, 0, select_item.icon_id),
+	DATAOBJ(ITEM_ICON_ID_LIST, 0, select_item.item_icon_id_list),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, select_item.text_attr),
+	DATAOBJ(ITEM_TEXT_ATTRIBUTE_LIST, 0, select_item.item_text_attr_list),
+	DATAOBJ(FRAME_ID, 0, select_item.frame_id),
+	{ }
+};
+
 static void destroy_select_item(struct stk_command *command)
 {
-	l_free(command->select_item.alpha_id);
-	l_queue_destroy(command->select_item.items, destroy_stk_item);
+	l_queue_destroy(command->select_item.items, NULL);
 }
 
 static enum stk_command_parse_result parse_select_item(
@@ -2636,27 +2757,7 @@ static enum stk_command_parse_result parse_select_item(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
-			&obj->item_id,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-			&obj->frame_id,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, select_item_dataobjs, command, NULL);
 
 	command->destructor = destroy_select_item;
 
@@ -2668,11 +2769,24 @@ static enum stk_command_parse_result parse_select_item(
 	return status;
 }
 
-static void destroy_send_sms(struct stk_command *command)
-{
-	l_free(command->send_sms.alpha_id);
-	l_free(command->send_sms.cdma_sms.array);
-}
+/* Parsed into the scratch area before being decoded into the command */
+struct send_sms_scratch {
+	struct stk_address sc_address;
+	struct gsm_sms_tpdu gsm_tpdu;
+};
+
+static const struct dataobj_desc send_sms_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, send_sms.alpha_id),
+	{ STK_DATA_OBJECT_TYPE_ADDRESS, DATAOBJ_FLAG_SCRATCH,
+		offsetof(struct send_sms_scratch, sc_address) },
+	{ STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, DATAOBJ_FLAG_SCRATCH,
+		offsetof(struct send_sms_scratch, gsm_tpdu) },
+	DATAOBJ(CDMA_SMS_TPDU, 0, send_sms.cdma_sms),
+	DATAOBJ(ICON_ID, 0, send_sms.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, send_sms.text_attr),
+	DATAOBJ(FRAME_ID, 0, send_sms.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_send_sms(
 					struct stk_command *command,
@@ -2680,8 +2794,9 @@ static enum stk_command_parse_result parse_send_sms(
 {
 	struct stk_command_send_sms *obj = &command->send_sms;
 	enum stk_command_parse_result status;
-	struct gsm_sms_tpdu gsm_tpdu;
-	struct stk_address sc_address = { 0, NULL };
+	struct send_sms_scratch scratch;
+	struct gsm_sms_tpdu *gsm_tpdu = &scratch.gsm_tpdu;
+	struct stk_address *sc_address = &scratch.sc_address;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2689,24 +2804,8 @@ static enum stk_command_parse_result parse_send_sms(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	memset(&gsm_tpdu, 0, sizeof(gsm_tpdu));
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ADDRESS, 0,
-				&sc_address,
-				STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
-				&gsm_tpdu,
-				STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
-				&obj->cdma_sms,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
-
-	command->destructor = destroy_send_sms;
+	memset(&scratch, 0, sizeof(scratch));
+	status = parse_dataobj(iter, send_sms_dataobjs, command, &scratch);
 
 	if (status != STK_PARSE_RESULT_OK)
 		goto out;
@@ -2716,12 +2815,12 @@ static enum stk_command_parse_result parse_send_sms(
 	if (status != STK_PARSE_RESULT_OK)
 		goto out;
 
-	if (gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
+	if (gsm_tpdu->len == 0 && obj->cdma_sms.len == 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	if (gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
+	if (gsm_tpdu->len > 0 && obj->cdma_sms.len > 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2732,7 +2831,7 @@ static enum stk_command_parse_result parse_send_sms(
 
 	/* packing is needed */
 	if (command->qualifier & 0x01) {
-		if (!sms_decode_unpacked_stk_pdu(gsm_tpdu.tpdu, gsm_tpdu.len,
+		if (!sms_decode_unpacked_stk_pdu(gsm_tpdu->tpdu, gsm_tpdu->len,
 							&obj->gsm_sms)) {
 			status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 			goto out;
@@ -2741,8 +2840,8 @@ static enum stk_command_parse_result parse_send_sms(
 		goto set_addr;
 	}
 
-	if (sms_decode(gsm_tpdu.tpdu, gsm_tpdu.len, TRUE,
-				gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
+	if (sms_decode(gsm_tpdu->tpdu, gsm_tpdu->len, TRUE,
+				gsm_tpdu->len, &obj->gsm_sms) == FALSE) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2754,96 +2853,79 @@ static enum stk_command_parse_result parse_send_sms(
 	}
 
 set_addr:
-	if (sc_address.number == NULL)
+	if (sc_address->number == NULL)
 		goto out;
 
-	if (strlen(sc_address.number) > 20) {
+	if (strlen(sc_address->number) > 20) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	strcpy(obj->gsm_sms.sc_addr.address, sc_address.number);
-	obj->gsm_sms.sc_addr.numbering_plan = sc_address.ton_npi & 15;
-	obj->gsm_sms.sc_addr.number_type = (sc_address.ton_npi >> 4) & 7;
+	strcpy(obj->gsm_sms.sc_addr.address, sc_address->number);
+	obj->gsm_sms.sc_addr.numbering_plan = sc_address->ton_npi & 15;
+	obj->gsm_sms.sc_addr.number_type = (sc_address->ton_npi >> 4) & 7;
 
 out:
-	l_free(sc_address.number);
-
 	return status;
 }
 
-static void destroy_send_ss(struct stk_command *command)
-{
-	l_free(command->send_ss.alpha_id);
-	l_free(command->send_ss.ss.ss);
-}
+static const struct dataobj_desc send_ss_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, send_ss.alpha_id),
+	DATAOBJ(SS_STRING, DATAOBJ_REQUIRED, send_ss.ss),
+	DATAOBJ(ICON_ID, 0, send_ss.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, send_ss.text_attr),
+	DATAOBJ(FRAME_ID, 0, send_ss.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ss *obj = &command->send_ss;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_send_ss;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_SS_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ss,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, send_ss_dataobjs, command, NULL);
 }
 
-static void destroy_send_ussd(struct stk_command *command)
-{
-	l_free(command->send_ussd.alpha_id);
-}
+static const struct dataobj_desc send_ussd_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, send_ussd.alpha_id),
+	DATAOBJ(USSD_STRING, DATAOBJ_REQUIRED, send_ussd.ussd_string),
+	DATAOBJ(ICON_ID, 0, send_ussd.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, send_ussd.text_attr),
+	DATAOBJ(FRAME_ID, 0, send_ussd.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_send_ussd(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ussd *obj = &command->send_ussd;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_send_ussd;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_USSD_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ussd_string,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
-
-static void destroy_setup_call(struct stk_command *command)
-{
-	l_free(command->setup_call.alpha_id_usr_cfm);
-	l_free(command->setup_call.addr.number);
-	l_free(command->setup_call.alpha_id_call_setup);
-}
+	return parse_dataobj(iter, send_ussd_dataobjs, command, NULL);
+}
+
+static const struct dataobj_desc setup_call_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, setup_call.alpha_id_usr_cfm),
+	DATAOBJ(ADDRESS, DATAOBJ_REQUIRED, setup_call.addr),
+	DATAOBJ(CCP, 0, setup_call.ccp),
+	DATAOBJ(SUBADDRESS, 0, setup_call.subaddr),
+	DATAOBJ(DURATION, 0, setup_call.duration),
+	DATAOBJ(ICON_ID, 0, setup_call.icon_id_usr_cfm),
+	DATAOBJ(ALPHA_ID, 0, setup_call.alpha_id_call_setup),
+	DATAOBJ(ICON_ID, 0, setup_call.icon_id_call_setup),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, setup_call.text_attr_usr_cfm),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, setup_call.text_attr_call_setup),
+	DATAOBJ(FRAME_ID, 0, setup_call.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_setup_call(
 					struct stk_command *command,
@@ -2858,32 +2940,7 @@ static enum stk_command_parse_result parse_setup_call(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_setup_call;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ADDRESS,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->addr,
-				STK_DATA_OBJECT_TYPE_CCP, 0,
-				&obj->ccp,
-				STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
-				&obj->subaddr,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_call_setup,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_call_setup,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_usr_cfm,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_call_setup,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, setup_call_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id_usr_cfm, obj->icon_id_usr_cfm.id);
 	CHECK_TEXT_AND_ICON(obj->alpha_id_call_setup,
@@ -2892,10 +2949,19 @@ static enum stk_command_parse_result parse_setup_call(
 	return status;
 }
 
+static const struct dataobj_desc refresh_dataobjs[] = {
+	DATAOBJ(FILE_LIST, 0, refresh.file_list),
+	DATAOBJ(AID, 0, refresh.aid),
+	DATAOBJ(ALPHA_ID, 0, refresh.alpha_id),
+	DATAOBJ(ICON_ID, 0, refresh.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, refresh.text_attr),
+	DATAOBJ(FRAME_ID, 0, refresh.frame_id),
+	{ }
+};
+
 static void destroy_refresh(struct stk_command *command)
 {
 	l_queue_destroy(command->refresh.file_list, l_free);
-	l_free(command->refresh.alpha_id);
 }
 
 static enum stk_command_parse_result parse_refresh(
@@ -2913,19 +2979,7 @@ static enum stk_command_parse_result parse_refresh(
 
 	command->destructor = destroy_refresh;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
-				&obj->file_list,
-				STK_DATA_OBJECT_TYPE_AID, 0,
-				&obj->aid,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, refresh_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -2958,30 +3012,33 @@ static enum stk_command_parse_result parse_provide_local_info(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_desc setup_event_list_dataobjs[] = {
+	DATAOBJ(EVENT_LIST, DATAOBJ_REQUIRED, setup_event_list.event_list),
+	{ }
+};
+
 static enum stk_command_parse_result parse_setup_event_list(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_setup_event_list *obj = &command->setup_event_list;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_EVENT_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->event_list,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, setup_event_list_dataobjs, command, NULL);
 }
 
+static const struct dataobj_desc perform_card_apdu_dataobjs[] = {
+	DATAOBJ(C_APDU, DATAOBJ_REQUIRED, perform_card_apdu.c_apdu),
+	{ }
+};
+
 static enum stk_command_parse_result parse_perform_card_apdu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_perform_card_apdu *obj = &command->perform_card_apdu;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -2989,10 +3046,7 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CARD_READER_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_C_APDU,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->c_apdu,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, perform_card_apdu_dataobjs, command, NULL);
 }
 
 static enum stk_command_parse_result parse_power_off_card(
@@ -3048,12 +3102,23 @@ static enum stk_command_parse_result parse_get_reader_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_desc timer_start_dataobjs[] = {
+	DATAOBJ(TIMER_ID, DATAOBJ_REQUIRED, timer_mgmt.timer_id),
+	DATAOBJ(TIMER_VALUE, DATAOBJ_FLAG_MANDATORY, timer_mgmt.timer_value),
+	{ }
+};
+
+static const struct dataobj_desc timer_mgmt_dataobjs[] = {
+	DATAOBJ(TIMER_ID, DATAOBJ_REQUIRED, timer_mgmt.timer_id),
+	DATAOBJ(TIMER_VALUE, 0, timer_mgmt.timer_value),
+	{ }
+};
+
 static enum stk_command_parse_result parse_timer_mgmt(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_timer_mgmt *obj = &command->timer_mgmt;
-	enum stk_data_object_flag value_flags = 0;
+	const struct dataobj_desc *desc = timer_mgmt_dataobjs;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3062,20 +3127,18 @@ static enum stk_command_parse_result parse_timer_mgmt(
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if ((command->qualifier & 3) == 0) /* Start a timer */
-		value_flags = DATAOBJ_FLAG_MANDATORY;
+		desc = timer_start_dataobjs;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TIMER_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->timer_id,
-				STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
-				&obj->timer_value,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, desc, command, NULL);
 }
 
-static void destroy_setup_idle_mode_text(struct stk_command *command)
-{
-	l_free(command->setup_idle_mode_text.text);
-}
+static const struct dataobj_desc setup_idle_mode_text_dataobjs[] = {
+	DATAOBJ(TEXT, DATAOBJ_REQUIRED, setup_idle_mode_text.text),
+	DATAOBJ(ICON_ID, 0, setup_idle_mode_text.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, setup_idle_mode_text.text_attr),
+	DATAOBJ(FRAME_ID, 0, setup_idle_mode_text.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_setup_idle_mode_text(
 					struct stk_command *command,
@@ -3091,29 +3154,22 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_setup_idle_mode_text;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, setup_idle_mode_text_dataobjs,
+				command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_run_at_command(struct stk_command *command)
-{
-	l_free(command->run_at_command.alpha_id);
-	l_free(command->run_at_command.at_command);
-}
+static const struct dataobj_desc run_at_command_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, run_at_command.alpha_id),
+	DATAOBJ(AT_COMMAND, DATAOBJ_REQUIRED, run_at_command.at_command),
+	DATAOBJ(ICON_ID, 0, run_at_command.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, run_at_command.text_attr),
+	DATAOBJ(FRAME_ID, 0, run_at_command.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_run_at_command(
 					struct stk_command *command,
@@ -3128,31 +3184,21 @@ static enum stk_command_parse_result parse_run_at_command(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_run_at_command;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_AT_COMMAND,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->at_command,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, run_at_command_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_send_dtmf(struct stk_command *command)
-{
-	l_free(command->send_dtmf.alpha_id);
-	l_free(command->send_dtmf.dtmf);
-}
+static const struct dataobj_desc send_dtmf_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, send_dtmf.alpha_id),
+	DATAOBJ(DTMF_STRING, DATAOBJ_REQUIRED, send_dtmf.dtmf),
+	DATAOBJ(ICON_ID, 0, send_dtmf.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, send_dtmf.text_attr),
+	DATAOBJ(FRAME_ID, 0, send_dtmf.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_send_dtmf(
 					struct stk_command *command,
@@ -3167,62 +3213,58 @@ static enum stk_command_parse_result parse_send_dtmf(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_send_dtmf;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_DTMF_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->dtmf,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, send_dtmf_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_desc language_notification_dataobjs[] = {
+	DATAOBJ(LANGUAGE, 0, language_notification.language),
+	{ }
+};
+
 static enum stk_command_parse_result parse_language_notification(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_language_notification *obj =
-					&command->language_notification;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
-				&obj->language,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
+	return parse_dataobj(iter, language_notification_dataobjs,
+				command, NULL);
+}
+
+static const struct dataobj_desc launch_browser_dataobjs[] = {
+	DATAOBJ(BROWSER_ID, 0, launch_browser.browser_id),
+	DATAOBJ(URL, DATAOBJ_REQUIRED, launch_browser.url),
+	DATAOBJ(BEARER, 0, launch_browser.bearer),
+	DATAOBJ(PROVISIONING_FILE_REF, DATAOBJ_FLAG_LIST,
+		launch_browser.prov_file_refs),
+	DATAOBJ(TEXT, 0, launch_browser.text_gateway_proxy_id),
+	DATAOBJ(ALPHA_ID, 0, launch_browser.alpha_id),
+	DATAOBJ(ICON_ID, 0, launch_browser.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, launch_browser.text_attr),
+	DATAOBJ(FRAME_ID, 0, launch_browser.frame_id),
+	DATAOBJ(NETWORK_ACCESS_NAME, 0, launch_browser.network_name),
+	DATAOBJ(TEXT, 0, launch_browser.text_usr),
+	DATAOBJ(TEXT, 0, launch_browser.text_passwd),
+	{ }
+};
 
 static void destroy_launch_browser(struct stk_command *command)
 {
-	l_free(command->launch_browser.url);
-	l_free(command->launch_browser.bearer.array);
-	l_queue_destroy(command->launch_browser.prov_file_refs, l_free);
-	l_free(command->launch_browser.text_gateway_proxy_id);
-	l_free(command->launch_browser.alpha_id);
-	l_free(command->launch_browser.network_name.array);
-	l_free(command->launch_browser.text_usr);
-	l_free(command->launch_browser.text_passwd);
+	l_queue_destroy(command->launch_browser.prov_file_refs, NULL);
 }
 
 static enum stk_command_parse_result parse_launch_browser(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_launch_browser *obj = &command->launch_browser;
-
 	if (command->qualifier > 3 || command->qualifier == 1)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3234,43 +3276,24 @@ static enum stk_command_parse_result parse_launch_browser(
 
 	command->destructor = destroy_launch_browser;
 
-	return parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
-				&obj->browser_id,
-				STK_DATA_OBJECT_TYPE_URL,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->url,
-				STK_DATA_OBJECT_TYPE_BEARER, 0,
-				&obj->bearer,
-				STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF,
-				DATAOBJ_FLAG_LIST,
-				&obj->prov_file_refs,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_gateway_proxy_id,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->network_name,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_INVALID);
-}
-
-static void destroy_open_channel(struct stk_command *command)
-{
-	l_free(command->open_channel.alpha_id);
-	l_free(command->open_channel.apn);
-	l_free(command->open_channel.text_usr);
-	l_free(command->open_channel.text_passwd);
-}
+	return parse_dataobj(iter, launch_browser_dataobjs, command, NULL);
+}
+
+static const struct dataobj_desc open_channel_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, open_channel.alpha_id),
+	DATAOBJ(ICON_ID, 0, open_channel.icon_id),
+	DATAOBJ(BEARER_DESCRIPTION, DATAOBJ_REQUIRED, open_channel.bearer_desc),
+	DATAOBJ(BUFFER_SIZE, DATAOBJ_REQUIRED, open_channel.buf_size),
+	DATAOBJ(NETWORK_ACCESS_NAME, 0, open_channel.apn),
+	DATAOBJ(OTHER_ADDRESS, 0, open_channel.local_addr),
+	DATAOBJ(TEXT, 0, open_channel.text_usr),
+	DATAOBJ(TEXT, 0, open_channel.text_passwd),
+	DATAOBJ(UICC_TE_INTERFACE, 0, open_channel.uti),
+	DATAOBJ(OTHER_ADDRESS, 0, open_channel.data_dest_addr),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, open_channel.text_attr),
+	DATAOBJ(FRAME_ID, 0, open_channel.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_open_channel(
 					struct stk_command *command,
@@ -3288,50 +3311,24 @@ static enum stk_command_parse_result parse_open_channel(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_open_channel;
-
 	/*
 	 * parse the Open Channel data objects related to packet data service
 	 * bearer
 	 */
-	status = parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->bearer_desc,
-				STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->buf_size,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->apn,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->local_addr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->uti,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->data_dest_addr,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, open_channel_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_close_channel(struct stk_command *command)
-{
-	l_free(command->close_channel.alpha_id);
-}
+static const struct dataobj_desc close_channel_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, close_channel.alpha_id),
+	DATAOBJ(ICON_ID, 0, close_channel.icon_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, close_channel.text_attr),
+	DATAOBJ(FRAME_ID, 0, close_channel.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_close_channel(
 					struct stk_command *command,
@@ -3347,27 +3344,21 @@ static enum stk_command_parse_result parse_close_channel(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CHANNEL_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_close_channel;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, close_channel_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_receive_data(struct stk_command *command)
-{
-	l_free(command->receive_data.alpha_id);
-}
+static const struct dataobj_desc receive_data_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, receive_data.alpha_id),
+	DATAOBJ(ICON_ID, 0, receive_data.icon_id),
+	DATAOBJ(CHANNEL_DATA_LENGTH, DATAOBJ_REQUIRED, receive_data.data_len),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, receive_data.text_attr),
+	DATAOBJ(FRAME_ID, 0, receive_data.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_receive_data(
 					struct stk_command *command,
@@ -3383,31 +3374,21 @@ static enum stk_command_parse_result parse_receive_data(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CHANNEL_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_receive_data;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data_len,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, receive_data_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
-static void destroy_send_data(struct stk_command *command)
-{
-	l_free(command->send_data.alpha_id);
-	l_free(command->send_data.data.array);
-}
+static const struct dataobj_desc send_data_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, send_data.alpha_id),
+	DATAOBJ(ICON_ID, 0, send_data.icon_id),
+	DATAOBJ(CHANNEL_DATA, DATAOBJ_REQUIRED, send_data.data),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, send_data.text_attr),
+	DATAOBJ(FRAME_ID, 0, send_data.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_send_data(
 					struct stk_command *command,
@@ -3426,20 +3407,7 @@ static enum stk_command_parse_result parse_send_data(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CHANNEL_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_send_data;
-
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, send_data_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3459,124 +3427,88 @@ static enum stk_command_parse_result parse_get_channel_status(
 	return STK_PARSE_RESULT_OK;
 }
 
-static void destroy_service_search(struct stk_command *command)
-{
-	l_free(command->service_search.alpha_id);
-	l_free(command->service_search.serv_search.ser_search);
-	l_free(command->service_search.dev_filter.dev_filter);
-}
+static const struct dataobj_desc service_search_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, service_search.alpha_id),
+	DATAOBJ(ICON_ID, 0, service_search.icon_id),
+	DATAOBJ(SERVICE_SEARCH, DATAOBJ_REQUIRED, service_search.serv_search),
+	DATAOBJ(DEVICE_FILTER, 0, service_search.dev_filter),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, service_search.text_attr),
+	DATAOBJ(FRAME_ID, 0, service_search.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_service_search(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_service_search *obj = &command->service_search;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_service_search;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_search,
-				STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
-				&obj->dev_filter,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, service_search_dataobjs, command, NULL);
 }
 
-static void destroy_get_service_info(struct stk_command *command)
-{
-	l_free(command->get_service_info.alpha_id);
-	l_free(command->get_service_info.attr_info.attr_info);
-}
+static const struct dataobj_desc get_service_info_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, get_service_info.alpha_id),
+	DATAOBJ(ICON_ID, 0, get_service_info.icon_id),
+	DATAOBJ(ATTRIBUTE_INFO, DATAOBJ_REQUIRED, get_service_info.attr_info),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, get_service_info.text_attr),
+	DATAOBJ(FRAME_ID, 0, get_service_info.frame_id),
+	{ }
+};
 
 static enum stk_command_parse_result parse_get_service_info(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_get_service_info *obj = &command->get_service_info;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_get_service_info;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->attr_info,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, get_service_info_dataobjs, command, NULL);
 }
 
-static void destroy_declare_service(struct stk_command *command)
-{
-	l_free(command->declare_service.serv_rec.serv_rec);
-}
+static const struct dataobj_desc declare_service_dataobjs[] = {
+	DATAOBJ(SERVICE_RECORD, DATAOBJ_REQUIRED, declare_service.serv_rec),
+	DATAOBJ(UICC_TE_INTERFACE, 0, declare_service.intf),
+	{ }
+};
 
 static enum stk_command_parse_result parse_declare_service(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_declare_service *obj = &command->declare_service;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	command->destructor = destroy_declare_service;
-
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_rec,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->intf,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, declare_service_dataobjs, command, NULL);
 }
 
+static const struct dataobj_desc set_frames_dataobjs[] = {
+	DATAOBJ(FRAME_ID, DATAOBJ_REQUIRED, set_frames.frame_id),
+	DATAOBJ(FRAME_LAYOUT, 0, set_frames.frame_layout),
+	DATAOBJ(FRAME_ID, 0, set_frames.frame_id_default),
+	{ }
+};
+
 static enum stk_command_parse_result parse_set_frames(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_set_frames *obj = &command->set_frames;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FRAME_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
-				&obj->frame_layout,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id_default,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, set_frames_dataobjs, command, NULL);
 }
 
 static enum stk_command_parse_result parse_get_frames_status(
@@ -3592,9 +3524,20 @@ static enum stk_command_parse_result parse_get_frames_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_desc retrieve_mms_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, retrieve_mms.alpha_id),
+	DATAOBJ(ICON_ID, 0, retrieve_mms.icon_id),
+	DATAOBJ(MMS_REFERENCE, DATAOBJ_REQUIRED, retrieve_mms.mms_ref),
+	DATAOBJ(FILE_LIST, DATAOBJ_REQUIRED, retrieve_mms.mms_rec_files),
+	DATAOBJ(MMS_CONTENT_ID, DATAOBJ_REQUIRED, retrieve_mms.mms_content_id),
+	DATAOBJ(MMS_ID, 0, retrieve_mms.mms_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, retrieve_mms.text_attr),
+	DATAOBJ(FRAME_ID, 0, retrieve_mms.frame_id),
+	{ }
+};
+
 static void destroy_retrieve_mms(struct stk_command *command)
 {
-	l_free(command->retrieve_mms.alpha_id);
 	l_queue_destroy(command->retrieve_mms.mms_rec_files, l_free);
 }
 
@@ -3613,35 +3556,25 @@ static enum stk_command_parse_result parse_retrieve_mms(
 
 	command->destructor = destroy_retrieve_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_ref,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_rec_files,
-				STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_content_id,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, retrieve_mms_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_desc submit_mms_dataobjs[] = {
+	DATAOBJ(ALPHA_ID, 0, submit_mms.alpha_id),
+	DATAOBJ(ICON_ID, 0, submit_mms.icon_id),
+	DATAOBJ(FILE_LIST, DATAOBJ_REQUIRED, submit_mms.mms_subm_files),
+	DATAOBJ(MMS_ID, 0, submit_mms.mms_id),
+	DATAOBJ(TEXT_ATTRIBUTE, 0, submit_mms.text_attr),
+	DATAOBJ(FRAME_ID, 0, submit_mms.frame_id),
+	{ }
+};
+
 static void destroy_submit_mms(struct stk_command *command)
 {
-	l_free(command->submit_mms.alpha_id);
 	l_queue_destroy(command->submit_mms.mms_subm_files, l_free);
 }
 
@@ -3660,26 +3593,21 @@ static enum stk_command_parse_result parse_submit_mms(
 
 	command->destructor = destroy_submit_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, submit_mms_dataobjs, command, NULL);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_desc display_mms_dataobjs[] = {
+	DATAOBJ(FILE_LIST, DATAOBJ_REQUIRED, display_mms.mms_subm_files),
+	DATAOBJ(MMS_ID, DATAOBJ_REQUIRED, display_mms.mms_id),
+	DATAOBJ(IMMEDIATE_RESPONSE, 0, display_mms.imd_resp),
+	DATAOBJ(FRAME_ID, 0, display_mms.frame_id),
+	{ }
+};
+
 static void destroy_display_mms(struct stk_command *command)
 {
 	l_queue_destroy(command->display_mms.mms_subm_files, l_free);
@@ -3689,8 +3617,6 @@ static enum stk_command_parse_result parse_display_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_display_mms *obj = &command->display_mms;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3699,35 +3625,25 @@ static enum stk_command_parse_result parse_display_mms(
 
 	command->destructor = destroy_display_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->imd_resp,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, display_mms_dataobjs, command, NULL);
 }
 
+static const struct dataobj_desc activate_dataobjs[] = {
+	DATAOBJ(ACTIVATE_DESCRIPTOR, DATAOBJ_REQUIRED, activate.actv_desc),
+	{ }
+};
+
 static enum stk_command_parse_result parse_activate(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_activate *obj = &command->activate;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->actv_desc,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, activate_dataobjs, command, NULL);
 }
 
 static enum stk_command_parse_result parse_command_body(
@@ -3827,6 +3743,7 @@ struct stk_command *stk_command_new_from_pdu(const uint8_t *pdu,
 	struct comprehension_tlv_iter iter;
 	const uint8_t *data;
 	struct stk_command *command;
+	struct stk_arena *arena;
 
 	ber_tlv_iter_init(&ber, pdu, len);
 
@@ -3855,7 +3772,9 @@ struct stk_command *stk_command_new_from_pdu(const uint8_t *pdu,
 
 	data = comprehension_tlv_iter_get_data(&iter);
 
-	command = g_new0(struct stk_command, 1);
+	arena = stk_arena_new(STK_ARENA_BLOCK_SIZE);
+	command = stk_arena_alloc0(arena, sizeof(struct stk_command));
+	command->arena = arena;
 
 	command->number = data[0];
 	command->type = data[1];
@@ -3893,7 +3812,7 @@ void stk_command_free(struct stk_command *command)
 	if (command->destructor)
 		command->destructor(command);
 
-	g_free(command);
+	stk_arena_free(command->arena);
 }
 
 static bool stk_tlv_builder_init(struct stk_tlv_builder *iter,
@@ -3924,22 +3843,36 @@ static bool stk_tlv_builder_open_container(struct stk_tlv_builder *iter,
 						uint8_t shorttag,
 						bool relocatable)
 {
+	unsigned int room;
+
 	if (comprehension_tlv_builder_next(&iter->ctlv, cr, shorttag) != TRUE)
 		return false;
 
+	/*
+	 * The value is always placed after a short form length, which is
+	 * all that most objects need, so that closing the container does
+	 * not have to move it.  Relocatable ones may still grow past 0x7f
+	 * bytes, as long as there is room to shift them up by one byte.
+	 */
 	iter->len = 0;
-	iter->max_len = relocatable ? 0xff : 0x7f;
-	if (comprehension_tlv_builder_set_length(&iter->ctlv, iter->max_len) !=
-			TRUE)
+	if (comprehension_tlv_builder_set_length(&iter->ctlv, 0x7f) != TRUE)
 		return false;
 
 	iter->value = comprehension_tlv_builder_get_data(&iter->ctlv);
+	iter->max_len = 0x7f;
+
+	room = iter->ctlv.max - (iter->value - iter->ctlv.pdu);
+	if (relocatable && room > 0x80)
+		iter->max_len = MIN(room - 1, 0xff);
 
 	return true;
 }
 
 static bool stk_tlv_builder_close_container(struct stk_tlv_builder *iter)
 {
+	/* Everything appended is moved if a long form length is needed */
+	iter->ctlv.len = iter->len;
+
 	return comprehension_tlv_builder_set_length(&iter->ctlv, iter->len);
 }
 
@@ -3970,30 +3903,60 @@ static bool stk_tlv_builder_append_short(struct stk_tlv_builder *iter,
 	return true;
 }
 
+/*
+ * Encodes UTF-8 text as UCS2 big endian following the rules of
+ * l_utf8_to_ucs2be.  Only whole characters that fit in size bytes are
+ * written, the length of the complete encoding or -1 is returned.
+ */
+static long utf8_to_ucs2be_own_buf(const char *text, uint8_t *buf,
+					size_t size)
+{
+	long res_length = 0;
+	wchar_t c;
+	int nread;
+
+	if (text == NULL)
+		return -1;
+
+	for (; *text; text += nread) {
+		nread = l_utf8_get_codepoint(text, 4, &c);
+		if (nread < 0 || c >= 0x10000)
+			return -1;
+
+		if ((size_t) res_length + 2 <= size)
+			l_put_be16(c, buf + res_length);
+
+		res_length += 2;
+	}
+
+	return res_length;
+}
+
+/*
+ * The text encoders below write straight into the open container, after the
+ * DCS byte, and only commit the DCS and length once the text is known to fit
+ */
 static bool stk_tlv_builder_append_gsm_packed(struct stk_tlv_builder *iter,
 							const char *text)
 {
-	unsigned int len;
-	uint8_t *gsm;
+	uint8_t gsm[256 * 8 / 7 + 1];
+	long len;
 	long written = 0;
 
 	if (text == NULL)
 		return true;
 
-	len = strlen(text);
-
-	gsm = convert_utf8_to_gsm(text, len, NULL, &written, 0);
-	if (gsm == NULL && len > 0)
+	len = convert_utf8_to_gsm_own_buf(text, -1, NULL, GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						gsm, sizeof(gsm));
+	if (len < 0 || len > (long) sizeof(gsm))
 		return false;
 
-	if (iter->len + (written * 7 + 7) / 8 >= iter->max_len) {
-		l_free(gsm);
+	if (iter->len + (len * 7 + 7) / 8 >= iter->max_len)
 		return false;
-	}
 
 	pack_7bit_own_buf(gsm, len, 0, false, &written, 0,
 				iter->value + iter->len + 1);
-	l_free(gsm);
 
 	if (written < 1 && len > 0)
 		return false;
@@ -4007,29 +3970,23 @@ static bool stk_tlv_builder_append_gsm_packed(struct stk_tlv_builder *iter,
 static bool stk_tlv_builder_append_gsm_unpacked(struct stk_tlv_builder *iter,
 						const char *text)
 {
-	unsigned int len;
-	uint8_t *gsm;
-	long written = 0;
+	long len;
 
 	if (text == NULL)
 		return true;
 
-	len = strlen(text);
-
-	gsm = convert_utf8_to_gsm(text, len, NULL, &written, 0);
-	if (gsm == NULL && len > 0)
+	if (iter->len >= iter->max_len)
 		return false;
 
-	if (iter->len + written >= iter->max_len) {
-		l_free(gsm);
+	len = convert_utf8_to_gsm_own_buf(text, -1, NULL, GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						iter->value + iter->len + 1,
+						iter->max_len - iter->len - 1);
+	if (len < 0 || iter->len + len >= iter->max_len)
 		return false;
-	}
 
 	iter->value[iter->len++] = 0x04;
-	memcpy(iter->value + iter->len, gsm, written);
-	iter->len += written;
-
-	l_free(gsm);
+	iter->len += len;
 
 	return true;
 }
@@ -4037,23 +3994,18 @@ static bool stk_tlv_builder_append_gsm_unpacked(struct stk_tlv_builder *iter,
 static bool stk_tlv_builder_append_ucs2(struct stk_tlv_builder *iter,
 						const char *text)
 {
-	L_AUTO_FREE_VAR(uint8_t *, ucs2);
-	size_t ucs2_len;
+	long len;
 
-	ucs2 = l_utf8_to_ucs2be(text, &ucs2_len);
-	if (!ucs2)
+	if (iter->len >= iter->max_len)
 		return false;
 
-	/* Don't include terminating NULL */
-	ucs2_len -= 2;
-
-	if (iter->len + ucs2_len >= iter->max_len)
+	len = utf8_to_ucs2be_own_buf(text, iter->value + iter->len + 1,
+					iter->max_len - iter->len - 1);
+	if (len < 0 || iter->len + len >= iter->max_len)
 		return false;
 
 	iter->value[iter->len++] = 0x08;
-
-	memcpy(iter->value + iter->len, ucs2, ucs2_len);
-	iter->len += ucs2_len;
+	iter->len += len;
 
 	return true;
 }
@@ -4121,8 +4073,8 @@ static bool build_dataobj_alpha_id(struct stk_tlv_builder *tlv,
 					const void *data, bool cr)
 {
 	uint8_t tag = STK_DATA_OBJECT_TYPE_ALPHA_ID;
-	int len;
-	uint8_t *string;
+	uint8_t string[256];
+	long len;
 
 	if (data == NULL)
 		return true;
@@ -4131,8 +4083,21 @@ static bool build_dataobj_alpha_id(struct stk_tlv_builder *tlv,
 		return stk_tlv_builder_open_container(tlv, cr, tag, false) &&
 			stk_tlv_builder_close_container(tlv);
 
-	string = utf8_to_sim_string(data, -1, &len);
-	if (string == NULL)
+	/* Same coding as utf8_to_sim_string: GSM if possible, else UCS2 */
+	len = convert_utf8_to_gsm_own_buf(data, -1, NULL, GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						string, sizeof(string));
+	if (len < 0) {
+		string[0] = 0x80;
+		len = utf8_to_ucs2be_own_buf(data, string + 1,
+						sizeof(string) - 1);
+		if (len < 0)
+			return false;
+
+		len += 1;
+	}
+
+	if (len > (long) sizeof(string))
 		return false;
 
 	return stk_tlv_builder_open_container(tlv, cr, tag, true) &&
@@ -4386,14 +4351,13 @@ static bool build_dataobj_file_list(struct stk_tlv_builder *tlv,
 static bool build_dataobj_file(struct stk_tlv_builder *tlv,
 					const void *data, bool cr)
 {
-	struct l_queue *fl = l_queue_new();
-	bool ret;
-
-	l_queue_push_tail(fl, (void *) data);
-	ret = build_dataobj_file_list(tlv, fl, cr);
+	const struct stk_file *file = data;
+	uint8_t tag = STK_DATA_OBJECT_TYPE_FILE_LIST;
 
-	l_queue_destroy(fl, NULL);
-	return ret;
+	return stk_tlv_builder_open_container(tlv, cr, tag, true) &&
+		stk_tlv_builder_append_byte(tlv, 1) &&
+		stk_tlv_builder_append_bytes(tlv, file->file, file->len) &&
+		stk_tlv_builder_close_container(tlv);
 }
 
 /* Described in TS 102.223 Section 8.19 */
@@ -5251,23 +5215,25 @@ static bool build_dataobj_registry_application_data(
 	const struct stk_registry_application_data *rad = data;
 	uint8_t tag = STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA;
 	uint8_t dcs;
-	L_AUTO_FREE_VAR(uint8_t *, name);
-	size_t len;
-	long gsmlen;
+	uint8_t name[256];
+	long len;
 
-	name = convert_utf8_to_gsm(rad->name, -1, NULL, &gsmlen, 0);
-	len = gsmlen;
+	len = convert_utf8_to_gsm_own_buf(rad->name, -1, NULL,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						name, sizeof(name));
 	dcs = 0x04;
-	if (!name) {
-		name = l_utf8_to_ucs2be(rad->name, &len);
-		if (!name)
+	if (len < 0) {
+		len = utf8_to_ucs2be_own_buf(rad->name, name, sizeof(name));
+		if (len < 0)
 			return false;
 
-		/* len includes null terminator, so strip it */
-		len -= 2;
 		dcs = 0x08;
 	}
 
+	if (len > (long) sizeof(name))
+		return false;
+
 	return stk_tlv_builder_open_container(tlv, cr, tag, true) &&
 		stk_tlv_builder_append_short(tlv, rad->port) &&
 		stk_tlv_builder_append_byte(tlv, dcs) &&
@@ -6400,19 +6366,43 @@ static const char chars_table[] = {
 	'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p',
 	'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '+', '.' };
 
-char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
-			enum stk_img_scheme scheme, const uint8_t *clut,
-			uint16_t clut_len)
+#define STK_IMAGE_SERIAL_VERSION	1
+#define STK_IMAGE_SERIAL_HEADER		7
+
+static struct stk_image *stk_image_new(uint8_t width, uint8_t height,
+					uint8_t nbits, uint16_t ncolors)
+{
+	size_t pixels_len = (width * height * nbits + 7) / 8;
+	struct stk_image *image;
+
+	image = l_malloc(sizeof(struct stk_image) + ncolors * 3 + pixels_len);
+	image->width = width;
+	image->height = height;
+	image->nbits = nbits;
+	image->transparency = false;
+	image->ncolors = ncolors;
+	image->palette = (uint8_t *) (image + 1);
+	image->pixels = image->palette + ncolors * 3;
+
+	return image;
+}
+
+static size_t stk_image_pixels_len(const struct stk_image *image)
+{
+	return (image->width * image->height * image->nbits + 7) / 8;
+}
+
+struct stk_image *stk_image_decode(const uint8_t *img, unsigned int len,
+					enum stk_img_scheme scheme,
+					const uint8_t *clut, uint16_t clut_len)
 {
+	static const uint8_t basic_palette[] = {
+		0x00, 0x00, 0x00, 0xff, 0xff, 0xff
+	};
+	struct stk_image *image;
 	uint8_t width, height;
-	unsigned int ncolors, nbits, entry, cpp;
-	unsigned int i, j;
-	int bit, k;
-	struct l_string *xpm;
+	unsigned int ncolors, nbits;
 	unsigned int pos = 0;
-	const char xpm_header[] = "/* XPM */\n";
-	const char declaration[] = "static char *xpm[] = {\n";
-	char c[3];
 
 	if (img == NULL)
 		return NULL;
@@ -6427,6 +6417,7 @@ char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 	if (scheme == STK_IMG_SCHEME_BASIC) {
 		nbits = 1;
 		ncolors = 2;
+		clut = basic_palette;
 	} else {
 		/* sanity check length */
 		if ((pos + 4 > len) || (clut == NULL))
@@ -6444,11 +6435,97 @@ char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 
 		if ((ncolors * 3) > clut_len)
 			return NULL;
+
+		/* 1 to 8 bits per raster image point */
+		if (nbits == 0 || nbits > 8)
+			return NULL;
 	}
 
-	if (pos + ((width * height + 7) / 8) > len)
+	if (pos + (width * height * nbits + 7) / 8 > len)
+		return NULL;
+
+	image = stk_image_new(width, height, nbits, ncolors);
+	image->transparency = scheme == STK_IMG_SCHEME_TRANSPARENCY;
+	memcpy(image->palette, clut, ncolors * 3);
+	memcpy(image->pixels, img + pos, stk_image_pixels_len(image));
+
+	return image;
+}
+
+/*
+ * Flat form of an stk_image: a version byte, width, height, nbits, a flags
+ * byte, ncolors in network order, then the palette and packed pixels.
+ */
+uint8_t *stk_image_serialize(const struct stk_image *image, size_t *out_len)
+{
+	size_t pixels_len = stk_image_pixels_len(image);
+	size_t len = STK_IMAGE_SERIAL_HEADER + image->ncolors * 3 + pixels_len;
+	uint8_t *buf = l_malloc(len);
+
+	buf[0] = STK_IMAGE_SERIAL_VERSION;
+	buf[1] = image->width;
+	buf[2] = image->height;
+	buf[3] = image->nbits;
+	buf[4] = image->transparency ? 0x01 : 0x00;
+	l_put_be16(image->ncolors, buf + 5);
+	memcpy(buf + STK_IMAGE_SERIAL_HEADER, image->palette,
+		image->ncolors * 3);
+	memcpy(buf + STK_IMAGE_SERIAL_HEADER + image->ncolors * 3,
+		image->pixels, pixels_len);
+
+	*out_len = len;
+
+	return buf;
+}
+
+struct stk_image *stk_image_deserialize(const uint8_t *data, size_t len)
+{
+	struct stk_image *image;
+	uint16_t ncolors;
+
+	if (len < STK_IMAGE_SERIAL_HEADER ||
+			data[0] != STK_IMAGE_SERIAL_VERSION)
+		return NULL;
+
+	ncolors = l_get_be16(data + 5);
+
+	if (data[3] == 0 || data[3] > 8 || ncolors == 0 || ncolors > 256)
 		return NULL;
 
+	image = stk_image_new(data[1], data[2], data[3], ncolors);
+	image->transparency = data[4] & 0x01;
+
+	if (len != STK_IMAGE_SERIAL_HEADER + ncolors * 3 +
+					stk_image_pixels_len(image)) {
+		l_free(image);
+		return NULL;
+	}
+
+	memcpy(image->palette, data + STK_IMAGE_SERIAL_HEADER, ncolors * 3);
+	memcpy(image->pixels, data + STK_IMAGE_SERIAL_HEADER + ncolors * 3,
+		stk_image_pixels_len(image));
+
+	return image;
+}
+
+void stk_image_free(struct stk_image *image)
+{
+	l_free(image);
+}
+
+char *stk_image_xpm(const struct stk_image *image)
+{
+	unsigned int ncolors = image->ncolors;
+	const uint8_t *palette = image->palette;
+	const uint8_t *pixels = image->pixels;
+	unsigned int entry, cpp;
+	unsigned int i, j;
+	int bit, k;
+	struct l_string *xpm;
+	const char xpm_header[] = "/* XPM */\n";
+	const char declaration[] = "static char *xpm[] = {\n";
+	char c[3];
+
 	/* determine the number of chars need to represent the pixel */
 	cpp = ncolors > 64 ? 2 : 1;
 
@@ -6463,56 +6540,50 @@ char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 	 */
 	xpm = l_string_new(strlen(xpm_header) + strlen(declaration) +
 				19 + ((cpp + 14) * ncolors) +
-				(width * height * cpp) + (4 * height) + 2);
+				(image->width * image->height * cpp) +
+				(4 * image->height) + 2);
 
 	/* add header, declaration, values */
 	l_string_append(xpm, xpm_header);
 	l_string_append(xpm, declaration);
-	l_string_append_printf(xpm, "\"%d %d %d %d\",\n", width, height,
-				ncolors, cpp);
+	l_string_append_printf(xpm, "\"%d %d %d %d\",\n", image->width,
+				image->height, ncolors, cpp);
 
 	/* create colors */
-	if (scheme == STK_IMG_SCHEME_BASIC) {
-		l_string_append(xpm, "\"0\tc #000000\",\n");
-		l_string_append(xpm, "\"1\tc #FFFFFF\",\n");
-	} else {
-		for (i = 0; i < ncolors; i++) {
-			/* lookup char representation of this number */
-			if (ncolors > 64) {
-				c[0] = chars_table[i / 64];
-				c[1] = chars_table[i % 64];
-				c[2] = '\0';
-			} else {
-				c[0] = chars_table[i % 64];
-				c[1] = '\0';
-			}
+	for (i = 0; i < ncolors; i++) {
+		/* lookup char representation of this number */
+		if (ncolors > 64) {
+			c[0] = chars_table[i / 64];
+			c[1] = chars_table[i % 64];
+			c[2] = '\0';
+		} else {
+			c[0] = chars_table[i % 64];
+			c[1] = '\0';
+		}
 
-			if ((i == (ncolors - 1)) &&
-					scheme == STK_IMG_SCHEME_TRANSPARENCY)
-				l_string_append_printf(xpm,
-					"\"%s\tc None\",\n", c);
-			else
-				l_string_append_printf(xpm,
+		if (i == (ncolors - 1) && image->transparency)
+			l_string_append_printf(xpm, "\"%s\tc None\",\n", c);
+		else
+			l_string_append_printf(xpm,
 					"\"%s\tc #%02hhX%02hhX%02hhX\",\n",
-					c, clut[0], clut[1], clut[2]);
-			clut += 3;
-		}
+					c, palette[0], palette[1], palette[2]);
+		palette += 3;
 	}
 
 	/* height rows of width pixels */
 	k = 7;
-	for (i = 0; i < height; i++) {
+	for (i = 0; i < image->height; i++) {
 		l_string_append(xpm, "\"");
-		for (j = 0; j < width; j++) {
+		for (j = 0; j < image->width; j++) {
 			entry = 0;
-			for (bit = nbits - 1; bit >= 0; bit--) {
-				entry |= (img[pos] >> k & 0x1) << bit;
+			for (bit = image->nbits - 1; bit >= 0; bit--) {
+				entry |= (*pixels >> k & 0x1) << bit;
 				k--;
 
 				/* see if we crossed a byte boundary */
 				if (k < 0) {
 					k = 7;
-					pos++;
+					pixels++;
 				}
 			}
 
@@ -6526,7 +6597,7 @@ char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 				c[1] = '\0';
 			}
 
-			l_string_append_printf(xpm, "%s", c);
+			l_string_append(xpm, c);
 		}
 
 		l_string_append(xpm, "\",\n");
@@ -6537,3 +6608,20 @@ char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 	/* Caller must free char data */
 	return l_string_unwrap(xpm);
 }
+
+char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
+			enum stk_img_scheme scheme, const uint8_t *clut,
+			uint16_t clut_len)
+{
+	struct stk_image *image;
+	char *xpm;
+
+	image = stk_image_decode(img, len, scheme, clut, clut_len);
+	if (image == NULL)
+		return NULL;
+
+	xpm = stk_image_xpm(image);
+	stk_image_free(image);
+
+	return xpm;
+}
@@ -6,6 +6,7 @@
  */
 
 struct l_queue;
+struct stk_arena;
 
 /*
  * TS 101.220, Section 7.2, Card Application Toolkit assigned templates,
@@ -1436,6 +1437,7 @@ struct stk_command {
 	};
 
 	void (*destructor)(struct stk_command *command);
+	struct stk_arena *arena;
 };
 
 /* TERMINAL RESPONSEs defined in TS 102.223 Section 6.8 */
@@ -1768,6 +1770,30 @@ const uint8_t *stk_pdu_from_response(const struct stk_response *response,
 const uint8_t *stk_pdu_from_envelope(const struct stk_envelope *envelope,
 						unsigned int *out_length);
 char *stk_text_to_html(const char *text, const uint16_t *attrs, int num_attrs);
+
+/*
+ * Decoded EFimg image instance.  palette holds ncolors RGB triplets and
+ * pixels the width * height palette indexes of nbits each, packed MSB
+ * first as they are stored in EFiidf.  With transparency set the last
+ * palette entry is transparent.
+ */
+struct stk_image {
+	uint8_t width;
+	uint8_t height;
+	uint8_t nbits;
+	bool transparency;
+	uint16_t ncolors;
+	uint8_t *palette;
+	uint8_t *pixels;
+};
+
+struct stk_image *stk_image_decode(const uint8_t *img, unsigned int len,
+					enum stk_img_scheme scheme,
+					const uint8_t *clut, uint16_t clut_len);
+uint8_t *stk_image_serialize(const struct stk_image *image, size_t *out_len);
+struct stk_image *stk_image_deserialize(const uint8_t *data, size_t len);
+void stk_image_free(struct stk_image *image);
+char *stk_image_xpm(const struct stk_image *image);
 char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 			enum stk_img_scheme scheme, const uint8_t *clut,
 			uint16_t clut_len);
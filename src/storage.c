@@ -18,6 +18,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
+#include <time.h>
 
 #include <glib.h>
 #include <ell/ell.h>
@@ -136,16 +138,317 @@ char *storage_get_file_path(const char *imsi, const char *store)
 		return l_strdup_printf(STORAGEDIR "/%s", store);
 }
 
+/* FNV-1a, enough to catch torn and corrupted writes */
+static uint32_t storage_checksum(const unsigned char *data, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Binary keyfile format: a 16 byte header holding a magic, the format
+ * version, the number of records and a checksum over the records that
+ * follow.  A group record is a type byte, a le16 length and the group
+ * name.  A key record is a type byte, a le16 key length, a le32 value
+ * length, the key and the raw (still escaped) value, so that loading it
+ * back is a plain g_key_file_set_value() without any parsing.
+ */
+#define KEYFILE_MAGIC		"OFKB"
+#define KEYFILE_VERSION		1
+#define KEYFILE_HEADER_LEN	16
+#define KEYFILE_SUFFIX		".bin"
+#define KEYFILE_GROUP		'G'
+#define KEYFILE_KEY		'K'
+
+static bool binary_keyfiles;
+
+/*
+ * Selects the format settings are written in.  Files in the other format
+ * are converted as they are opened, so switching either way is lossless
+ * apart from comments.
+ */
+void storage_set_binary_keyfiles(bool enable)
+{
+	binary_keyfiles = enable;
+}
+
+static void keyfile_put_record(GByteArray *buf, uint8_t type,
+				const char *str, const char *value)
+{
+	size_t str_len = strlen(str);
+	size_t value_len = value ? strlen(value) : 0;
+	unsigned char hdr[7];
+	size_t hdr_len = 3;
+
+	hdr[0] = type;
+	l_put_le16(str_len, hdr + 1);
+
+	if (type == KEYFILE_KEY) {
+		l_put_le32(value_len, hdr + 3);
+		hdr_len += 4;
+	}
+
+	g_byte_array_append(buf, hdr, hdr_len);
+	g_byte_array_append(buf, (const guint8 *) str, str_len);
+
+	if (value_len)
+		g_byte_array_append(buf, (const guint8 *) value, value_len);
+}
+
+static GByteArray *keyfile_to_binary(GKeyFile *keyfile)
+{
+	GByteArray *buf = g_byte_array_new();
+	unsigned char hdr[KEYFILE_HEADER_LEN] = { 0 };
+	uint32_t n_records = 0;
+	char **groups = g_key_file_get_groups(keyfile, NULL);
+	int i, j;
+
+	g_byte_array_append(buf, hdr, sizeof(hdr));
+
+	for (i = 0; groups[i]; i++) {
+		char **keys = g_key_file_get_keys(keyfile, groups[i],
+							NULL, NULL);
+
+		if (strlen(groups[i]) > UINT16_MAX)
+			goto next;
+
+		keyfile_put_record(buf, KEYFILE_GROUP, groups[i], NULL);
+		n_records += 1;
+
+		for (j = 0; keys && keys[j]; j++) {
+			char *value = g_key_file_get_value(keyfile, groups[i],
+								keys[j], NULL);
+
+			if (value && strlen(keys[j]) <= UINT16_MAX) {
+				keyfile_put_record(buf, KEYFILE_KEY, keys[j],
+							value);
+				n_records += 1;
+			}
+
+			g_free(value);
+		}
+next:
+		g_strfreev(keys);
+	}
+
+	g_strfreev(groups);
+
+	memcpy(buf->data, KEYFILE_MAGIC, 4);
+	buf->data[4] = KEYFILE_VERSION;
+	l_put_le32(n_records, buf->data + 8);
+	l_put_le32(storage_checksum(buf->data + KEYFILE_HEADER_LEN,
+					buf->len - KEYFILE_HEADER_LEN),
+			buf->data + 12);
+
+	return buf;
+}
+
+static bool keyfile_from_binary(GKeyFile *keyfile, const unsigned char *data,
+				size_t size)
+{
+	const char *group = NULL;
+	uint32_t n_records;
+	size_t pos = KEYFILE_HEADER_LEN;
+	_auto_(l_free) char *group_buf = NULL;
+
+	if (size < KEYFILE_HEADER_LEN || memcmp(data, KEYFILE_MAGIC, 4) ||
+			data[4] != KEYFILE_VERSION)
+		return false;
+
+	if (l_get_le32(data + 12) != storage_checksum(data + pos, size - pos))
+		return false;
+
+	for (n_records = l_get_le32(data + 8); n_records; n_records--) {
+		bool is_key;
+		size_t str_len, value_len = 0, hdr_len = 3;
+		_auto_(l_free) char *key = NULL;
+		_auto_(l_free) char *value = NULL;
+
+		if (size - pos < hdr_len)
+			return false;
+
+		is_key = data[pos] == KEYFILE_KEY;
+		str_len = l_get_le16(data + pos + 1);
+
+		if (is_key) {
+			hdr_len += 4;
+
+			if (size - pos < hdr_len || !group)
+				return false;
+
+			value_len = l_get_le32(data + pos + 3);
+		} else if (data[pos] != KEYFILE_GROUP)
+			return false;
+
+		if (size - pos - hdr_len < str_len ||
+				size - pos - hdr_len - str_len < value_len)
+			return false;
+
+		pos += hdr_len;
+
+		if (!is_key) {
+			l_free(group_buf);
+			group_buf = l_strndup((const char *) data + pos,
+						str_len);
+			group = group_buf;
+			pos += str_len;
+			continue;
+		}
+
+		key = l_strndup((const char *) data + pos, str_len);
+		value = l_strndup((const char *) data + pos + str_len,
+					value_len);
+		pos += str_len + value_len;
+
+		g_key_file_set_value(keyfile, group, key, value);
+	}
+
+	return pos == size;
+}
+
+/* Read in one go, the files are too small for mapping them to pay off */
+static GKeyFile *keyfile_load_binary(const char *path)
+{
+	_auto_(l_free) char *bin_path = l_strdup_printf("%s" KEYFILE_SUFFIX,
+								path);
+	GKeyFile *keyfile;
+	unsigned char *data;
+	size_t size = 0;
+	bool r;
+
+	data = l_file_get_contents(bin_path, &size);
+	if (!data)
+		return NULL;
+
+	keyfile = g_key_file_new();
+	r = keyfile_from_binary(keyfile, data, size);
+	l_free(data);
+
+	if (r)
+		return keyfile;
+
+	l_error("Ignoring corrupted settings in %s", bin_path);
+	g_key_file_free(keyfile);
+
+	return NULL;
+}
+
+/*
+ * Settings are written back after STORAGE_SYNC_DELAY, so that a burst of
+ * property changes on the same keyfile costs a single rewrite.  The
+ * keyfile is owned by the caller, storage_close() writes out anything
+ * still pending before it goes away.
+ */
+#define STORAGE_SYNC_DELAY 2
+
+struct pending_sync {
+	char *path;
+	GKeyFile *keyfile;
+};
+
+static struct l_queue *pending_syncs;
+static struct l_timeout *sync_timeout;
+static unsigned int syncs_coalesced;
+
+static void keyfile_write(const char *path, GKeyFile *keyfile)
+{
+	char *data;
+	gsize length = 0;
+
+	if (create_dirs(path) != 0)
+		return;
+
+	if (binary_keyfiles) {
+		_auto_(l_free) char *bin_path =
+				l_strdup_printf("%s" KEYFILE_SUFFIX, path);
+		GByteArray *buf = keyfile_to_binary(keyfile);
+
+		if (l_file_set_contents(bin_path, buf->data, buf->len) == 0)
+			unlink(path);
+
+		g_byte_array_unref(buf);
+		return;
+	}
+
+	data = g_key_file_to_data(keyfile, &length, NULL);
+
+	if (g_file_set_contents(path, data, length, NULL)) {
+		char *bin_path = l_strdup_printf("%s" KEYFILE_SUFFIX, path);
+
+		unlink(bin_path);
+		l_free(bin_path);
+	}
+
+	g_free(data);
+}
+
+static void pending_sync_flush(void *data)
+{
+	struct pending_sync *pending = data;
+
+	keyfile_write(pending->path, pending->keyfile);
+
+	l_free(pending->path);
+	l_free(pending);
+}
+
+static bool pending_sync_match_keyfile(const void *a, const void *b)
+{
+	const struct pending_sync *pending = a;
+
+	return pending->keyfile == b;
+}
+
+static bool pending_sync_match_path(const void *a, const void *b)
+{
+	const struct pending_sync *pending = a;
+
+	return !strcmp(pending->path, b);
+}
+
+static void sync_timeout_cb(struct l_timeout *timeout, void *user_data)
+{
+	storage_flush_all();
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
 	GKeyFile *keyfile;
+	struct pending_sync *pending;
 	char *path = storage_get_file_path(imsi, store);
 
 	if (!path)
 		return NULL;
 
-	keyfile = g_key_file_new();
-	g_key_file_load_from_file(keyfile, path, 0, NULL);
+	/* Don't load a file that is older than a keyfile still in memory */
+	while ((pending = l_queue_remove_if(pending_syncs,
+						pending_sync_match_path, path)))
+		pending_sync_flush(pending);
+
+	/*
+	 * Whichever format is found is loaded, a file in the other format
+	 * than the configured one is converted straight away.
+	 */
+	keyfile = keyfile_load_binary(path);
+
+	if (keyfile) {
+		if (!binary_keyfiles)
+			keyfile_write(path, keyfile);
+	} else {
+		keyfile = g_key_file_new();
+
+		if (g_key_file_load_from_file(keyfile, path, 0, NULL) &&
+				binary_keyfiles)
+			keyfile_write(path, keyfile);
+	}
+
 	l_free(path);
 
 	return keyfile;
@@ -153,31 +456,620 @@ GKeyFile *storage_open(const char *imsi, const char *store)
 
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
+	struct pending_sync *pending;
 	char *path = storage_get_file_path(imsi, store);
-	char *data;
-	gsize length = 0;
 
 	if (path == NULL)
 		return;
 
-	if (create_dirs(path) != 0) {
+	if (l_queue_find(pending_syncs, pending_sync_match_keyfile, keyfile)) {
+		syncs_coalesced += 1;
 		l_free(path);
 		return;
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	if (!sync_timeout)
+		sync_timeout = l_timeout_create(STORAGE_SYNC_DELAY,
+						sync_timeout_cb, NULL, NULL);
 
-	g_file_set_contents(path, data, length, NULL);
+	/* No main loop to defer to, write it out straight away */
+	if (!sync_timeout) {
+		keyfile_write(path, keyfile);
+		l_free(path);
+		return;
+	}
 
-	g_free(data);
-	l_free(path);
+	if (!pending_syncs)
+		pending_syncs = l_queue_new();
+
+	pending = l_new(struct pending_sync, 1);
+	pending->path = path;
+	pending->keyfile = keyfile;
+	l_queue_push_tail(pending_syncs, pending);
+}
+
+/*
+ * Writes out a pending sync of keyfile right away, for changes that must
+ * not be lost if ofonod goes down within the next few seconds.
+ */
+void storage_flush(GKeyFile *keyfile)
+{
+	struct pending_sync *pending;
+
+	pending = l_queue_remove_if(pending_syncs, pending_sync_match_keyfile,
+					keyfile);
+	if (pending)
+		pending_sync_flush(pending);
+}
+
+void storage_flush_all(void)
+{
+	l_timeout_remove(sync_timeout);
+	sync_timeout = NULL;
+
+	l_queue_destroy(pending_syncs, pending_sync_flush);
+	pending_syncs = NULL;
+
+	if (syncs_coalesced)
+		l_debug("%u settings writes coalesced", syncs_coalesced);
+}
+
+unsigned int storage_get_coalesced_syncs(void)
+{
+	return syncs_coalesced;
 }
 
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save)
 {
-	if (save == TRUE)
-		storage_sync(imsi, store, keyfile);
+	struct pending_sync *pending;
+
+	pending = l_queue_remove_if(pending_syncs, pending_sync_match_keyfile,
+					keyfile);
+
+	if (pending) {
+		pending_sync_flush(pending);
+
+		/* The write above already holds the latest contents */
+		if (save == TRUE)
+			syncs_coalesced += 1;
+	} else if (save == TRUE) {
+		char *path = storage_get_file_path(imsi, store);
+
+		if (path)
+			keyfile_write(path, keyfile);
+
+		l_free(path);
+	}
 
 	g_key_file_free(keyfile);
 }
+
+/*
+ * Stores holding a copy of state owned by the network stamp the group
+ * when writing it, readers only trust it for max_age seconds after that.
+ */
+void storage_stamp(GKeyFile *keyfile, const char *group)
+{
+	g_key_file_set_uint64(keyfile, group, "Stamp", time(NULL));
+}
+
+bool storage_stamp_valid(GKeyFile *keyfile, const char *group,
+				time_t max_age)
+{
+	GError *error = NULL;
+	guint64 stamp;
+	time_t now = time(NULL);
+
+	stamp = g_key_file_get_uint64(keyfile, group, "Stamp", &error);
+	if (error) {
+		g_error_free(error);
+		return false;
+	}
+
+	return stamp <= (guint64) now && now - (time_t) stamp < max_age;
+}
+
+/*
+ * Journal format: a magic, then records of a 16 byte header followed by
+ * the key and the value.  The header holds a checksum over the rest of the
+ * record, the key and value lengths and the time of the write.  A removal
+ * is a record with value length JOURNAL_REMOVED and no value.  A torn or
+ * corrupted record ends the replay and is cut off, so an interrupted write
+ * loses at most that record.
+ */
+#define JOURNAL_MAGIC		"OFJ1"
+#define JOURNAL_MAGIC_LEN	4
+#define JOURNAL_HEADER_LEN	16
+#define JOURNAL_REMOVED		0xffff
+#define JOURNAL_MAX_VALUE	(JOURNAL_REMOVED - 1)
+
+/* Don't bother compacting until this much has been superseded */
+#define JOURNAL_COMPACT_MIN	4096
+
+struct storage_journal {
+	char *path;
+	int fd;
+	GHashTable *entries;
+	size_t size;
+	size_t live;
+	GByteArray *batch;	/* Records held back until the commit */
+};
+
+struct journal_entry {
+	time_t mtime;
+	size_t len;
+	unsigned char value[];
+};
+
+static size_t journal_record_len(const char *key, size_t len)
+{
+	return JOURNAL_HEADER_LEN + strlen(key) + len;
+}
+
+static size_t journal_record_build(unsigned char *buf, const char *key,
+					const void *value, size_t len,
+					bool removed, time_t mtime)
+{
+	size_t key_len = strlen(key);
+	size_t total = JOURNAL_HEADER_LEN + key_len + len;
+
+	l_put_le16(key_len, buf + 4);
+	l_put_le16(removed ? JOURNAL_REMOVED : len, buf + 6);
+	l_put_le64(mtime, buf + 8);
+	memcpy(buf + JOURNAL_HEADER_LEN, key, key_len);
+
+	if (len)
+		memcpy(buf + JOURNAL_HEADER_LEN + key_len, value, len);
+
+	l_put_le32(storage_checksum(buf + 4, total - 4), buf);
+
+	return total;
+}
+
+static void journal_set(struct storage_journal *journal, const char *key,
+				const void *value, size_t len, time_t mtime)
+{
+	struct journal_entry *entry = l_malloc(sizeof(*entry) + len);
+	struct journal_entry *old = g_hash_table_lookup(journal->entries, key);
+
+	if (old)
+		journal->live -= journal_record_len(key, old->len);
+
+	entry->mtime = mtime;
+	entry->len = len;
+
+	if (len)
+		memcpy(entry->value, value, len);
+
+	g_hash_table_replace(journal->entries, l_strdup(key), entry);
+	journal->live += journal_record_len(key, len);
+}
+
+static void journal_unset(struct storage_journal *journal, const char *key)
+{
+	struct journal_entry *entry;
+
+	entry = g_hash_table_lookup(journal->entries, key);
+	if (!entry)
+		return;
+
+	journal->live -= journal_record_len(key, entry->len);
+	g_hash_table_remove(journal->entries, key);
+}
+
+/* Returns the length of the valid prefix of the journal */
+static size_t journal_replay(struct storage_journal *journal,
+				const unsigned char *data, size_t size)
+{
+	size_t pos = JOURNAL_MAGIC_LEN;
+
+	if (size < JOURNAL_MAGIC_LEN ||
+			memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN))
+		return 0;
+
+	while (size - pos >= JOURNAL_HEADER_LEN) {
+		const unsigned char *rec = data + pos;
+		size_t key_len = l_get_le16(rec + 4);
+		size_t len = l_get_le16(rec + 6);
+		bool removed = len == JOURNAL_REMOVED;
+		size_t total;
+		char *key;
+
+		if (removed)
+			len = 0;
+
+		total = JOURNAL_HEADER_LEN + key_len + len;
+
+		if (!key_len || size - pos < total)
+			break;
+
+		if (l_get_le32(rec) != storage_checksum(rec + 4, total - 4))
+			break;
+
+		key = l_strndup((const char *) rec + JOURNAL_HEADER_LEN,
+				key_len);
+
+		if (removed)
+			journal_unset(journal, key);
+		else
+			journal_set(journal, key,
+					rec + JOURNAL_HEADER_LEN + key_len,
+					len, l_get_le64(rec + 8));
+
+		l_free(key);
+		pos += total;
+	}
+
+	return pos;
+}
+
+static bool journal_write(struct storage_journal *journal,
+				const unsigned char *buf, size_t len)
+{
+	ssize_t written;
+
+	if (journal->batch) {
+		g_byte_array_append(journal->batch, buf, len);
+		return true;
+	}
+
+	written = L_TFR(write(journal->fd, buf, len));
+
+	if (written == (ssize_t) len) {
+		journal->size += len;
+		return true;
+	}
+
+	/* Don't leave a partial record for the next one to follow */
+	if (written > 0 && ftruncate(journal->fd, journal->size) < 0)
+		l_error("Unable to truncate %s: %s", journal->path,
+			strerror(errno));
+
+	return false;
+}
+
+static bool journal_append(struct storage_journal *journal, const char *key,
+				const void *value, size_t len, bool removed,
+				time_t mtime)
+{
+	size_t total = journal_record_len(key, len);
+	unsigned char stack[512];
+	unsigned char *buf = total <= sizeof(stack) ? stack : l_malloc(total);
+	bool r;
+
+	journal_record_build(buf, key, value, len, removed, mtime);
+	r = journal_write(journal, buf, total);
+
+	if (buf != stack)
+		l_free(buf);
+
+	return r;
+}
+
+static int journal_open_fd(const char *path)
+{
+	return L_TFR(open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+				0600));
+}
+
+static void journal_compact(struct storage_journal *journal)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	unsigned char *buf;
+	size_t len = JOURNAL_MAGIC_LEN;
+	int fd;
+
+	buf = l_malloc(JOURNAL_MAGIC_LEN + journal->live);
+	memcpy(buf, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+
+	g_hash_table_iter_init(&iter, journal->entries);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct journal_entry *entry = value;
+
+		len += journal_record_build(buf + len, key, entry->value,
+						entry->len, false,
+						entry->mtime);
+	}
+
+	/* Written aside and renamed over, the old journal stays valid */
+	if (l_file_set_contents(journal->path, buf, len) < 0)
+		goto done;
+
+	fd = journal_open_fd(journal->path);
+	if (fd < 0)
+		goto done;
+
+	L_TFR(close(journal->fd));
+	journal->fd = fd;
+	journal->size = len;
+
+done:
+	l_free(buf);
+}
+
+static void journal_maybe_compact(struct storage_journal *journal)
+{
+	size_t garbage;
+
+	/* The batched records are not in size yet */
+	if (journal->batch)
+		return;
+
+	garbage = journal->size - JOURNAL_MAGIC_LEN - journal->live;
+
+	if (garbage >= JOURNAL_COMPACT_MIN && garbage >= journal->live)
+		journal_compact(journal);
+}
+
+/*
+ * Pulls in a tree of files as written with write_file(), one per key named
+ * after the key, at most one directory deep.  Each file is only removed
+ * once its record is in the journal, so this can be interrupted and rerun.
+ */
+static void journal_migrate(struct storage_journal *journal,
+				const char *dir, const char *prefix)
+{
+	struct dirent **entries;
+	int len;
+	int i;
+
+	len = scandir(dir, &entries, NULL, alphasort);
+	if (len < 0)
+		return;
+
+	for (i = 0; i < len; i++) {
+		const char *name = entries[i]->d_name;
+		char *path = l_strdup_printf("%s/%s", dir, name);
+		char *key = prefix ? l_strdup_printf("%s/%s", prefix, name) :
+					l_strdup(name);
+		struct stat st;
+		unsigned char *data;
+		size_t size = 0;
+
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			goto next;
+
+		if (stat(path, &st) < 0)
+			goto next;
+
+		if (S_ISDIR(st.st_mode)) {
+			if (!prefix)
+				journal_migrate(journal, path, name);
+
+			rmdir(path);
+			goto next;
+		}
+
+		if (!S_ISREG(st.st_mode))
+			goto next;
+
+		data = l_file_get_contents(path, &size);
+		if (!data && st.st_size)
+			goto next;
+
+		if (size <= JOURNAL_MAX_VALUE &&
+				journal_append(journal, key, data, size, false,
+						st.st_mtime)) {
+			journal_set(journal, key, data, size, st.st_mtime);
+			unlink(path);
+		}
+
+		l_free(data);
+next:
+		l_free(key);
+		l_free(path);
+		free(entries[i]);
+	}
+
+	free(entries);
+
+	if (!prefix)
+		rmdir(dir);
+}
+
+/*
+ * Opens the journal at path, creating it if needed.  If legacy_dir is given
+ * and exists, the files in it are moved into the journal first.
+ */
+struct storage_journal *storage_journal_open(const char *path,
+						const char *legacy_dir)
+{
+	struct storage_journal *journal;
+	unsigned char *data;
+	size_t size = 0;
+	size_t valid;
+
+	if (create_dirs(path) < 0)
+		return NULL;
+
+	journal = l_new(struct storage_journal, 1);
+	journal->path = l_strdup(path);
+	journal->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+							l_free, l_free);
+
+	journal->fd = journal_open_fd(path);
+	if (journal->fd < 0) {
+		storage_journal_close(journal);
+		return NULL;
+	}
+
+	data = l_file_get_contents(path, &size);
+	valid = data ? journal_replay(journal, data, size) : 0;
+	l_free(data);
+
+	if (valid == 0) {
+		/* New or unreadable, start over */
+		if (ftruncate(journal->fd, 0) < 0 ||
+				!journal_write(journal,
+					(const unsigned char *) JOURNAL_MAGIC,
+					JOURNAL_MAGIC_LEN)) {
+			storage_journal_close(journal);
+			return NULL;
+		}
+	} else {
+		journal->size = valid;
+
+		if (valid < size && ftruncate(journal->fd, valid) < 0)
+			l_error("Unable to truncate %s: %s", path,
+				strerror(errno));
+	}
+
+	if (legacy_dir)
+		journal_migrate(journal, legacy_dir, NULL);
+
+	journal_maybe_compact(journal);
+
+	return journal;
+}
+
+void storage_journal_close(struct storage_journal *journal)
+{
+	if (!journal)
+		return;
+
+	storage_journal_commit(journal);
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	g_hash_table_destroy(journal->entries);
+	l_free(journal->path);
+	l_free(journal);
+}
+
+/*
+ * Holds back the records of the following puts and removes, so that
+ * storage_journal_commit() can write them out with a single write and
+ * sync.  Lookups see the changes straight away.
+ */
+void storage_journal_begin(struct storage_journal *journal)
+{
+	if (!journal || journal->batch)
+		return;
+
+	journal->batch = g_byte_array_new();
+}
+
+bool storage_journal_commit(struct storage_journal *journal)
+{
+	GByteArray *batch;
+	bool r = true;
+
+	if (!journal || !journal->batch)
+		return true;
+
+	batch = journal->batch;
+	journal->batch = NULL;
+
+	if (batch->len) {
+		r = journal_write(journal, batch->data, batch->len);
+
+		if (r && fdatasync(journal->fd) < 0)
+			r = false;
+
+		if (!r)
+			l_error("Unable to write %s: %s", journal->path,
+				strerror(errno));
+	}
+
+	g_byte_array_unref(batch);
+	journal_maybe_compact(journal);
+
+	return r;
+}
+
+bool storage_journal_put(struct storage_journal *journal, const char *key,
+				const void *value, size_t len)
+{
+	time_t now = time(NULL);
+
+	if (!journal || !key[0] || len > JOURNAL_MAX_VALUE)
+		return false;
+
+	if (!journal_append(journal, key, value, len, false, now))
+		return false;
+
+	journal_set(journal, key, value, len, now);
+	journal_maybe_compact(journal);
+
+	return true;
+}
+
+bool storage_journal_remove(struct storage_journal *journal, const char *key)
+{
+	if (!journal || !g_hash_table_contains(journal->entries, key))
+		return false;
+
+	if (!journal_append(journal, key, NULL, 0, true, 0))
+		return false;
+
+	journal_unset(journal, key);
+	journal_maybe_compact(journal);
+
+	return true;
+}
+
+void storage_journal_remove_prefix(struct storage_journal *journal,
+					const char *prefix)
+{
+	GList *keys;
+	GList *l;
+
+	if (!journal)
+		return;
+
+	keys = g_hash_table_get_keys(journal->entries);
+
+	for (l = keys; l; l = l->next) {
+		if (l_str_has_prefix(l->data, prefix))
+			l->data = l_strdup(l->data);
+		else
+			l->data = NULL;
+	}
+
+	for (l = keys; l; l = l->next) {
+		if (!l->data)
+			continue;
+
+		storage_journal_remove(journal, l->data);
+		l_free(l->data);
+	}
+
+	g_list_free(keys);
+}
+
+/*
+ * Calls func for every key in the journal, in key order.  func may put and
+ * remove keys, those changes are not visited.
+ */
+void storage_journal_foreach(struct storage_journal *journal,
+				storage_journal_foreach_func_t func,
+				void *user_data)
+{
+	GList *keys;
+	GList *l;
+
+	if (!journal)
+		return;
+
+	keys = g_hash_table_get_keys(journal->entries);
+
+	for (l = keys; l; l = l->next)
+		l->data = l_strdup(l->data);
+
+	keys = g_list_sort(keys, (GCompareFunc) strcmp);
+
+	for (l = keys; l; l = l->next) {
+		struct journal_entry *entry;
+
+		entry = g_hash_table_lookup(journal->entries, l->data);
+		if (entry)
+			func(l->data, entry->value, entry->len, entry->mtime,
+				user_data);
+	}
+
+	g_list_free_full(keys, l_free);
+}
@@ -17,7 +17,34 @@ ssize_t write_file(const void *buffer, size_t len, const char *path_fmt, ...)
 	__attribute__((format(printf, 3, 4)));
 
 char *storage_get_file_path(const char *imsi, const char *store);
+void storage_set_binary_keyfiles(bool enable);
 GKeyFile *storage_open(const char *imsi, const char *store);
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
+void storage_flush(GKeyFile *keyfile);
+void storage_flush_all(void);
+unsigned int storage_get_coalesced_syncs(void);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
+void storage_stamp(GKeyFile *keyfile, const char *group);
+bool storage_stamp_valid(GKeyFile *keyfile, const char *group,
+				time_t max_age);
+
+struct storage_journal;
+
+typedef void (*storage_journal_foreach_func_t)(const char *key,
+						const void *value, size_t len,
+						time_t mtime, void *user_data);
+
+struct storage_journal *storage_journal_open(const char *path,
+						const char *legacy_dir);
+void storage_journal_close(struct storage_journal *journal);
+void storage_journal_begin(struct storage_journal *journal);
+bool storage_journal_commit(struct storage_journal *journal);
+bool storage_journal_put(struct storage_journal *journal, const char *key,
+				const void *value, size_t len);
+bool storage_journal_remove(struct storage_journal *journal, const char *key);
+void storage_journal_remove_prefix(struct storage_journal *journal,
+					const char *prefix);
+void storage_journal_foreach(struct storage_journal *journal,
+				storage_journal_foreach_func_t func,
+				void *user_data);
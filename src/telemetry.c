@@ -0,0 +1,423 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+
+/*
+ * Metrics are plain integers that their subsystems update in place.
+ * Values already tracked elsewhere are only read when a snapshot is
+ * taken, and no timer runs unless an agent asked for reports, so while
+ * nobody looks the cost is the one of the additions.
+ */
+struct ofono_telemetry {
+	struct ofono_modem *modem;	/* NULL for daemon wide metrics */
+	char *name;
+	enum ofono_telemetry_type type;
+	uint64_t value;			/* Counter value or sample count */
+	uint64_t sum;
+	uint64_t buckets[OFONO_TELEMETRY_BUCKETS];
+	ofono_telemetry_read_func_t read;
+	void *read_data;
+};
+
+/* The Telemetry interface of the manager or of one modem */
+struct telemetry_object {
+	struct ofono_modem *modem;
+	char *path;
+	char *agent_path;
+	char *agent_bus;
+	unsigned int disconnect_watch;
+	unsigned int interval;
+	struct l_timeout *report_timeout;
+};
+
+static struct l_queue *metrics;
+static struct l_queue *objects;
+static unsigned int modemwatch_id;
+
+struct ofono_telemetry *__ofono_telemetry_register(struct ofono_modem *modem,
+					const char *name,
+					enum ofono_telemetry_type type)
+{
+	struct ofono_telemetry *metric = l_new(struct ofono_telemetry, 1);
+
+	metric->modem = modem;
+	metric->name = l_strdup(name);
+	metric->type = type;
+
+	if (metrics == NULL)
+		metrics = l_queue_new();
+
+	l_queue_push_tail(metrics, metric);
+
+	return metric;
+}
+
+void __ofono_telemetry_unregister(struct ofono_telemetry *metric)
+{
+	if (metric == NULL)
+		return;
+
+	l_queue_remove(metrics, metric);
+	l_free(metric->name);
+	l_free(metric);
+}
+
+/* func is called before the metric is reported, to update its value */
+void __ofono_telemetry_set_read_func(struct ofono_telemetry *metric,
+					ofono_telemetry_read_func_t func,
+					void *user_data)
+{
+	if (metric == NULL)
+		return;
+
+	metric->read = func;
+	metric->read_data = user_data;
+}
+
+void __ofono_telemetry_add(struct ofono_telemetry *metric, uint64_t n)
+{
+	if (metric == NULL)
+		return;
+
+	metric->value += n;
+}
+
+void __ofono_telemetry_set(struct ofono_telemetry *metric, uint64_t value)
+{
+	if (metric == NULL)
+		return;
+
+	metric->value = value;
+}
+
+/* Bucket n counts the samples below 2^n, the last one all the others */
+void __ofono_telemetry_sample(struct ofono_telemetry *metric, uint64_t value)
+{
+	unsigned int n = 0;
+
+	if (metric == NULL)
+		return;
+
+	while (n < OFONO_TELEMETRY_BUCKETS - 1 && value >= (1ULL << n))
+		n += 1;
+
+	metric->buckets[n] += 1;
+	metric->value += 1;
+	metric->sum += value;
+}
+
+static void append_histogram(DBusMessageIter *dict,
+				const struct ofono_telemetry *metric)
+{
+	DBusMessageIter entry, variant, histogram, buckets;
+	unsigned int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						&metric->name);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+						"(ttat)", &variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_STRUCT,
+						NULL, &histogram);
+	dbus_message_iter_append_basic(&histogram, DBUS_TYPE_UINT64,
+						&metric->value);
+	dbus_message_iter_append_basic(&histogram, DBUS_TYPE_UINT64,
+						&metric->sum);
+	dbus_message_iter_open_container(&histogram, DBUS_TYPE_ARRAY,
+						DBUS_TYPE_UINT64_AS_STRING,
+						&buckets);
+
+	for (i = 0; i < OFONO_TELEMETRY_BUCKETS; i++)
+		dbus_message_iter_append_basic(&buckets, DBUS_TYPE_UINT64,
+						&metric->buckets[i]);
+
+	dbus_message_iter_close_container(&histogram, &buckets);
+	dbus_message_iter_close_container(&variant, &histogram);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_snapshot(struct telemetry_object *obj,
+				DBusMessageIter *iter)
+{
+	const struct l_queue_entry *entry;
+	DBusMessageIter dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	for (entry = l_queue_get_entries(metrics); entry;
+						entry = entry->next) {
+		struct ofono_telemetry *metric = entry->data;
+
+		if (metric->modem != obj->modem)
+			continue;
+
+		if (metric->read)
+			metric->read(metric, metric->read_data);
+
+		if (metric->type == OFONO_TELEMETRY_HISTOGRAM)
+			append_histogram(&dict, metric);
+		else
+			ofono_dbus_dict_append(&dict, metric->name,
+						DBUS_TYPE_UINT64,
+						&metric->value);
+	}
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+static DBusMessage *telemetry_get_snapshot(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct telemetry_object *obj = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	append_snapshot(obj, &iter);
+
+	return reply;
+}
+
+static void telemetry_report(struct l_timeout *timeout, void *user_data)
+{
+	struct telemetry_object *obj = user_data;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	DBusMessage *msg;
+	DBusMessageIter iter;
+
+	msg = dbus_message_new_method_call(obj->agent_bus, obj->agent_path,
+						OFONO_TELEMETRY_AGENT_INTERFACE,
+						"Report");
+	if (msg) {
+		dbus_message_iter_init_append(msg, &iter);
+		append_snapshot(obj, &iter);
+		dbus_message_set_no_reply(msg, TRUE);
+		g_dbus_send_message(conn, msg);
+	}
+
+	l_timeout_modify(timeout, obj->interval);
+}
+
+static void agent_release(struct telemetry_object *obj, bool send_release)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	DBusMessage *msg;
+
+	if (obj->agent_path == NULL)
+		return;
+
+	if (send_release) {
+		msg = dbus_message_new_method_call(obj->agent_bus,
+					obj->agent_path,
+					OFONO_TELEMETRY_AGENT_INTERFACE,
+					"Release");
+		if (msg) {
+			dbus_message_set_no_reply(msg, TRUE);
+			g_dbus_send_message(conn, msg);
+		}
+	}
+
+	if (obj->disconnect_watch) {
+		g_dbus_remove_watch(conn, obj->disconnect_watch);
+		obj->disconnect_watch = 0;
+	}
+
+	l_timeout_remove(obj->report_timeout);
+	obj->report_timeout = NULL;
+
+	l_free(obj->agent_path);
+	obj->agent_path = NULL;
+	l_free(obj->agent_bus);
+	obj->agent_bus = NULL;
+}
+
+static void agent_disconnect_cb(DBusConnection *conn, void *user_data)
+{
+	struct telemetry_object *obj = user_data;
+
+	ofono_debug("Agent exited without calling UnregisterAgent");
+
+	obj->disconnect_watch = 0;
+	agent_release(obj, false);
+}
+
+static DBusMessage *telemetry_register_agent(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct telemetry_object *obj = data;
+	const char *agent_path;
+	unsigned int interval;
+
+	if (obj->agent_path)
+		return __ofono_error_busy(msg);
+
+	if (dbus_message_get_args(msg, NULL,
+				DBUS_TYPE_OBJECT_PATH, &agent_path,
+				DBUS_TYPE_UINT32, &interval,
+				DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (!dbus_validate_path(agent_path, NULL))
+		return __ofono_error_invalid_format(msg);
+
+	if (!interval)
+		return __ofono_error_invalid_args(msg);
+
+	obj->agent_path = l_strdup(agent_path);
+	obj->agent_bus = l_strdup(dbus_message_get_sender(msg));
+	obj->interval = interval;
+	obj->disconnect_watch = g_dbus_add_disconnect_watch(conn,
+							obj->agent_bus,
+							agent_disconnect_cb,
+							obj, NULL);
+	obj->report_timeout = l_timeout_create(interval, telemetry_report,
+							obj, NULL);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *telemetry_unregister_agent(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct telemetry_object *obj = data;
+	const char *agent_path;
+	const char *agent_bus = dbus_message_get_sender(msg);
+
+	if (dbus_message_get_args(msg, NULL,
+					DBUS_TYPE_OBJECT_PATH, &agent_path,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (obj->agent_path == NULL)
+		return __ofono_error_failed(msg);
+
+	if (strcmp(obj->agent_path, agent_path) ||
+			strcmp(obj->agent_bus, agent_bus))
+		return __ofono_error_access_denied(msg);
+
+	agent_release(obj, true);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable telemetry_methods[] = {
+	{ GDBUS_METHOD("GetSnapshot",
+			NULL, GDBUS_ARGS({ "metrics", "a{sv}" }),
+			telemetry_get_snapshot) },
+	{ GDBUS_METHOD("RegisterAgent",
+			GDBUS_ARGS({ "path", "o" }, { "interval", "u" }), NULL,
+			telemetry_register_agent) },
+	{ GDBUS_METHOD("UnregisterAgent",
+			GDBUS_ARGS({ "path", "o" }), NULL,
+			telemetry_unregister_agent) },
+	{ }
+};
+
+static void telemetry_object_add(struct ofono_modem *modem, const char *path)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct telemetry_object *obj = l_new(struct telemetry_object, 1);
+
+	obj->modem = modem;
+	obj->path = l_strdup(path);
+
+	if (!g_dbus_register_interface(conn, path,
+					OFONO_TELEMETRY_INTERFACE,
+					telemetry_methods, NULL, NULL,
+					obj, NULL)) {
+		ofono_error("Could not create %s interface on %s",
+				OFONO_TELEMETRY_INTERFACE, path);
+		l_free(obj->path);
+		l_free(obj);
+		return;
+	}
+
+	l_queue_push_tail(objects, obj);
+}
+
+static void telemetry_object_free(void *data)
+{
+	struct telemetry_object *obj = data;
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	agent_release(obj, true);
+	g_dbus_unregister_interface(conn, obj->path,
+					OFONO_TELEMETRY_INTERFACE);
+
+	l_free(obj->path);
+	l_free(obj);
+}
+
+static bool telemetry_object_match(const void *a, const void *b)
+{
+	const struct telemetry_object *obj = a;
+
+	return obj->modem == b;
+}
+
+static void modem_watch(struct ofono_modem *modem, gboolean added, void *data)
+{
+	struct telemetry_object *obj;
+
+	if (added) {
+		telemetry_object_add(modem, ofono_modem_get_path(modem));
+		return;
+	}
+
+	obj = l_queue_remove_if(objects, telemetry_object_match, modem);
+	if (obj)
+		telemetry_object_free(obj);
+}
+
+static void call_modemwatch(struct ofono_modem *modem, void *user)
+{
+	modem_watch(modem, TRUE, user);
+}
+
+static int telemetry_init(void)
+{
+	objects = l_queue_new();
+
+	telemetry_object_add(NULL, OFONO_MANAGER_PATH);
+
+	modemwatch_id = __ofono_modemwatch_add(modem_watch, NULL, NULL);
+	__ofono_modem_foreach(call_modemwatch, NULL);
+
+	return 0;
+}
+
+static void telemetry_exit(void)
+{
+	__ofono_modemwatch_remove(modemwatch_id);
+	modemwatch_id = 0;
+
+	l_queue_destroy(objects, telemetry_object_free);
+	objects = NULL;
+
+	/* Metrics still registered belong to their subsystems */
+	l_queue_destroy(metrics, NULL);
+	metrics = NULL;
+}
+
+OFONO_MODULE(telemetry, telemetry_init, telemetry_exit)
@@ -0,0 +1,379 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+#include "gatio.h"
+
+#define TRACE_MIN_SIZE (64 * 1024)
+#define TRACE_SNAPLEN 4096
+#define TRACE_DUMP_FILE STORAGEDIR "/trace.pcapng"
+
+#define PCAPNG_BLOCK_SHB 0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+#define PCAPNG_LINKTYPE_USER0 147
+
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_EPB_FLAGS 2
+
+#define PCAPNG_EPB_INBOUND 1
+#define PCAPNG_EPB_OUTBOUND 2
+
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((size_t) (a) - 1))
+
+/*
+ * Records are stored back to back in a byte ring, each one a header
+ * followed by the captured bytes padded to 8.  The oldest records are
+ * dropped to make room, so the ring always holds the most recent traffic.
+ */
+struct trace_hdr {
+	uint64_t timestamp;
+	uint32_t channel;
+	uint32_t orig_len;
+	uint16_t cap_len;
+	uint8_t link;
+	uint8_t incoming;
+};
+
+struct trace_iface {
+	uint8_t link;
+	uint32_t channel;
+};
+
+static uint8_t *ring;
+static size_t ring_size;
+static size_t ring_head;
+static size_t ring_used;
+
+static const char *link_names[] = {
+	[OFONO_TRACE_LINK_AT] = "at",
+	[OFONO_TRACE_LINK_QMI] = "qmi",
+	[OFONO_TRACE_LINK_MBIM] = "mbim",
+};
+
+static void ring_write(size_t pos, const void *src, size_t len)
+{
+	size_t first = MIN(len, ring_size - pos);
+
+	memcpy(ring + pos, src, first);
+	memcpy(ring, (const uint8_t *) src + first, len - first);
+}
+
+static void ring_read(size_t pos, void *dst, size_t len)
+{
+	size_t first = MIN(len, ring_size - pos);
+
+	memcpy(dst, ring + pos, first);
+	memcpy((uint8_t *) dst + first, ring, len - first);
+}
+
+static size_t ring_tail(void)
+{
+	return (ring_head + ring_size - ring_used) % ring_size;
+}
+
+static size_t record_size(const struct trace_hdr *hdr)
+{
+	return sizeof(*hdr) + ALIGN(hdr->cap_len, 8);
+}
+
+static void ring_drop_oldest(void)
+{
+	struct trace_hdr hdr;
+
+	ring_read(ring_tail(), &hdr, sizeof(hdr));
+	ring_used -= record_size(&hdr);
+}
+
+ofono_bool_t ofono_trace_enabled(void)
+{
+	return ring != NULL;
+}
+
+void ofono_trace_record(enum ofono_trace_link link, unsigned int channel,
+				ofono_bool_t incoming,
+				const void *data, size_t len)
+{
+	struct trace_hdr hdr;
+	struct timespec ts;
+	size_t size;
+
+	if (ring == NULL || len == 0)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.timestamp = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	hdr.channel = channel;
+	hdr.orig_len = len;
+	hdr.cap_len = MIN(len, TRACE_SNAPLEN);
+	hdr.link = link;
+	hdr.incoming = incoming;
+
+	size = record_size(&hdr);
+
+	while (ring_used + size > ring_size)
+		ring_drop_oldest();
+
+	ring_write(ring_head, &hdr, sizeof(hdr));
+	ring_write((ring_head + sizeof(hdr)) % ring_size, data, hdr.cap_len);
+
+	ring_head = (ring_head + size) % ring_size;
+	ring_used += size;
+}
+
+static void at_trace(gboolean in, int fd, const char *data, gsize len)
+{
+	ofono_trace_record(OFONO_TRACE_LINK_AT, fd, in, data, len);
+}
+
+static void append_u16(GByteArray *buf, uint16_t val)
+{
+	g_byte_array_append(buf, (const guint8 *) &val, sizeof(val));
+}
+
+static void append_u32(GByteArray *buf, uint32_t val)
+{
+	g_byte_array_append(buf, (const guint8 *) &val, sizeof(val));
+}
+
+static void append_pad(GByteArray *buf)
+{
+	static const guint8 zero[4];
+
+	g_byte_array_append(buf, zero, ALIGN(buf->len, 4) - buf->len);
+}
+
+/* Patch the leading length field and append the trailing copy of it */
+static void finish_block(GByteArray *buf)
+{
+	uint32_t total = buf->len + sizeof(uint32_t);
+
+	memcpy(buf->data + sizeof(uint32_t), &total, sizeof(total));
+	append_u32(buf, total);
+}
+
+static int write_block(FILE *fp, GByteArray *buf)
+{
+	finish_block(buf);
+
+	if (fwrite(buf->data, buf->len, 1, fp) != 1)
+		return -EIO;
+
+	g_byte_array_set_size(buf, 0);
+
+	return 0;
+}
+
+static int write_shb(FILE *fp, GByteArray *buf)
+{
+	uint64_t section_len = UINT64_MAX;
+
+	append_u32(buf, PCAPNG_BLOCK_SHB);
+	append_u32(buf, 0);
+	append_u32(buf, PCAPNG_BYTE_ORDER_MAGIC);
+	append_u16(buf, 1);
+	append_u16(buf, 0);
+	g_byte_array_append(buf, (const guint8 *) &section_len,
+						sizeof(section_len));
+
+	return write_block(fp, buf);
+}
+
+static int write_idb(FILE *fp, GByteArray *buf, const struct trace_iface *iface)
+{
+	char name[32];
+	size_t len;
+
+	len = snprintf(name, sizeof(name), "%s%u",
+				link_names[iface->link], iface->channel);
+
+	append_u32(buf, PCAPNG_BLOCK_IDB);
+	append_u32(buf, 0);
+	append_u16(buf, PCAPNG_LINKTYPE_USER0 + iface->link);
+	append_u16(buf, 0);
+	append_u32(buf, TRACE_SNAPLEN);
+
+	append_u16(buf, PCAPNG_OPT_IF_NAME);
+	append_u16(buf, len);
+	g_byte_array_append(buf, (const guint8 *) name, len);
+	append_pad(buf);
+	append_u16(buf, PCAPNG_OPT_END);
+	append_u16(buf, 0);
+
+	return write_block(fp, buf);
+}
+
+static int find_iface(GArray *ifaces, const struct trace_hdr *hdr,
+				FILE *fp, GByteArray *buf)
+{
+	struct trace_iface iface;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < ifaces->len; i++) {
+		struct trace_iface *cur = &g_array_index(ifaces,
+							struct trace_iface, i);
+
+		if (cur->link == hdr->link && cur->channel == hdr->channel)
+			return i;
+	}
+
+	iface.link = hdr->link;
+	iface.channel = hdr->channel;
+
+	err = write_idb(fp, buf, &iface);
+	if (err < 0)
+		return err;
+
+	g_array_append_val(ifaces, iface);
+
+	return ifaces->len - 1;
+}
+
+static int write_epb(FILE *fp, GByteArray *buf, uint32_t iface_id,
+			const struct trace_hdr *hdr, size_t data_pos)
+{
+	unsigned int offset;
+
+	append_u32(buf, PCAPNG_BLOCK_EPB);
+	append_u32(buf, 0);
+	append_u32(buf, iface_id);
+	append_u32(buf, hdr->timestamp >> 32);
+	append_u32(buf, hdr->timestamp & 0xffffffff);
+	append_u32(buf, hdr->cap_len);
+	append_u32(buf, hdr->orig_len);
+
+	offset = buf->len;
+	g_byte_array_set_size(buf, offset + hdr->cap_len);
+	ring_read(data_pos, buf->data + offset, hdr->cap_len);
+	append_pad(buf);
+
+	append_u16(buf, PCAPNG_OPT_EPB_FLAGS);
+	append_u16(buf, sizeof(uint32_t));
+	append_u32(buf, hdr->incoming ? PCAPNG_EPB_INBOUND :
+						PCAPNG_EPB_OUTBOUND);
+	append_u16(buf, PCAPNG_OPT_END);
+	append_u16(buf, 0);
+
+	return write_block(fp, buf);
+}
+
+static int trace_write(FILE *fp)
+{
+	GByteArray *buf = g_byte_array_new();
+	GArray *ifaces = g_array_new(FALSE, FALSE, sizeof(struct trace_iface));
+	size_t pos = ring_tail();
+	size_t remaining = ring_used;
+	int err;
+
+	err = write_shb(fp, buf);
+
+	while (err == 0 && remaining > 0) {
+		struct trace_hdr hdr;
+		int id;
+
+		ring_read(pos, &hdr, sizeof(hdr));
+
+		id = find_iface(ifaces, &hdr, fp, buf);
+		if (id < 0) {
+			err = id;
+			break;
+		}
+
+		err = write_epb(fp, buf, id, &hdr,
+					(pos + sizeof(hdr)) % ring_size);
+
+		pos = (pos + record_size(&hdr)) % ring_size;
+		remaining -= record_size(&hdr);
+	}
+
+	g_array_free(ifaces, TRUE);
+	g_byte_array_free(buf, TRUE);
+
+	return err;
+}
+
+int __ofono_trace_dump(void)
+{
+	const char *tmp = TRACE_DUMP_FILE ".tmp";
+	FILE *fp;
+	int err;
+
+	if (ring == NULL)
+		return -ENOTSUP;
+
+	fp = fopen(tmp, "w");
+	if (fp == NULL)
+		return -errno;
+
+	err = trace_write(fp);
+
+	if (fclose(fp) != 0 && err == 0)
+		err = -errno;
+
+	if (err == 0 && rename(tmp, TRACE_DUMP_FILE) < 0)
+		err = -errno;
+
+	if (err < 0) {
+		unlink(tmp);
+		return err;
+	}
+
+	ofono_info("Protocol trace written to %s", TRACE_DUMP_FILE);
+
+	return 0;
+}
+
+int __ofono_trace_init(unsigned int size)
+{
+	if (size == 0)
+		return 0;
+
+	size = ALIGN(MAX(size, TRACE_MIN_SIZE), 8);
+
+	ring = g_try_malloc(size);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring_size = size;
+	ring_head = 0;
+	ring_used = 0;
+
+	g_at_io_set_trace_func(at_trace);
+
+	return 0;
+}
+
+void __ofono_trace_cleanup(void)
+{
+	if (ring == NULL)
+		return;
+
+	g_at_io_set_trace_func(NULL);
+
+	g_free(ring);
+	ring = NULL;
+	ring_size = 0;
+}
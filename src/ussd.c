@@ -23,6 +23,9 @@
 
 #define MAX_USSD_LENGTH 160
 
+/* Initiate and Respond calls a client may have waiting */
+#define USSD_CLIENT_QUEUE_MAX 8
+
 enum ussd_state {
 	USSD_STATE_IDLE = 0,
 	USSD_STATE_ACTIVE = 1,
@@ -35,6 +38,31 @@ struct ussd_request {
 	void *user_data;
 };
 
+/*
+ * Calls that came in while the session was busy, per client.  Clients
+ * take turns starting sessions, while Respond calls queued by the client
+ * that started the current session go out as soon as the network asks
+ * for input.
+ */
+struct ussd_client {
+	char *sender;
+	struct l_queue *calls;
+};
+
+struct ussd_queued_call {
+	DBusMessage *msg;
+	bool respond;
+};
+
+struct ussd_stats {
+	unsigned int requests;
+	unsigned int replies;
+	unsigned int failures;
+	uint64_t latency_total;		/* milliseconds, over requests */
+	unsigned int latency_max;
+	unsigned int latency_last;
+};
+
 struct ofono_ussd {
 	int state;
 	DBusMessage *pending;
@@ -46,6 +74,11 @@ struct ofono_ussd {
 	void *driver_data;
 	struct ofono_atom *atom;
 	struct ussd_request *req;
+	struct l_queue *clients;
+	char *session_owner;	/* Sender whose Initiate opened the session */
+	struct l_idle *dispatch;
+	uint64_t sent_time;	/* Request to the network outstanding since */
+	struct ussd_stats stats;
 };
 
 struct ssc_entry {
@@ -291,6 +324,16 @@ static const char *ussd_get_state_string(struct ofono_ussd *ussd)
 	return "";
 }
 
+static void ussd_dispatch(struct l_idle *idle, void *user_data);
+
+static void ussd_schedule_dispatch(struct ofono_ussd *ussd)
+{
+	if (ussd->dispatch || l_queue_isempty(ussd->clients))
+		return;
+
+	ussd->dispatch = l_idle_create(ussd_dispatch, ussd, NULL);
+}
+
 static void ussd_change_state(struct ofono_ussd *ussd, int state)
 {
 	const char *value;
@@ -302,10 +345,30 @@ static void ussd_change_state(struct ofono_ussd *ussd, int state)
 
 	ussd->state = state;
 
+	if (state == USSD_STATE_IDLE) {
+		l_free(ussd->session_owner);
+		ussd->session_owner = NULL;
+	}
+
 	value = ussd_get_state_string(ussd);
 	ofono_dbus_signal_property_changed(conn, path,
 			OFONO_SUPPLEMENTARY_SERVICES_INTERFACE,
 			"State", DBUS_TYPE_STRING, &value);
+
+	ussd_schedule_dispatch(ussd);
+}
+
+static void ussd_request_sent(struct ofono_ussd *ussd)
+{
+	ussd->sent_time = l_time_now();
+	ussd->stats.requests += 1;
+}
+
+static void ussd_request_failed(struct ofono_ussd *ussd)
+{
+	ussd->sent_time = 0;
+	ussd->stats.failures += 1;
+	ussd_schedule_dispatch(ussd);
 }
 
 static void ussd_request_finish(struct ofono_ussd *ussd, int error, int dcs,
@@ -318,6 +381,8 @@ static void ussd_request_finish(struct ofono_ussd *ussd, int error, int dcs,
 
 	g_free(req);
 	ussd->req = NULL;
+
+	ussd_schedule_dispatch(ussd);
 }
 
 static int ussd_status_to_failure_code(int status)
@@ -385,6 +450,20 @@ void ofono_ussd_notify(struct ofono_ussd *ussd, int status, int dcs,
 		status, ussd_status_name(status),
 		ussd->state, ussd_state_name(ussd->state));
 
+	if (ussd->sent_time) {
+		unsigned int latency = l_time_diff(ussd->sent_time,
+						l_time_now()) / 1000;
+
+		ussd->stats.replies += 1;
+		ussd->stats.latency_total += latency;
+		ussd->stats.latency_last = latency;
+
+		if (latency > ussd->stats.latency_max)
+			ussd->stats.latency_max = latency;
+
+		ussd->sent_time = 0;
+	}
+
 	if (ussd->req &&
 			(status == OFONO_USSD_STATUS_NOTIFY ||
 			status == OFONO_USSD_STATUS_TERMINATED ||
@@ -524,6 +603,7 @@ out:
 
 	dbus_message_unref(ussd->pending);
 	ussd->pending = NULL;
+	ussd_schedule_dispatch(ussd);
 
 free:
 	g_free(utf8_str);
@@ -543,6 +623,8 @@ static void ussd_callback(const struct ofono_error *error, void *data)
 		return;
 	}
 
+	ussd_request_failed(ussd);
+
 	if (ussd->pending == NULL)
 		return;
 
@@ -550,10 +632,9 @@ static void ussd_callback(const struct ofono_error *error, void *data)
 	__ofono_dbus_pending_reply(&ussd->pending, reply);
 }
 
-static DBusMessage *ussd_initiate(DBusConnection *conn, DBusMessage *msg,
-					void *data)
+static DBusMessage *ussd_start_initiate(struct ofono_ussd *ussd,
+							DBusMessage *msg)
 {
-	struct ofono_ussd *ussd = data;
 	struct ofono_modem *modem = __ofono_atom_get_modem(ussd->atom);
 	struct ofono_voicecall *vc;
 	gboolean call_in_progress;
@@ -597,6 +678,10 @@ static DBusMessage *ussd_initiate(DBusConnection *conn, DBusMessage *msg,
 
 	ussd->pending = dbus_message_ref(msg);
 
+	l_free(ussd->session_owner);
+	ussd->session_owner = l_strdup(dbus_message_get_sender(msg));
+
+	ussd_request_sent(ussd);
 	ussd->driver->request(ussd, dcs, buf, num_packed, ussd_callback, ussd);
 
 	return NULL;
@@ -616,6 +701,8 @@ static void ussd_response_callback(const struct ofono_error *error, void *data)
 		return;
 	}
 
+	ussd_request_failed(ussd);
+
 	if (ussd->pending == NULL)
 		return;
 
@@ -623,10 +710,9 @@ static void ussd_response_callback(const struct ofono_error *error, void *data)
 	__ofono_dbus_pending_reply(&ussd->pending, reply);
 }
 
-static DBusMessage *ussd_respond(DBusConnection *conn, DBusMessage *msg,
-					void *data)
+static DBusMessage *ussd_start_respond(struct ofono_ussd *ussd,
+							DBusMessage *msg)
 {
-	struct ofono_ussd *ussd = data;
 	const char *str;
 	int dcs = 0x0f;
 	unsigned char buf[160];
@@ -653,12 +739,210 @@ static DBusMessage *ussd_respond(DBusConnection *conn, DBusMessage *msg,
 
 	ussd->pending = dbus_message_ref(msg);
 
+	ussd_request_sent(ussd);
 	ussd->driver->request(ussd, dcs, buf, num_packed,
 				ussd_response_callback, ussd);
 
 	return NULL;
 }
 
+static bool ussd_client_match(const void *a, const void *b)
+{
+	const struct ussd_client *client = a;
+
+	return !strcmp(client->sender, b);
+}
+
+static void ussd_client_free(void *data)
+{
+	struct ussd_client *client = data;
+
+	l_queue_destroy(client->calls, NULL);
+	l_free(client->sender);
+	l_free(client);
+}
+
+static bool ussd_queue_call(struct ofono_ussd *ussd, DBusMessage *msg,
+							bool respond)
+{
+	const char *sender = dbus_message_get_sender(msg);
+	struct ussd_client *client;
+	struct ussd_queued_call *call;
+
+	if (ussd->clients == NULL)
+		ussd->clients = l_queue_new();
+
+	client = l_queue_find(ussd->clients, ussd_client_match, sender);
+	if (client == NULL) {
+		client = l_new(struct ussd_client, 1);
+		client->sender = l_strdup(sender);
+		client->calls = l_queue_new();
+		l_queue_push_tail(ussd->clients, client);
+	}
+
+	if (l_queue_length(client->calls) >= USSD_CLIENT_QUEUE_MAX)
+		return false;
+
+	call = l_new(struct ussd_queued_call, 1);
+	call->msg = dbus_message_ref(msg);
+	call->respond = respond;
+	l_queue_push_tail(client->calls, call);
+
+	DBG("%s queued %s, %u waiting", sender,
+			respond ? "Respond" : "Initiate",
+			l_queue_length(client->calls));
+
+	return true;
+}
+
+static struct ussd_queued_call *ussd_client_pop(struct ofono_ussd *ussd,
+						struct ussd_client *client)
+{
+	struct ussd_queued_call *call = l_queue_pop_head(client->calls);
+
+	l_queue_remove(ussd->clients, client);
+
+	/* Served clients go to the back, so that others get their turn */
+	if (l_queue_isempty(client->calls))
+		ussd_client_free(client);
+	else
+		l_queue_push_tail(ussd->clients, client);
+
+	return call;
+}
+
+static unsigned int ussd_queue_length(struct ofono_ussd *ussd)
+{
+	const struct l_queue_entry *entry;
+	unsigned int len = 0;
+
+	for (entry = l_queue_get_entries(ussd->clients); entry;
+							entry = entry->next) {
+		const struct ussd_client *client = entry->data;
+
+		len += l_queue_length(client->calls);
+	}
+
+	return len;
+}
+
+static void ussd_run_call(struct ofono_ussd *ussd,
+					struct ussd_queued_call *call)
+{
+	DBusMessage *reply;
+
+	if (!call->respond)
+		reply = ussd_start_initiate(ussd, call->msg);
+	else if (ussd->state == USSD_STATE_USER_ACTION)
+		reply = ussd_start_respond(ussd, call->msg);
+	else
+		/* The session it was meant for has ended */
+		reply = __ofono_error_not_active(call->msg);
+
+	if (reply)
+		g_dbus_send_message(ofono_dbus_get_connection(), reply);
+
+	dbus_message_unref(call->msg);
+	l_free(call);
+}
+
+static void ussd_dispatch(struct l_idle *idle, void *user_data)
+{
+	struct ofono_ussd *ussd = user_data;
+	struct ussd_client *client;
+
+	l_idle_remove(idle);
+	ussd->dispatch = NULL;
+
+	while (!l_queue_isempty(ussd->clients)) {
+		if (ussd->pending || ussd->cancel || ussd->req)
+			return;
+
+		if (ussd->state == USSD_STATE_USER_ACTION) {
+			struct ussd_queued_call *call;
+
+			if (ussd->session_owner == NULL)
+				return;
+
+			client = l_queue_find(ussd->clients, ussd_client_match,
+							ussd->session_owner);
+			if (client == NULL)
+				return;
+
+			call = l_queue_peek_head(client->calls);
+			if (!call->respond)
+				return;
+
+			ussd_run_call(ussd, ussd_client_pop(ussd, client));
+			continue;
+		}
+
+		if (ussd->state != USSD_STATE_IDLE)
+			return;
+
+		client = l_queue_peek_head(ussd->clients);
+		ussd_run_call(ussd, ussd_client_pop(ussd, client));
+	}
+}
+
+static DBusMessage *ussd_initiate(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_ussd *ussd = data;
+	const char *str;
+
+	if (!__ofono_ussd_is_busy(ussd) && !ussd->cancel &&
+					l_queue_isempty(ussd->clients))
+		return ussd_start_initiate(ussd, msg);
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &str,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (strlen(str) == 0)
+		return __ofono_error_invalid_format(msg);
+
+	if (!ussd_queue_call(ussd, msg, false))
+		return __ofono_error_busy(msg);
+
+	return NULL;
+}
+
+static DBusMessage *ussd_respond(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_ussd *ussd = data;
+	const char *sender = dbus_message_get_sender(msg);
+	const char *str;
+
+	if (ussd->state == USSD_STATE_USER_ACTION && !ussd->pending &&
+					l_queue_isempty(ussd->clients))
+		return ussd_start_respond(ussd, msg);
+
+	/*
+	 * The client that started the session may answer ahead of the
+	 * network, its answers go out in order as input is asked for.
+	 */
+	if (ussd->session_owner == NULL ||
+			strcmp(ussd->session_owner, sender) ||
+			(ussd->state == USSD_STATE_IDLE && !ussd->pending))
+		return ussd_start_respond(ussd, msg);
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &str,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (strlen(str) == 0)
+		return __ofono_error_invalid_format(msg);
+
+	if (!ussd_queue_call(ussd, msg, true))
+		return __ofono_error_busy(msg);
+
+	ussd_schedule_dispatch(ussd);
+
+	return NULL;
+}
+
 static void ussd_cancel_callback(const struct ofono_error *error, void *data)
 {
 	struct ofono_ussd *ussd = data;
@@ -670,6 +954,7 @@ static void ussd_cancel_callback(const struct ofono_error *error, void *data)
 
 		reply = __ofono_error_failed(ussd->cancel);
 		__ofono_dbus_pending_reply(&ussd->cancel, reply);
+		ussd_schedule_dispatch(ussd);
 
 		return;
 	}
@@ -740,6 +1025,51 @@ static DBusMessage *ussd_get_properties(DBusConnection *conn,
 	return reply;
 }
 
+static DBusMessage *ussd_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_ussd *ussd = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	uint32_t value;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	value = ussd->stats.requests;
+	ofono_dbus_dict_append(&dict, "Requests", DBUS_TYPE_UINT32, &value);
+
+	value = ussd->stats.failures;
+	ofono_dbus_dict_append(&dict, "Failures", DBUS_TYPE_UINT32, &value);
+
+	value = ussd->stats.replies ?
+		ussd->stats.latency_total / ussd->stats.replies : 0;
+	ofono_dbus_dict_append(&dict, "LatencyAverage",
+					DBUS_TYPE_UINT32, &value);
+
+	value = ussd->stats.latency_max;
+	ofono_dbus_dict_append(&dict, "LatencyMaximum",
+					DBUS_TYPE_UINT32, &value);
+
+	value = ussd->stats.latency_last;
+	ofono_dbus_dict_append(&dict, "LatencyLast", DBUS_TYPE_UINT32, &value);
+
+	value = ussd_queue_length(ussd);
+	ofono_dbus_dict_append(&dict, "Queued", DBUS_TYPE_UINT32, &value);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static const GDBusMethodTable ussd_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Initiate",
 			GDBUS_ARGS({ "command", "s" }),
@@ -753,6 +1083,9 @@ static const GDBusMethodTable ussd_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
 			ussd_get_properties) },
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			ussd_get_statistics) },
 	{ }
 };
 
@@ -773,6 +1106,26 @@ static void ussd_unregister(struct ofono_atom *atom)
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 	const char *path = __ofono_atom_get_path(atom);
 	DBusMessage *reply;
+	struct ussd_client *client;
+
+	l_idle_remove(ussd->dispatch);
+	ussd->dispatch = NULL;
+
+	while ((client = l_queue_pop_head(ussd->clients))) {
+		struct ussd_queued_call *call;
+
+		while ((call = l_queue_pop_head(client->calls))) {
+			reply = __ofono_error_canceled(call->msg);
+			g_dbus_send_message(conn, reply);
+			dbus_message_unref(call->msg);
+			l_free(call);
+		}
+
+		ussd_client_free(client);
+	}
+
+	l_queue_destroy(ussd->clients, NULL);
+	ussd->clients = NULL;
 
 	if (ussd->pending) {
 		reply = __ofono_error_canceled(ussd->pending);
@@ -789,6 +1142,9 @@ static void ussd_unregister(struct ofono_atom *atom)
 
 	ussd_change_state(ussd, USSD_STATE_IDLE);
 
+	l_free(ussd->session_owner);
+	ussd->session_owner = NULL;
+
 	g_slist_free_full(ussd->ss_control_list, ssc_entry_destroy);
 	ussd->ss_control_list = NULL;
 
@@ -859,9 +1215,10 @@ static void ussd_request_callback(const struct ofono_error *error, void *data)
 {
 	struct ofono_ussd *ussd = data;
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		ussd_request_failed(ussd);
 		ussd_request_finish(ussd, -EINVAL, 0, NULL, 0);
-	else
+	} else
 		ussd_change_state(ussd, USSD_STATE_ACTIVE);
 }
 
@@ -886,6 +1243,7 @@ int __ofono_ussd_initiate(struct ofono_ussd *ussd, int dcs,
 
 	ussd->req = req;
 
+	ussd_request_sent(ussd);
 	ussd->driver->request(ussd, dcs, pdu, len, ussd_request_callback, ussd);
 
 	return 0;
@@ -56,21 +56,23 @@ struct codepoint {
 	unsigned short to;
 };
 
+/* Unicode to GSM table paged by the high byte, missing pages map to GUND */
+struct codepoint_index {
+	unsigned short *page[256];
+};
+
 struct conversion_table {
 	/* To unicode locking shift table */
-	const struct codepoint *locking_u;
-	unsigned int locking_len_u;
+	const struct codepoint_index *locking_u;
 
 	/* To unicode single shift table */
-	const struct codepoint *single_u;
-	unsigned int single_len_u;
+	const struct codepoint_index *single_u;
 
 	/* To GSM locking shift table, fixed size */
 	const unsigned short *locking_g;
 
-	/* To GSM single shift table */
-	const struct codepoint *single_g;
-	unsigned int single_len_g;
+	/* To GSM single shift table, fixed size */
+	const unsigned short *single_g;
 };
 
 /* GSM to Unicode extension table, for GSM sequences starting with 0x1B */
@@ -2626,24 +2628,69 @@ const struct codepoint urd_unicode[] = {
 	{ 0x06CC, 0x59 }, { 0x06D0, 0x5A }, { 0x06D2, 0x5B }, { 0x06D5, 0x55 }
 };
 
-static int compare_codepoints(const void *a, const void *b)
+/*
+ * The tables above are sparse, they are expanded into direct lookup tables
+ * once per dialect on first use and kept for the lifetime of the process
+ */
+static struct codepoint_index *locking_index[GSM_DIALECT_URDU + 1];
+static struct codepoint_index *single_index[GSM_DIALECT_URDU + 1];
+static unsigned short *single_gsm_index[GSM_DIALECT_URDU + 1];
+
+static const struct codepoint_index *build_codepoint_index(
+					struct codepoint_index **cache,
+					const struct codepoint *table,
+					unsigned int len)
 {
-	const struct codepoint *ca = (const struct codepoint *) a;
-	const struct codepoint *cb = (const struct codepoint *) b;
+	struct codepoint_index *index = *cache;
+	unsigned int i;
+
+	if (index)
+		return index;
+
+	index = l_new(struct codepoint_index, 1);
+
+	for (i = 0; i < len; i++) {
+		unsigned short **page = &index->page[table[i].from >> 8];
 
-	return (ca->from > cb->from) - (ca->from < cb->from);
+		if (!*page) {
+			*page = l_malloc(256 * sizeof(unsigned short));
+			memset(*page, 0xff, 256 * sizeof(unsigned short));
+		}
+
+		(*page)[table[i].from & 0xff] = table[i].to;
+	}
+
+	*cache = index;
+	return index;
 }
 
-static unsigned short codepoint_lookup(struct codepoint *key,
+static const unsigned short *build_gsm_index(unsigned short **cache,
 					const struct codepoint *table,
 					unsigned int len)
 {
-	struct codepoint *result = NULL;
+	unsigned short *index = *cache;
+	unsigned int i;
+
+	if (index)
+		return index;
 
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
+	index = l_malloc(128 * sizeof(unsigned short));
+	memset(index, 0xff, 128 * sizeof(unsigned short));
+
+	for (i = 0; i < len; i++)
+		if (table[i].from < 128)
+			index[table[i].from] = table[i].to;
+
+	*cache = index;
+	return index;
+}
+
+static unsigned short codepoint_lookup(const struct codepoint_index *index,
+					unsigned short k)
+{
+	const unsigned short *page = index->page[k >> 8];
 
-	return result ? result->to : GUND;
+	return page ? page[k & 0xff] : GUND;
 }
 
 static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
@@ -2655,215 +2702,229 @@ static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
 static unsigned short gsm_single_shift_lookup(struct conversion_table *t,
 						unsigned char k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_g, t->single_len_g);
+	return k < 128 ? t->single_g[k] : GUND;
 }
 
 static unsigned short unicode_locking_shift_lookup(struct conversion_table *t,
 							unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->locking_u, t->locking_len_u);
+	return codepoint_lookup(t->locking_u, k);
 }
 
 static unsigned short unicode_single_shift_lookup(struct conversion_table *t,
 							unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_u, t->single_len_u);
+	return codepoint_lookup(t->single_u, k);
 }
 
 static bool populate_locking_shift(struct conversion_table *t,
 					enum gsm_dialect lang)
 {
+	const struct codepoint *u;
+	unsigned int len_u;
+
 	switch (lang) {
 	case GSM_DIALECT_DEFAULT:
 	case GSM_DIALECT_SPANISH:
 		t->locking_g = def_gsm;
-		t->locking_u = def_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(def_unicode);
-		return true;
+		u = def_unicode;
+		len_u = L_ARRAY_SIZE(def_unicode);
+		break;
 
 	case GSM_DIALECT_TURKISH:
 		t->locking_g = tur_gsm;
-		t->locking_u = tur_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tur_unicode);
-		return true;
+		u = tur_unicode;
+		len_u = L_ARRAY_SIZE(tur_unicode);
+		break;
 
 	case GSM_DIALECT_PORTUGUESE:
 		t->locking_g = por_gsm;
-		t->locking_u = por_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(por_unicode);
-		return true;
+		u = por_unicode;
+		len_u = L_ARRAY_SIZE(por_unicode);
+		break;
 
 	case GSM_DIALECT_BENGALI:
 		t->locking_g = ben_gsm;
-		t->locking_u = ben_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(ben_unicode);
-		return true;
+		u = ben_unicode;
+		len_u = L_ARRAY_SIZE(ben_unicode);
+		break;
 
 	case GSM_DIALECT_GUJARATI:
                 t->locking_g = guj_gsm;
-                t->locking_u = guj_unicode;
-                t->locking_len_u = L_ARRAY_SIZE(guj_unicode);
-                return true;
+                u = guj_unicode;
+                len_u = L_ARRAY_SIZE(guj_unicode);
+                break;
 
 	case GSM_DIALECT_HINDI:
 		t->locking_g = hin_gsm;
-		t->locking_u = hin_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(hin_unicode);
-		return true;
+		u = hin_unicode;
+		len_u = L_ARRAY_SIZE(hin_unicode);
+		break;
 
 	case GSM_DIALECT_KANNADA:
 		t->locking_g = kan_gsm;
-		t->locking_u = kan_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(kan_unicode);
-		return true;
+		u = kan_unicode;
+		len_u = L_ARRAY_SIZE(kan_unicode);
+		break;
 
 	case GSM_DIALECT_MALAYALAM:
 		t->locking_g = mal_gsm;
-		t->locking_u = mal_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(mal_unicode);
-		return true;
+		u = mal_unicode;
+		len_u = L_ARRAY_SIZE(mal_unicode);
+		break;
 
 	case GSM_DIALECT_ORIYA:
 		t->locking_g = ori_gsm;
-		t->locking_u = ori_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(ori_unicode);
-		return true;
+		u = ori_unicode;
+		len_u = L_ARRAY_SIZE(ori_unicode);
+		break;
 
 	case GSM_DIALECT_PUNJABI:
 		t->locking_g = pun_gsm;
-		t->locking_u = pun_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(pun_unicode);
-		return true;
+		u = pun_unicode;
+		len_u = L_ARRAY_SIZE(pun_unicode);
+		break;
 
 	case GSM_DIALECT_TAMIL:
 		t->locking_g = tam_gsm;
-		t->locking_u = tam_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tam_unicode);
-		return true;
+		u = tam_unicode;
+		len_u = L_ARRAY_SIZE(tam_unicode);
+		break;
 
 	case GSM_DIALECT_TELUGU:
 		t->locking_g = tel_gsm;
-		t->locking_u = tel_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(tel_unicode);
-		return true;
+		u = tel_unicode;
+		len_u = L_ARRAY_SIZE(tel_unicode);
+		break;
 
 	case GSM_DIALECT_URDU:
 		t->locking_g = urd_gsm;
-		t->locking_u = urd_unicode;
-		t->locking_len_u = L_ARRAY_SIZE(urd_unicode);
-		return true;
-        }
+		u = urd_unicode;
+		len_u = L_ARRAY_SIZE(urd_unicode);
+		break;
 
-	return false;
+	default:
+		return false;
+	}
+
+	t->locking_u = build_codepoint_index(&locking_index[lang], u, len_u);
+	return true;
 }
 
 static bool populate_single_shift(struct conversion_table *t,
 					enum gsm_dialect lang)
 {
+	const struct codepoint *g;
+	unsigned int len_g;
+	const struct codepoint *u;
+	unsigned int len_u;
+
 	switch (lang) {
 	case GSM_DIALECT_DEFAULT:
-		t->single_g = def_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(def_ext_gsm);
-		t->single_u = def_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(def_ext_unicode);
-		return true;
+		g = def_ext_gsm;
+		len_g = L_ARRAY_SIZE(def_ext_gsm);
+		u = def_ext_unicode;
+		len_u = L_ARRAY_SIZE(def_ext_unicode);
+		break;
 
 	case GSM_DIALECT_TURKISH:
-		t->single_g = tur_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tur_ext_gsm);
-		t->single_u = tur_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tur_ext_unicode);
-		return true;
+		g = tur_ext_gsm;
+		len_g = L_ARRAY_SIZE(tur_ext_gsm);
+		u = tur_ext_unicode;
+		len_u = L_ARRAY_SIZE(tur_ext_unicode);
+		break;
 
 	case GSM_DIALECT_SPANISH:
-		t->single_g = spa_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(spa_ext_gsm);
-		t->single_u = spa_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(spa_ext_unicode);
-		return true;
+		g = spa_ext_gsm;
+		len_g = L_ARRAY_SIZE(spa_ext_gsm);
+		u = spa_ext_unicode;
+		len_u = L_ARRAY_SIZE(spa_ext_unicode);
+		break;
 
 	case GSM_DIALECT_PORTUGUESE:
-		t->single_g = por_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(por_ext_gsm);
-		t->single_u = por_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(por_ext_unicode);
-		return true;
+		g = por_ext_gsm;
+		len_g = L_ARRAY_SIZE(por_ext_gsm);
+		u = por_ext_unicode;
+		len_u = L_ARRAY_SIZE(por_ext_unicode);
+		break;
 
 	case GSM_DIALECT_BENGALI:
-		t->single_g = ben_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(ben_ext_gsm);
-		t->single_u = ben_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(ben_ext_unicode);
-		return true;
+		g = ben_ext_gsm;
+		len_g = L_ARRAY_SIZE(ben_ext_gsm);
+		u = ben_ext_unicode;
+		len_u = L_ARRAY_SIZE(ben_ext_unicode);
+		break;
 
 	case GSM_DIALECT_GUJARATI:
-                t->single_g = guj_ext_gsm;
-                t->single_len_g = L_ARRAY_SIZE(guj_ext_gsm);
-                t->single_u = guj_ext_unicode;
-                t->single_len_u = L_ARRAY_SIZE(guj_ext_unicode);
-                return true;
+                g = guj_ext_gsm;
+                len_g = L_ARRAY_SIZE(guj_ext_gsm);
+                u = guj_ext_unicode;
+                len_u = L_ARRAY_SIZE(guj_ext_unicode);
+                break;
 
 	case GSM_DIALECT_HINDI:
-		t->single_g = hin_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(hin_ext_gsm);
-		t->single_u = hin_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(hin_ext_unicode);
-		return true;
+		g = hin_ext_gsm;
+		len_g = L_ARRAY_SIZE(hin_ext_gsm);
+		u = hin_ext_unicode;
+		len_u = L_ARRAY_SIZE(hin_ext_unicode);
+		break;
 
 	case GSM_DIALECT_KANNADA:
-		t->single_g = kan_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(kan_ext_gsm);
-		t->single_u = kan_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(kan_ext_unicode);
-		return true;
+		g = kan_ext_gsm;
+		len_g = L_ARRAY_SIZE(kan_ext_gsm);
+		u = kan_ext_unicode;
+		len_u = L_ARRAY_SIZE(kan_ext_unicode);
+		break;
 
 	case GSM_DIALECT_MALAYALAM:
-		t->single_g = mal_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(mal_ext_gsm);
-		t->single_u = mal_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(mal_ext_unicode);
-		return true;
+		g = mal_ext_gsm;
+		len_g = L_ARRAY_SIZE(mal_ext_gsm);
+		u = mal_ext_unicode;
+		len_u = L_ARRAY_SIZE(mal_ext_unicode);
+		break;
 
 	case GSM_DIALECT_ORIYA:
-		t->single_g = ori_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(ori_ext_gsm);
-		t->single_u = ori_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(ori_ext_unicode);
-		return true;
+		g = ori_ext_gsm;
+		len_g = L_ARRAY_SIZE(ori_ext_gsm);
+		u = ori_ext_unicode;
+		len_u = L_ARRAY_SIZE(ori_ext_unicode);
+		break;
 
 	case GSM_DIALECT_PUNJABI:
-		t->single_g = pun_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(pun_ext_gsm);
-		t->single_u = pun_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(pun_ext_unicode);
-		return true;
+		g = pun_ext_gsm;
+		len_g = L_ARRAY_SIZE(pun_ext_gsm);
+		u = pun_ext_unicode;
+		len_u = L_ARRAY_SIZE(pun_ext_unicode);
+		break;
 
 	case GSM_DIALECT_TAMIL:
-		t->single_g = tam_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tam_ext_gsm);
-		t->single_u = tam_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tam_ext_unicode);
-		return true;
+		g = tam_ext_gsm;
+		len_g = L_ARRAY_SIZE(tam_ext_gsm);
+		u = tam_ext_unicode;
+		len_u = L_ARRAY_SIZE(tam_ext_unicode);
+		break;
 
 	case GSM_DIALECT_TELUGU:
-		t->single_g = tel_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(tel_ext_gsm);
-		t->single_u = tel_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(tel_ext_unicode);
-		return true;
+		g = tel_ext_gsm;
+		len_g = L_ARRAY_SIZE(tel_ext_gsm);
+		u = tel_ext_unicode;
+		len_u = L_ARRAY_SIZE(tel_ext_unicode);
+		break;
 
 	case GSM_DIALECT_URDU:
-		t->single_g = urd_ext_gsm;
-		t->single_len_g = L_ARRAY_SIZE(urd_ext_gsm);
-		t->single_u = urd_ext_unicode;
-		t->single_len_u = L_ARRAY_SIZE(urd_ext_unicode);
-		return true;
-        }
+		g = urd_ext_gsm;
+		len_g = L_ARRAY_SIZE(urd_ext_gsm);
+		u = urd_ext_unicode;
+		len_u = L_ARRAY_SIZE(urd_ext_unicode);
+		break;
 
-	return false;
+	default:
+		return false;
+	}
+
+	t->single_g = build_gsm_index(&single_gsm_index[lang], g, len_g);
+	t->single_u = build_codepoint_index(&single_index[lang], u, len_u);
+	return true;
 }
 
 static bool conversion_table_init(struct conversion_table *t,
@@ -2876,6 +2937,63 @@ static bool conversion_table_init(struct conversion_table *t,
 			populate_single_shift(t, single);
 }
 
+/*!
+ * Converts text coded using GSM codec into UTF8 encoded text stored in the
+ * caller supplied buffer, using the given language identifiers for single
+ * shift and locking shift tables.  Only whole characters that fit in the
+ * first size bytes of buf are written, and the result is not terminated.
+ *
+ * Returns the length in bytes of the complete UTF8 encoded text, which may
+ * be larger than size, or -1 if the conversion could not be performed.
+ * Returns the number of bytes actually written into buf in items_written
+ * (if not NULL).
+ */
+long convert_gsm_to_utf8_own_buf(const unsigned char *text, long len,
+					long *items_written,
+					enum gsm_dialect locking_lang,
+					enum gsm_dialect single_lang,
+					char *buf, size_t size)
+{
+	struct conversion_table t;
+	long res_length = 0;
+	long written = 0;
+	long i;
+
+	if (!conversion_table_init(&t, locking_lang, single_lang))
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		unsigned short c;
+
+		if (text[i] > 0x7f)
+			return -1;
+
+		if (text[i] == 0x1b) {
+			++i;
+			if (i >= len || text[i] > 0x7f)
+				return -1;
+
+			c = gsm_single_shift_lookup(&t, text[i]);
+
+			if (c == GUND)
+				c = gsm_locking_shift_lookup(&t, text[i]);
+		} else
+			c = gsm_locking_shift_lookup(&t, text[i]);
+
+		/* Once a character did not fit, leave the rest out */
+		if (written == res_length &&
+				(size_t) (res_length + UTF8_LENGTH(c)) <= size)
+			written += l_utf8_from_wchar(c, buf + written);
+
+		res_length += UTF8_LENGTH(c);
+	}
+
+	if (items_written)
+		*items_written = written;
+
+	return res_length;
+}
+
 /*!
  * Converts text coded using GSM codec into UTF8 encoded text, using
  * the given language identifiers for single shift and locking shift
@@ -2925,7 +3043,7 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 
 		if (text[i] == 0x1b) {
 			++i;
-			if (i >= len)
+			if (i >= len || text[i] > 0x7f)
 				goto error;
 
 			c = gsm_single_shift_lookup(&t, text[i]);
@@ -2993,6 +3111,44 @@ char *convert_gsm_to_utf8(const unsigned char *text, long len,
 						GSM_DIALECT_DEFAULT);
 }
 
+static unsigned short utf8_to_gsm_lookup(struct conversion_table *t,
+						wchar_t c)
+{
+	unsigned short converted = unicode_locking_shift_lookup(t, c);
+
+	if (converted == GUND)
+		converted = unicode_single_shift_lookup(t, c);
+
+	return converted;
+}
+
+/* Encodes nchars characters already known to convert with the table */
+static unsigned char *utf8_to_gsm_encode(struct conversion_table *t,
+						const char *in, long nchars,
+						unsigned char *out)
+{
+	long i;
+
+	for (i = 0; i < nchars; i++) {
+		wchar_t c;
+		unsigned short converted;
+		int nread = l_utf8_get_codepoint(in, 4, &c);
+
+		converted = utf8_to_gsm_lookup(t, c);
+
+		if (converted & 0x1b00) {
+			*out = 0x1b;
+			++out;
+		}
+
+		*out = converted;
+		++out;
+		in += nread;
+	}
+
+	return out;
+}
+
 /*!
  * Converts UTF-8 encoded text to GSM alphabet.  The result is unpacked,
  * with the 7th bit always 0.  If terminator is not 0, a terminator character
@@ -3015,7 +3171,6 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	unsigned char *out;
 	unsigned char *res = NULL;
 	long res_len;
-	long i;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
 		return NULL;
@@ -3035,10 +3190,7 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 		if (c > 0xffff)
 			goto err_out;
 
-		converted = unicode_locking_shift_lookup(&t, c);
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
+		converted = utf8_to_gsm_lookup(&t, c);
 		if (converted == GUND)
 			goto err_out;
 
@@ -3052,39 +3204,79 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	}
 
 	res = l_malloc(res_len + (terminator ? 1 : 0));
-	in = text;
-	out = res;
+	out = utf8_to_gsm_encode(&t, text, nchars, res);
 
-	for (i = 0; i < nchars; i++) {
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - res;
+
+err_out:
+	if (items_read)
+		*items_read = in - text;
+
+	return res;
+}
+
+/*!
+ * Converts UTF-8 encoded text to GSM alphabet stored in the caller supplied
+ * buffer, using the given language identifiers for single shift and locking
+ * shift tables.  The result is unpacked and not terminated.  If len is less
+ * than 0, the text is NUL terminated.  Only whole characters, including any
+ * escape, that fit in the first size bytes of buf are written.
+ *
+ * Returns the length in bytes of the complete GSM encoded text, which may be
+ * larger than size, or -1 if the text could not be encoded.  Returns the
+ * number of bytes actually written into buf in items_written (if not NULL).
+ */
+long convert_utf8_to_gsm_own_buf(const char *text, long len,
+					long *items_written,
+					enum gsm_dialect locking_lang,
+					enum gsm_dialect single_lang,
+					unsigned char *buf, size_t size)
+{
+	struct conversion_table t;
+	const char *in = text;
+	long res_length = 0;
+	long written = 0;
+
+	if (!conversion_table_init(&t, locking_lang, single_lang))
+		return -1;
+
+	while ((len < 0 || text + len - in > 0) && *in) {
+		long max = len < 0 ? 4 : text + len - in;
 		wchar_t c;
 		unsigned short converted;
-		int nread = l_utf8_get_codepoint(in, 4, &c);
+		int nread = l_utf8_get_codepoint(in, max, &c);
+		int n;
 
-		converted = unicode_locking_shift_lookup(&t, c);
+		if (nread < 0 || c > 0xffff)
+			return -1;
+
+		converted = utf8_to_gsm_lookup(&t, c);
 		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
+			return -1;
 
-		if (converted & 0x1b00) {
-			*out = 0x1b;
-			++out;
+		n = (converted & 0x1b00) ? 2 : 1;
+
+		/* Once a character did not fit, leave the rest out */
+		if (written == res_length &&
+				(size_t) (res_length + n) <= size) {
+			if (n == 2)
+				buf[written++] = 0x1b;
+
+			buf[written++] = converted;
 		}
 
-		*out = converted;
-		++out;
+		res_length += n;
 		in += nread;
 	}
 
-	if (terminator)
-		*out = terminator;
-
 	if (items_written)
-		*items_written = out - res;
-
-err_out:
-	if (items_read)
-		*items_read = in - text;
+		*items_written = written;
 
-	return res;
+	return res_length;
 }
 
 unsigned char *convert_utf8_to_gsm(const char *text, long len,
@@ -3098,14 +3290,42 @@ unsigned char *convert_utf8_to_gsm(const char *text, long len,
 						GSM_DIALECT_DEFAULT);
 }
 
+/* Table pairs tried by convert_utf8_to_gsm_best_lang() */
+#define BEST_LANG_MAX_PAIRS 3
+
+/*
+ * Septets taken in the user data header by the national language shift
+ * IEs for a table pair, including the UDHL octet when there is any.
+ */
+static long best_lang_udh_septets(enum gsm_dialect locking,
+					enum gsm_dialect single)
+{
+	long octets = 0;
+
+	if (locking != GSM_DIALECT_DEFAULT)
+		octets += 3;
+
+	if (single != GSM_DIALECT_DEFAULT)
+		octets += 3;
+
+	if (octets)
+		octets += 1;
+
+	return (octets * 8 + 6) / 7;
+}
+
 /*!
- * Converts UTF-8 encoded text to GSM alphabet. It finds an encoding
- * that uses the minimum set of GSM dialects based on the hint given.
+ * Converts UTF-8 encoded text to GSM alphabet. It finds the cheapest
+ * encoding among the default dialect's tables, the single shift table
+ * of the hinted dialect, and both the single shift and locking shift
+ * tables of the hinted dialect.
  *
- * It first attempts to use the default dialect's single shift and
- * locking shift tables. It then tries with only the single shift
- * table of the hinted dialect, and finally with both the single shift
- * and locking shift tables of the hinted dialect.
+ * The text is scanned once against all the candidate table pairs, which
+ * are costed in septets including the user data header needed to signal
+ * their dialects, and then encoded once with the cheapest of them.  On
+ * a tie the pair using fewer dialects wins, so text that converts with
+ * the default tables keeps using them unless a national table saves
+ * enough escapes to pay for its header.
  *
  * Returns the encoded data or NULL if no suitable encoding could be
  * found. The data must be freed by the caller. If items_read is not
@@ -3121,48 +3341,117 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					enum gsm_dialect *used_locking,
 					enum gsm_dialect *used_single)
 {
-	enum gsm_dialect locking = GSM_DIALECT_DEFAULT;
-	enum gsm_dialect single = GSM_DIALECT_DEFAULT;
-	unsigned char *encoded;
-
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+	const enum gsm_dialect def = GSM_DIALECT_DEFAULT;
+	const enum gsm_dialect locking[BEST_LANG_MAX_PAIRS] = {
+		def, def, hint
+	};
+	const enum gsm_dialect single[BEST_LANG_MAX_PAIRS] = {
+		def, hint, hint
+	};
+	struct conversion_table t[BEST_LANG_MAX_PAIRS];
+	long septets[BEST_LANG_MAX_PAIRS] = { 0 };
+	bool viable[BEST_LANG_MAX_PAIRS];
+	unsigned int n_pairs = BEST_LANG_MAX_PAIRS;
+	unsigned int n_viable = 0;
+	unsigned int best = 0;
+	long best_cost = -1;
+	const char *in = utf8;
+	long nchars = 0;
+	unsigned char *res;
+	unsigned char *out;
+	unsigned int i;
 
 	if (hint == GSM_DIALECT_DEFAULT)
-		return NULL;
+		n_pairs = 1;
+	else if (hint == GSM_DIALECT_SPANISH)
+		/* Spanish dialect uses the default locking shift table */
+		n_pairs = 2;
+
+	for (i = 0; i < n_pairs; i++) {
+		viable[i] = conversion_table_init(&t[i], locking[i], single[i]);
+		n_viable += viable[i];
+	}
 
-	single = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+	while (n_viable && (len < 0 || utf8 + len - in > 0) && *in) {
+		long max = len < 0 ? 4 : utf8 + len - in;
+		wchar_t c;
+		int nread = l_utf8_get_codepoint(in, max, &c);
 
-	/* Spanish dialect uses the default locking shift table */
-	if (hint == GSM_DIALECT_SPANISH)
-		return NULL;
+		if (nread < 0 || c > 0xffff)
+			n_viable = 0;
+
+		for (i = 0; i < n_pairs && n_viable; i++) {
+			unsigned short converted;
+
+			if (!viable[i])
+				continue;
+
+			converted = utf8_to_gsm_lookup(&t[i], c);
+			if (converted == GUND) {
+				viable[i] = false;
+				n_viable -= 1;
+				continue;
+			}
+
+			septets[i] += (converted & 0x1b00) ? 2 : 1;
+		}
+
+		if (!n_viable)
+			break;
+
+		in += nread;
+		nchars += 1;
+	}
 
-	locking = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
+	if (items_read)
+		*items_read = in - utf8;
 
-	if (encoded == NULL)
+	if (!n_viable)
 		return NULL;
 
-out:
+	for (i = 0; i < n_pairs; i++) {
+		long cost;
+
+		if (!viable[i])
+			continue;
+
+		cost = septets[i] +
+			best_lang_udh_septets(locking[i], single[i]);
+
+		if (best_cost < 0 || cost < best_cost) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+
+	res = l_malloc(septets[best] + (terminator ? 1 : 0));
+	out = utf8_to_gsm_encode(&t[best], utf8, nchars, res);
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - res;
+
 	if (used_locking != NULL)
-		*used_locking = locking;
+		*used_locking = locking[best];
 
 	if (used_single != NULL)
-		*used_single = single;
+		*used_single = single[best];
 
-	return encoded;
+	return res;
 }
 
+/* Hex digit values plus one, so that anything else maps to 0 */
+static const unsigned char hex_value[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
 /*!
  * Decodes the hex encoded data and converts to a byte array.  If terminator
  * is not 0, the terminator character is appended to the end of the result.
@@ -3177,9 +3466,8 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
+	const unsigned char *p = (const unsigned char *) in;
 	long i, j;
-	char c;
-	unsigned char b;
 
 	if (!buf)
 		return NULL;
@@ -3189,28 +3477,14 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 
 	len &= ~0x1;
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = toupper(in[i]);
+	for (i = 0, j = 0; i < len; i += 2, j++) {
+		unsigned char hi = hex_value[p[i]];
+		unsigned char lo = hex_value[p[i + 1]];
 
-		if (c >= '0' && c <= '9')
-			b = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = 10 + c - 'A';
-		else
-			return NULL;
-
-		i += 1;
-
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = b * 16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = b * 16 + 10 + c - 'A';
-		else
+		if (!hi || !lo)
 			return NULL;
 
-		buf[j] = b;
+		buf[j] = (hi - 1) << 4 | (lo - 1);
 	}
 
 	if (terminator)
@@ -3232,7 +3506,6 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 				unsigned char terminator, char *buf)
 {
 	long i, j;
-	char c;
 
 	if (len < 0) {
 		i = 0;
@@ -3243,27 +3516,54 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 		len = i;
 	}
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = (in[i] >> 4) & 0xf;
+	for (i = 0, j = 0; i < len; i++, j += 2) {
+		buf[j] = hex_digits[in[i] >> 4];
+		buf[j + 1] = hex_digits[in[i] & 0xf];
+	}
 
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
+	buf[j] = '\0';
 
-		j += 1;
+	return buf;
+}
 
-		c = (in[i]) & 0xf;
+/*
+ * 7 octets hold exactly 8 septets, so once the stream is octet aligned the
+ * septets can be moved a whole group at a time by spreading or squeezing
+ * the bit fields of a 64-bit word
+ */
+static inline void unpack_7bit_group(const unsigned char *in,
+					unsigned char *out)
+{
+	uint64_t v = (uint64_t) in[0] | (uint64_t) in[1] << 8 |
+			(uint64_t) in[2] << 16 | (uint64_t) in[3] << 24 |
+			(uint64_t) in[4] << 32 | (uint64_t) in[5] << 40 |
+			(uint64_t) in[6] << 48;
 
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
-	}
+	v = (v & 0x000000000fffffffULL) | ((v << 4) & 0x0fffffff00000000ULL);
+	v = (v & 0x00003fff00003fffULL) | ((v << 2) & 0x3fff00003fff0000ULL);
+	v = (v & 0x007f007f007f007fULL) | ((v << 1) & 0x7f007f007f007f00ULL);
 
-	buf[j] = '\0';
+	l_put_le64(v, out);
+}
 
-	return buf;
+/* Septets with the top bit set are left to the septet at a time path */
+static inline bool pack_7bit_group(const unsigned char *in,
+					unsigned char *out)
+{
+	uint64_t v = l_get_le64(in);
+	int k;
+
+	if (v & 0x8080808080808080ULL)
+		return false;
+
+	v = (v & 0x007f007f007f007fULL) | ((v & 0x7f007f007f007f00ULL) >> 1);
+	v = (v & 0x00003fff00003fffULL) | ((v & 0x3fff00003fff0000ULL) >> 2);
+	v = (v & 0x000000000fffffffULL) | ((v & 0x0fffffff00000000ULL) >> 4);
+
+	for (k = 0; k < 7; k++)
+		out[k] = v >> (k * 8);
+
+	return true;
 }
 
 unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
@@ -3285,6 +3585,15 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 		max_to_unpack = len * 8 / 7;
 
 	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		/* Octet aligned, take a whole group if it fits */
+		if (bits == 7 && len - i >= 7 &&
+				max_to_unpack - (out - buf) >= 8) {
+			unpack_7bit_group(in + i, out);
+			out += 8;
+			i += 6;
+			continue;
+		}
+
 		/* Grab what we have in the current octet */
 		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
 
@@ -3386,6 +3695,13 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	}
 
 	for (i = 0; i < len; i++) {
+		/* Octet aligned, pack a whole group if there is one */
+		if (bits == 7 && len - i >= 8 && pack_7bit_group(in + i, out)) {
+			out += 7;
+			i += 7;
+			continue;
+		}
+
 		if (bits != 7) {
 			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
 					(bits + 1);
@@ -3463,26 +3779,81 @@ unsigned char *pack_7bit(const unsigned char *in, long len, int byte_offset,
 					terminator, buf);
 }
 
-char *sim_string_to_utf8(const unsigned char *buffer, int length)
+/* UTF8 output that keeps whole characters while they fit, see below */
+struct utf8_sink {
+	char *buf;
+	size_t size;
+	long len;
+	long written;
+};
+
+static void utf8_sink_put(struct utf8_sink *sink, unsigned short c)
+{
+	/* Once a character did not fit, leave the rest out */
+	if (sink->written == sink->len &&
+			(size_t) (sink->len + UTF8_LENGTH(c)) < sink->size)
+		sink->written += l_utf8_from_wchar(c,
+						sink->buf + sink->written);
+
+	sink->len += UTF8_LENGTH(c);
+}
+
+/* Same rules as l_utf8_from_ucs2be, a NUL character ends the string */
+static bool sim_ucs2_to_utf8(struct utf8_sink *sink,
+				const unsigned char *ucs2, int len)
 {
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		uint16_t c = l_get_be16(ucs2 + i);
+
+		if (!c)
+			break;
+
+		if (c >= 0xd800 && c < 0xe000)
+			return false;
+
+		if ((c >= 0xfdd0 && c <= 0xfdef) || c >= 0xfffe)
+			return false;
+
+		utf8_sink_put(sink, c);
+	}
+
+	return true;
+}
+
+/*!
+ * Decodes a SIM alpha field, as described in 3GPP 31.102 Annex A, into
+ * UTF8 text stored in the caller supplied buffer.  Only whole characters
+ * that fit in the first size - 1 bytes of buf are written, followed by a
+ * terminator unless size is 0, so that a call with a NULL buf and a size
+ * of 0 only finds the length.
+ *
+ * Returns the length in bytes of the complete UTF8 text, not including
+ * the terminator, or -1 if the field is not valid.
+ */
+long sim_string_to_utf8_own_buf(const unsigned char *buffer, int length,
+					char *buf, size_t size)
+{
+	struct utf8_sink sink = { .buf = buf, .size = size };
 	struct conversion_table t;
 	int i;
 	int j;
 	int num_chars;
 	unsigned short ucs2_offset;
-	int res_len;
 	int offset;
-	char *utf8 = NULL;
-	char *out;
 
 	if (!conversion_table_init(&t, GSM_DIALECT_DEFAULT,
 					GSM_DIALECT_DEFAULT))
-		return NULL;
+		return -1;
 
 	if (length < 1)
-		return NULL;
+		return -1;
 
 	if (buffer[0] < 0x80) {
+		long len;
+		long written;
+
 		/*
 		 * We have to find the real length, since on SIM file system
 		 * alpha fields are 0xff padded
@@ -3491,14 +3862,21 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			if (buffer[i] == 0xff)
 				break;
 
-		return convert_gsm_to_utf8(buffer, i, NULL, NULL, 0);
+		len = convert_gsm_to_utf8_own_buf(buffer, i, &written,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						buf, size ? size - 1 : 0);
+		if (len >= 0 && size)
+			buf[written] = '\0';
+
+		return len;
 	}
 
 	switch (buffer[0]) {
 	case 0x80:
 		if (((length - 1) % 2) == 1) {
 			if (buffer[length - 1] != 0xff)
-				return NULL;
+				return -1;
 
 			length = length - 1;
 		}
@@ -3507,10 +3885,13 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			if (buffer[i] == 0xff && buffer[i + 1] == 0xff)
 				break;
 
-		return l_utf8_from_ucs2be(buffer + 1, i - 1);
+		if (!sim_ucs2_to_utf8(&sink, buffer + 1, i - 1))
+			return -1;
+
+		goto done;
 	case 0x81:
 		if (length < 3 || (buffer[1] > (length - 3)))
-			return NULL;
+			return -1;
 
 		num_chars = buffer[1];
 		ucs2_offset = buffer[2] << 7;
@@ -3519,7 +3900,7 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 
 	case 0x82:
 		if (length < 4 || buffer[1] > length - 4)
-			return NULL;
+			return -1;
 
 		num_chars = buffer[1];
 		ucs2_offset = (buffer[2] << 8) | buffer[3];
@@ -3533,10 +3914,9 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 		break;
 
 	default:
-		return NULL;
+		return -1;
 	}
 
-	res_len = 0;
 	i = offset;
 	j = 0;
 
@@ -3547,9 +3927,9 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			c = (buffer[i++] & 0x7f) + ucs2_offset;
 
 			if (c >= 0xd800 && c < 0xe000)
-				return NULL;
+				return -1;
 
-			res_len += UTF8_LENGTH(c);
+			utf8_sink_put(&sink, c);
 			j += 1;
 			continue;
 		}
@@ -3557,12 +3937,12 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 		if (buffer[i] == 0x1b) {
 			++i;
 			if (i >= length)
-				return NULL;
+				return -1;
 
 			c = gsm_single_shift_lookup(&t, buffer[i++]);
 
 			if (c == 0)
-				return NULL;
+				return -1;
 
 			j += 2;
 		} else {
@@ -3570,36 +3950,34 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			j += 1;
 		}
 
-		res_len += UTF8_LENGTH(c);
+		utf8_sink_put(&sink, c);
 	}
 
 	if (j != num_chars)
-		return NULL;
+		return -1;
 
 	/* Check that the string is padded out to the length by 0xff */
 	for (; i < length; i++)
 		if (buffer[i] != 0xff)
-			return NULL;
+			return -1;
 
-	utf8 = l_malloc(res_len + 1);
-	i = offset;
-	out = utf8;
+done:
+	if (size)
+		buf[sink.written] = '\0';
 
-	while (out < utf8 + res_len) {
-		unsigned short c;
+	return sink.len;
+}
 
-		if (buffer[i] & 0x80)
-			c = (buffer[i++] & 0x7f) + ucs2_offset;
-		else if (buffer[i] == 0x1b) {
-			++i;
-			c = gsm_single_shift_lookup(&t, buffer[i++]);
-		} else
-			c = gsm_locking_shift_lookup(&t, buffer[i++]);
+char *sim_string_to_utf8(const unsigned char *buffer, int length)
+{
+	long len = sim_string_to_utf8_own_buf(buffer, length, NULL, 0);
+	char *utf8;
 
-		out += l_utf8_from_wchar(c, out);
-	}
+	if (len < 0)
+		return NULL;
 
-	*out = '\0';
+	utf8 = l_malloc(len + 1);
+	sim_string_to_utf8_own_buf(buffer, length, utf8, len + 1);
 
 	return utf8;
 }
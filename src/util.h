@@ -6,6 +6,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 enum gsm_dialect {
 	GSM_DIALECT_DEFAULT = 0,
@@ -57,6 +58,18 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 					enum gsm_dialect locking_shift_lang,
 					enum gsm_dialect single_shift_lang);
 
+long convert_gsm_to_utf8_own_buf(const unsigned char *text, long len,
+					long *items_written,
+					enum gsm_dialect locking_shift_lang,
+					enum gsm_dialect single_shift_lang,
+					char *buf, size_t size);
+
+long convert_utf8_to_gsm_own_buf(const char *text, long len,
+					long *items_written,
+					enum gsm_dialect locking_shift_lang,
+					enum gsm_dialect single_shift_lang,
+					unsigned char *buf, size_t size);
+
 unsigned char *convert_utf8_to_gsm(const char *text, long len, long *items_read,
 				long *items_written, unsigned char terminator);
 
@@ -101,6 +114,8 @@ unsigned char *pack_7bit(const unsigned char *in, long len, int byte_offset,
 				long *items_written, unsigned char terminator);
 
 char *sim_string_to_utf8(const unsigned char *buffer, int length);
+long sim_string_to_utf8_own_buf(const unsigned char *buffer, int length,
+					char *buf, size_t size);
 
 unsigned char *utf8_to_sim_string(const char *utf,
 					int max_length, int *out_length);
@@ -35,8 +35,49 @@
 #define SETTINGS_STORE "voicecall"
 #define SETTINGS_GROUP "Settings"
 
+/*
+ * Call setup stages, each stamped once per call with the monotonic
+ * clock.  The first three are taken while dialing and kept on the atom
+ * until the outgoing call object shows up.
+ */
+enum call_timing {
+	TIMING_REQUESTED = 0,
+	TIMING_SUBMITTED,
+	TIMING_ACKNOWLEDGED,
+	TIMING_DETECTED,
+	TIMING_DIALING,
+	TIMING_ALERTING,
+	TIMING_ACTIVE,
+	TIMING_AUDIO,
+	TIMING_COUNT,
+};
+
+static const char *timing_names[] = {
+	[TIMING_REQUESTED] = "Requested",
+	[TIMING_SUBMITTED] = "Submitted",
+	[TIMING_ACKNOWLEDGED] = "Acknowledged",
+	[TIMING_DETECTED] = "Detected",
+	[TIMING_DIALING] = "Dialing",
+	[TIMING_ALERTING] = "Alerting",
+	[TIMING_ACTIVE] = "Active",
+	[TIMING_AUDIO] = "AudioConnected",
+};
+
+/* Upper bounds in seconds, the last bucket counts everything slower */
+static const unsigned int setup_bounds[] = { 1, 2, 3, 5, 8, 13, 20, 30 };
+
+static const char *setup_names[] = {
+	"UpTo1s", "UpTo2s", "UpTo3s", "UpTo5s", "UpTo8s", "UpTo13s",
+	"UpTo20s", "UpTo30s", "Over30s",
+};
+
+#define SETUP_BUCKETS L_ARRAY_SIZE(setup_names)
+
 struct ofono_voicecall {
 	GSList *call_list;
+	GHashTable *call_index;	/* call id to struct voicecall */
+	unsigned int num_calls;
+	unsigned int status_count[CALL_STATUS_DISCONNECTED + 1];
 	GSList *release_list;
 	GSList *multiparty_list;
 	GHashTable *en_list; /* emergency number list */
@@ -62,6 +103,9 @@ struct ofono_voicecall {
 	ofono_voicecall_cb_t release_queue_done_cb;
 	struct ofono_emulator *pending_em;
 	unsigned int pending_id;
+	uint64_t dial_timings[TIMING_COUNT];
+	uint32_t setup_times[SETUP_BUCKETS];
+	struct ofono_telemetry *setup_time;
 };
 
 struct voicecall {
@@ -75,6 +119,8 @@ struct voicecall {
 	gboolean dial_result_handled;
 	ofono_bool_t remote_held;
 	ofono_bool_t remote_multiparty;
+	uint64_t timings[TIMING_COUNT];
+	bool setup_counted;
 };
 
 struct dial_request {
@@ -195,21 +241,88 @@ static const char *time_to_str(const time_t *t)
 	return buf;
 }
 
-static unsigned int voicecalls_num_with_status(struct ofono_voicecall *vc,
-						int status)
+static void dial_timing_start(struct ofono_voicecall *vc)
 {
-	GSList *l;
-	struct voicecall *v;
-	int num = 0;
+	memset(vc->dial_timings, 0, sizeof(vc->dial_timings));
+	vc->dial_timings[TIMING_REQUESTED] = l_time_now();
+}
 
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
+static void dial_timing_clear(struct ofono_voicecall *vc)
+{
+	memset(vc->dial_timings, 0, sizeof(vc->dial_timings));
+}
 
-		if (v->call->status == status)
-			num += 1;
+/*
+ * Fills a NULL terminated name/value list for the dict helpers, values
+ * are milliseconds since the dial request or, failing that, detection.
+ */
+static void timings_to_entries(struct voicecall *v, const void **entries,
+				uint32_t *values)
+{
+	uint64_t origin = v->timings[TIMING_REQUESTED];
+	unsigned int i;
+	unsigned int n = 0;
+
+	if (origin == 0)
+		origin = v->timings[TIMING_DETECTED];
+
+	for (i = 0; i < TIMING_COUNT; i++) {
+		if (v->timings[i] == 0)
+			continue;
+
+		values[i] = l_time_to_msecs(l_time_diff(origin,
+							v->timings[i]));
+		entries[n++] = timing_names[i];
+		entries[n++] = &values[i];
 	}
 
-	return num;
+	entries[n] = NULL;
+}
+
+static void setup_times_to_entries(struct ofono_voicecall *vc,
+					const void **entries)
+{
+	unsigned int i;
+
+	for (i = 0; i < SETUP_BUCKETS; i++) {
+		entries[i * 2] = setup_names[i];
+		entries[i * 2 + 1] = &vc->setup_times[i];
+	}
+
+	entries[SETUP_BUCKETS * 2] = NULL;
+}
+
+/*
+ * call_list stays sorted for iteration, while lookups by id and the
+ * status queries below go through the index and per-status counters.
+ */
+static void voicecalls_add(struct ofono_voicecall *vc, struct voicecall *v)
+{
+	vc->call_list = g_slist_insert_sorted(vc->call_list, v, call_compare);
+	g_hash_table_insert(vc->call_index, GUINT_TO_POINTER(v->call->id), v);
+	vc->status_count[v->call->status] += 1;
+	vc->num_calls += 1;
+}
+
+static void voicecalls_remove(struct ofono_voicecall *vc,
+					struct voicecall *v)
+{
+	vc->call_list = g_slist_remove(vc->call_list, v);
+	g_hash_table_remove(vc->call_index, GUINT_TO_POINTER(v->call->id));
+	vc->status_count[v->call->status] -= 1;
+	vc->num_calls -= 1;
+}
+
+static struct voicecall *voicecalls_find(struct ofono_voicecall *vc,
+						unsigned int id)
+{
+	return g_hash_table_lookup(vc->call_index, GUINT_TO_POINTER(id));
+}
+
+static unsigned int voicecalls_num_with_status(struct ofono_voicecall *vc,
+						int status)
+{
+	return vc->status_count[status];
 }
 
 static unsigned int voicecalls_num_active(struct ofono_voicecall *vc)
@@ -234,35 +347,14 @@ static unsigned int voicecalls_num_connecting(struct ofono_voicecall *vc)
 
 static gboolean voicecalls_have_active(struct ofono_voicecall *vc)
 {
-	GSList *l;
-	struct voicecall *v;
-
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		if (v->call->status == CALL_STATUS_ACTIVE ||
-				v->call->status == CALL_STATUS_DIALING ||
-				v->call->status == CALL_STATUS_ALERTING)
-			return TRUE;
-	}
-
-	return FALSE;
+	return voicecalls_num_active(vc) > 0 ||
+			voicecalls_num_connecting(vc) > 0;
 }
 
 static gboolean voicecalls_have_with_status(struct ofono_voicecall *vc,
 						int status)
 {
-	GSList *l;
-	struct voicecall *v;
-
-	for (l = vc->call_list; l; l = l->next) {
-		v = l->data;
-
-		if (v->call->status == status)
-			return TRUE;
-	}
-
-	return FALSE;
+	return voicecalls_num_with_status(vc, status) > 0;
 }
 
 static gboolean voicecalls_have_held(struct ofono_voicecall *vc)
@@ -291,6 +383,8 @@ static void dial_request_finish(struct ofono_voicecall *vc)
 	l_free(dial_req->message);
 	g_free(dial_req);
 	vc->dial_req = NULL;
+
+	dial_timing_clear(vc);
 }
 
 static gboolean voicecalls_can_dtmf(struct ofono_voicecall *vc)
@@ -387,6 +481,9 @@ static void append_voicecall_properties(struct voicecall *v,
 	const char *name;
 	ofono_bool_t mpty;
 	dbus_bool_t emergency_call;
+	const void *timing_entries[TIMING_COUNT * 2 + 1];
+	const void **timings = timing_entries;
+	uint32_t timing_values[TIMING_COUNT];
 
 	status = call_status_to_string(call->status);
 
@@ -453,6 +550,10 @@ static void append_voicecall_properties(struct voicecall *v,
 
 	ofono_dbus_dict_append(dict, "Emergency",
 					DBUS_TYPE_BOOLEAN, &emergency_call);
+
+	timings_to_entries(v, timing_entries, timing_values);
+	ofono_dbus_dict_append_dict(dict, "Timings", DBUS_TYPE_UINT32,
+					&timings);
 }
 
 static DBusMessage *voicecall_get_properties(DBusConnection *conn,
@@ -681,6 +782,100 @@ static const char *voicecall_build_path(struct ofono_voicecall *vc,
 	return path;
 }
 
+static enum call_timing status_to_timing(int status)
+{
+	switch (status) {
+	case CALL_STATUS_DIALING:
+		return TIMING_DIALING;
+	case CALL_STATUS_ALERTING:
+		return TIMING_ALERTING;
+	case CALL_STATUS_ACTIVE:
+		return TIMING_ACTIVE;
+	}
+
+	return TIMING_COUNT;
+}
+
+/* Time from the dial request until the far end rings or answers */
+static void voicecall_count_setup(struct voicecall *v, uint64_t now)
+{
+	struct ofono_voicecall *vc = v->vc;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = __ofono_atom_get_path(vc->atom);
+	const void *entries[SETUP_BUCKETS * 2 + 1];
+	const void **setup_times = entries;
+	unsigned int msecs;
+	unsigned int i;
+
+	if (v->setup_counted || v->timings[TIMING_REQUESTED] == 0)
+		return;
+
+	v->setup_counted = true;
+	msecs = l_time_to_msecs(l_time_diff(v->timings[TIMING_REQUESTED],
+						now));
+
+	for (i = 0; i < L_ARRAY_SIZE(setup_bounds); i++)
+		if (msecs <= setup_bounds[i] * 1000)
+			break;
+
+	vc->setup_times[i] += 1;
+	__ofono_telemetry_sample(vc->setup_time, msecs);
+
+	DBG("call %u set up in %u ms", v->call->id, msecs);
+
+	setup_times_to_entries(vc, entries);
+	ofono_dbus_signal_dict_property_changed(conn, path,
+					OFONO_VOICECALL_MANAGER_INTERFACE,
+					"SetupTimes", DBUS_TYPE_UINT32,
+					&setup_times);
+}
+
+static void voicecall_timing_mark(struct voicecall *v,
+					enum call_timing stage, bool emit)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const void *entries[TIMING_COUNT * 2 + 1];
+	const void **timings = entries;
+	uint32_t values[TIMING_COUNT];
+	const char *path;
+
+	if (stage == TIMING_COUNT || v->timings[stage] != 0)
+		return;
+
+	v->timings[stage] = l_time_now();
+
+	if (stage == TIMING_ALERTING || stage == TIMING_ACTIVE)
+		voicecall_count_setup(v, v->timings[stage]);
+
+	if (!emit)
+		return;
+
+	path = voicecall_build_path(v->vc, v->call);
+	timings_to_entries(v, entries, values);
+	ofono_dbus_signal_dict_property_changed(conn, path,
+						OFONO_VOICECALL_INTERFACE,
+						"Timings", DBUS_TYPE_UINT32,
+						&timings);
+}
+
+/*
+ * Called before a new call is registered, an outgoing call takes over
+ * whatever was stamped while dialing.
+ */
+static void voicecall_timing_init(struct voicecall *v)
+{
+	struct ofono_voicecall *vc = v->vc;
+
+	if (v->call->direction == CALL_DIRECTION_MOBILE_ORIGINATED &&
+			vc->dial_timings[TIMING_REQUESTED] != 0) {
+		memcpy(v->timings, vc->dial_timings, sizeof(v->timings));
+		dial_timing_clear(vc);
+	}
+
+	v->timings[TIMING_DETECTED] = l_time_now();
+	voicecall_timing_mark(v, status_to_timing(v->call->status), false);
+}
+
 static void voicecall_emit_disconnect_reason(struct voicecall *call,
 					enum ofono_disconnect_reason reason)
 {
@@ -876,6 +1071,11 @@ static void voicecall_set_call_status(struct voicecall *call, int status)
 
 	old_status = call->call->status;
 
+	if (voicecalls_find(call->vc, call->call->id) == call) {
+		call->vc->status_count[old_status] -= 1;
+		call->vc->status_count[status] += 1;
+	}
+
 	call->call->status = status;
 
 	status_str = call_status_to_string(status);
@@ -886,6 +1086,8 @@ static void voicecall_set_call_status(struct voicecall *call, int status)
 						"State", DBUS_TYPE_STRING,
 						&status_str);
 
+	voicecall_timing_mark(call, status_to_timing(status), true);
+
 	notify_emulator_call_status(call->vc);
 
 	if (status == CALL_STATUS_ACTIVE &&
@@ -1127,6 +1329,9 @@ struct ofono_call *__ofono_voicecall_find_call_with_status(
 	GSList *l;
 	struct voicecall *v;
 
+	if (!voicecalls_have_with_status(vc, status))
+		return NULL;
+
 	for (l = vc->call_list; l; l = l->next) {
 		v = l->data;
 
@@ -1287,6 +1492,8 @@ static DBusMessage *manager_get_properties(DBusConnection *conn,
 	char **list;
 	GHashTableIter ht_iter;
 	gpointer key, value;
+	const void *setup_entries[SETUP_BUCKETS * 2 + 1];
+	const void **setup_times = setup_entries;
 
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
@@ -1309,6 +1516,10 @@ static DBusMessage *manager_get_properties(DBusConnection *conn,
 					DBUS_TYPE_STRING, &list);
 	g_free(list);
 
+	setup_times_to_entries(vc, setup_entries);
+	ofono_dbus_dict_append_dict(&dict, "SetupTimes", DBUS_TYPE_UINT32,
+					&setup_times);
+
 	dbus_message_iter_close_container(&iter, &dict);
 
 	return reply;
@@ -1357,6 +1568,7 @@ static struct voicecall *synthesize_outgoing_call(struct ofono_voicecall *vc,
 
 	v = voicecall_create(vc, call);
 	v->detect_time = time(NULL);
+	voicecall_timing_init(v);
 
 	DBG("Registering new call: %d", call->id);
 	if (!voicecall_dbus_register(v)) {
@@ -1365,7 +1577,7 @@ static struct voicecall *synthesize_outgoing_call(struct ofono_voicecall *vc,
 	}
 
 	__ofono_modem_callid_hold(modem, call->id);
-	vc->call_list = g_slist_insert_sorted(vc->call_list, v, call_compare);
+	voicecalls_add(vc, v);
 
 	return v;
 }
@@ -1384,6 +1596,7 @@ static struct voicecall *dial_handle_result(struct ofono_voicecall *vc,
 		DBG("Dial callback returned error: %s",
 			telephony_error_to_str(error));
 
+		dial_timing_clear(vc);
 		return NULL;
 	}
 
@@ -1417,6 +1630,7 @@ static struct voicecall *dial_handle_result(struct ofono_voicecall *vc,
 
 handled:
 	v->dial_result_handled = TRUE;
+	voicecall_timing_mark(v, TIMING_ACKNOWLEDGED, !*need_to_emit);
 
 	return v;
 }
@@ -1464,7 +1678,7 @@ static int voicecall_dial(struct ofono_voicecall *vc, const char *number,
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
 	struct ofono_phone_number ph;
 
-	if (g_slist_length(vc->call_list) >= MAX_VOICE_CALLS)
+	if (vc->num_calls >= MAX_VOICE_CALLS)
 		return -EPERM;
 
 	if (valid_ussd_string(number, vc->call_list != NULL))
@@ -1489,6 +1703,8 @@ static int voicecall_dial(struct ofono_voicecall *vc, const char *number,
 	if (voicecalls_have_active(vc) && voicecalls_have_held(vc))
 		return -EBUSY;
 
+	dial_timing_start(vc);
+
 	if (is_emergency_number(vc, number) == TRUE)
 		__ofono_modem_inc_emergency_mode(modem);
 
@@ -1500,6 +1716,7 @@ static int voicecall_dial(struct ofono_voicecall *vc, const char *number,
 		storage_sync(vc->imsi, SETTINGS_STORE, vc->settings);
 	}
 
+	vc->dial_timings[TIMING_SUBMITTED] = l_time_now();
 	vc->driver->dial(vc, &ph, clir, cb, vc);
 
 	return 0;
@@ -1564,6 +1781,8 @@ static void manager_dial_hfp_callback(const struct ofono_error *error,
 	if (!v)
 		goto error;
 
+	voicecall_timing_mark(v, TIMING_ACKNOWLEDGED, false);
+
 	path = voicecall_build_path(vc, v->call);
 	reply = dbus_message_new_method_return(vc->pending);
 	dbus_message_append_args(reply, DBUS_TYPE_OBJECT_PATH, &path,
@@ -1574,6 +1793,7 @@ static void manager_dial_hfp_callback(const struct ofono_error *error,
 	return;
 
 error:
+	dial_timing_clear(vc);
 	__ofono_dbus_pending_reply(&vc->pending,
 					__ofono_error_failed(vc->pending));
 }
@@ -1583,7 +1803,7 @@ static int voicecall_dial_hfp(struct ofono_voicecall *vc, unsigned int position,
 {
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
 
-	if (g_slist_length(vc->call_list) >= MAX_VOICE_CALLS)
+	if (vc->num_calls >= MAX_VOICE_CALLS)
 		return -EPERM;
 
 	if (ofono_modem_get_online(modem) == FALSE)
@@ -1604,11 +1824,15 @@ static int voicecall_dial_hfp(struct ofono_voicecall *vc, unsigned int position,
 		if (vc->driver->dial_last == NULL)
 			return -ENOTSUP;
 
+		dial_timing_start(vc);
+		vc->dial_timings[TIMING_SUBMITTED] = l_time_now();
 		vc->driver->dial_last(vc, cb, vc);
 	} else {
 		if (vc->driver->dial_memory == NULL )
 			return -ENOTSUP;
 
+		dial_timing_start(vc);
+		vc->dial_timings[TIMING_SUBMITTED] = l_time_now();
 		vc->driver->dial_memory(vc, position, cb, vc);
        }
 
@@ -2297,17 +2521,13 @@ void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
 
 	__ofono_modem_callid_release(modem, id);
 
-	l = g_slist_find_custom(vc->call_list, GUINT_TO_POINTER(id),
-				call_compare_by_id);
-
-	if (l == NULL) {
+	call = voicecalls_find(vc, id);
+	if (call == NULL) {
 		ofono_error("Plugin notified us of call disconnect for"
 				" unknown call");
 		return;
 	}
 
-	call = l->data;
-
 	ts = time(NULL);
 	prev_status = call->call->status;
 
@@ -2349,16 +2569,15 @@ void ofono_voicecall_disconnected(struct ofono_voicecall *vc, int id,
 
 	voicecalls_emit_call_removed(vc, call);
 
-	voicecall_dbus_unregister(vc, call);
+	voicecalls_remove(vc, call);
 
-	vc->call_list = g_slist_remove(vc->call_list, call);
+	voicecall_dbus_unregister(vc, call);
 }
 
 void ofono_voicecall_notify(struct ofono_voicecall *vc,
 				const struct ofono_call *call)
 {
 	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
-	GSList *l;
 	struct voicecall *v;
 	struct ofono_call *newcall;
 
@@ -2368,17 +2587,14 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 			call->status, call->id, call->phone_number.number,
 			call->called_number.number, call->name);
 
-	l = g_slist_find_custom(vc->call_list, GUINT_TO_POINTER(call->id),
-				call_compare_by_id);
-
-	if (l) {
+	v = voicecalls_find(vc, call->id);
+	if (v) {
 		DBG("Found call with id: %d", call->id);
-		voicecall_set_call_status(l->data, call->status);
-		voicecall_set_call_lineid(l->data, &call->phone_number,
+		voicecall_set_call_status(v, call->status);
+		voicecall_set_call_lineid(v, &call->phone_number,
 						call->clip_validity);
-		voicecall_set_call_calledid(l->data, &call->called_number);
-		voicecall_set_call_name(l->data, call->name,
-						call->cnap_validity);
+		voicecall_set_call_calledid(v, &call->called_number);
+		voicecall_set_call_name(v, call->name, call->cnap_validity);
 
 		return;
 	}
@@ -2421,6 +2637,7 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 	}
 
 	v->detect_time = time(NULL);
+	voicecall_timing_init(v);
 
 	if (!voicecall_dbus_register(v)) {
 		ofono_error("Unable to register voice call");
@@ -2428,7 +2645,7 @@ void ofono_voicecall_notify(struct ofono_voicecall *vc,
 	}
 
 	__ofono_modem_callid_hold(modem, call->id);
-	vc->call_list = g_slist_insert_sorted(vc->call_list, v, call_compare);
+	voicecalls_add(vc, v);
 
 	voicecalls_emit_call_added(vc, v);
 }
@@ -2850,6 +3067,12 @@ static void voicecall_unregister(struct ofono_atom *atom)
 
 	g_slist_free(vc->call_list);
 	vc->call_list = NULL;
+	g_hash_table_remove_all(vc->call_index);
+	memset(vc->status_count, 0, sizeof(vc->status_count));
+	vc->num_calls = 0;
+
+	__ofono_telemetry_unregister(vc->setup_time);
+	vc->setup_time = NULL;
 
 	ofono_modem_remove_interface(modem, OFONO_VOICECALL_MANAGER_INTERFACE);
 	g_dbus_unregister_interface(conn, path,
@@ -2882,11 +3105,13 @@ static void voicecall_remove(struct ofono_atom *atom)
 		g_queue_free(vc->toneq);
 	}
 
+	g_hash_table_destroy(vc->call_index);
 	g_free(vc);
 }
 
 OFONO_DEFINE_ATOM_CREATE(voicecall, OFONO_ATOM_TYPE_VOICECALL, {
 	atom->toneq = g_queue_new();
+	atom->call_index = g_hash_table_new(g_direct_hash, g_direct_equal);
 })
 
 static void read_sim_ecc_numbers(int id, void *userdata)
@@ -3625,6 +3850,10 @@ void ofono_voicecall_register(struct ofono_voicecall *vc)
 	add_to_en_list(vc, (char **) default_en_list_no_sim);
 	add_to_en_list(vc, (char **) default_en_list);
 
+	vc->setup_time = __ofono_telemetry_register(modem,
+						"voicecall.setup-time",
+						OFONO_TELEMETRY_HISTOGRAM);
+
 	vc->sim_watch = __ofono_modem_add_atom_watch(modem,
 						OFONO_ATOM_TYPE_SIM,
 						sim_watch, vc, NULL);
@@ -3678,15 +3907,15 @@ ofono_bool_t __ofono_voicecall_is_busy(struct ofono_voicecall *vc,
 		return vc->call_list != NULL;
 	case OFONO_VOICECALL_INTERACTION_DISCONNECT:
 		/* Only support releasing active calls */
-		if (voicecalls_num_active(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_active(vc) == vc->num_calls)
 			return FALSE;
 
 		return TRUE;
 	case OFONO_VOICECALL_INTERACTION_PUT_ON_HOLD:
-		if (voicecalls_num_active(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_active(vc) == vc->num_calls)
 			return FALSE;
 
-		if (voicecalls_num_held(vc) == g_slist_length(vc->call_list))
+		if (voicecalls_num_held(vc) == vc->num_calls)
 			return FALSE;
 
 		return TRUE;
@@ -3746,6 +3975,7 @@ static void dial_request(struct ofono_voicecall *vc)
 		__ofono_modem_inc_emergency_mode(modem);
 	}
 
+	vc->dial_timings[TIMING_SUBMITTED] = l_time_now();
 	vc->driver->dial(vc, &vc->dial_req->ph, OFONO_CLIR_OPTION_DEFAULT,
 				dial_request_cb, vc);
 }
@@ -3808,6 +4038,7 @@ int __ofono_voicecall_dial(struct ofono_voicecall *vc,
 	strncpy(req->ph.number, addr, OFONO_MAX_PHONE_NUMBER_LENGTH);
 
 	vc->dial_req = req;
+	dial_timing_start(vc);
 
 	switch (interaction) {
 	case OFONO_VOICECALL_INTERACTION_NONE:
@@ -3895,6 +4126,22 @@ static gboolean tone_request_run(gpointer user_data)
 	if (entry == NULL)
 		return FALSE;
 
+	if (vc->driver->send_tone_string) {
+		len = strlen(entry->left);
+		len = MIN(len, OFONO_VOICECALL_TONE_STRING_MAX);
+
+		final = entry->left[len];
+		entry->left[len] = '\0';
+
+		vc->driver->send_tone_string(vc, entry->left,
+						tone_request_cb, vc);
+
+		entry->left += len;
+		entry->left[0] = final;
+
+		return FALSE;
+	}
+
 	len = strcspn(entry->left, "pP");
 
 	if (len) {
@@ -3990,6 +4237,32 @@ void __ofono_voicecall_clear_alpha_and_icon_id(struct ofono_voicecall *vc)
 	vc->flags &= ~VOICECALL_FLAG_STK_MODEM_CALLSETUP;
 }
 
+static void audio_connected(struct ofono_modem *modem, void *userdata)
+{
+	struct ofono_voicecall *vc;
+	GSList *l;
+
+	vc = __ofono_atom_find(OFONO_ATOM_TYPE_VOICECALL, modem);
+	if (vc == NULL)
+		return;
+
+	for (l = vc->call_list; l; l = l->next) {
+		struct voicecall *v = l->data;
+
+		if (v->call->status != CALL_STATUS_DISCONNECTED)
+			voicecall_timing_mark(v, TIMING_AUDIO, true);
+	}
+}
+
+/*
+ * SCO links are not tied to a particular modem, the first one after a
+ * call shows up is taken as the audio path of every call still up.
+ */
+void __ofono_voicecall_audio_connected(void)
+{
+	__ofono_modem_foreach(audio_connected, NULL);
+}
+
 static void ssn_mt_forwarded_notify(struct ofono_voicecall *vc,
 					unsigned int id, int code,
 					const struct ofono_phone_number *ph)
@@ -4007,18 +4280,10 @@ static void ssn_mt_forwarded_notify(struct ofono_voicecall *vc,
 static struct voicecall *voicecall_select(struct ofono_voicecall *vc,
 						unsigned int id)
 {
-	if (id != 0) {
-		GSList *l = g_slist_find_custom(vc->call_list,
-						GUINT_TO_POINTER(id),
-						call_compare_by_id);
-
-		if (l == NULL)
-			return NULL;
-
-		return l->data;
-	}
+	if (id != 0)
+		return voicecalls_find(vc, id);
 
-	if (g_slist_length(vc->call_list) == 1)
+	if (vc->num_calls == 1)
 		return vc->call_list->data;
 
 	return NULL;
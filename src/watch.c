@@ -12,6 +12,29 @@
 #include <glib.h>
 #include "ofono.h"
 
+/*
+ * Items are kept in a vector in the order they were added, which is also
+ * the order of their ids, so that an id is found with a binary search.
+ * Removing an item leaves a tombstone in its slot, and the vector is only
+ * compacted when no walk is in progress, so that walks can go on by slot
+ * index whatever their callbacks add or remove.
+ */
+struct watchlist_entry {
+	unsigned int id;
+	struct ofono_watchlist_item *item;	/* NULL once removed */
+};
+
+struct ofono_watchlist {
+	unsigned int next_id;
+	struct watchlist_entry *entries;
+	unsigned int len;		/* Slots in use, tombstones included */
+	unsigned int size;
+	unsigned int count;		/* Items not removed */
+	unsigned int walking;
+	gboolean freed;
+	ofono_destroy_func destroy;
+};
+
 struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
 {
 	struct ofono_watchlist *watchlist;
@@ -22,69 +45,185 @@ struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
 	return watchlist;
 }
 
+static void watchlist_compact(struct ofono_watchlist *watchlist)
+{
+	unsigned int i;
+	unsigned int n = 0;
+
+	if (watchlist->walking || watchlist->count == watchlist->len)
+		return;
+
+	for (i = 0; i < watchlist->len; i++)
+		if (watchlist->entries[i].item)
+			watchlist->entries[n++] = watchlist->entries[i];
+
+	watchlist->len = n;
+}
+
+static int watchlist_find(struct ofono_watchlist *watchlist, unsigned int id)
+{
+	unsigned int lo = 0;
+	unsigned int hi = watchlist->len;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		unsigned int cur = watchlist->entries[mid].id;
+
+		if (cur == id)
+			return watchlist->entries[mid].item ? (int) mid : -1;
+
+		if (cur < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -1;
+}
+
 unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
 					struct ofono_watchlist_item *item)
 {
+	struct watchlist_entry *entry;
+
+	if (watchlist->len == watchlist->size) {
+		watchlist_compact(watchlist);
+
+		if (watchlist->len == watchlist->size) {
+			watchlist->size = watchlist->size ?
+						watchlist->size * 2 : 4;
+			watchlist->entries = g_renew(struct watchlist_entry,
+							watchlist->entries,
+							watchlist->size);
+		}
+	}
+
 	item->id = ++watchlist->next_id;
 
-	watchlist->items = g_slist_prepend(watchlist->items, item);
+	entry = &watchlist->entries[watchlist->len++];
+	entry->id = item->id;
+	entry->item = item;
+	watchlist->count += 1;
 
 	return item->id;
 }
 
+static void watchlist_item_free(struct ofono_watchlist *watchlist,
+				struct ofono_watchlist_item *item)
+{
+	if (item->destroy)
+		item->destroy(item->notify_data);
+
+	if (watchlist->destroy)
+		watchlist->destroy(item);
+}
+
 gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
 					unsigned int id)
 {
 	struct ofono_watchlist_item *item;
-	GSList *p;
-	GSList *c;
+	int i = watchlist_find(watchlist, id);
 
-	p = NULL;
-	c = watchlist->items;
+	if (i < 0)
+		return FALSE;
 
-	while (c) {
-		item = c->data;
+	item = watchlist->entries[i].item;
+	watchlist->entries[i].item = NULL;
+	watchlist->count -= 1;
 
-		if (item->id != id) {
-			p = c;
-			c = c->next;
-			continue;
-		}
+	watchlist_item_free(watchlist, item);
 
-		if (p)
-			p->next = c->next;
-		else
-			watchlist->items = c->next;
+	/* Leave the tombstones until they are half of the vector */
+	if (watchlist->len - watchlist->count > watchlist->count)
+		watchlist_compact(watchlist);
 
-		if (item->destroy)
-			item->destroy(item->notify_data);
+	return TRUE;
+}
 
-		if (watchlist->destroy)
-			watchlist->destroy(item);
-		g_slist_free_1(c);
+void *__ofono_watchlist_find(struct ofono_watchlist *watchlist,
+					unsigned int id)
+{
+	int i = watchlist_find(watchlist, id);
 
-		return TRUE;
-	}
+	if (i < 0)
+		return NULL;
+
+	return watchlist->entries[i].item;
+}
 
-	return FALSE;
+unsigned int __ofono_watchlist_count(struct ofono_watchlist *watchlist)
+{
+	return watchlist->count;
+}
+
+static void watchlist_release(struct ofono_watchlist *watchlist)
+{
+	g_free(watchlist->entries);
+	g_free(watchlist);
 }
 
 void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
 {
-	struct ofono_watchlist_item *item;
-	GSList *l;
+	unsigned int i;
 
-	for (l = watchlist->items; l; l = l->next) {
-		item = l->data;
+	for (i = watchlist->len; i > 0; i--) {
+		struct ofono_watchlist_item *item =
+					watchlist->entries[i - 1].item;
 
-		if (item->destroy)
-			item->destroy(item->notify_data);
+		if (item == NULL)
+			continue;
 
-		if (watchlist->destroy)
-			watchlist->destroy(item);
+		watchlist->entries[i - 1].item = NULL;
+		watchlist_item_free(watchlist, item);
 	}
 
-	g_slist_free(watchlist->items);
-	watchlist->items = NULL;
-	g_free(watchlist);
+	watchlist->count = 0;
+
+	/* Freed from a callback, the walk in progress releases it */
+	if (watchlist->walking) {
+		watchlist->freed = TRUE;
+		return;
+	}
+
+	watchlist_release(watchlist);
+}
+
+void __ofono_watchlist_iter_init(struct ofono_watchlist_iter *iter,
+					struct ofono_watchlist *watchlist)
+{
+	iter->watchlist = watchlist;
+
+	if (watchlist == NULL)
+		return;
+
+	iter->pos = watchlist->len;
+	watchlist->walking += 1;
+}
+
+void *__ofono_watchlist_iter_next(struct ofono_watchlist_iter *iter)
+{
+	struct ofono_watchlist *watchlist = iter->watchlist;
+
+	if (watchlist == NULL)
+		return NULL;
+
+	while (iter->pos > 0) {
+		struct ofono_watchlist_item *item =
+				watchlist->entries[--iter->pos].item;
+
+		if (item)
+			return item;
+	}
+
+	iter->watchlist = NULL;
+
+	if (--watchlist->walking)
+		return NULL;
+
+	if (watchlist->freed)
+		watchlist_release(watchlist);
+	else if (watchlist->len - watchlist->count > watchlist->count)
+		watchlist_compact(watchlist);
+
+	return NULL;
 }
@@ -0,0 +1,137 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gatchat.h>
+
+#include "unit/bench.h"
+#include "unit/at-replay.h"
+
+static gchar *option_channel = NULL;
+static gchar *option_syntax = NULL;
+static gint option_rounds = 1;
+
+static void print_result(const char *name, guint count, guint lines,
+				double cpu, gpointer user_data)
+{
+	/* Prefixes only ever seen in command responses */
+	if (count == 0)
+		return;
+
+	printf("%-24s %10u %10u %12.1f %10.2f\n", name, count, lines,
+		cpu * 1e6, count ? cpu * 1e6 / count : 0.0);
+}
+
+static GOptionEntry options[] = {
+	{ "channel", 'c', 0, G_OPTION_ARG_STRING, &option_channel,
+				"Only replay the given channel", "PREFIX:" },
+	{ "syntax", 's', 0, G_OPTION_ARG_STRING, &option_syntax,
+				"Syntax to use, gsmv1 or permissive", "NAME" },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &option_rounds,
+				"Replay the transcript this many times", "N" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	struct at_replay *replay;
+	struct at_replay_stats stats;
+	struct at_replay_stats total;
+	unsigned long allocs;
+	gint i;
+
+	context = g_option_context_new("TRANSCRIPT");
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+		} else
+			g_printerr("An unknown error occurred\n");
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (argc != 2) {
+		g_printerr("No transcript specified\n");
+		return EXIT_FAILURE;
+	}
+
+	replay = at_replay_new();
+
+	if (at_replay_load(replay, argv[1], option_channel) == 0) {
+		g_printerr("No AT records found in %s\n", argv[1]);
+		at_replay_free(replay);
+		return EXIT_FAILURE;
+	}
+
+	memset(&total, 0, sizeof(total));
+	allocs = bench_alloc_count();
+
+	for (i = 0; i < option_rounds; i++) {
+		GAtSyntax *syntax;
+		gboolean ok;
+
+		if (g_strcmp0(option_syntax, "gsmv1") == 0)
+			syntax = g_at_syntax_new_gsmv1();
+		else
+			syntax = g_at_syntax_new_gsm_permissive();
+
+		ok = at_replay_run(replay, syntax, &stats);
+		g_at_syntax_unref(syntax);
+
+		if (!ok) {
+			g_printerr("Replay stalled after %u commands\n",
+					stats.commands);
+			at_replay_free(replay);
+			return EXIT_FAILURE;
+		}
+
+		total.commands += stats.commands;
+		total.incomplete += stats.incomplete;
+		total.notifications += stats.notifications;
+		total.lines += stats.lines;
+		total.bytes += stats.bytes;
+		total.elapsed += stats.elapsed;
+		total.cpu += stats.cpu;
+	}
+
+	allocs = bench_alloc_count() - allocs;
+
+	printf("%-24s %10s %10s %12s %10s\n", "Result", "Count", "Lines",
+		"CPU (us)", "us/each");
+	at_replay_foreach_result(replay, print_result, NULL);
+
+	printf("\n%u commands (%u incomplete), %u notifications\n",
+		total.commands, total.incomplete, total.notifications);
+	printf("%u lines, %zu bytes in %.3fs, %.3fs CPU\n",
+		total.lines, total.bytes, total.elapsed, total.cpu);
+	printf("%.0f lines/s, %.1f MB/s\n",
+		total.elapsed > 0 ? total.lines / total.elapsed : 0.0,
+		total.elapsed > 0 ? total.bytes / total.elapsed / 1e6 : 0.0);
+
+	if (bench_alloc_counted())
+		printf("%lu allocations, %.1f per line\n", allocs,
+			total.lines ? (double) allocs / total.lines : 0.0);
+
+	at_replay_free(replay);
+	g_free(option_channel);
+	g_free(option_syntax);
+
+	return EXIT_SUCCESS;
+}
@@ -12,6 +12,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <errno.h>
 
@@ -23,7 +25,362 @@
 
 #include "provisiondb.h"
 
+#define BATCH_SIZE 256
+#define BENCH_USEC (1 * L_USEC_PER_SEC)
+#define FIELD_SEPARATORS " \t,"
+
 static const char *option_file;
+static const char *option_batch;
+static bool option_bench;
+
+struct batch {
+	struct provision_db_query queries[BATCH_SIZE];
+	char *lines[BATCH_SIZE];
+	unsigned int linenos[BATCH_SIZE];
+	size_t len;
+};
+
+static struct provision_db *open_db(void)
+{
+	struct provision_db *pdb;
+
+	if (option_file)
+		pdb = provision_db_new(option_file);
+	else
+		pdb = provision_db_new_default();
+
+	if (!pdb)
+		fprintf(stderr, "Database opening failed\n");
+
+	return pdb;
+}
+
+static char *next_field(char **pos)
+{
+	char *start = *pos + strspn(*pos, FIELD_SEPARATORS);
+	char *end = start + strcspn(start, FIELD_SEPARATORS);
+
+	if (start == end)
+		return NULL;
+
+	*pos = *end ? end + 1 : end;
+	*end = '\0';
+
+	return start;
+}
+
+/*
+ * Parses "<mcc> <mnc> [spn]" in place, fields are separated by blanks or
+ * commas and the SPN is the rest of the line.  Returns -ENODATA for empty
+ * and comment lines.
+ */
+static int parse_query(char *line, struct provision_db_query *query)
+{
+	char *pos = line;
+	char *spn;
+	size_t len;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	pos += strspn(pos, FIELD_SEPARATORS);
+
+	if (*pos == '\0' || *pos == '#')
+		return -ENODATA;
+
+	query->mcc = next_field(&pos);
+	query->mnc = next_field(&pos);
+	query->result = NULL;
+	query->error = 0;
+
+	if (!query->mnc)
+		return -EINVAL;
+
+	spn = pos + strspn(pos, FIELD_SEPARATORS);
+	len = strlen(spn);
+
+	while (len && strchr(FIELD_SEPARATORS, spn[len - 1]))
+		spn[--len] = '\0';
+
+	query->spn = len ? spn : NULL;
+
+	return 0;
+}
+
+/* Reads the next query, the line is returned so the caller can free it */
+static char *read_query(FILE *fp, unsigned int *lineno,
+				struct provision_db_query *query, int *err)
+{
+	char *line = NULL;
+	size_t size = 0;
+
+	while (getline(&line, &size, fp) >= 0) {
+		*lineno += 1;
+		*err = parse_query(line, query);
+
+		if (*err != -ENODATA)
+			return line;
+	}
+
+	free(line);
+	return NULL;
+}
+
+static void print_json_string(const char *str)
+{
+	if (!str) {
+		fputs("null", stdout);
+		return;
+	}
+
+	putchar('"');
+
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+
+	putchar('"');
+}
+
+static void print_json_field(const char *name, const char *value)
+{
+	printf(",\"%s\":", name);
+	print_json_string(value);
+}
+
+static void print_json_result(unsigned int lineno,
+				const struct provision_db_query *query)
+{
+	size_t i;
+
+	printf("{\"line\":%u", lineno);
+	print_json_field("mcc", query->mcc);
+	print_json_field("mnc", query->mnc);
+	print_json_field("spn", query->spn);
+
+	if (query->error < 0) {
+		print_json_field("error", strerror(-query->error));
+		printf("}\n");
+		return;
+	}
+
+	printf(",\"contexts\":[");
+
+	for (i = 0; i < query->result->n_items; i++) {
+		const struct provision_db_entry *ap = query->result->items + i;
+
+		printf("%s{\"type\":%u,\"proto\":%u", i ? "," : "",
+						ap->type, ap->proto);
+		print_json_field("name", ap->name);
+		print_json_field("apn", ap->apn);
+		print_json_field("username", ap->username);
+		print_json_field("password", ap->password);
+		print_json_field("message_proxy", ap->message_proxy);
+		print_json_field("message_center", ap->message_center);
+		print_json_field("tags", ap->tags);
+		putchar('}');
+	}
+
+	printf("]}\n");
+}
+
+static void batch_flush(struct provision_db *pdb, char **tags_filter,
+				struct batch *batch)
+{
+	size_t i;
+
+	provision_db_lookup_batch(pdb, tags_filter, batch->queries,
+					batch->len);
+
+	for (i = 0; i < batch->len; i++) {
+		print_json_result(batch->linenos[i], batch->queries + i);
+		provision_db_result_unref(batch->queries[i].result);
+		free(batch->lines[i]);
+	}
+
+	batch->len = 0;
+}
+
+static FILE *open_batch_input(void)
+{
+	FILE *fp;
+
+	if (!strcmp(option_batch, "-"))
+		return stdin;
+
+	fp = fopen(option_batch, "r");
+	if (!fp)
+		fprintf(stderr, "Unable to open %s: %s\n", option_batch,
+							strerror(errno));
+
+	return fp;
+}
+
+/* One JSON object per input line, in input order */
+static int lookup_apn_batch(char **tags_filter)
+{
+	struct provision_db *pdb;
+	struct batch *batch;
+	struct provision_db_query query;
+	unsigned int lineno = 0;
+	char *line;
+	int err;
+	FILE *fp;
+
+	fp = open_batch_input();
+	if (!fp)
+		return -EIO;
+
+	pdb = open_db();
+	if (!pdb) {
+		if (fp != stdin)
+			fclose(fp);
+
+		return -EIO;
+	}
+
+	batch = l_new(struct batch, 1);
+
+	while ((line = read_query(fp, &lineno, &query, &err))) {
+		if (err < 0) {
+			/* Keep the output in input order */
+			batch_flush(pdb, tags_filter, batch);
+
+			query.error = err;
+			print_json_result(lineno, &query);
+			free(line);
+			continue;
+		}
+
+		batch->queries[batch->len] = query;
+		batch->lines[batch->len] = line;
+		batch->linenos[batch->len] = lineno;
+
+		if (++batch->len == BATCH_SIZE)
+			batch_flush(pdb, tags_filter, batch);
+	}
+
+	batch_flush(pdb, tags_filter, batch);
+	l_free(batch);
+
+	provision_db_free(pdb);
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return 0;
+}
+
+/*
+ * Repeats the uncached lookups over all the queries until BENCH_USEC
+ * have passed, the lookup result cache would only measure itself.
+ */
+static int lookup_apn_bench(const char *mcc, const char *mnc,
+				const char *spn, char **tags_filter)
+{
+	struct provision_db *pdb;
+	struct provision_db_query *queries = NULL;
+	char **lines = NULL;
+	size_t n_queries = 0;
+	struct provision_db_query query;
+	unsigned int lineno = 0;
+	unsigned int lookups = 0;
+	unsigned int found = 0;
+	uint64_t start;
+	uint64_t elapsed;
+	char *line;
+	size_t i;
+	int err;
+	FILE *fp = NULL;
+
+	if (option_batch) {
+		fp = open_batch_input();
+		if (!fp)
+			return -EIO;
+
+		while ((line = read_query(fp, &lineno, &query, &err))) {
+			if (err < 0) {
+				free(line);
+				continue;
+			}
+
+			queries = l_realloc(queries,
+					(n_queries + 1) * sizeof(*queries));
+			lines = l_realloc(lines,
+					(n_queries + 1) * sizeof(*lines));
+			queries[n_queries] = query;
+			lines[n_queries++] = line;
+		}
+
+		if (fp != stdin)
+			fclose(fp);
+	} else {
+		queries = l_new(struct provision_db_query, 1);
+		queries[0].mcc = mcc;
+		queries[0].mnc = mnc;
+		queries[0].spn = spn;
+		n_queries = 1;
+	}
+
+	err = -EINVAL;
+
+	if (!n_queries) {
+		fprintf(stderr, "No queries to run\n");
+		goto done;
+	}
+
+	err = -EIO;
+
+	pdb = open_db();
+	if (!pdb)
+		goto done;
+
+	start = l_time_now();
+
+	do {
+		for (i = 0; i < n_queries; i++) {
+			struct provision_db_entry *contexts;
+			size_t n_contexts;
+
+			if (provision_db_lookup(pdb, queries[i].mcc,
+						queries[i].mnc, queries[i].spn,
+						tags_filter, &contexts,
+						&n_contexts) == 0) {
+				l_free(contexts);
+				found += 1;
+			}
+		}
+
+		lookups += n_queries;
+		elapsed = l_time_diff(start, l_time_now());
+	} while (elapsed < BENCH_USEC);
+
+	provision_db_free(pdb);
+
+	fprintf(stdout, "%u queries, %u lookups in %" PRIu64 " ms: "
+			"%.0f lookups/sec, %.2f us/lookup, %u found\n",
+			(unsigned int) n_queries, lookups, elapsed / 1000,
+			lookups * 1e6 / elapsed, (double) elapsed / lookups,
+			found);
+	err = 0;
+
+done:
+	if (lines) {
+		for (i = 0; i < n_queries; i++)
+			free(lines[i]);
+
+		l_free(lines);
+	}
+
+	l_free(queries);
+
+	return err;
+}
 
 static int lookup_apn(const char *match_mcc, const char *match_mnc,
 			const char *match_spn, char **tags_filter)
@@ -94,10 +451,15 @@ static void usage(void)
 {
 	printf("lookup-apn\nUsage:\n");
 	printf("lookup-apn [options] <mcc> <mnc> [spn]\n");
+	printf("lookup-apn [options] --batch <file>\n");
 	printf("Options:\n"
 		"\t-v, --version	Show version\n"
 		"\t-f, --file		Provision DB file to use\n"
 		"\t-t, --tags		Comma separated tag filter\n"
+		"\t-b, --batch		Look up '<mcc> <mnc> [spn]' lines\n"
+		"\t			from a file or - for stdin,\n"
+		"\t			printing JSON lines\n"
+		"\t-B, --bench		Report lookups per second\n"
 		"\t-h, --help		Show help options\n");
 }
 
@@ -106,15 +468,20 @@ static const struct option options[] = {
 	{ "help",	no_argument,		NULL, 'h' },
 	{ "file",	required_argument,	NULL, 'f' },
 	{ "tags",	required_argument,	NULL, 't' },
+	{ "batch",	required_argument,	NULL, 'b' },
+	{ "bench",	no_argument,		NULL, 'B' },
 	{ },
 };
 
 int main(int argc, char **argv)
 {
 	_auto_(l_strv_free) char **tags_filter = NULL;
+	const char *mcc = NULL;
+	const char *mnc = NULL;
+	const char *spn = NULL;
 
 	for (;;) {
-		int opt = getopt_long(argc, argv, "f:t:vh", options, NULL);
+		int opt = getopt_long(argc, argv, "f:t:b:Bvh", options, NULL);
 
 		if (opt < 0)
 			break;
@@ -126,6 +493,12 @@ int main(int argc, char **argv)
 		case 't':
 			tags_filter = l_strsplit(optarg, ',');
 			break;
+		case 'b':
+			option_batch = optarg;
+			break;
+		case 'B':
+			option_bench = true;
+			break;
 		case 'v':
 			printf("%s\n", VERSION);
 			return EXIT_SUCCESS;
@@ -142,12 +515,29 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	if (argc - optind < 2) {
+	if (option_batch && argc - optind > 0) {
+		fprintf(stderr, "Batch mode takes no MCC MNC parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!option_batch && argc - optind < 2) {
 		fprintf(stderr, "Missing MCC MNC parameters\n");
 		return EXIT_FAILURE;
 	}
 
-	return lookup_apn(argv[optind], argv[optind + 1],
-				argc - optind == 3 ? argv[optind + 2] : NULL,
-				tags_filter);
+	if (!option_batch) {
+		mcc = argv[optind];
+		mnc = argv[optind + 1];
+		spn = argc - optind == 3 ? argv[optind + 2] : NULL;
+	}
+
+	if (option_bench)
+		return lookup_apn_bench(mcc, mnc, spn, tags_filter) < 0 ?
+						EXIT_FAILURE : EXIT_SUCCESS;
+
+	if (option_batch)
+		return lookup_apn_batch(tags_filter) < 0 ?
+						EXIT_FAILURE : EXIT_SUCCESS;
+
+	return lookup_apn(mcc, mnc, spn, tags_filter);
 }
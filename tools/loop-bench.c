@@ -0,0 +1,346 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "eventloop.h"
+
+/*
+ * Measures the time from a timestamp being written into a pipe by another
+ * process until the read callback runs, for a GIOChannel watch as used by
+ * gatchat, gril and gisi, and for an l_io as used by qmimodem and
+ * mbimmodem.  Both are run with ell nested in GLib, as ofonod does by
+ * default, and with GLib driven from ell, as with --ell-loop.
+ */
+
+static unsigned int option_samples = 2000;
+static unsigned int option_interval = 500;
+
+enum loop_mode {
+	LOOP_NESTED,
+	LOOP_ELL,
+};
+
+enum transport {
+	TRANSPORT_GIO,
+	TRANSPORT_L_IO,
+};
+
+struct bench {
+	enum loop_mode mode;
+	int fd;
+	guint watch;
+	uint64_t *latency;
+	unsigned int count;
+};
+
+static GMainLoop *main_loop;
+
+struct ell_event_source {
+	GSource source;
+	GPollFD pollfd;
+};
+
+static gboolean event_prepare(GSource *source, gint *timeout)
+{
+	*timeout = l_main_prepare();
+
+	return FALSE;
+}
+
+static gboolean event_check(GSource *source)
+{
+	l_main_iterate(0);
+	return FALSE;
+}
+
+static GSourceFuncs event_funcs = {
+	.prepare = event_prepare,
+	.check = event_check,
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void writer(int fd)
+{
+	struct timespec interval = {
+		.tv_sec = option_interval / 1000000,
+		.tv_nsec = option_interval % 1000000 * 1000,
+	};
+	unsigned int i;
+
+	for (i = 0; i < option_samples; i++) {
+		uint64_t ts = now_ns();
+
+		if (write(fd, &ts, sizeof(ts)) != sizeof(ts))
+			break;
+
+		nanosleep(&interval, NULL);
+	}
+}
+
+static void bench_quit(struct bench *bench)
+{
+	if (bench->mode == LOOP_ELL)
+		eventloop_quit();
+	else
+		g_main_loop_quit(main_loop);
+}
+
+static bool bench_read(struct bench *bench)
+{
+	uint64_t ts[64];
+	ssize_t len;
+	uint64_t now;
+	unsigned int i;
+
+	len = read(bench->fd, ts, sizeof(ts));
+	now = now_ns();
+
+	if (len <= 0) {
+		bench_quit(bench);
+		return false;
+	}
+
+	for (i = 0; i < len / sizeof(uint64_t); i++)
+		if (bench->count < option_samples)
+			bench->latency[bench->count++] = now - ts[i];
+
+	if (bench->count < option_samples)
+		return true;
+
+	bench_quit(bench);
+	return false;
+}
+
+static gboolean gio_ready(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct bench *bench = user_data;
+
+	if ((cond & G_IO_IN) && bench_read(bench))
+		return TRUE;
+
+	bench_quit(bench);
+	bench->watch = 0;
+
+	return FALSE;
+}
+
+static bool l_io_ready(struct l_io *io, void *user_data)
+{
+	return bench_read(user_data);
+}
+
+static int latency_compare(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *) a;
+	uint64_t lb = *(const uint64_t *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static void report(const struct bench *bench, enum transport transport)
+{
+	uint64_t *l = bench->latency;
+	unsigned int n = bench->count;
+
+	if (!n)
+		return;
+
+	qsort(l, n, sizeof(uint64_t), latency_compare);
+
+	printf("%-8s %-10s %8u %10.1f %10.1f %10.1f %10.1f\n",
+		bench->mode == LOOP_ELL ? "ell" : "nested",
+		transport == TRANSPORT_L_IO ? "l_io" : "GIOChannel", n,
+		l[0] / 1000.0, l[n / 2] / 1000.0,
+		l[(uint64_t) n * 99 / 100] / 1000.0, l[n - 1] / 1000.0);
+}
+
+static bool run(enum loop_mode mode, enum transport transport)
+{
+	struct bench bench = { .mode = mode };
+	GIOChannel *channel = NULL;
+	struct l_io *io = NULL;
+	int fds[2];
+	pid_t pid;
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		perror("pipe2");
+		return false;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1]);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+
+	bench.fd = fds[0];
+	bench.latency = l_new(uint64_t, option_samples);
+
+	if (transport == TRANSPORT_GIO) {
+		channel = g_io_channel_unix_new(fds[0]);
+		bench.watch = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				gio_ready, &bench);
+	} else {
+		io = l_io_new(fds[0]);
+		l_io_set_read_handler(io, l_io_ready, &bench, NULL);
+	}
+
+	if (mode == LOOP_ELL)
+		eventloop_run();
+	else
+		g_main_loop_run(main_loop);
+
+	if (bench.watch)
+		g_source_remove(bench.watch);
+
+	if (channel)
+		g_io_channel_unref(channel);
+
+	l_io_destroy(io);
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+
+	report(&bench, transport);
+	l_free(bench.latency);
+
+	return true;
+}
+
+static bool run_mode(enum loop_mode mode)
+{
+	struct ell_event_source *source = NULL;
+	bool ok;
+
+	if (mode == LOOP_ELL) {
+		if (eventloop_init() < 0) {
+			fprintf(stderr, "Unable to drive GLib from ell\n");
+			return false;
+		}
+	} else {
+		source = (struct ell_event_source *) g_source_new(&event_funcs,
+					sizeof(struct ell_event_source));
+
+		source->pollfd.fd = l_main_get_epoll_fd();
+		source->pollfd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+
+		g_source_add_poll((GSource *) source, &source->pollfd);
+		g_source_attach((GSource *) source, NULL);
+	}
+
+	ok = run(mode, TRANSPORT_GIO) && run(mode, TRANSPORT_L_IO);
+
+	if (mode == LOOP_ELL)
+		eventloop_exit();
+	else {
+		g_source_destroy((GSource *) source);
+		g_source_unref((GSource *) source);
+	}
+
+	return ok;
+}
+
+static void usage(void)
+{
+	printf("loop-bench\nUsage:\n");
+	printf("loop-bench [options]\n");
+	printf("Options:\n"
+		"\t-s, --samples		Number of wakeups per run\n"
+		"\t-i, --interval		Microseconds between wakeups\n"
+		"\t-h, --help		Show help options\n");
+}
+
+static const struct option options[] = {
+	{ "samples",	required_argument,	NULL, 's' },
+	{ "interval",	required_argument,	NULL, 'i' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ },
+};
+
+int main(int argc, char **argv)
+{
+	bool ok;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "s:i:h", options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 's':
+			if (l_safe_atou32(optarg, &option_samples) < 0 ||
+					!option_samples) {
+				fprintf(stderr, "Invalid samples\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'i':
+			if (l_safe_atou32(optarg, &option_interval) < 0) {
+				fprintf(stderr, "Invalid interval\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	printf("Wakeup to dispatch latency, %u samples %u us apart\n\n",
+		option_samples, option_interval);
+	printf("%-8s %-10s %8s %10s %10s %10s %10s\n", "Loop", "Transport",
+		"Samples", "min us", "median us", "p99 us", "max us");
+
+	ok = run_mode(LOOP_NESTED) && run_mode(LOOP_ELL);
+
+	g_main_loop_unref(main_loop);
+	l_main_exit();
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
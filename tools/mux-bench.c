@@ -0,0 +1,690 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "gatmux.h"
+#include "gsm0710.h"
+
+/*
+ * Runs a GSM 07.10 multiplexer over a socketpair against a modem side in
+ * a child process, so that the CPU time measured is the multiplexer's
+ * alone.  DLC 1 carries bulk data both ways, as a PPP session would, and
+ * every other DLC runs AT commands through GAtChat back to back.  Reports
+ * the throughput of DLC 1, the command round trip on each AT channel and
+ * the CPU time spent per MiB moved.
+ */
+
+#define MAX_AT_CHANNELS 60
+#define MAX_FRAME_SIZE 1024
+#define BULK_CHUNK 4096
+
+/* Bulk data the modem keeps queued ahead of its socket */
+#define MODEM_BULK_QUEUE 4096
+
+enum mux_mode {
+	MUX_BASIC,
+	MUX_ADVANCED,
+};
+
+static const char *mode_name[] = { "basic", "advanced" };
+
+static int option_mode = -1;
+static unsigned int option_frame_size;
+static unsigned int option_channels = 3;
+static unsigned int option_duration = 5;
+static unsigned int option_priority;
+static unsigned int option_quantum;
+static unsigned int option_buffer = 16384;
+static bool option_json;
+
+struct modem {
+	int fd;
+	enum mux_mode mode;
+	unsigned int frame_size;
+	guint8 in[8192];
+	int in_len;
+	guint8 out[16384];
+	int out_len;
+	unsigned int pending[64];
+};
+
+struct at_channel {
+	struct run *run;
+	GIOChannel *io;
+	GAtChat *chat;
+	guint8 dlc;
+	uint64_t sent;
+	GArray *latency;
+	unsigned int failed;
+};
+
+struct run {
+	enum mux_mode mode;
+	unsigned int frame_size;
+	GMainLoop *main_loop;
+	GAtMux *mux;
+	GIOChannel *bulk;
+	guint bulk_in_watch;
+	guint bulk_out_watch;
+	uint64_t down_bytes;
+	struct at_channel at[MAX_AT_CHANNELS];
+	bool running;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static bool modem_append(struct modem *m, guint8 dlc, const guint8 *data,
+								int len)
+{
+	/* Advanced mode may quote every octet */
+	if (m->out_len + 2 * len + 8 > (int) sizeof(m->out))
+		return false;
+
+	if (m->mode == MUX_ADVANCED)
+		m->out_len += gsm0710_advanced_fill_frame(m->out + m->out_len,
+						dlc, GSM0710_DATA, data, len);
+	else
+		m->out_len += gsm0710_basic_fill_frame(m->out + m->out_len,
+						dlc, GSM0710_DATA, data, len);
+
+	return true;
+}
+
+/* Responses go out ahead of any bulk data not yet queued */
+static void modem_queue(struct modem *m)
+{
+	static const guint8 ok[] = "\r\nOK\r\n";
+	static guint8 bulk[MAX_FRAME_SIZE];
+	unsigned int dlc;
+
+	for (dlc = 2; dlc < L_ARRAY_SIZE(m->pending); dlc++) {
+		while (m->pending[dlc]) {
+			if (!modem_append(m, dlc, ok, sizeof(ok) - 1))
+				return;
+
+			m->pending[dlc] -= 1;
+		}
+	}
+
+	while (m->out_len < MODEM_BULK_QUEUE)
+		if (!modem_append(m, 1, bulk, m->frame_size))
+			return;
+}
+
+static void modem_parse(struct modem *m)
+{
+	guint8 *frame;
+	guint8 dlc;
+	guint8 ctrl;
+	int frame_len;
+	int nread;
+	int off = 0;
+	int i;
+
+	for (;;) {
+		if (m->mode == MUX_ADVANCED)
+			nread = gsm0710_advanced_extract_frame(m->in + off,
+						m->in_len - off, &dlc, &ctrl,
+						&frame, &frame_len);
+		else
+			nread = gsm0710_basic_extract_frame(m->in + off,
+						m->in_len - off, &dlc, &ctrl,
+						&frame, &frame_len);
+
+		if (nread <= 0)
+			break;
+
+		off += nread;
+
+		if (frame == NULL || dlc < 2 || dlc >= 64)
+			continue;
+
+		if (ctrl != GSM0710_DATA && ctrl != GSM0710_DATA_ALT)
+			continue;
+
+		for (i = 0; i < frame_len; i++)
+			if (frame[i] == '\r')
+				m->pending[dlc] += 1;
+	}
+
+	m->in_len -= off;
+	memmove(m->in, m->in + off, m->in_len);
+
+	/* Nothing in a full buffer is a frame, start over */
+	if (m->in_len == (int) sizeof(m->in))
+		m->in_len = 0;
+}
+
+static void modem_run(int fd, enum mux_mode mode, unsigned int frame_size)
+{
+	struct modem m = {
+		.fd = fd,
+		.mode = mode,
+		.frame_size = frame_size,
+	};
+	struct pollfd pfd = { .fd = fd };
+	ssize_t len;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	for (;;) {
+		modem_queue(&m);
+
+		pfd.events = POLLIN;
+		if (m.out_len > 0)
+			pfd.events |= POLLOUT;
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		if (pfd.revents & POLLIN) {
+			len = read(fd, m.in + m.in_len,
+					sizeof(m.in) - m.in_len);
+			if (len <= 0)
+				break;
+
+			m.in_len += len;
+			modem_parse(&m);
+		} else if (pfd.revents & (POLLHUP | POLLERR))
+			break;
+
+		if (!(pfd.revents & POLLOUT))
+			continue;
+
+		len = send(fd, m.out, m.out_len, MSG_NOSIGNAL);
+		if (len < 0 && errno != EAGAIN)
+			break;
+
+		if (len > 0) {
+			m.out_len -= len;
+			memmove(m.out, m.out + len, m.out_len);
+		}
+	}
+}
+
+static void at_send(struct at_channel *at);
+
+static void at_callback(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct at_channel *at = user_data;
+	uint64_t latency = now_ns() - at->sent;
+
+	if (ok)
+		g_array_append_val(at->latency, latency);
+	else
+		at->failed += 1;
+
+	if (at->run->running)
+		at_send(at);
+}
+
+static void at_send(struct at_channel *at)
+{
+	at->sent = now_ns();
+
+	if (g_at_chat_send(at->chat, "AT", NULL, at_callback, at, NULL) == 0)
+		at->failed += 1;
+}
+
+static gboolean bulk_write(GIOChannel *channel, GIOCondition cond,
+				gpointer user_data)
+{
+	static const gchar bulk[BULK_CHUNK];
+	gsize written;
+
+	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL))
+		return FALSE;
+
+	g_io_channel_write_chars(channel, bulk, sizeof(bulk), &written, NULL);
+
+	return TRUE;
+}
+
+static gboolean bulk_read(GIOChannel *channel, GIOCondition cond,
+				gpointer user_data)
+{
+	struct run *run = user_data;
+	gchar buf[BULK_CHUNK];
+	gsize len;
+
+	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL))
+		return FALSE;
+
+	if (g_io_channel_read_chars(channel, buf, sizeof(buf), &len,
+					NULL) != G_IO_STATUS_NORMAL)
+		return TRUE;
+
+	run->down_bytes += len;
+
+	return TRUE;
+}
+
+static gboolean run_stop(gpointer user_data)
+{
+	struct run *run = user_data;
+
+	run->running = false;
+	g_main_loop_quit(run->main_loop);
+
+	return FALSE;
+}
+
+static GIOChannel *run_channel(struct run *run)
+{
+	GIOChannel *io = g_at_mux_create_channel(run->mux);
+
+	if (io == NULL)
+		return NULL;
+
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+
+	return io;
+}
+
+static int latency_compare(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *) a;
+	uint64_t lb = *(const uint64_t *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static void report(struct run *run, uint64_t elapsed, uint64_t cpu)
+{
+	GAtMuxChannelStats stats;
+	double seconds = elapsed / 1e9;
+	double up;
+	double down;
+	unsigned int i;
+
+	g_at_mux_get_channel_stats(run->mux, run->bulk, &stats);
+	up = stats.tx_bytes / 1048576.0;
+	down = run->down_bytes / 1048576.0;
+
+	if (option_json)
+		printf("{\"mode\":\"%s\",\"frame_size\":%u,\"seconds\":%.3f,"
+			"\"up_mib_s\":%.3f,\"down_mib_s\":%.3f,"
+			"\"cpu_ms_per_mib\":%.3f,\"dlcs\":[",
+			mode_name[run->mode], run->frame_size, seconds,
+			up / seconds, down / seconds,
+			up + down > 0 ? cpu / 1e6 / (up + down) : 0);
+	else
+		printf("%-8s %6u %12.2f %12.2f %12.2f\n",
+			mode_name[run->mode], run->frame_size, up / seconds,
+			down / seconds,
+			up + down > 0 ? cpu / 1e6 / (up + down) : 0);
+
+	for (i = 0; i < option_channels; i++) {
+		struct at_channel *at = &run->at[i];
+		uint64_t *l = (uint64_t *) at->latency->data;
+		unsigned int n = at->latency->len;
+		uint64_t total = 0;
+		unsigned int j;
+
+		g_at_mux_get_channel_stats(run->mux, at->io, &stats);
+
+		if (n)
+			qsort(l, n, sizeof(uint64_t), latency_compare);
+
+		for (j = 0; j < n; j++)
+			total += l[j];
+
+		if (option_json) {
+			printf("%s{\"dlc\":%u,\"commands\":%u,\"failed\":%u,"
+				"\"mean_us\":%.1f,\"p50_us\":%.1f,"
+				"\"p99_us\":%.1f,\"max_us\":%.1f,"
+				"\"deferred\":%lu}", i ? "," : "",
+				at->dlc, n, at->failed,
+				n ? total / 1000.0 / n : 0,
+				n ? l[n / 2] / 1000.0 : 0,
+				n ? l[(uint64_t) n * 99 / 100] / 1000.0 : 0,
+				n ? l[n - 1] / 1000.0 : 0,
+				stats.tx_deferred);
+			continue;
+		}
+
+		printf("  DLC %-2u %8u commands, mean %.1f us, p50 %.1f us, "
+			"p99 %.1f us, max %.1f us, %lu deferred\n",
+			at->dlc, n, n ? total / 1000.0 / n : 0,
+			n ? l[n / 2] / 1000.0 : 0,
+			n ? l[(uint64_t) n * 99 / 100] / 1000.0 : 0,
+			n ? l[n - 1] / 1000.0 : 0, stats.tx_deferred);
+	}
+
+	if (option_json)
+		printf("]}\n");
+}
+
+static bool run_setup(struct run *run, int fd)
+{
+	GAtSyntax *syntax;
+	GIOChannel *io;
+	unsigned int i;
+
+	io = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+
+	if (run->mode == MUX_ADVANCED)
+		run->mux = g_at_mux_new_gsm0710_advanced(io, run->frame_size);
+	else
+		run->mux = g_at_mux_new_gsm0710_basic(io, run->frame_size);
+
+	g_io_channel_unref(io);
+
+	if (run->mux == NULL || !g_at_mux_start(run->mux))
+		return false;
+
+	if (option_quantum && !g_at_mux_set_write_quantum(run->mux,
+							option_quantum))
+		return false;
+
+	run->bulk = run_channel(run);
+	if (run->bulk == NULL)
+		return false;
+
+	syntax = g_at_syntax_new_gsm_permissive();
+
+	for (i = 0; i < option_channels; i++) {
+		struct at_channel *at = &run->at[i];
+
+		at->run = run;
+		at->dlc = i + 2;
+		at->latency = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		at->io = run_channel(run);
+		if (at->io == NULL)
+			break;
+
+		if (option_priority && !g_at_mux_set_channel_priority(
+					run->mux, at->io, option_priority))
+			break;
+
+		at->chat = g_at_chat_new(at->io, syntax);
+		if (at->chat == NULL)
+			break;
+	}
+
+	g_at_syntax_unref(syntax);
+
+	return i == option_channels;
+}
+
+static void run_free(struct run *run)
+{
+	unsigned int i;
+
+	if (run->bulk_in_watch)
+		g_source_remove(run->bulk_in_watch);
+
+	if (run->bulk_out_watch)
+		g_source_remove(run->bulk_out_watch);
+
+	for (i = 0; i < option_channels; i++) {
+		struct at_channel *at = &run->at[i];
+
+		if (at->chat)
+			g_at_chat_unref(at->chat);
+
+		if (at->io)
+			g_io_channel_unref(at->io);
+
+		if (at->latency)
+			g_array_free(at->latency, TRUE);
+	}
+
+	if (run->bulk)
+		g_io_channel_unref(run->bulk);
+
+	if (run->mux)
+		g_at_mux_unref(run->mux);
+
+	g_main_loop_unref(run->main_loop);
+}
+
+static bool run_bench(enum mux_mode mode)
+{
+	struct run run = {
+		.mode = mode,
+		.frame_size = option_frame_size,
+		.running = true,
+	};
+	uint64_t start;
+	uint64_t cpu;
+	unsigned int i;
+	bool ok = false;
+	int sv[2];
+	pid_t pid;
+
+	if (!run.frame_size)
+		run.frame_size = mode == MUX_ADVANCED ? 64 : 31;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+		perror("socketpair");
+		return false;
+	}
+
+	for (i = 0; option_buffer && i < 2; i++) {
+		setsockopt(sv[i], SOL_SOCKET, SO_SNDBUF, &option_buffer,
+				sizeof(option_buffer));
+		setsockopt(sv[i], SOL_SOCKET, SO_RCVBUF, &option_buffer,
+				sizeof(option_buffer));
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	}
+
+	if (pid == 0) {
+		close(sv[0]);
+		modem_run(sv[1], mode, run.frame_size);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(sv[1]);
+
+	run.main_loop = g_main_loop_new(NULL, FALSE);
+
+	if (!run_setup(&run, sv[0])) {
+		fprintf(stderr, "Unable to set up the %s multiplexer\n",
+				mode_name[mode]);
+		goto done;
+	}
+
+	run.bulk_in_watch = g_io_add_watch(run.bulk,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				bulk_read, &run);
+	run.bulk_out_watch = g_io_add_watch(run.bulk,
+				G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				bulk_write, &run);
+
+	for (i = 0; i < option_channels; i++)
+		at_send(&run.at[i]);
+
+	g_timeout_add_seconds(option_duration, run_stop, &run);
+
+	start = now_ns();
+	cpu = cpu_ns();
+
+	g_main_loop_run(run.main_loop);
+
+	report(&run, now_ns() - start, cpu_ns() - cpu);
+	ok = true;
+
+done:
+	run.running = false;
+	run_free(&run);
+
+	/* The modem side goes away once it reads end of file */
+	waitpid(pid, NULL, 0);
+
+	return ok;
+}
+
+static void usage(void)
+{
+	printf("mux-bench\nUsage:\n");
+	printf("mux-bench [options]\n");
+	printf("Options:\n"
+		"\t-m, --mode		basic or advanced, default both\n"
+		"\t-f, --frame-size	Frame size, default 31 or 64\n"
+		"\t-c, --channels		Number of AT channels\n"
+		"\t-d, --duration		Seconds per run\n"
+		"\t-p, --priority		Priority of the AT channels\n"
+		"\t-q, --quantum		Frames written per wakeup\n"
+		"\t-b, --buffer		Socket buffer size, 0 for default\n"
+		"\t-j, --json		One JSON object per run\n"
+		"\t-h, --help		Show help options\n");
+}
+
+static const struct option options[] = {
+	{ "mode",	required_argument,	NULL, 'm' },
+	{ "frame-size",	required_argument,	NULL, 'f' },
+	{ "channels",	required_argument,	NULL, 'c' },
+	{ "duration",	required_argument,	NULL, 'd' },
+	{ "priority",	required_argument,	NULL, 'p' },
+	{ "quantum",	required_argument,	NULL, 'q' },
+	{ "buffer",	required_argument,	NULL, 'b' },
+	{ "json",	no_argument,		NULL, 'j' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ },
+};
+
+static bool parse_uint(const char *name, unsigned int *out,
+			unsigned int min, unsigned int max)
+{
+	if (l_safe_atou32(optarg, out) < 0 || *out < min || *out > max) {
+		fprintf(stderr, "Invalid %s\n", name);
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	bool ok = true;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "m:f:c:d:p:q:b:jh",
+					options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'm':
+			if (!strcmp(optarg, "basic"))
+				option_mode = MUX_BASIC;
+			else if (!strcmp(optarg, "advanced"))
+				option_mode = MUX_ADVANCED;
+			else {
+				fprintf(stderr, "Invalid mode\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f':
+			if (!parse_uint("frame size", &option_frame_size,
+						1, MAX_FRAME_SIZE))
+				return EXIT_FAILURE;
+			break;
+		case 'c':
+			if (!parse_uint("channels", &option_channels,
+						0, MAX_AT_CHANNELS))
+				return EXIT_FAILURE;
+			break;
+		case 'd':
+			if (!parse_uint("duration", &option_duration,
+						1, 3600))
+				return EXIT_FAILURE;
+			break;
+		case 'p':
+			if (!parse_uint("priority", &option_priority, 1, 255))
+				return EXIT_FAILURE;
+			break;
+		case 'q':
+			if (!parse_uint("quantum", &option_quantum,
+						1, UINT_MAX))
+				return EXIT_FAILURE;
+			break;
+		case 'b':
+			if (!parse_uint("buffer", &option_buffer,
+						0, INT_MAX))
+				return EXIT_FAILURE;
+			break;
+		case 'j':
+			option_json = true;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!option_json) {
+		printf("GSM 07.10 multiplexer, bulk on DLC 1 and %u AT "
+			"channels, %u s per run\n\n", option_channels,
+			option_duration);
+		printf("%-8s %6s %12s %12s %12s\n", "Mode", "Frame",
+			"Up MiB/s", "Down MiB/s", "CPU ms/MiB");
+	}
+
+	if (option_mode != MUX_ADVANCED)
+		ok = run_bench(MUX_BASIC);
+
+	if (ok && option_mode != MUX_BASIC)
+		ok = run_bench(MUX_ADVANCED);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,195 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <ell/ell.h>
+
+#include "unit/bench.h"
+#include "unit/qmi-replay.h"
+
+static unsigned int option_rounds = 1;
+static unsigned int option_window = 1;
+static bool option_fuzz;
+
+static void print_result(const char *name, unsigned int count,
+				uint64_t total_ns, uint64_t max_ns,
+				void *user_data)
+{
+	if (count == 0)
+		return;
+
+	printf("%-24s %10u %12.1f %12.1f\n", name, count,
+		total_ns / 1e3 / count, max_ns / 1e3);
+}
+
+/* Runs each file through the fuzzing entry point, as afl-fuzz would */
+static int fuzz(int argc, char **argv)
+{
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		size_t len;
+		uint8_t *data = l_file_get_contents(argv[i], &len);
+
+		if (!data) {
+			fprintf(stderr, "Unable to read %s\n", argv[i]);
+			continue;
+		}
+
+		qmi_replay_fuzz(data, len);
+		l_free(data);
+	}
+
+	qmi_replay_fuzz_cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+static int replay(const char *path)
+{
+	struct qmi_replay *replay = qmi_replay_new();
+	struct qmi_replay_stats stats;
+	struct qmi_replay_stats total;
+	unsigned long allocs;
+	unsigned int messages;
+	unsigned int i;
+
+	if (qmi_replay_load(replay, path) == 0) {
+		fprintf(stderr, "No QMI records found in %s\n", path);
+		qmi_replay_free(replay);
+		return EXIT_FAILURE;
+	}
+
+	memset(&total, 0, sizeof(total));
+	allocs = bench_alloc_count();
+
+	for (i = 0; i < option_rounds; i++) {
+		if (!qmi_replay_run(replay, option_window, &stats)) {
+			fprintf(stderr, "Replay stalled after %u requests\n",
+					stats.requests);
+			qmi_replay_free(replay);
+			return EXIT_FAILURE;
+		}
+
+		total.requests += stats.requests;
+		total.responses += stats.responses;
+		total.synthesized += stats.synthesized;
+		total.indications += stats.indications;
+		total.bytes += stats.bytes;
+		total.response_ns += stats.response_ns;
+		total.indication_ns += stats.indication_ns;
+		total.elapsed += stats.elapsed;
+		total.cpu += stats.cpu;
+	}
+
+	allocs = bench_alloc_count() - allocs;
+	messages = total.requests + total.responses + total.indications;
+
+	printf("%-24s %10s %12s %12s\n", "Path", "Count", "us/each",
+		"us max");
+	qmi_replay_foreach_result(replay, print_result, NULL);
+
+	printf("\n%u requests (%u without response), %u indications\n",
+		total.requests, total.synthesized, total.indications);
+	printf("%u messages, %zu bytes in %.3fs, %.3fs CPU\n",
+		messages, total.bytes, total.elapsed, total.cpu);
+	printf("%.0f messages/s, %.1f us per response, "
+		"%.1f us per indication\n",
+		total.elapsed > 0 ? messages / total.elapsed : 0.0,
+		total.responses ? total.response_ns / 1e3 / total.responses :
+									0.0,
+		total.indications ?
+			total.indication_ns / 1e3 / total.indications : 0.0);
+
+	if (bench_alloc_counted())
+		printf("%lu allocations, %.1f per message\n", allocs,
+			messages ? (double) allocs / messages : 0.0);
+
+	qmi_replay_free(replay);
+
+	return EXIT_SUCCESS;
+}
+
+static void usage(void)
+{
+	printf("qmi-replay\nUsage:\n");
+	printf("qmi-replay [options] <capture>\n");
+	printf("qmi-replay --fuzz <input>...\n");
+	printf("Options:\n"
+		"\t-r, --rounds		Replay the capture this many times\n"
+		"\t-w, --window		Requests in flight at once\n"
+		"\t-f, --fuzz		Run the inputs through the fuzz target\n"
+		"\t-h, --help		Show help options\n");
+}
+
+static const struct option options[] = {
+	{ "rounds",	required_argument,	NULL, 'r' },
+	{ "window",	required_argument,	NULL, 'w' },
+	{ "fuzz",	no_argument,		NULL, 'f' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ },
+};
+
+int main(int argc, char **argv)
+{
+	int ret;
+
+	for (;;) {
+		int opt = getopt_long(argc, argv, "r:w:fh", options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'r':
+			if (l_safe_atou32(optarg, &option_rounds) < 0) {
+				fprintf(stderr, "Invalid rounds\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'w':
+			if (l_safe_atou32(optarg, &option_window) < 0 ||
+					!option_window) {
+				fprintf(stderr, "Invalid window\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f':
+			option_fuzz = true;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (option_fuzz ? argc == optind : argc - optind != 1) {
+		fprintf(stderr, "No capture specified\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	if (option_fuzz)
+		ret = fuzz(argc - optind, argv + optind);
+	else
+		ret = replay(argv[optind]);
+
+	l_main_exit();
+
+	return ret;
+}
@@ -0,0 +1,446 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "util.h"
+#include "smsutil.h"
+#include "unit/bench.h"
+
+static unsigned int option_rounds = 1000;
+static const char *option_filter;
+
+#define BENCH_TO "+15555550123"
+#define BENCH_LONG_GSM7 \
+	"The quick brown fox jumps over the lazy dog while the band plays " \
+	"on, and everyone at the station waits for the last train home. "
+
+#define BENCH_LONG_UCS2 \
+	"Съешь же ещё этих мягких французских булок, да выпей чаю. "
+
+/* Turkish text that needs the national single shift table */
+#define BENCH_TURKISH \
+	"Pijamalı hasta yağız şoföre çabucak güvendi. "
+
+struct bench_sample {
+	const char *name;
+	const char *text;
+	enum sms_alphabet alphabet;
+	unsigned int repeat;
+	bool datagram;
+	char *utf8;
+	GSList *list;
+};
+
+static struct bench_sample corpus[] = {
+	{ "gsm7", "See you at 5pm by the main entrance, bring the tickets!",
+		SMS_ALPHABET_DEFAULT, 1 },
+	{ "gsm7-concat", BENCH_LONG_GSM7, SMS_ALPHABET_DEFAULT, 6 },
+	{ "ucs2", "Привет! Встречаемся в 17:00 у входа.",
+		SMS_ALPHABET_DEFAULT, 1 },
+	{ "ucs2-concat", BENCH_LONG_UCS2, SMS_ALPHABET_DEFAULT, 4 },
+	{ "national-shift", BENCH_TURKISH, SMS_ALPHABET_TURKISH, 1 },
+	{ "national-concat", BENCH_TURKISH, SMS_ALPHABET_TURKISH, 8 },
+	{ "app-port", NULL, SMS_ALPHABET_DEFAULT, 0, true },
+};
+
+/* Received messages as captured from live networks, see unit/test-sms.c */
+static const char *deliver_hex[] = {
+	"07911326040000F0"
+	"040B911346610089F60000208062917314480CC8F71D14969741F977FD07",
+	"0791447758100650"
+	"040DD0F334FC1CA6970100008080312170224008D4F29CDE0EA7D9",
+	"04819999990414D0FBFD7EBFDFEFF77BFE1E001"
+	"9512090801361807E00DC00FC00C400E400D600F600C500E500D800F800C"
+	"600E600C700E700C900E900CA00EA00DF003100320033003400350036003"
+	"7003800390030002000540068006900730020006D0065007300730061006"
+	"7006500200069007300200036003300200075006E00690063006F0064006"
+	"5002000630068006100720073002E",
+};
+
+static const char *cbs_hex[] = {
+	"011000320111C2327BFC76BBCBEE46A3D168341A8D46A3D168341A8D46A3D168341A"
+	"8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D16834"
+	"1A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100",
+	"0110003201114679785E96371A8D46A3D168341A8D46A3D168341A8D46A3D168341A"
+	"8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D16834"
+	"1A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100",
+};
+
+struct bench_pdu {
+	unsigned char pdu[176];
+	int len;
+	int tpdu_len;
+	gboolean outgoing;
+};
+
+static struct bench_pdu *pdus;
+static unsigned int n_pdus;
+static struct cbs cbs_pages[L_ARRAY_SIZE(cbs_hex)];
+static unsigned char app_data[300];
+
+static GSList *sample_prepare(const struct bench_sample *sample)
+{
+	if (sample->datagram)
+		return sms_datagram_prepare(BENCH_TO, app_data,
+						sizeof(app_data), 42, FALSE,
+						9200, 2948, TRUE, FALSE);
+
+	return sms_text_prepare_with_alphabet(BENCH_TO, sample->utf8, 42,
+						FALSE, FALSE, sample->alphabet);
+}
+
+static bool corpus_init(void)
+{
+	unsigned int i;
+	unsigned int j;
+	GSList *l;
+
+	for (i = 0; i < sizeof(app_data); i++)
+		app_data[i] = i * 7;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		struct bench_sample *sample = &corpus[i];
+		GString *str = g_string_new(NULL);
+
+		for (j = 0; j < sample->repeat; j++)
+			g_string_append(str, sample->text);
+
+		sample->utf8 = g_string_free(str, FALSE);
+		sample->list = sample_prepare(sample);
+
+		if (!sample->list) {
+			fprintf(stderr, "Unable to prepare %s\n", sample->name);
+			return false;
+		}
+
+		n_pdus += g_slist_length(sample->list);
+	}
+
+	n_pdus += L_ARRAY_SIZE(deliver_hex);
+	pdus = l_new(struct bench_pdu, n_pdus);
+	n_pdus = 0;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		for (l = corpus[i].list; l; l = l->next) {
+			struct bench_pdu *p = &pdus[n_pdus++];
+
+			sms_encode(l->data, &p->len, &p->tpdu_len, p->pdu);
+			p->outgoing = TRUE;
+		}
+	}
+
+	for (i = 0; i < L_ARRAY_SIZE(deliver_hex); i++) {
+		struct bench_pdu *p = &pdus[n_pdus++];
+		size_t len;
+		unsigned char *pdu = l_util_from_hexstring(deliver_hex[i],
+								&len);
+
+		memcpy(p->pdu, pdu, len);
+		p->len = len;
+		p->tpdu_len = len - pdu[0] - 1;
+		p->outgoing = FALSE;
+		l_free(pdu);
+	}
+
+	for (i = 0; i < L_ARRAY_SIZE(cbs_hex); i++) {
+		size_t len;
+		unsigned char *pdu = l_util_from_hexstring(cbs_hex[i], &len);
+		gboolean ok = cbs_decode(pdu, len, &cbs_pages[i]);
+
+		l_free(pdu);
+
+		if (!ok) {
+			fprintf(stderr, "Unable to decode CBS page %u\n", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void corpus_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		g_slist_free_full(corpus[i].list, g_free);
+		g_free(corpus[i].utf8);
+	}
+
+	l_free(pdus);
+}
+
+static unsigned int bench_decode(unsigned int round)
+{
+	unsigned int i;
+	struct sms sms;
+
+	for (i = 0; i < n_pdus; i++)
+		sms_decode(pdus[i].pdu, pdus[i].len, pdus[i].outgoing,
+				pdus[i].tpdu_len, &sms);
+
+	return n_pdus;
+}
+
+static unsigned int bench_encode(unsigned int round)
+{
+	unsigned char pdu[176];
+	unsigned int ops = 0;
+	unsigned int i;
+	int len;
+	int tpdu_len;
+	GSList *l;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		for (l = corpus[i].list; l; l = l->next, ops++)
+			sms_encode(l->data, &len, &tpdu_len, pdu);
+	}
+
+	return ops;
+}
+
+static unsigned int bench_text_prepare(unsigned int round)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++)
+		g_slist_free_full(sample_prepare(&corpus[i]), g_free);
+
+	return L_ARRAY_SIZE(corpus);
+}
+
+static unsigned int bench_decode_text(unsigned int round)
+{
+	unsigned int ops = 0;
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		if (corpus[i].datagram)
+			continue;
+
+		g_free(sms_decode_text(corpus[i].list));
+		ops += 1;
+	}
+
+	return ops;
+}
+
+static unsigned int bench_decode_text_own_buf(unsigned int round)
+{
+	char buf[4096];
+	unsigned int ops = 0;
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		if (corpus[i].datagram)
+			continue;
+
+		sms_decode_text_own_buf(corpus[i].list, buf, sizeof(buf));
+		ops += 1;
+	}
+
+	return ops;
+}
+
+static struct sms_assembly *assembly;
+
+/*
+ * Feeds every concatenated sample through the assembly, using a fresh
+ * reference each time so that each message completes and is released
+ */
+static unsigned int bench_assembly(unsigned int round)
+{
+	unsigned int ops = 0;
+	unsigned int i;
+	GSList *l;
+
+	for (i = 0; i < L_ARRAY_SIZE(corpus); i++) {
+		guint16 ref = round * L_ARRAY_SIZE(corpus) + i;
+
+		for (l = corpus[i].list; l; l = l->next) {
+			const struct sms *sms = l->data;
+			guint16 unused;
+			guint8 max;
+			guint8 seq;
+			GSList *completed;
+
+			if (!sms_extract_concatenation(sms, &unused,
+							&max, &seq))
+				break;
+
+			completed = sms_assembly_add_fragment(assembly, sms,
+							round,
+							&sms->submit.daddr,
+							ref, max, seq);
+			g_slist_free_full(completed, g_free);
+			ops += 1;
+		}
+	}
+
+	return ops;
+}
+
+static struct cbs_assembly *cbs_assembly;
+
+/* Pages 1 and 3 come from cbs1, page 2 from cbs2 */
+static unsigned int bench_cbs_assembly(unsigned int round)
+{
+	static const unsigned int order[] = { 1, 0, 1 };
+	unsigned int page;
+
+	for (page = 1; page <= L_ARRAY_SIZE(order); page++) {
+		struct cbs cbs = cbs_pages[order[page - 1]];
+
+		cbs.update_number = round & 0xf;
+		cbs.max_pages = L_ARRAY_SIZE(order);
+		cbs.page = page;
+
+		g_slist_free_full(cbs_assembly_add_page(cbs_assembly, &cbs),
+					g_free);
+	}
+
+	/* Forget the serial so the next round is accepted as new */
+	cbs_assembly_location_changed(cbs_assembly, TRUE, TRUE, TRUE);
+
+	return L_ARRAY_SIZE(order);
+}
+
+static const struct {
+	const char *name;
+	unsigned int (*run)(unsigned int round);
+} benchmarks[] = {
+	{ "sms_decode",			bench_decode },
+	{ "sms_encode",			bench_encode },
+	{ "sms_text_prepare",		bench_text_prepare },
+	{ "sms_decode_text",		bench_decode_text },
+	{ "sms_decode_text_own_buf",	bench_decode_text_own_buf },
+	{ "sms_assembly_add_fragment",	bench_assembly },
+	{ "cbs_assembly_add_page",	bench_cbs_assembly },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(void)
+{
+	unsigned int i;
+	unsigned int round;
+
+	assembly = sms_assembly_new(NULL);
+	cbs_assembly = cbs_assembly_new();
+
+	printf("%u PDUs from %zu samples, %u rounds\n\n", n_pdus,
+		L_ARRAY_SIZE(corpus), option_rounds);
+	printf("%-26s %10s %12s %10s %12s\n", "Operation", "Count", "ops/s",
+		"ns/op", "allocs/op");
+
+	for (i = 0; i < L_ARRAY_SIZE(benchmarks); i++) {
+		unsigned long allocs;
+		unsigned long ops = 0;
+		uint64_t start;
+		uint64_t elapsed;
+
+		if (option_filter && !strstr(benchmarks[i].name, option_filter))
+			continue;
+
+		allocs = bench_alloc_count();
+		start = now_ns();
+
+		for (round = 0; round < option_rounds; round++)
+			ops += benchmarks[i].run(round);
+
+		elapsed = now_ns() - start;
+		allocs = bench_alloc_count() - allocs;
+
+		if (!ops)
+			continue;
+
+		printf("%-26s %10lu %12.0f %10.1f", benchmarks[i].name, ops,
+			elapsed ? ops * 1e9 / elapsed : 0.0,
+			(double) elapsed / ops);
+
+		if (bench_alloc_counted())
+			printf(" %12.2f\n", (double) allocs / ops);
+		else
+			printf(" %12s\n", "-");
+	}
+
+	cbs_assembly_free(cbs_assembly);
+	sms_assembly_free(assembly);
+}
+
+static void usage(void)
+{
+	printf("sms-bench\nUsage:\n");
+	printf("sms-bench [options]\n");
+	printf("Options:\n"
+		"\t-r, --rounds		Run over the corpus this many times\n"
+		"\t-b, --bench		Only run benchmarks matching this name\n"
+		"\t-h, --help		Show help options\n");
+}
+
+static const struct option options[] = {
+	{ "rounds",	required_argument,	NULL, 'r' },
+	{ "bench",	required_argument,	NULL, 'b' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ },
+};
+
+int main(int argc, char **argv)
+{
+	for (;;) {
+		int opt = getopt_long(argc, argv, "r:b:h", options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'r':
+			if (l_safe_atou32(optarg, &option_rounds) < 0 ||
+					!option_rounds) {
+				fprintf(stderr, "Invalid rounds\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			option_filter = optarg;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!corpus_init()) {
+		corpus_free();
+		return EXIT_FAILURE;
+	}
+
+	run();
+	corpus_free();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <ell/ell.h>
+
+#include "unit/stk-fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	stk_fuzz_one(data, size);
+
+	return 0;
+}
+
+/* libFuzzer brings its own main, otherwise run the inputs as it would */
+#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+int main(int argc, char **argv)
+{
+	unsigned int parsed = 0;
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <input>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 1; i < argc; i++) {
+		size_t len;
+		uint8_t *data = l_file_get_contents(argv[i], &len);
+
+		if (!data) {
+			fprintf(stderr, "Unable to read %s\n", argv[i]);
+			continue;
+		}
+
+		if (stk_fuzz_one(data, len))
+			parsed += 1;
+
+		l_free(data);
+	}
+
+	printf("%u of %d inputs parsed as proactive commands\n",
+		parsed, argc - 1);
+
+	return EXIT_SUCCESS;
+}
+#endif
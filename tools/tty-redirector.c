@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <termios.h>
 #include <signal.h>
 #include <sys/signalfd.h>
@@ -27,8 +29,12 @@
 
 #define IFX_RESET_PATH "/sys/module/hsi_ffl_tty/parameters/reset_modem"
 
+#define FORWARD_CHUNK 65536
+
 static gchar *option_device = NULL;
 static gboolean option_ifx = FALSE;
+static gboolean option_copy = FALSE;
+static gint option_stats = 0;
 
 static GMainLoop *main_loop;
 static bool main_terminated;
@@ -39,6 +45,32 @@ static int client_fd = -1;
 static guint device_watch = 0;
 static guint client_watch = 0;
 
+/*
+ * Data is moved through a pipe with splice() so that it never reaches
+ * userspace.  A direction falls back to read() and write() through a
+ * buffer when that was asked for, or when the kernel cannot splice from
+ * its input, as older kernels cannot for TTYs.
+ */
+struct forward {
+	const char *name;
+	int pipe[2];
+	bool copy;
+	uint64_t bytes;
+	uint64_t chunks;
+	int64_t total_time;
+	int64_t max_time;
+};
+
+static struct forward device_forward = {
+	.name = "device to client",
+	.pipe = { -1, -1 },
+};
+
+static struct forward client_forward = {
+	.name = "client to device",
+	.pipe = { -1, -1 },
+};
+
 static gboolean shutdown_timeout(gpointer user_data)
 {
 	g_main_loop_quit(main_loop);
@@ -165,35 +197,174 @@ static int open_device(const char *path)
 	return fd;
 }
 
-static gboolean forward_data(GIOCondition cond, int input_fd, int output_fd)
+static void forward_open(struct forward *fw)
 {
-	unsigned char buf[1024];
-	ssize_t bytes_read, bytes_written;
+	fw->copy = option_copy;
 
-	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
-		return FALSE;
+	if (fw->copy)
+		return;
+
+	if (pipe2(fw->pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+		perror("Failed to create pipe, copying instead");
+		fw->copy = true;
+		return;
+	}
+
+	/* Room for a whole chunk, so that one splice moves it */
+	fcntl(fw->pipe[1], F_SETPIPE_SZ, FORWARD_CHUNK);
+}
+
+static void forward_close(struct forward *fw)
+{
+	if (fw->pipe[0] >= 0)
+		close(fw->pipe[0]);
+
+	if (fw->pipe[1] >= 0)
+		close(fw->pipe[1]);
+
+	fw->pipe[0] = -1;
+	fw->pipe[1] = -1;
+}
+
+static bool write_all(int fd, const unsigned char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0)
+			return false;
+
+		buf += written;
+		len -= written;
+	}
+
+	return true;
+}
+
+static ssize_t forward_copy(int input_fd, int output_fd)
+{
+	unsigned char buf[FORWARD_CHUNK];
+	ssize_t bytes_read;
 
 	bytes_read = read(input_fd, buf, sizeof(buf));
-	if (bytes_read < 0)
+	if (bytes_read <= 0)
+		return -1;
+
+	if (!write_all(output_fd, buf, bytes_read))
+		return -1;
+
+	return bytes_read;
+}
+
+static ssize_t forward_splice(struct forward *fw, int input_fd,
+								int output_fd)
+{
+	ssize_t in, out;
+	ssize_t left;
+
+	in = splice(input_fd, NULL, fw->pipe[1], NULL, FORWARD_CHUNK,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (in < 0 && (errno == EINVAL || errno == ENOSYS)) {
+		g_printerr("Cannot splice %s, copying instead\n", fw->name);
+		forward_close(fw);
+		fw->copy = true;
+		return forward_copy(input_fd, output_fd);
+	}
+
+	if (in <= 0)
+		return -1;
+
+	/* The output is blocking, the pipe is drained before returning */
+	for (left = in; left > 0; left -= out) {
+		out = splice(fw->pipe[0], NULL, output_fd, NULL, left,
+								SPLICE_F_MOVE);
+		if (out < 0 && errno == EINTR) {
+			out = 0;
+			continue;
+		}
+
+		if (out <= 0)
+			return -1;
+	}
+
+	return in;
+}
+
+static gboolean forward_data(struct forward *fw, GIOCondition cond,
+						int input_fd, int output_fd)
+{
+	int64_t start;
+	int64_t elapsed;
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
-	bytes_written = write(output_fd, buf, bytes_read);
-	if (bytes_written != bytes_read)
+	start = g_get_monotonic_time();
+
+	if (fw->copy)
+		len = forward_copy(input_fd, output_fd);
+	else
+		len = forward_splice(fw, input_fd, output_fd);
+
+	if (len < 0)
 		return FALSE;
 
+	elapsed = g_get_monotonic_time() - start;
+
+	fw->bytes += len;
+	fw->chunks += 1;
+	fw->total_time += elapsed;
+	fw->max_time = MAX(fw->max_time, elapsed);
+
+	return TRUE;
+}
+
+static void forward_print_stats(struct forward *fw)
+{
+	int64_t mean = fw->chunks ? fw->total_time / (int64_t) fw->chunks : 0;
+
+	g_printerr("%s (%s): %" PRIu64 " bytes in %" PRIu64 " chunks, "
+			"%" PRId64 " us mean, %" PRId64 " us max\n",
+			fw->name, fw->copy ? "copy" : "splice",
+			fw->bytes, fw->chunks, mean, fw->max_time);
+
+	fw->bytes = 0;
+	fw->chunks = 0;
+	fw->total_time = 0;
+	fw->max_time = 0;
+}
+
+static gboolean stats_timeout(gpointer user_data)
+{
+	forward_print_stats(&device_forward);
+	forward_print_stats(&client_forward);
+
 	return TRUE;
 }
 
+static void close_forwarding(void)
+{
+	forward_close(&device_forward);
+	forward_close(&client_forward);
+}
+
 static gboolean device_handler(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
-	if (forward_data(cond, device_fd, client_fd) == FALSE) {
+	if (forward_data(&device_forward, cond,
+					device_fd, client_fd) == FALSE) {
 		g_printerr("Closing device descriptor\n");
 		if (client_watch > 0) {
 			g_source_remove(client_watch);
 			client_watch = 0;
 		}
 
+		close_forwarding();
+
 		device_watch = 0;
 		return FALSE;
 	}
@@ -204,13 +375,16 @@ static gboolean device_handler(GIOChannel *channel, GIOCondition cond,
 static gboolean client_handler(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
-	if (forward_data(cond, client_fd, device_fd) == FALSE) {
+	if (forward_data(&client_forward, cond,
+					client_fd, device_fd) == FALSE) {
 		g_printerr("Closing client connection\n");
 		if (device_watch > 0) {
 			g_source_remove(device_watch);
 			device_watch = 0;
 		}
 
+		close_forwarding();
+
 		client_watch = 0;
 		return FALSE;
 	}
@@ -246,6 +420,8 @@ static gboolean accept_handler(GIOChannel *channel, GIOCondition cond,
 			g_source_remove(client_watch);
 			client_watch = 0;
 		}
+
+		close_forwarding();
 	}
 
 	if (option_ifx == TRUE) {
@@ -261,6 +437,9 @@ static gboolean accept_handler(GIOChannel *channel, GIOCondition cond,
 		return TRUE;
 	}
 
+	forward_open(&device_forward);
+	forward_open(&client_forward);
+
 	device_watch = create_watch(device_fd, device_handler);
 	if (device_watch == 0) {
 		close(nfd);
@@ -318,6 +497,10 @@ static GOptionEntry options[] = {
 				"Specify device to use", "DEVNODE" },
 	{ "ifx", 0, 0, G_OPTION_ARG_NONE, &option_ifx,
 				"Use Infineon reset handling" },
+	{ "copy", 0, 0, G_OPTION_ARG_NONE, &option_copy,
+				"Copy data instead of splicing it" },
+	{ "stats", 0, 0, G_OPTION_ARG_INT, &option_stats,
+				"Print statistics every SECS seconds", "SECS" },
 	{ NULL },
 };
 
@@ -327,6 +510,7 @@ int main(int argc, char **argv)
 	GError *error = NULL;
 	guint signal_watch;
 	guint server_watch;
+	guint stats_watch = 0;
 
 	context = g_option_context_new(NULL);
 	g_option_context_add_main_entries(context, options, NULL);
@@ -355,8 +539,19 @@ int main(int argc, char **argv)
 	signal_watch = setup_signalfd();
 	server_watch = setup_server();
 
+	if (option_stats > 0)
+		stats_watch = g_timeout_add_seconds(option_stats,
+							stats_timeout, NULL);
+
 	g_main_loop_run(main_loop);
 
+	if (stats_watch > 0) {
+		g_source_remove(stats_watch);
+		stats_timeout(NULL);
+	}
+
+	close_forwarding();
+
 	g_source_remove(server_watch);
 	g_source_remove(signal_watch);
 	g_main_loop_unref(main_loop);
@@ -0,0 +1,589 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+#include "at-replay.h"
+
+#define CTRLZ 26
+#define ESC 25
+
+struct replay_step {
+	GString *out;			/* Written by the chat, NULL if none */
+	GString *in;			/* Modem output following it */
+	gboolean continuation;		/* Rest of a command with a prompt */
+};
+
+struct replay_result {
+	struct at_replay *replay;
+	char *name;
+	guint count;
+	guint lines;
+	gint64 cpu_ns;
+};
+
+struct at_replay {
+	GPtrArray *steps;
+	GHashTable *notify_prefixes;	/* prefix -> TRUE if PDU follows */
+	GHashTable *results;		/* name -> struct replay_result */
+	GAtChat *chat;
+	int fd;				/* Modem side of the socketpair */
+	gboolean pending;		/* Command awaiting final response */
+	gint64 last_cpu_ns;
+	struct at_replay_stats *stats;
+};
+
+static const char *pdu_prefixes[] = { "+CMT:", "+CDS:", "+CBM:", NULL };
+
+static gint64 thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+		return 0;
+
+	return ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static void replay_step_free(gpointer data)
+{
+	struct replay_step *step = data;
+
+	if (step->out)
+		g_string_free(step->out, TRUE);
+
+	g_string_free(step->in, TRUE);
+	g_free(step);
+}
+
+static void replay_result_free(gpointer data)
+{
+	struct replay_result *result = data;
+
+	g_free(result->name);
+	g_free(result);
+}
+
+struct at_replay *at_replay_new(void)
+{
+	struct at_replay *replay = g_new0(struct at_replay, 1);
+
+	replay->steps = g_ptr_array_new_with_free_func(replay_step_free);
+	replay->notify_prefixes = g_hash_table_new_full(g_str_hash,
+						g_str_equal, g_free, NULL);
+	replay->results = g_hash_table_new_full(g_str_hash, g_str_equal,
+						NULL, replay_result_free);
+	replay->fd = -1;
+
+	return replay;
+}
+
+void at_replay_free(struct at_replay *replay)
+{
+	if (replay == NULL)
+		return;
+
+	g_ptr_array_free(replay->steps, TRUE);
+	g_hash_table_destroy(replay->notify_prefixes);
+	g_hash_table_destroy(replay->results);
+	g_free(replay);
+}
+
+/* Reverses the escaping done by g_at_util_debug_chat */
+static void unescape(GString *str, const char *data)
+{
+	while (*data) {
+		if (data[0] == '\\' && data[1] == 'r') {
+			g_string_append_c(str, '\r');
+			data += 2;
+		} else if (data[0] == '\\' && data[1] == 'n') {
+			g_string_append_c(str, '\n');
+			data += 2;
+		} else if (data[0] == '\\' && data[1] == 't') {
+			g_string_append_c(str, '\t');
+			data += 2;
+		} else if (data[0] == '\\' && data[1] >= '0' && data[1] <= '3' &&
+				data[2] >= '0' && data[2] <= '7' &&
+				data[3] >= '0' && data[3] <= '7') {
+			g_string_append_c(str, ((data[1] - '0') << 6) |
+						((data[2] - '0') << 3) |
+						(data[3] - '0'));
+			data += 4;
+		} else if (g_str_has_prefix(data, "<CtrlZ>")) {
+			g_string_append_c(str, CTRLZ);
+			data += 7;
+		} else if (g_str_has_prefix(data, "<ESC>")) {
+			g_string_append_c(str, ESC);
+			data += 5;
+		} else
+			g_string_append_c(str, *data++);
+	}
+}
+
+/* Finds the "< " or "> " marker of a record and checks its channel */
+static const char *find_record(const char *line, const char *channel)
+{
+	const char *in;
+	const char *out;
+	const char *marker;
+	gsize len;
+
+	if ((line[0] == '<' || line[0] == '>') && line[1] == ' ')
+		return channel ? NULL : line;
+
+	in = strstr(line, ": < ");
+	out = strstr(line, ": > ");
+
+	if (in == NULL || (out && out < in))
+		marker = out;
+	else
+		marker = in;
+
+	if (marker == NULL)
+		return NULL;
+
+	/* The channel name includes the ':' ending the prefix */
+	if (channel) {
+		len = strlen(channel);
+
+		if ((gsize) (marker + 1 - line) < len ||
+				strncmp(marker + 1 - len, channel, len))
+			return NULL;
+	}
+
+	return marker + 2;
+}
+
+static struct replay_step *replay_add_step(struct at_replay *replay,
+						gboolean out)
+{
+	struct replay_step *step = g_new0(struct replay_step, 1);
+
+	if (out)
+		step->out = g_string_new(NULL);
+
+	step->in = g_string_new(NULL);
+	g_ptr_array_add(replay->steps, step);
+
+	return step;
+}
+
+static void collect_notify_prefixes(struct at_replay *replay,
+					const GString *in)
+{
+	char **lines = g_strsplit_set(in->str, "\r\n", -1);
+	char **line;
+
+	for (line = lines; *line; line++) {
+		const char *colon;
+		gboolean pdu = FALSE;
+		const char **p;
+		char *prefix;
+
+		if (!strcmp(*line, "RING")) {
+			prefix = g_strdup(*line);
+			goto add;
+		}
+
+		if (**line == '\0' || strchr("+^%$*#", **line) == NULL)
+			continue;
+
+		colon = strchr(*line, ':');
+		if (colon == NULL)
+			continue;
+
+		prefix = g_strndup(*line, colon - *line + 1);
+
+		for (p = pdu_prefixes; *p; p++)
+			if (!strcmp(prefix, *p))
+				pdu = TRUE;
+add:
+		g_hash_table_replace(replay->notify_prefixes, prefix,
+					GINT_TO_POINTER(pdu));
+	}
+
+	g_strfreev(lines);
+}
+
+guint at_replay_parse(struct at_replay *replay, const char *transcript,
+			const char *channel)
+{
+	char **lines = g_strsplit(transcript, "\n", -1);
+	struct replay_step *step = NULL;
+	guint records = 0;
+	char **line;
+	guint i;
+
+	for (line = lines; *line; line++) {
+		const char *record = find_record(*line, channel);
+		const char *data;
+		gsize len;
+
+		if (record == NULL)
+			continue;
+
+		data = record + 2;
+		records += 1;
+
+		/* Trailing blanks may be data, e.g. in a "> " prompt */
+		len = strlen(data);
+		if (len && data[len - 1] == '\r')
+			((char *) data)[len - 1] = '\0';
+
+		if (record[0] == '<') {
+			if (step == NULL)
+				step = replay_add_step(replay, FALSE);
+
+			unescape(step->in, data);
+			continue;
+		}
+
+		if (g_ascii_strncasecmp(data, "AT", 2) == 0) {
+			step = replay_add_step(replay, TRUE);
+		} else if (step && step->out) {
+			step = replay_add_step(replay, TRUE);
+			step->continuation = TRUE;
+		} else
+			continue;
+
+		unescape(step->out, data);
+	}
+
+	g_strfreev(lines);
+
+	for (i = 0; i < replay->steps->len; i++) {
+		struct replay_step *s = g_ptr_array_index(replay->steps, i);
+
+		collect_notify_prefixes(replay, s->in);
+	}
+
+	return records;
+}
+
+guint at_replay_load(struct at_replay *replay, const char *path,
+			const char *channel)
+{
+	char *contents;
+	guint records;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL))
+		return 0;
+
+	records = at_replay_parse(replay, contents, channel);
+	g_free(contents);
+
+	return records;
+}
+
+/* Names commands the same way GAtChat accounts them, e.g. +COPS=? */
+static char *command_name(const char *cmd)
+{
+	gsize len;
+
+	if (g_ascii_strncasecmp(cmd, "AT", 2) == 0)
+		cmd += 2;
+
+	len = strcspn(cmd, "=?;\r\032");
+
+	if (cmd[len] == '?')
+		len += 1;
+	else if (cmd[len] == '=')
+		len += cmd[len + 1] == '?' ? 2 : 1;
+
+	return g_strndup(cmd, len);
+}
+
+static struct replay_result *replay_get_result(struct at_replay *replay,
+						char *name)
+{
+	struct replay_result *result;
+
+	result = g_hash_table_lookup(replay->results, name);
+	if (result) {
+		g_free(name);
+		return result;
+	}
+
+	result = g_new0(struct replay_result, 1);
+	result->replay = replay;
+	result->name = name;
+	g_hash_table_insert(replay->results, name, result);
+
+	return result;
+}
+
+static void replay_account(struct replay_result *result, GAtResult *r)
+{
+	struct at_replay *replay = result->replay;
+	GAtResultIter iter;
+	gint64 now = thread_cpu_ns();
+	guint lines = 0;
+
+	g_at_result_iter_init(&iter, r);
+
+	while (g_at_result_iter_next(&iter, NULL))
+		lines += 1;
+
+	if (g_at_result_final_response(r))
+		lines += 1;
+
+	result->count += 1;
+	result->lines += lines;
+	result->cpu_ns += now - replay->last_cpu_ns;
+
+	replay->stats->lines += lines;
+	replay->last_cpu_ns = now;
+}
+
+static void replay_notify(GAtResult *r, gpointer user_data)
+{
+	struct replay_result *result = user_data;
+
+	result->replay->stats->notifications += 1;
+	replay_account(result, r);
+}
+
+static void replay_command_cb(gboolean ok, GAtResult *r, gpointer user_data)
+{
+	struct replay_result *result = user_data;
+
+	result->replay->pending = FALSE;
+	replay_account(result, r);
+}
+
+static void replay_drain(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static gboolean replay_feed(struct at_replay *replay, const char *data,
+				gsize len)
+{
+	gsize written = 0;
+
+	while (written < len) {
+		ssize_t r = write(replay->fd, data + written, len - written);
+
+		if (r < 0 && errno != EAGAIN && errno != EINTR)
+			return FALSE;
+
+		if (r > 0)
+			written += r;
+		else if (!g_main_context_iteration(NULL, FALSE))
+			return FALSE;
+	}
+
+	replay->stats->bytes += len;
+	replay_drain();
+
+	return TRUE;
+}
+
+/* Reads what the chat writes out, until it stalls */
+static gboolean replay_wait_written(struct at_replay *replay, gsize len)
+{
+	char buf[256];
+	gsize got = 0;
+
+	while (got < len) {
+		ssize_t r = read(replay->fd, buf, MIN(sizeof(buf), len - got));
+
+		if (r > 0) {
+			got += r;
+			continue;
+		}
+
+		if (r == 0 || (errno != EAGAIN && errno != EINTR))
+			return FALSE;
+
+		if (!g_main_context_iteration(NULL, FALSE))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean replay_finish_command(struct at_replay *replay)
+{
+	static const char ok[] = "\r\nOK\r\n";
+
+	if (!replay->pending)
+		return TRUE;
+
+	replay_drain();
+
+	if (!replay->pending)
+		return TRUE;
+
+	/* The transcript ended or was cut, complete the command */
+	replay->stats->incomplete += 1;
+
+	if (!replay_feed(replay, ok, sizeof(ok) - 1))
+		return FALSE;
+
+	return !replay->pending;
+}
+
+static gboolean replay_send(struct at_replay *replay, guint index)
+{
+	struct replay_step *step = g_ptr_array_index(replay->steps, index);
+	GString *cmd = g_string_new(step->out->str);
+	struct replay_result *result;
+	const char *prefixes[2] = { NULL, NULL };
+	char *prefix = NULL;
+	char *name;
+	guint i;
+
+	for (i = index + 1; i < replay->steps->len; i++) {
+		struct replay_step *next = g_ptr_array_index(replay->steps, i);
+
+		if (!next->continuation)
+			break;
+
+		g_string_append(cmd, next->out->str);
+	}
+
+	/* GAtChat terminates the command by itself */
+	if (cmd->len && (cmd->str[cmd->len - 1] == '\r' ||
+				cmd->str[cmd->len - 1] == CTRLZ))
+		g_string_truncate(cmd, cmd->len - 1);
+
+	name = command_name(cmd->str);
+
+	if (name[0] != '\0' && strchr("+^%$*#", name[0])) {
+		prefix = g_strdup_printf("%.*s:", (int) strcspn(name, "=?"),
+						name);
+		prefixes[0] = prefix;
+	}
+
+	result = replay_get_result(replay, name);
+	replay->pending = g_at_chat_send(replay->chat, cmd->str,
+						prefix ? prefixes : NULL,
+						replay_command_cb, result,
+						NULL) > 0;
+	replay->stats->commands += 1;
+
+	g_free(prefix);
+	g_string_free(cmd, TRUE);
+
+	return replay->pending;
+}
+
+static void replay_register(gpointer key, gpointer value, gpointer user_data)
+{
+	struct at_replay *replay = user_data;
+	struct replay_result *result;
+
+	result = replay_get_result(replay, g_strdup(key));
+	g_at_chat_register(replay->chat, key, replay_notify,
+				GPOINTER_TO_INT(value), result, NULL);
+}
+
+gboolean at_replay_run(struct at_replay *replay, GAtSyntax *syntax,
+			struct at_replay_stats *stats)
+{
+	GIOChannel *io;
+	gint64 start_cpu;
+	gint64 start;
+	gboolean ret = FALSE;
+	int sv[2];
+	guint i;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+		return FALSE;
+
+	if (fcntl(sv[1], F_SETFL, O_NONBLOCK) < 0)
+		goto out;
+
+	io = g_io_channel_unix_new(sv[0]);
+	replay->chat = g_at_chat_new(io, syntax);
+	g_io_channel_unref(io);
+
+	if (replay->chat == NULL)
+		goto out;
+
+	/* The chat owns the other end now */
+	sv[0] = -1;
+
+	memset(stats, 0, sizeof(*stats));
+	replay->stats = stats;
+	replay->fd = sv[1];
+	replay->pending = FALSE;
+
+	g_hash_table_foreach(replay->notify_prefixes, replay_register, replay);
+
+	start = g_get_monotonic_time();
+	start_cpu = thread_cpu_ns();
+	replay->last_cpu_ns = start_cpu;
+
+	for (i = 0; i < replay->steps->len; i++) {
+		struct replay_step *step = g_ptr_array_index(replay->steps, i);
+
+		if (step->out && !step->continuation) {
+			if (!replay_finish_command(replay))
+				goto done;
+
+			if (!replay_send(replay, i))
+				goto done;
+		}
+
+		if (step->out && !replay_wait_written(replay, step->out->len))
+			goto done;
+
+		if (!replay_feed(replay, step->in->str, step->in->len))
+			goto done;
+	}
+
+	ret = replay_finish_command(replay);
+
+done:
+	stats->cpu = (thread_cpu_ns() - start_cpu) / 1e9;
+	stats->elapsed = (g_get_monotonic_time() - start) / 1e6;
+
+	g_at_chat_unref(replay->chat);
+	replay->chat = NULL;
+	replay->stats = NULL;
+	replay->fd = -1;
+
+out:
+	if (sv[0] >= 0)
+		close(sv[0]);
+
+	close(sv[1]);
+
+	return ret;
+}
+
+void at_replay_foreach_result(struct at_replay *replay,
+				at_replay_result_func func, gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, replay->results);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct replay_result *result = value;
+
+		func(result->name, result->count, result->lines,
+			result->cpu_ns / 1e9, user_data);
+	}
+}
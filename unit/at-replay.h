@@ -0,0 +1,51 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+struct at_replay;
+
+struct at_replay_stats {
+	guint commands;		/* Commands sent */
+	guint incomplete;	/* Commands missing their final response */
+	guint notifications;	/* Unsolicited results delivered */
+	guint lines;		/* Lines delivered to callbacks */
+	gsize bytes;		/* Bytes fed to the chat */
+	double elapsed;		/* Wall clock seconds */
+	double cpu;		/* Thread CPU seconds */
+};
+
+typedef void (*at_replay_result_func)(const char *name, guint count,
+					guint lines, double cpu,
+					gpointer user_data);
+
+struct at_replay *at_replay_new(void);
+void at_replay_free(struct at_replay *replay);
+
+/*
+ * Parses an AT transcript as logged with OFONO_AT_DEBUG, one "< " or "> "
+ * record per line, optionally preceded by a debug prefix ending in ": ".
+ * If channel is not NULL, only the records whose prefix ends with it are
+ * taken, e.g. "Aux:".  Returns the number of records taken.
+ */
+guint at_replay_parse(struct at_replay *replay, const char *transcript,
+			const char *channel);
+guint at_replay_load(struct at_replay *replay, const char *path,
+			const char *channel);
+
+/*
+ * Replays the transcript through a GAtChat over a socketpair, as fast as
+ * the chat consumes it.  Commands are sent when the transcript shows them
+ * written and the recorded modem output following them is fed back once
+ * the chat has written them out.
+ */
+gboolean at_replay_run(struct at_replay *replay, GAtSyntax *syntax,
+			struct at_replay_stats *stats);
+
+/*
+ * Calls func for every command and unsolicited result name seen during the
+ * runs so far, with the CPU time attributed to parsing and handling them.
+ */
+void at_replay_foreach_result(struct at_replay *replay,
+				at_replay_result_func func, gpointer user_data);
@@ -0,0 +1,459 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "ofono.h"
+
+#include "bench.h"
+
+/*
+ * Dictionary builder writing the body of a reply carrying one a{sv} in the
+ * D-Bus wire format, in host byte order, instead of going through a libdbus
+ * iterator call for every key, variant and value.  libdbus cannot take
+ * marshalled data into an existing message, so the reply is written out
+ * whole and loaded with dbus_message_demarshal().  The body starts at an
+ * 8 byte boundary of the message, so alignments are taken from its start.
+ */
+#define DICT_BUILDER_BODY_START 8	/* Array length, padding */
+
+struct dict_builder {
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+};
+
+static void wire_reserve(struct dict_builder *builder, size_t len)
+{
+	if (builder->len + len <= builder->size)
+		return;
+
+	while (builder->len + len > builder->size)
+		builder->size = builder->size ? builder->size * 2 : 256;
+
+	builder->buf = g_realloc(builder->buf, builder->size);
+}
+
+static void wire_align(struct dict_builder *builder, size_t alignment)
+{
+	size_t pad = (alignment - (builder->len & (alignment - 1))) &
+							(alignment - 1);
+
+	wire_reserve(builder, pad);
+	memset(builder->buf + builder->len, 0, pad);
+	builder->len += pad;
+}
+
+static void wire_put(struct dict_builder *builder,
+					const void *data, size_t len)
+{
+	wire_reserve(builder, len);
+	memcpy(builder->buf + builder->len, data, len);
+	builder->len += len;
+}
+
+static void wire_put_u32(struct dict_builder *builder, uint32_t value)
+{
+	wire_align(builder, 4);
+	wire_put(builder, &value, sizeof(value));
+}
+
+static void wire_put_string(struct dict_builder *builder, const char *str)
+{
+	size_t len = strlen(str);
+
+	wire_put_u32(builder, len);
+	wire_put(builder, str, len + 1);
+}
+
+static void wire_put_signature(struct dict_builder *builder,
+							const char *sig)
+{
+	uint8_t len = strlen(sig);
+
+	wire_put(builder, &len, 1);
+	wire_put(builder, sig, len + 1);
+}
+
+/* Returns the size and alignment of fixed types, 0 for strings */
+static int wire_fixed_size(int type)
+{
+	switch (type) {
+	case DBUS_TYPE_BYTE:
+		return 1;
+	case DBUS_TYPE_INT16:
+	case DBUS_TYPE_UINT16:
+		return 2;
+	case DBUS_TYPE_BOOLEAN:
+	case DBUS_TYPE_INT32:
+	case DBUS_TYPE_UINT32:
+		return 4;
+	case DBUS_TYPE_INT64:
+	case DBUS_TYPE_UINT64:
+	case DBUS_TYPE_DOUBLE:
+		return 8;
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+		return 0;
+	}
+
+	return -1;
+}
+
+/* Empties the dictionary, keeping the buffer for the next one */
+static void dict_builder_reset(struct dict_builder *builder)
+{
+	builder->len = 0;
+
+	/* The array length is filled in once the dictionary is complete */
+	wire_put_u32(builder, 0);
+	wire_align(builder, 8);
+}
+
+static struct dict_builder *dict_builder_new(void)
+{
+	struct dict_builder *builder;
+
+	builder = g_new0(struct dict_builder, 1);
+	dict_builder_reset(builder);
+
+	return builder;
+}
+
+static void dict_builder_free(struct dict_builder *builder)
+{
+	if (builder == NULL)
+		return;
+
+	g_free(builder->buf);
+	g_free(builder);
+}
+
+static void wire_put_key(struct dict_builder *builder,
+					const char *key, const char *sig)
+{
+	wire_align(builder, 8);
+	wire_put_string(builder, key);
+	wire_put_signature(builder, sig);
+}
+
+/*
+ * Same as ofono_dbus_dict_append(), value points to the value, or to the
+ * string for string types.  Returns false for other than basic types.
+ */
+static bool dict_builder_append(struct dict_builder *builder,
+					const char *key, int type,
+					const void *value)
+{
+	int size = wire_fixed_size(type);
+	char sig[2] = { type, '\0' };
+	const char *str;
+
+	if (size < 0)
+		return false;
+
+	if (size == 0) {
+		str = *((const char **) value);
+		if (str == NULL)
+			return true;
+
+		wire_put_key(builder, key, sig);
+		wire_put_string(builder, str);
+		return true;
+	}
+
+	wire_put_key(builder, key, sig);
+	wire_align(builder, size);
+
+	if (type == DBUS_TYPE_BOOLEAN)
+		wire_put_u32(builder, *((const dbus_bool_t *) value) ? 1 : 0);
+	else
+		wire_put(builder, value, size);
+
+	return true;
+}
+
+/*
+ * Same as ofono_dbus_dict_append_array(), for NULL terminated arrays of
+ * strings or object paths
+ */
+static bool dict_builder_append_array(struct dict_builder *builder,
+					const char *key, int type,
+					const void *value)
+{
+	const char **str_array = *(const char ***) value;
+	char sig[3] = { DBUS_TYPE_ARRAY, type, '\0' };
+	size_t start;
+	uint32_t len;
+	int i;
+
+	if (wire_fixed_size(type) != 0)
+		return false;
+
+	wire_put_key(builder, key, sig);
+	wire_put_u32(builder, 0);
+	start = builder->len;
+
+	for (i = 0; str_array[i]; i++)
+		wire_put_string(builder, str_array[i]);
+
+	len = builder->len - start;
+	memcpy(builder->buf + start - sizeof(len), &len, sizeof(len));
+
+	return true;
+}
+
+static void wire_put_header_field(struct dict_builder *header,
+					uint8_t code, const char *sig)
+{
+	wire_align(header, 8);
+	wire_put(header, &code, 1);
+	wire_put_signature(header, sig);
+}
+
+/*
+ * Returns the reply to msg carrying the dictionary, or NULL if it could
+ * not be loaded, such as for a string that is not valid UTF-8.  The
+ * builder can be reset and used again afterwards.
+ */
+static DBusMessage *dict_builder_reply(struct dict_builder *builder,
+						DBusMessage *msg)
+{
+	struct dict_builder header = { NULL, 0, 0 };
+	const char *sender = dbus_message_get_sender(msg);
+	uint8_t fixed[4] = {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+		DBUS_LITTLE_ENDIAN,
+#else
+		DBUS_BIG_ENDIAN,
+#endif
+		DBUS_MESSAGE_TYPE_METHOD_RETURN,
+		DBUS_HEADER_FLAG_NO_REPLY_EXPECTED,
+		DBUS_MAJOR_PROTOCOL_VERSION,
+	};
+	uint32_t dict_len = builder->len - DICT_BUILDER_BODY_START;
+	DBusMessage *loaded;
+	DBusMessage *reply;
+	size_t start;
+	uint32_t len;
+
+	memcpy(builder->buf, &dict_len, sizeof(dict_len));
+
+	wire_reserve(&header, 128 + builder->len);
+	wire_put(&header, fixed, sizeof(fixed));
+	wire_put_u32(&header, builder->len);
+
+	/* Any serial will do, it is dropped by the copy below */
+	wire_put_u32(&header, 1);
+
+	wire_put_u32(&header, 0);
+	start = header.len;
+
+	wire_put_header_field(&header, DBUS_HEADER_FIELD_REPLY_SERIAL,
+					DBUS_TYPE_UINT32_AS_STRING);
+	wire_put_u32(&header, dbus_message_get_serial(msg));
+
+	if (sender) {
+		wire_put_header_field(&header, DBUS_HEADER_FIELD_DESTINATION,
+					DBUS_TYPE_STRING_AS_STRING);
+		wire_put_string(&header, sender);
+	}
+
+	wire_put_header_field(&header, DBUS_HEADER_FIELD_SIGNATURE,
+					DBUS_TYPE_SIGNATURE_AS_STRING);
+	wire_put_signature(&header, DBUS_TYPE_ARRAY_AS_STRING
+					OFONO_PROPERTIES_ARRAY_SIGNATURE);
+
+	len = header.len - start;
+	memcpy(header.buf + start - sizeof(len), &len, sizeof(len));
+
+	wire_align(&header, 8);
+	wire_put(&header, builder->buf, builder->len);
+
+	loaded = dbus_message_demarshal((const char *) header.buf, header.len,
+						NULL);
+	g_free(header.buf);
+
+	if (loaded == NULL)
+		return NULL;
+
+	/* Gets a serial of its own when sent */
+	reply = dbus_message_copy(loaded);
+	dbus_message_unref(loaded);
+
+	return reply;
+}
+
+
+/* Like the Settings of an active org.ofono.ConnectionContext */
+static const char *settings[] = {
+	"Interface", "rmnet0",
+	"Method", "static",
+	"Address", "10.11.12.13",
+	"Netmask", "255.255.255.0",
+	"Gateway", "10.11.12.1",
+	"AccessPointName", "internet.example.com",
+	"Name", "Internet",
+	"Type", "internet",
+	"Protocol", "ipv4v6",
+	"Username", "user",
+	"Password", "secret",
+	"AuthenticationMethod", "chap",
+	NULL
+};
+
+static const char *dns[] = { "10.11.12.2", "10.11.12.3", NULL };
+
+static DBusMessage *call;
+static struct dict_builder *builder;
+
+/* Not linked with src/main.c, there is no main.conf to read */
+const struct l_settings *__ofono_get_config(void)
+{
+	return NULL;
+}
+
+static DBusMessage *iter_reply(DBusMessageIter *iter, DBusMessageIter *dict)
+{
+	DBusMessage *reply = dbus_message_new_method_return(call);
+
+	dbus_message_iter_init_append(reply, iter);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					dict);
+
+	return reply;
+}
+
+static unsigned int bench_iter_settings(const void *data)
+{
+	DBusMessageIter iter, dict;
+	DBusMessage *reply = iter_reply(&iter, &dict);
+	int i;
+
+	for (i = 0; settings[i]; i += 2)
+		ofono_dbus_dict_append(&dict, settings[i], DBUS_TYPE_STRING,
+					&settings[i + 1]);
+
+	dbus_message_iter_close_container(&iter, &dict);
+	dbus_message_unref(reply);
+
+	return 1;
+}
+
+static unsigned int bench_builder_settings(const void *data)
+{
+	int i;
+
+	dict_builder_reset(builder);
+
+	for (i = 0; settings[i]; i += 2)
+		dict_builder_append(builder, settings[i],
+						DBUS_TYPE_STRING,
+						&settings[i + 1]);
+
+	dbus_message_unref(dict_builder_reply(builder, call));
+
+	return 1;
+}
+
+/* Like the serving cell of org.ofono.NetworkMonitor */
+static unsigned int bench_iter_mixed(const void *data)
+{
+	DBusMessageIter iter, dict;
+	DBusMessage *reply = iter_reply(&iter, &dict);
+	const char *tech = "lte";
+	const char **servers = dns;
+	dbus_uint32_t ci = 0x1234567;
+	dbus_uint16_t tac = 0x4321;
+	unsigned char rssi = 42;
+	dbus_int32_t rsrp = -95;
+	dbus_bool_t active = TRUE;
+
+	ofono_dbus_dict_append(&dict, "Technology", DBUS_TYPE_STRING, &tech);
+	ofono_dbus_dict_append(&dict, "CellId", DBUS_TYPE_UINT32, &ci);
+	ofono_dbus_dict_append(&dict, "TrackingAreaCode", DBUS_TYPE_UINT16,
+					&tac);
+	ofono_dbus_dict_append(&dict, "Strength", DBUS_TYPE_BYTE, &rssi);
+	ofono_dbus_dict_append(&dict, "ReferenceSignalReceivedPower",
+					DBUS_TYPE_INT32, &rsrp);
+	ofono_dbus_dict_append(&dict, "Active", DBUS_TYPE_BOOLEAN, &active);
+	ofono_dbus_dict_append_array(&dict, "DomainNameServers",
+					DBUS_TYPE_STRING, &servers);
+
+	dbus_message_iter_close_container(&iter, &dict);
+	dbus_message_unref(reply);
+
+	return 1;
+}
+
+static unsigned int bench_builder_mixed(const void *data)
+{
+	const char *tech = "lte";
+	const char **servers = dns;
+	dbus_uint32_t ci = 0x1234567;
+	dbus_uint16_t tac = 0x4321;
+	unsigned char rssi = 42;
+	dbus_int32_t rsrp = -95;
+	dbus_bool_t active = TRUE;
+
+	dict_builder_reset(builder);
+	dict_builder_append(builder, "Technology",
+						DBUS_TYPE_STRING, &tech);
+	dict_builder_append(builder, "CellId",
+						DBUS_TYPE_UINT32, &ci);
+	dict_builder_append(builder, "TrackingAreaCode",
+						DBUS_TYPE_UINT16, &tac);
+	dict_builder_append(builder, "Strength",
+						DBUS_TYPE_BYTE, &rssi);
+	dict_builder_append(builder,
+						"ReferenceSignalReceivedPower",
+						DBUS_TYPE_INT32, &rsrp);
+	dict_builder_append(builder, "Active",
+						DBUS_TYPE_BOOLEAN, &active);
+	dict_builder_append_array(builder, "DomainNameServers",
+						DBUS_TYPE_STRING, &servers);
+
+	dbus_message_unref(dict_builder_reply(builder, call));
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+
+	bench_init(&argc, &argv);
+
+	call = dbus_message_new_method_call(OFONO_SERVICE, "/bench/context1",
+					OFONO_CONNECTION_CONTEXT_INTERFACE,
+					"GetProperties");
+	dbus_message_set_serial(call, 1);
+	dbus_message_set_sender(call, ":1.42");
+
+	builder = dict_builder_new();
+
+	bench_add("dict/iter/settings", bench_iter_settings, NULL);
+	bench_add("dict/builder/settings", bench_builder_settings, NULL);
+	bench_add("dict/iter/mixed", bench_iter_mixed, NULL);
+	bench_add("dict/builder/mixed", bench_builder_mixed, NULL);
+
+	ret = bench_run();
+
+	dict_builder_free(builder);
+	dbus_message_unref(call);
+
+	return ret;
+}
@@ -0,0 +1,147 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "util.h"
+#include "smsutil.h"
+
+#include "bench.h"
+
+#define BENCH_TO "+15555550123"
+
+/* Received messages and pages as captured from live networks */
+static const char *simple_deliver = "07911326040000F0"
+	"040B911346610089F60000208062917314480CC8F71D14969741F977FD07";
+
+static const char *unicode_deliver = "04819999990414D0FBFD7EBFDFEFF77BFE1E001"
+	"9512090801361807E00DC00FC00C400E400D600F600C500E500D800F800C"
+	"600E600C700E700C900E900CA00EA00DF003100320033003400350036003"
+	"7003800390030002000540068006900730020006D0065007300730061006"
+	"7006500200069007300200036003300200075006E00690063006F0064006"
+	"5002000630068006100720073002E";
+
+static const char *cbs_page = "011000320111C2327BFC76BBCBEE46A3D168341A8D46"
+	"A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D"
+	"46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100";
+
+static const char *text_long =
+	"The quick brown fox jumps over the lazy dog while the band plays "
+	"on, and everyone at the station waits for the last train home. "
+	"The quick brown fox jumps over the lazy dog while the band plays "
+	"on, and everyone at the station waits for the last train home. "
+	"The quick brown fox jumps over the lazy dog while the band plays "
+	"on, and everyone at the station waits for the last train home.";
+
+struct bench_pdu {
+	unsigned char *pdu;
+	size_t len;
+	int tpdu_len;
+};
+
+static struct bench_pdu deliver_gsm7;
+static struct bench_pdu deliver_ucs2;
+static struct bench_pdu cbs;
+static GSList *submit_list;
+
+static void pdu_from_hex(struct bench_pdu *p, const char *hex, bool sms)
+{
+	p->pdu = l_util_from_hexstring(hex, &p->len);
+	p->tpdu_len = sms ? (int) p->len - p->pdu[0] - 1 : (int) p->len;
+}
+
+static unsigned int bench_decode_deliver(const void *data)
+{
+	const struct bench_pdu *p = data;
+	struct sms sms;
+
+	sms_decode(p->pdu, p->len, FALSE, p->tpdu_len, &sms);
+
+	return 1;
+}
+
+static unsigned int bench_encode_submit(const void *data)
+{
+	unsigned char pdu[176];
+	unsigned int ops = 0;
+	int tpdu_len;
+	int len;
+	GSList *l;
+
+	for (l = submit_list; l; l = l->next, ops++)
+		sms_encode(l->data, &len, &tpdu_len, pdu);
+
+	return ops;
+}
+
+static unsigned int bench_text_prepare(const void *data)
+{
+	GSList *list = sms_text_prepare(BENCH_TO, data, 42, FALSE, FALSE);
+
+	g_slist_free_full(list, g_free);
+
+	return 1;
+}
+
+static unsigned int bench_decode_text(const void *data)
+{
+	g_free(sms_decode_text(submit_list));
+
+	return 1;
+}
+
+static unsigned int bench_cbs_decode(const void *data)
+{
+	struct cbs out;
+
+	cbs_decode(cbs.pdu, cbs.len, &out);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	bench_init(&argc, &argv);
+
+	pdu_from_hex(&deliver_gsm7, simple_deliver, true);
+	pdu_from_hex(&deliver_ucs2, unicode_deliver, true);
+	pdu_from_hex(&cbs, cbs_page, false);
+
+	submit_list = sms_text_prepare(BENCH_TO, text_long, 42, FALSE, FALSE);
+	if (submit_list == NULL) {
+		fprintf(stderr, "Unable to prepare the long message\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_add("sms_decode/deliver-gsm7", bench_decode_deliver,
+							&deliver_gsm7);
+	bench_add("sms_decode/deliver-ucs2", bench_decode_deliver,
+							&deliver_ucs2);
+	bench_add("sms_encode/submit-concat", bench_encode_submit, NULL);
+	bench_add("sms_text_prepare/concat", bench_text_prepare, text_long);
+	bench_add("sms_decode_text/concat", bench_decode_text, NULL);
+	bench_add("cbs_decode", bench_cbs_decode, NULL);
+
+	bench_run();
+
+	g_slist_free_full(submit_list, g_free);
+	l_free(deliver_gsm7.pdu);
+	l_free(deliver_ucs2.pdu);
+	l_free(cbs.pdu);
+
+	return EXIT_SUCCESS;
+}
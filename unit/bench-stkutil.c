@@ -0,0 +1,88 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include <ofono/types.h>
+#include "smsutil.h"
+#include "stkutil.h"
+
+#include "stk-test-data.h"
+#include "bench.h"
+
+struct bench_command {
+	const unsigned char *pdu;
+	unsigned int len;
+};
+
+#define COMMAND(name) { name, sizeof(name) }
+
+static const struct bench_command display_text_short =
+						COMMAND(display_text_111);
+static const struct bench_command display_text_long =
+						COMMAND(display_text_161);
+static const struct bench_command get_inkey = COMMAND(get_inkey_111);
+static const struct bench_command play_tone = COMMAND(play_tone_612);
+static const struct bench_command poll_interval =
+						COMMAND(poll_interval_111);
+
+static unsigned int bench_command_parse(const void *data)
+{
+	const struct bench_command *c = data;
+	struct stk_command *command;
+
+	command = stk_command_new_from_pdu(c->pdu, c->len);
+	stk_command_free(command);
+
+	return 1;
+}
+
+static unsigned int bench_terminal_response(const void *data)
+{
+	struct stk_response response;
+	unsigned int len;
+
+	memset(&response, 0, sizeof(response));
+	response.number = 1;
+	response.type = STK_COMMAND_TYPE_DISPLAY_TEXT;
+	response.qualifier = 0x80;
+	response.src = STK_DEVICE_IDENTITY_TYPE_TERMINAL;
+	response.dst = STK_DEVICE_IDENTITY_TYPE_UICC;
+	response.result.type = STK_RESULT_TYPE_SUCCESS;
+
+	stk_pdu_from_response(&response, &len);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	bench_init(&argc, &argv);
+
+	bench_add("stk_command_new_from_pdu/display-text",
+				bench_command_parse, &display_text_short);
+	bench_add("stk_command_new_from_pdu/display-text-long",
+				bench_command_parse, &display_text_long);
+	bench_add("stk_command_new_from_pdu/get-inkey",
+				bench_command_parse, &get_inkey);
+	bench_add("stk_command_new_from_pdu/play-tone",
+				bench_command_parse, &play_tone);
+	bench_add("stk_command_new_from_pdu/poll-interval",
+				bench_command_parse, &poll_interval);
+	bench_add("stk_pdu_from_response/display-text",
+				bench_terminal_response, NULL);
+
+	return bench_run();
+}
@@ -0,0 +1,150 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "util.h"
+
+#include "bench.h"
+
+static const char text_gsm7[] =
+	"The quick brown fox jumps over the lazy dog while the band plays "
+	"on, and everyone at the station waits for the last train home.";
+
+static const char text_ucs2[] =
+	"Съешь же ещё этих мягких французских булок, да выпей чаю.";
+
+static const char text_turkish[] =
+	"Pijamalı hasta yağız şoföre çabucak güvendi.";
+
+static unsigned char gsm7[160];
+static long gsm7_len;
+static unsigned char packed[140];
+static long packed_len;
+
+static unsigned int bench_utf8_to_gsm(const void *data)
+{
+	const char *text = data;
+	unsigned char *gsm = convert_utf8_to_gsm(text, -1, NULL, NULL, 0);
+
+	l_free(gsm);
+
+	return 1;
+}
+
+static unsigned int bench_utf8_to_gsm_own_buf(const void *data)
+{
+	const char *text = data;
+	unsigned char buf[256];
+	long written;
+
+	convert_utf8_to_gsm_own_buf(text, -1, &written, GSM_DIALECT_DEFAULT,
+					GSM_DIALECT_DEFAULT, buf, sizeof(buf));
+
+	return 1;
+}
+
+static unsigned int bench_utf8_to_gsm_best_lang(const void *data)
+{
+	const char *text = data;
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	unsigned char *gsm;
+
+	gsm = convert_utf8_to_gsm_best_lang(text, -1, NULL, NULL, 0,
+						GSM_DIALECT_TURKISH,
+						&locking, &single);
+	l_free(gsm);
+
+	return 1;
+}
+
+static unsigned int bench_gsm_to_utf8(const void *data)
+{
+	char *utf8 = convert_gsm_to_utf8(gsm7, gsm7_len, NULL, NULL, 0);
+
+	l_free(utf8);
+
+	return 1;
+}
+
+static unsigned int bench_gsm_to_utf8_own_buf(const void *data)
+{
+	char buf[512];
+	long written;
+
+	convert_gsm_to_utf8_own_buf(gsm7, gsm7_len, &written,
+					GSM_DIALECT_DEFAULT,
+					GSM_DIALECT_DEFAULT, buf, sizeof(buf));
+
+	return 1;
+}
+
+static unsigned int bench_pack_7bit(const void *data)
+{
+	unsigned char buf[160];
+	long written;
+
+	pack_7bit_own_buf(gsm7, gsm7_len, 0, false, &written, 0, buf);
+
+	return 1;
+}
+
+static unsigned int bench_unpack_7bit(const void *data)
+{
+	unsigned char buf[160];
+	long written;
+
+	unpack_7bit_own_buf(packed, packed_len, 0, false, gsm7_len,
+				&written, 0, buf);
+
+	return 1;
+}
+
+static unsigned int bench_encode_hex(const void *data)
+{
+	char buf[sizeof(packed) * 2 + 1];
+
+	encode_hex_own_buf(packed, packed_len, 0, buf);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *gsm;
+
+	bench_init(&argc, &argv);
+
+	gsm = convert_utf8_to_gsm(text_gsm7, -1, NULL, &gsm7_len, 0);
+	memcpy(gsm7, gsm, gsm7_len);
+	l_free(gsm);
+
+	pack_7bit_own_buf(gsm7, gsm7_len, 0, false, &packed_len, 0, packed);
+
+	bench_add("utf8_to_gsm/gsm7", bench_utf8_to_gsm, text_gsm7);
+	bench_add("utf8_to_gsm/ucs2", bench_utf8_to_gsm, text_ucs2);
+	bench_add("utf8_to_gsm_own_buf/gsm7", bench_utf8_to_gsm_own_buf,
+							text_gsm7);
+	bench_add("utf8_to_gsm_best_lang/turkish",
+				bench_utf8_to_gsm_best_lang, text_turkish);
+	bench_add("gsm_to_utf8", bench_gsm_to_utf8, NULL);
+	bench_add("gsm_to_utf8_own_buf", bench_gsm_to_utf8_own_buf, NULL);
+	bench_add("pack_7bit_own_buf", bench_pack_7bit, NULL);
+	bench_add("unpack_7bit_own_buf", bench_unpack_7bit, NULL);
+	bench_add("encode_hex_own_buf", bench_encode_hex, NULL);
+
+	return bench_run();
+}
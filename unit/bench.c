@@ -0,0 +1,273 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <ell/ell.h>
+
+#include "bench.h"
+
+struct bench {
+	const char *name;
+	bench_func_t func;
+	const void *data;
+};
+
+static unsigned int option_warmup = 100;
+static unsigned int option_iterations = 1000;
+static const char *option_filter;
+static bool option_json;
+
+static struct l_queue *benches;
+static const char *prog;
+
+static unsigned long alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCS
+
+/*
+ * glibc provides the underlying allocator under these names.  The
+ * sanitizers bring their own, which must not be bypassed.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+bool bench_alloc_counted(void)
+{
+#ifdef COUNT_ALLOCS
+	return true;
+#else
+	return false;
+#endif
+}
+
+unsigned long bench_alloc_count(void)
+{
+	return alloc_count;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank on samples sorted in ascending order */
+static double percentile(const double *samples, unsigned int n,
+							unsigned int p)
+{
+	unsigned int rank = (n * p + 99) / 100;
+
+	return samples[rank ? rank - 1 : 0];
+}
+
+static void bench_one(const struct bench *b, double *samples)
+{
+	unsigned long allocs;
+	unsigned long ops = 0;
+	double total = 0;
+	unsigned int n = 0;
+	unsigned int i;
+
+	for (i = 0; i < option_warmup; i++)
+		b->func(b->data);
+
+	allocs = alloc_count;
+
+	for (i = 0; i < option_iterations; i++) {
+		uint64_t start = now_ns();
+		unsigned int done = b->func(b->data);
+		uint64_t elapsed = now_ns() - start;
+
+		if (!done)
+			continue;
+
+		samples[n] = (double) elapsed / done;
+		total += elapsed;
+		ops += done;
+		n += 1;
+	}
+
+	allocs = alloc_count - allocs;
+
+	if (!n)
+		return;
+
+	qsort(samples, n, sizeof(double), compare_double);
+
+	if (option_json) {
+		printf("{\"program\":\"%s\",\"name\":\"%s\","
+			"\"iterations\":%u,\"ops\":%lu,"
+			"\"mean_ns\":%.1f,\"min_ns\":%.1f,"
+			"\"p50_ns\":%.1f,\"p90_ns\":%.1f,"
+			"\"p99_ns\":%.1f,\"max_ns\":%.1f",
+			prog, b->name, n, ops, total / ops, samples[0],
+			percentile(samples, n, 50),
+			percentile(samples, n, 90),
+			percentile(samples, n, 99), samples[n - 1]);
+
+		if (bench_alloc_counted())
+			printf(",\"allocs_per_op\":%.2f",
+						(double) allocs / ops);
+
+		printf("}\n");
+		return;
+	}
+
+	printf("%-32s %10lu %10.1f %10.1f %10.1f %10.1f",
+		b->name, ops, total / ops, percentile(samples, n, 50),
+		percentile(samples, n, 90), percentile(samples, n, 99));
+
+	if (bench_alloc_counted())
+		printf(" %10.2f\n", (double) allocs / ops);
+	else
+		printf(" %10s\n", "-");
+}
+
+static void usage(void)
+{
+	printf("%s\nUsage:\n", prog);
+	printf("%s [options]\n", prog);
+	printf("Options:\n"
+		"\t-w, --warmup		Untimed iterations before measuring\n"
+		"\t-i, --iterations	Timed iterations\n"
+		"\t-b, --bench		Only run matching benchmarks\n"
+		"\t-j, --json		One JSON object per benchmark\n"
+		"\t-h, --help		Show help options\n");
+}
+
+static const struct option options[] = {
+	{ "warmup",	required_argument,	NULL, 'w' },
+	{ "iterations",	required_argument,	NULL, 'i' },
+	{ "bench",	required_argument,	NULL, 'b' },
+	{ "json",	no_argument,		NULL, 'j' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ },
+};
+
+void bench_init(int *argc, char ***argv)
+{
+	const char *slash = strrchr((*argv)[0], '/');
+
+	prog = slash ? slash + 1 : (*argv)[0];
+
+	for (;;) {
+		int opt = getopt_long(*argc, *argv, "w:i:b:jh", options, NULL);
+
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'w':
+			if (l_safe_atou32(optarg, &option_warmup) < 0) {
+				fprintf(stderr, "Invalid warmup\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'i':
+			if (l_safe_atou32(optarg, &option_iterations) < 0 ||
+					!option_iterations) {
+				fprintf(stderr, "Invalid iterations\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			option_filter = optarg;
+			break;
+		case 'j':
+			option_json = true;
+			break;
+		case 'h':
+			usage();
+			exit(EXIT_SUCCESS);
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	benches = l_queue_new();
+}
+
+void bench_add(const char *name, bench_func_t func, const void *data)
+{
+	struct bench *b;
+
+	if (option_filter && !strstr(name, option_filter))
+		return;
+
+	b = l_new(struct bench, 1);
+	b->name = name;
+	b->func = func;
+	b->data = data;
+
+	l_queue_push_tail(benches, b);
+}
+
+int bench_run(void)
+{
+	double *samples = l_new(double, option_iterations);
+	const struct l_queue_entry *entry;
+
+	if (!option_json)
+		printf("%-32s %10s %10s %10s %10s %10s %10s\n", "Operation",
+			"Count", "mean ns", "p50 ns", "p90 ns", "p99 ns",
+			"allocs/op");
+
+	for (entry = l_queue_get_entries(benches); entry;
+						entry = entry->next)
+		bench_one(entry->data, samples);
+
+	l_free(samples);
+	l_queue_destroy(benches, l_free);
+	benches = NULL;
+
+	return EXIT_SUCCESS;
+}
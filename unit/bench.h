@@ -0,0 +1,29 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Micro-benchmark harness.  Each benchmark function is one iteration and
+ * returns the number of operations it did, figures are per operation.
+ * Iterations are timed one by one after a warm-up, and reported as mean,
+ * percentiles and allocations, as a table or as one JSON object per line
+ * with --json.
+ */
+#include <stdbool.h>
+
+typedef unsigned int (*bench_func_t)(const void *data);
+
+void bench_init(int *argc, char ***argv);
+void bench_add(const char *name, bench_func_t func, const void *data);
+int bench_run(void);
+
+/*
+ * Number of malloc, calloc and realloc calls so far, which l_malloc and
+ * g_malloc end up in, for any program linking the harness.  Counting
+ * needs glibc and is left out under AddressSanitizer, in which case
+ * bench_alloc_counted() is false and the count stays 0.
+ */
+bool bench_alloc_counted(void);
+unsigned long bench_alloc_count(void);
@@ -0,0 +1,1269 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <ell/ell.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+
+#include "qmi-replay.h"
+
+#define QMUX_HDR_SIZE		6
+#define CONTROL_HDR_SIZE	2
+#define SERVICE_HDR_SIZE	3
+#define MESSAGE_HDR_SIZE	4
+#define TLV_HDR_SIZE		3
+
+/* qmi_qmux_device reads at most this much at once */
+#define MAX_FRAME		2048
+#define MAX_TLVS		(MAX_FRAME - QMUX_HDR_SIZE - SERVICE_HDR_SIZE - \
+					MESSAGE_HDR_SIZE)
+#define MAX_CHUNK		4096
+
+#define SERVICE_REQUEST		0x00
+#define SERVICE_RESPONSE	0x02
+#define SERVICE_INDICATION	0x04
+#define CONTROL_RESPONSE	0x01
+
+/* Indications written but not yet delivered */
+#define INDICATION_RING		256
+
+#define ITERATE_TIMEOUT_MS	10
+#define STALL_TIMEOUT_NS	1000000000ULL
+
+/* The TLV types a typical driver parser looks at */
+#define DECODE_FIRST_TLV	0x01
+#define DECODE_LAST_TLV		0x2f
+
+#define FUZZ_MESSAGE		0x5555
+#define FUZZ_INDICATION		0x0001
+#define FUZZ_WINDOW		4
+
+struct replay_msg {
+	bool out;			/* Written by the host */
+	uint8_t service;
+	uint8_t client;
+	uint8_t type;
+	uint16_t message;
+	uint16_t length;
+	uint8_t data[];			/* TLVs */
+};
+
+struct replay_result {
+	unsigned int count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct replay_service {
+	struct qmi_replay *replay;
+	uint8_t type;
+	struct l_uintset *indications;	/* Message ids to register for */
+	struct qmi_service *service;
+	uint8_t client;
+	struct replay_result response;
+	struct replay_result indication;
+};
+
+struct replay_request {
+	struct replay_service *rs;
+	uint64_t start_ns;
+	struct replay_request *next;
+};
+
+struct qmi_replay {
+	struct l_queue *msgs;
+	struct replay_service *services[256];
+
+	/* Run state */
+	struct qmi_replay_stats *stats;
+	struct qmi_qmux_device *qmux;
+	struct l_io *io;			/* Modem end of the socketpair */
+	struct l_queue *backlog;		/* Frames the socket didn't take */
+	struct l_hashmap *responses;		/* Recorded, by service/msg */
+	struct replay_request *requests;
+	struct replay_request *free_requests;
+	unsigned int outstanding;
+	unsigned int clients_pending;
+	uint64_t indication_sent[INDICATION_RING];
+	unsigned int indication_head;
+	unsigned int indication_tail;
+	unsigned int progress;
+	uint8_t next_client;
+	const uint8_t *fuzz_payload;
+	uint16_t fuzz_length;
+	bool ready : 1;
+	bool failed : 1;
+	bool fuzzing : 1;
+};
+
+static const struct {
+	const char *name;
+	uint8_t type;
+} service_names[] = {
+	{ "WDS",	QMI_SERVICE_WDS		},
+	{ "DMS",	QMI_SERVICE_DMS		},
+	{ "NAS",	QMI_SERVICE_NAS		},
+	{ "QOS",	QMI_SERVICE_QOS		},
+	{ "WMS",	QMI_SERVICE_WMS		},
+	{ "PDS",	QMI_SERVICE_PDS		},
+	{ "AUTH",	QMI_SERVICE_AUTH	},
+	{ "AT",		QMI_SERVICE_AT		},
+	{ "VOICE",	QMI_SERVICE_VOICE	},
+	{ "CAT",	QMI_SERVICE_CAT		},
+	{ "UIM",	QMI_SERVICE_UIM		},
+	{ "PBM",	QMI_SERVICE_PBM		},
+	{ "LOC",	QMI_SERVICE_LOC		},
+	{ "WDA",	QMI_SERVICE_WDA		},
+	{ "PDC",	QMI_SERVICE_PDC		},
+	{ "DSD",	QMI_SERVICE_DSD		},
+	{ }
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	if (clock_gettime(clock, &ts) < 0)
+		return 0;
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int service_from_name(const char *name, size_t len)
+{
+	unsigned int i;
+	char *end;
+	unsigned long type;
+
+	for (i = 0; service_names[i].name; i++) {
+		if (strlen(service_names[i].name) == len &&
+				!strncmp(name, service_names[i].name, len))
+			return service_names[i].type;
+	}
+
+	type = strtoul(name, &end, 10);
+	if (end != name + len || !len || type > 0xff)
+		return -1;
+
+	return type;
+}
+
+static void service_to_name(uint8_t type, char *buf, size_t size)
+{
+	unsigned int i;
+
+	for (i = 0; service_names[i].name; i++) {
+		if (service_names[i].type == type) {
+			l_strlcpy(buf, service_names[i].name, size);
+			return;
+		}
+	}
+
+	snprintf(buf, size, "%u", type);
+}
+
+static struct replay_service *replay_get_service(struct qmi_replay *replay,
+							uint8_t type)
+{
+	struct replay_service *rs = replay->services[type];
+
+	if (rs)
+		return rs;
+
+	rs = l_new(struct replay_service, 1);
+	rs->replay = replay;
+	rs->type = type;
+	rs->indications = l_uintset_new(0xffff);
+	replay->services[type] = rs;
+
+	return rs;
+}
+
+struct qmi_replay *qmi_replay_new(void)
+{
+	struct qmi_replay *replay = l_new(struct qmi_replay, 1);
+
+	replay->msgs = l_queue_new();
+
+	return replay;
+}
+
+void qmi_replay_free(struct qmi_replay *replay)
+{
+	unsigned int i;
+
+	if (!replay)
+		return;
+
+	for (i = 0; i < L_ARRAY_SIZE(replay->services); i++) {
+		struct replay_service *rs = replay->services[i];
+
+		if (!rs)
+			continue;
+
+		l_uintset_free(rs->indications);
+		l_free(rs);
+	}
+
+	l_queue_destroy(replay->msgs, l_free);
+	l_free(replay);
+}
+
+static void replay_add_msg(struct qmi_replay *replay, bool out,
+				uint8_t service, uint8_t client,
+				uint8_t type, const uint8_t *msg, size_t len)
+{
+	struct replay_msg *rec;
+	uint16_t length;
+
+	if (len < MESSAGE_HDR_SIZE)
+		return;
+
+	length = l_get_le16(msg + 2);
+	if (length > len - MESSAGE_HDR_SIZE || length > MAX_TLVS)
+		return;
+
+	/* Only keep what the replay can reproduce */
+	if (out != (type == SERVICE_REQUEST))
+		return;
+
+	if (!out && type != SERVICE_RESPONSE && type != SERVICE_INDICATION)
+		return;
+
+	rec = l_malloc(sizeof(struct replay_msg) + length);
+	rec->out = out;
+	rec->service = service;
+	rec->client = client;
+	rec->type = type;
+	rec->message = l_get_le16(msg);
+	rec->length = length;
+	memcpy(rec->data, msg + MESSAGE_HDR_SIZE, length);
+	l_queue_push_tail(replay->msgs, rec);
+
+	replay_get_service(replay, service);
+
+	if (type == SERVICE_INDICATION)
+		l_uintset_put(replay->services[service]->indications,
+								rec->message);
+}
+
+/* A read may hold several QMUX frames, a write always holds one */
+static unsigned int replay_add_qmux(struct qmi_replay *replay, bool out,
+					const uint8_t *buf, size_t len)
+{
+	unsigned int count = 0;
+
+	while (len >= QMUX_HDR_SIZE) {
+		size_t frame_len = l_get_le16(buf + 1) + 1;
+		const uint8_t *srv = buf + QMUX_HDR_SIZE;
+
+		if (buf[0] != 0x01 || frame_len > len ||
+				frame_len < QMUX_HDR_SIZE + SERVICE_HDR_SIZE)
+			break;
+
+		/* Control messages are answered by the replay itself */
+		if (buf[4] != QMI_SERVICE_CONTROL) {
+			unsigned int before = l_queue_length(replay->msgs);
+
+			replay_add_msg(replay, out, buf[4], buf[5], srv[0],
+					srv + SERVICE_HDR_SIZE,
+					frame_len - QMUX_HDR_SIZE -
+					SERVICE_HDR_SIZE);
+			count += l_queue_length(replay->msgs) - before;
+		}
+
+		buf += frame_len;
+		len -= frame_len;
+	}
+
+	return count;
+}
+
+static unsigned int replay_add_chunk(struct qmi_replay *replay, bool out,
+					const uint8_t *buf, size_t len,
+					int service)
+{
+	unsigned int before;
+
+	if (!len)
+		return 0;
+
+	if (buf[0] == 0x01)
+		return replay_add_qmux(replay, out, buf, len);
+
+	/* QRTR messages start with the service header */
+	if (service <= QMI_SERVICE_CONTROL || len < SERVICE_HDR_SIZE)
+		return 0;
+
+	before = l_queue_length(replay->msgs);
+	replay_add_msg(replay, out, service, 0, buf[0],
+			buf + SERVICE_HDR_SIZE, len - SERVICE_HDR_SIZE);
+
+	return l_queue_length(replay->msgs) - before;
+}
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static bool is_hexdump(const char *s)
+{
+	if (s[0] != '<' && s[0] != '>' && s[0] != ' ')
+		return false;
+
+	return s[1] == ' ' && hex_value(s[2]) >= 0 && hex_value(s[3]) >= 0 &&
+			(s[4] == ' ' || s[4] == '\0');
+}
+
+/* The "<   NAS_ind msg=..." summary logged after each message */
+static int summary_service(const char *s)
+{
+	const char *name;
+
+	if (s[0] != '<' && s[0] != '>' && s[0] != ' ')
+		return -1;
+
+	if (strncmp(s + 1, "   ", 3) || !l_ascii_isalnum(s[4]))
+		return -1;
+
+	name = s + 4;
+
+	return service_from_name(name, strcspn(name, "_ "));
+}
+
+unsigned int qmi_replay_parse(struct qmi_replay *replay, const char *capture)
+{
+	_auto_(l_strv_free) char **lines = l_strsplit(capture, '\n');
+	_auto_(l_free) uint8_t *chunk = l_malloc(MAX_CHUNK);
+	size_t chunk_len = 0;
+	bool chunk_out = false;
+	bool overflow = false;
+	unsigned int count = 0;
+	char **line;
+
+	for (line = lines; *line; line++) {
+		const char *s = strstr(*line, "QMI: ");
+		int service;
+
+		if (s)
+			s += 5;
+		else if ((s = strstr(*line, "QRTR: ")))
+			s += 6;
+		else
+			s = *line;
+
+		if (!is_hexdump(s)) {
+			service = summary_service(s);
+			if (service < 0)
+				continue;
+
+			if (!overflow)
+				count += replay_add_chunk(replay, chunk_out,
+							chunk, chunk_len,
+							service);
+
+			chunk_len = 0;
+			continue;
+		}
+
+		/* A new hexdump, whatever came before had no summary */
+		if (s[0] != ' ') {
+			if (!overflow)
+				count += replay_add_chunk(replay, chunk_out,
+							chunk, chunk_len, -1);
+
+			chunk_len = 0;
+			chunk_out = s[0] == '>';
+			overflow = false;
+		}
+
+		/* Up to 16 " xx" groups, then two blanks and the ASCII */
+		for (s += 1; s[0] == ' ' && hex_value(s[1]) >= 0 &&
+					hex_value(s[2]) >= 0; s += 3) {
+			if (chunk_len == MAX_CHUNK) {
+				overflow = true;
+				break;
+			}
+
+			chunk[chunk_len++] = hex_value(s[1]) << 4 |
+						hex_value(s[2]);
+		}
+	}
+
+	if (!overflow)
+		count += replay_add_chunk(replay, chunk_out, chunk, chunk_len,
+						-1);
+
+	return count;
+}
+
+unsigned int qmi_replay_load(struct qmi_replay *replay, const char *path)
+{
+	size_t len;
+	char *contents = l_file_get_contents(path, &len);
+	unsigned int count;
+
+	if (!contents)
+		return 0;
+
+	/* The contents are not NUL terminated */
+	contents = l_realloc(contents, len + 1);
+	contents[len] = '\0';
+
+	count = qmi_replay_parse(replay, contents);
+	l_free(contents);
+
+	return count;
+}
+
+struct backlog_frame {
+	size_t len;
+	uint8_t data[];
+};
+
+static bool modem_write_ready(struct l_io *io, void *user_data)
+{
+	struct qmi_replay *replay = user_data;
+	int fd = l_io_get_fd(io);
+	struct backlog_frame *frame;
+
+	while ((frame = l_queue_peek_head(replay->backlog))) {
+		if (write(fd, frame->data, frame->len) < 0) {
+			if (errno == EAGAIN || errno == ENOBUFS)
+				return true;
+
+			replay->failed = true;
+			return false;
+		}
+
+		replay->stats->bytes += frame->len;
+		l_free(l_queue_pop_head(replay->backlog));
+	}
+
+	return false;
+}
+
+/* Each write is one read on the other end, just like a cdc-wdm device */
+static void modem_write(struct qmi_replay *replay, const void *data,
+								size_t len)
+{
+	struct backlog_frame *frame;
+
+	if (l_queue_isempty(replay->backlog)) {
+		if (write(l_io_get_fd(replay->io), data, len) >= 0) {
+			replay->stats->bytes += len;
+			return;
+		}
+
+		if (errno != EAGAIN && errno != ENOBUFS) {
+			replay->failed = true;
+			return;
+		}
+
+		l_io_set_write_handler(replay->io, modem_write_ready,
+					replay, NULL);
+	}
+
+	frame = l_malloc(sizeof(struct backlog_frame) + len);
+	frame->len = len;
+	memcpy(frame->data, data, len);
+	l_queue_push_tail(replay->backlog, frame);
+}
+
+static void modem_send(struct qmi_replay *replay, uint8_t service,
+			uint8_t client, uint8_t type, uint16_t tid,
+			uint16_t message, const void *tlvs, uint16_t length)
+{
+	uint8_t frame[MAX_FRAME];
+	size_t hdr = QMUX_HDR_SIZE;
+
+	if (length > MAX_TLVS)
+		length = MAX_TLVS;
+
+	frame[0] = 0x01;
+	frame[3] = 0x80;
+	frame[4] = service;
+	frame[5] = client;
+	frame[6] = type;
+
+	if (service == QMI_SERVICE_CONTROL) {
+		frame[7] = tid;
+		hdr += CONTROL_HDR_SIZE;
+	} else {
+		l_put_le16(tid, frame + 7);
+		hdr += SERVICE_HDR_SIZE;
+	}
+
+	l_put_le16(message, frame + hdr);
+	l_put_le16(length, frame + hdr + 2);
+	memcpy(frame + hdr + MESSAGE_HDR_SIZE, tlvs, length);
+	l_put_le16(hdr + MESSAGE_HDR_SIZE + length - 1, frame + 1);
+
+	modem_write(replay, frame, hdr + MESSAGE_HDR_SIZE + length);
+}
+
+static size_t put_result_code(uint8_t *buf)
+{
+	buf[0] = 0x02;
+	l_put_le16(QMI_RESULT_CODE_SIZE, buf + 1);
+	memset(buf + TLV_HDR_SIZE, 0, QMI_RESULT_CODE_SIZE);
+
+	return TLV_HDR_SIZE + QMI_RESULT_CODE_SIZE;
+}
+
+static void modem_control(struct qmi_replay *replay, const uint8_t *buf,
+								size_t len)
+{
+	uint8_t tlvs[TLV_HDR_SIZE + QMI_RESULT_CODE_SIZE + TLV_HDR_SIZE +
+			QMI_SERVICE_LIST_SIZE + 256 * 5];
+	const uint8_t *req;
+	uint16_t message;
+	uint16_t length;
+	size_t n;
+	unsigned int i;
+
+	if (len < CONTROL_HDR_SIZE + MESSAGE_HDR_SIZE || buf[0] != 0x00)
+		return;
+
+	message = l_get_le16(buf + CONTROL_HDR_SIZE);
+	length = l_get_le16(buf + CONTROL_HDR_SIZE + 2);
+	req = buf + CONTROL_HDR_SIZE + MESSAGE_HDR_SIZE;
+
+	if (length > len - CONTROL_HDR_SIZE - MESSAGE_HDR_SIZE)
+		return;
+
+	n = put_result_code(tlvs);
+
+	switch (message) {
+	case QMI_CTL_GET_VERSION_INFO:
+	{
+		uint8_t *list = tlvs + n;
+		uint8_t count = 0;
+
+		/* Control 1.4, so no SYNC is sent */
+		list[TLV_HDR_SIZE + 1] = QMI_SERVICE_CONTROL;
+		l_put_le16(1, list + TLV_HDR_SIZE + 2);
+		l_put_le16(4, list + TLV_HDR_SIZE + 4);
+		count += 1;
+
+		for (i = 1; i < L_ARRAY_SIZE(replay->services); i++) {
+			uint8_t *entry = list + TLV_HDR_SIZE + 1 + count * 5;
+
+			if (!replay->services[i] || count == 255)
+				continue;
+
+			entry[0] = i;
+			l_put_le16(1, entry + 1);
+			l_put_le16(0, entry + 3);
+			count += 1;
+		}
+
+		list[0] = 0x01;
+		l_put_le16(1 + count * 5, list + 1);
+		list[TLV_HDR_SIZE] = count;
+		n += TLV_HDR_SIZE + 1 + count * 5;
+		break;
+	}
+	case QMI_CTL_GET_CLIENT_ID:
+	{
+		struct replay_service *rs;
+
+		if (length < TLV_HDR_SIZE + 1 || req[0] != 0x01)
+			goto send;
+
+		rs = replay->services[req[TLV_HDR_SIZE]];
+		if (!rs)
+			goto send;
+
+		rs->client = replay->next_client++;
+
+		tlvs[n] = 0x01;
+		l_put_le16(QMI_CLIENT_ID_SIZE, tlvs + n + 1);
+		tlvs[n + TLV_HDR_SIZE] = rs->type;
+		tlvs[n + TLV_HDR_SIZE + 1] = rs->client;
+		n += TLV_HDR_SIZE + QMI_CLIENT_ID_SIZE;
+		break;
+	}
+	default:
+		break;
+	}
+
+send:
+	modem_send(replay, QMI_SERVICE_CONTROL, 0, CONTROL_RESPONSE, buf[1],
+			message, tlvs, n);
+}
+
+static void modem_service(struct qmi_replay *replay, uint8_t service,
+				uint8_t client, const uint8_t *buf, size_t len)
+{
+	uint8_t tlvs[TLV_HDR_SIZE + QMI_RESULT_CODE_SIZE];
+	struct l_queue *queue;
+	const struct replay_msg *rec;
+	uint16_t tid;
+	uint16_t message;
+
+	if (len < SERVICE_HDR_SIZE + MESSAGE_HDR_SIZE ||
+			buf[0] != SERVICE_REQUEST)
+		return;
+
+	tid = l_get_le16(buf + 1);
+	message = l_get_le16(buf + SERVICE_HDR_SIZE);
+
+	if (replay->fuzz_payload && message == FUZZ_MESSAGE) {
+		modem_send(replay, service, client, SERVICE_RESPONSE, tid,
+				message, replay->fuzz_payload,
+				replay->fuzz_length);
+		return;
+	}
+
+	queue = l_hashmap_lookup(replay->responses,
+					L_UINT_TO_PTR(service << 16 | message));
+	rec = l_queue_pop_head(queue);
+
+	if (rec) {
+		modem_send(replay, service, client, SERVICE_RESPONSE, tid,
+				message, rec->data, rec->length);
+		return;
+	}
+
+	/* The capture ended or was cut before the response */
+	replay->stats->synthesized += 1;
+	modem_send(replay, service, client, SERVICE_RESPONSE, tid, message,
+			tlvs, put_result_code(tlvs));
+}
+
+static bool modem_received(struct l_io *io, void *user_data)
+{
+	struct qmi_replay *replay = user_data;
+	uint8_t buf[MAX_FRAME];
+	ssize_t bytes_read;
+
+	while ((bytes_read = read(l_io_get_fd(io), buf, sizeof(buf))) > 0) {
+		const uint8_t *frame = buf;
+		size_t len = bytes_read;
+
+		while (len >= QMUX_HDR_SIZE) {
+			size_t frame_len = l_get_le16(frame + 1) + 1;
+
+			if (frame[0] != 0x01 || frame_len > len ||
+					frame_len < QMUX_HDR_SIZE)
+				break;
+
+			if (frame[4] == QMI_SERVICE_CONTROL)
+				modem_control(replay, frame + QMUX_HDR_SIZE,
+						frame_len - QMUX_HDR_SIZE);
+			else
+				modem_service(replay, frame[4], frame[5],
+						frame + QMUX_HDR_SIZE,
+						frame_len - QMUX_HDR_SIZE);
+
+			frame += frame_len;
+			len -= frame_len;
+		}
+	}
+
+	return true;
+}
+
+static void replay_account(struct replay_result *result, uint64_t latency)
+{
+	result->count += 1;
+	result->total_ns += latency;
+
+	if (latency > result->max_ns)
+		result->max_ns = latency;
+}
+
+struct decode_values {
+	uint8_t u8;
+	int16_t i16;
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+};
+
+static void decode_all(struct qmi_result *result)
+{
+	static const struct qmi_result_field fields[] = {
+		{ 0x01, QMI_RESULT_FIELD_UINT8,
+			offsetof(struct decode_values, u8) },
+		{ 0x10, QMI_RESULT_FIELD_INT16,
+			offsetof(struct decode_values, i16) },
+		{ 0x11, QMI_RESULT_FIELD_UINT16,
+			offsetof(struct decode_values, u16) },
+		{ 0x12, QMI_RESULT_FIELD_UINT32,
+			offsetof(struct decode_values, u32) },
+		{ 0x13, QMI_RESULT_FIELD_UINT64,
+			offsetof(struct decode_values, u64) },
+	};
+	struct decode_values values;
+	unsigned int type;
+	uint16_t len;
+
+	qmi_result_get_error(result);
+	qmi_result_print_tlvs(result);
+	qmi_result_get_fields(result, fields, L_ARRAY_SIZE(fields), &values);
+
+	for (type = 0; type <= 0xff; type++) {
+		char *str;
+
+		qmi_result_get(result, type, &len);
+		qmi_result_get_uint8(result, type, &values.u8);
+		qmi_result_get_int16(result, type, &values.i16);
+		qmi_result_get_uint16(result, type, &values.u16);
+		qmi_result_get_uint32(result, type, &values.u32);
+		qmi_result_get_uint64(result, type, &values.u64);
+
+		str = qmi_result_get_string(result, type);
+		l_free(str);
+	}
+}
+
+static void decode_result(struct qmi_replay *replay,
+					struct qmi_result *result)
+{
+	unsigned int type;
+	uint16_t error;
+	uint16_t len;
+
+	qmi_result_set_error(result, &error);
+
+	if (replay->fuzzing) {
+		decode_all(result);
+		return;
+	}
+
+	for (type = DECODE_FIRST_TLV; type <= DECODE_LAST_TLV; type++)
+		qmi_result_get(result, type, &len);
+}
+
+static void replay_response(struct qmi_result *result, void *user_data)
+{
+	struct replay_request *req = user_data;
+	struct replay_service *rs = req->rs;
+	struct qmi_replay *replay = rs->replay;
+	uint64_t latency;
+
+	decode_result(replay, result);
+	latency = clock_ns(CLOCK_MONOTONIC) - req->start_ns;
+
+	replay_account(&rs->response, latency);
+	replay->stats->responses += 1;
+	replay->stats->response_ns += latency;
+	replay->outstanding -= 1;
+	replay->progress += 1;
+
+	req->next = replay->free_requests;
+	replay->free_requests = req;
+}
+
+static void replay_indication(struct qmi_result *result, void *user_data)
+{
+	struct replay_service *rs = user_data;
+	struct qmi_replay *replay = rs->replay;
+	uint64_t latency;
+
+	decode_result(replay, result);
+
+	/* Fuzz input may carry indications of its own */
+	if (replay->indication_head == replay->indication_tail)
+		return;
+
+	latency = clock_ns(CLOCK_MONOTONIC) -
+		replay->indication_sent[replay->indication_head++ %
+							INDICATION_RING];
+
+	replay_account(&rs->indication, latency);
+	replay->stats->indications += 1;
+	replay->stats->indication_ns += latency;
+	replay->progress += 1;
+}
+
+static void register_indication(uint32_t message, void *user_data)
+{
+	struct replay_service *rs = user_data;
+
+	qmi_service_register(rs->service, message, replay_indication,
+				rs, NULL);
+}
+
+static void replay_client_created(struct qmi_service *service,
+							void *user_data)
+{
+	struct replay_service *rs = user_data;
+	struct qmi_replay *replay = rs->replay;
+
+	rs->service = service;
+
+	if (service)
+		l_uintset_foreach(rs->indications, register_indication, rs);
+
+	replay->progress += 1;
+
+	if (--replay->clients_pending == 0)
+		replay->ready = true;
+}
+
+static void replay_discovered(void *user_data)
+{
+	struct qmi_replay *replay = user_data;
+	unsigned int i;
+
+	replay->progress += 1;
+
+	for (i = 1; i < L_ARRAY_SIZE(replay->services); i++) {
+		struct replay_service *rs = replay->services[i];
+
+		if (!rs)
+			continue;
+
+		if (qmi_qmux_device_create_client(replay->qmux, i,
+						replay_client_created, rs,
+						NULL))
+			replay->clients_pending += 1;
+	}
+
+	if (!replay->clients_pending)
+		replay->ready = true;
+}
+
+static bool replay_ready(struct qmi_replay *replay)
+{
+	return replay->ready;
+}
+
+static bool replay_settled(struct qmi_replay *replay)
+{
+	return !replay->outstanding &&
+		replay->indication_head == replay->indication_tail &&
+		l_queue_isempty(replay->backlog);
+}
+
+/* Runs the main loop until done returns true or nothing moves anymore */
+static bool replay_wait(struct qmi_replay *replay,
+				bool (*done)(struct qmi_replay *replay))
+{
+	uint64_t deadline = clock_ns(CLOCK_MONOTONIC) + STALL_TIMEOUT_NS;
+	unsigned int progress = replay->progress;
+
+	while (!done(replay)) {
+		if (replay->failed)
+			return false;
+
+		l_main_iterate(ITERATE_TIMEOUT_MS);
+
+		if (replay->progress != progress) {
+			progress = replay->progress;
+			deadline = clock_ns(CLOCK_MONOTONIC) +
+							STALL_TIMEOUT_NS;
+		} else if (clock_ns(CLOCK_MONOTONIC) > deadline)
+			return false;
+	}
+
+	return !replay->failed;
+}
+
+static void response_queue_free(void *data)
+{
+	/* The records belong to the capture */
+	l_queue_destroy(data, NULL);
+}
+
+static void replay_stop(struct qmi_replay *replay)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(replay->services); i++) {
+		struct replay_service *rs = replay->services[i];
+
+		if (!rs)
+			continue;
+
+		qmi_service_free(rs->service);
+		rs->service = NULL;
+	}
+
+	qmi_qmux_device_free(replay->qmux);
+	replay->qmux = NULL;
+
+	l_io_destroy(replay->io);
+	replay->io = NULL;
+
+	l_queue_destroy(replay->backlog, l_free);
+	replay->backlog = NULL;
+
+	l_free(replay->requests);
+	replay->requests = NULL;
+	replay->free_requests = NULL;
+
+	l_hashmap_destroy(replay->responses, response_queue_free);
+	replay->responses = NULL;
+	replay->stats = NULL;
+}
+
+static void fuzz_debug(const char *str, void *user_data)
+{
+}
+
+static bool replay_start(struct qmi_replay *replay, unsigned int window,
+				struct qmi_replay_stats *stats)
+{
+	const struct l_queue_entry *entry;
+	unsigned int i;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK,
+								0, sv) < 0)
+		return false;
+
+	replay->qmux = qmi_qmux_device_new_from_fd(sv[0]);
+	if (!replay->qmux) {
+		close(sv[1]);
+		return false;
+	}
+
+	/* The debug output walks the TLVs as well */
+	if (replay->fuzzing)
+		qmi_qmux_device_set_debug(replay->qmux, fuzz_debug, NULL);
+
+	memset(stats, 0, sizeof(*stats));
+	replay->stats = stats;
+
+	replay->io = l_io_new(sv[1]);
+	l_io_set_close_on_destroy(replay->io, true);
+	l_io_set_read_handler(replay->io, modem_received, replay, NULL);
+
+	replay->backlog = l_queue_new();
+	replay->responses = l_hashmap_new();
+
+	for (entry = l_queue_get_entries(replay->msgs); entry;
+						entry = entry->next) {
+		struct replay_msg *rec = entry->data;
+		void *key = L_UINT_TO_PTR(rec->service << 16 | rec->message);
+		struct l_queue *queue;
+
+		if (rec->type != SERVICE_RESPONSE)
+			continue;
+
+		queue = l_hashmap_lookup(replay->responses, key);
+		if (!queue) {
+			queue = l_queue_new();
+			l_hashmap_insert(replay->responses, key, queue);
+		}
+
+		l_queue_push_tail(queue, rec);
+	}
+
+	replay->requests = l_new(struct replay_request, window);
+	replay->free_requests = NULL;
+
+	for (i = 0; i < window; i++) {
+		replay->requests[i].next = replay->free_requests;
+		replay->free_requests = &replay->requests[i];
+	}
+
+	replay->outstanding = 0;
+	replay->clients_pending = 0;
+	replay->indication_head = 0;
+	replay->indication_tail = 0;
+	replay->next_client = 1;
+	replay->ready = false;
+	replay->failed = false;
+
+	if (qmi_qmux_device_discover(replay->qmux, replay_discovered,
+					replay, NULL) < 0)
+		return false;
+
+	return replay_wait(replay, replay_ready);
+}
+
+static bool replay_send(struct qmi_replay *replay, struct replay_service *rs,
+				uint16_t message, const uint8_t *tlvs,
+				uint16_t length)
+{
+	struct replay_request *req = replay->free_requests;
+	struct qmi_param *param = qmi_param_new();
+
+	while (length >= TLV_HDR_SIZE) {
+		uint16_t tlv_len = l_get_le16(tlvs + 1);
+
+		if (tlv_len > length - TLV_HDR_SIZE)
+			break;
+
+		qmi_param_append(param, tlvs[0], tlv_len, tlvs + TLV_HDR_SIZE);
+		tlvs += TLV_HDR_SIZE + tlv_len;
+		length -= TLV_HDR_SIZE + tlv_len;
+	}
+
+	req->rs = rs;
+	req->start_ns = clock_ns(CLOCK_MONOTONIC);
+
+	if (!qmi_service_send(rs->service, message, param,
+				replay_response, req, NULL)) {
+		qmi_param_free(param);
+		replay->failed = true;
+		return false;
+	}
+
+	replay->free_requests = req->next;
+	replay->outstanding += 1;
+	replay->stats->requests += 1;
+
+	return true;
+}
+
+static bool replay_indicate(struct qmi_replay *replay,
+				struct replay_service *rs, uint8_t client,
+				uint16_t message, const uint8_t *tlvs,
+				uint16_t length)
+{
+	if (replay->indication_tail - replay->indication_head ==
+							INDICATION_RING)
+		return false;
+
+	/* Broadcasts stay broadcasts, the rest go to our client */
+	if (client != 0xff)
+		client = rs->client;
+
+	replay->indication_sent[replay->indication_tail++ % INDICATION_RING] =
+						clock_ns(CLOCK_MONOTONIC);
+	modem_send(replay, rs->type, client, SERVICE_INDICATION, 0,
+			message, tlvs, length);
+
+	return true;
+}
+
+/* Feeds the capture as far as the window allows, false once it stalls */
+static bool replay_pump(struct qmi_replay *replay)
+{
+	const struct l_queue_entry *entry = l_queue_get_entries(replay->msgs);
+	uint64_t deadline = clock_ns(CLOCK_MONOTONIC) + STALL_TIMEOUT_NS;
+	unsigned int progress = replay->progress;
+
+	while (entry || !replay_settled(replay)) {
+		while (entry) {
+			const struct replay_msg *rec = entry->data;
+			struct replay_service *rs =
+				replay->services[rec->service];
+
+			if (rec->type == SERVICE_RESPONSE || !rs->service) {
+				entry = entry->next;
+				continue;
+			}
+
+			if (rec->type == SERVICE_REQUEST) {
+				if (!replay->free_requests)
+					break;
+
+				if (!replay_send(replay, rs, rec->message,
+						rec->data, rec->length))
+					return false;
+			} else if (!replay_indicate(replay, rs, rec->client,
+							rec->message,
+							rec->data,
+							rec->length))
+				break;
+
+			entry = entry->next;
+		}
+
+		if (replay->failed)
+			return false;
+
+		l_main_iterate(entry ? 0 : ITERATE_TIMEOUT_MS);
+
+		if (replay->progress != progress) {
+			progress = replay->progress;
+			deadline = clock_ns(CLOCK_MONOTONIC) +
+							STALL_TIMEOUT_NS;
+		} else if (clock_ns(CLOCK_MONOTONIC) > deadline)
+			return false;
+	}
+
+	return true;
+}
+
+bool qmi_replay_run(struct qmi_replay *replay, unsigned int window,
+			struct qmi_replay_stats *stats)
+{
+	uint64_t start;
+	uint64_t start_cpu;
+	bool ret = false;
+
+	if (!replay || !stats)
+		return false;
+
+	if (!window)
+		window = 1;
+
+	replay->fuzzing = false;
+
+	if (!replay_start(replay, window, stats))
+		goto done;
+
+	start = clock_ns(CLOCK_MONOTONIC);
+	start_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+	ret = replay_pump(replay);
+
+	stats->cpu = (clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu) / 1e9;
+	stats->elapsed = (clock_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+done:
+	replay_stop(replay);
+
+	return ret;
+}
+
+void qmi_replay_foreach_result(struct qmi_replay *replay,
+				qmi_replay_result_func_t func, void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(replay->services); i++) {
+		struct replay_service *rs = replay->services[i];
+		char service[16];
+		char name[32];
+
+		if (!rs)
+			continue;
+
+		service_to_name(i, service, sizeof(service));
+
+		snprintf(name, sizeof(name), "%s response", service);
+		func(name, rs->response.count, rs->response.total_ns,
+			rs->response.max_ns, user_data);
+
+		snprintf(name, sizeof(name), "%s indication", service);
+		func(name, rs->indication.count, rs->indication.total_ns,
+			rs->indication.max_ns, user_data);
+	}
+}
+
+static struct qmi_replay *fuzz_replay;
+static struct qmi_replay_stats fuzz_stats;
+
+static struct qmi_replay *fuzz_start(void)
+{
+	static const uint8_t services[] = {
+		QMI_SERVICE_WDS, QMI_SERVICE_DMS, QMI_SERVICE_NAS,
+		QMI_SERVICE_WMS, QMI_SERVICE_VOICE, QMI_SERVICE_UIM,
+	};
+	struct qmi_replay *replay = qmi_replay_new();
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(services); i++) {
+		struct replay_service *rs =
+				replay_get_service(replay, services[i]);
+
+		l_uintset_put(rs->indications, FUZZ_INDICATION);
+	}
+
+	replay->fuzzing = true;
+
+	if (!replay_start(replay, FUZZ_WINDOW, &fuzz_stats)) {
+		replay_stop(replay);
+		qmi_replay_free(replay);
+		return NULL;
+	}
+
+	return replay;
+}
+
+void qmi_replay_fuzz(const uint8_t *data, size_t len)
+{
+	struct replay_service *rs;
+	unsigned int n_services = 0;
+	unsigned int i;
+
+	if (!fuzz_replay)
+		fuzz_replay = fuzz_start();
+
+	if (!fuzz_replay)
+		return;
+
+	/* Straight into the QMUX framing and __rx_message() */
+	if (len)
+		modem_write(fuzz_replay, data, len > MAX_FRAME ?
+							MAX_FRAME : len);
+
+	if (!replay_wait(fuzz_replay, replay_settled) || !len)
+		goto done;
+
+	/* Then as the TLVs of a well formed response and indication */
+	for (i = 0; i < L_ARRAY_SIZE(fuzz_replay->services); i++)
+		if (fuzz_replay->services[i] &&
+				fuzz_replay->services[i]->service)
+			n_services += 1;
+
+	for (i = 0, rs = NULL; i < L_ARRAY_SIZE(fuzz_replay->services); i++) {
+		if (!fuzz_replay->services[i] ||
+				!fuzz_replay->services[i]->service)
+			continue;
+
+		rs = fuzz_replay->services[i];
+
+		if (data[0] % n_services == 0)
+			break;
+
+		n_services -= 1;
+	}
+
+	if (!rs)
+		goto done;
+
+	fuzz_replay->fuzz_payload = data + 1;
+	fuzz_replay->fuzz_length = len - 1 > MAX_TLVS ? MAX_TLVS : len - 1;
+
+	if (!replay_send(fuzz_replay, rs, FUZZ_MESSAGE, NULL, 0))
+		goto done;
+
+	replay_indicate(fuzz_replay, rs, rs->client, FUZZ_INDICATION,
+			fuzz_replay->fuzz_payload, fuzz_replay->fuzz_length);
+
+	replay_wait(fuzz_replay, replay_settled);
+
+done:
+	fuzz_replay->fuzz_payload = NULL;
+
+	/* Anything left over would confuse the next input */
+	if (!replay_settled(fuzz_replay) || fuzz_replay->failed)
+		qmi_replay_fuzz_cleanup();
+}
+
+void qmi_replay_fuzz_cleanup(void)
+{
+	if (!fuzz_replay)
+		return;
+
+	replay_stop(fuzz_replay);
+	qmi_replay_free(fuzz_replay);
+	fuzz_replay = NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+struct qmi_replay;
+
+struct qmi_replay_stats {
+	unsigned int requests;		/* Requests sent */
+	unsigned int responses;		/* Responses delivered */
+	unsigned int synthesized;	/* Responses missing from the capture */
+	unsigned int indications;	/* Indications delivered */
+	size_t bytes;			/* Bytes fed to the device */
+	uint64_t response_ns;		/* Summed request to callback latency */
+	uint64_t indication_ns;		/* Summed write to callback latency */
+	double elapsed;			/* Wall clock seconds */
+	double cpu;			/* Thread CPU seconds */
+};
+
+typedef void (*qmi_replay_result_func_t)(const char *name, unsigned int count,
+					uint64_t total_ns, uint64_t max_ns,
+					void *user_data);
+
+struct qmi_replay *qmi_replay_new(void);
+void qmi_replay_free(struct qmi_replay *replay);
+
+/*
+ * Parses a capture as logged with OFONO_QMI_IO_DEBUG, i.e. the hexdumps of
+ * the QMUX frames read and written, optionally preceded by a debug prefix
+ * ending in "QMI: ".  QRTR hexdumps ("QRTR: ") carry no service type, it is
+ * taken from the message summary logged after them.  Control messages are
+ * skipped, the replay answers those by itself.  Returns the number of
+ * service messages taken.
+ */
+unsigned int qmi_replay_parse(struct qmi_replay *replay, const char *capture);
+unsigned int qmi_replay_load(struct qmi_replay *replay, const char *path);
+
+/*
+ * Replays the capture through a qmi_qmux_device over a socketpair, as fast
+ * as the device takes it.  The recorded requests are sent with at most
+ * window in flight and answered with the recorded responses, the recorded
+ * indications are fed back as the capture reaches them.  The QRTR records
+ * go through QMUX framing, their payload is the same.  Needs a running ell
+ * main loop.
+ */
+bool qmi_replay_run(struct qmi_replay *replay, unsigned int window,
+			struct qmi_replay_stats *stats);
+
+/*
+ * Calls func for the response and indication paths of every service seen
+ * during the runs so far, with the latencies measured on them.
+ */
+void qmi_replay_foreach_result(struct qmi_replay *replay,
+				qmi_replay_result_func_t func, void *user_data);
+
+/*
+ * Fuzzing entry point.  data is fed to a persistent device as a raw read
+ * from the modem, then as the TLVs of a response and of an indication
+ * which are decoded with every qmi_result accessor.  Suitable as the body
+ * of LLVMFuzzerTestOneInput().
+ */
+void qmi_replay_fuzz(const uint8_t *data, size_t len);
+void qmi_replay_fuzz_cleanup(void);
@@ -15,6 +15,7 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include <ofono/types.h>
 
@@ -27,6 +28,25 @@
 
 static GMainLoop *mainloop;
 
+struct load_hdr {
+	/* Warning: length is stored in network order */
+	uint32_t length;
+	uint32_t unsolicited;
+	uint32_t serial;
+	uint32_t error;
+};
+
+struct engine_load {
+	const struct rilmodem_test_load *load;
+	struct rilmodem_test_load_stats *stats;
+	guint fill_source;
+	gboolean started;
+	gint64 start_us;
+	double start_cpu;
+	unsigned char rx_buf[MAX_REQUEST_SIZE];
+	size_t rx_len;
+};
+
 struct engine_data {
 	int server_sk;
 	int connected_sk;
@@ -37,8 +57,11 @@ struct engine_data {
 	struct rilmodem_test_data rtd;
 	int step_i;
 	void *user_data;
+	struct engine_load *load;
 };
 
+static void load_rx(struct engine_data *ed);
+
 static void send_parcel(struct engine_data *ed)
 {
 	GIOStatus status;
@@ -71,6 +94,11 @@ static gboolean on_rx_data(GIOChannel *chan, GIOCondition cond, gpointer data)
 	if (cond == G_IO_NVAL)
 		return FALSE;
 
+	if (ed->load) {
+		load_rx(ed);
+		return TRUE;
+	}
+
 	buf = g_malloc0(MAX_REQUEST_SIZE);
 
 	status = g_io_channel_read_chars(ed->server_io, buf, MAX_REQUEST_SIZE,
@@ -264,3 +292,220 @@ void rilmodem_test_engine_start(struct engine_data *ed)
 	g_main_loop_run(mainloop);
 	g_main_loop_unref(mainloop);
 }
+
+static double cpu_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const struct rilmodem_test_load_response *load_find_response(
+					const struct rilmodem_test_load *load,
+					int req)
+{
+	int i;
+
+	for (i = 0; i < load->num_responses; i++)
+		if (load->responses[i].req == req)
+			return &load->responses[i];
+
+	return NULL;
+}
+
+static void load_respond(struct engine_data *ed, int req, uint32_t serial)
+{
+	struct engine_load *el = ed->load;
+	const struct rilmodem_test_load_response *rsp;
+	unsigned char buf[MAX_REQUEST_SIZE];
+	struct load_hdr hdr;
+	size_t size = 0;
+
+	rsp = load_find_response(el->load, req);
+	if (rsp)
+		size = rsp->size;
+
+	g_assert(sizeof(hdr) + size <= sizeof(buf));
+
+	hdr.length = htonl(sizeof(hdr) - sizeof(hdr.length) + size);
+	hdr.unsolicited = 0;
+	hdr.serial = serial;
+	hdr.error = 0;
+
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	if (size)
+		memcpy(buf + sizeof(hdr), rsp->data, size);
+
+	rilmodem_test_engine_write_socket(ed, buf, sizeof(hdr) + size);
+
+	el->stats->responses += 1;
+	el->stats->bytes += sizeof(hdr) + size;
+}
+
+/* Requests are length, request id and serial, then the parcel */
+static void load_rx(struct engine_data *ed)
+{
+	struct engine_load *el = ed->load;
+	unsigned char *buf = el->rx_buf;
+	GIOStatus status;
+	gsize rbytes;
+
+	status = g_io_channel_read_chars(ed->server_io,
+					(char *) el->rx_buf + el->rx_len,
+					sizeof(el->rx_buf) - el->rx_len,
+					&rbytes, NULL);
+	g_assert(status == G_IO_STATUS_NORMAL);
+
+	el->rx_len += rbytes;
+
+	while (el->rx_len - (buf - el->rx_buf) >= 12) {
+		size_t avail = el->rx_len - (buf - el->rx_buf);
+		uint32_t len;
+		uint32_t req;
+		uint32_t serial;
+
+		memcpy(&len, buf, 4);
+		len = ntohl(len);
+		g_assert(len >= 8 && len + 4 <= sizeof(el->rx_buf));
+
+		if (avail < len + 4)
+			break;
+
+		memcpy(&req, buf + 4, 4);
+		memcpy(&serial, buf + 8, 4);
+
+		el->stats->requests += 1;
+		load_respond(ed, req, serial);
+
+		buf += len + 4;
+	}
+
+	el->rx_len -= buf - el->rx_buf;
+	memmove(el->rx_buf, buf, el->rx_len);
+}
+
+static gboolean load_fill(gpointer data)
+{
+	struct engine_data *ed = data;
+	struct engine_load *el = ed->load;
+	const struct rilmodem_test_load *load = el->load;
+	struct rilmodem_test_load_stats *stats = el->stats;
+	unsigned int due = load->count;
+
+	if (load->rate) {
+		gint64 elapsed = g_get_monotonic_time() - el->start_us;
+
+		due = elapsed * load->rate / G_USEC_PER_SEC + 1;
+		if (due > load->count)
+			due = load->count;
+	}
+
+	while (stats->unsolicited < due &&
+			stats->unsolicited + stats->issued - stats->handled <
+								load->window) {
+		const struct rilmodem_test_load_record *record =
+			&load->unsol[stats->unsolicited % load->num_unsol];
+
+		rilmodem_test_engine_write_socket(ed, record->parcel_data,
+							record->parcel_size);
+		stats->unsolicited += 1;
+		stats->bytes += record->parcel_size;
+
+		if (load->request && load->request_interval &&
+				stats->unsolicited % load->request_interval == 0) {
+			stats->issued += 1;
+			load->request(ed->user_data);
+		}
+	}
+
+	/* Paced loads keep ticking until everything is out */
+	if (load->rate && stats->unsolicited < load->count)
+		return TRUE;
+
+	el->fill_source = 0;
+	return FALSE;
+}
+
+static void load_schedule(struct engine_data *ed)
+{
+	struct engine_load *el = ed->load;
+	const struct rilmodem_test_load *load = el->load;
+
+	if (el->fill_source)
+		return;
+
+	if (load->rate) {
+		guint interval = 1000 / load->rate;
+
+		el->fill_source = g_timeout_add(interval ? interval : 1,
+						load_fill, ed);
+	} else
+		el->fill_source = g_idle_add(load_fill, ed);
+}
+
+void rilmodem_test_engine_load_start(struct engine_data *ed)
+{
+	struct engine_load *el = ed->load;
+
+	g_assert(el != NULL);
+
+	if (el->started)
+		return;
+
+	el->started = TRUE;
+	el->start_us = g_get_monotonic_time();
+	el->start_cpu = cpu_seconds();
+
+	load_schedule(ed);
+}
+
+void rilmodem_test_engine_load_handled(struct engine_data *ed)
+{
+	struct engine_load *el = ed->load;
+	struct rilmodem_test_load_stats *stats = el->stats;
+
+	stats->handled += 1;
+
+	if (stats->unsolicited == el->load->count &&
+			stats->handled >= stats->unsolicited + stats->issued) {
+		stats->elapsed = (g_get_monotonic_time() - el->start_us) /
+							(double) G_USEC_PER_SEC;
+		stats->cpu = cpu_seconds() - el->start_cpu;
+
+		if (el->fill_source) {
+			g_source_remove(el->fill_source);
+			el->fill_source = 0;
+		}
+
+		g_main_loop_quit(mainloop);
+		return;
+	}
+
+	/* The window opened up, paced loads wait for their next tick */
+	if (el->load->rate == 0)
+		load_schedule(ed);
+}
+
+void rilmodem_test_engine_run_load(struct engine_data *ed,
+					const struct rilmodem_test_load *load,
+					struct rilmodem_test_load_stats *stats)
+{
+	g_assert(load->num_unsol > 0 && load->window > 0);
+
+	memset(stats, 0, sizeof(*stats));
+
+	ed->load = g_new0(struct engine_load, 1);
+	ed->load->load = load;
+	ed->load->stats = stats;
+
+	rilmodem_test_engine_start(ed);
+
+	if (ed->load->fill_source)
+		g_source_remove(ed->load->fill_source);
+
+	g_free(ed->load);
+	ed->load = NULL;
+}
@@ -58,3 +58,59 @@ const struct rilmodem_test_step *rilmodem_test_engine_get_current_step(
 							struct engine_data *ed);
 
 void rilmodem_test_engine_start(struct engine_data *ed);
+
+/*
+ * Load mode.  Instead of following the steps, the engine writes count
+ * unsolicited records, cycling through unsol, and answers every request
+ * it reads with the matching entry of responses, or with an empty success
+ * for requests not listed.  Every request_interval records request is
+ * called so that the test issues a request through a driver.  At most
+ * window records and requests are left unhandled at a time, and no more
+ * than rate records a second go out, 0 being as fast as they are taken.
+ */
+struct rilmodem_test_load_record {
+	const unsigned char *parcel_data;	/* Whole record, length included */
+	size_t parcel_size;
+};
+
+struct rilmodem_test_load_response {
+	int req;
+	const unsigned char *data;		/* Payload after the error field */
+	size_t size;
+};
+
+struct rilmodem_test_load {
+	const struct rilmodem_test_load_record *unsol;
+	int num_unsol;
+	const struct rilmodem_test_load_response *responses;
+	int num_responses;
+	unsigned int count;
+	unsigned int rate;
+	unsigned int window;
+	rilmodem_test_engine_cb_t request;
+	unsigned int request_interval;
+};
+
+struct rilmodem_test_load_stats {
+	unsigned int unsolicited;	/* Unsolicited records written */
+	unsigned int issued;		/* Requests issued through request */
+	unsigned int requests;		/* Requests read, any origin */
+	unsigned int responses;		/* Responses written */
+	unsigned int handled;		/* Completions reported by the test */
+	size_t bytes;			/* Bytes written to gril */
+	double elapsed;			/* Wall clock seconds */
+	double cpu;			/* Process CPU seconds, engine included */
+};
+
+/*
+ * Runs the main loop until every record and issued request has been
+ * reported handled.  The stream starts with rilmodem_test_engine_load_start,
+ * which the test calls once its atoms are registered, and the test reports
+ * each unsolicited record and request that reached the core with
+ * rilmodem_test_engine_load_handled.
+ */
+void rilmodem_test_engine_run_load(struct engine_data *ed,
+					const struct rilmodem_test_load *load,
+					struct rilmodem_test_load_stats *stats);
+void rilmodem_test_engine_load_start(struct engine_data *ed);
+void rilmodem_test_engine_load_handled(struct engine_data *ed);
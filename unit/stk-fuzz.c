@@ -0,0 +1,137 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include <ofono/types.h>
+#include "smsutil.h"
+#include "stkutil.h"
+
+#include "stk-fuzz.h"
+
+static void fuzz_response(const struct stk_command *command)
+{
+	struct stk_response response;
+	const struct stk_item *item;
+	unsigned int pdu_len;
+
+	memset(&response, 0, sizeof(response));
+	response.number = command->number;
+	response.type = command->type;
+	response.qualifier = command->qualifier;
+	response.src = STK_DEVICE_IDENTITY_TYPE_TERMINAL;
+	response.dst = STK_DEVICE_IDENTITY_TYPE_UICC;
+	response.result.type = STK_RESULT_TYPE_SUCCESS;
+
+	/* Echo what the card sent back wherever the response carries text */
+	switch (command->type) {
+	case STK_COMMAND_TYPE_GET_INKEY:
+		response.get_inkey.text.text = command->get_inkey.text;
+		response.get_inkey.text.yesno =
+					(command->qualifier & 0x04) != 0;
+		break;
+	case STK_COMMAND_TYPE_GET_INPUT:
+		response.get_input.text.text = command->get_input.default_text;
+		response.get_input.text.packed =
+					(command->qualifier & 0x08) != 0;
+		break;
+	case STK_COMMAND_TYPE_SELECT_ITEM:
+		item = l_queue_peek_head(command->select_item.items);
+		if (item)
+			response.select_item.item_id = item->id;
+		break;
+	}
+
+	stk_pdu_from_response(&response, &pdu_len);
+}
+
+static void fuzz_envelopes(const struct stk_command *command)
+{
+	struct stk_envelope envelope;
+	const struct stk_item *item;
+	unsigned int pdu_len;
+
+	memset(&envelope, 0, sizeof(envelope));
+	envelope.src = STK_DEVICE_IDENTITY_TYPE_TERMINAL;
+	envelope.dst = STK_DEVICE_IDENTITY_TYPE_UICC;
+
+	switch (command->type) {
+	case STK_COMMAND_TYPE_SETUP_MENU:
+		item = l_queue_peek_head(command->setup_menu.items);
+		if (!item)
+			return;
+
+		envelope.type = STK_ENVELOPE_TYPE_MENU_SELECTION;
+		envelope.menu_selection.item_id = item->id;
+		break;
+	case STK_COMMAND_TYPE_SETUP_CALL:
+		if (!command->setup_call.addr.number)
+			return;
+
+		envelope.type = STK_ENVELOPE_TYPE_CALL_CONTROL;
+		envelope.call_control.type = STK_CC_TYPE_CALL_SETUP;
+		envelope.call_control.address = command->setup_call.addr;
+		envelope.call_control.ccp1 = command->setup_call.ccp;
+		envelope.call_control.subaddress = command->setup_call.subaddr;
+		break;
+	default:
+		return;
+	}
+
+	stk_pdu_from_envelope(&envelope, &pdu_len);
+}
+
+static void fuzz_ussd_download(const uint8_t *data, size_t len)
+{
+	struct stk_envelope envelope;
+	struct stk_ussd_string *ussd = &envelope.ussd_data_download.string;
+	unsigned int pdu_len;
+
+	memset(&envelope, 0, sizeof(envelope));
+	envelope.type = STK_ENVELOPE_TYPE_USSD_DOWNLOAD;
+	envelope.src = STK_DEVICE_IDENTITY_TYPE_NETWORK;
+	envelope.dst = STK_DEVICE_IDENTITY_TYPE_UICC;
+
+	ussd->dcs = data[0];
+	ussd->len = MIN(len - 1, sizeof(ussd->string));
+	memcpy(ussd->string, data + 1, ussd->len);
+
+	stk_pdu_from_envelope(&envelope, &pdu_len);
+}
+
+bool stk_fuzz_one(const uint8_t *data, size_t len)
+{
+	struct stk_command *command;
+	bool parsed = false;
+
+	if (!len)
+		return false;
+
+	command = stk_command_new_from_pdu(data, len);
+	if (command) {
+		parsed = command->status == STK_PARSE_RESULT_OK;
+
+		if (parsed) {
+			fuzz_response(command);
+			fuzz_envelopes(command);
+		}
+
+		stk_command_free(command);
+	}
+
+	fuzz_ussd_download(data, len);
+
+	return parsed;
+}
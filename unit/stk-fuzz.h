@@ -0,0 +1,14 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Fuzzing entry point.  data is parsed as a proactive command, a command
+ * which parses is answered with a terminal response built from it and the
+ * envelopes it may lead to are encoded.  data is also encoded as the
+ * string of a USSD data download envelope.  Suitable as the body of
+ * LLVMFuzzerTestOneInput().  Returns true if data parsed as a command.
+ */
+bool stk_fuzz_one(const uint8_t *data, size_t len);
@@ -0,0 +1,158 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+#include "at-replay.h"
+
+/* Excerpt of an ofonod log with OFONO_AT_DEBUG set, two channels mixed */
+static const char transcript[] =
+	"ofonod[42]: Aux: > ATE0 +CMEE=1\\r\n"
+	"ofonod[42]: Aux: < \\r\\nOK\\r\\n\n"
+	"ofonod[42]: Aux: > AT+CGMI\\r\n"
+	"ofonod[42]: Aux: < \\r\\n+CGMI: Quectel\\r\\n\\r\\nOK\\r\\n\n"
+	"ofonod[42]: Modem: > AT+CGDCONT?\\r\n"
+	"ofonod[42]: Modem: < \\r\\n+CGDCONT: 1,\"IP\",\"internet\"\\r\\n"
+	"\\r\\nOK\\r\\n\n"
+	"ofonod[42]: Aux: < \\r\\n+CREG: 1,\"00A1\",\"0321D0F\",7\\r\\n\n"
+	"ofonod[42]: Aux: > AT+COPS=?\\r\n"
+	"ofonod[42]: Aux: < \\r\\n+CSQ: 17,99\\r\\n\n"
+	"ofonod[42]: Aux: < \\r\\n+COPS: (2,\"Op\",\"Op\",\"20404\",7),"
+	"(1,\"Other\",\"Other\",\"20408\",2),,(0-4),(0-2)\\r\\n\\r\\nOK"
+	"\\r\\n\n"
+	"ofonod[42]: Aux: > AT+CMGS=23\\r\n"
+	"ofonod[42]: Aux: < \\r\\n> \n"
+	"ofonod[42]: Aux: > 0011000B916407281553F80000AA0AE8329BFD4697D9EC37"
+						"<CtrlZ>\n"
+	"ofonod[42]: Aux: < \\r\\n+CMGS: 10\\r\\n\\r\\nOK\\r\\n\n"
+	"ofonod[42]: Aux: < \\r\\n+CMT: ,23\\r\\n"
+	"0791447758100650040C914477581006500000"
+	"21409051935800049B3A\\r\\n\n"
+	"ofonod[42]: Aux: < \\r\\n+CREG: 5,\"00A1\",\"0321D10\",7\\r\\n\n"
+	"ofonod[42]: Aux: > AT+CPMS?\\r\n";
+
+struct replay_counts {
+	guint cgmi;
+	guint cops;
+	guint cmgs;
+	guint creg;
+	guint cmt;
+	guint total;
+};
+
+static void count_result(const char *name, guint count, guint lines,
+				double cpu, gpointer user_data)
+{
+	struct replay_counts *counts = user_data;
+
+	if (!strcmp(name, "+CGMI"))
+		counts->cgmi += count;
+	else if (!strcmp(name, "+COPS=?"))
+		counts->cops += count;
+	else if (!strcmp(name, "+CMGS="))
+		counts->cmgs += count;
+	else if (!strcmp(name, "+CREG:"))
+		counts->creg += count;
+	else if (!strcmp(name, "+CMT:"))
+		counts->cmt += count;
+
+	counts->total += count;
+}
+
+static void test_replay(void)
+{
+	struct at_replay *replay = at_replay_new();
+	struct replay_counts counts = { 0 };
+	struct at_replay_stats stats;
+	GAtSyntax *syntax;
+
+	g_assert_cmpuint(at_replay_parse(replay, transcript, "Aux:"), ==, 15);
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	g_assert(at_replay_run(replay, syntax, &stats));
+	g_at_syntax_unref(syntax);
+
+	g_assert_cmpuint(stats.commands, ==, 5);
+	g_assert_cmpuint(stats.notifications, ==, 4);
+
+	/* The transcript ends before the +CPMS? response */
+	g_assert_cmpuint(stats.incomplete, ==, 1);
+
+	at_replay_foreach_result(replay, count_result, &counts);
+	g_assert_cmpuint(counts.cgmi, ==, 1);
+	g_assert_cmpuint(counts.cops, ==, 1);
+	g_assert_cmpuint(counts.cmgs, ==, 1);
+	g_assert_cmpuint(counts.creg, ==, 2);
+	g_assert_cmpuint(counts.cmt, ==, 1);
+	g_assert_cmpuint(counts.total, ==, stats.commands +
+						stats.notifications);
+
+	at_replay_free(replay);
+}
+
+static void test_replay_perf(void)
+{
+	struct at_replay *replay = at_replay_new();
+	struct at_replay_stats stats;
+	GAtSyntax *syntax;
+	GString *big = g_string_new(NULL);
+	unsigned int i, j;
+
+	/* Replay a long session of notifications and listings */
+	for (i = 0; i < 2000; i++) {
+		g_string_append_printf(big, "Aux: < \\r\\n+CREG: 1,\"%04X\","
+					"\"%07X\",7\\r\\n\n", i, i * 7);
+		g_string_append(big, "Aux: < \\r\\n+CSQ: 17,99\\r\\n\n");
+
+		if (i % 100)
+			continue;
+
+		g_string_append(big, "Aux: > AT+CPBR=1,50\\r\n");
+		g_string_append(big, "Aux: < ");
+
+		for (j = 0; j < 50; j++)
+			g_string_append_printf(big, "\\r\\n+CPBR: %u,"
+					"\"+1555%07u\",145,\"Contact %u\""
+					"\\r\\n", j + 1, j, j);
+
+		g_string_append(big, "\\r\\nOK\\r\\n\n");
+	}
+
+	at_replay_parse(replay, big->str, "Aux:");
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	g_assert(at_replay_run(replay, syntax, &stats));
+	g_at_syntax_unref(syntax);
+
+	g_test_message("%u lines in %.3fs (%.3fs cpu), %.0f lines/s",
+			stats.lines, stats.elapsed, stats.cpu,
+			stats.lines / stats.elapsed);
+	g_test_maximized_result(stats.lines / stats.elapsed,
+				"%.0f lines/s", stats.lines / stats.elapsed);
+
+	g_string_free(big, TRUE);
+	at_replay_free(replay);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testatreplay/replay", test_replay);
+
+	if (g_test_perf())
+		g_test_add_func("/testatreplay/perf/replay", test_replay_perf);
+
+	return g_test_run();
+}
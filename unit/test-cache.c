@@ -0,0 +1,141 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "ofono.h"
+
+struct test_value {
+	unsigned int refs;
+};
+
+unsigned int __ofono_memtrim_add(ofono_memtrim_func_t func, void *user_data)
+{
+	return 1;
+}
+
+void __ofono_memtrim_remove(unsigned int id)
+{
+}
+
+static void *test_ref(void *data)
+{
+	struct test_value *value = data;
+
+	value->refs += 1;
+
+	return value;
+}
+
+static void test_unref(void *data)
+{
+	struct test_value *value = data;
+
+	g_assert_cmpuint(value->refs, >, 0);
+	value->refs -= 1;
+}
+
+struct test_stats {
+	const char *name;
+	unsigned int entries;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+static void test_foreach(const char *name, unsigned int entries,
+				uint64_t hits, uint64_t misses,
+				void *user_data)
+{
+	struct test_stats *stats = user_data;
+
+	if (strcmp(name, stats->name))
+		return;
+
+	stats->entries = entries;
+	stats->hits = hits;
+	stats->misses = misses;
+}
+
+static void test_lookup(void)
+{
+	static const uint8_t key1[] = { 0x01, 0x02, 0x03 };
+	static const uint8_t key2[] = { 0x01, 0x02, 0x04 };
+	struct test_value value = { .refs = 1 };
+	struct test_stats stats = { .name = "lookup" };
+	struct ofono_cache *cache;
+
+	cache = __ofono_cache_get("lookup", 4, test_ref, test_unref);
+	g_assert(__ofono_cache_get("lookup", 1, NULL, NULL) == cache);
+
+	g_assert(!__ofono_cache_lookup(cache, key1, sizeof(key1)));
+
+	__ofono_cache_insert(cache, key1, sizeof(key1), &value);
+	g_assert_cmpuint(value.refs, ==, 2);
+
+	/* Same length, different contents */
+	g_assert(!__ofono_cache_lookup(cache, key2, sizeof(key2)));
+	g_assert(!__ofono_cache_lookup(cache, key1, sizeof(key1) - 1));
+
+	g_assert(__ofono_cache_lookup(cache, key1, sizeof(key1)) == &value);
+	g_assert_cmpuint(value.refs, ==, 3);
+
+	__ofono_cache_foreach(test_foreach, &stats);
+	g_assert_cmpuint(stats.entries, ==, 1);
+	g_assert_cmpuint(stats.hits, ==, 1);
+	g_assert_cmpuint(stats.misses, ==, 3);
+}
+
+static void test_evict(void)
+{
+	struct test_value values[3] = { { 1 }, { 1 }, { 1 } };
+	struct test_stats stats = { .name = "evict" };
+	struct ofono_cache *cache;
+	uint8_t i;
+
+	cache = __ofono_cache_get("evict", 2, test_ref, test_unref);
+
+	for (i = 0; i < 2; i++)
+		__ofono_cache_insert(cache, &i, sizeof(i), &values[i]);
+
+	/* Using the first entry makes the second the oldest */
+	i = 0;
+	g_assert(__ofono_cache_lookup(cache, &i, sizeof(i)) == &values[0]);
+	test_unref(&values[0]);
+
+	i = 2;
+	__ofono_cache_insert(cache, &i, sizeof(i), &values[2]);
+
+	/* Evicted entries drop their reference, held ones stay valid */
+	g_assert_cmpuint(values[0].refs, ==, 2);
+	g_assert_cmpuint(values[1].refs, ==, 1);
+	g_assert_cmpuint(values[2].refs, ==, 2);
+
+	i = 1;
+	g_assert(!__ofono_cache_lookup(cache, &i, sizeof(i)));
+
+	/* Inserting an existing key replaces the value */
+	__ofono_cache_insert(cache, &i, sizeof(i), &values[1]);
+	__ofono_cache_insert(cache, &i, sizeof(i), &values[2]);
+	g_assert_cmpuint(values[1].refs, ==, 1);
+	g_assert_cmpuint(values[2].refs, ==, 3);
+
+	__ofono_cache_foreach(test_foreach, &stats);
+	g_assert_cmpuint(stats.entries, ==, 2);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testcache/lookup", test_lookup);
+	g_test_add_func("/testcache/evict", test_evict);
+
+	return g_test_run();
+}
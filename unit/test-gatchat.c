@@ -0,0 +1,535 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+static const char *csq_prefix[] = { "+CSQ:", NULL };
+static const char *creg_prefix[] = { "+CREG:", NULL };
+static const char *cops_prefix[] = { "+COPS:", NULL };
+static const char *none_prefix[] = { NULL };
+
+struct chat_test {
+	GAtChat *chat;
+	int fd;				/* Modem side of the socketpair */
+	GString *log;			/* Responses seen by the callbacks */
+};
+
+static void drain(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void chat_test_init(struct chat_test *test)
+{
+	GIOChannel *io;
+	GAtSyntax *syntax;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	g_assert(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	syntax = g_at_syntax_new_gsmv1();
+	test->chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+
+	g_assert(test->chat);
+
+	test->fd = sv[1];
+	test->log = g_string_new(NULL);
+}
+
+static void chat_test_cleanup(struct chat_test *test)
+{
+	g_at_chat_unref(test->chat);
+	close(test->fd);
+	g_string_free(test->log, TRUE);
+}
+
+/* Whatever the chat has written out so far */
+static char *modem_read(struct chat_test *test)
+{
+	GString *str = g_string_new(NULL);
+	char buf[256];
+	ssize_t r;
+
+	drain();
+
+	while ((r = read(test->fd, buf, sizeof(buf))) > 0)
+		g_string_append_len(str, buf, r);
+
+	g_assert(r < 0 && errno == EAGAIN);
+
+	return g_string_free(str, FALSE);
+}
+
+static void modem_expect(struct chat_test *test, const char *expected)
+{
+	char *written = modem_read(test);
+
+	g_assert_cmpstr(written, ==, expected);
+	g_free(written);
+}
+
+static void modem_write(struct chat_test *test, const char *str)
+{
+	gsize len = strlen(str);
+
+	g_assert(write(test->fd, str, len) == (ssize_t) len);
+	drain();
+}
+
+static void log_expect(struct chat_test *test, const char *expected)
+{
+	g_assert_cmpstr(test->log->str, ==, expected);
+	g_string_truncate(test->log, 0);
+}
+
+/* Logs the first response line and the final response of a command */
+static void result_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct chat_test *test = user_data;
+	const char *final = g_at_result_final_response(result);
+	GAtResultIter iter;
+	const char *line = "";
+
+	g_at_result_iter_init(&iter, result);
+
+	if (g_at_result_iter_next(&iter, NULL))
+		line = g_at_result_iter_raw_line(&iter);
+
+	g_string_append_printf(test->log, "[%s|%s]", line, final);
+}
+
+static guint send_pipelined(struct chat_test *test, GAtChat *chat,
+				const char *cmd, const char **prefix)
+{
+	guint id = g_at_chat_send_pipelined(chat, cmd, prefix,
+						result_cb, test, NULL);
+
+	g_assert(id > 0);
+
+	return id;
+}
+
+/*
+ * Final responses go to the commands in the order they were written, with
+ * the intermediate lines of each.  A command sent without pipelining waits
+ * for all the ones before it to complete.
+ */
+static void test_pipeline_order(void)
+{
+	struct chat_test test;
+
+	chat_test_init(&test);
+	g_assert(g_at_chat_set_pipeline_depth(test.chat, 3));
+
+	send_pipelined(&test, test.chat, "AT+CSQ", csq_prefix);
+	send_pipelined(&test, test.chat, "AT+CREG?", creg_prefix);
+	send_pipelined(&test, test.chat, "AT+COPS?", cops_prefix);
+	send_pipelined(&test, test.chat, "AT+CGATT?", none_prefix);
+	g_at_chat_send(test.chat, "AT+CFUN=1", none_prefix,
+				result_cb, &test, NULL);
+
+	modem_expect(&test, "AT+CSQ\rAT+CREG?\rAT+COPS?\r");
+
+	modem_write(&test, "\r\n+CSQ: 15,99\r\n\r\nOK\r\n");
+	log_expect(&test, "[+CSQ: 15,99|OK]");
+	modem_expect(&test, "AT+CGATT?\r");
+
+	modem_write(&test, "\r\nERROR\r\n"
+				"\r\n+COPS: 0,0,\"Operator\"\r\n\r\nOK\r\n");
+	log_expect(&test, "[|ERROR][+COPS: 0,0,\"Operator\"|OK]");
+
+	/* The unpipelined command waits for the last pipelined one */
+	modem_expect(&test, "");
+
+	modem_write(&test, "\r\nOK\r\n");
+	log_expect(&test, "[|OK]");
+	modem_expect(&test, "AT+CFUN=1\r");
+
+	modem_write(&test, "\r\nOK\r\n");
+	log_expect(&test, "[|OK]");
+
+	chat_test_cleanup(&test);
+}
+
+/*
+ * A command cancelled once written still takes its final response, its
+ * callback is just not called.  One cancelled before being written is
+ * never written at all.
+ */
+static void test_pipeline_cancel(void)
+{
+	struct chat_test test;
+	guint csq;
+	guint creg;
+	guint cgatt;
+
+	chat_test_init(&test);
+	g_assert(g_at_chat_set_pipeline_depth(test.chat, 3));
+
+	csq = send_pipelined(&test, test.chat, "AT+CSQ", csq_prefix);
+	creg = send_pipelined(&test, test.chat, "AT+CREG?", creg_prefix);
+	send_pipelined(&test, test.chat, "AT+COPS?", cops_prefix);
+	cgatt = send_pipelined(&test, test.chat, "AT+CGATT?", none_prefix);
+
+	modem_expect(&test, "AT+CSQ\rAT+CREG?\rAT+COPS?\r");
+
+	g_assert(g_at_chat_cancel(test.chat, creg));
+	g_assert(g_at_chat_cancel(test.chat, csq));
+	g_assert(g_at_chat_cancel(test.chat, cgatt));
+
+	modem_write(&test, "\r\n+CSQ: 15,99\r\n\r\nOK\r\n"
+				"\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+	log_expect(&test, "");
+	modem_expect(&test, "");
+
+	modem_write(&test, "\r\n+COPS: 0\r\n\r\nOK\r\n");
+	log_expect(&test, "[+COPS: 0|OK]");
+	modem_expect(&test, "");
+
+	chat_test_cleanup(&test);
+}
+
+/* Same for the commands of a clone cancelled all together */
+static void test_pipeline_cancel_group(void)
+{
+	struct chat_test test;
+	GAtChat *clone;
+
+	chat_test_init(&test);
+	g_assert(g_at_chat_set_pipeline_depth(test.chat, 3));
+
+	clone = g_at_chat_clone(test.chat);
+
+	send_pipelined(&test, clone, "AT+CSQ", csq_prefix);
+	send_pipelined(&test, test.chat, "AT+CREG?", creg_prefix);
+	send_pipelined(&test, clone, "AT+COPS?", cops_prefix);
+	send_pipelined(&test, clone, "AT+CGATT?", none_prefix);
+	send_pipelined(&test, test.chat, "AT+CSQ", csq_prefix);
+
+	modem_expect(&test, "AT+CSQ\rAT+CREG?\rAT+COPS?\r");
+
+	g_assert(g_at_chat_cancel_all(clone));
+	g_at_chat_unref(clone);
+
+	/* The removed AT+CGATT? makes room for the next one right away */
+	modem_write(&test, "\r\n+CSQ: 15,99\r\n\r\nOK\r\n");
+	log_expect(&test, "");
+	modem_expect(&test, "AT+CSQ\r");
+
+	modem_write(&test, "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+	log_expect(&test, "[+CREG: 0,1|OK]");
+
+	modem_write(&test, "\r\n+COPS: 0\r\n\r\nOK\r\n");
+	log_expect(&test, "");
+	modem_expect(&test, "");
+
+	modem_write(&test, "\r\n+CSQ: 20,99\r\n\r\nOK\r\n");
+	log_expect(&test, "[+CSQ: 20,99|OK]");
+
+	chat_test_cleanup(&test);
+}
+
+struct cancel_timer {
+	struct chat_test *test;
+	guint id;
+	gboolean fired;
+};
+
+static gboolean cancel_timeout(gpointer user_data)
+{
+	struct cancel_timer *timer = user_data;
+
+	g_at_chat_cancel(timer->test->chat, timer->id);
+	timer->fired = TRUE;
+
+	return FALSE;
+}
+
+/*
+ * Drivers give up on a command by cancelling it from a timeout.  The late
+ * response of such a command must not be taken for the one of the
+ * command after it, nor free a slot of the pipeline early.
+ */
+static void test_pipeline_timeout(void)
+{
+	struct chat_test test;
+	struct cancel_timer timer;
+
+	chat_test_init(&test);
+	g_assert(g_at_chat_set_pipeline_depth(test.chat, 2));
+
+	timer.test = &test;
+	timer.id = send_pipelined(&test, test.chat, "AT+CSQ", csq_prefix);
+	timer.fired = FALSE;
+	send_pipelined(&test, test.chat, "AT+CREG?", creg_prefix);
+
+	modem_expect(&test, "AT+CSQ\rAT+CREG?\r");
+
+	g_timeout_add(10, cancel_timeout, &timer);
+
+	while (!timer.fired)
+		g_main_context_iteration(NULL, TRUE);
+
+	send_pipelined(&test, test.chat, "AT+COPS?", cops_prefix);
+	modem_expect(&test, "");
+
+	modem_write(&test, "\r\nERROR\r\n");
+	log_expect(&test, "");
+	modem_expect(&test, "AT+COPS?\r");
+
+	modem_write(&test, "\r\n+CREG: 0,1\r\n\r\nOK\r\n"
+				"\r\n+COPS: 0\r\n\r\nOK\r\n");
+	log_expect(&test, "[+CREG: 0,1|OK][+COPS: 0|OK]");
+
+	chat_test_cleanup(&test);
+}
+
+/*
+ * Suspending with some commands written and others queued leaves the
+ * responses unread and the rest unwritten until resumed, after which
+ * the pipeline carries on where it was.
+ */
+static void test_pipeline_suspend(void)
+{
+	struct chat_test test;
+
+	chat_test_init(&test);
+	g_assert(g_at_chat_set_pipeline_depth(test.chat, 2));
+
+	send_pipelined(&test, test.chat, "AT+CSQ", csq_prefix);
+	send_pipelined(&test, test.chat, "AT+CREG?", creg_prefix);
+	send_pipelined(&test, test.chat, "AT+COPS?", cops_prefix);
+
+	modem_expect(&test, "AT+CSQ\rAT+CREG?\r");
+
+	g_at_chat_suspend(test.chat);
+
+	modem_write(&test, "\r\n+CSQ: 15,99\r\n\r\nOK\r\n");
+	log_expect(&test, "");
+	modem_expect(&test, "");
+
+	g_at_chat_resume(test.chat);
+	drain();
+
+	log_expect(&test, "[+CSQ: 15,99|OK]");
+	modem_expect(&test, "AT+COPS?\r");
+
+	modem_write(&test, "\r\n+CREG: 0,1\r\n\r\nOK\r\n"
+				"\r\n+COPS: 0\r\n\r\nOK\r\n");
+	log_expect(&test, "[+CREG: 0,1|OK][+COPS: 0|OK]");
+
+	chat_test_cleanup(&test);
+}
+
+struct notify_handler {
+	struct chat_test *test;
+	const char *name;
+	guint id;
+};
+
+/* Logs the handler with the notification line and the PDU, if any */
+static void notify_cb(GAtResult *result, gpointer user_data)
+{
+	struct notify_handler *handler = user_data;
+	GAtResultIter iter;
+	const char *pdu = g_at_result_pdu(result);
+
+	g_at_result_iter_init(&iter, result);
+	g_assert(g_at_result_iter_next(&iter, NULL));
+
+	g_string_append_printf(handler->test->log, "{%s:%s", handler->name,
+				g_at_result_iter_raw_line(&iter));
+
+	if (pdu)
+		g_string_append_printf(handler->test->log, "/%s", pdu);
+
+	g_string_append_c(handler->test->log, '}');
+}
+
+static void notify_register(struct chat_test *test,
+				struct notify_handler *handler,
+				const char *prefix, gboolean expect_pdu)
+{
+	handler->test = test;
+	handler->name = prefix;
+	handler->id = g_at_chat_register(test->chat, prefix, notify_cb,
+						expect_pdu, handler, NULL);
+
+	g_assert(handler->id > 0);
+}
+
+/* Every registered prefix of a line matches, shortest first */
+static void test_notify_nested(void)
+{
+	struct chat_test test;
+	struct notify_handler cr;
+	struct notify_handler cring;
+	struct notify_handler creg;
+
+	chat_test_init(&test);
+
+	notify_register(&test, &cring, "+CRING:", FALSE);
+	notify_register(&test, &cr, "+CR", FALSE);
+	notify_register(&test, &creg, "+CREG:", FALSE);
+
+	modem_write(&test, "\r\n+CRING: VOICE\r\n");
+	log_expect(&test, "{+CR:+CRING: VOICE}{+CRING::+CRING: VOICE}");
+
+	modem_write(&test, "\r\n+CREG: 1\r\n");
+	log_expect(&test, "{+CR:+CREG: 1}{+CREG::+CREG: 1}");
+
+	modem_write(&test, "\r\n+CRC: 1\r\n\r\n+CMTI: \"SM\",1\r\n");
+	log_expect(&test, "{+CR:+CRC: 1}");
+
+	g_assert(g_at_chat_unregister(test.chat, cr.id));
+
+	modem_write(&test, "\r\n+CRING: VOICE\r\n");
+	log_expect(&test, "{+CRING::+CRING: VOICE}");
+
+	chat_test_cleanup(&test);
+}
+
+/* Handlers sharing a prefix are all called for the same line */
+static void test_notify_same_line(void)
+{
+	struct chat_test test;
+	struct notify_handler first;
+	struct notify_handler second;
+
+	chat_test_init(&test);
+
+	notify_register(&test, &first, "+CMTI:", FALSE);
+	first.name = "first";
+	notify_register(&test, &second, "+CMTI:", FALSE);
+	second.name = "second";
+
+	modem_write(&test, "\r\n+CMTI: \"SM\",1\r\n");
+	log_expect(&test, "{second:+CMTI: \"SM\",1}{first:+CMTI: \"SM\",1}");
+
+	g_assert(g_at_chat_unregister(test.chat, second.id));
+
+	modem_write(&test, "\r\n+CMTI: \"SM\",2\r\n");
+	log_expect(&test, "{first:+CMTI: \"SM\",2}");
+
+	chat_test_cleanup(&test);
+}
+
+/*
+ * A PDU notification is only called once its PDU is read, with the line
+ * it follows.  Handlers of the shorter prefixes of that line that don't
+ * expect a PDU are still called for the line itself.
+ */
+static void test_notify_pdu(void)
+{
+	struct chat_test test;
+	struct notify_handler cmt;
+	struct notify_handler cmti;
+	struct notify_handler cm;
+
+	chat_test_init(&test);
+
+	notify_register(&test, &cmt, "+CMT:", TRUE);
+	notify_register(&test, &cmti, "+CMTI:", FALSE);
+
+	modem_write(&test, "\r\n+CMT: ,23\r\n");
+	log_expect(&test, "");
+
+	modem_write(&test, "07911326040000F0\r\n");
+	log_expect(&test, "{+CMT::+CMT: ,23/07911326040000F0}");
+
+	modem_write(&test, "\r\n+CMTI: \"SM\",1\r\n");
+	log_expect(&test, "{+CMTI::+CMTI: \"SM\",1}");
+
+	notify_register(&test, &cm, "+CM", FALSE);
+
+	modem_write(&test, "\r\n+CMT: ,23\r\n07911326040000F0\r\n");
+	log_expect(&test, "{+CM:+CMT: ,23}{+CMT::+CMT: ,23/07911326040000F0}");
+
+	chat_test_cleanup(&test);
+}
+
+struct notify_swap {
+	struct notify_handler handler;
+	struct notify_handler replacement;
+};
+
+/* Hands the notification over to a longer prefix */
+static void notify_swap_cb(GAtResult *result, gpointer user_data)
+{
+	struct notify_swap *swap = user_data;
+
+	notify_cb(result, &swap->handler);
+
+	g_assert(g_at_chat_unregister(swap->handler.test->chat,
+					swap->handler.id));
+	notify_register(swap->handler.test, &swap->replacement, "+CRING:",
+				FALSE);
+}
+
+/*
+ * Registering and unregistering from a notification callback is safe, and
+ * only takes effect from the next line on.
+ */
+static void test_notify_register_in_callback(void)
+{
+	struct chat_test test;
+	struct notify_swap swap;
+
+	chat_test_init(&test);
+
+	swap.handler.test = &test;
+	swap.handler.name = "+CR";
+	swap.handler.id = g_at_chat_register(test.chat, "+CR", notify_swap_cb,
+						FALSE, &swap, NULL);
+	g_assert(swap.handler.id > 0);
+
+	modem_write(&test, "\r\n+CRING: VOICE\r\n");
+	log_expect(&test, "{+CR:+CRING: VOICE}");
+
+	modem_write(&test, "\r\n+CRING: VOICE\r\n");
+	log_expect(&test, "{+CRING::+CRING: VOICE}");
+
+	chat_test_cleanup(&test);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgatchat/pipeline_order", test_pipeline_order);
+	g_test_add_func("/testgatchat/pipeline_cancel", test_pipeline_cancel);
+	g_test_add_func("/testgatchat/pipeline_cancel_group",
+				test_pipeline_cancel_group);
+	g_test_add_func("/testgatchat/pipeline_timeout",
+				test_pipeline_timeout);
+	g_test_add_func("/testgatchat/pipeline_suspend",
+				test_pipeline_suspend);
+	g_test_add_func("/testgatchat/notify_nested", test_notify_nested);
+	g_test_add_func("/testgatchat/notify_same_line",
+				test_notify_same_line);
+	g_test_add_func("/testgatchat/notify_pdu", test_notify_pdu);
+	g_test_add_func("/testgatchat/notify_register_in_callback",
+				test_notify_register_in_callback);
+
+	return g_test_run();
+}
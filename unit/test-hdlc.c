@@ -0,0 +1,574 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "crc-ccitt.h"
+#include "gathdlc.h"
+
+#define MAX_FRAME 1500
+
+struct hdlc_test {
+	GAtHDLC *hdlc;
+	int fd;
+	GPtrArray *expected;
+	guint received;
+	gsize bytes;
+};
+
+static void receive_cb(const unsigned char *data, gsize size,
+			gpointer user_data)
+{
+	struct hdlc_test *test = user_data;
+	GByteArray *frame;
+
+	test->bytes += size;
+
+	/* The benchmark only counts the frames */
+	if (test->expected == NULL) {
+		test->received += 1;
+		return;
+	}
+
+	g_assert_cmpuint(test->received, <, test->expected->len);
+	frame = g_ptr_array_index(test->expected, test->received);
+
+	g_assert_cmpuint(size, ==, frame->len);
+	g_assert(memcmp(data, frame->data, size) == 0);
+
+	test->received += 1;
+}
+
+static struct hdlc_test *hdlc_test_new(guint32 recv_accm)
+{
+	struct hdlc_test *test = g_new0(struct hdlc_test, 1);
+	GIOChannel *io;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	test->hdlc = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+	g_assert(test->hdlc);
+
+	g_at_hdlc_set_recv_accm(test->hdlc, recv_accm);
+	g_at_hdlc_set_receive(test->hdlc, receive_cb, test);
+
+	test->fd = sv[1];
+
+	return test;
+}
+
+static void hdlc_test_free(struct hdlc_test *test)
+{
+	g_at_hdlc_unref(test->hdlc);
+	close(test->fd);
+	g_free(test);
+}
+
+static void encode_byte(GByteArray *out, guint8 c, guint32 xmit_accm)
+{
+	if (c == 0x7e || c == 0x7d || (c < 0x20 && (xmit_accm & (1U << c)))) {
+		guint8 esc[2] = { 0x7d, c ^ 0x20 };
+
+		g_byte_array_append(out, esc, 2);
+	} else
+		g_byte_array_append(out, &c, 1);
+}
+
+/* Frame the payload, with fcs_error flipping a bit of the FCS */
+static void encode_frame(GByteArray *out, const GByteArray *frame,
+				guint32 xmit_accm, gboolean fcs_error)
+{
+	guint8 flag = 0x7e;
+	guint16 fcs;
+	guint i;
+
+	fcs = crc_ccitt_update(0xffff, frame->data, frame->len) ^ 0xffff;
+
+	if (fcs_error)
+		fcs ^= 0x0100;
+
+	for (i = 0; i < frame->len; i++)
+		encode_byte(out, frame->data[i], xmit_accm);
+
+	encode_byte(out, fcs & 0xff, xmit_accm);
+	encode_byte(out, fcs >> 8, xmit_accm);
+	g_byte_array_append(out, &flag, 1);
+}
+
+static GByteArray *random_frame(GRand *rand, guint len, guint special)
+{
+	static const guint8 specials[] = { 0x7e, 0x7d, 0x00, 0x11, 0x13,
+						0x1f, 0x20, 0x5e, 0x5d };
+	GByteArray *frame = g_byte_array_sized_new(len);
+	guint i;
+
+	for (i = 0; i < len; i++) {
+		guint8 c = g_rand_int_range(rand, 0x20, 0x100);
+
+		/* One in 'special' bytes needs a closer look by the deframer */
+		if (special && g_rand_int_range(rand, 0, special) == 0)
+			c = specials[g_rand_int_range(rand, 0,
+						sizeof(specials))];
+
+		g_byte_array_append(frame, &c, 1);
+	}
+
+	return frame;
+}
+
+/* Write the stream in chunks of random size, letting the HDLC catch up */
+static void feed_stream(struct hdlc_test *test, GByteArray *stream,
+				GRand *rand, guint frames)
+{
+	gint64 deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+	gsize written = 0;
+
+	while (written < stream->len || test->received < frames) {
+		g_assert(g_get_monotonic_time() < deadline);
+
+		if (written < stream->len) {
+			gsize chunk = MIN(stream->len - written, rand ?
+					(gsize) g_rand_int_range(rand, 1, 3000) :
+					65536);
+			ssize_t n = send(test->fd, stream->data + written,
+						chunk, MSG_DONTWAIT);
+
+			if (n > 0)
+				written += n;
+		}
+
+		g_main_context_iteration(NULL, FALSE);
+	}
+}
+
+static void test_deframe(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	struct hdlc_test *test = hdlc_test_new(accm);
+	GRand *rand = g_rand_new_with_seed(0x7e7d);
+	GByteArray *stream = g_byte_array_new();
+	GPtrArray *expected = g_ptr_array_new_with_free_func(
+						(GDestroyNotify) g_byte_array_unref);
+	GByteArray *garbage;
+	guint8 flag = 0x7e;
+	guint i;
+
+	g_byte_array_append(stream, &flag, 1);
+
+	for (i = 0; i < 300; i++) {
+		guint len = g_rand_int_range(rand, 1, MAX_FRAME);
+		GByteArray *frame = random_frame(rand, len, i % 3 ? 64 : 4);
+
+		/* Every so often a corrupted frame which must be dropped */
+		if (i % 17 == 0) {
+			encode_frame(stream, frame, ~0U, TRUE);
+			g_byte_array_unref(frame);
+			continue;
+		}
+
+		encode_frame(stream, frame, accm, FALSE);
+		g_ptr_array_add(expected, frame);
+	}
+
+	/* A frame longer than the decode buffer is dropped as well */
+	garbage = random_frame(rand, 8000, 0);
+	encode_frame(stream, garbage, ~0U, FALSE);
+	g_byte_array_unref(garbage);
+
+	garbage = random_frame(rand, 40, 8);
+	encode_frame(stream, garbage, accm, FALSE);
+	g_ptr_array_add(expected, garbage);
+
+	test->expected = expected;
+	feed_stream(test, stream, rand, expected->len);
+	g_assert_cmpuint(test->received, ==, expected->len);
+
+	hdlc_test_free(test);
+	g_ptr_array_unref(expected);
+	g_byte_array_unref(stream);
+	g_rand_free(rand);
+}
+
+static void test_crc(void)
+{
+	GRand *rand = g_rand_new_with_seed(0xcc17);
+	guint8 buf[300];
+	guint i, offset, len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = g_rand_int_range(rand, 0, 0x100);
+
+	/* Known answer for the PPP FCS of "123456789" */
+	g_assert_cmphex(crc_ccitt_update(0xffff, (const guint8 *) "123456789",
+						9) ^ 0xffff, ==, 0x906e);
+
+	for (offset = 0; offset < 8; offset++) {
+		for (len = 0; len < sizeof(buf) - offset; len++) {
+			guint16 crc = 0xffff;
+
+			for (i = 0; i < len; i++)
+				crc = crc_ccitt_byte(crc, buf[offset + i]);
+
+			g_assert_cmphex(crc_ccitt_update(0xffff, buf + offset,
+							len), ==, crc);
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+/* Frames sent by one GAtHDLC must come out of another unchanged */
+static void test_send(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	struct hdlc_test *test = hdlc_test_new(accm);
+	GRand *rand = g_rand_new_with_seed(0x5e4d);
+	GPtrArray *expected = g_ptr_array_new_with_free_func(
+						(GDestroyNotify) g_byte_array_unref);
+	gint64 deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+	GIOChannel *io;
+	GAtHDLC *sender;
+	guint i;
+
+	io = g_io_channel_unix_new(test->fd);
+	sender = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+	g_at_hdlc_set_xmit_accm(sender, accm);
+
+	test->expected = expected;
+
+	for (i = 0; i < 200; i++) {
+		GByteArray *frame = random_frame(rand,
+					g_rand_int_range(rand, 1, MAX_FRAME),
+					i % 2 ? 32 : 0);
+
+		g_assert(g_at_hdlc_send(sender, frame->data, frame->len));
+		g_ptr_array_add(expected, frame);
+
+		/* Let the write queue drain every now and then */
+		while (i % 16 == 15 && test->received < expected->len) {
+			g_assert(g_get_monotonic_time() < deadline);
+			g_main_context_iteration(NULL, FALSE);
+		}
+	}
+
+	while (test->received < expected->len) {
+		g_assert(g_get_monotonic_time() < deadline);
+		g_main_context_iteration(NULL, FALSE);
+	}
+
+	g_at_hdlc_unref(sender);
+	hdlc_test_free(test);
+	g_ptr_array_unref(expected);
+	g_rand_free(rand);
+}
+
+static guint32 get32(const guint8 *p)
+{
+	guint32 val;
+
+	memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+/* Check the capture holds the frames, returns the number of frames */
+static guint check_pcapng(const char *filename, GPtrArray *frames,
+				guint32 direction)
+{
+	const guint8 *p;
+	gchar *contents;
+	gsize len;
+	guint n = 0;
+
+	g_assert(g_file_get_contents(filename, &contents, &len, NULL));
+	p = (const guint8 *) contents;
+
+	/* Section header and the PPP interface description */
+	g_assert_cmpuint(len, >=, 48);
+	g_assert_cmphex(get32(p), ==, 0x0a0d0d0a);
+	g_assert_cmpuint(get32(p + 4), ==, 28);
+	g_assert_cmphex(get32(p + 8), ==, 0x1a2b3c4d);
+	g_assert_cmpuint(get32(p + 28), ==, 1);
+	g_assert_cmpuint(get32(p + 32), ==, 20);
+	g_assert_cmpuint(get32(p + 36) & 0xffff, ==, 9);
+	p += 48;
+
+	while (p < (const guint8 *) contents + len) {
+		GByteArray *frame = g_ptr_array_index(frames, n);
+		guint32 total = get32(p + 4);
+
+		g_assert_cmpuint(get32(p), ==, 6);
+		g_assert_cmpuint(get32(p + 20), ==, frame->len);
+		g_assert(memcmp(p + 28, frame->data, frame->len) == 0);
+		g_assert_cmpuint(get32(p + total - 12), ==, direction);
+		g_assert_cmpuint(get32(p + total - 4), ==, total);
+
+		p += total;
+		n += 1;
+	}
+
+	g_free(contents);
+
+	return n;
+}
+
+static void test_record(void)
+{
+	struct hdlc_test *test = hdlc_test_new(0);
+	GRand *rand = g_rand_new_with_seed(0x7ec0);
+	GPtrArray *expected = g_ptr_array_new_with_free_func(
+						(GDestroyNotify) g_byte_array_unref);
+	gint64 deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+	gchar *dir = g_dir_make_tmp("test-hdlc-XXXXXX", NULL);
+	gchar *tx = g_build_filename(dir, "tx.pcapng", NULL);
+	gchar *rx = g_build_filename(dir, "rx.pcapng", NULL);
+	gchar *dump = g_build_filename(dir, "rx.pppdump", NULL);
+	gchar *contents;
+	gsize len;
+	GIOChannel *io;
+	GAtHDLC *sender;
+	guint i;
+
+	g_assert(dir);
+
+	io = g_io_channel_unix_new(test->fd);
+	sender = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+
+	g_at_hdlc_set_recording(sender, tx);
+	g_at_hdlc_set_recording(test->hdlc, rx);
+
+	test->expected = expected;
+
+	for (i = 0; i < 40; i++) {
+		GByteArray *frame = random_frame(rand,
+					g_rand_int_range(rand, 1, MAX_FRAME),
+					32);
+
+		g_assert(g_at_hdlc_send(sender, frame->data, frame->len));
+		g_ptr_array_add(expected, frame);
+
+		/* Switching over writes out what was recorded so far */
+		if (i == 20) {
+			while (test->received < expected->len) {
+				g_assert(g_get_monotonic_time() < deadline);
+				g_main_context_iteration(NULL, FALSE);
+			}
+
+			g_at_hdlc_set_recording(test->hdlc, dump);
+		}
+	}
+
+	while (test->received < expected->len) {
+		g_assert(g_get_monotonic_time() < deadline);
+		g_main_context_iteration(NULL, FALSE);
+	}
+
+	/* Dropping the recording flushes it */
+	g_at_hdlc_unref(sender);
+	hdlc_test_free(test);
+
+	g_assert_cmpuint(check_pcapng(tx, expected, 2), ==, 40);
+	g_assert_cmpuint(check_pcapng(rx, expected, 1), ==, 21);
+
+	/* The pppdump keeps the raw stream, led by a time stamp record */
+	g_assert(g_file_get_contents(dump, &contents, &len, NULL));
+	g_assert_cmpuint(len, >, 8);
+	g_assert_cmpuint(contents[0], ==, 0x07);
+	g_assert_cmpuint(contents[5], ==, 0x02);
+	g_free(contents);
+
+	unlink(tx);
+	unlink(rx);
+	unlink(dump);
+	rmdir(dir);
+
+	g_free(tx);
+	g_free(rx);
+	g_free(dump);
+	g_free(dir);
+	g_ptr_array_unref(expected);
+	g_rand_free(rand);
+}
+
+static void drain_socket(int fd)
+{
+	char buf[65536];
+
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+}
+
+static void test_send_perf(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	GRand *rand = g_rand_new_with_seed(0x5e4d);
+	GByteArray *frame = random_frame(rand, MAX_FRAME, 0);
+	unsigned int frames = 0;
+	double elapsed;
+	GIOChannel *io;
+	GAtHDLC *sender;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	sender = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+	g_at_hdlc_set_xmit_accm(sender, accm);
+
+	g_test_timer_start();
+
+	do {
+		/* Flush and discard the output once the write queue is full */
+		while (!g_at_hdlc_send(sender, frame->data, frame->len)) {
+			g_main_context_iteration(NULL, FALSE);
+			drain_socket(sv[1]);
+		}
+
+		frames += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	g_test_message("%u frames of %u octets, %.0f frames/s", frames,
+			MAX_FRAME, frames / elapsed);
+	g_test_maximized_result(frames / elapsed, "%.0f frames/s",
+				frames / elapsed);
+
+	g_at_hdlc_unref(sender);
+	close(sv[1]);
+	g_byte_array_unref(frame);
+	g_rand_free(rand);
+}
+
+static void test_crc_perf(void)
+{
+	guint8 buf[MAX_FRAME];
+	unsigned int rounds = 0;
+	double bytewise, block, elapsed;
+	guint16 crc = 0xffff;
+	guint i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7;
+
+	g_test_timer_start();
+
+	do {
+		for (i = 0; i < sizeof(buf); i++)
+			crc = crc_ccitt_byte(crc, buf[i]);
+
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	bytewise = sizeof(buf) * rounds / elapsed;
+	rounds = 0;
+	g_test_timer_start();
+
+	do {
+		crc = crc_ccitt_update(crc, buf, sizeof(buf));
+
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	block = sizeof(buf) * rounds / elapsed;
+
+	g_test_message("bytewise %.1f MB/s, sliced %.1f MB/s (%.1fx), %04x",
+			bytewise / 1e6, block / 1e6, block / bytewise, crc);
+	g_test_maximized_result(block, "crc %.1f MB/s", block / 1e6);
+}
+
+static void test_deframe_perf(gconstpointer data)
+{
+	guint32 accm = GPOINTER_TO_UINT(data);
+	struct hdlc_test *test = hdlc_test_new(accm);
+	GRand *rand = g_rand_new_with_seed(0x7e7d);
+	GByteArray *stream = g_byte_array_new();
+	guint8 flag = 0x7e;
+	guint frames = 0;
+	guint rounds = 0;
+	double elapsed;
+	guint i;
+
+	g_byte_array_append(stream, &flag, 1);
+
+	/* Full sized IP packets of random data in a single stream */
+	for (i = 0; i < 256; i++) {
+		GByteArray *frame = random_frame(rand, MAX_FRAME, 0);
+
+		encode_frame(stream, frame, accm, FALSE);
+		g_byte_array_unref(frame);
+	}
+
+	g_test_timer_start();
+
+	do {
+		frames += 256;
+		feed_stream(test, stream, NULL, frames);
+		rounds += 1;
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	g_test_message("%u frames, %.1f MB/s of payload", test->received,
+			test->bytes / elapsed / 1e6);
+	g_test_maximized_result(stream->len * rounds / elapsed,
+				"deframe %.1f MB/s",
+				stream->len * rounds / elapsed / 1e6);
+
+	hdlc_test_free(test);
+	g_byte_array_unref(stream);
+	g_rand_free(rand);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/testhdlc/deframe default accm",
+				GUINT_TO_POINTER(~0U), test_deframe);
+	g_test_add_data_func("/testhdlc/deframe no accm",
+				GUINT_TO_POINTER(0), test_deframe);
+	g_test_add_data_func("/testhdlc/deframe partial accm",
+				GUINT_TO_POINTER(0x000a0000), test_deframe);
+	g_test_add_func("/testhdlc/crc", test_crc);
+	g_test_add_data_func("/testhdlc/send default accm",
+				GUINT_TO_POINTER(~0U), test_send);
+	g_test_add_data_func("/testhdlc/send no accm",
+				GUINT_TO_POINTER(0), test_send);
+	g_test_add_func("/testhdlc/record", test_record);
+
+	if (g_test_perf()) {
+		g_test_add_func("/testhdlc/perf/crc", test_crc_perf);
+		g_test_add_data_func("/testhdlc/perf/send default accm",
+					GUINT_TO_POINTER(~0U), test_send_perf);
+		g_test_add_data_func("/testhdlc/perf/send no accm",
+					GUINT_TO_POINTER(0), test_send_perf);
+		g_test_add_data_func("/testhdlc/perf/deframe default accm",
+					GUINT_TO_POINTER(~0U),
+					test_deframe_perf);
+		g_test_add_data_func("/testhdlc/perf/deframe no accm",
+					GUINT_TO_POINTER(0), test_deframe_perf);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,109 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+#include "gatio.h"
+
+/* Well past the read worker FIFO and the GAtIO read buffer together */
+#define BURST_SIZE (64 * 1024)
+
+struct io_test {
+	gsize received;
+	gboolean corrupt;
+};
+
+static unsigned char burst_byte(gsize pos)
+{
+	return pos * 7 + pos / 251;
+}
+
+static void burst_read(struct ring_buffer *rbuf, gpointer user_data)
+{
+	struct io_test *test = user_data;
+	unsigned int len;
+
+	while ((len = ring_buffer_len_no_wrap(rbuf)) > 0) {
+		unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+		unsigned int i;
+
+		for (i = 0; i < len; i++)
+			if (buf[i] != burst_byte(test->received + i))
+				test->corrupt = TRUE;
+
+		test->received += len;
+		ring_buffer_drain(rbuf, len);
+	}
+}
+
+/*
+ * The whole burst is queued before the main loop runs, so that the worker
+ * fills its FIFO and waits for room while the FIFO holds more than the
+ * read buffer can take in one go.  Nothing is written afterwards, every
+ * byte has to come through without a further wakeup.
+ */
+static void test_threaded_burst(void)
+{
+	struct io_test test = { 0 };
+	unsigned char buf[BURST_SIZE];
+	gint64 deadline;
+	GIOChannel *channel;
+	GAtIO *io;
+	int sv[2];
+	gsize i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	channel = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	g_at_io_set_threaded_reads(TRUE);
+	io = g_at_io_new_fd(channel);
+	g_at_io_set_threaded_reads(FALSE);
+
+	g_io_channel_unref(channel);
+	g_assert(io);
+
+	g_at_io_set_read_handler(io, burst_read, &test);
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = burst_byte(i);
+
+	g_assert(write(sv[1], buf, sizeof(buf)) == (ssize_t) sizeof(buf));
+
+	/* Let the worker run into the full FIFO */
+	g_usleep(100 * 1000);
+
+	deadline = g_get_monotonic_time() + 2 * G_USEC_PER_SEC;
+
+	while (test.received < sizeof(buf)) {
+		g_assert(g_get_monotonic_time() < deadline);
+		g_main_context_iteration(NULL, FALSE);
+	}
+
+	g_assert_cmpuint(test.received, ==, sizeof(buf));
+	g_assert(!test.corrupt);
+
+	g_at_io_unref(io);
+	close(sv[1]);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testio/threaded_burst", test_threaded_burst);
+
+	return g_test_run();
+}
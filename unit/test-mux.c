@@ -541,6 +541,239 @@ static void test_extract_advanced(void)
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+static void deliver_notify(GAtResult *result, gpointer user_data)
+{
+	guint *count = user_data;
+
+	*count += 1;
+}
+
+static void test_deliver(void)
+{
+	GIOChannel *io;
+	GIOChannel *dlc;
+	GAtSyntax *syntax;
+	GAtChat *chat;
+	GString *input = g_string_new(NULL);
+	guint8 frame[64];
+	gint64 deadline;
+	guint count = 0;
+	gsize sent;
+	int sv[2];
+	int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	mux = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(mux));
+
+	dlc = g_at_mux_create_channel(mux);
+	g_assert(dlc);
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	chat = g_at_chat_new(dlc, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(dlc);
+
+	g_at_chat_register(chat, "+CREG:", deliver_notify, FALSE,
+				&count, NULL);
+
+	/* Small frames, so that lines span several of them */
+	for (i = 0; i < 200; i++) {
+		guint8 line[32];
+		int len = sprintf((char *) line, "\r\n+CREG: %d\r\n", i);
+		int off;
+
+		for (off = 0; off < len; off += 5)
+			g_string_append_len(input, (char *) frame,
+				gsm0710_basic_fill_frame(frame, 1,
+						GSM0710_DATA, line + off,
+						MIN(5, len - off)));
+	}
+
+	deadline = g_get_monotonic_time() + G_USEC_PER_SEC;
+
+	/* Odd sized writes leave partial frames in the mux buffer */
+	for (sent = 0; sent < input->len; sent += 1001) {
+		gsize len = MIN(1001, input->len - sent);
+
+		g_assert(write(sv[1], input->str + sent, len) == (ssize_t) len);
+
+		while (g_main_context_iteration(NULL, FALSE))
+			;
+	}
+
+	while (count < 200) {
+		g_assert(g_get_monotonic_time() < deadline);
+		g_main_context_iteration(NULL, FALSE);
+	}
+
+	g_assert_cmpuint(count, ==, 200);
+
+	g_at_chat_unref(chat);
+	g_at_mux_unref(mux);
+	close(sv[1]);
+	g_string_free(input, TRUE);
+}
+
+struct schedule_data {
+	int fd;
+	GString *stream;
+	guint bulk_frames;
+	guint bulk_frames_at;
+	guint control_frames;
+};
+
+static gboolean bulk_write(GIOChannel *channel, GIOCondition cond,
+				gpointer user_data)
+{
+	static const gchar bulk[4096];
+	gsize written;
+
+	g_io_channel_write_chars(channel, bulk, sizeof(bulk), &written, NULL);
+
+	return TRUE;
+}
+
+static gboolean control_write(GIOChannel *channel, GIOCondition cond,
+				gpointer user_data)
+{
+	gsize written;
+
+	g_io_channel_write_chars(channel, "AT\r", 3, &written, NULL);
+
+	return FALSE;
+}
+
+/* Spin the main loop, sorting the data frames written by the mux */
+static void schedule_spin(struct schedule_data *data, guint iterations)
+{
+	guint8 buf[4096];
+	guint8 *frame;
+	guint8 dlc;
+	guint8 ctrl;
+	int frame_len;
+	int nread;
+	ssize_t len;
+
+	while (iterations--) {
+		g_main_context_iteration(NULL, FALSE);
+
+		len = recv(data->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len > 0)
+			g_string_append_len(data->stream, (char *) buf, len);
+
+		while ((nread = gsm0710_basic_extract_frame(
+					(guint8 *) data->stream->str,
+					data->stream->len, &dlc, &ctrl,
+					&frame, &frame_len)) > 0) {
+			g_string_erase(data->stream, 0, nread);
+
+			if (frame == NULL || ctrl != GSM0710_DATA)
+				continue;
+
+			if (dlc == 1)
+				data->bulk_frames += 1;
+			else if (dlc == 2)
+				data->control_frames += 1;
+		}
+	}
+}
+
+static void schedule_status(int fd, guint8 dlc, guint8 status)
+{
+	guint8 msc[] = { GSM0710_STATUS_SET, 0x05, (dlc << 2) | 0x03,
+				status };
+	guint8 frame[16];
+	int len;
+
+	len = gsm0710_basic_fill_frame(frame, 0, GSM0710_DATA,
+					msc, sizeof(msc));
+	g_assert(write(fd, frame, len) == len);
+}
+
+static void test_schedule(void)
+{
+	struct schedule_data data = { 0 };
+	GAtMuxChannelStats stats;
+	GIOChannel *io;
+	GIOChannel *bulk;
+	GIOChannel *control;
+	guint bulk_watch;
+	guint frames;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	data.fd = sv[1];
+	data.stream = g_string_new(NULL);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	mux = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(mux));
+	g_assert(g_at_mux_set_write_quantum(mux, 8));
+
+	bulk = g_at_mux_create_channel(mux);
+	g_io_channel_set_encoding(bulk, NULL, NULL);
+	g_io_channel_set_buffered(bulk, FALSE);
+
+	control = g_at_mux_create_channel(mux);
+	g_io_channel_set_encoding(control, NULL, NULL);
+	g_io_channel_set_buffered(control, FALSE);
+	g_assert(g_at_mux_set_channel_priority(mux, control, 4));
+	g_assert(!g_at_mux_set_channel_priority(mux, control, 0));
+
+	bulk_watch = g_io_add_watch(bulk, G_IO_OUT, bulk_write, NULL);
+	schedule_spin(&data, 50);
+	g_assert_cmpuint(data.bulk_frames, >, 0);
+
+	/* A command queued behind the bulk writer goes out in one quantum */
+	g_io_add_watch(control, G_IO_OUT, control_write, NULL);
+	frames = data.bulk_frames;
+
+	while (data.control_frames == 0)
+		schedule_spin(&data, 1);
+
+	g_assert_cmpuint(data.bulk_frames - frames, <=, 8);
+
+	g_assert(g_at_mux_get_channel_stats(mux, control, &stats));
+	g_assert_cmpuint(stats.priority, ==, 4);
+	g_assert_cmpuint(stats.tx_frames, ==, 1);
+	g_assert_cmpuint(stats.tx_bytes, ==, 3);
+
+	/* Nothing goes out on a DLC while the other side has FC set */
+	schedule_status(sv[1], 1, 0x03);
+	schedule_spin(&data, 50);
+	frames = data.bulk_frames;
+	schedule_spin(&data, 50);
+	g_assert_cmpuint(data.bulk_frames, ==, frames);
+
+	g_assert(g_at_mux_get_channel_stats(mux, bulk, &stats));
+	g_assert(stats.throttled);
+
+	schedule_status(sv[1], 1, 0x0D);
+	schedule_spin(&data, 50);
+	g_assert_cmpuint(data.bulk_frames, >, frames);
+
+	g_source_remove(bulk_watch);
+	g_io_channel_unref(bulk);
+	g_io_channel_unref(control);
+	g_at_mux_unref(mux);
+	close(sv[1]);
+	g_string_free(data.stream, TRUE);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -549,6 +782,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/fill_advanced", test_fill_advanced);
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
+	g_test_add_func("/testmux/deliver", test_deliver);
+	g_test_add_func("/testmux/schedule", test_schedule);
 	g_test_add_func("/testmux/basic", test_basic);
 
 	return g_test_run();
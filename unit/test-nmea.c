@@ -0,0 +1,216 @@
+/*
+ * oFono - Open Source Telephony
+ * Copyright (C) 2008-2011  Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "nmea.h"
+
+static const char rmc[] =
+	"$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,"
+	"003.1,W*6A\r\n";
+static const char gga[] =
+	"$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,"
+	"*47\r\n";
+static const char gsv[] =
+	"$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45"
+	"*75\r\n";
+
+struct collect {
+	struct nmea_fix fixes[4];
+	unsigned int n_fixes;
+	unsigned int n_lines;
+	size_t line_bytes;
+};
+
+static void collect_fix(const struct nmea_fix *fix, void *user_data)
+{
+	struct collect *c = user_data;
+
+	assert(c->n_fixes < L_ARRAY_SIZE(c->fixes));
+	c->fixes[c->n_fixes++] = *fix;
+}
+
+static void collect_line(const char *line, size_t len, void *user_data)
+{
+	struct collect *c = user_data;
+
+	assert(line[len - 1] == '\n');
+
+	c->n_lines += 1;
+	c->line_bytes += len;
+}
+
+static struct nmea_parser *parser_new(struct collect *c)
+{
+	struct nmea_parser *parser = nmea_parser_new();
+
+	memset(c, 0, sizeof(*c));
+	nmea_parser_set_fix_func(parser, collect_fix, c);
+	nmea_parser_set_sentence_func(parser, collect_line, c);
+
+	return parser;
+}
+
+static bool near(double a, double b)
+{
+	return fabs(a - b) < 1e-6;
+}
+
+static void test_parse_rmc(void)
+{
+	struct nmea_fix fix;
+
+	assert(nmea_parse_sentence(rmc, strlen(rmc) - 2, &fix));
+	assert(fix.sentences == NMEA_SENTENCE_RMC);
+	assert(fix.time == 45319000);
+	assert(fix.date == 230394);
+	assert(near(fix.latitude, 48 + 7.038 / 60));
+	assert(near(fix.longitude, 11 + 31.0 / 60));
+	assert(near(fix.speed, 22.4 * 1852 / 3600));
+	assert(near(fix.course, 84.4));
+	assert(isnan(fix.altitude));
+}
+
+static void test_parse_gga(void)
+{
+	struct nmea_fix fix;
+
+	assert(nmea_parse_sentence(gga, strlen(gga) - 2, &fix));
+	assert(fix.sentences == NMEA_SENTENCE_GGA);
+	assert(fix.quality == 1);
+	assert(fix.satellites == 8);
+	assert(near(fix.hdop, 0.9));
+	assert(near(fix.altitude, 545.4));
+	assert(isnan(fix.speed));
+}
+
+static void test_parse_invalid(void)
+{
+	static const char bad_sum[] =
+		"$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,"
+		"46.9,M,,*48";
+	static const char no_sum[] = "$GPRMC,123519,V,,,,,,,230394,,";
+	static const char no_fix[] = "$GPRMC,123519,V,,,,,,,230394,,*33";
+	struct nmea_fix fix;
+
+	assert(!nmea_parse_sentence(bad_sum, strlen(bad_sum), &fix));
+	assert(!nmea_parse_sentence(no_sum, strlen(no_sum), &fix));
+	assert(!nmea_parse_sentence(gsv, strlen(gsv) - 2, &fix));
+
+	assert(nmea_parse_sentence(no_fix, strlen(no_fix), &fix));
+	assert(isnan(fix.latitude));
+}
+
+static void test_merge(void)
+{
+	struct nmea_parser *parser;
+	struct collect c;
+
+	parser = parser_new(&c);
+
+	nmea_parser_feed(parser, rmc, strlen(rmc));
+	nmea_parser_feed(parser, gsv, strlen(gsv));
+	assert(c.n_fixes == 0);
+
+	nmea_parser_feed(parser, gga, strlen(gga));
+	assert(c.n_fixes == 1);
+	assert(c.fixes[0].sentences ==
+			(NMEA_SENTENCE_RMC | NMEA_SENTENCE_GGA));
+	assert(c.fixes[0].date == 230394);
+	assert(c.fixes[0].satellites == 8);
+	assert(near(c.fixes[0].altitude, 545.4));
+	assert(near(c.fixes[0].course, 84.4));
+
+	assert(c.n_lines == 3);
+	assert(c.line_bytes == strlen(rmc) + strlen(gsv) + strlen(gga));
+
+	nmea_parser_free(parser);
+}
+
+static void test_epoch_change(void)
+{
+	static const char next[] = "$GPRMC,123520,V,,,,,,,230394,,*39\r\n";
+	struct nmea_parser *parser;
+	struct collect c;
+
+	parser = parser_new(&c);
+
+	nmea_parser_feed(parser, rmc, strlen(rmc));
+	nmea_parser_feed(parser, next, strlen(next));
+
+	assert(c.n_fixes == 1);
+	assert(c.fixes[0].sentences == NMEA_SENTENCE_RMC);
+	assert(c.fixes[0].time == 45319000);
+
+	nmea_parser_free(parser);
+}
+
+static void test_split_feed(void)
+{
+	char stream[512];
+	struct nmea_parser *parser;
+	struct collect c;
+	size_t len;
+	size_t i;
+
+	len = snprintf(stream, sizeof(stream), "%s%s%s", gsv, rmc, gga);
+	parser = parser_new(&c);
+
+	/* One byte at a time, every line goes through the line buffer */
+	for (i = 0; i < len; i++)
+		nmea_parser_feed(parser, stream + i, 1);
+
+	assert(c.n_lines == 3);
+	assert(c.line_bytes == len);
+	assert(c.n_fixes == 1);
+
+	nmea_parser_free(parser);
+}
+
+static void test_overlong_line(void)
+{
+	char stream[512];
+	struct nmea_parser *parser;
+	struct collect c;
+
+	memset(stream, 'x', 300);
+	stream[300] = '\n';
+	parser = parser_new(&c);
+
+	nmea_parser_feed(parser, stream, 150);
+	nmea_parser_feed(parser, stream + 150, 151);
+	nmea_parser_feed(parser, rmc, strlen(rmc));
+
+	assert(c.n_lines == 1);
+	assert(c.line_bytes == strlen(rmc));
+
+	nmea_parser_free(parser);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testnmea/Parse RMC", test_parse_rmc);
+	g_test_add_func("/testnmea/Parse GGA", test_parse_gga);
+	g_test_add_func("/testnmea/Parse invalid", test_parse_invalid);
+	g_test_add_func("/testnmea/Merge epoch", test_merge);
+	g_test_add_func("/testnmea/Epoch change", test_epoch_change);
+	g_test_add_func("/testnmea/Split feed", test_split_feed);
+	g_test_add_func("/testnmea/Overlong line", test_overlong_line);
+
+	return g_test_run();
+}
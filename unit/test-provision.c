@@ -243,21 +243,11 @@ static const struct provision_test lookup_no_match = {
 	.result = -ENOENT,
 };
 
-static void provision_lookup(const void *data)
+static void check_items(const struct provision_test *test,
+				const struct provision_db_entry *items,
+				size_t n_items)
 {
-	const struct provision_test *test = data;
-	struct provision_db_entry *items;
-	_auto_(l_strv_free) char **tags = l_strsplit(test->tags, ',');
-	size_t n_items;
 	size_t i;
-	int r;
-
-	r = provision_db_lookup(pdb, test->mcc, test->mnc, test->spn, tags,
-					&items, &n_items);
-	assert(r == test->result);
-
-	if (r < 0)
-		return;
 
 	assert(n_items == test->n_items);
 	for (i = 0; i < n_items; i++) {
@@ -274,10 +264,111 @@ static void provision_lookup(const void *data)
 		assert(l_streq0(b->message_proxy, a->message_proxy));
 		assert(l_streq0(b->message_center, a->message_center));
 	}
+}
+
+static void provision_lookup(const void *data)
+{
+	const struct provision_test *test = data;
+	struct provision_db_entry *items;
+	_auto_(l_strv_free) char **tags = l_strsplit(test->tags, ',');
+	size_t n_items;
+	int r;
+
+	r = provision_db_lookup(pdb, test->mcc, test->mnc, test->spn, tags,
+					&items, &n_items);
+	assert(r == test->result);
+
+	if (r < 0)
+		return;
 
+	check_items(test, items, n_items);
 	l_free(items);
 }
 
+static void provision_lookup_shared(const void *data)
+{
+	const struct provision_test *test = data;
+	struct provision_db_result *first = NULL;
+	struct provision_db_result *second = NULL;
+	_auto_(l_strv_free) char **tags = l_strsplit(test->tags, ',');
+	int r;
+
+	r = provision_db_lookup_shared(pdb, test->mcc, test->mnc, test->spn,
+					tags, &first);
+	assert(r == test->result);
+
+	/* The second lookup is answered from the cache */
+	r = provision_db_lookup_shared(pdb, test->mcc, test->mnc, test->spn,
+					tags, &second);
+	assert(r == test->result);
+
+	if (r < 0) {
+		assert(!first && !second);
+		return;
+	}
+
+	assert(first == second);
+	check_items(test, second->items, second->n_items);
+
+	provision_db_result_unref(first);
+	provision_db_result_unref(second);
+}
+
+static void provision_lookup_batch(const void *data)
+{
+	const struct provision_test *tests[] = {
+		&unknown_mcc_mnc, &lookup_beta, &two_digit_mnc,
+		&fallback_no_spn, &fallback_no_spn_2, &lookup_alpha,
+		&lookup_zyx, &lookup_charlie, &lookup_no_match,
+	};
+	struct provision_db_query queries[L_ARRAY_SIZE(tests)];
+	size_t i;
+
+	for (i = 0; i < L_ARRAY_SIZE(tests); i++) {
+		queries[i].mcc = tests[i]->mcc;
+		queries[i].mnc = tests[i]->mnc;
+		queries[i].spn = tests[i]->spn;
+	}
+
+	provision_db_lookup_batch(pdb, NULL, queries, L_ARRAY_SIZE(queries));
+
+	for (i = 0; i < L_ARRAY_SIZE(tests); i++) {
+		assert(queries[i].error == tests[i]->result);
+
+		if (queries[i].error < 0) {
+			assert(!queries[i].result);
+			continue;
+		}
+
+		check_items(tests[i], queries[i].result->items,
+				queries[i].result->n_items);
+		provision_db_result_unref(queries[i].result);
+	}
+}
+
+static void provision_result_outlives_db(const void *data)
+{
+	const struct provision_test *test = data;
+	struct provision_db *replaced;
+	struct provision_db_result *result = NULL;
+	int r;
+
+	replaced = provision_db_new(UNITDIR "test-provision.db");
+	assert(replaced);
+	assert(provision_db_is_current(replaced,
+					UNITDIR "test-provision.db"));
+
+	r = provision_db_lookup_shared(replaced, test->mcc, test->mnc,
+					test->spn, NULL, &result);
+	assert(r == 0);
+
+	/* A reload frees the old database while results are still in use */
+	provision_db_free(replaced);
+	check_items(test, result->items, result->n_items);
+
+	provision_db_result_unref(result);
+}
+
 int main(int argc, char **argv)
 {
 	int r;
@@ -297,6 +388,15 @@ int main(int argc, char **argv)
 	l_test_add("Exact match (XYZ)", provision_lookup, &lookup_lte_xyz);
 	l_test_add("Exact match (XYZ 5G)", provision_lookup, &lookup_5g_xyz);
 	l_test_add("Exact math (no match)", provision_lookup, &lookup_no_match);
+	l_test_add("Shared lookup (Beta)", provision_lookup_shared,
+							&lookup_beta);
+	l_test_add("Shared lookup (XYZ 5G)", provision_lookup_shared,
+							&lookup_5g_xyz);
+	l_test_add("Shared lookup (no match)", provision_lookup_shared,
+							&lookup_no_match);
+	l_test_add("Batch lookup", provision_lookup_batch, NULL);
+	l_test_add("Result outlives db", provision_result_outlives_db,
+							&lookup_beta);
 
 	pdb = provision_db_new(UNITDIR "test-provision.db");
 	assert(pdb);
@@ -0,0 +1,185 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <ell/ell.h>
+
+#include "qmi-replay.h"
+
+/*
+ * OFONO_QMI_IO_DEBUG output, with the ASCII column trimmed: discovery, a
+ * NAS request answered together with an indication in one read, a WDS
+ * request with its response and a broadcast indication, a WMS request the
+ * capture ends before answering and a NAS indication received over QRTR
+ */
+static const char capture[] =
+	"QMI: > 01 0b 00 00 00 00 00 01 21 00 00 00\n"
+	"QMI: >   CTL_req msg=33 len=0 [client=0,type=0,tid=1,len=11]\n"
+	"QMI: < 01 12 00 80 00 00 01 01 21 00 07 00 02 04 00 00\n"
+	"QMI:   00 00 00\n"
+	"QMI: > 01 0c 00 00 03 01 00 01 00 24 00 00 00\n"
+	"QMI: >   NAS_req msg=36 len=0 [client=1,type=0,tid=1,len=12]\n"
+	"QMI: < 01 17 00 80 03 01 02 01 00 24 00 0b 00 02 04 00\n"
+	"QMI:   00 00 00 00 01 01 00 04 01 10 00 80 03 01 04 00\n"
+	"QMI:   00 51 00 04 00 01 01 00 01\n"
+	"QMI: > 01 17 00 00 01 02 00 01 00 20 00 0b 00 14 08 00\n"
+	"QMI:   69 6e 74 65 72 6e 65 74\n"
+	"QMI: < 01 1a 00 80 01 02 02 01 00 20 00 0e 00 02 04 00\n"
+	"QMI:   00 00 00 00 01 04 00 34 12 00 00\n"
+	"QMI: < 01 10 00 80 01 ff 04 00 00 22 00 04 00 01 01 00\n"
+	"QMI:   02\n"
+	"QMI: > 01 0c 00 00 05 03 00 01 00 22 00 00 00\n"
+	"QRTR: < 04 00 00 4f 00 05 00 10 02 00 01 00\n"
+	"QRTR:     NAS_ind msg=79 len=6 [client=0,type=4,tid=0,len=13]\n";
+
+struct replay_counts {
+	unsigned int nas_response;
+	unsigned int nas_indication;
+	unsigned int wds_response;
+	unsigned int wds_indication;
+	unsigned int wms_response;
+	unsigned int total;
+};
+
+static void count_result(const char *name, unsigned int count,
+				uint64_t total_ns, uint64_t max_ns,
+				void *user_data)
+{
+	struct replay_counts *counts = user_data;
+
+	if (!strcmp(name, "NAS response"))
+		counts->nas_response += count;
+	else if (!strcmp(name, "NAS indication"))
+		counts->nas_indication += count;
+	else if (!strcmp(name, "WDS response"))
+		counts->wds_response += count;
+	else if (!strcmp(name, "WDS indication"))
+		counts->wds_indication += count;
+	else if (!strcmp(name, "WMS response"))
+		counts->wms_response += count;
+
+	assert(max_ns <= total_ns);
+	counts->total += count;
+}
+
+static void test_replay(const void *data)
+{
+	struct qmi_replay *replay = qmi_replay_new();
+	struct replay_counts counts = { 0 };
+	struct qmi_replay_stats stats;
+
+	assert(qmi_replay_parse(replay, capture) == 8);
+
+	assert(qmi_replay_run(replay, 1, &stats));
+	assert(stats.requests == 3);
+	assert(stats.responses == 3);
+	assert(stats.indications == 3);
+
+	/* The capture ends before the WMS response */
+	assert(stats.synthesized == 1);
+
+	/* Once more with everything in flight at once */
+	assert(qmi_replay_run(replay, 8, &stats));
+	assert(stats.responses == 3);
+	assert(stats.indications == 3);
+
+	qmi_replay_foreach_result(replay, count_result, &counts);
+	assert(counts.nas_response == 2);
+	assert(counts.nas_indication == 4);
+	assert(counts.wds_response == 2);
+	assert(counts.wds_indication == 2);
+	assert(counts.wms_response == 2);
+	assert(counts.total == 12);
+
+	qmi_replay_free(replay);
+}
+
+static void test_replay_empty(const void *data)
+{
+	struct qmi_replay *replay = qmi_replay_new();
+	struct qmi_replay_stats stats;
+
+	assert(qmi_replay_parse(replay, "QMI: < 01 ff\n"
+					"QRTR: < 02 00 00 01 00 00 00\n"
+					"QMI: > 01 05 00 00 00\n") == 0);
+
+	assert(qmi_replay_run(replay, 1, &stats));
+	assert(stats.requests == 0);
+
+	qmi_replay_free(replay);
+}
+
+static const uint8_t fuzz_mux_length[] = {
+	0x01, 0xff, 0xff, 0x80, 0x03, 0x01, 0x04, 0x00, 0x00, 0x24, 0x00,
+};
+
+static const uint8_t fuzz_msg_length[] = {
+	0x01, 0x0c, 0x00, 0x80, 0x03, 0x01, 0x04, 0x00, 0x00, 0x24, 0x00,
+	0xff, 0x00,
+};
+
+static const uint8_t fuzz_ctl_length[] = {
+	0x01, 0x0a, 0x00, 0x80, 0x00, 0x00, 0x01, 0x01, 0x21, 0x00, 0xff,
+};
+
+static const uint8_t fuzz_short_header[] = {
+	0x01, 0x03, 0x00, 0x80,
+};
+
+static const uint8_t fuzz_tlv_length[] = {
+	0x00, 0x02, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0xff, 0xff,
+	0x41,
+};
+
+static const uint8_t fuzz_string[] = {
+	0x02, 0x10, 0x05, 0x00, 'h', 'e', 'l', 'l', 'o', 0x11, 0x00, 0x00,
+};
+
+static void test_fuzz(const void *data)
+{
+	static const struct {
+		const uint8_t *data;
+		size_t len;
+	} inputs[] = {
+		{ fuzz_mux_length, sizeof(fuzz_mux_length) },
+		{ fuzz_msg_length, sizeof(fuzz_msg_length) },
+		{ fuzz_ctl_length, sizeof(fuzz_ctl_length) },
+		{ fuzz_short_header, sizeof(fuzz_short_header) },
+		{ fuzz_tlv_length, sizeof(fuzz_tlv_length) },
+		{ fuzz_string, sizeof(fuzz_string) },
+		{ NULL, 0 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(inputs); i++)
+		qmi_replay_fuzz(inputs[i].data, inputs[i].len);
+
+	qmi_replay_fuzz_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	int result;
+
+	l_main_init();
+
+	l_test_init(&argc, &argv);
+	l_test_add("QMI replay", test_replay, NULL);
+	l_test_add("QMI replay without records", test_replay_empty, NULL);
+	l_test_add("QMI fuzz entry points", test_fuzz, NULL);
+	result = l_test_run();
+
+	l_main_exit();
+
+	return result;
+}
@@ -460,15 +460,35 @@ static void test_send_data(const void *data)
 	qmi_service_free(service);
 }
 
+struct test_fields {
+	uint8_t data;
+	uint16_t missing;
+};
+
 static void notify_cb(struct qmi_result *result, void *user_data)
 {
+	static const struct qmi_result_field fields[] = {
+		{ TEST_TLV_TYPE + 1, QMI_RESULT_FIELD_UINT16,
+			offsetof(struct test_fields, missing) },
+		{ TEST_TLV_TYPE, QMI_RESULT_FIELD_UINT8,
+			offsetof(struct test_fields, data) },
+		{ TEST_TLV_TYPE, QMI_RESULT_FIELD_UINT16,
+			offsetof(struct test_fields, missing) },
+	};
 	struct test_info *info = user_data;
+	struct test_fields decoded = { .missing = 0xffff };
 	uint8_t data;
 
 	assert(!qmi_result_set_error(result, NULL));
 	assert(qmi_result_get_uint8(result, TEST_TLV_TYPE, &data));
 	assert(data == TEST_IND_DATA_VALUE);
 
+	/* Absent TLVs and a length mismatch leave the members alone */
+	assert(qmi_result_get_fields(result, fields, L_ARRAY_SIZE(fields),
+					&decoded) == 1 << 1);
+	assert(decoded.data == TEST_IND_DATA_VALUE);
+	assert(decoded.missing == 0xffff);
+
 	info->notify_callback_called = true;
 }
 
@@ -498,6 +518,8 @@ static void test_notifications(const void *data)
 	while (!info->notify_callback_called)
 		l_main_iterate(-1);
 
+	assert(qmi_service_get_indication_count(service) == 1);
+
 	qmi_service_free(service);
 
 	/* Confirm no notifications received after the service is destroyed */
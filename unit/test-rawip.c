@@ -0,0 +1,88 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+#include "gatutil.h"
+
+#define BUFFER_SIZE 256
+
+/* IPv4 packet without payload */
+static const unsigned char ipv4_packet[] = {
+	0x45, 0x00, 0x00, 0x14, 0x00, 0x00, 0x40, 0x00,
+	0x40, 0x11, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x01,
+	0x0a, 0x00, 0x00, 0x02,
+};
+
+/* IPv4 header claiming the largest total length there is */
+static const unsigned char ipv4_oversize[] = {
+	0x45, 0x00, 0xff, 0xff, 0x00, 0x00,
+};
+
+/* IPv6 header with a payload beyond the buffer */
+static const unsigned char ipv6_oversize[] = {
+	0x60, 0x00, 0x00, 0x00, 0x01, 0x00,
+};
+
+/* Drops what can't be a packet, as the tun writer does */
+static int next_packet_len(struct ring_buffer *rbuf)
+{
+	int len;
+
+	while ((len = g_at_util_ip_packet_len(rbuf)) < 0)
+		ring_buffer_drain(rbuf, 1);
+
+	return len;
+}
+
+static void test_packet(void)
+{
+	struct ring_buffer *rbuf = ring_buffer_new(BUFFER_SIZE);
+
+	ring_buffer_write(rbuf, ipv4_packet, 10);
+	g_assert_cmpint(next_packet_len(rbuf), ==, 0);
+
+	ring_buffer_write(rbuf, ipv4_packet + 10, sizeof(ipv4_packet) - 10);
+	g_assert_cmpint(next_packet_len(rbuf), ==, sizeof(ipv4_packet));
+
+	ring_buffer_free(rbuf);
+}
+
+/*
+ * A length beyond the buffer can never be completed, the parser has to
+ * skip it and find the packet behind
+ */
+static void test_oversize(gconstpointer data)
+{
+	const unsigned char *header = data;
+	struct ring_buffer *rbuf = ring_buffer_new(BUFFER_SIZE);
+
+	ring_buffer_write(rbuf, header, 6);
+	ring_buffer_write(rbuf, ipv4_packet, sizeof(ipv4_packet));
+
+	g_assert_cmpint(next_packet_len(rbuf), ==, sizeof(ipv4_packet));
+	g_assert_cmpint(ring_buffer_len(rbuf), ==, sizeof(ipv4_packet));
+
+	ring_buffer_free(rbuf);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testrawip/packet", test_packet);
+	g_test_add_data_func("/testrawip/ipv4_oversize", ipv4_oversize,
+				test_oversize);
+	g_test_add_data_func("/testrawip/ipv6_oversize", ipv6_oversize,
+				test_oversize);
+
+	return g_test_run();
+}
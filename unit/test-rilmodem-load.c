@@ -0,0 +1,559 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <ofono/modem.h>
+#include <ofono/types.h>
+#include <ofono/netreg.h>
+#include <ofono/netmon.h>
+#include <ofono/sms.h>
+#include <gril.h>
+
+#include "common.h"
+#include "ril_constants.h"
+#include "rilmodem-test-engine.h"
+
+static unsigned long alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCS
+
+/*
+ * Count allocations by interposing the allocator, glibc provides the
+ * underlying implementation under these names.  The sanitizers bring
+ * their own allocator, which must not be bypassed.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+/*
+ * RIL_UNSOL_SIGNAL_STRENGTH, RIL_SignalStrength_v6 with a GSM signal
+ * strength of 20 to 23 and no LTE measurements.  The drivers drop repeated
+ * measurements, so that consecutive records differ.
+ */
+static const unsigned char unsol_signal_strength_20[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0xf1, 0x03, 0x00, 0x00,
+	0x14, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x7f,
+	0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f
+};
+
+static const unsigned char unsol_signal_strength_21[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0xf1, 0x03, 0x00, 0x00,
+	0x15, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x7f,
+	0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f
+};
+
+static const unsigned char unsol_signal_strength_22[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0xf1, 0x03, 0x00, 0x00,
+	0x16, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x7f,
+	0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f
+};
+
+static const unsigned char unsol_signal_strength_23[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0xf1, 0x03, 0x00, 0x00,
+	0x17, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x7f,
+	0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f
+};
+
+/* RIL_REQUEST_SIGNAL_STRENGTH reply carrying the same measurements */
+static const unsigned char rsp_signal_strength[] = {
+	0x14, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0x63, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x7f,
+	0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x7f
+};
+
+/*
+ * RIL_UNSOL_CELL_INFO_LIST with one registered GSM cell:
+ * mcc=214, mnc=07, lac=0x1234, cid=0x5678, rssi=20 to 22, ber=0
+ */
+static const unsigned char unsol_cell_info_list_20[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xd6, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x34, 0x12, 0x00, 0x00,
+	0x78, 0x56, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const unsigned char unsol_cell_info_list_21[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xd6, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x34, 0x12, 0x00, 0x00,
+	0x78, 0x56, 0x00, 0x00, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const unsigned char unsol_cell_info_list_22[] = {
+	0x00, 0x00, 0x00, 0x38, 0x01, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xd6, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x34, 0x12, 0x00, 0x00,
+	0x78, 0x56, 0x00, 0x00, 0x16, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/*
+ * RIL_UNSOL_RESPONSE_NEW_SMS with the PDU
+ * 07914306073011F0040B914336543980F50000310113212002400AC8373B0C6AD7DDE437
+ */
+static const unsigned char unsol_new_sms[] = {
+	0x00, 0x00, 0x00, 0xA0, 0x01, 0x00, 0x00, 0x00, 0xEB, 0x03, 0x00, 0x00,
+	0x48, 0x00, 0x00, 0x00, 0x30, 0x00, 0x37, 0x00, 0x39, 0x00, 0x31, 0x00,
+	0x34, 0x00, 0x33, 0x00, 0x30, 0x00, 0x36, 0x00, 0x30, 0x00, 0x37, 0x00,
+	0x33, 0x00, 0x30, 0x00, 0x31, 0x00, 0x31, 0x00, 0x46, 0x00, 0x30, 0x00,
+	0x30, 0x00, 0x34, 0x00, 0x30, 0x00, 0x42, 0x00, 0x39, 0x00, 0x31, 0x00,
+	0x34, 0x00, 0x33, 0x00, 0x33, 0x00, 0x36, 0x00, 0x35, 0x00, 0x34, 0x00,
+	0x33, 0x00, 0x39, 0x00, 0x38, 0x00, 0x30, 0x00, 0x46, 0x00, 0x35, 0x00,
+	0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x33, 0x00, 0x31, 0x00,
+	0x30, 0x00, 0x31, 0x00, 0x31, 0x00, 0x33, 0x00, 0x32, 0x00, 0x31, 0x00,
+	0x32, 0x00, 0x30, 0x00, 0x30, 0x00, 0x32, 0x00, 0x34, 0x00, 0x30, 0x00,
+	0x30, 0x00, 0x41, 0x00, 0x43, 0x00, 0x38, 0x00, 0x33, 0x00, 0x37, 0x00,
+	0x33, 0x00, 0x42, 0x00, 0x30, 0x00, 0x43, 0x00, 0x36, 0x00, 0x41, 0x00,
+	0x44, 0x00, 0x37, 0x00, 0x44, 0x00, 0x44, 0x00, 0x45, 0x00, 0x34, 0x00,
+	0x33, 0x00, 0x37, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* A handset mostly sees measurements, with the odd SMS in between */
+static const struct rilmodem_test_load_record load_records[] = {
+	{ unsol_signal_strength_20, sizeof(unsol_signal_strength_20) },
+	{ unsol_cell_info_list_20, sizeof(unsol_cell_info_list_20) },
+	{ unsol_signal_strength_21, sizeof(unsol_signal_strength_21) },
+	{ unsol_cell_info_list_21, sizeof(unsol_cell_info_list_21) },
+	{ unsol_signal_strength_22, sizeof(unsol_signal_strength_22) },
+	{ unsol_cell_info_list_22, sizeof(unsol_cell_info_list_22) },
+	{ unsol_signal_strength_23, sizeof(unsol_signal_strength_23) },
+	{ unsol_new_sms, sizeof(unsol_new_sms) },
+};
+
+static const struct rilmodem_test_load_response load_responses[] = {
+	{
+		.req = RIL_REQUEST_SIGNAL_STRENGTH,
+		.data = rsp_signal_strength,
+		.size = sizeof(rsp_signal_strength),
+	},
+};
+
+struct notify_counts {
+	unsigned int strength;
+	unsigned int status;
+	unsigned int time;
+	unsigned int serving_cell;
+	unsigned int sms;
+};
+
+/* Declarations && Re-implementations of core functions. */
+struct load_data {
+	GRil *ril;
+	struct engine_data *engined;
+	struct ofono_netreg *netreg;
+	struct ofono_netmon *netmon;
+	struct ofono_sms *sms;
+	unsigned int registered;
+	struct notify_counts notify;
+};
+
+struct ofono_netreg {
+	void *driver_data;
+	struct load_data *ld;
+};
+
+struct ofono_netmon {
+	void *driver_data;
+	struct load_data *ld;
+};
+
+struct ofono_sms {
+	void *driver_data;
+	struct load_data *ld;
+};
+
+extern struct ofono_driver_desc __start___netreg[];
+extern struct ofono_driver_desc __start___netmon[];
+extern struct ofono_driver_desc __start___sms[];
+
+static const struct ofono_netreg_driver *netreg_drv;
+static const struct ofono_netmon_driver *netmon_drv;
+static const struct ofono_sms_driver *sms_drv;
+
+/* The stream only starts once all three atoms listen for it */
+static void atom_registered(struct load_data *ld)
+{
+	if (++ld->registered == 3)
+		rilmodem_test_engine_load_start(ld->engined);
+}
+
+void ofono_netreg_set_data(struct ofono_netreg *netreg, void *data)
+{
+	netreg->driver_data = data;
+}
+
+void *ofono_netreg_get_data(struct ofono_netreg *netreg)
+{
+	return netreg->driver_data;
+}
+
+void ofono_netreg_register(struct ofono_netreg *netreg)
+{
+	atom_registered(netreg->ld);
+}
+
+void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
+{
+	/* GSM signal strengths 20 to 23 */
+	g_assert(strength == 64 || strength == 67 || strength == 70 ||
+							strength == 74);
+
+	netreg->ld->notify.strength += 1;
+	rilmodem_test_engine_load_handled(netreg->ld->engined);
+}
+
+void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
+					int lac, int ci, int tech)
+{
+	netreg->ld->notify.status += 1;
+}
+
+void ofono_netreg_time_notify(struct ofono_netreg *netreg,
+				struct ofono_network_time *info)
+{
+	netreg->ld->notify.time += 1;
+}
+
+void ofono_netmon_set_data(struct ofono_netmon *netmon, void *data)
+{
+	netmon->driver_data = data;
+}
+
+void *ofono_netmon_get_data(struct ofono_netmon *netmon)
+{
+	return netmon->driver_data;
+}
+
+void ofono_netmon_register(struct ofono_netmon *netmon)
+{
+	atom_registered(netmon->ld);
+}
+
+void ofono_netmon_serving_cell_notify(struct ofono_netmon *netmon,
+					enum ofono_netmon_cell_type type,
+					int info_type, ...)
+{
+	g_assert(type == OFONO_NETMON_CELL_TYPE_GSM);
+
+	netmon->ld->notify.serving_cell += 1;
+	rilmodem_test_engine_load_handled(netmon->ld->engined);
+}
+
+void ofono_sms_set_data(struct ofono_sms *sms, void *data)
+{
+	sms->driver_data = data;
+}
+
+void *ofono_sms_get_data(struct ofono_sms *sms)
+{
+	return sms->driver_data;
+}
+
+void ofono_sms_register(struct ofono_sms *sms)
+{
+	atom_registered(sms->ld);
+}
+
+void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
+							int len, int tpdu_len)
+{
+	g_assert(len == 36 && tpdu_len == 28);
+
+	sms->ld->notify.sms += 1;
+	rilmodem_test_engine_load_handled(sms->ld->engined);
+}
+
+void ofono_sms_status_notify(struct ofono_sms *sms, const unsigned char *pdu,
+							int len, int tpdu_len)
+{
+	ofono_sms_deliver_notify(sms, pdu, len, tpdu_len);
+}
+
+static void strength_cb(const struct ofono_error *error, int strength,
+								void *data)
+{
+	struct load_data *ld = data;
+
+	g_assert(error->type == OFONO_ERROR_TYPE_NO_ERROR);
+	g_assert(strength == 64);
+
+	rilmodem_test_engine_load_handled(ld->engined);
+}
+
+static void load_request(void *data)
+{
+	struct load_data *ld = data;
+
+	netreg_drv->strength(ld->netreg, strength_cb, ld);
+}
+
+static void server_connect_cb(gpointer data)
+{
+	struct load_data *ld = data;
+	int retval;
+
+	netreg_drv = __start___netreg[0].driver;
+	netmon_drv = __start___netmon[0].driver;
+	sms_drv = __start___sms[0].driver;
+
+	retval = netreg_drv->probe(ld->netreg, OFONO_RIL_VENDOR_AOSP, ld->ril);
+	g_assert(retval == 0);
+
+	retval = netmon_drv->probe(ld->netmon, OFONO_RIL_VENDOR_AOSP, ld->ril);
+	g_assert(retval == 0);
+
+	retval = sms_drv->probe(ld->sms, OFONO_RIL_VENDOR_AOSP, ld->ril);
+	g_assert(retval == 0);
+}
+
+/*
+ * Pushes load->count records through gril and the netreg, netmon and sms
+ * drivers, returning the engine statistics, the allocations made on the
+ * way and the notifications the core got, each of which could emit a
+ * D-Bus signal in the daemon.
+ */
+static void run_load(const struct rilmodem_test_load *load,
+			struct rilmodem_test_load_stats *stats,
+			unsigned long *allocs, struct notify_counts *notify)
+{
+	static const struct rilmodem_test_data no_steps;
+	struct load_data *ld = g_new0(struct load_data, 1);
+
+	ld->netreg = g_new0(struct ofono_netreg, 1);
+	ld->netreg->ld = ld;
+	ld->netmon = g_new0(struct ofono_netmon, 1);
+	ld->netmon->ld = ld;
+	ld->sms = g_new0(struct ofono_sms, 1);
+	ld->sms->ld = ld;
+
+	ld->engined = rilmodem_test_engine_create(&server_connect_cb,
+							&no_steps, ld);
+
+	ld->ril = g_ril_new(rilmodem_test_engine_get_socket_name(ld->engined),
+							OFONO_RIL_VENDOR_AOSP);
+	g_assert(ld->ril != NULL);
+
+	*allocs = alloc_count;
+	rilmodem_test_engine_run_load(ld->engined, load, stats);
+	*allocs = alloc_count - *allocs;
+	*notify = ld->notify;
+
+	sms_drv->remove(ld->sms);
+	netmon_drv->remove(ld->netmon);
+	netreg_drv->remove(ld->netreg);
+	g_ril_unref(ld->ril);
+
+	rilmodem_test_engine_remove(ld->engined);
+
+	g_free(ld->sms);
+	g_free(ld->netmon);
+	g_free(ld->netreg);
+	g_free(ld);
+}
+
+static void print_stats(const struct rilmodem_test_load_stats *stats,
+			unsigned long allocs, const struct notify_counts *notify)
+{
+	unsigned int messages = stats->unsolicited + stats->responses;
+
+	printf("%u unsolicited, %u requests (%u issued), %u responses\n",
+		stats->unsolicited, stats->requests, stats->issued,
+		stats->responses);
+	printf("%u messages, %zu bytes in %.3fs, %.3fs CPU\n",
+		messages, stats->bytes, stats->elapsed, stats->cpu);
+	printf("%.0f messages/s, %.2f us CPU per message\n",
+		stats->elapsed > 0 ? messages / stats->elapsed : 0.0,
+		messages ? stats->cpu * 1e6 / messages : 0.0);
+#ifdef COUNT_ALLOCS
+	printf("%lu allocations, %.1f per message\n", allocs,
+		messages ? (double) allocs / messages : 0.0);
+#endif
+	printf("Notifications: strength %u, serving cell %u, sms %u, "
+		"status %u, time %u\n", notify->strength,
+		notify->serving_cell, notify->sms, notify->status,
+		notify->time);
+}
+
+static void check_load(const struct rilmodem_test_load *load,
+			const struct rilmodem_test_load_stats *stats,
+			const struct notify_counts *notify)
+{
+	unsigned int sms = load->count / G_N_ELEMENTS(load_records);
+
+	g_assert(stats->unsolicited == load->count);
+	g_assert(stats->handled == stats->unsolicited + stats->issued);
+	g_assert(stats->issued == load->count / load->request_interval);
+
+	/* Every request was answered, SMS acks and setup included */
+	g_assert(stats->responses == stats->requests);
+	g_assert(stats->requests >= stats->issued + sms);
+
+	g_assert(notify->sms == sms);
+	g_assert(notify->strength + notify->serving_cell + notify->sms ==
+							load->count);
+}
+
+static const struct rilmodem_test_load load_burst = {
+	.unsol = load_records,
+	.num_unsol = G_N_ELEMENTS(load_records),
+	.responses = load_responses,
+	.num_responses = G_N_ELEMENTS(load_responses),
+	.count = 800,
+	.window = 16,
+	.request = load_request,
+	.request_interval = 10,
+};
+
+static const struct rilmodem_test_load load_paced = {
+	.unsol = load_records,
+	.num_unsol = G_N_ELEMENTS(load_records),
+	.responses = load_responses,
+	.num_responses = G_N_ELEMENTS(load_responses),
+	.count = 80,
+	.rate = 1000,
+	.window = 4,
+	.request = load_request,
+	.request_interval = 20,
+};
+
+static void test_load(gconstpointer data)
+{
+	const struct rilmodem_test_load *load = data;
+	struct rilmodem_test_load_stats stats;
+	struct notify_counts notify;
+	unsigned long allocs;
+
+	run_load(load, &stats, &allocs, &notify);
+	check_load(load, &stats, &notify);
+
+	if (g_test_verbose())
+		print_stats(&stats, allocs, &notify);
+}
+
+static gint option_count;
+static gint option_rate;
+static gint option_window = 16;
+static gint option_interval = 10;
+
+static GOptionEntry options[] = {
+	{ "count", 0, 0, G_OPTION_ARG_INT, &option_count,
+			"Benchmark with this many unsolicited records", "N" },
+	{ "rate", 0, 0, G_OPTION_ARG_INT, &option_rate,
+			"Records per second, 0 for unpaced", "RATE" },
+	{ "window", 0, 0, G_OPTION_ARG_INT, &option_window,
+			"Records and requests unhandled at once", "N" },
+	{ "request-interval", 0, 0, G_OPTION_ARG_INT, &option_interval,
+			"Records between signal strength queries", "N" },
+	{ NULL },
+};
+
+static int benchmark(void)
+{
+	struct rilmodem_test_load load = load_burst;
+	struct rilmodem_test_load_stats stats;
+	struct notify_counts notify;
+	unsigned long allocs;
+
+	if (option_count <= 0 || option_rate < 0 || option_window <= 0 ||
+			option_interval < 0) {
+		fprintf(stderr, "Invalid load\n");
+		return EXIT_FAILURE;
+	}
+
+	load.count = option_count;
+	load.rate = option_rate;
+	load.window = option_window;
+	load.request_interval = option_interval;
+
+	run_load(&load, &stats, &allocs, &notify);
+	print_stats(&stats, allocs, &notify);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+
+	context = g_option_context_new(NULL);
+	g_option_context_set_ignore_unknown_options(context, TRUE);
+	g_option_context_set_help_enabled(context, FALSE);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &err) == FALSE) {
+		fprintf(stderr, "%s\n", err->message);
+		g_error_free(err);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+/*
+ * As all our architectures are little-endian except for
+ * PowerPC, and the Binder wire-format differs slightly
+ * depending on endian-ness, the following guards against test
+ * failures when run on PowerPC.
+ */
+#if BYTE_ORDER == LITTLE_ENDIAN
+	if (option_count)
+		return benchmark();
+#endif
+
+	g_test_init(&argc, &argv, NULL);
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+	g_test_add_data_func("/test-rilmodem-load/burst", &load_burst,
+								test_load);
+	g_test_add_data_func("/test-rilmodem-load/paced", &load_paced,
+								test_load);
+#endif
+	return g_test_run();
+}
@@ -0,0 +1,303 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatserver.h"
+
+#define PREFIX_COUNT 64
+
+struct server_test {
+	GAtServer *server;
+	int fd;
+	GString *response;
+	guint hits[PREFIX_COUNT];
+	char *prefixes[PREFIX_COUNT];
+};
+
+struct handler_data {
+	struct server_test *test;
+	guint index;
+};
+
+static void generic_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *result, gpointer user_data)
+{
+	struct handler_data *data = user_data;
+	struct server_test *test = data->test;
+	GAtResultIter iter;
+	char buf[64];
+
+	test->hits[data->index] += 1;
+
+	g_at_result_iter_init(&iter, result);
+	g_assert(g_at_result_iter_next(&iter, ""));
+
+	switch (type) {
+	case G_AT_SERVER_REQUEST_TYPE_QUERY:
+		snprintf(buf, sizeof(buf), "%s: 1,0,0",
+				test->prefixes[data->index]);
+		g_at_server_send_info(server, buf, TRUE);
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+		break;
+	case G_AT_SERVER_REQUEST_TYPE_SET:
+	case G_AT_SERVER_REQUEST_TYPE_COMMAND_ONLY:
+	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+		break;
+	default:
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+		break;
+	}
+}
+
+static void register_prefix(struct server_test *test, guint index)
+{
+	struct handler_data *data = g_new0(struct handler_data, 1);
+
+	data->test = test;
+	data->index = index;
+
+	g_assert(g_at_server_register(test->server, test->prefixes[index],
+					generic_cb, data, g_free));
+}
+
+static struct server_test *server_test_new(void)
+{
+	struct server_test *test = g_new0(struct server_test, 1);
+	static const char *known[] = { "+CIND", "+CLCC", "+BRSF", "+CHLD",
+					"+CMER", "+VGS", "+VGM", "+CLIP" };
+	GIOChannel *io;
+	int sv[2];
+	guint i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	test->server = g_at_server_new(io);
+	g_io_channel_unref(io);
+	g_assert(test->server);
+
+	g_at_server_set_echo(test->server, FALSE);
+
+	test->fd = sv[1];
+	test->response = g_string_new(NULL);
+
+	for (i = 0; i < PREFIX_COUNT; i++) {
+		if (i < G_N_ELEMENTS(known))
+			test->prefixes[i] = g_strdup(known[i]);
+		else
+			test->prefixes[i] = g_strdup_printf("+X%c%02u",
+							'A' + i % 26, i);
+
+		register_prefix(test, i);
+	}
+
+	return test;
+}
+
+static void server_test_free(struct server_test *test)
+{
+	guint i;
+
+	g_at_server_unref(test->server);
+	close(test->fd);
+
+	for (i = 0; i < PREFIX_COUNT; i++)
+		g_free(test->prefixes[i]);
+
+	g_string_free(test->response, TRUE);
+	g_free(test);
+}
+
+static gboolean response_complete(GString *response)
+{
+	return g_str_has_suffix(response->str, "\r\nOK\r\n") ||
+		g_str_has_suffix(response->str, "\r\nERROR\r\n");
+}
+
+/* Write the line and spin the main loop until a final result arrives */
+static const char *exchange(struct server_test *test, const char *line)
+{
+	gsize len = strlen(line);
+	gint64 deadline = g_get_monotonic_time() + G_USEC_PER_SEC;
+	char buf[1024];
+
+	g_string_truncate(test->response, 0);
+	g_assert(write(test->fd, line, len) == (ssize_t) len);
+
+	while (!response_complete(test->response)) {
+		ssize_t n;
+
+		g_assert(g_get_monotonic_time() < deadline);
+		g_main_context_iteration(NULL, FALSE);
+
+		n = recv(test->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n > 0)
+			g_string_append_len(test->response, buf, n);
+	}
+
+	return test->response->str;
+}
+
+static void test_lookup(void)
+{
+	struct server_test *test = server_test_new();
+	char *line;
+	guint i;
+
+	for (i = 0; i < PREFIX_COUNT; i++) {
+		line = g_strdup_printf("AT%s?\r", test->prefixes[i]);
+		g_assert(g_str_has_suffix(exchange(test, line), "\r\nOK\r\n"));
+		g_free(line);
+
+		line = g_strdup_printf("\r\n%s: 1,0,0\r\n", test->prefixes[i]);
+		g_assert(g_str_has_prefix(test->response->str, line));
+		g_free(line);
+
+		g_assert_cmpuint(test->hits[i], ==, 1);
+	}
+
+	/* Concatenated commands are looked up one by one */
+	exchange(test, "AT+CIND=?;+CLCC;+BRSF=1\r");
+	g_assert_cmpstr(test->response->str, ==, "\r\nOK\r\n");
+	g_assert_cmpuint(test->hits[0], ==, 2);
+	g_assert_cmpuint(test->hits[1], ==, 2);
+	g_assert_cmpuint(test->hits[2], ==, 2);
+
+	/* A prefix of a registered command is not a match */
+	g_assert_cmpstr(exchange(test, "AT+CIN?\r"), ==, "\r\nERROR\r\n");
+	g_assert_cmpstr(exchange(test, "AT+CINDX?\r"), ==, "\r\nERROR\r\n");
+
+	/* Lookups follow registrations made after the first command */
+	g_assert(g_at_server_unregister(test->server, "+CLCC"));
+	g_assert_cmpstr(exchange(test, "AT+CLCC\r"), ==, "\r\nERROR\r\n");
+	g_assert_cmpuint(test->hits[1], ==, 2);
+
+	register_prefix(test, 1);
+	g_assert_cmpstr(exchange(test, "AT+CLCC\r"), ==, "\r\nOK\r\n");
+	g_assert_cmpuint(test->hits[1], ==, 3);
+
+	server_test_free(test);
+}
+
+static void dial_cb(GAtServer *server, GAtServerRequestType type,
+			GAtResult *result, gpointer user_data)
+{
+	char **dialed = user_data;
+
+	g_free(*dialed);
+	*dialed = g_strdup(result->lines->data);
+
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+}
+
+/*
+ * The copy pass must not start in the string state the sizing pass ended
+ * in, a line with an odd number of quotes would keep or drop the wrong
+ * blanks and could outgrow its buffer
+ */
+static void test_unbalanced_quote(void)
+{
+	struct server_test *test = server_test_new();
+	char *dialed = NULL;
+
+	g_assert(g_at_server_register(test->server, "D", dial_cb,
+					&dialed, NULL));
+
+	exchange(test, "ATD12 34\"\r");
+	g_assert_cmpstr(dialed, ==, "1234\"");
+
+	exchange(test, "ATD\"12 34\r");
+	g_assert_cmpstr(dialed, ==, "\"12 34");
+
+	g_free(dialed);
+	server_test_free(test);
+}
+
+static void test_fuzz(void)
+{
+	/* Leave out E, Q, S and V which would change the response format */
+	static const char alphabet[] = "+CINDLBHGMXA0123456789=?;,\" &";
+	struct server_test *test = server_test_new();
+	GRand *rand = g_rand_new_with_seed(0x590a7);
+	GString *line = g_string_new(NULL);
+	guint i, j;
+
+	for (i = 0; i < 2000; i++) {
+		guint len = g_rand_int_range(rand, 1, 48);
+
+		g_string_assign(line, "AT");
+
+		/* Mostly keep close to real commands */
+		if (g_rand_boolean(rand))
+			g_string_append(line, test->prefixes[
+					g_rand_int_range(rand, 0, PREFIX_COUNT)]);
+
+		for (j = 0; j < len; j++)
+			g_string_append_c(line, alphabet[g_rand_int_range(rand,
+					0, sizeof(alphabet) - 1)]);
+
+		g_string_append_c(line, '\r');
+
+		exchange(test, line->str);
+
+		/* Whatever the line did, the server must still respond */
+		g_assert_cmpstr(exchange(test, "AT\r"), ==, "\r\nOK\r\n");
+	}
+
+	g_string_free(line, TRUE);
+	g_rand_free(rand);
+	server_test_free(test);
+}
+
+static void test_dispatch_perf(void)
+{
+	struct server_test *test = server_test_new();
+	unsigned int commands = 0;
+	double elapsed;
+
+	g_test_timer_start();
+
+	do {
+		exchange(test, "AT+CIND?;+CLCC;+XZ25?;+VGS=7\r");
+		commands += 4;
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	g_test_message("%u commands in %.3fs, %.0f commands/s", commands,
+			elapsed, commands / elapsed);
+	g_test_maximized_result(commands / elapsed, "%.0f commands/s",
+				commands / elapsed);
+
+	server_test_free(test);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testserver/lookup", test_lookup);
+	g_test_add_func("/testserver/unbalanced_quote", test_unbalanced_quote);
+	g_test_add_func("/testserver/fuzz", test_fuzz);
+
+	if (g_test_perf())
+		g_test_add_func("/testserver/perf/dispatch",
+					test_dispatch_perf);
+
+	return g_test_run();
+}
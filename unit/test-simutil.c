@@ -392,6 +392,98 @@ static void test_eons(void)
 	sim_eons_free(eons_info);
 }
 
+/*
+ * Overlapping LAC ranges, wildcard digits and catch-all records, looked
+ * up before and after the records were indexed.
+ */
+static void test_eons_index(void)
+{
+	static const char digits[] = "246";
+	const struct sim_eons_operator_info *expected[54][81];
+	struct sim_eons *eons;
+	unsigned int seed = 1;
+	uint8_t record[8];
+	char mcc[4];
+	char mnc[4];
+	int matched = 0;
+	int pass;
+	int i;
+	int p;
+	int lac;
+
+	eons = sim_eons_new(32);
+
+	for (i = 0; i < 400; i++) {
+		uint16_t low;
+		uint16_t high;
+
+		seed = seed * 1103515245 + 12345;
+
+		record[0] = 0x02 | ((seed >> 8) % 3 == 0 ? 0xd0 : 0x40);
+		record[1] = 0x06 | ((seed >> 10) % 2 ? 0xf0 : 0x20);
+		/* MCC 2x6 and MNC xx or xx2, a few with a wildcard digit */
+		record[2] = 2 + 2 * ((seed >> 12) % 3);
+
+		if ((seed >> 14) % 5)
+			record[2] |= (2 + 2 * ((seed >> 16) % 3)) << 4;
+		else
+			record[2] |= 0xd0;
+
+		low = (seed >> 18) % 64;
+		high = low + (seed >> 24) % 16;
+
+		if ((seed >> 28) % 8 == 0) {
+			low = 0;
+			high = 0xfffe;
+		}
+
+		record[3] = low >> 8;
+		record[4] = low & 0xff;
+		record[5] = high >> 8;
+		record[6] = high & 0xff;
+		record[7] = 1 + i % 32;
+
+		sim_eons_add_opl_record(eons, record, sizeof(record));
+	}
+
+	for (pass = 0; pass < 2; pass++) {
+		for (p = 0; p < 54; p++) {
+			mcc[0] = '2';
+			mcc[1] = digits[p % 3];
+			mcc[2] = '6';
+			mcc[3] = '\0';
+			mnc[0] = digits[(p / 3) % 3];
+			mnc[1] = digits[(p / 9) % 3];
+			mnc[2] = p >= 27 ? '2' : '\0';
+			mnc[3] = '\0';
+
+			/* Slot 0 is the lookup without a LAC */
+			for (lac = 0; lac <= 80; lac++) {
+				const struct sim_eons_operator_info *info;
+
+				if (lac == 0)
+					info = sim_eons_lookup(eons, mcc, mnc);
+				else
+					info = sim_eons_lookup_with_lac(eons,
+							mcc, mnc, lac - 1);
+
+				if (pass == 0) {
+					expected[p][lac] = info;
+					matched += info != NULL;
+				} else {
+					g_assert(expected[p][lac] == info);
+				}
+			}
+		}
+
+		g_assert(matched > 0 && matched < 54 * 81);
+
+		sim_eons_optimize(eons);
+	}
+
+	sim_eons_free(eons);
+}
+
 static void test_ef_db(void)
 {
 	struct sim_ef_info *info;
@@ -404,6 +496,15 @@ static void test_ef_db(void)
 
 	info = sim_ef_db_lookup(0x2F05);
 	g_assert(info);
+
+	info = sim_ef_db_lookup(0x6F00);
+	g_assert(info == NULL);
+
+	info = sim_ef_db_lookup(0x6FDE);
+	g_assert(info && info->id == 0x6FDE);
+
+	info = sim_ef_db_lookup(0x7FFF);
+	g_assert(info && info->id == 0x7FFF);
 }
 
 static const char *binary_ef = "62178202412183022F058A01058B032F060F8002000A"
@@ -488,9 +589,21 @@ static void test_get_3g_path(void)
 	unsigned int len;
 	unsigned char path1[] = { 0x3F, 0x00, 0x7F, 0xFF };
 
+	unsigned char path2[] = { 0x3F, 0x00, 0x7F, 0x10, 0x5F, 0x50 };
+
 	len = sim_ef_db_get_path_3g(SIM_EFPNN_FILEID, path);
 	g_assert(len == 4);
 	g_assert(!memcmp(path, path1, len));
+
+	len = sim_ef_db_get_path_3g(0x4F20, path);
+	g_assert(len == 6);
+	g_assert(!memcmp(path, path2, len));
+
+	len = sim_ef_db_get_path_3g(SIM_EFPHASE_FILEID, path);
+	g_assert(len == 0);
+
+	len = sim_ef_db_get_path_3g(0x6FB1, path);
+	g_assert(len == 0);
 }
 
 static void test_get_2g_path(void)
@@ -746,6 +859,7 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/ber tlv encode 3G Status response",
 			test_ber_tlv_builder_3g_status);
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
+	g_test_add_func("/testsimutil/EONS index", test_eons_index);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
 	g_test_add_func("/testsimutil/Application entries decoding",
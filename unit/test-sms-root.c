@@ -75,7 +75,7 @@ static void test_serialize_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -102,12 +102,62 @@ static void test_serialize_assembly(void)
 	sms_assembly_free(assembly);
 }
 
+static GSList *add_fragment(struct sms_assembly *assembly,
+				const char *hex, int tpdu_len)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+
+	decode_hex_own_buf(hex, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, tpdu_len, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+
+	return sms_assembly_add_fragment(assembly, &sms, time(NULL),
+					&sms.deliver.oaddr, ref, max, seq);
+}
+
+static void test_deferred_restore(void)
+{
+	struct sms_assembly *assembly = sms_assembly_new("1235");
+	GSList *l;
+
+	g_assert(add_fragment(assembly, assembly_pdu1,
+					assembly_pdu_len1) == NULL);
+	g_assert(add_fragment(assembly, assembly_pdu2,
+					assembly_pdu_len2) == NULL);
+	sms_assembly_free(assembly);
+
+	/* Nothing is read before the restore */
+	assembly = sms_assembly_new_deferred("1235");
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	sms_assembly_restore(assembly);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	/* A second restore must not read the fragments again */
+	sms_assembly_restore(assembly);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	l = add_fragment(assembly, assembly_pdu3, assembly_pdu_len3);
+	g_assert(l != NULL);
+	g_assert(g_slist_length(l) == 3);
+
+	g_slist_free_full(l, g_free);
+	sms_assembly_free(assembly);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test SMS Assembly Deferred Restore",
+			test_deferred_restore);
 
 	return g_test_run();
 }
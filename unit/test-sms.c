@@ -1026,17 +1026,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1082,6 +1082,176 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+static void test_assembly_interleaved(void)
+{
+	const char *pdus[] = { assembly_pdu1, assembly_pdu2, assembly_pdu3 };
+	int pdu_lens[] = { assembly_pdu_len1, assembly_pdu_len2,
+				assembly_pdu_len3 };
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	struct sms frags[3];
+	struct sms_address other;
+	unsigned char pdu[176];
+	long pdu_len;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	GSList *l;
+	char *first;
+	char *second;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		decode_hex_own_buf(pdus[i], -1, &pdu_len, 0, pdu);
+		g_assert(sms_decode(pdu, pdu_len, FALSE, pdu_lens[i],
+					&frags[i]));
+	}
+
+	other = frags[0].deliver.oaddr;
+	strcpy(other.address, "5551234");
+
+	/* Two senders with the same reference, the second one older */
+	sms_extract_concatenation(&frags[2], &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &frags[2], 100,
+					&frags[2].deliver.oaddr, ref, max, seq);
+	g_assert(l == NULL);
+
+	l = sms_assembly_add_fragment(assembly, &frags[2], 50, &other,
+					ref, max, seq);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 2);
+
+	/* Duplicates, a different max and an out of range seq are dropped */
+	l = sms_assembly_add_fragment(assembly, &frags[2], 100,
+					&frags[2].deliver.oaddr, ref, max, seq);
+	g_assert(l == NULL);
+	l = sms_assembly_add_fragment(assembly, &frags[1], 100,
+					&frags[1].deliver.oaddr, ref, max + 1,
+					seq - 1);
+	g_assert(l == NULL);
+	l = sms_assembly_add_fragment(assembly, &frags[1], 100,
+					&frags[1].deliver.oaddr, ref, max,
+					max + 1);
+	g_assert(l == NULL);
+
+	/* Only the older message expires */
+	sms_assembly_expire(assembly, 60);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	l = sms_assembly_add_fragment(assembly, &frags[2], 110, &other,
+					ref, max, seq);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 2);
+
+	sms_extract_concatenation(&frags[0], &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &frags[0], 110, &other,
+					ref, max, seq);
+	g_assert(l == NULL);
+
+	/* Fragments out of order still come back in sequence */
+	for (i = 0; i < 2; i++) {
+		sms_extract_concatenation(&frags[i], &ref, &max, &seq);
+		l = sms_assembly_add_fragment(assembly, &frags[i], 120,
+						&frags[i].deliver.oaddr,
+						ref, max, seq);
+	}
+
+	g_assert(l != NULL);
+	g_assert(g_slist_length(l) == 3);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	first = sms_decode_text(l);
+	g_slist_free_full(l, g_free);
+
+	sms_extract_concatenation(&frags[1], &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &frags[1], 130, &other,
+					ref, max, seq);
+	g_assert(l != NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	second = sms_decode_text(l);
+	g_slist_free_full(l, g_free);
+
+	g_assert(!strcmp(first, second));
+
+	g_free(first);
+	g_free(second);
+
+	sms_extract_concatenation(&frags[0], &ref, &max, &seq);
+	l = sms_assembly_add_fragment(assembly, &frags[0], 140, &other,
+					ref, max, seq);
+	g_assert(l == NULL);
+
+	sms_assembly_expire(assembly, 200);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	sms_assembly_free(assembly);
+}
+
+static void check_decode_text_own_buf(GSList *l)
+{
+	char *expected = sms_decode_text(l);
+	size_t len = strlen(expected);
+	char *buf = l_malloc(len + 1);
+	size_t size;
+
+	g_assert(sms_decode_text_own_buf(l, NULL, 0) == len);
+
+	memset(buf, 0xff, len + 1);
+	g_assert(sms_decode_text_own_buf(l, buf, len + 1) == len);
+	g_assert(!strcmp(buf, expected));
+
+	/* Truncated results stop on a character boundary */
+	for (size = 1; size <= len; size++) {
+		memset(buf, 0xff, len + 1);
+		g_assert(sms_decode_text_own_buf(l, buf, size) == len);
+		g_assert(strlen(buf) < size);
+		g_assert(!strncmp(buf, expected, strlen(buf)));
+		g_assert(l_utf8_validate(buf, strlen(buf), NULL));
+	}
+
+	l_free(buf);
+	g_free(expected);
+}
+
+static void test_decode_text_own_buf(void)
+{
+	static const char *gsm = "Price: 10\u20ac [approx] {final} ~ ok";
+	static const char *turkish = "Pijamal\u0131 hasta ya\u011f\u0131z "
+					"\u015fof\u00f6re \u00e7abucak "
+					"g\u00fcvendi.";
+	static const char *ucs2 = "\u041f\u0440\u0438\u0432\u0435\u0442 "
+					"\U0001f600!";
+	GString *str = g_string_new(NULL);
+	GSList *l;
+	int i;
+
+	l = sms_text_prepare("555", gsm, 0, FALSE, FALSE);
+	check_decode_text_own_buf(l);
+	g_slist_free_full(l, g_free);
+
+	for (i = 0; i < 8; i++)
+		g_string_append(str, turkish);
+
+	l = sms_text_prepare_with_alphabet("555", str->str, 1, FALSE, FALSE,
+						SMS_ALPHABET_TURKISH);
+	g_assert(g_slist_length(l) > 1);
+	check_decode_text_own_buf(l);
+	g_slist_free_full(l, g_free);
+
+	/* Surrogate pairs may straddle fragments */
+	g_string_truncate(str, 0);
+
+	for (i = 0; i < 20; i++)
+		g_string_append(str, ucs2);
+
+	l = sms_text_prepare("555", str->str, 2, FALSE, FALSE);
+	g_assert(g_slist_length(l) > 1);
+	check_decode_text_own_buf(l);
+	g_slist_free_full(l, g_free);
+
+	g_string_free(str, TRUE);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1396,14 +1566,14 @@ static void test_cbs_assembly(void)
 	/* Add an initial page to the assembly */
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_table) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Can we receive new updates ? */
 	dec1.update_number = 8;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_table) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Do we ignore old pages ? */
@@ -1416,7 +1586,7 @@ static void test_cbs_assembly(void)
 	g_assert(l == NULL);
 
 	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
-	g_assert(assembly->recv_cell == NULL);
+	g_assert(g_hash_table_size(assembly->recv_table) == 0);
 
 	dec1.update_number = 9;
 	dec1.page = 3;
@@ -1455,6 +1625,72 @@ static void test_cbs_assembly(void)
 	cbs_assembly_free(assembly);
 }
 
+static void test_cbs_assembly_storm(void)
+{
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	unsigned char *decoded_pdu;
+	size_t pdu_len;
+	struct cbs dec;
+	GSList *l;
+	int i;
+
+	decoded_pdu = l_util_from_hexstring(cbs1, &pdu_len);
+	cbs_decode(decoded_pdu, pdu_len, &dec);
+	l_free(decoded_pdu);
+
+	dec.max_pages = 2;
+	dec.page = 1;
+
+	g_assert(!cbs_assembly_has_page(assembly, &dec));
+
+	/* Repeats of a page are dropped until the message completes */
+	for (i = 0; i < 100; i++) {
+		l = cbs_assembly_add_page(assembly, &dec);
+		g_assert(l == NULL);
+		g_assert(cbs_assembly_has_page(assembly, &dec));
+	}
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	dec.page = 2;
+	g_assert(!cbs_assembly_has_page(assembly, &dec));
+	l = cbs_assembly_add_page(assembly, &dec);
+	g_assert(g_slist_length(l) == 2);
+	g_slist_free_full(l, g_free);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+	g_assert(!cbs_assembly_has_page(assembly, &dec));
+
+	/* And so are repeats of the completed message */
+	for (i = 0; i < 100; i++) {
+		dec.page = i % 2 + 1;
+		l = cbs_assembly_add_page(assembly, &dec);
+		g_assert(l == NULL);
+	}
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	/* The received serials kept are bounded */
+	dec.max_pages = 1;
+	dec.page = 1;
+
+	for (i = 0; i < 1000; i++) {
+		dec.message_identifier = i;
+		l = cbs_assembly_add_page(assembly, &dec);
+		g_assert(l);
+		g_slist_free_full(l, g_free);
+	}
+
+	g_assert(g_hash_table_size(assembly->recv_table) <= 256);
+	g_assert(g_hash_table_size(assembly->recv_table) ==
+			assembly->recv_lru.length);
+
+	/* The most recently received ones are still suppressed */
+	l = cbs_assembly_add_page(assembly, &dec);
+	g_assert(l == NULL);
+
+	cbs_assembly_free(assembly);
+}
+
 static void test_cbs_padding_character(void)
 {
 	unsigned char *decoded_pdu;
@@ -1541,6 +1777,23 @@ static void test_range_minimizer(void)
 	}
 }
 
+static void test_cbs_topic_bitmap(void)
+{
+	unsigned char *bitmap = l_new(unsigned char, CBS_TOPIC_BITMAP_SIZE);
+	GSList *r = cbs_extract_topic_ranges("1,5-10,999");
+	unsigned int topic;
+
+	g_assert(r);
+	cbs_topic_bitmap_add_ranges(bitmap, r);
+
+	for (topic = 0; topic < 65536; topic++)
+		g_assert(cbs_topic_bitmap_test(bitmap, topic) ==
+				cbs_topic_in_range(topic, r));
+
+	g_slist_free_full(r, g_free);
+	l_free(bitmap);
+}
+
 static void test_sr_assembly(void)
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1639,6 +1892,50 @@ static void test_sr_assembly(void)
 	status_report_assembly_free(sra);
 }
 
+static void test_sr_assembly_index(void)
+{
+	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
+				"940A00";
+	struct sms sr1;
+	unsigned char pdu[176];
+	long pdu_len;
+	struct status_report_assembly *sra;
+	gboolean delivered;
+	struct sms_address addr;
+	struct sms_address other;
+	unsigned char sha1[SMS_MSGID_LEN] = { 1 };
+	unsigned char sha2[SMS_MSGID_LEN] = { 2 };
+	unsigned char sha3[SMS_MSGID_LEN] = { 3 };
+	unsigned char id[SMS_MSGID_LEN];
+
+	decode_hex_own_buf(sr_pdu1, -1, &pdu_len, 0, pdu);
+	g_assert(sms_decode(pdu, pdu_len, FALSE, 26, &sr1) == TRUE);
+	g_assert(sr1.status_report.mr == 4);
+
+	__sms_address_from_string(&addr, "+4915259911630");
+	__sms_address_from_string(&other, "+4915259911631");
+
+	sra = status_report_assembly_new(NULL);
+
+	/* Same reference to another address first, must not be matched */
+	status_report_assembly_add_fragment(sra, sha1, &other, 4, 100, 1);
+	status_report_assembly_add_fragment(sra, sha2, &addr, 4, 200, 1);
+	status_report_assembly_add_fragment(sra, sha3, &addr, 5, 300, 1);
+
+	g_assert(status_report_assembly_report(sra, &sr1, id, &delivered));
+	g_assert(memcmp(id, sha2, SMS_MSGID_LEN) == 0);
+	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
+
+	/* Expiry goes by age, not by reference */
+	status_report_assembly_expire(sra, 100);
+	g_assert(g_hash_table_size(sra->assembly_table) == 1);
+
+	status_report_assembly_expire(sra, 300);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	status_report_assembly_free(sra);
+}
+
 struct wap_push_data {
 	const char *pdu;
 	int len;
@@ -1767,6 +2064,10 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Interleaved",
+			test_assembly_interleaved);
+	g_test_add_func("/testsms/Test Decode Text Own Buffer",
+			test_decode_text_own_buf);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1789,13 +2090,18 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsms/Test CBS Encode / Decode",
 			test_cbs_encode_decode);
 	g_test_add_func("/testsms/Test CBS Assembly", test_cbs_assembly);
+	g_test_add_func("/testsms/Test CBS Assembly Storm",
+			test_cbs_assembly_storm);
 
 	g_test_add_func("/testsms/Test CBS Padding Character",
 			test_cbs_padding_character);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/CBS Topic Bitmap", test_cbs_topic_bitmap);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
+	g_test_add_func("/testsms/Status Report Assembly Index",
+			test_sr_assembly_index);
 
 	g_test_add_data_func("/testsms/Test WAP Push 1", &wap_push_1,
 				test_wap_push);
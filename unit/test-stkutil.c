@@ -24,6 +24,7 @@
 #include "util.h"
 
 #include "stk-test-data.h"
+#include "stk-fuzz.h"
 
 #define MAX_ITEM 100
 
@@ -22251,2094 +22252,2334 @@ static void test_img_to_xpm(gconstpointer data)
 	g_free(xpm);
 }
 
+static void test_img_serialize(gconstpointer data)
+{
+	const struct img_xpm_test *test = data;
+	struct stk_image *image;
+	struct stk_image *copy;
+	uint8_t *buf;
+	size_t len;
+	char *xpm;
+
+	image = stk_image_decode(test->img, test->len, test->scheme,
+					test->clut, test->clut_len);
+	g_assert(image);
+
+	buf = stk_image_serialize(image, &len);
+	g_assert(stk_image_deserialize(buf, len - 1) == NULL);
+
+	copy = stk_image_deserialize(buf, len);
+	g_assert(copy);
+	l_free(buf);
+
+	xpm = stk_image_xpm(copy);
+	g_assert(memcmp(xpm, test->xpm, strlen(test->xpm)) == 0);
+	l_free(xpm);
+
+	stk_image_free(copy);
+	stk_image_free(image);
+}
+
+/*
+ * Every PDU vector registered below also goes into a corpus, which the
+ * fuzz test mutates and the perf tests (-m perf) time.  The command test
+ * structures all start with the PDU, so they are read through this.
+ */
+struct corpus_pdu {
+	const unsigned char *pdu;
+	unsigned int pdu_len;
+};
+
+static GSList *command_corpus;
+static GSList *response_corpus;
+static GSList *envelope_corpus;
+
+static unsigned long alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count += 1;
+
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static void add_command_test(const char *path, gconstpointer data,
+				GTestDataFunc func)
+{
+	command_corpus = g_slist_prepend(command_corpus, (gpointer) data);
+	g_test_add_data_func(path, data, func);
+}
+
+static void add_response_test(const char *path,
+				const struct terminal_response_test *data,
+				GTestDataFunc func)
+{
+	response_corpus = g_slist_prepend(response_corpus, (gpointer) data);
+	g_test_add_data_func(path, data, func);
+}
+
+static void add_envelope_test(const char *path,
+				const struct envelope_test *data,
+				GTestDataFunc func)
+{
+	envelope_corpus = g_slist_prepend(envelope_corpus, (gpointer) data);
+	g_test_add_data_func(path, data, func);
+}
+
+static void fuzz_mutations(const unsigned char *pdu, unsigned int len)
+{
+	static const unsigned char values[] = { 0x00, 0x01, 0x7f, 0x80, 0xff };
+	unsigned char buf[512];
+	unsigned int i;
+	unsigned int j;
+
+	if (len > sizeof(buf))
+		len = sizeof(buf);
+
+	/* Every truncation, then every byte set to a few boundary values */
+	for (i = 0; i < len; i++)
+		stk_fuzz_one(pdu, i);
+
+	memcpy(buf, pdu, len);
+
+	for (i = 0; i < len; i++) {
+		for (j = 0; j < G_N_ELEMENTS(values); j++) {
+			buf[i] = values[j];
+			stk_fuzz_one(buf, len);
+		}
+
+		buf[i] = pdu[i];
+	}
+}
+
+static void test_fuzz_corpus(void)
+{
+	unsigned int parsed = 0;
+	GSList *l;
+
+	for (l = command_corpus; l; l = l->next) {
+		const struct corpus_pdu *test = l->data;
+
+		if (stk_fuzz_one(test->pdu, test->pdu_len))
+			parsed += 1;
+
+		fuzz_mutations(test->pdu, test->pdu_len);
+	}
+
+	/* Most of the command vectors are well formed */
+	g_assert(parsed > g_slist_length(command_corpus) / 2);
+
+	for (l = response_corpus; l; l = l->next) {
+		const struct terminal_response_test *test = l->data;
+
+		fuzz_mutations(test->pdu, test->pdu_len);
+	}
+
+	for (l = envelope_corpus; l; l = l->next) {
+		const struct envelope_test *test = l->data;
+
+		fuzz_mutations(test->pdu, test->pdu_len);
+	}
+}
+
+static void report_perf(const char *what, unsigned long count,
+			double elapsed, unsigned long allocs)
+{
+#ifdef COUNT_ALLOCS
+	g_test_message("%s %.0f/s, %.2f allocations each", what,
+			count / elapsed, (double) allocs / count);
+#else
+	g_test_message("%s %.0f/s", what, count / elapsed);
+#endif
+}
+
+static void test_parse_perf(void)
+{
+	unsigned long count = 0;
+	unsigned long allocs;
+	double elapsed;
+	GSList *l;
+
+	allocs = alloc_count;
+	g_test_timer_start();
+
+	do {
+		for (l = command_corpus; l; l = l->next) {
+			const struct corpus_pdu *test = l->data;
+			struct stk_command *command;
+
+			command = stk_command_new_from_pdu(test->pdu,
+								test->pdu_len);
+			stk_command_free(command);
+			count += 1;
+		}
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	report_perf("commands parsed", count, elapsed, alloc_count - allocs);
+}
+
+static void test_response_perf(void)
+{
+	unsigned long count = 0;
+	unsigned long allocs;
+	unsigned int pdu_len;
+	double elapsed;
+	GSList *l;
+
+	allocs = alloc_count;
+	g_test_timer_start();
+
+	do {
+		for (l = response_corpus; l; l = l->next) {
+			const struct terminal_response_test *test = l->data;
+
+			stk_pdu_from_response(&test->response, &pdu_len);
+			count += 1;
+		}
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	report_perf("responses built", count, elapsed, alloc_count - allocs);
+}
+
+static void test_envelope_perf(void)
+{
+	unsigned long count = 0;
+	unsigned long allocs;
+	unsigned int pdu_len;
+	double elapsed;
+	GSList *l;
+
+	allocs = alloc_count;
+	g_test_timer_start();
+
+	do {
+		for (l = envelope_corpus; l; l = l->next) {
+			const struct envelope_test *test = l->data;
+
+			stk_pdu_from_envelope(&test->envelope, &pdu_len);
+			count += 1;
+		}
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	report_perf("envelopes built", count, elapsed, alloc_count - allocs);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
-	g_test_add_data_func("/teststk/Display Text 1.1.1",
+	add_command_test("/teststk/Display Text 1.1.1",
 				&display_text_data_111, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 1.3.1",
+	add_command_test("/teststk/Display Text 1.3.1",
 				&display_text_data_131, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 1.4.1",
+	add_command_test("/teststk/Display Text 1.4.1",
 				&display_text_data_141, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 1.5.1",
+	add_command_test("/teststk/Display Text 1.5.1",
 				&display_text_data_151, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 1.6.1",
+	add_command_test("/teststk/Display Text 1.6.1",
 				&display_text_data_161, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 1.7.1",
+	add_command_test("/teststk/Display Text 1.7.1",
 				&display_text_data_171, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 5.1.1",
+	add_command_test("/teststk/Display Text 5.1.1",
 				&display_text_data_511, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 5.2.1",
+	add_command_test("/teststk/Display Text 5.2.1",
 				&display_text_data_521, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 5.3.1",
+	add_command_test("/teststk/Display Text 5.3.1",
 				&display_text_data_531, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 6.1.1",
+	add_command_test("/teststk/Display Text 6.1.1",
 				&display_text_data_611, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 7.1.1",
+	add_command_test("/teststk/Display Text 7.1.1",
 				&display_text_data_711, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.1.1",
+	add_command_test("/teststk/Display Text 8.1.1",
 				&display_text_data_811, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.2.1",
+	add_command_test("/teststk/Display Text 8.2.1",
 				&display_text_data_821, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.3.1",
+	add_command_test("/teststk/Display Text 8.3.1",
 				&display_text_data_831, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.4.1",
+	add_command_test("/teststk/Display Text 8.4.1",
 				&display_text_data_841, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.5.1",
+	add_command_test("/teststk/Display Text 8.5.1",
 				&display_text_data_851, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.6.1",
+	add_command_test("/teststk/Display Text 8.6.1",
 				&display_text_data_861, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.7.1",
+	add_command_test("/teststk/Display Text 8.7.1",
 				&display_text_data_871, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.8.1",
+	add_command_test("/teststk/Display Text 8.8.1",
 				&display_text_data_881, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 8.9.1",
+	add_command_test("/teststk/Display Text 8.9.1",
 				&display_text_data_891, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 9.1.1",
+	add_command_test("/teststk/Display Text 9.1.1",
 				&display_text_data_911, test_display_text);
-	g_test_add_data_func("/teststk/Display Text 10.1.1",
+	add_command_test("/teststk/Display Text 10.1.1",
 				&display_text_data_1011, test_display_text);
 
-	g_test_add_data_func("/teststk/Display Text response 1.1.1",
+	add_response_test("/teststk/Display Text response 1.1.1",
 				&display_text_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.2.1",
+	add_response_test("/teststk/Display Text response 1.2.1",
 				&display_text_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.3.1",
+	add_response_test("/teststk/Display Text response 1.3.1",
 				&display_text_response_data_131,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.5.1",
+	add_response_test("/teststk/Display Text response 1.5.1",
 				&display_text_response_data_151,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.7.1",
+	add_response_test("/teststk/Display Text response 1.7.1",
 				&display_text_response_data_171,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.8.1",
+	add_response_test("/teststk/Display Text response 1.8.1",
 				&display_text_response_data_181,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 1.9.1",
+	add_response_test("/teststk/Display Text response 1.9.1",
 				&display_text_response_data_191,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 2.1.1",
+	add_response_test("/teststk/Display Text response 2.1.1",
 				&display_text_response_data_211,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Display Text response 5.1.1B",
+	add_response_test("/teststk/Display Text response 5.1.1B",
 				&display_text_response_data_511b,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Get Inkey 1.1.1",
+	add_command_test("/teststk/Get Inkey 1.1.1",
 				&get_inkey_data_111, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 1.2.1",
+	add_command_test("/teststk/Get Inkey 1.2.1",
 				&get_inkey_data_121, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 1.3.1",
+	add_command_test("/teststk/Get Inkey 1.3.1",
 				&get_inkey_data_131, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 1.4.1",
+	add_command_test("/teststk/Get Inkey 1.4.1",
 				&get_inkey_data_141, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 1.5.1",
+	add_command_test("/teststk/Get Inkey 1.5.1",
 				&get_inkey_data_151, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 1.6.1",
+	add_command_test("/teststk/Get Inkey 1.6.1",
 				&get_inkey_data_161, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 2.1.1",
+	add_command_test("/teststk/Get Inkey 2.1.1",
 				&get_inkey_data_211, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 3.1.1",
+	add_command_test("/teststk/Get Inkey 3.1.1",
 				&get_inkey_data_311, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 3.2.1",
+	add_command_test("/teststk/Get Inkey 3.2.1",
 				&get_inkey_data_321, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 4.1.1",
+	add_command_test("/teststk/Get Inkey 4.1.1",
 				&get_inkey_data_411, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 5.1.1",
+	add_command_test("/teststk/Get Inkey 5.1.1",
 				&get_inkey_data_511, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 5.1.2",
+	add_command_test("/teststk/Get Inkey 5.1.2",
 				&get_inkey_data_512, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 6.1.1",
+	add_command_test("/teststk/Get Inkey 6.1.1",
 				&get_inkey_data_611, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 6.2.1",
+	add_command_test("/teststk/Get Inkey 6.2.1",
 				&get_inkey_data_621, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 6.3.1",
+	add_command_test("/teststk/Get Inkey 6.3.1",
 				&get_inkey_data_631, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 6.4.1",
+	add_command_test("/teststk/Get Inkey 6.4.1",
 				&get_inkey_data_641, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 7.1.1",
+	add_command_test("/teststk/Get Inkey 7.1.1",
 				&get_inkey_data_711, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 7.1.2",
+	add_command_test("/teststk/Get Inkey 7.1.2",
 				&get_inkey_data_712, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 8.1.1",
+	add_command_test("/teststk/Get Inkey 8.1.1",
 				&get_inkey_data_811, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.1.1",
+	add_command_test("/teststk/Get Inkey 9.1.1",
 				&get_inkey_data_911, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.1.2",
+	add_command_test("/teststk/Get Inkey 9.1.2",
 				&get_inkey_data_912, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.2.1",
+	add_command_test("/teststk/Get Inkey 9.2.1",
 				&get_inkey_data_921, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.2.2",
+	add_command_test("/teststk/Get Inkey 9.2.2",
 				&get_inkey_data_922, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.3.1",
+	add_command_test("/teststk/Get Inkey 9.3.1",
 				&get_inkey_data_931, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.3.2",
+	add_command_test("/teststk/Get Inkey 9.3.2",
 				&get_inkey_data_932, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.4.1",
+	add_command_test("/teststk/Get Inkey 9.4.1",
 				&get_inkey_data_941, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.4.2",
+	add_command_test("/teststk/Get Inkey 9.4.2",
 				&get_inkey_data_942, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.4.3",
+	add_command_test("/teststk/Get Inkey 9.4.3",
 				&get_inkey_data_943, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.5.1",
+	add_command_test("/teststk/Get Inkey 9.5.1",
 				&get_inkey_data_951, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.5.2",
+	add_command_test("/teststk/Get Inkey 9.5.2",
 				&get_inkey_data_952, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.5.3",
+	add_command_test("/teststk/Get Inkey 9.5.3",
 				&get_inkey_data_953, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.6.1",
+	add_command_test("/teststk/Get Inkey 9.6.1",
 				&get_inkey_data_961, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.6.2",
+	add_command_test("/teststk/Get Inkey 9.6.2",
 				&get_inkey_data_962, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.6.3",
+	add_command_test("/teststk/Get Inkey 9.6.3",
 				&get_inkey_data_963, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.7.1",
+	add_command_test("/teststk/Get Inkey 9.7.1",
 				&get_inkey_data_971, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.7.2",
+	add_command_test("/teststk/Get Inkey 9.7.2",
 				&get_inkey_data_972, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.7.3",
+	add_command_test("/teststk/Get Inkey 9.7.3",
 				&get_inkey_data_973, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.8.1",
+	add_command_test("/teststk/Get Inkey 9.8.1",
 				&get_inkey_data_981, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.8.2",
+	add_command_test("/teststk/Get Inkey 9.8.2",
 				&get_inkey_data_982, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.8.3",
+	add_command_test("/teststk/Get Inkey 9.8.3",
 				&get_inkey_data_983, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.9.1",
+	add_command_test("/teststk/Get Inkey 9.9.1",
 				&get_inkey_data_991, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.9.2a",
+	add_command_test("/teststk/Get Inkey 9.9.2a",
 				&get_inkey_data_992a, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.9.2b",
+	add_command_test("/teststk/Get Inkey 9.9.2b",
 				&get_inkey_data_992b, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.9.3",
+	add_command_test("/teststk/Get Inkey 9.9.3",
 				&get_inkey_data_993, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.10.1",
+	add_command_test("/teststk/Get Inkey 9.10.1",
 				&get_inkey_data_9101, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 9.10.2",
+	add_command_test("/teststk/Get Inkey 9.10.2",
 				&get_inkey_data_9102, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 10.1.1",
+	add_command_test("/teststk/Get Inkey 10.1.1",
 				&get_inkey_data_1011, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 10.2.1",
+	add_command_test("/teststk/Get Inkey 10.2.1",
 				&get_inkey_data_1021, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 11.1.1",
+	add_command_test("/teststk/Get Inkey 11.1.1",
 				&get_inkey_data_1111, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 12.1.1",
+	add_command_test("/teststk/Get Inkey 12.1.1",
 				&get_inkey_data_1211, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 12.2.1",
+	add_command_test("/teststk/Get Inkey 12.2.1",
 				&get_inkey_data_1221, test_get_inkey);
-	g_test_add_data_func("/teststk/Get Inkey 13.1.1",
+	add_command_test("/teststk/Get Inkey 13.1.1",
 				&get_inkey_data_1311, test_get_inkey);
 
-	g_test_add_data_func("/teststk/Get Inkey response 1.1.1",
+	add_response_test("/teststk/Get Inkey response 1.1.1",
 				&get_inkey_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 1.2.1",
+	add_response_test("/teststk/Get Inkey response 1.2.1",
 				&get_inkey_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 1.3.1",
+	add_response_test("/teststk/Get Inkey response 1.3.1",
 				&get_inkey_response_data_131,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 1.4.1",
+	add_response_test("/teststk/Get Inkey response 1.4.1",
 				&get_inkey_response_data_141,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 1.5.1",
+	add_response_test("/teststk/Get Inkey response 1.5.1",
 				&get_inkey_response_data_151,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 1.6.1",
+	add_response_test("/teststk/Get Inkey response 1.6.1",
 				&get_inkey_response_data_161,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 2.1.1",
+	add_response_test("/teststk/Get Inkey response 2.1.1",
 				&get_inkey_response_data_211,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 4.1.1",
+	add_response_test("/teststk/Get Inkey response 4.1.1",
 				&get_inkey_response_data_411,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 5.1.1",
+	add_response_test("/teststk/Get Inkey response 5.1.1",
 				&get_inkey_response_data_511,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 5.1.2",
+	add_response_test("/teststk/Get Inkey response 5.1.2",
 				&get_inkey_response_data_512,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 6.1.1B",
+	add_response_test("/teststk/Get Inkey response 6.1.1B",
 				&get_inkey_response_data_611b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 7.1.1",
+	add_response_test("/teststk/Get Inkey response 7.1.1",
 				&get_inkey_response_data_711,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 7.1.2",
+	add_response_test("/teststk/Get Inkey response 7.1.2",
 				&get_inkey_response_data_712,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 8.1.1",
+	add_response_test("/teststk/Get Inkey response 8.1.1",
 				&get_inkey_response_data_811,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 9.1.2",
+	add_response_test("/teststk/Get Inkey response 9.1.2",
 				&get_inkey_response_data_912,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 11.1.1",
+	add_response_test("/teststk/Get Inkey response 11.1.1",
 				&get_inkey_response_data_1111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Inkey response 13.1.1",
+	add_response_test("/teststk/Get Inkey response 13.1.1",
 				&get_inkey_response_data_1311,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Get Input 1.1.1",
+	add_command_test("/teststk/Get Input 1.1.1",
 				&get_input_data_111, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.2.1",
+	add_command_test("/teststk/Get Input 1.2.1",
 				&get_input_data_121, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.3.1",
+	add_command_test("/teststk/Get Input 1.3.1",
 				&get_input_data_131, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.4.1",
+	add_command_test("/teststk/Get Input 1.4.1",
 				&get_input_data_141, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.5.1",
+	add_command_test("/teststk/Get Input 1.5.1",
 				&get_input_data_151, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.6.1",
+	add_command_test("/teststk/Get Input 1.6.1",
 				&get_input_data_161, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.7.1",
+	add_command_test("/teststk/Get Input 1.7.1",
 				&get_input_data_171, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.8.1",
+	add_command_test("/teststk/Get Input 1.8.1",
 				&get_input_data_181, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.9.1",
+	add_command_test("/teststk/Get Input 1.9.1",
 				&get_input_data_191, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 1.10.1",
+	add_command_test("/teststk/Get Input 1.10.1",
 				&get_input_data_1101, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 2.1.1",
+	add_command_test("/teststk/Get Input 2.1.1",
 				&get_input_data_211, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 3.1.1",
+	add_command_test("/teststk/Get Input 3.1.1",
 				&get_input_data_311, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 3.2.1",
+	add_command_test("/teststk/Get Input 3.2.1",
 				&get_input_data_321, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 4.1.1",
+	add_command_test("/teststk/Get Input 4.1.1",
 				&get_input_data_411, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 4.2.1",
+	add_command_test("/teststk/Get Input 4.2.1",
 				&get_input_data_421, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 5.1.1",
+	add_command_test("/teststk/Get Input 5.1.1",
 				&get_input_data_511, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 5.2.1",
+	add_command_test("/teststk/Get Input 5.2.1",
 				&get_input_data_521, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 6.1.1",
+	add_command_test("/teststk/Get Input 6.1.1",
 				&get_input_data_611, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 6.2.1",
+	add_command_test("/teststk/Get Input 6.2.1",
 				&get_input_data_621, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 6.3.1",
+	add_command_test("/teststk/Get Input 6.3.1",
 				&get_input_data_631, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 6.4.1",
+	add_command_test("/teststk/Get Input 6.4.1",
 				&get_input_data_641, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 7.1.1",
+	add_command_test("/teststk/Get Input 7.1.1",
 				&get_input_data_711, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.1.1",
+	add_command_test("/teststk/Get Input 8.1.1",
 				&get_input_data_811, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.1.2",
+	add_command_test("/teststk/Get Input 8.1.2",
 				&get_input_data_812, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.2.1",
+	add_command_test("/teststk/Get Input 8.2.1",
 				&get_input_data_821, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.2.2",
+	add_command_test("/teststk/Get Input 8.2.2",
 				&get_input_data_822, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.3.1",
+	add_command_test("/teststk/Get Input 8.3.1",
 				&get_input_data_831, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.3.2",
+	add_command_test("/teststk/Get Input 8.3.2",
 				&get_input_data_832, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.4.1",
+	add_command_test("/teststk/Get Input 8.4.1",
 				&get_input_data_841, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.4.2",
+	add_command_test("/teststk/Get Input 8.4.2",
 				&get_input_data_842, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.4.3",
+	add_command_test("/teststk/Get Input 8.4.3",
 				&get_input_data_843, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.5.1",
+	add_command_test("/teststk/Get Input 8.5.1",
 				&get_input_data_851, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.5.2",
+	add_command_test("/teststk/Get Input 8.5.2",
 				&get_input_data_852, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.5.3",
+	add_command_test("/teststk/Get Input 8.5.3",
 				&get_input_data_853, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.6.1",
+	add_command_test("/teststk/Get Input 8.6.1",
 				&get_input_data_861, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.6.2",
+	add_command_test("/teststk/Get Input 8.6.2",
 				&get_input_data_862, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.6.3",
+	add_command_test("/teststk/Get Input 8.6.3",
 				&get_input_data_863, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.7.1",
+	add_command_test("/teststk/Get Input 8.7.1",
 				&get_input_data_871, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.7.2",
+	add_command_test("/teststk/Get Input 8.7.2",
 				&get_input_data_872, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.7.3",
+	add_command_test("/teststk/Get Input 8.7.3",
 				&get_input_data_873, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.8.1",
+	add_command_test("/teststk/Get Input 8.8.1",
 				&get_input_data_881, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.8.2",
+	add_command_test("/teststk/Get Input 8.8.2",
 				&get_input_data_882, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.8.3",
+	add_command_test("/teststk/Get Input 8.8.3",
 				&get_input_data_883, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.9.1",
+	add_command_test("/teststk/Get Input 8.9.1",
 				&get_input_data_891, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.9.2",
+	add_command_test("/teststk/Get Input 8.9.2",
 				&get_input_data_892, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.9.3",
+	add_command_test("/teststk/Get Input 8.9.3",
 				&get_input_data_893, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.10.1",
+	add_command_test("/teststk/Get Input 8.10.1",
 				&get_input_data_8101, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 8.10.2",
+	add_command_test("/teststk/Get Input 8.10.2",
 				&get_input_data_8102, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 9.1.1",
+	add_command_test("/teststk/Get Input 9.1.1",
 				&get_input_data_911, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 9.2.1",
+	add_command_test("/teststk/Get Input 9.2.1",
 				&get_input_data_921, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 10.1.1",
+	add_command_test("/teststk/Get Input 10.1.1",
 				&get_input_data_1011, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 10.2.1",
+	add_command_test("/teststk/Get Input 10.2.1",
 				&get_input_data_1021, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 11.1.1",
+	add_command_test("/teststk/Get Input 11.1.1",
 				&get_input_data_1111, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 11.2.1",
+	add_command_test("/teststk/Get Input 11.2.1",
 				&get_input_data_1121, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 12.1.1",
+	add_command_test("/teststk/Get Input 12.1.1",
 				&get_input_data_1211, test_get_input);
-	g_test_add_data_func("/teststk/Get Input 12.2.1",
+	add_command_test("/teststk/Get Input 12.2.1",
 				&get_input_data_1221, test_get_input);
 
-	g_test_add_data_func("/teststk/Get Input response 1.1.1",
+	add_response_test("/teststk/Get Input response 1.1.1",
 				&get_input_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.2.1",
+	add_response_test("/teststk/Get Input response 1.2.1",
 				&get_input_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.3.1",
+	add_response_test("/teststk/Get Input response 1.3.1",
 				&get_input_response_data_131,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.4.1",
+	add_response_test("/teststk/Get Input response 1.4.1",
 				&get_input_response_data_141,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.5.1",
+	add_response_test("/teststk/Get Input response 1.5.1",
 				&get_input_response_data_151,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.6.1",
+	add_response_test("/teststk/Get Input response 1.6.1",
 				&get_input_response_data_161,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.7.1",
+	add_response_test("/teststk/Get Input response 1.7.1",
 				&get_input_response_data_171,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.8.1",
+	add_response_test("/teststk/Get Input response 1.8.1",
 				&get_input_response_data_181,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 1.9.1",
+	add_response_test("/teststk/Get Input response 1.9.1",
 				&get_input_response_data_191,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 2.1.1",
+	add_response_test("/teststk/Get Input response 2.1.1",
 				&get_input_response_data_211,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 3.1.1",
+	add_response_test("/teststk/Get Input response 3.1.1",
 				&get_input_response_data_311,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 4.1.1",
+	add_response_test("/teststk/Get Input response 4.1.1",
 				&get_input_response_data_411,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 4.2.1",
+	add_response_test("/teststk/Get Input response 4.2.1",
 				&get_input_response_data_421,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 6.1.1A",
+	add_response_test("/teststk/Get Input response 6.1.1A",
 				&get_input_response_data_611a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 6.1.1B",
+	add_response_test("/teststk/Get Input response 6.1.1B",
 				&get_input_response_data_611b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 7.1.1",
+	add_response_test("/teststk/Get Input response 7.1.1",
 				&get_input_response_data_711,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 8.1.2",
+	add_response_test("/teststk/Get Input response 8.1.2",
 				&get_input_response_data_812,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 8.4.3",
+	add_response_test("/teststk/Get Input response 8.4.3",
 				&get_input_response_data_843,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 10.1.1",
+	add_response_test("/teststk/Get Input response 10.1.1",
 				&get_input_response_data_1011,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 10.2.1",
+	add_response_test("/teststk/Get Input response 10.2.1",
 				&get_input_response_data_1021,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 12.1.1",
+	add_response_test("/teststk/Get Input response 12.1.1",
 				&get_input_response_data_1211,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Input response 12.2.1",
+	add_response_test("/teststk/Get Input response 12.2.1",
 				&get_input_response_data_1221,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/More Time 1.1.1",
+	add_command_test("/teststk/More Time 1.1.1",
 				&more_time_data_111, test_more_time);
 
-	g_test_add_data_func("/teststk/More Time response 1.1.1",
+	add_response_test("/teststk/More Time response 1.1.1",
 				&more_time_response_data_111,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Play Tone 1.1.1",
+	add_command_test("/teststk/Play Tone 1.1.1",
 				&play_tone_data_111, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.2",
+	add_command_test("/teststk/Play Tone 1.1.2",
 				&play_tone_data_112, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.3",
+	add_command_test("/teststk/Play Tone 1.1.3",
 				&play_tone_data_113, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.4",
+	add_command_test("/teststk/Play Tone 1.1.4",
 				&play_tone_data_114, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.5",
+	add_command_test("/teststk/Play Tone 1.1.5",
 				&play_tone_data_115, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.6",
+	add_command_test("/teststk/Play Tone 1.1.6",
 				&play_tone_data_116, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.7",
+	add_command_test("/teststk/Play Tone 1.1.7",
 				&play_tone_data_117, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.8",
+	add_command_test("/teststk/Play Tone 1.1.8",
 				&play_tone_data_118, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.9",
+	add_command_test("/teststk/Play Tone 1.1.9",
 				&play_tone_data_119, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.10",
+	add_command_test("/teststk/Play Tone 1.1.10",
 				&play_tone_data_1110, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.11",
+	add_command_test("/teststk/Play Tone 1.1.11",
 				&play_tone_data_1111, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.12",
+	add_command_test("/teststk/Play Tone 1.1.12",
 				&play_tone_data_1112, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.13",
+	add_command_test("/teststk/Play Tone 1.1.13",
 				&play_tone_data_1113, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.14",
+	add_command_test("/teststk/Play Tone 1.1.14",
 				&play_tone_data_1114, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 1.1.15",
+	add_command_test("/teststk/Play Tone 1.1.15",
 				&play_tone_data_1115, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 2.1.1",
+	add_command_test("/teststk/Play Tone 2.1.1",
 				&play_tone_data_211, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 2.1.2",
+	add_command_test("/teststk/Play Tone 2.1.2",
 				&play_tone_data_212, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 2.1.3",
+	add_command_test("/teststk/Play Tone 2.1.3",
 				&play_tone_data_213, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 3.1.1",
+	add_command_test("/teststk/Play Tone 3.1.1",
 				&play_tone_data_311, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 3.2.1",
+	add_command_test("/teststk/Play Tone 3.2.1",
 				&play_tone_data_321, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 3.3.1",
+	add_command_test("/teststk/Play Tone 3.3.1",
 				&play_tone_data_331, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 3.4.1",
+	add_command_test("/teststk/Play Tone 3.4.1",
 				&play_tone_data_341, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.1.1",
+	add_command_test("/teststk/Play Tone 4.1.1",
 				&play_tone_data_411, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.1.2",
+	add_command_test("/teststk/Play Tone 4.1.2",
 				&play_tone_data_412, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.2.1",
+	add_command_test("/teststk/Play Tone 4.2.1",
 				&play_tone_data_421, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.2.2",
+	add_command_test("/teststk/Play Tone 4.2.2",
 				&play_tone_data_422, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.3.1",
+	add_command_test("/teststk/Play Tone 4.3.1",
 				&play_tone_data_431, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.3.2",
+	add_command_test("/teststk/Play Tone 4.3.2",
 				&play_tone_data_432, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.4.1",
+	add_command_test("/teststk/Play Tone 4.4.1",
 				&play_tone_data_441, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.4.2",
+	add_command_test("/teststk/Play Tone 4.4.2",
 				&play_tone_data_442, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.4.3",
+	add_command_test("/teststk/Play Tone 4.4.3",
 				&play_tone_data_443, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.5.1",
+	add_command_test("/teststk/Play Tone 4.5.1",
 				&play_tone_data_451, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.5.2",
+	add_command_test("/teststk/Play Tone 4.5.2",
 				&play_tone_data_452, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.5.3",
+	add_command_test("/teststk/Play Tone 4.5.3",
 				&play_tone_data_453, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.6.1",
+	add_command_test("/teststk/Play Tone 4.6.1",
 				&play_tone_data_461, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.6.2",
+	add_command_test("/teststk/Play Tone 4.6.2",
 				&play_tone_data_462, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.6.3",
+	add_command_test("/teststk/Play Tone 4.6.3",
 				&play_tone_data_463, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.7.1",
+	add_command_test("/teststk/Play Tone 4.7.1",
 				&play_tone_data_471, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.7.2",
+	add_command_test("/teststk/Play Tone 4.7.2",
 				&play_tone_data_472, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.7.3",
+	add_command_test("/teststk/Play Tone 4.7.3",
 				&play_tone_data_473, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.8.1",
+	add_command_test("/teststk/Play Tone 4.8.1",
 				&play_tone_data_481, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.8.2",
+	add_command_test("/teststk/Play Tone 4.8.2",
 				&play_tone_data_482, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.8.3",
+	add_command_test("/teststk/Play Tone 4.8.3",
 				&play_tone_data_483, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.9.1",
+	add_command_test("/teststk/Play Tone 4.9.1",
 				&play_tone_data_491, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.9.2",
+	add_command_test("/teststk/Play Tone 4.9.2",
 				&play_tone_data_492, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.9.3",
+	add_command_test("/teststk/Play Tone 4.9.3",
 				&play_tone_data_493, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.10.1",
+	add_command_test("/teststk/Play Tone 4.10.1",
 				&play_tone_data_4101, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 4.10.2",
+	add_command_test("/teststk/Play Tone 4.10.2",
 				&play_tone_data_4102, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 5.1.1",
+	add_command_test("/teststk/Play Tone 5.1.1",
 				&play_tone_data_511, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 5.1.2",
+	add_command_test("/teststk/Play Tone 5.1.2",
 				&play_tone_data_512, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 5.1.3",
+	add_command_test("/teststk/Play Tone 5.1.3",
 				&play_tone_data_513, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 6.1.1",
+	add_command_test("/teststk/Play Tone 6.1.1",
 				&play_tone_data_611, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 6.1.2",
+	add_command_test("/teststk/Play Tone 6.1.2",
 				&play_tone_data_612, test_play_tone);
-	g_test_add_data_func("/teststk/Play Tone 6.1.3",
+	add_command_test("/teststk/Play Tone 6.1.3",
 				&play_tone_data_613, test_play_tone);
 
-	g_test_add_data_func("/teststk/Play Tone response 1.1.1",
+	add_response_test("/teststk/Play Tone response 1.1.1",
 				&play_tone_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Play Tone response 1.1.9B",
+	add_response_test("/teststk/Play Tone response 1.1.9B",
 				&play_tone_response_data_119b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Play Tone response 1.1.14",
+	add_response_test("/teststk/Play Tone response 1.1.14",
 				&play_tone_response_data_1114,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Play Tone response 3.1.1B",
+	add_response_test("/teststk/Play Tone response 3.1.1B",
 				&play_tone_response_data_311b,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Poll Interval 1.1.1",
+	add_command_test("/teststk/Poll Interval 1.1.1",
 				&poll_interval_data_111, test_poll_interval);
 
-	g_test_add_data_func("/teststk/Poll Interval response 1.1.1",
+	add_response_test("/teststk/Poll Interval response 1.1.1",
 				&poll_interval_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Poll Interval response 1.1.1A",
+	add_response_test("/teststk/Poll Interval response 1.1.1A",
 				&poll_interval_response_data_111a,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Setup Menu 1.1.1",
+	add_command_test("/teststk/Setup Menu 1.1.1",
 				&setup_menu_data_111, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 1.1.2",
+	add_command_test("/teststk/Setup Menu 1.1.2",
 				&setup_menu_data_112, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 1.1.3",
+	add_command_test("/teststk/Setup Menu 1.1.3",
 				&setup_menu_data_113, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 1.2.1",
+	add_command_test("/teststk/Setup Menu 1.2.1",
 				&setup_menu_data_121, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 1.2.2",
+	add_command_test("/teststk/Setup Menu 1.2.2",
 				&setup_menu_data_122, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 1.2.3",
+	add_command_test("/teststk/Setup Menu 1.2.3",
 				&setup_menu_data_123, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 2.1.1",
+	add_command_test("/teststk/Setup Menu 2.1.1",
 				&setup_menu_data_211, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 3.1.1",
+	add_command_test("/teststk/Setup Menu 3.1.1",
 				&setup_menu_data_311, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 4.1.1",
+	add_command_test("/teststk/Setup Menu 4.1.1",
 				&setup_menu_data_411, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 4.2.1",
+	add_command_test("/teststk/Setup Menu 4.2.1",
 				&setup_menu_data_421, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 5.1.1",
+	add_command_test("/teststk/Setup Menu 5.1.1",
 				&setup_menu_data_511, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.1.1",
+	add_command_test("/teststk/Setup Menu 6.1.1",
 				&setup_menu_data_611, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.1.2",
+	add_command_test("/teststk/Setup Menu 6.1.2",
 				&setup_menu_data_612, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.2.1",
+	add_command_test("/teststk/Setup Menu 6.2.1",
 				&setup_menu_data_621, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.2.2",
+	add_command_test("/teststk/Setup Menu 6.2.2",
 				&setup_menu_data_622, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.3.1",
+	add_command_test("/teststk/Setup Menu 6.3.1",
 				&setup_menu_data_631, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.3.2",
+	add_command_test("/teststk/Setup Menu 6.3.2",
 				&setup_menu_data_632, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.4.1",
+	add_command_test("/teststk/Setup Menu 6.4.1",
 				&setup_menu_data_641, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.4.2",
+	add_command_test("/teststk/Setup Menu 6.4.2",
 				&setup_menu_data_642, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.4.3",
+	add_command_test("/teststk/Setup Menu 6.4.3",
 				&setup_menu_data_643, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.5.1",
+	add_command_test("/teststk/Setup Menu 6.5.1",
 				&setup_menu_data_651, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.6.1",
+	add_command_test("/teststk/Setup Menu 6.6.1",
 				&setup_menu_data_661, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.7.1",
+	add_command_test("/teststk/Setup Menu 6.7.1",
 				&setup_menu_data_671, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.8.1",
+	add_command_test("/teststk/Setup Menu 6.8.1",
 				&setup_menu_data_681, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.9.1",
+	add_command_test("/teststk/Setup Menu 6.9.1",
 				&setup_menu_data_691, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 6.10.1",
+	add_command_test("/teststk/Setup Menu 6.10.1",
 				&setup_menu_data_6101, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 7.1.1",
+	add_command_test("/teststk/Setup Menu 7.1.1",
 				&setup_menu_data_711, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 7.1.2",
+	add_command_test("/teststk/Setup Menu 7.1.2",
 				&setup_menu_data_712, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 7.1.3",
+	add_command_test("/teststk/Setup Menu 7.1.3",
 				&setup_menu_data_713, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 8.1.1",
+	add_command_test("/teststk/Setup Menu 8.1.1",
 				&setup_menu_data_811, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 8.1.2",
+	add_command_test("/teststk/Setup Menu 8.1.2",
 				&setup_menu_data_812, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 8.1.3",
+	add_command_test("/teststk/Setup Menu 8.1.3",
 				&setup_menu_data_813, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 9.1.1",
+	add_command_test("/teststk/Setup Menu 9.1.1",
 				&setup_menu_data_911, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 9.1.2",
+	add_command_test("/teststk/Setup Menu 9.1.2",
 				&setup_menu_data_912, test_setup_menu);
-	g_test_add_data_func("/teststk/Setup Menu 9.1.3",
+	add_command_test("/teststk/Setup Menu 9.1.3",
 				&setup_menu_data_913, test_setup_menu);
 
-	g_test_add_data_func("/teststk/Setup Menu Negative 1",
+	add_command_test("/teststk/Setup Menu Negative 1",
 			&setup_menu_data_neg_1, test_setup_menu_missing_val);
-	g_test_add_data_func("/teststk/Setup Menu Negative 2",
+	add_command_test("/teststk/Setup Menu Negative 2",
 			&setup_menu_data_neg_2, test_setup_menu_neg);
-	g_test_add_data_func("/teststk/Setup Menu Negative 3",
+	add_command_test("/teststk/Setup Menu Negative 3",
 			&setup_menu_data_neg_3, test_setup_menu_neg);
-	g_test_add_data_func("/teststk/Setup Menu Negative 4",
+	add_command_test("/teststk/Setup Menu Negative 4",
 			&setup_menu_data_neg_4, test_setup_menu_neg);
 
-	g_test_add_data_func("/teststk/Set Up Menu response 1.1.1",
+	add_response_test("/teststk/Set Up Menu response 1.1.1",
 				&set_up_menu_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Menu response 4.1.1B",
+	add_response_test("/teststk/Set Up Menu response 4.1.1B",
 				&set_up_menu_response_data_411b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Menu response 5.1.1",
+	add_response_test("/teststk/Set Up Menu response 5.1.1",
 				&set_up_menu_response_data_511,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Select Item 1.1.1",
+	add_command_test("/teststk/Select Item 1.1.1",
 				&select_item_data_111, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 1.2.1",
+	add_command_test("/teststk/Select Item 1.2.1",
 				&select_item_data_121, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 1.3.1",
+	add_command_test("/teststk/Select Item 1.3.1",
 				&select_item_data_131, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 1.4.1",
+	add_command_test("/teststk/Select Item 1.4.1",
 				&select_item_data_141, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 1.5.1",
+	add_command_test("/teststk/Select Item 1.5.1",
 				&select_item_data_151, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 1.6.1",
+	add_command_test("/teststk/Select Item 1.6.1",
 				&select_item_data_161, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 2.1.1",
+	add_command_test("/teststk/Select Item 2.1.1",
 				&select_item_data_211, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 3.1.1",
+	add_command_test("/teststk/Select Item 3.1.1",
 				&select_item_data_311, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 4.1.1",
+	add_command_test("/teststk/Select Item 4.1.1",
 				&select_item_data_411, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 5.1.1",
+	add_command_test("/teststk/Select Item 5.1.1",
 				&select_item_data_511, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 5.2.1",
+	add_command_test("/teststk/Select Item 5.2.1",
 				&select_item_data_521, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 6.1.1",
+	add_command_test("/teststk/Select Item 6.1.1",
 				&select_item_data_611, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 6.2.1",
+	add_command_test("/teststk/Select Item 6.2.1",
 				&select_item_data_621, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 7.1.1",
+	add_command_test("/teststk/Select Item 7.1.1",
 				&select_item_data_711, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 8.1.1",
+	add_command_test("/teststk/Select Item 8.1.1",
 				&select_item_data_811, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.1.1",
+	add_command_test("/teststk/Select Item 9.1.1",
 				&select_item_data_911, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.1.2",
+	add_command_test("/teststk/Select Item 9.1.2",
 				&select_item_data_912, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.2.1",
+	add_command_test("/teststk/Select Item 9.2.1",
 				&select_item_data_921, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.2.2",
+	add_command_test("/teststk/Select Item 9.2.2",
 				&select_item_data_922, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.3.1",
+	add_command_test("/teststk/Select Item 9.3.1",
 				&select_item_data_931, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.3.2",
+	add_command_test("/teststk/Select Item 9.3.2",
 				&select_item_data_932, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.4.1",
+	add_command_test("/teststk/Select Item 9.4.1",
 				&select_item_data_941, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.4.2",
+	add_command_test("/teststk/Select Item 9.4.2",
 				&select_item_data_942, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.4.3",
+	add_command_test("/teststk/Select Item 9.4.3",
 				&select_item_data_943, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.5.1",
+	add_command_test("/teststk/Select Item 9.5.1",
 				&select_item_data_951, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.5.2",
+	add_command_test("/teststk/Select Item 9.5.2",
 				&select_item_data_952, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.5.3",
+	add_command_test("/teststk/Select Item 9.5.3",
 				&select_item_data_953, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.6.1",
+	add_command_test("/teststk/Select Item 9.6.1",
 				&select_item_data_961, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.6.2",
+	add_command_test("/teststk/Select Item 9.6.2",
 				&select_item_data_962, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.6.3",
+	add_command_test("/teststk/Select Item 9.6.3",
 				&select_item_data_963, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.7.1",
+	add_command_test("/teststk/Select Item 9.7.1",
 				&select_item_data_971, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.7.2",
+	add_command_test("/teststk/Select Item 9.7.2",
 				&select_item_data_972, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.7.3",
+	add_command_test("/teststk/Select Item 9.7.3",
 				&select_item_data_973, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.8.1",
+	add_command_test("/teststk/Select Item 9.8.1",
 				&select_item_data_981, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.8.2",
+	add_command_test("/teststk/Select Item 9.8.2",
 				&select_item_data_982, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.8.3",
+	add_command_test("/teststk/Select Item 9.8.3",
 				&select_item_data_983, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.9.1",
+	add_command_test("/teststk/Select Item 9.9.1",
 				&select_item_data_991, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.9.2",
+	add_command_test("/teststk/Select Item 9.9.2",
 				&select_item_data_992, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.9.3",
+	add_command_test("/teststk/Select Item 9.9.3",
 				&select_item_data_993, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.10.1",
+	add_command_test("/teststk/Select Item 9.10.1",
 				&select_item_data_9101, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 9.10.2",
+	add_command_test("/teststk/Select Item 9.10.2",
 				&select_item_data_9102, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 10.1.1",
+	add_command_test("/teststk/Select Item 10.1.1",
 				&select_item_data_1011, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 10.2.1",
+	add_command_test("/teststk/Select Item 10.2.1",
 				&select_item_data_1021, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 10.3.1",
+	add_command_test("/teststk/Select Item 10.3.1",
 				&select_item_data_1031, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 11.1.1",
+	add_command_test("/teststk/Select Item 11.1.1",
 				&select_item_data_1111, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 12.1.1",
+	add_command_test("/teststk/Select Item 12.1.1",
 				&select_item_data_1211, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 12.2.1",
+	add_command_test("/teststk/Select Item 12.2.1",
 				&select_item_data_1221, test_select_item);
-	g_test_add_data_func("/teststk/Select Item 12.3.1",
+	add_command_test("/teststk/Select Item 12.3.1",
 				&select_item_data_1231, test_select_item);
 
-	g_test_add_data_func("/teststk/Select Item response 1.1.1",
+	add_response_test("/teststk/Select Item response 1.1.1",
 				&select_item_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 1.2.1",
+	add_response_test("/teststk/Select Item response 1.2.1",
 				&select_item_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 1.3.1",
+	add_response_test("/teststk/Select Item response 1.3.1",
 				&select_item_response_data_131,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 1.4.1",
+	add_response_test("/teststk/Select Item response 1.4.1",
 				&select_item_response_data_141,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 1.4.2",
+	add_response_test("/teststk/Select Item response 1.4.2",
 				&select_item_response_data_142,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 1.5.1",
+	add_response_test("/teststk/Select Item response 1.5.1",
 				&select_item_response_data_151,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 3.1.1",
+	add_response_test("/teststk/Select Item response 3.1.1",
 				&select_item_response_data_311,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 4.1.1",
+	add_response_test("/teststk/Select Item response 4.1.1",
 				&select_item_response_data_411,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 5.1.1B",
+	add_response_test("/teststk/Select Item response 5.1.1B",
 				&select_item_response_data_511b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 6.1.1",
+	add_response_test("/teststk/Select Item response 6.1.1",
 				&select_item_response_data_611,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 6.2.1",
+	add_response_test("/teststk/Select Item response 6.2.1",
 				&select_item_response_data_621,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 7.1.1",
+	add_response_test("/teststk/Select Item response 7.1.1",
 				&select_item_response_data_711,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Select Item response 8.1.1",
+	add_response_test("/teststk/Select Item response 8.1.1",
 				&select_item_response_data_811,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Send SMS 1.1.1",
+	add_command_test("/teststk/Send SMS 1.1.1",
 				&send_sms_data_111, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.2.1",
+	add_command_test("/teststk/Send SMS 1.2.1",
 				&send_sms_data_121, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.3.1",
+	add_command_test("/teststk/Send SMS 1.3.1",
 				&send_sms_data_131, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.4.1",
+	add_command_test("/teststk/Send SMS 1.4.1",
 				&send_sms_data_141, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.5.1",
+	add_command_test("/teststk/Send SMS 1.5.1",
 				&send_sms_data_151, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.6.1",
+	add_command_test("/teststk/Send SMS 1.6.1",
 				&send_sms_data_161, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.7.1",
+	add_command_test("/teststk/Send SMS 1.7.1",
 				&send_sms_data_171, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 1.8.1",
+	add_command_test("/teststk/Send SMS 1.8.1",
 				&send_sms_data_181, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 2.1.1",
+	add_command_test("/teststk/Send SMS 2.1.1",
 				&send_sms_data_211, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 2.1.2",
+	add_command_test("/teststk/Send SMS 2.1.2",
 				&send_sms_data_212, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 2.1.3",
+	add_command_test("/teststk/Send SMS 2.1.3",
 				&send_sms_data_213, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 3.1.1",
+	add_command_test("/teststk/Send SMS 3.1.1",
 				&send_sms_data_311, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 3.2.1",
+	add_command_test("/teststk/Send SMS 3.2.1",
 				&send_sms_data_321, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.1.1",
+	add_command_test("/teststk/Send SMS 4.1.1",
 				&send_sms_data_411, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.1.2",
+	add_command_test("/teststk/Send SMS 4.1.2",
 				&send_sms_data_412, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.2.1",
+	add_command_test("/teststk/Send SMS 4.2.1",
 				&send_sms_data_421, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.2.2",
+	add_command_test("/teststk/Send SMS 4.2.2",
 				&send_sms_data_422, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.3.1",
+	add_command_test("/teststk/Send SMS 4.3.1",
 				&send_sms_data_431, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.3.2",
+	add_command_test("/teststk/Send SMS 4.3.2",
 				&send_sms_data_432, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.4.1",
+	add_command_test("/teststk/Send SMS 4.4.1",
 				&send_sms_data_441, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.4.2",
+	add_command_test("/teststk/Send SMS 4.4.2",
 				&send_sms_data_442, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.4.3",
+	add_command_test("/teststk/Send SMS 4.4.3",
 				&send_sms_data_443, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.5.1",
+	add_command_test("/teststk/Send SMS 4.5.1",
 				&send_sms_data_451, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.5.2",
+	add_command_test("/teststk/Send SMS 4.5.2",
 				&send_sms_data_452, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.5.3",
+	add_command_test("/teststk/Send SMS 4.5.3",
 				&send_sms_data_453, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.6.1",
+	add_command_test("/teststk/Send SMS 4.6.1",
 				&send_sms_data_461, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.6.2",
+	add_command_test("/teststk/Send SMS 4.6.2",
 				&send_sms_data_462, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.6.3",
+	add_command_test("/teststk/Send SMS 4.6.3",
 				&send_sms_data_463, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.7.1",
+	add_command_test("/teststk/Send SMS 4.7.1",
 				&send_sms_data_471, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.7.2",
+	add_command_test("/teststk/Send SMS 4.7.2",
 				&send_sms_data_472, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.7.3",
+	add_command_test("/teststk/Send SMS 4.7.3",
 				&send_sms_data_473, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.8.1",
+	add_command_test("/teststk/Send SMS 4.8.1",
 				&send_sms_data_481, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.8.2",
+	add_command_test("/teststk/Send SMS 4.8.2",
 				&send_sms_data_482, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.8.3",
+	add_command_test("/teststk/Send SMS 4.8.3",
 				&send_sms_data_483, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.9.1",
+	add_command_test("/teststk/Send SMS 4.9.1",
 				&send_sms_data_491, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.9.2",
+	add_command_test("/teststk/Send SMS 4.9.2",
 				&send_sms_data_492, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.9.3",
+	add_command_test("/teststk/Send SMS 4.9.3",
 				&send_sms_data_493, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.10.1",
+	add_command_test("/teststk/Send SMS 4.10.1",
 				&send_sms_data_4101, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 4.10.2",
+	add_command_test("/teststk/Send SMS 4.10.2",
 				&send_sms_data_4102, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 5.1.1",
+	add_command_test("/teststk/Send SMS 5.1.1",
 				&send_sms_data_511, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 5.1.2",
+	add_command_test("/teststk/Send SMS 5.1.2",
 				&send_sms_data_512, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 5.1.3",
+	add_command_test("/teststk/Send SMS 5.1.3",
 				&send_sms_data_513, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 6.1.1",
+	add_command_test("/teststk/Send SMS 6.1.1",
 				&send_sms_data_611, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 6.1.2",
+	add_command_test("/teststk/Send SMS 6.1.2",
 				&send_sms_data_612, test_send_sms);
-	g_test_add_data_func("/teststk/Send SMS 6.1.3",
+	add_command_test("/teststk/Send SMS 6.1.3",
 				&send_sms_data_613, test_send_sms);
 
-	g_test_add_data_func("/teststk/Send SS 1.1.1",
+	add_command_test("/teststk/Send SS 1.1.1",
 				&send_ss_data_111, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 1.4.1",
+	add_command_test("/teststk/Send SS 1.4.1",
 				&send_ss_data_141, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 1.5.1",
+	add_command_test("/teststk/Send SS 1.5.1",
 				&send_ss_data_151, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 1.6.1",
+	add_command_test("/teststk/Send SS 1.6.1",
 				&send_ss_data_161, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 2.1.1",
+	add_command_test("/teststk/Send SS 2.1.1",
 				&send_ss_data_211, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 2.2.1",
+	add_command_test("/teststk/Send SS 2.2.1",
 				&send_ss_data_221, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 2.3.1",
+	add_command_test("/teststk/Send SS 2.3.1",
 				&send_ss_data_231, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 2.4.1",
+	add_command_test("/teststk/Send SS 2.4.1",
 				&send_ss_data_241, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 3.1.1",
+	add_command_test("/teststk/Send SS 3.1.1",
 				&send_ss_data_311, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.1.1",
+	add_command_test("/teststk/Send SS 4.1.1",
 				&send_ss_data_411, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.1.2",
+	add_command_test("/teststk/Send SS 4.1.2",
 				&send_ss_data_412, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.2.1",
+	add_command_test("/teststk/Send SS 4.2.1",
 				&send_ss_data_421, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.2.2",
+	add_command_test("/teststk/Send SS 4.2.2",
 				&send_ss_data_422, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.3.1",
+	add_command_test("/teststk/Send SS 4.3.1",
 				&send_ss_data_431, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.3.2",
+	add_command_test("/teststk/Send SS 4.3.2",
 				&send_ss_data_432, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.4.1",
+	add_command_test("/teststk/Send SS 4.4.1",
 				&send_ss_data_441, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.4.2",
+	add_command_test("/teststk/Send SS 4.4.2",
 				&send_ss_data_442, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.4.3",
+	add_command_test("/teststk/Send SS 4.4.3",
 				&send_ss_data_443, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.5.1",
+	add_command_test("/teststk/Send SS 4.5.1",
 				&send_ss_data_451, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.5.2",
+	add_command_test("/teststk/Send SS 4.5.2",
 				&send_ss_data_452, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.5.3",
+	add_command_test("/teststk/Send SS 4.5.3",
 				&send_ss_data_453, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.6.1",
+	add_command_test("/teststk/Send SS 4.6.1",
 				&send_ss_data_461, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.6.2",
+	add_command_test("/teststk/Send SS 4.6.2",
 				&send_ss_data_462, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.6.3",
+	add_command_test("/teststk/Send SS 4.6.3",
 				&send_ss_data_463, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.7.1",
+	add_command_test("/teststk/Send SS 4.7.1",
 				&send_ss_data_471, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.7.2",
+	add_command_test("/teststk/Send SS 4.7.2",
 				&send_ss_data_472, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.7.3",
+	add_command_test("/teststk/Send SS 4.7.3",
 				&send_ss_data_473, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.8.1",
+	add_command_test("/teststk/Send SS 4.8.1",
 				&send_ss_data_481, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.8.2",
+	add_command_test("/teststk/Send SS 4.8.2",
 				&send_ss_data_482, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.8.3",
+	add_command_test("/teststk/Send SS 4.8.3",
 				&send_ss_data_483, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.9.1",
+	add_command_test("/teststk/Send SS 4.9.1",
 				&send_ss_data_491, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.9.2",
+	add_command_test("/teststk/Send SS 4.9.2",
 				&send_ss_data_492, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.9.3",
+	add_command_test("/teststk/Send SS 4.9.3",
 				&send_ss_data_493, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.10.1",
+	add_command_test("/teststk/Send SS 4.10.1",
 				&send_ss_data_4101, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 4.10.2",
+	add_command_test("/teststk/Send SS 4.10.2",
 				&send_ss_data_4102, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 5.1.1",
+	add_command_test("/teststk/Send SS 5.1.1",
 				&send_ss_data_511, test_send_ss);
-	g_test_add_data_func("/teststk/Send SS 6.1.1",
+	add_command_test("/teststk/Send SS 6.1.1",
 				&send_ss_data_611, test_send_ss);
 
-	g_test_add_data_func("/teststk/Send USSD 1.1.1",
+	add_command_test("/teststk/Send USSD 1.1.1",
 				&send_ussd_data_111, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 1.2.1",
+	add_command_test("/teststk/Send USSD 1.2.1",
 				&send_ussd_data_121, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 1.3.1",
+	add_command_test("/teststk/Send USSD 1.3.1",
 				&send_ussd_data_131, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 1.6.1",
+	add_command_test("/teststk/Send USSD 1.6.1",
 				&send_ussd_data_161, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 1.7.1",
+	add_command_test("/teststk/Send USSD 1.7.1",
 				&send_ussd_data_171, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 1.8.1",
+	add_command_test("/teststk/Send USSD 1.8.1",
 				&send_ussd_data_181, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 2.1.1",
+	add_command_test("/teststk/Send USSD 2.1.1",
 				&send_ussd_data_211, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 2.2.1",
+	add_command_test("/teststk/Send USSD 2.2.1",
 				&send_ussd_data_221, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 2.3.1",
+	add_command_test("/teststk/Send USSD 2.3.1",
 				&send_ussd_data_231, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 2.4.1",
+	add_command_test("/teststk/Send USSD 2.4.1",
 				&send_ussd_data_241, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 3.1.1",
+	add_command_test("/teststk/Send USSD 3.1.1",
 				&send_ussd_data_311, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.1.1",
+	add_command_test("/teststk/Send USSD 4.1.1",
 				&send_ussd_data_411, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.1.2",
+	add_command_test("/teststk/Send USSD 4.1.2",
 				&send_ussd_data_412, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.2.1",
+	add_command_test("/teststk/Send USSD 4.2.1",
 				&send_ussd_data_421, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.2.2",
+	add_command_test("/teststk/Send USSD 4.2.2",
 				&send_ussd_data_422, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.3.1",
+	add_command_test("/teststk/Send USSD 4.3.1",
 				&send_ussd_data_431, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.3.2",
+	add_command_test("/teststk/Send USSD 4.3.2",
 				&send_ussd_data_432, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.4.1",
+	add_command_test("/teststk/Send USSD 4.4.1",
 				&send_ussd_data_441, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.4.2",
+	add_command_test("/teststk/Send USSD 4.4.2",
 				&send_ussd_data_442, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.4.3",
+	add_command_test("/teststk/Send USSD 4.4.3",
 				&send_ussd_data_443, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.5.1",
+	add_command_test("/teststk/Send USSD 4.5.1",
 				&send_ussd_data_451, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.5.2",
+	add_command_test("/teststk/Send USSD 4.5.2",
 				&send_ussd_data_452, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.5.3",
+	add_command_test("/teststk/Send USSD 4.5.3",
 				&send_ussd_data_453, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.6.1",
+	add_command_test("/teststk/Send USSD 4.6.1",
 				&send_ussd_data_461, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.6.2",
+	add_command_test("/teststk/Send USSD 4.6.2",
 				&send_ussd_data_462, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.6.3",
+	add_command_test("/teststk/Send USSD 4.6.3",
 				&send_ussd_data_463, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.7.1",
+	add_command_test("/teststk/Send USSD 4.7.1",
 				&send_ussd_data_471, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.7.2",
+	add_command_test("/teststk/Send USSD 4.7.2",
 				&send_ussd_data_472, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.7.3",
+	add_command_test("/teststk/Send USSD 4.7.3",
 				&send_ussd_data_473, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.8.1",
+	add_command_test("/teststk/Send USSD 4.8.1",
 				&send_ussd_data_481, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.8.2",
+	add_command_test("/teststk/Send USSD 4.8.2",
 				&send_ussd_data_482, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.8.3",
+	add_command_test("/teststk/Send USSD 4.8.3",
 				&send_ussd_data_483, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.9.1",
+	add_command_test("/teststk/Send USSD 4.9.1",
 				&send_ussd_data_491, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.9.2",
+	add_command_test("/teststk/Send USSD 4.9.2",
 				&send_ussd_data_492, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.9.3",
+	add_command_test("/teststk/Send USSD 4.9.3",
 				&send_ussd_data_493, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.10.1",
+	add_command_test("/teststk/Send USSD 4.10.1",
 				&send_ussd_data_4101, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 4.10.2",
+	add_command_test("/teststk/Send USSD 4.10.2",
 				&send_ussd_data_4102, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 5.1.1",
+	add_command_test("/teststk/Send USSD 5.1.1",
 				&send_ussd_data_511, test_send_ussd);
-	g_test_add_data_func("/teststk/Send USSD 6.1.1",
+	add_command_test("/teststk/Send USSD 6.1.1",
 				&send_ussd_data_611, test_send_ussd);
 
-	g_test_add_data_func("/teststk/Send SMS response 1.1.1",
+	add_response_test("/teststk/Send SMS response 1.1.1",
 				&send_sms_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send SMS response 1.2.1",
+	add_response_test("/teststk/Send SMS response 1.2.1",
 				&send_sms_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send SMS response 3.1.1B",
+	add_response_test("/teststk/Send SMS response 3.1.1B",
 				&send_sms_response_data_311b,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Setup Call 1.1.1",
+	add_command_test("/teststk/Setup Call 1.1.1",
 				&setup_call_data_111, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.4.1",
+	add_command_test("/teststk/Setup Call 1.4.1",
 				&setup_call_data_141, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.5.1",
+	add_command_test("/teststk/Setup Call 1.5.1",
 				&setup_call_data_151, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.8.1",
+	add_command_test("/teststk/Setup Call 1.8.1",
 				&setup_call_data_181, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.9.1",
+	add_command_test("/teststk/Setup Call 1.9.1",
 				&setup_call_data_191, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.10.1",
+	add_command_test("/teststk/Setup Call 1.10.1",
 				&setup_call_data_1101, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.11.1",
+	add_command_test("/teststk/Setup Call 1.11.1",
 				&setup_call_data_1111, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 1.12.1",
+	add_command_test("/teststk/Setup Call 1.12.1",
 				&setup_call_data_1121, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 2.1.1",
+	add_command_test("/teststk/Setup Call 2.1.1",
 				&setup_call_data_211, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 3.1.1",
+	add_command_test("/teststk/Setup Call 3.1.1",
 				&setup_call_data_311, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 3.2.1",
+	add_command_test("/teststk/Setup Call 3.2.1",
 				&setup_call_data_321, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 3.3.1",
+	add_command_test("/teststk/Setup Call 3.3.1",
 				&setup_call_data_331, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 3.4.1",
+	add_command_test("/teststk/Setup Call 3.4.1",
 				&setup_call_data_341, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.1.1",
+	add_command_test("/teststk/Setup Call 4.1.1",
 				&setup_call_data_411, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.1.2",
+	add_command_test("/teststk/Setup Call 4.1.2",
 				&setup_call_data_412, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.2.1",
+	add_command_test("/teststk/Setup Call 4.2.1",
 				&setup_call_data_421, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.2.2",
+	add_command_test("/teststk/Setup Call 4.2.2",
 				&setup_call_data_422, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.3.1",
+	add_command_test("/teststk/Setup Call 4.3.1",
 				&setup_call_data_431, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.3.2",
+	add_command_test("/teststk/Setup Call 4.3.2",
 				&setup_call_data_432, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.4.1",
+	add_command_test("/teststk/Setup Call 4.4.1",
 				&setup_call_data_441, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.4.2",
+	add_command_test("/teststk/Setup Call 4.4.2",
 				&setup_call_data_442, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.4.3",
+	add_command_test("/teststk/Setup Call 4.4.3",
 				&setup_call_data_443, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.5.1",
+	add_command_test("/teststk/Setup Call 4.5.1",
 				&setup_call_data_451, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.5.2",
+	add_command_test("/teststk/Setup Call 4.5.2",
 				&setup_call_data_452, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.5.3",
+	add_command_test("/teststk/Setup Call 4.5.3",
 				&setup_call_data_453, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.6.1",
+	add_command_test("/teststk/Setup Call 4.6.1",
 				&setup_call_data_461, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.6.2",
+	add_command_test("/teststk/Setup Call 4.6.2",
 				&setup_call_data_462, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.6.3",
+	add_command_test("/teststk/Setup Call 4.6.3",
 				&setup_call_data_463, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.7.1",
+	add_command_test("/teststk/Setup Call 4.7.1",
 				&setup_call_data_471, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.7.2",
+	add_command_test("/teststk/Setup Call 4.7.2",
 				&setup_call_data_472, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.7.3",
+	add_command_test("/teststk/Setup Call 4.7.3",
 				&setup_call_data_473, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.8.1",
+	add_command_test("/teststk/Setup Call 4.8.1",
 				&setup_call_data_481, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.8.2",
+	add_command_test("/teststk/Setup Call 4.8.2",
 				&setup_call_data_482, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.8.3",
+	add_command_test("/teststk/Setup Call 4.8.3",
 				&setup_call_data_483, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.9.1",
+	add_command_test("/teststk/Setup Call 4.9.1",
 				&setup_call_data_491, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.9.2",
+	add_command_test("/teststk/Setup Call 4.9.2",
 				&setup_call_data_492, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.9.3",
+	add_command_test("/teststk/Setup Call 4.9.3",
 				&setup_call_data_493, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.10.1",
+	add_command_test("/teststk/Setup Call 4.10.1",
 				&setup_call_data_4101, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 4.10.2",
+	add_command_test("/teststk/Setup Call 4.10.2",
 				&setup_call_data_4102, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 5.1.1",
+	add_command_test("/teststk/Setup Call 5.1.1",
 				&setup_call_data_511, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 5.2.1",
+	add_command_test("/teststk/Setup Call 5.2.1",
 				&setup_call_data_521, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 6.1.1",
+	add_command_test("/teststk/Setup Call 6.1.1",
 				&setup_call_data_611, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 6.2.1",
+	add_command_test("/teststk/Setup Call 6.2.1",
 				&setup_call_data_621, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 7.1.1",
+	add_command_test("/teststk/Setup Call 7.1.1",
 				&setup_call_data_711, test_setup_call);
-	g_test_add_data_func("/teststk/Setup Call 7.2.1",
+	add_command_test("/teststk/Setup Call 7.2.1",
 				&setup_call_data_721, test_setup_call);
 
-	g_test_add_data_func("/teststk/Set Up Call response 1.1.1",
+	add_response_test("/teststk/Set Up Call response 1.1.1",
 				&set_up_call_response_data_111,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.2.1",
+	add_response_test("/teststk/Set Up Call response 1.2.1",
 				&set_up_call_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.4.1",
+	add_response_test("/teststk/Set Up Call response 1.4.1",
 				&set_up_call_response_data_141,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.5.1",
+	add_response_test("/teststk/Set Up Call response 1.5.1",
 				&set_up_call_response_data_151,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.6.1",
+	add_response_test("/teststk/Set Up Call response 1.6.1",
 				&set_up_call_response_data_161,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.7.1A",
+	add_response_test("/teststk/Set Up Call response 1.7.1A",
 				&set_up_call_response_data_171a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.7.1B",
+	add_response_test("/teststk/Set Up Call response 1.7.1B",
 				&set_up_call_response_data_171b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.10.1",
+	add_response_test("/teststk/Set Up Call response 1.10.1",
 				&set_up_call_response_data_1101,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.11.1B",
+	add_response_test("/teststk/Set Up Call response 1.11.1B",
 				&set_up_call_response_data_1111b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 1.12.1",
+	add_response_test("/teststk/Set Up Call response 1.12.1",
 				&set_up_call_response_data_1121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Call response 3.1.1B",
+	add_response_test("/teststk/Set Up Call response 3.1.1B",
 				&set_up_call_response_data_311b,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Refresh 1.2.1",
+	add_command_test("/teststk/Refresh 1.2.1",
 				&refresh_data_121, test_refresh);
-	g_test_add_data_func("/teststk/Refresh 1.5.1",
+	add_command_test("/teststk/Refresh 1.5.1",
 				&refresh_data_151, test_refresh);
 
-	g_test_add_data_func("/teststk/Refresh response 1.1.1A",
+	add_response_test("/teststk/Refresh response 1.1.1A",
 				&refresh_response_data_111a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.1.1B",
+	add_response_test("/teststk/Refresh response 1.1.1B",
 				&refresh_response_data_111b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.2.1A",
+	add_response_test("/teststk/Refresh response 1.2.1A",
 				&refresh_response_data_121a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.2.1B",
+	add_response_test("/teststk/Refresh response 1.2.1B",
 				&refresh_response_data_121b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.3.1A",
+	add_response_test("/teststk/Refresh response 1.3.1A",
 				&refresh_response_data_131a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.3.1B",
+	add_response_test("/teststk/Refresh response 1.3.1B",
 				&refresh_response_data_141b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.4.1A",
+	add_response_test("/teststk/Refresh response 1.4.1A",
 				&refresh_response_data_141a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.4.1B",
+	add_response_test("/teststk/Refresh response 1.4.1B",
 				&refresh_response_data_141b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 1.7.1",
+	add_response_test("/teststk/Refresh response 1.7.1",
 				&refresh_response_data_171,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 2.4.1A",
+	add_response_test("/teststk/Refresh response 2.4.1A",
 				&refresh_response_data_241a,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 2.4.1B",
+	add_response_test("/teststk/Refresh response 2.4.1B",
 				&refresh_response_data_241b,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 3.1.1",
+	add_response_test("/teststk/Refresh response 3.1.1",
 				&refresh_response_data_311,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Refresh response 3.1.2",
+	add_response_test("/teststk/Refresh response 3.1.2",
 				&refresh_response_data_312,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Polling off 1.1.2",
+	add_command_test("/teststk/Polling off 1.1.2",
 				&polling_off_data_112, test_polling_off);
 
-	g_test_add_data_func("/teststk/Polling off response 1.1.2",
+	add_response_test("/teststk/Polling off response 1.1.2",
 				&polling_off_response_data_112,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Provide Local Info 1.2.1",
+	add_command_test("/teststk/Provide Local Info 1.2.1",
 			&provide_local_info_data_121, test_provide_local_info);
-	g_test_add_data_func("/teststk/Provide Local Info 1.4.1",
+	add_command_test("/teststk/Provide Local Info 1.4.1",
 			&provide_local_info_data_141, test_provide_local_info);
-	g_test_add_data_func("/teststk/Provide Local Info 1.5.1",
+	add_command_test("/teststk/Provide Local Info 1.5.1",
 			&provide_local_info_data_151, test_provide_local_info);
-	g_test_add_data_func("/teststk/Provide Local Info 1.8.1",
+	add_command_test("/teststk/Provide Local Info 1.8.1",
 			&provide_local_info_data_181, test_provide_local_info);
-	g_test_add_data_func("/teststk/Provide Local Info 1.9.1",
+	add_command_test("/teststk/Provide Local Info 1.9.1",
 			&provide_local_info_data_191, test_provide_local_info);
-	g_test_add_data_func("/teststk/Provide Local Info 1.11.1",
+	add_command_test("/teststk/Provide Local Info 1.11.1",
 			&provide_local_info_data_1111, test_provide_local_info);
 
-	g_test_add_data_func("/teststk/Provide Local Info response 1.1.1A",
+	add_response_test("/teststk/Provide Local Info response 1.1.1A",
 			&provide_local_info_response_data_111a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.1.1B",
+	add_response_test("/teststk/Provide Local Info response 1.1.1B",
 			&provide_local_info_response_data_111b,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.2.1",
+	add_response_test("/teststk/Provide Local Info response 1.2.1",
 			&provide_local_info_response_data_121,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.3.1",
+	add_response_test("/teststk/Provide Local Info response 1.3.1",
 			&provide_local_info_response_data_131,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.4.1",
+	add_response_test("/teststk/Provide Local Info response 1.4.1",
 			&provide_local_info_response_data_141,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.5.1",
+	add_response_test("/teststk/Provide Local Info response 1.5.1",
 			&provide_local_info_response_data_151,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.6.1",
+	add_response_test("/teststk/Provide Local Info response 1.6.1",
 			&provide_local_info_response_data_161,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.7.1",
+	add_response_test("/teststk/Provide Local Info response 1.7.1",
 			&provide_local_info_response_data_171,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.8.1",
+	add_response_test("/teststk/Provide Local Info response 1.8.1",
 			&provide_local_info_response_data_181,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.9.1",
+	add_response_test("/teststk/Provide Local Info response 1.9.1",
 			&provide_local_info_response_data_191,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.11.1",
+	add_response_test("/teststk/Provide Local Info response 1.11.1",
 			&provide_local_info_response_data_1111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.12.1",
+	add_response_test("/teststk/Provide Local Info response 1.12.1",
 			&provide_local_info_response_data_1121,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.13.1",
+	add_response_test("/teststk/Provide Local Info response 1.13.1",
 			&provide_local_info_response_data_1131,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.14.1",
+	add_response_test("/teststk/Provide Local Info response 1.14.1",
 			&provide_local_info_response_data_1141,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.15.1",
+	add_response_test("/teststk/Provide Local Info response 1.15.1",
 			&provide_local_info_response_data_1151,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.16.1",
+	add_response_test("/teststk/Provide Local Info response 1.16.1",
 			&provide_local_info_response_data_1161,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Provide Local Info response 1.17.1",
+	add_response_test("/teststk/Provide Local Info response 1.17.1",
 			&provide_local_info_response_data_1171,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Setup Event List 1.1.1",
+	add_command_test("/teststk/Setup Event List 1.1.1",
 			&setup_event_list_data_111, test_setup_event_list);
-	g_test_add_data_func("/teststk/Setup Event List 1.2.1",
+	add_command_test("/teststk/Setup Event List 1.2.1",
 			&setup_event_list_data_121, test_setup_event_list);
-	g_test_add_data_func("/teststk/Setup Event List 1.2.2",
+	add_command_test("/teststk/Setup Event List 1.2.2",
 			&setup_event_list_data_122, test_setup_event_list);
-	g_test_add_data_func("/teststk/Setup Event List 1.3.1",
+	add_command_test("/teststk/Setup Event List 1.3.1",
 			&setup_event_list_data_131, test_setup_event_list);
-	g_test_add_data_func("/teststk/Setup Event List 1.3.2",
+	add_command_test("/teststk/Setup Event List 1.3.2",
 			&setup_event_list_data_132, test_setup_event_list);
-	g_test_add_data_func("/teststk/Setup Event List 1.4.1",
+	add_command_test("/teststk/Setup Event List 1.4.1",
 			&setup_event_list_data_141, test_setup_event_list);
 
-	g_test_add_data_func("/teststk/Set Up Event List response 1.1.1",
+	add_response_test("/teststk/Set Up Event List response 1.1.1",
 			&set_up_event_list_response_data_111,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Perform Card APDU 1.1.1",
+	add_command_test("/teststk/Perform Card APDU 1.1.1",
 			&perform_card_apdu_data_111, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.1.2",
+	add_command_test("/teststk/Perform Card APDU 1.1.2",
 			&perform_card_apdu_data_112, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.2.1",
+	add_command_test("/teststk/Perform Card APDU 1.2.1",
 			&perform_card_apdu_data_121, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.2.2",
+	add_command_test("/teststk/Perform Card APDU 1.2.2",
 			&perform_card_apdu_data_122, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.2.3",
+	add_command_test("/teststk/Perform Card APDU 1.2.3",
 			&perform_card_apdu_data_123, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.2.4",
+	add_command_test("/teststk/Perform Card APDU 1.2.4",
 			&perform_card_apdu_data_124, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.2.5",
+	add_command_test("/teststk/Perform Card APDU 1.2.5",
 			&perform_card_apdu_data_125, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 1.5.1",
+	add_command_test("/teststk/Perform Card APDU 1.5.1",
 			&perform_card_apdu_data_151, test_perform_card_apdu);
-	g_test_add_data_func("/teststk/Perform Card APDU 2.1.1",
+	add_command_test("/teststk/Perform Card APDU 2.1.1",
 			&perform_card_apdu_data_211, test_perform_card_apdu);
 
-	g_test_add_data_func("/teststk/Get Reader Status 1.1.1",
+	add_command_test("/teststk/Get Reader Status 1.1.1",
 			&get_reader_status_data_111, test_get_reader_status);
 
-	g_test_add_data_func("/teststk/Timer Management 1.1.1",
+	add_command_test("/teststk/Timer Management 1.1.1",
 			&timer_mgmt_data_111, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.1.2",
+	add_command_test("/teststk/Timer Management 1.1.2",
 			&timer_mgmt_data_112, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.1.3",
+	add_command_test("/teststk/Timer Management 1.1.3",
 			&timer_mgmt_data_113, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.1.4",
+	add_command_test("/teststk/Timer Management 1.1.4",
 			&timer_mgmt_data_114, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.2.1",
+	add_command_test("/teststk/Timer Management 1.2.1",
 			&timer_mgmt_data_121, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.2.2",
+	add_command_test("/teststk/Timer Management 1.2.2",
 			&timer_mgmt_data_122, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.2.3",
+	add_command_test("/teststk/Timer Management 1.2.3",
 			&timer_mgmt_data_123, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.2.4",
+	add_command_test("/teststk/Timer Management 1.2.4",
 			&timer_mgmt_data_124, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.3.1",
+	add_command_test("/teststk/Timer Management 1.3.1",
 			&timer_mgmt_data_131, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.3.2",
+	add_command_test("/teststk/Timer Management 1.3.2",
 			&timer_mgmt_data_132, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.3.3",
+	add_command_test("/teststk/Timer Management 1.3.3",
 			&timer_mgmt_data_133, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.3.4",
+	add_command_test("/teststk/Timer Management 1.3.4",
 			&timer_mgmt_data_134, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.1",
+	add_command_test("/teststk/Timer Management 1.4.1",
 			&timer_mgmt_data_141, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.2",
+	add_command_test("/teststk/Timer Management 1.4.2",
 			&timer_mgmt_data_142, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.3",
+	add_command_test("/teststk/Timer Management 1.4.3",
 			&timer_mgmt_data_143, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.4",
+	add_command_test("/teststk/Timer Management 1.4.4",
 			&timer_mgmt_data_144, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.5",
+	add_command_test("/teststk/Timer Management 1.4.5",
 			&timer_mgmt_data_145, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.6",
+	add_command_test("/teststk/Timer Management 1.4.6",
 			&timer_mgmt_data_146, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.7",
+	add_command_test("/teststk/Timer Management 1.4.7",
 			&timer_mgmt_data_147, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.4.8",
+	add_command_test("/teststk/Timer Management 1.4.8",
 			&timer_mgmt_data_148, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.1",
+	add_command_test("/teststk/Timer Management 1.5.1",
 			&timer_mgmt_data_151, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.2",
+	add_command_test("/teststk/Timer Management 1.5.2",
 			&timer_mgmt_data_152, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.3",
+	add_command_test("/teststk/Timer Management 1.5.3",
 			&timer_mgmt_data_153, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.4",
+	add_command_test("/teststk/Timer Management 1.5.4",
 			&timer_mgmt_data_154, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.5",
+	add_command_test("/teststk/Timer Management 1.5.5",
 			&timer_mgmt_data_155, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.6",
+	add_command_test("/teststk/Timer Management 1.5.6",
 			&timer_mgmt_data_156, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.7",
+	add_command_test("/teststk/Timer Management 1.5.7",
 			&timer_mgmt_data_157, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.5.8",
+	add_command_test("/teststk/Timer Management 1.5.8",
 			&timer_mgmt_data_158, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.1",
+	add_command_test("/teststk/Timer Management 1.6.1",
 			&timer_mgmt_data_161, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.2",
+	add_command_test("/teststk/Timer Management 1.6.2",
 			&timer_mgmt_data_162, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.3",
+	add_command_test("/teststk/Timer Management 1.6.3",
 			&timer_mgmt_data_163, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.4",
+	add_command_test("/teststk/Timer Management 1.6.4",
 			&timer_mgmt_data_164, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.5",
+	add_command_test("/teststk/Timer Management 1.6.5",
 			&timer_mgmt_data_165, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.6",
+	add_command_test("/teststk/Timer Management 1.6.6",
 			&timer_mgmt_data_166, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.7",
+	add_command_test("/teststk/Timer Management 1.6.7",
 			&timer_mgmt_data_167, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 1.6.8",
+	add_command_test("/teststk/Timer Management 1.6.8",
 			&timer_mgmt_data_168, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 2.1.1",
+	add_command_test("/teststk/Timer Management 2.1.1",
 			&timer_mgmt_data_211, test_timer_mgmt);
-	g_test_add_data_func("/teststk/Timer Management 2.2.1",
+	add_command_test("/teststk/Timer Management 2.2.1",
 			&timer_mgmt_data_221, test_timer_mgmt);
 
-	g_test_add_data_func("/teststk/Timer Management response 1.1.1",
+	add_response_test("/teststk/Timer Management response 1.1.1",
 			&timer_mgmt_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.1.2",
+	add_response_test("/teststk/Timer Management response 1.1.2",
 			&timer_mgmt_response_data_112,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.1.4",
+	add_response_test("/teststk/Timer Management response 1.1.4",
 			&timer_mgmt_response_data_114,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.2.1",
+	add_response_test("/teststk/Timer Management response 1.2.1",
 			&timer_mgmt_response_data_121,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.2.2",
+	add_response_test("/teststk/Timer Management response 1.2.2",
 			&timer_mgmt_response_data_122,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.2.4",
+	add_response_test("/teststk/Timer Management response 1.2.4",
 			&timer_mgmt_response_data_124,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.3.1",
+	add_response_test("/teststk/Timer Management response 1.3.1",
 			&timer_mgmt_response_data_131,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.3.2",
+	add_response_test("/teststk/Timer Management response 1.3.2",
 			&timer_mgmt_response_data_132,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.3.4",
+	add_response_test("/teststk/Timer Management response 1.3.4",
 			&timer_mgmt_response_data_134,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.1A",
+	add_response_test("/teststk/Timer Management response 1.4.1A",
 			&timer_mgmt_response_data_141a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.1B",
+	add_response_test("/teststk/Timer Management response 1.4.1B",
 			&timer_mgmt_response_data_141b,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.2A",
+	add_response_test("/teststk/Timer Management response 1.4.2A",
 			&timer_mgmt_response_data_142a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.3A",
+	add_response_test("/teststk/Timer Management response 1.4.3A",
 			&timer_mgmt_response_data_143a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.4A",
+	add_response_test("/teststk/Timer Management response 1.4.4A",
 			&timer_mgmt_response_data_144a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.5A",
+	add_response_test("/teststk/Timer Management response 1.4.5A",
 			&timer_mgmt_response_data_145a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.6A",
+	add_response_test("/teststk/Timer Management response 1.4.6A",
 			&timer_mgmt_response_data_146a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.7A",
+	add_response_test("/teststk/Timer Management response 1.4.7A",
 			&timer_mgmt_response_data_147a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.4.8A",
+	add_response_test("/teststk/Timer Management response 1.4.8A",
 			&timer_mgmt_response_data_148a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.1A",
+	add_response_test("/teststk/Timer Management response 1.5.1A",
 			&timer_mgmt_response_data_151a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.1B",
+	add_response_test("/teststk/Timer Management response 1.5.1B",
 			&timer_mgmt_response_data_151b,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.2A",
+	add_response_test("/teststk/Timer Management response 1.5.2A",
 			&timer_mgmt_response_data_152a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.3A",
+	add_response_test("/teststk/Timer Management response 1.5.3A",
 			&timer_mgmt_response_data_153a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.4A",
+	add_response_test("/teststk/Timer Management response 1.5.4A",
 			&timer_mgmt_response_data_154a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.5A",
+	add_response_test("/teststk/Timer Management response 1.5.5A",
 			&timer_mgmt_response_data_155a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.6A",
+	add_response_test("/teststk/Timer Management response 1.5.6A",
 			&timer_mgmt_response_data_156a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.7A",
+	add_response_test("/teststk/Timer Management response 1.5.7A",
 			&timer_mgmt_response_data_157a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.5.8A",
+	add_response_test("/teststk/Timer Management response 1.5.8A",
 			&timer_mgmt_response_data_158a,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.6.3",
+	add_response_test("/teststk/Timer Management response 1.6.3",
 			&timer_mgmt_response_data_163,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.6.4",
+	add_response_test("/teststk/Timer Management response 1.6.4",
 			&timer_mgmt_response_data_164,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.6.5",
+	add_response_test("/teststk/Timer Management response 1.6.5",
 			&timer_mgmt_response_data_165,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.6.6",
+	add_response_test("/teststk/Timer Management response 1.6.6",
 			&timer_mgmt_response_data_166,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Timer Management response 1.6.7",
+	add_response_test("/teststk/Timer Management response 1.6.7",
 			&timer_mgmt_response_data_167,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 1.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 1.1.1",
 		&setup_idle_mode_text_data_111, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 1.2.1",
+	add_command_test("/teststk/Setup Idle Mode Text 1.2.1",
 		&setup_idle_mode_text_data_121, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 1.3.1",
+	add_command_test("/teststk/Setup Idle Mode Text 1.3.1",
 		&setup_idle_mode_text_data_131, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 1.7.1",
+	add_command_test("/teststk/Setup Idle Mode Text 1.7.1",
 		&setup_idle_mode_text_data_171, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 2.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 2.1.1",
 		&setup_idle_mode_text_data_211, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 2.2.1",
+	add_command_test("/teststk/Setup Idle Mode Text 2.2.1",
 		&setup_idle_mode_text_data_221, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 2.3.1",
+	add_command_test("/teststk/Setup Idle Mode Text 2.3.1",
 		&setup_idle_mode_text_data_231, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 2.4.1",
+	add_command_test("/teststk/Setup Idle Mode Text 2.4.1",
 		&setup_idle_mode_text_data_241, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 3.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 3.1.1",
 		&setup_idle_mode_text_data_311, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.1.1",
 		&setup_idle_mode_text_data_411, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.1.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.1.2",
 		&setup_idle_mode_text_data_412, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.2.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.2.1",
 		&setup_idle_mode_text_data_421, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.2.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.2.2",
 		&setup_idle_mode_text_data_422, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.3.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.3.1",
 		&setup_idle_mode_text_data_431, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.3.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.3.2",
 		&setup_idle_mode_text_data_432, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.4.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.4.1",
 		&setup_idle_mode_text_data_441, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.4.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.4.2",
 		&setup_idle_mode_text_data_442, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.4.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.4.3",
 		&setup_idle_mode_text_data_443, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.5.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.5.1",
 		&setup_idle_mode_text_data_451, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.5.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.5.2",
 		&setup_idle_mode_text_data_452, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.5.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.5.3",
 		&setup_idle_mode_text_data_453, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.6.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.6.1",
 		&setup_idle_mode_text_data_461, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.6.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.6.2",
 		&setup_idle_mode_text_data_462, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.6.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.6.3",
 		&setup_idle_mode_text_data_463, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.7.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.7.1",
 		&setup_idle_mode_text_data_471, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.7.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.7.2",
 		&setup_idle_mode_text_data_472, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.7.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.7.3",
 		&setup_idle_mode_text_data_473, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.8.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.8.1",
 		&setup_idle_mode_text_data_481, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.8.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.8.2",
 		&setup_idle_mode_text_data_482, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.8.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.8.3",
 		&setup_idle_mode_text_data_483, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.9.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.9.1",
 		&setup_idle_mode_text_data_491, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.9.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.9.2",
 		&setup_idle_mode_text_data_492, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.9.3",
+	add_command_test("/teststk/Setup Idle Mode Text 4.9.3",
 		&setup_idle_mode_text_data_493, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.10.1",
+	add_command_test("/teststk/Setup Idle Mode Text 4.10.1",
 		&setup_idle_mode_text_data_4101, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 4.10.2",
+	add_command_test("/teststk/Setup Idle Mode Text 4.10.2",
 		&setup_idle_mode_text_data_4102, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 5.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 5.1.1",
 		&setup_idle_mode_text_data_511, test_setup_idle_mode_text);
-	g_test_add_data_func("/teststk/Setup Idle Mode Text 6.1.1",
+	add_command_test("/teststk/Setup Idle Mode Text 6.1.1",
 		&setup_idle_mode_text_data_611, test_setup_idle_mode_text);
 
-	g_test_add_data_func("/teststk/Set Up Idle Mode Text response 1.1.1",
+	add_response_test("/teststk/Set Up Idle Mode Text response 1.1.1",
 			&set_up_idle_mode_text_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Idle Mode Text response 2.1.1B",
+	add_response_test("/teststk/Set Up Idle Mode Text response 2.1.1B",
 			&set_up_idle_mode_text_response_data_211b,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Set Up Idle Mode Text response 2.4.1",
+	add_response_test("/teststk/Set Up Idle Mode Text response 2.4.1",
 			&set_up_idle_mode_text_response_data_241,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Run At Command 1.1.1",
+	add_command_test("/teststk/Run At Command 1.1.1",
 			&run_at_command_data_111, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 1.2.1",
+	add_command_test("/teststk/Run At Command 1.2.1",
 			&run_at_command_data_121, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 1.3.1",
+	add_command_test("/teststk/Run At Command 1.3.1",
 			&run_at_command_data_131, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 2.1.1",
+	add_command_test("/teststk/Run At Command 2.1.1",
 			&run_at_command_data_211, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 2.2.1",
+	add_command_test("/teststk/Run At Command 2.2.1",
 			&run_at_command_data_221, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 2.3.1",
+	add_command_test("/teststk/Run At Command 2.3.1",
 			&run_at_command_data_231, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 2.4.1",
+	add_command_test("/teststk/Run At Command 2.4.1",
 			&run_at_command_data_241, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 2.5.1",
+	add_command_test("/teststk/Run At Command 2.5.1",
 			&run_at_command_data_251, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.1.1",
+	add_command_test("/teststk/Run At Command 3.1.1",
 			&run_at_command_data_311, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.1.2",
+	add_command_test("/teststk/Run At Command 3.1.2",
 			&run_at_command_data_312, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.2.1",
+	add_command_test("/teststk/Run At Command 3.2.1",
 			&run_at_command_data_321, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.2.2",
+	add_command_test("/teststk/Run At Command 3.2.2",
 			&run_at_command_data_322, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.3.1",
+	add_command_test("/teststk/Run At Command 3.3.1",
 			&run_at_command_data_331, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.3.2",
+	add_command_test("/teststk/Run At Command 3.3.2",
 			&run_at_command_data_332, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.4.1",
+	add_command_test("/teststk/Run At Command 3.4.1",
 			&run_at_command_data_341, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.4.2",
+	add_command_test("/teststk/Run At Command 3.4.2",
 			&run_at_command_data_342, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.4.3",
+	add_command_test("/teststk/Run At Command 3.4.3",
 			&run_at_command_data_343, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.5.1",
+	add_command_test("/teststk/Run At Command 3.5.1",
 			&run_at_command_data_351, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.5.2",
+	add_command_test("/teststk/Run At Command 3.5.2",
 			&run_at_command_data_352, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.5.3",
+	add_command_test("/teststk/Run At Command 3.5.3",
 			&run_at_command_data_353, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.6.1",
+	add_command_test("/teststk/Run At Command 3.6.1",
 			&run_at_command_data_361, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.6.2",
+	add_command_test("/teststk/Run At Command 3.6.2",
 			&run_at_command_data_362, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.6.3",
+	add_command_test("/teststk/Run At Command 3.6.3",
 			&run_at_command_data_363, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.7.1",
+	add_command_test("/teststk/Run At Command 3.7.1",
 			&run_at_command_data_371, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.7.2",
+	add_command_test("/teststk/Run At Command 3.7.2",
 			&run_at_command_data_372, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.7.3",
+	add_command_test("/teststk/Run At Command 3.7.3",
 			&run_at_command_data_373, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.8.1",
+	add_command_test("/teststk/Run At Command 3.8.1",
 			&run_at_command_data_381, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.8.2",
+	add_command_test("/teststk/Run At Command 3.8.2",
 			&run_at_command_data_382, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.8.3",
+	add_command_test("/teststk/Run At Command 3.8.3",
 			&run_at_command_data_383, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.9.1",
+	add_command_test("/teststk/Run At Command 3.9.1",
 			&run_at_command_data_391, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.9.2",
+	add_command_test("/teststk/Run At Command 3.9.2",
 			&run_at_command_data_392, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.9.3",
+	add_command_test("/teststk/Run At Command 3.9.3",
 			&run_at_command_data_393, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.10.1",
+	add_command_test("/teststk/Run At Command 3.10.1",
 			&run_at_command_data_3101, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 3.10.2",
+	add_command_test("/teststk/Run At Command 3.10.2",
 			&run_at_command_data_3102, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 4.1.1",
+	add_command_test("/teststk/Run At Command 4.1.1",
 			&run_at_command_data_411, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 5.1.1",
+	add_command_test("/teststk/Run At Command 5.1.1",
 			&run_at_command_data_511, test_run_at_command);
-	g_test_add_data_func("/teststk/Run At Command 6.1.1",
+	add_command_test("/teststk/Run At Command 6.1.1",
 			&run_at_command_data_611, test_run_at_command);
 
-	g_test_add_data_func("/teststk/Run AT Command response 1.1.1",
+	add_response_test("/teststk/Run AT Command response 1.1.1",
 			&run_at_command_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Run AT Command response 2.1.1B",
+	add_response_test("/teststk/Run AT Command response 2.1.1B",
 			&run_at_command_response_data_211b,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Run AT Command response 2.5.1",
+	add_response_test("/teststk/Run AT Command response 2.5.1",
 			&run_at_command_response_data_251,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Send DTMF 1.1.1",
+	add_command_test("/teststk/Send DTMF 1.1.1",
 			&send_dtmf_data_111, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 1.2.1",
+	add_command_test("/teststk/Send DTMF 1.2.1",
 			&send_dtmf_data_121, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 1.3.1",
+	add_command_test("/teststk/Send DTMF 1.3.1",
 			&send_dtmf_data_131, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 2.1.1",
+	add_command_test("/teststk/Send DTMF 2.1.1",
 			&send_dtmf_data_211, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 2.2.1",
+	add_command_test("/teststk/Send DTMF 2.2.1",
 			&send_dtmf_data_221, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 2.3.1",
+	add_command_test("/teststk/Send DTMF 2.3.1",
 			&send_dtmf_data_231, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 3.1.1",
+	add_command_test("/teststk/Send DTMF 3.1.1",
 			&send_dtmf_data_311, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.1.1",
+	add_command_test("/teststk/Send DTMF 4.1.1",
 			&send_dtmf_data_411, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.1.2",
+	add_command_test("/teststk/Send DTMF 4.1.2",
 			&send_dtmf_data_412, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.2.1",
+	add_command_test("/teststk/Send DTMF 4.2.1",
 			&send_dtmf_data_421, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.2.2",
+	add_command_test("/teststk/Send DTMF 4.2.2",
 			&send_dtmf_data_422, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.3.1",
+	add_command_test("/teststk/Send DTMF 4.3.1",
 			&send_dtmf_data_431, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.3.2",
+	add_command_test("/teststk/Send DTMF 4.3.2",
 			&send_dtmf_data_432, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.4.1",
+	add_command_test("/teststk/Send DTMF 4.4.1",
 			&send_dtmf_data_441, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.4.2",
+	add_command_test("/teststk/Send DTMF 4.4.2",
 			&send_dtmf_data_442, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.4.3",
+	add_command_test("/teststk/Send DTMF 4.4.3",
 			&send_dtmf_data_443, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.5.1",
+	add_command_test("/teststk/Send DTMF 4.5.1",
 			&send_dtmf_data_451, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.5.2",
+	add_command_test("/teststk/Send DTMF 4.5.2",
 			&send_dtmf_data_452, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.5.3",
+	add_command_test("/teststk/Send DTMF 4.5.3",
 			&send_dtmf_data_453, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.6.1",
+	add_command_test("/teststk/Send DTMF 4.6.1",
 			&send_dtmf_data_461, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.6.2",
+	add_command_test("/teststk/Send DTMF 4.6.2",
 			&send_dtmf_data_462, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.6.3",
+	add_command_test("/teststk/Send DTMF 4.6.3",
 			&send_dtmf_data_463, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.7.1",
+	add_command_test("/teststk/Send DTMF 4.7.1",
 			&send_dtmf_data_471, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.7.2",
+	add_command_test("/teststk/Send DTMF 4.7.2",
 			&send_dtmf_data_472, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.7.3",
+	add_command_test("/teststk/Send DTMF 4.7.3",
 			&send_dtmf_data_473, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.8.1",
+	add_command_test("/teststk/Send DTMF 4.8.1",
 			&send_dtmf_data_481, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.8.2",
+	add_command_test("/teststk/Send DTMF 4.8.2",
 			&send_dtmf_data_482, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.8.3",
+	add_command_test("/teststk/Send DTMF 4.8.3",
 			&send_dtmf_data_483, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.9.1",
+	add_command_test("/teststk/Send DTMF 4.9.1",
 			&send_dtmf_data_491, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.9.2",
+	add_command_test("/teststk/Send DTMF 4.9.2",
 			&send_dtmf_data_492, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.9.3",
+	add_command_test("/teststk/Send DTMF 4.9.3",
 			&send_dtmf_data_493, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.10.1",
+	add_command_test("/teststk/Send DTMF 4.10.1",
 			&send_dtmf_data_4101, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 4.10.2",
+	add_command_test("/teststk/Send DTMF 4.10.2",
 			&send_dtmf_data_4102, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 5.1.1",
+	add_command_test("/teststk/Send DTMF 5.1.1",
 			&send_dtmf_data_511, test_send_dtmf);
-	g_test_add_data_func("/teststk/Send DTMF 6.1.1",
+	add_command_test("/teststk/Send DTMF 6.1.1",
 			&send_dtmf_data_611, test_send_dtmf);
 
-	g_test_add_data_func("/teststk/Send DTMF response 1.1.1",
+	add_response_test("/teststk/Send DTMF response 1.1.1",
 			&send_dtmf_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send DTMF response 1.4.1",
+	add_response_test("/teststk/Send DTMF response 1.4.1",
 			&send_dtmf_response_data_141,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send DTMF response 2.1.1B",
+	add_response_test("/teststk/Send DTMF response 2.1.1B",
 			&send_dtmf_response_data_211b,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Language Notification 1.1.1",
+	add_command_test("/teststk/Language Notification 1.1.1",
 		&language_notification_data_111, test_language_notification);
-	g_test_add_data_func("/teststk/Language Notification 1.2.1",
+	add_command_test("/teststk/Language Notification 1.2.1",
 		&language_notification_data_121, test_language_notification);
 
-	g_test_add_data_func("/teststk/Language Notification response 1.1.1",
+	add_response_test("/teststk/Language Notification response 1.1.1",
 			&language_notification_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Language Notification response 1.2.1",
+	add_response_test("/teststk/Language Notification response 1.2.1",
 			&language_notification_response_data_121,
 			test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Launch Browser 1.1.1",
+	add_command_test("/teststk/Launch Browser 1.1.1",
 				&launch_browser_data_111, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 1.2.1",
+	add_command_test("/teststk/Launch Browser 1.2.1",
 				&launch_browser_data_121, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 1.3.1",
+	add_command_test("/teststk/Launch Browser 1.3.1",
 				&launch_browser_data_131, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 1.4.1",
+	add_command_test("/teststk/Launch Browser 1.4.1",
 				&launch_browser_data_141, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 2.1.1",
+	add_command_test("/teststk/Launch Browser 2.1.1",
 				&launch_browser_data_211, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 2.2.1",
+	add_command_test("/teststk/Launch Browser 2.2.1",
 				&launch_browser_data_221, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 2.3.1",
+	add_command_test("/teststk/Launch Browser 2.3.1",
 				&launch_browser_data_231, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 3.1.1",
+	add_command_test("/teststk/Launch Browser 3.1.1",
 				&launch_browser_data_311, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 4.1.1",
+	add_command_test("/teststk/Launch Browser 4.1.1",
 				&launch_browser_data_411, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 4.2.1",
+	add_command_test("/teststk/Launch Browser 4.2.1",
 				&launch_browser_data_421, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.1.1",
+	add_command_test("/teststk/Launch Browser 5.1.1",
 				&launch_browser_data_511, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.1.2",
+	add_command_test("/teststk/Launch Browser 5.1.2",
 				&launch_browser_data_512, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.2.1",
+	add_command_test("/teststk/Launch Browser 5.2.1",
 				&launch_browser_data_521, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.2.2",
+	add_command_test("/teststk/Launch Browser 5.2.2",
 				&launch_browser_data_522, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.3.1",
+	add_command_test("/teststk/Launch Browser 5.3.1",
 				&launch_browser_data_531, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.3.2",
+	add_command_test("/teststk/Launch Browser 5.3.2",
 				&launch_browser_data_532, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.4.1",
+	add_command_test("/teststk/Launch Browser 5.4.1",
 				&launch_browser_data_541, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.4.2",
+	add_command_test("/teststk/Launch Browser 5.4.2",
 				&launch_browser_data_542, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.4.3",
+	add_command_test("/teststk/Launch Browser 5.4.3",
 				&launch_browser_data_543, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.5.1",
+	add_command_test("/teststk/Launch Browser 5.5.1",
 				&launch_browser_data_551, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.5.2",
+	add_command_test("/teststk/Launch Browser 5.5.2",
 				&launch_browser_data_552, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.5.3",
+	add_command_test("/teststk/Launch Browser 5.5.3",
 				&launch_browser_data_553, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.6.1",
+	add_command_test("/teststk/Launch Browser 5.6.1",
 				&launch_browser_data_561, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.6.2",
+	add_command_test("/teststk/Launch Browser 5.6.2",
 				&launch_browser_data_562, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.6.3",
+	add_command_test("/teststk/Launch Browser 5.6.3",
 				&launch_browser_data_563, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.7.1",
+	add_command_test("/teststk/Launch Browser 5.7.1",
 				&launch_browser_data_571, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.7.2",
+	add_command_test("/teststk/Launch Browser 5.7.2",
 				&launch_browser_data_572, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.7.3",
+	add_command_test("/teststk/Launch Browser 5.7.3",
 				&launch_browser_data_573, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.8.1",
+	add_command_test("/teststk/Launch Browser 5.8.1",
 				&launch_browser_data_581, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.8.2",
+	add_command_test("/teststk/Launch Browser 5.8.2",
 				&launch_browser_data_582, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.8.3",
+	add_command_test("/teststk/Launch Browser 5.8.3",
 				&launch_browser_data_583, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.9.1",
+	add_command_test("/teststk/Launch Browser 5.9.1",
 				&launch_browser_data_591, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.9.2",
+	add_command_test("/teststk/Launch Browser 5.9.2",
 				&launch_browser_data_592, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.9.3",
+	add_command_test("/teststk/Launch Browser 5.9.3",
 				&launch_browser_data_593, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.10.1",
+	add_command_test("/teststk/Launch Browser 5.10.1",
 				&launch_browser_data_5101, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 5.10.2",
+	add_command_test("/teststk/Launch Browser 5.10.2",
 				&launch_browser_data_5102, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 6.1.1",
+	add_command_test("/teststk/Launch Browser 6.1.1",
 				&launch_browser_data_611, test_launch_browser);
-	g_test_add_data_func("/teststk/Launch Browser 7.1.1",
+	add_command_test("/teststk/Launch Browser 7.1.1",
 				&launch_browser_data_711, test_launch_browser);
 
-	g_test_add_data_func("/teststk/Launch Browser response 1.1.1",
+	add_response_test("/teststk/Launch Browser response 1.1.1",
 			&launch_browser_response_data_111,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Launch Browser response 2.1.1",
+	add_response_test("/teststk/Launch Browser response 2.1.1",
 			&launch_browser_response_data_211,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Launch Browser response 2.2.1",
+	add_response_test("/teststk/Launch Browser response 2.2.1",
 			&launch_browser_response_data_221,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Launch Browser response 2.3.1",
+	add_response_test("/teststk/Launch Browser response 2.3.1",
 			&launch_browser_response_data_231,
 			test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Launch Browser response 4.1.1B",
+	add_response_test("/teststk/Launch Browser response 4.1.1B",
 			&launch_browser_response_data_411b,
 			test_terminal_response_encoding);
 
 
-	g_test_add_data_func("/teststk/Open channel 2.1.1",
+	add_command_test("/teststk/Open channel 2.1.1",
 				&open_channel_data_211, test_open_channel);
-	g_test_add_data_func("/teststk/Open channel 2.2.1",
+	add_command_test("/teststk/Open channel 2.2.1",
 				&open_channel_data_221, test_open_channel);
-	g_test_add_data_func("/teststk/Open channel 2.3.1",
+	add_command_test("/teststk/Open channel 2.3.1",
 				&open_channel_data_231, test_open_channel);
-	g_test_add_data_func("/teststk/Open channel 2.4.1",
+	add_command_test("/teststk/Open channel 2.4.1",
 				&open_channel_data_241, test_open_channel);
-	g_test_add_data_func("/teststk/Open channel 5.1.1",
+	add_command_test("/teststk/Open channel 5.1.1",
 				&open_channel_data_511, test_open_channel);
-	g_test_add_data_func("/teststk/Open channel response 2.1.1",
+	add_response_test("/teststk/Open channel response 2.1.1",
 				&open_channel_response_data_211,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Open channel response 2.7.1",
+	add_response_test("/teststk/Open channel response 2.7.1",
 				&open_channel_response_data_271,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Close channel 1.1.1",
+	add_command_test("/teststk/Close channel 1.1.1",
 				&close_channel_data_111, test_close_channel);
-	g_test_add_data_func("/teststk/Close channel 2.1.1",
+	add_command_test("/teststk/Close channel 2.1.1",
 				&close_channel_data_211, test_close_channel);
-	g_test_add_data_func("/teststk/Close channel response 1.2.1",
+	add_response_test("/teststk/Close channel response 1.2.1",
 				&close_channel_response_data_121,
 				test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Close channel response 1.3.1",
+	add_response_test("/teststk/Close channel response 1.3.1",
 				&close_channel_response_data_131,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Receive data 1.1.1",
+	add_command_test("/teststk/Receive data 1.1.1",
 				&receive_data_data_111, test_receive_data);
-	g_test_add_data_func("/teststk/Receive data 2.1.1",
+	add_command_test("/teststk/Receive data 2.1.1",
 				&receive_data_data_211, test_receive_data);
-	g_test_add_data_func("/teststk/Receive data response 1.1.1",
+	add_response_test("/teststk/Receive data response 1.1.1",
 				&receive_data_response_data_111,
 				test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Send data 1.1.1",
+	add_command_test("/teststk/Send data 1.1.1",
 					&send_data_data_111, test_send_data);
-	g_test_add_data_func("/teststk/Send data 1.2.1",
+	add_command_test("/teststk/Send data 1.2.1",
 					&send_data_data_121, test_send_data);
-	g_test_add_data_func("/teststk/Send data 2.1.1",
+	add_command_test("/teststk/Send data 2.1.1",
 					&send_data_data_211, test_send_data);
-	g_test_add_data_func("/teststk/Send data response 1.1.1",
+	add_response_test("/teststk/Send data response 1.1.1",
 					&send_data_response_data_111,
 					test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send data response 1.2.1",
+	add_response_test("/teststk/Send data response 1.2.1",
 					&send_data_response_data_121,
 					test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Send data response 1.5.1",
+	add_response_test("/teststk/Send data response 1.5.1",
 					&send_data_response_data_151,
 					test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/Get Channel status 1.1.1",
+	add_command_test("/teststk/Get Channel status 1.1.1",
 			&get_channel_status_data_111, test_get_channel_status);
-	g_test_add_data_func("/teststk/Get Channel status response 1.1.1",
+	add_response_test("/teststk/Get Channel status response 1.1.1",
 					&get_channel_status_response_data_111,
 					test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Channel status response 1.2.1",
+	add_response_test("/teststk/Get Channel status response 1.2.1",
 					&get_channel_status_response_data_121,
 					test_terminal_response_encoding);
-	g_test_add_data_func("/teststk/Get Channel status response 1.3.1",
+	add_response_test("/teststk/Get Channel status response 1.3.1",
 					&get_channel_status_response_data_131,
 					test_terminal_response_encoding);
 
-	g_test_add_data_func("/teststk/SMS-PP data download 1.6.1",
+	add_envelope_test("/teststk/SMS-PP data download 1.6.1",
 			&sms_pp_data_download_data_161,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/SMS-PP data download 1.6.2",
+	add_envelope_test("/teststk/SMS-PP data download 1.6.2",
 			&sms_pp_data_download_data_162,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/SMS-PP data download 1.8.2",
+	add_envelope_test("/teststk/SMS-PP data download 1.8.2",
 			&sms_pp_data_download_data_182,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/CBS-PP data download 1.1",
+	add_envelope_test("/teststk/CBS-PP data download 1.1",
 			&cbs_pp_data_download_data_11, test_envelope_encoding);
-	g_test_add_data_func("/teststk/CBS-PP data download 1.7",
+	add_envelope_test("/teststk/CBS-PP data download 1.7",
 			&cbs_pp_data_download_data_17, test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Menu Selection 1.1.1",
+	add_envelope_test("/teststk/Menu Selection 1.1.1",
 			&menu_selection_data_111, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 1.1.2",
+	add_envelope_test("/teststk/Menu Selection 1.1.2",
 			&menu_selection_data_112, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 1.2.1",
+	add_envelope_test("/teststk/Menu Selection 1.2.1",
 			&menu_selection_data_121, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 1.2.2",
+	add_envelope_test("/teststk/Menu Selection 1.2.2",
 			&menu_selection_data_122, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 1.2.3",
+	add_envelope_test("/teststk/Menu Selection 1.2.3",
 			&menu_selection_data_123, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 2.1.1",
+	add_envelope_test("/teststk/Menu Selection 2.1.1",
 			&menu_selection_data_211, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 6.1.2",
+	add_envelope_test("/teststk/Menu Selection 6.1.2",
 			&menu_selection_data_612, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Menu Selection 6.4.1",
+	add_envelope_test("/teststk/Menu Selection 6.4.1",
 			&menu_selection_data_641, test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Call Control 1.1.1A",
+	add_envelope_test("/teststk/Call Control 1.1.1A",
 			&call_control_data_111a, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Call Control 1.1.1B",
+	add_envelope_test("/teststk/Call Control 1.1.1B",
 			&call_control_data_111b, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Call Control 1.3.1A",
+	add_envelope_test("/teststk/Call Control 1.3.1A",
 			&call_control_data_131a, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Call Control 1.3.1B",
+	add_envelope_test("/teststk/Call Control 1.3.1B",
 			&call_control_data_131b, test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/MO Short Message Control 1.1.1A",
+	add_envelope_test("/teststk/MO Short Message Control 1.1.1A",
 			&mo_short_message_control_data_111a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/MO Short Message Control 1.1.1B",
+	add_envelope_test("/teststk/MO Short Message Control 1.1.1B",
 			&mo_short_message_control_data_111b,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: MT Call 1.1.1",
+	add_envelope_test("/teststk/Event: MT Call 1.1.1",
 			&event_download_mt_call_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: MT Call 1.1.2",
+	add_envelope_test("/teststk/Event: MT Call 1.1.2",
 			&event_download_mt_call_data_112,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Call Connected 1.1.1",
+	add_envelope_test("/teststk/Event: Call Connected 1.1.1",
 			&event_download_call_connected_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Connected 1.1.2",
+	add_envelope_test("/teststk/Event: Call Connected 1.1.2",
 			&event_download_call_connected_data_112,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.1",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.1",
 			&event_download_call_disconnected_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.2A",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.2A",
 			&event_download_call_disconnected_data_112a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.2B",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.2B",
 			&event_download_call_disconnected_data_112b,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.2C",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.2C",
 			&event_download_call_disconnected_data_112c,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.3A",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.3A",
 			&event_download_call_disconnected_data_113a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.3B",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.3B",
 			&event_download_call_disconnected_data_113b,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.4A",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.4A",
 			&event_download_call_disconnected_data_114a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Call Disconnected 1.1.4B",
+	add_envelope_test("/teststk/Event: Call Disconnected 1.1.4B",
 			&event_download_call_disconnected_data_114b,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Location Status 1.1.1",
+	add_envelope_test("/teststk/Event: Location Status 1.1.1",
 			&event_download_location_status_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Location Status 1.1.2A",
+	add_envelope_test("/teststk/Event: Location Status 1.1.2A",
 			&event_download_location_status_data_112a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Location Status 1.1.2B",
+	add_envelope_test("/teststk/Event: Location Status 1.1.2B",
 			&event_download_location_status_data_112b,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Location Status 1.2.2",
+	add_envelope_test("/teststk/Event: Location Status 1.2.2",
 			&event_download_location_status_data_122,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: User Activity 1.1.1",
+	add_envelope_test("/teststk/Event: User Activity 1.1.1",
 			&event_download_user_activity_data_111,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Idle Screen Available 1.1.1",
+	add_envelope_test("/teststk/Event: Idle Screen Available 1.1.1",
 			&event_download_idle_screen_available_data_111,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.1A",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.1A",
 			&event_download_card_reader_status_data_111a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.1B",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.1B",
 			&event_download_card_reader_status_data_111b,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.1C",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.1C",
 			&event_download_card_reader_status_data_111c,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.1D",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.1D",
 			&event_download_card_reader_status_data_111d,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.2A",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.2A",
 			&event_download_card_reader_status_data_112a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.2B",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.2B",
 			&event_download_card_reader_status_data_112b,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.2C",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.2C",
 			&event_download_card_reader_status_data_112c,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 1.1.2D",
+	add_envelope_test("/teststk/Event: Card Reader Status 1.1.2D",
 			&event_download_card_reader_status_data_112d,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 2.1.2A",
+	add_envelope_test("/teststk/Event: Card Reader Status 2.1.2A",
 			&event_download_card_reader_status_data_212a,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Card Reader Status 2.1.2B",
+	add_envelope_test("/teststk/Event: Card Reader Status 2.1.2B",
 			&event_download_card_reader_status_data_212b,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Language Selection 1.1.1",
+	add_envelope_test("/teststk/Event: Language Selection 1.1.1",
 			&event_download_language_selection_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Language Selection 1.2.2",
+	add_envelope_test("/teststk/Event: Language Selection 1.2.2",
 			&event_download_language_selection_data_122,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Browser Termination 1.1.1",
+	add_envelope_test("/teststk/Event: Browser Termination 1.1.1",
 			&event_download_browser_termination_data_111,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Data Available 1.1.1",
+	add_envelope_test("/teststk/Event: Data Available 1.1.1",
 			&event_download_data_available_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Data Available 2.1.1",
+	add_envelope_test("/teststk/Event: Data Available 2.1.1",
 			&event_download_data_available_data_211,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Channel Status 1.3.1",
+	add_envelope_test("/teststk/Event: Channel Status 1.3.1",
 			&event_download_channel_status_data_131,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Channel Status 2.1.1",
+	add_envelope_test("/teststk/Event: Channel Status 2.1.1",
 			&event_download_channel_status_data_211,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Channel Status 2.2.1",
+	add_envelope_test("/teststk/Event: Channel Status 2.2.1",
 			&event_download_channel_status_data_221,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Event: Network Rejection 1.1.1",
+	add_envelope_test("/teststk/Event: Network Rejection 1.1.1",
 			&event_download_network_rejection_data_111,
 			test_envelope_encoding);
-	g_test_add_data_func("/teststk/Event: Network Rejection 1.2.1",
+	add_envelope_test("/teststk/Event: Network Rejection 1.2.1",
 			&event_download_network_rejection_data_121,
 			test_envelope_encoding);
 
-	g_test_add_data_func("/teststk/Timer Expiration 2.1.1",
+	add_envelope_test("/teststk/Timer Expiration 2.1.1",
 			&timer_expiration_data_211, test_envelope_encoding);
-	g_test_add_data_func("/teststk/Timer Expiration 2.2.1A",
+	add_envelope_test("/teststk/Timer Expiration 2.2.1A",
 			&timer_expiration_data_221a, test_envelope_encoding);
 
 	g_test_add_data_func("/teststk/HTML Attribute Test 1",
@@ -24362,6 +24603,26 @@ int main(int argc, char **argv)
 				&xpm_test_5, test_img_to_xpm);
 	g_test_add_data_func("/teststk/IMG to XPM Test 6",
 				&xpm_test_6, test_img_to_xpm);
+	g_test_add_data_func("/teststk/IMG serialize Test 1",
+				&xpm_test_1, test_img_serialize);
+	g_test_add_data_func("/teststk/IMG serialize Test 2",
+				&xpm_test_2, test_img_serialize);
+	g_test_add_data_func("/teststk/IMG serialize Test 3",
+				&xpm_test_3, test_img_serialize);
+	g_test_add_data_func("/teststk/IMG serialize Test 4",
+				&xpm_test_4, test_img_serialize);
+	g_test_add_data_func("/teststk/IMG serialize Test 5",
+				&xpm_test_5, test_img_serialize);
+	g_test_add_data_func("/teststk/IMG serialize Test 6",
+				&xpm_test_6, test_img_serialize);
+
+	g_test_add_func("/teststk/Fuzz corpus", test_fuzz_corpus);
+
+	if (g_test_perf()) {
+		g_test_add_func("/teststk/perf/Parse", test_parse_perf);
+		g_test_add_func("/teststk/perf/Response", test_response_perf);
+		g_test_add_func("/teststk/perf/Envelope", test_envelope_perf);
+	}
 
 	return g_test_run();
 }
@@ -0,0 +1,298 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gatsyntax.h"
+
+struct syntax_event {
+	GAtSyntaxResult result;
+	gsize offset;
+};
+
+static const char *cmgl_prefix = "+CMGL:";
+
+static GString *build_cmgl(unsigned int count)
+{
+	GString *str = g_string_sized_new(count * 200);
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		g_string_append_printf(str, "\r\n+CMGL: %u,1,,159\r\n", i + 1);
+		g_string_append(str, "07911326040000F0040B911346610089F6"
+					"0000208062917314080CC8F71D14969741"
+					"F977FD07A3C3EAF41C442F9FC37D104ECB"
+					"D3F9E8ECA3C3E832E8FCBEB3E1645A3\r\n");
+	}
+
+	g_string_append(str, "\r\nOK\r\n");
+
+	return str;
+}
+
+static GString *build_cops(unsigned int count)
+{
+	GString *str = g_string_sized_new(count * 40);
+	unsigned int i;
+
+	g_string_append(str, "\r\n+COPS: ");
+
+	for (i = 0; i < count; i++)
+		g_string_append_printf(str, "%s(2,\"Operator %u\",\"Op%u\","
+					"\"%05u\",7)", i ? "," : "",
+					i, i, 20000 + i);
+
+	g_string_append(str, ",,(0-4),(0-2)\r\n\r\nOK\r\n");
+
+	return str;
+}
+
+static GString *build_cpbr(unsigned int count)
+{
+	GString *str = g_string_sized_new(count * 50);
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		g_string_append_printf(str, "\r\n+CPBR: %u,\"+1555%07u\",145,"
+					"\"Contact, number %u\"\r\n",
+					i + 1, i, i);
+
+	g_string_append(str, "\r\nOK\r\n");
+
+	return str;
+}
+
+/*
+ * Feed the data in blocks of at most chunk bytes, the same way GAtChat
+ * does, and collect the results together with the offset they were
+ * reported at.
+ */
+static GArray *feed_data(GAtSyntax *syntax, const char *data, gsize len,
+				gsize chunk)
+{
+	GArray *events = g_array_new(FALSE, FALSE,
+					sizeof(struct syntax_event));
+	gsize line_start = 0;
+	gsize offset = 0;
+
+	while (offset < len) {
+		gsize rbytes = MIN(chunk, len - offset);
+		struct syntax_event event;
+
+		event.result = syntax->feed(syntax, data + offset, &rbytes);
+		offset += rbytes;
+
+		if (event.result == G_AT_SYNTAX_RESULT_UNSURE)
+			continue;
+
+		event.offset = offset;
+		g_array_append_val(events, event);
+
+		/* Mimic GAtChat asking for the PDU following a listing */
+		if (event.result == G_AT_SYNTAX_RESULT_LINE &&
+				g_strstr_len(data + line_start,
+						offset - line_start,
+						cmgl_prefix) &&
+				syntax->set_hint)
+			syntax->set_hint(syntax, G_AT_SYNTAX_EXPECT_PDU);
+
+		line_start = offset;
+	}
+
+	return events;
+}
+
+static void check_events(GArray *a, GArray *b)
+{
+	unsigned int i;
+
+	g_assert_cmpuint(a->len, ==, b->len);
+
+	for (i = 0; i < a->len; i++) {
+		struct syntax_event *ea = &g_array_index(a, struct syntax_event,
+								i);
+		struct syntax_event *eb = &g_array_index(b, struct syntax_event,
+								i);
+
+		g_assert_cmpint(ea->result, ==, eb->result);
+		g_assert_cmpuint(ea->offset, ==, eb->offset);
+	}
+}
+
+static unsigned int count_results(GArray *events, GAtSyntaxResult result)
+{
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (i = 0; i < events->len; i++)
+		if (g_array_index(events, struct syntax_event, i).result ==
+				result)
+			count += 1;
+
+	return count;
+}
+
+typedef GAtSyntax *(*syntax_new_func)(void);
+
+struct syntax_test {
+	syntax_new_func syntax_new;
+	GString *(*build)(unsigned int count);
+	unsigned int count;
+	unsigned int lines;
+	unsigned int pdus;
+};
+
+static void test_feed(gconstpointer data)
+{
+	const struct syntax_test *test = data;
+	static const gsize chunks[] = { 1, 2, 7, 64, 1023, 8192 };
+	GString *str = test->build(test->count);
+	GAtSyntax *syntax;
+	GArray *reference;
+	unsigned int i;
+
+	/* Fed byte by byte, the scan fast path never gets to skip ahead */
+	syntax = test->syntax_new();
+	reference = feed_data(syntax, str->str, str->len, 1);
+	g_at_syntax_unref(syntax);
+
+	g_assert_cmpuint(count_results(reference, G_AT_SYNTAX_RESULT_PDU),
+				==, test->pdus);
+	g_assert_cmpuint(count_results(reference, G_AT_SYNTAX_RESULT_LINE) +
+			count_results(reference,
+					G_AT_SYNTAX_RESULT_MULTILINE),
+				==, test->lines);
+
+	for (i = 1; i < G_N_ELEMENTS(chunks); i++) {
+		GArray *events;
+
+		syntax = test->syntax_new();
+		events = feed_data(syntax, str->str, str->len, chunks[i]);
+		g_at_syntax_unref(syntax);
+
+		check_events(reference, events);
+		g_array_free(events, TRUE);
+	}
+
+	g_array_free(reference, TRUE);
+	g_string_free(str, TRUE);
+}
+
+static const struct syntax_test gsmv1_cmgl_test = {
+	.syntax_new = g_at_syntax_new_gsmv1,
+	.build = build_cmgl,
+	.count = 300,
+	.lines = 301,
+	.pdus = 300,
+};
+
+static const struct syntax_test permissive_cmgl_test = {
+	.syntax_new = g_at_syntax_new_gsm_permissive,
+	.build = build_cmgl,
+	.count = 300,
+	.lines = 301,
+	.pdus = 300,
+};
+
+static const struct syntax_test gsmv1_cops_test = {
+	.syntax_new = g_at_syntax_new_gsmv1,
+	.build = build_cops,
+	.count = 200,
+	.lines = 2,
+};
+
+static const struct syntax_test permissive_cops_test = {
+	.syntax_new = g_at_syntax_new_gsm_permissive,
+	.build = build_cops,
+	.count = 200,
+	.lines = 2,
+};
+
+static const struct syntax_test gsmv1_cpbr_test = {
+	.syntax_new = g_at_syntax_new_gsmv1,
+	.build = build_cpbr,
+	.count = 500,
+	.lines = 501,
+};
+
+static const struct syntax_test permissive_cpbr_test = {
+	.syntax_new = g_at_syntax_new_gsm_permissive,
+	.build = build_cpbr,
+	.count = 500,
+	.lines = 501,
+};
+
+static double measure(syntax_new_func syntax_new, GString *str, gsize chunk)
+{
+	unsigned int rounds = 0;
+	double elapsed;
+
+	g_test_timer_start();
+
+	do {
+		GAtSyntax *syntax = syntax_new();
+
+		g_array_free(feed_data(syntax, str->str, str->len, chunk),
+				TRUE);
+		g_at_syntax_unref(syntax);
+		rounds += 1;
+
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	return str->len * rounds / elapsed;
+}
+
+static void test_feed_perf(gconstpointer data)
+{
+	const struct syntax_test *test = data;
+	GString *str = test->build(test->count);
+	double bytewise = measure(test->syntax_new, str, 1);
+	double block = measure(test->syntax_new, str, 8192);
+
+	g_test_message("bytewise %.1f MB/s, block %.1f MB/s (%.1fx)",
+			bytewise / 1e6, block / 1e6, block / bytewise);
+	g_test_maximized_result(block, "block feed %.1f MB/s", block / 1e6);
+
+	g_string_free(str, TRUE);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/testsyntax/gsmv1 CMGL", &gsmv1_cmgl_test,
+				test_feed);
+	g_test_add_data_func("/testsyntax/permissive CMGL",
+				&permissive_cmgl_test, test_feed);
+	g_test_add_data_func("/testsyntax/gsmv1 COPS", &gsmv1_cops_test,
+				test_feed);
+	g_test_add_data_func("/testsyntax/permissive COPS",
+				&permissive_cops_test, test_feed);
+	g_test_add_data_func("/testsyntax/gsmv1 CPBR", &gsmv1_cpbr_test,
+				test_feed);
+	g_test_add_data_func("/testsyntax/permissive CPBR",
+				&permissive_cpbr_test, test_feed);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testsyntax/perf/gsmv1 CMGL",
+					&gsmv1_cmgl_test, test_feed_perf);
+		g_test_add_data_func("/testsyntax/perf/permissive CMGL",
+					&permissive_cmgl_test, test_feed_perf);
+		g_test_add_data_func("/testsyntax/perf/gsmv1 COPS",
+					&gsmv1_cops_test, test_feed_perf);
+		g_test_add_data_func("/testsyntax/perf/permissive CPBR",
+					&permissive_cpbr_test, test_feed_perf);
+	}
+
+	return g_test_run();
+}
@@ -927,6 +927,42 @@ static void test_sim(void)
 	l_free(utf8);
 }
 
+static void test_sim_own_buf(void)
+{
+	char buf[8];
+
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_7bit, sizeof(sim_7bit),
+							NULL, 0), ==, 5);
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_7bit, sizeof(sim_7bit),
+						buf, sizeof(buf)), ==, 5);
+	g_assert_cmpstr(buf, ==, "oFono");
+
+	/* Whole characters only, and always terminated */
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_7bit, sizeof(sim_7bit),
+							buf, 3), ==, 5);
+	g_assert_cmpstr(buf, ==, "oF");
+
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_80_2, sizeof(sim_80_2),
+						buf, sizeof(buf)), ==, 3);
+	g_assert_cmpstr(buf, ==, "ono");
+
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_81_1, sizeof(sim_81_1),
+						buf, sizeof(buf)), ==, 3);
+	g_assert_cmpstr(buf, ==, "ono");
+
+	/* Three characters of two bytes do not fit in 6 */
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_81_2, sizeof(sim_81_2),
+							buf, 6), ==, 8);
+	g_assert_cmpuint(strlen(buf), ==, 4);
+
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_82_2, sizeof(sim_82_2),
+						buf, sizeof(buf)), ==, -1);
+	g_assert_cmpint(sim_string_to_utf8_own_buf(sim_7bit_empty,
+						sizeof(sim_7bit_empty),
+						buf, sizeof(buf)), ==, 0);
+	g_assert_cmpstr(buf, ==, "");
+}
+
 static void test_unicode_to_gsm(void)
 {
 	long nwritten;
@@ -986,6 +1022,421 @@ static void test_unicode_to_gsm(void)
 	}
 }
 
+/*
+ * The septet at a time implementations the group at a time ones in util.c
+ * are checked against
+ */
+static unsigned char *ref_unpack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long max_to_unpack, long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	unsigned char rest = 0;
+	unsigned char *out = buf;
+	int bits = 7 - (byte_offset % 7);
+	long i;
+
+	if (len <= 0)
+		return NULL;
+
+	/* In the case of CB, unpack as much as possible */
+	if (ussd)
+		max_to_unpack = len * 8 / 7;
+
+	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		/* Grab what we have in the current octet */
+		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
+
+		/* Append what we have from the previous octet, if any */
+		*out |= rest;
+
+		/* Figure out the remainder */
+		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+
+		/*
+		 * We have the entire character, here we don't increate
+		 * out if this is we started at an offset.  Instead
+		 * we effectively populate variable rest
+		 */
+		if (i != 0 || bits == 7)
+			out++;
+
+		if ((out-buf) == max_to_unpack)
+			break;
+
+		/*
+		 * We expected only 1 bit from this octet, means there's 7
+		 * left, take care of them here
+		 */
+		if (bits == 1) {
+			*out = rest;
+			out++;
+			bits = 7;
+			rest = 0;
+		} else {
+			bits = bits - 1;
+		}
+	}
+
+	/*
+	 * According to 23.038 6.1.2.3.1, last paragraph:
+	 * "If the total number of characters to be sent equals (8n-1)
+	 * where n=1,2,3 etc. then there are 7 spare bits at the end
+	 * of the message. To avoid the situation where the receiving
+	 * entity confuses 7 binary zero pad bits as the @ character,
+	 * the carriage return or <CR> character shall be used for
+	 * padding in this situation, just as for Cell Broadcast."
+	 *
+	 * "The receiving entity shall remove the final <CR> character where
+	 * the message ends on an octet boundary with <CR> as the last
+	 * character.
+	 */
+	if (ussd && (((out - buf) % 8) == 0) && (*(out - 1) == '\r'))
+		out = out - 1;
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static unsigned char *ref_pack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	int bits = 7 - (byte_offset % 7);
+	unsigned char *out = buf;
+	long i;
+	long total_bits;
+
+	if (len == 0)
+		return NULL;
+
+	if (len < 0) {
+		i = 0;
+
+		while (in[i] != terminator)
+			i++;
+
+		len = i;
+	}
+
+	total_bits = len * 7;
+
+	if (bits != 7) {
+		total_bits += bits;
+		bits = bits - 1;
+		*out = 0;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (bits != 7) {
+			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
+					(bits + 1);
+			out++;
+		}
+
+		/* This is a no op when bits == 0, lets keep valgrind happy */
+		if (bits != 0)
+			*out = in[i] >> (7 - bits);
+
+		if (bits == 0)
+			bits = 7;
+		else
+			bits = bits - 1;
+	}
+
+	/*
+	 * If <CR> is intended to be the last character and the message
+	 * (including the wanted <CR>) ends on an octet boundary, then
+	 * another <CR> must be added together with a padding bit 0. The
+	 * receiving entity will perform the carriage return function twice,
+	 * but this will not result in misoperation as the definition of
+	 * <CR> in clause 6.1.1 is identical to the definition of <CR><CR>.
+	 */
+	if (ussd && ((total_bits % 8) == 1))
+		*out |= '\r' << 1;
+
+	if (bits != 7)
+		out++;
+
+	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
+		*out = '\r';
+		out++;
+	}
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static void fill_septets(unsigned char *buf, long len, unsigned int seed,
+				unsigned char mask)
+{
+	long i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (seed >> 16) & mask;
+	}
+}
+
+static void test_7bit_cross_check(void)
+{
+	unsigned char septets[200];
+	unsigned char packed[200];
+	unsigned char ref_packed[200];
+	unsigned char unpacked[240];
+	unsigned char ref_unpacked[240];
+	long len, max, size, ref_size;
+	unsigned int round;
+	int offset, ussd;
+
+	/* Every length, offset and USSD mode, with and without a final CR */
+	for (round = 0; round < 180 * 7 * 2 * 2; round++) {
+		len = round / 28 + 1;
+		offset = round / 4 % 7;
+		ussd = round / 2 % 2;
+
+		/* Garbage in the top bit has to come out the same too */
+		fill_septets(septets, len, round, len % 3 ? 0x7f : 0xff);
+
+		if (round % 2)
+			septets[len - 1] = '\r';
+
+		memset(packed, 0x55, sizeof(packed));
+		memset(ref_packed, 0x55, sizeof(ref_packed));
+
+		g_assert(pack_7bit_own_buf(septets, len, offset, ussd, &size,
+						0, packed));
+		g_assert(ref_pack_7bit(septets, len, offset, ussd, &ref_size,
+						0, ref_packed));
+		g_assert_cmpint(size, ==, ref_size);
+		g_assert(!memcmp(packed, ref_packed, sizeof(packed)));
+
+		for (max = len - 2; max <= len + 1; max++) {
+			long n, ref_n;
+
+			memset(unpacked, 0x55, sizeof(unpacked));
+			memset(ref_unpacked, 0x55, sizeof(ref_unpacked));
+
+			g_assert(unpack_7bit_own_buf(packed, size, offset,
+							ussd, max, &n, 0xff,
+							unpacked));
+			g_assert(ref_unpack_7bit(packed, size, offset, ussd,
+							max, &ref_n, 0xff,
+							ref_unpacked));
+			g_assert_cmpint(n, ==, ref_n);
+			g_assert(!memcmp(unpacked, ref_unpacked,
+						sizeof(unpacked)));
+		}
+	}
+}
+
+static void test_7bit_perf(void)
+{
+	unsigned char septets[160];
+	unsigned char packed[140];
+	unsigned char unpacked[160];
+	unsigned int rounds;
+	double elapsed, pack, ref_pack, unpack, ref_unpack;
+	long size;
+
+	fill_septets(septets, sizeof(septets), 1, 0x7f);
+
+	rounds = 0;
+	g_test_timer_start();
+
+	do {
+		ref_pack_7bit(septets, sizeof(septets), 0, false, &size, 0,
+				packed);
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	ref_pack = sizeof(septets) * rounds / elapsed;
+	rounds = 0;
+	g_test_timer_start();
+
+	do {
+		pack_7bit_own_buf(septets, sizeof(septets), 0, false, &size, 0,
+					packed);
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	pack = sizeof(septets) * rounds / elapsed;
+	rounds = 0;
+	g_test_timer_start();
+
+	do {
+		ref_unpack_7bit(packed, size, 0, false, sizeof(unpacked),
+				NULL, 0, unpacked);
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	ref_unpack = sizeof(unpacked) * rounds / elapsed;
+	rounds = 0;
+	g_test_timer_start();
+
+	do {
+		unpack_7bit_own_buf(packed, size, 0, false, sizeof(unpacked),
+					NULL, 0, unpacked);
+		rounds += 1;
+		elapsed = g_test_timer_elapsed();
+	} while (elapsed < 0.5);
+
+	unpack = sizeof(unpacked) * rounds / elapsed;
+
+	g_test_message("pack %.1f Mseptets/s, septetwise %.1f (%.1fx)",
+			pack / 1e6, ref_pack / 1e6, pack / ref_pack);
+	g_test_message("unpack %.1f Mseptets/s, septetwise %.1f (%.1fx)",
+			unpack / 1e6, ref_unpack / 1e6, unpack / ref_unpack);
+}
+
+static void test_hex(void)
+{
+	unsigned char all[256];
+	char hex[513];
+	unsigned char buf[257];
+	long len;
+	int i;
+
+	for (i = 0; i < 256; i++)
+		all[i] = i;
+
+	encode_hex_own_buf(all, sizeof(all), 0, hex);
+	g_assert(!strncmp(hex, "000102", 6));
+	g_assert(!strcmp(hex + 500, "FAFBFCFDFEFF"));
+
+	g_assert(decode_hex_own_buf(hex, -1, &len, 0, buf));
+	g_assert_cmpint(len, ==, 256);
+	g_assert(!memcmp(buf, all, sizeof(all)));
+
+	g_assert(decode_hex_own_buf("a0fFBc", -1, &len, 0xff, buf));
+	g_assert_cmpint(len, ==, 3);
+	g_assert(!memcmp(buf, "\xa0\xff\xbc\xff", 4));
+
+	/* A trailing odd digit is ignored */
+	g_assert(decode_hex_own_buf("123", -1, &len, 0, buf));
+	g_assert_cmpint(len, ==, 1);
+
+	g_assert(!decode_hex_own_buf("12G4", -1, &len, 0, buf));
+	g_assert(!decode_hex_own_buf("1 ", -1, &len, 0, buf));
+	g_assert(!decode_hex_own_buf("\xb1\xb2", -1, &len, 0, buf));
+}
+
+static void test_utf8_to_gsm_own_buf(void)
+{
+	const char *text = "a[\xc3\xa9]";
+	unsigned char buf[8];
+	unsigned char *ref;
+	long ref_len;
+	long written;
+	long len;
+
+	ref = convert_utf8_to_gsm(text, -1, NULL, &ref_len, 0);
+	g_assert(ref);
+
+	len = convert_utf8_to_gsm_own_buf(text, -1, &written,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						buf, sizeof(buf));
+	g_assert_cmpint(len, ==, ref_len);
+	g_assert_cmpint(written, ==, len);
+	g_assert(!memcmp(buf, ref, len));
+
+	/* An escaped character is never split */
+	len = convert_utf8_to_gsm_own_buf(text, -1, &written,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT, buf, 2);
+	g_assert_cmpint(len, ==, ref_len);
+	g_assert_cmpint(written, ==, 1);
+
+	len = convert_utf8_to_gsm_own_buf(text, 1, &written,
+						GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT, NULL, 0);
+	g_assert_cmpint(len, ==, 1);
+	g_assert_cmpint(written, ==, 0);
+
+	g_assert_cmpint(convert_utf8_to_gsm_own_buf("\xe2\x82\xac\xe4\xb8\xad",
+						-1, NULL, GSM_DIALECT_DEFAULT,
+						GSM_DIALECT_DEFAULT,
+						buf, sizeof(buf)), ==, -1);
+
+	l_free(ref);
+}
+
+struct best_lang_test {
+	const char *text;
+	enum gsm_dialect hint;
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	long written;
+};
+
+static const struct best_lang_test best_lang_tests[] = {
+	{ "Hello", GSM_DIALECT_TURKISH,
+		GSM_DIALECT_DEFAULT, GSM_DIALECT_DEFAULT, 5 },
+	/* One escape is cheaper than the locking shift IE */
+	{ "\xc5\x9f", GSM_DIALECT_TURKISH,
+		GSM_DIALECT_DEFAULT, GSM_DIALECT_TURKISH, 2 },
+	/* Enough escapes pay for it */
+	{ "\xc5\x9f\xc5\x9f\xc5\x9f\xc5\x9f\xc5\x9f"
+		"\xc5\x9f\xc5\x9f\xc5\x9f\xc5\x9f\xc5\x9f",
+		GSM_DIALECT_TURKISH,
+		GSM_DIALECT_TURKISH, GSM_DIALECT_TURKISH, 10 },
+	/* Spanish has no locking shift table of its own */
+	{ "\xc3\xa1\xc3\xa1\xc3\xa1\xc3\xa1\xc3\xa1"
+		"\xc3\xa1\xc3\xa1\xc3\xa1\xc3\xa1\xc3\xa1",
+		GSM_DIALECT_SPANISH,
+		GSM_DIALECT_DEFAULT, GSM_DIALECT_SPANISH, 20 },
+};
+
+static void test_utf8_to_gsm_best_lang(void)
+{
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	unsigned char *gsm;
+	char *back;
+	long written;
+	unsigned int i;
+
+	for (i = 0; i < L_ARRAY_SIZE(best_lang_tests); i++) {
+		const struct best_lang_test *test = &best_lang_tests[i];
+
+		gsm = convert_utf8_to_gsm_best_lang(test->text, -1, NULL,
+							&written, 0, test->hint,
+							&locking, &single);
+		g_assert(gsm);
+		g_assert_cmpint(locking, ==, test->locking);
+		g_assert_cmpint(single, ==, test->single);
+		g_assert_cmpint(written, ==, test->written);
+
+		back = convert_gsm_to_utf8_with_lang(gsm, written, NULL, NULL,
+							0, locking, single);
+		g_assert_cmpstr(back, ==, test->text);
+
+		l_free(back);
+		l_free(gsm);
+	}
+
+	g_assert(!convert_utf8_to_gsm_best_lang("\xc5\x9f", -1, NULL, NULL, 0,
+						GSM_DIALECT_DEFAULT,
+						NULL, NULL));
+	g_assert(!convert_utf8_to_gsm_best_lang("a\xe4\xb8\xad", -1, NULL,
+						NULL, 0, GSM_DIALECT_TURKISH,
+						NULL, NULL));
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -1000,8 +1451,19 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SMS Handling", test_sms_handling);
 	g_test_add_func("/testutil/Offset Handling", test_offset_handling);
 	g_test_add_func("/testutil/SIM conversions", test_sim);
+	g_test_add_func("/testutil/SIM conversions own buffer",
+			test_sim_own_buf);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);
+	g_test_add_func("/testutil/7bit Cross Check", test_7bit_cross_check);
+	g_test_add_func("/testutil/Hex", test_hex);
+	g_test_add_func("/testutil/UTF8 to GSM own buffer",
+			test_utf8_to_gsm_own_buf);
+	g_test_add_func("/testutil/UTF8 to GSM best language",
+			test_utf8_to_gsm_best_lang);
+
+	if (g_test_perf())
+		g_test_add_func("/testutil/perf/7bit", test_7bit_perf);
 
 	return g_test_run();
 }
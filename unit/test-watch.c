@@ -0,0 +1,240 @@
+/*
+ * oFono - Open Source Telephony
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "ofono.h"
+
+typedef void (*test_notify_func)(struct ofono_watchlist_item *item,
+					void *data);
+
+struct test_data {
+	struct ofono_watchlist *watchlist;
+	GString *visited;
+	unsigned int ids[8];
+	unsigned int destroyed;
+};
+
+static void test_destroy(void *data)
+{
+	struct test_data *td = data;
+
+	td->destroyed += 1;
+}
+
+static unsigned int test_add(struct test_data *td, test_notify_func notify)
+{
+	struct ofono_watchlist_item *item = g_new0(struct ofono_watchlist_item,
+							1);
+
+	item->notify = notify;
+	item->notify_data = td;
+	item->destroy = test_destroy;
+
+	return __ofono_watchlist_add_item(td->watchlist, item);
+}
+
+static void test_walk(struct test_data *td)
+{
+	struct ofono_watchlist_iter iter;
+	struct ofono_watchlist_item *item;
+
+	g_string_truncate(td->visited, 0);
+
+	__ofono_watchlist_iter_init(&iter, td->watchlist);
+
+	while ((item = __ofono_watchlist_iter_next(&iter))) {
+		test_notify_func notify = item->notify;
+
+		g_string_append_printf(td->visited, "%u ", item->id);
+		notify(item, item->notify_data);
+	}
+}
+
+static void notify_nothing(struct ofono_watchlist_item *item, void *data)
+{
+}
+
+static void notify_remove_self(struct ofono_watchlist_item *item, void *data)
+{
+	struct test_data *td = data;
+
+	g_assert(__ofono_watchlist_remove_item(td->watchlist, item->id));
+}
+
+static void notify_remove_first(struct ofono_watchlist_item *item,
+					void *data)
+{
+	struct test_data *td = data;
+
+	__ofono_watchlist_remove_item(td->watchlist, td->ids[0]);
+}
+
+static void notify_add(struct ofono_watchlist_item *item, void *data)
+{
+	struct test_data *td = data;
+
+	test_add(td, notify_nothing);
+}
+
+static void notify_free(struct ofono_watchlist_item *item, void *data)
+{
+	struct test_data *td = data;
+
+	__ofono_watchlist_free(td->watchlist);
+}
+
+static void test_setup(struct test_data *td)
+{
+	td->watchlist = __ofono_watchlist_new(g_free);
+	td->visited = g_string_new(NULL);
+	td->destroyed = 0;
+}
+
+static void test_teardown(struct test_data *td)
+{
+	if (td->watchlist)
+		__ofono_watchlist_free(td->watchlist);
+
+	g_string_free(td->visited, TRUE);
+}
+
+static void test_add_remove(void)
+{
+	struct test_data td;
+	unsigned int i;
+
+	test_setup(&td);
+
+	for (i = 0; i < 3; i++)
+		td.ids[i] = test_add(&td, notify_nothing);
+
+	g_assert_cmpuint(td.ids[0], !=, 0);
+	g_assert_cmpuint(__ofono_watchlist_count(td.watchlist), ==, 3);
+	g_assert(__ofono_watchlist_find(td.watchlist, td.ids[1]));
+
+	/* Newest first */
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "3 2 1 ");
+
+	g_assert(__ofono_watchlist_remove_item(td.watchlist, td.ids[1]));
+	g_assert(!__ofono_watchlist_remove_item(td.watchlist, td.ids[1]));
+	g_assert(!__ofono_watchlist_find(td.watchlist, td.ids[1]));
+	g_assert_cmpuint(td.destroyed, ==, 1);
+	g_assert_cmpuint(__ofono_watchlist_count(td.watchlist), ==, 2);
+
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "3 1 ");
+
+	test_teardown(&td);
+	g_assert_cmpuint(td.destroyed, ==, 3);
+}
+
+static void test_remove_during_walk(void)
+{
+	struct test_data td;
+
+	test_setup(&td);
+
+	td.ids[0] = test_add(&td, notify_nothing);
+	td.ids[1] = test_add(&td, notify_remove_self);
+	td.ids[2] = test_add(&td, notify_remove_first);
+	td.ids[3] = test_add(&td, notify_remove_self);
+
+	/* The first item is removed before its turn comes */
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "4 3 2 ");
+	g_assert_cmpuint(__ofono_watchlist_count(td.watchlist), ==, 1);
+
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "3 ");
+
+	test_teardown(&td);
+	g_assert_cmpuint(td.destroyed, ==, 4);
+}
+
+static void test_add_during_walk(void)
+{
+	struct test_data td;
+
+	test_setup(&td);
+
+	test_add(&td, notify_nothing);
+	test_add(&td, notify_add);
+
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "2 1 ");
+	g_assert_cmpuint(__ofono_watchlist_count(td.watchlist), ==, 3);
+
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "3 2 1 ");
+
+	test_teardown(&td);
+}
+
+static void test_free_during_walk(void)
+{
+	struct test_data td;
+
+	test_setup(&td);
+
+	test_add(&td, notify_nothing);
+	test_add(&td, notify_free);
+	test_add(&td, notify_nothing);
+
+	test_walk(&td);
+	g_assert_cmpstr(td.visited->str, ==, "3 2 ");
+	g_assert_cmpuint(td.destroyed, ==, 3);
+
+	td.watchlist = NULL;
+	test_teardown(&td);
+}
+
+static void test_compact(void)
+{
+	struct test_data td;
+	unsigned int ids[64];
+	unsigned int i;
+
+	test_setup(&td);
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		ids[i] = test_add(&td, notify_nothing);
+
+	/* Enough removals to compact, the rest must still be found */
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		if (i % 4)
+			g_assert(__ofono_watchlist_remove_item(td.watchlist,
+								ids[i]));
+
+	for (i = 0; i < L_ARRAY_SIZE(ids); i++)
+		g_assert(!__ofono_watchlist_find(td.watchlist, ids[i]) ==
+								!!(i % 4));
+
+	test_walk(&td);
+	g_assert_cmpuint(__ofono_watchlist_count(td.watchlist), ==, 16);
+	g_assert(g_str_has_prefix(td.visited->str, "61 57 53 "));
+
+	test_teardown(&td);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testwatch/add_remove", test_add_remove);
+	g_test_add_func("/testwatch/remove_during_walk",
+					test_remove_during_walk);
+	g_test_add_func("/testwatch/add_during_walk", test_add_during_walk);
+	g_test_add_func("/testwatch/free_during_walk", test_free_during_walk);
+	g_test_add_func("/testwatch/compact", test_compact);
+
+	return g_test_run();
+}